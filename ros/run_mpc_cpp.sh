@@ -19,6 +19,386 @@ NUM_STEPS_POLY=50
 
 DEBUG=true
 
+# Optional (private) parameters
+PERSISTENT_TAPE=false
+WARM_START=false
+# "shift" (the previous solution) or "learned" (the weights of
+# mpc_warmstart_fit in WARM_START_WEIGHTS)
+WARM_START_INITIALIZER=shift
+WARM_START_WEIGHTS=""
+# Warm start Ipopt's multipliers too (with PERSISTENT_TAPE), from a barrier
+# parameter of WARM_START_MU
+DUAL_WARM_START=false
+WARM_START_MU=0.0001
+# Start the solves without a last solution (after a fallback or a jump) from
+# the plan of the same stretch on a previous lap (with LAP_PROGRESS)
+LAP_WARM_START=false
+LAP_WARM_START_BINS=1000
+# The solver by name: ipopt, riccati, rti, mppi, sqp or another registered one;
+# "" for the one of RICCATI_SOLVER, RTI and MPPI
+BACKEND=""
+RICCATI_SOLVER=false
+FIXED_HORIZON=false
+# Needs the library built with catkin_make -DMPC_CODEGEN=ON
+CODEGEN=false
+# One tape of a step of the model, called for every step (with PERSISTENT_TAPE)
+CHECKPOINT_STAGE=false
+# Polynomial sin, cos and atan in the steps of the model, exact beyond their range (with PERSISTENT_TAPE)
+FAST_TRIG=false
+# The sparsity patterns and the last solution, kept across runs (with
+# PERSISTENT_TAPE), e.g. in ~/.ros/mpc_structure_cache; "" not to
+STRUCTURE_CACHE=""
+# Closed-form derivatives instead of the tape (with PERSISTENT_TAPE)
+ANALYTIC_DERIVATIVES=false
+# "double", "mixed" (the window of the fit, and the analytic Hessian, in float) or "float"
+PRECISION=double
+# The derivatives of the steps of the model from Eigen's AutoDiff (with ANALYTIC_DERIVATIVES)
+AUTODIFF_STAGES=false
+# L-BFGS approximation of the Hessian instead of the exact one
+LIMITED_MEMORY_HESSIAN=false
+# The Hessian of the quadratic cost evaluated once, only the constraints differentiated twice (with PERSISTENT_TAPE)
+CONSTANT_COST_HESSIAN=false
+# Chunks of the Jacobian and the Hessian evaluated in parallel, on threads of their own (with PERSISTENT_TAPE, <= 1 for none)
+PARALLEL_DERIVATIVES=0
+# Chunks of stages whose steps of the model are evaluated in parallel, out of the tape (with PERSISTENT_TAPE, <= 1 for none)
+PARALLEL_STAGES=0
+# Ipopt's linear solver ("mumps", "ma27", "ma57", ...; empty for its
+# default), or the fastest of them, timed on start
+LINEAR_SOLVER=""
+CALIBRATE_LINEAR_SOLVER=false
+# Ipopt's barrier parameter update ("monotone", "adaptive"; empty for its
+# default), and CppAD's sparsity without PERSISTENT_TAPE ("both", "forward",
+# "reverse", "none")
+MU_STRATEGY=""
+CPPAD_SPARSITY=both
+# Scale the variables, the rows and the cost of the NLP by their typical
+# magnitudes instead of Ipopt's gradient-based scaling (PERSISTENT_TAPE only)
+NLP_SCALING=false
+# Or the fastest of these and of the linear solvers and the Hessians, timed
+# on start, and kept for the next starts in the profile, if set (one per
+# board)
+CALIBRATE_IPOPT=false
+IPOPT_PROFILE=""
+# Ipopt's iterations and messages into the telemetry (it never prints)
+IPOPT_JOURNAL=false
+# The initial state as fixed variables rather than rows (persistent tape)
+FIX_INITIAL_STATE=false
+# Single shooting: optimize the actuations alone, the states rolled out
+CONDENSED=false
+# Steps per block of held actuations, e.g. [1,1,2,4,8]; [] for one per step
+INPUT_BLOCKS=[]
+# "kinematic", or "dynamic" (a dynamic bicycle with linear tyres, through the tape only)
+VEHICLE_MODEL=kinematic
+# How the kinematic model is integrated over a step: "euler", "rk2", "rk4" or
+# "exact" (accurate with a longer DT and fewer STEPS_AHEAD), through the tape only
+INTEGRATOR=euler
+# |cte| [m] and |epsi| [rad] at the end of the horizon, and the rate of the
+# steering [rad/s], at most; 0 for none
+TERMINAL_CTE=0.0
+TERMINAL_EPSI=0.0
+MAX_STEER_RATE=0.0
+# Cost of the errors at the end of the horizon from the LQR of the kinematic
+# model (to shorten the horizon), through the tape only
+TERMINAL_COST=false
+# Learning MPC: the terminal cost is about the fastest of the nearest states
+# of the previous laps (with TERMINAL_COST and LAP_PROGRESS)
+LEARNING_MPC=false
+SAFE_SET_NEIGHBORS=8
+SAFE_SET_SIZE=20000
+# Soften them with penalized slacks, so that the problem is always feasible
+SOFT_CONSTRAINTS=false
+SOFT_CONSTRAINT_WEIGHT=10000.0
+# [s] from every stage to the next, e.g. [0.05,0.05,0.1,0.1,0.2]; [] for DT
+DT_STEPS=[]
+# One controller per horizon, each used from its speed [m/s] on (one fewer),
+# e.g. [10,15,20] and [2.0,3.5]; [] for STEPS_AHEAD at any speed
+ADAPTIVE_HORIZONS=[]
+ADAPTIVE_HORIZON_SPEEDS=[]
+# Variants solved in parallel with every solve, as a fallback: with the
+# reference speed scaled by each of these, e.g. [0.8,0.6], and from scratch
+PARALLEL_REF_V_SCALES=[]
+PARALLEL_COLD_START=false
+# Alternative reference lines solved in parallel with every solve, at these
+# offsets [m] to the left of the path, e.g. [-0.4,0.4]; the commands follow
+# the cheapest, its cost plus REFERENCE_OFFSET_COST per metre of offset
+REFERENCE_OFFSETS=[]
+REFERENCE_OFFSET_COST=500.0
+REFERENCE_SWITCH_MARGIN=0.1
+# Backends to choose from before every solve, the most optimal first, e.g.
+# "ipopt,sqp,rti": the first one predicted (by the models of mpc_solvetime_fit
+# in SOLVE_TIME_MODEL) to be done before the deadline solves
+PREDICTED_BACKENDS=""
+SOLVE_TIME_MODEL=""
+# Looks the commands up in this table (made by mpc_tablegen for these same
+# parameters) where its error is within the tolerances [rad], [m/s], if set
+EXPLICIT_TABLE=""
+EXPLICIT_TABLE_STEER_TOLERANCE=0.01
+EXPLICIT_TABLE_SPEED_TOLERANCE=0.1
+# Reuses the results of the last N solves (0 not to) for the problems within
+# the tolerance of theirs
+SOLUTION_CACHE_SIZE=0
+SOLUTION_CACHE_TOLERANCE=0.001
+# Solves the next tick's problem ahead, from the pose the plan predicts, and
+# takes that solution when the pose is within the tolerances [m], [rad]
+SPECULATIVE_SOLVE=false
+SPECULATIVE_TOLERANCE=0.02
+SPECULATIVE_HEADING_TOLERANCE=0.01
+# Remote offload of the solves to mpc_solver_server ("host:port", "" not to),
+# whose results are taken within REMOTE_TIMEOUT [s] of the start of the tick
+REMOTE_SOLVER=""
+REMOTE_TIMEOUT=0.02
+# Check every plan against the corridor (by the tolerance [m]) and the
+# actuators before following it, the PID law steering instead of a bad one
+VALIDATE_PLAN=false
+VALIDATE_PLAN_TOLERANCE=0.1
+# The PID law the commands fall back on when a solve fails with no previous
+# plan (the gains of run_pid_python.sh)
+PID_KP_CTE=1.0
+PID_KI_CTE=0.0
+PID_KD_CTE=5.0
+PID_KP_EPSI=1.0
+PID_KI_EPSI=0.0
+PID_KD_EPSI=5.0
+# "mpc", or "pid" to steer by the PID law alone (see run_pid_cpp.sh)
+CONTROLLER=mpc
+RTI=false
+# At most this many solver iterations per tick, converging over the ticks (with WARM_START for Ipopt, 0 for no limit)
+ITERATIONS_PER_TICK=0
+# With RICCATI_SOLVER, up to this many ticks after a full solve only update
+# its plan to first order (0 not to), while the corrections are within the
+# tolerance [rad], [m/s]
+SENSITIVITY_UPDATES=0
+SENSITIVITY_TOLERANCE=0.02
+# The steps of RICCATI_SOLVER (or RTI) from a QP with the bounds of the
+# actuators, instead of clamping them
+ACTIVE_SET_QP=false
+# The linearizations of RTI from a table of LINEARIZATION_SPEED_BINS speeds
+# (0 not to) by LINEARIZATION_EPSI_BINS heading errors up to
+# LINEARIZATION_MAX_EPSI [rad] by LINEARIZATION_CURVATURE_BINS curvatures of
+# the path up to LINEARIZATION_MAX_CURVATURE [1/m], made at start-up
+LINEARIZATION_SPEED_BINS=0
+LINEARIZATION_EPSI_BINS=9
+LINEARIZATION_MAX_EPSI=0.5
+LINEARIZATION_CURVATURE_BINS=1
+LINEARIZATION_MAX_CURVATURE=0.5
+# Sampling-based control (MPPI) instead of the NLP: samples per solve, their
+# temperature, steering [rad] and speed [m/s] noise, and rollout threads
+MPPI=false
+MPPI_SAMPLES=1024
+MPPI_TEMPERATURE=10.0
+MPPI_STEER_NOISE=0.1
+MPPI_SPEED_NOISE=0.5
+MPPI_THREADS=1
+# [s], 0 disables the deadline
+SOLVE_DEADLINE=0
+# CPU time [s] after which Ipopt gives up on a solve, 0 for no limit but its iterations
+SOLVE_TIME_LIMIT=0.5
+# Gives up on a solve (with persistent_tape) once it diverges: from the
+# iteration DIVERGENCE_MIN_ITERATIONS on, when the infeasibility grows this many
+# times past its lowest, the step stays below DIVERGENCE_MIN_ALPHA for
+# DIVERGENCE_SMALL_STEPS iterations, or the restoration phase lasts this long (0
+# disables a test)
+ABORT_DIVERGENCE=false
+DIVERGENCE_MIN_ITERATIONS=3
+DIVERGENCE_INF_PR_GROWTH=1000
+DIVERGENCE_MIN_ALPHA=0.0001
+DIVERGENCE_SMALL_STEPS=3
+DIVERGENCE_RESTORATION_ITERATIONS=10
+# Relax Ipopt's tolerances (down to RELAXED_TOL and RELAXED_ACCEPTABLE_TOL)
+# when the time left to the deadline is short
+ADAPTIVE_TOLERANCE=false
+RELAXED_TOL=0.0001
+RELAXED_ACCEPTABLE_TOL=0.01
+# "rate" (at LOOP_RATE [Hz]) or "pose"
+SCHEDULER=rate
+LOOP_RATE=100
+# Find the highest rate (down to GOVERNOR_MIN_RATE [Hz]) at which at most
+# GOVERNOR_MISS_RATIO of the ticks miss their deadline, instead of LOOP_RATE
+RATE_GOVERNOR=false
+GOVERNOR_MIN_RATE=20
+GOVERNOR_MISS_RATIO=0.01
+# Rate [Hz] of the loop that follows the latest plan between the solves (0: off)
+TRACKING_RATE=0
+# Rate [Hz] at which the commands go out, along the latest plan, from a timer
+# of their own instead of at the end of every tick (0: off)
+ACTUATION_RATE=0
+# Prepares the next tick's problem on another thread while this one solves
+PIPELINED=false
+WINDOWED_CLOSEST=false
+# Project the car onto the segments of the window of WINDOWED_CLOSEST instead of taking the nearest waypoint
+PROJECTED_CLOSEST=false
+# Track the progress along the path instead of searching the closest waypoint
+LAP_PROGRESS=false
+SPLINE_REFERENCE=false
+# The reference of every step from the spline of the path (contouring and
+# heading errors) instead of a polynomial fit
+CONTOURING_REFERENCE=false
+INCREMENTAL_FIT=false
+PRECOMPUTED_FIT=false
+# Fit the polynomial in the pass that reads the window from the path
+FUSED_FIT=false
+# Fewer, wider-spaced points in the window of the fit on straights, and a
+# shorter window where the path winds
+ADAPTIVE_WINDOW=false
+# The window of the fit (and the corridor) from resamplings of the path, 4x
+# sparser per level: near points fine, far ones coarse (0: none)
+PYRAMID_LEVELS=0
+# Keep the waypoints in fixed point too, for the windowed closest search
+COMPACT_WAYPOINTS=false
+# Waypoints copied past both ends of the path, for contiguous windows across
+# the start line: 0 for as many as the windows need, -1 for none
+RING_MARGIN=0
+# Reuse the last fit while the car is within this distance [m] and angle [rad]
+# of where it was fit (0: always fit)
+FIT_REUSE_DISTANCE=0
+FIT_REUSE_ANGLE=0.02
+# The reference speed from a profile of the path, by its curvature and the
+# limits of the car [m/s^2], instead of from the window of the fit
+SPEED_PROFILE=false
+MAX_LATERAL_ACCEL=4.0
+MAX_ACCEL=2.0
+MAX_DECEL=4.0
+# The half width of the track about the path [m] (0.0 for no corridor), and
+# how far inside it the car's center stays [m]
+CORRIDOR_WIDTH=0.0
+CORRIDOR_MARGIN=0.15
+# How many of the obstacles on /obstacles (mpc/Obstacles) the plan keeps
+# clear of (0 for none), and by how much [m]
+MAX_OBSTACLES=0
+OBSTACLE_MARGIN=0.2
+# "marker" (/centerline), "numpy" (/centerline_numpy) or "shared" (the
+# TRACK_STORE file of track_store_node, announced on /centerline_store)
+CENTERLINE_FORMAT=marker
+TRACK_STORE=/dev/shm/mpc_track
+# separate (/commands/servo/position and /commands/motor/speed), combined (one
+# stamped mpc/Commands on /commands/combined) or both
+COMMANDS=separate
+# The commands straight to the VESC on this port too (e.g. /dev/ttyACM0,
+# with the driver's node not writing them), "" not to
+VESC_PORT=""
+# Publish the whole plan of every tick (mpc/Plan on /mpc/plan)
+PUBLISH_PLAN=false
+# Reads the path from the CSV (cached next to it) instead, if set (e.g. the
+# raceline written by mpc_raceline)
+WAYPOINTS_CSV=""
+WAYPOINTS_SPACING=0.05
+# Streams the path from the tiled route (written by mpc_route_tiles) instead,
+# if set, with the tiles behind and ahead of the car's in memory
+ROUTE_TILES=""
+ROUTE_TILES_BEHIND=1
+ROUTE_TILES_AHEAD=2
+# Takes patches of spans of the path from /centerline_patch (e.g. from a local
+# planner)
+CENTERLINE_PATCHES=false
+# Prepares the new paths on a thread of their own, swapped in with the next
+# pose
+BACKGROUND_CENTERLINE=false
+# Callback queues (and spinner threads) of their own for the poses, the paths
+# and /signal/go, and the transport of the small high-rate topics ("tcp",
+# "tcp_nodelay", "udp")
+CALLBACK_QUEUES=false
+POSE_TRANSPORT=tcp
+# Sends the neutral commands on an emergency stop right from /signal/go's
+# callback, and cancels the solve in flight
+PRIORITY_STOP=false
+# Stops along a braking trajectory kept ready from the latest plan, at this
+# deceleration [m/s^2], when the localization is lost or the solver fails (0:
+# off), and how old the pose may get [s]
+CONTINGENCY_DECEL=0.0
+CONTINGENCY_POSE_TIMEOUT=0.25
+# Runs the stages after the solve (commands, speculation, plan, flight record,
+# markers) as a graph of tasks, on a thread besides the solver loop's
+TASK_GRAPH=false
+# Localizes in the node (from /scan, /map, /odom and /initialpose) instead of
+# taking the pose from pf/pose/odom
+PARTICLE_FILTER=false
+PF_PARTICLES=2000
+PF_BEAMS=60
+PF_MAX_RANGE=10.0
+PF_THREADS=2
+PF_NOISE_X=0.05
+PF_NOISE_Y=0.025
+PF_NOISE_THETA=0.25
+PF_SIGMA_HIT=0.4
+# Looks the ranges up in a table cast once per map (2 B per cell and direction)
+PF_RANGE_TABLE=false
+PF_RANGE_BINS=120
+# Log one in every N ticks of each group (0 silences it)
+LOG_EVENTS_EVERY=1
+LOG_FIT_EVERY=1
+LOG_ACTUATORS_EVERY=1
+LOG_COST_EVERY=1
+LOG_TIMING_EVERY=1
+LOG_IPOPT_EVERY=1
+DEBUG_RATE=10
+# Publishes the compact debug view (/mpc/debug_cpp) instead of the markers,
+# for mpc_debug_markers to build them off-board
+DEBUG_COMPACT=false
+LATENCY_MODE=fixed
+# The pose and the speed of a tick at its start, interpolated between their
+# latest samples (or extrapolated by at most the given [s])
+ALIGN_INPUTS=false
+ALIGN_MAX_EXTRAPOLATION=0.05
+# The pose of a tick at its start, dead reckoned from the latest fix by the
+# odometry (and the IMU on imu), up to the given age [s]
+DEAD_RECKONING=false
+DEAD_RECKONING_MAX_AGE=0.5
+DEAD_RECKONING_IMU=false
+RT_CPU=-1
+RT_PRIORITY=0
+RT_LOCK_MEMORY=false
+WARMUP_SOLVES=0
+# Builds and warms up all the solvers at start-up at once, on all the cores
+PARALLEL_BUILD=false
+# Times solves at start-up against ADMISSION_BUDGET of the control period:
+# "warn", "refuse", "downgrade" (to shorter horizons down to
+# ADMISSION_MIN_STEPS, then to the backends of ADMISSION_BACKENDS), or "" not
+# to check
+ADMISSION=""
+ADMISSION_SOLVES=100
+ADMISSION_BUDGET=0.8
+ADMISSION_MIN_STEPS=8
+ADMISSION_BACKENDS=rti
+# [s], 0 disables /mpc/stats and the diagnostics
+STATS_PERIOD=1.0
+# Hardware counters of the stages on /mpc/stats (needs perf_event_paranoid <= 2)
+PERF_COUNTERS=false
+# CPU time of the stages on /mpc/stats, and per backend on the diagnostics
+CPU_TIME=false
+# Sensor of the board's power rail in sysfs ("" not to), for the energy of
+# the ticks on the diagnostics, in units of POWER_RAIL_SCALE [W] (1e-6 for
+# hwmon, 1e-3 for the INA3221 of a Jetson)
+POWER_RAIL=""
+POWER_RAIL_SCALE=1e-6
+# Sends a summary of the stats every UPLINK_PERIOD [s] to the
+# mpc_telemetry_collector at UPLINK ("host:port", "" not to), as vehicle
+# UPLINK_VEHICLE
+UPLINK=""
+UPLINK_PERIOD=5.0
+UPLINK_VEHICLE=0
+# [MiB] of CppAD's memory pool reserved at the start, and the most it holds
+# for reuse after a solve (0: none, no cap)
+CPPAD_RESERVE_MB=0.0
+CPPAD_CAP_MB=0.0
+# Dumps of the trace (on a missed deadline and on /mpc/dump_trace) go to TRACE_DIRECTORY
+TRACE=false
+TRACE_DIRECTORY=/tmp
+# What the node measures of itself from the start: off, counters, histograms
+# or trace; switched at runtime with
+#   rosservice call /mpc/set_instrumentation "level: 'trace'"
+INSTRUMENTATION=histograms
+# Every tick goes into the ring of the last FLIGHT_RECORDER_TICKS in this
+# file (the previous run's is kept as <file>.prev), for mpc_replay,
+# mpc_log_stats and mpc_audit; "" not to
+FLIGHT_RECORDER=/tmp/mpc_flight.log
+FLIGHT_RECORDER_TICKS=36000
+# The latest tick in shared memory for the local visualization tools (see
+# src/LiveView.h and scripts/live_view.py), e.g. /dev/shm/mpc_live_view
+LIVE_VIEW=""
+# [MiB] of huge pages the allocations of each tick come from (see
+# src/TickArena.h; 0: from the heap)
+TICK_ARENA_MB=0.0
+
 rosrun mpc mpc_node_cpp \
     $STEPS_AHEAD \
     $DT \
@@ -34,4 +414,204 @@ rosrun mpc mpc_node_cpp \
     $CONSEC_SPEED_COEFF \
     $POLY_DEGREE \
     $NUM_STEPS_POLY \
-    $DEBUG
+    $DEBUG \
+    _persistent_tape:=$PERSISTENT_TAPE \
+    _warm_start:=$WARM_START \
+    _warm_start_initializer:=$WARM_START_INITIALIZER \
+    _dual_warm_start:=$DUAL_WARM_START \
+    _warm_start_mu:=$WARM_START_MU \
+    _lap_warm_start:=$LAP_WARM_START \
+    _lap_warm_start_bins:=$LAP_WARM_START_BINS \
+    ${BACKEND:+_backend:=$BACKEND} \
+    _riccati_solver:=$RICCATI_SOLVER \
+    _fixed_horizon:=$FIXED_HORIZON \
+    _codegen:=$CODEGEN \
+    _checkpoint_stage:=$CHECKPOINT_STAGE \
+    _fast_trig:=$FAST_TRIG \
+    _structure_cache:=$STRUCTURE_CACHE \
+    _analytic_derivatives:=$ANALYTIC_DERIVATIVES \
+    _precision:=$PRECISION \
+    _autodiff_stages:=$AUTODIFF_STAGES \
+    _limited_memory_hessian:=$LIMITED_MEMORY_HESSIAN \
+    _constant_cost_hessian:=$CONSTANT_COST_HESSIAN \
+    _parallel_derivatives:=$PARALLEL_DERIVATIVES \
+    _parallel_stages:=$PARALLEL_STAGES \
+    _calibrate_linear_solver:=$CALIBRATE_LINEAR_SOLVER \
+    _cppad_sparsity:=$CPPAD_SPARSITY \
+    _nlp_scaling:=$NLP_SCALING \
+    _calibrate_ipopt:=$CALIBRATE_IPOPT \
+    _ipopt_journal:=$IPOPT_JOURNAL \
+    _fix_initial_state:=$FIX_INITIAL_STATE \
+    _condensed:=$CONDENSED \
+    _input_blocks:=$INPUT_BLOCKS \
+    _vehicle_model:=$VEHICLE_MODEL \
+    _integrator:=$INTEGRATOR \
+    _terminal_cte:=$TERMINAL_CTE \
+    _terminal_epsi:=$TERMINAL_EPSI \
+    _max_steer_rate:=$MAX_STEER_RATE \
+    _terminal_cost:=$TERMINAL_COST \
+    _learning_mpc:=$LEARNING_MPC \
+    _safe_set_neighbors:=$SAFE_SET_NEIGHBORS \
+    _safe_set_size:=$SAFE_SET_SIZE \
+    _soft_constraints:=$SOFT_CONSTRAINTS \
+    _soft_constraint_weight:=$SOFT_CONSTRAINT_WEIGHT \
+    _dt_steps:=$DT_STEPS \
+    _adaptive_horizons:=$ADAPTIVE_HORIZONS \
+    _adaptive_horizon_speeds:=$ADAPTIVE_HORIZON_SPEEDS \
+    _parallel_ref_v_scales:=$PARALLEL_REF_V_SCALES \
+    _parallel_cold_start:=$PARALLEL_COLD_START \
+    _reference_offsets:=$REFERENCE_OFFSETS \
+    _reference_offset_cost:=$REFERENCE_OFFSET_COST \
+    _reference_switch_margin:=$REFERENCE_SWITCH_MARGIN \
+    _explicit_table_steer_tolerance:=$EXPLICIT_TABLE_STEER_TOLERANCE \
+    _explicit_table_speed_tolerance:=$EXPLICIT_TABLE_SPEED_TOLERANCE \
+    _solution_cache_size:=$SOLUTION_CACHE_SIZE \
+    _solution_cache_tolerance:=$SOLUTION_CACHE_TOLERANCE \
+    _speculative_solve:=$SPECULATIVE_SOLVE \
+    _speculative_tolerance:=$SPECULATIVE_TOLERANCE \
+    _speculative_heading_tolerance:=$SPECULATIVE_HEADING_TOLERANCE \
+    _remote_timeout:=$REMOTE_TIMEOUT \
+    _validate_plan:=$VALIDATE_PLAN \
+    _validate_plan_tolerance:=$VALIDATE_PLAN_TOLERANCE \
+    _pid_kp_cte:=$PID_KP_CTE \
+    _pid_ki_cte:=$PID_KI_CTE \
+    _pid_kd_cte:=$PID_KD_CTE \
+    _pid_kp_epsi:=$PID_KP_EPSI \
+    _pid_ki_epsi:=$PID_KI_EPSI \
+    _pid_kd_epsi:=$PID_KD_EPSI \
+    _controller:=$CONTROLLER \
+    _rti:=$RTI \
+    _iterations_per_tick:=$ITERATIONS_PER_TICK \
+    _sensitivity_updates:=$SENSITIVITY_UPDATES \
+    _sensitivity_tolerance:=$SENSITIVITY_TOLERANCE \
+    _active_set_qp:=$ACTIVE_SET_QP \
+    _linearization_speed_bins:=$LINEARIZATION_SPEED_BINS \
+    _linearization_epsi_bins:=$LINEARIZATION_EPSI_BINS \
+    _linearization_max_epsi:=$LINEARIZATION_MAX_EPSI \
+    _linearization_curvature_bins:=$LINEARIZATION_CURVATURE_BINS \
+    _linearization_max_curvature:=$LINEARIZATION_MAX_CURVATURE \
+    _mppi:=$MPPI \
+    _mppi_samples:=$MPPI_SAMPLES \
+    _mppi_temperature:=$MPPI_TEMPERATURE \
+    _mppi_steer_noise:=$MPPI_STEER_NOISE \
+    _mppi_speed_noise:=$MPPI_SPEED_NOISE \
+    _mppi_threads:=$MPPI_THREADS \
+    _solve_deadline:=$SOLVE_DEADLINE \
+    _solve_time_limit:=$SOLVE_TIME_LIMIT \
+    _abort_divergence:=$ABORT_DIVERGENCE \
+    _divergence_min_iterations:=$DIVERGENCE_MIN_ITERATIONS \
+    _divergence_inf_pr_growth:=$DIVERGENCE_INF_PR_GROWTH \
+    _divergence_min_alpha:=$DIVERGENCE_MIN_ALPHA \
+    _divergence_small_steps:=$DIVERGENCE_SMALL_STEPS \
+    _divergence_restoration_iterations:=$DIVERGENCE_RESTORATION_ITERATIONS \
+    _adaptive_tolerance:=$ADAPTIVE_TOLERANCE \
+    _relaxed_tol:=$RELAXED_TOL \
+    _relaxed_acceptable_tol:=$RELAXED_ACCEPTABLE_TOL \
+    _scheduler:=$SCHEDULER \
+    _loop_rate:=$LOOP_RATE \
+    _rate_governor:=$RATE_GOVERNOR \
+    _governor_min_rate:=$GOVERNOR_MIN_RATE \
+    _governor_miss_ratio:=$GOVERNOR_MISS_RATIO \
+    _tracking_rate:=$TRACKING_RATE \
+    _actuation_rate:=$ACTUATION_RATE \
+    _pipelined:=$PIPELINED \
+    _windowed_closest:=$WINDOWED_CLOSEST \
+    _projected_closest:=$PROJECTED_CLOSEST \
+    _lap_progress:=$LAP_PROGRESS \
+    _spline_reference:=$SPLINE_REFERENCE \
+    _contouring_reference:=$CONTOURING_REFERENCE \
+    _incremental_fit:=$INCREMENTAL_FIT \
+    _precomputed_fit:=$PRECOMPUTED_FIT \
+    _fused_fit:=$FUSED_FIT \
+    _adaptive_window:=$ADAPTIVE_WINDOW \
+    _pyramid_levels:=$PYRAMID_LEVELS \
+    _compact_waypoints:=$COMPACT_WAYPOINTS \
+    _ring_margin:=$RING_MARGIN \
+    _fit_reuse_distance:=$FIT_REUSE_DISTANCE \
+    _fit_reuse_angle:=$FIT_REUSE_ANGLE \
+    _speed_profile:=$SPEED_PROFILE \
+    _max_lateral_accel:=$MAX_LATERAL_ACCEL \
+    _max_accel:=$MAX_ACCEL \
+    _max_decel:=$MAX_DECEL \
+    _corridor_width:=$CORRIDOR_WIDTH \
+    _corridor_margin:=$CORRIDOR_MARGIN \
+    _max_obstacles:=$MAX_OBSTACLES \
+    _obstacle_margin:=$OBSTACLE_MARGIN \
+    _centerline_format:=$CENTERLINE_FORMAT \
+    _track_store:=$TRACK_STORE \
+    _commands:=$COMMANDS \
+    ${VESC_PORT:+_vesc_port:=$VESC_PORT} \
+    _publish_plan:=$PUBLISH_PLAN \
+    _waypoints_spacing:=$WAYPOINTS_SPACING \
+    _route_tiles_behind:=$ROUTE_TILES_BEHIND \
+    _route_tiles_ahead:=$ROUTE_TILES_AHEAD \
+    _centerline_patches:=$CENTERLINE_PATCHES \
+    _background_centerline:=$BACKGROUND_CENTERLINE \
+    _callback_queues:=$CALLBACK_QUEUES \
+    _pose_transport:=$POSE_TRANSPORT \
+    _priority_stop:=$PRIORITY_STOP \
+    _contingency_decel:=$CONTINGENCY_DECEL \
+    _contingency_pose_timeout:=$CONTINGENCY_POSE_TIMEOUT \
+    _task_graph:=$TASK_GRAPH \
+    _particle_filter:=$PARTICLE_FILTER \
+    _pf_particles:=$PF_PARTICLES \
+    _pf_beams:=$PF_BEAMS \
+    _pf_max_range:=$PF_MAX_RANGE \
+    _pf_threads:=$PF_THREADS \
+    _pf_noise_x:=$PF_NOISE_X \
+    _pf_noise_y:=$PF_NOISE_Y \
+    _pf_noise_theta:=$PF_NOISE_THETA \
+    _pf_sigma_hit:=$PF_SIGMA_HIT \
+    _pf_range_table:=$PF_RANGE_TABLE \
+    _pf_range_bins:=$PF_RANGE_BINS \
+    _log_events_every:=$LOG_EVENTS_EVERY \
+    _log_fit_every:=$LOG_FIT_EVERY \
+    _log_actuators_every:=$LOG_ACTUATORS_EVERY \
+    _log_cost_every:=$LOG_COST_EVERY \
+    _log_timing_every:=$LOG_TIMING_EVERY \
+    _log_ipopt_every:=$LOG_IPOPT_EVERY \
+    _debug_rate:=$DEBUG_RATE \
+    _debug_compact:=$DEBUG_COMPACT \
+    _latency_mode:=$LATENCY_MODE \
+    _align_inputs:=$ALIGN_INPUTS \
+    _align_max_extrapolation:=$ALIGN_MAX_EXTRAPOLATION \
+    _dead_reckoning:=$DEAD_RECKONING \
+    _dead_reckoning_max_age:=$DEAD_RECKONING_MAX_AGE \
+    _dead_reckoning_imu:=$DEAD_RECKONING_IMU \
+    _rt_cpu:=$RT_CPU \
+    _rt_priority:=$RT_PRIORITY \
+    _rt_lock_memory:=$RT_LOCK_MEMORY \
+    _warmup_solves:=$WARMUP_SOLVES \
+    _parallel_build:=$PARALLEL_BUILD \
+    ${ADMISSION:+_admission:=$ADMISSION} \
+    _admission_solves:=$ADMISSION_SOLVES \
+    _admission_budget:=$ADMISSION_BUDGET \
+    _admission_min_steps:=$ADMISSION_MIN_STEPS \
+    _admission_backends:=$ADMISSION_BACKENDS \
+    _stats_period:=$STATS_PERIOD \
+    _perf_counters:=$PERF_COUNTERS \
+    _cpu_time:=$CPU_TIME \
+    ${POWER_RAIL:+_power_rail:=$POWER_RAIL} \
+    _power_rail_scale:=$POWER_RAIL_SCALE \
+    _uplink_period:=$UPLINK_PERIOD \
+    _uplink_vehicle:=$UPLINK_VEHICLE \
+    _cppad_reserve_mb:=$CPPAD_RESERVE_MB \
+    _cppad_cap_mb:=$CPPAD_CAP_MB \
+    _trace:=$TRACE \
+    _trace_directory:=$TRACE_DIRECTORY \
+    _instrumentation:=$INSTRUMENTATION \
+    _flight_recorder:=$FLIGHT_RECORDER \
+    _flight_recorder_ticks:=$FLIGHT_RECORDER_TICKS \
+    ${LIVE_VIEW:+_live_view:=$LIVE_VIEW} \
+    _tick_arena_mb:=$TICK_ARENA_MB \
+    ${WAYPOINTS_CSV:+_waypoints_csv:=$WAYPOINTS_CSV} \
+    ${ROUTE_TILES:+_route_tiles:=$ROUTE_TILES} \
+    ${EXPLICIT_TABLE:+_explicit_table:=$EXPLICIT_TABLE} \
+    ${WARM_START_WEIGHTS:+_warm_start_weights:=$WARM_START_WEIGHTS} \
+    ${REMOTE_SOLVER:+_remote_solver:=$REMOTE_SOLVER} \
+    ${UPLINK:+_uplink:=$UPLINK} \
+    ${PREDICTED_BACKENDS:+_predicted_backends:=$PREDICTED_BACKENDS} \
+    ${SOLVE_TIME_MODEL:+_solve_time_model:=$SOLVE_TIME_MODEL} \
+    ${LINEAR_SOLVER:+_linear_solver:=$LINEAR_SOLVER} \
+    ${MU_STRATEGY:+_mu_strategy:=$MU_STRATEGY} \
+    ${IPOPT_PROFILE:+_ipopt_profile:=$IPOPT_PROFILE}
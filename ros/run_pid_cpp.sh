@@ -0,0 +1,34 @@
+DEBUG=false
+
+# The gains of run_pid_python.sh
+Kp_cte=1.0
+Ki_cte=0.0
+Kd_cte=5.0
+
+Kp_ePsi=1.0
+Ki_ePsi=0.0
+Kd_ePsi=5.0
+
+POLY_DEGREE=3
+POLY_STEPS=30
+
+# [m/s]
+REF_V=4.5
+LATENCY=0.0
+LOOP_RATE=1000
+WINDOWED_CLOSEST=true
+
+rosrun mpc pid_node_cpp \
+    _debug:=$DEBUG \
+    _pid_kp_cte:=$Kp_cte \
+    _pid_ki_cte:=$Ki_cte \
+    _pid_kd_cte:=$Kd_cte \
+    _pid_kp_epsi:=$Kp_ePsi \
+    _pid_ki_epsi:=$Ki_ePsi \
+    _pid_kd_epsi:=$Kd_ePsi \
+    _poly_degree:=$POLY_DEGREE \
+    _num_steps_poly:=$POLY_STEPS \
+    _ref_v:=$REF_V \
+    _latency:=$LATENCY \
+    _loop_rate:=$LOOP_RATE \
+    _windowed_closest:=$WINDOWED_CLOSEST
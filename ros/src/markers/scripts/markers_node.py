@@ -2,8 +2,10 @@
 from __future__ import print_function
 import numpy as np
 import csv
+import os
 
 import rospy
+from std_srvs.srv import Empty, EmptyResponse
 from visualization_msgs.msg import Marker
 from geometry_msgs.msg import Point
 from rospy.numpy_msg import numpy_msg
@@ -15,15 +17,32 @@ def dist2(x1, y1, x2, y2):
 
 
 def sparse_trajectory(xs, ys, yaws, speeds, distance):
+    '''The points that are at least `distance` from the previous one kept
+    (the first one is). The next point kept is found among the following
+    ones in one vectorised step, over a window that grows until it has one'''
     assert len(xs) == len(ys) == len(yaws) == len(speeds)
+    xs = np.asarray(xs, dtype=np.float64)
+    ys = np.asarray(ys, dtype=np.float64)
     length = len(xs)
     distance2 = distance*distance
-    sparse = [(xs[0], ys[0], yaws[0], speeds[0])]
-    for i in range(length):
-        x, y, yaw, speed = xs[i], ys[i], yaws[i], speeds[i]
-        if dist2(x, y, sparse[-1][0], sparse[-1][1]) >= distance2:
-           sparse.append((x, y, yaw, speed))
-    return sparse
+    kept = [0]
+    while True:
+        last = kept[-1]
+        window = 64
+        start = last + 1
+        found = None
+        while start < length:
+            end = min(start + window, length)
+            far = dist2(xs[start:end], ys[start:end], xs[last], ys[last]) >= distance2
+            if far.any():
+                found = start + int(np.argmax(far))
+                break
+            start = end
+            window *= 2
+        if found is None:
+            break
+        kept.append(found)
+    return [(xs[i], ys[i], yaws[i], speeds[i]) for i in kept]
 # PREVIOUS VERSION:
 # def sparse_trajectory(data_zip, distance=1):
 #    distance2 = distance*distance
@@ -79,14 +98,11 @@ def get_marker(sparse):
 
 
 def get_waypoints(sparse):
-    waypoints = np.zeros((len(sparse), len(sparse[0])), dtype=np.float32)
-    for i in range(len(sparse)):
-        waypoints[i] = sparse[i]
-    return waypoints
+    return np.array(sparse, dtype=np.float32).reshape(len(sparse), -1)
 
 
-if __name__ == '__main__':
-    fname = rospy.get_param("/csv_file")
+def load_centerline(fname, distance):
+    '''The Marker and the array of waypoints of the CSV, sparsified'''
     xs = []
     ys = []
     yaws = []
@@ -99,27 +115,65 @@ if __name__ == '__main__':
            yaws.append(float(row[2]))
            speeds.append(float(row[3]))
 
-    rospy.init_node('~markers_node')
-
-    publishers = {}
-    publishers['centerline'] = rospy.Publisher('/centerline', Marker, queue_size=10)
-    publishers['centerline_numpy'] = rospy.Publisher('/centerline_numpy', numpy_msg(Floats), queue_size=10)
-
-    distance = 0.05
     sparse = sparse_trajectory(xs, ys, yaws, speeds, distance)
 
     print('fname: "{}"'.format(fname))
     print('Original trajectory length:', len(xs))
     print('  Example:', xs[0], ys[0], yaws[0], speeds[0])
-    print('Sparse trajectory (%.1fm) length:' % float(distance), len(sparse))
+    print('Sparse trajectory (%.2fm) length:' % float(distance), len(sparse))
     print('  Example:', sparse[0])
 
-    marker = get_marker(sparse)
-    waypoints_numpy = get_waypoints(sparse)
+    return get_marker(sparse), get_waypoints(sparse)
 
-    while not rospy.is_shutdown():
-       # Publish the Marker
-       publishers['centerline'].publish(marker)
-       publishers['centerline_numpy'].publish(waypoints_numpy.reshape(-1))
 
-       rospy.sleep(0.01)
+if __name__ == '__main__':
+    fname = rospy.get_param("/csv_file")
+
+    rospy.init_node('~markers_node')
+
+    # Latched: the path is published once (and again when the CSV changes,
+    # or on ~republish), and late subscribers get the last one; otherwise
+    # it's republished at ~rate
+    latched = rospy.get_param('~latched', True)
+    rate = rospy.get_param('~rate', 100.0)
+    distance = rospy.get_param('~distance', 0.05)
+
+    publishers = {}
+    publishers['centerline'] = rospy.Publisher('/centerline', Marker, queue_size=10, latch=latched)
+    publishers['centerline_numpy'] = rospy.Publisher('/centerline_numpy', numpy_msg(Floats), queue_size=10,
+                                                     latch=latched)
+
+    centerline = {'mtime': os.path.getmtime(fname)}
+    centerline['marker'], centerline['waypoints'] = load_centerline(fname, distance)
+
+    def publish():
+       publishers['centerline'].publish(centerline['marker'])
+       publishers['centerline_numpy'].publish(centerline['waypoints'].reshape(-1))
+
+    def republish_cb(request):
+       publish()
+       return EmptyResponse()
+
+    rospy.Service('~republish', Empty, republish_cb)
+
+    publish()
+    while not rospy.is_shutdown():
+       if not latched:
+           publish()
+           rospy.sleep(1.0 / rate)
+           continue
+
+       # The CSV is checked for changes once a second
+       rospy.sleep(1.0)
+       try:
+           mtime = os.path.getmtime(fname)
+       except OSError:
+           continue
+       if mtime != centerline['mtime']:
+           try:
+               centerline['marker'], centerline['waypoints'] = load_centerline(fname, distance)
+           except (IOError, ValueError, IndexError) as e:
+               rospy.logwarn('Could not reload "{}": {}'.format(fname, e))
+               continue
+           centerline['mtime'] = mtime
+           publish()
@@ -0,0 +1,21 @@
+## Gives the objects of TO_TARGET the profile that the training run recorded
+## for the same sources in the objects of FROM_TARGET (see MPC_PGO in
+## CMakeLists.txt):
+##
+##   cmake -DMPC_PGO_DIR=... -DFROM_TARGET=mpc_benchmark -DTO_TARGET=mpc_controller -P MpcPgoProfiles.cmake
+##
+## GCC names the profile of an object after its path, with the separators made
+## '#': .../CMakeFiles/mpc_benchmark.dir/src/MPC.cpp.o has
+## MPC_PGO_DIR/#...#CMakeFiles#mpc_benchmark.dir#src#MPC.cpp.gcda
+
+file(GLOB profiles "${MPC_PGO_DIR}/*#${FROM_TARGET}.dir#*.gcda")
+if(NOT profiles)
+  message(FATAL_ERROR "No profile of ${FROM_TARGET} in ${MPC_PGO_DIR}, was it built with MPC_PGO=generate?")
+endif()
+
+foreach(profile ${profiles})
+  string(REPLACE "#${FROM_TARGET}.dir#" "#${TO_TARGET}.dir#" target_profile "${profile}")
+  configure_file("${profile}" "${target_profile}" COPYONLY)
+endforeach()
+list(LENGTH profiles num_profiles)
+message(STATUS "The profiles of ${num_profiles} objects of ${FROM_TARGET} copied for ${TO_TARGET}")
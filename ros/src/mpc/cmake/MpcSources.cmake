@@ -0,0 +1,30 @@
+## The sources of the controller's core, without ROS, for the targets of this
+## package and for those of the ROS 2 component (ros2/src/mpc_ros2), which
+## builds the same core from here
+
+get_filename_component(MPC_SOURCE_DIR ${CMAKE_CURRENT_LIST_DIR}/../src ABSOLUTE)
+
+set(MPC_SOURCES
+  ${MPC_SOURCE_DIR}/MPC.cpp ${MPC_SOURCE_DIR}/MPC_NLP.cpp ${MPC_SOURCE_DIR}/IpoptJournal.cpp
+  ${MPC_SOURCE_DIR}/SolverBackend.cpp ${MPC_SOURCE_DIR}/RiccatiSolver.cpp ${MPC_SOURCE_DIR}/MPPISolver.cpp
+  ${MPC_SOURCE_DIR}/BatchRollout.cpp ${MPC_SOURCE_DIR}/AllocationCounter.cpp ${MPC_SOURCE_DIR}/CountedNew.cpp
+  ${MPC_SOURCE_DIR}/Trace.cpp ${MPC_SOURCE_DIR}/KinematicModel.cpp ${MPC_SOURCE_DIR}/ExplicitTable.cpp
+  ${MPC_SOURCE_DIR}/WarmStart.cpp ${MPC_SOURCE_DIR}/SolverStructure.cpp ${MPC_SOURCE_DIR}/SolverCalibration.cpp
+  ${MPC_SOURCE_DIR}/ActiveSetQP.cpp ${MPC_SOURCE_DIR}/ParallelDerivatives.cpp ${MPC_SOURCE_DIR}/ParallelCppAD.cpp
+  ${MPC_SOURCE_DIR}/TerminalCost.cpp ${MPC_SOURCE_DIR}/ParallelStages.cpp ${MPC_SOURCE_DIR}/SQPSolver.cpp
+  ${MPC_SOURCE_DIR}/Instrumentation.cpp)
+set(PATH_SOURCES
+  ${MPC_SOURCE_DIR}/PathTracker.cpp ${MPC_SOURCE_DIR}/SpatialGrid.cpp ${MPC_SOURCE_DIR}/PathSpline.cpp
+  ${MPC_SOURCE_DIR}/SpeedProfile.cpp ${MPC_SOURCE_DIR}/LapProgress.cpp ${MPC_SOURCE_DIR}/PathSegments.cpp
+  ${MPC_SOURCE_DIR}/SlidingPolyFit.cpp ${MPC_SOURCE_DIR}/WindowMoments.cpp ${MPC_SOURCE_DIR}/CompactTrack.cpp
+  ${MPC_SOURCE_DIR}/PaddedRing.cpp ${MPC_SOURCE_DIR}/CenterlinePyramid.cpp)
+set(PIPELINE_SOURCES
+  ${MPC_SOURCE_DIR}/ControlPipeline.cpp ${MPC_SOURCE_DIR}/MultiStartSolver.cpp ${MPC_SOURCE_DIR}/ReferenceCandidates.cpp
+  ${PATH_SOURCES}
+  ${MPC_SOURCE_DIR}/Obstacles.cpp ${MPC_SOURCE_DIR}/SolutionCache.cpp ${MPC_SOURCE_DIR}/PIDController.cpp
+  ${MPC_SOURCE_DIR}/PlanFollower.cpp ${MPC_SOURCE_DIR}/PlanValidator.cpp ${MPC_SOURCE_DIR}/RemoteSolve.cpp
+  ${MPC_SOURCE_DIR}/StateHistory.cpp ${MPC_SOURCE_DIR}/DeadReckoning.cpp ${MPC_SOURCE_DIR}/PerfCounters.cpp
+  ${MPC_SOURCE_DIR}/MemoryStats.cpp ${MPC_SOURCE_DIR}/SolveTimePredictor.cpp ${MPC_SOURCE_DIR}/ParallelBuild.cpp
+  ${MPC_SOURCE_DIR}/SampledSafeSet.cpp ${MPC_SOURCE_DIR}/LapWarmStarts.cpp)
+## The batches of independent solves of the offline tools (see BatchSolver)
+set(BATCH_SOURCES ${MPC_SOURCE_DIR}/BatchSolver.cpp)
@@ -1,15 +1,70 @@
 #!/usr/bin/env python
 from __future__ import print_function
+import hashlib
+import inspect
+import os
 import numpy as np
 from scipy.optimize import minimize
 from scipy.interpolate import splprep, splev
+from scipy.optimize import OptimizeResult
 import sympy as sym
 from sympy.tensor.array import derive_by_array
 sym.init_printing()
 
+# The interior-point backend (config.BACKEND = 'ipopt'): cyipopt, or the
+# module of its releases before 1.0
+try:
+    import cyipopt
+    _IpoptProblem = cyipopt.Problem
+except ImportError:
+    try:
+        import ipopt as cyipopt
+        _IpoptProblem = cyipopt.problem
+    except ImportError:
+        _IpoptProblem = None
+
 import config
 
 
+# Bump when the layout of the generated modules changes
+_CACHE_FORMAT = 2
+
+
+def _load_module(path):
+    """The module of the Python file at `path`, None if there's none."""
+    if not os.path.exists(path):
+        return None
+    name = os.path.splitext(os.path.basename(path))[0]
+    try:
+        import importlib.util
+        spec = importlib.util.spec_from_file_location(name, path)
+        module = importlib.util.module_from_spec(spec)
+        spec.loader.exec_module(module)
+        return module
+    except ImportError:
+        import imp
+        return imp.load_source(name, path)
+
+
+def _write_module(path, functions, constants):
+    """Writes the lambdified `functions` and the `constants` (dicts by name)
+    as a module, which is renamed into place once complete (other nodes may
+    be reading it)."""
+    directory = os.path.dirname(path)
+    if not os.path.isdir(directory):
+        os.makedirs(directory)
+    lines = ['# Generated by _mpc_controller.py, do not edit', 'import numpy', 'from numpy import *', '']
+    for name in sorted(functions):
+        source = inspect.getsource(functions[name])
+        lines.append(source.replace('def _lambdifygenerated(', 'def {}('.format(name), 1))
+    for name in sorted(constants):
+        lines.append('{} = {!r}'.format(name, constants[name]))
+    temporary = '{}.{}.tmp'.format(path, os.getpid())
+    with open(temporary, 'w') as module:
+        module.write('\n'.join(lines) + '\n')
+    os.rename(temporary, path)
+
+
 class _EqualityConstraints(object):
     """Class for storing equality constraints in the MPC controller."""
 
@@ -25,8 +80,44 @@ class _EqualityConstraints(object):
         self.dict[key] = value
 
 
+class _SparseProblem(object):
+    """The NLP of MPCController as cyipopt's problem object: the functions
+    of `MPCController.get_sparse_functions` (or of the module generated
+    from them) evaluated at the initial state and the polynomial `args`.
+    """
+
+    def __init__(self, module, args=()):
+        self.module = module
+        self.args = args
+        if hasattr(module, 'hessian'):
+            self.hessian = self._hessian
+            self.hessianstructure = self._hessianstructure
+
+    def objective(self, x):
+        return self.module.cost(x, *self.args)
+
+    def gradient(self, x):
+        return np.asarray(self.module.cost_grad(x, *self.args), dtype=float)
+
+    def constraints(self, x):
+        return np.ravel(self.module.constraints(x, *self.args))
+
+    def jacobian(self, x):
+        return np.asarray(self.module.constraints_jac(x, *self.args), dtype=float)
+
+    def jacobianstructure(self):
+        return self.module.JAC_ROWS, self.module.JAC_COLS
+
+    def _hessian(self, x, lagrange, obj_factor):
+        return np.asarray(self.module.hessian(x, lagrange, obj_factor, *self.args), dtype=float)
+
+    def _hessianstructure(self):
+        return self.module.HESS_ROWS, self.module.HESS_COLS
+
+
 class MPCController:
-    def __init__(self, target_speed, steps_ahead, dt, logg):
+    def __init__(self, target_speed, steps_ahead, dt, logg,
+                 vectorized_constraints=config.VECTORIZED_CONSTRAINTS, backend=config.BACKEND):
         self.target_speed = target_speed
         self.state_vars = ('x', 'y', 'v', 'psi', 'cte', 'epsi')
 
@@ -64,7 +155,18 @@ class MPCController:
         # Lambdify and minimize stuff
         self.evaluator = 'numpy'
         self.tolerance = config.TOLERANCE
-        self.cost_func, self.cost_grad_func, self.constr_funcs = self.get_func_constraints_and_bounds()
+        self.vectorized_constraints = vectorized_constraints
+        self.backend = backend
+        if self.backend == 'ipopt' and _IpoptProblem is None:
+            self.logg('The ipopt backend needs cyipopt, solving with SLSQP')
+            self.backend = 'slsqp'
+        if self.backend == 'ipopt':
+            self.sparse_problem, self.nlp = self.get_sparse_problem()
+        else:
+            self.cost_func, self.cost_grad_func, self.constr_funcs = self.get_functions()
+        # The inputs of the last solution, which the ipopt backend starts
+        #  the next solve from
+        self.previous_inputs = None
 
         # To keep the previous state
         self.steer = None
@@ -72,9 +174,122 @@ class MPCController:
         self.next_pos = None
         self.next_pos_poly = None
 
-    def get_func_constraints_and_bounds(self):
-        """The most important method of this class, defining the MPC's cost
-        function and constraints.
+    def cache_key(self):
+        """What the generated functions depend on."""
+        key = (
+            _CACHE_FORMAT, sym.__version__, self.steps_ahead, self.dt, self.poly_degree, self.target_speed,
+            self.cte_coeff, self.epsi_coeff, self.speed_coeff, self.acc_coeff, self.steer_coeff,
+            self.consec_acc_coeff, self.consec_steer_coeff, self.Lf, self.vectorized_constraints,
+            self.backend, self.backend == 'ipopt' and config.IPOPT_EXACT_HESSIAN,
+        )
+        return hashlib.sha1(repr(key).encode()).hexdigest()[:16]
+
+    def get_functions(self):
+        """The cost, its gradient and the constraints for SLSQP: from the
+        module generated by an earlier run for the same problem (in
+        config.CODEGEN_CACHE_DIR), or derived and lambdified (and then
+        written there).
+        """
+        path = None
+        module = None
+        if config.CODEGEN_CACHE_DIR:
+            path = os.path.join(config.CODEGEN_CACHE_DIR, 'mpc_functions_{}.py'.format(self.cache_key()))
+            try:
+                module = _load_module(path)
+                if module is not None and not hasattr(module, 'NUM_CONSTRAINTS'):
+                    raise ImportError('incomplete module')
+            except Exception as e:
+                self.logg('Regenerating {}: {}'.format(path, e))
+                module = None
+
+        if module is not None:
+            cost_func = module.cost
+            cost_grad_func = module.cost_grad
+            constr_pairs = [
+                (getattr(module, 'constraint_{}'.format(i)), getattr(module, 'constraint_jac_{}'.format(i)))
+                for i in range(module.NUM_CONSTRAINTS)
+            ]
+        else:
+            cost_func, cost_grad_func, constr_pairs = self.get_func_constraints_and_bounds()
+            if path is not None:
+                functions = {'cost': cost_func, 'cost_grad': cost_grad_func}
+                for i, (func, jac_func) in enumerate(constr_pairs):
+                    functions['constraint_{}'.format(i)] = func
+                    functions['constraint_jac_{}'.format(i)] = jac_func
+                try:
+                    _write_module(path, functions, {'NUM_CONSTRAINTS': len(constr_pairs)})
+                except (IOError, OSError, TypeError) as e:
+                    self.logg('Could not cache the generated functions in {}: {}'.format(path, e))
+
+        return cost_func, cost_grad_func, self.make_constraints(constr_pairs)
+
+    def get_sparse_problem(self):
+        """The problem object and the cyipopt problem of the ipopt backend,
+        with the functions of `get_sparse_functions`, cached as those of
+        `get_functions`.
+        """
+        path = None
+        module = None
+        if config.CODEGEN_CACHE_DIR:
+            path = os.path.join(config.CODEGEN_CACHE_DIR, 'mpc_sparse_functions_{}.py'.format(self.cache_key()))
+            try:
+                module = _load_module(path)
+                if module is not None and not hasattr(module, 'JAC_COLS'):
+                    raise ImportError('incomplete module')
+            except Exception as e:
+                self.logg('Regenerating {}: {}'.format(path, e))
+                module = None
+
+        if module is None:
+            functions, constants = self.get_sparse_functions()
+            module = type('SparseFunctions', (object,), {})()
+            for name, value in list(functions.items()) + list(constants.items()):
+                setattr(module, name, value)
+            if path is not None:
+                try:
+                    _write_module(path, functions, constants)
+                except (IOError, OSError, TypeError) as e:
+                    self.logg('Could not cache the generated functions in {}: {}'.format(path, e))
+
+        problem = _SparseProblem(module)
+        num_vars = len(self.bounds)
+        nlp = _IpoptProblem(
+            n=num_vars,
+            m=module.NUM_CONSTRAINTS,
+            problem_obj=problem,
+            lb=[-2e19 if lower is None else lower for lower, _ in self.bounds],
+            ub=[2e19 if upper is None else upper for _, upper in self.bounds],
+            cl=np.zeros(module.NUM_CONSTRAINTS),
+            cu=np.zeros(module.NUM_CONSTRAINTS),
+        )
+        add_option = getattr(nlp, 'add_option', None) or nlp.addOption
+        for name, value in config.IPOPT_OPTIONS.items():
+            add_option(name, value)
+        if not hasattr(module, 'hessian'):
+            add_option('hessian_approximation', 'limited-memory')
+        return problem, nlp
+
+    def make_constraints(self, constr_pairs):
+        """The constraints in the form of scipy's `minimize`, from pairs of
+        functions (the constraint, its gradient or Jacobian)."""
+        if self.vectorized_constraints:
+            (func, jac_func), = constr_pairs
+            return [{
+                'type': 'eq',
+                'fun': lambda x, *args: np.ravel(func(x, *args)),
+                'jac': lambda x, *args: np.asarray(jac_func(x, *args), dtype=float),
+                'args': None,
+            }]
+        return [
+            {'type': 'eq', 'fun': func, 'jac': jac_func, 'args': None}
+            for func, jac_func in constr_pairs
+        ]
+
+    def symbolic_problem(self):
+        """The MPC's cost function and constraints, symbolic: the terms of
+        the cost, the equality constraints (by state variable, then by
+        stage), and the symbols of the variables, of the initial state and
+        of the polynomial.
         """
         # Polynomial coefficients will also be symbolic variables
         poly = self.create_array_of_symbols('poly', self.poly_degree+1)
@@ -109,9 +324,9 @@ class MPCController:
             a, delta,
         ], ())
 
-        cost = 0
+        cost_terms = []
         for t in range(self.steps_ahead):
-            cost += (
+            cost_terms.append(
                 # Reference state penalties
                 self.cte_coeff * cte[t]**2
                 + self.epsi_coeff * epsi[t]**2 +
@@ -124,7 +339,7 @@ class MPCController:
 
         # Penalty for differences in consecutive actuators
         for t in range(self.steps_ahead-1):
-            cost += (
+            cost_terms.append(
                 self.consec_acc_coeff * (a[t+1] - a[t])**2
                 + self.consec_steer_coeff * (delta[t+1] - delta[t])**2
             )
@@ -151,20 +366,97 @@ class MPCController:
             eq_constr['cte'][t] = cte[t] - (curve - y[t-1] + v[t-1] * sym.sin(epsi[t-1]) * self.dt)
             eq_constr['epsi'][t] = epsi[t] - (psi[t-1] - psides - v[t-1] * delta[t-1] / self.Lf * self.dt)
 
+        constraints = [
+            eq_constr[symbol][t]
+            for symbol in self.state_vars
+            for t in range(self.steps_ahead)
+        ]
+        return cost_terms, constraints, vars_, init, poly
+
+    def get_func_constraints_and_bounds(self):
+        """The most important method of this class, defining the MPC's cost
+        function and constraints: the cost, its gradient, and the pairs of
+        the constraint functions and their gradients (just one pair, of the
+        vector of all of them and its Jacobian, with `vectorized_constraints`).
+        """
+        cost_terms, constraints, vars_, init, poly = self.symbolic_problem()
+        cost = sum(cost_terms)
+
         # Generate actual functions from
         cost_func = self.generate_fun(cost, vars_, init, poly)
         cost_grad_func = self.generate_grad(cost, vars_, init, poly)
 
-        constr_funcs = []
-        for symbol in self.state_vars:
-            for t in range(self.steps_ahead):
-                func = self.generate_fun(eq_constr[symbol][t], vars_, init, poly)
-                grad_func = self.generate_grad(eq_constr[symbol][t], vars_, init, poly)
-                constr_funcs.append(
-                    {'type': 'eq', 'fun': func, 'jac': grad_func, 'args': None},
-                )
+        if self.vectorized_constraints:
+            # All the equality constraints in one vector-valued function, and
+            # its (dense) Jacobian in one matrix: SLSQP calls two functions
+            # per iteration instead of two per constraint
+            constraints = sym.Matrix(constraints)
+            func = self.generate_fun(constraints, vars_, init, poly)
+            jac_func = self.generate_fun(constraints.jacobian(vars_), vars_, init, poly)
+            return cost_func, cost_grad_func, [(func, jac_func)]
+
+        constr_pairs = []
+        for constraint in constraints:
+            func = self.generate_fun(constraint, vars_, init, poly)
+            grad_func = self.generate_grad(constraint, vars_, init, poly)
+            constr_pairs.append((func, grad_func))
+
+        return cost_func, cost_grad_func, constr_pairs
+
+    def get_sparse_functions(self):
+        """The functions of the interior-point backend: the cost and its
+        gradient, the vector of the constraints, the nonzeros of their
+        Jacobian and (with config.IPOPT_EXACT_HESSIAN) those of the lower
+        triangle of the Hessian of the Lagrangian, by name, and the
+        coordinates of the nonzeros (constants by name). The derivatives
+        are only taken w.r.t. the few variables each term has, so that
+        their number grows linearly with the horizon.
+        """
+        cost_terms, constraints, vars_, init, poly = self.symbolic_problem()
+        index = {var: i for i, var in enumerate(vars_)}
+
+        def term_vars(term):
+            return sorted(index[symbol] for symbol in term.free_symbols if symbol in index)
+
+        jac_rows, jac_cols, jac_values = [], [], []
+        for row, constraint in enumerate(constraints):
+            for col in term_vars(constraint):
+                jac_rows.append(row)
+                jac_cols.append(col)
+                jac_values.append(constraint.diff(vars_[col]))
+
+        functions = {
+            'cost': self.generate_fun(sum(cost_terms), vars_, init, poly),
+            'cost_grad': self.generate_grad(sum(cost_terms), vars_, init, poly),
+            'constraints': self.generate_fun(sym.Matrix(constraints), vars_, init, poly),
+            'constraints_jac': self.generate_fun(jac_values, vars_, init, poly),
+        }
+        constants = {
+            'NUM_CONSTRAINTS': len(constraints),
+            'JAC_ROWS': jac_rows,
+            'JAC_COLS': jac_cols,
+        }
 
-        return cost_func, cost_grad_func, constr_funcs
+        if config.IPOPT_EXACT_HESSIAN:
+            # sigma * cost + lambda' * constraints, by pair of variables
+            multipliers = self.create_array_of_symbols('lambda', len(constraints))
+            obj_factor = sym.symbols('obj_factor')
+            hessian = {}
+            for term, factor in zip(cost_terms + constraints, len(cost_terms) * [obj_factor] + list(multipliers)):
+                cols = term_vars(term)
+                for k, i in enumerate(cols):
+                    d_i = term.diff(vars_[i])
+                    for j in cols[:k+1]:
+                        d_ij = d_i.diff(vars_[j])
+                        if d_ij != 0:
+                            hessian[(i, j)] = hessian.get((i, j), 0) + factor * d_ij
+            pairs = sorted(hessian)
+            functions['hessian'] = sym.lambdify(
+                (vars_, multipliers, obj_factor) + init + poly, [hessian[pair] for pair in pairs], self.evaluator)
+            constants['HESS_ROWS'] = [i for i, _ in pairs]
+            constants['HESS_COLS'] = [j for _, j in pairs]
+
+        return functions, constants
 
     def _find_closest(self, pts_2D, position):
         dists = np.linalg.norm(pts_2D - position, axis=1)
@@ -189,11 +481,16 @@ class MPCController:
         self.logg('cte={:.2f}, epsi={:.2f}, psi={:.2f}'.format(cte, epsi, psi))
 
         init = (0, 0, 0, v, cte, epsi) + tuple(poly)
-        self.state0 = self.get_state0(v, cte, epsi, self.steer, self.throttle, poly)
+        if self.backend == 'ipopt' and self.previous_inputs is not None:
+            self.state0 = self.get_warm_state0(v, cte, epsi, poly)
+        else:
+            self.state0 = self.get_state0(v, cte, epsi, self.steer, self.throttle, poly)
         result = self.minimize_cost(self.bounds, self.state0, init)
 
 
-        if 'success' in result.message:
+        success = result.success
+        if success:
+            self.previous_inputs = result.x[6*self.steps_ahead:].copy()
             next_x = result.x[:self.steps_ahead]
             next_y = result.x[self.steps_ahead:2*self.steps_ahead]
             self.next_pos = np.c_[next_x, next_y]
@@ -207,6 +504,7 @@ class MPCController:
         return {
             'steer': self.steer,
             'throttle': self.throttle,
+            'success': success,
             'cost': result.fun,
             'next_pos': self.next_pos,
             'poly': self.poly,
@@ -231,6 +529,31 @@ class MPCController:
         self.state0[7*self.steps_ahead:8*self.steps_ahead] = delta
         return self.state0
 
+    def get_warm_state0(self, v, cte, epsi, poly):
+        """The starting point of the ipopt backend: the inputs of the last
+        solution one step on (the last one held), and the states the model
+        goes through with them from the current ones, so that it starts
+        feasible.
+        """
+        N = self.steps_ahead
+        a = np.r_[self.previous_inputs[1:N], self.previous_inputs[N-1]]
+        delta = np.r_[self.previous_inputs[N+1:], self.previous_inputs[-1]]
+        dpoly = np.polyder(poly)
+        state = self.state0.reshape(8, N)
+        state[:, 0] = (0, 0, 0, v, cte, epsi, a[0], delta[0])
+        for t in range(1, N):
+            x, y, psi, v, cte, epsi = state[:6, t-1]
+            turn = v * delta[t-1] / self.Lf * self.dt
+            state[0, t] = x + v * np.cos(psi) * self.dt
+            state[1, t] = y + v * np.sin(psi) * self.dt
+            state[2, t] = psi - turn
+            state[3, t] = v + a[t-1] * self.dt
+            state[4, t] = np.polyval(poly, x) - y + v * np.sin(epsi) * self.dt
+            state[5, t] = psi - np.polyval(dpoly, x) - turn
+        state[6] = a
+        state[7] = delta
+        return self.state0
+
     def generate_fun(self, symb_fun, vars_, init, poly):
         '''This function generates a function of the form `fun(x, *args)` because
         that's what the scipy `minimize` API expects (if we don't want to minimize
@@ -259,7 +582,21 @@ class MPCController:
         # ]
 
     def minimize_cost(self, bounds, x0, init):
+        if self.backend == 'ipopt':
+            # The bounds are the problem's already
+            self.sparse_problem.args = init
+            x, info = self.nlp.solve(x0)
+            message = info['status_msg']
+            return OptimizeResult(
+                x=x,
+                fun=info['obj_val'],
+                success=info['status'] in (0, 1),
+                status=info['status'],
+                message=message.decode() if isinstance(message, bytes) else message,
+            )
+
         # TODO: this is a bit retarded, but hey -- that's scipy API's fault ;)
+        # (with `vectorized_constraints` there's just the one)
         for constr_func in self.constr_funcs:
             constr_func['args'] = init
 
@@ -1,3 +1,6 @@
+import os
+
+
 def deg2rad(deg):
     return deg * 3.1415 / 180
 
@@ -31,3 +34,33 @@ TOLERANCE = 0.1
 #  fewer iterations (and it has a higher chance of converging)
 #  BUT the of the cost function can be sub-optimal, and thus
 #  the actuators that correspond to that cost function
+
+# Give SLSQP all the equality constraints as one vector-valued function
+#  (and one Jacobian) instead of one function per constraint, which cuts
+#  the Python calls per iteration by about 6 * STEPS_AHEAD
+VECTORIZED_CONSTRAINTS = False
+
+# The solver of MPCController: 'slsqp' (scipy's, dense), or 'ipopt' (the
+#  interior-point solver of cyipopt, with the constraints as one vector and
+#  their Jacobian sparse, and starting from the last solution), whose cost
+#  grows about linearly with STEPS_AHEAD rather than cubically
+BACKEND = 'slsqp'
+# With 'ipopt': the exact (sparse) Hessian of the Lagrangian rather than
+#  Ipopt's quasi-Newton approximation, and the options of Ipopt
+IPOPT_EXACT_HESSIAN = True
+IPOPT_OPTIONS = {
+    'tol': 1e-4,
+    'max_iter': 100,
+    'print_level': 0,
+    'sb': 'yes',
+}
+
+# Where MPCController keeps the functions it generates (as Python modules,
+#  one per problem), so that restarts import them instead of deriving them
+#  again; empty to always derive them
+CODEGEN_CACHE_DIR = os.path.expanduser('~/.ros/mpc_python_cache')
+
+# The control loop of mpc_in_python.py solves on every new pose or (when
+#  False) at LOOP_RATE [Hz]; either way it never spins on stale data
+CONTROL_ON_POSE = True
+LOOP_RATE = 100
@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+"""Reader of the live view of mpc_node_cpp (see src/LiveView.h and the
+parameter live_view): the latest tick of its solver loop in shared memory,
+polled without ROS and without holding the node up.
+
+    view = live_view.LiveView('/dev/shm/mpc_live_view')
+    frame = view.read()
+    if frame is not None:
+        draw(frame['plan_x'], frame['plan_y'])
+
+The layout is that of LiveViewHeader and LiveFrame, in the native
+endianness; a frame is read again when it was written meanwhile (the
+seqlock of the header).
+"""
+from __future__ import print_function
+import mmap
+import struct
+import sys
+import time
+
+import numpy as np
+
+
+_MAGIC = b'MPCLIV1\0'
+_VERSION = 1
+_HEADER = struct.Struct('=8sIIQ')
+_SEQUENCE = struct.Struct('=Q')
+_SEQUENCE_OFFSET = 16
+_FRAME_OFFSET = 64
+
+_NUM_STAGES = 8
+_MAX_POINTS = 64
+_MAX_STAGES = 64
+
+# The fields of LiveFrame before its arrays, in their order
+_SCALARS = (
+    ('tick', 'Q'), ('stamp', 'd'),
+    ('pos_x', 'd'), ('pos_y', 'd'), ('psi', 'd'), ('speed', 'd'),
+    ('pos_x_lat', 'd'), ('pos_y_lat', 'd'), ('psi_lat', 'd'),
+    ('cte', 'd'), ('epsi', 'd'), ('coeffs', '8d'),
+    ('steer_cmd', 'd'), ('rpm', 'd'),
+    ('cost', 'f'), ('latency', 'f'), ('stage_time', '{}f'.format(_NUM_STAGES)),
+    ('events', 'I'), ('num_coeffs', 'B'), ('fallback', 'B'), ('num_points', 'H'), ('num_stages', 'H'),
+    ('steps_ahead', 'H'), ('iterations', 'h'), ('reserved', 'H'),
+)
+_SCALARS_STRUCT = struct.Struct('=' + ''.join(code for _, code in _SCALARS))
+_ARRAYS = ('pts_x', 'pts_y', 'plan_x', 'plan_y', 'plan_time', 'plan_heading', 'plan_speed', 'plan_steer')
+_FRAME_SIZE = _SCALARS_STRUCT.size + 4 * (2 * _MAX_POINTS + 6 * _MAX_STAGES)
+
+_MAX_RETRIES = 16
+
+
+class LiveView(object):
+    """The live view at `path`, mapped read-only."""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.mapping = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, frame_size, _ = _HEADER.unpack_from(self.mapping, 0)
+        if magic != _MAGIC or version != _VERSION or frame_size != _FRAME_SIZE:
+            raise ValueError('{} is not a live view of this version'.format(path))
+
+    def sequence(self):
+        return _SEQUENCE.unpack_from(self.mapping, _SEQUENCE_OFFSET)[0]
+
+    def read(self):
+        """The latest frame, as a dict of its fields (the arrays as NumPy
+        arrays of their sizes, the fit's coefficients lowest order first)
+        with its number as 'frame'; None when there's none yet, or when it
+        kept being rewritten while it was copied."""
+        for _ in range(_MAX_RETRIES):
+            before = self.sequence()
+            if before == 0:
+                return None
+            if before & 1:
+                continue
+            data = self.mapping[_FRAME_OFFSET:_FRAME_OFFSET + _FRAME_SIZE]
+            if self.sequence() == before:
+                return _unpack(data, before // 2)
+        return None
+
+
+def _unpack(data, number):
+    values = _SCALARS_STRUCT.unpack_from(data, 0)
+    frame = {'frame': number}
+    i = 0
+    for name, code in _SCALARS:
+        count = int(code[:-1]) if len(code) > 1 else 1
+        frame[name] = values[i] if count == 1 else np.array(values[i:i+count])
+        i += count
+    arrays = np.frombuffer(data, dtype=np.float32, offset=_SCALARS_STRUCT.size)
+    sizes = 2 * [frame['num_points']] + 6 * [frame['num_stages']]
+    capacities = 2 * [_MAX_POINTS] + 6 * [_MAX_STAGES]
+    start = 0
+    for name, size, capacity in zip(_ARRAYS, sizes, capacities):
+        frame[name] = arrays[start:start + size].copy()
+        start += capacity
+    frame['coeffs'] = frame['coeffs'][:frame['num_coeffs']]
+    return frame
+
+
+if __name__ == '__main__':
+    # Prints the plan of every new frame
+    view = LiveView(sys.argv[1] if len(sys.argv) > 1 else '/dev/shm/mpc_live_view')
+    last = 0
+    while True:
+        frame = view.read()
+        if frame is not None and frame['frame'] != last:
+            last = frame['frame']
+            print('tick {}: cte {:.3f} epsi {:.3f}, {} stages to ({:.2f}, {:.2f}), tick {:.2f} ms'.format(
+                frame['tick'], frame['cte'], frame['epsi'], frame['num_stages'],
+                frame['plan_x'][-1] if frame['num_stages'] else float('nan'),
+                frame['plan_y'][-1] if frame['num_stages'] else float('nan'),
+                1e3 * frame['stage_time'][_NUM_STAGES - 1]))
+        time.sleep(0.01)
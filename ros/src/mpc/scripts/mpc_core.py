@@ -0,0 +1,286 @@
+#!/usr/bin/env python
+"""Python bindings of the C++ core of the controller (see src/mpc_core.h).
+
+The library libmpc_core.so is looked up in $MPC_CORE_LIBRARY, then on the
+library path (e.g. the devel space of catkin, once sourced). The arrays are
+NumPy arrays of doubles; contiguous ones are passed to the C++ code as they
+are, without a copy (others are converted first).
+
+    params = mpc_core.Params()
+    params.steps_ahead = 10
+    params.persistent_tape = True
+    solver = mpc_core.Solver(params)
+    coeffs = mpc_core.polyfit(car_x, car_y, params.poly_degree)
+    result = solver.solve([0, 0, 0, cte, epsi], coeffs, params.ref_v)
+    steer, speed = result[0], result[1]
+"""
+from __future__ import print_function
+import ctypes
+import ctypes.util
+import os
+
+import numpy as np
+
+
+def _load_library():
+    path = os.environ.get('MPC_CORE_LIBRARY') or ctypes.util.find_library('mpc_core')
+    if path is None:
+        for directory in os.environ.get('LD_LIBRARY_PATH', '').split(os.pathsep):
+            candidate = os.path.join(directory, 'libmpc_core.so')
+            if directory and os.path.exists(candidate):
+                path = candidate
+                break
+    if path is None:
+        raise ImportError('libmpc_core.so not found, build the mpc package or set MPC_CORE_LIBRARY')
+    return ctypes.CDLL(path)
+
+
+_lib = _load_library()
+
+_doubles = np.ctypeslib.ndpointer(dtype=np.float64, flags='C_CONTIGUOUS')
+_ints = np.ctypeslib.ndpointer(dtype=np.intc, flags='C_CONTIGUOUS')
+_size = ctypes.c_size_t
+_double = ctypes.c_double
+
+
+class Stats(ctypes.Structure):
+    """What the last solve reported (see SolveStats)."""
+    _fields_ = [
+        ('ok', ctypes.c_int),
+        ('deadline_hit', ctypes.c_int),
+        ('cost', _double),
+        ('iterations', ctypes.c_int),
+        ('solve_time', _double),
+        ('eval_time', _double),
+        ('constraint_violation', _double),
+        ('fallback', ctypes.c_int),
+        ('slack', _double),
+        ('tolerance', _double),
+    ]
+
+
+def _declare(name, restype, argtypes):
+    function = getattr(_lib, name)
+    function.restype = restype
+    function.argtypes = argtypes
+
+
+_declare('mpc_last_error', ctypes.c_char_p, [])
+_declare('mpc_params_new', ctypes.c_void_p, [])
+_declare('mpc_params_copy', ctypes.c_void_p, [ctypes.c_void_p])
+_declare('mpc_params_free', None, [ctypes.c_void_p])
+_declare('mpc_params_set', ctypes.c_int, [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p])
+_declare('mpc_params_get', ctypes.c_int, [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, _size])
+_declare('mpc_params_name', ctypes.c_char_p, [_size])
+_declare('mpc_params_type', ctypes.c_char_p, [ctypes.c_char_p])
+_declare('mpc_solver_new', ctypes.c_void_p, [ctypes.c_void_p])
+_declare('mpc_solver_free', None, [ctypes.c_void_p])
+_declare('mpc_solver_result_size', _size, [ctypes.c_void_p])
+_declare('mpc_solver_solve', ctypes.c_int,
+         [ctypes.c_void_p, _doubles, _doubles, _size, _double, _double, _doubles, _size])
+_declare('mpc_solver_stats', None, [ctypes.c_void_p, ctypes.POINTER(Stats)])
+_declare('mpc_solver_set_weights', ctypes.c_int, [ctypes.c_void_p, ctypes.c_void_p])
+_declare('mpc_solver_reset_warm_start', None, [ctypes.c_void_p])
+_declare('mpc_polyfit', ctypes.c_int, [_doubles, _doubles, _size, ctypes.c_int, _doubles])
+_declare('mpc_polyeval', None, [_doubles, _size, _doubles, _size, _doubles, _doubles])
+_declare('mpc_to_car_frame', None, [_doubles, _doubles, _size, _double, _double, _double, _doubles, _doubles])
+_declare('mpc_path_new', ctypes.c_void_p, [_doubles, _doubles, _size, ctypes.c_void_p])
+_declare('mpc_path_free', None, [ctypes.c_void_p])
+_declare('mpc_path_size', _size, [ctypes.c_void_p])
+_declare('mpc_path_length', _double, [ctypes.c_void_p])
+_declare('mpc_path_closed', ctypes.c_int, [ctypes.c_void_p])
+_declare('mpc_path_closest', ctypes.c_int, [ctypes.c_void_p, _double, _double])
+_declare('mpc_path_sample', None, [ctypes.c_void_p, _doubles, _size, _doubles, _doubles, _doubles, _doubles])
+_declare('mpc_path_progress', ctypes.c_int, [ctypes.c_void_p, _doubles, _doubles, _size, _doubles, _doubles, _ints])
+_declare('mpc_path_reset_progress', None, [ctypes.c_void_p])
+
+
+def _array(values):
+    """The values as a contiguous array of doubles (the same one if it is)."""
+    return np.ascontiguousarray(values, dtype=np.float64)
+
+
+def _check(status):
+    if status != 0:
+        raise ValueError(_lib.mpc_last_error().decode())
+
+
+def _text(value):
+    if isinstance(value, bool):
+        return 'true' if value else 'false'
+    if isinstance(value, (list, tuple, np.ndarray)):
+        return ','.join(_text(v) for v in value)
+    return str(value)
+
+
+_PARSERS = {
+    'double': float,
+    'int': int,
+    'bool': lambda text: text == 'true',
+    'string': lambda text: text,
+    'double list': lambda text: [float(v) for v in text.split(',')] if text else [],
+    'int list': lambda text: [int(v) for v in text.split(',')] if text else [],
+}
+
+
+class Params(object):
+    """The Params of the controller, with the defaults of run_mpc_cpp.sh.
+
+    The fields are attributes, by their names in Params (see `names`)."""
+
+    def __init__(self, **fields):
+        object.__setattr__(self, '_handle', _lib.mpc_params_new())
+        for name, value in fields.items():
+            setattr(self, name, value)
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            _lib.mpc_params_free(self._handle)
+
+    @staticmethod
+    def names():
+        names = []
+        while _lib.mpc_params_name(len(names)) is not None:
+            names.append(_lib.mpc_params_name(len(names)).decode())
+        return names
+
+    def copy(self):
+        params = Params.__new__(Params)
+        object.__setattr__(params, '_handle', _lib.mpc_params_copy(self._handle))
+        return params
+
+    def __setattr__(self, name, value):
+        _check(_lib.mpc_params_set(self._handle, name.encode(), _text(value).encode()))
+
+    def __getattr__(self, name):
+        if name.startswith('_'):
+            raise AttributeError(name)
+        field_type = _lib.mpc_params_type(name.encode())
+        if field_type is None:
+            raise AttributeError(name)
+        size = _lib.mpc_params_get(self._handle, name.encode(), None, 0)
+        buffer = ctypes.create_string_buffer(size + 1)
+        _lib.mpc_params_get(self._handle, name.encode(), buffer, size + 1)
+        return _PARSERS[field_type.decode()](buffer.value.decode())
+
+    def __repr__(self):
+        return 'Params({})'.format(', '.join('{}={!r}'.format(n, getattr(self, n)) for n in Params.names()))
+
+
+class Solver(object):
+    """MPC::Solve, for the Params it's built with."""
+
+    def __init__(self, params):
+        self._handle = _lib.mpc_solver_new(params._handle)
+        if not self._handle:
+            raise ValueError(_lib.mpc_last_error().decode())
+        self.result_size = _lib.mpc_solver_result_size(self._handle)
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            _lib.mpc_solver_free(self._handle)
+
+    def solve(self, state, coeffs, ref_v, time_limit=0.0, out=None):
+        """The actuations [rad], [m/s], then the predicted (x, y) of every
+        step, from the state (x, y, psi, cte, epsi) and the coefficients of
+        the fit (lowest order first), into `out` if given; within
+        `time_limit` [s] (0: none)."""
+        state = _array(state)
+        coeffs = _array(coeffs)
+        if out is None:
+            out = np.empty(self.result_size)
+        _check(_lib.mpc_solver_solve(self._handle, state, coeffs, coeffs.size, ref_v, time_limit,
+                                     out, out.size))
+        return out
+
+    def stats(self):
+        stats = Stats()
+        _lib.mpc_solver_stats(self._handle, ctypes.byref(stats))
+        return stats
+
+    def set_weights(self, params):
+        _check(_lib.mpc_solver_set_weights(self._handle, params._handle))
+
+    def reset_warm_start(self):
+        _lib.mpc_solver_reset_warm_start(self._handle)
+
+
+def polyfit(x, y, order):
+    """The least-squares polynomial of degree `order`, lowest order first
+    (the reverse of np.polyfit)."""
+    x = _array(x)
+    y = _array(y)
+    coeffs = np.empty(order + 1)
+    _check(_lib.mpc_polyfit(x, y, x.size, order, coeffs))
+    return coeffs
+
+
+def polyeval(coeffs, x):
+    """The polynomial and its derivative at `x`."""
+    coeffs = _array(coeffs)
+    x = _array(x)
+    value = np.empty_like(x)
+    derivative = np.empty_like(x)
+    _lib.mpc_polyeval(coeffs, coeffs.size, x, x.size, value, derivative)
+    return value, derivative
+
+
+def to_car_frame(x, y, pos_x, pos_y, psi, out_x=None, out_y=None):
+    """The points from the world frame to that of a car at (pos_x, pos_y)
+    with heading psi; `out_x` and `out_y` may be `x` and `y`."""
+    x = _array(x)
+    y = _array(y)
+    out_x = np.empty_like(x) if out_x is None else out_x
+    out_y = np.empty_like(y) if out_y is None else out_y
+    _lib.mpc_to_car_frame(x, y, x.size, pos_x, pos_y, psi, out_x, out_y)
+    return out_x, out_y
+
+
+class Path(object):
+    """A path through the waypoints, prepared as the controller prepares a
+    centerline: its spatial index, spline and progress tracking."""
+
+    def __init__(self, x, y, params=None):
+        x = _array(x)
+        y = _array(y)
+        self._handle = _lib.mpc_path_new(x, y, x.size, params._handle if params is not None else None)
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            _lib.mpc_path_free(self._handle)
+
+    def __len__(self):
+        return _lib.mpc_path_size(self._handle)
+
+    @property
+    def length(self):
+        return _lib.mpc_path_length(self._handle)
+
+    @property
+    def closed(self):
+        return bool(_lib.mpc_path_closed(self._handle))
+
+    def closest(self, x, y):
+        return _lib.mpc_path_closest(self._handle, x, y)
+
+    def sample(self, s):
+        """The positions, headings and curvatures of the spline at the arc
+        lengths `s`."""
+        s = _array(s)
+        x, y, heading, curvature = (np.empty_like(s) for _ in range(4))
+        _lib.mpc_path_sample(self._handle, s, s.size, x, y, heading, curvature)
+        return x, y, heading, curvature
+
+    def progress(self, x, y):
+        """The arc lengths, lateral offsets and closest waypoints of the
+        poses, tracked from those of the previous call (see LapProgress)."""
+        x = _array(x)
+        y = _array(y)
+        s = np.empty_like(x)
+        d = np.empty_like(x)
+        closest = np.empty(x.size, dtype=np.intc)
+        _check(_lib.mpc_path_progress(self._handle, x, y, x.size, s, d, closest))
+        return s, d, closest
+
+    def reset_progress(self):
+        _lib.mpc_path_reset_progress(self._handle)
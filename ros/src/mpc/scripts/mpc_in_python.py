@@ -1,6 +1,9 @@
 #!/usr/bin/env python
+import mmap
+import struct
+import threading
+
 import numpy as np
-from scipy.linalg import expm
 
 import rospy
 from rospy.numpy_msg import numpy_msg
@@ -12,7 +15,7 @@ from tf.transformations import (
 )
 
 # Message types
-from std_msgs.msg import Float32, Time
+from std_msgs.msg import Float32, Time, UInt64
 from nav_msgs.msg import Odometry
 from visualization_msgs.msg import Marker
 from geometry_msgs.msg import Point
@@ -22,6 +25,36 @@ from _mpc_controller import MPCController
 import config
 
 
+# The layout of TrackStoreHeader (see src/TrackStore.h in the mpc package):
+# the fields up to the sections, then (offset, count) of every array
+TRACK_STORE_MAGIC = b'MPCTRK1\0'
+TRACK_STORE_VERSION = 1
+TRACK_STORE_FIELDS = struct.Struct('=8sIIQQ')
+TRACK_STORE_SECTIONS_OFFSET = 72
+TRACK_STORE_SECTION = struct.Struct('=QQ')
+TRACK_STORE_PTS_X, TRACK_STORE_PTS_Y = 0, 1
+
+
+def read_track_store(path, expected_hash):
+    '''The (x, y) waypoints of the track store of track_store_node, mapped
+    rather than received; None if it's not the path of `expected_hash`
+    (replaced by a newer one since it was announced)'''
+    with open(path, 'rb') as f:
+        mapping = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, version, _, path_hash, _ = TRACK_STORE_FIELDS.unpack_from(mapping, 0)
+    if magic != TRACK_STORE_MAGIC or version != TRACK_STORE_VERSION:
+        rospy.logerr('{} is not a track store'.format(path))
+        return None
+    if path_hash != expected_hash:
+        return None
+    columns = []
+    for section in (TRACK_STORE_PTS_X, TRACK_STORE_PTS_Y):
+        offset, count = TRACK_STORE_SECTION.unpack_from(
+            mapping, TRACK_STORE_SECTIONS_OFFSET + section * TRACK_STORE_SECTION.size)
+        columns.append(np.frombuffer(mapping, dtype=np.float64, count=count, offset=offset))
+    return np.column_stack(columns)
+
+
 class MPCControllerNode:
     def __init__(self, mpc_controller, common_queue_size=None, which_speed='VESC'):
         self.which_speed = which_speed
@@ -32,6 +65,8 @@ class MPCControllerNode:
         self.position = None
         self.psi = None
         self.orient_euler = None
+        # Set by every new pose, which the control loop waits for
+        self.new_pose = threading.Event()
 
         self.mpc_controller = mpc_controller
 
@@ -91,13 +126,35 @@ class MPCControllerNode:
 
         rospy.init_node('~mpc_node_python')
 
+        # ~track_store: the path is mapped from the track store of
+        # track_store_node whenever /centerline_store announces a new one,
+        # instead of received on /centerline_numpy
+        self.track_store = rospy.get_param('~track_store', '')
+        if self.track_store:
+            self.subscribers.pop('/centerline_numpy').unregister()
+            self.subscribers['/centerline_store'] = rospy.Subscriber(
+                '/centerline_store',
+                UInt64,
+                self.centerline_store_cb,
+                queue_size=queue_size,
+            )
+
         self.loop()
 
     def loop(self):
-        rate = rospy.Rate(100)
+        rate = rospy.Rate(config.LOOP_RATE)
         start_time = 0
 
         while not rospy.is_shutdown():
+            # On every new pose (the only point in solving again), or at the
+            # loop rate
+            if config.CONTROL_ON_POSE:
+                if not self.new_pose.wait(1.0 / config.LOOP_RATE):
+                    continue
+                self.new_pose.clear()
+            else:
+                rate.sleep()
+
             self.speed = {
                 'VESC': self.speed_from_vesc,
                 'PF': self.speed_from_pf,
@@ -114,16 +171,14 @@ class MPCControllerNode:
                 self.publishers['/mpc/throttle'].publish(mpc_results['throttle'])
 
                 if config.DEBUG and mpc_results['next_pos'] is not None:
-                    next_pos = mpc_results['next_pos']
-                    rot_fn = lambda v: self.rot_euler(v, self.orient_euler)
-                    rotated_next_pos = np.apply_along_axis(rot_fn, 1, next_pos)
+                    # From the car's frame to the map's, all the points at once
+                    rotation = self.rotation_2D(self.psi)
+                    rotated_next_pos = mpc_results['next_pos'].dot(rotation.T)
                     marker = self.get_marker(rotated_next_pos + self.position, 1.0, 0.0, 0.0)
                     self.publishers['/mpc/next_pos'].publish(marker)
 
-                    poly = mpc_results['poly']
-                    rot_fn = lambda v: self.rot_euler(v, self.orient_euler)
-                    rotated_next_pos = np.apply_along_axis(rot_fn, 1, poly)
-                    marker = self.get_marker(rotated_next_pos + self.position, 1.0, 1.0, 0.0)
+                    rotated_poly = mpc_results['poly'].dot(rotation.T)
+                    marker = self.get_marker(rotated_poly + self.position, 1.0, 1.0, 0.0)
                     self.publishers['/mpc/poly'].publish(marker)
 
                 elapsed = rospy.Time.now().to_sec() - start_time
@@ -173,13 +228,16 @@ class MPCControllerNode:
         return marker
 
     @staticmethod
-    def rot_euler(v, xyz):
-        '''Rotate vector v (or array of vectors) by the euler angles xyz '''
-        # https://stackoverflow.com/questions/6802577/python-rotation-of-3d-vector
-        v = np.r_[v, 0]
-        for theta, axis in zip(xyz, np.eye(3)):
-            v = np.dot(np.array(v), expm(np.cross(np.eye(3), axis*-theta)))
-        return v[:2]
+    def rotation_2D(psi):
+        '''The rotation by the heading psi, from the car's frame to the map's
+        (what rotating by all three Euler angles comes down to on the plane,
+        where the roll and the pitch are 0)'''
+        cos_psi = np.cos(psi)
+        sin_psi = np.sin(psi)
+        return np.array([
+            [cos_psi, -sin_psi],
+            [sin_psi,  cos_psi],
+        ])
 
     ### Callbacks ###
     def centerline_cb(self, data):
@@ -188,6 +246,15 @@ class MPCControllerNode:
         #  the first two
         self.points = data.data.reshape(-1, 4)[:, :2]  # TODO: magic number 4
 
+    def centerline_store_cb(self, data):
+        try:
+            points = read_track_store(self.track_store, data.data)
+        except (IOError, ValueError, struct.error) as e:
+            rospy.logwarn('Could not read the track store {}: {}'.format(self.track_store, e))
+            return
+        if points is not None:
+            self.points = points
+
     def pf_pose_odom_cb(self, data):
         position = data.pose.pose.position
         self.position = np.array([position.x, position.y])
@@ -196,6 +263,7 @@ class MPCControllerNode:
         orient = data.pose.pose.orientation
         self.orient_euler = euler_from_quaternion([orient.x, orient.y, orient.z, orient.w])
         self.psi = self.orient_euler[-1]  # The last, third Euler angle is psi
+        self.new_pose.set()
 
         # FIXME
         self.speed_from_pf = 0.5  # TODO: consult with Karol how to determine speed
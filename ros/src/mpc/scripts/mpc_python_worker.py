@@ -0,0 +1,53 @@
+#!/usr/bin/env python
+'''The controller of mpc_in_python.py (MPCController), driven over stdin and
+stdout by mpc_bag_replay --python, which runs it on the same inputs as the
+C++ one to compare them. One request per line, one reply per request:
+
+    path x0 y0 x1 y1 ...      the waypoints, until the next path (no reply)
+    control v x y psi         the speed [m/s] and the pose of a tick
+
+and the reply to a control is
+
+    success steer throttle seconds
+
+with `seconds` the time `MPCController.control` took. What the controller
+prints goes to stderr.'''
+import sys
+import time
+
+import numpy as np
+
+from _mpc_controller import MPCController
+import config
+
+
+def main():
+    replies = sys.stdout
+    sys.stdout = sys.stderr
+
+    mpc_controller = MPCController(config.TARGET_SPEED, config.STEPS_AHEAD, config.TIME_STEP,
+                                   lambda message: None)
+    points = None
+    for line in iter(sys.stdin.readline, ''):
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == 'path':
+            points = np.array(fields[1:], dtype=float).reshape(-1, 2)
+        elif fields[0] == 'control':
+            v, x, y, psi = (float(field) for field in fields[1:5])
+            if points is None or len(points) == 0:
+                replies.write('0 nan nan 0\n')
+            else:
+                start = time.time()
+                result = mpc_controller.control(points, v, np.array([x, y]), psi)
+                elapsed = time.time() - start
+                steer = result['steer'] if result['steer'] is not None else float('nan')
+                throttle = result['throttle'] if result['throttle'] is not None else float('nan')
+                replies.write('{:d} {!r} {!r} {!r}\n'.format(int(result['success']), float(steer),
+                                                             float(throttle), elapsed))
+            replies.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "ActiveSetQP.h"
+
+
+constexpr int ActiveSetQP::MAX_ITERATIONS;
+constexpr double ActiveSetQP::TOLERANCE;
+constexpr int ActiveSetQP::MAX_UPDATES;
+
+
+ActiveSetQP::ActiveSetQP(size_t n)
+        : m_n(n), m_H(Eigen::MatrixXd::Zero(n, n)), m_g(Eigen::VectorXd::Zero(n)),
+          m_lower(Eigen::VectorXd::Zero(n)), m_upper(Eigen::VectorXd::Zero(n)),
+          m_x(Eigen::VectorXd::Zero(n)), m_working(n, FREE), m_fixing(n, FREE),
+          m_iterations(0),
+          m_L(n, n), m_num_updates(0), m_step(n), m_grad(n), m_plus(n), m_minus(n) {}
+
+
+void ActiveSetQP::shift(size_t count) {
+    for (size_t i=0; i + count < m_n; i++)
+        m_working[i] = m_working[i + count];
+}
+
+
+void ActiveSetQP::reset() {
+    std::fill(m_working.begin(), m_working.end(), FREE);
+}
+
+
+bool ActiveSetQP::factorize() {
+    for (size_t j=0; j < m_n; j++) {
+        for (size_t i=j; i < m_n; i++) {
+            if (m_working[i] == FREE and m_working[j] == FREE)
+                m_L(i, j) = m_H(i, j);
+            else
+                m_L(i, j) = (i == j) ? 1.0 : 0.0;
+        }
+    }
+    m_num_updates = 0;
+    // In place: only the lower triangle is read and written
+    Eigen::LLT<Eigen::Ref<Eigen::MatrixXd> > llt(m_L);
+    return llt.info() == Eigen::Success;
+}
+
+
+// As Eigen's llt_rank_update_lower, without its temporary
+bool ActiveSetQP::rank_update(Eigen::VectorXd & v, double sigma) {
+    double beta = 1.0;
+    for (size_t j=0; j < m_n; j++) {
+        double L_jj = m_L(j, j);
+        double d_j = L_jj * L_jj;
+        double w_j = v[j];
+        double swj2 = sigma * w_j * w_j;
+        double gamma = d_j * beta + swj2;
+
+        double x = d_j + swj2 / beta;
+        if (x <= 0.0)
+            return false;
+        double new_L_jj = std::sqrt(x);
+        m_L(j, j) = new_L_jj;
+        beta += swj2 / d_j;
+
+        size_t rest = m_n - j - 1;
+        if (rest > 0) {
+            v.tail(rest) -= (w_j / L_jj) * m_L.col(j).tail(rest);
+            if (gamma != 0.0)
+                m_L.col(j).tail(rest) = (new_L_jj / L_jj) * m_L.col(j).tail(rest)
+                        + (new_L_jj * sigma * w_j / gamma) * v.tail(rest);
+        }
+    }
+    return true;
+}
+
+
+// Fixing i replaces its row and column of the system with those of the
+// identity, freeing it puts back those of H (on the free variables): a
+// symmetric change d e_i' + e_i d', i.e.
+// 1/2 (e_i + d)(e_i + d)' - 1/2 (e_i - d)(e_i - d)'
+bool ActiveSetQP::update_factor(size_t i, bool fix) {
+    if (++m_num_updates > MAX_UPDATES)
+        return factorize();
+
+    for (size_t j=0; j < m_n; j++) {
+        double d = 0.0;
+        if (j == i)
+            d = 0.5 * (fix ? 1.0 - m_H(i, i) : m_H(i, i) - 1.0);
+        else if (m_working[j] == FREE)
+            d = fix ? -m_H(j, i) : m_H(j, i);
+        m_plus[j] = d;
+        m_minus[j] = -d;
+    }
+    m_plus[i] += 1.0;
+    m_minus[i] += 1.0;
+    if (!rank_update(m_plus, 0.5) or !rank_update(m_minus, -0.5))
+        return factorize();
+    return true;
+}
+
+
+void ActiveSetQP::solve_step() {
+    for (size_t i=0; i < m_n; i++) {
+        if (m_working[i] != FREE) {
+            m_step[i] = m_x[i];
+            continue;
+        }
+        double rhs = -m_g[i];
+        for (size_t j=0; j < m_n; j++)
+            if (m_working[j] != FREE)
+                rhs -= m_H(i, j) * m_x[j];
+        m_step[i] = rhs;
+    }
+    m_L.triangularView<Eigen::Lower>().solveInPlace(m_step);
+    m_L.triangularView<Eigen::Lower>().transpose().solveInPlace(m_step);
+    m_step -= m_x;
+}
+
+
+void ActiveSetQP::start() {
+    m_iterations = 0;
+
+    // From the bounds of the working set, and the point of the box nearest
+    // to 0 elsewhere
+    for (size_t i=0; i < m_n; i++) {
+        if (m_working[i] == AT_LOWER)
+            m_x[i] = m_lower[i];
+        else if (m_working[i] == AT_UPPER)
+            m_x[i] = m_upper[i];
+        else
+            m_x[i] = std::min(std::max(0.0, m_lower[i]), m_upper[i]);
+    }
+}
+
+
+bool ActiveSetQP::solve() {
+    start();
+    if (!factorize())
+        return false;
+    return iterate();
+}
+
+
+bool ActiveSetQP::solve(const Eigen::MatrixXd & factor) {
+    start();
+
+    // Two rank-one updates of O(n^2) per variable fixed, against O(n^3 / 3)
+    // for the factorization
+    size_t num_fixed = 0;
+    for (Bound bound : m_working)
+        if (bound != FREE)
+            num_fixed++;
+    if (6 * num_fixed > m_n) {
+        if (!factorize())
+            return false;
+        return iterate();
+    }
+
+    // The variables of the working set fixed one after the other, from all
+    // of them free
+    m_L.triangularView<Eigen::Lower>() = factor.triangularView<Eigen::Lower>();
+    m_num_updates = 0;
+    std::swap(m_fixing, m_working);
+    std::fill(m_working.begin(), m_working.end(), FREE);
+    bool factor_OK = true;
+    for (size_t i=0; i < m_n and factor_OK; i++) {
+        if (m_fixing[i] == FREE)
+            continue;
+        m_working[i] = m_fixing[i];
+        factor_OK = update_factor(i, true);
+    }
+    std::swap(m_fixing, m_working);
+    if (!factor_OK and !factorize())
+        return false;
+    return iterate();
+}
+
+
+bool ActiveSetQP::iterate() {
+    for (int iter=0; iter < MAX_ITERATIONS; iter++) {
+        solve_step();
+
+        // As far along the step as the bounds of the free variables let it
+        double alpha = 1.0;
+        size_t blocking = m_n;
+        Bound blocking_bound = FREE;
+        for (size_t i=0; i < m_n; i++) {
+            if (m_working[i] != FREE)
+                continue;
+            if (m_step[i] < 0.0) {
+                double to_bound = std::max(0.0, (m_lower[i] - m_x[i]) / m_step[i]);
+                if (to_bound < alpha) {
+                    alpha = to_bound;
+                    blocking = i;
+                    blocking_bound = AT_LOWER;
+                }
+            } else if (m_step[i] > 0.0) {
+                double to_bound = std::max(0.0, (m_upper[i] - m_x[i]) / m_step[i]);
+                if (to_bound < alpha) {
+                    alpha = to_bound;
+                    blocking = i;
+                    blocking_bound = AT_UPPER;
+                }
+            }
+        }
+        m_x += alpha * m_step;
+
+        if (blocking < m_n) {
+            m_x[blocking] = (blocking_bound == AT_LOWER) ? m_lower[blocking] : m_upper[blocking];
+            m_working[blocking] = blocking_bound;
+            m_iterations++;
+            if (!update_factor(blocking, true))
+                return false;
+            continue;
+        }
+
+        // At the minimizer of the working set (the whole step): optimal
+        // unless a bound of it pulls its variable out of the box
+        m_grad.noalias() = m_H * m_x;
+        m_grad += m_g;
+        double worst_multiplier = -TOLERANCE * (1.0 + m_grad.lpNorm<Eigen::Infinity>());
+        size_t worst = m_n;
+        for (size_t i=0; i < m_n; i++) {
+            if (m_working[i] == FREE)
+                continue;
+            double multiplier = (m_working[i] == AT_LOWER) ? m_grad[i] : -m_grad[i];
+            if (multiplier < worst_multiplier) {
+                worst_multiplier = multiplier;
+                worst = i;
+            }
+        }
+        if (worst == m_n)
+            return true;
+
+        m_working[worst] = FREE;
+        m_iterations++;
+        if (!update_factor(worst, false))
+            return false;
+    }
+    return false;
+}
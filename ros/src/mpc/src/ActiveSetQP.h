@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+
+
+///* Dense convex QP with bounds on its variables,
+///*
+///*     min 1/2 x' H x + g' x    s.t.  lower <= x <= upper,
+///*
+///* by a primal active-set method: the bounds of the working set hold the
+///* variables they fix, and every iteration steps to the minimizer over the
+///* others, adding the first bound it runs into, or, at that minimizer,
+///* frees the variable whose bound has the most negative multiplier.
+///*
+///* The working set is kept from one solve to the next (see `shift` for
+///* problems that move along a horizon), so a problem close to the last one
+///* is solved in a handful of changes of it. The system of an iteration is
+///* H on the free variables and the identity on the fixed ones; its
+///* Cholesky factor is updated by two rank-one updates for every change of
+///* the working set instead of being refactorized.
+///*
+///* All the storage is allocated by the constructor, for `n` variables:
+///* `solve` doesn't allocate.
+class ActiveSetQP {
+public:
+    ///* Where the working set holds a variable
+    enum Bound : int8_t {
+        FREE = 0,
+        AT_LOWER = -1,
+        AT_UPPER = 1
+    };
+
+    explicit ActiveSetQP(size_t n);
+
+    size_t size() const { return m_n; }
+
+    ///* The problem, filled in place before `solve`: H (symmetric positive
+    ///* definite, in full), g and the bounds (lower <= upper)
+    Eigen::MatrixXd & hessian() { return m_H; }
+    Eigen::VectorXd & gradient() { return m_g; }
+    Eigen::VectorXd & lower() { return m_lower; }
+    Eigen::VectorXd & upper() { return m_upper; }
+
+    ///* Solves from the working set of the last solve. False if H isn't
+    ///* positive definite on the free variables, or after MAX_ITERATIONS;
+    ///* `solution` is the last (feasible) iterate then
+    bool solve();
+
+    ///* The same, with `factor` the Cholesky factor (lower triangle) of H
+    ///* with all the variables free, made beforehand for the H of the
+    ///* problem: the variables of the working set are fixed in it by the
+    ///* updates of the iterations, rather than by factorizing the system
+    ///* (unless it fixes so many that it's cheaper)
+    bool solve(const Eigen::MatrixXd & factor);
+
+    const Eigen::VectorXd & solution() const { return m_x; }
+
+    ///* The changes of the working set of the last solve
+    int iterations() const { return m_iterations; }
+
+    ///* Moves the working set `count` variables ahead, those of the last
+    ///* `count` keeping theirs, e.g. by a stage of a horizon whose problem
+    ///* moved by one step
+    void shift(size_t count);
+
+    ///* Empties the working set (a cold start)
+    void reset();
+
+    static constexpr int MAX_ITERATIONS = 100;
+
+private:
+    ///* The starting point, from the working set
+    void start();
+
+    ///* The iterations, from `start` with the factor of the working set
+    bool iterate();
+
+    ///* The matrix of the working set into `m_L`, factorized
+    bool factorize();
+
+    ///* Fixes (or frees) variable i in the factor, by two rank-one updates
+    bool update_factor(size_t i, bool fix);
+
+    ///* m_L m_L' + sigma v v', in place; false if it isn't positive
+    ///* definite any more
+    bool rank_update(Eigen::VectorXd & v, double sigma);
+
+    ///* The minimizer over the free variables (the fixed ones where they
+    ///* are) into `m_step`, as a step from `m_x`
+    void solve_step();
+
+    size_t m_n;
+    Eigen::MatrixXd m_H;
+    Eigen::VectorXd m_g;
+    Eigen::VectorXd m_lower;
+    Eigen::VectorXd m_upper;
+
+    Eigen::VectorXd m_x;
+    std::vector<Bound> m_working;
+    ///* The working set while it's fixed in a factor given to `solve`
+    std::vector<Bound> m_fixing;
+    int m_iterations;
+
+    ///* The Cholesky factor (lower triangle) of the system, the updates it
+    ///* went through since it was last factorized, and the work vectors
+    Eigen::MatrixXd m_L;
+    int m_num_updates;
+    Eigen::VectorXd m_step;
+    Eigen::VectorXd m_grad;
+    Eigen::VectorXd m_plus;
+    Eigen::VectorXd m_minus;
+
+    ///* Below this (relative to the gradient) a multiplier is taken as 0
+    static constexpr double TOLERANCE = 1e-10;
+    ///* The factor is recomputed after this many updates, before their
+    ///* rounding errors add up
+    static constexpr int MAX_UPDATES = 50;
+};
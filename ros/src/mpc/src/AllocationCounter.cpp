@@ -0,0 +1,62 @@
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+
+#ifndef NDEBUG
+
+static thread_local uint64_t t_count = 0;
+static thread_local int t_paused = 0;
+
+
+void AllocationCounter::record() {
+    if (t_paused == 0)
+        t_count++;
+}
+
+
+uint64_t AllocationCounter::count() {
+    return t_count;
+}
+
+
+bool AllocationCounter::available() {
+    // A direct call, unlike a new-expression, can't be optimized away
+    uint64_t before = t_count;
+    void * p = ::operator new(1);
+    ::operator delete(p);
+    return t_count != before;
+}
+
+
+AllocationCounter::Pause::Pause() {
+    t_paused++;
+}
+
+
+AllocationCounter::Pause::~Pause() {
+    t_paused--;
+}
+
+#else
+
+void AllocationCounter::record() {}
+
+
+uint64_t AllocationCounter::count() {
+    return 0;
+}
+
+
+bool AllocationCounter::available() {
+    return false;
+}
+
+
+AllocationCounter::Pause::Pause() {}
+
+
+AllocationCounter::Pause::~Pause() {}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+
+///* Count of the heap allocations (operator new) made by each thread, to
+///* check that the solver loop doesn't allocate once it's warmed up. Only in
+///* debug builds (without NDEBUG); otherwise the count stays at 0 and
+///* `available` is false. CountedNew.cpp replaces the global operator new
+///* of debug builds to count them, and ArenaNew.cpp that of mpc_node_cpp
+///* (only), to serve its ticks from their arena (see TickArena).
+class AllocationCounter {
+public:
+    ///* Counts an allocation of the calling thread, unless it's paused (the
+    ///* replaced operator new's)
+    static void record();
+
+    ///* Allocations made so far by the calling thread (outside of a Pause)
+    static uint64_t count();
+
+    ///* Whether allocations are counted at all: not in a release build, nor
+    ///* when the operator new of another library took precedence (which can
+    ///* happen when this one is loaded as a nodelet)
+    static bool available();
+
+    ///* The allocations of the calling thread in its scope aren't counted
+    ///* (e.g. those of Ipopt, which allocates on its own)
+    class Pause {
+    public:
+        Pause();
+        ~Pause();
+    };
+};
@@ -0,0 +1,75 @@
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+#include "TickArena.h"
+
+
+// The global operator new and delete of mpc_node_cpp, through the arena of
+// the tick (see TickArena) when there's one, counted in debug builds. Only
+// the executable has them: the libraries (the controller's, the nodelet,
+// mpc_core) and the other tools keep the heap's
+
+static void * arena_malloc(std::size_t size) {
+#ifndef NDEBUG
+    AllocationCounter::record();
+#endif
+    void * p = TickArena::thread_allocate(size);
+    return (p != nullptr) ? p : std::malloc(size == 0 ? 1 : size);
+}
+
+
+static void arena_free(void * p) {
+    if (!TickArena::release(p))
+        std::free(p);
+}
+
+
+// The arenas are of use from now on
+static const bool s_hooked = TickArena::set_hooked();
+
+
+void * operator new(std::size_t size) {
+    void * p = arena_malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+
+void * operator new[](std::size_t size) {
+    void * p = arena_malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return arena_malloc(size);
+}
+
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return arena_malloc(size);
+}
+
+
+void operator delete(void * p) noexcept {
+    arena_free(p);
+}
+
+
+void operator delete[](void * p) noexcept {
+    arena_free(p);
+}
+
+
+void operator delete(void * p, const std::nothrow_t &) noexcept {
+    arena_free(p);
+}
+
+
+void operator delete[](void * p, const std::nothrow_t &) noexcept {
+    arena_free(p);
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "BatchRollout.h"
+
+
+BatchRollout::BatchRollout(const Params & params)
+        : m_dt(params.dt), m_M(0), m_N(0), m_initial(nullptr), m_delta(nullptr), m_v(nullptr),
+          m_pool(nullptr), m_num_chunks(1), m_chunks(1), m_next(0), m_done(0), m_outstanding(0)
+{
+}
+
+
+BatchRollout::~BatchRollout() {
+    while (m_outstanding.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
+
+
+void BatchRollout::set_pool(Eigen::ThreadPoolInterface * pool, size_t num_chunks) {
+    m_pool = pool;
+    m_num_chunks = std::max(num_chunks, size_t(1));
+}
+
+
+void BatchRollout::rollout(const Eigen::ArrayXXd & initial, const Eigen::ArrayXXd & delta,
+                           const Eigen::ArrayXXd & v, const Eigen::VectorXd & coeffs) {
+    assert(initial.cols() == STATE_SIZE and delta.rows() == initial.rows() and v.rows() == initial.rows());
+    assert(delta.cols() == v.cols());
+    m_M = size_t(initial.rows());
+    m_N = size_t(delta.cols()) + 1;
+    m_initial = &initial;
+    m_delta = &delta;
+    m_v = &v;
+    m_coeffs = coeffs;
+    for (Eigen::ArrayXXd & state : m_states)
+        state.resize(m_M, m_N);
+    m_f.resize(m_M);
+    m_slope.resize(m_M);
+
+    // No more chunks than trajectories, and a single one without a pool
+    m_chunks = (m_pool != nullptr) ? std::min(m_num_chunks, std::max(m_M, size_t(1))) : 1;
+    m_done.store(0, std::memory_order_relaxed);
+    m_next.store(0, std::memory_order_release);
+    if (m_pool != nullptr) {
+        for (size_t c=1; c < m_chunks; c++) {
+            m_outstanding.fetch_add(1, std::memory_order_relaxed);
+            m_pool->Schedule([this]() {
+                work();
+                m_outstanding.fetch_sub(1, std::memory_order_release);
+            });
+        }
+    }
+    work();
+    while (m_done.load(std::memory_order_acquire) < m_chunks)
+        std::this_thread::yield();
+}
+
+
+void BatchRollout::work() {
+    for (;;) {
+        size_t chunk = m_next.fetch_add(1, std::memory_order_acq_rel);
+        if (chunk >= m_chunks)
+            return;
+        rollout_range(chunk * m_M / m_chunks, (chunk + 1) * m_M / m_chunks);
+        m_done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+void BatchRollout::rollout_range(size_t begin, size_t end) {
+    size_t n = end - begin;
+    if (n == 0)
+        return;
+    const double inverse_Lf = 1.0 / Lf();
+    Eigen::Index last = m_coeffs.size() - 1;
+
+    for (size_t i=0; i < STATE_SIZE; i++)
+        m_states[i].col(0).segment(begin, n) = m_initial->col(i).segment(begin, n);
+    auto f = m_f.segment(begin, n);
+    auto slope = m_slope.segment(begin, n);
+
+    // The stages of FG_eval: from the state and the actuations of step t to
+    // the state of step t + 1
+    for (size_t t=0; t + 1 < m_N; t++) {
+        auto x = m_states[R_X].col(t).segment(begin, n);
+        auto y = m_states[R_Y].col(t).segment(begin, n);
+        auto psi = m_states[R_PSI].col(t).segment(begin, n);
+        auto epsi = m_states[R_EPSI].col(t).segment(begin, n);
+        auto delta = m_delta->col(t).segment(begin, n);
+        auto v = m_v->col(t).segment(begin, n);
+
+        // The reference and its slope at x, by Horner
+        f.setConstant(last >= 0 ? m_coeffs[last] : 0.0);
+        slope.setConstant(last >= 1 ? last * m_coeffs[last] : 0.0);
+        for (Eigen::Index i = last - 1; i >= 0; i--) {
+            f = f * x + m_coeffs[i];
+            if (i >= 1)
+                slope = slope * x + i * m_coeffs[i];
+        }
+
+        m_states[R_X].col(t + 1).segment(begin, n) = x + v * psi.cos() * m_dt;
+        m_states[R_Y].col(t + 1).segment(begin, n) = y + v * psi.sin() * m_dt;
+        m_states[R_PSI].col(t + 1).segment(begin, n) = psi - v * inverse_Lf * delta * m_dt;
+        m_states[R_CTE].col(t + 1).segment(begin, n) = f - y + v * epsi.sin() * m_dt;
+        m_states[R_EPSI].col(t + 1).segment(begin, n) = m_states[R_PSI].col(t + 1).segment(begin, n)
+                                                         - slope.atan();
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* Rolls many trajectories of the kinematic model out at once: M initial
+///* states over N steps of given inputs, for checking candidate plans (the
+///* fallbacks, the soft constraints), simulating, or sampling.
+///*
+///* The equations are those of FG_eval's stages, in double, with `Lf()` and
+///* the `dt` of the params. Everything is a structure of arrays, a
+///* trajectory per lane: the states of the batch are arrays over the
+///* trajectories that Eigen vectorizes, and the inputs and the rollouts are
+///* (M x N) arrays with a column per step. With a pool (see `set_pool`) the
+///* trajectories are split into `num_chunks` chunks claimed by its threads
+///* and the calling thread, as MPPISolver does. Nothing is allocated once
+///* the batch has had its size.
+class BatchRollout {
+public:
+    ///* The state of a step, in the order of MPC's state
+    enum StateIndex { R_X, R_Y, R_PSI, R_CTE, R_EPSI, STATE_SIZE };
+
+    explicit BatchRollout(const Params & params);
+
+    ///* Waits for the tasks still on the pool
+    ~BatchRollout();
+
+    ///* The chunks of the batch go to the threads of `pool` too, the calling
+    ///* thread doing them all otherwise
+    void set_pool(Eigen::ThreadPoolInterface * pool, size_t num_chunks);
+
+    ///* Rolls `initial` (M x STATE_SIZE) out with the inputs `delta` and `v`
+    ///* (M x N - 1, a column per step) along the polynomial `coeffs`: the
+    ///* states of every step, the initial one included, are then those of
+    ///* `state` (M x N each)
+    void rollout(const Eigen::ArrayXXd & initial, const Eigen::ArrayXXd & delta, const Eigen::ArrayXXd & v,
+                 const Eigen::VectorXd & coeffs);
+
+    const Eigen::ArrayXXd & state(StateIndex i) const { return m_states[i]; }
+
+    size_t trajectories() const { return m_M; }
+    size_t steps() const { return m_N; }
+
+private:
+    ///* The chunks, claimed until there are none left
+    void work();
+    ///* Rolls the trajectories [begin, end) out
+    void rollout_range(size_t begin, size_t end);
+
+    double m_dt;
+    size_t m_M;
+    size_t m_N;
+
+    ///* The batch being rolled out
+    const Eigen::ArrayXXd * m_initial;
+    const Eigen::ArrayXXd * m_delta;
+    const Eigen::ArrayXXd * m_v;
+    Eigen::VectorXd m_coeffs;
+
+    Eigen::ArrayXXd m_states[STATE_SIZE];
+    ///* The reference and its slope at the x of the step, per trajectory
+    Eigen::ArrayXd m_f;
+    Eigen::ArrayXd m_slope;
+
+    Eigen::ThreadPoolInterface * m_pool;
+    size_t m_num_chunks;
+    ///* Those of the current batch
+    size_t m_chunks;
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_done;
+    std::atomic<size_t> m_outstanding;
+};
@@ -0,0 +1,62 @@
+#include <thread>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "BatchSolver.h"
+#include "ParallelCppAD.h"
+#include "Trace.h"
+
+
+BatchSolver::BatchSolver(const Params & params, int num_threads) : m_pending(0) {
+    if (num_threads <= 0)
+        num_threads = std::max(int(std::thread::hardware_concurrency()), 1);
+    m_pool.reset(new Eigen::NonBlockingThreadPool(num_threads));
+    ParallelCppAD::setup(m_pool.get());
+
+    // A controller per thread of the pool, each of them solved only there
+    Params batch_params = params;
+    batch_params.warm_start = false;
+    for (int i=0; i < num_threads; i++)
+        m_controllers.emplace_back(new MPC(batch_params));
+}
+
+
+// The controllers go first: the pool waits for its threads (which are idle
+// between the batches)
+BatchSolver::~BatchSolver() {
+    m_controllers.clear();
+    ParallelCppAD::release(m_pool.get());
+    m_pool.reset();
+}
+
+
+void BatchSolver::Solve(const BatchProblem * problems, size_t n, BatchSolution * solutions) {
+    if (n == 0)
+        return;
+
+    ParallelCppAD::Section parallel;
+    m_pending = n;
+    for (size_t i=0; i < n; i++) {
+        m_pool->Schedule([this, problems, solutions, i]() {
+            {
+                MPC_TRACE_SCOPE("BatchSolver::problem");
+                MPC & controller = *m_controllers[m_pool->CurrentThreadId()];
+                const BatchProblem & problem = problems[i];
+                controller.Solve(problem.state, problem.coeffs, problem.ref_v, solutions[i].result);
+                solutions[i].stats = controller.stats();
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0)
+                m_done.notify_one();
+        });
+    }
+
+    MPC_TRACE_SCOPE("BatchSolver::wait");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_pending == 0; });
+}
+
+
+void BatchSolver::Solve(const std::vector<BatchProblem> & problems, std::vector<BatchSolution> & solutions) {
+    solutions.resize(problems.size());
+    Solve(problems.data(), problems.size(), solutions.data());
+}
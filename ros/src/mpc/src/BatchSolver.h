@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* One of the independent problems of a batch (see BatchSolver)
+struct BatchProblem {
+    Eigen::VectorXd state;
+    Eigen::VectorXd coeffs;
+    double ref_v = 0.0;
+};
+
+
+///* Its solution: what `MPC::Solve` returns, and how the solve went
+struct BatchSolution {
+    std::vector<double> result;
+    SolveStats stats;
+};
+
+
+///* Solves many independent problems on a (work-stealing) thread pool, for
+///* the offline tools (the tuning, the explicit MPC's table): every thread
+///* has an MPC of its own, with its own tape, and takes the next problem as
+///* it's done with one, so the throughput scales with the threads.
+///*
+///* The problems are independent, so they aren't warm started from each
+///* other (`warm_start` is off), and a solution doesn't depend on the thread
+///* that solved it. Solutions that have the right size already aren't
+///* reallocated.
+///*
+///* CppAD is set up for the threads of the pool (see ParallelCppAD), which
+///* take thread numbers of their own: several BatchSolvers (and pipelines)
+///* can solve side by side.
+class BatchSolver {
+public:
+    ///* `num_threads` of 0: one per core
+    BatchSolver(const Params & params, int num_threads = 0);
+    ~BatchSolver();
+
+    ///* Solves `problems[0 ... n)` into `solutions[0 ... n)`, returns once
+    ///* all of them are solved
+    void Solve(const BatchProblem * problems, size_t n, BatchSolution * solutions);
+
+    ///* The same, into `solutions` (resized to the problems)
+    void Solve(const std::vector<BatchProblem> & problems, std::vector<BatchSolution> & solutions);
+
+    int num_threads() const { return int(m_controllers.size()); }
+
+private:
+    std::unique_ptr<Eigen::ThreadPoolInterface> m_pool;
+    std::vector<std::unique_ptr<MPC> > m_controllers;
+
+    ///* The problems still solving
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    size_t m_pending;
+};
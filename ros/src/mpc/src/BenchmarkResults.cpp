@@ -0,0 +1,72 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "BenchmarkResults.h"
+#include "Log.h"
+
+
+static const char * const HEADER = "tick,solve_ms,min_ms,max_ms,iterations,steer,speed";
+
+
+bool BenchmarkResults::save(const std::string & path) const {
+    FILE * file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        MPC_ERROR("Could not write the results to %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    std::fprintf(file, "# log %s repeats %lu\n%s\n", log.c_str(), repeats, HEADER);
+    for (const BenchmarkTick & tick : ticks)
+        std::fprintf(file, "%lu,%.6f,%.6f,%.6f,%d,%.17g,%.17g\n", tick.tick, 1e3 * tick.solve_time,
+                     1e3 * tick.min_time, 1e3 * tick.max_time, tick.iterations, tick.steer, tick.speed);
+    bool OK = (std::fclose(file) == 0);
+    if (!OK)
+        MPC_ERROR("Could not write the results to %s", path.c_str());
+    return OK;
+}
+
+
+bool BenchmarkResults::load(const std::string & path) {
+    FILE * file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        MPC_ERROR("Could not read the results of %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    char line[4096];
+    log.clear();
+    repeats = 0;
+    ticks.clear();
+    bool OK = true;
+    size_t number = 0;
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+        number++;
+        if (line[0] == '#') {
+            char name[sizeof(line)];
+            unsigned long count;
+            if (std::sscanf(line, "# log %4095s repeats %lu", name, &count) == 2) {
+                log = name;
+                repeats = count;
+            }
+            continue;
+        }
+        if (std::strncmp(line, HEADER, std::strlen(HEADER)) == 0)
+            continue;
+
+        BenchmarkTick tick;
+        unsigned long number_of_tick;
+        if (std::sscanf(line, "%lu,%lf,%lf,%lf,%d,%lf,%lf", &number_of_tick, &tick.solve_time, &tick.min_time,
+                        &tick.max_time, &tick.iterations, &tick.steer, &tick.speed) != 7) {
+            MPC_ERROR("%s:%lu: not a tick of the results", path.c_str(), number);
+            OK = false;
+            break;
+        }
+        tick.tick = number_of_tick;
+        tick.solve_time *= 1e-3;
+        tick.min_time *= 1e-3;
+        tick.max_time *= 1e-3;
+        ticks.push_back(tick);
+    }
+    std::fclose(file);
+    return OK;
+}
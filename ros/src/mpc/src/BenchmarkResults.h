@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+///* The results of a benchmark replay of a flight log (mpc_replay --results),
+///* which mpc_bench_compare compares with those of another build or
+///* configuration: for every tick solved, its solve time over the repeats of
+///* the replay, the solver's iterations and the first actuations.
+///*
+///* Saved as CSV, after a line of `#` comments with the log and the number
+///* of repeats, so that they can be plotted as they are.
+struct BenchmarkTick {
+    uint64_t tick;
+    ///* The median, the fastest and the slowest solve times [s]
+    double solve_time;
+    double min_time;
+    double max_time;
+    ///* -1 if not known
+    int iterations;
+    double steer;
+    double speed;
+};
+
+
+struct BenchmarkResults {
+    std::string log;
+    size_t repeats = 0;
+    std::vector<BenchmarkTick> ticks;
+
+    ///* False (and logs why) if the file can't be written or read
+    bool save(const std::string & path) const;
+    bool load(const std::string & path);
+};
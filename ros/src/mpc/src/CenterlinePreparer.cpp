@@ -0,0 +1,58 @@
+#include "CenterlinePreparer.h"
+#include "SharedCenterlines.h"
+
+
+CenterlinePreparer::CenterlinePreparer()
+        : m_stop(false), m_submitted(false), m_submitted_hash(0), m_submitted_points(0)
+{
+    m_thread = std::thread(&CenterlinePreparer::loop, this);
+}
+
+
+CenterlinePreparer::~CenterlinePreparer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+
+void CenterlinePreparer::submit(const std::shared_ptr<Centerline> & centerline, const Params & params) {
+    m_submitted = true;
+    m_submitted_hash = centerline->hash;
+    m_submitted_points = centerline->pts_x.size();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = centerline;
+        m_pending_params = params;
+    }
+    m_cv.notify_one();
+}
+
+
+std::shared_ptr<const Centerline> CenterlinePreparer::take() {
+    // Nothing to swap most of the time
+    if (!std::atomic_load(&m_ready))
+        return nullptr;
+    return std::atomic_exchange(&m_ready, std::shared_ptr<const Centerline>());
+}
+
+
+void CenterlinePreparer::loop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_stop or m_pending; });
+        if (m_stop)
+            return;
+        std::shared_ptr<Centerline> centerline = std::move(m_pending);
+        m_pending.reset();
+        Params params = m_pending_params;
+        lock.unlock();
+
+        // A prepared one that wasn't taken yet is replaced by this one
+        std::atomic_store(&m_ready, SharedCenterlines::share(centerline, params));
+    }
+}
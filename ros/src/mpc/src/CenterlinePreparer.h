@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "MPC.h"
+#include "PathTracker.h"
+
+
+///* Prepares the new paths (the spline, the indexes, the corridor, the speed
+///* profile, ... see `SharedCenterlines::share`) on a thread of its own, so
+///* that the callback a path arrives in doesn't hold up those of the poses
+///* (see `Params::background_centerline`).
+///*
+///* A path submitted while another one is being prepared takes the place of
+///* any that's still waiting: only the latest is of any use. A prepared one
+///* is a whole snapshot that nothing changes anymore, handed over through
+///* an atomic swap of its pointer, which `take` never waits on; the solves
+///* that started with the one it replaces keep theirs until they finish.
+class CenterlinePreparer {
+public:
+    CenterlinePreparer();
+    ~CenterlinePreparer();
+
+    ///* Prepares `centerline` for the fit of `params`
+    void submit(const std::shared_ptr<Centerline> & centerline, const Params & params);
+
+    ///* The last centerline prepared, when there's one since the last call
+    ///* (nullptr otherwise)
+    std::shared_ptr<const Centerline> take();
+
+    ///* Whether the path (by its hash and size) is that of the last one
+    ///* submitted; not synchronized, as `submit` (see MPCControllerNode's
+    ///* `m_inputs_mutex`)
+    bool submitted(uint64_t hash, size_t num_points) const {
+        return m_submitted and m_submitted_hash == hash and m_submitted_points == num_points;
+    }
+
+private:
+    void loop();
+
+    ///* The path waiting to be prepared and its parameters
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::shared_ptr<Centerline> m_pending;
+    Params m_pending_params;
+    bool m_stop;
+    std::thread m_thread;
+
+    ///* The last one prepared, until it's taken (only through the atomic
+    ///* functions of shared_ptr)
+    std::shared_ptr<const Centerline> m_ready;
+
+    bool m_submitted;
+    uint64_t m_submitted_hash;
+    size_t m_submitted_points;
+};
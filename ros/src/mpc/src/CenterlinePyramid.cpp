@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cmath>
+
+#include "CenterlinePyramid.h"
+
+
+const size_t CenterlinePyramid::FACTOR;
+
+
+void CenterlinePyramid::build(const PathSpline & spline, double spacing, size_t num_levels) {
+    m_levels.clear();
+    m_closed = spline.closed();
+    double length = spline.length();
+    if (spline.empty() or !(spacing > 0.0) or !(length > 0.0))
+        return;
+
+    // Whole numbers of samples, so that a closed path's wrap around evenly
+    // and an open path's end on its last point
+    double target = spacing;
+    for (size_t l=0; l < num_levels; l++, target *= FACTOR) {
+        size_t num_samples = std::max(size_t(std::round(length / target)), size_t(1));
+        if (!m_closed)
+            num_samples++;
+        if (num_samples < 2)
+            break;
+        m_levels.emplace_back();
+        Level & level = m_levels.back();
+        level.spacing = length / (m_closed ? num_samples : num_samples - 1);
+        level.x.resize(num_samples);
+        level.y.resize(num_samples);
+        for (size_t i=0; i < num_samples; i++)
+            spline.position(i * level.spacing, level.x[i], level.y[i]);
+    }
+}
+
+
+void CenterlinePyramid::reduce_corridor() {
+    if (m_levels.empty())
+        return;
+    const Level & fine = m_levels.front();
+    for (size_t l=1; l < m_levels.size(); l++) {
+        // The fine samples within half a coarse spacing of the coarse one
+        Level & level = m_levels[l];
+        level.left.resize(level.x.size());
+        level.right.resize(level.x.size());
+        long half = long(std::ceil(0.5 * level.spacing / fine.spacing));
+        for (size_t i=0; i < level.x.size(); i++) {
+            long center = long(std::round(i * level.spacing / fine.spacing));
+            double left = fine.left[wrap(0, center)], right = fine.right[wrap(0, center)];
+            for (long j=center - half; j <= center + half; j++) {
+                left = std::min(left, fine.left[wrap(0, j)]);
+                right = std::min(right, fine.right[wrap(0, j)]);
+            }
+            level.left[i] = left;
+            level.right[i] = right;
+        }
+    }
+}
+
+
+long CenterlinePyramid::first_at(size_t level, double s) const {
+    return long(std::ceil(s / m_levels[level].spacing - 1e-9));
+}
+
+
+size_t CenterlinePyramid::wrap(size_t level, long index) const {
+    long size = long(m_levels[level].x.size());
+    if (m_closed)
+        return size_t((index % size + size) % size);
+    return size_t(std::min(std::max(index, 0L), size - 1));
+}
+
+
+size_t CenterlinePyramid::level_for(double spacing) const {
+    size_t level = 0;
+    while (level + 1 < m_levels.size() and m_levels[level + 1].spacing <= spacing)
+        level++;
+    return level;
+}
+
+
+void CenterlinePyramid::corridor(size_t level, double s, double & left, double & right) const {
+    const Level & samples = m_levels[level];
+    size_t i = wrap(level, long(std::round(s / samples.spacing)));
+    left = samples.left[i];
+    right = samples.right[i];
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "PathSpline.h"
+
+
+///* The centerline at several resolutions (see `Params::pyramid_levels`),
+///* built once per path: level 0 samples the spline of the path evenly at
+///* about the spacing of its waypoints, and every next level FACTOR times
+///* as sparsely (5 cm, 20 cm, 80 cm... for waypoints 5 cm apart). A window
+///* of the fit then takes its near points from the fine level and its far
+///* ones from the coarse levels, and the corridor of a far stage of the
+///* horizon comes from a coarse level, so both cost the same whatever how
+///* far ahead they reach.
+///*
+///* The samples of a level are indexed by the arc length along the path
+///* (at `spacing(level)` from one to the next), so a lookup is a division,
+///* without a search. On a closed path the indexes wrap around, otherwise
+///* they're clamped to the ends. With the corridor, a sample of a coarse
+///* level has the narrowest room of the fine samples it spans, so reading
+///* it never widens the corridor.
+class CenterlinePyramid {
+public:
+    struct Level {
+        double spacing = 0.0; // [m]
+        std::vector<double> x;
+        std::vector<double> y;
+        ///* The room on either side [m] (empty without the corridor)
+        std::vector<double> left;
+        std::vector<double> right;
+    };
+
+    ///* Samples `spline` at about `spacing` [m] on level 0 and more sparsely
+    ///* on the `num_levels - 1` next ones (as long as they have two samples
+    ///* or more), without the corridor
+    void build(const PathSpline & spline, double spacing, size_t num_levels);
+
+    ///* The corridor of the coarse levels from that of level 0, whose
+    ///* `left` and `right` the caller has filled in (see `fine_level`)
+    void reduce_corridor();
+
+    bool empty() const { return m_levels.empty(); }
+    size_t num_levels() const { return m_levels.size(); }
+    bool closed() const { return m_closed; }
+    double spacing(size_t level) const { return m_levels[level].spacing; }
+    const Level & level(size_t level) const { return m_levels[level]; }
+    Level & fine_level() { return m_levels.front(); }
+    bool has_corridor() const { return !m_levels.empty() and !m_levels.front().left.empty(); }
+
+    ///* The index on `level` of the first sample at or past `s` [m] (not
+    ///* wrapped: see `wrap`)
+    long first_at(size_t level, double s) const;
+    ///* The sample `index` of `level`, wrapped around the path or clamped
+    ///* to its ends
+    size_t wrap(size_t level, long index) const;
+
+    ///* The coarsest level whose samples are at most `spacing` [m] apart
+    ///* (level 0 when none is)
+    size_t level_for(double spacing) const;
+
+    ///* The room [m] on either side at `s` [m], from the sample of `level`
+    ///* nearest to it; only with the corridor
+    void corridor(size_t level, double s, double & left, double & right) const;
+
+    static const size_t FACTOR = 4;
+
+private:
+    std::vector<Level> m_levels;
+    bool m_closed = false;
+};
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "CompactTrack.h"
+
+
+constexpr size_t CompactTrack::TILE_POINTS;
+constexpr double CompactTrack::MIN_QUANTUM;
+
+
+void CompactTrack::build(const std::vector<double> & pts_x, const std::vector<double> & pts_y) {
+    size_t num_points = std::min(pts_x.size(), pts_y.size());
+    m_tiles.resize((num_points + TILE_POINTS - 1) / TILE_POINTS);
+    m_dx.resize(num_points);
+    m_dy.resize(num_points);
+    for (size_t t=0; t < m_tiles.size(); t++)
+        encode(pts_x, pts_y, t);
+}
+
+
+void CompactTrack::update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t first,
+                          size_t count) {
+    if (count == 0)
+        return;
+    for (size_t t = first / TILE_POINTS; t <= (first + count - 1) / TILE_POINTS and t < m_tiles.size(); t++)
+        encode(pts_x, pts_y, t);
+}
+
+
+void CompactTrack::encode(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t t) {
+    size_t begin = t * TILE_POINTS;
+    size_t end = std::min(begin + TILE_POINTS, m_dx.size());
+    Tile & tile = m_tiles[t];
+    tile.x0 = pts_x[begin];
+    tile.y0 = pts_y[begin];
+    double span = 0.0;
+    for (size_t i=begin; i < end; i++)
+        span = std::max(span, std::max(std::abs(pts_x[i] - tile.x0), std::abs(pts_y[i] - tile.y0)));
+    tile.quantum = std::max(MIN_QUANTUM, span / INT16_MAX);
+    for (size_t i=begin; i < end; i++) {
+        m_dx[i] = int16_t(std::lround((pts_x[i] - tile.x0) / tile.quantum));
+        m_dy[i] = int16_t(std::lround((pts_y[i] - tile.y0) / tile.quantum));
+    }
+}
+
+
+void CompactTrack::point(size_t i, double & x, double & y) const {
+    const Tile & tile = m_tiles[i / TILE_POINTS];
+    x = tile.x0 + tile.quantum * m_dx[i];
+    y = tile.y0 + tile.quantum * m_dy[i];
+}
+
+
+size_t CompactTrack::nearest(size_t first, size_t count, double x, double y, double & dist2) const {
+    typedef Eigen::Map<const Eigen::Array<int16_t, Eigen::Dynamic, 1> > Offsets;
+    size_t num_points = size();
+    size_t best = first % num_points;
+    dist2 = INFINITY;
+
+    // A run of the window within a tile at a time, in the tile's frame and
+    // in its quanta
+    size_t i = first % num_points;
+    while (count > 0) {
+        const Tile & tile = m_tiles[i / TILE_POINTS];
+        size_t n = std::min(std::min(count, TILE_POINTS - i % TILE_POINTS), num_points - i);
+        float px = float((x - tile.x0) / tile.quantum);
+        float py = float((y - tile.y0) / tile.quantum);
+        Offsets dx(m_dx.data() + i, Eigen::Index(n));
+        Offsets dy(m_dy.data() + i, Eigen::Index(n));
+        Eigen::Index k;
+        float run_best = ((dx.cast<float>() - px).square() + (dy.cast<float>() - py).square()).minCoeff(&k);
+        double run_dist2 = double(run_best) * tile.quantum * tile.quantum;
+        if (run_dist2 < dist2) {
+            dist2 = run_dist2;
+            best = i + size_t(k);
+        }
+        count -= n;
+        i = (i + n) % num_points;
+    }
+    return best;
+}
+
+
+size_t CompactTrack::memory() const {
+    return m_tiles.capacity() * sizeof(Tile) + (m_dx.capacity() + m_dy.capacity()) * sizeof(int16_t);
+}
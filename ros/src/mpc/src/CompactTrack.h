@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+///* The waypoints of a path in fixed point (see `Params::compact_waypoints`),
+///* for the scans that touch many of them: in tiles of TILE_POINTS
+///* consecutive waypoints, each one the int16 offset from the first of its
+///* tile, in quanta of the tile's own (MIN_QUANTUM, or coarser for a tile
+///* that spans more than 32767 of those), so 4 bytes a waypoint instead of
+///* the 16 of the doubles.
+///*
+///* The windowed search of the closest waypoint scans them in place: a run
+///* of a tile at a time, as one Eigen expression in float, in the frame and
+///* the quanta of the tile. Nothing is allocated once it's built.
+class CompactTrack {
+public:
+    static constexpr size_t TILE_POINTS = 64;
+    static constexpr double MIN_QUANTUM = 0.001; // [m]
+
+    ///* (Re)encodes the points; it keeps no reference to them
+    void build(const std::vector<double> & pts_x, const std::vector<double> & pts_y);
+
+    ///* ... only the tiles of the points [first, first + count), moved (the
+    ///* same number of them)
+    void update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t first, size_t count);
+
+    bool empty() const { return m_dx.empty(); }
+    size_t size() const { return m_dx.size(); }
+
+    ///* The i-th waypoint, to within half a quantum of its tile
+    void point(size_t i, double & x, double & y) const;
+
+    ///* Of the `count` waypoints from `first` on (past the last, from the
+    ///* first again), the index of the closest to (x, y), the first one of
+    ///* a tie, and the squared distance to it [m^2]
+    size_t nearest(size_t first, size_t count, double x, double y, double & dist2) const;
+
+    ///* The bytes it takes
+    size_t memory() const;
+
+private:
+    struct Tile {
+        double x0;
+        double y0;
+        double quantum;
+    };
+
+    void encode(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t t);
+
+    std::vector<Tile> m_tiles;
+    std::vector<int16_t> m_dx;
+    std::vector<int16_t> m_dy;
+};
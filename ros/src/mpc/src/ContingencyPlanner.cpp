@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cmath>
+
+#include "ContingencyPlanner.h"
+#include "RealTime.h"
+#include "Trace.h"
+
+
+ContingencyPlanner::ContingencyPlanner(const Params & params)
+        : m_decel(params.contingency_decel), m_pending_OK(false), m_pending_brake_after(0.0), m_stop(false)
+{
+    m_thread = std::thread(&ContingencyPlanner::loop, this);
+}
+
+
+ContingencyPlanner::~ContingencyPlanner() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+
+void ContingencyPlanner::submit(const std::shared_ptr<const Centerline> & centerline, double brake_after) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(m_pending, m_source);
+        m_pending_OK = true;
+        m_pending_centerline = centerline;
+        m_pending_brake_after = brake_after;
+    }
+    m_cv.notify_one();
+}
+
+
+void ContingencyPlanner::loop() {
+    Trace::name_thread("contingency");
+    set_thread_background_priority();
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_stop or m_pending_OK; });
+        if (m_stop)
+            return;
+        std::swap(m_working, m_pending);
+        m_pending_OK = false;
+        std::shared_ptr<const Centerline> centerline = std::move(m_pending_centerline);
+        m_pending_centerline.reset();
+        double brake_after = m_pending_brake_after;
+        lock.unlock();
+
+        MPC_TRACE_SCOPE("contingency");
+        make(m_working, centerline.get(), brake_after, m_decel, m_ready.back());
+        m_ready.publish();
+    }
+}
+
+
+// A stage at the end of `contingency`
+static void push_stage(Plan & contingency, double x, double y, double time, double heading, double speed,
+                       double steer_angle) {
+    contingency.x.push_back(x);
+    contingency.y.push_back(y);
+    contingency.time.push_back(time);
+    contingency.heading.push_back(heading);
+    contingency.speed.push_back(speed);
+    contingency.steer_angle.push_back(steer_angle);
+}
+
+
+void ContingencyPlanner::make(const Plan & plan, const Centerline * centerline, double brake_after, double decel,
+                              Plan & contingency) {
+    contingency.OK = false;
+    contingency.x.clear();
+    contingency.y.clear();
+    contingency.time.clear();
+    contingency.heading.clear();
+    contingency.speed.clear();
+    contingency.steer_angle.clear();
+    size_t num_points = plan.time.size();
+    if (!plan.OK or num_points < 2 or decel <= 0.0)
+        return;
+    contingency.stamp = plan.stamp;
+    contingency.pos_x = plan.pos_x;
+    contingency.pos_y = plan.pos_y;
+    contingency.psi = plan.psi;
+
+    // The plan as it is until the braking starts, then the stage it starts
+    // at, between two of the plan's
+    double brake_time = std::min(std::max(brake_after, 0.0), plan.time.back());
+    size_t i = 0;
+    for (; plan.time[i] < brake_time; i++)
+        push_stage(contingency, plan.x[i], plan.y[i], plan.time[i], plan.heading[i], plan.speed[i],
+                   plan.steer_angle[i]);
+    if (i == 0) {
+        push_stage(contingency, plan.x[0], plan.y[0], 0.0, plan.heading[0], plan.speed[0], plan.steer_angle[0]);
+    } else {
+        double step_time = plan.time[i] - plan.time[i - 1];
+        double a = (step_time > 0.0) ? (brake_time - plan.time[i - 1]) / step_time : 0.0;
+        push_stage(contingency, plan.x[i - 1] + a * (plan.x[i] - plan.x[i - 1]),
+                   plan.y[i - 1] + a * (plan.y[i] - plan.y[i - 1]), brake_time, plan.heading[i - 1],
+                   plan.speed[i - 1] + a * (plan.speed[i] - plan.speed[i - 1]),
+                   plan.steer_angle[i - 1] + a * (plan.steer_angle[i] - plan.steer_angle[i - 1]));
+    }
+    size_t brake = contingency.x.size() - 1;
+    double brake_speed = std::max(contingency.speed[brake], 0.0);
+    double stop_distance = brake_speed * brake_speed / (2 * decel);
+    if (brake_speed < 1e-3) {
+        contingency.speed[brake] = 0.0;
+        contingency.OK = brake > 0;
+        return;
+    }
+
+    // The path ahead: the rest of the plan, with its steering angles...
+    double length = 0.0;
+    for (; i < num_points; i++) {
+        double step = std::hypot(plan.x[i] - contingency.x.back(), plan.y[i] - contingency.y.back());
+        if (step <= 0.0)
+            continue;
+        length += step;
+        push_stage(contingency, plan.x[i], plan.y[i], 0.0, 0.0, 0.0, plan.steer_angle[i]);
+    }
+
+    // ... then the waypoints past its end, ahead of the heading of its last
+    // step, with those of the curvature of the path there (by the model's
+    // psi' = -v delta / Lf, as PlanFollower's)
+    size_t track = contingency.x.size();
+    size_t num_waypoints = centerline ? centerline->pts_x.size() : 0;
+    if (length < stop_distance and num_waypoints > 1) {
+        double end_x = plan.x[num_points - 1], end_y = plan.y[num_points - 1];
+        double end_heading = plan.heading[num_points - 2];
+        size_t closest = 0;
+        double closest_dist2 = -1.0;
+        for (size_t k=0; k < num_waypoints; k++) {
+            double dx = centerline->pts_x[k] - end_x, dy = centerline->pts_y[k] - end_y;
+            double dist2 = dx * dx + dy * dy;
+            if (closest_dist2 < 0.0 or dist2 < closest_dist2) {
+                closest = k;
+                closest_dist2 = dist2;
+            }
+        }
+        bool closed = centerline->spline.closed();
+        for (size_t k=0; k < num_waypoints and length < stop_distance; k++) {
+            size_t index = closest + k;
+            if (index >= num_waypoints) {
+                if (!closed)
+                    break;
+                index -= num_waypoints;
+            }
+            double x = centerline->pts_x[index], y = centerline->pts_y[index];
+            if (contingency.x.size() == track
+                    and (x - end_x) * std::cos(end_heading) + (y - end_y) * std::sin(end_heading) <= 0.0)
+                continue;
+            double step = std::hypot(x - contingency.x.back(), y - contingency.y.back());
+            if (step <= 0.0)
+                continue;
+            length += step;
+            push_stage(contingency, x, y, 0.0, 0.0, 0.0, 0.0);
+        }
+        double max_steer = 0.017453 * delta_constraint();
+        size_t size = contingency.x.size();
+        for (size_t k=track; k + 1 < size; k++) {
+            double prev_x = contingency.x[k] - contingency.x[k - 1];
+            double prev_y = contingency.y[k] - contingency.y[k - 1];
+            double next_x = contingency.x[k + 1] - contingency.x[k];
+            double next_y = contingency.y[k + 1] - contingency.y[k];
+            double mean_length = 0.5 * (std::hypot(next_x, next_y) + std::hypot(prev_x, prev_y));
+            double curvature = std::remainder(std::atan2(next_y, next_x) - std::atan2(prev_y, prev_x), 2 * M_PI)
+                    / mean_length;
+            contingency.steer_angle[k] = std::min(std::max(-Lf() * curvature, -max_steer), max_steer);
+        }
+        if (size > track)
+            contingency.steer_angle[size - 1] = contingency.steer_angle[size - 2];
+    }
+
+    // The stop, harder when the path is shorter than it
+    if (length < stop_distance) {
+        if (length <= 0.0) {
+            contingency.speed[brake] = 0.0;
+            contingency.OK = brake > 0;
+            return;
+        }
+        decel = brake_speed * brake_speed / (2 * length);
+        stop_distance = length;
+    }
+    double distance = 0.0;
+    size_t size = contingency.x.size();
+    size_t k = brake + 1;
+    bool stopped = false;
+    for (; k < size and !stopped; k++) {
+        double step = std::hypot(contingency.x[k] - contingency.x[k - 1], contingency.y[k] - contingency.y[k - 1]);
+        contingency.heading[k - 1] = std::atan2(contingency.y[k] - contingency.y[k - 1],
+                                                contingency.x[k] - contingency.x[k - 1]);
+        if (distance + step >= stop_distance) {
+            // Where it stops, on this step
+            double a = (stop_distance - distance) / step;
+            contingency.x[k] = contingency.x[k - 1] + a * (contingency.x[k] - contingency.x[k - 1]);
+            contingency.y[k] = contingency.y[k - 1] + a * (contingency.y[k] - contingency.y[k - 1]);
+            contingency.steer_angle[k] = contingency.steer_angle[k - 1]
+                    + a * (contingency.steer_angle[k] - contingency.steer_angle[k - 1]);
+            contingency.speed[k] = 0.0;
+            contingency.time[k] = brake_time + brake_speed / decel;
+            stopped = true;
+            continue;
+        }
+        distance += step;
+        double speed = std::sqrt(std::max(brake_speed * brake_speed - 2 * decel * distance, 0.0));
+        contingency.speed[k] = speed;
+        contingency.time[k] = brake_time + (brake_speed - speed) / decel;
+    }
+    contingency.x.resize(k);
+    contingency.y.resize(k);
+    contingency.time.resize(k);
+    contingency.heading.resize(k);
+    contingency.speed.resize(k);
+    contingency.steer_angle.resize(k);
+    contingency.heading[k - 1] = contingency.heading[k - 2];
+    // Short of the stop by the rounding of the lengths
+    contingency.speed[k - 1] = 0.0;
+    contingency.time[k - 1] = brake_time + brake_speed / decel;
+    contingency.OK = true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "MPC.h"
+#include "PathTracker.h"
+#include "PlanFollower.h"
+#include "TripleBuffer.h"
+
+
+///* The stop of the car when the solver loop can't drive it anymore (see
+///* `Params::contingency_decel`): a trajectory kept ready at all times, so
+///* that nothing is computed on the tick that needs it.
+///*
+///* Every plan of the solver loop is handed over (`submit`) to a thread of
+///* its own, at the lowest priority of the system (SCHED_IDLE), which makes
+///* its contingency: the plan as it is until the next tick's (`brake_after`
+///* [s] from its start, when the one of the next tick would take over), then
+///* along what's left of it and on along the waypoints of the path past its
+///* end, slowing down at `contingency_decel` [m/s^2] to a stop (harder when
+///* the path ends before). It's a Plan like the solver's, which the loops
+///* follow as they do those (see `plan_inputs_at`), open-loop: the switch to
+///* it is a swap of the plan they read.
+///*
+///* A plan submitted while the previous one is still being worked on takes
+///* the place of any that's waiting: only the latest is of any use.
+class ContingencyPlanner {
+public:
+    ContingencyPlanner(const Params & params);
+    ~ContingencyPlanner();
+
+    ///* Where the plan of a tick goes before it's submitted (the solver
+    ///* loop's, as `submit`)
+    Plan & source() { return m_source; }
+
+    ///* Makes the contingency of `source()` (whose contents it swaps out),
+    ///* along `centerline` past its end
+    void submit(const std::shared_ptr<const Centerline> & centerline, double brake_after);
+
+    ///* The reader's side (the solver loop's): `update` makes the latest
+    ///* contingency, when there's a new one (then it returns true), the
+    ///* `front()`
+    bool update() { return m_ready.update(); }
+    const Plan & front() const { return m_ready.front(); }
+
+    ///* The contingency of `plan` into `contingency`, along the waypoints of
+    ///* `centerline` (if any) past its end
+    static void make(const Plan & plan, const Centerline * centerline, double brake_after, double decel,
+                     Plan & contingency);
+
+private:
+    void loop();
+
+    double m_decel;
+
+    ///* The solver loop's
+    Plan m_source;
+
+    ///* The plan waiting to be worked on, and what it needs
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Plan m_pending;
+    bool m_pending_OK;
+    std::shared_ptr<const Centerline> m_pending_centerline;
+    double m_pending_brake_after;
+    bool m_stop;
+    std::thread m_thread;
+
+    ///* The thread's
+    Plan m_working;
+
+    TripleBuffer<Plan> m_ready;
+};
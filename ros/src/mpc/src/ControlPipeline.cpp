@@ -0,0 +1,1340 @@
+#include <math.h> /* floor, abs */
+#include <cmath> /* atan2, M_PI */
+#include <algorithm>
+#include <cassert>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "ControlPipeline.h"
+#include "ParallelCppAD.h"
+#include "SolverBackend.h"
+#include "SolverCalibration.h"
+#include "AllocationCounter.h"
+#include "Log.h"
+#include "MemoryStats.h"
+#include "PerfCounters.h"
+#include "Instrumentation.h"
+#include "Trace.h"
+
+
+constexpr double ControlPipeline::CENTER_IN_DZIK;
+constexpr double ControlPipeline::MAX_MEASURED_LATENCY;
+constexpr double ControlPipeline::PROJECTION_STEP;
+constexpr double ControlPipeline::TICK_TIME_ALPHA;
+constexpr double ControlPipeline::SPECULATION_MIN_STEP;
+constexpr double ControlPipeline::HORIZON_HYSTERESIS;
+constexpr uint64_t ControlPipeline::ALLOCATION_CHECK_WARMUP;
+
+
+// Time [s] since `start`, which moves on to now: the time of the stage
+// `name` that just ended (which is traced too)
+static float end_stage(std::chrono::steady_clock::time_point & start, const char * name) {
+    auto now = std::chrono::steady_clock::now();
+    float elapsed = std::chrono::duration<float>(now - start).count();
+    if (Trace::enabled())
+        Trace::complete(name, std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(),
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+    start = now;
+    return elapsed;
+}
+
+
+// The hardware counts of the calling thread since `start`, which moves on to
+// now, as those of the stage that just ended
+static void end_stage_counts(PerfCounts & start, TelemetryRecord & record, TelemetryRecord::Stage stage) {
+    PerfCounts now = PerfCounters::thread().read();
+    record.stage_counts[stage] = now - start;
+    start = now;
+}
+
+
+// The CPU time of the calling thread since `start`, which moves on to now,
+// as that of the stage that just ended
+static void end_stage_cpu_time(double & start, TelemetryRecord & record, TelemetryRecord::Stage stage) {
+    double now = thread_cpu_time();
+    record.stage_cpu_time[stage] = float(now - start);
+    start = now;
+}
+
+
+// The polynomial `coeffs` (lowest order first) of a frame, in that of a car
+// at (dx, dy) in it and turned by dpsi: shifted along x exactly (by Horner's
+// scheme) and along y, and turned to first order in dpsi (dropping the
+// term of the cte times the slope, small where the fit is reused)
+static void move_fit(const Eigen::VectorXd & coeffs, double dx, double dy, double dpsi, Eigen::VectorXd & moved) {
+    moved = coeffs;
+    Eigen::Index n = moved.size();
+    for (Eigen::Index i=0; i + 1 < n; i++)
+        for (Eigen::Index j = n - 2; j >= i; j--)
+            moved[j] += dx * moved[j + 1];
+    if (n > 0)
+        moved[0] -= dy;
+    if (n > 1)
+        moved[1] -= dpsi;
+}
+
+
+ControlPipeline::ControlPipeline(const Params & params, Eigen::ThreadPoolInterface * pool)
+        : m_params(params), m_pid(params), m_tracker(params)
+{
+    // A thread per parallel variant, or per chunk of the derivatives (of
+    // the stages, or of the samples) but the solving thread's, set up before anything
+    // tapes (unless the threads are shared)
+    m_pool = pool;
+    size_t num_variants = params.parallel_ref_v_scales.size() + (params.parallel_cold_start ? 1 : 0)
+            + params.reference_offsets.size();
+    size_t num_threads = std::max(num_variants, size_t(std::max(params.parallel_derivatives - 1, 0)));
+    num_threads = std::max(num_threads, size_t(std::max(params.parallel_stages - 1, 0)));
+    if (backend_name(params) == "mppi")
+        num_threads = std::max(num_threads, size_t(std::max(params.mppi_threads - 1, 0)));
+    if (m_pool == nullptr and num_threads > 0) {
+        m_own_pool.reset(new Eigen::NonBlockingThreadPool(int(num_threads)));
+        m_pool = m_own_pool.get();
+        ParallelCppAD::setup(m_pool);
+    }
+
+    m_pid_only = (params.controller == "pid");
+    m_pid_stats.ok = true;
+    // The reference lines are fits of the centerline's, solved by the one
+    // horizon, locally
+    if (!m_params.reference_offsets.empty()) {
+        const char * conflict = m_pid_only ? "the PID law"
+                : !m_params.adaptive_horizons.empty() ? "adaptive_horizons"
+                : m_params.contouring_reference ? "contouring_reference"
+                : !m_params.remote_solver.empty() ? "remote_solver" : nullptr;
+        if (conflict != nullptr) {
+            MPC_WARN("reference_offsets doesn't work with %s, ignoring it", conflict);
+            m_params.reference_offsets.clear();
+        }
+    }
+    // The backends and the horizons are chosen among the same controllers
+    if (!m_params.predicted_backends.empty() and (m_pid_only or !m_params.adaptive_horizons.empty())) {
+        MPC_WARN("predicted_backends doesn't work with %s, ignoring it",
+                 m_pid_only ? "the PID law" : "adaptive_horizons");
+        m_params.predicted_backends.clear();
+    }
+    build_controllers(params.warmup_solves);
+    size_t max_steps_ahead = params.steps_ahead;
+    for (int steps_ahead : m_params.adaptive_horizons)
+        max_steps_ahead = std::max(max_steps_ahead, size_t(steps_ahead));
+
+    m_ref_v = params.ref_v;
+    m_ref_v_alpha = params.ref_v_alpha;
+    m_new_ref_v = m_ref_v;
+    m_latency = params.latency;
+    m_measured_latency = (params.latency_mode == "measured");
+    m_align_inputs = params.align_inputs;
+    m_align_max_extrapolation = params.align_max_extrapolation;
+    m_dead_reckoning = params.dead_reckoning;
+    m_dead_reckoning_max_age = params.dead_reckoning_max_age;
+    m_perf_counters = params.perf_counters;
+    m_cpu_time = params.cpu_time;
+    m_fit_reuse_distance = params.fit_reuse_distance;
+    m_fit_reuse_angle = params.fit_reuse_angle;
+    m_fit_anchor.coeffs.resize(params.poly_degree + 1);
+    m_tick_time_estimate = -1.0;
+    m_pipelined = params.pipelined;
+
+    // At a fixed rate, the solve has to be done by the next tick
+    m_time_budget = params.solve_deadline;
+    m_fixed_time_budget = (params.solve_deadline > 0.0);
+    m_cancel = nullptr;
+    if (m_time_budget <= 0.0 and params.scheduler != "pose")
+        m_time_budget = 1.0 / params.loop_rate;
+
+    // The buffers of a tick, and whether debug builds check that they're all
+    // it needs: with an allocation-free solver, and a polynomial fit on the
+    // fixed-size kernels
+    m_state = Eigen::VectorXd::Zero(5);
+    m_vars.reserve(2 + 2 * max_steps_ahead);
+    m_max_steps_ahead = max_steps_ahead;
+    m_ticks_solved = 0;
+    m_check_allocations = AllocationCounter::available() and (m_pid_only or controller().allocation_free())
+            and (!m_candidates or m_candidates->allocation_free()) and m_tracker.poly_degree() <= 3;
+    m_cache.reset(size_t(std::max(params.solution_cache_size, 1)), params.solution_cache_tolerance,
+                  2 + 2 * max_steps_ahead);
+    m_cache_enabled = (params.solution_cache_size > 0);
+    if (m_cache_enabled and params.corridor_width > 0.0) {
+        MPC_WARN("The solution cache doesn't tell the corridors of the problems apart, ignoring it");
+        m_cache_enabled = false;
+    }
+    if (m_cache_enabled and params.max_obstacles > 0) {
+        MPC_WARN("The solution cache doesn't tell the obstacles of the problems apart, ignoring it");
+        m_cache_enabled = false;
+    }
+    if (m_cache_enabled and m_candidates) {
+        MPC_WARN("The solution cache doesn't keep the solutions of the reference lines, ignoring it");
+        m_cache_enabled = false;
+    }
+
+    // The slots of the obstacles, filled in by every solve
+    if (params.max_obstacles > 0 and !m_pid_only) {
+        m_obstacles.reset(new ObstacleSelector(params, max_steps_ahead));
+        m_plan_x.reserve(max_steps_ahead);
+        m_plan_y.reserve(max_steps_ahead);
+    }
+    m_cached_stats.ok = true;
+
+    // The speculative solve has a thread of its own, so that it runs while
+    // the node waits for the next tick
+    m_speculative = params.speculative_solve and !m_pid_only;
+    if (m_speculative and m_pipelined) {
+        MPC_WARN("speculative_solve and pipelined hide the same time, ignoring speculative_solve");
+        m_speculative = false;
+    }
+    if (m_speculative and m_obstacles) {
+        MPC_WARN("speculative_solve can't tell where the obstacles will be, ignoring it");
+        m_speculative = false;
+    }
+    if (m_speculative and m_candidates) {
+        MPC_WARN("speculative_solve only speculates about the centerline, ignoring it");
+        m_speculative = false;
+    }
+    m_speculation_pool = pool;
+    if (m_speculative and m_speculation_pool == nullptr) {
+        m_own_speculation_pool.reset(new Eigen::NonBlockingThreadPool(1));
+        m_speculation_pool = m_own_speculation_pool.get();
+    }
+    m_speculative_tolerance = params.speculative_tolerance;
+    m_speculative_heading_tolerance = params.speculative_heading_tolerance;
+    m_speculative_controller = 0;
+    m_speculative_x = m_speculative_y = m_speculative_psi = 0.0;
+    m_speculative_state = Eigen::VectorXd::Zero(5);
+    m_speculative_ref_v = 0.0;
+    m_speculative_vars.reserve(2 + 2 * max_steps_ahead);
+    m_speculation_OK = false;
+    m_speculating = false;
+
+    // The remote solves, alongside the node's own; their results may be
+    // longer than the local horizon's
+    m_remote_timeout = params.remote_timeout;
+    m_remote_reset = true;
+    if (!params.remote_solver.empty() and !m_pid_only) {
+        if (m_obstacles or params.corridor_width > 0.0) {
+            MPC_WARN("remote_solver isn't sent the obstacles nor the corridor, ignoring it");
+        } else {
+            m_remote.reset(new RemoteSolver());
+            if (m_remote->open(params.remote_solver))
+                m_vars.reserve(RemoteReply::MAX_VARS);
+            else
+                m_remote.reset();
+        }
+    }
+    if (params.validate_plan and !m_pid_only)
+        m_validator.reset(new PlanValidator(params, max_steps_ahead, controller().speed_upperbound()));
+
+    // The states of the previous laps, which the terminal cost targets
+    if (params.learning_mpc and !m_pid_only) {
+        if (!params.terminal_cost or !params.lap_progress) {
+            MPC_WARN("learning_mpc needs terminal_cost and lap_progress, ignoring it");
+        } else {
+            m_safe_set.reset(new SampledSafeSet(size_t(std::max(params.safe_set_size, 1)),
+                                                size_t(std::max(params.safe_set_neighbors, 1))));
+            if (m_cache_enabled) {
+                MPC_WARN("The solution cache doesn't tell the targets of learning_mpc apart, ignoring it");
+                m_cache_enabled = false;
+            }
+        }
+    }
+
+    // The plans of the previous laps, with room for the largest layout of
+    // the controllers
+    if (params.lap_warm_start and !m_pid_only) {
+        if (!params.lap_progress or !params.warm_start) {
+            MPC_WARN("lap_warm_start needs lap_progress and warm_start, ignoring it");
+        } else {
+            size_t max_size = 0;
+            for (const std::unique_ptr<MultiStartSolver> & solver : m_controllers)
+                max_size = std::max(max_size, solver->chosen_controller().num_vars());
+            m_lap_warm_starts.reset(new LapWarmStarts(size_t(std::max(params.lap_warm_start_bins, 1)), max_size));
+        }
+    }
+
+    // CppAD's pool, once the controllers have taped
+    if (params.cppad_reserve_mb > 0.0)
+        reserve_cppad_memory(size_t(params.cppad_reserve_mb * (1 << 20)));
+    m_cppad_cap = size_t(std::max(params.cppad_cap_mb, 0.0) * (1 << 20));
+    if (m_cppad_cap > 0 and m_speculative) {
+        MPC_WARN("cppad_cap_mb can't free CppAD's memory while the speculative solve runs, ignoring it");
+        m_cppad_cap = 0;
+    }
+    // Memory given back is allocated again
+    if (m_cppad_cap > 0)
+        m_check_allocations = false;
+    m_plan_OK = false;
+    m_solved_plan_OK = false;
+    m_stamp_lat = 0.0;
+
+    ///* Actuators
+    m_steer = CENTER_IN_DZIK;
+    m_steer_angle = 0.0;
+    m_rpm = 0;
+
+    m_pos_x_lat = 0.0;
+    m_pos_y_lat = 0.0;
+    m_psi_lat = 0.0;
+}
+
+
+// The controllers go first: the pool waits for its threads (which are idle
+// between the solves)
+ControlPipeline::~ControlPipeline() {
+    finish_speculation();
+    m_own_speculation_pool.reset();
+    m_controllers.clear();
+    if (m_own_pool)
+        ParallelCppAD::release(m_own_pool.get());
+    m_own_pool.reset();
+}
+
+
+void ControlPipeline::build_controllers(int warmup_solves) {
+    // All the controllers are built here, so that switching between them
+    // never tapes nor allocates; their MPCs all at once with parallel_build
+    ParallelBuild parallel_build;
+    ParallelBuild * build = m_params.parallel_build ? &parallel_build : nullptr;
+    m_controllers.clear();
+    m_horizon_speeds.clear();
+    m_active = 0;
+    // The PID law needs none of them
+    if (m_pid_only)
+        return;
+    // Once, for the horizon of `steps_ahead`
+    if (m_params.calibrate_ipopt) {
+        calibrate_ipopt(m_params, std::vector<double>());
+    } else if (m_params.calibrate_linear_solver) {
+        m_params.linear_solver = fastest_linear_solver(m_params);
+        m_params.calibrate_linear_solver = false;
+    }
+    // The backends of the predictor, in their order of preference
+    std::vector<std::string> backends;
+    for (size_t start=0; start < m_params.predicted_backends.size();) {
+        size_t end = std::min(m_params.predicted_backends.find(',', start), m_params.predicted_backends.size());
+        if (end > start)
+            backends.push_back(m_params.predicted_backends.substr(start, end - start));
+        start = end + 1;
+    }
+    m_predictor.reset();
+    m_previous_controller = 0;
+    m_previous_iterations = -1;
+    m_previous_cte = m_previous_epsi = 0.0;
+    if (!backends.empty()) {
+        m_predictor.reset(new SolveTimePredictor());
+        if (m_params.solve_time_model.empty()) {
+            MPC_WARN("predicted_backends needs solve_time_model, ignoring it");
+            m_predictor.reset();
+        } else if (!m_predictor->load(m_params.solve_time_model, backends)) {
+            MPC_WARN("Could not load the solve times of predicted_backends, ignoring it");
+            m_predictor.reset();
+        }
+    }
+    bool adaptive = !m_params.adaptive_horizons.empty();
+    if (adaptive and m_params.adaptive_horizon_speeds.size() + 1 != m_params.adaptive_horizons.size()) {
+        MPC_WARN("%lu adaptive_horizon_speeds for %lu adaptive_horizons, using steps_ahead only",
+                 m_params.adaptive_horizon_speeds.size(), m_params.adaptive_horizons.size());
+        adaptive = false;
+    }
+    if (adaptive) {
+        for (int steps_ahead : m_params.adaptive_horizons) {
+            Params horizon_params = m_params;
+            horizon_params.steps_ahead = steps_ahead;
+            m_controllers.emplace_back(new MultiStartSolver(horizon_params, m_pool, build));
+        }
+        m_horizon_speeds = m_params.adaptive_horizon_speeds;
+    } else if (m_predictor) {
+        for (const std::string & backend : backends) {
+            Params backend_params = m_params;
+            backend_params.backend = backend;
+            m_controllers.emplace_back(new MultiStartSolver(backend_params, m_pool, build));
+        }
+        m_previous_controller = m_controllers.size();
+    } else {
+        m_controllers.emplace_back(new MultiStartSolver(m_params, m_pool, build));
+    }
+    m_candidates.reset();
+    if (!m_params.reference_offsets.empty())
+        m_candidates.reset(new ReferenceCandidates(m_params, m_pool, build));
+    if (build != nullptr) {
+        size_t num_solvers = build->size();
+        double elapsed = build->run(warmup_solves);
+        MPC_INFO("%lu solvers built and warmed up (%d solves each) in %.3f [s]", num_solvers, warmup_solves,
+                 elapsed);
+    }
+}
+
+
+void ControlPipeline::memory_stats(MemoryStats & stats) const {
+    stats = MemoryStats();
+    for (const std::unique_ptr<MultiStartSolver> & controller : m_controllers)
+        controller->memory_stats(stats);
+    if (m_candidates)
+        m_candidates->memory_stats(stats);
+    read_cppad_memory(stats);
+}
+
+
+void ControlPipeline::reconfigure(const Params & params) {
+    reconfigure_path(params);
+    reconfigure_solver(params);
+}
+
+
+void ControlPipeline::reconfigure_path(const Params & params) {
+    m_ref_v = params.ref_v;
+    m_ref_v_alpha = params.ref_v_alpha;
+    m_latency = params.latency;
+    m_fit_anchor.OK = false;
+    m_fit_anchor.coeffs.resize(params.poly_degree + 1);
+    if (size_t(params.poly_degree) != m_tracker.poly_degree()
+            or size_t(params.num_steps_poly) != m_tracker.num_steps_poly())
+        m_tracker.reconfigure(params);
+}
+
+
+void ControlPipeline::reconfigure_solver(const Params & params) {
+    // Whatever was speculated is for the old problem
+    finish_speculation();
+
+    m_params.ref_v = params.ref_v;
+    m_params.ref_v_alpha = params.ref_v_alpha;
+    m_params.latency = params.latency;
+
+    bool refit = (params.poly_degree != m_params.poly_degree or params.num_steps_poly != m_params.num_steps_poly);
+    bool reweight = !params.same_weights(m_params);
+    if (!refit and !reweight)
+        return;
+
+    // The weights in place, unless a controller has them built in (or the
+    // tape is for another degree anyway)
+    bool retape = (params.poly_degree != m_params.poly_degree);
+    m_params.copy_weights(params);
+    if (reweight and !retape) {
+        for (std::unique_ptr<MultiStartSolver> & controller : m_controllers) {
+            if (!controller->set_weights(m_params)) {
+                MPC_WARN("The derivative code has the weights built in, re-taping");
+                retape = true;
+                break;
+            }
+        }
+        if (!retape and m_candidates and !m_candidates->set_weights(m_params)) {
+            MPC_WARN("The derivative code has the weights built in, re-taping");
+            retape = true;
+        }
+    }
+
+    m_params.poly_degree = params.poly_degree;
+    m_params.num_steps_poly = params.num_steps_poly;
+    if (retape)
+        build_controllers();
+
+    // Nothing solved so far is for the new problems
+    m_cache.clear();
+    m_ticks_solved = 0;
+    m_check_allocations = AllocationCounter::available() and (m_pid_only or controller().allocation_free())
+            and (!m_candidates or m_candidates->allocation_free()) and m_params.poly_degree <= 3
+            and m_cppad_cap == 0;
+}
+
+
+void ControlPipeline::prepare_centerline(Centerline & centerline) const {
+    prepare_centerline(centerline, m_params);
+}
+
+
+size_t ControlPipeline::select_controller(double speed) const {
+    size_t active = m_active;
+    while (active + 1 < m_controllers.size() and speed >= m_horizon_speeds[active] + HORIZON_HYSTERESIS / 2)
+        active++;
+    while (active > 0 and speed < m_horizon_speeds[active - 1] - HORIZON_HYSTERESIS / 2)
+        active--;
+    return active;
+}
+
+
+size_t ControlPipeline::select_backend(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double speed,
+                                       double ref_v, std::chrono::steady_clock::time_point deadline,
+                                       TelemetryRecord & record) {
+    SolveTimePredictor::features(state[3], state[4], coeffs.data(), size_t(coeffs.size()), speed, ref_v,
+                                 m_previous_cte, m_previous_epsi, m_previous_iterations, m_features);
+    // What's left of the tick's time (at least a little, so that a tick
+    // that's late already takes the fastest)
+    double budget = 0.0;
+    if (deadline != std::chrono::steady_clock::time_point::max())
+        budget = std::max(std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count(),
+                          1e-6);
+    double predicted = 0.0;
+    size_t active = m_predictor->select(m_features, m_previous_controller, budget, predicted);
+    record.backend = uint8_t(active);
+    record.predicted_time = float(predicted);
+    return active;
+}
+
+
+void ControlPipeline::project_pose(double pos_x, double pos_y, double psi, double v, double steer_angle,
+                                   double interval, double & pos_x_out, double & pos_y_out, double & psi_out) {
+    // The kinematic model of FG_eval, in steps of at most PROJECTION_STEP
+    int num_steps = std::max(1, int(std::ceil(interval / PROJECTION_STEP)));
+    double dt = interval / num_steps;
+    for (int i=0; i < num_steps; i++) {
+        pos_x += v * cos(psi) * dt;
+        pos_y += v * sin(psi) * dt;
+        psi -= v * steer_angle / Lf() * dt;
+    }
+    pos_x_out = pos_x;
+    pos_y_out = pos_y;
+    psi_out = psi;
+}
+
+
+double ControlPipeline::speed_to_dzik(double speed) {
+    double rpm = speed / 2 / M_PI / WHEEL_RADIUS_IN_DZIK; // [1/s]
+    rpm *= 60; // [1/min = RPM]
+    rpm *= 10; // TODO: I had to multiply by 10 to get values as they really are in Dzik
+    return rpm;
+}
+
+
+double ControlPipeline::speed_from_dzik(double rpm) {
+    return rpm / 10 / 60 * 2 * M_PI * WHEEL_RADIUS_IN_DZIK;
+}
+
+
+double ControlPipeline::warm_up(int num_solves) {
+    finish_speculation();
+    Eigen::VectorXd state = Eigen::VectorXd::Zero(5);
+    Eigen::VectorXd coeffs = Eigen::VectorXd::Zero(m_tracker.poly_degree() + 1);
+    auto start = std::chrono::steady_clock::now();
+    for (std::unique_ptr<MultiStartSolver> & controller : m_controllers) {
+        for (int i=0; i < num_solves; i++)
+            controller->Solve(state, coeffs, m_ref_v, m_vars);
+        controller->reset_warm_start();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+bool ControlPipeline::step(const InputSnapshot & inputs, double now, std::chrono::steady_clock::time_point tick_start,
+                           TelemetryRecord & record) {
+    prepare(inputs, now, tick_start, m_problem, record);
+    return solve(inputs, m_problem, tick_start, record);
+}
+
+
+bool ControlPipeline::prepare(const InputSnapshot & inputs, double now,
+                              std::chrono::steady_clock::time_point tick_start, TickProblem & problem,
+                              TelemetryRecord & record) {
+    bool pts_OK = bool(inputs.centerline) and !inputs.centerline->pts_x.empty();
+    record.inputs = (pts_OK ? TelemetryRecord::INPUT_PTS : 0) | (inputs.speed_OK ? TelemetryRecord::INPUT_SPEED : 0)
+            | (inputs.pos_OK ? TelemetryRecord::INPUT_POS : 0) | (inputs.psi_OK ? TelemetryRecord::INPUT_PSI : 0);
+
+    problem.OK = false;
+    if (!(pts_OK and inputs.speed_OK and inputs.pos_OK and inputs.psi_OK)) {
+        record.events |= TelemetryRecord::NO_OPTIMIZATION;
+        return false;
+    }
+
+    uint64_t allocations_before = AllocationCounter::count();
+    auto stage_start = std::chrono::steady_clock::now();
+    // The level is read once for the stage (see Instrumentation.h)
+    bool perf_counters = m_perf_counters and Instrumentation::level() >= INSTRUMENTATION_HISTOGRAMS;
+    PerfCounts stage_counts = perf_counters ? PerfCounters::thread().read() : PerfCounts();
+    bool cpu_time = m_cpu_time and Instrumentation::level() >= INSTRUMENTATION_HISTOGRAMS;
+    double stage_cpu_start = cpu_time ? thread_cpu_time() : 0.0;
+
+    // The pose and the speed at the start of the tick, when their streams
+    // have the samples for it, or the latest of each
+    double pos_x = inputs.pos_x, pos_y = inputs.pos_y, psi = inputs.psi;
+    double speed = inputs.speed;
+    double pose_stamp = inputs.pose_stamp;
+    if (m_dead_reckoning and inputs.dead_reckoning.pose_at(now, m_dead_reckoning_max_age, pos_x, pos_y, psi)) {
+        if (m_align_inputs)
+            inputs.history.speed_at(now, m_align_max_extrapolation, speed);
+        pose_stamp = now;
+    } else if (m_align_inputs and inputs.history.pose_at(now, m_align_max_extrapolation, pos_x, pos_y, psi)) {
+        inputs.history.speed_at(now, m_align_max_extrapolation, speed);
+        pose_stamp = now;
+    }
+
+    double v_lat = speed;// + m_latency * m_throttle; TODO: you can collect m_throttle from /odom
+    double psi_lat, pos_x_lat, pos_y_lat;
+    if (m_measured_latency and pose_stamp > 0.0) {
+        // From when the pose was measured until the commands of this
+        // tick go out (by the estimate of how long that takes)
+        double latency = std::max(0.0, now - pose_stamp)
+                + std::max(0.0, m_tick_time_estimate.load(std::memory_order_relaxed));
+        latency = std::min(latency, MAX_MEASURED_LATENCY);
+        project_pose(pos_x, pos_y, psi, v_lat, m_steer_angle.load(std::memory_order_relaxed),
+                     latency, pos_x_lat, pos_y_lat, psi_lat);
+        record.latency = latency;
+        problem.stamp_lat = pose_stamp + latency;
+        record.pose_age = now - inputs.pose_stamp;
+        record.odom_age = now - inputs.odom_stamp;
+    } else {
+        psi_lat = psi - m_latency * (v_lat * m_steer.load(std::memory_order_relaxed) / Lf());
+        pos_x_lat = pos_x + m_latency * (v_lat * cos(psi_lat));
+        pos_y_lat = pos_y + m_latency * (v_lat * sin(psi_lat));
+        record.latency = m_latency;
+        problem.stamp_lat = pose_stamp + m_latency;
+    }
+    problem.pos_x_lat = pos_x_lat;
+    problem.pos_y_lat = pos_y_lat;
+    problem.psi_lat = psi_lat;
+
+    // Barely moved since the last fit: no closest waypoint, window or fit,
+    // the last fit is moved into the car's frame
+    const Centerline & centerline = *inputs.centerline;
+    double anchor_dx = 0.0, anchor_dy = 0.0, anchor_dpsi = 0.0;
+    bool reuse_fit = m_fit_reuse_distance > 0.0 and !m_params.contouring_reference and m_fit_anchor.OK
+            and m_fit_anchor.centerline == &centerline and m_fit_anchor.hash == centerline.hash;
+    if (reuse_fit) {
+        double c = cos(m_fit_anchor.psi), s = sin(m_fit_anchor.psi);
+        double dx = pos_x_lat - m_fit_anchor.pos_x, dy = pos_y_lat - m_fit_anchor.pos_y;
+        anchor_dx = dx * c + dy * s;
+        anchor_dy = dy * c - dx * s;
+        anchor_dpsi = std::remainder(psi_lat - m_fit_anchor.psi, 2 * M_PI);
+        reuse_fit = std::hypot(anchor_dx, anchor_dy) < m_fit_reuse_distance
+                and std::abs(anchor_dpsi) < m_fit_reuse_angle;
+    }
+
+    int closest_idx = reuse_fit ? 0 : m_tracker.closest_waypoint(centerline, pos_x_lat, pos_y_lat, record);
+    problem.progress_OK = !reuse_fit and (record.events & TelemetryRecord::LAP_PROGRESS);
+    problem.progress_lost = problem.progress_OK and m_tracker.progress().lost();
+    problem.progress_s = m_tracker.progress().s();
+    problem.laps = m_tracker.progress().laps();
+    problem.path_length = centerline.spline.length();
+    record.stage_time[TelemetryRecord::STAGE_CLOSEST] = end_stage(stage_start, "closest");
+    if (perf_counters)
+        end_stage_counts(stage_counts, record, TelemetryRecord::STAGE_CLOSEST);
+    if (cpu_time)
+        end_stage_cpu_time(stage_cpu_start, record, TelemetryRecord::STAGE_CLOSEST);
+
+    // The window of the fit, in the car's frame
+    double fraction_steps_OK = reuse_fit
+            ? m_fit_anchor.fraction_steps_OK
+            : m_tracker.make_window(centerline, closest_idx, pos_x_lat, pos_y_lat, psi_lat, record);
+    record.stage_time[TelemetryRecord::STAGE_TRANSFORM] = end_stage(stage_start, "transform");
+    if (perf_counters)
+        end_stage_counts(stage_counts, record, TelemetryRecord::STAGE_TRANSFORM);
+    if (cpu_time)
+        end_stage_cpu_time(stage_cpu_start, record, TelemetryRecord::STAGE_TRANSFORM);
+
+    if (!centerline.speed_profile.empty())
+        problem.new_ref_v = std::min(m_ref_v, centerline.speed_profile.speed(m_tracker.arc_length(centerline)));
+    else
+        problem.new_ref_v = m_ref_v_alpha * m_ref_v + (1-m_ref_v_alpha) * (fraction_steps_OK * m_ref_v);
+
+    // The corridor over the horizon, about where the reference speed takes
+    // the car
+    if (!centerline.corridor_left.empty()) {
+        problem.cte_lower.resize(m_max_steps_ahead);
+        problem.cte_upper.resize(m_max_steps_ahead);
+        m_tracker.corridor(centerline, problem.new_ref_v, m_params, m_max_steps_ahead, problem.cte_lower.data(),
+                           problem.cte_upper.data());
+    } else {
+        problem.cte_lower.clear();
+        problem.cte_upper.clear();
+    }
+
+    // Here we calculate the fit to the points in *car's coordinate system*,
+    // or take the reference of every step from the spline, for the longest
+    // horizon of the controllers
+    Eigen::VectorXd & coeffs = problem.coeffs;
+    double cte, epsi;
+    if (m_params.contouring_reference) {
+        m_tracker.contouring_reference(centerline, pos_x_lat, pos_y_lat, psi_lat, problem.new_ref_v, m_params,
+                                       m_max_steps_ahead, coeffs);
+        contouring_errors(coeffs, 0, 0.0, 0.0, 0.0, cte, epsi);
+    } else {
+        if (reuse_fit) {
+            move_fit(m_fit_anchor.coeffs, anchor_dx, anchor_dy, anchor_dpsi, coeffs);
+            record.events |= TelemetryRecord::FIT_REUSED;
+        } else {
+            m_tracker.fit(centerline, pos_x_lat, pos_y_lat, psi_lat, coeffs);
+            if (m_fit_reuse_distance > 0.0 and coeffs.size() == m_fit_anchor.coeffs.size()) {
+                m_fit_anchor.OK = true;
+                m_fit_anchor.centerline = &centerline;
+                m_fit_anchor.hash = centerline.hash;
+                m_fit_anchor.pos_x = pos_x_lat;
+                m_fit_anchor.pos_y = pos_y_lat;
+                m_fit_anchor.psi = psi_lat;
+                m_fit_anchor.fraction_steps_OK = fraction_steps_OK;
+                m_fit_anchor.coeffs = coeffs;
+            }
+        }
+
+        // Now, we can calculate the cross track error, and psi's error
+        // from the slope at the car
+        double slope;
+        polyeval_with_diff(coeffs, 0.0, cte, slope);
+        epsi = -atan(slope);
+    }
+    record.num_coeffs = std::min(size_t(coeffs.size()), sizeof(record.coeffs) / sizeof(record.coeffs[0]));
+    for (size_t c=0; c < record.num_coeffs; c++)
+        record.coeffs[c] = coeffs[c];
+
+    record.cte = cte;
+    record.epsi = epsi;
+    record.psi = inputs.psi;
+    if (problem.state.size() != 5)
+        problem.state.resize(5);
+    problem.state << 0, 0, 0, cte, epsi;
+
+    // The solve of a pipelined tick overlaps with the next window
+    if (m_pipelined)
+        problem.car_pts = m_tracker.car_pts();
+    record.stage_time[TelemetryRecord::STAGE_POLYFIT] = end_stage(stage_start, "polyfit");
+    if (perf_counters)
+        end_stage_counts(stage_counts, record, TelemetryRecord::STAGE_POLYFIT);
+    if (cpu_time)
+        end_stage_cpu_time(stage_cpu_start, record, TelemetryRecord::STAGE_POLYFIT);
+
+    problem.allocations = AllocationCounter::count() - allocations_before;
+    problem.OK = true;
+    return true;
+}
+
+
+void ControlPipeline::select_obstacles(const InputSnapshot & inputs, const TickProblem & problem) {
+    // The latest plan, from the latest tick's pose, or without one, the
+    // path straight ahead at the reference speed
+    size_t num_stages = m_obstacles->num_stages();
+    size_t num_plan = (m_vars.size() > 2) ? std::min((m_vars.size() - 2) / 2, num_stages) : 0;
+    m_plan_x.resize(num_stages);
+    m_plan_y.resize(num_stages);
+    if (num_plan > 0) {
+        double cos_psi = cos(m_psi_lat);
+        double sin_psi = sin(m_psi_lat);
+        for (size_t t=0; t < num_plan; t++) {
+            double x = m_vars[2 + 2*t];
+            double y = m_vars[3 + 2*t];
+            m_plan_x[t] = m_pos_x_lat + cos_psi * x - sin_psi * y;
+            m_plan_y[t] = m_pos_y_lat + sin_psi * x + cos_psi * y;
+        }
+    } else {
+        const std::vector<double> & times = m_obstacles->times();
+        for (size_t t=0; t < num_stages; t++) {
+            m_plan_x[t] = problem.pos_x_lat + cos(problem.psi_lat) * problem.new_ref_v * times[t];
+            m_plan_y[t] = problem.pos_y_lat + sin(problem.psi_lat) * problem.new_ref_v * times[t];
+        }
+        num_plan = num_stages;
+    }
+    m_obstacles->select(inputs.obstacles.get(), problem.stamp_lat, problem.pos_x_lat, problem.pos_y_lat,
+                        problem.psi_lat, m_plan_x.data(), m_plan_y.data(), num_plan);
+}
+
+
+bool ControlPipeline::solve(const InputSnapshot & inputs, TickProblem & problem,
+                            std::chrono::steady_clock::time_point tick_start, TelemetryRecord & record) {
+    m_plan_OK = false;
+    m_solved_plan_OK = false;
+    if (!problem.OK)
+        return false;
+
+    uint64_t allocations_before = AllocationCounter::count();
+    auto stage_start = std::chrono::steady_clock::now();
+    // The level is read once for the stage (see Instrumentation.h)
+    bool perf_counters = m_perf_counters and Instrumentation::level() >= INSTRUMENTATION_HISTOGRAMS;
+    PerfCounts stage_counts = perf_counters ? PerfCounters::thread().read() : PerfCounts();
+    bool cpu_time = m_cpu_time and Instrumentation::level() >= INSTRUMENTATION_HISTOGRAMS;
+    double stage_cpu_start = cpu_time ? thread_cpu_time() : 0.0;
+
+    if (m_obstacles)
+        select_obstacles(inputs, problem);
+
+    // The problem becomes the latest tick's
+    m_pos_x_lat = problem.pos_x_lat;
+    m_pos_y_lat = problem.pos_y_lat;
+    m_psi_lat = problem.psi_lat;
+    m_stamp_lat = problem.stamp_lat;
+    m_new_ref_v = problem.new_ref_v;
+    m_coeffs = problem.coeffs;
+    m_state = problem.state;
+    if (m_pipelined) {
+        m_car_pts.x.swap(problem.car_pts.x);
+        m_car_pts.y.swap(problem.car_pts.y);
+    }
+    double pos_x_lat = m_pos_x_lat;
+    double pos_y_lat = m_pos_y_lat;
+    double psi_lat = m_psi_lat;
+    double new_ref_v = m_new_ref_v;
+    const Eigen::VectorXd & coeffs = m_coeffs;
+    const Eigen::VectorXd & state = m_state;
+    m_pid.update(state[3], state[4]);
+
+    // The controllers are free once the speculative solve is over
+    bool speculated = finish_speculation();
+
+    std::vector<double> & vars = m_vars;
+    const SolutionCache::Entry * cached = nullptr;
+    bool speculation_hit = false;
+    bool remote_used = false;
+    if (m_pid_only) {
+        // The PID law alone, at the reference speed: the actuations, and
+        // no predicted path
+        double max_steer = 0.017453 * delta_constraint();
+        vars.resize(2);
+        vars[0] = std::min(std::max(m_pid.steer(), -max_steer), max_steer);
+        vars[1] = new_ref_v;
+    } else {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        if (m_time_budget > 0.0)
+            deadline = tick_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(m_time_budget));
+        // The horizon for the speed, or the backend for the time left, with
+        // a controller that was kept ready
+        size_t active = m_predictor ? select_backend(state, coeffs, inputs.speed, new_ref_v, deadline, record)
+                : select_controller(inputs.speed);
+        if (active != m_active) {
+            m_active = active;
+            controller().reset_warm_start();
+            record.events |= m_predictor ? TelemetryRecord::BACKEND_SWITCHED : TelemetryRecord::HORIZON_SWITCHED;
+            m_remote_reset = true;
+            Trace::instant(m_predictor ? "backend_switched" : "horizon_switched");
+        }
+
+        // The speculative solution stands when the pose is where the plan
+        // predicted it; otherwise the controller warm starts from it
+        if (speculated and m_speculative_controller == m_active) {
+            double dx = pos_x_lat - m_speculative_x;
+            double dy = pos_y_lat - m_speculative_y;
+            double dpsi = std::remainder(psi_lat - m_speculative_psi, 2 * M_PI);
+            speculation_hit = (dx * dx + dy * dy <= m_speculative_tolerance * m_speculative_tolerance
+                               and std::abs(dpsi) <= m_speculative_heading_tolerance);
+        }
+
+        // A problem solved already (within the tolerance) isn't solved again:
+        // with the cache, or while parked on the same one
+        SolutionCache::Key key;
+        bool key_OK = !speculation_hit and m_cache.make_key(m_active, state, coeffs, new_ref_v, key);
+        if (key_OK and (m_cache_enabled or !inputs.go_flag))
+            cached = m_cache.find(key);
+        if (speculation_hit) {
+            vars.assign(m_speculative_vars.begin(), m_speculative_vars.end());
+            record.events |= TelemetryRecord::SPECULATION_HIT;
+        } else if (cached != nullptr) {
+            vars.assign(cached->result.begin(), cached->result.end());
+            m_cached_stats.cost = cached->cost;
+            record.events |= m_cache_enabled ? TelemetryRecord::CACHE_HIT : TelemetryRecord::SOLVE_SKIPPED;
+        } else {
+            if (!problem.cte_lower.empty())
+                controller().set_cte_bounds(problem.cte_lower.data(), problem.cte_upper.data(),
+                                            problem.cte_lower.size());
+            if (m_obstacles)
+                controller().set_obstacles(m_obstacles->positions().data(), m_obstacles->clearances().data(),
+                                           m_obstacles->num_stages());
+            if (m_obstacles and m_candidates)
+                m_candidates->set_obstacles(m_obstacles->positions().data(), m_obstacles->clearances().data(),
+                                            m_obstacles->num_stages());
+            // The server solves the same problem meanwhile, and its result
+            // stands if it's back in time
+            bool remote_sent = m_remote and m_remote->request(state, coeffs, new_ref_v, m_remote_reset);
+            if (remote_sent)
+                m_remote_reset = false;
+            if (m_safe_set)
+                target_safe_set(problem, inputs.speed);
+            if (m_lap_warm_starts) {
+                // A jump of the pose leaves the last plan behind; then,
+                // or after a failed solve, the plan of the stretch ahead
+                // on a previous lap is the start
+                if (problem.progress_lost)
+                    controller().reset_warm_start();
+                const MPC & solver = controller().chosen_controller();
+                controller().set_lap_seed(problem.progress_OK
+                        ? m_lap_warm_starts->find(problem.progress_s, inputs.centerline->hash, problem.path_length,
+                                                  m_active, solver.num_vars())
+                        : nullptr, solver.num_vars());
+            }
+            controller().set_cancel_flag(inputs.go_flag ? m_cancel : nullptr);
+            if (m_candidates) {
+                // The reference lines on the pool meanwhile, and the
+                // commands of the one followed
+                m_candidates->set_cancel_flag(inputs.go_flag ? m_cancel : nullptr);
+                m_candidates->Solve(controller(), state, coeffs, new_ref_v, problem.cte_lower, problem.cte_upper,
+                                    vars, deadline);
+                record.reference = uint8_t(m_candidates->followed());
+                if (m_candidates->switched()) {
+                    record.events |= TelemetryRecord::REFERENCE_SWITCHED;
+                    Trace::instant("reference_switched");
+                }
+            } else {
+                controller().Solve(state, coeffs, new_ref_v, vars, deadline);
+            }
+            const SolveStats & stats = controller().stats();
+            if (key_OK and stats.ok and !stats.deadline_hit and record.reference == 0)
+                m_cache.insert(key, vars, stats.cost);
+            if (remote_sent) {
+                auto remote_deadline = std::min(deadline, tick_start
+                        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(m_remote_timeout)));
+                const RemoteReply & reply = m_remote_reply;
+                if (m_remote->receive(remote_deadline, m_remote_reply) and reply.ok and reply.num_vars >= 2) {
+                    vars.assign(reply.vars, reply.vars + reply.num_vars);
+                    m_remote_stats.ok = true;
+                    m_remote_stats.deadline_hit = reply.deadline_hit;
+                    m_remote_stats.cost = reply.cost;
+                    m_remote_stats.iterations = reply.iterations;
+                    m_remote_stats.solve_time = reply.solve_time;
+                    remote_used = true;
+                    record.events |= TelemetryRecord::REMOTE_USED;
+                }
+            }
+        }
+    }
+
+    // The solve, split into the evaluations of the model (when they're
+    // known) and the solver's own work
+    float solve_time = end_stage(stage_start, "solve");
+    if (perf_counters)
+        end_stage_counts(stage_counts, record, TelemetryRecord::STAGE_SOLVER);
+    if (cpu_time)
+        end_stage_cpu_time(stage_cpu_start, record, TelemetryRecord::STAGE_SOLVER);
+    const SolveStats & solve_stats = m_pid_only ? m_pid_stats
+            : speculation_hit ? m_speculative_stats
+            : remote_used ? m_remote_stats
+            : (cached != nullptr) ? m_cached_stats
+            : (record.reference > 0) ? m_candidates->stats(record.reference) : controller().stats();
+    float eval_time = solve_stats.eval_time;
+    if (eval_time >= 0.0f) {
+        record.stage_time[TelemetryRecord::STAGE_DERIVATIVES] = std::min(eval_time, solve_time);
+        record.stage_time[TelemetryRecord::STAGE_SOLVER] = solve_time - std::min(eval_time, solve_time);
+    } else {
+        record.stage_time[TelemetryRecord::STAGE_SOLVER] = solve_time;
+    }
+
+    // Debug builds check that, once warmed up, nothing from the search
+    // of the closest point to the solve allocated
+    if (m_check_allocations) {
+        uint64_t allocations = problem.allocations + AllocationCounter::count() - allocations_before;
+        if (m_ticks_solved >= ALLOCATION_CHECK_WARMUP and allocations != 0) {
+            MPC_ERROR("%lu heap allocations in the solve of a warmed-up tick", allocations);
+            assert(allocations == 0);
+        }
+    }
+    m_ticks_solved++;
+    if (m_cppad_cap > 0)
+        cap_cppad_memory(m_cppad_cap);
+    // What the next tick's backend warm starts from: this solve, if it was
+    // the controller's own and it succeeded
+    if (m_predictor) {
+        const SolveStats & stats = controller().stats();
+        bool solved = !speculation_hit and cached == nullptr and !remote_used;
+        m_previous_controller = (solved and stats.ok) ? m_active : m_controllers.size();
+        m_previous_iterations = std::max(stats.iterations, 0);
+        m_previous_cte = state[3];
+        m_previous_epsi = state[4];
+    }
+    record.time_budget = m_time_budget;
+    record.cost = solve_stats.cost;
+    record.iterations = int16_t(std::min(solve_stats.iterations, int(INT16_MAX)));
+    record.steps_ahead = uint16_t((vars.size() - 2) / 2);
+    record.variant = (m_pid_only or cached != nullptr or speculation_hit or remote_used or record.reference > 0) ? 0
+            : uint8_t(controller().chosen());
+    if (record.variant != 0)
+        record.events |= TelemetryRecord::VARIANT_USED;
+    record.constraint_violation = solve_stats.constraint_violation;
+    record.linear_solver_time = solve_stats.linear_solver_time;
+    record.slack = solve_stats.slack;
+    record.tolerance = solve_stats.tolerance;
+    if (solve_stats.ipopt_log != nullptr)
+        record.ipopt = *solve_stats.ipopt_log;
+    if (solve_stats.restoration)
+        record.events |= TelemetryRecord::RESTORATION;
+    if (solve_stats.diverged)
+        record.events |= TelemetryRecord::DIVERGED;
+    if (solve_stats.explicit_law)
+        record.events |= TelemetryRecord::EXPLICIT_LAW;
+    if (solve_stats.deadline_hit)
+    {
+        record.events |= TelemetryRecord::DEADLINE_HIT;
+        Trace::instant("deadline_hit");
+    }
+    if (!solve_stats.ok)
+    {
+        record.events |= TelemetryRecord::SOLVE_FAILED;
+        Trace::instant("solve_failed");
+    }
+
+    // A failed solve with nothing of the solver's to fall back on, or a
+    // plan that leaves the corridor or the actuators' range (whatever the
+    // solver says of it): the PID law steers, at the lower reference speed
+    record.fallback = solve_stats.fallback;
+    bool plan_invalid = m_validator and (solve_stats.ok or solve_stats.fallback != FALLBACK_NONE)
+            and !m_validator->valid(vars, problem.coeffs, problem.cte_lower, problem.cte_upper);
+    if (plan_invalid)
+        record.events |= TelemetryRecord::PLAN_INVALID;
+    if ((!solve_stats.ok and solve_stats.fallback == FALLBACK_NONE) or plan_invalid) {
+        double max_steer = 0.017453 * delta_constraint();
+        vars[0] = std::min(std::max(m_pid.steer(), -max_steer), max_steer);
+        vars[1] = m_params.ref_v_alpha * new_ref_v;
+        record.fallback = FALLBACK_PID;
+    }
+    if (record.fallback != FALLBACK_NONE)
+        record.events |= TelemetryRecord::FALLBACK;
+
+    // The plan of a successful solve of the controller's own, for the same
+    // stretch of the next laps
+    bool solved = !m_pid_only and !speculation_hit and cached == nullptr and !remote_used and record.reference == 0;
+    if (m_lap_warm_starts and problem.progress_OK and solved and solve_stats.ok and !solve_stats.deadline_hit
+            and record.fallback == FALLBACK_NONE)
+        m_lap_warm_starts->store(problem.progress_s, inputs.centerline->hash, problem.path_length, m_active,
+                                 controller().chosen_controller().last_solution());
+    if (solve_stats.lap_seeded)
+        record.events |= TelemetryRecord::LAP_SEEDED;
+
+    // The closed-loop state of the tick, for the laps to come; a lap with
+    // a fallback isn't one to learn from
+    if (m_safe_set and problem.progress_OK)
+        m_safe_set->record(problem.stamp_lat, problem.progress_s, problem.laps, problem.path_length, state[3],
+                           state[4], inputs.speed, vars[0],
+                           inputs.go_flag and solve_stats.ok and record.fallback == FALLBACK_NONE);
+
+    // Extract the actuator values
+    double steering_angle_in_radians = vars[0];
+    double speed_in_meters_by_second = vars[1];
+
+    record.steer = steering_angle_in_radians;
+    record.speed = speed_in_meters_by_second;
+
+    // Map the angle to the values used in Dzik
+    double steer = steer_to_dzik(steering_angle_in_radians);
+
+    if (steer < 0.0) {
+        record.events |= TelemetryRecord::STEER_CLIPPED_LOW;
+        steer = 0.0;
+    } else if (steer > 1.0) {
+        record.events |= TelemetryRecord::STEER_CLIPPED_HIGH;
+        steer = 1.0;
+    }
+
+    // Map the speed to the values used in Dzik
+    m_rpm = speed_to_dzik(speed_in_meters_by_second);
+
+    double steer_angle = steer_from_dzik(steer);
+    if (!inputs.go_flag) {
+        steer = CENTER_IN_DZIK;
+        steer_angle = 0.0;
+        m_rpm = 0;
+    } else {
+        record.events |= TelemetryRecord::GO;
+    }
+    m_steer.store(steer, std::memory_order_relaxed);
+    m_steer_angle.store(steer_angle, std::memory_order_relaxed);
+    record.steer_cmd = steer;
+    record.rpm = m_rpm;
+
+    // A plan of the solver, which the car follows, to speculate from
+    m_solved_plan_OK = inputs.go_flag and solve_stats.ok and record.fallback == FALLBACK_NONE and vars.size() > 2;
+    m_plan_OK = m_speculative and m_solved_plan_OK;
+
+    // How long it took to get the commands out, for the latency estimate
+    // of the next ticks
+    double tick_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - tick_start).count();
+    double estimate = m_tick_time_estimate.load(std::memory_order_relaxed);
+    estimate = (estimate < 0.0) ? tick_time : TICK_TIME_ALPHA * tick_time + (1 - TICK_TIME_ALPHA) * estimate;
+    m_tick_time_estimate.store(estimate, std::memory_order_relaxed);
+
+    record.odom_speed = inputs.speed;
+    return true;
+}
+
+
+void ControlPipeline::plan(Plan & plan) const {
+    plan.OK = m_solved_plan_OK;
+    if (!plan.OK)
+        return;
+    plan.stamp = m_stamp_lat;
+    plan.pos_x = m_pos_x_lat;
+    plan.pos_y = m_pos_y_lat;
+    plan.psi = m_psi_lat;
+
+    // The points of the time grid (the first one is the car's)
+    const std::vector<double> & vars = m_vars;
+    size_t num_points = (vars.size() - 2) / 2;
+    if (num_points < 2) {
+        plan.OK = false;
+        return;
+    }
+    plan.x.resize(num_points);
+    plan.y.resize(num_points);
+    plan.time.resize(num_points);
+    plan.heading.resize(num_points);
+    plan.speed.resize(num_points);
+    plan.steer_angle.resize(num_points);
+    double sin_psi = sin(m_psi_lat), cos_psi = cos(m_psi_lat);
+    double time = 0.0;
+    for (size_t i=0; i < num_points; i++) {
+        double x = vars[2 + 2*i], y = vars[3 + 2*i];
+        plan.x[i] = m_pos_x_lat + x * cos_psi - y * sin_psi;
+        plan.y[i] = m_pos_y_lat + x * sin_psi + y * cos_psi;
+        plan.time[i] = time;
+        if (i + 1 < num_points)
+            time += m_params.step_dt(i);
+    }
+
+    // The model steps x by v cos(psi) dt (and y by v sin(psi) dt), and psi
+    // by -v delta / Lf dt: the heading and the speed of a stage are those
+    // of the step to the next one, its steering angle that of the turn to
+    // the step after. The first stage's are the solution's own
+    double max_steer = 0.017453 * delta_constraint();
+    for (size_t i=0; i + 1 < num_points; i++) {
+        double step_x = plan.x[i + 1] - plan.x[i];
+        double step_y = plan.y[i + 1] - plan.y[i];
+        double dt = plan.time[i + 1] - plan.time[i];
+        double heading = atan2(step_y, step_x);
+        // Unwrapped from stage to stage; a step of no length keeps the heading
+        if (step_x * step_x + step_y * step_y < SPECULATION_MIN_STEP * SPECULATION_MIN_STEP)
+            heading = (i == 0) ? m_psi_lat : plan.heading[i - 1];
+        else if (i > 0)
+            heading = plan.heading[i - 1] + std::remainder(heading - plan.heading[i - 1], 2 * M_PI);
+        plan.heading[i] = heading;
+        plan.speed[i] = (dt > 0.0) ? std::hypot(step_x, step_y) / dt : 0.0;
+    }
+    plan.heading[num_points - 1] = plan.heading[std::max(num_points, size_t(2)) - 2];
+    plan.speed[num_points - 1] = plan.speed[std::max(num_points, size_t(2)) - 2];
+    for (size_t i=0; i < num_points; i++) {
+        double steer_angle = (i > 0) ? plan.steer_angle[i - 1] : 0.0;
+        if (i + 2 < num_points) {
+            double v_dt = plan.speed[i] * (plan.time[i + 1] - plan.time[i]);
+            if (v_dt > SPECULATION_MIN_STEP)
+                steer_angle = -(plan.heading[i + 1] - plan.heading[i]) * Lf() / v_dt;
+        }
+        plan.steer_angle[i] = std::min(std::max(steer_angle, -max_steer), max_steer);
+    }
+    plan.steer_angle[0] = vars[0];
+    plan.speed[0] = vars[1];
+}
+
+
+void ControlPipeline::set_control_period(double period) {
+    if (!m_fixed_time_budget)
+        m_time_budget = period;
+}
+
+
+void ControlPipeline::speculate(double interval) {
+    if (!m_plan_OK)
+        return;
+    m_plan_OK = false;
+
+    // The step of the plan that `interval` falls in (the first point is the
+    // car's), and where along it
+    const std::vector<double> & vars = m_vars;
+    size_t num_points = (vars.size() - 2) / 2;
+    size_t i = 0;
+    double t = 0.0;
+    while (i + 1 < num_points and t + m_params.step_dt(i) < interval) {
+        t += m_params.step_dt(i);
+        i++;
+    }
+    if (i + 1 >= num_points)
+        return;
+    double step_x = vars[4 + 2*i] - vars[2 + 2*i];
+    double step_y = vars[5 + 2*i] - vars[3 + 2*i];
+    if (step_x * step_x + step_y * step_y < SPECULATION_MIN_STEP * SPECULATION_MIN_STEP)
+        return;
+    double fraction = (interval - t) / m_params.step_dt(i);
+    double x = vars[2 + 2*i] + fraction * step_x;
+    double y = vars[3 + 2*i] + fraction * step_y;
+    double heading = atan2(step_y, step_x);
+
+    // That pose in the world frame, for the next tick to compare its own to
+    double sin_psi = sin(m_psi_lat), cos_psi = cos(m_psi_lat);
+    m_speculative_x = m_pos_x_lat + x * cos_psi - y * sin_psi;
+    m_speculative_y = m_pos_y_lat + x * sin_psi + y * cos_psi;
+    m_speculative_psi = m_psi_lat + heading;
+
+    // The problem from there: the waypoints of this tick in its frame, and
+    // the fit to them, or the references of this tick in its frame
+    double cte, epsi;
+    if (m_params.contouring_reference) {
+        double sin_heading = sin(heading), cos_heading = cos(heading);
+        m_speculative_coeffs = m_coeffs;
+        for (Eigen::Index k=0; k < m_coeffs.size(); k += REF_SAMPLE_SIZE) {
+            double dx = m_coeffs[k + REF_X] - x, dy = m_coeffs[k + REF_Y] - y;
+            m_speculative_coeffs[k + REF_X] = dx * cos_heading + dy * sin_heading;
+            m_speculative_coeffs[k + REF_Y] = dy * cos_heading - dx * sin_heading;
+            m_speculative_coeffs[k + REF_HEADING] = m_coeffs[k + REF_HEADING] - heading;
+        }
+        contouring_errors(m_speculative_coeffs, 0, 0.0, 0.0, 0.0, cte, epsi);
+    } else {
+        to_car_frame(car_pts(), x, y, sin(heading), cos(heading), m_speculative_pts);
+        polyfit(m_speculative_pts.x.data(), m_speculative_pts.y.data(), m_speculative_pts.size(),
+                int(m_tracker.poly_degree()), m_speculative_coeffs);
+        double slope;
+        polyeval_with_diff(m_speculative_coeffs, 0.0, cte, slope);
+        epsi = -atan(slope);
+    }
+    m_speculative_state << 0, 0, 0, cte, epsi;
+    m_speculative_ref_v = m_new_ref_v;
+    m_speculative_controller = m_active;
+
+    // It has until the next tick is due
+    m_speculative_deadline = std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+    {
+        std::lock_guard<std::mutex> lock(m_speculation_mutex);
+        m_speculating = true;
+    }
+    m_speculation_pool->Schedule([this]() { solve_speculation(); });
+}
+
+
+void ControlPipeline::solve_speculation() {
+    MPC_TRACE_SCOPE("speculate");
+    MultiStartSolver & solver = *m_controllers[m_speculative_controller];
+    solver.Solve(m_speculative_state, m_speculative_coeffs, m_speculative_ref_v, m_speculative_vars,
+                 m_speculative_deadline);
+    m_speculative_stats = solver.stats();
+    // The tick that takes it over spends no time on the model
+    m_speculative_stats.eval_time = -1.0;
+
+    std::lock_guard<std::mutex> lock(m_speculation_mutex);
+    m_speculation_OK = m_speculative_stats.ok and !m_speculative_stats.deadline_hit
+            and m_speculative_stats.fallback == FALLBACK_NONE;
+    m_speculating = false;
+    m_speculation_done.notify_one();
+}
+
+
+void ControlPipeline::target_safe_set(const TickProblem & problem, double speed) {
+    // The end of the last plan: its errors and speed, as far along the path
+    // as the plan is long
+    const MPC & last = controller().chosen_controller();
+    const std::vector<double> & solution = last.last_solution();
+    const Indexes & I = last.indexes();
+    double s = problem.progress_s;
+    double cte = problem.state[3], epsi = problem.state[4], v = speed;
+    size_t N = I.steps_ahead;
+    if (problem.progress_OK and N >= 2 and solution.size() > I.v(N - 2)) {
+        for (size_t t=1; t < N; t++)
+            s += std::hypot(solution[I.x_start + t] - solution[I.x_start + t - 1],
+                            solution[I.y_start + t] - solution[I.y_start + t - 1]);
+        cte = solution[I.cte_start + N - 1];
+        epsi = solution[I.epsi_start + N - 1];
+        v = solution[I.v(N - 2)];
+    }
+
+    double target_cte = 0.0, target_epsi = 0.0, target_delta = 0.0;
+    if (problem.progress_OK)
+        m_safe_set->target(s, cte, epsi, v, target_cte, target_epsi, target_delta);
+    controller().set_terminal_target(target_cte, target_epsi, target_delta);
+}
+
+
+bool ControlPipeline::finish_speculation() {
+    std::unique_lock<std::mutex> lock(m_speculation_mutex);
+    m_speculation_done.wait(lock, [this]() { return !m_speculating; });
+    bool OK = m_speculation_OK;
+    m_speculation_OK = false;
+    return OK;
+}
+
+
+void ControlPipeline::record_flight(const InputSnapshot & inputs, const TelemetryRecord & record,
+                                    FlightRecord & flight) {
+    flight.stamp = record.stamp;
+    flight.pos_x = inputs.pos_x;
+    flight.pos_y = inputs.pos_y;
+    flight.psi = inputs.psi;
+    flight.speed = inputs.speed;
+    flight.pose_stamp = inputs.pose_stamp;
+    flight.odom_stamp = inputs.odom_stamp;
+    flight.events = record.events;
+    flight.inputs = record.inputs;
+    std::copy(record.stage_time, record.stage_time + TelemetryRecord::NUM_STAGES, flight.stage_time);
+    flight.latency = record.latency;
+    flight.steer_cmd = steer_cmd();
+    flight.rpm = m_rpm;
+
+    // Nothing was solved without all the inputs
+    if (record.events & TelemetryRecord::NO_OPTIMIZATION) {
+        flight.num_coeffs = 0;
+        flight.num_points = 0;
+        flight.num_vars = 0;
+        flight.steps_ahead = 0;
+        return;
+    }
+
+    flight.pos_x_lat = m_pos_x_lat;
+    flight.pos_y_lat = m_pos_y_lat;
+    flight.psi_lat = m_psi_lat;
+    flight.cte = m_state[3];
+    flight.epsi = m_state[4];
+    flight.ref_v = m_new_ref_v;
+    // A contouring reference doesn't fit in the record: its ticks aren't
+    // replayed
+    flight.num_coeffs = m_params.contouring_reference
+            ? 0 : uint8_t(std::min(size_t(m_coeffs.size()), FlightRecord::MAX_COEFFS));
+    std::copy(m_coeffs.data(), m_coeffs.data() + flight.num_coeffs, flight.coeffs);
+    flight.weights[0] = m_params.cte_coeff;
+    flight.weights[1] = m_params.epsi_coeff;
+    flight.weights[2] = m_params.speed_coeff;
+    flight.weights[3] = m_params.steer_coeff;
+    flight.weights[4] = m_params.consec_speed_coeff;
+    flight.weights[5] = m_params.consec_steer_coeff;
+
+    flight.variant = record.variant;
+    flight.fallback = record.fallback;
+    flight.steps_ahead = record.steps_ahead;
+    flight.iterations = record.iterations;
+    flight.cost = record.cost;
+
+    const WaypointBuffer & car_pts = m_tracker.car_pts();
+    flight.num_points = uint16_t(std::min(car_pts.size(), FlightRecord::MAX_POINTS));
+    for (size_t i=0; i < flight.num_points; i++) {
+        flight.pts_x[i] = float(car_pts.x[i]);
+        flight.pts_y[i] = float(car_pts.y[i]);
+    }
+    flight.num_vars = uint16_t(std::min(m_vars.size(), FlightRecord::MAX_VARS));
+    std::copy(m_vars.begin(), m_vars.begin() + flight.num_vars, flight.vars);
+}
+
+
+void ControlPipeline::live_frame(const InputSnapshot & inputs, const TelemetryRecord & record, const Plan & plan,
+                                 LiveFrame & frame) {
+    frame.stamp = record.stamp;
+    frame.pos_x = inputs.pos_x;
+    frame.pos_y = inputs.pos_y;
+    frame.psi = inputs.psi;
+    frame.speed = inputs.speed;
+    frame.events = record.events;
+    std::copy(record.stage_time, record.stage_time + TelemetryRecord::NUM_STAGES, frame.stage_time);
+    frame.latency = record.latency;
+    frame.steer_cmd = steer_cmd();
+    frame.rpm = m_rpm;
+    frame.fallback = record.fallback;
+    frame.steps_ahead = record.steps_ahead;
+    frame.iterations = record.iterations;
+    frame.cost = record.cost;
+    frame.num_coeffs = 0;
+    frame.num_points = 0;
+    frame.num_stages = 0;
+    if (record.events & TelemetryRecord::NO_OPTIMIZATION)
+        return;
+
+    frame.pos_x_lat = m_pos_x_lat;
+    frame.pos_y_lat = m_pos_y_lat;
+    frame.psi_lat = m_psi_lat;
+    frame.cte = m_state[3];
+    frame.epsi = m_state[4];
+    frame.num_coeffs = uint8_t(std::min(size_t(m_coeffs.size()), size_t(LiveFrame::MAX_COEFFS)));
+    std::copy(m_coeffs.data(), m_coeffs.data() + frame.num_coeffs, frame.coeffs);
+
+    const WaypointBuffer & car_pts = this->car_pts();
+    frame.num_points = uint16_t(std::min(car_pts.size(), size_t(LiveFrame::MAX_POINTS)));
+    for (size_t i=0; i < frame.num_points; i++) {
+        frame.pts_x[i] = float(car_pts.x[i]);
+        frame.pts_y[i] = float(car_pts.y[i]);
+    }
+
+    if (!plan.OK)
+        return;
+    frame.num_stages = uint16_t(std::min(plan.x.size(), size_t(LiveFrame::MAX_STAGES)));
+    for (size_t i=0; i < frame.num_stages; i++) {
+        frame.plan_x[i] = float(plan.x[i]);
+        frame.plan_y[i] = float(plan.y[i]);
+        frame.plan_time[i] = float(plan.time[i]);
+        frame.plan_heading[i] = float(plan.heading[i]);
+        frame.plan_speed[i] = float(plan.speed[i]);
+        frame.plan_steer[i] = float(plan.steer_angle[i]);
+    }
+}
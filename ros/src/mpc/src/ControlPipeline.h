@@ -0,0 +1,506 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "MultiStartSolver.h"
+#include "Obstacles.h"
+#include "PIDController.h"
+#include "PlanFollower.h"
+#include "PlanValidator.h"
+#include "LapWarmStarts.h"
+#include "ReferenceCandidates.h"
+#include "SampledSafeSet.h"
+#include "PathTracker.h"
+#include "RemoteSolve.h"
+#include "SolutionCache.h"
+#include "SolveTimePredictor.h"
+#include "StateHistory.h"
+#include "DeadReckoning.h"
+#include "WaypointBuffer.h"
+#include "Telemetry.h"
+#include "FlightRecorder.h"
+#include "LiveView.h"
+
+
+///* Everything a solve needs to know about the car and the path
+struct InputSnapshot {
+    std::shared_ptr<const Centerline> centerline;
+
+    double pos_x = 0.0;
+    double pos_y = 0.0;
+    bool pos_OK = false;
+    ///* Stamps [s] of the pose (which comes with psi) and of the speed
+    double pose_stamp = 0.0;
+    double odom_stamp = 0.0;
+
+    double speed = 0.0;
+    bool speed_OK = false;
+
+    double psi = 0.0;
+    bool psi_OK = false;
+
+    bool go_flag = false;
+
+    ///* The latest samples of the pose and the speed (see
+    ///* `Params::align_inputs`)
+    StateHistory history;
+
+    ///* The pose dead reckoned from the latest fix (see
+    ///* `Params::dead_reckoning`)
+    DeadReckoning dead_reckoning;
+
+    ///* The latest obstacles, if any (see `Params::max_obstacles`)
+    std::shared_ptr<const ObstacleSet> obstacles;
+};
+
+
+///* The problem of a tick, as the path stage (`ControlPipeline::prepare`)
+///* makes it for the solve (`ControlPipeline::solve`). With
+///* `Params::pipelined` the two run on threads of their own, and the
+///* problems go from one to the other in slots allocated up front
+struct TickProblem {
+    ///* All the inputs were there (otherwise nothing else is filled in)
+    bool OK = false;
+
+    ///* The pose projected by the latency, in the world frame
+    double pos_x_lat = 0.0;
+    double pos_y_lat = 0.0;
+    double psi_lat = 0.0;
+    ///* ... and when [s], on the clock of the stamps of the inputs
+    double stamp_lat = 0.0;
+
+    ///* The problem: (0, 0, 0, cte, epsi) in the car's frame, the fit and
+    ///* the reference speed
+    Eigen::VectorXd state;
+    Eigen::VectorXd coeffs;
+    double new_ref_v = 0.0;
+
+    ///* The waypoints of the fit, in the car's frame: only with
+    ///* `Params::pipelined`, as the path stage's own are overwritten by the
+    ///* next tick while this one is solved
+    WaypointBuffer car_pts;
+
+    ///* The bounds of the cte of every step of the longest horizon, from the
+    ///* corridor (see `Params::corridor_width`); empty without it
+    std::vector<double> cte_lower;
+    std::vector<double> cte_upper;
+
+    ///* The progress along the path of the pose (see `Params::lap_progress`,
+    ///* not OK without it or when the fit was reused): whether its tracking
+    ///* was lost (the pose jumped), the arc length [m], the laps, and the
+    ///* length of the path [m]
+    bool progress_OK = false;
+    bool progress_lost = false;
+    double progress_s = 0.0;
+    int laps = 0;
+    double path_length = 0.0;
+
+    ///* Heap allocations the path stage made for it
+    uint64_t allocations = 0;
+};
+
+
+///* One tick of the controller, from the inputs to Dzik's commands, without
+///* the ROS transport: the latency projection of the pose, the path tracking
+///* (the closest waypoint and the polynomial fit in the car's frame, see
+///* PathTracker) and the solve.
+///* MPCControllerNode runs it on its solver loop, mpc_simulator in closed
+///* loop with the kinematic model.
+///*
+///* Keeps the state carried from tick to tick (the tracked closest point,
+///* the sliding fit, the last commands, the tick time estimate), and the
+///* buffers that make a warmed-up tick allocation-free.
+///*
+///* A tick is the path stage (`prepare`) then the solve (`solve`), which
+///* `step` runs one after the other. With `Params::pipelined` the node runs
+///* them on two threads instead, the path stage of a tick while the previous
+///* one is solved: what either of them carries over is its own, but for the
+///* last commands and the tick time estimate (which the path stage projects
+///* the pose with), which are atomic.
+class ControlPipeline {
+public:
+    ///* The parallel variants (and the speculative solve) run on threads of
+    ///* the pipeline's own, or on those of `pool` when there's one (e.g. the
+    ///* pool mpc_host shares between its vehicles), for which CppAD has to
+    ///* be set up already (see ParallelCppAD)
+    ControlPipeline(const Params & params, Eigen::ThreadPoolInterface * pool = nullptr);
+    ~ControlPipeline();
+
+    ///* Builds the structures derived from the waypoints of `centerline`
+    void prepare_centerline(Centerline & centerline) const;
+
+    ///* The same, for the fit of `params` (e.g. the next one, see
+    ///* `reconfigure`); reads nothing of a ControlPipeline, so it's safe to
+    ///* call from another thread than `step`'s
+    static void prepare_centerline(Centerline & centerline, const Params & params) {
+        PathTracker::prepare_centerline(centerline, params);
+    }
+
+    ///* Takes over the fields of `params` that can change at runtime,
+    ///* between two steps: the weights of the cost (without re-taping, see
+    ///* `MPC::set_weights`), `ref_v`, `ref_v_alpha`, `latency`, and the fit
+    ///* (`poly_degree`, which re-tapes, and `num_steps_poly`). The centerlines
+    ///* prepared for another fit are fit from scratch until they're prepared
+    ///* again. The other fields are ignored
+    void reconfigure(const Params & params);
+
+    ///* The same, split by stage: what the path stage takes over (`ref_v`,
+    ///* `ref_v_alpha`, `latency` and the fit) and what the solve does (the
+    ///* rest). Each from the thread of its stage
+    void reconfigure_path(const Params & params);
+    void reconfigure_solver(const Params & params);
+
+    ///* Solves the tick that started at `tick_start` (by the steady clock)
+    ///* from `inputs`, where `now` [s] is on the clock of the stamps of the
+    ///* inputs. Fills `record` in, and false (with NO_OPTIMIZATION) when an
+    ///* input is missing, in which case the commands are left unchanged
+    bool step(const InputSnapshot & inputs, double now, std::chrono::steady_clock::time_point tick_start,
+              TelemetryRecord & record);
+
+    ///* The path stage of `step`: the latency projection, the closest
+    ///* waypoint, the window and the fit, into `problem`. Fills the fields of
+    ///* `record` about them in, and false (with NO_OPTIMIZATION) when an input
+    ///* is missing
+    bool prepare(const InputSnapshot & inputs, double now, std::chrono::steady_clock::time_point tick_start,
+                 TickProblem & problem, TelemetryRecord & record);
+
+    ///* The rest of `step`: the solve of `problem` (prepared from `inputs`)
+    ///* and the commands. False, leaving the commands unchanged, when the
+    ///* problem isn't OK. The waypoints of `problem` are swapped out (the
+    ///* slot gets the previous ones back)
+    bool solve(const InputSnapshot & inputs, TickProblem & problem, std::chrono::steady_clock::time_point tick_start,
+               TelemetryRecord & record);
+
+    ///* The latest commands, in Dzik's units: the servo position in [0, 1]
+    ///* and the motor speed [RPM]
+    double steer_cmd() const { return m_steer.load(std::memory_order_relaxed); }
+    double rpm() const { return m_rpm; }
+
+    ///* The (latency-corrected) pose the latest tick solved from
+    double pos_x() const { return m_pos_x_lat; }
+    double pos_y() const { return m_pos_y_lat; }
+    double psi() const { return m_psi_lat; }
+
+    ///* The progress along the path of that pose (see `Params::lap_progress`)
+    const LapProgress & progress() const { return m_tracker.progress(); }
+
+    ///* The memory of the controllers and of CppAD (see MemoryStats), from
+    ///* the thread of `solve`; the process' isn't read
+    void memory_stats(MemoryStats & stats) const;
+
+    ///* The buffers of the latest tick: the solution (as returned by
+    ///* `MPC::Solve`), the fit and its waypoints (in the car's frame). The
+    ///* caller may swap their contents out (see Visualizer::push). The
+    ///* waypoints are converted on demand from a float window
+    std::vector<double> & vars() { return m_vars; }
+    Eigen::VectorXd & coeffs() { return m_coeffs; }
+    WaypointBuffer & car_pts() { return m_pipelined ? m_car_pts : m_tracker.car_pts(); }
+
+    ///* Starts the speculative solve (see `Params::speculative_solve`) of the
+    ///* next tick, expected `interval` [s] after the latest one: from the
+    ///* pose the latest plan predicts for then, with the waypoints of the
+    ///* latest tick taken to its frame. Returns once the problem is made (so
+    ///* before the buffers of the tick may be swapped out), the solve goes on
+    ///* on a thread of its own until the next `step` (or `reconfigure`)
+    ///* waits for it. Does nothing without the mode, after a tick that
+    ///* wasn't solved, or when the plan doesn't reach that far
+    void speculate(double interval);
+
+    ///* The period [s] of the ticks from now on, when the rate changes (see
+    ///* `Params::rate_governor`): the deadline of the solves, unless
+    ///* `solve_deadline` sets it. From the solver loop
+    void set_control_period(double period);
+
+    ///* A flag that, once raised (from any thread, see
+    ///* MPCControllerNode::signal_go_cb), cancels the solve of a tick with
+    ///* go that's in flight (see `MPC::set_cancel_flag`); the ticks without
+    ///* go aren't cancelled. Null for none
+    void set_cancel_flag(const std::atomic<bool> * cancel) { m_cancel = cancel; }
+
+    ///* The plan of the latest tick, for the fast tracking loop (see
+    ///* `Params::tracking_rate`) and the plan topic: not OK unless it was
+    ///* solved, with go. Doesn't allocate once `plan` has the room
+    void plan(Plan & plan) const;
+
+    ///* The controller the latest solution is from (its variables and
+    ///* their layout), for the offline tools; null with the PID law alone
+    const MPC * solved_controller() const {
+        return m_controllers.empty() ? nullptr : &m_controllers[m_active]->chosen_controller();
+    }
+
+    ///* Fills the flight record of the latest tick in, from its `inputs` and
+    ///* what `step` reported of it (`record`); doesn't allocate
+    void record_flight(const InputSnapshot & inputs, const TelemetryRecord & record, FlightRecord & flight);
+
+    ///* The same for the live view, with `plan` that of the tick (see
+    ///* `plan`); doesn't allocate
+    void live_frame(const InputSnapshot & inputs, const TelemetryRecord & record, const Plan & plan,
+                    LiveFrame & frame);
+
+    ///* `num_solves` solves straight ahead from the path, with the shape of
+    ///* the real problem; returns how long they took [s]
+    double warm_up(int num_solves);
+
+    ///* The servo position that means "go straight" in Dzik
+    static constexpr double CENTER_IN_DZIK = 0.56;
+    ///* Dzik's wheel radius
+    static constexpr double WHEEL_RADIUS_IN_DZIK = 0.055; // [m]
+
+    ///* The pose of the car after driving at speed v and with the steering
+    ///* angle [rad] for `interval` [s], by the kinematic model of FG_eval
+    static void project_pose(double pos_x, double pos_y, double psi, double v, double steer_angle,
+                             double interval, double & pos_x_out, double & pos_y_out, double & psi_out);
+
+    ///* The mapping of the actuators to Dzik's commands, and back
+    static double steer_to_dzik(double steer_angle) { return CENTER_IN_DZIK - steer_angle; }
+    static double steer_from_dzik(double steer_cmd) { return CENTER_IN_DZIK - steer_cmd; }
+    static double speed_to_dzik(double speed);
+    static double speed_from_dzik(double rpm);
+
+private:
+    ///* (Re-)builds the controllers for `m_params`, with `parallel_build`
+    ///* warmed up by `warmup_solves` solves each
+    void build_controllers(int warmup_solves = 0);
+
+    ///* Fills the slots of the obstacles of `m_obstacles` in for `problem`,
+    ///* culled against the latest tick's plan (so before `solve` replaces it)
+    void select_obstacles(const InputSnapshot & inputs, const TickProblem & problem);
+
+    ///* Targets the terminal cost of the active controller at the states of
+    ///* the previous laps (see `Params::learning_mpc`) about where its last
+    ///* plan ended, or at where the car is before it has one
+    void target_safe_set(const TickProblem & problem, double speed);
+
+    ///* Waits for the speculative solve, if one is running; whether there's
+    ///* a speculative solution (which `step` may take once)
+    bool finish_speculation();
+    void solve_speculation();
+
+    ///* The configuration the controllers are built for
+    Params m_params;
+
+    ///* The Model Predictive controllers: just one, one per horizon of the
+    ///* speed-adaptive horizon (see `Params::adaptive_horizons`), or one per
+    ///* predicted backend (see `Params::predicted_backends`), each with its
+    ///* own tape, buffers and warm start (and with its parallel
+    ///* variants, solved on `m_pool`, which may be the pipeline's own).
+    ///* `m_active` solves
+    std::unique_ptr<Eigen::ThreadPoolInterface> m_own_pool;
+    Eigen::ThreadPoolInterface * m_pool;
+    std::vector<std::unique_ptr<MultiStartSolver> > m_controllers;
+    size_t m_active;
+    ///* The speeds [m/s] from which each next controller takes over
+    std::vector<double> m_horizon_speeds;
+    ///* The longest of their horizons
+    size_t m_max_steps_ahead;
+
+    ///* The alternative reference lines, solved along with the controller
+    ///* (see `Params::reference_offsets`); null without them
+    std::unique_ptr<ReferenceCandidates> m_candidates;
+
+    ///* The choice of the controller of a tick by the predicted solve times
+    ///* of their backends (see `Params::predicted_backends`), null without
+    ///* it; the features of the latest problem, and how the controller that
+    ///* solved the previous tick (none: `m_controllers.size()`) warm starts:
+    ///* from the errors of that problem, in its iterations
+    std::unique_ptr<SolveTimePredictor> m_predictor;
+    double m_features[SolveTimePredictor::NUM_FEATURES];
+    size_t m_previous_controller;
+    double m_previous_cte;
+    double m_previous_epsi;
+    int m_previous_iterations;
+
+    MultiStartSolver & controller() { return *m_controllers[m_active]; }
+
+    ///* The controller for `speed` [m/s], from the active one: it only
+    ///* changes once the speed is HORIZON_HYSTERESIS past the threshold
+    size_t select_controller(double speed) const;
+
+    ///* The controller whose backend is predicted to solve the problem of
+    ///* `state` and `coeffs` by `deadline`, from now (see SolveTimePredictor),
+    ///* and its prediction into `record`
+    size_t select_backend(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double speed,
+                          double ref_v, std::chrono::steady_clock::time_point deadline, TelemetryRecord & record);
+
+    ///* The results of the last solves (see `Params::solution_cache_size`),
+    ///* looked up before solving; without the cache, the last one alone,
+    ///* which stands while parked (no go) on the same problem. The stats of
+    ///* a tick answered from it
+    SolutionCache m_cache;
+    bool m_cache_enabled;
+    SolveStats m_cached_stats;
+
+    ///* The speculative solve (see `speculate`), on `m_speculation_pool` (a
+    ///* thread of its own, or the shared pool): the controller it's for, the
+    ///* pose it's from (in the world frame), its problem, result and stats,
+    ///* and whether it's running
+    std::unique_ptr<Eigen::ThreadPoolInterface> m_own_speculation_pool;
+    Eigen::ThreadPoolInterface * m_speculation_pool;
+    bool m_speculative;
+    double m_speculative_tolerance;
+    double m_speculative_heading_tolerance;
+    size_t m_speculative_controller;
+    double m_speculative_x;
+    double m_speculative_y;
+    double m_speculative_psi;
+    WaypointBuffer m_speculative_pts;
+    Eigen::VectorXd m_speculative_coeffs;
+    Eigen::VectorXd m_speculative_state;
+    double m_speculative_ref_v;
+    std::vector<double> m_speculative_vars;
+    SolveStats m_speculative_stats;
+    bool m_speculation_OK;
+    ///* The latest tick's plan is one to speculate from
+    bool m_plan_OK;
+    ///* ... or one the car follows, and when it starts (see `plan`)
+    bool m_solved_plan_OK;
+    double m_stamp_lat;
+    std::chrono::steady_clock::time_point m_speculative_deadline;
+    std::mutex m_speculation_mutex;
+    std::condition_variable m_speculation_done;
+    bool m_speculating;
+
+    ///* The remote offload (see `Params::remote_solver`): the socket to the
+    ///* server, how long [s] from the start of a tick its result is waited
+    ///* for, whether its warm start is to be reset with the next request, and
+    ///* the last reply with its stats
+    std::unique_ptr<RemoteSolver> m_remote;
+    double m_remote_timeout;
+    bool m_remote_reset;
+    RemoteReply m_remote_reply;
+    SolveStats m_remote_stats;
+
+    ///* The check of the plans before they're followed (see
+    ///* `Params::validate_plan`)
+    std::unique_ptr<PlanValidator> m_validator;
+
+    ///* The states of the previous laps the terminal cost targets (see
+    ///* `Params::learning_mpc`), null without it
+    std::unique_ptr<SampledSafeSet> m_safe_set;
+
+    ///* The plans of the previous laps by stretch of the track, which seed
+    ///* the solves without a last solution (see `Params::lap_warm_start`),
+    ///* null without them
+    std::unique_ptr<LapWarmStarts> m_lap_warm_starts;
+
+    ///* The last fallback of a failed solve, and how much slower than the
+    ///* reference speed it drives
+    PIDController m_pid;
+
+    ///* The PID law steers on its own, without controllers (see
+    ///* `Params::controller`), and the stats of its ticks
+    bool m_pid_only;
+    SolveStats m_pid_stats;
+
+    ///* The closest waypoint, the window of the fit and the fit
+    PathTracker m_tracker;
+
+    ///* The last fit made from the waypoints, which the path stage moves into
+    ///* the frame of a pose within `Params::fit_reuse_distance` and
+    ///* `fit_reuse_angle` of its own instead of fitting again: the path (and
+    ///* its hash, in case another takes its place), the pose, the fraction
+    ///* of the window that was real and the coefficients
+    struct FitAnchor {
+        bool OK = false;
+        const Centerline * centerline = nullptr;
+        uint64_t hash = 0;
+        double pos_x = 0.0;
+        double pos_y = 0.0;
+        double psi = 0.0;
+        double fraction_steps_OK = 1.0;
+        Eigen::VectorXd coeffs;
+    };
+    FitAnchor m_fit_anchor;
+    double m_fit_reuse_distance;
+    double m_fit_reuse_angle;
+
+    ///* Only with `Params::max_obstacles`: the obstacles of the slots of the
+    ///* controllers, and the latest plan in the world frame they're culled by
+    std::unique_ptr<ObstacleSelector> m_obstacles;
+    std::vector<double> m_plan_x;
+    std::vector<double> m_plan_y;
+
+    ///* The path stage and the solve run on threads of their own (see
+    ///* `Params::pipelined`); the problem of `step` otherwise
+    bool m_pipelined;
+    TickProblem m_problem;
+
+    ///* Scratch buffers, kept to reuse their storage: the fit, the state and
+    ///* the solution (of the tick solved last), which makes a warmed-up tick
+    ///* allocation-free (see AllocationCounter), and the waypoints of the fit
+    ///* of a pipelined tick
+    Eigen::VectorXd m_coeffs;
+    Eigen::VectorXd m_state;
+    std::vector<double> m_vars;
+    WaypointBuffer m_car_pts;
+    bool m_check_allocations;
+    uint64_t m_ticks_solved;
+
+    ///* The solve has to be done this long [s] after the start of the tick
+    ///* (0: no deadline), see `Params::solve_deadline`
+    double m_time_budget;
+    bool m_fixed_time_budget;
+
+    ///* See `set_cancel_flag`
+    const std::atomic<bool> * m_cancel;
+
+    ///* The last commands (the steering angle [rad] too), which the path
+    ///* stage projects the pose by
+    std::atomic<double> m_steer;
+    std::atomic<double> m_steer_angle;
+    double m_rpm;
+
+    double m_pos_x_lat;
+    double m_pos_y_lat;
+    double m_psi_lat;
+
+    ///* The path stage's (m_params' are the solve's)
+    double m_ref_v;
+    double m_ref_v_alpha;
+    ///* The reference speed of the latest tick's problem
+    double m_new_ref_v;
+
+    double m_latency;
+    ///* See `Params::latency_mode`, and the running estimate of the time from
+    ///* the start of a tick to its commands [s] (negative before the first)
+    bool m_measured_latency;
+    std::atomic<double> m_tick_time_estimate;
+    ///* See `Params::align_inputs`
+    bool m_align_inputs;
+    double m_align_max_extrapolation;
+    ///* See `Params::dead_reckoning`
+    bool m_dead_reckoning;
+    double m_dead_reckoning_max_age;
+    ///* See `Params::perf_counters`
+    bool m_perf_counters;
+    ///* See `Params::cpu_time`
+    bool m_cpu_time;
+    ///* See `Params::cppad_cap_mb` [bytes] (0: no cap)
+    size_t m_cppad_cap;
+
+    ///* A measured latency is capped to this (e.g. with unsynchronized clocks)
+    static constexpr double MAX_MEASURED_LATENCY = 0.5; // [s]
+    ///* Longest step of the integration of `project_pose`
+    static constexpr double PROJECTION_STEP = 0.01; // [s]
+    ///* Weight of the latest tick in `m_tick_time_estimate`
+    static constexpr double TICK_TIME_ALPHA = 0.1;
+
+    ///* Shortest step [m] of the plan a heading is taken from (slower, the
+    ///* car isn't speculated about)
+    static constexpr double SPECULATION_MIN_STEP = 1e-3;
+
+    ///* Band [m/s] around the speeds of the adaptive horizon within which
+    ///* the active controller is kept
+    static constexpr double HORIZON_HYSTERESIS = 0.2;
+
+    ///* Solved ticks after which a tick must no longer allocate
+    static constexpr uint64_t ALLOCATION_CHECK_WARMUP = 10;
+};
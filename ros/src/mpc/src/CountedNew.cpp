@@ -0,0 +1,64 @@
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+
+// The global operator new and delete of debug builds, counted (see
+// AllocationCounter). mpc_node_cpp replaces them with those of
+// ArenaNew.cpp, which count the same
+
+#ifndef NDEBUG
+
+static void * counted_malloc(std::size_t size) {
+    AllocationCounter::record();
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+
+void * operator new(std::size_t size) {
+    void * p = counted_malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+
+void * operator new[](std::size_t size) {
+    void * p = counted_malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return counted_malloc(size);
+}
+
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return counted_malloc(size);
+}
+
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+
+void operator delete[](void * p) noexcept {
+    std::free(p);
+}
+
+
+void operator delete(void * p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+
+void operator delete[](void * p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+#endif
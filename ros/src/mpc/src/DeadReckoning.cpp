@@ -0,0 +1,102 @@
+#include <cmath>
+
+#include "DeadReckoning.h"
+
+
+constexpr size_t DeadReckoning::CAPACITY;
+constexpr double DeadReckoning::IMU_MAX_AGE;
+
+
+void DeadReckoning::add_odometry(double stamp, double speed, double yaw_rate) {
+    if (m_imu_OK and stamp >= m_imu_stamp and stamp - m_imu_stamp <= IMU_MAX_AGE)
+        yaw_rate = m_imu_yaw_rate;
+
+    Sample sample{stamp, 0.0, 0.0, 0.0, speed, yaw_rate};
+    if (m_size > 0) {
+        const Sample & last = m_samples[(m_next + CAPACITY - 1) % CAPACITY];
+        if (stamp <= last.stamp)
+            return;
+        sample.x = last.x;
+        sample.y = last.y;
+        sample.psi = last.psi;
+        drive(sample.x, sample.y, sample.psi, last.speed, last.yaw_rate, stamp - last.stamp);
+    }
+    m_samples[m_next] = sample;
+    m_next = (m_next + 1) % CAPACITY;
+    if (m_size < CAPACITY)
+        m_size++;
+
+    // A fix from before the first sample can be placed now
+    if (!m_fix_OK and m_fix_stamp > 0.0)
+        set_fix(m_fix_stamp, m_fix_x, m_fix_y, m_fix_psi);
+}
+
+
+void DeadReckoning::add_imu(double stamp, double yaw_rate) {
+    m_imu_stamp = stamp;
+    m_imu_yaw_rate = yaw_rate;
+    m_imu_OK = true;
+}
+
+
+void DeadReckoning::set_fix(double stamp, double x, double y, double psi) {
+    m_fix_stamp = stamp;
+    m_fix_x = x;
+    m_fix_y = y;
+    m_fix_psi = psi;
+    m_fix_OK = integrated_at(stamp, m_fix_integrated_x, m_fix_integrated_y, m_fix_integrated_psi);
+}
+
+
+bool DeadReckoning::pose_at(double time, double max_age, double & x, double & y, double & psi) const {
+    if (!m_fix_OK or std::fabs(time - m_fix_stamp) > max_age)
+        return false;
+    const Sample & last = m_samples[(m_next + CAPACITY - 1) % CAPACITY];
+    if (time - last.stamp > max_age)
+        return false;
+    double integrated_x, integrated_y, integrated_psi;
+    if (!integrated_at(time, integrated_x, integrated_y, integrated_psi))
+        return false;
+
+    // The motion since the fix, in the frame of the car at the fix, onto
+    // the fix
+    double dx = integrated_x - m_fix_integrated_x;
+    double dy = integrated_y - m_fix_integrated_y;
+    double c = std::cos(m_fix_integrated_psi);
+    double s = std::sin(m_fix_integrated_psi);
+    double forward = c * dx + s * dy;
+    double left = -s * dx + c * dy;
+    x = m_fix_x + std::cos(m_fix_psi) * forward - std::sin(m_fix_psi) * left;
+    y = m_fix_y + std::sin(m_fix_psi) * forward + std::cos(m_fix_psi) * left;
+    psi = std::remainder(m_fix_psi + integrated_psi - m_fix_integrated_psi, 2 * M_PI);
+    return true;
+}
+
+
+bool DeadReckoning::integrated_at(double time, double & x, double & y, double & psi) const {
+    for (size_t i=0; i < m_size; i++) {
+        const Sample & sample = m_samples[(m_next + CAPACITY - 1 - i) % CAPACITY];
+        if (sample.stamp <= time) {
+            x = sample.x;
+            y = sample.y;
+            psi = sample.psi;
+            drive(x, y, psi, sample.speed, sample.yaw_rate, time - sample.stamp);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void DeadReckoning::drive(double & x, double & y, double & psi, double speed, double yaw_rate, double dt) {
+    double dpsi = yaw_rate * dt;
+    if (std::fabs(dpsi) < 1e-9) {
+        x += speed * dt * std::cos(psi);
+        y += speed * dt * std::sin(psi);
+    } else {
+        double radius = speed / yaw_rate;
+        x += radius * (std::sin(psi + dpsi) - std::sin(psi));
+        y += radius * (std::cos(psi) - std::cos(psi + dpsi));
+    }
+    psi += dpsi;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+
+///* The pose between two fixes of the localization (see
+///* `Params::dead_reckoning`), dead reckoned from the odometry: its speed
+///* and yaw rate (or the IMU's, when there's a recent one) are integrated at
+///* their own rate, sample after sample, into a pose of its own frame, and
+///* the motion from the fix's instant to the query's is applied to the fix.
+///*
+///* A ring of CAPACITY samples, each with the pose integrated up to it, in
+///* place (no allocation), so that it travels with the InputSnapshot
+///* through its triple buffer, like the StateHistory. A query at or after
+///* the latest sample (as the ticks' are) integrates from it alone; an
+///* older one walks back to the sample before it.
+struct DeadReckoning {
+    static constexpr size_t CAPACITY = 32;
+
+    ///* A sample of the odometry: speed [m/s] and yaw rate [rad/s] from
+    ///* `stamp` [s] on. Samples out of order are dropped
+    void add_odometry(double stamp, double speed, double yaw_rate);
+
+    ///* The yaw rate [rad/s] of the IMU, used by the odometry samples in
+    ///* place of their own for up to IMU_MAX_AGE after `stamp`
+    void add_imu(double stamp, double yaw_rate);
+
+    ///* A fix of the localization; the queries are from the latest one
+    void set_fix(double stamp, double x, double y, double psi);
+
+    ///* The pose at `time` [s], at most `max_age` [s] from the fix and from
+    ///* the latest odometry. False without a fix within the samples
+    bool pose_at(double time, double max_age, double & x, double & y, double & psi) const;
+
+    static constexpr double IMU_MAX_AGE = 0.1; // [s]
+
+private:
+    struct Sample {
+        double stamp;
+        ///* The pose integrated up to the sample, in the frame of the dead
+        ///* reckoning, and the motion from it on
+        double x;
+        double y;
+        double psi;
+        double speed;
+        double yaw_rate;
+    };
+
+    ///* The pose of the dead reckoning at `time`, from the latest sample
+    ///* before it; false if it's before the oldest
+    bool integrated_at(double time, double & x, double & y, double & psi) const;
+
+    ///* Drives (x, y, psi) at `speed` and `yaw_rate` for `dt`, along the arc
+    static void drive(double & x, double & y, double & psi, double speed, double yaw_rate, double dt);
+
+    std::array<Sample, CAPACITY> m_samples;
+    size_t m_next = 0;
+    size_t m_size = 0;
+
+    double m_imu_stamp = 0.0;
+    double m_imu_yaw_rate = 0.0;
+    bool m_imu_OK = false;
+
+    ///* The fix, and the pose of the dead reckoning at its instant
+    bool m_fix_OK = false;
+    double m_fix_stamp = 0.0;
+    double m_fix_x = 0.0;
+    double m_fix_y = 0.0;
+    double m_fix_psi = 0.0;
+    double m_fix_integrated_x = 0.0;
+    double m_fix_integrated_y = 0.0;
+    double m_fix_integrated_psi = 0.0;
+};
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ExplicitTable.h"
+#include "Log.h"
+
+
+constexpr size_t ExplicitTable::MAX_DIMS;
+const char ExplicitTable::MAGIC[8] = {'M', 'P', 'C', 'T', 'A', 'B', '1', '\0'};
+
+
+ExplicitTable::ExplicitTable()
+        : m_map(nullptr), m_size(0), m_header(nullptr), m_nodes(nullptr), m_cell_errors(nullptr) {}
+
+
+ExplicitTable::~ExplicitTable() {
+    if (m_map != nullptr)
+        munmap(m_map, m_size);
+}
+
+
+size_t ExplicitTable::num_nodes(const Header & header) {
+    size_t n = 1;
+    for (size_t d=0; d < header.num_dims; d++)
+        n *= header.axis_count[d];
+    return n;
+}
+
+
+size_t ExplicitTable::num_cells(const Header & header) {
+    size_t n = 1;
+    for (size_t d=0; d < header.num_dims; d++)
+        n *= header.axis_count[d] - 1;
+    return n;
+}
+
+
+ExplicitTable::Header ExplicitTable::make_header(const Params & params, const std::vector<float> & axis_min,
+                                                 const std::vector<float> & axis_max,
+                                                 const std::vector<uint32_t> & axis_count) {
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.num_dims = uint32_t(axis_count.size());
+    header.steps_ahead = uint32_t(params.steps_ahead);
+    header.poly_degree = params.poly_degree;
+    header.dt = float(params.dt);
+    header.cte_coeff = float(params.cte_coeff);
+    header.epsi_coeff = float(params.epsi_coeff);
+    header.speed_coeff = float(params.speed_coeff);
+    header.steer_coeff = float(params.steer_coeff);
+    header.consec_steer_coeff = float(params.consec_steer_coeff);
+    header.consec_speed_coeff = float(params.consec_speed_coeff);
+    for (size_t d=0; d < axis_count.size() and d < MAX_DIMS; d++) {
+        header.axis_min[d] = axis_min[d];
+        header.axis_max[d] = axis_max[d];
+        header.axis_count[d] = axis_count[d];
+    }
+    return header;
+}
+
+
+bool ExplicitTable::load(const std::string & path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        MPC_ERROR("Could not open %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    struct stat table_stat;
+    if (fstat(fd, &table_stat) != 0) {
+        MPC_ERROR("Could not stat %s: %s", path.c_str(), std::strerror(errno));
+        close(fd);
+        return false;
+    }
+    size_t size = size_t(table_stat.st_size);
+    if (size < sizeof(Header)) {
+        MPC_ERROR("%s is not an explicit MPC table", path.c_str());
+        close(fd);
+        return false;
+    }
+    void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        MPC_ERROR("Could not map %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    // The header, and the sizes it implies
+    const Header * header = static_cast<const Header *>(data);
+    bool OK = (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0
+               and header->num_dims >= 2 and header->num_dims <= MAX_DIMS);
+    for (size_t d=0; OK and d < header->num_dims; d++)
+        OK = (header->axis_count[d] >= 2 and header->axis_max[d] > header->axis_min[d]);
+    if (OK)
+        OK = (size == sizeof(Header) + (2 * num_nodes(*header) + 2 * num_cells(*header)) * sizeof(float));
+    if (!OK) {
+        MPC_ERROR("%s is not an explicit MPC table", path.c_str());
+        munmap(data, size);
+        return false;
+    }
+
+    if (m_map != nullptr)
+        munmap(m_map, m_size);
+    m_map = data;
+    m_size = size;
+    m_header = header;
+    m_nodes = reinterpret_cast<const float *>(static_cast<const char *>(data) + sizeof(Header));
+    m_cell_errors = m_nodes + 2 * num_nodes(*header);
+    return true;
+}
+
+
+bool ExplicitTable::matches(const Params & params) const {
+    if (m_header == nullptr)
+        return false;
+    const Header & h = *m_header;
+    // The weights went through floats
+    auto same = [](float stored, double value) {
+        return std::abs(stored - value) <= 1e-6 * std::max(1.0, std::abs(value));
+    };
+    return h.steps_ahead == params.steps_ahead and h.poly_degree == params.poly_degree
+           and h.num_dims == size_t(params.poly_degree) + 2
+           and same(h.dt, params.dt) and params.dt_steps.empty() and params.input_blocks.empty()
+           and same(h.cte_coeff, params.cte_coeff) and same(h.epsi_coeff, params.epsi_coeff)
+           and same(h.speed_coeff, params.speed_coeff) and same(h.steer_coeff, params.steer_coeff)
+           and same(h.consec_steer_coeff, params.consec_steer_coeff)
+           and same(h.consec_speed_coeff, params.consec_speed_coeff);
+}
+
+
+void ExplicitTable::grid_point(const Header & header, const double * index, double * point) {
+    for (size_t d=0; d < header.num_dims; d++)
+        point[d] = header.axis_min[d]
+                + index[d] * (double(header.axis_max[d]) - header.axis_min[d]) / (header.axis_count[d] - 1);
+}
+
+
+bool ExplicitTable::interpolate(const Header & header, const float * nodes, const double * point,
+                                double & delta, double & v, size_t & cell) {
+    size_t num_dims = header.num_dims;
+
+    // The cell, and where in it the point is
+    size_t lower[MAX_DIMS];
+    double fraction[MAX_DIMS];
+    size_t node_stride[MAX_DIMS];
+    size_t node_stride_d = 1, cell_stride_d = 1;
+    cell = 0;
+    for (size_t d=num_dims; d-- > 0;) {
+        size_t count = header.axis_count[d];
+        double t = (point[d] - header.axis_min[d]) / (double(header.axis_max[d]) - header.axis_min[d]) * (count - 1);
+        if (!(t >= 0.0 and t <= count - 1))
+            return false;
+        lower[d] = std::min(size_t(t), count - 2);
+        fraction[d] = t - lower[d];
+
+        node_stride[d] = node_stride_d;
+        cell += lower[d] * cell_stride_d;
+        node_stride_d *= count;
+        cell_stride_d *= count - 1;
+    }
+
+    // Every corner of the cell, by its weight
+    delta = 0.0;
+    v = 0.0;
+    for (size_t corner=0; corner < (size_t(1) << num_dims); corner++) {
+        double weight = 1.0;
+        size_t node = 0;
+        for (size_t d=0; d < num_dims; d++) {
+            bool upper = (corner >> d) & 1;
+            weight *= upper ? fraction[d] : 1.0 - fraction[d];
+            node += (lower[d] + (upper ? 1 : 0)) * node_stride[d];
+        }
+        float node_delta = nodes[2 * node];
+        float node_v = nodes[2 * node + 1];
+        if (std::isnan(node_delta) or std::isnan(node_v))
+            return false;
+        delta += weight * node_delta;
+        v += weight * node_v;
+    }
+    return true;
+}
+
+
+bool ExplicitTable::lookup(const Eigen::VectorXd & coeffs, double ref_v, double steer_tolerance,
+                           double speed_tolerance, double & delta, double & v) const {
+    if (m_header == nullptr or size_t(coeffs.size()) + 1 != m_header->num_dims)
+        return false;
+
+    double point[MAX_DIMS];
+    for (int i=0; i < coeffs.size(); i++)
+        point[i] = coeffs[i];
+    point[coeffs.size()] = ref_v;
+
+    size_t cell;
+    if (!interpolate(*m_header, m_nodes, point, delta, v, cell))
+        return false;
+    // NaN (a failed solve at the center) doesn't pass either
+    return m_cell_errors[2 * cell] <= steer_tolerance and m_cell_errors[2 * cell + 1] <= speed_tolerance;
+}
+
+
+bool ExplicitTable::write(const std::string & path, const Header & header, const std::vector<float> & nodes,
+                          const std::vector<float> & cell_errors) {
+    if (nodes.size() != 2 * num_nodes(header) or cell_errors.size() != 2 * num_cells(header)) {
+        MPC_ERROR("The table doesn't have the size of its grid");
+        return false;
+    }
+
+    // Written aside and then renamed, so a reader never maps half of it
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream table(tmp_path, std::ios::binary | std::ios::trunc);
+        table.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        table.write(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(float));
+        table.write(reinterpret_cast<const char *>(cell_errors.data()), cell_errors.size() * sizeof(float));
+        if (!table) {
+            MPC_ERROR("Could not write %s", tmp_path.c_str());
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        MPC_ERROR("Could not write %s: %s", path.c_str(), std::strerror(errno));
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+///* Explicit MPC: the first actuations of the solves on a regular grid over
+///* the inputs of `MPC::Solve`, interpolated (multilinearly) in between.
+///*
+///* The state of a solve follows from the fit (cte = c0, epsi = -atan(c1)),
+///* so the inputs are the coefficients of the polynomial and the reference
+///* speed: a grid of `poly_degree` + 2 dimensions. Every cell keeps the
+///* error of the interpolation at its center (against a solve there), so a
+///* lookup can refuse the cells where the law isn't smooth enough.
+///*
+///* The file (made by mpc_tablegen) is the Header, then the actuations
+///* (delta, v) of every node, NaN where the solve failed, then the errors
+///* (of delta and v) of every cell, all floats. It's mapped into memory, not
+///* read.
+class ExplicitTable {
+public:
+    static constexpr size_t MAX_DIMS = 6;
+
+    struct Header {
+        char magic[8];
+        uint32_t num_dims;
+        uint32_t steps_ahead;
+        int32_t poly_degree;
+        float dt;
+        ///* The weights of the cost the solves had
+        float cte_coeff;
+        float epsi_coeff;
+        float speed_coeff;
+        float steer_coeff;
+        float consec_steer_coeff;
+        float consec_speed_coeff;
+        ///* The grid: the coefficients of the polynomial (lowest order
+        ///* first), then the reference speed; at least 2 nodes each
+        float axis_min[MAX_DIMS];
+        float axis_max[MAX_DIMS];
+        uint32_t axis_count[MAX_DIMS];
+    };
+
+    ExplicitTable();
+    ~ExplicitTable();
+    ExplicitTable(const ExplicitTable &) = delete;
+    ExplicitTable & operator=(const ExplicitTable &) = delete;
+
+    ///* Maps the table at `path`; false (and logs why) if it can't, or if it
+    ///* isn't one
+    bool load(const std::string & path);
+
+    ///* Whether it was made for the horizon, the weights and the degree of
+    ///* `params`
+    bool matches(const Params & params) const;
+
+    ///* The actuations for the inputs, interpolated; false outside of the
+    ///* grid, next to a failed solve, or in a cell whose error exceeds the
+    ///* tolerances ([rad] and [m/s]). Doesn't allocate
+    bool lookup(const Eigen::VectorXd & coeffs, double ref_v, double steer_tolerance, double speed_tolerance,
+                double & delta, double & v) const;
+
+    ///* The header of a table for the grid, and of its nodes and cells
+    static Header make_header(const Params & params, const std::vector<float> & axis_min,
+                              const std::vector<float> & axis_max, const std::vector<uint32_t> & axis_count);
+    static size_t num_nodes(const Header & header);
+    static size_t num_cells(const Header & header);
+
+    ///* The point of the grid at the (fractional) `index` of every axis
+    static void grid_point(const Header & header, const double * index, double * point);
+
+    ///* The multilinear interpolation of `nodes` (2 floats each) at `point`,
+    ///* and the cell it's in; false outside of the grid or next to a failed
+    ///* solve
+    static bool interpolate(const Header & header, const float * nodes, const double * point,
+                            double & delta, double & v, size_t & cell);
+
+    ///* Writes a table; false (and logs why) if it can't
+    static bool write(const std::string & path, const Header & header, const std::vector<float> & nodes,
+                      const std::vector<float> & cell_errors);
+
+private:
+    void * m_map;
+    size_t m_size;
+    const Header * m_header;
+    const float * m_nodes;
+    const float * m_cell_errors;
+
+    static const char MAGIC[8];
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <cppad/cppad.hpp>
+#include "MPC.h"
+#include "Polynomial.h"
+#include "StageCost.h"
+#include "TerminalCost.h"
+#include "Trace.h"
+#include "VehicleModel.h"
+
+
+using CppAD::AD;
+
+
+///* `Base` is double, except when generating the derivative code (see
+///* mpc_codegen.cpp), where it is CppAD::cg::CG<double>. `Model` is the
+///* vehicle model (see VehicleModel.h), whose extra states (after x, y,
+///* psi, cte and epsi, see `Indexes::extra`) are constrained like the others.
+///* `Trig` has the trigonometric functions of the stages (see FastTrig.h)
+template <class Base, class Model = KinematicBicycle, class Trig = ExactTrig>
+class FG_eval_base {
+public:
+    typedef CPPAD_TESTVECTOR(AD<Base>) ADvector;
+
+    // Fitted polynomial coefficients, or the references of the steps with
+    // `Params::contouring_reference`
+    ADvector m_coeffs;
+
+    // Reference speed
+    AD<Base> m_ref_v;
+
+    // Weights of the terms of the cost (see StageCost)
+    enum Weight {
+        W_CTE = StageCost::W_CTE, W_EPSI = StageCost::W_EPSI, W_SPEED = StageCost::W_SPEED,
+        W_STEER = StageCost::W_STEER, W_CONSEC_STEER = StageCost::W_CONSEC_STEER,
+        W_CONSEC_SPEED = StageCost::W_CONSEC_SPEED, NUM_WEIGHTS = StageCost::NUM_WEIGHTS
+    };
+    AD<Base> m_weights[NUM_WEIGHTS];
+
+    Params m_params;
+    Indexes m_indexes;
+
+    FG_eval_base(const Eigen::VectorXd & coeffs, const Params & params, const Indexes & indexes, const double ref_v)
+        : m_coeffs(coeffs.size()), m_params(params), m_indexes(indexes) {
+
+        for (int i=0; i<coeffs.size(); i++)
+            m_coeffs[i] = coeffs[i];
+        m_ref_v = ref_v;
+        set_weights(params);
+    }
+
+    // Used when recording a persistent tape: `coeffs` and `ref_v` are then
+    // CppAD dynamic parameters instead of constants baked into the tape
+    FG_eval_base(const ADvector & coeffs, const AD<Base> & ref_v, const Params & params, const Indexes & indexes)
+        : m_coeffs(coeffs), m_ref_v(ref_v), m_params(params), m_indexes(indexes) {
+        set_weights(params);
+    }
+
+    // ... and so are the weights, in the order of `Weight`
+    FG_eval_base(const ADvector & coeffs, const AD<Base> & ref_v, const ADvector & weights, const Params & params,
+                 const Indexes & indexes)
+        : m_coeffs(coeffs), m_ref_v(ref_v), m_params(params), m_indexes(indexes) {
+        for (size_t i=0; i<NUM_WEIGHTS; i++)
+            m_weights[i] = weights[i];
+    }
+
+    // The weights of `params`, in the order of `Weight`
+    static void weights(const Params & params, double * out) {
+        StageCost::weights(params, out);
+    }
+
+    void operator()(ADvector &fg, const ADvector &vars) {
+        MPC_TRACE_SCOPE("FG_eval");
+
+        // The cost is stored in the first element of fg.
+        // Any additions to the cost should be added to fg[0].
+        // The terms of the states and of the actuations (see StageCost)
+        fg[0] = StageCost::Cost::value(vars, m_indexes, m_params.steps_ahead, m_weights, m_ref_v);
+
+        // The cost to go from the end of the horizon (see TerminalCost)
+        if (m_terminal.size() == TerminalCost::SIZE) {
+            const ADvector & p = m_terminal;
+            AD<Base> cte = vars[m_indexes.cte_start + m_params.steps_ahead - 1] - p[TerminalCost::CTE_TARGET];
+            AD<Base> epsi = vars[m_indexes.epsi_start + m_params.steps_ahead - 1] - p[TerminalCost::EPSI_TARGET];
+            AD<Base> delta = vars[m_indexes.delta(m_params.steps_ahead - 2)] - p[TerminalCost::DELTA_TARGET];
+            fg[0] += cte * (p[TerminalCost::CTE_CTE] * cte + p[TerminalCost::CTE_EPSI] * epsi
+                            + p[TerminalCost::CTE_DELTA] * delta)
+                    + epsi * (p[TerminalCost::CTE_EPSI] * cte + p[TerminalCost::EPSI_EPSI] * epsi
+                              + p[TerminalCost::EPSI_DELTA] * delta)
+                    + delta * (p[TerminalCost::CTE_DELTA] * cte + p[TerminalCost::EPSI_DELTA] * epsi
+                               + p[TerminalCost::DELTA_DELTA] * delta);
+        }
+
+
+        // Initial constraints
+        //
+        // We add 1 to each of the starting indices due to cost being located at
+        // index 0 of `fg`.
+        // This bumps up the position of all the other values.
+        fg[1 + m_indexes.x_start] = vars[m_indexes.x_start];
+        fg[1 + m_indexes.y_start] = vars[m_indexes.y_start];
+        fg[1 + m_indexes.psi_start] = vars[m_indexes.psi_start];
+        fg[1 + m_indexes.cte_start] = vars[m_indexes.cte_start];
+        fg[1 + m_indexes.epsi_start] = vars[m_indexes.epsi_start];
+        for (size_t e=0; e < Model::EXTRA_STATES; e++)
+            fg[1 + m_indexes.extra(e, 0)] = vars[m_indexes.extra(e, 0)];
+
+        // The rest of the constraints (the steps don't get the references
+        // of a contouring one, which only the errors below need)
+        ADvector in(STAGE_COEFFS + stage_coeffs(m_params, m_coeffs.size()));
+        ADvector out(STAGE_OUTPUTS);
+        for (size_t i=0; i<out.size(); i++)
+            out[i] = 0.0;
+        for (size_t i=STAGE_COEFFS; i<in.size(); i++)
+            in[i] = m_coeffs[i - STAGE_COEFFS];
+
+        for (size_t t = 1; t < m_params.steps_ahead; t++) {
+            // The state at time t+1 .
+            AD<Base> x1 = vars[m_indexes.x_start + t];
+            AD<Base> y1 = vars[m_indexes.y_start + t];
+            AD<Base> psi1 = vars[m_indexes.psi_start + t];
+            // No longer needed:
+            // AD<Base> v1 = vars[m_indexes.v_start + t];
+            AD<Base> cte1 = vars[m_indexes.cte_start + t];
+            AD<Base> epsi1 = vars[m_indexes.epsi_start + t];
+
+            // The state at time t, and only the actuation at time t
+            in[STAGE_X] = vars[m_indexes.x_start + t - 1];
+            in[STAGE_Y] = vars[m_indexes.y_start + t - 1];
+            in[STAGE_PSI] = vars[m_indexes.psi_start + t - 1];
+            in[STAGE_EPSI] = vars[m_indexes.epsi_start + t - 1];
+            in[STAGE_V] = vars[m_indexes.v(t - 1)];
+            in[STAGE_DELTA] = vars[m_indexes.delta(t - 1)];
+            in[STAGE_DT] = m_params.step_dt(t - 1);
+            for (size_t e=0; e < Model::EXTRA_STATES; e++)
+                in[STAGE_EXTRA + e] = vars[m_indexes.extra(e, t - 1)];
+
+            // The same operations every step: recorded once, when they're
+            // a checkpoint function, and not at all when they're evaluated
+            // outside of the tape (`out` stays 0, which x1 - 0 doesn't
+            // record)
+            if (m_stage != nullptr and !m_stages_outside)
+                (*m_stage)(in, out);
+            else if (!m_stages_outside)
+                stage(in, out);
+
+            // The idea here is to constraint these values to be 0.
+            fg[1 + m_indexes.x_start + t] = x1 - out[0];
+            fg[1 + m_indexes.y_start + t] = y1 - out[1];
+            fg[1 + m_indexes.psi_start + t] = psi1 - out[2];
+            if (m_params.contouring_reference) {
+                AD<Base> cte, epsi;
+                contouring_errors(m_coeffs, t, x1, y1, psi1, cte, epsi);
+                fg[1 + m_indexes.cte_start + t] = cte1 - cte;
+                fg[1 + m_indexes.epsi_start + t] = epsi1 - epsi;
+            } else {
+                fg[1 + m_indexes.cte_start + t] = cte1 - out[3];
+                fg[1 + m_indexes.epsi_start + t] = epsi1 - out[4];
+            }
+            for (size_t e=0; e < Model::EXTRA_STATES; e++)
+                fg[1 + m_indexes.extra(e, t)] = vars[m_indexes.extra(e, t)] - out[5 + e];
+        }
+
+        // The terminal conditions and the rate of the steering, each with
+        // its slack (fixed at 0 when they're hard), whose sum is penalized
+        size_t k = 0;
+        size_t last = m_params.steps_ahead - 1;
+        if (m_params.terminal_cte > 0.0)
+            soft_constraint(fg, vars, k++, vars[m_indexes.cte_start + last]);
+        if (m_params.terminal_epsi > 0.0)
+            soft_constraint(fg, vars, k++, vars[m_indexes.epsi_start + last]);
+        if (m_params.max_steer_rate > 0.0) {
+            for (size_t t = 0; t < m_params.steps_ahead-2; t++) {
+                if (m_indexes.delta(t + 1) != m_indexes.delta(t))
+                    soft_constraint(fg, vars, k++, vars[m_indexes.delta(t + 1)] - vars[m_indexes.delta(t)]);
+            }
+        }
+
+        // The squared distance from every step to the obstacle of every
+        // slot, whose bounds tell whether it's kept clear of
+        for (size_t j=0; j < m_indexes.num_obstacles; j++) {
+            for (size_t t = 1; t < m_params.steps_ahead; t++) {
+                size_t row = m_indexes.obstacle(j, t);
+                size_t o = 2 * (row - m_indexes.obstacle_start);
+                AD<Base> dx = vars[m_indexes.x_start + t] - m_obstacles[o];
+                AD<Base> dy = vars[m_indexes.y_start + t] - m_obstacles[o + 1];
+                fg[1 + row] = dx * dx + dy * dy;
+            }
+        }
+    }
+
+    ///* The inputs of `stage`: the state and the actuations at t, dt, the
+    ///* extra states of the model at t, then the coefficients of the
+    ///* polynomial
+    enum StageInput { STAGE_X, STAGE_Y, STAGE_PSI, STAGE_EPSI, STAGE_V, STAGE_DELTA, STAGE_DT, STAGE_EXTRA,
+                      STAGE_COEFFS = STAGE_EXTRA + Model::EXTRA_STATES };
+    ///* ... and its outputs: x, y, psi, cte and epsi at t+1, then the extra
+    ///* states
+    enum { STAGE_OUTPUTS = 5 + Model::EXTRA_STATES };
+
+    ///* How many of `num_coeffs` coefficients are inputs of `stage`: none of
+    ///* a contouring reference (whose cte and epsi outputs are then unused)
+    static size_t stage_coeffs(const Params & params, size_t num_coeffs) {
+        return params.contouring_reference ? 0 : num_coeffs;
+    }
+
+    ///* One step of the model
+    static void stage(const ADvector & in, ADvector & out) {
+        const AD<Base> & x0 = in[STAGE_X];
+        const AD<Base> & y0 = in[STAGE_Y];
+        const AD<Base> & psi0 = in[STAGE_PSI];
+        const AD<Base> & epsi0 = in[STAGE_EPSI];
+        const AD<Base> & v0 = in[STAGE_V];
+        const AD<Base> & delta0 = in[STAGE_DELTA];
+        const AD<Base> & dt = in[STAGE_DT];
+        size_t n_coeffs = in.size() - STAGE_COEFFS;
+
+        // The pose (and the extra states) at t+1 from the model, e.g. the
+        // kinematic one:
+        // x_[t+1] = x[t] + v[t] * cos(psi[t]) * dt
+        // y_[t+1] = y[t] + v[t] * sin(psi[t]) * dt
+        // psi_[t+1] = psi[t] - v[t] / Lf * delta[t] * dt
+        // ("... - v[t] ..." in contrast to the quizzes)
+        AD<Base> state[Model::STATE_DIM];
+        AD<Base> next[Model::STATE_DIM];
+        state[MODEL_X] = x0;
+        state[MODEL_Y] = y0;
+        state[MODEL_PSI] = psi0;
+        for (size_t e=0; e < Model::EXTRA_STATES; e++)
+            state[MODEL_EXTRA + e] = in[STAGE_EXTRA + e];
+        Model::template step<AD<Base>, Trig>(state, delta0, v0, dt, next);
+
+        out[0] = next[MODEL_X];
+        out[1] = next[MODEL_Y];
+        out[2] = next[MODEL_PSI];
+        // And the errors that follow from it:
+        // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
+        // epsi[t+1] = psi[t+1] - psides[t]
+        // (or, with a model that integrates more accurately, those of the
+        // pose at t+1)
+        if (Model::ERRORS_FROM_POSE) {
+            AD<Base> f1, fdiff1;
+            horner_with_diff(in, STAGE_COEFFS, n_coeffs, next[MODEL_X], f1, fdiff1);
+            out[3] = f1 - next[MODEL_Y];
+            out[4] = next[MODEL_PSI] - Trig::atan(fdiff1);
+        } else {
+            AD<Base> f0, fdiff0;
+            horner_with_diff(in, STAGE_COEFFS, n_coeffs, x0, f0, fdiff0);
+            AD<Base> psides0 = Trig::atan(fdiff0);
+            out[3] = f0 - y0 + Model::template lateral_speed<AD<Base>, Trig>(state, v0, epsi0) * dt;
+            out[4] = next[MODEL_PSI] - psides0;
+        }
+        for (size_t e=0; e < Model::EXTRA_STATES; e++)
+            out[5 + e] = next[MODEL_EXTRA + e];
+    }
+
+    ///* Records the steps through `stage_function` (see Params::checkpoint_stage),
+    ///* which has to outlive the tapes recorded with it
+    void set_stage_function(CppAD::checkpoint<Base> * stage_function) { m_stage = stage_function; }
+
+    ///* Leaves the steps out of the rows of the states they lead to, which
+    ///* are then just the states (see ParallelStages)
+    void set_stages_outside(bool outside) { m_stages_outside = outside; }
+
+    ///* The centers of the obstacles of the rows from `Indexes::obstacle_start`,
+    ///* x then y for each: dynamic parameters of a persistent tape, or
+    ///* constants
+    void set_obstacles(const ADvector & positions) {
+        m_obstacles.resize(positions.size());
+        for (size_t i=0; i < positions.size(); i++)
+            m_obstacles[i] = positions[i];
+    }
+    void set_obstacles(const std::vector<double> & positions) {
+        m_obstacles.resize(positions.size());
+        for (size_t i=0; i < positions.size(); i++)
+            m_obstacles[i] = positions[i];
+    }
+
+    ///* The weights and the target of the terminal cost (see TerminalCost),
+    ///* in the order of `TerminalCost::Entry`: dynamic parameters of a
+    ///* persistent tape, or constants; none when empty
+    void set_terminal_cost(const ADvector & weights) { m_terminal = weights; }
+    void set_terminal_cost(const std::vector<double> & weights) {
+        m_terminal.resize(weights.size());
+        for (size_t i=0; i < weights.size(); i++)
+            m_terminal[i] = weights[i];
+    }
+
+private:
+    // The k-th soft constraint on `value` (see `Indexes::soft_start`)
+    void soft_constraint(ADvector & fg, const ADvector & vars, size_t k, const AD<Base> & value) {
+        const AD<Base> & slack = vars[m_indexes.slack_start + k];
+        fg[0] += m_params.soft_constraint_weight * slack;
+        fg[1 + m_indexes.soft_start + 2*k] = value - slack;
+        fg[1 + m_indexes.soft_start + 2*k + 1] = value + slack;
+    }
+
+    void set_weights(const Params & params) {
+        double values[NUM_WEIGHTS];
+        weights(params, values);
+        for (size_t i=0; i<NUM_WEIGHTS; i++)
+            m_weights[i] = values[i];
+    }
+
+    CppAD::checkpoint<Base> * m_stage = nullptr;
+    bool m_stages_outside = false;
+
+    ADvector m_obstacles;
+    ADvector m_terminal;
+};
+
+
+typedef FG_eval_base<double> FG_eval;
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cassert>
+#include <cppad/cppad.hpp>
+#include "MPC.h"
+#include "FG_eval.h"
+#include "Trace.h"
+
+
+using CppAD::AD;
+
+
+///* The same problem as FG_eval, condensed (single shooting): the states are
+///* eliminated by rolling the model out from the initial state, so the only
+///* variables are the actuations, the deltas then the v's (one of each per
+///* step, or per block with move blocking), and the only constraints their
+///* bounds (`fg` is just the cost).
+///*
+///* `rollout` gives the multiple-shooting layout of `Indexes` back, for the
+///* result and the warm start.
+class FG_eval_condensed {
+public:
+    typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+    // Fitted polynomial coefficients
+    ADvector m_coeffs;
+
+    // Reference speed
+    AD<double> m_ref_v;
+
+    Params m_params;
+    Indexes m_indexes;
+
+    ///* The initial state (x, y, psi, cte, epsi)
+    AD<double> m_state[5];
+
+    FG_eval_condensed(const Eigen::VectorXd & coeffs, const Params & params, const Indexes & indexes,
+                      const double ref_v, const Eigen::VectorXd & state)
+        : m_coeffs(coeffs.size()), m_params(params), m_indexes(indexes), m_full(full_size(indexes)) {
+
+        for (int i=0; i<coeffs.size(); i++)
+            m_coeffs[i] = coeffs[i];
+        m_ref_v = ref_v;
+        for (int i=0; i<5; i++)
+            m_state[i] = state[i];
+    }
+
+    ///* Where the actuations are in the condensed variables: as in the
+    ///* layout of `indexes`, without the states
+    static size_t delta_start() { return 0; }
+    static size_t v_start(const Indexes & indexes) { return indexes.v_start - indexes.delta_start; }
+    static size_t n_vars(const Indexes & indexes) { return 2 * v_start(indexes); }
+
+    void operator()(ADvector &fg, const ADvector &u) {
+        MPC_TRACE_SCOPE("FG_eval");
+
+        rollout(u, m_full);
+        const ADvector & vars = m_full;
+
+        // The cost of FG_eval, on the rolled out states
+        double weights[StageCost::NUM_WEIGHTS];
+        StageCost::weights(m_params, weights);
+        fg[0] = StageCost::Cost::value(vars, m_indexes, m_params.steps_ahead, weights, m_ref_v);
+    }
+
+    ///* The variables of FG_eval (in the layout of `m_indexes`) for the
+    ///* actuations `u`: the states are those of the model from the initial
+    ///* state, so all of its constraints hold
+    void rollout(const ADvector & u, ADvector & vars) const {
+        assert(vars.size() == full_size(m_indexes));
+        size_t N = m_params.steps_ahead;
+        size_t n_inputs = v_start(m_indexes);
+
+        for (size_t i=0; i < n_inputs; i++) {
+            vars[m_indexes.delta_start + i] = u[delta_start() + i];
+            vars[m_indexes.v_start + i] = u[v_start(m_indexes) + i];
+        }
+
+        vars[m_indexes.x_start] = m_state[0];
+        vars[m_indexes.y_start] = m_state[1];
+        vars[m_indexes.psi_start] = m_state[2];
+        vars[m_indexes.cte_start] = m_state[3];
+        vars[m_indexes.epsi_start] = m_state[4];
+
+        ADvector in(FG_eval::STAGE_COEFFS + m_coeffs.size());
+        ADvector out(FG_eval::STAGE_OUTPUTS);
+        for (size_t i=0; i<m_coeffs.size(); i++)
+            in[FG_eval::STAGE_COEFFS + i] = m_coeffs[i];
+
+        for (size_t t=1; t < N; t++) {
+            in[FG_eval::STAGE_X] = vars[m_indexes.x_start + t - 1];
+            in[FG_eval::STAGE_Y] = vars[m_indexes.y_start + t - 1];
+            in[FG_eval::STAGE_PSI] = vars[m_indexes.psi_start + t - 1];
+            in[FG_eval::STAGE_EPSI] = vars[m_indexes.epsi_start + t - 1];
+            in[FG_eval::STAGE_V] = vars[m_indexes.v(t - 1)];
+            in[FG_eval::STAGE_DELTA] = vars[m_indexes.delta(t - 1)];
+            in[FG_eval::STAGE_DT] = m_params.step_dt(t - 1);
+            FG_eval::stage(in, out);
+
+            vars[m_indexes.x_start + t] = out[0];
+            vars[m_indexes.y_start + t] = out[1];
+            vars[m_indexes.psi_start + t] = out[2];
+            vars[m_indexes.cte_start + t] = out[3];
+            vars[m_indexes.epsi_start + t] = out[4];
+        }
+    }
+
+private:
+    static size_t full_size(const Indexes & indexes) {
+        return indexes.v_start + v_start(indexes);
+    }
+
+    ///* The rolled out variables of the last evaluation
+    ADvector m_full;
+};
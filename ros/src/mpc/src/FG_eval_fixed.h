@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cppad/cppad.hpp>
+#include "MPC.h"
+#include "Polynomial.h"
+#include "Trace.h"
+
+
+using CppAD::AD;
+
+
+///* Compile-time version of `Indexes` for a horizon of N steps
+template <size_t N>
+struct FixedIndexes {
+    // Non-actuators
+    static constexpr size_t x_start = 0;
+    static constexpr size_t y_start = x_start + N;
+    static constexpr size_t psi_start = y_start + N;
+    static constexpr size_t cte_start = psi_start + N;
+    static constexpr size_t epsi_start = cte_start + N;
+
+    // Actuators
+    static constexpr size_t delta_start = epsi_start + N;
+    static constexpr size_t v_start = delta_start + N - 1;
+
+    static constexpr size_t n_vars = N * 5 + (N - 1) * 2;
+    static constexpr size_t n_constraints = N * 5;
+};
+
+
+///* The same cost and constraints as FG_eval, but with the horizon and the
+///* degree of the polynomial known at compile time, so the loops over the
+///* stages and over the coefficients have constant bounds (and can be
+///* unrolled) and the coefficients live in fixed-size storage.
+template <size_t N, size_t Degree>
+class FG_eval_fixed {
+public:
+    typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+    typedef FixedIndexes<N> I;
+
+    // Fitted polynomial coefficients
+    std::array<AD<double>, Degree + 1> m_coeffs;
+
+    // Reference speed
+    AD<double> m_ref_v;
+
+    Params m_params;
+
+    FG_eval_fixed(const Eigen::VectorXd & coeffs, const Params & params, const double ref_v)
+        : m_ref_v(ref_v), m_params(params) {
+
+        assert(size_t(coeffs.size()) == Degree + 1);
+        for (size_t i=0; i<Degree+1; i++)
+            m_coeffs[i] = coeffs[i];
+    }
+
+    void operator()(ADvector &fg, const ADvector &vars) {
+        MPC_TRACE_SCOPE("FG_eval");
+
+        // The cost is stored in the first element of fg.
+        fg[0] = 0;
+
+        // The part of the cost based on the reference state.
+        for (size_t t=0; t<N; t++) {
+            fg[0] += m_params.cte_coeff * square(vars[I::cte_start + t]);
+            fg[0] += m_params.epsi_coeff * square(vars[I::epsi_start + t]);
+        }
+
+        // Minimize the use of actuators.
+        for (size_t t=0; t<N-1; t++) {
+            fg[0] += m_params.speed_coeff * square(vars[I::v_start + t] - m_ref_v);
+            fg[0] += m_params.steer_coeff * square(vars[I::delta_start + t]);
+        }
+
+        // Minimize the value gap between sequential actuations.
+        for (size_t t=0; t<N-2; t++) {
+            fg[0] += m_params.consec_steer_coeff * square(vars[I::delta_start + t + 1] - vars[I::delta_start + t]);
+            fg[0] += m_params.consec_speed_coeff * square(vars[I::v_start + t + 1] - vars[I::v_start + t]);
+        }
+
+        // Initial constraints (shifted by 1 because of the cost at fg[0])
+        fg[1 + I::x_start] = vars[I::x_start];
+        fg[1 + I::y_start] = vars[I::y_start];
+        fg[1 + I::psi_start] = vars[I::psi_start];
+        fg[1 + I::cte_start] = vars[I::cte_start];
+        fg[1 + I::epsi_start] = vars[I::epsi_start];
+
+        // The rest of the constraints, see FG_eval for the model
+        for (size_t t=1; t<N; t++) {
+            AD<double> x1 = vars[I::x_start + t];
+            AD<double> y1 = vars[I::y_start + t];
+            AD<double> psi1 = vars[I::psi_start + t];
+            AD<double> cte1 = vars[I::cte_start + t];
+            AD<double> epsi1 = vars[I::epsi_start + t];
+
+            AD<double> x0 = vars[I::x_start + t - 1];
+            AD<double> y0 = vars[I::y_start + t - 1];
+            AD<double> psi0 = vars[I::psi_start + t - 1];
+            AD<double> v0 = vars[I::v_start + t - 1];
+            AD<double> epsi0 = vars[I::epsi_start + t - 1];
+
+            AD<double> delta0 = vars[I::delta_start + t - 1];
+
+            AD<double> f0, fdiff0;
+            horner_with_diff(m_coeffs, 0, Degree + 1, x0, f0, fdiff0);
+
+            AD<double> psides0 = CppAD::atan(fdiff0);
+
+            fg[1 + I::x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * m_params.dt);
+            fg[1 + I::y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * m_params.dt);
+            fg[1 + I::psi_start + t] = psi1 - (psi0 - v0 * delta0 / Lf() * m_params.dt);
+            fg[1 + I::cte_start + t] = cte1 - (f0 - y0 + (v0 * CppAD::sin(epsi0) * m_params.dt));
+            fg[1 + I::epsi_start + t] = epsi1 - (psi0 - psides0 - v0 * delta0 / Lf() * m_params.dt);
+        }
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+
+///* The trigonometric functions of the stages of FG_eval, as policies the
+///* vehicle models and FG_eval are templates of (see `Params::fast_trig`),
+///* for any scalar with the operators of double (AD<double>, the
+///* CppADCodeGen one).
+///*
+///* ExactTrig has those of the scalar, found by argument-dependent lookup.
+struct ExactTrig {
+    template <class T>
+    static T sin(const T & x) {
+        using std::sin;
+        return sin(x);
+    }
+
+    template <class T>
+    static T cos(const T & x) {
+        using std::cos;
+        return cos(x);
+    }
+
+    template <class T>
+    static T atan(const T & x) {
+        using std::atan;
+        return atan(x);
+    }
+};
+
+
+///* FastTrig has near-minimax polynomials instead (Chebyshev interpolants,
+///* in powers of x^2, evaluated by Horner's scheme): a handful of
+///* multiplications and additions on the tape, whose derivatives are
+///* again polynomials. Within |x| <= SIN_COS_RANGE for sin and cos (off by
+///* less than 1e-10) and |x| <= ATAN_RANGE for atan (less than 2e-9); they
+///* drift away past them, which `in_range` keeps the solves from.
+struct FastTrig {
+    static constexpr double SIN_COS_RANGE = M_PI / 2;
+    static constexpr double ATAN_RANGE = 1.0;
+
+    template <class T>
+    static T sin(const T & x) {
+        static const double C[] = {
+            0.99999999998291944, -0.1666666661681632, 0.0083333309742322365, -0.00019840861182112497,
+            2.7525269943042129e-06, -2.388921993257769e-08
+        };
+        return x * horner(x * x, C, sizeof(C) / sizeof(C[0]));
+    }
+
+    template <class T>
+    static T cos(const T & x) {
+        static const double C[] = {
+            0.9999999999992476, -0.49999999997012562, 0.041666666472844602, -0.0013888884170661481,
+            2.480103991851118e-05, -2.752467012436553e-07, 1.9907502790667467e-09
+        };
+        return horner(x * x, C, sizeof(C) / sizeof(C[0]));
+    }
+
+    template <class T>
+    static T atan(const T & x) {
+        static const double C[] = {
+            0.999999997160544, -0.33333276291968977, 0.1999807528082414, -0.14260016079705623,
+            0.10932341485896302, -0.083497249245010619, 0.057089555186985316, -0.030351864043404932,
+            0.010487648853086284, -0.0017011699732393027
+        };
+        return x * horner(x * x, C, sizeof(C) / sizeof(C[0]));
+    }
+
+    ///* Whether headings (psi, epsi [rad]) within `max_angle` and slopes of
+    ///* the path within `max_slope` are, with a margin for the solve to move
+    ///* them (GUARD_MARGIN), where the polynomials are accurate
+    static bool in_range(double max_angle, double max_slope) {
+        return max_angle <= GUARD_MARGIN * SIN_COS_RANGE and max_slope <= GUARD_MARGIN * ATAN_RANGE;
+    }
+
+    static constexpr double GUARD_MARGIN = 0.8;
+
+private:
+    ///* The polynomial of the `n` coefficients `c` (lowest order first) at u
+    template <class T>
+    static T horner(const T & u, const double * c, size_t n) {
+        T sum = c[n - 1];
+        for (size_t k = n - 1; k-- > 0; )
+            sum = c[k] + u * sum;
+        return sum;
+    }
+};
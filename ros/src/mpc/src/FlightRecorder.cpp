@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FlightRecorder.h"
+#include "Log.h"
+#include "VehicleModel.h"
+
+
+constexpr size_t FlightRecord::MAX_COEFFS;
+constexpr size_t FlightRecord::MAX_POINTS;
+constexpr size_t FlightRecord::MAX_VARS;
+constexpr uint32_t FlightLogHeader::VERSION;
+constexpr size_t FlightLogHeader::RECORDS_OFFSET;
+const char FlightLogHeader::MAGIC[8] = {'M', 'P', 'C', 'F', 'L', 'T', '1', '\0'};
+const char * const FlightLogHeader::PRECISIONS[3] = {"double", "mixed", "float"};
+
+// Copied with memcpy, and read back as is
+static_assert(std::is_trivially_copyable<FlightRecord>::value, "FlightRecord has to be plain data");
+static_assert(sizeof(FlightLogHeader) <= FlightLogHeader::RECORDS_OFFSET, "FlightLogHeader is too large");
+static_assert(sizeof(FlightRecord) % 8 == 0, "FlightRecords have to stay aligned");
+
+
+FlightRecorder::FlightRecorder()
+        : m_header(nullptr), m_records(nullptr), m_capacity(0), m_head(0), m_mapped_size(0) {}
+
+
+FlightRecorder::~FlightRecorder() {
+    close();
+}
+
+
+void FlightRecorder::close() {
+    if (m_header != nullptr)
+        munmap(m_header, m_mapped_size);
+    m_header = nullptr;
+    m_records = nullptr;
+}
+
+
+bool FlightRecorder::open(const std::string & path, size_t capacity, const Params & params) {
+    close();
+    if (capacity == 0)
+        return false;
+
+    // The previous run's log is kept aside
+    std::string prev_path = path + ".prev";
+    if (std::rename(path.c_str(), prev_path.c_str()) != 0 and errno != ENOENT)
+        MPC_WARN("Could not move the previous flight log to %s: %s", prev_path.c_str(), std::strerror(errno));
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        MPC_ERROR("Could not create the flight log %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    // The blocks are allocated now, so that no tick ever waits for the
+    // file system (nor fails on a full disk)
+    size_t size = FlightLogHeader::RECORDS_OFFSET + capacity * sizeof(FlightRecord);
+    int error = posix_fallocate(fd, 0, off_t(size));
+    if (error != 0) {
+        MPC_ERROR("Could not allocate the flight log %s (%lu MB): %s", path.c_str(), size >> 20,
+                  std::strerror(error));
+        ::close(fd);
+        return false;
+    }
+    void * data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        MPC_ERROR("Could not map the flight log %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    m_header = static_cast<FlightLogHeader *>(data);
+    m_records = reinterpret_cast<FlightRecord *>(static_cast<char *>(data) + FlightLogHeader::RECORDS_OFFSET);
+    m_capacity = capacity;
+    m_head = 0;
+    m_mapped_size = size;
+
+    FlightLogHeader & header = *m_header;
+    std::memcpy(header.magic, FlightLogHeader::MAGIC, sizeof(header.magic));
+    header.version = FlightLogHeader::VERSION;
+    header.record_size = uint32_t(sizeof(FlightRecord));
+    header.capacity = capacity;
+    header.head = 0;
+    header.dt = params.dt;
+    header.num_steps_poly = params.num_steps_poly;
+    header.precision = 0;
+    for (uint32_t p=0; p < 3; p++)
+        if (params.precision == FlightLogHeader::PRECISIONS[p])
+            header.precision = p;
+    header.solver_flags = (params.persistent_tape ? FlightLogHeader::SOLVER_PERSISTENT_TAPE : 0)
+            | (params.warm_start ? FlightLogHeader::SOLVER_WARM_START : 0)
+            | (params.fixed_horizon ? FlightLogHeader::SOLVER_FIXED_HORIZON : 0)
+            | (params.riccati_solver ? FlightLogHeader::SOLVER_RICCATI : 0)
+            | (params.rti ? FlightLogHeader::SOLVER_RTI : 0)
+            | (params.checkpoint_stage ? FlightLogHeader::SOLVER_CHECKPOINT_STAGE : 0)
+            | (params.analytic_derivatives ? FlightLogHeader::SOLVER_ANALYTIC_DERIVATIVES : 0)
+            | (params.autodiff_stages ? FlightLogHeader::SOLVER_AUTODIFF_STAGES : 0)
+            | (params.limited_memory_hessian ? FlightLogHeader::SOLVER_LIMITED_MEMORY_HESSIAN : 0)
+            | (params.condensed ? FlightLogHeader::SOLVER_CONDENSED : 0)
+            | (params.vehicle_model == DynamicBicycle::name() ? FlightLogHeader::SOLVER_DYNAMIC_MODEL : 0)
+            | (params.fast_trig ? FlightLogHeader::SOLVER_FAST_TRIG : 0);
+    Integrator integrator = INTEGRATOR_EULER;
+    integrator_from_name(params.integrator, integrator);
+    header.solver_flags |= uint32_t(integrator) << FlightLogHeader::SOLVER_INTEGRATOR_SHIFT;
+    header.reserved = 0;
+    return true;
+}
+
+
+void FlightRecorder::commit() {
+    // The record is whole before the head moves past it
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->head = ++m_head;
+}
+
+
+// Whether the header is that of a flight log of this version
+static bool valid_header(const FlightLogHeader & header) {
+    return std::memcmp(header.magic, FlightLogHeader::MAGIC, sizeof(header.magic)) == 0
+            and header.version == FlightLogHeader::VERSION and header.record_size == sizeof(FlightRecord)
+            and header.capacity > 0 and header.precision < 3;
+}
+
+
+bool FlightLog::load(const std::string & path) {
+    m_records.clear();
+    FILE * file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        MPC_ERROR("Could not open the flight log %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    bool OK = (std::fread(&m_header, sizeof(m_header), 1, file) == 1 and valid_header(m_header));
+    if (!OK) {
+        MPC_ERROR("%s is not a flight log (of this version of the node)", path.c_str());
+        std::fclose(file);
+        return false;
+    }
+
+    // The ring, unrolled from its oldest record
+    uint64_t head = m_header.head;
+    size_t count = size_t(std::min(head, m_header.capacity));
+    std::vector<FlightRecord> ring(count);
+    OK = (std::fseek(file, long(FlightLogHeader::RECORDS_OFFSET), SEEK_SET) == 0
+          and std::fread(ring.data(), sizeof(FlightRecord), count, file) == count);
+    std::fclose(file);
+    if (!OK) {
+        MPC_ERROR("The flight log %s is truncated", path.c_str());
+        return false;
+    }
+    size_t oldest = (head > m_header.capacity) ? size_t(head % m_header.capacity) : 0;
+    m_records.reserve(count);
+    m_records.insert(m_records.end(), ring.begin() + oldest, ring.end());
+    m_records.insert(m_records.end(), ring.begin(), ring.begin() + oldest);
+    return true;
+}
+
+
+Params FlightLog::params(const Params & base, const FlightRecord & record) const {
+    Params params = base;
+    params.dt = m_header.dt;
+    params.num_steps_poly = m_header.num_steps_poly;
+    params.precision = FlightLogHeader::PRECISIONS[m_header.precision];
+    uint32_t flags = m_header.solver_flags;
+    params.persistent_tape = (flags & FlightLogHeader::SOLVER_PERSISTENT_TAPE) != 0;
+    params.warm_start = (flags & FlightLogHeader::SOLVER_WARM_START) != 0;
+    params.fixed_horizon = (flags & FlightLogHeader::SOLVER_FIXED_HORIZON) != 0;
+    params.riccati_solver = (flags & FlightLogHeader::SOLVER_RICCATI) != 0;
+    params.rti = (flags & FlightLogHeader::SOLVER_RTI) != 0;
+    params.checkpoint_stage = (flags & FlightLogHeader::SOLVER_CHECKPOINT_STAGE) != 0;
+    params.analytic_derivatives = (flags & FlightLogHeader::SOLVER_ANALYTIC_DERIVATIVES) != 0;
+    params.autodiff_stages = (flags & FlightLogHeader::SOLVER_AUTODIFF_STAGES) != 0;
+    params.limited_memory_hessian = (flags & FlightLogHeader::SOLVER_LIMITED_MEMORY_HESSIAN) != 0;
+    params.condensed = (flags & FlightLogHeader::SOLVER_CONDENSED) != 0;
+    params.vehicle_model = (flags & FlightLogHeader::SOLVER_DYNAMIC_MODEL) ? DynamicBicycle::name()
+                                                                           : KinematicBicycle::name();
+    params.fast_trig = (flags & FlightLogHeader::SOLVER_FAST_TRIG) != 0;
+    params.integrator = integrator_name(Integrator(
+            (flags & FlightLogHeader::SOLVER_INTEGRATOR) >> FlightLogHeader::SOLVER_INTEGRATOR_SHIFT));
+
+    params.steps_ahead = record.steps_ahead;
+    params.poly_degree = int(record.num_coeffs) - 1;
+    params.cte_coeff = record.weights[0];
+    params.epsi_coeff = record.weights[1];
+    params.speed_coeff = record.weights[2];
+    params.steer_coeff = record.weights[3];
+    params.consec_speed_coeff = record.weights[4];
+    params.consec_steer_coeff = record.weights[5];
+    return params;
+}
+
+
+MappedFlightLog::MappedFlightLog()
+        : m_header(nullptr), m_records(nullptr), m_count(0), m_oldest(0), m_mapped_size(0) {}
+
+
+MappedFlightLog::~MappedFlightLog() {
+    close();
+}
+
+
+void MappedFlightLog::close() {
+    if (m_header != nullptr)
+        munmap(const_cast<FlightLogHeader *>(m_header), m_mapped_size);
+    m_header = nullptr;
+    m_records = nullptr;
+    m_count = 0;
+}
+
+
+bool MappedFlightLog::open(const std::string & path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        MPC_ERROR("Could not open the flight log %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 or size_t(file_stat.st_size) < FlightLogHeader::RECORDS_OFFSET) {
+        MPC_ERROR("%s is not a flight log (of this version of the node)", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    size_t size = size_t(file_stat.st_size);
+    void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        MPC_ERROR("Could not map the flight log %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    // The records are scanned in order, from both ends of the ring at most
+    madvise(data, size, MADV_SEQUENTIAL);
+    m_header = static_cast<const FlightLogHeader *>(data);
+    m_mapped_size = size;
+    if (!valid_header(*m_header)) {
+        MPC_ERROR("%s is not a flight log (of this version of the node)", path.c_str());
+        close();
+        return false;
+    }
+
+    uint64_t head = m_header->head;
+    size_t count = size_t(std::min(head, m_header->capacity));
+    if (FlightLogHeader::RECORDS_OFFSET + count * sizeof(FlightRecord) > size) {
+        MPC_ERROR("The flight log %s is truncated", path.c_str());
+        close();
+        return false;
+    }
+    m_records = reinterpret_cast<const FlightRecord *>(static_cast<const char *>(data)
+                                                       + FlightLogHeader::RECORDS_OFFSET);
+    m_count = count;
+    m_oldest = (head > m_header->capacity) ? size_t(head % m_header->capacity) : 0;
+    return true;
+}
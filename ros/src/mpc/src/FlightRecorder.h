@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MPC.h"
+#include "Telemetry.h"
+
+
+///* What the flight recorder keeps of one tick, in a fixed binary layout
+///* (native endianness): the inputs, the problem the solver was given, its
+///* solution, the commands and the timings. The problem is kept exactly (in
+///* doubles), so that mpc_replay can solve it again
+struct FlightRecord {
+    ///* Number of the tick since the start of the node, and its ros::Time [s]
+    uint64_t tick;
+    double stamp;
+
+    ///* The inputs: the pose, the speed [m/s] and their stamps [s]
+    double pos_x;
+    double pos_y;
+    double psi;
+    double speed;
+    double pose_stamp;
+    double odom_stamp;
+
+    ///* The pose projected by the latency, which the problem is solved from
+    double pos_x_lat;
+    double pos_y_lat;
+    double psi_lat;
+
+    ///* The problem: the state is (0, 0, 0, cte, epsi) in the car's frame,
+    ///* with the fit (the first `num_coeffs`, lowest order first), the
+    ///* reference speed (`new_ref_v`) and the weights of the cost (the
+    ///* *_coeff of Params, in their order there)
+    double cte;
+    double epsi;
+    double ref_v;
+    double coeffs[8];
+    double weights[6];
+
+    ///* The commands sent to Dzik
+    double steer_cmd;
+    double rpm;
+
+    ///* TelemetryRecord::Event and TelemetryRecord::Input bits
+    uint32_t events;
+    uint8_t inputs;
+    uint8_t num_coeffs;
+    ///* The parallel variant the commands are from, and where those of a
+    ///* failed solve are from (see TelemetryRecord)
+    uint8_t variant;
+    uint8_t fallback;
+
+    ///* The horizon of the controller that solved, the sizes of `pts_x`,
+    ///* `pts_y` and `vars`, and the solver's iterations (-1 if not known)
+    uint16_t steps_ahead;
+    uint16_t num_points;
+    uint16_t num_vars;
+    int16_t iterations;
+
+    float cost;
+    ///* The latency the pose was projected by [s]
+    float latency;
+    ///* How long each stage took [s] (see TelemetryRecord::Stage)
+    float stage_time[TelemetryRecord::NUM_STAGES];
+
+    ///* The waypoints of the fit, in the car's frame
+    float pts_x[64];
+    float pts_y[64];
+
+    ///* The solution, as returned by `MPC::Solve`: the actuations, followed
+    ///* by the predicted (x, y) of every step (truncated past 64 steps)
+    double vars[130];
+
+    static constexpr size_t MAX_COEFFS = sizeof(coeffs) / sizeof(coeffs[0]);
+    static constexpr size_t MAX_POINTS = sizeof(pts_x) / sizeof(pts_x[0]);
+    static constexpr size_t MAX_VARS = sizeof(vars) / sizeof(vars[0]);
+
+    ///* The solve time of the tick [s], from its stages
+    double solve_time() const {
+        return double(std::max(0.0f, stage_time[TelemetryRecord::STAGE_DERIVATIVES])
+                      + std::max(0.0f, stage_time[TelemetryRecord::STAGE_SOLVER]));
+    }
+};
+
+
+///* The start of a flight log: what stays the same for the whole run, then
+///* (from RECORDS_OFFSET) `capacity` FlightRecords of `record_size` bytes.
+///* `head` counts the records written so far, the last `capacity` of which
+///* are in the file (the oldest at `head % capacity`)
+struct FlightLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t head;
+
+    ///* Of the solver, as in Params: `dt`, `num_steps_poly`, `precision`
+    ///* (one of PRECISIONS) and the flags of its configuration (SOLVER_*
+    ///* bits, see OfflineTools.h)
+    double dt;
+    int32_t num_steps_poly;
+    uint32_t precision;
+    uint32_t solver_flags;
+    uint32_t reserved;
+
+    enum SolverFlag : uint32_t {
+        SOLVER_PERSISTENT_TAPE = 1 << 0,
+        SOLVER_WARM_START = 1 << 1,
+        SOLVER_FIXED_HORIZON = 1 << 2,
+        SOLVER_RICCATI = 1 << 3,
+        SOLVER_RTI = 1 << 4,
+        SOLVER_CHECKPOINT_STAGE = 1 << 5,
+        SOLVER_ANALYTIC_DERIVATIVES = 1 << 6,
+        SOLVER_AUTODIFF_STAGES = 1 << 7,
+        SOLVER_LIMITED_MEMORY_HESSIAN = 1 << 8,
+        SOLVER_CONDENSED = 1 << 9,
+        SOLVER_DYNAMIC_MODEL = 1 << 10,
+        SOLVER_FAST_TRIG = 1 << 11,
+        ///* The `Integrator` (see VehicleModel.h), in two bits from here
+        SOLVER_INTEGRATOR_SHIFT = 12,
+        SOLVER_INTEGRATOR = 3 << SOLVER_INTEGRATOR_SHIFT
+    };
+
+    static const char * const PRECISIONS[3];
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t RECORDS_OFFSET = 4096;
+    static const char MAGIC[8];
+};
+
+
+///* Always-on record of the ticks of the solver loop (see
+///* `Params::flight_recorder`), to find out after the fact what led to e.g.
+///* a latency spike, and to solve the same problems again (mpc_replay).
+///*
+///* The records go straight into a ring of `capacity` of them in a
+///* memory-mapped file, allocated and faulted in when it's opened: a tick
+///* costs a copy of its record into the mapping, and the kernel writes the
+///* pages back on its own (also when the node crashes). The previous run's
+///* file is kept aside, as <path>.prev.
+///*
+///* One writer (the solver loop). The file is meant to be read once the run
+///* is over (see FlightLog): the head only moves past a record once it's
+///* whole.
+class FlightRecorder {
+public:
+    FlightRecorder();
+    ~FlightRecorder();
+
+    ///* Creates the file of `capacity` records at `path` for the run of
+    ///* `params`; false (and logs why) if it can't, and the recorder stays
+    ///* off
+    bool open(const std::string & path, size_t capacity, const Params & params);
+
+    bool is_open() const { return m_header != nullptr; }
+
+    ///* The slot of the next record, to fill in before `commit`
+    FlightRecord & next() { return m_records[m_head % m_capacity]; }
+
+    ///* Counts the record of `next` in
+    void commit();
+
+private:
+    void close();
+
+    FlightLogHeader * m_header;
+    FlightRecord * m_records;
+    size_t m_capacity;
+    uint64_t m_head;
+    size_t m_mapped_size;
+};
+
+
+///* A flight log, as read back from the file of a FlightRecorder
+class FlightLog {
+public:
+    ///* Reads the log at `path`; false (and logs why) if it isn't one
+    bool load(const std::string & path);
+
+    const FlightLogHeader & header() const { return m_header; }
+
+    ///* The records in the file, oldest first
+    const std::vector<FlightRecord> & records() const { return m_records; }
+
+    ///* The Params of the solver of the run, from `base` (for the fields the
+    ///* log doesn't keep) and `record` (for those that change at runtime:
+    ///* the weights, the horizon and the degree of the fit)
+    Params params(const Params & base, const FlightRecord & record) const;
+
+private:
+    FlightLogHeader m_header;
+    std::vector<FlightRecord> m_records;
+};
+
+
+///* A flight log mapped read-only, for the scans of many (large) logs (see
+///* mpc_log_stats): the records are read in place, through the page cache,
+///* rather than copied out as by FlightLog
+class MappedFlightLog {
+public:
+    MappedFlightLog();
+    ~MappedFlightLog();
+
+    MappedFlightLog(const MappedFlightLog &) = delete;
+    MappedFlightLog & operator=(const MappedFlightLog &) = delete;
+
+    ///* Maps the log at `path`; false (and logs why) if it isn't one
+    bool open(const std::string & path);
+
+    const FlightLogHeader & header() const { return *m_header; }
+
+    ///* The records in the file
+    size_t size() const { return m_count; }
+
+    ///* The i-th of them, oldest first
+    const FlightRecord & operator[](size_t i) const {
+        size_t slot = m_oldest + i;
+        return m_records[(slot < m_count) ? slot : slot - m_count];
+    }
+
+private:
+    void close();
+
+    const FlightLogHeader * m_header;
+    const FlightRecord * m_records;
+    size_t m_count;
+    size_t m_oldest;
+    size_t m_mapped_size;
+};
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cmath> /* atan2 */
+
+#include <ros/console.h>
+
+#include "InputMessages.h"
+
+
+// FNV-1a
+static void fnv1a(uint64_t & hash, const void * data, size_t size) {
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (size_t i=0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+
+static const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ULL;
+
+
+// Over the coordinates of the points
+uint64_t centerline_hash(const visualization_msgs::Marker & marker) {
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    for (auto & p : marker.points) {
+        fnv1a(hash, &p.x, sizeof(p.x));
+        fnv1a(hash, &p.y, sizeof(p.y));
+    }
+    return hash;
+}
+
+
+uint64_t centerline_hash(const rospy_tutorials::Floats & rows) {
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    fnv1a(hash, rows.data.data(), rows.data.size() * sizeof(float));
+    return hash;
+}
+
+
+uint64_t centerline_hash(const std::vector<double> & pts_x, const std::vector<double> & pts_y) {
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    for (size_t i=0; i < pts_x.size() and i < pts_y.size(); i++) {
+        fnv1a(hash, &pts_x[i], sizeof(pts_x[i]));
+        fnv1a(hash, &pts_y[i], sizeof(pts_y[i]));
+    }
+    return hash;
+}
+
+
+std::shared_ptr<Centerline> make_centerline(const visualization_msgs::Marker & marker, uint64_t hash) {
+    int num_points = marker.points.size();
+
+    // A new object every time: the solver thread may still be using the
+    // previous one
+    std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>();
+    centerline->hash = hash;
+    centerline->pts_x.reserve(num_points);
+    centerline->pts_y.reserve(num_points);
+
+    for (auto & p : marker.points) {
+        centerline->pts_x.push_back(p.x);
+        centerline->pts_y.push_back(p.y);
+    }
+    return centerline;
+}
+
+
+std::shared_ptr<Centerline> make_centerline(const rospy_tutorials::Floats & rows, uint64_t hash) {
+    if (rows.data.size() % CENTERLINE_NUMPY_COLUMNS != 0) {
+        ROS_ERROR("/centerline_numpy: %lu values aren't rows of (x, y, yaw, speed)", rows.data.size());
+        return nullptr;
+    }
+    size_t num_points = rows.data.size() / CENTERLINE_NUMPY_COLUMNS;
+
+    std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>();
+    centerline->hash = hash;
+    centerline->pts_x.resize(num_points);
+    centerline->pts_y.resize(num_points);
+    centerline->yaw.resize(num_points);
+    centerline->speed.resize(num_points);
+
+    const float * row = rows.data.data();
+    for (size_t i=0; i < num_points; i++, row += CENTERLINE_NUMPY_COLUMNS) {
+        centerline->pts_x[i] = row[0];
+        centerline->pts_y[i] = row[1];
+        centerline->yaw[i] = row[2];
+        centerline->speed[i] = row[3];
+    }
+    return centerline;
+}
+
+
+std::shared_ptr<Centerline> patch_centerline(const std::shared_ptr<const Centerline> & current,
+                                             const mpc::CenterlinePatch & patch, const Params & params) {
+    if (!current or current->spline.empty())
+        return nullptr;
+    uint64_t base_hash = (current->patched_from != 0) ? current->patched_from : current->hash;
+    if (patch.base_hash != 0 and patch.base_hash != base_hash) {
+        ROS_WARN("/centerline_patch: of another path than the current one, ignoring it");
+        return nullptr;
+    }
+    if (patch.version <= current->version) {
+        ROS_WARN("/centerline_patch: version %u after %u, ignoring it", patch.version, current->version);
+        return nullptr;
+    }
+    size_t count = patch.x.size();
+    bool with_yaw = !current->yaw.empty(), with_speed = !current->speed.empty();
+    if (count == 0 or patch.y.size() != count or patch.yaw.size() != (with_yaw ? count : 0)
+            or patch.speed.size() != (with_speed ? count : 0)) {
+        ROS_ERROR("/centerline_patch: %lu x, %lu y, %lu yaw and %lu speed aren't one of each per waypoint "
+                  "(with yaw and speed if and only if the path has them)",
+                  count, patch.y.size(), patch.yaw.size(), patch.speed.size());
+        return nullptr;
+    }
+
+    // The waypoints of [s_start, s_end), by their arc length
+    const PathSpline & spline = current->spline;
+    size_t num_points = current->pts_x.size();
+    size_t first = 0;
+    while (first < num_points and spline.arc_length(first) < patch.s_start)
+        first++;
+    size_t end = first;
+    while (end < num_points and spline.arc_length(end) < patch.s_end)
+        end++;
+    if (patch.s_end <= patch.s_start or end == first) {
+        ROS_ERROR("/centerline_patch: no waypoint from %.2f m to %.2f m of the %.2f m of the path",
+                  patch.s_start, patch.s_end, spline.length());
+        return nullptr;
+    }
+
+    // A new object, as the centerlines: the solver thread may still be
+    // using the current one
+    std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>(*current);
+    centerline->patched_from = base_hash;
+    centerline->version = patch.version;
+    centerline->hash = base_hash;
+    fnv1a(centerline->hash, &patch.version, sizeof(patch.version));
+    if (end - first == count) {
+        std::copy(patch.x.begin(), patch.x.end(), centerline->pts_x.begin() + first);
+        std::copy(patch.y.begin(), patch.y.end(), centerline->pts_y.begin() + first);
+        std::copy(patch.yaw.begin(), patch.yaw.end(), centerline->yaw.begin() + first);
+        std::copy(patch.speed.begin(), patch.speed.end(), centerline->speed.begin() + first);
+        PathTracker::patch_centerline(*centerline, first, count, params);
+        return centerline;
+    }
+
+    // Another number of waypoints: spliced in, and everything derived from
+    // them built again
+    auto splice = [first, end](std::vector<double> & values, const std::vector<double> & span) {
+        values.erase(values.begin() + first, values.begin() + end);
+        values.insert(values.begin() + first, span.begin(), span.end());
+    };
+    splice(centerline->pts_x, patch.x);
+    splice(centerline->pts_y, patch.y);
+    if (with_yaw)
+        splice(centerline->yaw, patch.yaw);
+    if (with_speed)
+        splice(centerline->speed, patch.speed);
+    centerline->grid = SpatialGrid();
+    centerline->spline = PathSpline();
+    centerline->compact = CompactTrack();
+    centerline->segments = PathSegments();
+    PathTracker::prepare_centerline(*centerline, params);
+    return centerline;
+}
+
+
+void read_odom(const nav_msgs::Odometry & odom, InputSnapshot & inputs) {
+    inputs.speed = odom.twist.twist.linear.x;
+    inputs.speed_OK = true;
+    inputs.odom_stamp = odom.header.stamp.toSec();
+    inputs.history.add_speed(inputs.odom_stamp, inputs.speed);
+    inputs.dead_reckoning.add_odometry(inputs.odom_stamp, inputs.speed, odom.twist.twist.angular.z);
+}
+
+
+void read_imu(const sensor_msgs::Imu & imu, InputSnapshot & inputs) {
+    inputs.dead_reckoning.add_imu(imu.header.stamp.toSec(), imu.angular_velocity.z);
+}
+
+
+void read_pose(const nav_msgs::Odometry & pose, InputSnapshot & inputs) {
+    inputs.pos_x = pose.pose.pose.position.x;
+    inputs.pos_y = pose.pose.pose.position.y;
+    inputs.pos_OK = true;
+    inputs.pose_stamp = pose.header.stamp.toSec();
+    inputs.psi = quaternion_yaw(pose.pose.pose.orientation);
+    inputs.psi_OK = true;
+    inputs.history.add_pose(inputs.pose_stamp, inputs.pos_x, inputs.pos_y, inputs.psi);
+    inputs.dead_reckoning.set_fix(inputs.pose_stamp, inputs.pos_x, inputs.pos_y, inputs.psi);
+}
+
+
+void read_pose(const ParticleFilter & filter, double stamp, InputSnapshot & inputs) {
+    inputs.pos_x = filter.x();
+    inputs.pos_y = filter.y();
+    inputs.pos_OK = true;
+    inputs.pose_stamp = stamp;
+    inputs.psi = filter.theta();
+    inputs.psi_OK = true;
+    inputs.history.add_pose(inputs.pose_stamp, inputs.pos_x, inputs.pos_y, inputs.psi);
+    inputs.dead_reckoning.set_fix(inputs.pose_stamp, inputs.pos_x, inputs.pos_y, inputs.psi);
+}
+
+
+double quaternion_yaw(const geometry_msgs::Quaternion & o) {
+    // Calculate the psi Euler angle
+    // (source: https://en.wikipedia.org/wiki/Conversion_between_quaternions_and_Euler_angles)
+    double siny_cosp = 2.0 * (o.w * o.z + o.x * o.y);
+    double cosy_cosp = 1.0 - 2.0 * (o.y * o.y + o.z * o.z);
+    return atan2(siny_cosp, cosy_cosp);
+}
+
+
+std::shared_ptr<LocalizationMap> make_localization_map(const nav_msgs::OccupancyGrid & grid) {
+    if (grid.data.size() != size_t(grid.info.width) * grid.info.height or grid.info.resolution <= 0.0f) {
+        ROS_ERROR("/map: %lu cells aren't %u x %u, ignoring it", grid.data.size(), grid.info.width, grid.info.height);
+        return nullptr;
+    }
+    std::shared_ptr<LocalizationMap> map = std::make_shared<LocalizationMap>();
+    map->resolution = grid.info.resolution;
+    map->origin_x = grid.info.origin.position.x;
+    map->origin_y = grid.info.origin.position.y;
+    map->origin_yaw = quaternion_yaw(grid.info.origin.orientation);
+    map->build(grid.data.data(), grid.info.width, grid.info.height);
+    return map;
+}
+
+
+std::shared_ptr<ObstacleSet> make_obstacles(const mpc::Obstacles & msg) {
+    size_t num_obstacles = msg.x.size();
+    if (msg.y.size() != num_obstacles or msg.radius.size() != num_obstacles
+            or (!msg.vx.empty() and msg.vx.size() != num_obstacles)
+            or (!msg.vy.empty() and msg.vy.size() != num_obstacles)) {
+        ROS_ERROR("/obstacles: %lu x, %lu y, %lu radius, %lu vx and %lu vy aren't one of each per obstacle",
+                  num_obstacles, msg.y.size(), msg.radius.size(), msg.vx.size(), msg.vy.size());
+        return nullptr;
+    }
+
+    // A new object every time, as the centerlines
+    std::shared_ptr<ObstacleSet> obstacles = std::make_shared<ObstacleSet>();
+    obstacles->stamp = msg.header.stamp.toSec();
+    obstacles->x = msg.x;
+    obstacles->y = msg.y;
+    obstacles->radius = msg.radius;
+    obstacles->vx = msg.vx;
+    obstacles->vy = msg.vy;
+    obstacles->build();
+    return obstacles;
+}
+
+
+void read_signal_go(uint16_t signal, InputSnapshot & inputs) {
+    if (signal == 0) {
+        ROS_WARN("Emergency stop!");
+        inputs.go_flag = false;
+    } else if (signal == 2309){
+        ROS_WARN("GO!");
+        inputs.go_flag = true;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <geometry_msgs/Quaternion.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/Imu.h>
+#include <rospy_tutorials/Floats.h>
+#include <visualization_msgs/Marker.h>
+#include <mpc/CenterlinePatch.h>
+#include <mpc/Obstacles.h>
+
+#include "ControlPipeline.h"
+#include "ParticleFilter.h"
+
+
+///* The messages of the node's topics, as the inputs of the controller:
+///* what MPCControllerNode's callbacks and mpc_bag_replay make of them
+
+///* The hash of the path of /centerline (see `Centerline::hash`)
+uint64_t centerline_hash(const visualization_msgs::Marker & marker);
+
+///* ... and of /centerline_numpy
+uint64_t centerline_hash(const rospy_tutorials::Floats & rows);
+
+///* ... and of the waypoints of a CSV
+uint64_t centerline_hash(const std::vector<double> & pts_x, const std::vector<double> & pts_y);
+
+///* A new centerline of the path of /centerline, with its `hash`
+std::shared_ptr<Centerline> make_centerline(const visualization_msgs::Marker & marker, uint64_t hash);
+
+///* ... of /centerline_numpy: its packed rows of (x, y, yaw, speed) floats;
+///* nullptr (after logging why) if they're not whole rows
+std::shared_ptr<Centerline> make_centerline(const rospy_tutorials::Floats & rows, uint64_t hash);
+
+///* A new centerline, `current` with the span of `patch` replaced and
+///* prepared for `params` (see `PathTracker::patch_centerline`), with the
+///* hash of its path and its version; nullptr (after logging why) if the
+///* patch is of another path, not newer than the last one applied to it, or
+///* doesn't fit it
+std::shared_ptr<Centerline> patch_centerline(const std::shared_ptr<const Centerline> & current,
+                                             const mpc::CenterlinePatch & patch, const Params & params);
+
+///* Columns of /centerline_numpy: x, y, yaw, speed
+constexpr size_t CENTERLINE_NUMPY_COLUMNS = 4;
+
+///* The speed from /odom, and its yaw rate for the dead reckoning
+void read_odom(const nav_msgs::Odometry & odom, InputSnapshot & inputs);
+
+///* The IMU's yaw rate, for the dead reckoning (see
+///* `Params::dead_reckoning_imu`)
+void read_imu(const sensor_msgs::Imu & imu, InputSnapshot & inputs);
+
+///* The pose from /pf/pose/odom (psi from its quaternion)
+void read_pose(const nav_msgs::Odometry & pose, InputSnapshot & inputs);
+
+///* ... or from the node's own ParticleFilter, for the scan at `stamp`
+void read_pose(const ParticleFilter & filter, double stamp, InputSnapshot & inputs);
+
+///* The yaw [rad] of a quaternion
+double quaternion_yaw(const geometry_msgs::Quaternion & o);
+
+///* The map of /map, for the ParticleFilter; nullptr (after logging why)
+///* if it doesn't have a cell for each of its width by its height
+std::shared_ptr<LocalizationMap> make_localization_map(const nav_msgs::OccupancyGrid & grid);
+
+///* The obstacles of /obstacles, with their grid; nullptr (after logging
+///* why) if its arrays don't have one entry per obstacle
+std::shared_ptr<ObstacleSet> make_obstacles(const mpc::Obstacles & msg);
+
+///* The go flag from /signal/go: 0 stops, 2309 goes, the rest is ignored
+void read_signal_go(uint16_t signal, InputSnapshot & inputs);
@@ -0,0 +1,29 @@
+#include "Instrumentation.h"
+#include "Trace.h"
+
+
+std::atomic<int> Instrumentation::s_level(INSTRUMENTATION_HISTOGRAMS);
+
+static const char * const LEVEL_NAMES[NUM_INSTRUMENTATION_LEVELS] = {"off", "counters", "histograms", "trace"};
+
+
+void Instrumentation::set_level(InstrumentationLevel level) {
+    s_level.store(level, std::memory_order_relaxed);
+    Trace::enable(level >= INSTRUMENTATION_TRACE);
+}
+
+
+const char * Instrumentation::name(InstrumentationLevel level) {
+    return (level >= 0 and level < NUM_INSTRUMENTATION_LEVELS) ? LEVEL_NAMES[level] : "unknown";
+}
+
+
+bool Instrumentation::from_name(const std::string & name, InstrumentationLevel & level) {
+    for (int l=0; l < NUM_INSTRUMENTATION_LEVELS; l++) {
+        if (name == LEVEL_NAMES[l]) {
+            level = InstrumentationLevel(l);
+            return true;
+        }
+    }
+    return false;
+}
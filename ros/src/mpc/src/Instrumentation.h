@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+
+///* How much the controller measures of itself, switched at runtime (see
+///* /mpc/set_instrumentation and `Params::instrumentation`), each level on
+///* top of the one before it:
+///*
+///*   off         nothing
+///*   counters    the counts of /mpc/stats (ticks, overruns, deadline hits,
+///*               restorations, iterations)
+///*   histograms  the latency histograms of the stages, and their hardware
+///*               counters with `Params::perf_counters`
+///*   trace       the trace (see Trace.h)
+///*
+///* The level is a single atomic, read once per tick by the solver loop
+///* (with a relaxed load) and branched on for the rest of it; the trace
+///* scopes read Trace's own flag, which follows it.
+enum InstrumentationLevel : int {
+    INSTRUMENTATION_OFF,
+    INSTRUMENTATION_COUNTERS,
+    INSTRUMENTATION_HISTOGRAMS,
+    INSTRUMENTATION_TRACE,
+    NUM_INSTRUMENTATION_LEVELS
+};
+
+
+class Instrumentation {
+public:
+    static InstrumentationLevel level() {
+        return InstrumentationLevel(s_level.load(std::memory_order_relaxed));
+    }
+
+    ///* Switches to `level`, turning the trace on or off with it; the ticks
+    ///* that are under way finish at the level they started with
+    static void set_level(InstrumentationLevel level);
+
+    static const char * name(InstrumentationLevel level);
+
+    ///* The level called `name`; false if none is
+    static bool from_name(const std::string & name, InstrumentationLevel & level);
+
+private:
+    static std::atomic<int> s_level;
+};
@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "IpoptJournal.h"
+
+
+constexpr size_t IpoptLog::MAX_ITERATIONS;
+constexpr size_t IpoptLog::MESSAGE_SIZE;
+
+
+IpoptJournal::IpoptJournal(IpoptLog & log) : Ipopt::Journal("mpc_telemetry", Ipopt::J_STRONGWARNING), m_log(log) {
+}
+
+
+void IpoptJournal::PrintImpl(Ipopt::EJournalCategory, Ipopt::EJournalLevel, const char * str) {
+    keep(str);
+}
+
+
+void IpoptJournal::PrintfImpl(Ipopt::EJournalCategory, Ipopt::EJournalLevel, const char * pformat, va_list ap) {
+    char buffer[IpoptLog::MESSAGE_SIZE];
+    std::vsnprintf(buffer, sizeof(buffer), pformat, ap);
+    keep(buffer);
+}
+
+
+void IpoptJournal::keep(const char * text) {
+    // Ipopt prints a message in pieces, with blank lines around it, which
+    // aren't messages of their own
+    size_t length = std::strcspn(text, "\n");
+    while (length == 0 and *text == '\n')
+        length = std::strcspn(++text, "\n");
+    if (length == 0)
+        return;
+    length = std::min(length, IpoptLog::MESSAGE_SIZE - 1);
+    std::memcpy(m_log.message, text, length);
+    m_log.message[length] = '\0';
+    if (m_log.num_messages < UINT16_MAX)
+        m_log.num_messages++;
+}
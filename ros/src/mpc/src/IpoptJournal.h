@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdarg>
+
+#include <coin/IpJournalist.hpp>
+
+#include "IpoptLog.h"
+
+
+///* Ipopt's journal of `Params::ipopt_journal`, in place of its console
+///* output: the messages Ipopt prints go into the IpoptLog of the solve,
+///* formatted into its fixed buffer, instead of being written to stdout
+///* from inside the solve. Only the errors and strong warnings are accepted
+///* (see `MPC::MPC`), so the summaries Ipopt prints at every solve aren't
+///* even formatted.
+class IpoptJournal : public Ipopt::Journal {
+public:
+    IpoptJournal(IpoptLog & log);
+
+protected:
+    void PrintImpl(Ipopt::EJournalCategory category, Ipopt::EJournalLevel level, const char * str);
+    void PrintfImpl(Ipopt::EJournalCategory category, Ipopt::EJournalLevel level, const char * pformat,
+                    va_list ap);
+    void FlushBufferImpl() {}
+
+private:
+    ///* Counts the first line of `text` as a message, unless it's blank
+    void keep(const char * text);
+
+    IpoptLog & m_log;
+};
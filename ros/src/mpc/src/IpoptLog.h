@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+///* What Ipopt reported during one solve, in place of its output (see
+///* `Params::ipopt_journal`): the latest MAX_ITERATIONS of its iterations,
+///* as `intermediate_callback` sees them, and its messages (errors and
+///* strong warnings), of which the last is kept. A fixed-size record, so
+///* that it's filled without allocating and goes into the telemetry ring
+///* with the tick's TelemetryRecord.
+struct IpoptLog {
+    static constexpr size_t MAX_ITERATIONS = 16;
+    static constexpr size_t MESSAGE_SIZE = 96;
+
+    struct Iteration {
+        int16_t iter;
+        ///* Whether it's one of the restoration phase
+        uint8_t restoration;
+        uint8_t ls_trials;
+        float obj_value;
+        float inf_pr;
+        float inf_du;
+        float log10_mu;
+        float alpha_pr;
+    };
+
+    ///* All the iterations of the solve, of which the latest MAX_ITERATIONS
+    ///* are in the ring `iterations`
+    uint16_t num_iterations = 0;
+    Iteration iterations[MAX_ITERATIONS];
+
+    ///* All the messages of the solve, and the first line of the last one
+    uint16_t num_messages = 0;
+    char message[MESSAGE_SIZE] = {0};
+
+    void clear() {
+        num_iterations = 0;
+        num_messages = 0;
+        message[0] = '\0';
+    }
+
+    void add_iteration(const Iteration & iteration) {
+        iterations[num_iterations % MAX_ITERATIONS] = iteration;
+        if (num_iterations < UINT16_MAX)
+            num_iterations++;
+    }
+
+    ///* The i-th oldest of the iterations that are kept
+    size_t num_kept() const { return num_iterations < MAX_ITERATIONS ? num_iterations : MAX_ITERATIONS; }
+    const Iteration & kept(size_t i) const {
+        return iterations[(num_iterations - num_kept() + i) % MAX_ITERATIONS];
+    }
+};
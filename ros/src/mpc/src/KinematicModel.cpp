@@ -0,0 +1,423 @@
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <utility>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/AutoDiff"
+#include "KinematicModel.h"
+#include "StageCost.h"
+
+
+constexpr double KinematicModel::FLOAT_TOLERANCE;
+const size_t KinematicModel::STAGE_OUTPUTS;
+
+
+// The scalars of the steps on AutoDiff: first order over the inputs of a
+// step, and second order (first order over the first order ones)
+typedef Eigen::AutoDiffScalar<Eigen::Matrix<double, 7, 1> > Stage1;
+typedef Eigen::AutoDiffScalar<Eigen::Matrix<Stage1, 7, 1> > Stage2;
+
+
+// AutoDiffScalar has no atan
+static Stage1 atan_ad(const Stage1 & a) {
+    double value = a.value();
+    return Stage1(std::atan(value), a.derivatives() * (1.0 / (1.0 + value * value)));
+}
+
+
+static Stage2 atan_ad(const Stage2 & a) {
+    const Stage1 & value = a.value();
+    Stage1 scale = 1.0 / (1.0 + value * value);
+    return Stage2(atan_ad(value), a.derivatives() * scale);
+}
+
+
+KinematicModel::KinematicModel(const Params & params, const Indexes & indexes)
+        : m_float_hessian(params.precision == "mixed" or params.precision == "float"),
+          m_float_all(params.precision == "float"), m_autodiff_stages(params.autodiff_stages),
+          m_params(params), m_indexes(indexes),
+          m_n_vars(params.steps_ahead * 5 + (params.steps_ahead - 1) * 2),
+          m_n_constraints(params.steps_ahead * 5),
+          m_coeffs(params.poly_degree + 1, 0.0), m_ref_v(0.0)
+{
+    // The patterns are those of the entries emitted at any x
+    std::vector<double> x(m_n_vars, 0.0);
+    std::vector<double> lambda(m_n_constraints, 0.0);
+
+    jacobian_entries<double>(x.data(), [this](size_t row, size_t col, double) {
+        m_jac_row.push_back(row);
+        m_jac_col.push_back(col);
+    });
+
+    std::map<std::pair<size_t, size_t>, size_t> slots;
+    hessian_entries<double>(x.data(), 1.0, lambda.data(), [&](size_t row, size_t col, double) {
+        assert(row >= col);
+        auto inserted = slots.insert(std::make_pair(std::make_pair(row, col), m_hes_row.size()));
+        if (inserted.second) {
+            m_hes_row.push_back(row);
+            m_hes_col.push_back(col);
+        }
+        m_hes_slot.push_back(inserted.first->second);
+    });
+}
+
+
+void KinematicModel::set_problem(const Eigen::VectorXd & coeffs, double ref_v) {
+    assert(size_t(coeffs.size()) == m_coeffs.size());
+    for (size_t i=0; i < m_coeffs.size(); i++)
+        m_coeffs[i] = coeffs[i];
+    m_ref_v = ref_v;
+}
+
+
+template <class Scalar>
+void KinematicModel::poly(Scalar x, Scalar & f, Scalar & f1, Scalar & f2, Scalar & f3) const {
+    // Horner's scheme, for each of them
+    size_t n = m_coeffs.size();
+    f = f1 = f2 = f3 = Scalar(0);
+    for (size_t k=n; k-- > 0;)
+        f = f * x + Scalar(m_coeffs[k]);
+    for (size_t k=n; k-- > 1;)
+        f1 = f1 * x + Scalar(double(k) * m_coeffs[k]);
+    for (size_t k=n; k-- > 2;)
+        f2 = f2 * x + Scalar(double(k) * double(k - 1) * m_coeffs[k]);
+    for (size_t k=n; k-- > 3;)
+        f3 = f3 * x + Scalar(double(k) * double(k - 1) * double(k - 2) * m_coeffs[k]);
+}
+
+
+template <class T>
+void KinematicModel::predict(const T * in, T * out) const {
+    const double dt = m_params.dt;
+    const double lf = Lf();
+    const T & x0 = in[S_X];
+
+    // The polynomial and its derivative, by Horner's scheme (from a
+    // constant of x0's type)
+    size_t n = m_coeffs.size();
+    T f0 = x0 * 0.0 + m_coeffs[n - 1];
+    for (size_t k=n - 1; k-- > 0;)
+        f0 = f0 * x0 + m_coeffs[k];
+    T f1 = x0 * 0.0 + double(n - 1) * m_coeffs[n - 1];
+    for (size_t k=n - 1; k-- > 1;)
+        f1 = f1 * x0 + double(k) * m_coeffs[k];
+
+    using std::cos;
+    using std::sin;
+    out[S_X] = x0 + in[S_V] * cos(in[S_PSI]) * dt;
+    out[S_Y] = in[S_Y] + in[S_V] * sin(in[S_PSI]) * dt;
+    out[S_PSI] = in[S_PSI] - in[S_V] * in[S_DELTA] / lf * dt;
+    out[S_CTE] = f0 - in[S_Y] + in[S_V] * sin(in[S_EPSI]) * dt;
+    out[S_EPSI] = in[S_PSI] - atan_ad(f1) - in[S_V] * in[S_DELTA] / lf * dt;
+}
+
+
+// The variables of step a, in the order of the inputs of a step
+static void stage_inputs(const Indexes & I, const double * x, size_t a, double * in) {
+    in[0] = x[I.x_start + a];
+    in[1] = x[I.y_start + a];
+    in[2] = x[I.psi_start + a];
+    in[3] = x[I.cte_start + a];
+    in[4] = x[I.epsi_start + a];
+    in[5] = x[I.delta_start + a];
+    in[6] = x[I.v_start + a];
+}
+
+
+template <class Scalar>
+void KinematicModel::stage_jacobian(const double * x, size_t a, Scalar J[][STAGE_INPUTS]) const {
+    double values[STAGE_INPUTS];
+    stage_inputs(m_indexes, x, a, values);
+    Stage1 in[STAGE_INPUTS];
+    for (size_t i=0; i < STAGE_INPUTS; i++)
+        in[i] = Stage1(values[i], STAGE_INPUTS, i);
+
+    Stage1 out[STAGE_OUTPUTS];
+    predict(in, out);
+    for (size_t r=0; r < STAGE_OUTPUTS; r++)
+        for (size_t i=0; i < STAGE_INPUTS; i++)
+            J[r][i] = Scalar(out[r].derivatives()[i]);
+}
+
+
+template <class Scalar>
+void KinematicModel::stage_hessian(const double * x, const double * lambda, size_t t,
+                                   Scalar H[][STAGE_INPUTS]) const {
+    const Indexes & I = m_indexes;
+    double values[STAGE_INPUTS];
+    stage_inputs(I, x, t - 1, values);
+    Stage2 in[STAGE_INPUTS];
+    for (size_t i=0; i < STAGE_INPUTS; i++) {
+        in[i].value() = Stage1(values[i], STAGE_INPUTS, i);
+        for (size_t j=0; j < STAGE_INPUTS; j++)
+            in[i].derivatives()[j] = Stage1(i == j ? 1.0 : 0.0);
+    }
+
+    Stage2 out[STAGE_OUTPUTS];
+    predict(in, out);
+    const double l[STAGE_OUTPUTS] = {
+        lambda[I.x_start + t], lambda[I.y_start + t], lambda[I.psi_start + t],
+        lambda[I.cte_start + t], lambda[I.epsi_start + t]
+    };
+    Stage2 lagrangian = out[S_X] * l[S_X];
+    for (size_t r=1; r < STAGE_OUTPUTS; r++)
+        lagrangian += out[r] * l[r];
+
+    // The constraints are the state at t minus the predictions
+    for (size_t i=0; i < STAGE_INPUTS; i++)
+        for (size_t j=0; j < STAGE_INPUTS; j++)
+            H[i][j] = Scalar(-lagrangian.derivatives()[i].derivatives()[j]);
+}
+
+
+double KinematicModel::cost(const double * x) const {
+    return m_float_all ? cost_as<float>(x) : cost_as<double>(x);
+}
+
+
+void KinematicModel::gradient(const double * x, double * grad) const {
+    if (m_float_all)
+        gradient_as<float>(x, grad);
+    else
+        gradient_as<double>(x, grad);
+}
+
+
+void KinematicModel::constraints(const double * x, double * g) const {
+    if (m_float_all)
+        constraints_as<float>(x, g);
+    else
+        constraints_as<double>(x, g);
+}
+
+
+template <class Scalar>
+Scalar KinematicModel::cost_as(const double * x) const {
+    double weights[StageCost::NUM_WEIGHTS];
+    StageCost::weights(m_params, weights);
+    return StageCost::Cost::value(x, m_indexes, m_params.steps_ahead, weights, Scalar(m_ref_v));
+}
+
+
+template <class Scalar>
+void KinematicModel::gradient_as(const double * x, double * grad) const {
+    double weights[StageCost::NUM_WEIGHTS];
+    StageCost::weights(m_params, weights);
+    for (size_t i=0; i < m_n_vars; i++)
+        grad[i] = 0.0;
+    Scalar f = Scalar(0);
+    StageCost::Cost::evaluate(x, m_indexes, m_params.steps_ahead, weights, Scalar(m_ref_v), f, grad);
+}
+
+
+template <class Scalar>
+void KinematicModel::constraints_as(const double * x, double * g) const {
+    const Indexes & I = m_indexes;
+    size_t N = m_params.steps_ahead;
+    const Scalar dt = Scalar(m_params.dt);
+    const Scalar lf = Scalar(Lf());
+
+    // The initial state
+    g[I.x_start] = x[I.x_start];
+    g[I.y_start] = x[I.y_start];
+    g[I.psi_start] = x[I.psi_start];
+    g[I.cte_start] = x[I.cte_start];
+    g[I.epsi_start] = x[I.epsi_start];
+
+    // The steps of the model, as in FG_eval::stage
+    for (size_t t=1; t < N; t++) {
+        size_t a = t - 1;
+        Scalar x0 = Scalar(x[I.x_start + a]);
+        Scalar y0 = Scalar(x[I.y_start + a]);
+        Scalar psi0 = Scalar(x[I.psi_start + a]);
+        Scalar epsi0 = Scalar(x[I.epsi_start + a]);
+        Scalar v0 = Scalar(x[I.v_start + a]);
+        Scalar delta0 = Scalar(x[I.delta_start + a]);
+        Scalar f0, f1, f2, f3;
+        poly(x0, f0, f1, f2, f3);
+
+        g[I.x_start + t] = Scalar(x[I.x_start + t]) - (x0 + v0 * std::cos(psi0) * dt);
+        g[I.y_start + t] = Scalar(x[I.y_start + t]) - (y0 + v0 * std::sin(psi0) * dt);
+        g[I.psi_start + t] = Scalar(x[I.psi_start + t]) - (psi0 - v0 * delta0 / lf * dt);
+        g[I.cte_start + t] = Scalar(x[I.cte_start + t]) - (f0 - y0 + v0 * std::sin(epsi0) * dt);
+        g[I.epsi_start + t] = Scalar(x[I.epsi_start + t]) - (psi0 - std::atan(f1) - v0 * delta0 / lf * dt);
+    }
+}
+
+
+template <class Scalar, class Emit>
+void KinematicModel::jacobian_entries(const double * x, Emit emit) const {
+    const Indexes & I = m_indexes;
+    size_t N = m_params.steps_ahead;
+    const Scalar one = Scalar(1);
+    const Scalar dt = Scalar(m_params.dt);
+    const Scalar lf = Scalar(Lf());
+
+    emit(I.x_start, I.x_start, one);
+    emit(I.y_start, I.y_start, one);
+    emit(I.psi_start, I.psi_start, one);
+    emit(I.cte_start, I.cte_start, one);
+    emit(I.epsi_start, I.epsi_start, one);
+
+    for (size_t t=1; t < N; t++) {
+        size_t a = t - 1;
+
+        // The derivatives of the step's predictions of the state at t by its
+        // inputs, at a (only those that can be non-zero)
+        Scalar J[STAGE_OUTPUTS][STAGE_INPUTS];
+        if (m_autodiff_stages) {
+            stage_jacobian(x, a, J);
+        } else {
+            Scalar psi0 = Scalar(x[I.psi_start + a]);
+            Scalar epsi0 = Scalar(x[I.epsi_start + a]);
+            Scalar v0 = Scalar(x[I.v_start + a]);
+            Scalar delta0 = Scalar(x[I.delta_start + a]);
+            Scalar f0, f1, f2, f3;
+            poly(Scalar(x[I.x_start + a]), f0, f1, f2, f3);
+            Scalar cos_psi0 = std::cos(psi0), sin_psi0 = std::sin(psi0);
+
+            J[S_X][S_X] = one;
+            J[S_X][S_PSI] = -v0 * sin_psi0 * dt;
+            J[S_X][S_V] = cos_psi0 * dt;
+
+            J[S_Y][S_Y] = one;
+            J[S_Y][S_PSI] = v0 * cos_psi0 * dt;
+            J[S_Y][S_V] = sin_psi0 * dt;
+
+            J[S_PSI][S_PSI] = one;
+            J[S_PSI][S_DELTA] = -v0 / lf * dt;
+            J[S_PSI][S_V] = -delta0 / lf * dt;
+
+            J[S_CTE][S_X] = f1;
+            J[S_CTE][S_Y] = -one;
+            J[S_CTE][S_EPSI] = v0 * std::cos(epsi0) * dt;
+            J[S_CTE][S_V] = std::sin(epsi0) * dt;
+
+            J[S_EPSI][S_X] = -f2 / (one + f1 * f1);
+            J[S_EPSI][S_PSI] = one;
+            J[S_EPSI][S_DELTA] = -v0 / lf * dt;
+            J[S_EPSI][S_V] = -delta0 / lf * dt;
+        }
+
+        // The constraints are the state at t minus the predictions
+        size_t row = I.x_start + t;
+        emit(row, I.x_start + t, one);
+        emit(row, I.x_start + a, -J[S_X][S_X]);
+        emit(row, I.psi_start + a, -J[S_X][S_PSI]);
+        emit(row, I.v_start + a, -J[S_X][S_V]);
+
+        row = I.y_start + t;
+        emit(row, I.y_start + t, one);
+        emit(row, I.y_start + a, -J[S_Y][S_Y]);
+        emit(row, I.psi_start + a, -J[S_Y][S_PSI]);
+        emit(row, I.v_start + a, -J[S_Y][S_V]);
+
+        row = I.psi_start + t;
+        emit(row, I.psi_start + t, one);
+        emit(row, I.psi_start + a, -J[S_PSI][S_PSI]);
+        emit(row, I.delta_start + a, -J[S_PSI][S_DELTA]);
+        emit(row, I.v_start + a, -J[S_PSI][S_V]);
+
+        row = I.cte_start + t;
+        emit(row, I.cte_start + t, one);
+        emit(row, I.x_start + a, -J[S_CTE][S_X]);
+        emit(row, I.y_start + a, -J[S_CTE][S_Y]);
+        emit(row, I.epsi_start + a, -J[S_CTE][S_EPSI]);
+        emit(row, I.v_start + a, -J[S_CTE][S_V]);
+
+        row = I.epsi_start + t;
+        emit(row, I.epsi_start + t, one);
+        emit(row, I.x_start + a, -J[S_EPSI][S_X]);
+        emit(row, I.psi_start + a, -J[S_EPSI][S_PSI]);
+        emit(row, I.delta_start + a, -J[S_EPSI][S_DELTA]);
+        emit(row, I.v_start + a, -J[S_EPSI][S_V]);
+    }
+}
+
+
+void KinematicModel::jacobian(const double * x, double * values) const {
+    size_t k = 0;
+    if (m_float_all)
+        jacobian_entries<float>(x, [&](size_t, size_t, float value) {
+            values[k++] = value;
+        });
+    else
+        jacobian_entries<double>(x, [&](size_t, size_t, double value) {
+            values[k++] = value;
+        });
+}
+
+
+template <class Scalar, class Emit>
+void KinematicModel::hessian_entries(const double * x, double obj_factor, const double * lambda,
+                                     Emit emit) const {
+    const Indexes & I = m_indexes;
+    size_t N = m_params.steps_ahead;
+    const Scalar dt = Scalar(m_params.dt);
+    const Scalar lf = Scalar(Lf());
+
+    // The cost
+    double weights[StageCost::NUM_WEIGHTS];
+    StageCost::weights(m_params, weights);
+    StageCost::Cost::hessian<Scalar>(I, N, weights, obj_factor, emit);
+
+    // The steps of the model (the initial state constraints are linear)
+    for (size_t t=1; t < N; t++) {
+        size_t a = t - 1;
+
+        // The Hessian of the step's constraints (weighted by their lambdas)
+        // by its inputs, at a (only the entries that can be non-zero)
+        Scalar H[STAGE_INPUTS][STAGE_INPUTS];
+        if (m_autodiff_stages) {
+            stage_hessian(x, lambda, t, H);
+        } else {
+            Scalar psi0 = Scalar(x[I.psi_start + a]);
+            Scalar epsi0 = Scalar(x[I.epsi_start + a]);
+            Scalar v0 = Scalar(x[I.v_start + a]);
+            Scalar f0, f1, f2, f3;
+            poly(Scalar(x[I.x_start + a]), f0, f1, f2, f3);
+            Scalar cos_psi0 = std::cos(psi0), sin_psi0 = std::sin(psi0);
+
+            Scalar l_x = Scalar(lambda[I.x_start + t]);
+            Scalar l_y = Scalar(lambda[I.y_start + t]);
+            Scalar l_psi = Scalar(lambda[I.psi_start + t]);
+            Scalar l_cte = Scalar(lambda[I.cte_start + t]);
+            Scalar l_epsi = Scalar(lambda[I.epsi_start + t]);
+
+            // d2/dx2 of atan(f'(x))
+            Scalar slope = Scalar(1) + f1 * f1;
+            Scalar atan_diff2 = (f3 * slope - Scalar(2) * f1 * f2 * f2) / (slope * slope);
+
+            H[S_PSI][S_PSI] = (l_x * cos_psi0 + l_y * sin_psi0) * v0 * dt;
+            H[S_V][S_PSI] = (l_x * sin_psi0 - l_y * cos_psi0) * dt;
+            H[S_V][S_DELTA] = (l_psi + l_epsi) / lf * dt;
+            H[S_X][S_X] = -l_cte * f2 + l_epsi * atan_diff2;
+            H[S_EPSI][S_EPSI] = l_cte * v0 * std::sin(epsi0) * dt;
+            H[S_V][S_EPSI] = -l_cte * std::cos(epsi0) * dt;
+        }
+
+        emit(I.psi_start + a, I.psi_start + a, H[S_PSI][S_PSI]);
+        emit(I.v_start + a, I.psi_start + a, H[S_V][S_PSI]);
+        emit(I.v_start + a, I.delta_start + a, H[S_V][S_DELTA]);
+        emit(I.x_start + a, I.x_start + a, H[S_X][S_X]);
+        emit(I.epsi_start + a, I.epsi_start + a, H[S_EPSI][S_EPSI]);
+        emit(I.v_start + a, I.epsi_start + a, H[S_V][S_EPSI]);
+    }
+}
+
+
+void KinematicModel::hessian(const double * x, double obj_factor, const double * lambda, double * values) const {
+    // The entries that share a slot are summed in double either way
+    for (size_t k=0; k < m_hes_row.size(); k++)
+        values[k] = 0.0;
+    size_t e = 0;
+    if (m_float_hessian)
+        hessian_entries<float>(x, obj_factor, lambda, [&](size_t, size_t, float value) {
+            values[m_hes_slot[e++]] += value;
+        });
+    else
+        hessian_entries<double>(x, obj_factor, lambda, [&](size_t, size_t, double value) {
+            values[m_hes_slot[e++]] += value;
+        });
+}
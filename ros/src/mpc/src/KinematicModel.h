@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+///* The NLP of FG_eval (its cost and the constraints of the kinematic model)
+///* with the sparsity patterns and the first and second derivatives in
+///* closed form, for evaluating it without AD (see
+///* `Params::analytic_derivatives`).
+///*
+///* The constraints are those of FG_eval without the cost (row 0 of its
+///* `fg`); the Hessian is that of the Lagrangian, lower triangle only. The
+///* patterns are fixed at construction, the evaluations don't allocate.
+///*
+///* The evaluations are templates of their scalar type, double or float
+///* (see `Params::precision`); the interface is in double either way.
+///*
+///* The derivatives of a step of the model can come from Eigen's AutoDiff
+///* instead of their closed forms (see `Params::autodiff_stages`): fixed-size
+///* forward mode over the STAGE_INPUTS variables of the step, on the stack,
+///* without a tape. They're the same entries either way.
+class KinematicModel {
+public:
+    KinematicModel(const Params & params, const Indexes & indexes);
+
+    ///* The polynomial and the reference speed of the next evaluations
+    void set_problem(const Eigen::VectorXd & coeffs, double ref_v);
+
+    ///* ... and the weights of the cost (those of `params`)
+    void set_weights(const Params & params) { m_params.copy_weights(params); }
+
+    double cost(const double * x) const;
+    void gradient(const double * x, double * grad) const;
+    void constraints(const double * x, double * g) const;
+
+    ///* The Jacobian of the constraints: its pattern, and its values in the
+    ///* order of the pattern
+    const std::vector<size_t> & jac_row() const { return m_jac_row; }
+    const std::vector<size_t> & jac_col() const { return m_jac_col; }
+    void jacobian(const double * x, double * values) const;
+
+    ///* The lower triangle of the Hessian of obj_factor * cost + lambda . g
+    const std::vector<size_t> & hes_row() const { return m_hes_row; }
+    const std::vector<size_t> & hes_col() const { return m_hes_col; }
+    void hessian(const double * x, double obj_factor, const double * lambda, double * values) const;
+
+    ///* Ipopt's tolerance when everything is evaluated in float: its default
+    ///* (1e-8) is below the rounding of the derivatives
+    static constexpr double FLOAT_TOLERANCE = 1e-6;
+
+private:
+    ///* The inputs of a step of the model (the variables of step a), the
+    ///* first STAGE_OUTPUTS of which it predicts at step t = a + 1
+    enum StageInput { S_X, S_Y, S_PSI, S_CTE, S_EPSI, S_DELTA, S_V, STAGE_INPUTS };
+    static const size_t STAGE_OUTPUTS = S_DELTA;
+
+    ///* A step of the model, in any scalar (the AutoDiff ones, see the .cpp)
+    template <class T>
+    void predict(const T * in, T * out) const;
+
+    ///* With AutoDiff: the Jacobian of the predictions of the step from a,
+    ///* and the Hessian of lambda . g of the constraints of step t, by the
+    ///* step's inputs
+    template <class Scalar>
+    void stage_jacobian(const double * x, size_t a, Scalar J[][STAGE_INPUTS]) const;
+    template <class Scalar>
+    void stage_hessian(const double * x, const double * lambda, size_t t, Scalar H[][STAGE_INPUTS]) const;
+
+    ///* The polynomial and its first three derivatives at x
+    template <class Scalar>
+    void poly(Scalar x, Scalar & f, Scalar & f1, Scalar & f2, Scalar & f3) const;
+
+    template <class Scalar>
+    Scalar cost_as(const double * x) const;
+    template <class Scalar>
+    void gradient_as(const double * x, double * grad) const;
+    template <class Scalar>
+    void constraints_as(const double * x, double * g) const;
+
+    ///* Calls emit(row, col, value) for every entry of the Jacobian, or of
+    ///* the Hessian of the Lagrangian, always in the same order (which is
+    ///* how the patterns are made, with x = 0)
+    template <class Scalar, class Emit>
+    void jacobian_entries(const double * x, Emit emit) const;
+    template <class Scalar, class Emit>
+    void hessian_entries(const double * x, double obj_factor, const double * lambda, Emit emit) const;
+
+    ///* See `Params::precision`
+    bool m_float_hessian;
+    bool m_float_all;
+    ///* See `Params::autodiff_stages`
+    bool m_autodiff_stages;
+
+    Params m_params;
+    Indexes m_indexes;
+    size_t m_n_vars;
+    size_t m_n_constraints;
+
+    std::vector<double> m_coeffs;
+    double m_ref_v;
+
+    std::vector<size_t> m_jac_row;
+    std::vector<size_t> m_jac_col;
+
+    ///* The Hessian's entries are emitted more than once at some
+    ///* positions: the slot of the pattern of each emitted entry
+    std::vector<size_t> m_hes_row;
+    std::vector<size_t> m_hes_col;
+    std::vector<size_t> m_hes_slot;
+};
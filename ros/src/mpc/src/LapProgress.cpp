@@ -0,0 +1,137 @@
+#include <cmath>
+#include <algorithm>
+
+#include "LapProgress.h"
+#include "PathTracker.h"
+
+
+constexpr double LapProgress::TRACK_LOST_DISTANCE;
+
+
+LapProgress::LapProgress() {
+    reset();
+}
+
+
+void LapProgress::reset() {
+    m_centerline = nullptr;
+    m_num_points = 0;
+    m_num_segments = 0;
+    m_closed = false;
+    m_segment = 0;
+    m_t = 0.0;
+    m_s = 0.0;
+    m_d = 0.0;
+    m_laps = 0;
+    m_lost = false;
+}
+
+
+int LapProgress::closest_waypoint() const {
+    return (m_t < 0.5) ? m_segment : next(m_segment);
+}
+
+
+void LapProgress::project(const Centerline & centerline, int i, double x, double y,
+                          double & t, double & dist2) const {
+    int j = next(i);
+    double seg_x = centerline.pts_x[j] - centerline.pts_x[i];
+    double seg_y = centerline.pts_y[j] - centerline.pts_y[i];
+    double rel_x = x - centerline.pts_x[i];
+    double rel_y = y - centerline.pts_y[i];
+    double length2 = seg_x*seg_x + seg_y*seg_y;
+
+    // A repeated waypoint is a segment of no length, at its start
+    t = (length2 > 0.0) ? (rel_x*seg_x + rel_y*seg_y) / length2 : 0.0;
+    double clamped = std::min(std::max(t, 0.0), 1.0);
+    double diff_x = rel_x - clamped * seg_x;
+    double diff_y = rel_y - clamped * seg_y;
+    dist2 = diff_x*diff_x + diff_y*diff_y;
+}
+
+
+void LapProgress::relocalize(const Centerline & centerline, double x, double y, double & t, double & dist2) {
+    // The projection is on one of the two segments of the closest waypoint
+    int closest = centerline.grid.nearest(x, y);
+    m_segment = std::min(closest, m_num_segments - 1);
+    project(centerline, m_segment, x, y, t, dist2);
+    if (m_closed or closest > 0) {
+        double t_before, dist2_before;
+        project(centerline, previous(closest), x, y, t_before, dist2_before);
+        if (dist2_before < dist2) {
+            m_segment = previous(closest);
+            t = t_before;
+            dist2 = dist2_before;
+        }
+    }
+}
+
+
+bool LapProgress::update(const Centerline & centerline, double x, double y) {
+    int num_points = int(centerline.pts_x.size());
+    if (num_points < 2)
+        return false;
+
+    // A new path, or nothing to track yet
+    bool tracking = (&centerline == m_centerline and num_points == m_num_points);
+    m_centerline = &centerline;
+    m_num_points = num_points;
+    m_closed = centerline.spline.closed();
+    m_num_segments = m_closed ? num_points : num_points - 1;
+
+    double t = 0.0;
+    double dist2 = 0.0;
+    m_lost = false;
+    if (tracking) {
+        // Down the path while the car is past the end of its segment, or
+        // up it while it's before the start, stopping at the corner where
+        // it's past one and before the next
+        int segment = m_segment;
+        project(centerline, segment, x, y, t, dist2);
+        int walked = 0;
+        while (t > 1.0 and walked < MAX_WALK and (m_closed or segment + 1 < m_num_segments)) {
+            double t_next, dist2_next;
+            project(centerline, next(segment), x, y, t_next, dist2_next);
+            if (t_next < 0.0)
+                break;
+            segment = next(segment);
+            if (segment == 0)
+                m_laps++;
+            t = t_next;
+            dist2 = dist2_next;
+            walked++;
+        }
+        while (t < 0.0 and walked < MAX_WALK and (m_closed or segment > 0)) {
+            double t_previous, dist2_previous;
+            project(centerline, previous(segment), x, y, t_previous, dist2_previous);
+            if (t_previous > 1.0)
+                break;
+            if (segment == 0)
+                m_laps--;
+            segment = previous(segment);
+            t = t_previous;
+            dist2 = dist2_previous;
+            walked++;
+        }
+        m_segment = segment;
+        m_lost = (walked == MAX_WALK or dist2 > TRACK_LOST_DISTANCE * TRACK_LOST_DISTANCE);
+    }
+    if (!tracking or m_lost)
+        relocalize(centerline, x, y, t, dist2);
+
+    // The arc length from that of the start of the segment, which is where
+    // the offset is measured from too
+    m_t = std::min(std::max(t, 0.0), 1.0);
+    const PathSpline & spline = centerline.spline;
+    double s_start = spline.arc_length(m_segment);
+    double s_end = (m_segment + 1 < num_points) ? spline.arc_length(m_segment + 1) : spline.length();
+    m_s = s_start + m_t * (s_end - s_start);
+
+    int j = next(m_segment);
+    double seg_x = centerline.pts_x[j] - centerline.pts_x[m_segment];
+    double seg_y = centerline.pts_y[j] - centerline.pts_y[m_segment];
+    double length = std::hypot(seg_x, seg_y);
+    double cross = seg_x * (y - centerline.pts_y[m_segment]) - seg_y * (x - centerline.pts_x[m_segment]);
+    m_d = (length > 0.0) ? cross / length : std::sqrt(dist2);
+    return true;
+}
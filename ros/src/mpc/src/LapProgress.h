@@ -0,0 +1,78 @@
+#pragma once
+
+
+struct Centerline;
+
+
+///* The car's progress along the path, in the Frenet frame of the polyline
+///* of its waypoints: the arc length `s` of the car's projection on the
+///* path and its lateral offset `d` from it (positive to the left), kept
+///* from tick to tick. The car is projected onto the segments between the
+///* waypoints rather than snapped to the closest one, so `s` moves smoothly
+///* between them.
+///*
+///* An update walks from the segment of the previous one along the pose
+///* delta, which is a segment or two for the distance a car covers in a
+///* tick. A search of the whole path (with the spatial index of the
+///* centerline) starts the tracking, and restarts it when the car jumps
+///* (e.g. the particle filter relocalized it).
+///*
+///* On a closed path (see `PathSpline::closed`) `s` wraps around at the
+///* length of the path, and the laps are counted.
+class LapProgress {
+public:
+    LapProgress();
+
+    ///* Forgets the path, the next update searches all of it
+    void reset();
+
+    ///* Projects (x, y) on the path; false (and nothing changes) if it has
+    ///* fewer than two waypoints
+    bool update(const Centerline & centerline, double x, double y);
+
+    ///* The arc length [m] along the path (as in `PathSpline::arc_length`),
+    ///* and the lateral offset [m]
+    double s() const { return m_s; }
+    double d() const { return m_d; }
+
+    ///* The laps completed (negative driving backwards over the start)
+    int laps() const { return m_laps; }
+
+    ///* The segment (from the waypoint of its index to the next one) the car
+    ///* is on, and the waypoint at its nearer end
+    int segment() const { return m_segment; }
+    int closest_waypoint() const;
+
+    ///* The last update lost track of the car and searched the whole path
+    bool lost() const { return m_lost; }
+
+private:
+    ///* The fraction `t` along segment i of the projection of (x, y), and
+    ///* its squared distance to the segment
+    void project(const Centerline & centerline, int i, double x, double y, double & t, double & dist2) const;
+
+    ///* The segment with the projection closest to (x, y), from the
+    ///* waypoint closest to it
+    void relocalize(const Centerline & centerline, double x, double y, double & t, double & dist2);
+
+    int next(int i) const { return (i + 1 == m_num_points) ? 0 : i + 1; }
+    int previous(int i) const { return (i == 0) ? m_num_points - 1 : i - 1; }
+
+    ///* The path tracked, and its shape the last time it was
+    const Centerline * m_centerline;
+    int m_num_points;
+    int m_num_segments;
+    bool m_closed;
+
+    int m_segment;
+    double m_t;
+    double m_s;
+    double m_d;
+    int m_laps;
+    bool m_lost;
+
+    ///* The most segments an update walks; the car is lost beyond them, and
+    ///* farther than this from the path
+    static constexpr int MAX_WALK = 50;
+    static constexpr double TRACK_LOST_DISTANCE = 1.0; // [m]
+};
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cmath>
+
+#include "LapWarmStarts.h"
+
+
+constexpr double LapWarmStarts::BIN_LENGTH;
+
+
+LapWarmStarts::LapWarmStarts(size_t max_bins, size_t max_size)
+        : m_max_size(max_size), m_bins(std::max(max_bins, size_t(1))), m_num_bins(0), m_bin_length(BIN_LENGTH),
+          m_hash(0), m_length(0.0), m_size(0) {
+    m_solutions.resize(m_bins.size() * m_max_size);
+}
+
+
+void LapWarmStarts::clear() {
+    for (Bin & bin : m_bins)
+        bin.used = false;
+    m_size = 0;
+}
+
+
+void LapWarmStarts::start(uint64_t hash, double length) {
+    if (hash == m_hash and length == m_length and m_num_bins > 0)
+        return;
+    clear();
+    m_hash = hash;
+    m_length = length;
+    m_num_bins = std::min(std::max(size_t(std::ceil(length / BIN_LENGTH)), size_t(1)), m_bins.size());
+    m_bin_length = length / m_num_bins;
+}
+
+
+size_t LapWarmStarts::bin(double s) const {
+    s = std::fmod(s, m_length);
+    if (s < 0.0)
+        s += m_length;
+    return std::min(size_t(s / m_bin_length), m_num_bins - 1);
+}
+
+
+void LapWarmStarts::store(double s, uint64_t hash, double length, size_t controller,
+                          const std::vector<double> & solution) {
+    if (!(length > 0.0) or solution.empty() or solution.size() > m_max_size)
+        return;
+    start(hash, length);
+    size_t b = bin(s);
+    Bin & entry = m_bins[b];
+    if (!entry.used)
+        m_size++;
+    entry.used = true;
+    entry.controller = controller;
+    entry.size = solution.size();
+    std::copy(solution.begin(), solution.end(), m_solutions.begin() + b * m_max_size);
+}
+
+
+const double * LapWarmStarts::find(double s, uint64_t hash, double length, size_t controller, size_t size) const {
+    if (m_num_bins == 0 or hash != m_hash or length != m_length)
+        return nullptr;
+    size_t b = bin(s);
+    const Bin & entry = m_bins[b];
+    if (!entry.used or entry.controller != controller or entry.size != size)
+        return nullptr;
+    return &m_solutions[b * m_max_size];
+}
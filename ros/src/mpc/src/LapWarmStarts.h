@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+///* The plans of the previous laps by stretch of the track (see
+///* `Params::lap_warm_start`): the solution of the latest successful solve
+///* of every bin of the lap progress (the arc length along the path, see
+///* LapProgress), in the layout of the controller that solved it. On a
+///* circuit the plans of the same stretch are alike from lap to lap, so
+///* the stored one is a start for a solve that has no last solution to
+///* shift (after a fallback, or a jump of the pose), a few iterations from
+///* the solution rather than a cold start.
+///*
+///* The plans are in the frame of the car they were solved from, which the
+///* car is in again (about) when it's at the same progress. The bins are
+///* allocated up front, for solutions of up to a size, so storing and
+///* finding them doesn't allocate.
+class LapWarmStarts {
+public:
+    ///* `max_bins` bins of solutions of up to `max_size` values
+    LapWarmStarts(size_t max_bins, size_t max_size);
+
+    ///* The `solution` of the controller of index `controller`, at arc length
+    ///* `s` [m] of the path of `hash` and of `length` [m] (another path
+    ///* forgets the plans of the previous one). Ignored when it's too large
+    void store(double s, uint64_t hash, double length, size_t controller, const std::vector<double> & solution);
+
+    ///* The plan of the bin of `s` for the controller, if one of `size`
+    ///* values was stored there for the same path; null otherwise
+    const double * find(double s, uint64_t hash, double length, size_t controller, size_t size) const;
+
+    ///* The bins that have a plan
+    size_t size() const { return m_size; }
+
+    void clear();
+
+    ///* The length [m] of a bin (or a bit longer, on a path too long for
+    ///* the bins)
+    static constexpr double BIN_LENGTH = 0.5;
+
+private:
+    ///* The bins of the path of `hash` and `length`, empty, unless they're
+    ///* those already
+    void start(uint64_t hash, double length);
+
+    size_t bin(double s) const;
+
+    struct Bin {
+        bool used = false;
+        size_t controller = 0;
+        size_t size = 0;
+    };
+
+    size_t m_max_size;
+    std::vector<Bin> m_bins;
+    ///* The solutions, `m_max_size` values per bin
+    std::vector<double> m_solutions;
+    size_t m_num_bins;
+    double m_bin_length;
+    uint64_t m_hash;
+    double m_length;
+    size_t m_size;
+};
@@ -0,0 +1,69 @@
+#include <cmath>
+#include <algorithm>
+
+#include "LatencyHistogram.h"
+
+
+constexpr size_t LatencyHistogram::SUB_BUCKETS;
+constexpr size_t LatencyHistogram::NUM_BUCKETS;
+
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+
+void LatencyHistogram::reset() {
+    std::fill(m_counts, m_counts + NUM_BUCKETS, 0);
+    m_count = 0;
+    m_max = 0.0;
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram & other) {
+    for (size_t b=0; b < NUM_BUCKETS; b++)
+        m_counts[b] += other.m_counts[b];
+    m_count += other.m_count;
+    m_max = std::max(m_max, other.m_max);
+}
+
+
+size_t LatencyHistogram::bucket(uint64_t nanoseconds) {
+    // The top SUB_BUCKET_BITS bits of the value, and how far down they are:
+    // the values with the same magnitude share SUB_BUCKETS buckets
+    int magnitude = 63 - __builtin_clzll(nanoseconds | 1);
+    int shift = std::max(0, magnitude - (SUB_BUCKET_BITS - 1));
+    size_t top = size_t(nanoseconds >> shift);
+    return std::min(shift * SUB_BUCKETS + top, NUM_BUCKETS - 1);
+}
+
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t bucket) {
+    // The inverse of `bucket` (below 2 * SUB_BUCKETS, there's no shift)
+    size_t shift = (bucket < 2 * SUB_BUCKETS) ? 0 : bucket / SUB_BUCKETS - 1;
+    uint64_t top = bucket - shift * SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+
+void LatencyHistogram::record(double seconds) {
+    seconds = std::max(seconds, 0.0);
+    double nanoseconds = std::min(seconds * 1e9, std::ldexp(1.0, MAX_VALUE_BITS));
+    m_counts[bucket(uint64_t(nanoseconds))]++;
+    m_count++;
+    m_max = std::max(m_max, seconds);
+}
+
+
+double LatencyHistogram::percentile(double p) const {
+    if (m_count == 0)
+        return 0.0;
+    uint64_t rank = std::max(uint64_t(std::ceil(p / 100.0 * m_count)), uint64_t(1));
+    uint64_t seen = 0;
+    for (size_t b=0; b < NUM_BUCKETS; b++) {
+        seen += m_counts[b];
+        if (seen >= rank)
+            return std::min(1e-9 * bucket_upper_bound(b), m_max);
+    }
+    return m_max;
+}
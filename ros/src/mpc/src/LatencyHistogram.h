@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+///* Histogram of durations with HDR-style buckets: below 2^SUB_BUCKET_BITS
+///* [ns] every nanosecond has a bucket, and above it every power of two is
+///* split into 2^(SUB_BUCKET_BITS - 1) equal buckets, so a percentile is off
+///* by less than 2^-(SUB_BUCKET_BITS - 1) of its value. The buckets cover up
+///* to MAX_VALUE; recording is allocation-free and O(1), and the histogram is
+///* a flat array, so it can be copied wholesale.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    ///* Records a duration [s]; negative ones count as 0, those over
+    ///* MAX_VALUE into the last bucket
+    void record(double seconds);
+
+    void reset();
+
+    ///* Adds the durations of `other` (e.g. recorded by another thread)
+    void merge(const LatencyHistogram & other);
+
+    uint64_t count() const { return m_count; }
+
+    ///* Largest duration recorded (exactly) [s], 0 when empty
+    double max() const { return m_max; }
+
+    ///* Upper bound of the bucket of the p-th percentile [s] (at most `max`),
+    ///* 0 when empty
+    double percentile(double p) const;
+
+private:
+    static size_t bucket(uint64_t nanoseconds);
+    static uint64_t bucket_upper_bound(size_t bucket);
+
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr int MAX_VALUE_BITS = 36; // 2^36 [ns] ~ 68 [s]
+    static constexpr size_t SUB_BUCKETS = size_t(1) << (SUB_BUCKET_BITS - 1);
+    static constexpr size_t NUM_BUCKETS = SUB_BUCKETS * (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2);
+
+    uint64_t m_counts[NUM_BUCKETS];
+    uint64_t m_count;
+    double m_max;
+};
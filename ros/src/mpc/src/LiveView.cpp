@@ -0,0 +1,163 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "LiveView.h"
+#include "Log.h"
+
+
+constexpr size_t LiveFrame::MAX_COEFFS;
+constexpr size_t LiveFrame::MAX_POINTS;
+constexpr size_t LiveFrame::MAX_STAGES;
+constexpr uint32_t LiveViewHeader::VERSION;
+constexpr size_t LiveViewHeader::FRAME_OFFSET;
+constexpr int LiveViewReader::MAX_RETRIES;
+const char LiveViewHeader::MAGIC[8] = {'M', 'P', 'C', 'L', 'I', 'V', '1', '\0'};
+
+// Copied with memcpy, and read by other processes (the Python ones too)
+static_assert(std::is_trivially_copyable<LiveFrame>::value, "LiveFrame has to be plain data");
+static_assert(sizeof(LiveViewHeader) <= LiveViewHeader::FRAME_OFFSET, "LiveViewHeader is too large");
+static_assert(sizeof(LiveFrame) % 8 == 0, "LiveFrame has to stay aligned");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The sequence has to be lock-free to be shared between processes");
+
+// The size of the segment
+static const size_t SEGMENT_SIZE = LiveViewHeader::FRAME_OFFSET + sizeof(LiveFrame);
+
+
+LiveView::LiveView()
+        : m_header(nullptr), m_frame(nullptr) {}
+
+
+LiveView::~LiveView() {
+    close();
+}
+
+
+void LiveView::close() {
+    if (m_header != nullptr)
+        munmap(m_header, SEGMENT_SIZE);
+    m_header = nullptr;
+    m_frame = nullptr;
+}
+
+
+bool LiveView::open(const std::string & path) {
+    close();
+
+    // Made aside, then renamed over any previous one
+    std::string tmp_path = path + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        MPC_ERROR("Could not create the live view %s: %s", tmp_path.c_str(), std::strerror(errno));
+        return false;
+    }
+    int error = posix_fallocate(fd, 0, off_t(SEGMENT_SIZE));
+    if (error != 0) {
+        MPC_ERROR("Could not allocate the live view %s: %s", tmp_path.c_str(), std::strerror(error));
+        ::close(fd);
+        return false;
+    }
+    void * data = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        MPC_ERROR("Could not map the live view %s: %s", tmp_path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    m_header = static_cast<LiveViewHeader *>(data);
+    m_frame = reinterpret_cast<LiveFrame *>(static_cast<char *>(data) + LiveViewHeader::FRAME_OFFSET);
+    std::memcpy(m_header->magic, LiveViewHeader::MAGIC, sizeof(m_header->magic));
+    m_header->version = LiveViewHeader::VERSION;
+    m_header->frame_size = uint32_t(sizeof(LiveFrame));
+    m_header->sequence.store(0, std::memory_order_release);
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        MPC_ERROR("Could not move the live view to %s: %s", path.c_str(), std::strerror(errno));
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void LiveView::write(const LiveFrame & frame) {
+    // Odd while the frame is being written, which the readers see before
+    // any of it
+    uint64_t sequence = m_header->sequence.load(std::memory_order_relaxed);
+    m_header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(m_frame, &frame, sizeof(LiveFrame));
+    m_header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+LiveViewReader::LiveViewReader()
+        : m_header(nullptr), m_frame(nullptr) {}
+
+
+LiveViewReader::~LiveViewReader() {
+    close();
+}
+
+
+void LiveViewReader::close() {
+    if (m_header != nullptr)
+        munmap(const_cast<LiveViewHeader *>(m_header), SEGMENT_SIZE);
+    m_header = nullptr;
+    m_frame = nullptr;
+}
+
+
+bool LiveViewReader::open(const std::string & path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        MPC_ERROR("Could not open the live view %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 or size_t(status.st_size) < SEGMENT_SIZE) {
+        MPC_ERROR("%s is not a live view", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    void * data = mmap(nullptr, SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        MPC_ERROR("Could not map the live view %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    const LiveViewHeader * header = static_cast<const LiveViewHeader *>(data);
+    if (std::memcmp(header->magic, LiveViewHeader::MAGIC, sizeof(header->magic)) != 0
+            or header->version != LiveViewHeader::VERSION or header->frame_size != sizeof(LiveFrame)) {
+        MPC_ERROR("%s is not a live view of this version", path.c_str());
+        munmap(data, SEGMENT_SIZE);
+        return false;
+    }
+    m_header = header;
+    m_frame = reinterpret_cast<const LiveFrame *>(static_cast<const char *>(data) + LiveViewHeader::FRAME_OFFSET);
+    return true;
+}
+
+
+uint64_t LiveViewReader::read(LiveFrame & frame) const {
+    for (int retry=0; retry < MAX_RETRIES; retry++) {
+        uint64_t before = m_header->sequence.load(std::memory_order_acquire);
+        if (before == 0)
+            return 0;
+        if (before & 1)
+            continue;
+        std::memcpy(&frame, m_frame, sizeof(LiveFrame));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_header->sequence.load(std::memory_order_relaxed) == before)
+            return before / 2;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Telemetry.h"
+
+
+///* What the live view shows of the latest tick, in a fixed binary layout
+///* (native endianness): the pose, the problem, the plan and the timings,
+///* as the debug markers draw them
+struct LiveFrame {
+    ///* Number of the tick since the start of the node, and its ros::Time [s]
+    uint64_t tick;
+    double stamp;
+
+    ///* The pose and the speed [m/s] of the inputs, and the pose projected
+    ///* by the latency, which the problem is solved from (and the plan and
+    ///* the window are in the frame of)
+    double pos_x;
+    double pos_y;
+    double psi;
+    double speed;
+    double pos_x_lat;
+    double pos_y_lat;
+    double psi_lat;
+
+    ///* The problem: the cte, the epsi, and the fit (the first `num_coeffs`,
+    ///* lowest order first), in the car's frame
+    double cte;
+    double epsi;
+    double coeffs[8];
+
+    ///* The commands sent to Dzik
+    double steer_cmd;
+    double rpm;
+
+    float cost;
+    ///* The latency the pose was projected by [s]
+    float latency;
+    ///* How long each stage took [s] (see TelemetryRecord::Stage)
+    float stage_time[TelemetryRecord::NUM_STAGES];
+
+    ///* TelemetryRecord::Event bits
+    uint32_t events;
+    uint8_t num_coeffs;
+    ///* Where the commands of a failed solve are from (see TelemetryRecord)
+    uint8_t fallback;
+    ///* The sizes of `pts_x` and `pts_y`, and of the plan
+    uint16_t num_points;
+    uint16_t num_stages;
+    ///* The horizon of the controller that solved, and the solver's
+    ///* iterations (-1 if not known)
+    uint16_t steps_ahead;
+    int16_t iterations;
+    uint16_t reserved;
+
+    ///* The waypoints of the fit, in the car's frame
+    float pts_x[64];
+    float pts_y[64];
+
+    ///* The plan (see Plan), in the map's frame: the stages [m], their time
+    ///* [s] from `stamp`, heading [rad], speed [m/s] and steering angle
+    ///* [rad]. None when the tick wasn't solved
+    float plan_x[64];
+    float plan_y[64];
+    float plan_time[64];
+    float plan_heading[64];
+    float plan_speed[64];
+    float plan_steer[64];
+
+    static constexpr size_t MAX_COEFFS = sizeof(coeffs) / sizeof(coeffs[0]);
+    static constexpr size_t MAX_POINTS = sizeof(pts_x) / sizeof(pts_x[0]);
+    static constexpr size_t MAX_STAGES = sizeof(plan_x) / sizeof(plan_x[0]);
+};
+
+
+///* The start of a live view segment, before its one LiveFrame (at
+///* FRAME_OFFSET). `sequence` is the seqlock of the frame: odd while it's
+///* being written, and 2 more once per frame
+struct LiveViewHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t frame_size;
+    std::atomic<uint64_t> sequence;
+
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t FRAME_OFFSET = 64;
+    static const char MAGIC[8];
+};
+
+
+///* The latest tick of the solver loop in shared memory (see
+///* `Params::live_view`), for the visualization tools on the same machine:
+///* they poll it (see LiveViewReader) instead of subscribing to the debug
+///* markers, with no serialization, and nothing they do holds the solver
+///* loop up. A tick costs a copy of its frame into the mapping.
+///*
+///* One writer (the solver loop). The file (usually in /dev/shm) is created
+///* whole before it's renamed into place, so a reader maps either no view or
+///* a complete one.
+class LiveView {
+public:
+    LiveView();
+    ~LiveView();
+
+    LiveView(const LiveView &) = delete;
+    LiveView & operator=(const LiveView &) = delete;
+
+    ///* Creates the segment at `path`; false (and logs why) if it can't, and
+    ///* the view stays off
+    bool open(const std::string & path);
+
+    bool is_open() const { return m_header != nullptr; }
+
+    ///* Replaces the frame of the segment with `frame`
+    void write(const LiveFrame & frame);
+
+private:
+    void close();
+
+    LiveViewHeader * m_header;
+    LiveFrame * m_frame;
+};
+
+
+///* The reader's side of a LiveView, never blocking the writer: a read
+///* copies the frame out, again if it was written meanwhile
+class LiveViewReader {
+public:
+    LiveViewReader();
+    ~LiveViewReader();
+
+    LiveViewReader(const LiveViewReader &) = delete;
+    LiveViewReader & operator=(const LiveViewReader &) = delete;
+
+    ///* Maps the segment at `path`; false (and logs why) if it isn't one
+    bool open(const std::string & path);
+
+    bool is_open() const { return m_header != nullptr; }
+
+    ///* The latest frame into `frame`, and its number (the count of the
+    ///* frames written so far): 0 when there's none yet, or when it kept
+    ///* being rewritten while it was copied (`frame` is of no use then)
+    uint64_t read(LiveFrame & frame) const;
+
+private:
+    void close();
+
+    const LiveViewHeader * m_header;
+    const LiveFrame * m_frame;
+
+    static constexpr int MAX_RETRIES = 16;
+};
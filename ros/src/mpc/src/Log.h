@@ -0,0 +1,23 @@
+#pragma once
+
+///* Logging of the sources that are also built without ROS (with
+///* MPC_NO_ROS, e.g. into mpc_benchmark): the solver and the waypoints
+///* loader. With ROS it goes to rosconsole, without it to stderr.
+
+#ifdef MPC_NO_ROS
+
+#include <cstdio>
+
+#define MPC_INFO(...) (std::fprintf(stderr, "[ INFO] " __VA_ARGS__), std::fputc('\n', stderr))
+#define MPC_WARN(...) (std::fprintf(stderr, "[ WARN] " __VA_ARGS__), std::fputc('\n', stderr))
+#define MPC_ERROR(...) (std::fprintf(stderr, "[ERROR] " __VA_ARGS__), std::fputc('\n', stderr))
+
+#else
+
+#include <ros/console.h>
+
+#define MPC_INFO(...) ROS_INFO(__VA_ARGS__)
+#define MPC_WARN(...) ROS_WARN(__VA_ARGS__)
+#define MPC_ERROR(...) ROS_ERROR(__VA_ARGS__)
+
+#endif
@@ -1,14 +1,55 @@
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <string>
 #include "MPC.h"
+#include "AllocationCounter.h"
+#include "Polynomial.h"
+#include "FG_eval.h"
+#include "FG_eval_fixed.h"
+#include "FG_eval_condensed.h"
+#include "MPC_NLP.h"
+#include "IpoptJournal.h"
+#include "SolverStructure.h"
+#include "SolverBackend.h"
+#include "ExplicitTable.h"
+#include "WarmStart.h"
+#include "Trace.h"
 #include <cppad/cppad.hpp>
 #include <cppad/ipopt/solve.hpp>
+#include <coin/IpIpoptApplication.hpp>
 
-#include <ros/console.h>
+#include "Log.h"
 
 
 using CppAD::AD;
 
 
+constexpr size_t MPC::NUM_TOLERANCE_LEVELS;
+constexpr double MPC::TOLERANCE_SAFETY;
+constexpr double MPC::LEVEL_TIME_ALPHA;
+constexpr double MPC::LEVEL_TIME_DECAY;
+constexpr size_t MPC::MAX_TIME_LIMIT_OPTION;
+constexpr double MPC::NO_TIME_LIMIT;
+
+// Ipopt's defaults: full convergence
+static const double IPOPT_TOL = 1e-8;
+static const double IPOPT_ACCEPTABLE_TOL = 1e-6;
+static const int IPOPT_ACCEPTABLE_ITER = 15;
+// ... and the initial barrier parameter of a cold start
+static const double IPOPT_MU_INIT = 0.1;
+
+// With `Params::nlp_scaling`: the range of the scaling factors, the typical
+// cte [m] (without a corridor), and the smallest typical distance [m] and
+// cost
+static const double MIN_SCALING = 1e-2;
+static const double MAX_SCALING = 1e2;
+static const double TYPICAL_CTE = 1.0;
+static const double MIN_TYPICAL_DISTANCE = 1.0;
+static const double MIN_TYPICAL_COST = 1.0;
+
+
 // Fit a polynomial.
 // Adapted from
 // https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
@@ -33,22 +74,97 @@ Eigen::VectorXd polyfit(const Eigen::VectorXd & xvals, const Eigen::VectorXd & y
 }
 
 
-// Evaluate a polynomial.
-double polyeval(const Eigen::VectorXd coeffs, double x) {
-    double result = 0.0;
-    for (int i = 0; i < coeffs.size(); i++) {
-        result += coeffs[i] * pow(x, i);
+// Fit a polynomial to n points, on the fixed-size kernels for the degrees
+// the controller normally uses.
+void polyfit(const double * xvals, const double * yvals, size_t n, int order, Eigen::VectorXd & coeffs) {
+    assert(order >= 1 && size_t(order) <= n - 1);
+    switch (order) {
+        case 1: coeffs = polyfit_fixed<1>(xvals, yvals, n); break;
+        case 2: coeffs = polyfit_fixed<2>(xvals, yvals, n); break;
+        case 3: coeffs = polyfit_fixed<3>(xvals, yvals, n); break;
+        default:
+            coeffs = polyfit(Eigen::Map<const Eigen::VectorXd>(xvals, n),
+                             Eigen::Map<const Eigen::VectorXd>(yvals, n), order);
     }
-    return result;
 }
 
 
-double polyeval_diff(const Eigen::VectorXd coeffs, double x) {
-    double result = 0.0;
-    for (int i = 1; i < coeffs.size(); i++) {
-        result += i * coeffs[i] * pow(x, i-1);
+void polyfit(const float * xvals, const float * yvals, size_t n, int order, Eigen::VectorXd & coeffs) {
+    assert(order >= 1 && size_t(order) <= n - 1);
+    switch (order) {
+        case 1: coeffs = polyfit_fixed<1>(xvals, yvals, n); break;
+        case 2: coeffs = polyfit_fixed<2>(xvals, yvals, n); break;
+        case 3: coeffs = polyfit_fixed<3>(xvals, yvals, n); break;
+        default:
+            coeffs = polyfit(Eigen::Map<const Eigen::VectorXf>(xvals, n).cast<double>(),
+                             Eigen::Map<const Eigen::VectorXf>(yvals, n).cast<double>(), order);
+    }
+}
+
+
+Eigen::VectorXd polyfit(const double * xvals, const double * yvals, size_t n, int order) {
+    Eigen::VectorXd coeffs;
+    polyfit(xvals, yvals, n, order, coeffs);
+    return coeffs;
+}
+
+
+// Fit `count` interleaved problems, on the batched kernels for the degrees
+// the controller normally uses, and problem by problem otherwise.
+template <class Scalar>
+static void polyfit_batch_any(const Scalar * xvals, const Scalar * yvals, size_t n, size_t count, int order,
+                              double * coeffs) {
+    assert(order >= 1 && size_t(order) <= n - 1);
+    switch (order) {
+        case 1: polyfit_fixed_batch<1>(xvals, yvals, n, count, coeffs); return;
+        case 2: polyfit_fixed_batch<2>(xvals, yvals, n, count, coeffs); return;
+        case 3: polyfit_fixed_batch<3>(xvals, yvals, n, count, coeffs); return;
+    }
+    Eigen::VectorXd x(n), y(n), problem_coeffs;
+    for (size_t p=0; p < count; p++) {
+        for (size_t i=0; i < n; i++) {
+            x[i] = double(xvals[i * count + p]);
+            y[i] = double(yvals[i * count + p]);
+        }
+        problem_coeffs = polyfit(x, y, order);
+        Eigen::Map<Eigen::VectorXd>(coeffs + p * (order + 1), order + 1) = problem_coeffs;
+    }
+}
+
+
+void polyfit_batch(const double * xvals, const double * yvals, size_t n, size_t count, int order, double * coeffs) {
+    polyfit_batch_any(xvals, yvals, n, count, order, coeffs);
+}
+
+
+void polyfit_batch(const float * xvals, const float * yvals, size_t n, size_t count, int order, double * coeffs) {
+    polyfit_batch_any(xvals, yvals, n, count, order, coeffs);
+}
+
+
+// Evaluate a polynomial.
+double polyeval(const Eigen::VectorXd & coeffs, double x) {
+    double value, derivative;
+    polyeval_with_diff(coeffs, x, value, derivative);
+    return value;
+}
+
+
+double polyeval_diff(const Eigen::VectorXd & coeffs, double x) {
+    double value, derivative;
+    polyeval_with_diff(coeffs, x, value, derivative);
+    return derivative;
+}
+
+
+// Horner's scheme, carrying the derivative along.
+void polyeval_with_diff(const Eigen::VectorXd & coeffs, double x, double & value, double & derivative) {
+    value = 0.0;
+    derivative = 0.0;
+    for (int i = coeffs.size() - 1; i >= 0; i--) {
+        derivative = derivative * x + value;
+        value = value * x + coeffs[i];
     }
-    return result;
 }
 
 
@@ -68,116 +184,221 @@ double Lf() { return 0.325; }
 double delta_constraint() { return 25; }
 
 
-class FG_eval {
-public:
-    // Fitted polynomial coefficients
-    Eigen::VectorXd m_coeffs;
+// Largest violation of the bounds of the constraints by `g`
+template <class Vector>
+static double constraint_violation(const Vector & g, const Vector & lower, const Vector & upper) {
+    double violation = 0.0;
+    for (size_t i=0; i < g.size(); i++)
+        violation = std::max(violation, std::max(lower[i] - g[i], g[i] - upper[i]));
+    return violation;
+}
+
+
+// The block of every step (see Params::input_blocks) into `block`, empty
+// without move blocking; returns the number of blocks
+static size_t input_blocks(const Params & params, std::vector<size_t> & block) {
+    size_t n_steps = params.steps_ahead - 1;
+    block.clear();
+    if (params.input_blocks.empty())
+        return n_steps;
+
+    size_t t = 0;
+    for (size_t b=0; t < n_steps; b++) {
+        // The last block takes the rest of the steps
+        bool last = (b + 1 == params.input_blocks.size());
+        size_t length = last ? n_steps - t : size_t(std::max(params.input_blocks[b], 1));
+        for (size_t i=0; i < length and t < n_steps; i++, t++)
+            block.push_back(b);
+    }
+    return block.back() + 1;
+}
+
+
+// The configurations we deploy, each with its own specialisation of FG_eval
+#define MPC_FIXED_HORIZONS(X) \
+    X(10, 1) X(10, 2) X(10, 3) \
+    X(15, 1) X(15, 2) X(15, 3) \
+    X(20, 1) X(20, 2) X(20, 3)
+
 
-    // Reference speed
-    double m_ref_v;
+template <size_t N, size_t Degree, class Dvector>
+static void solve_fixed(
+        const std::string & options, const Dvector & vars,
+        const Dvector & vars_lowerbound, const Dvector & vars_upperbound,
+        const Dvector & constraints_lowerbound, const Dvector & constraints_upperbound,
+        const Params & params, const Eigen::VectorXd & coeffs, double ref_v,
+        CppAD::ipopt::solve_result<Dvector> & solution) {
+
+    FG_eval_fixed<N, Degree> fg_eval(coeffs, params, ref_v);
+    CppAD::ipopt::solve<Dvector, FG_eval_fixed<N, Degree> >(
+            options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+            constraints_upperbound, fg_eval, solution);
+}
 
-    Params m_params;
-    Indexes m_indexes;
 
-    FG_eval(Eigen::VectorXd coeffs, const Params & params, const Indexes & indexes, const double ref_v)
-        : m_coeffs(coeffs), m_params(params), m_indexes(indexes) {
+// Runtime dispatch to the specialisations above; false if there's none
+// for the configuration in `params`
+template <class Dvector>
+static bool dispatch_fixed(
+        const std::string & options, const Dvector & vars,
+        const Dvector & vars_lowerbound, const Dvector & vars_upperbound,
+        const Dvector & constraints_lowerbound, const Dvector & constraints_upperbound,
+        const Params & params, const Eigen::VectorXd & coeffs, double ref_v,
+        CppAD::ipopt::solve_result<Dvector> & solution) {
 
-        m_ref_v = ref_v;
+#define MPC_SOLVE_FIXED(N, DEGREE) \
+    if (params.steps_ahead == N and params.poly_degree == DEGREE) { \
+        solve_fixed<N, DEGREE>(options, vars, vars_lowerbound, vars_upperbound, \
+                constraints_lowerbound, constraints_upperbound, params, coeffs, ref_v, solution); \
+        return true; \
     }
+    MPC_FIXED_HORIZONS(MPC_SOLVE_FIXED)
+#undef MPC_SOLVE_FIXED
 
-    typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+    return false;
+}
 
-    void operator()(ADvector &fg, const ADvector &vars) {
-        // The cost is stored in the first element of fg.
-        // Any additions to the cost should be added to fg[0].
-        fg[0] = 0;
 
-        // The part of the cost based on the reference state.
-        for (size_t t=0; t<m_params.steps_ahead; t++) {
-            fg[0] += m_params.cte_coeff * CppAD::pow(vars[m_indexes.cte_start + t], 2);
-            fg[0] += m_params.epsi_coeff * CppAD::pow(vars[m_indexes.epsi_start + t], 2);
-        }
+// CppAD::ipopt::solve through FG_eval of the vehicle model `Model`, with
+// the obstacles and the terminal cost of the solve
+template <class Model, class Dvector>
+static void solve_model(
+        const std::string & options, const Dvector & vars,
+        const Dvector & vars_lowerbound, const Dvector & vars_upperbound,
+        const Dvector & constraints_lowerbound, const Dvector & constraints_upperbound,
+        const Params & params, const Indexes & indexes, const Eigen::VectorXd & coeffs, double ref_v,
+        const std::vector<double> & obstacle_positions, const std::vector<double> & terminal_cost,
+        CppAD::ipopt::solve_result<Dvector> & solution) {
+    FG_eval_base<double, Model> fg_eval(coeffs, params, indexes, ref_v);
+    fg_eval.set_obstacles(obstacle_positions);
+    fg_eval.set_terminal_cost(terminal_cost);
 
-        // Minimize the use of actuators.
-        for (size_t t=0; t<m_params.steps_ahead-1; t++) {
-            fg[0] += m_params.speed_coeff * CppAD::pow(vars[m_indexes.v_start + t] - m_ref_v, 2);
-            fg[0] += m_params.steer_coeff * CppAD::pow(vars[m_indexes.delta_start + t], 2);
-        }
+    CppAD::ipopt::solve<Dvector, FG_eval_base<double, Model> >(
+            options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+            constraints_upperbound, fg_eval, solution);
+}
 
-        // Minimize the value gap between sequential actuations.
-        for (size_t t = 0; t < m_params.steps_ahead-2; t++) {
-            fg[0] += m_params.consec_steer_coeff * CppAD::pow(vars[m_indexes.delta_start + t + 1] - vars[m_indexes.delta_start + t], 2);
-            fg[0] += m_params.consec_speed_coeff * CppAD::pow(vars[m_indexes.v_start + t + 1] - vars[m_indexes.v_start + t], 2);
-        }
+
+bool MPC::has_fixed_horizon(size_t steps_ahead, int poly_degree) {
+#define MPC_HAS_FIXED(N, DEGREE) \
+    if (steps_ahead == N and poly_degree == DEGREE) \
+        return true;
+    MPC_FIXED_HORIZONS(MPC_HAS_FIXED)
+#undef MPC_HAS_FIXED
+
+    return false;
+}
 
 
-        // Initial constraints
-        //
-        // We add 1 to each of the starting indices due to cost being located at
-        // index 0 of `fg`.
-        // This bumps up the position of all the other values.
-        fg[1 + m_indexes.x_start] = vars[m_indexes.x_start];
-        fg[1 + m_indexes.y_start] = vars[m_indexes.y_start];
-        fg[1 + m_indexes.psi_start] = vars[m_indexes.psi_start];
-        fg[1 + m_indexes.cte_start] = vars[m_indexes.cte_start];
-        fg[1 + m_indexes.epsi_start] = vars[m_indexes.epsi_start];
-
-        // The rest of the constraints
-        for (size_t t = 1; t < m_params.steps_ahead; t++) {
-            // The state at time t+1 .
-            AD<double> x1 = vars[m_indexes.x_start + t];
-            AD<double> y1 = vars[m_indexes.y_start + t];
-            AD<double> psi1 = vars[m_indexes.psi_start + t];
-            // No longer needed:
-            // AD<double> v1 = vars[m_indexes.v_start + t];
-            AD<double> cte1 = vars[m_indexes.cte_start + t];
-            AD<double> epsi1 = vars[m_indexes.epsi_start + t];
-
-            // The state at time t.
-            AD<double> x0 = vars[m_indexes.x_start + t - 1];
-            AD<double> y0 = vars[m_indexes.y_start + t - 1];
-            AD<double> psi0 = vars[m_indexes.psi_start + t - 1];
-            AD<double> v0 = vars[m_indexes.v_start + t - 1];
-            AD<double> cte0 = vars[m_indexes.cte_start + t - 1];
-            AD<double> epsi0 = vars[m_indexes.epsi_start + t - 1];
-
-            // Only consider the actuation at time t.
-            AD<double> delta0 = vars[m_indexes.delta_start + t - 1];
-
-            AD<double> f0 = 0;
-            for (int i=0; i<m_coeffs.size(); i++)
-                f0 += m_coeffs[i] * CppAD::pow(x0, i);
-
-            AD<double> fdiff0 = 0;
-            for (int i=1; i<m_coeffs.size(); i++)
-                fdiff0 += i * m_coeffs[i] * CppAD::pow(x0, i-1);
-
-            AD<double> psides0 = CppAD::atan(fdiff0);
-
-            // Here's `x` to get you started.
-            // The idea here is to constraint this value to be 0.
-            //
-            // Recall the equations for the model:
-            // x_[t+1] = x[t] + v[t] * cos(psi[t]) * dt
-            // y_[t+1] = y[t] + v[t] * sin(psi[t]) * dt
-            // psi_[t+1] = psi[t] + v[t] / Lf * delta[t] * dt
-            // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
-            // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
-            fg[1 + m_indexes.x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * m_params.dt);
-            fg[1 + m_indexes.y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * m_params.dt);
-            // "... - (psi0 ..." in contrast to the quizzes
-            fg[1 + m_indexes.psi_start + t] = psi1 - (psi0 - v0 * delta0 / Lf() * m_params.dt);
-            fg[1 + m_indexes.cte_start + t] = cte1 - (f0 - y0 + (v0 * CppAD::sin(epsi0) * m_params.dt));
-            // "... - v0 ..." in contrast to the quizzes
-            fg[1 + m_indexes.epsi_start + t] = epsi1 - (psi0 - psides0 - v0 * delta0 / Lf() * m_params.dt);
+// The bounds of the extra states of `Model` and of the actuators
+template <class Model, class Dvector>
+static void model_bounds(const Indexes & indexes, Dvector & lower, Dvector & upper) {
+    for (size_t e=0; e < indexes.num_extra; e++) {
+        for (size_t t=0; t < indexes.steps_ahead; t++) {
+            lower[indexes.extra(e, t)] = Model::extra_lower(e);
+            upper[indexes.extra(e, t)] = Model::extra_upper(e);
         }
     }
+
+    // BEGIN: CONSTRAINTS ON THE ACTUATORS
+    for (size_t i=indexes.delta_start; i<indexes.v_start; i++) {
+        lower[i] = -Model::max_steer();
+        upper[i] = Model::max_steer();
+    }
+    for (size_t i=indexes.v_start; i<indexes.v_start + (indexes.v_start - indexes.delta_start); i++) {
+        lower[i] = 0.0;
+        upper[i] = Model::max_speed();
+    }
+    // END: CONSTRAINTS ON THE ACTUATORS
+}
+
+
+// The scaling factors of the variables and the rows of the NLP (see
+// `Params::nlp_scaling`): the inverse of the typical magnitude of every
+// variable, from its bounds when they're finite, and otherwise from a
+// trajectory at `ref_v` over the horizon that turns at full lock; the rows
+// of the model take that of their state, the soft rows that of their bound,
+// and those of the obstacles the square of the reach of the horizon
+template <class Dvector>
+static void nlp_scaling(const Params & params, const Indexes & indexes, const Dvector & vars_lowerbound,
+                        const Dvector & vars_upperbound, const Dvector & constraints_upperbound,
+                        Dvector & x_scaling, Dvector & g_scaling) {
+    size_t n_vars = vars_lowerbound.size();
+    size_t n_constraints = constraints_upperbound.size();
+    size_t num_steps = params.steps_ahead;
+    double horizon = 0.0;
+    for (size_t t=0; t + 1 < num_steps; t++)
+        horizon += params.step_dt(t);
+    double reach = std::max(params.ref_v * horizon, MIN_TYPICAL_DISTANCE);
+    double turn = std::min(M_PI, reach * tan(KinematicBicycle::max_steer()) / Lf());
+
+    auto scaling = [](double magnitude) {
+        return std::min(std::max(1.0 / magnitude, MIN_SCALING), MAX_SCALING);
+    };
+    auto in_block = [num_steps](size_t i, size_t start) {
+        return i >= start and i < start + num_steps;
+    };
+    x_scaling.resize(n_vars);
+    for (size_t i=0; i < n_vars; i++) {
+        double lower = vars_lowerbound[i], upper = vars_upperbound[i];
+        double magnitude = 1.0;
+        if (lower > -1.0e19 and upper < 1.0e19 and upper > lower)
+            magnitude = std::max(std::abs(lower), std::abs(upper));
+        else if (in_block(i, indexes.x_start) or in_block(i, indexes.y_start))
+            magnitude = reach;
+        else if (in_block(i, indexes.psi_start) or in_block(i, indexes.epsi_start))
+            magnitude = turn;
+        else if (in_block(i, indexes.cte_start))
+            magnitude = TYPICAL_CTE;
+        else if (i >= indexes.slack_start and i < indexes.slack_start + indexes.num_slacks)
+            magnitude = constraints_upperbound[indexes.soft_start + 2 * (i - indexes.slack_start)];
+        x_scaling[i] = scaling(magnitude);
+    }
+
+    g_scaling.resize(n_constraints);
+    for (size_t i=0; i < indexes.soft_start; i++)
+        g_scaling[i] = x_scaling[i];
+    for (size_t k=0; k < indexes.num_slacks; k++) {
+        g_scaling[indexes.soft_start + 2*k] = x_scaling[indexes.slack_start + k];
+        g_scaling[indexes.soft_start + 2*k + 1] = x_scaling[indexes.slack_start + k];
+    }
+    for (size_t i=indexes.obstacle_start; i < n_constraints; i++)
+        g_scaling[i] = scaling(reach * reach);
+}
+
+
+struct MPC::SolveBuffers {
+    typedef CPPAD_TESTVECTOR(double) Dvector;
+
+    Dvector vars;
+    Dvector vars_lowerbound;
+    Dvector vars_upperbound;
+    Dvector constraints_lowerbound;
+    Dvector constraints_upperbound;
+    Dvector solution_x;
+
+    ///* Only used with `dual_warm_start`: the multipliers the solve starts
+    ///* from
+    Dvector z_L;
+    Dvector z_U;
+    Dvector lambda;
+
+    ///* Only used with `condensed`: the actuations and their bounds, and the
+    ///* (empty) bounds of the constraints
+    Dvector condensed_vars;
+    Dvector condensed_lowerbound;
+    Dvector condensed_upperbound;
+    Dvector condensed_constraints;
 };
 
+
 //
 // MPC class definition implementation.
 //
-MPC::MPC(const Params & params) : m_params(params) {
+MPC::MPC(const Params & params) : m_params(params), m_saves_solution(true), m_terminal_target() {
+    // The flags of the backend, which the checks below go by
+    apply_backend(m_params);
+
     // Non-actuators
     m_indexes.x_start = 0;
     m_indexes.y_start = m_indexes.x_start + params.steps_ahead;
@@ -185,19 +406,793 @@ MPC::MPC(const Params & params) : m_params(params) {
     m_indexes.cte_start = m_indexes.psi_start+ params.steps_ahead;
     m_indexes.epsi_start = m_indexes.cte_start + params.steps_ahead;
 
-    // Actuators
-    m_indexes.delta_start = m_indexes.epsi_start + params.steps_ahead;
-    m_indexes.v_start = m_indexes.delta_start + params.steps_ahead - 1;
+    // The states of the vehicle model beyond the pose
+    if (params.vehicle_model != KinematicBicycle::name() and params.vehicle_model != DynamicBicycle::name()) {
+        MPC_WARN("Unknown vehicle_model \"%s\", using the kinematic one", params.vehicle_model.c_str());
+        m_params.vehicle_model = KinematicBicycle::name();
+    }
+    m_dynamic_model = (m_params.vehicle_model == DynamicBicycle::name());
+    m_indexes.extra_start = m_indexes.epsi_start + params.steps_ahead;
+    m_indexes.num_extra = m_dynamic_model ? size_t(DynamicBicycle::EXTRA_STATES)
+                                          : size_t(KinematicBicycle::EXTRA_STATES);
+    m_indexes.steps_ahead = params.steps_ahead;
+
+    // Actuators, one pair per step or per block
+    size_t n_inputs = input_blocks(params, m_indexes.block);
+    m_indexes.delta_start = m_indexes.extra_start + m_indexes.num_extra * params.steps_ahead;
+    m_indexes.v_start = m_indexes.delta_start + n_inputs;
+
+    m_n_vars = params.steps_ahead * (5 + m_indexes.num_extra) + n_inputs * 2;
+    m_n_constraints = params.steps_ahead * (5 + m_indexes.num_extra);
+
+    // The terminal conditions and the rates of the steering, a slack and
+    // two rows each (see Indexes::soft_start)
+    m_indexes.slack_start = m_n_vars;
+    m_indexes.soft_start = m_n_constraints;
+    m_indexes.num_slacks = (params.terminal_cte > 0.0) + (params.terminal_epsi > 0.0)
+            + ((params.max_steer_rate > 0.0) ? n_inputs - 1 : 0);
+    m_n_vars += m_indexes.num_slacks;
+    m_n_constraints += 2 * m_indexes.num_slacks;
+
+    // The obstacles, a row per slot and step (see Indexes::obstacle_start)
+    m_indexes.obstacle_start = m_n_constraints;
+    m_indexes.num_obstacles = size_t(std::max(params.max_obstacles, 0));
+    m_n_constraints += m_indexes.num_obstacles * (params.steps_ahead - 1);
+
+    // One step per stage of the time grid
+    if (!m_params.dt_steps.empty() and m_params.dt_steps.size() != params.steps_ahead - 1) {
+        MPC_WARN("%lu dt_steps for %lu steps, repeating or dropping the last ones",
+                 m_params.dt_steps.size(), params.steps_ahead - 1);
+        m_params.dt_steps.resize(params.steps_ahead - 1, m_params.dt_steps.back());
+    }
+
+    // The backends that have one actuation per step and a uniform time grid
+    // built in
+    if (!m_indexes.block.empty() or !m_params.dt_steps.empty()) {
+        if (m_params.fixed_horizon or m_params.analytic_derivatives or m_params.codegen)
+            MPC_WARN("input_blocks and dt_steps replace fixed_horizon, analytic_derivatives and codegen, "
+                     "ignoring them");
+        if (m_params.riccati_solver or m_params.rti)
+            MPC_WARN("The Riccati solver has neither input_blocks nor dt_steps, ignoring them");
+        m_params.fixed_horizon = false;
+        m_params.analytic_derivatives = false;
+        m_params.codegen = false;
+    }
+
+    // The backends that have the kinematic model built in
+    if (m_dynamic_model) {
+        if (m_params.fixed_horizon or m_params.analytic_derivatives or m_params.codegen or m_params.condensed
+                or m_params.riccati_solver or m_params.rti or !m_params.explicit_table.empty())
+            MPC_WARN("The dynamic vehicle_model replaces fixed_horizon, analytic_derivatives, codegen, condensed, "
+                     "the Riccati solver and the explicit table, ignoring them");
+        m_params.fixed_horizon = false;
+        m_params.analytic_derivatives = false;
+        m_params.codegen = false;
+        m_params.condensed = false;
+        m_params.riccati_solver = false;
+        m_params.rti = false;
+        m_params.explicit_table.clear();
+    }
+
+    // ... and those that only have the bounds of the actuators
+    if (m_indexes.num_slacks > 0 or m_indexes.num_obstacles > 0) {
+        if (m_params.fixed_horizon or m_params.analytic_derivatives or m_params.codegen or m_params.condensed
+                or m_params.riccati_solver or m_params.rti or !m_params.explicit_table.empty())
+            MPC_WARN("terminal_cte, terminal_epsi, max_steer_rate and max_obstacles replace fixed_horizon, "
+                     "analytic_derivatives, codegen, condensed, the Riccati solver and the explicit table, "
+                     "ignoring them");
+        m_params.fixed_horizon = false;
+        m_params.analytic_derivatives = false;
+        m_params.codegen = false;
+        m_params.condensed = false;
+        m_params.riccati_solver = false;
+        m_params.rti = false;
+        m_params.explicit_table.clear();
+    }
+    // ... and those that have the polynomial reference built in
+    if (m_params.contouring_reference) {
+        if (m_params.fixed_horizon or m_params.analytic_derivatives or m_params.codegen or m_params.condensed
+                or m_params.riccati_solver or m_params.rti or !m_params.explicit_table.empty())
+            MPC_WARN("contouring_reference replaces fixed_horizon, analytic_derivatives, codegen, condensed, "
+                     "the Riccati solver and the explicit table, ignoring them");
+        m_params.fixed_horizon = false;
+        m_params.analytic_derivatives = false;
+        m_params.codegen = false;
+        m_params.condensed = false;
+        m_params.riccati_solver = false;
+        m_params.rti = false;
+        m_params.explicit_table.clear();
+    }
+    // ... and those without the terminal cost
+    if (m_params.terminal_cost) {
+        if (m_params.fixed_horizon or m_params.analytic_derivatives or m_params.codegen or m_params.condensed
+                or m_params.riccati_solver or m_params.rti or !m_params.explicit_table.empty())
+            MPC_WARN("terminal_cost replaces fixed_horizon, analytic_derivatives, codegen, condensed, "
+                     "the Riccati solver and the explicit table, ignoring them");
+        m_params.fixed_horizon = false;
+        m_params.analytic_derivatives = false;
+        m_params.codegen = false;
+        m_params.condensed = false;
+        m_params.riccati_solver = false;
+        m_params.rti = false;
+        m_params.explicit_table.clear();
+        m_terminal_cost.assign(TerminalCost::SIZE, 0.0);
+    }
+    // ... and those with the Euler step of the kinematic model
+    Integrator integrator = INTEGRATOR_EULER;
+    if (!integrator_from_name(m_params.integrator, integrator)) {
+        MPC_WARN("Unknown integrator \"%s\", using the Euler step", m_params.integrator.c_str());
+        m_params.integrator = "euler";
+    }
+    if (integrator != INTEGRATOR_EULER and m_dynamic_model) {
+        MPC_WARN("The dynamic vehicle_model has substeps of its own, ignoring the integrator");
+        m_params.integrator = "euler";
+        integrator = INTEGRATOR_EULER;
+    }
+    if (integrator != INTEGRATOR_EULER) {
+        if (m_params.fixed_horizon or m_params.analytic_derivatives or m_params.codegen or m_params.condensed
+                or m_params.riccati_solver or m_params.rti or !m_params.explicit_table.empty())
+            MPC_WARN("The %s integrator replaces fixed_horizon, analytic_derivatives, codegen, condensed, "
+                     "the Riccati solver and the explicit table, ignoring them", m_params.integrator.c_str());
+        m_params.fixed_horizon = false;
+        m_params.analytic_derivatives = false;
+        m_params.codegen = false;
+        m_params.condensed = false;
+        m_params.riccati_solver = false;
+        m_params.rti = false;
+        m_params.explicit_table.clear();
+    }
+    m_integrator = integrator;
+    if (m_indexes.num_slacks == 0 and params.soft_constraints)
+        MPC_WARN("soft_constraints needs terminal_cte, terminal_epsi or max_steer_rate, ignoring it");
 
     // A check on speed
     assert(params.ref_v < SPEED_UPPERBOUND);
+
+    m_prev_x_OK = false;
+    m_prev_x_age = 0;
+    m_lap_seed.resize(m_n_vars);
+    m_lap_seed_OK = false;
+    m_prev_duals_OK = false;
+    m_app_dual_start = false;
+    m_objective_scaling_OK = false;
+    m_stats = SolveStats();
+
+    // No estimates of the times of the levels of the tolerances yet: the
+    // first solves try to converge fully
+    for (size_t level=0; level < NUM_TOLERANCE_LEVELS; level++)
+        m_level_time[level] = -1.0;
+    m_tolerance_level = 0;
+    m_app_tolerance_level = 0;
+    m_full_tol = IPOPT_TOL;
+
+    // The vectors of the NLP; the bounds never change, besides those on the
+    // initial state, which every solve sets
+    m_buffers.reset(new SolveBuffers());
+    SolveBuffers & buffers = *m_buffers;
+    buffers.vars.resize(m_n_vars);
+    buffers.vars_lowerbound.resize(m_n_vars);
+    buffers.vars_upperbound.resize(m_n_vars);
+    buffers.constraints_lowerbound.resize(m_n_constraints);
+    buffers.constraints_upperbound.resize(m_n_constraints);
+    buffers.solution_x.resize(m_n_vars);
+
+    for (size_t i = 0; i < m_indexes.extra_start; i++) {
+        buffers.vars_lowerbound[i] = -1.0e19;
+        buffers.vars_upperbound[i] = 1.0e19;
+    }
+
+    // Those of the extra states and of the actuators are the model's
+    if (m_dynamic_model)
+        model_bounds<DynamicBicycle>(m_indexes, buffers.vars_lowerbound, buffers.vars_upperbound);
+    else
+        model_bounds<KinematicBicycle>(m_indexes, buffers.vars_lowerbound, buffers.vars_upperbound);
+
+    // The same bounds, on the actuations alone
+    if (m_params.condensed) {
+        size_t n_condensed = FG_eval_condensed::n_vars(m_indexes);
+        buffers.condensed_vars.resize(n_condensed);
+        buffers.condensed_lowerbound.resize(n_condensed);
+        buffers.condensed_upperbound.resize(n_condensed);
+        for (size_t i=0; i < n_condensed; i++) {
+            buffers.condensed_lowerbound[i] = buffers.vars_lowerbound[m_indexes.delta_start + i];
+            buffers.condensed_upperbound[i] = buffers.vars_upperbound[m_indexes.delta_start + i];
+        }
+    }
+
+    // Lower and upper limits for the constraints
+    // Should be 0 besides initial state.
+    for (size_t i=0; i<m_indexes.soft_start; i++) {
+        buffers.constraints_lowerbound[i] = 0;
+        buffers.constraints_upperbound[i] = 0;
+    }
+
+    // The soft constraints: |value| <= bound, as value - slack <= bound
+    // and value + slack >= -bound, with slacks fixed at 0 when they're hard
+    std::vector<double> soft_bounds;
+    if (m_params.terminal_cte > 0.0)
+        soft_bounds.push_back(m_params.terminal_cte);
+    if (m_params.terminal_epsi > 0.0)
+        soft_bounds.push_back(m_params.terminal_epsi);
+    if (m_params.max_steer_rate > 0.0) {
+        for (size_t t=0; t + 2 < m_params.steps_ahead; t++) {
+            if (m_indexes.delta(t + 1) != m_indexes.delta(t))
+                soft_bounds.push_back(m_params.max_steer_rate * m_params.step_dt(t));
+        }
+    }
+    assert(soft_bounds.size() == m_indexes.num_slacks);
+    for (size_t k=0; k < m_indexes.num_slacks; k++) {
+        buffers.vars_lowerbound[m_indexes.slack_start + k] = 0.0;
+        buffers.vars_upperbound[m_indexes.slack_start + k] = m_params.soft_constraints ? 1.0e19 : 0.0;
+        buffers.constraints_lowerbound[m_indexes.soft_start + 2*k] = -1.0e19;
+        buffers.constraints_upperbound[m_indexes.soft_start + 2*k] = soft_bounds[k];
+        buffers.constraints_lowerbound[m_indexes.soft_start + 2*k + 1] = -soft_bounds[k];
+        buffers.constraints_upperbound[m_indexes.soft_start + 2*k + 1] = 1.0e19;
+    }
+
+    // The rows of the obstacles are free until their slots are filled (see
+    // set_obstacles), and every solve bounds those that are below
+    size_t n_obstacle_rows = m_n_constraints - m_indexes.obstacle_start;
+    for (size_t k=0; k < n_obstacle_rows; k++) {
+        buffers.constraints_lowerbound[m_indexes.obstacle_start + k] = -1.0e19;
+        buffers.constraints_upperbound[m_indexes.obstacle_start + k] = 1.0e19;
+    }
+    m_obstacle_positions.assign(2 * n_obstacle_rows, 0.0);
+    m_obstacle_clearances.assign(n_obstacle_rows, 0.0);
+
+    // Going on from the last iterate is what makes the budget converge
+    if (m_params.iterations_per_tick > 0 and m_params.rti) {
+        MPC_WARN("rti takes a single iteration per tick, ignoring iterations_per_tick");
+        m_params.iterations_per_tick = 0;
+    }
+    if (m_params.iterations_per_tick > 0 and !params.warm_start and !m_params.riccati_solver) {
+        MPC_WARN("iterations_per_tick needs warm_start, ignoring it");
+        m_params.iterations_per_tick = 0;
+    }
+
+    // NOTE: You don't have to worry about these options
+    //
+    // options for IPOPT solver (of CppAD::ipopt::solve; every solve appends
+    // its time limit to them)
+    //
+    // Nothing goes to the console, not even the banner: writing to a slow
+    // terminal from inside the solve holds it up (see
+    // `Params::ipopt_journal` for where it goes instead)
+    m_options += "Integer print_level  0\n";
+    m_options += "String  sb          yes\n";
+    // NOTE: Setting sparse to true allows the solver to take advantage
+    // of sparse routines, this makes the computation MUCH FASTER. If you
+    // can uncomment 1 of these and see if it makes a difference or not but
+    // if you uncomment both the computation time should go up in orders of
+    // magnitude. Which of them is `Params::cppad_sparsity`.
+    std::string sparsity = params.cppad_sparsity;
+    if (sparsity != "both" and sparsity != "forward" and sparsity != "reverse" and sparsity != "none") {
+        MPC_WARN("Unknown cppad_sparsity \"%s\", using both", sparsity.c_str());
+        sparsity = "both";
+    }
+    if (sparsity == "both" or sparsity == "forward")
+        m_options += "Sparse  true        forward\n";
+    if (sparsity == "both" or sparsity == "reverse")
+        m_options += "Sparse  true        reverse\n";
+    if (!params.mu_strategy.empty())
+        m_options += "String  mu_strategy " + params.mu_strategy + "\n";
+    if (params.limited_memory_hessian)
+        m_options += "String  hessian_approximation limited-memory\n";
+    if (!params.linear_solver.empty())
+        m_options += "String  linear_solver " + params.linear_solver + "\n";
+    if (m_params.iterations_per_tick > 0)
+        m_options += "Integer max_iter " + std::to_string(m_params.iterations_per_tick) + "\n";
+    m_options_prefix = m_options.size();
+    m_options.reserve(m_options_prefix + MAX_TIME_LIMIT_OPTION);
+
+    // The tape only depends on the horizon and the polynomial degree, so it
+    // can be recorded here, once. The same goes for the Ipopt application:
+    // its options are parsed only once, and the problem structure is kept
+    // between the solves.
+    m_app_OK = false;
+    m_nlp_solved_once = false;
+    m_app_same_structure = false;
+    if (params.precision != "double" and !(params.persistent_tape and m_params.analytic_derivatives))
+        MPC_WARN("Only the analytic derivatives are evaluated in %s precision, the NLP stays in double",
+                 params.precision.c_str());
+    if (m_params.constant_cost_hessian and (!params.persistent_tape or m_params.condensed
+            or m_params.analytic_derivatives or m_params.riccati_solver or m_params.rti
+            or params.limited_memory_hessian)) {
+        MPC_WARN("constant_cost_hessian needs persistent_tape on the CppAD tape and the exact Hessian, ignoring it");
+        m_params.constant_cost_hessian = false;
+    }
+    if (m_params.parallel_derivatives > 1 and (!params.persistent_tape or m_params.condensed
+            or m_params.analytic_derivatives or m_params.riccati_solver or m_params.rti)) {
+        MPC_WARN("parallel_derivatives needs persistent_tape on the CppAD tape, ignoring it");
+        m_params.parallel_derivatives = 0;
+    }
+    if (m_params.fast_trig and (!params.persistent_tape or m_params.condensed or m_params.analytic_derivatives
+            or m_params.riccati_solver or m_params.rti)) {
+        MPC_WARN("fast_trig needs persistent_tape on the CppAD tape, ignoring it");
+        m_params.fast_trig = false;
+    }
+    if (m_params.parallel_derivatives > 1 and m_params.constant_cost_hessian) {
+        MPC_WARN("parallel_derivatives differentiates the whole Lagrangian, ignoring constant_cost_hessian");
+        m_params.constant_cost_hessian = false;
+    }
+    if (m_params.parallel_stages > 1 and (!params.persistent_tape or m_params.condensed
+            or m_params.analytic_derivatives or m_params.riccati_solver or m_params.rti)) {
+        MPC_WARN("parallel_stages needs persistent_tape on the CppAD tape, ignoring it");
+        m_params.parallel_stages = 0;
+    }
+    if (m_params.parallel_stages > 1 and (m_params.parallel_derivatives > 1 or m_params.constant_cost_hessian
+            or m_params.checkpoint_stage or m_params.codegen)) {
+        MPC_WARN("parallel_stages takes the steps out of the tape, ignoring parallel_derivatives, "
+                 "constant_cost_hessian, checkpoint_stage and codegen");
+        m_params.parallel_derivatives = 0;
+        m_params.constant_cost_hessian = false;
+        m_params.checkpoint_stage = false;
+        m_params.codegen = false;
+    }
+    if (params.persistent_tape and !m_params.condensed) {
+        // The patterns of an earlier run, or those of this one for the next
+        bool structure_loaded = false;
+        if (!params.structure_cache.empty()) {
+            m_structure.reset(new SolverStructure(m_params, m_n_vars, m_n_constraints));
+            m_structure_path = m_structure->path(params.structure_cache);
+            structure_loaded = m_structure->load(m_structure_path);
+        }
+        m_nlp = new MPC_NLP(m_params, m_indexes, m_n_vars, m_n_constraints, m_structure.get());
+        if (m_params.fix_initial_state)
+            m_nlp->fix_initial_state(m_indexes);
+        if (m_structure and !structure_loaded)
+            m_structure->save(m_structure_path);
+        if (m_structure and params.warm_start)
+            m_seed_x = m_structure->solution;
+
+#ifdef MPC_CODEGEN
+        if (m_params.codegen and m_params.analytic_derivatives)
+            MPC_WARN("analytic_derivatives replaces codegen, ignoring it");
+        else if (m_params.codegen and !m_nlp->load_codegen(MPC_CODEGEN_LIBRARY, m_params))
+            MPC_WARN("Falling back to the CppAD tape");
+#else
+        if (m_params.codegen)
+            MPC_WARN("Built without MPC_CODEGEN, using the CppAD tape");
+#endif
+
+        // Without the console's journal, and with ours instead
+        m_app = new Ipopt::IpoptApplication(false);
+        m_app->Options()->SetIntegerValue("print_level", 0);
+        m_app->Options()->SetStringValue("sb", "yes");
+        if (m_params.ipopt_journal) {
+            m_app->Jnlst()->AddJournal(new IpoptJournal(m_ipopt_log));
+            m_nlp->set_log(&m_ipopt_log);
+        }
+        m_app->Options()->SetNumericValue("max_cpu_time", (m_params.solve_time_limit > 0.0)
+                                          ? m_params.solve_time_limit : NO_TIME_LIMIT);
+        if (params.limited_memory_hessian)
+            m_app->Options()->SetStringValue("hessian_approximation", "limited-memory");
+        if (m_params.iterations_per_tick > 0)
+            m_app->Options()->SetIntegerValue("max_iter", m_params.iterations_per_tick);
+        if (!params.linear_solver.empty() and !m_app->Options()->SetStringValue("linear_solver", params.linear_solver))
+            MPC_WARN("Unknown linear_solver \"%s\", using Ipopt's default", params.linear_solver.c_str());
+        if (!params.mu_strategy.empty() and !m_app->Options()->SetStringValue("mu_strategy", params.mu_strategy))
+            MPC_WARN("Unknown mu_strategy \"%s\", using Ipopt's default", params.mu_strategy.c_str());
+        if (m_params.nlp_scaling) {
+            CPPAD_TESTVECTOR(double) x_scaling, g_scaling;
+            nlp_scaling(m_params, m_indexes, buffers.vars_lowerbound, buffers.vars_upperbound,
+                        buffers.constraints_upperbound, x_scaling, g_scaling);
+            m_nlp->set_scaling(1.0, x_scaling, g_scaling);
+            m_app->Options()->SetStringValue("nlp_scaling_method", "user-scaling");
+        }
+        if (m_params.analytic_derivatives and params.precision == "float") {
+            m_full_tol = KinematicModel::FLOAT_TOLERANCE;
+            m_app->Options()->SetNumericValue("tol", m_full_tol);
+        }
+
+        // Only read by the solves that start from the multipliers (see
+        // `warm_start_init_point` below): they're as far from their bounds
+        // as the barrier parameter they start with keeps them
+        if (params.dual_warm_start and params.warm_start) {
+            m_app->Options()->SetNumericValue("warm_start_bound_push", params.warm_start_mu);
+            m_app->Options()->SetNumericValue("warm_start_bound_frac", params.warm_start_mu);
+            m_app->Options()->SetNumericValue("warm_start_slack_bound_push", params.warm_start_mu);
+            m_app->Options()->SetNumericValue("warm_start_slack_bound_frac", params.warm_start_mu);
+            m_app->Options()->SetNumericValue("warm_start_mult_bound_push", params.warm_start_mu);
+        }
+
+        Ipopt::ApplicationReturnStatus status = m_app->Initialize();
+        m_app_OK = (status == Ipopt::Solve_Succeeded);
+        if (!m_app_OK)
+            MPC_ERROR("Could not initialize Ipopt (status: %d)", status);
+    }
+
+    if (m_params.fix_initial_state and (!params.persistent_tape or m_params.condensed)) {
+        MPC_WARN("fix_initial_state needs persistent_tape, ignoring it");
+        m_params.fix_initial_state = false;
+    }
+    if (m_params.nlp_scaling and (!params.persistent_tape or m_params.condensed)) {
+        MPC_WARN("nlp_scaling needs persistent_tape, ignoring it");
+        m_params.nlp_scaling = false;
+    }
+    if (m_params.ipopt_journal and (!params.persistent_tape or m_params.condensed)) {
+        MPC_WARN("ipopt_journal needs persistent_tape, ignoring it");
+        m_params.ipopt_journal = false;
+    }
+    if (m_params.codegen and !params.persistent_tape)
+        MPC_WARN("codegen needs persistent_tape, ignoring it");
+    if (!params.structure_cache.empty() and (!params.persistent_tape or m_params.condensed))
+        MPC_WARN("structure_cache needs persistent_tape, ignoring it");
+    if (params.checkpoint_stage and !params.persistent_tape)
+        MPC_WARN("checkpoint_stage needs persistent_tape, ignoring it");
+    if (m_params.analytic_derivatives and !params.persistent_tape)
+        MPC_WARN("analytic_derivatives needs persistent_tape, ignoring it");
+    if (params.autodiff_stages and !m_params.analytic_derivatives)
+        MPC_WARN("autodiff_stages needs analytic_derivatives, ignoring it");
+    if (m_params.condensed and (params.persistent_tape or params.fixed_horizon))
+        MPC_WARN("condensed replaces persistent_tape and fixed_horizon, ignoring them");
+
+    if (m_params.fixed_horizon and !has_fixed_horizon(params.steps_ahead, params.poly_degree))
+        MPC_WARN("No fixed-horizon FG_eval for steps_ahead=%lu, poly_degree=%d, using the generic one",
+                 params.steps_ahead, params.poly_degree);
+
+    // CppAD::ipopt::solve only takes the variables to start from
+    if (m_params.dual_warm_start and (!params.warm_start or !params.persistent_tape or m_params.condensed
+                                      or m_params.riccati_solver or m_params.rti)) {
+        MPC_WARN("dual_warm_start needs warm_start and persistent_tape, ignoring it");
+        m_params.dual_warm_start = false;
+    }
+    if (m_params.dual_warm_start) {
+        m_prev_z_L.resize(m_n_vars);
+        m_prev_z_U.resize(m_n_vars);
+        m_prev_lambda.resize(m_n_constraints);
+        m_buffers->z_L.resize(m_n_vars);
+        m_buffers->z_U.resize(m_n_vars);
+        m_buffers->lambda.resize(m_n_constraints);
+    }
+
+    if (m_params.adaptive_tolerance and (m_params.riccati_solver or m_params.rti)) {
+        MPC_WARN("adaptive_tolerance needs Ipopt, ignoring it");
+        m_params.adaptive_tolerance = false;
+    }
+
+    if (params.active_set_qp and !m_params.riccati_solver and !m_params.rti)
+        MPC_WARN("active_set_qp needs riccati_solver or rti, ignoring it");
+
+    if (m_params.sensitivity_updates > 0 and (m_params.rti or !m_params.riccati_solver)) {
+        MPC_WARN("sensitivity_updates needs riccati_solver without rti, ignoring it");
+        m_params.sensitivity_updates = 0;
+    }
+
+    if (m_params.linearization_speed_bins > 0 and !m_params.rti) {
+        MPC_WARN("linearization_speed_bins needs rti, ignoring it");
+        m_params.linearization_speed_bins = 0;
+    }
+
+    // The rollouts have the kinematic model, the polynomial reference and a
+    // uniform grid of one actuation per step built in, and only penalise the
+    // obstacles and the corridor
+    if (m_params.mppi and (m_dynamic_model or m_params.contouring_reference or !m_indexes.block.empty()
+                           or !m_params.dt_steps.empty() or m_indexes.num_slacks > 0)) {
+        MPC_WARN("mppi needs the kinematic model, the polynomial reference, neither input_blocks nor dt_steps, "
+                 "and neither terminal_cte, terminal_epsi nor max_steer_rate, ignoring it");
+        m_params.mppi = false;
+    }
+
+    // The solves go to the backend, but with Ipopt
+    std::string backend = backend_name(m_params);
+    if (backend != "ipopt") {
+        if (m_params.terminal_cost) {
+            MPC_WARN("The %s backend has no terminal_cost, ignoring it", backend.c_str());
+            m_params.terminal_cost = false;
+            m_terminal_cost.clear();
+        }
+        if (m_integrator != INTEGRATOR_EULER) {
+            MPC_WARN("The %s backend has the Euler step, ignoring the integrator", backend.c_str());
+            m_params.integrator = "euler";
+            m_integrator = INTEGRATOR_EULER;
+        }
+        m_backend = SolverBackends::make(backend, m_params, 0.017453 * delta_constraint(), SPEED_UPPERBOUND);
+        if (m_backend) {
+            m_backend->set_obstacles(m_obstacle_positions.data(), m_obstacle_clearances.data(),
+                                     m_indexes.num_obstacles);
+        } else {
+            MPC_WARN("Solving with Ipopt instead of the %s backend", backend.c_str());
+            m_params.backend = "ipopt";
+        }
+    }
+
+    if (params.warm_start and !m_params.riccati_solver and !m_params.rti) {
+        if (params.warm_start_initializer == "learned" and m_params.contouring_reference) {
+            MPC_WARN("The learned warm start is for the polynomial reference, shifting the previous solution "
+                     "instead");
+        } else if (params.warm_start_initializer == "learned") {
+            std::unique_ptr<LearnedWarmStart> learned(
+                    new LearnedWarmStart(m_params, m_indexes, 0.017453 * delta_constraint(), SPEED_UPPERBOUND));
+            if (learned->load(params.warm_start_weights))
+                m_initializer = std::move(learned);
+            else
+                MPC_WARN("Warm starting from the shifted previous solution instead");
+        } else if (params.warm_start_initializer != "shift") {
+            MPC_WARN("Unknown warm_start_initializer \"%s\", shifting the previous solution",
+                     params.warm_start_initializer.c_str());
+        }
+    }
+    if (!m_initializer)
+        m_initializer.reset(new ShiftWarmStart(m_params, m_indexes));
+
+    // No bounds on the cte until the first corridor
+    m_corridor = (params.corridor_width > 0.0);
+    if (m_corridor and (m_params.condensed or m_params.riccati_solver or m_params.rti
+                        or !m_params.explicit_table.empty())) {
+        MPC_WARN("corridor_width needs the cte of every step, which condensed, the Riccati solver and the "
+                 "explicit table don't have, ignoring it");
+        m_corridor = false;
+    }
+    m_cte_lower.assign(m_params.steps_ahead, -1.0e19);
+    m_cte_upper.assign(m_params.steps_ahead, 1.0e19);
+    if (m_backend and m_corridor)
+        m_backend->set_cte_bounds(m_cte_lower.data(), m_cte_upper.data());
+
+    if (!m_params.explicit_table.empty()) {
+        m_table.reset(new ExplicitTable());
+        if (!m_table->load(m_params.explicit_table)) {
+            MPC_WARN("Solving without the explicit table");
+            m_table.reset();
+        } else if (!m_table->matches(m_params)) {
+            MPC_WARN("%s was made for another horizon, cost, degree or time grid, solving without it",
+                     m_params.explicit_table.c_str());
+            m_table.reset();
+        }
+    }
+}
+
+// The last solution, for the first solves of the next run
+MPC::~MPC() {
+    if (m_structure and m_saves_solution and m_prev_x_OK and m_prev_x_age == 0
+            and m_prev_x.size() == m_n_vars) {
+        m_structure->solution = m_prev_x;
+        m_structure->save(m_structure_path);
+    }
+}
+
+
+void MPC::set_derivative_pool(Eigen::ThreadPoolInterface * pool) {
+    if (m_backend)
+        m_backend->set_pool(pool);
+    if (m_params.parallel_derivatives > 1 and Ipopt::IsValid(m_nlp)
+            and !m_nlp->set_parallel(pool, size_t(m_params.parallel_derivatives)))
+        MPC_WARN("parallel_derivatives needs the derivatives of the CppAD tape, ignoring it");
+    if (m_params.parallel_stages > 1 and Ipopt::IsValid(m_nlp) and !m_nlp->set_stage_pool(pool))
+        MPC_WARN("parallel_stages needs the CppAD tape, ignoring it");
+}
+
+
+void MPC::reset_warm_start() {
+    m_prev_x_OK = false;
+    m_prev_duals_OK = false;
+    if (m_backend)
+        m_backend->reset_warm_start();
+}
+
+
+bool MPC::set_weights(const Params & params) {
+    if (m_params.same_weights(params))
+        return true;
+    if (Ipopt::IsValid(m_nlp) and !m_nlp->set_weights(params))
+        return false;
+    m_params.copy_weights(params);
+    if (m_backend)
+        m_backend->set_weights(params);
+    if (m_table and !m_table->matches(m_params)) {
+        MPC_WARN("The explicit table was made for other weights, solving without it");
+        m_table.reset();
+    }
+    return true;
+}
+
+
+void MPC::set_cte_bounds(const double * lower, const double * upper, size_t n) {
+    if (!m_corridor or n == 0)
+        return;
+    for (size_t t=0; t < m_params.steps_ahead; t++) {
+        m_cte_lower[t] = lower[std::min(t, n - 1)];
+        m_cte_upper[t] = upper[std::min(t, n - 1)];
+    }
+}
+
+
+void MPC::set_obstacles(const double * positions, const double * clearances, size_t n) {
+    if (m_indexes.num_obstacles == 0 or n == 0)
+        return;
+    for (size_t j=0; j < m_indexes.num_obstacles; j++) {
+        for (size_t t=1; t < m_params.steps_ahead; t++) {
+            size_t k = m_indexes.obstacle(j, t) - m_indexes.obstacle_start;
+            size_t s = j * n + std::min(t, n - 1);
+            m_obstacle_positions[2*k] = positions[2*s];
+            m_obstacle_positions[2*k + 1] = positions[2*s + 1];
+            m_obstacle_clearances[k] = clearances[s];
+        }
+    }
+}
+
+
+void MPC::set_lap_seed(const double * x, size_t n) {
+    m_lap_seed_OK = (x != nullptr and n == m_n_vars);
+    if (m_lap_seed_OK)
+        std::copy(x, x + n, m_lap_seed.begin());
+}
+
+
+void MPC::set_terminal_target(double cte, double epsi, double delta) {
+    m_terminal_target[0] = cte;
+    m_terminal_target[1] = epsi;
+    m_terminal_target[2] = delta;
+}
+
+
+void MPC::set_cancel_flag(const std::atomic<bool> * cancel) {
+    if (Ipopt::IsValid(m_nlp))
+        m_nlp->set_cancel_flag(cancel);
+}
+
+
+void MPC::set_initializer(std::unique_ptr<WarmStartInitializer> initializer) {
+    m_initializer = std::move(initializer);
+}
+
+
+void MPC::memory_stats(MemoryStats & stats) const {
+    if (Ipopt::IsValid(m_nlp))
+        m_nlp->memory_stats(stats);
+}
+
+
+bool MPC::allocation_free() const {
+    if (m_backend)
+        return m_backend->allocation_free();
+    return m_params.persistent_tape and !m_params.condensed;
+}
+
+
+void MPC::set_time_limit(const std::chrono::steady_clock::time_point & deadline) {
+    // The limit of `solve_time_limit`. There's no intermediate callback
+    // through CppAD::ipopt::solve, so the deadline can only shorten it (the
+    // CPU time of the single-threaded solve is close to its wall-clock time)
+    double max_cpu_time = (m_params.solve_time_limit > 0.0) ? m_params.solve_time_limit : NO_TIME_LIMIT;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+        std::chrono::duration<double> remaining = deadline - std::chrono::steady_clock::now();
+        max_cpu_time = std::max(std::min(max_cpu_time, remaining.count()), 1e-3);
+    }
+    char time_limit[MAX_TIME_LIMIT_OPTION];
+    m_options.resize(m_options_prefix);
+    if (m_params.adaptive_tolerance) {
+        double tol, acceptable_tol;
+        int acceptable_iter;
+        tolerances(m_tolerance_level, tol, acceptable_tol, acceptable_iter);
+        std::snprintf(time_limit, sizeof(time_limit), "Numeric tol                   %e\n"
+                      "Numeric acceptable_tol        %e\nInteger acceptable_iter       %d\n",
+                      tol, acceptable_tol, acceptable_iter);
+        m_options += time_limit;
+    }
+    std::snprintf(time_limit, sizeof(time_limit), "Numeric max_cpu_time          %f\n", max_cpu_time);
+    m_options += time_limit;
+}
+
+
+size_t MPC::tolerance_level(const std::chrono::steady_clock::time_point & deadline) const {
+    if (!m_params.adaptive_tolerance or deadline == std::chrono::steady_clock::time_point::max())
+        return 0;
+
+    // A level that was never timed is tried
+    double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+    for (size_t level=0; level + 1 < NUM_TOLERANCE_LEVELS; level++) {
+        if (m_level_time[level] < 0.0 or TOLERANCE_SAFETY * m_level_time[level] <= remaining)
+            return level;
+    }
+    return NUM_TOLERANCE_LEVELS - 1;
+}
+
+
+void MPC::tolerances(size_t level, double & tol, double & acceptable_tol, int & acceptable_iter) const {
+    // From full convergence to the relaxed tolerances, geometrically, and
+    // to a stop at the first acceptable point
+    double f = double(level) / (NUM_TOLERANCE_LEVELS - 1);
+    tol = m_full_tol * std::pow(std::max(m_params.relaxed_tol, m_full_tol) / m_full_tol, f);
+    acceptable_tol = IPOPT_ACCEPTABLE_TOL
+            * std::pow(std::max(m_params.relaxed_acceptable_tol, IPOPT_ACCEPTABLE_TOL) / IPOPT_ACCEPTABLE_TOL, f);
+    acceptable_iter = 1 + int(std::lround((IPOPT_ACCEPTABLE_ITER - 1) * (1.0 - f)));
+}
+
+
+bool MPC::fast_trig_in_range(const double * vars, const Eigen::VectorXd & coeffs, double ref_v) const {
+    double max_angle = 0.0;
+    double max_x = 0.0;
+    double horizon = 0.0;
+    for (size_t t=0; t < m_params.steps_ahead; t++) {
+        max_angle = std::max(max_angle, std::max(std::abs(vars[m_indexes.psi_start + t]),
+                                                 std::abs(vars[m_indexes.epsi_start + t])));
+        max_x = std::max(max_x, vars[m_indexes.x_start + t]);
+        if (t + 1 < m_params.steps_ahead)
+            horizon += m_params.step_dt(t);
+    }
+
+    // The contouring reference has no slope to take the atan of
+    double max_slope = 0.0;
+    if (!m_params.contouring_reference) {
+        double length = std::max(max_x, ref_v * horizon);
+        for (size_t t=0; t < m_params.steps_ahead; t++) {
+            double x = length * t / std::max<size_t>(1, m_params.steps_ahead - 1);
+            double value, slope;
+            horner_with_diff(coeffs, 0, m_params.num_coeffs(), x, value, slope);
+            max_slope = std::max(max_slope, std::abs(slope));
+        }
+    }
+    return FastTrig::in_range(max_angle, max_slope);
+}
+
+
+bool MPC::lookup_explicit(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double new_ref_v,
+                          std::vector<double> & result) {
+    double delta, v;
+    if (!m_table->lookup(coeffs, new_ref_v, m_params.explicit_table_steer_tolerance,
+                         m_params.explicit_table_speed_tolerance, delta, v))
+        return false;
+
+    // The table only has the first actuations: the predicted path is that
+    // of holding them, by the model of FG_eval
+    result.resize(2 + 2*m_params.steps_ahead);
+    result[0] = delta;
+    result[1] = v;
+    double x = state[0], y = state[1], psi = state[2];
+    for (size_t i=0; i < m_params.steps_ahead; i++) {
+        result[2 + 2*i] = x;
+        result[3 + 2*i] = y;
+        // (the table is only for the uniform time grid)
+        x += v * std::cos(psi) * m_params.dt;
+        y += v * std::sin(psi) * m_params.dt;
+        psi -= v / Lf() * delta * m_params.dt;
+    }
+    return true;
+}
+
+
+std::vector<double> MPC::Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double new_ref_v,
+                               const std::chrono::steady_clock::time_point & deadline) {
+    std::vector<double> result;
+    Solve(state, coeffs, new_ref_v, result, deadline);
+    return result;
 }
 
-MPC::~MPC() {}
 
-std::vector<double> MPC::Solve(const Eigen::VectorXd state, const Eigen::VectorXd coeffs, const double new_ref_v) {
+void MPC::Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double new_ref_v,
+                std::vector<double> & result, const std::chrono::steady_clock::time_point & deadline) {
+    MPC_TRACE_SCOPE("MPC::Solve");
+    auto solve_start = std::chrono::steady_clock::now();
+
+    // Inside the explicit law's grid there's nothing to solve. Its answer
+    // isn't a solution of the NLP, so nothing is warm started from it
+    m_stats.explicit_law = false;
+    if (m_table and lookup_explicit(state, coeffs, new_ref_v, result)) {
+        m_prev_x_OK = false;
+        m_prev_duals_OK = false;
+        m_stats = SolveStats();
+        m_stats.ok = true;
+        m_stats.explicit_law = true;
+        m_stats.constraint_violation = 0.0;
+        m_stats.solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - solve_start).count();
+        return;
+    }
+
+    // A backend (e.g. the Riccati solver, which works on the inputs only)
+    // needs none of the NLP set up below
+    m_stats.lap_seeded = false;
+    if (m_backend) {
+        m_backend->solve(SolveProblem(state, coeffs, new_ref_v, deadline), result, m_stats);
+        m_stats.solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - solve_start).count();
+        return;
+    }
+
     bool ok = true;
-    typedef CPPAD_TESTVECTOR(double) Dvector;
+    typedef SolveBuffers::Dvector Dvector;
+
+    // The tolerances the time left allows
+    m_tolerance_level = tolerance_level(deadline);
 
     double x = state[0];
     double y = state[1];
@@ -205,44 +1200,37 @@ std::vector<double> MPC::Solve(const Eigen::VectorXd state, const Eigen::VectorX
     double cte = state[3];
     double epsi = state[4];
 
-    size_t n_vars = m_params.steps_ahead * 5 + (m_params.steps_ahead - 1) * 2;
-    size_t n_constraints = m_params.steps_ahead * 5;
+    size_t n_vars = m_n_vars;
 
     // Initial value of the independent variables.
     // Should be 0 besides initial state.
-    Dvector vars(n_vars);
+    Dvector & vars = m_buffers->vars;
     for (size_t i = 0; i < n_vars; i++)
         vars[i] = 0;
 
-    Dvector vars_lowerbound(n_vars);
-    Dvector vars_upperbound(n_vars);
-
-    for (size_t i = 0; i < m_indexes.delta_start; i++) {
-        vars_lowerbound[i] = -1.0e19;
-        vars_upperbound[i] = 1.0e19;
+    // ... unless there's a better guess (see WarmStart.h), e.g. where the
+    // previous solve ended (or one of the previous run did), or where the
+    // one of the same stretch of a previous lap did when the previous one
+    // failed
+    const double * prev_x = m_prev_x_OK ? m_prev_x.data() : (m_seed_x.empty() ? nullptr : m_seed_x.data());
+    m_stats.lap_seeded = m_lap_seed_OK and (!m_prev_x_OK or m_prev_x_age > 0);
+    if (m_stats.lap_seeded)
+        prev_x = m_lap_seed.data();
+    if (m_params.warm_start and m_initializer->initialize(state, coeffs, new_ref_v, prev_x, &vars[0])) {
+        vars[m_indexes.x_start] = x;
+        vars[m_indexes.y_start] = y;
+        vars[m_indexes.psi_start] = psi;
+        vars[m_indexes.cte_start] = cte;
+        vars[m_indexes.epsi_start] = epsi;
     }
 
-    // BEGIN: CONSTRAINTS ON THE ACTUATORS
-    for (size_t i=m_indexes.delta_start; i<m_indexes.v_start; i++) {
-        // 1 degree = 0.017453 radians
-        vars_lowerbound[i] = -0.017453 * delta_constraint();
-        vars_upperbound[i] = 0.017453 * delta_constraint();
-    }
-    for (size_t i=m_indexes.v_start; i<n_vars; i++) {
-        vars_lowerbound[i] = 0.0;
-        vars_upperbound[i] = SPEED_UPPERBOUND;
-    }
-    // END: CONSTRAINTS ON THE ACTUATORS
-
-    // Lower and upper limits for the constraints
-    // Should be 0 besides initial state.
-    Dvector constraints_lowerbound(n_constraints);
-    Dvector constraints_upperbound(n_constraints);
+    // All the bounds were set in the constructor, but those on the initial
+    // state, on the cte of the corridor and of the obstacles
+    Dvector & vars_lowerbound = m_buffers->vars_lowerbound;
+    Dvector & vars_upperbound = m_buffers->vars_upperbound;
+    Dvector & constraints_lowerbound = m_buffers->constraints_lowerbound;
+    Dvector & constraints_upperbound = m_buffers->constraints_upperbound;
 
-    for (size_t i=0; i<n_constraints; i++) {
-        constraints_lowerbound[i] = 0;
-        constraints_upperbound[i] = 0;
-    }
     constraints_lowerbound[m_indexes.x_start] = x;
     constraints_lowerbound[m_indexes.y_start] = y;
     constraints_lowerbound[m_indexes.psi_start] = psi;
@@ -255,50 +1243,321 @@ std::vector<double> MPC::Solve(const Eigen::VectorXd state, const Eigen::VectorX
     constraints_upperbound[m_indexes.cte_start] = cte;
     constraints_upperbound[m_indexes.epsi_start] = epsi;
 
-    // Object that computes objective and constraints
-    FG_eval fg_eval(coeffs, m_params, m_indexes, new_ref_v);
+    // A car out of the corridor already only has to get no farther out
+    if (m_corridor) {
+        for (size_t t=1; t < m_params.steps_ahead; t++) {
+            vars_lowerbound[m_indexes.cte_start + t] = std::min(m_cte_lower[t], cte);
+            vars_upperbound[m_indexes.cte_start + t] = std::max(m_cte_upper[t], cte);
+        }
+    }
 
-    // NOTE: You don't have to worry about these options
-    //
-    // options for IPOPT solver
-    std::string options;
-    // Uncomment this if you'd like more print information
-    options += "Integer print_level  2\n";
-    // NOTE: Setting sparse to true allows the solver to take advantage
-    // of sparse routines, this makes the computation MUCH FASTER. If you
-    // can uncomment 1 of these and see if it makes a difference or not but
-    // if you uncomment both the computation time should go up in orders of
-    // magnitude.
-    options += "Sparse  true        forward\n";
-    options += "Sparse  true        reverse\n";
-    // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
-    // Change this as you see fit.
-    options += "Numeric max_cpu_time          0.5\n";
-
-    // place to return solution
-    CppAD::ipopt::solve_result <Dvector> solution;
-
-    // solve the problem
-    CppAD::ipopt::solve<Dvector, FG_eval>(
-            options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
-            constraints_upperbound, fg_eval, solution);
+    // The distances to keep from the obstacles of the slots, none from a
+    // free one
+    for (size_t k=0; k < m_obstacle_clearances.size(); k++) {
+        double clearance = m_obstacle_clearances[k];
+        constraints_lowerbound[m_indexes.obstacle_start + k] = (clearance > 0.0) ? clearance * clearance : -1.0e19;
+    }
 
-    // Check some of the solution values
-    ok &= (solution.status == CppAD::ipopt::solve_result<Dvector>::success);
+    // The extra states of the model, from the state when it has them, or
+    // as the last plan predicted them for now
+    for (size_t e=0; e < m_indexes.num_extra; e++) {
+        double value = 0.0;
+        if (size_t(state.size()) > 5 + e)
+            value = state[5 + e];
+        else if (m_prev_x_OK and m_prev_x.size() == n_vars)
+            value = m_prev_x[m_indexes.extra(e, std::min(1 + m_prev_x_age, m_params.steps_ahead - 1))];
+        vars[m_indexes.extra(e, 0)] = value;
+        constraints_lowerbound[m_indexes.extra(e, 0)] = value;
+        constraints_upperbound[m_indexes.extra(e, 0)] = value;
+    }
 
-    // Cost
-    auto cost = solution.obj_value;
-    ROS_WARN("COST: %.2f, OK: %d", cost, ok);
+    // The solution of either of the two paths below
+    Dvector & solution_x = m_buffers->solution_x;
+    double cost;
 
-    // {...} is shorthand for creating a vector, so auto x1 = {1.0,2.0}
-    // creates a 2 element double vector.
-    std::vector<double> result;
-    result.reserve(2 + 2*m_params.steps_ahead);
-    result.push_back(solution.x[m_indexes.delta_start]);
-    result.push_back(solution.x[m_indexes.v_start]);
+    // The terminal cost at the reference speed of this solve, about its
+    // target
+    if (m_params.terminal_cost) {
+        TerminalCost::weights(m_params, new_ref_v, m_terminal_cost.data());
+        m_terminal_cost[TerminalCost::CTE_TARGET] = m_terminal_target[0];
+        m_terminal_cost[TerminalCost::EPSI_TARGET] = m_terminal_target[1];
+        m_terminal_cost[TerminalCost::DELTA_TARGET] = m_terminal_target[2];
+    }
+
+    // Beyond the range of the polynomials of the tape, the exact model
+    // taped for this solve
+    bool exact_trig = m_params.fast_trig and !fast_trig_in_range(&vars[0], coeffs, new_ref_v);
+
+    if (m_params.condensed) {
+        // The actuations of the initial guess: the states follow from them
+        Dvector & u = m_buffers->condensed_vars;
+        for (size_t i=0; i < u.size(); i++)
+            u[i] = vars[m_indexes.delta_start + i];
+
+        set_time_limit(deadline);
+        CppAD::ipopt::solve_result <Dvector> solution;
+        FG_eval_condensed fg_eval(coeffs, m_params, m_indexes, new_ref_v, state);
+        {
+            MPC_TRACE_SCOPE("CppAD::ipopt::solve");
+            CppAD::ipopt::solve<Dvector, FG_eval_condensed>(
+                    m_options, u, m_buffers->condensed_lowerbound, m_buffers->condensed_upperbound,
+                    m_buffers->condensed_constraints, m_buffers->condensed_constraints, fg_eval, solution);
+        }
+
+        // Back to the layout of the other paths
+        ok &= (solution.status == CppAD::ipopt::solve_result<Dvector>::success
+               or (m_params.adaptive_tolerance
+                   and solution.status == CppAD::ipopt::solve_result<Dvector>::stop_at_acceptable_point)
+               or (m_params.iterations_per_tick > 0
+                   and solution.status == CppAD::ipopt::solve_result<Dvector>::maxiter_exceeded));
+        FG_eval_condensed::ADvector a_u(solution.x.size()), a_vars(n_vars);
+        for (size_t i=0; i < solution.x.size(); i++)
+            a_u[i] = solution.x[i];
+        fg_eval.rollout(a_u, a_vars);
+        for (size_t i=0; i < n_vars; i++)
+            solution_x[i] = CppAD::Value(a_vars[i]);
+        cost = solution.obj_value;
+        m_stats.iterations = -1;
+        m_stats.restoration = false;
+        m_stats.diverged = false;
+        // Rolled out from the actuations, the states satisfy the model by
+        // construction
+        m_stats.constraint_violation = 0.0;
+        m_stats.eval_time = -1.0;
+        m_stats.linear_solver_time = -1.0;
+    } else if (m_params.persistent_tape and !exact_trig) {
+        // Only the dynamic parameters of the tape change from tick to tick
+        if (m_indexes.num_obstacles > 0)
+            m_nlp->set_obstacles(m_obstacle_positions.data());
+        if (m_params.terminal_cost)
+            m_nlp->set_terminal_cost(m_terminal_cost.data());
+        m_nlp->set_problem(
+                vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                constraints_upperbound, coeffs, new_ref_v);
+        m_nlp->set_deadline(deadline);
+
+        // The multipliers of the last solve, shifted as its variables were,
+        // and a barrier parameter that doesn't undo their centering. Ipopt
+        // is only told to read them when there are some
+        bool dual_start = m_params.dual_warm_start and m_prev_duals_OK;
+        if (dual_start) {
+            shift_multipliers(m_prev_z_L.data(), m_prev_z_U.data(), m_prev_lambda.data(), m_indexes,
+                              m_params.steps_ahead, m_buffers->z_L, m_buffers->z_U, m_buffers->lambda);
+            m_nlp->set_multipliers(m_buffers->z_L, m_buffers->z_U, m_buffers->lambda);
+        }
+        if (m_params.dual_warm_start and dual_start != m_app_dual_start) {
+            // The options are Ipopt's own allocations
+            AllocationCounter::Pause pause;
+            m_app->Options()->SetStringValue("warm_start_init_point", dual_start ? "yes" : "no");
+            m_app->Options()->SetNumericValue("mu_init", dual_start ? m_params.warm_start_mu : IPOPT_MU_INIT);
+            m_app_dual_start = dual_start;
+        }
+        if (m_params.adaptive_tolerance and m_tolerance_level != m_app_tolerance_level) {
+            double tol, acceptable_tol;
+            int acceptable_iter;
+            tolerances(m_tolerance_level, tol, acceptable_tol, acceptable_iter);
+            // The options are Ipopt's own allocations
+            AllocationCounter::Pause pause;
+            m_app->Options()->SetNumericValue("tol", tol);
+            m_app->Options()->SetNumericValue("acceptable_tol", acceptable_tol);
+            m_app->Options()->SetIntegerValue("acceptable_iter", acceptable_iter);
+            m_app_tolerance_level = m_tolerance_level;
+        }
+
+        // The structure of the problem never changes, so after the first
+        // solve Ipopt can skip most of its set up
+        ok &= m_app_OK;
+        if (m_params.ipopt_journal)
+            m_ipopt_log.clear();
+        if (ok) {
+            AllocationCounter::Pause pause;
+            MPC_TRACE_SCOPE("Ipopt");
+            if (m_nlp_solved_once) {
+                m_app->ReOptimizeTNLP(m_nlp);
+            } else {
+                m_app->OptimizeTNLP(m_nlp);
+                m_nlp_solved_once = true;
+            }
+        }
+
+        // With adaptive tolerances, an acceptable point is what was asked
+        // for, and with an iteration budget the last iterate
+        ok &= (m_nlp->status() == Ipopt::SUCCESS
+               or (m_params.adaptive_tolerance and m_nlp->status() == Ipopt::STOP_AT_ACCEPTABLE_POINT)
+               or (m_params.iterations_per_tick > 0 and m_nlp->status() == Ipopt::MAXITER_EXCEEDED));
+
+        // The KKT matrix has the same pattern on every tick, so once the
+        // linear solver has analyzed it, its ordering and symbolic
+        // factorization are kept. Not with obstacles: Ipopt takes a row that
+        // gets bounded or unbounded for another structure
+        if (ok and !m_app_same_structure and m_indexes.num_obstacles == 0) {
+            AllocationCounter::Pause pause;
+            m_app->Options()->SetStringValue("warm_start_same_structure", "yes");
+            m_app_same_structure = true;
+        }
+        solution_x = m_nlp->x();
+        cost = m_nlp->obj_value();
+        m_stats.iterations = m_nlp->iterations();
+        m_stats.restoration = m_nlp->restoration();
+        m_stats.diverged = m_nlp->diverged();
+        m_stats.constraint_violation = m_nlp->constraint_violation();
+        m_stats.eval_time = m_nlp->eval_time();
+        m_stats.linear_solver_time = m_nlp->linear_solver_time();
+        m_stats.ipopt_log = m_params.ipopt_journal ? &m_ipopt_log : nullptr;
+
+        // The cost of the first solve that converges is the typical one,
+        // which the objective is scaled by from the next solve on
+        if (m_params.nlp_scaling and ok and !m_objective_scaling_OK) {
+            m_nlp->set_objective_scaling(1.0 / std::max(std::abs(cost), MIN_TYPICAL_COST));
+            m_objective_scaling_OK = true;
+        }
+        m_stats.objective_scaling = m_params.nlp_scaling ? m_nlp->objective_scaling() : -1.0;
+
+        // The multipliers of Ipopt's last iterate, for the next solve
+        m_prev_duals_OK = ok and m_params.dual_warm_start;
+        if (m_prev_duals_OK) {
+            for (size_t i=0; i < n_vars; i++) {
+                m_prev_z_L[i] = m_nlp->z_L()[i];
+                m_prev_z_U[i] = m_nlp->z_U()[i];
+            }
+            for (size_t i=0; i < m_n_constraints; i++)
+                m_prev_lambda[i] = m_nlp->lambda()[i];
+        }
+
+        // Stopped by the deadline: Ipopt's last iterate may be infeasible,
+        // the best feasible one is a usable answer
+        if (!ok and m_nlp->deadline_hit() and m_nlp->best_feasible_OK()) {
+            solution_x = m_nlp->best_x();
+            cost = m_nlp->best_obj_value();
+            ok = true;
+            // Only known to be within Ipopt's (scaled) tolerance
+            m_stats.constraint_violation = -1.0;
+        }
+    } else {
+        set_time_limit(deadline);
+
+        // place to return solution
+        CppAD::ipopt::solve_result <Dvector> solution;
+        MPC_TRACE_SCOPE("CppAD::ipopt::solve");
+
+        // solve the problem, with the compile-time specialised FG_eval if
+        // there's one
+        bool solved = m_params.fixed_horizon and dispatch_fixed(
+                m_options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                constraints_upperbound, m_params, coeffs, new_ref_v, solution);
+        if (!solved and m_dynamic_model)
+            solve_model<DynamicBicycle>(m_options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                                        constraints_upperbound, m_params, m_indexes, coeffs, new_ref_v,
+                                        m_obstacle_positions, m_terminal_cost, solution);
+        else if (!solved and m_integrator == INTEGRATOR_RK2)
+            solve_model<IntegratedKinematic<INTEGRATOR_RK2> >(
+                    m_options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                    constraints_upperbound, m_params, m_indexes, coeffs, new_ref_v,
+                    m_obstacle_positions, m_terminal_cost, solution);
+        else if (!solved and m_integrator == INTEGRATOR_RK4)
+            solve_model<IntegratedKinematic<INTEGRATOR_RK4> >(
+                    m_options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                    constraints_upperbound, m_params, m_indexes, coeffs, new_ref_v,
+                    m_obstacle_positions, m_terminal_cost, solution);
+        else if (!solved and m_integrator == INTEGRATOR_EXACT)
+            solve_model<IntegratedKinematic<INTEGRATOR_EXACT> >(
+                    m_options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                    constraints_upperbound, m_params, m_indexes, coeffs, new_ref_v,
+                    m_obstacle_positions, m_terminal_cost, solution);
+        else if (!solved)
+            solve_model<KinematicBicycle>(m_options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                                          constraints_upperbound, m_params, m_indexes, coeffs, new_ref_v,
+                                          m_obstacle_positions, m_terminal_cost, solution);
+
+        // Check some of the solution values
+        ok &= (solution.status == CppAD::ipopt::solve_result<Dvector>::success
+               or (m_params.adaptive_tolerance
+                   and solution.status == CppAD::ipopt::solve_result<Dvector>::stop_at_acceptable_point)
+               or (m_params.iterations_per_tick > 0
+                   and solution.status == CppAD::ipopt::solve_result<Dvector>::maxiter_exceeded));
+        solution_x = solution.x;
+        cost = solution.obj_value;
+        m_stats.iterations = -1;
+        m_stats.restoration = false;
+        m_stats.diverged = false;
+        m_stats.constraint_violation = constraint_violation(solution.g, constraints_lowerbound,
+                                                            constraints_upperbound);
+        m_stats.eval_time = -1.0;
+        m_stats.linear_solver_time = -1.0;
+
+        // The multipliers of this solve, for the next one on the persistent
+        // tape (e.g. after an `exact_trig` tick), not those of the last one
+        m_prev_duals_OK = ok and m_params.dual_warm_start and solution.zl.size() == n_vars
+                and solution.lambda.size() == m_n_constraints;
+        if (m_prev_duals_OK) {
+            for (size_t i=0; i < n_vars; i++) {
+                m_prev_z_L[i] = solution.zl[i];
+                m_prev_z_U[i] = solution.zu[i];
+            }
+            for (size_t i=0; i < m_n_constraints; i++)
+                m_prev_lambda[i] = solution.lambda[i];
+        }
+    }
+
+    m_stats.deadline_hit = (std::chrono::steady_clock::now() >= deadline);
+
+    // How long the solves of the level take: at least this long, when it
+    // wasn't done in time
+    m_stats.tolerance = -1.0;
+    if (m_params.adaptive_tolerance) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - solve_start).count();
+        double & estimate = m_level_time[m_tolerance_level];
+        if (estimate < 0.0)
+            estimate = elapsed;
+        else if (m_stats.deadline_hit)
+            estimate = std::max(estimate, elapsed);
+        else
+            estimate += LEVEL_TIME_ALPHA * (elapsed - estimate);
+        for (size_t level=0; level < m_tolerance_level; level++)
+            m_level_time[level] *= LEVEL_TIME_DECAY;
+
+        double acceptable_tol;
+        int acceptable_iter;
+        tolerances(m_tolerance_level, m_stats.tolerance, acceptable_tol, acceptable_iter);
+    }
+
+    m_stats.slack = 0.0;
+    for (size_t k=0; k < m_indexes.num_slacks; k++)
+        m_stats.slack = std::max(m_stats.slack, solution_x[m_indexes.slack_start + k]);
+
+    // Failed (out of time, or not converged) without a usable answer: the
+    // last successful plan, shifted by one more step, still gives a command
+    // to publish on time, as long as it has steps left. Otherwise the
+    // caller falls back on its own
+    m_stats.fallback = FALLBACK_NONE;
+    bool shifted = (!ok and m_prev_x_OK and m_prev_x_age + 2 < m_params.steps_ahead);
+    if (shifted) {
+        shift_solution(m_prev_x.data(), m_indexes, m_params.steps_ahead, solution_x);
+        m_stats.fallback = FALLBACK_SHIFTED_PLAN;
+    }
+
+    // Keep the solution for warm starting the next solve (but only a
+    // successful one, a failed solve would be a poor starting point), or
+    // the shifted plan for the next fallback
+    if (ok or shifted) {
+        m_prev_x.resize(n_vars);
+        for (size_t i=0; i < n_vars; i++)
+            m_prev_x[i] = solution_x[i];
+    }
+    m_prev_x_age = ok ? 0 : m_prev_x_age + 1;
+    m_prev_x_OK = ok or shifted;
+
+    // Cost (logged by the caller)
+    m_stats.cost = cost;
+    m_stats.ok = ok;
+
+    // The actuations, then the predicted positions
+    result.resize(2 + 2*m_params.steps_ahead);
+    result[0] = solution_x[m_indexes.delta_start];
+    result[1] = solution_x[m_indexes.v_start];
     for (size_t i=0; i < m_params.steps_ahead; i++) {
-        result.push_back(solution.x[m_indexes.x_start + i]);
-        result.push_back(solution.x[m_indexes.y_start + i]);
+        result[2 + 2*i] = solution_x[m_indexes.x_start + i];
+        result[3 + 2*i] = solution_x[m_indexes.y_start + i];
     }
-    return result;
+    m_stats.solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - solve_start).count();
 }
@@ -1,17 +1,81 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <coin/IpSmartPtr.hpp>
 #include "Eigen-3.3/Eigen/Core"
 #include "Eigen-3.3/Eigen/QR"
+#include "IpoptLog.h"
 
 
 Eigen::VectorXd polyfit(const Eigen::VectorXd & xvals, const Eigen::VectorXd & yvals, int order);
 
 
-double polyeval(const Eigen::VectorXd coeffs, double x);
+///* The same fit to n points; degrees 1 to 3 use the allocation-free
+///* kernels from Polynomial.h
+Eigen::VectorXd polyfit(const double * xvals, const double * yvals, size_t n, int order);
 
+///* The same, into `coeffs` (which isn't reallocated if it has the right
+///* size already)
+void polyfit(const double * xvals, const double * yvals, size_t n, int order, Eigen::VectorXd & coeffs);
 
-double polyeval_diff(const Eigen::VectorXd coeffs, double x);
+///* ... from points in float (see `Params::precision`); the fit itself is
+///* still in double
+void polyfit(const float * xvals, const float * yvals, size_t n, int order, Eigen::VectorXd & coeffs);
+
+///* The fits of `count` problems of n points each, at once (see
+///* `polyfit_fixed_batch` for the layouts: the points interleaved, problem
+///* after problem, the coefficients problem after problem). Degrees 1 to 3
+///* fit several problems per instruction; the others fit one at a time
+void polyfit_batch(const double * xvals, const double * yvals, size_t n, size_t count, int order, double * coeffs);
+
+void polyfit_batch(const float * xvals, const float * yvals, size_t n, size_t count, int order, double * coeffs);
+
+
+double polyeval(const Eigen::VectorXd & coeffs, double x);
+
+
+double polyeval_diff(const Eigen::VectorXd & coeffs, double x);
+
+
+///* Value and first derivative together, in one pass
+void polyeval_with_diff(const Eigen::VectorXd & coeffs, double x, double & value, double & derivative);
+
+
+///* The reference of a step with `Params::contouring_reference`: the point
+///* of the path it's expected at [m], the heading [rad] and the curvature
+///* [1/m] (positive to the left) of the path there, in the car's frame;
+///* `REF_SAMPLE_SIZE` values per step in `coeffs`
+enum ReferenceSample { REF_X, REF_Y, REF_HEADING, REF_CURVATURE, REF_SAMPLE_SIZE };
+
+
+///* The cte and epsi of the pose (x, y, psi) of step t from its reference
+///* (see `ReferenceSample`). The lag error (along the path) slides the
+///* point to the nearest one of the path, to second order in it: the cte
+///* is the contouring error from there (as f(x) - y, positive to the right
+///* of the path), and epsi is from the heading there. `Scalar` is double,
+///* or CppAD's AD in FG_eval
+template <class Vector, class Scalar>
+void contouring_errors(const Vector & coeffs, size_t t, const Scalar & x, const Scalar & y, const Scalar & psi,
+                       Scalar & cte, Scalar & epsi) {
+    using std::cos;
+    using std::sin;
+    size_t k = REF_SAMPLE_SIZE * t;
+    Scalar dx = x - coeffs[k + REF_X];
+    Scalar dy = y - coeffs[k + REF_Y];
+    Scalar cos_heading = cos(coeffs[k + REF_HEADING]);
+    Scalar sin_heading = sin(coeffs[k + REF_HEADING]);
+    Scalar lag = cos_heading * dx + sin_heading * dy;
+    Scalar left = cos_heading * dy - sin_heading * dx;
+    cte = Scalar(0.5) * coeffs[k + REF_CURVATURE] * lag * lag - left;
+    epsi = psi - coeffs[k + REF_HEADING] - coeffs[k + REF_CURVATURE] * lag;
+}
 
 
 struct Params {
@@ -20,8 +84,45 @@ struct Params {
     double ref_v;
     double ref_v_alpha;
 
+    ///* Non-uniform time grid: the step [s] from every stage of the horizon
+    ///* to the next (`steps_ahead` - 1 of them, the last one repeated when
+    ///* fewer), e.g. fine near the car and coarse further out. Empty: `dt`
+    ///* for all of them. Not with `fixed_horizon`, `analytic_derivatives`,
+    ///* `codegen` or the Riccati solver, which have `dt` built in
+    std::vector<double> dt_steps;
+
+    ///* The step from stage t to t + 1: the last of `dt_steps` past their
+    ///* end, as the MPC repeats it
+    double step_dt(size_t t) const {
+        return dt_steps.empty() ? dt : dt_steps[std::min(t, dt_steps.size() - 1)];
+    }
+
     double latency;
 
+    ///* How far ahead the pose is projected to make up for the latency:
+    ///* "fixed", by `latency` [s], or "measured": from the stamp of the
+    ///* pose to the time the commands go out (by a running estimate of the
+    ///* time a tick takes), integrating the kinematic model
+    std::string latency_mode = "fixed";
+
+    ///* Take the pose and the speed of a tick at its start, from the latest
+    ///* samples of their streams (see StateHistory): interpolated between
+    ///* them, or extrapolated by at most `align_max_extrapolation` [s],
+    ///* instead of the latest of each, which are of different instants. The
+    ///* latency projection then starts from the start of the tick
+    bool align_inputs = false;
+    double align_max_extrapolation = 0.05;
+
+    ///* Take the pose of a tick at its start dead reckoned from the latest
+    ///* fix of the localization (see DeadReckoning), by the speed and the
+    ///* yaw rate of the odometry since (those of the IMU on imu with
+    ///* `dead_reckoning_imu`), instead of the fix itself; at most
+    ///* `dead_reckoning_max_age` [s] from the fix and from the odometry.
+    ///* Takes precedence over `align_inputs`, for the pose
+    bool dead_reckoning = false;
+    double dead_reckoning_max_age = 0.5;
+    bool dead_reckoning_imu = false;
+
     double cte_coeff;
     double epsi_coeff;
     double speed_coeff;
@@ -30,10 +131,890 @@ struct Params {
     double consec_speed_coeff;
     double consec_steer_coeff;
 
+    ///* Whether the weights of the cost (the *_coeff above) are those of
+    ///* `other`, and taking them from it
+    bool same_weights(const Params & other) const {
+        return cte_coeff == other.cte_coeff and epsi_coeff == other.epsi_coeff
+                and speed_coeff == other.speed_coeff and steer_coeff == other.steer_coeff
+                and consec_speed_coeff == other.consec_speed_coeff
+                and consec_steer_coeff == other.consec_steer_coeff;
+    }
+    void copy_weights(const Params & other) {
+        cte_coeff = other.cte_coeff;
+        epsi_coeff = other.epsi_coeff;
+        speed_coeff = other.speed_coeff;
+        steer_coeff = other.steer_coeff;
+        consec_speed_coeff = other.consec_speed_coeff;
+        consec_steer_coeff = other.consec_steer_coeff;
+    }
+
     int poly_degree;
     int num_steps_poly;
 
     bool debug;
+
+    ///* Rate [Hz] at which the debug markers are published, at most
+    double debug_rate = 10.0;
+
+    ///* Publish the compact debug view of the ticks (/mpc/debug_cpp: the
+    ///* pose, the fit and the plan, see Debug.msg) instead of the markers,
+    ///* which mpc_debug_markers builds off-board
+    bool debug_compact = false;
+
+    ///* Record the CppAD tape once (with `coeffs` and `ref_v` as dynamic
+    ///* parameters) and reuse it, and its sparsity, in every solve. This also
+    ///* switches to the native Ipopt backend: a single, long-lived
+    ///* IpoptApplication that re-optimizes MPC_NLP on every tick, keeping
+    ///* the ordering and the symbolic factorization of its KKT matrix from
+    ///* the first successful solve on (but with `max_obstacles`, whose rows
+    ///* are bounded or not from tick to tick), so that a tick only
+    ///* refactorizes numerically
+    bool persistent_tape = false;
+
+    ///* Seed every solve with the previous solution shifted by one step
+    ///* (instead of all zeros)
+    bool warm_start = false;
+
+    ///* What the warm start is (see WarmStart.h): "shift", the previous
+    ///* solution shifted by one step, or "learned", a regression from the
+    ///* problem to its solution with the weights in `warm_start_weights`
+    ///* (made by mpc_warmstart_fit), which doesn't need a previous solution.
+    ///* Not with the Riccati solver, which warm starts on its own
+    std::string warm_start_initializer = "shift";
+    std::string warm_start_weights = "";
+
+    ///* With `warm_start` and `persistent_tape`, start Ipopt from the
+    ///* multipliers of the bounds and of the constraints of the last solve
+    ///* too, shifted by one step like the variables, and from a barrier
+    ///* parameter of `warm_start_mu` (instead of 0.1), which the variables
+    ///* and the multipliers are only pushed as far into the interior as.
+    ///* The steady-state solves then take a few iterations
+    bool dual_warm_start = false;
+    double warm_start_mu = 1e-4;
+
+    ///* With `warm_start` and `lap_progress`, keep the plan of the latest
+    ///* successful solve of every stretch of the track (of
+    ///* LapWarmStarts::BIN_LENGTH, `lap_warm_start_bins` of them at most),
+    ///* and start a solve that has no last solution to shift (after a
+    ///* fallback, or a jump of the pose) from the one of its stretch on a
+    ///* previous lap, see LapWarmStarts. Only Ipopt's solves
+    bool lap_warm_start = false;
+    int lap_warm_start_bins = 1000;
+
+    ///* The solver of the optimal control problem, by name (see
+    ///* SolverBackends): "ipopt" (the NLP, as the other fields set it up),
+    ///* "riccati", "rti", "mppi", "sqp" (SQPSolver), or another registered
+    ///* backend (Ipopt when it can't solve the problem). Empty: the
+    ///* one of the flags `mppi`, `rti` and `riccati_solver`, which the
+    ///* built-in names set
+    std::string backend = "";
+
+    ///* Solve with the structure-exploiting Riccati (DDP) solver instead of
+    ///* Ipopt; its cost is linear in `steps_ahead`
+    bool riccati_solver = false;
+
+    ///* Use the FG_eval specialised at compile time for `steps_ahead` and
+    ///* `poly_degree`, when there is one (see `MPC::has_fixed_horizon`)
+    bool fixed_horizon = false;
+
+    ///* With `persistent_tape`, evaluate the NLP with the code generated at
+    ///* build time by mpc_codegen (needs the MPC_CODEGEN CMake option)
+    bool codegen = false;
+
+    ///* With `persistent_tape`, record one step of the model as a CppAD
+    ///* checkpoint function, called for every step, instead of `steps_ahead`
+    ///* copies of it: a smaller tape, cheaper to record for long horizons
+    bool checkpoint_stage = false;
+
+    ///* With `persistent_tape` (on the CppAD tape), record the sin, cos and
+    ///* atan of the stages as polynomials (see FastTrig): cheaper sweeps of
+    ///* the tape. The ticks whose initial guess has headings or slopes of
+    ///* the path beyond where they're accurate are solved by the exact
+    ///* model, taped for the solve (as without `persistent_tape`)
+    bool fast_trig = false;
+
+    ///* With `persistent_tape`, keep what the first solves would otherwise
+    ///* work out again on every start in this directory ("" not to): the
+    ///* sparsity patterns of the tape, written on first use, and the last
+    ///* solution, written when the controller is destroyed, which the first
+    ///* solves warm start from (with `warm_start`). See SolverStructure
+    std::string structure_cache = "";
+
+    ///* With `persistent_tape`, evaluate the NLP and its derivatives (and
+    ///* their sparsity) from their closed forms in KinematicModel instead
+    ///* of a CppAD tape
+    bool analytic_derivatives = false;
+
+    ///* "double", "mixed" or "float". With "mixed" and "float" the window of
+    ///* the fit goes to the car's frame in float (the fit itself stays in
+    ///* double), and with `analytic_derivatives` KinematicModel evaluates
+    ///* the Hessian ("mixed"), or everything ("float", with Ipopt's tolerance
+    ///* loosened to what float resolves), in float. The tapes stay in double
+    std::string precision = "double";
+
+    ///* With `analytic_derivatives`, the derivatives of the steps of the
+    ///* model from Eigen's AutoDiff (fixed-size, on the stack) instead of
+    ///* their closed forms; the cost's stay in closed form
+    bool autodiff_stages = false;
+
+    ///* Let Ipopt approximate the Hessian of the Lagrangian (L-BFGS) instead
+    ///* of evaluating it, the Jacobians staying exact. Ipopt starts a new
+    ///* memory at every solve; the warm start is what carries over
+    bool limited_memory_hessian = false;
+
+    ///* With `persistent_tape` (on the CppAD tape), take the Hessian of the
+    ///* cost, which is quadratic with constant weights, as a constant: it's
+    ///* evaluated once for the weights, and the Hessian of the Lagrangian
+    ///* only differentiates the constraints twice, on their own (sparser)
+    ///* pattern, then adds it
+    bool constant_cost_hessian = false;
+
+    ///* With `persistent_tape` (on the CppAD tape), evaluate the Jacobian
+    ///* and the Hessian of the main solve in this many chunks of their
+    ///* colors, on the threads of the parallel variants' pool (one more of
+    ///* them than needed for the variants if there are fewer) and the
+    ///* solving thread; 1 or less evaluates them on the solving thread
+    int parallel_derivatives = 0;
+
+    ///* With `persistent_tape` (on the CppAD tape), take the steps of the
+    ///* model out of the tape and evaluate them, their Jacobians and their
+    ///* Hessians in this many chunks of consecutive stages, on the threads
+    ///* of the parallel variants' pool as `parallel_derivatives` (see
+    ///* ParallelStages): for the models whose steps are most of the work;
+    ///* 1 or less leaves them on the tape
+    int parallel_stages = 0;
+
+    ///* Ipopt's solver of the linear (KKT) systems: "mumps", "ma27", "ma57",
+    ///* "ma86", "ma97", ... or "" for the default of Ipopt's build. Those of
+    ///* HSL are only there when Ipopt finds their library at run time
+    std::string linear_solver = "";
+
+    ///* Time a few solves with each of the linear solvers on start, and use
+    ///* the fastest one that's there instead of `linear_solver` (see
+    ///* SolverCalibration.h)
+    bool calibrate_linear_solver = false;
+
+    ///* Ipopt's update of the barrier parameter: "monotone", "adaptive", or
+    ///* "" for the default of Ipopt (monotone)
+    std::string mu_strategy = "";
+
+    ///* With `persistent_tape`, scale the NLP for Ipopt (its user-scaling)
+    ///* instead of by its gradients: every variable by the inverse of its
+    ///* typical magnitude, from its bounds or from a trajectory at `ref_v`
+    ///* over the horizon turning at full lock, each row of the model as its
+    ///* state, and the objective by the inverse of the cost of the first
+    ///* solve that converges (see `SolveStats::objective_scaling`)
+    bool nlp_scaling = false;
+
+    ///* The sparse derivatives of CppAD::ipopt::solve (without
+    ///* `persistent_tape`, or `condensed`): "both" (its forward and reverse
+    ///* sparsity options), "forward", "reverse" or "none"
+    std::string cppad_sparsity = "both";
+
+    ///* Time a few solves with each of the options of Ipopt in turn on
+    ///* start (the linear solver, then `mu_strategy`, `limited_memory_hessian`
+    ///* and `cppad_sparsity`, each with the fastest of those before it), on
+    ///* problems of the curvatures of the path of `waypoints_csv` (synthetic
+    ///* ones without it), and use the fastest (see SolverCalibration.h).
+    ///* Replaces `calibrate_linear_solver`. With `ipopt_profile`, they're
+    ///* kept in that file, and a start of the same problem (horizon,
+    ///* degree and solver flags) takes them from it without the sweep
+    bool calibrate_ipopt = false;
+    std::string ipopt_profile = "";
+
+    ///* Ipopt never writes to the console (a slow terminal would hold the
+    ///* solve up). With `persistent_tape`, its iterations and its errors and
+    ///* strong warnings go into an IpoptLog instead (see IpoptJournal),
+    ///* which the telemetry logs from its own thread
+    bool ipopt_journal = false;
+
+    ///* With `persistent_tape` (not `condensed`), give Ipopt the initial
+    ///* state as variables fixed by their bounds, which it takes out of the
+    ///* problem, instead of the rows of equality constraints that set them
+    ///* (see `MPC_NLP::fix_initial_state`): 5 variables and 5 rows fewer in
+    ///* the KKT systems (and one more of each per extra state of the model).
+    ///* The layout of the solution and of the multipliers is the same.
+    ///* Ipopt already takes the bounds of +-1e19 as no bound at all
+    bool fix_initial_state = false;
+
+    ///* Condensed (single shooting) formulation: eliminate the states by
+    ///* rolling the model out, and optimize the actuations alone, with
+    ///* CppAD::ipopt::solve. A dense NLP of 2 * (steps_ahead - 1) variables
+    ///* with bounds only, instead of a sparse one of 7 * steps_ahead - 2
+    ///* with 5 * steps_ahead equality constraints
+    bool condensed = false;
+
+    ///* Move blocking: the actuations are held over blocks of this many
+    ///* steps each (e.g. 1, 1, 2, 4, ...), so there's one pair of actuator
+    ///* variables per block instead of per step. The last block extends to
+    ///* the end of the horizon, and the blocks past it are dropped. Empty:
+    ///* every step has its own. Not with `fixed_horizon`,
+    ///* `analytic_derivatives`, `codegen` or the Riccati solver, which have
+    ///* the layout of one actuation per step built in
+    std::vector<int> input_blocks;
+
+    ///* The vehicle model of FG_eval (see VehicleModel.h): "kinematic", or
+    ///* "dynamic", a dynamic bicycle with linear tyres, whose lateral
+    ///* velocity and yaw rate are states too (initially those of the state
+    ///* passed to `MPC::Solve` after epsi, or when it doesn't have them, the
+    ///* last plan's prediction). Only through
+    ///* the tape (persistent or not): not with `fixed_horizon`,
+    ///* `analytic_derivatives`, `codegen`, `condensed`, the Riccati solver
+    ///* or the explicit table, which have the kinematic model built in
+    std::string vehicle_model = "kinematic";
+
+    ///* How FG_eval integrates the kinematic model over a step (see
+    ///* `IntegratedKinematic`): "euler", the explicit Euler step it always
+    ///* had, "rk2" (midpoint), "rk4" or "exact" (the arc of constant
+    ///* inputs), whose cte and epsi then follow from the pose. Those are
+    ///* accurate over longer steps, so that doubling `dt` and halving
+    ///* `steps_ahead` predicts as far about as well, with half the NLP.
+    ///* Like `vehicle_model`, only through the tape (persistent or not),
+    ///* and not with the dynamic model, which has substeps of its own
+    std::string integrator = "euler";
+
+    ///* Constraints besides the model and the bounds of the actuators:
+    ///* |cte| and |epsi| at the end of the horizon at most `terminal_cte`
+    ///* [m] and `terminal_epsi` [rad], and the steering angle changing by at
+    ///* most `max_steer_rate` [rad/s] from an actuation to the next. 0: none
+    double terminal_cte = 0.0;
+    double terminal_epsi = 0.0;
+    double max_steer_rate = 0.0;
+
+    ///* LQR terminal cost: the errors at the end of the horizon (and the
+    ///* last steering) also cost what the rest of the drive would, from the
+    ///* discrete Riccati equation of the kinematic model linearised at the
+    ///* reference speed of the solve, with the weights of the cost (see
+    ///* TerminalCost), so that a shorter horizon still steers into the
+    ///* corners in time. Only through the tape (persistent or not): not
+    ///* with `fixed_horizon`, `analytic_derivatives`, `codegen`,
+    ///* `condensed`, the Riccati solver, the explicit table or the other
+    ///* backends
+    bool terminal_cost = false;
+    ///* Learning MPC: with `terminal_cost` and `lap_progress`, the terminal
+    ///* cost is about a target learned from the previous laps instead of
+    ///* about the centerline, see SampledSafeSet: the states the car drove
+    ///* through on its completed laps are kept (`safe_set_size` of them at
+    ///* most, the slowest dropped first) with the time it took from each to
+    ///* the end of its lap, and the target of a solve is a blend of the
+    ///* `safe_set_neighbors` nearest to the end of the previous plan that
+    ///* get to the end of the lap first
+    bool learning_mpc = false;
+    int safe_set_neighbors = 8;
+    int safe_set_size = 20000;
+    ///* Soften them: each of them gets a slack variable (see
+    ///* `Indexes::slack_start`), by which it may be violated at a cost of
+    ///* `soft_constraint_weight` times it. The penalty is exact (the
+    ///* solution is that of the hard constraints, whenever they can be met)
+    ///* as long as the weight is above their multipliers, and the problem is
+    ///* always feasible, so Ipopt doesn't go into its restoration phase
+    ///* when the initial state can't meet them. Like `vehicle_model`, only
+    ///* through the tape (persistent or not)
+    bool soft_constraints = false;
+    double soft_constraint_weight = 1.0e4;
+
+    ///* Speed-adaptive horizon: one controller per `steps_ahead` of
+    ///* `adaptive_horizons` (e.g. 10, 15, 20), all built and warmed up at
+    ///* start-up, and the one solving is the one of the measured speed: from
+    ///* `adaptive_horizon_speeds[i]` [m/s] (one fewer, increasing) on, the
+    ///* (i + 1)-th. Empty: `steps_ahead` at any speed
+    std::vector<int> adaptive_horizons;
+    std::vector<double> adaptive_horizon_speeds;
+
+    ///* Parallel variants of every solve, solved on a thread pool along with
+    ///* it until the same deadline, each by an MPC of its own: one with the
+    ///* reference speed scaled by each of `parallel_ref_v_scales` (e.g. 0.8,
+    ///* 0.6) and, with `parallel_cold_start` (and `warm_start`), one from
+    ///* scratch. The commands are the main solve's when it succeeded, else
+    ///* those of the first variant that did (see MultiStartSolver). With
+    ///* Ipopt, its linear solver has to be reentrant
+    std::vector<double> parallel_ref_v_scales;
+    bool parallel_cold_start = false;
+
+    ///* Alternative reference paths, solved on the thread pool along with
+    ///* the centerline's until the same deadline, each by an MPC of its own:
+    ///* the lines at each of `reference_offsets` [m] to the left of the path
+    ///* (negative: to the right, e.g. -0.4, 0.4 to overtake on either side).
+    ///* The commands follow the line of the cheapest feasible solution, its
+    ///* cost plus `reference_offset_cost` per metre of offset (which brings
+    ///* the car back to the centerline once the way is clear), another line
+    ///* than the one followed having to be cheaper by
+    ///* `reference_switch_margin` (relative). See ReferenceCandidates
+    std::vector<double> reference_offsets;
+    double reference_offset_cost = 500.0;
+    double reference_switch_margin = 0.1;
+
+    ///* Proactive choice of the solver: one controller per backend of
+    ///* `predicted_backends` (comma-separated, the most optimal first, e.g.
+    ///* "ipopt,sqp,rti"), all built and warmed up at start-up, and the one
+    ///* solving a tick is the first whose solve time, as predicted from the
+    ///* problem by the models of `solve_time_model` (made by
+    ///* mpc_solvetime_fit from flight logs), fits in the time left before
+    ///* the deadline, else the fastest. "" for `backend` alone. See
+    ///* SolveTimePredictor
+    std::string predicted_backends = "";
+    std::string solve_time_model = "";
+
+    ///* Explicit MPC: look the actuations up in this table (made offline by
+    ///* mpc_tablegen, see ExplicitTable) instead of solving, wherever the
+    ///* inputs are inside its grid and the error of its cell is within
+    ///* `explicit_table_steer_tolerance` [rad] and
+    ///* `explicit_table_speed_tolerance` [m/s]; the solver only runs
+    ///* elsewhere. "" not to. The table has to be made for the same
+    ///* horizon, weights and degree
+    std::string explicit_table = "";
+    double explicit_table_steer_tolerance = 0.01;
+    double explicit_table_speed_tolerance = 0.1;
+
+    ///* Solution cache: the results of the last `solution_cache_size` solves
+    ///* (0 not to keep them), by their problems quantized to
+    ///* `solution_cache_tolerance` (cte [m], epsi [rad], the coefficients and
+    ///* the reference speed [m/s]); a problem found there isn't solved
+    ///* again, e.g. on long straights. See SolutionCache. While parked (no
+    ///* go), the same problem as the last solve is never solved again, with
+    ///* the cache or without
+    int solution_cache_size = 0;
+    double solution_cache_tolerance = 1e-3;
+
+    ///* Speculative solve: right after its commands go out, a tick starts
+    ///* solving (on a thread of its own) the problem from the pose its plan
+    ///* predicts for the next tick. The next tick takes that solution over
+    ///* when its pose is within `speculative_tolerance` [m] and
+    ///* `speculative_heading_tolerance` [rad] of the predicted one, and
+    ///* otherwise solves warm started from it. See `ControlPipeline::speculate`
+    bool speculative_solve = false;
+    double speculative_tolerance = 0.02;
+    double speculative_heading_tolerance = 0.01;
+
+    ///* Remote offload: every tick also sends its problem to
+    ///* mpc_solver_server at `remote_solver` ("host:port", "" not to), e.g.
+    ///* on a faster machine with a longer horizon or a heavier model, and
+    ///* takes its result over the node's own solve when it comes back within
+    ///* `remote_timeout` [s] of the start of the tick (and the deadline). See
+    ///* RemoteSolver. Not with obstacles nor the corridor, which aren't sent
+    std::string remote_solver = "";
+    double remote_timeout = 0.02;
+
+    ///* Check every plan before following it (see PlanValidator): its
+    ///* actuations within the actuators' range and, with the corridor, its
+    ///* positions within that of their steps by `validate_plan_tolerance`
+    ///* [m]. The PID law steers instead of a plan that isn't, as after a
+    ///* failed solve, so that solves cut short early are safe to follow
+    bool validate_plan = false;
+    double validate_plan_tolerance = 0.1;
+
+    ///* The gains of the PID law the commands fall back on when the solve
+    ///* fails with no previous plan to shift (see PIDController); those of
+    ///* run_pid_python.sh by default
+    double pid_kp_cte = 1.0;
+    double pid_ki_cte = 0.0;
+    double pid_kd_cte = 5.0;
+    double pid_kp_epsi = 1.0;
+    double pid_ki_epsi = 0.0;
+    double pid_kd_epsi = 5.0;
+
+    ///* What steers: "mpc", or "pid" for the PID law above alone (nothing is
+    ///* taped nor solved, the pipeline of the path is the same), e.g. as a
+    ///* lightweight controller, see pid_node_cpp
+    std::string controller = "mpc";
+
+    ///* Real-time iteration: one linearization and one LQ subproblem per
+    ///* tick (with the Riccati solver), instead of iterating to convergence
+    bool rti = false;
+
+    ///* Iteration budget: at most this many iterations per tick (of Ipopt,
+    ///* of the Riccati solver or of SQPSolver), the last iterate being used when they
+    ///* run out. The next tick goes on from it on the problem of its own
+    ///* initial state, so the solve converges over the ticks (as `rti`, with
+    ///* more than one step), and the compute of a tick is bounded however
+    ///* hard the problem. Needs `warm_start` with Ipopt, and works best with
+    ///* `dual_warm_start`. 0 iterates to convergence
+    int iterations_per_tick = 0;
+
+    ///* Sensitivity updates: with the Riccati solver, up to this many ticks
+    ///* after a full solve (0 disables them) only take its tangential
+    ///* predictor: the plan shifted by one step and corrected to first
+    ///* order for the new state and coefficients by a single
+    ///* back-substitution through the factors of the full solve. A full
+    ///* solve runs instead when the correction of an input is over
+    ///* `sensitivity_tolerance` ([rad], [m/s]) or puts other bounds of the
+    ///* actuators active. Not with `rti`, which is a single step already
+    int sensitivity_updates = 0;
+    double sensitivity_tolerance = 0.02;
+
+    ///* With the Riccati solver (or `rti`), solve every Gauss-Newton
+    ///* subproblem as a dense QP in the inputs with the bounds of the
+    ///* actuators as its constraints (see ActiveSetQP), hot started from the
+    ///* bounds active in the last one, instead of the Riccati recursion,
+    ///* which only clamps the inputs in the forward pass
+    bool active_set_qp = false;
+
+    ///* Gain scheduling of `rti`: its step is that of a linearization of the
+    ///* model taken from a table, made at start-up, instead of one made
+    ///* around the trajectory every tick, with the factors of the recursion
+    ///* on it (and with `active_set_qp` the condensed Hessian of the QP and
+    ///* its Cholesky factor): a tick only takes the gradients of the cost
+    ///* along its trajectory through them. The table has
+    ///* `linearization_speed_bins` bins of speed (0 for none) by
+    ///* `linearization_epsi_bins` of heading error, up to
+    ///* `linearization_max_epsi` [rad] either way, by
+    ///* `linearization_curvature_bins` of curvature of the path, up to
+    ///* `linearization_max_curvature` [1/m] either way, each linearized
+    ///* around following a path of its curvature at its speed. The ticks out
+    ///* of it, or whose step from it falls short of the decrease of the cost
+    ///* it predicts, linearize as usual. See RiccatiSolver
+    int linearization_speed_bins = 0;
+    int linearization_epsi_bins = 9;
+    double linearization_max_epsi = 0.5;
+    int linearization_curvature_bins = 1;
+    double linearization_max_curvature = 0.5;
+
+    ///* Sampling-based control (see MPPISolver) instead of Ipopt or the
+    ///* Riccati solver: every solve averages `mppi_samples` rollouts of
+    ///* perturbations of the last inputs (with these standard deviations,
+    ///* [rad] and [m/s]), weighted by exp(-cost / `mppi_temperature`), and
+    ///* rolls them out on `mppi_threads` threads. Kinematic model only
+    bool mppi = false;
+    int mppi_samples = 1024;
+    double mppi_temperature = 10.0;
+    double mppi_steer_noise = 0.1;
+    double mppi_speed_noise = 0.5;
+    int mppi_threads = 1;
+
+    ///* Anytime mode: time budget of a solve [s] from the start of the
+    ///* control tick; the best feasible iterate so far is used when it runs
+    ///* out. 0 disables it
+    double solve_deadline = 0.0;
+
+    ///* CPU time [s] after which Ipopt gives up on a solve, whatever the
+    ///* deadline; 0 for none, its iteration limit (max_iter) being the only
+    ///* one then, which doesn't depend on the load of the machine (see
+    ///* mpc_replay --deterministic)
+    double solve_time_limit = 0.5;
+
+    ///* With `persistent_tape`, give up on a solve that's going nowhere at
+    ///* the iteration it shows (from Ipopt's intermediate callback), rather
+    ///* than at the deadline or `solve_time_limit`: from the iteration
+    ///* `divergence_min_iterations` on, when the primal infeasibility grows
+    ///* past `divergence_inf_pr_growth` times its lowest of the solve, when
+    ///* the primal step is below `divergence_min_alpha` for
+    ///* `divergence_small_steps` iterations in a row, or when the
+    ///* restoration phase goes on for `divergence_restoration_iterations`
+    ///* iterations (0 disables a test). The solve fails, straight to the
+    ///* fallbacks
+    bool abort_divergence = false;
+    int divergence_min_iterations = 3;
+    double divergence_inf_pr_growth = 1e3;
+    double divergence_min_alpha = 1e-4;
+    int divergence_small_steps = 3;
+    int divergence_restoration_iterations = 10;
+
+    ///* Adaptive termination: with a deadline, Ipopt's tolerances follow the
+    ///* time left for the solve. They're the tightest of a few levels, from
+    ///* Ipopt's defaults (full convergence) to `relaxed_tol` and
+    ///* `relaxed_acceptable_tol` with a stop at the first acceptable point,
+    ///* whose solves are expected (by running estimates of their times) to
+    ///* be done in time. Not with the Riccati solver, which has tolerances
+    ///* of its own
+    bool adaptive_tolerance = false;
+    double relaxed_tol = 1e-4;
+    double relaxed_acceptable_tol = 1e-2;
+
+    ///* When the node solves: "rate" at `loop_rate` [Hz] (with the period
+    ///* as the default deadline), or "pose" on every new pose. Either way
+    ///* only when the inputs have changed since the last solve
+    std::string scheduler = "rate";
+    double loop_rate = 100.0;
+
+    ///* Let the "rate" scheduler find the highest rate its ticks sustain (see
+    ///* RateGovernor), between `governor_min_rate` and `loop_rate` [Hz],
+    ///* with at most `governor_miss_ratio` of the ticks missing their
+    ///* deadline. The deadline of the solves (unless `solve_deadline` sets
+    ///* it) and the speculative solve follow the rate; not pipelined
+    bool rate_governor = false;
+    double governor_min_rate = 20.0;
+    double governor_miss_ratio = 0.01;
+
+    ///* Multi-rate control: between the solves, a loop of its own follows
+    ///* the latest plan of the MPC at `tracking_rate` [Hz] and publishes its
+    ///* commands, from the freshest pose (see PlanFollower), so that the
+    ///* commands go out faster than the MPC solves. 0 disables it
+    double tracking_rate = 0.0;
+
+    ///* Fixed-rate actuation: the commands go out at `actuation_rate` [Hz]
+    ///* from a timer thread of their own, interpolated along the latest
+    ///* plan for the instant they go out at (see `plan_inputs_at`), instead
+    ///* of whenever a tick finishes, so that their timing doesn't jitter
+    ///* with the solves. The commands of the latest tick go out while there's
+    ///* no plan to follow (after a fallback, or stopped). 0 disables it; not
+    ///* with `tracking_rate`, which publishes the commands already
+    double actuation_rate = 0.0;
+
+    ///* Run the path stage of a tick (the latency projection, the closest
+    ///* waypoint, the window and the fit, see `ControlPipeline::prepare`) on
+    ///* a thread of its own, while the solver loop is still solving the
+    ///* previous tick: the problems are handed over in a queue of slots
+    ///* allocated up front, and the solver loop takes the newest
+    bool pipelined = false;
+
+    ///* Search for the closest waypoint only around the previous one, see
+    ///* `MPCControllerNode::find_closest_tracked`
+    bool windowed_closest = false;
+
+    ///* With `windowed_closest`: project the car onto the segments between
+    ///* the waypoints of the window (vectorized, see PathSegments) rather
+    ///* than take the nearest waypoint, so the arc length the spline
+    ///* reference, the contouring reference and the corridor start from
+    ///* moves smoothly between the waypoints, as with `lap_progress`
+    bool projected_closest = false;
+
+    ///* Track the car's progress along the path (the arc length and the
+    ///* lateral offset of its projection on the segments between the
+    ///* waypoints) from tick to tick instead of searching the closest
+    ///* waypoint, and index the window of the fit by it, see LapProgress.
+    ///* Overrides `windowed_closest`
+    bool lap_progress = false;
+
+    ///* Fit the reference polynomial to samples of a spline of the
+    ///* centerline (built once per path) instead of to the raw waypoints
+    bool spline_reference = false;
+
+    ///* Contouring reference: instead of fitting a polynomial to the window,
+    ///* take the reference of every step of the horizon from the spline of
+    ///* the centerline (see PathSpline) where the reference speed takes the
+    ///* car along it by then, as `coeffs` (see `ReferenceSample`; dynamic
+    ///* parameters of the tape with `persistent_tape`). The cte and epsi of
+    ///* a step are then its contouring and heading errors from there (see
+    ///* `contouring_errors`), so there's no fit to degenerate in a hairpin.
+    ///* Like `vehicle_model`, only through the tape (persistent or not)
+    bool contouring_reference = false;
+
+    ///* The size of the `coeffs` of a solve
+    size_t num_coeffs() const {
+        return contouring_reference ? REF_SAMPLE_SIZE * steps_ahead : size_t(poly_degree + 1);
+    }
+
+    ///* Update the fit of the polynomial as the window of waypoints slides
+    ///* along the path instead of refitting it every tick, see SlidingPolyFit
+    bool incremental_fit = false;
+
+    ///* Precompute, when a path arrives, the moments of the window of every
+    ///* waypoint (see WindowMoments), so each tick only maps them into the
+    ///* car's frame; takes precedence over `incremental_fit`
+    bool precomputed_fit = false;
+
+    ///* Fit the polynomial in the same pass that reads the window from the
+    ///* path (see `polyfit_transformed`), without the buffers of its points:
+    ///* for the windows of `PaddedRing` spans that `incremental_fit` and
+    ///* `precomputed_fit` don't take, with degrees 1 to 3. A window with a
+    ///* point that would break the fit is made as without it
+    bool fused_fit = false;
+
+    ///* Shape the window of the fit by the curvature of the path (worked out
+    ///* per waypoint when a path arrives): every few waypoints of the same
+    ///* stretch on a straight, and cut short where the path winds enough to
+    ///* break the fit (see `PathTracker::MAX_WINDOW_TURN`), within the
+    ///* `num_steps_poly` waypoints. The cut windows and the thinned ones are
+    ///* fit from scratch, not by `incremental_fit` or `precomputed_fit`
+    bool adaptive_window = false;
+
+    ///* Resample the path at `pyramid_levels` resolutions (0: none) when it
+    ///* arrives, each CenterlinePyramid::FACTOR times as sparse as the
+    ///* previous one from about the spacing of the waypoints (see
+    ///* CenterlinePyramid): the `num_steps_poly` points of the window of the
+    ///* fit are shared out between the levels, the near ones fine and the
+    ///* far ones coarse, so the window reaches farther ahead for the same
+    ///* points, and the corridor of every stage is looked up on a level as
+    ///* fine as the stages are apart. Takes precedence over
+    ///* `spline_reference`, `adaptive_window` and the fits of the raw
+    ///* windows (`incremental_fit`, `precomputed_fit`, `fused_fit`)
+    int pyramid_levels = 0;
+
+    ///* Keep the waypoints in fixed point too (see CompactTrack), a quarter
+    ///* of the bytes, which the search of the closest waypoint around the
+    ///* previous one (`windowed_closest`) scans instead of the doubles
+    bool compact_waypoints = false;
+
+    ///* The waypoints copied past both ends of the path (see PaddedRing), so
+    ///* that the window of the fit across the start line is a contiguous
+    ///* span of them: 0 for as many as the windows reach past the ends,
+    ///* negative for none (the window then wraps point by point)
+    int ring_margin = 0;
+
+    ///* Reuse the last fit while the car (its pose projected by the latency)
+    ///* is within `fit_reuse_distance` [m] and `fit_reuse_angle` [rad] of
+    ///* where it was fit: it's moved into the car's frame instead of
+    ///* searching the closest waypoint and fitting the window again (e.g.
+    ///* while parked, waiting for go). With the solution cache, a tick that
+    ///* didn't move is then answered without a solve either. Not with
+    ///* `contouring_reference`. 0 disables it
+    double fit_reuse_distance = 0.0;
+    double fit_reuse_angle = 0.02;
+
+    ///* Take the reference speed of every tick from a profile of the path
+    ///* (built once per path, see SpeedProfile) at the car's progress along
+    ///* it: the fastest speed that keeps within `max_lateral_accel` in the
+    ///* turns, and `max_accel` and `max_decel` [m/s^2] between them, capped
+    ///* by `ref_v`. Instead of slowing down by how much of the window of
+    ///* the fit is real (with `ref_v_alpha`)
+    bool speed_profile = false;
+    double max_lateral_accel = 4.0;
+    double max_accel = 2.0;
+    double max_decel = 4.0;
+
+    ///* Keep the car within the track: `corridor_width` [m] is the half
+    ///* width of the track about the path (0: no corridor), and the car's
+    ///* center stays `corridor_margin` [m] (e.g. half its width) inside it,
+    ///* and short of the center of a tight turn. The sides are worked out
+    ///* for every waypoint when the path arrives (see `Centerline::corridor_left`),
+    ///* and every tick bounds the cross track error of each step of the
+    ///* horizon by those of the waypoint it's expected at (see
+    ///* `MPC::set_cte_bounds`), so the plan may use the whole width, and the
+    ///* NLP doesn't grow. Not with `condensed`, the Riccati solver or the
+    ///* explicit table, which have no cross track error to bound
+    double corridor_width = 0.0;
+    double corridor_margin = 0.15;
+
+    ///* Keep clear of the obstacles on the "obstacles" topic (static or
+    ///* moving, see ObstacleSelector), by `obstacle_margin` [m] (e.g. half
+    ///* the width of the car) from their edges: every step of the plan is
+    ///* constrained to be that far from each of the `max_obstacles` (0:
+    ///* none) that come closest to the previous plan. The slots are there
+    ///* whatever the scene (unused ones without bounds), so the NLP, its
+    ///* tape and their sparsity never change, and with `persistent_tape`
+    ///* the centers of the obstacles are dynamic parameters of the tape.
+    ///* Like `vehicle_model`, only through the tape (persistent or not)
+    int max_obstacles = 0;
+    double obstacle_margin = 0.2;
+
+    ///* Where the path comes from: "marker" (the Marker on /centerline),
+    ///* "numpy" (the packed floats on /centerline_numpy, with the yaw and
+    ///* speed columns) or "shared" (the `track_store` file of
+    ///* track_store_node, mapped whenever /centerline_store announces a new
+    ///* path, with its grid and spline already built, see TrackStore)
+    std::string centerline_format = "marker";
+    std::string track_store = "/dev/shm/mpc_track";
+
+    ///* How the commands go out: "separate", the servo position and the
+    ///* motor speed on /commands/servo/position and /commands/motor/speed
+    ///* (two unstamped Float64), "combined", in one stamped mpc/Commands on
+    ///* /commands/combined (with the stamp of the pose and the status of the
+    ///* solve), or "both"
+    std::string commands = "separate";
+
+    ///* Also write the commands straight to the VESC on this serial port
+    ///* (e.g. "/dev/ttyACM0", "" not to), ahead of the topics, which then
+    ///* only mirror them (see VescSerial): the driver's node must not write
+    ///* them to the VESC too
+    std::string vesc_port = "";
+
+    ///* Publish the plan of every solved tick, all the stages of the horizon
+    ///* with their times, states and inputs, as an mpc/Plan on /mpc/plan
+    ///* (see `ControlPipeline::plan`), for a driver to interpolate when a
+    ///* solve is late
+    bool publish_plan = false;
+
+    ///* Load the path from this waypoints CSV (see `load_waypoints`) instead
+    ///* of waiting for it on a topic, keeping every waypoint at least
+    ///* `waypoints_spacing` [m] from the previous one; "" to use the topic
+    std::string waypoints_csv = "";
+    double waypoints_spacing = 0.05;
+
+    ///* Stream the path from this tiled route (see RouteStreamer, written by
+    ///* mpc_route_tiles) instead: only the tiles about the car are read,
+    ///* `route_tiles_behind` behind the one it's in and `route_tiles_ahead`
+    ///* ahead of it, and the path is swapped for theirs whenever it moves on
+    ///* to another tile. Takes precedence over `waypoints_csv`; "" to load
+    ///* the whole path
+    std::string route_tiles = "";
+    int route_tiles_behind = 1;
+    int route_tiles_ahead = 2;
+
+    ///* Take patches of the path from /centerline_patch (see
+    ///* msg/CenterlinePatch.msg): the span they replace is taken in with
+    ///* the spline solved again about it only (see
+    ///* `PathTracker::patch_centerline`), into a new copy of the centerline
+    ///* so that a solve under way keeps the one it started with. The path
+    ///* it patches re-published is then the current one still
+    bool centerline_patches = false;
+
+    ///* Prepare the new paths (see `ControlPipeline::prepare_centerline`)
+    ///* on a thread of their own (see CenterlinePreparer) instead of in the
+    ///* callback they arrive in, and swap them in with the next pose, so
+    ///* that a long path never holds the poses up. The path loaded on start
+    ///* (`waypoints_csv`) is prepared before anything runs anyway
+    bool background_centerline = false;
+
+    ///* Take the poses (with the odometry, the IMU and the scans of the
+    ///* particle filter), the paths (with the obstacles and the patches)
+    ///* and /signal/go through callback queues of their own, each with a
+    ///* spinner thread, instead of the node's, so that a pose never waits
+    ///* for a path to be read
+    bool callback_queues = false;
+
+    ///* The transport of the odometry, the poses, the IMU and /signal/go:
+    ///* "tcp", "tcp_nodelay" (without Nagle's delay), or "udp" (UDPROS,
+    ///* over TCP without Nagle's delay from a publisher that hasn't it)
+    std::string pose_transport = "tcp";
+
+    ///* On an emergency stop (0 on /signal/go), send the neutral commands
+    ///* (`ControlPipeline::CENTER_IN_DZIK`, 0 rpm) right from its callback
+    ///* instead of with the next tick, and cancel the solve of a tick with
+    ///* go that's in flight (through Ipopt's intermediate callback, with
+    ///* `persistent_tape`); until the next go, the commands of the loops
+    ///* are the neutral ones too. With `callback_queues`, the callback has
+    ///* a thread of its own
+    bool priority_stop = false;
+
+    ///* On a fault with go, the localization lost (no pose for
+    ///* `contingency_pose_timeout` [s], or the inputs missing) or nothing
+    ///* of the solver's left to drive with (the PID fallback), stop along a
+    ///* braking trajectory kept ready from the latest plan (see
+    ///* ContingencyPlanner), slowing down at `contingency_decel` [m/s^2]
+    ///* along the plan and the path past it, instead of the abrupt neutral
+    ///* commands or the PID law; until a tick without a fault. 0 disables it
+    double contingency_decel = 0.0;
+    double contingency_pose_timeout = 0.25;
+
+    ///* Run the stages of a solved tick after its solve (the commands, the
+    ///* speculative solve, the plan to the tracking loop and its topic, the
+    ///* flight record and the debug markers) as a graph of tasks (see
+    ///* TaskGraph), each once those it needs are done, on a thread besides
+    ///* the solver loop's, instead of one after the other; the node logs
+    ///* the times of every stage when it's done
+    bool task_graph = false;
+
+    ///* Localize in the node itself (see ParticleFilter) instead of taking
+    ///* the pose from pf/pose/odom: from the scans of /scan in the map of
+    ///* /map, moved by the odometry of /odom, from the pose of /initialpose.
+    ///* With `pf_particles` particles, weighted by `pf_beams` beams of every
+    ///* scan up to `pf_max_range` [m], on `pf_threads` threads besides the
+    ///* callbacks'. The noise of the motion model, per update, is
+    ///* `pf_noise_x`, `pf_noise_y` [m] and `pf_noise_theta` [rad], that of
+    ///* the hits of the sensor model `pf_sigma_hit` [m]
+    bool particle_filter = false;
+    int pf_particles = 2000;
+    int pf_beams = 60;
+    double pf_max_range = 10.0;
+    int pf_threads = 2;
+    double pf_noise_x = 0.05;
+    double pf_noise_y = 0.025;
+    double pf_noise_theta = 0.25;
+    double pf_sigma_hit = 0.4;
+    ///* Look the expected ranges of the beams up in a table of those from
+    ///* every cell along `pf_range_bins` directions, cast once per map,
+    ///* instead of casting them for every particle (see ParticleFilter)
+    bool pf_range_table = false;
+    int pf_range_bins = 120;
+
+    ///* Log one in every this many ticks of each group of the telemetry
+    ///* (0 silences it), see Telemetry
+    int log_events_every = 1;
+    int log_fit_every = 1;
+    int log_actuators_every = 1;
+    int log_cost_every = 1;
+    int log_timing_every = 1;
+    int log_ipopt_every = 1;
+
+    ///* Real-time profile of the solver loop: pin it to the core `rt_cpu`
+    ///* (-1 not to), run it with the SCHED_FIFO priority `rt_priority` (0 not
+    ///* to), lock the memory of the node (`rt_lock_memory`), and solve
+    ///* `warmup_solves` times at start-up, so that the heaps and the tapes
+    ///* are faulted in before the first real solve. See RealTime.h
+    int rt_cpu = -1;
+    int rt_priority = 0;
+    bool rt_lock_memory = false;
+    int warmup_solves = 0;
+    ///* Make the MPCs of the controllers (of the horizons, the backends, the
+    ///* parallel variants and the reference lines) at start-up all at once,
+    ///* on all the cores, each warmed up by `warmup_solves` solves on the
+    ///* thread that made it, instead of one after the other (see
+    ///* ParallelBuild). Either way, /signal/go is only taken once they're
+    ///* all warmed up
+    bool parallel_build = false;
+    ///* Admission of the configuration at start-up (see `admit` in
+    ///* SolverCalibration.h): the 99th percentile of the times of
+    ///* `admission_solves` solves of problems like those of the path has to
+    ///* be within `admission_budget` of the control period (`solve_deadline`
+    ///* if set, the period of `loop_rate` otherwise). When it isn't, "warn"
+    ///* logs the times, "refuse" stops the node from starting, and
+    ///* "downgrade" takes the first horizon (down to `admission_min_steps`)
+    ///* and backend (that of the parameters, then those of the
+    ///* comma-separated `admission_backends`) that is, else refuses. ""
+    ///* doesn't check. Of the solver of the parameters alone, without the
+    ///* load of the rest of the node
+    std::string admission = "";
+    int admission_solves = 100;
+    double admission_budget = 0.8;
+    int admission_min_steps = 8;
+    std::string admission_backends = "rti";
+    ///* Period [s] of the latency histograms of the stages of the ticks on
+    ///* /mpc/stats and /diagnostics (0 not to publish them); the ticks that
+    ///* take longer than the control period (`solve_deadline` if set, the
+    ///* period of `loop_rate` otherwise) are counted as overruns
+    double stats_period = 1.0;
+    ///* Count the cycles, the instructions, the cache misses and the branch
+    ///* misses of the stages of the pipeline with the hardware counters of
+    ///* the solver loop's thread (see PerfCounters), onto /mpc/stats and
+    ///* /diagnostics (per tick: the means over the window, and the IPC)
+    bool perf_counters = false;
+    ///* Measure the CPU time of the stages on the threads that run them
+    ///* (see `thread_cpu_time`), onto /mpc/stats (the mean per tick) and
+    ///* /diagnostics, where it's also summed per backend (see
+    ///* `predicted_backends`): the share of the stages' time the solver
+    ///* loop was actually running, and the cost of each backend. Solves
+    ///* parallel over a pool only count the solver loop's share
+    bool cpu_time = false;
+    ///* The sysfs file of the sensor of the board's power rail (e.g.
+    ///* "/sys/class/hwmon/hwmon0/power1_input"), read at the end of every
+    ///* tick for its energy, whose means per tick and per backend go onto
+    ///* /diagnostics (see PowerRail), in units of `power_rail_scale` [W]
+    ///* (1e-6 for hwmon, 1e-3 for the INA3221 of a Jetson); "" not to
+    std::string power_rail = "";
+    double power_rail_scale = 1e-6;
+    ///* Send a summary of the stats windows (the latencies of the stages,
+    ///* the overruns, the deadline hits, the failed solves, the cross-track
+    ///* error and the CPU load, see TelemetryUplink) to the
+    ///* mpc_telemetry_collector of the base station at `uplink`
+    ///* ("host:port", "" not to) every `uplink_period` [s] (at least 0.1),
+    ///* as vehicle `uplink_vehicle`; needs `stats_period`
+    std::string uplink = "";
+    double uplink_period = 5.0;
+    int uplink_vehicle = 0;
+    ///* Fill CppAD's memory pool with this much [MiB] from the start (0 not
+    ///* to), so that the first solves don't grow it, and give what it holds
+    ///* for reuse back to the system whenever it's over `cppad_cap_mb` [MiB]
+    ///* after a solve (0: no cap). Its use, the tapes, Ipopt's problems and
+    ///* the resident set of the node go to /mpc/memory (see MemoryStats)
+    double cppad_reserve_mb = 0.0;
+    double cppad_cap_mb = 0.0;
+    ///* Trace the scopes of the ticks and the solver (see Trace.h), and dump
+    ///* them into `trace_directory` on a missed deadline and on
+    ///* /mpc/dump_trace
+    bool trace = false;
+    std::string trace_directory = "/tmp";
+    ///* What the node measures of itself from the start: "off", "counters",
+    ///* "histograms" or "trace" (see Instrumentation.h; `trace` makes it
+    ///* "trace"), switched at runtime with /mpc/set_instrumentation
+    std::string instrumentation = "histograms";
+    ///* Record every tick of the solver loop (its inputs, problem, solution,
+    ///* commands and timings) into the ring of the last
+    ///* `flight_recorder_ticks` in the file `flight_recorder` ("" not to),
+    ///* see FlightRecorder; mpc_replay solves them again
+    std::string flight_recorder = "/tmp/mpc_flight.log";
+    int flight_recorder_ticks = 36000;
+    ///* Keep the latest tick (its pose, problem, fit window, plan and
+    ///* timings) in the shared memory of the file `live_view` ("" not to,
+    ///* e.g. /dev/shm/mpc_live_view), for the visualization tools on the
+    ///* same machine to poll instead of the debug markers: see LiveView
+    std::string live_view = "";
+    ///* Serve the allocations of the solver loop's ticks from an arena of
+    ///* this much [MiB] of huge pages (0 not to), reset after each tick,
+    ///* instead of from the heap: see TickArena. Only mpc_node_cpp's
+    ///* operator new goes through it (not the nodelet's, nor the other
+    ///* nodes'). Its high-water mark, the allocations that didn't fit and
+    ///* the ticks it couldn't be reset after go to /mpc/memory
+    double tick_arena_mb = 0.0;
 };
 
 
@@ -46,6 +1027,42 @@ struct Indexes {
     size_t epsi_start;
     size_t delta_start;
     size_t v_start;
+
+    ///* The extra states of the vehicle model (see `Params::vehicle_model`),
+    ///* `steps_ahead` of each from `extra_start` (between epsi and the
+    ///* actuations), none with the kinematic model
+    size_t extra_start = 0;
+    size_t num_extra = 0;
+    size_t steps_ahead = 0;
+
+    ///* The variable of extra state e at step t
+    size_t extra(size_t e, size_t t) const { return extra_start + e * steps_ahead + t; }
+
+    ///* With move blocking (see `Params::input_blocks`), the block of every
+    ///* step; empty when every step is a block of its own
+    std::vector<size_t> block;
+
+    ///* The variables of the actuations of step t
+    size_t delta(size_t t) const { return delta_start + (block.empty() ? t : block[t]); }
+    size_t v(size_t t) const { return v_start + (block.empty() ? t : block[t]); }
+
+    ///* The constraints of `Params::terminal_cte`, `terminal_epsi` and
+    ///* `max_steer_rate`, in this order, `num_slacks` of them: their slack
+    ///* variables from `slack_start` (after the actuations), and their
+    ///* pairs of rows (the constraint minus the slack below its bound, plus
+    ///* the slack above minus it) from `soft_start`, after those of the model
+    size_t slack_start = 0;
+    size_t num_slacks = 0;
+    size_t soft_start = 0;
+
+    ///* The distances to the obstacles of `Params::max_obstacles`: a row for
+    ///* every step but the first of each of the `num_obstacles` slots, from
+    ///* `obstacle_start` (after the soft rows)
+    size_t obstacle_start = 0;
+    size_t num_obstacles = 0;
+
+    ///* The row of slot j at step t (from 1)
+    size_t obstacle(size_t j, size_t t) const { return obstacle_start + j * (steps_ahead - 1) + t - 1; }
 };
 
 
@@ -54,6 +1071,93 @@ double Lf();
 
 double delta_constraint();
 
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+class MPC_NLP;
+struct MemoryStats;
+class SolverStructure;
+class SolverBackend;
+class ExplicitTable;
+class WarmStartInitializer;
+
+
+///* Where the commands of a failed solve come from, fastest first: the last
+///* successful plan of the MPC, shifted by the steps since, then the PID law
+///* (by ControlPipeline)
+enum Fallback : uint8_t {
+    FALLBACK_NONE,
+    FALLBACK_SHIFTED_PLAN,
+    FALLBACK_PID
+};
+
+
+///* What a solve reports about itself (see `MPC::stats`); -1 where the solver
+///* doesn't tell
+struct SolveStats {
+    bool ok = false;
+    bool deadline_hit = false;
+    double cost = 0.0;
+
+    ///* Iterations, and whether Ipopt went through its restoration phase
+    ///* (a poor initial guess, or an infeasible problem)
+    int iterations = 0;
+    bool restoration = false;
+
+    ///* Whether the solve was given up on as diverging (see
+    ///* `Params::abort_divergence`)
+    bool diverged = false;
+
+    ///* Largest violation of the constraints by the solution, unscaled
+    double constraint_violation = -1.0;
+
+    ///* Wall-clock time [s] of the whole solve, of the evaluations of the
+    ///* model and its derivatives, and of the factorizations and back-solves
+    ///* of the linear (KKT) systems
+    double solve_time = 0.0;
+    double eval_time = -1.0;
+    double linear_solver_time = -1.0;
+
+    ///* Largest slack of the soft constraints (see
+    ///* `Params::soft_constraints`), by how much the solution violates them;
+    ///* 0 without them
+    double slack = 0.0;
+
+    ///* Ipopt's `tol` the solve ran with, with `Params::adaptive_tolerance`
+    ///* (-1 otherwise)
+    double tolerance = -1.0;
+
+    ///* The factor of the objective for Ipopt, with `Params::nlp_scaling`
+    ///* (-1 otherwise); 1 until a solve has converged
+    double objective_scaling = -1.0;
+
+    ///* Whether the actuations were looked up in the explicit table (see
+    ///* `Params::explicit_table`) rather than solved for
+    bool explicit_law = false;
+
+    ///* Whether the solve started from the plan of a previous lap (see
+    ///* `MPC::set_lap_seed`)
+    bool lap_seeded = false;
+
+    ///* What the result of a failed solve is, FALLBACK_NONE when it's the
+    ///* solver's own last iterate
+    Fallback fallback = FALLBACK_NONE;
+
+    ///* What Ipopt reported, with `Params::ipopt_journal` (nullptr without
+    ///* it); the solver's own, until its next solve
+    const IpoptLog * ipopt_log = nullptr;
+};
+
+namespace Ipopt {
+    class IpoptApplication;
+}
+
+///* An MPC is used by one thread at a time. MPCs can be solved on several
+///* threads at once, each with its own tapes, from the threads of pools set
+///* up for CppAD, or from threads holding a `ParallelCppAD::Thread` (see
+///* ParallelCppAD for what's guaranteed)
 class MPC {
 public:
     MPC(const Params & p);
@@ -62,12 +1166,268 @@ public:
 
     // Solve the model given an initial state and polynomial coefficients.
     // Return the first actuations.
-    std::vector<double> Solve(const Eigen::VectorXd state, const Eigen::VectorXd coeffs, const double new_ref_v);
+    //
+    // The solve is cut short at `deadline` (wall-clock), see `deadline_hit`.
+    std::vector<double> Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double new_ref_v,
+                              const std::chrono::steady_clock::time_point & deadline
+                                    = std::chrono::steady_clock::time_point::max());
+
+    // The same, into `result`: the actuations, followed by the predicted
+    // (x, y) of every step. `result` is only reallocated the first time
+    void Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double new_ref_v,
+               std::vector<double> & result,
+               const std::chrono::steady_clock::time_point & deadline
+                    = std::chrono::steady_clock::time_point::max());
+
+    // Whether the solves, once warmed up, make no heap allocations (besides
+    // those Ipopt makes on its own): with `persistent_tape` or the Riccati
+    // solver, but not through CppAD::ipopt::solve, which records a new tape
+    // every time
+    bool allocation_free() const;
+
+    // Adds the sizes of the tape and of Ipopt's problem of the persistent
+    // NLP (see MemoryStats), nothing for the other solvers
+    void memory_stats(MemoryStats & stats) const;
+
+    // The bound on the speed of the plans [m/s]
+    double speed_upperbound() const { return SPEED_UPPERBOUND; }
+
+    // The weights of the cost of `params` (its other fields are ignored),
+    // from the next solve on. Without re-taping: the weights are dynamic
+    // parameters of the persistent tape. False when they're baked into the
+    // derivative code (`codegen`), the controller has to be rebuilt then.
+    // The explicit table, made for the old weights, is no longer used
+    bool set_weights(const Params & params);
+
+    // Bounds on the cross track error of every step of the horizon (those
+    // of the corridor, see `Params::corridor_width`), from the next solve
+    // on: the first `steps_ahead` of the `n`, the last one repeated when
+    // there are fewer. The initial cte stays within them, when the car is
+    // out of the corridor already. Ignored without `corridor_width`
+    void set_cte_bounds(const double * lower, const double * upper, size_t n);
+
+    // The obstacles of every slot (see `Params::max_obstacles`), from the
+    // next solve on: at s = j * n + t for slot j and step t (the last of
+    // the `n` repeated for the steps after it), its center in the car's
+    // frame (x at 2 s, y at 2 s + 1) and how far from it the car keeps (at
+    // s, 0 for none), as ObstacleSelector fills them
+    void set_obstacles(const double * positions, const double * clearances, size_t n);
+
+    // The target (cte [m], epsi [rad], steering [rad]) of the terminal cost
+    // from the next solve on, instead of 0 (see TerminalCost and
+    // SampledSafeSet). Ignored without `terminal_cost`
+    void set_terminal_target(double cte, double epsi, double delta);
+
+    // A flag that, once raised, cancels the solve in flight (see
+    // `MPC_NLP::set_cancel_flag`), from the next solve on; null for none.
+    // Only Ipopt's solves with `persistent_tape` go through the
+    // intermediate callback that reads it, the others run to the end
+    void set_cancel_flag(const std::atomic<bool> * cancel);
+
+    // Forget the last solution: the next solve isn't warm started from it
+    // (but from the solution of the structure cache, if there's one), nor
+    // falls back on it (e.g. when this controller takes over from another
+    // one, and its last solution is from long ago)
+    void reset_warm_start();
+
+    // The plan of the same stretch of the track on a previous lap (see
+    // LapWarmStarts), `n` variables in the layout of `indexes()`: the next
+    // solves start from it (instead of from the structure cache's) when
+    // there's no last solution, or when the last solve failed and it was
+    // shifted. Null, or one of another size, for none. Only Ipopt's solves
+    void set_lap_seed(const double * x, size_t n);
+
+    // Evaluate the derivatives of the solves on the threads of `pool` too,
+    // with `Params::parallel_derivatives` (see ParallelDerivatives), or
+    // share it with the backend (see `SolverBackend::set_pool`); the pool
+    // must be set up for CppAD and outlive this controller
+    void set_derivative_pool(Eigen::ThreadPoolInterface * pool);
+
+    // Whether the last solution goes into the structure cache when this
+    // controller is destroyed (see `Params::structure_cache`); the parallel
+    // variants' don't
+    void set_saves_solution(bool saves) { m_saves_solution = saves; }
+
+    // Where the solves start from with `warm_start` (that of
+    // `warm_start_initializer` by default); `initializer` works on the
+    // layout of `indexes()`
+    void set_initializer(std::unique_ptr<WarmStartInitializer> initializer);
+    const Indexes & indexes() const { return m_indexes; }
+
+    // The variables of the last successful solve, in the layout of
+    // `indexes()` (empty before the first one)
+    const std::vector<double> & last_solution() const { return m_prev_x; }
+    size_t num_vars() const { return m_n_vars; }
+
+    // Whether the deadline cut the last solve short. The result is then the
+    // best feasible iterate found by then or, when there was none, the
+    // fallback (see `SolveStats::fallback`)
+    bool deadline_hit() const { return m_stats.deadline_hit; }
+
+    // Cost of the last solution, and whether the last solve succeeded
+    double cost() const { return m_stats.cost; }
+    bool ok() const { return m_stats.ok; }
+
+    // Iterations of the last solve; -1 when it's not known (through
+    // CppAD::ipopt::solve)
+    int iterations() const { return m_stats.iterations; }
+
+    // Time [s] the last solve spent evaluating the model and its derivatives
+    // (the sweeps of the tape, the generated code, or the linearizations of
+    // the Riccati solver), the rest being the solver's own; -1 when it's not
+    // known (through CppAD::ipopt::solve, which tapes and differentiates on
+    // its own)
+    double eval_time() const { return m_stats.eval_time; }
+
+    // All of the above, and where the rest of the time of the last solve
+    // went (the linear solver's share is only known from Ipopt, with
+    // `persistent_tape`)
+    const SolveStats & stats() const { return m_stats; }
+
+    // Whether there's a compile-time specialisation of FG_eval for the
+    // given horizon and polynomial degree
+    static bool has_fixed_horizon(size_t steps_ahead, int poly_degree);
 
 private:
+    ///* The time limit of CppAD::ipopt::solve (the last line of `m_options`),
+    ///* after the tolerances of `m_tolerance_level` with `adaptive_tolerance`
+    void set_time_limit(const std::chrono::steady_clock::time_point & deadline);
+
+    ///* The tightest level of the tolerances whose solves are expected to be
+    ///* done by `deadline`, and Ipopt's options of a level (see
+    ///* `Params::adaptive_tolerance`)
+    size_t tolerance_level(const std::chrono::steady_clock::time_point & deadline) const;
+    void tolerances(size_t level, double & tol, double & acceptable_tol, int & acceptable_iter) const;
+
+    ///* The actuations from the explicit table, and the path of holding
+    ///* them over the horizon, into `result`; false where the table has no
+    ///* answer (the solver's turn then)
+    bool lookup_explicit(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double new_ref_v,
+                         std::vector<double> & result);
+
+    ///* Whether the headings of the initial guess `vars` and the slopes of
+    ///* the path of `coeffs` over the horizon (as far as the guess or the
+    ///* reference speed `ref_v` goes) are where the polynomials of
+    ///* `fast_trig` are accurate
+    bool fast_trig_in_range(const double * vars, const Eigen::VectorXd & coeffs, double ref_v) const;
+
     Params m_params;
     Indexes m_indexes;
+    ///* Whether `vehicle_model` is the dynamic one (the kinematic one
+    ///* otherwise)
+    bool m_dynamic_model;
+    ///* The `Integrator` of `integrator` (see VehicleModel.h)
+    int m_integrator;
+
+    size_t m_n_vars;
+    size_t m_n_constraints;
+
+    ///* Only used with `persistent_tape`
+    Ipopt::SmartPtr<MPC_NLP> m_nlp;
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> m_app;
+    bool m_app_OK;
+    ///* Written by the IpoptJournal of `m_app` and by `m_nlp`, with
+    ///* `ipopt_journal`
+    IpoptLog m_ipopt_log;
+    bool m_nlp_solved_once;
+    ///* Whether Ipopt is told the structure is that of the last solve
+    ///* (`warm_start_same_structure`)
+    bool m_app_same_structure;
+
+    ///* Only used with `structure_cache`: the structure, its file, and the
+    ///* solution of the previous run the solves start from when there's no
+    ///* last one
+    std::unique_ptr<SolverStructure> m_structure;
+    std::string m_structure_path;
+    bool m_saves_solution;
+    std::vector<double> m_seed_x;
+
+    ///* See `set_lap_seed`: its copy, and whether there's one
+    std::vector<double> m_lap_seed;
+    bool m_lap_seed_OK;
+
+    ///* The backend that takes the solves over, null with Ipopt (see
+    ///* `Params::backend`)
+    std::unique_ptr<SolverBackend> m_backend;
+
+    ///* Only used with `explicit_table`
+    std::unique_ptr<ExplicitTable> m_table;
+
+    ///* Only used with `warm_start`
+    std::unique_ptr<WarmStartInitializer> m_initializer;
+
+    ///* Only used with `corridor_width`: the bounds on the cte of every step
+    bool m_corridor;
+    std::vector<double> m_cte_lower;
+    std::vector<double> m_cte_upper;
+
+    ///* Only used with `terminal_cost`: its weights for the current solve
+    ///* (see TerminalCost), empty without it, and its target
+    std::vector<double> m_terminal_cost;
+    double m_terminal_target[3];
+
+    ///* Only used with `max_obstacles`: the centers of the obstacles (x then
+    ///* y) and their clearances, by row (see `Indexes::obstacle_start`)
+    std::vector<double> m_obstacle_positions;
+    std::vector<double> m_obstacle_clearances;
+
+    ///* The vectors of the NLP, allocated once (the bounds are filled once
+    ///* too, only those on the initial state change), and the options of
+    ///* CppAD::ipopt::solve, which only differ in their last line
+    struct SolveBuffers;
+    std::unique_ptr<SolveBuffers> m_buffers;
+    std::string m_options;
+    size_t m_options_prefix;
+
+    ///* The last successful solution, used with `warm_start` and as the
+    ///* fallback of a failed solve, and the failed solves since (each of
+    ///* which shifted it by a step)
+    std::vector<double> m_prev_x;
+    bool m_prev_x_OK;
+    size_t m_prev_x_age;
+
+    ///* Only used with `dual_warm_start`: the multipliers of the last
+    ///* solve, when it succeeded with Ipopt's last iterate (they're of no
+    ///* use with any other solution), and whether Ipopt's options are set
+    ///* to start from them
+    std::vector<double> m_prev_z_L;
+    std::vector<double> m_prev_z_U;
+    std::vector<double> m_prev_lambda;
+    bool m_prev_duals_OK;
+    bool m_app_dual_start;
+
+    ///* Only used with `nlp_scaling`: whether the objective has been scaled
+    ///* by the cost of a solve that converged
+    bool m_objective_scaling_OK;
+
+    SolveStats m_stats;
+
+    ///* Only used with `adaptive_tolerance`: the running estimates of the
+    ///* time [s] of a solve at every level (negative until there's one),
+    ///* the level of the current solve, that Ipopt's options are at (with
+    ///* `persistent_tape`), and the `tol` of full convergence
+    static constexpr size_t NUM_TOLERANCE_LEVELS = 4;
+    double m_level_time[NUM_TOLERANCE_LEVELS];
+    size_t m_tolerance_level;
+    size_t m_app_tolerance_level;
+    double m_full_tol;
+
+    ///* A level is only chosen when the time left is this many times its
+    ///* estimate
+    static constexpr double TOLERANCE_SAFETY = 1.5;
+    ///* Weight of the latest solve in the estimate of its level, and the
+    ///* factor by which the tighter levels' estimates shrink at every solve
+    ///* that isn't theirs (so they're tried again, once in a while)
+    static constexpr double LEVEL_TIME_ALPHA = 0.2;
+    static constexpr double LEVEL_TIME_DECAY = 0.99;
 
     ///* Upper bound
     const double SPEED_UPPERBOUND = 10.0;
+
+    ///* Room for the time limit line of `m_options` (and those of the
+    ///* tolerances)
+    static constexpr size_t MAX_TIME_LIMIT_OPTION = 256;
+    ///* Ipopt's max_cpu_time [s] without `solve_time_limit` (it has to be
+    ///* positive)
+    static constexpr double NO_TIME_LIMIT = 1e6;
 };
@@ -0,0 +1,1102 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include "Log.h"
+#include <coin/IpIpoptData.hpp>
+#include <coin/IpIpoptCalculatedQuantities.hpp>
+#include <coin/IpOrigIpoptNLP.hpp>
+#include <coin/IpTNLPAdapter.hpp>
+#include <coin/IpTimingStatistics.hpp>
+
+#include "MPC_NLP.h"
+#include "AllocationCounter.h"
+#include "FG_eval.h"
+#include "Trace.h"
+
+
+const char * const MPC_NLP::CODEGEN_MODEL = "mpc_fg";
+constexpr double MPC_NLP::FEASIBILITY_TOLERANCE;
+
+
+// The entries of the patterns of the Jacobian of `fg` (but the cost) and of
+// the lower triangle of the Hessian, sorted by row, then column
+static void pattern_entries(const MPC_NLP::SetVector & jac_pattern, const MPC_NLP::SetVector & hes_pattern,
+                            std::vector<size_t> & jac_row, std::vector<size_t> & jac_col,
+                            std::vector<size_t> & hes_row, std::vector<size_t> & hes_col) {
+    for (size_t i=1; i < jac_pattern.size(); i++) {
+        for (auto j : jac_pattern[i]) {
+            jac_row.push_back(i);
+            jac_col.push_back(j);
+        }
+    }
+
+    for (size_t i=0; i < hes_pattern.size(); i++) {
+        for (auto j : hes_pattern[i]) {
+            // Ipopt only needs the lower triangle
+            if (j <= i) {
+                hes_row.push_back(i);
+                hes_col.push_back(j);
+            }
+        }
+    }
+}
+
+
+// Adds the time from its construction to its destruction to `total` [s]
+struct ScopedEvalTimer {
+    ScopedEvalTimer(double & total) : m_total(total), m_start(std::chrono::steady_clock::now()) {}
+    ~ScopedEvalTimer() {
+        m_total += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    double & m_total;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+
+MPC_NLP::MPC_NLP(const Params & params, const Indexes & indexes, size_t n_vars, size_t n_constraints,
+                 SolverStructure * structure)
+        : m_n_vars(n_vars), m_n_constraints(n_constraints), m_n_coeffs(params.num_coeffs()),
+          m_dynamic(params.num_coeffs() + 1 + FG_eval::NUM_WEIGHTS + (params.terminal_cost ? TerminalCost::SIZE : 0)
+                    + 2 * indexes.num_obstacles * (params.steps_ahead - 1)),
+          m_terminal_start(params.num_coeffs() + 1 + FG_eval::NUM_WEIGHTS),
+          m_obstacles_start(m_terminal_start + (params.terminal_cost ? TerminalCost::SIZE : 0)),
+          m_constant_cost_hessian(false), m_cost_hessian_OK(false),
+          m_xv(n_vars), m_fg(1 + n_constraints), m_w(1 + n_constraints), m_fg_OK(false),
+          m_vars(n_vars), m_vars_lowerbound(n_vars), m_vars_upperbound(n_vars),
+          m_constraints_lowerbound(n_constraints), m_constraints_upperbound(n_constraints),
+          m_start_z_L(n_vars), m_start_z_U(n_vars), m_start_lambda(n_constraints),
+          m_scaling_OK(false), m_obj_scaling(1.0),
+          m_status(Ipopt::UNASSIGNED), m_obj_value(0.0),
+          m_x(n_vars), m_z_L(n_vars), m_z_U(n_vars), m_lambda(n_constraints), m_iterations(0), m_eval_time(0.0),
+          m_linear_solver_time(0.0), m_restoration(false), m_constraint_violation(0.0), m_log(nullptr),
+          m_fixed_initial_state(false),
+          m_abort_divergence(params.abort_divergence), m_divergence_min_iterations(params.divergence_min_iterations),
+          m_divergence_inf_pr_growth(params.divergence_inf_pr_growth),
+          m_divergence_min_alpha(params.divergence_min_alpha), m_divergence_small_steps(params.divergence_small_steps),
+          m_divergence_restoration_iterations(params.divergence_restoration_iterations), m_lowest_inf_pr(-1.0),
+          m_small_steps(0), m_restoration_iterations(0), m_diverged(false),
+          m_deadline(std::chrono::steady_clock::time_point::max()), m_deadline_hit(false), m_cancel(nullptr),
+          m_best_OK(false), m_best_obj_value(0.0), m_best_x(n_vars)
+{
+    for (size_t i=0; i < m_dynamic.size(); i++)
+        m_dynamic[i] = 0.0;
+    FG_eval::weights(params, &m_dynamic[m_n_coeffs + 1]);
+
+    // Nothing to record: the model knows its derivatives
+    if (params.analytic_derivatives) {
+        m_analytic.reset(new KinematicModel(params, indexes));
+        std::vector<size_t> jac_row(m_analytic->jac_row());
+        for (size_t & row : jac_row)
+            row++;
+        set_patterns(jac_row, m_analytic->jac_col(), m_analytic->hes_row(), m_analytic->hes_col());
+        return;
+    }
+
+    if (params.vehicle_model == DynamicBicycle::name() and params.fast_trig)
+        record_tape<DynamicBicycle, FastTrig>(params, indexes, n_vars, n_constraints);
+    else if (params.vehicle_model == DynamicBicycle::name())
+        record_tape<DynamicBicycle, ExactTrig>(params, indexes, n_vars, n_constraints);
+    else if (params.fast_trig)
+        record_kinematic_tape<FastTrig>(params, indexes, n_vars, n_constraints);
+    else
+        record_kinematic_tape<ExactTrig>(params, indexes, n_vars, n_constraints);
+
+    // The sparsity (computed once, it doesn't depend on the parameters), or
+    // that of an earlier run
+    if (structure != nullptr and structure->patterns_OK()) {
+        m_jac_pattern.resize(1 + n_constraints);
+        for (size_t k=0; k < structure->jac_row.size(); k++)
+            m_jac_pattern[structure->jac_row[k]].insert(structure->jac_col[k]);
+        m_hes_pattern.resize(n_vars);
+        for (size_t k=0; k < structure->hes_row.size(); k++)
+            m_hes_pattern[structure->hes_row[k]].insert(structure->hes_col[k]);
+    } else {
+        record_patterns(n_vars, n_constraints);
+        if (structure != nullptr) {
+            for (size_t i=0; i < 1 + n_constraints; i++) {
+                for (auto j : m_jac_pattern[i]) {
+                    structure->jac_row.push_back(uint32_t(i));
+                    structure->jac_col.push_back(uint32_t(j));
+                }
+            }
+            for (size_t i=0; i < n_vars; i++) {
+                for (auto j : m_hes_pattern[i]) {
+                    structure->hes_row.push_back(uint32_t(i));
+                    structure->hes_col.push_back(uint32_t(j));
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> jac_row, jac_col, hes_row, hes_col;
+    pattern_entries(m_jac_pattern, m_hes_pattern, jac_row, jac_col, hes_row, hes_col);
+    if (m_stages) {
+        // Ipopt gets the entries of the steps too, those of the tape are
+        // some of them
+        SetVector jac_pattern(m_jac_pattern), hes_pattern(m_hes_pattern);
+        m_stages->add_patterns(jac_pattern, hes_pattern);
+        std::vector<size_t> all_jac_row, all_jac_col, all_hes_row, all_hes_col;
+        pattern_entries(jac_pattern, hes_pattern, all_jac_row, all_jac_col, all_hes_row, all_hes_col);
+        set_patterns(all_jac_row, all_jac_col, all_hes_row, all_hes_col);
+        set_tape_patterns(jac_row, jac_col, hes_row, hes_col);
+        m_stages->set_slots(m_jac_row, m_jac_col, m_hes_row, m_hes_col);
+        m_stages->new_dynamic(m_dynamic);
+    } else {
+        set_patterns(jac_row, jac_col, hes_row, hes_col);
+    }
+
+    m_constant_cost_hessian = params.constant_cost_hessian;
+    if (m_constant_cost_hessian)
+        record_constraint_pattern(n_vars, n_constraints);
+}
+
+
+template <class Trig>
+void MPC_NLP::record_kinematic_tape(const Params & params, const Indexes & indexes, size_t n_vars,
+                                    size_t n_constraints) {
+    Integrator integrator = INTEGRATOR_EULER;
+    integrator_from_name(params.integrator, integrator);
+    switch (integrator) {
+        case INTEGRATOR_RK2:
+            record_tape<IntegratedKinematic<INTEGRATOR_RK2>, Trig>(params, indexes, n_vars, n_constraints);
+            break;
+        case INTEGRATOR_RK4:
+            record_tape<IntegratedKinematic<INTEGRATOR_RK4>, Trig>(params, indexes, n_vars, n_constraints);
+            break;
+        case INTEGRATOR_EXACT:
+            record_tape<IntegratedKinematic<INTEGRATOR_EXACT>, Trig>(params, indexes, n_vars, n_constraints);
+            break;
+        default:
+            record_tape<KinematicBicycle, Trig>(params, indexes, n_vars, n_constraints);
+    }
+}
+
+
+template <class Model, class Trig>
+void MPC_NLP::record_tape(const Params & params, const Indexes & indexes, size_t n_vars, size_t n_constraints) {
+    typedef FG_eval_base<double, Model, Trig> FG;
+    typedef typename FG::ADvector ADvector;
+
+    MPC_TRACE_SCOPE("MPC_NLP::record_tape");
+
+    // The step of the model is recorded on a tape of its own, before the
+    // tape of the NLP (CppAD records one tape at a time)
+    if (params.checkpoint_stage) {
+        ADvector a_in(FG::STAGE_COEFFS + FG::stage_coeffs(params, m_n_coeffs));
+        ADvector a_out(FG::STAGE_OUTPUTS);
+        for (size_t i=0; i < a_in.size(); i++)
+            a_in[i] = 0.0;
+        a_in[FG::STAGE_DT] = params.dt;
+        m_stage.reset(new CppAD::checkpoint<double>("mpc_stage", FG::stage, a_in, a_out));
+    }
+
+    // ... or evaluated outside of the tape of the NLP, which then only has
+    // the next states in their rows (see ParallelStages)
+    if (params.parallel_stages > 1) {
+        ADvector a_in(FG::STAGE_COEFFS + FG::stage_coeffs(params, m_n_coeffs));
+        ADvector a_out(FG::STAGE_OUTPUTS);
+        for (size_t i=0; i < a_in.size(); i++)
+            a_in[i] = 0.0;
+        a_in[FG::STAGE_DT] = params.dt;
+        CppAD::Independent(a_in);
+        FG::stage(a_in, a_out);
+        CppAD::ADFun<double> stage(a_in, a_out);
+        stage.optimize();
+
+        ParallelStages::Layout layout;
+        layout.num_inputs = a_in.size();
+        layout.var_inputs = {FG::STAGE_X, FG::STAGE_Y, FG::STAGE_PSI, FG::STAGE_EPSI, FG::STAGE_V, FG::STAGE_DELTA};
+        for (size_t e=0; e < Model::EXTRA_STATES; e++)
+            layout.var_inputs.push_back(FG::STAGE_EXTRA + e);
+        // The errors of a contouring reference stay on the tape
+        layout.used_outputs = {0, 1, 2};
+        if (!params.contouring_reference) {
+            layout.used_outputs.push_back(3);
+            layout.used_outputs.push_back(4);
+        }
+        for (size_t e=0; e < Model::EXTRA_STATES; e++)
+            layout.used_outputs.push_back(5 + e);
+        layout.dt_input = FG::STAGE_DT;
+        layout.coeffs_input = FG::STAGE_COEFFS;
+        layout.num_coeffs = FG::stage_coeffs(params, m_n_coeffs);
+        for (size_t t = 1; t < params.steps_ahead; t++) {
+            layout.vars.insert(layout.vars.end(), {indexes.x_start + t - 1, indexes.y_start + t - 1,
+                                                   indexes.psi_start + t - 1, indexes.epsi_start + t - 1,
+                                                   indexes.v(t - 1), indexes.delta(t - 1)});
+            for (size_t e=0; e < Model::EXTRA_STATES; e++)
+                layout.vars.push_back(indexes.extra(e, t - 1));
+            layout.rows.insert(layout.rows.end(), {1 + indexes.x_start + t, 1 + indexes.y_start + t,
+                                                   1 + indexes.psi_start + t});
+            if (!params.contouring_reference)
+                layout.rows.insert(layout.rows.end(), {1 + indexes.cte_start + t, 1 + indexes.epsi_start + t});
+            for (size_t e=0; e < Model::EXTRA_STATES; e++)
+                layout.rows.push_back(1 + indexes.extra(e, t));
+            layout.dt.push_back(params.step_dt(t - 1));
+        }
+        m_stages.reset(new ParallelStages(stage, layout, size_t(params.parallel_stages)));
+    }
+
+    // Record the tape. The values used here don't matter: there are no
+    // conditional expressions in FG_eval, so the operation sequence is the
+    // same for every (vars, coeffs, ref_v, weights, obstacles).
+    ADvector a_vars(n_vars);
+    for (size_t i=0; i < n_vars; i++)
+        a_vars[i] = 0.0;
+
+    ADvector a_dynamic(m_dynamic.size());
+    for (size_t i=0; i < m_dynamic.size(); i++)
+        a_dynamic[i] = m_dynamic[i];
+
+    size_t abort_op_index = 0;
+    bool record_compare = false;
+    CppAD::Independent(a_vars, abort_op_index, record_compare, a_dynamic);
+
+    ADvector a_coeffs(m_n_coeffs);
+    for (size_t i=0; i < m_n_coeffs; i++)
+        a_coeffs[i] = a_dynamic[i];
+
+    ADvector a_weights(FG::NUM_WEIGHTS);
+    for (size_t i=0; i < FG::NUM_WEIGHTS; i++)
+        a_weights[i] = a_dynamic[m_n_coeffs + 1 + i];
+
+    ADvector a_terminal(m_obstacles_start - m_terminal_start);
+    for (size_t i=0; i < a_terminal.size(); i++)
+        a_terminal[i] = a_dynamic[m_terminal_start + i];
+
+    ADvector a_obstacles(m_dynamic.size() - m_obstacles_start);
+    for (size_t i=0; i < a_obstacles.size(); i++)
+        a_obstacles[i] = a_dynamic[m_obstacles_start + i];
+
+    FG fg_eval(a_coeffs, a_dynamic[m_n_coeffs], a_weights, params, indexes);
+    fg_eval.set_stage_function(m_stage.get());
+    fg_eval.set_stages_outside(bool(m_stages));
+    fg_eval.set_obstacles(a_obstacles);
+    fg_eval.set_terminal_cost(a_terminal);
+    ADvector a_fg(1 + n_constraints);
+    fg_eval(a_fg, a_vars);
+
+    m_fun.Dependent(a_vars, a_fg);
+    m_fun.optimize();
+}
+
+
+void MPC_NLP::record_patterns(size_t n_vars, size_t n_constraints) {
+    MPC_TRACE_SCOPE("MPC_NLP::record_patterns");
+
+    // Jacobian sparsity
+    SetVector r(n_vars);
+    for (size_t i=0; i < n_vars; i++)
+        r[i].insert(i);
+    m_jac_pattern = m_fun.ForSparseJac(n_vars, r);
+
+    // Hessian sparsity of the Lagrangian (cost + all constraints)
+    SetVector s(1);
+    for (size_t i=0; i < 1 + n_constraints; i++)
+        s[0].insert(i);
+    m_hes_pattern = m_fun.RevSparseHes(n_vars, s);
+}
+
+
+void MPC_NLP::record_constraint_pattern(size_t n_vars, size_t n_constraints) {
+    MPC_TRACE_SCOPE("MPC_NLP::record_constraint_pattern");
+
+    // RevSparseHes works from the last ForSparseJac, which the patterns of
+    // an earlier run skipped
+    SetVector r(n_vars);
+    for (size_t i=0; i < n_vars; i++)
+        r[i].insert(i);
+    m_fun.ForSparseJac(n_vars, r);
+
+    SetVector s(1);
+    for (size_t i=1; i < 1 + n_constraints; i++)
+        s[0].insert(i);
+    m_con_hes_pattern = m_fun.RevSparseHes(n_vars, s);
+
+    // A subset of the Lagrangian's, which is sorted by row, then column
+    std::map<std::pair<size_t, size_t>, size_t> position;
+    for (size_t k=0; k < m_hes_row.size(); k++)
+        position[std::make_pair(m_hes_row[k], m_hes_col[k])] = k;
+    std::vector<size_t> rows, cols;
+    for (size_t i=0; i < n_vars; i++) {
+        for (auto j : m_con_hes_pattern[i]) {
+            if (j <= i) {
+                rows.push_back(i);
+                cols.push_back(j);
+                m_con_hes_k.push_back(position.at(std::make_pair(i, size_t(j))));
+            }
+        }
+    }
+    m_con_hes_row.resize(rows.size());
+    m_con_hes_col.resize(cols.size());
+    m_con_hes_values.resize(rows.size());
+    for (size_t k=0; k < rows.size(); k++) {
+        m_con_hes_row[k] = rows[k];
+        m_con_hes_col[k] = cols[k];
+    }
+    m_cost_hessian.resize(m_hes_row.size());
+    m_cost_hessian_OK = false;
+}
+
+
+void MPC_NLP::set_patterns(const std::vector<size_t> & jac_row, const std::vector<size_t> & jac_col,
+                           const std::vector<size_t> & hes_row, const std::vector<size_t> & hes_col) {
+    m_jac_row.resize(jac_row.size());
+    m_jac_col.resize(jac_col.size());
+    m_jac_values.resize(jac_row.size());
+    for (size_t k=0; k < jac_row.size(); k++) {
+        m_jac_row[k] = jac_row[k];
+        m_jac_col[k] = jac_col[k];
+    }
+    m_hes_row.resize(hes_row.size());
+    m_hes_col.resize(hes_col.size());
+    m_hes_values.resize(hes_row.size());
+    for (size_t k=0; k < hes_row.size(); k++) {
+        m_hes_row[k] = hes_row[k];
+        m_hes_col[k] = hes_col[k];
+    }
+}
+
+
+void MPC_NLP::set_tape_patterns(const std::vector<size_t> & jac_row, const std::vector<size_t> & jac_col,
+                                const std::vector<size_t> & hes_row, const std::vector<size_t> & hes_col) {
+    // Subsets of those of set_patterns, which are sorted by row, then column
+    std::map<std::pair<size_t, size_t>, size_t> jac_position, hes_position;
+    for (size_t k=0; k < m_jac_row.size(); k++)
+        jac_position[std::make_pair(m_jac_row[k], m_jac_col[k])] = k;
+    for (size_t k=0; k < m_hes_row.size(); k++)
+        hes_position[std::make_pair(m_hes_row[k], m_hes_col[k])] = k;
+
+    m_tape_jac_row.resize(jac_row.size());
+    m_tape_jac_col.resize(jac_col.size());
+    m_tape_jac_values.resize(jac_row.size());
+    m_tape_jac_k.resize(jac_row.size());
+    for (size_t k=0; k < jac_row.size(); k++) {
+        m_tape_jac_row[k] = jac_row[k];
+        m_tape_jac_col[k] = jac_col[k];
+        m_tape_jac_k[k] = jac_position.at(std::make_pair(jac_row[k], jac_col[k]));
+    }
+    m_tape_hes_row.resize(hes_row.size());
+    m_tape_hes_col.resize(hes_col.size());
+    m_tape_hes_values.resize(hes_row.size());
+    m_tape_hes_k.resize(hes_row.size());
+    for (size_t k=0; k < hes_row.size(); k++) {
+        m_tape_hes_row[k] = hes_row[k];
+        m_tape_hes_col[k] = hes_col[k];
+        m_tape_hes_k[k] = hes_position.at(std::make_pair(hes_row[k], hes_col[k]));
+    }
+}
+
+
+MPC_NLP::~MPC_NLP() {}
+
+
+#ifdef MPC_CODEGEN
+bool MPC_NLP::load_codegen(const std::string & library, const Params & params) {
+    // The generated code has the parameters below baked in
+    std::string config_name = library.substr(0, library.rfind('.')) + ".params";
+    std::ifstream config(config_name);
+    size_t steps_ahead;
+    int poly_degree;
+    double baked[7];
+    config >> steps_ahead >> baked[0] >> baked[1] >> baked[2] >> baked[3] >> baked[4] >> baked[5] >> baked[6] >> poly_degree;
+    if (!config) {
+        MPC_ERROR("Could not read %s", config_name.c_str());
+        return false;
+    }
+
+    double expected[7] = {
+        params.dt, params.cte_coeff, params.epsi_coeff, params.speed_coeff,
+        params.steer_coeff, params.consec_steer_coeff, params.consec_speed_coeff
+    };
+    bool same = (steps_ahead == params.steps_ahead and poly_degree == params.poly_degree);
+    for (int i=0; i < 7; i++)
+        same &= (std::abs(baked[i] - expected[i]) <= 1e-9 * std::max(1.0, std::abs(expected[i])));
+    if (!same) {
+        MPC_ERROR("%s was generated for other parameters, regenerate it with mpc_codegen", library.c_str());
+        return false;
+    }
+
+    try {
+        m_codegen_lib.reset(new CppAD::cg::LinuxDynamicLib<double>(library));
+        m_model = m_codegen_lib->model(CODEGEN_MODEL);
+    } catch (const std::exception & e) {
+        MPC_ERROR("Could not load %s: %s", library.c_str(), e.what());
+        m_model.reset();
+        m_codegen_lib.reset();
+        return false;
+    }
+    if (!m_model or m_model->Domain() != m_n_vars or m_model->Range() != 1 + m_n_constraints) {
+        MPC_ERROR("%s doesn't have the expected model", library.c_str());
+        m_model.reset();
+        m_codegen_lib.reset();
+        return false;
+    }
+
+    // Split the Jacobian of `fg` into the gradient of the cost and the
+    // Jacobian of the constraints (in the tape's numbering: rows from 1)
+    std::vector<size_t> row, col;
+    m_model->JacobianSparsity(row, col);
+    m_cg_grad_k.clear();
+    m_cg_grad_col.clear();
+    m_cg_jac_k.clear();
+    std::vector<size_t> jac_row, jac_col;
+    for (size_t k=0; k < row.size(); k++) {
+        if (row[k] == 0) {
+            m_cg_grad_k.push_back(k);
+            m_cg_grad_col.push_back(col[k]);
+        } else {
+            m_cg_jac_k.push_back(k);
+            jac_row.push_back(row[k]);
+            jac_col.push_back(col[k]);
+        }
+    }
+    m_jac_row.resize(jac_row.size());
+    m_jac_col.resize(jac_col.size());
+    m_jac_values.resize(jac_row.size());
+    for (size_t k=0; k < jac_row.size(); k++) {
+        m_jac_row[k] = jac_row[k];
+        m_jac_col[k] = jac_col[k];
+    }
+    m_cg_jac.resize(row.size());
+
+    // Only the lower triangle was generated
+    m_model->HessianSparsity(row, col);
+    m_hes_row.resize(row.size());
+    m_hes_col.resize(col.size());
+    m_hes_values.resize(row.size());
+    for (size_t k=0; k < row.size(); k++) {
+        m_hes_row[k] = row[k];
+        m_hes_col[k] = col[k];
+    }
+    m_cg_hes.resize(row.size());
+
+    m_cg_x.resize(m_n_vars);
+    m_cg_p.resize(m_n_coeffs + 1);
+    m_cg_fg.resize(1 + m_n_constraints);
+    m_cg_w.resize(1 + m_n_constraints);
+    for (size_t i=0; i < m_n_coeffs + 1; i++)
+        m_cg_p[i] = m_dynamic[i];
+    m_fg_OK = false;
+    return true;
+}
+
+
+void MPC_NLP::update_cg_x(const Ipopt::Number * x) {
+    for (size_t i=0; i < m_n_vars; i++)
+        m_cg_x[i] = x[i];
+}
+#endif
+
+
+bool MPC_NLP::set_weights(const Params & params) {
+#ifdef MPC_CODEGEN
+    if (m_model)
+        return false;
+#endif
+    FG_eval::weights(params, &m_dynamic[m_n_coeffs + 1]);
+    if (m_analytic)
+        m_analytic->set_weights(params);
+    m_fg_OK = false;
+    m_cost_hessian_OK = false;
+    return true;
+}
+
+
+void MPC_NLP::set_terminal_cost(const double * weights) {
+    // The Hessian of the cost changes with them
+    for (size_t i=m_terminal_start; i < m_obstacles_start; i++) {
+        if (m_dynamic[i] != weights[i - m_terminal_start]) {
+            m_dynamic[i] = weights[i - m_terminal_start];
+            m_cost_hessian_OK = false;
+        }
+    }
+    m_fg_OK = false;
+}
+
+
+void MPC_NLP::set_obstacles(const double * positions) {
+    for (size_t i=m_obstacles_start; i < m_dynamic.size(); i++)
+        m_dynamic[i] = positions[i - m_obstacles_start];
+    m_fg_OK = false;
+}
+
+
+void MPC_NLP::set_problem(
+        const Dvector & vars,
+        const Dvector & vars_lowerbound, const Dvector & vars_upperbound,
+        const Dvector & constraints_lowerbound, const Dvector & constraints_upperbound,
+        const Eigen::VectorXd & coeffs, double ref_v) {
+
+    // A contouring reference may be for a longer horizon, whose first
+    // steps are this one's
+    assert(size_t(coeffs.size()) >= m_n_coeffs);
+
+    m_eval_time = 0.0;
+    m_vars = vars;
+    m_vars_lowerbound = vars_lowerbound;
+    m_vars_upperbound = vars_upperbound;
+    m_constraints_lowerbound = constraints_lowerbound;
+    m_constraints_upperbound = constraints_upperbound;
+
+    for (size_t i=0; i < m_n_coeffs; i++)
+        m_dynamic[i] = coeffs[i];
+    m_dynamic[m_n_coeffs] = ref_v;
+    if (m_analytic) {
+        m_analytic->set_problem(coeffs, ref_v);
+    } else {
+        // CppAD's own allocations, if any, aren't ours to avoid
+        AllocationCounter::Pause pause;
+        m_fun.new_dynamic(m_dynamic);
+        if (m_parallel)
+            m_parallel->new_dynamic(m_dynamic);
+        if (m_stages)
+            m_stages->new_dynamic(m_dynamic);
+
+        // The cost is quadratic: its Hessian is the same at any point, e.g.
+        // the start
+        if (m_constant_cost_hessian and !m_cost_hessian_OK) {
+            for (size_t i=0; i < m_n_vars; i++)
+                m_xv[i] = vars[i];
+            for (size_t i=0; i < 1 + m_n_constraints; i++)
+                m_w[i] = 0.0;
+            m_w[0] = 1.0;
+            m_fun.SparseHessian(m_xv, m_w, m_hes_pattern, m_hes_row, m_hes_col, m_cost_hessian, m_hes_work);
+            m_cost_hessian_OK = true;
+        }
+    }
+#ifdef MPC_CODEGEN
+    if (m_model) {
+        for (size_t i=0; i < m_n_coeffs + 1; i++)
+            m_cg_p[i] = m_dynamic[i];
+    }
+#endif
+
+    m_fg_OK = false;
+    m_deadline_hit = false;
+    m_best_OK = false;
+    m_linear_solver_time = 0.0;
+    m_restoration = false;
+    m_lowest_inf_pr = -1.0;
+    m_small_steps = 0;
+    m_restoration_iterations = 0;
+    m_diverged = false;
+}
+
+
+bool MPC_NLP::set_parallel(Eigen::ThreadPoolInterface * pool, size_t num_chunks) {
+    if (m_analytic or m_stages)
+        return false;
+#ifdef MPC_CODEGEN
+    if (m_model)
+        return false;
+#endif
+    m_parallel.reset(new ParallelDerivatives(m_fun, m_jac_row, m_jac_col, m_hes_row, m_hes_col, num_chunks, pool));
+    m_parallel->new_dynamic(m_dynamic);
+    return true;
+}
+
+
+bool MPC_NLP::set_stage_pool(Eigen::ThreadPoolInterface * pool) {
+    if (!m_stages)
+        return false;
+    m_stages->set_pool(pool);
+    return true;
+}
+
+
+void MPC_NLP::set_multipliers(const Dvector & z_L, const Dvector & z_U, const Dvector & lambda) {
+    for (size_t i=0; i < m_n_vars; i++) {
+        m_start_z_L[i] = z_L[i];
+        m_start_z_U[i] = z_U[i];
+    }
+    for (size_t i=0; i < m_n_constraints; i++)
+        m_start_lambda[i] = lambda[i];
+}
+
+
+void MPC_NLP::set_scaling(double obj_scaling, const Dvector & x_scaling, const Dvector & g_scaling) {
+    assert(x_scaling.size() == m_n_vars and g_scaling.size() == m_n_constraints);
+    m_obj_scaling = obj_scaling;
+    m_x_scaling = x_scaling;
+    m_g_scaling = g_scaling;
+    m_scaling_OK = true;
+}
+
+
+void MPC_NLP::fix_initial_state(const Indexes & indexes) {
+    // The row of every state equals it to its variable
+    m_fixed = {indexes.x_start, indexes.y_start, indexes.psi_start, indexes.cte_start, indexes.epsi_start};
+    for (size_t e=0; e < indexes.num_extra; e++)
+        m_fixed.push_back(indexes.extra(e, 0));
+
+    std::vector<bool> left_out(m_n_constraints, false);
+    for (size_t row : m_fixed)
+        left_out[row] = true;
+    std::vector<Ipopt::Index> seen_row(m_n_constraints, -1);
+    m_rows.clear();
+    for (size_t i=0; i < m_n_constraints; i++) {
+        if (!left_out[i]) {
+            seen_row[i] = Ipopt::Index(m_rows.size());
+            m_rows.push_back(i);
+        }
+    }
+    m_jac_seen.clear();
+    m_jac_seen_row.clear();
+    for (size_t k=0; k < m_jac_row.size(); k++) {
+        // Row 0 of the tape is the cost
+        if (!left_out[m_jac_row[k] - 1]) {
+            m_jac_seen.push_back(k);
+            m_jac_seen_row.push_back(seen_row[m_jac_row[k] - 1]);
+        }
+    }
+    m_all_g.resize(m_n_constraints);
+    m_all_jac.resize(m_jac_row.size());
+    m_all_lambda.resize(m_n_constraints);
+    for (size_t i=0; i < m_n_constraints; i++)
+        m_all_lambda[i] = 0.0;
+    for (size_t row : m_fixed)
+        m_lambda[row] = 0.0;
+    m_fixed_initial_state = true;
+}
+
+
+void MPC_NLP::update_x(const Ipopt::Number * x, bool new_x) {
+    if (new_x or !m_fg_OK) {
+#ifdef MPC_CODEGEN
+        if (m_model) {
+            update_cg_x(x);
+            m_model->ForwardZero(m_cg_x, m_cg_p, m_cg_fg);
+            for (size_t i=0; i < 1 + m_n_constraints; i++)
+                m_fg[i] = m_cg_fg[i];
+            m_fg_OK = true;
+            return;
+        }
+#endif
+        for (size_t i=0; i < m_n_vars; i++)
+            m_xv[i] = x[i];
+        m_fg = m_fun.Forward(0, m_xv);
+        if (m_stages)
+            m_stages->constraints(x, m_fg.data());
+        m_fg_OK = true;
+    }
+}
+
+
+void MPC_NLP::memory_stats(MemoryStats & stats) const {
+    stats.tape_ops += m_fun.size_op();
+    stats.tape_vars += m_fun.size_var();
+    stats.tape_bytes += m_fun.size_op_seq();
+    stats.nlp_vars += m_n_vars - m_fixed.size();
+    stats.nlp_constraints += m_fixed_initial_state ? m_rows.size() : m_n_constraints;
+    stats.jacobian_nonzeros += m_fixed_initial_state ? m_jac_seen.size() : m_jac_row.size();
+    stats.hessian_nonzeros += m_hes_row.size();
+}
+
+
+bool MPC_NLP::get_nlp_info(Ipopt::Index & n, Ipopt::Index & m, Ipopt::Index & nnz_jac_g,
+                           Ipopt::Index & nnz_h_lag, IndexStyleEnum & index_style) {
+    n = m_n_vars;
+    m = m_fixed_initial_state ? m_rows.size() : m_n_constraints;
+    nnz_jac_g = m_fixed_initial_state ? m_jac_seen.size() : m_jac_row.size();
+    nnz_h_lag = m_hes_row.size();
+    index_style = C_STYLE;
+    return true;
+}
+
+
+bool MPC_NLP::get_bounds_info(Ipopt::Index n, Ipopt::Number * x_l, Ipopt::Number * x_u,
+                              Ipopt::Index m, Ipopt::Number * g_l, Ipopt::Number * g_u) {
+    for (Ipopt::Index i=0; i < n; i++) {
+        x_l[i] = m_vars_lowerbound[i];
+        x_u[i] = m_vars_upperbound[i];
+    }
+    if (m_fixed_initial_state) {
+        // The bounds of the rows left out, on their variables
+        for (size_t i : m_fixed) {
+            x_l[i] = m_constraints_lowerbound[i];
+            x_u[i] = m_constraints_upperbound[i];
+        }
+        for (Ipopt::Index i=0; i < m; i++) {
+            g_l[i] = m_constraints_lowerbound[m_rows[i]];
+            g_u[i] = m_constraints_upperbound[m_rows[i]];
+        }
+        return true;
+    }
+    for (Ipopt::Index i=0; i < m; i++) {
+        g_l[i] = m_constraints_lowerbound[i];
+        g_u[i] = m_constraints_upperbound[i];
+    }
+    return true;
+}
+
+
+bool MPC_NLP::get_scaling_parameters(Ipopt::Number & obj_scaling, bool & use_x_scaling, Ipopt::Index n,
+                                     Ipopt::Number * x_scaling, bool & use_g_scaling, Ipopt::Index m,
+                                     Ipopt::Number * g_scaling) {
+    obj_scaling = m_obj_scaling;
+    use_x_scaling = m_scaling_OK;
+    use_g_scaling = m_scaling_OK;
+    if (!m_scaling_OK)
+        return true;
+    for (Ipopt::Index i=0; i < n; i++)
+        x_scaling[i] = m_x_scaling[i];
+    for (Ipopt::Index i=0; i < m; i++)
+        g_scaling[i] = m_g_scaling[m_fixed_initial_state ? m_rows[i] : i];
+    return true;
+}
+
+
+bool MPC_NLP::get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number * x,
+                                 bool init_z, Ipopt::Number * z_L, Ipopt::Number * z_U,
+                                 Ipopt::Index m, bool init_lambda, Ipopt::Number * lambda) {
+    assert(init_x and init_z == init_lambda);
+    for (Ipopt::Index i=0; i < n; i++)
+        x[i] = m_vars[i];
+    for (size_t i : m_fixed)
+        x[i] = m_constraints_lowerbound[i];
+    if (init_z) {
+        for (Ipopt::Index i=0; i < n; i++) {
+            z_L[i] = m_start_z_L[i];
+            z_U[i] = m_start_z_U[i];
+        }
+        for (Ipopt::Index i=0; i < m; i++)
+            lambda[i] = m_start_lambda[m_fixed_initial_state ? m_rows[i] : i];
+    }
+    return true;
+}
+
+
+bool MPC_NLP::eval_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number & obj_value) {
+    ScopedEvalTimer timer(m_eval_time);
+    if (m_analytic) {
+        obj_value = m_analytic->cost(x);
+        return true;
+    }
+    update_x(x, new_x);
+    obj_value = m_fg[0];
+    return true;
+}
+
+
+bool MPC_NLP::eval_grad_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number * grad_f) {
+    ScopedEvalTimer timer(m_eval_time);
+    if (m_analytic) {
+        m_analytic->gradient(x, grad_f);
+        return true;
+    }
+#ifdef MPC_CODEGEN
+    if (m_model) {
+        update_cg_x(x);
+        m_model->SparseJacobian(m_cg_x, m_cg_p, m_cg_jac, m_cg_row, m_cg_col);
+        for (Ipopt::Index i=0; i < n; i++)
+            grad_f[i] = 0.0;
+        for (size_t k=0; k < m_cg_grad_k.size(); k++)
+            grad_f[m_cg_grad_col[k]] = m_cg_jac[m_cg_grad_k[k]];
+        return true;
+    }
+#endif
+
+    // The reverse sweep needs the zero order forward sweep at `x` to be the
+    // last one done on the tape (the sparse drivers do their own sweeps)
+    for (size_t i=0; i < m_n_vars; i++)
+        m_xv[i] = x[i];
+    m_fg = m_fun.Forward(0, m_xv);
+    // (without the steps evaluated outside of the tape)
+    m_fg_OK = !m_stages;
+
+    for (size_t i=0; i < 1 + m_n_constraints; i++)
+        m_w[i] = 0.0;
+    m_w[0] = 1.0;
+    Dvector grad = m_fun.Reverse(1, m_w);
+    for (size_t i=0; i < m_n_vars; i++)
+        grad_f[i] = grad[i];
+    return true;
+}
+
+
+bool MPC_NLP::eval_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m, Ipopt::Number * g) {
+    ScopedEvalTimer timer(m_eval_time);
+    if (!m_fixed_initial_state) {
+        constraints(x, new_x, g);
+        return true;
+    }
+    constraints(x, new_x, m_all_g.data());
+    for (Ipopt::Index i=0; i < m; i++)
+        g[i] = m_all_g[m_rows[i]];
+    return true;
+}
+
+
+void MPC_NLP::constraints(const Ipopt::Number * x, bool new_x, Ipopt::Number * g) {
+    if (m_analytic) {
+        m_analytic->constraints(x, g);
+        return;
+    }
+    update_x(x, new_x);
+    for (size_t i=0; i < m_n_constraints; i++)
+        g[i] = m_fg[1 + i];
+}
+
+
+bool MPC_NLP::eval_jac_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m,
+                         Ipopt::Index nele_jac, Ipopt::Index * iRow, Ipopt::Index * jCol, Ipopt::Number * values) {
+    ScopedEvalTimer timer(m_eval_time);
+    if (values == NULL) {
+        for (Ipopt::Index k=0; k < nele_jac; k++) {
+            // Row 0 of the tape is the cost
+            size_t entry = m_fixed_initial_state ? m_jac_seen[k] : size_t(k);
+            iRow[k] = m_fixed_initial_state ? m_jac_seen_row[k] : Ipopt::Index(m_jac_row[entry] - 1);
+            jCol[k] = m_jac_col[entry];
+        }
+        return true;
+    }
+    if (!m_fixed_initial_state) {
+        jacobian(x, values);
+        return true;
+    }
+    jacobian(x, m_all_jac.data());
+    for (Ipopt::Index k=0; k < nele_jac; k++)
+        values[k] = m_all_jac[m_jac_seen[k]];
+    return true;
+}
+
+
+void MPC_NLP::jacobian(const Ipopt::Number * x, Ipopt::Number * values) {
+    if (m_analytic) {
+        m_analytic->jacobian(x, values);
+        return;
+    }
+
+#ifdef MPC_CODEGEN
+    if (m_model) {
+        update_cg_x(x);
+        m_model->SparseJacobian(m_cg_x, m_cg_p, m_cg_jac, m_cg_row, m_cg_col);
+        for (size_t k=0; k < m_jac_row.size(); k++)
+            values[k] = m_cg_jac[m_cg_jac_k[k]];
+        return;
+    }
+#endif
+
+    if (m_parallel) {
+        m_parallel->jacobian(x, values);
+        return;
+    }
+
+    for (size_t i=0; i < m_n_vars; i++)
+        m_xv[i] = x[i];
+    if (m_stages) {
+        m_fun.SparseJacobianReverse(m_xv, m_jac_pattern, m_tape_jac_row, m_tape_jac_col, m_tape_jac_values,
+                                    m_jac_work);
+        for (size_t k=0; k < m_jac_row.size(); k++)
+            values[k] = 0.0;
+        for (size_t k=0; k < m_tape_jac_k.size(); k++)
+            values[m_tape_jac_k[k]] = m_tape_jac_values[k];
+        m_stages->jacobian(x, values);
+        return;
+    }
+    m_fun.SparseJacobianReverse(m_xv, m_jac_pattern, m_jac_row, m_jac_col, m_jac_values, m_jac_work);
+    for (size_t k=0; k < m_jac_row.size(); k++)
+        values[k] = m_jac_values[k];
+}
+
+
+bool MPC_NLP::eval_h(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number obj_factor,
+                     Ipopt::Index m, const Ipopt::Number * lambda, bool new_lambda,
+                     Ipopt::Index nele_hess, Ipopt::Index * iRow, Ipopt::Index * jCol, Ipopt::Number * values) {
+    ScopedEvalTimer timer(m_eval_time);
+    if (values == NULL) {
+        for (Ipopt::Index k=0; k < nele_hess; k++) {
+            iRow[k] = m_hes_row[k];
+            jCol[k] = m_hes_col[k];
+        }
+        return true;
+    }
+    // The rows left out are linear, their multipliers 0 change nothing
+    if (m_fixed_initial_state) {
+        for (Ipopt::Index i=0; i < m; i++)
+            m_all_lambda[m_rows[i]] = lambda[i];
+        lambda = m_all_lambda.data();
+        m = Ipopt::Index(m_n_constraints);
+    }
+    if (m_analytic) {
+        m_analytic->hessian(x, obj_factor, lambda, values);
+        return true;
+    }
+
+#ifdef MPC_CODEGEN
+    if (m_model) {
+        update_cg_x(x);
+        m_cg_w[0] = obj_factor;
+        for (Ipopt::Index i=0; i < m; i++)
+            m_cg_w[1 + i] = lambda[i];
+        m_model->SparseHessian(m_cg_x, m_cg_p, m_cg_w, m_cg_hes, m_cg_row, m_cg_col);
+        for (Ipopt::Index k=0; k < nele_hess; k++)
+            values[k] = m_cg_hes[k];
+        return true;
+    }
+#endif
+
+    for (size_t i=0; i < m_n_vars; i++)
+        m_xv[i] = x[i];
+    for (Ipopt::Index i=0; i < m; i++)
+        m_w[1 + i] = lambda[i];
+
+    if (m_parallel) {
+        m_w[0] = obj_factor;
+        m_parallel->hessian(x, m_w.data(), values);
+        return true;
+    }
+
+    if (m_stages) {
+        m_w[0] = obj_factor;
+        m_fun.SparseHessian(m_xv, m_w, m_hes_pattern, m_tape_hes_row, m_tape_hes_col, m_tape_hes_values,
+                            m_hes_work);
+        for (Ipopt::Index k=0; k < nele_hess; k++)
+            values[k] = 0.0;
+        for (size_t k=0; k < m_tape_hes_k.size(); k++)
+            values[m_tape_hes_k[k]] = m_tape_hes_values[k];
+        m_stages->hessian(x, m_w.data(), values);
+        return true;
+    }
+
+    // The constant Hessian of the cost, and the curvature of the constraints
+    if (m_constant_cost_hessian) {
+        m_w[0] = 0.0;
+        m_fun.SparseHessian(m_xv, m_w, m_con_hes_pattern, m_con_hes_row, m_con_hes_col, m_con_hes_values,
+                            m_con_hes_work);
+        for (Ipopt::Index k=0; k < nele_hess; k++)
+            values[k] = obj_factor * m_cost_hessian[k];
+        for (size_t k=0; k < m_con_hes_k.size(); k++)
+            values[m_con_hes_k[k]] += m_con_hes_values[k];
+        return true;
+    }
+
+    m_w[0] = obj_factor;
+    m_fun.SparseHessian(m_xv, m_w, m_hes_pattern, m_hes_row, m_hes_col, m_hes_values, m_hes_work);
+    for (Ipopt::Index k=0; k < nele_hess; k++)
+        values[k] = m_hes_values[k];
+    return true;
+}
+
+
+void MPC_NLP::finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number * x,
+                                const Ipopt::Number * z_L, const Ipopt::Number * z_U,
+                                Ipopt::Index m, const Ipopt::Number * g, const Ipopt::Number * lambda,
+                                Ipopt::Number obj_value, const Ipopt::IpoptData * ip_data,
+                                Ipopt::IpoptCalculatedQuantities * ip_cq) {
+    m_status = status;
+    m_obj_value = obj_value;
+    for (Ipopt::Index i=0; i < n; i++) {
+        m_x[i] = x[i];
+        m_z_L[i] = z_L[i];
+        m_z_U[i] = z_U[i];
+    }
+    m_constraint_violation = 0.0;
+    if (m_fixed_initial_state) {
+        // Those of the rows left out stay 0
+        for (Ipopt::Index i=0; i < m; i++) {
+            size_t row = m_rows[i];
+            m_lambda[row] = lambda[i];
+            m_constraint_violation = std::max(m_constraint_violation, std::max(
+                    m_constraints_lowerbound[row] - g[i], g[i] - m_constraints_upperbound[row]));
+        }
+        return;
+    }
+    for (Ipopt::Index i=0; i < m; i++) {
+        m_lambda[i] = lambda[i];
+        m_constraint_violation = std::max(m_constraint_violation, std::max(
+                m_constraints_lowerbound[i] - g[i], g[i] - m_constraints_upperbound[i]));
+    }
+}
+
+
+bool MPC_NLP::intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                                    Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                                    Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                                    Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                                    const Ipopt::IpoptData * ip_data, Ipopt::IpoptCalculatedQuantities * ip_cq) {
+    m_iterations = iter;
+    if (mode == Ipopt::RestorationPhaseMode) {
+        if (!m_restoration)
+            Trace::instant("restoration", iter);
+        m_restoration = true;
+    }
+    if (m_log != nullptr) {
+        IpoptLog::Iteration iteration;
+        iteration.iter = int16_t(std::min(iter, Ipopt::Index(INT16_MAX)));
+        iteration.restoration = (mode == Ipopt::RestorationPhaseMode);
+        iteration.ls_trials = uint8_t(std::min(ls_trials, Ipopt::Index(UINT8_MAX)));
+        iteration.obj_value = float(obj_value);
+        iteration.inf_pr = float(inf_pr);
+        iteration.inf_du = float(inf_du);
+        iteration.log10_mu = float(std::log10(mu));
+        iteration.alpha_pr = float(alpha_pr);
+        m_log->add_iteration(iteration);
+    }
+
+    // Ipopt resets its timing statistics at the start of every solve. Only
+    // the non-const IpoptData has them, though they're only read here
+    if (ip_data != NULL) {
+        Ipopt::TimingStatistics & timing = const_cast<Ipopt::IpoptData *>(ip_data)->TimingStats();
+        m_linear_solver_time = timing.LinearSystemFactorization().TotalWallclockTime()
+                + timing.LinearSystemBackSolve().TotalWallclockTime();
+    }
+
+    // Keep the best feasible iterate. The iterates of the restoration phase
+    // are those of another problem, so they're skipped.
+    bool better = (!m_best_OK or obj_value < m_best_obj_value);
+    if (mode == Ipopt::RegularMode and inf_pr <= FEASIBILITY_TOLERANCE and better and ip_cq != NULL) {
+        // The TNLP interface doesn't expose the current iterate, it has to be
+        // taken from Ipopt's internal (reordered) vector
+        Ipopt::OrigIpoptNLP * orignlp = dynamic_cast<Ipopt::OrigIpoptNLP *>(GetRawPtr(ip_cq->GetIpoptNLP()));
+        Ipopt::TNLPAdapter * tnlp_adapter = NULL;
+        if (orignlp != NULL)
+            tnlp_adapter = dynamic_cast<Ipopt::TNLPAdapter *>(GetRawPtr(orignlp->nlp()));
+        if (tnlp_adapter != NULL) {
+            tnlp_adapter->ResortX(*ip_data->curr()->x(), &m_best_x[0]);
+            m_best_obj_value = obj_value;
+            m_best_OK = true;
+        }
+    }
+
+    // Going nowhere: the fallbacks are better off with the time left
+    if (m_abort_divergence and diverging(mode, iter, inf_pr, alpha_pr)) {
+        Trace::instant("diverged", iter);
+        m_diverged = true;
+        return false;
+    }
+    if (std::chrono::steady_clock::now() >= m_deadline) {
+        m_deadline_hit = true;
+        return false;
+    }
+    // Cancelled (an emergency stop): whatever the solve comes to isn't
+    // followed anymore
+    if (m_cancel != nullptr and m_cancel->load(std::memory_order_relaxed))
+        return false;
+    return true;
+}
+
+
+bool MPC_NLP::diverging(Ipopt::AlgorithmMode mode, Ipopt::Index iter, double inf_pr, double alpha_pr) {
+    // The restoration phase's infeasibility is that of another problem,
+    // the lowest is the regular iterations'. Iteration 0 has no step
+    bool restoration = (mode == Ipopt::RestorationPhaseMode);
+    m_restoration_iterations = restoration ? m_restoration_iterations + 1 : 0;
+    if (!restoration and (m_lowest_inf_pr < 0.0 or inf_pr < m_lowest_inf_pr))
+        m_lowest_inf_pr = inf_pr;
+    if (iter > 0)
+        m_small_steps = (alpha_pr < m_divergence_min_alpha) ? m_small_steps + 1 : 0;
+    if (iter < m_divergence_min_iterations)
+        return false;
+
+    if (!restoration and m_divergence_inf_pr_growth > 0.0
+            and inf_pr > m_divergence_inf_pr_growth * std::max(m_lowest_inf_pr, FEASIBILITY_TOLERANCE))
+        return true;
+    if (m_divergence_small_steps > 0 and m_small_steps >= m_divergence_small_steps)
+        return true;
+    return m_divergence_restoration_iterations > 0
+            and m_restoration_iterations >= m_divergence_restoration_iterations;
+}
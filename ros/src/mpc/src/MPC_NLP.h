@@ -0,0 +1,399 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <atomic>
+
+#include <cppad/cppad.hpp>
+#ifdef MPC_CODEGEN
+#include <cppad/cg.hpp>
+#endif
+#include <coin/IpTNLP.hpp>
+
+#include "MPC.h"
+#include "KinematicModel.h"
+#include "SolverStructure.h"
+#include "ParallelDerivatives.h"
+#include "ParallelStages.h"
+#include "MemoryStats.h"
+
+
+///* Ipopt problem whose objective and constraints are evaluated from a CppAD
+///* tape that is recorded only once. The polynomial coefficients and the
+///* reference speed are dynamic parameters of that tape, so a new control tick
+///* only has to update them (see `set_problem`), and the sparsity patterns
+///* (together with the coloring kept in the CppAD work objects) are reused.
+///* So are the weights of the cost (see `set_weights`).
+class MPC_NLP : public Ipopt::TNLP {
+public:
+    typedef CPPAD_TESTVECTOR(double) Dvector;
+    typedef CPPAD_TESTVECTOR(size_t) Svector;
+    typedef CPPAD_TESTVECTOR(std::set<size_t>) SetVector;
+
+    ///* The sparsity patterns of the tape come from `structure` when it has
+    ///* them, and go into it otherwise (when it's there)
+    MPC_NLP(const Params & params, const Indexes & indexes, size_t n_vars, size_t n_constraints,
+            SolverStructure * structure = nullptr);
+
+    virtual ~MPC_NLP();
+
+    ///* Name of the model in the libraries generated by mpc_codegen
+    static const char * const CODEGEN_MODEL;
+
+#ifdef MPC_CODEGEN
+    ///* Evaluate everything with the code generated by mpc_codegen in
+    ///* `library` instead of the tape. False (and the tape is kept) if it
+    ///* can't be loaded or was generated for other parameters
+    bool load_codegen(const std::string & library, const Params & params);
+#endif
+
+    ///* Set the data of the next solve (the tape itself is left untouched)
+    void set_problem(
+            const Dvector & vars,
+            const Dvector & vars_lowerbound, const Dvector & vars_upperbound,
+            const Dvector & constraints_lowerbound, const Dvector & constraints_upperbound,
+            const Eigen::VectorXd & coeffs, double ref_v
+    );
+
+    ///* The weights of the cost of `params`, from the next `set_problem` on;
+    ///* false (and they're left as they were) with the generated code, which
+    ///* has them built in
+    bool set_weights(const Params & params);
+
+    ///* Evaluate the Jacobian and the Hessian from the tape on `pool`, in
+    ///* `num_chunks` chunks (see ParallelDerivatives); false (and they're
+    ///* evaluated here) with the analytic derivatives or the generated code
+    bool set_parallel(Eigen::ThreadPoolInterface * pool, size_t num_chunks);
+
+    ///* Evaluate the steps of the model on `pool` (see ParallelStages);
+    ///* false unless they're evaluated outside of the tape (with
+    ///* `Params::parallel_stages`)
+    bool set_stage_pool(Eigen::ThreadPoolInterface * pool);
+
+    ///* The centers of the obstacles (see `FG_eval::set_obstacles`), from
+    ///* the next `set_problem` on
+    void set_obstacles(const double * positions);
+
+    ///* The weights of the terminal cost (see `FG_eval::set_terminal_cost`),
+    ///* from the next `set_problem` on; only with `Params::terminal_cost`
+    void set_terminal_cost(const double * weights);
+
+    ///* The multipliers the next solves start from, in the layout of
+    ///* `z_L()`, `z_U()` and `lambda()`, when Ipopt's `warm_start_init_point`
+    ///* asks for them (see `Params::dual_warm_start`)
+    void set_multipliers(const Dvector & z_L, const Dvector & z_U, const Dvector & lambda);
+
+    ///* Wall-clock time after which Ipopt is stopped (from
+    ///* `intermediate_callback`), for the next solves
+    void set_deadline(const std::chrono::steady_clock::time_point & deadline) { m_deadline = deadline; }
+
+    ///* A flag that, once raised (from any thread), stops Ipopt at its next
+    ///* iteration (from `intermediate_callback`), as the deadline does;
+    ///* null for none
+    void set_cancel_flag(const std::atomic<bool> * cancel) { m_cancel = cancel; }
+
+    ///* Give Ipopt the initial state as variables fixed by their bounds
+    ///* (which it takes out of the problem) instead of through the rows
+    ///* that equal them to it, which are left out (see
+    ///* `Params::fix_initial_state`). Everything in and out of the class
+    ///* keeps the layout of all the constraints, the multipliers of those
+    ///* rows being 0
+    void fix_initial_state(const Indexes & indexes);
+
+    ///* The scaling factors of the objective, of the variables and of the
+    ///* constraints (all of them, in the layout of `set_problem`) that
+    ///* Ipopt's `nlp_scaling_method user-scaling` reads, from the next solve
+    ///* on (see `Params::nlp_scaling`)
+    void set_scaling(double obj_scaling, const Dvector & x_scaling, const Dvector & g_scaling);
+    void set_objective_scaling(double obj_scaling) { m_obj_scaling = obj_scaling; }
+    double objective_scaling() const { return m_obj_scaling; }
+
+    ///* Where the iterations of the next solves go (see
+    ///* `Params::ipopt_journal`), nullptr for nowhere
+    void set_log(IpoptLog * log) { m_log = log; }
+
+    ///* Whether the last solve was stopped by the deadline, and the best
+    ///* (lowest cost) feasible iterate it went through
+    bool deadline_hit() const { return m_deadline_hit; }
+    bool best_feasible_OK() const { return m_best_OK; }
+    double best_obj_value() const { return m_best_obj_value; }
+    const Dvector & best_x() const { return m_best_x; }
+
+    ///* Results of the last solve
+    Ipopt::SolverReturn status() const { return m_status; }
+    double obj_value() const { return m_obj_value; }
+    int iterations() const { return m_iterations; }
+    ///* Time spent in the eval_* callbacks (the tape or the generated code) [s]
+    double eval_time() const { return m_eval_time; }
+    ///* Time Ipopt spent factorizing and back-solving its linear systems
+    ///* [s], from its timing statistics (0 if it doesn't collect them)
+    double linear_solver_time() const { return m_linear_solver_time; }
+    ///* Adds the sizes of the tape (empty with the analytic derivatives) and
+    ///* of the problem
+    void memory_stats(MemoryStats & stats) const;
+    ///* Whether Ipopt went through its restoration phase
+    bool restoration() const { return m_restoration; }
+    ///* Whether the last solve was stopped as diverging (see
+    ///* `Params::abort_divergence`)
+    bool diverged() const { return m_diverged; }
+    ///* Largest violation of the bounds of the constraints by `x`
+    double constraint_violation() const { return m_constraint_violation; }
+    const Dvector & x() const { return m_x; }
+    const Dvector & z_L() const { return m_z_L; }
+    const Dvector & z_U() const { return m_z_U; }
+    const Dvector & lambda() const { return m_lambda; }
+
+    ///* Ipopt::TNLP interface
+    bool get_nlp_info(Ipopt::Index & n, Ipopt::Index & m, Ipopt::Index & nnz_jac_g,
+                      Ipopt::Index & nnz_h_lag, IndexStyleEnum & index_style);
+
+    bool get_bounds_info(Ipopt::Index n, Ipopt::Number * x_l, Ipopt::Number * x_u,
+                         Ipopt::Index m, Ipopt::Number * g_l, Ipopt::Number * g_u);
+
+    bool get_scaling_parameters(Ipopt::Number & obj_scaling, bool & use_x_scaling, Ipopt::Index n,
+                                Ipopt::Number * x_scaling, bool & use_g_scaling, Ipopt::Index m,
+                                Ipopt::Number * g_scaling);
+
+    bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number * x,
+                            bool init_z, Ipopt::Number * z_L, Ipopt::Number * z_U,
+                            Ipopt::Index m, bool init_lambda, Ipopt::Number * lambda);
+
+    bool eval_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number & obj_value);
+
+    bool eval_grad_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number * grad_f);
+
+    bool eval_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m, Ipopt::Number * g);
+
+    bool eval_jac_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m,
+                    Ipopt::Index nele_jac, Ipopt::Index * iRow, Ipopt::Index * jCol, Ipopt::Number * values);
+
+    bool eval_h(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number obj_factor,
+                Ipopt::Index m, const Ipopt::Number * lambda, bool new_lambda,
+                Ipopt::Index nele_hess, Ipopt::Index * iRow, Ipopt::Index * jCol, Ipopt::Number * values);
+
+    void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number * x,
+                           const Ipopt::Number * z_L, const Ipopt::Number * z_U,
+                           Ipopt::Index m, const Ipopt::Number * g, const Ipopt::Number * lambda,
+                           Ipopt::Number obj_value, const Ipopt::IpoptData * ip_data,
+                           Ipopt::IpoptCalculatedQuantities * ip_cq);
+
+    bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                               Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                               Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                               Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                               const Ipopt::IpoptData * ip_data, Ipopt::IpoptCalculatedQuantities * ip_cq);
+
+private:
+    ///* Records `m_fun` (and `m_stage`) from FG_eval of the vehicle model
+    ///* `Model` (see `Params::vehicle_model`) and the trigonometric
+    ///* functions of `Trig` (see `Params::fast_trig`)
+    template <class Model, class Trig>
+    void record_tape(const Params & params, const Indexes & indexes, size_t n_vars, size_t n_constraints);
+
+    ///* ... of the kinematic model, integrated by `Params::integrator`
+    template <class Trig>
+    void record_kinematic_tape(const Params & params, const Indexes & indexes, size_t n_vars,
+                               size_t n_constraints);
+
+    ///* The sparsity of the Jacobian of `fg` and of the Hessian of the
+    ///* Lagrangian, from the tape (by far the longest part of building
+    ///* the NLP with long horizons)
+    void record_patterns(size_t n_vars, size_t n_constraints);
+
+    ///* Sets the patterns of the Jacobian (with the rows of `fg`, i.e. one
+    ///* more than those of the constraints) and of the Hessian
+    void set_patterns(const std::vector<size_t> & jac_row, const std::vector<size_t> & jac_col,
+                      const std::vector<size_t> & hes_row, const std::vector<size_t> & hes_col);
+
+    ///* ... and those of the tape alone, when the steps are evaluated
+    ///* outside of it, with where their entries are in the others
+    void set_tape_patterns(const std::vector<size_t> & jac_row, const std::vector<size_t> & jac_col,
+                           const std::vector<size_t> & hes_row, const std::vector<size_t> & hes_col);
+
+    ///* Copies `x` into `m_xv` and runs a zero order forward sweep if needed
+    void update_x(const Ipopt::Number * x, bool new_x);
+
+    ///* All the constraints at `x`, and the values of the Jacobian of all
+    ///* of them (`m_jac_row.size()`), whichever rows Ipopt sees
+    void constraints(const Ipopt::Number * x, bool new_x, Ipopt::Number * g);
+    void jacobian(const Ipopt::Number * x, Ipopt::Number * values);
+
+    ///* The sparsity of the Hessian of the constraints alone, and where its
+    ///* entries are in that of the Lagrangian (see `m_cost_hessian`)
+    void record_constraint_pattern(size_t n_vars, size_t n_constraints);
+
+    size_t m_n_vars;
+    size_t m_n_constraints;
+    size_t m_n_coeffs;
+
+    ///* The tape: vars -> fg (the cost followed by the constraints)
+    CppAD::ADFun<double> m_fun;
+
+    ///* Evaluates everything instead of the tape, if set (with
+    ///* `Params::analytic_derivatives`)
+    std::unique_ptr<KinematicModel> m_analytic;
+
+    ///* One step of the model, which the tape calls `steps_ahead` times
+    ///* (with `Params::checkpoint_stage` only)
+    std::unique_ptr<CppAD::checkpoint<double> > m_stage;
+
+    ///* Current values of the dynamic parameters: coeffs, ref_v, the weights
+    ///* (see FG_eval::Weight), the weights of the terminal cost from
+    ///* `m_terminal_start` (with `Params::terminal_cost`), then the centers
+    ///* of the obstacles from `m_obstacles_start`
+    Dvector m_dynamic;
+    size_t m_terminal_start;
+    size_t m_obstacles_start;
+
+    ///* Sparsity of the constraint Jacobian (rows of `fg` without the cost)
+    SetVector m_jac_pattern;
+    Svector m_jac_row;
+    Svector m_jac_col;
+    Dvector m_jac_values;
+    CppAD::sparse_jacobian_work m_jac_work;
+
+    ///* Sparsity of the Hessian of the Lagrangian (lower triangle only)
+    SetVector m_hes_pattern;
+    Svector m_hes_row;
+    Svector m_hes_col;
+    Dvector m_hes_values;
+    CppAD::sparse_hessian_work m_hes_work;
+
+    ///* With `Params::constant_cost_hessian`: the Hessian of the cost, in the
+    ///* layout of `m_hes_row` (evaluated once for the weights, whenever
+    ///* they change), and that of the constraints alone, the only one the
+    ///* tape is differentiated twice for, whose k-th entry is the
+    ///* `m_con_hes_k[k]`-th of the Lagrangian's
+    bool m_constant_cost_hessian;
+    bool m_cost_hessian_OK;
+    Dvector m_cost_hessian;
+    SetVector m_con_hes_pattern;
+    Svector m_con_hes_row;
+    Svector m_con_hes_col;
+    Dvector m_con_hes_values;
+    std::vector<size_t> m_con_hes_k;
+    CppAD::sparse_hessian_work m_con_hes_work;
+
+    ///* Evaluates the Jacobian and the Hessian instead of `m_fun`, if set
+    ///* (with `Params::parallel_derivatives`)
+    std::unique_ptr<ParallelDerivatives> m_parallel;
+
+    ///* Evaluates the steps of the model, which are then left out of the
+    ///* tape (with `Params::parallel_stages`). The patterns above are the
+    ///* tape's, the entries Ipopt gets are those of the tape and the steps,
+    ///* and those of the tape alone are the `m_tape_*_k[k]`-th of them
+    std::unique_ptr<ParallelStages> m_stages;
+    Svector m_tape_jac_row;
+    Svector m_tape_jac_col;
+    Dvector m_tape_jac_values;
+    std::vector<size_t> m_tape_jac_k;
+    Svector m_tape_hes_row;
+    Svector m_tape_hes_col;
+    Dvector m_tape_hes_values;
+    std::vector<size_t> m_tape_hes_k;
+
+    ///* Evaluation buffers
+    Dvector m_xv;
+    Dvector m_fg;
+    Dvector m_w;
+    bool m_fg_OK;
+
+    ///* Data of the current problem
+    Dvector m_vars;
+    Dvector m_vars_lowerbound;
+    Dvector m_vars_upperbound;
+    Dvector m_constraints_lowerbound;
+    Dvector m_constraints_upperbound;
+    Dvector m_start_z_L;
+    Dvector m_start_z_U;
+    Dvector m_start_lambda;
+
+    ///* User scaling, if set
+    bool m_scaling_OK;
+    double m_obj_scaling;
+    Dvector m_x_scaling;
+    Dvector m_g_scaling;
+
+    ///* Solution
+    Ipopt::SolverReturn m_status;
+    double m_obj_value;
+    Dvector m_x;
+    Dvector m_z_L;
+    Dvector m_z_U;
+    Dvector m_lambda;
+    int m_iterations;
+    double m_eval_time;
+    double m_linear_solver_time;
+    bool m_restoration;
+    double m_constraint_violation;
+    IpoptLog * m_log;
+
+    ///* With `fix_initial_state`: the constraints of the rows Ipopt sees,
+    ///* the variables fixed instead of the others (each that of its row),
+    ///* and the entries of the Jacobian of the rows that are seen, with
+    ///* their row. All the constraints, their Jacobian and their
+    ///* multipliers are worked out in the other buffers
+    bool m_fixed_initial_state;
+    std::vector<size_t> m_rows;
+    std::vector<size_t> m_fixed;
+    std::vector<size_t> m_jac_seen;
+    std::vector<Ipopt::Index> m_jac_seen_row;
+    Dvector m_all_g;
+    Dvector m_all_jac;
+    Dvector m_all_lambda;
+
+    ///* The divergence tests (see `Params::abort_divergence`), and what
+    ///* they keep of the solve so far: the lowest primal infeasibility, and
+    ///* the iterations in a row with a small step and in the restoration
+    ///* phase
+    bool m_abort_divergence;
+    int m_divergence_min_iterations;
+    double m_divergence_inf_pr_growth;
+    double m_divergence_min_alpha;
+    int m_divergence_small_steps;
+    int m_divergence_restoration_iterations;
+    double m_lowest_inf_pr;
+    int m_small_steps;
+    int m_restoration_iterations;
+    bool m_diverged;
+
+    ///* Whether the iteration of `intermediate_callback` shows the solve is
+    ///* diverging, by the tests of `Params::abort_divergence`
+    bool diverging(Ipopt::AlgorithmMode mode, Ipopt::Index iter, double inf_pr, double alpha_pr);
+
+    ///* Anytime mode
+    std::chrono::steady_clock::time_point m_deadline;
+    bool m_deadline_hit;
+    const std::atomic<bool> * m_cancel;
+    bool m_best_OK;
+    double m_best_obj_value;
+    Dvector m_best_x;
+
+    ///* Constraint violation below which an iterate counts as feasible
+    ///* (Ipopt's default `constr_viol_tol`)
+    static constexpr double FEASIBILITY_TOLERANCE = 1e-4;
+
+#ifdef MPC_CODEGEN
+    ///* Generated code, if loaded; it computes the Jacobian of the whole
+    ///* `fg`, whose row 0 is the gradient of the cost
+    std::unique_ptr<CppAD::cg::DynamicLib<double> > m_codegen_lib;
+    std::unique_ptr<CppAD::cg::GenericModel<double> > m_model;
+    std::vector<size_t> m_cg_grad_k;
+    std::vector<size_t> m_cg_grad_col;
+    std::vector<size_t> m_cg_jac_k;
+    std::vector<double> m_cg_x;
+    std::vector<double> m_cg_p;
+    std::vector<double> m_cg_fg;
+    std::vector<double> m_cg_w;
+    std::vector<double> m_cg_jac;
+    std::vector<double> m_cg_hes;
+    std::vector<size_t> m_cg_row;
+    std::vector<size_t> m_cg_col;
+
+    ///* Copies `x` into `m_cg_x`
+    void update_cg_x(const Ipopt::Number * x);
+#endif
+};
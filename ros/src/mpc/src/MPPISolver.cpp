@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "MPPISolver.h"
+#include "SolverBackend.h"
+
+
+constexpr float MPPISolver::PENALTY;
+
+
+MPPISolver::MPPISolver(const Params & params, double steer_bound, double speed_upperbound)
+        : m_params(params), m_N(params.steps_ahead), m_K(size_t(std::max(params.mppi_samples, 1))),
+          m_steer_bound(steer_bound), m_speed_upperbound(speed_upperbound),
+          m_state(Eigen::VectorXd::Zero(5)), m_ref_v(0.0),
+          m_obstacle_positions(nullptr), m_obstacle_clearances(nullptr), m_num_obstacles(0),
+          m_cte_lower(nullptr), m_cte_upper(nullptr),
+          m_u_delta(params.steps_ahead - 1, 0.0), m_u_v(params.steps_ahead - 1, 0.0), m_u_OK(false),
+          m_delta(m_K, params.steps_ahead - 1), m_v(m_K, params.steps_ahead - 1),
+          m_x(m_K), m_y(m_K), m_psi(m_K), m_cte(m_K), m_epsi(m_K), m_f(m_K), m_slope(m_K),
+          m_cost_samples(m_K), m_weights(m_K),
+          m_nominal_x(params.steps_ahead), m_nominal_y(params.steps_ahead),
+          m_pool(nullptr), m_num_chunks(size_t(std::max(params.mppi_threads, 1))),
+          m_next(0), m_done(0), m_outstanding(0), m_ok(false), m_cost(0.0)
+{
+    m_num_chunks = std::min(m_num_chunks, m_K);
+    for (size_t c=0; c < m_num_chunks; c++) {
+        m_generators.emplace_back(std::mt19937::result_type(c + 1));
+        m_normals.emplace_back(0.0f, 1.0f);
+    }
+}
+
+
+MPPISolver::~MPPISolver() {
+    while (m_outstanding.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
+
+
+void MPPISolver::set_obstacles(const double * positions, const double * clearances, size_t num_slots) {
+    m_obstacle_positions = positions;
+    m_obstacle_clearances = clearances;
+    m_num_obstacles = (positions != nullptr and clearances != nullptr) ? num_slots : 0;
+}
+
+
+void MPPISolver::set_cte_bounds(const double * lower, const double * upper) {
+    m_cte_lower = lower;
+    m_cte_upper = upper;
+}
+
+
+void MPPISolver::Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                       std::vector<double> & result) {
+    m_state = state;
+    m_coeffs = coeffs;
+    m_ref_v = ref_v;
+
+    // The inputs the samples perturb: the last ones shifted by one step, or
+    // straight at the reference speed
+    if (m_u_OK) {
+        for (size_t t=0; t + 2 < m_N; t++) {
+            m_u_delta[t] = m_u_delta[t + 1];
+            m_u_v[t] = m_u_v[t + 1];
+        }
+    } else {
+        std::fill(m_u_delta.begin(), m_u_delta.end(), 0.0);
+        std::fill(m_u_v.begin(), m_u_v.end(), std::min(std::max(ref_v, 0.0), m_speed_upperbound));
+    }
+
+    // The rollouts, a chunk of samples at a time; the calling thread claims
+    // chunks too, and then waits for those being rolled out
+    m_done.store(0, std::memory_order_relaxed);
+    m_next.store(0, std::memory_order_release);
+    if (m_pool != nullptr) {
+        for (size_t c=1; c < m_num_chunks; c++) {
+            m_outstanding.fetch_add(1, std::memory_order_relaxed);
+            m_pool->Schedule([this]() {
+                work();
+                m_outstanding.fetch_sub(1, std::memory_order_release);
+            });
+        }
+    }
+    work();
+    while (m_done.load(std::memory_order_acquire) < m_num_chunks)
+        std::this_thread::yield();
+
+    // The importance weights, relative to the best sample so that they
+    // don't all underflow
+    float best = m_cost_samples.minCoeff();
+    float temperature = float(std::max(m_params.mppi_temperature, 1e-9));
+    m_weights = (-(m_cost_samples - best) / temperature).exp();
+    float total = m_weights.sum();
+    for (size_t t=0; t + 1 < m_N; t++) {
+        m_u_delta[t] = (m_weights * m_delta.col(t)).sum() / total;
+        m_u_v[t] = (m_weights * m_v.col(t)).sum() / total;
+    }
+
+    m_cost = rollout_nominal();
+    m_ok = std::isfinite(m_cost);
+    m_u_OK = m_ok;
+
+    result.resize(2 + 2*m_N);
+    result[0] = m_u_delta[0];
+    result[1] = m_u_v[0];
+    for (size_t t=0; t < m_N; t++) {
+        result[2 + 2*t] = m_nominal_x[t];
+        result[3 + 2*t] = m_nominal_y[t];
+    }
+}
+
+
+void MPPISolver::work() {
+    for (;;) {
+        size_t chunk = m_next.fetch_add(1, std::memory_order_acq_rel);
+        if (chunk >= m_num_chunks)
+            return;
+        rollout_samples(chunk, chunk * m_K / m_num_chunks, (chunk + 1) * m_K / m_num_chunks);
+        m_done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+void MPPISolver::rollout_samples(size_t chunk, size_t begin, size_t end) {
+    const Params & p = m_params;
+    const float dt = float(p.dt);
+    const float steer_bound = float(m_steer_bound);
+    const float speed_upperbound = float(m_speed_upperbound);
+    const float ref_v = float(m_ref_v);
+    const float steer_noise = float(p.mppi_steer_noise);
+    const float speed_noise = float(p.mppi_speed_noise);
+    const float inverse_Lf = float(1.0 / Lf());
+    size_t n = end - begin;
+    std::mt19937 & generator = m_generators[chunk];
+    std::normal_distribution<float> & normal = m_normals[chunk];
+
+    // The inputs of the samples; the first sample is the unperturbed one
+    for (size_t t=0; t + 1 < m_N; t++) {
+        float delta = float(m_u_delta[t]);
+        float v = float(m_u_v[t]);
+        for (size_t k=begin; k < end; k++) {
+            m_delta(k, t) = delta + steer_noise * normal(generator);
+            m_v(k, t) = v + speed_noise * normal(generator);
+        }
+        if (begin == 0) {
+            m_delta(0, t) = delta;
+            m_v(0, t) = v;
+        }
+        m_delta.col(t).segment(begin, n) = m_delta.col(t).segment(begin, n).max(-steer_bound).min(steer_bound);
+        m_v.col(t).segment(begin, n) = m_v.col(t).segment(begin, n).max(0.0f).min(speed_upperbound);
+    }
+
+    auto x = m_x.segment(begin, n);
+    auto y = m_y.segment(begin, n);
+    auto psi = m_psi.segment(begin, n);
+    auto cte = m_cte.segment(begin, n);
+    auto epsi = m_epsi.segment(begin, n);
+    auto f = m_f.segment(begin, n);
+    auto slope = m_slope.segment(begin, n);
+    auto cost = m_cost_samples.segment(begin, n);
+    x.setConstant(float(m_state[0]));
+    y.setConstant(float(m_state[1]));
+    psi.setConstant(float(m_state[2]));
+    cte.setConstant(float(m_state[3]));
+    epsi.setConstant(float(m_state[4]));
+    cost.setZero();
+
+    // The same stages as FG_eval, and the same cost; the state of step t is
+    // that of the rollout after t steps
+    for (size_t t=0; t < m_N; t++) {
+        cost += float(p.cte_coeff) * cte.square() + float(p.epsi_coeff) * epsi.square();
+        if (m_cte_lower != nullptr)
+            cost += PENALTY * (cte < float(m_cte_lower[t]) or cte > float(m_cte_upper[t])).cast<float>();
+        for (size_t j=0; t >= 1 and j < m_num_obstacles; j++) {
+            size_t k = j * (m_N - 1) + t - 1;
+            float clearance = float(m_obstacle_clearances[k]);
+            if (clearance <= 0.0f)
+                continue;
+            float ox = float(m_obstacle_positions[2*k]);
+            float oy = float(m_obstacle_positions[2*k + 1]);
+            cost += PENALTY * ((x - ox).square() + (y - oy).square() < clearance * clearance).cast<float>();
+        }
+        if (t + 1 == m_N)
+            break;
+
+        auto delta = m_delta.col(t).segment(begin, n);
+        auto v = m_v.col(t).segment(begin, n);
+        cost += float(p.speed_coeff) * (v - ref_v).square() + float(p.steer_coeff) * delta.square();
+        if (t >= 1) {
+            cost += float(p.consec_steer_coeff) * (delta - m_delta.col(t - 1).segment(begin, n)).square();
+            cost += float(p.consec_speed_coeff) * (v - m_v.col(t - 1).segment(begin, n)).square();
+        }
+
+        // The reference at x, before x moves on
+        f.setConstant(float(m_coeffs[m_coeffs.size() - 1]));
+        slope.setConstant(float((m_coeffs.size() - 1) * m_coeffs[m_coeffs.size() - 1]));
+        for (Eigen::Index i = m_coeffs.size() - 2; i >= 0; i--) {
+            f = f * x + float(m_coeffs[i]);
+            if (i >= 1)
+                slope = slope * x + float(i * m_coeffs[i]);
+        }
+
+        cte = f - y + v * epsi.sin() * dt;
+        epsi = psi - slope.atan() - v * delta * inverse_Lf * dt;
+        x += v * psi.cos() * dt;
+        y += v * psi.sin() * dt;
+        psi -= v * delta * inverse_Lf * dt;
+    }
+}
+
+
+double MPPISolver::rollout_nominal() {
+    const Params & p = m_params;
+    double dt = p.dt;
+    double x = m_state[0], y = m_state[1], psi = m_state[2], cte = m_state[3], epsi = m_state[4];
+    double cost = 0.0;
+    for (size_t t=0; t < m_N; t++) {
+        m_nominal_x[t] = x;
+        m_nominal_y[t] = y;
+        cost += p.cte_coeff * cte * cte + p.epsi_coeff * epsi * epsi;
+        if (m_cte_lower != nullptr and (cte < m_cte_lower[t] or cte > m_cte_upper[t]))
+            cost += PENALTY;
+        for (size_t j=0; t >= 1 and j < m_num_obstacles; j++) {
+            size_t k = j * (m_N - 1) + t - 1;
+            double dx = x - m_obstacle_positions[2*k];
+            double dy = y - m_obstacle_positions[2*k + 1];
+            if (dx * dx + dy * dy < m_obstacle_clearances[k] * m_obstacle_clearances[k])
+                cost += PENALTY;
+        }
+        if (t + 1 == m_N)
+            break;
+
+        double delta = m_u_delta[t], v = m_u_v[t];
+        cost += p.speed_coeff * (v - m_ref_v) * (v - m_ref_v) + p.steer_coeff * delta * delta;
+        if (t >= 1) {
+            cost += p.consec_steer_coeff * (delta - m_u_delta[t - 1]) * (delta - m_u_delta[t - 1]);
+            cost += p.consec_speed_coeff * (v - m_u_v[t - 1]) * (v - m_u_v[t - 1]);
+        }
+
+        double f = polyeval(m_coeffs, x);
+        double slope = polyeval_diff(m_coeffs, x);
+        cte = f - y + v * sin(epsi) * dt;
+        epsi = psi - atan(slope) - v * delta / Lf() * dt;
+        x += v * cos(psi) * dt;
+        y += v * sin(psi) * dt;
+        psi -= v * delta / Lf() * dt;
+    }
+    return cost;
+}
+
+
+// The backend "mppi": the samples satisfy the bounds of the actuators and
+// pay for the other constraints in their cost
+class MPPIBackend : public SolverBackend {
+public:
+    MPPIBackend(const Params & params, double steer_bound, double speed_upperbound)
+            : m_solver(params, steer_bound, speed_upperbound), m_threads(params.mppi_threads) {}
+
+    void solve(const SolveProblem & problem, std::vector<double> & result, SolveStats & stats) {
+        m_solver.Solve(problem.state, problem.coeffs, problem.ref_v, result);
+        stats.deadline_hit = false;
+        stats.fallback = FALLBACK_NONE;
+        stats.cost = m_solver.cost();
+        stats.ok = m_solver.ok();
+        stats.iterations = 1;
+        stats.restoration = false;
+        stats.diverged = false;
+        stats.constraint_violation = 0.0;
+        stats.eval_time = -1.0;
+        stats.linear_solver_time = -1.0;
+    }
+
+    void reset_warm_start() { m_solver.reset_warm_start(); }
+    void set_weights(const Params & params) { m_solver.set_weights(params); }
+    void set_cte_bounds(const double * lower, const double * upper) { m_solver.set_cte_bounds(lower, upper); }
+    void set_obstacles(const double * positions, const double * clearances, size_t num_slots) {
+        m_solver.set_obstacles(positions, clearances, num_slots);
+    }
+    void set_pool(Eigen::ThreadPoolInterface * pool) {
+        if (m_threads > 1)
+            m_solver.set_pool(pool);
+    }
+    bool allocation_free() const { return true; }
+
+private:
+    MPPISolver m_solver;
+    int m_threads;
+};
+
+
+static std::unique_ptr<SolverBackend> make_mppi(const Params & params, double steer_bound,
+                                                double speed_upperbound) {
+    return std::unique_ptr<SolverBackend>(new MPPIBackend(params, steer_bound, speed_upperbound));
+}
+
+MPC_REGISTER_BACKEND(mppi, make_mppi);
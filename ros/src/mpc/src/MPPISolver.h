@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* Sampling-based controller for the same optimal control problem as
+///* `MPC::Solve` (see `Params::mppi`), without derivatives: Model Predictive
+///* Path Integral control. Every solve rolls `mppi_samples` perturbations of
+///* the last input sequence (shifted by one step) out through the kinematic
+///* model, and averages them with the weights exp(-cost / temperature), so
+///* that its cost is the same on every tick, whatever the problem. The cost
+///* can be anything: the obstacles and the corridor are penalties that the
+///* samples that hit them pay.
+///*
+///* The rollouts are in float, a sample per lane: every state and input is
+///* an array over the samples (structure of arrays) that Eigen vectorizes,
+///* split into `mppi_threads` chunks of samples (each with a random number
+///* generator of its own) claimed by the threads of a pool and the calling
+///* thread, as ParallelDerivatives does.
+class MPPISolver {
+public:
+    MPPISolver(const Params & params, double steer_bound, double speed_upperbound);
+
+    ///* Waits for the tasks still on the pool
+    ~MPPISolver();
+
+    ///* The chunks of samples go to the threads of `pool` too, with
+    ///* `mppi_threads` > 1 (the calling thread alone otherwise)
+    void set_pool(Eigen::ThreadPoolInterface * pool) { m_pool = pool; }
+
+    ///* The penalties of the obstacles (in the layout of MPC's rows of the
+    ///* obstacles, see `Indexes::obstacle`, `num_slots` of them) and of the
+    ///* corridor (the bounds of the cte of every step), which are read on
+    ///* every solve; null for none
+    void set_obstacles(const double * positions, const double * clearances, size_t num_slots);
+    void set_cte_bounds(const double * lower, const double * upper);
+
+    ///* Same arguments and result layout as `MPC::Solve`: the first
+    ///* actuations followed by the (x, y) of every stage of the averaged
+    ///* inputs. Nothing is allocated once `result` has the right size
+    void Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+               std::vector<double> & result);
+
+    void set_weights(const Params & params) { m_params.copy_weights(params); }
+
+    ///* The next solve perturbs straight driving at the reference speed
+    void reset_warm_start() { m_u_OK = false; }
+
+    ///* Whether the last solve's inputs have a finite cost, and that cost
+    bool ok() const { return m_ok; }
+    double cost() const { return m_cost; }
+
+private:
+    ///* The chunks of samples, claimed until there are none left
+    void work();
+    ///* Draws the inputs of the samples [begin, end) and rolls them out
+    void rollout_samples(size_t chunk, size_t begin, size_t end);
+    ///* Rolls the averaged inputs out (in double), into `m_nominal_*`, and
+    ///* returns their cost
+    double rollout_nominal();
+
+    Params m_params;
+    size_t m_N;
+    size_t m_K;
+    double m_steer_bound;
+    double m_speed_upperbound;
+
+    ///* The problem of the current solve
+    Eigen::VectorXd m_state;
+    Eigen::VectorXd m_coeffs;
+    double m_ref_v;
+    const double * m_obstacle_positions;
+    const double * m_obstacle_clearances;
+    size_t m_num_obstacles;
+    const double * m_cte_lower;
+    const double * m_cte_upper;
+
+    ///* The input sequence (steering, speed) the samples perturb, and
+    ///* whether it's that of the last solve
+    std::vector<double> m_u_delta;
+    std::vector<double> m_u_v;
+    bool m_u_OK;
+
+    ///* The samples: their inputs (a column per step, a row per sample), the
+    ///* state of their rollouts (that of the step being rolled out) and
+    ///* their costs, the values of the reference there, and their weights
+    Eigen::ArrayXXf m_delta;
+    Eigen::ArrayXXf m_v;
+    Eigen::ArrayXf m_x;
+    Eigen::ArrayXf m_y;
+    Eigen::ArrayXf m_psi;
+    Eigen::ArrayXf m_cte;
+    Eigen::ArrayXf m_epsi;
+    Eigen::ArrayXf m_f;
+    Eigen::ArrayXf m_slope;
+    Eigen::ArrayXf m_cost_samples;
+    Eigen::ArrayXf m_weights;
+
+    ///* The rollout of the averaged inputs
+    std::vector<double> m_nominal_x;
+    std::vector<double> m_nominal_y;
+
+    ///* A generator (and distribution, which keeps a draw of its own) per
+    ///* chunk, so that the chunks draw in parallel and the draws don't
+    ///* depend on which thread claims which chunk
+    std::vector<std::mt19937> m_generators;
+    std::vector<std::normal_distribution<float> > m_normals;
+
+    Eigen::ThreadPoolInterface * m_pool;
+    size_t m_num_chunks;
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_done;
+    std::atomic<size_t> m_outstanding;
+
+    bool m_ok;
+    double m_cost;
+
+    ///* The cost of a step into an obstacle or out of the corridor
+    static constexpr float PENALTY = 1e6f;
+};
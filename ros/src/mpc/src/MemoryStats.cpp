@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cppad/cppad.hpp>
+
+#include "MemoryStats.h"
+#include "Log.h"
+
+
+void read_cppad_memory(MemoryStats & stats) {
+    stats.cppad_inuse = 0;
+    stats.cppad_available = 0;
+    for (size_t thread=0; thread < CppAD::thread_alloc::num_threads(); thread++) {
+        stats.cppad_inuse += CppAD::thread_alloc::inuse(thread);
+        stats.cppad_available += CppAD::thread_alloc::available(thread);
+    }
+}
+
+
+bool read_process_memory(MemoryStats & stats) {
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    bool rss_OK = false;
+    while (std::getline(file, line)) {
+        // In kB
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            stats.rss = 1024 * std::stoull(line.substr(6));
+            rss_OK = true;
+        } else if (line.compare(0, 6, "VmHWM:") == 0) {
+            stats.peak_rss = 1024 * std::stoull(line.substr(6));
+        }
+    }
+    return rss_OK;
+}
+
+
+void reserve_cppad_memory(size_t bytes) {
+    static constexpr size_t SMALLEST = 128;
+    static constexpr size_t LARGEST = 1 << 20;
+
+    // Held even in sequential mode
+    CppAD::thread_alloc::hold_memory(true);
+
+    // Round robin over the sizes, so that each has its share
+    std::vector<void *> blocks;
+    size_t reserved = 0;
+    while (reserved < bytes) {
+        for (size_t size=SMALLEST; size <= LARGEST and reserved < bytes; size *= 2) {
+            size_t capacity;
+            blocks.push_back(CppAD::thread_alloc::get_memory(size, capacity));
+            reserved += capacity;
+        }
+    }
+    for (void * block : blocks)
+        CppAD::thread_alloc::return_memory(block);
+    MPC_INFO("Reserved %.1f MiB for CppAD", reserved / double(1 << 20));
+}
+
+
+bool cap_cppad_memory(size_t bytes) {
+    if (CppAD::thread_alloc::in_parallel())
+        return false;
+    size_t available = 0;
+    for (size_t thread=0; thread < CppAD::thread_alloc::num_threads(); thread++)
+        available += CppAD::thread_alloc::available(thread);
+    if (available <= bytes)
+        return false;
+    for (size_t thread=0; thread < CppAD::thread_alloc::num_threads(); thread++)
+        CppAD::thread_alloc::free_available(thread);
+    return true;
+}
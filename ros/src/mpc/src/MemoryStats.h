@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+///* The memory of the controller, to size the computer it runs on and to
+///* see it grow (leaks, fragmentation) over a race: CppAD's pools, the
+///* sizes of the tapes and of Ipopt's problems, and the resident set of the
+///* process. A flat object, handed over with StageStats.
+struct MemoryStats {
+    ///* CppAD's memory (its thread_alloc), over all its threads [bytes]: in
+    ///* use, and held for reuse
+    uint64_t cppad_inuse = 0;
+    uint64_t cppad_available = 0;
+
+    ///* The tapes of the controllers (see `MPC::memory_stats`): their
+    ///* operations, their variables, and the bytes of their operation
+    ///* sequences
+    uint64_t tape_ops = 0;
+    uint64_t tape_vars = 0;
+    uint64_t tape_bytes = 0;
+
+    ///* Ipopt's problems: the variables, the constraints, and the nonzeros
+    ///* of the Jacobian of the constraints and of the Hessian of the
+    ///* Lagrangian (which size its KKT systems)
+    uint64_t nlp_vars = 0;
+    uint64_t nlp_constraints = 0;
+    uint64_t jacobian_nonzeros = 0;
+    uint64_t hessian_nonzeros = 0;
+
+    ///* The resident set of the process and its peak [bytes]
+    uint64_t rss = 0;
+    uint64_t peak_rss = 0;
+
+    ///* The arena of the ticks (see TickArena): the most of it in use
+    ///* [bytes], its allocations that came from the heap, and the ticks at
+    ///* the end of which it couldn't be reset
+    uint64_t arena_high_water = 0;
+    uint64_t arena_fallbacks = 0;
+    uint64_t arena_pinned_ticks = 0;
+};
+
+
+///* Sets the counts of CppAD's memory, from the thread that solves outside
+///* of the pool (see ParallelCppAD)
+void read_cppad_memory(MemoryStats & stats);
+
+///* Sets the resident set of the process, from /proc/self/status (false
+///* when it can't be read). It reads a file: not from the solver loop
+bool read_process_memory(MemoryStats & stats);
+
+///* Fills CppAD's pool of the calling thread with `bytes` [bytes] of blocks
+///* of all the sizes up to a MiB, held for reuse, so that the first solves
+///* don't grow it (see `Params::cppad_reserve_mb`)
+void reserve_cppad_memory(size_t bytes);
+
+///* Gives what CppAD holds for reuse back to the system when it's over
+///* `bytes` [bytes], outside of the parallel sections; false when it's
+///* under it
+bool cap_cppad_memory(size_t bytes);
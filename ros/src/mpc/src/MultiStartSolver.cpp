@@ -0,0 +1,155 @@
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "MultiStartSolver.h"
+#include "ParallelCppAD.h"
+#include "Log.h"
+#include "Trace.h"
+
+
+MultiStartSolver::MultiStartSolver(const Params & params, Eigen::ThreadPoolInterface * pool, ParallelBuild * build)
+        : m_pool(pool), m_chosen(0), m_state(nullptr), m_coeffs(nullptr), m_ref_v(0.0), m_pending(0)
+{
+    // The main solve, then the variants in the order they're preferred in
+    m_variants.push_back(Variant{nullptr, 1.0, false, {}});
+    if (pool != nullptr) {
+        if (params.parallel_cold_start and !params.warm_start)
+            MPC_WARN("parallel_cold_start needs warm_start, ignoring it");
+        else if (params.parallel_cold_start)
+            m_variants.push_back(Variant{nullptr, 1.0, true, {}});
+        for (double scale : params.parallel_ref_v_scales)
+            m_variants.push_back(Variant{nullptr, scale, false, {}});
+    }
+    for (Variant & variant : m_variants) {
+        variant.result.reserve(2 + 2 * params.steps_ahead);
+        if (build != nullptr)
+            build->add(params, variant.controller);
+        else
+            variant.controller.reset(new MPC(params));
+    }
+    if (build != nullptr)
+        build->then([this]() { setup(); });
+    else
+        setup();
+}
+
+
+void MultiStartSolver::setup() {
+    // The derivatives (or the samples, or whatever the backend shares) of
+    // the main solve are spread over the pool too
+    if (m_pool != nullptr)
+        m_variants.front().controller->set_derivative_pool(m_pool);
+
+    // The structure cache warm starts the next run from the main solve
+    for (Variant & variant : m_variants)
+        variant.controller->set_saves_solution(&variant == &m_variants.front());
+}
+
+
+bool MultiStartSolver::allocation_free() const {
+    for (const Variant & variant : m_variants)
+        if (!variant.controller->allocation_free())
+            return false;
+    return true;
+}
+
+
+void MultiStartSolver::memory_stats(MemoryStats & stats) const {
+    for (const Variant & variant : m_variants)
+        variant.controller->memory_stats(stats);
+}
+
+
+bool MultiStartSolver::set_weights(const Params & params) {
+    bool OK = true;
+    for (Variant & variant : m_variants)
+        OK = variant.controller->set_weights(params) and OK;
+    return OK;
+}
+
+
+void MultiStartSolver::set_cte_bounds(const double * lower, const double * upper, size_t n) {
+    for (Variant & variant : m_variants)
+        variant.controller->set_cte_bounds(lower, upper, n);
+}
+
+
+void MultiStartSolver::set_obstacles(const double * positions, const double * clearances, size_t n) {
+    for (Variant & variant : m_variants)
+        variant.controller->set_obstacles(positions, clearances, n);
+}
+
+
+void MultiStartSolver::set_lap_seed(const double * x, size_t n) {
+    for (Variant & variant : m_variants)
+        variant.controller->set_lap_seed(x, n);
+}
+
+
+void MultiStartSolver::set_terminal_target(double cte, double epsi, double delta) {
+    for (Variant & variant : m_variants)
+        variant.controller->set_terminal_target(cte, epsi, delta);
+}
+
+
+void MultiStartSolver::set_cancel_flag(const std::atomic<bool> * cancel) {
+    for (Variant & variant : m_variants)
+        variant.controller->set_cancel_flag(cancel);
+}
+
+
+void MultiStartSolver::reset_warm_start() {
+    for (Variant & variant : m_variants)
+        variant.controller->reset_warm_start();
+}
+
+
+void MultiStartSolver::solve_variant(size_t index) {
+    MPC_TRACE_SCOPE("MultiStartSolver::variant");
+    Variant & variant = m_variants[index];
+    if (variant.cold_start)
+        variant.controller->reset_warm_start();
+    variant.controller->Solve(*m_state, *m_coeffs, m_ref_v * variant.ref_v_scale, variant.result, m_deadline);
+}
+
+
+void MultiStartSolver::Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                             std::vector<double> & result, const std::chrono::steady_clock::time_point & deadline) {
+    if (m_variants.size() == 1) {
+        m_variants[0].controller->Solve(state, coeffs, ref_v, result, deadline);
+        m_chosen = 0;
+        return;
+    }
+
+    m_state = &state;
+    m_coeffs = &coeffs;
+    m_ref_v = ref_v;
+    m_deadline = deadline;
+
+    // The variants on the pool (the capture fits in std::function's own
+    // storage, so scheduling doesn't allocate), the main one here
+    ParallelCppAD::Section parallel;
+    m_pending = m_variants.size() - 1;
+    for (size_t i=1; i < m_variants.size(); i++) {
+        m_pool->Schedule([this, i]() {
+            solve_variant(i);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0)
+                m_done.notify_one();
+        });
+    }
+    solve_variant(0);
+    {
+        MPC_TRACE_SCOPE("MultiStartSolver::wait");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_pending == 0; });
+    }
+
+    // The most preferred solve that succeeded, the main one if none did
+    m_chosen = 0;
+    for (size_t i=0; i < m_variants.size(); i++) {
+        if (m_variants[i].controller->ok()) {
+            m_chosen = i;
+            break;
+        }
+    }
+    result = m_variants[m_chosen].result;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "ParallelBuild.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* One solve of the controller, and its parallel variants (see
+///* `Params::parallel_ref_v_scales`): each variant has an MPC of its own,
+///* solved on `pool` while the main one is solved on the calling thread, all
+///* of them until the same deadline. The result is the main solve's if it
+///* succeeded, otherwise that of the first variant that did: the cold
+///* start, then the reference speeds in the order of their scales.
+///*
+///* Without variants (or a pool) it's just the main MPC.
+class MultiStartSolver {
+public:
+    ///* With `build`, the MPCs are made by it (see ParallelBuild), and the
+    ///* solver can't be used before its `run`
+    MultiStartSolver(const Params & params, Eigen::ThreadPoolInterface * pool, ParallelBuild * build = nullptr);
+
+    ///* Same arguments and result as `MPC::Solve`. Nothing is allocated once
+    ///* the results have the right size
+    void Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+               std::vector<double> & result,
+               const std::chrono::steady_clock::time_point & deadline
+                    = std::chrono::steady_clock::time_point::max());
+
+    ///* The stats of the solve the last result is from, and which one it is
+    ///* (0: the main solve)
+    const SolveStats & stats() const { return m_variants[m_chosen].controller->stats(); }
+    size_t chosen() const { return m_chosen; }
+    const MPC & chosen_controller() const { return *m_variants[m_chosen].controller; }
+
+    size_t num_variants() const { return m_variants.size(); }
+
+    ///* See `MPC::set_weights`, for all the variants; false if any of them
+    ///* can't take them
+    bool set_weights(const Params & params);
+
+    ///* See `MPC::set_cte_bounds`, for all the variants
+    void set_cte_bounds(const double * lower, const double * upper, size_t n);
+
+    ///* See `MPC::set_obstacles`, for all the variants
+    void set_obstacles(const double * positions, const double * clearances, size_t n);
+
+    ///* See `MPC::set_lap_seed`, for all the variants
+    void set_lap_seed(const double * x, size_t n);
+
+    ///* See `MPC::set_terminal_target`, for all the variants
+    void set_terminal_target(double cte, double epsi, double delta);
+
+    ///* See `MPC::set_cancel_flag`, for all the variants
+    void set_cancel_flag(const std::atomic<bool> * cancel);
+
+    bool allocation_free() const;
+    void reset_warm_start();
+    ///* Of all the variants (see `MPC::memory_stats`)
+    void memory_stats(MemoryStats & stats) const;
+
+    double speed_upperbound() const { return m_variants.front().controller->speed_upperbound(); }
+
+private:
+    struct Variant {
+        std::unique_ptr<MPC> controller;
+        double ref_v_scale;
+        bool cold_start;
+        std::vector<double> result;
+    };
+
+    void solve_variant(size_t index);
+    ///* What's set up once the MPCs are made
+    void setup();
+
+    std::vector<Variant> m_variants;
+    Eigen::ThreadPoolInterface * m_pool;
+    size_t m_chosen;
+
+    ///* The problem being solved, for the variants
+    const Eigen::VectorXd * m_state;
+    const Eigen::VectorXd * m_coeffs;
+    double m_ref_v;
+    std::chrono::steady_clock::time_point m_deadline;
+
+    ///* The variants still solving
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    size_t m_pending;
+};
@@ -0,0 +1,132 @@
+#include <cmath>
+#include <algorithm>
+
+#include "Obstacles.h"
+#include "AllocationCounter.h"
+
+
+constexpr double ObstacleSelector::SWEEP_MARGIN;
+
+
+void ObstacleSet::build() {
+    size_t num_obstacles = x.size();
+    vx.resize(num_obstacles, 0.0);
+    vy.resize(num_obstacles, 0.0);
+    grid.build(x, y);
+
+    max_radius = 0.0;
+    max_speed = 0.0;
+    for (size_t i=0; i < num_obstacles; i++) {
+        max_radius = std::max(max_radius, radius[i]);
+        max_speed = std::max(max_speed, std::hypot(vx[i], vy[i]));
+    }
+}
+
+
+ObstacleSelector::ObstacleSelector(const Params & params, size_t num_stages)
+        : m_num_slots(size_t(std::max(params.max_obstacles, 0))), m_num_stages(std::max(num_stages, size_t(1))),
+          m_margin(params.obstacle_margin), m_epoch(0), m_num_candidates(0), m_num_selected(0)
+{
+    // Along the time grid of the longest horizon
+    m_times.resize(m_num_stages);
+    m_times[0] = 0.0;
+    for (size_t t=1; t < m_num_stages; t++)
+        m_times[t] = m_times[t - 1] + params.step_dt(t - 1);
+
+    m_best.resize(m_num_slots);
+    m_best_clearance.resize(m_num_slots);
+    m_positions.assign(2 * m_num_slots * m_num_stages, 0.0);
+    m_clearances.assign(m_num_slots * m_num_stages, 0.0);
+}
+
+
+void ObstacleSelector::select(const ObstacleSet * obstacles, double time, double pos_x, double pos_y, double psi,
+                              const double * plan_x, const double * plan_y, size_t num_plan) {
+    std::fill(m_positions.begin(), m_positions.end(), 0.0);
+    std::fill(m_clearances.begin(), m_clearances.end(), 0.0);
+    m_num_candidates = 0;
+    m_num_selected = 0;
+    if (obstacles == nullptr or obstacles->size() == 0 or m_num_slots == 0 or num_plan == 0)
+        return;
+    const ObstacleSet & set = *obstacles;
+
+    // The buffers grow with the largest scene so far, on the schedule of
+    // the perception rather than of the ticks
+    if (m_marks.size() < set.size()) {
+        AllocationCounter::Pause pause;
+        m_marks.resize(set.size(), 0);
+        m_found.reserve(set.size());
+    }
+    if (++m_epoch == 0) {
+        std::fill(m_marks.begin(), m_marks.end(), 0);
+        m_epoch = 1;
+    }
+
+    // Far enough from the plan that it can't come near, at any step
+    double age = std::max(0.0, time - set.stamp);
+    size_t num_points = std::min(num_plan, m_num_stages);
+    double reach = set.max_radius + m_margin + SWEEP_MARGIN + set.max_speed * (age + m_times.back());
+
+    size_t num_best = 0;
+    for (size_t k=0; k < num_points; k++) {
+        set.grid.within_radius(plan_x[k], plan_y[k], reach, m_found);
+        for (int i : m_found) {
+            if (m_marks[i] == m_epoch)
+                continue;
+            m_marks[i] = m_epoch;
+            m_num_candidates++;
+
+            double keep = set.radius[i] + m_margin;
+            double dx = set.x[i] + set.vx[i] * age - pos_x;
+            double dy = set.y[i] + set.vy[i] * age - pos_y;
+            if (dx * dx + dy * dy <= keep * keep)
+                continue;
+
+            // How close it comes to the plan, each where it is at every step
+            double clearance = 1.0e19;
+            for (size_t t=0; t < m_num_stages; t++) {
+                size_t p = std::min(t, num_points - 1);
+                double ox = set.x[i] + set.vx[i] * (age + m_times[t]) - plan_x[p];
+                double oy = set.y[i] + set.vy[i] * (age + m_times[t]) - plan_y[p];
+                clearance = std::min(clearance, std::hypot(ox, oy) - set.radius[i]);
+            }
+
+            // Into the best ones, which stay sorted
+            size_t b = num_best;
+            while (b > 0 and m_best_clearance[b - 1] > clearance)
+                b--;
+            if (b >= m_num_slots)
+                continue;
+            num_best = std::min(num_best + 1, m_num_slots);
+            for (size_t c = num_best - 1; c > b; c--) {
+                m_best[c] = m_best[c - 1];
+                m_best_clearance[c] = m_best_clearance[c - 1];
+            }
+            m_best[b] = i;
+            m_best_clearance[b] = clearance;
+        }
+    }
+
+    // The slots, in the car's frame, active where the plan comes near
+    double cos_psi = std::cos(psi);
+    double sin_psi = std::sin(psi);
+    for (size_t j=0; j < num_best; j++) {
+        int i = m_best[j];
+        double keep = set.radius[i] + m_margin;
+        double near = keep + SWEEP_MARGIN;
+        for (size_t t=0; t < m_num_stages; t++) {
+            double ox = set.x[i] + set.vx[i] * (age + m_times[t]);
+            double oy = set.y[i] + set.vy[i] * (age + m_times[t]);
+            size_t s = j * m_num_stages + t;
+            m_positions[2*s] = cos_psi * (ox - pos_x) + sin_psi * (oy - pos_y);
+            m_positions[2*s + 1] = -sin_psi * (ox - pos_x) + cos_psi * (oy - pos_y);
+
+            size_t p = std::min(t, num_points - 1);
+            double dx = ox - plan_x[p];
+            double dy = oy - plan_y[p];
+            if (dx * dx + dy * dy <= near * near)
+                m_clearances[s] = keep;
+        }
+    }
+    m_num_selected = num_best;
+}
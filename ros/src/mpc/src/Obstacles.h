@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MPC.h"
+#include "SpatialGrid.h"
+
+
+///* The obstacles to keep clear of (see `Params::max_obstacles`), in the
+///* world frame: discs of `radius` [m] about (x, y) [m] at `stamp` [s],
+///* moving at (vx, vy) [m/s] from then on, with a grid over their centers.
+///* Built once per message (see `build`) and only read after that, so the
+///* solver loop can hold on to it while the next one arrives
+struct ObstacleSet {
+    double stamp = 0.0;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> radius;
+    std::vector<double> vx;
+    std::vector<double> vy;
+
+    SpatialGrid grid;
+    ///* The largest radius and speed among them
+    double max_radius = 0.0;
+    double max_speed = 0.0;
+
+    size_t size() const { return x.size(); }
+
+    ///* The grid and the maxima of the obstacles above (static ones where
+    ///* the velocities are missing)
+    void build();
+};
+
+
+///* Picks the obstacles a solve keeps clear of out of a scene of any size,
+///* into the fixed number of slots of the NLP (see `Indexes::obstacle_start`),
+///* so that neither its structure nor its tape change from tick to tick.
+///*
+///* The candidates are the obstacles the grid finds about the points of the
+///* previous plan (or of the path straight ahead, without one), as far as
+///* the new plan may stray from the old one (SWEEP_MARGIN) plus the margin,
+///* the largest radius and how far the fastest obstacle moves over the
+///* horizon: the swept region of the plan, so the work doesn't grow with
+///* the scene. The `num_slots()` of them that come closest to the plan take
+///* the slots, and the constraint of a slot is only active at the steps
+///* where its obstacle (where it is then, at constant velocity) comes that
+///* near the plan's point; the other rows are left without bounds. An
+///* obstacle the car is within already is left out: no plan clears it.
+class ObstacleSelector {
+public:
+    ///* The slots of `params`, for horizons of up to `num_stages` steps
+    ObstacleSelector(const Params & params, size_t num_stages);
+
+    size_t num_slots() const { return m_num_slots; }
+    size_t num_stages() const { return m_num_stages; }
+
+    ///* The time [s] from the first step to each of them
+    const std::vector<double> & times() const { return m_times; }
+
+    ///* Fills the slots for the plan from the pose (pos_x, pos_y, psi) at
+    ///* `time` [s] (on the clock of `ObstacleSet::stamp`), culling the
+    ///* obstacles against the plan at (plan_x[t], plan_y[t]) in the world
+    ///* frame at each of the first `num_plan` steps (the last one standing
+    ///* for those after it). No obstacles when `obstacles` is nullptr
+    void select(const ObstacleSet * obstacles, double time, double pos_x, double pos_y, double psi,
+                const double * plan_x, const double * plan_y, size_t num_plan);
+
+    ///* Of the last `select`: the obstacles found about the plan, and those
+    ///* of them that got a slot
+    size_t num_candidates() const { return m_num_candidates; }
+    size_t num_selected() const { return m_num_selected; }
+
+    ///* For slot j at step t, at s = j * num_stages() + t: the center of its
+    ///* obstacle in the car's frame (x at 2 s, y at 2 s + 1), and how far
+    ///* from it the car keeps (at s, 0 where the slot is free)
+    const std::vector<double> & positions() const { return m_positions; }
+    const std::vector<double> & clearances() const { return m_clearances; }
+
+    ///* How far [m] a plan is expected to stray from the previous one
+    static constexpr double SWEEP_MARGIN = 1.0;
+
+private:
+    size_t m_num_slots;
+    size_t m_num_stages;
+    double m_margin;
+    std::vector<double> m_times;
+
+    ///* What the grid found about a point of the plan, the obstacles marked
+    ///* with the `select` that looked at them last, and the best so far, in
+    ///* increasing order of how close they come to the plan
+    std::vector<int> m_found;
+    std::vector<uint32_t> m_marks;
+    uint32_t m_epoch;
+    std::vector<int> m_best;
+    std::vector<double> m_best_clearance;
+    size_t m_num_candidates;
+    size_t m_num_selected;
+
+    std::vector<double> m_positions;
+    std::vector<double> m_clearances;
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+///* What the ROS-free tools (mpc_benchmark, mpc_simulator, ...) share
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "MPC.h"
+#include "FlightRecorder.h"
+#include "VehicleModel.h"
+#include "WaypointBuffer.h"
+#include "WaypointLoader.h"
+
+
+///* The solver configurations, by the Params flags they set
+struct Configuration {
+    const char * name;
+    bool persistent_tape;
+    bool warm_start;
+    bool fixed_horizon;
+    bool riccati_solver;
+    bool rti;
+    bool checkpoint_stage;
+    bool analytic_derivatives;
+    bool autodiff_stages;
+    bool limited_memory_hessian;
+    bool condensed;
+    bool dual_warm_start;
+
+    void apply(Params & params) const {
+        params.persistent_tape = persistent_tape;
+        params.warm_start = warm_start;
+        params.fixed_horizon = fixed_horizon;
+        params.riccati_solver = riccati_solver;
+        params.rti = rti;
+        params.checkpoint_stage = checkpoint_stage;
+        params.analytic_derivatives = analytic_derivatives;
+        params.autodiff_stages = autodiff_stages;
+        params.limited_memory_hessian = limited_memory_hessian;
+        params.condensed = condensed;
+        params.dual_warm_start = dual_warm_start;
+    }
+};
+
+
+static const Configuration CONFIGURATIONS[] = {
+    {"ipopt",              false, false, false, false, false, false, false, false, false, false, false},
+    {"ipopt_warm",         false, true,  false, false, false, false, false, false, false, false, false},
+    {"ipopt_fixed",        false, false, true,  false, false, false, false, false, false, false, false},
+    {"ipopt_lbfgs",        false, true,  false, false, false, false, false, false, true,  false, false},
+    {"persistent",         true,  false, false, false, false, false, false, false, false, false, false},
+    {"persistent_warm",    true,  true,  false, false, false, false, false, false, false, false, false},
+    {"persistent_dual",    true,  true,  false, false, false, false, false, false, false, false, true},
+    {"persistent_lbfgs",   true,  true,  false, false, false, false, false, false, true,  false, false},
+    {"checkpoint",         true,  false, false, false, false, true,  false, false, false, false, false},
+    {"analytic",           true,  false, false, false, false, false, true,  false, false, false, false},
+    {"autodiff",           true,  false, false, false, false, false, true,  true,  false, false, false},
+    {"condensed",          false, false, false, false, false, false, false, false, false, true,  false},
+    {"condensed_warm",     false, true,  false, false, false, false, false, false, false, true,  false},
+    {"riccati",            false, false, false, true,  false, false, false, false, false, false, false},
+    {"riccati_warm",       false, true,  false, true,  false, false, false, false, false, false, false},
+    {"rti",                false, false, false, false, true,  false, false, false, false, false, false},
+};
+
+
+///* The configuration called `name`, nullptr if none is
+inline const Configuration * find_configuration(const std::string & name) {
+    for (const Configuration & configuration : CONFIGURATIONS)
+        if (name == configuration.name)
+            return &configuration;
+    return nullptr;
+}
+
+
+///* The configuration of the solver of a log: the name of the
+///* configurations of mpc_benchmark it matches (or its flags), and what the
+///* configurations don't set
+inline std::string configuration_label(const FlightLogHeader & header) {
+    uint32_t flags = header.solver_flags;
+    std::string label;
+    for (const Configuration & configuration : CONFIGURATIONS) {
+        bool same = (configuration.persistent_tape == ((flags & FlightLogHeader::SOLVER_PERSISTENT_TAPE) != 0))
+                and (configuration.warm_start == ((flags & FlightLogHeader::SOLVER_WARM_START) != 0))
+                and (configuration.fixed_horizon == ((flags & FlightLogHeader::SOLVER_FIXED_HORIZON) != 0))
+                and (configuration.riccati_solver == ((flags & FlightLogHeader::SOLVER_RICCATI) != 0))
+                and (configuration.rti == ((flags & FlightLogHeader::SOLVER_RTI) != 0))
+                and (configuration.checkpoint_stage == ((flags & FlightLogHeader::SOLVER_CHECKPOINT_STAGE) != 0))
+                and (configuration.analytic_derivatives
+                     == ((flags & FlightLogHeader::SOLVER_ANALYTIC_DERIVATIVES) != 0))
+                and (configuration.autodiff_stages == ((flags & FlightLogHeader::SOLVER_AUTODIFF_STAGES) != 0))
+                and (configuration.limited_memory_hessian
+                     == ((flags & FlightLogHeader::SOLVER_LIMITED_MEMORY_HESSIAN) != 0))
+                and (configuration.condensed == ((flags & FlightLogHeader::SOLVER_CONDENSED) != 0));
+        if (same) {
+            label = configuration.name;
+            break;
+        }
+    }
+    char buffer[64];
+    if (label.empty()) {
+        std::snprintf(buffer, sizeof(buffer), "flags_%x", flags & ~(FlightLogHeader::SOLVER_DYNAMIC_MODEL
+                      | FlightLogHeader::SOLVER_FAST_TRIG | FlightLogHeader::SOLVER_INTEGRATOR));
+        label = buffer;
+    }
+    if (flags & FlightLogHeader::SOLVER_DYNAMIC_MODEL)
+        label += "+dynamic";
+    if (flags & FlightLogHeader::SOLVER_FAST_TRIG)
+        label += "+fast_trig";
+    Integrator integrator = Integrator((flags & FlightLogHeader::SOLVER_INTEGRATOR)
+                                       >> FlightLogHeader::SOLVER_INTEGRATOR_SHIFT);
+    if (integrator != INTEGRATOR_EULER)
+        label += std::string("+") + integrator_name(integrator);
+    if (header.precision != 0)
+        label += std::string("+") + FlightLogHeader::PRECISIONS[header.precision];
+    std::snprintf(buffer, sizeof(buffer), "/dt=%g", header.dt);
+    return label + buffer;
+}
+
+
+///* The defaults of run_mpc_cpp.sh
+inline Params default_params() {
+    Params params;
+    params.steps_ahead = 20;
+    params.dt = 0.05;
+    params.ref_v = 4.5;
+    params.ref_v_alpha = 0.9;
+    params.latency = 0.05;
+    params.cte_coeff = 200;
+    params.epsi_coeff = 100;
+    params.speed_coeff = 100;
+    params.steer_coeff = 2;
+    params.consec_steer_coeff = 1000;
+    params.consec_speed_coeff = 5;
+    params.poly_degree = 2;
+    params.num_steps_poly = 50;
+    params.debug = false;
+    return params;
+}
+
+
+///* The synthetic drive of the replays: at `tick`, the car is next to the
+///* waypoint of the tick, weaving around the path (so that the cross track
+///* and the heading errors aren't 0). Its pose, and the window of waypoints
+///* the polynomial is fit to (of the size of `window`), as in ControlPipeline.
+///* The drive is the same on every run
+template <class Scalar>
+inline void replay_pose(const Waypoints & waypoints, size_t tick, WaypointBufferT<Scalar> & window,
+                        double & pos_x, double & pos_y, double & psi) {
+    // As in ControlPipeline
+    const int NUM_STEPS_BACK = 5;
+    // How the car weaves around the path: offsets [m], [rad] and periods [ticks]
+    const double LATERAL_AMPLITUDE = 0.1;
+    const double LATERAL_PERIOD = 50.0;
+    const double HEADING_AMPLITUDE = 0.05;
+    const double HEADING_PERIOD = 37.0;
+
+    const std::vector<double> & pts_x = waypoints.x;
+    const std::vector<double> & pts_y = waypoints.y;
+    int n = int(pts_x.size());
+
+    int i = int(tick % n);
+    int prev = (i - 1 + n) % n;
+    int next = (i + 1) % n;
+    double heading = atan2(pts_y[next] - pts_y[prev], pts_x[next] - pts_x[prev]);
+    double offset = LATERAL_AMPLITUDE * sin(2 * M_PI * tick / LATERAL_PERIOD);
+    pos_x = pts_x[i] - offset * sin(heading);
+    pos_y = pts_y[i] + offset * cos(heading);
+    psi = heading + HEADING_AMPLITUDE * sin(2 * M_PI * tick / HEADING_PERIOD);
+
+    for (size_t k=0; k < window.size(); k++) {
+        int idx = ((i - NUM_STEPS_BACK + int(k)) % n + n) % n;
+        window.x[k] = Scalar(pts_x[idx]);
+        window.y[k] = Scalar(pts_y[idx]);
+    }
+}
+
+
+///* The p-th percentile (nearest rank) of the sorted values, 0 if none
+inline double percentile(const std::vector<double> & sorted, double p) {
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
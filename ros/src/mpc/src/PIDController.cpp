@@ -0,0 +1,33 @@
+#include "PIDController.h"
+
+
+PIDController::PIDController(const Params & params)
+        : m_kp_cte(params.pid_kp_cte), m_ki_cte(params.pid_ki_cte), m_kd_cte(params.pid_kd_cte),
+          m_kp_epsi(params.pid_kp_epsi), m_ki_epsi(params.pid_ki_epsi), m_kd_epsi(params.pid_kd_epsi) {}
+
+
+void PIDController::Storage::step(double value) {
+    // No derivative on the first value
+    prev = OK ? curr : value;
+    curr = value;
+    integral += value;
+    OK = true;
+}
+
+
+void PIDController::update(double cte, double epsi) {
+    m_cte.step(cte);
+    m_epsi.step(epsi);
+}
+
+
+double PIDController::steer() const {
+    return m_kp_cte * m_cte.curr + m_ki_cte * m_cte.integral + m_kd_cte * m_cte.derivative()
+           - m_kp_epsi * m_epsi.curr - m_ki_epsi * m_epsi.integral - m_kd_epsi * m_epsi.derivative();
+}
+
+
+void PIDController::reset() {
+    m_cte = Storage();
+    m_epsi = Storage();
+}
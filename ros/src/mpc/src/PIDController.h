@@ -0,0 +1,47 @@
+#pragma once
+
+#include "MPC.h"
+
+
+///* The CTE/ePsi PID law of pid/scripts/_pid_controller.py, the last
+///* fallback of the solver (see `SolveStats::fallback`): the steering angle
+///* [rad] from the cross track and the heading errors of the fit, their
+///* change since the previous tick and their sums over the ticks.
+///*
+///* The errors are updated every tick, whether it's used or not, so that
+///* the derivatives are those of consecutive ticks when it takes over.
+class PIDController {
+public:
+    PIDController(const Params & params);
+
+    ///* The errors of this tick
+    void update(double cte, double epsi);
+
+    ///* The steering angle of the last errors
+    double steer() const;
+
+    ///* Forgets the errors (e.g. on a new path)
+    void reset();
+
+private:
+    ///* The errors, as the Storage of the Python controller
+    struct Storage {
+        double curr = 0.0;
+        double prev = 0.0;
+        double integral = 0.0;
+        bool OK = false;
+
+        void step(double value);
+        double derivative() const { return curr - prev; }
+    };
+
+    double m_kp_cte;
+    double m_ki_cte;
+    double m_kd_cte;
+    double m_kp_epsi;
+    double m_ki_epsi;
+    double m_kd_epsi;
+
+    Storage m_cte;
+    Storage m_epsi;
+};
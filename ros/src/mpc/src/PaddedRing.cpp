@@ -0,0 +1,31 @@
+#include <algorithm>
+
+#include "PaddedRing.h"
+
+
+void PaddedRing::build(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t margin) {
+    m_size = pts_x.size();
+    m_margin = (m_size == 0) ? 0 : margin;
+    m_x.resize(m_size + 2 * m_margin);
+    m_y.resize(m_size + 2 * m_margin);
+    for (size_t k=0; k < m_x.size(); k++) {
+        // The margins may be longer than the path, wrapping around it more
+        // than once
+        size_t i = (k + m_size - m_margin % std::max<size_t>(m_size, 1)) % std::max<size_t>(m_size, 1);
+        m_x[k] = pts_x[i];
+        m_y[k] = pts_y[i];
+    }
+}
+
+
+void PaddedRing::update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t first,
+                        size_t count) {
+    // Every copy of a moved point: those of the margins are `size` apart
+    for (size_t c=0; c < std::min(count, m_size); c++) {
+        size_t i = (first + c) % m_size;
+        for (size_t k=(m_margin + i) % m_size; k < m_x.size(); k += m_size) {
+            m_x[k] = pts_x[i];
+            m_y[k] = pts_y[i];
+        }
+    }
+}
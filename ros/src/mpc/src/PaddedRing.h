@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+///* The points of a closed path with `margin` of them copied past both of
+///* its ends: the point i (for i in [-margin, size + margin)) is that of
+///* i modulo `size`, and every run of points within those bounds is a
+///* contiguous span, e.g. the window of the fit across the start line. So
+///* the kernels that read it (the transform into the car's frame, the
+///* fits) stream it without a modulo or a branch per point.
+class PaddedRing {
+public:
+    PaddedRing() : m_size(0), m_margin(0) {}
+
+    ///* (Re)builds the ring of the points; keeps no reference to them
+    void build(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t margin);
+
+    ///* ... only the copies of the points [first, first + count), moved
+    void update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t first,
+                size_t count);
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    size_t margin() const { return m_margin; }
+
+    ///* Whether the points [first, first + count) are all within the ring
+    bool covers(long first, size_t count) const {
+        return first >= -long(m_margin) and first + long(count) <= long(m_size + m_margin);
+    }
+
+    ///* The coordinates from the point i on (within the bounds above)
+    const double * x(long i) const { return &m_x[size_t(long(m_margin) + i)]; }
+    const double * y(long i) const { return &m_y[size_t(long(m_margin) + i)]; }
+
+private:
+    size_t m_size;
+    size_t m_margin;
+    std::vector<double> m_x;
+    std::vector<double> m_y;
+};
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "ParallelBuild.h"
+#include "ParallelCppAD.h"
+#include "SolverBackend.h"
+#include "Log.h"
+#include "Trace.h"
+
+
+void ParallelBuild::add(const Params & params, std::unique_ptr<MPC> & slot) {
+    m_instances.push_back(Instance{params, &slot});
+}
+
+
+void ParallelBuild::then(std::function<void()> setup) {
+    m_setups.push_back(std::move(setup));
+}
+
+
+void ParallelBuild::build(size_t index, int warmup_solves) {
+    MPC_TRACE_SCOPE("ParallelBuild::build");
+    auto start = std::chrono::steady_clock::now();
+    const Params & params = m_instances[index].params;
+    m_instances[index].slot->reset(new MPC(params));
+    MPC & controller = **m_instances[index].slot;
+    auto built = std::chrono::steady_clock::now();
+
+    // The first solves allocate the solver's buffers and factorize
+    // symbolically, here rather than on the first ticks
+    Eigen::VectorXd state = Eigen::VectorXd::Zero(5);
+    Eigen::VectorXd coeffs = Eigen::VectorXd::Zero(params.poly_degree + 1);
+    std::vector<double> result;
+    for (int i=0; i < warmup_solves; i++)
+        controller.Solve(state, coeffs, params.ref_v, result);
+    controller.reset_warm_start();
+    auto warm = std::chrono::steady_clock::now();
+
+    MPC_INFO("Solver %lu of %lu ready (%s, %lu steps): built in %.3f [s], warmed up in %.3f [s]", index + 1,
+             m_instances.size(), backend_name(params).c_str(), params.steps_ahead,
+             std::chrono::duration<double>(built - start).count(), std::chrono::duration<double>(warm - built).count());
+}
+
+
+double ParallelBuild::run(int warmup_solves, int num_threads) {
+    auto start = std::chrono::steady_clock::now();
+    if (num_threads <= 0)
+        num_threads = std::max(int(std::thread::hardware_concurrency()), 1);
+    num_threads = std::min(num_threads, int(m_instances.size()));
+
+    // A pool for the build alone, whose threads each get thread numbers of
+    // CppAD's for as long as it lives
+    std::unique_ptr<Eigen::ThreadPoolInterface> pool;
+    if (num_threads > 1) {
+        pool.reset(new Eigen::NonBlockingThreadPool(num_threads));
+        if (!ParallelCppAD::setup(pool.get())) {
+            MPC_WARN("Building the %lu solvers one after the other", m_instances.size());
+            pool.reset();
+        }
+    }
+    if (pool) {
+        ParallelCppAD::Section parallel;
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t pending = m_instances.size();
+        for (size_t i=0; i < m_instances.size(); i++) {
+            pool->Schedule([this, i, warmup_solves, &mutex, &done, &pending]() {
+                build(i, warmup_solves);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0)
+                    done.notify_one();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&pending]() { return pending == 0; });
+    } else {
+        for (size_t i=0; i < m_instances.size(); i++)
+            build(i, warmup_solves);
+    }
+    if (pool) {
+        ParallelCppAD::release(pool.get());
+        pool.reset();
+    }
+
+    for (std::function<void()> & setup : m_setups)
+        setup();
+    m_instances.clear();
+    m_setups.clear();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
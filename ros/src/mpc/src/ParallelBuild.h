@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "MPC.h"
+
+
+///* The start-up of the MPCs of a pipeline all at once (see
+///* `Params::parallel_build`): the horizons, the backends, the parallel
+///* variants and the reference lines each have MPCs of their own, which tape
+///* (and find the sparsity of their NLP) when they're made, and factorize
+///* their KKT matrix symbolically on their first solve. Queued by the
+///* classes that own them (`add`), they're made and warmed up by `run`, each
+///* on one of the threads of a pool of the build's own, which logs when
+///* it's ready; the owners then finish setting them up (`then`), once
+///* they're all there.
+///*
+///* CppAD is parallel meanwhile (see ParallelCppAD). With Ipopt, its linear
+///* solver has to be reentrant, as for the parallel variants.
+class ParallelBuild {
+public:
+    ///* An MPC of `params` into `slot`, which has to stay where it is until
+    ///* `run` returns
+    void add(const Params & params, std::unique_ptr<MPC> & slot);
+
+    ///* What to do once all the MPCs are made (e.g. hand them a pool), on
+    ///* the thread of `run`, in the order they're queued in
+    void then(std::function<void()> setup);
+
+    size_t size() const { return m_instances.size(); }
+
+    ///* Makes the MPCs queued, and solves each of them `warmup_solves`
+    ///* times (straight ahead along an empty path, after which its warm
+    ///* start is reset), on up to `num_threads` threads (0: one per core),
+    ///* then runs the `then`s. On the calling thread alone when there's one
+    ///* MPC, or CppAD has no thread numbers left. Returns how long it took
+    ///* [s]
+    double run(int warmup_solves, int num_threads = 0);
+
+private:
+    struct Instance {
+        Params params;
+        std::unique_ptr<MPC> * slot;
+    };
+
+    ///* Makes and warms up `m_instances[index]`, and logs it
+    void build(size_t index, int warmup_solves);
+
+    std::vector<Instance> m_instances;
+    std::vector<std::function<void()> > m_setups;
+};
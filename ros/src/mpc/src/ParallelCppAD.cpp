@@ -0,0 +1,151 @@
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cppad/cppad.hpp>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "ParallelCppAD.h"
+#include "Log.h"
+
+
+// The pools set up at once
+static const size_t MAX_POOLS = 8;
+
+struct PoolNumbers {
+    std::atomic<Eigen::ThreadPoolInterface *> pool;
+    size_t first;
+};
+
+static std::mutex s_mutex;
+static bool s_setup = false;
+// The thread numbers taken, by the master thread (0), the pools and the
+// Threads
+static std::vector<bool> s_taken;
+static PoolNumbers s_pools[MAX_POOLS];
+static std::atomic<int> s_sections(0);
+
+// The thread number of the calling thread, once known (0 is the master's)
+static thread_local size_t t_thread_num = 0;
+static thread_local bool t_known = false;
+
+
+static bool cppad_in_parallel() {
+    return s_sections.load(std::memory_order_acquire) > 0;
+}
+
+static size_t cppad_thread_num() {
+    if (t_known)
+        return t_thread_num;
+    // A pool's thread is one for as long as it lives
+    for (PoolNumbers & numbers : s_pools) {
+        Eigen::ThreadPoolInterface * pool = numbers.pool.load(std::memory_order_acquire);
+        int id = (pool != nullptr) ? pool->CurrentThreadId() : -1;
+        if (id >= 0) {
+            t_thread_num = numbers.first + size_t(id);
+            t_known = true;
+            return t_thread_num;
+        }
+    }
+    return 0;
+}
+
+
+// The first of `count` free thread numbers in a row, taken; 0 if there
+// aren't, under s_mutex
+static size_t take_numbers(size_t count) {
+    for (size_t first=1; first + count <= s_taken.size(); first++) {
+        size_t n = 0;
+        while (n < count and !s_taken[first + n])
+            n++;
+        if (n == count) {
+            std::fill(s_taken.begin() + first, s_taken.begin() + first + count, true);
+            return first;
+        }
+        first += n;
+    }
+    return 0;
+}
+
+
+bool ParallelCppAD::setup(Eigen::ThreadPoolInterface * pool) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!s_setup) {
+        s_taken.assign(CPPAD_MAX_NUM_THREADS, false);
+        s_taken[0] = true;
+        CppAD::thread_alloc::parallel_setup(CPPAD_MAX_NUM_THREADS, cppad_in_parallel, cppad_thread_num);
+        CppAD::thread_alloc::hold_memory(true);
+        CppAD::parallel_ad<double>();
+        s_setup = true;
+    }
+    if (pool == nullptr)
+        return true;
+
+    PoolNumbers * free_slot = nullptr;
+    for (PoolNumbers & numbers : s_pools) {
+        Eigen::ThreadPoolInterface * set_up = numbers.pool.load(std::memory_order_relaxed);
+        if (set_up == pool)
+            return true;
+        if (set_up == nullptr and free_slot == nullptr)
+            free_slot = &numbers;
+    }
+    size_t first = (free_slot != nullptr) ? take_numbers(size_t(pool->NumThreads())) : 0;
+    if (first == 0) {
+        MPC_ERROR("CppAD has no thread numbers left for a pool of %d threads", pool->NumThreads());
+        return false;
+    }
+    free_slot->first = first;
+    free_slot->pool.store(pool, std::memory_order_release);
+    return true;
+}
+
+
+void ParallelCppAD::release(Eigen::ThreadPoolInterface * pool) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (PoolNumbers & numbers : s_pools) {
+        if (pool != nullptr and numbers.pool.load(std::memory_order_relaxed) == pool) {
+            numbers.pool.store(nullptr, std::memory_order_release);
+            std::fill(s_taken.begin() + numbers.first, s_taken.begin() + numbers.first + pool->NumThreads(), false);
+            return;
+        }
+    }
+}
+
+
+ParallelCppAD::Section::Section() {
+    s_sections.fetch_add(1, std::memory_order_release);
+}
+
+
+ParallelCppAD::Section::~Section() {
+    s_sections.fetch_sub(1, std::memory_order_release);
+}
+
+
+ParallelCppAD::Thread::Thread() : m_thread_num(0) {
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (!s_setup) {
+            MPC_ERROR("CppAD isn't set up for threads (see ParallelCppAD::setup), the thread is its master");
+            return;
+        }
+        m_thread_num = take_numbers(1);
+    }
+    if (m_thread_num == 0) {
+        MPC_ERROR("CppAD has no thread number left, the thread is its master");
+        return;
+    }
+    t_thread_num = m_thread_num;
+    t_known = true;
+    s_sections.fetch_add(1, std::memory_order_release);
+}
+
+
+ParallelCppAD::Thread::~Thread() {
+    if (m_thread_num == 0)
+        return;
+    s_sections.fetch_sub(1, std::memory_order_release);
+    t_known = false;
+    t_thread_num = 0;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_taken[m_thread_num] = false;
+}
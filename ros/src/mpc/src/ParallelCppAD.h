@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* CppAD from several threads at once: its memory (thread_alloc) and the
+///* tapes it records are per thread then. Each thread pool set up here
+///* takes thread numbers of its own (so the parallel variants of a
+///* pipeline, the batches of a BatchSolver and the vehicles of mpc_host can
+///* run side by side), as does each thread outside of the pools holding a
+///* Thread; any other thread is CppAD's master thread 0.
+///*
+///* What it guarantees, while CppAD is parallel (in a Section, or while a
+///* Thread lives):
+///* - the threads of the pools and those holding a Thread each allocate
+///*   from a pool of their own, and record on a tape of their own, so that
+///*   they can tape and solve at the same time (only one of the other
+///*   threads may use CppAD at a time, as thread 0);
+///* - the tapes of an MPC are its own (CppAD's ADFun), so that MPCs can be
+///*   solved on different threads at once, but not an MPC on two threads at
+///*   once;
+///* - memory goes back to the thread it was taken by, so an MPC is best
+///*   solved and destroyed by the thread that made it (as BatchSolver's
+///*   are), or outside of the parallel stretches.
+class ParallelCppAD {
+public:
+    ///* Once per pool, before its threads use CppAD (nullptr for the
+    ///* Threads alone). The first one sets CppAD up for the process, and has
+    ///* to be called while no other thread uses it. False (and logs why)
+    ///* when there aren't enough thread numbers left (CPPAD_MAX_NUM_THREADS)
+    ///* for the pool
+    static bool setup(Eigen::ThreadPoolInterface * pool);
+
+    ///* Frees the thread numbers of a pool set up, for another one: before
+    ///* the pool is destroyed, once its threads don't use CppAD anymore
+    static void release(Eigen::ThreadPoolInterface * pool);
+
+    ///* Brackets the stretches during which the pools' threads may use
+    ///* CppAD (nested ones count once)
+    class Section {
+    public:
+        Section();
+        ~Section();
+        Section(const Section &) = delete;
+        Section & operator=(const Section &) = delete;
+    };
+
+    ///* A thread number of its own for the thread outside of the pools that
+    ///* holds it (e.g. a std::thread with an MPC of its own), for as long as
+    ///* it lives, during which CppAD is parallel, as in a Section. Not
+    ///* `ok()` (the thread is thread 0 then) when CppAD isn't set up or
+    ///* there's no number left
+    class Thread {
+    public:
+        Thread();
+        ~Thread();
+        Thread(const Thread &) = delete;
+        Thread & operator=(const Thread &) = delete;
+
+        bool ok() const { return m_thread_num != 0; }
+
+    private:
+        size_t m_thread_num;
+    };
+};
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "ParallelDerivatives.h"
+#include "ParallelCppAD.h"
+
+
+namespace {
+    constexpr size_t NO_COLOR = std::numeric_limits<size_t>::max();
+}
+
+
+ParallelDerivatives::ParallelDerivatives(const CppAD::ADFun<double> & fun, const Svector & jac_row,
+                                         const Svector & jac_col, const Svector & hes_row, const Svector & hes_col,
+                                         size_t num_chunks, Eigen::ThreadPoolInterface * pool)
+        : m_n(fun.Domain()), m_m(fun.Range()), m_jac_row(jac_row), m_hes_row(hes_row),
+          m_pool(pool), m_hessian(false), m_x(m_n), m_w(m_m), m_values(nullptr),
+          m_next(0), m_done(0), m_outstanding(0)
+{
+    color(jac_row, jac_col, m_n, false, m_jac);
+    color(hes_row, hes_col, m_n, true, m_hes);
+
+    // No more chunks than colors to sweep
+    num_chunks = std::max<size_t>(1, std::min(num_chunks, std::max(m_jac.num_colors, m_hes.num_colors)));
+    m_funs.resize(num_chunks);
+    m_seeds.resize(num_chunks);
+    for (size_t c=0; c < num_chunks; c++) {
+        m_funs[c] = fun;
+        // The Taylor coefficients of the sweeps, allocated once
+        m_funs[c].capacity_order(2);
+        m_seeds[c].resize(m_n);
+        for (size_t j=0; j < m_n; j++)
+            m_seeds[c][j] = 0.0;
+    }
+}
+
+
+ParallelDerivatives::~ParallelDerivatives() {
+    while (m_outstanding.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
+
+
+void ParallelDerivatives::new_dynamic(const Dvector & dynamic) {
+    for (CppAD::ADFun<double> & fun : m_funs)
+        fun.new_dynamic(dynamic);
+}
+
+
+void ParallelDerivatives::jacobian(const double * x, double * values) {
+    for (size_t j=0; j < m_n; j++)
+        m_x[j] = x[j];
+    m_values = values;
+    run(false);
+}
+
+
+void ParallelDerivatives::hessian(const double * x, const double * w, double * values) {
+    for (size_t j=0; j < m_n; j++)
+        m_x[j] = x[j];
+    for (size_t i=0; i < m_m; i++)
+        m_w[i] = w[i];
+    m_values = values;
+    run(true);
+}
+
+
+void ParallelDerivatives::color(const Svector & rows, const Svector & cols, size_t n, bool symmetric,
+                                Coloring & coloring) {
+    // The columns of every row and the rows of every column, of the whole
+    // pattern
+    size_t num_rows = 0;
+    for (size_t k=0; k < rows.size(); k++)
+        num_rows = std::max(num_rows, rows[k] + 1);
+    if (symmetric)
+        num_rows = std::max(num_rows, n);
+    std::vector<std::vector<size_t> > row_columns(num_rows);
+    std::vector<std::vector<size_t> > column_rows(n);
+    for (size_t k=0; k < rows.size(); k++) {
+        row_columns[rows[k]].push_back(cols[k]);
+        column_rows[cols[k]].push_back(rows[k]);
+        if (symmetric and rows[k] != cols[k]) {
+            row_columns[cols[k]].push_back(rows[k]);
+            column_rows[rows[k]].push_back(cols[k]);
+        }
+    }
+
+    // Only the columns entries are read from are swept, each with the
+    // first color none of the columns it shares a row with has
+    std::vector<bool> read(n, false);
+    for (size_t k=0; k < cols.size(); k++)
+        read[cols[k]] = true;
+    std::vector<size_t> column_color(n, NO_COLOR);
+    std::vector<size_t> taken;
+    coloring.num_colors = 0;
+    for (size_t j=0; j < n; j++) {
+        if (!read[j])
+            continue;
+        for (size_t row : column_rows[j])
+            for (size_t other : row_columns[row])
+                if (column_color[other] != NO_COLOR)
+                    taken[column_color[other]] = j;
+        size_t c = 0;
+        while (c < coloring.num_colors and taken[c] == j)
+            c++;
+        if (c == coloring.num_colors) {
+            coloring.num_colors++;
+            taken.push_back(NO_COLOR);
+        }
+        column_color[j] = c;
+    }
+
+    coloring.column_start.assign(coloring.num_colors + 1, 0);
+    for (size_t j=0; j < n; j++)
+        if (column_color[j] != NO_COLOR)
+            coloring.column_start[column_color[j] + 1]++;
+    coloring.entry_start.assign(coloring.num_colors + 1, 0);
+    for (size_t k=0; k < cols.size(); k++)
+        coloring.entry_start[column_color[cols[k]] + 1]++;
+    for (size_t c=0; c < coloring.num_colors; c++) {
+        coloring.column_start[c + 1] += coloring.column_start[c];
+        coloring.entry_start[c + 1] += coloring.entry_start[c];
+    }
+
+    std::vector<size_t> next(coloring.column_start.begin(), coloring.column_start.end() - 1);
+    coloring.columns.resize(coloring.column_start.back());
+    for (size_t j=0; j < n; j++)
+        if (column_color[j] != NO_COLOR)
+            coloring.columns[next[column_color[j]]++] = j;
+    next.assign(coloring.entry_start.begin(), coloring.entry_start.end() - 1);
+    coloring.entries.resize(cols.size());
+    for (size_t k=0; k < cols.size(); k++)
+        coloring.entries[next[column_color[cols[k]]]++] = k;
+}
+
+
+void ParallelDerivatives::run(bool hessian) {
+    ParallelCppAD::Section parallel;
+
+    // Everything a chunk reads is set before the chunks can be claimed (a
+    // task left over from the last run may claim one as soon as `m_next`
+    // is reset)
+    m_hessian = hessian;
+    m_done.store(0, std::memory_order_relaxed);
+    m_next.store(0, std::memory_order_release);
+
+    // The capture fits in std::function's own storage, so scheduling
+    // doesn't allocate
+    for (size_t c=1; c < m_funs.size(); c++) {
+        m_outstanding.fetch_add(1, std::memory_order_relaxed);
+        m_pool->Schedule([this]() {
+            work();
+            m_outstanding.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    work();
+    while (m_done.load(std::memory_order_acquire) < m_funs.size())
+        std::this_thread::yield();
+}
+
+
+void ParallelDerivatives::work() {
+    for (;;) {
+        size_t chunk = m_next.fetch_add(1, std::memory_order_acq_rel);
+        if (chunk >= m_funs.size())
+            return;
+        sweep(chunk);
+        m_done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+void ParallelDerivatives::sweep(size_t chunk) {
+    CppAD::ADFun<double> & fun = m_funs[chunk];
+    Dvector & seed = m_seeds[chunk];
+    const Coloring & coloring = m_hessian ? m_hes : m_jac;
+    const Svector & rows = m_hessian ? m_hes_row : m_jac_row;
+    if (chunk >= coloring.num_colors)
+        return;
+
+    fun.Forward(0, m_x);
+    for (size_t c=chunk; c < coloring.num_colors; c += m_funs.size()) {
+        for (size_t i=coloring.column_start[c]; i < coloring.column_start[c + 1]; i++)
+            seed[coloring.columns[i]] = 1.0;
+
+        // Row i of the product of the Hessian with the seed is at 2 i + 1
+        // of the second order reverse sweep
+        Dvector dy = fun.Forward(1, seed);
+        if (m_hessian) {
+            Dvector ddw = fun.Reverse(2, m_w);
+            for (size_t i=coloring.entry_start[c]; i < coloring.entry_start[c + 1]; i++)
+                m_values[coloring.entries[i]] = ddw[2 * rows[coloring.entries[i]] + 1];
+        } else {
+            for (size_t i=coloring.entry_start[c]; i < coloring.entry_start[c + 1]; i++)
+                m_values[coloring.entries[i]] = dy[rows[coloring.entries[i]]];
+        }
+
+        for (size_t i=coloring.column_start[c]; i < coloring.column_start[c + 1]; i++)
+            seed[coloring.columns[i]] = 0.0;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <cppad/cppad.hpp>
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* The sparse Jacobian of the constraints and Hessian of the Lagrangian of
+///* a tape, evaluated on the threads of a pool (see
+///* `Params::parallel_derivatives`).
+///*
+///* The columns of each are colored so that no two of a color have an entry
+///* in the same row: a forward sweep seeded with all the columns of a color
+///* (and, for the Hessian, the reverse sweep of second order after it)
+///* gives all their entries at once. The colors are independent, so they're
+///* split into `num_chunks` chunks, each swept on its own copy of the tape.
+///* The chunks are claimed by the threads of the pool and by the calling
+///* thread, which only waits for those already being swept: a pool busy
+///* with other work (e.g. the parallel variants) doesn't hold it up.
+///*
+///* The pool must be set up for CppAD (see ParallelCppAD).
+class ParallelDerivatives {
+public:
+    typedef CPPAD_TESTVECTOR(double) Dvector;
+    typedef CPPAD_TESTVECTOR(size_t) Svector;
+
+    ///* For the patterns of MPC_NLP: those of the Jacobian with the rows of
+    ///* `fg` (one more than those of the constraints), that of the Hessian
+    ///* in the lower triangle
+    ParallelDerivatives(const CppAD::ADFun<double> & fun, const Svector & jac_row, const Svector & jac_col,
+                        const Svector & hes_row, const Svector & hes_col, size_t num_chunks,
+                        Eigen::ThreadPoolInterface * pool);
+
+    ///* Waits for the tasks still on the pool
+    ~ParallelDerivatives();
+
+    ParallelDerivatives(const ParallelDerivatives &) = delete;
+    ParallelDerivatives & operator=(const ParallelDerivatives &) = delete;
+
+    ///* The dynamic parameters of the copies of the tape
+    void new_dynamic(const Dvector & dynamic);
+
+    ///* The entries of the Jacobian at `x`, in the order of the pattern
+    void jacobian(const double * x, double * values);
+
+    ///* The entries of the Hessian of the Lagrangian with weights `w` (those
+    ///* of `fg`) at `x`, in the order of the pattern
+    void hessian(const double * x, const double * w, double * values);
+
+    size_t num_jacobian_colors() const { return m_jac.num_colors; }
+    size_t num_hessian_colors() const { return m_hes.num_colors; }
+
+private:
+    ///* The columns of every color, and the entries of the pattern read from
+    ///* it (from `column_start[c]` and `entry_start[c]` on)
+    struct Coloring {
+        size_t num_colors = 0;
+        std::vector<size_t> column_start;
+        std::vector<size_t> columns;
+        std::vector<size_t> entry_start;
+        std::vector<size_t> entries;
+    };
+
+    ///* Greedy coloring of the columns of the pattern given by `rows` and
+    ///* `cols`, the entry k being read from column `cols[k]`; `symmetric`
+    ///* for a lower triangle, whose mirror counts too
+    static void color(const Svector & rows, const Svector & cols, size_t n, bool symmetric, Coloring & coloring);
+
+    ///* Sweeps all the chunks, on the pool and here
+    void run(bool hessian);
+
+    ///* Claims and sweeps chunks until there's none left
+    void work();
+
+    void sweep(size_t chunk);
+
+    size_t m_n;
+    size_t m_m;
+    Svector m_jac_row;
+    Svector m_hes_row;
+    Coloring m_jac;
+    Coloring m_hes;
+
+    ///* A copy of the tape, and its seed, per chunk
+    std::vector<CppAD::ADFun<double> > m_funs;
+    std::vector<Dvector> m_seeds;
+
+    Eigen::ThreadPoolInterface * m_pool;
+
+    ///* The evaluation being swept
+    bool m_hessian;
+    Dvector m_x;
+    Dvector m_w;
+    double * m_values;
+
+    ///* The next chunk to claim, the chunks swept, and the tasks still on
+    ///* the pool
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_done;
+    std::atomic<size_t> m_outstanding;
+};
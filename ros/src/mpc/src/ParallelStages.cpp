@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <map>
+#include <thread>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "ParallelStages.h"
+#include "ParallelCppAD.h"
+
+
+ParallelStages::ParallelStages(const CppAD::ADFun<double> & stage, const Layout & layout, size_t num_chunks)
+        : m_layout(layout), m_num_stages(layout.dt.size()), m_pool(nullptr), m_sweep(CONSTRAINTS),
+          m_x(nullptr), m_w(nullptr), m_values(nullptr), m_next(0), m_done(0), m_outstanding(0)
+{
+    // The pattern of a step, from a copy of its tape (the sparsity sweeps
+    // leave their patterns in it)
+    size_t n = layout.num_inputs;
+    CppAD::ADFun<double> fun(stage);
+    SetVector r(n);
+    for (size_t i=0; i < n; i++)
+        r[i].insert(i);
+    SetVector jac = fun.ForSparseJac(n, r);
+    SetVector s(1);
+    for (size_t output : layout.used_outputs)
+        s[0].insert(output);
+    SetVector hes = fun.RevSparseHes(n, s);
+
+    size_t num_var_inputs = layout.var_inputs.size();
+    m_jac_start.assign(1, 0);
+    m_hes_start.assign(1, 0);
+    for (size_t p=0; p < num_var_inputs; p++) {
+        size_t input = layout.var_inputs[p];
+        for (size_t o=0; o < layout.used_outputs.size(); o++)
+            if (jac[layout.used_outputs[o]].count(input) > 0)
+                m_jac_output.push_back(o);
+        // Each pair once, from the sweep of the first of them
+        for (size_t q=p; q < num_var_inputs; q++)
+            if (hes[input].count(layout.var_inputs[q]) > 0)
+                m_hes_other.push_back(q);
+        m_jac_start.push_back(m_jac_output.size());
+        m_hes_start.push_back(m_hes_other.size());
+    }
+
+    // Consecutive stages per chunk, no more chunks than stages
+    num_chunks = std::max<size_t>(1, std::min(num_chunks, m_num_stages));
+    m_chunks.resize(num_chunks);
+    for (size_t c=0; c < num_chunks; c++) {
+        m_chunks[c].reset(new Chunk);
+        Chunk & chunk = *m_chunks[c];
+        chunk.fun = stage;
+        // The Taylor coefficients of the sweeps, allocated once
+        chunk.fun.capacity_order(2);
+        chunk.in.resize(n);
+        chunk.seed.resize(n);
+        for (size_t i=0; i < n; i++) {
+            chunk.in[i] = 0.0;
+            chunk.seed[i] = 0.0;
+        }
+        chunk.w.resize(stage.Range());
+        for (size_t i=0; i < chunk.w.size(); i++)
+            chunk.w[i] = 0.0;
+        chunk.first_stage = c * m_num_stages / num_chunks;
+        chunk.end_stage = (c + 1) * m_num_stages / num_chunks;
+    }
+}
+
+
+ParallelStages::~ParallelStages() {
+    while (m_outstanding.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
+
+
+void ParallelStages::add_patterns(SetVector & jac_pattern, SetVector & hes_pattern) const {
+    size_t num_var_inputs = m_layout.var_inputs.size();
+    size_t num_outputs = m_layout.used_outputs.size();
+    for (size_t s=0; s < m_num_stages; s++) {
+        const size_t * vars = &m_layout.vars[s * num_var_inputs];
+        const size_t * rows = &m_layout.rows[s * num_outputs];
+        for (size_t p=0; p < num_var_inputs; p++) {
+            for (size_t e=m_jac_start[p]; e < m_jac_start[p + 1]; e++)
+                jac_pattern[rows[m_jac_output[e]]].insert(vars[p]);
+            for (size_t e=m_hes_start[p]; e < m_hes_start[p + 1]; e++) {
+                hes_pattern[vars[p]].insert(vars[m_hes_other[e]]);
+                hes_pattern[vars[m_hes_other[e]]].insert(vars[p]);
+            }
+        }
+    }
+}
+
+
+void ParallelStages::set_slots(const Svector & jac_row, const Svector & jac_col, const Svector & hes_row,
+                               const Svector & hes_col) {
+    std::map<std::pair<size_t, size_t>, size_t> jac_position, hes_position;
+    for (size_t k=0; k < jac_row.size(); k++)
+        jac_position[std::make_pair(jac_row[k], jac_col[k])] = k;
+    for (size_t k=0; k < hes_row.size(); k++)
+        hes_position[std::make_pair(hes_row[k], hes_col[k])] = k;
+
+    size_t num_var_inputs = m_layout.var_inputs.size();
+    size_t num_outputs = m_layout.used_outputs.size();
+    size_t jac_entries = m_jac_output.size(), hes_entries = m_hes_other.size();
+    m_jac_slots.resize(m_num_stages * jac_entries);
+    m_hes_slots.resize(m_num_stages * hes_entries);
+    std::vector<size_t> writers(hes_row.size(), 0);
+    for (size_t s=0; s < m_num_stages; s++) {
+        const size_t * vars = &m_layout.vars[s * num_var_inputs];
+        const size_t * rows = &m_layout.rows[s * num_outputs];
+        for (size_t p=0; p < num_var_inputs; p++) {
+            for (size_t e=m_jac_start[p]; e < m_jac_start[p + 1]; e++)
+                m_jac_slots[s * jac_entries + e] = jac_position.at(std::make_pair(rows[m_jac_output[e]], vars[p]));
+            for (size_t e=m_hes_start[p]; e < m_hes_start[p + 1]; e++) {
+                // In the lower triangle
+                size_t a = vars[p], b = vars[m_hes_other[e]];
+                size_t slot = hes_position.at(std::make_pair(std::max(a, b), std::min(a, b)));
+                m_hes_slots[s * hes_entries + e] = slot;
+                writers[slot]++;
+            }
+        }
+    }
+
+    // (A stage adds to the same slot once at most: its variables are
+    // different ones)
+    m_hes_shared.assign(m_hes_slots.size(), 0);
+    m_shared_values.assign(m_hes_slots.size(), 0.0);
+    m_shared.clear();
+    for (size_t i=0; i < m_hes_slots.size(); i++) {
+        if (writers[m_hes_slots[i]] > 1) {
+            m_hes_shared[i] = 1;
+            m_shared.push_back(i);
+        }
+    }
+}
+
+
+void ParallelStages::new_dynamic(const Dvector & dynamic) {
+    for (std::unique_ptr<Chunk> & chunk : m_chunks)
+        for (size_t i=0; i < m_layout.num_coeffs; i++)
+            chunk->in[m_layout.coeffs_input + i] = dynamic[i];
+}
+
+
+void ParallelStages::constraints(const double * x, double * fg) {
+    m_x = x;
+    m_values = fg;
+    run(CONSTRAINTS);
+}
+
+
+void ParallelStages::jacobian(const double * x, double * values) {
+    m_x = x;
+    m_values = values;
+    run(JACOBIAN);
+}
+
+
+void ParallelStages::hessian(const double * x, const double * w, double * values) {
+    m_x = x;
+    m_w = w;
+    m_values = values;
+    run(HESSIAN);
+    for (size_t i : m_shared)
+        values[m_hes_slots[i]] += m_shared_values[i];
+}
+
+
+void ParallelStages::run(Sweep sweep) {
+    m_sweep = sweep;
+    if (m_pool == nullptr or m_chunks.size() == 1) {
+        for (std::unique_ptr<Chunk> & chunk : m_chunks)
+            this->sweep(*chunk);
+        return;
+    }
+
+    ParallelCppAD::Section parallel;
+
+    // Everything a chunk reads is set before the chunks can be claimed (a
+    // task left over from the last run may claim one as soon as `m_next`
+    // is reset)
+    m_done.store(0, std::memory_order_relaxed);
+    m_next.store(0, std::memory_order_release);
+
+    // The capture fits in std::function's own storage, so scheduling
+    // doesn't allocate
+    for (size_t c=1; c < m_chunks.size(); c++) {
+        m_outstanding.fetch_add(1, std::memory_order_relaxed);
+        m_pool->Schedule([this]() {
+            work();
+            m_outstanding.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    work();
+    while (m_done.load(std::memory_order_acquire) < m_chunks.size())
+        std::this_thread::yield();
+}
+
+
+void ParallelStages::work() {
+    for (;;) {
+        size_t c = m_next.fetch_add(1, std::memory_order_acq_rel);
+        if (c >= m_chunks.size())
+            return;
+        sweep(*m_chunks[c]);
+        m_done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+void ParallelStages::sweep(Chunk & chunk) {
+    const Layout & layout = m_layout;
+    size_t num_var_inputs = layout.var_inputs.size();
+    size_t num_outputs = layout.used_outputs.size();
+    size_t jac_entries = m_jac_output.size(), hes_entries = m_hes_other.size();
+
+    for (size_t s=chunk.first_stage; s < chunk.end_stage; s++) {
+        const size_t * vars = &layout.vars[s * num_var_inputs];
+        const size_t * rows = &layout.rows[s * num_outputs];
+        for (size_t p=0; p < num_var_inputs; p++)
+            chunk.in[layout.var_inputs[p]] = m_x[vars[p]];
+        chunk.in[layout.dt_input] = layout.dt[s];
+        Dvector y = chunk.fun.Forward(0, chunk.in);
+
+        // The rows are the next states less the step's outputs
+        if (m_sweep == CONSTRAINTS) {
+            for (size_t o=0; o < num_outputs; o++)
+                m_values[rows[o]] -= y[layout.used_outputs[o]];
+            continue;
+        }
+        if (m_sweep == HESSIAN) {
+            for (size_t o=0; o < num_outputs; o++)
+                chunk.w[layout.used_outputs[o]] = -m_w[rows[o]];
+        }
+
+        // A first order sweep per variable input: a column of the Jacobian
+        // or, with the second order reverse sweep after it (row i of the
+        // product of the Hessian with the seed at 2 i + 1), of the Hessian
+        for (size_t p=0; p < num_var_inputs; p++) {
+            bool hessian = (m_sweep == HESSIAN);
+            size_t begin = hessian ? m_hes_start[p] : m_jac_start[p];
+            size_t end = hessian ? m_hes_start[p + 1] : m_jac_start[p + 1];
+            if (begin == end)
+                continue;
+            size_t input = layout.var_inputs[p];
+            chunk.seed[input] = 1.0;
+            Dvector dy = chunk.fun.Forward(1, chunk.seed);
+            chunk.seed[input] = 0.0;
+            if (!hessian) {
+                for (size_t e=begin; e < end; e++)
+                    m_values[m_jac_slots[s * jac_entries + e]] -= dy[layout.used_outputs[m_jac_output[e]]];
+                continue;
+            }
+            Dvector ddw = chunk.fun.Reverse(2, chunk.w);
+            for (size_t e=begin; e < end; e++) {
+                size_t i = s * hes_entries + e;
+                double value = ddw[2 * layout.var_inputs[m_hes_other[e]] + 1];
+                if (m_hes_shared[i])
+                    m_shared_values[i] = value;
+                else
+                    m_values[m_hes_slots[i]] += value;
+            }
+        }
+    }
+}
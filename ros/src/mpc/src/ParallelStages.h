@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <cppad/cppad.hpp>
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* The steps of the model of FG_eval (its `stage`), evaluated outside of
+///* the tape of the NLP, stage by stage on the threads of a pool (see
+///* `Params::parallel_stages`): their values, which are subtracted from the
+///* rows of the states they lead to, their Jacobians and their part of the
+///* Hessian of the Lagrangian.
+///*
+///* The stages are independent given the variables, so each of
+///* `num_chunks` chunks of consecutive stages has its own copy of the
+///* step's (small) tape and its own buffers, and writes its entries
+///* straight into slots of the sparse Jacobian and Hessian worked out once
+///* (see `set_slots`). A chunk's stages are always the same ones, so its
+///* rows of the Jacobian are contiguous and no two chunks write to the same
+///* cache lines but at their ends. The entries of the Hessian that several
+///* stages add to (a variable shared by several, as the actuation of an
+///* input block) are summed up by the calling thread once they're done.
+///*
+///* The chunks are claimed by the threads of the pool and by the calling
+///* thread, as those of ParallelDerivatives; without a pool, the calling
+///* thread sweeps them all. The pool must be set up for CppAD (see
+///* ParallelCppAD).
+class ParallelStages {
+public:
+    typedef CPPAD_TESTVECTOR(double) Dvector;
+    typedef CPPAD_TESTVECTOR(size_t) Svector;
+    typedef CPPAD_TESTVECTOR(std::set<size_t>) SetVector;
+
+    ///* The inputs and outputs of the step, and where they are in the NLP
+    struct Layout {
+        ///* Of the step's tape
+        size_t num_inputs = 0;
+        ///* Its inputs that are variables of the NLP, and its outputs that
+        ///* are subtracted from rows of `fg`
+        std::vector<size_t> var_inputs;
+        std::vector<size_t> used_outputs;
+        ///* The input that is the length of the step [s], and the first of
+        ///* the `num_coeffs` that are the first dynamic parameters of the
+        ///* tape of the NLP
+        size_t dt_input = 0;
+        size_t coeffs_input = 0;
+        size_t num_coeffs = 0;
+        ///* For every stage, one after the other: the variables of
+        ///* `var_inputs`, the rows (of `fg`) of `used_outputs`, and its step
+        std::vector<size_t> vars;
+        std::vector<size_t> rows;
+        std::vector<double> dt;
+    };
+
+    ParallelStages(const CppAD::ADFun<double> & stage, const Layout & layout, size_t num_chunks);
+
+    ///* Waits for the tasks still on the pool
+    ~ParallelStages();
+
+    ParallelStages(const ParallelStages &) = delete;
+    ParallelStages & operator=(const ParallelStages &) = delete;
+
+    ///* Where the chunks are swept from now on (nullptr: here)
+    void set_pool(Eigen::ThreadPoolInterface * pool) { m_pool = pool; }
+
+    ///* Adds the entries of the steps to the patterns of the Jacobian of
+    ///* `fg` and of the Hessian of the Lagrangian (both of them, as those
+    ///* of MPC_NLP's tape)
+    void add_patterns(SetVector & jac_pattern, SetVector & hes_pattern) const;
+
+    ///* The entries of the Jacobian (rows of `fg`) and of the lower triangle
+    ///* of the Hessian that the values are written to, which have those of
+    ///* `add_patterns`
+    void set_slots(const Svector & jac_row, const Svector & jac_col, const Svector & hes_row,
+                   const Svector & hes_col);
+
+    ///* The dynamic parameters of the tape of the NLP, whose first ones are
+    ///* the coefficients of the steps
+    void new_dynamic(const Dvector & dynamic);
+
+    ///* Subtracts the steps at `x` from their rows of `fg`
+    void constraints(const double * x, double * fg);
+
+    ///* Adds their Jacobian at `x` to `values`, in the order of the slots
+    void jacobian(const double * x, double * values);
+
+    ///* ... and their Hessian with the weights `w` of the rows of `fg`
+    void hessian(const double * x, const double * w, double * values);
+
+    size_t num_chunks() const { return m_chunks.size(); }
+
+private:
+    enum Sweep { CONSTRAINTS, JACOBIAN, HESSIAN };
+
+    ///* A copy of the step's tape and the buffers of a chunk of stages, each
+    ///* allocated on its own
+    struct Chunk {
+        CppAD::ADFun<double> fun;
+        Dvector in;
+        Dvector seed;
+        Dvector w;
+        size_t first_stage;
+        size_t end_stage;
+    };
+
+    ///* Sweeps all the chunks, on the pool and here
+    void run(Sweep sweep);
+
+    ///* Claims and sweeps chunks until there's none left
+    void work();
+
+    void sweep(Chunk & chunk);
+
+    Layout m_layout;
+    size_t m_num_stages;
+
+    ///* The pattern of a step: the entries (output, variable input) of its
+    ///* Jacobian and (variable input, later variable input) of its Hessian,
+    ///* each by the variable input whose sweep they come from (from
+    ///* `*_start[p]` on, in the order of `var_inputs`); positions in
+    ///* `used_outputs` and `var_inputs`
+    std::vector<size_t> m_jac_start;
+    std::vector<size_t> m_jac_output;
+    std::vector<size_t> m_hes_start;
+    std::vector<size_t> m_hes_other;
+
+    ///* Of every entry of every stage (stage after stage): its slot, and
+    ///* for the Hessian, whether other stages add to it (then its value is
+    ///* kept in `m_shared_values` until they're done, see `m_shared`)
+    std::vector<size_t> m_jac_slots;
+    std::vector<size_t> m_hes_slots;
+    std::vector<char> m_hes_shared;
+    std::vector<double> m_shared_values;
+    std::vector<size_t> m_shared;
+
+    std::vector<std::unique_ptr<Chunk> > m_chunks;
+
+    Eigen::ThreadPoolInterface * m_pool;
+
+    ///* The evaluation being swept
+    Sweep m_sweep;
+    const double * m_x;
+    const double * m_w;
+    double * m_values;
+
+    ///* The next chunk to claim, the chunks swept, and the tasks still on
+    ///* the pool
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_done;
+    std::atomic<size_t> m_outstanding;
+};
@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+
+#include "ParticleFilter.h"
+#include "Log.h"
+
+
+constexpr double ParticleFilter::INV_SQUASH_FACTOR;
+constexpr double ParticleFilter::Z_HIT;
+constexpr double ParticleFilter::Z_SHORT;
+constexpr double ParticleFilter::Z_MAX;
+constexpr double ParticleFilter::Z_RAND;
+constexpr size_t ParticleFilter::CHUNKS_PER_THREAD;
+constexpr size_t ParticleFilter::MAX_RANGE_TABLE_SIZE;
+
+
+// The squared distances of the 1-D distance transform of `f` (of `n`
+// samples) into `d`, after Felzenszwalb and Huttenlocher: the lower
+// envelope of the parabolas rooted at the samples. `v` and `z` are room for
+// n and n + 1 of its vertices and their boundaries
+static void transform_1d(const double * f, int n, double * d, int * v, double * z) {
+    const double INF = 1e20;
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INF;
+    z[1] = INF;
+    for (int q=1; q < n; q++) {
+        double s = ((f[q] + double(q) * q) - (f[v[k]] + double(v[k]) * v[k])) / (2.0 * q - 2.0 * v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + double(q) * q) - (f[v[k]] + double(v[k]) * v[k])) / (2.0 * q - 2.0 * v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INF;
+    }
+    k = 0;
+    for (int q=0; q < n; q++) {
+        while (z[k + 1] < q)
+            k++;
+        d[q] = double(q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+
+void LocalizationMap::build(const int8_t * cells, size_t width, size_t height, int threshold) {
+    this->width = width;
+    this->height = height;
+
+    // The squared distances, along the columns and then along the rows
+    std::vector<double> squared(width * height);
+    for (size_t i=0; i < width * height; i++)
+        squared[i] = (cells[i] < 0 or cells[i] > threshold) ? 0.0 : 1e20;
+    size_t n = std::max(width, height);
+    std::vector<double> f(n), d(n), z(n + 1);
+    std::vector<int> v(n);
+    for (size_t x=0; x < width; x++) {
+        for (size_t y=0; y < height; y++)
+            f[y] = squared[y * width + x];
+        transform_1d(f.data(), int(height), d.data(), v.data(), z.data());
+        for (size_t y=0; y < height; y++)
+            squared[y * width + x] = d[y];
+    }
+    for (size_t y=0; y < height; y++) {
+        transform_1d(&squared[y * width], int(width), d.data(), v.data(), z.data());
+        std::copy(d.begin(), d.begin() + width, squared.begin() + y * width);
+    }
+
+    distance.resize(width * height);
+    for (size_t i=0; i < width * height; i++)
+        distance[i] = float(std::sqrt(squared[i]));
+}
+
+
+ParticleFilter::ParticleFilter(const Params & params)
+        : m_num_particles(size_t(std::max(params.pf_particles, 1))),
+          m_num_beams(size_t(std::max(params.pf_beams, 1))),
+          m_max_range_m(params.pf_max_range),
+          m_noise_x(params.pf_noise_x),
+          m_noise_y(params.pf_noise_y),
+          m_noise_theta(params.pf_noise_theta),
+          m_sigma_hit(params.pf_sigma_hit),
+          m_max_range(0),
+          m_use_range_table(params.pf_range_table),
+          m_range_bins(size_t(std::max(params.pf_range_bins, 1))),
+          m_x(m_num_particles), m_y(m_num_particles), m_theta(m_num_particles), m_weight(m_num_particles),
+          m_next_x(m_num_particles), m_next_y(m_num_particles), m_next_theta(m_num_particles),
+          m_noise_x_draws(m_num_particles), m_noise_y_draws(m_num_particles),
+          m_noise_theta_draws(m_num_particles),
+          m_beam_angles(m_num_beams), m_beam_ranges(m_num_beams),
+          m_initialized(false), m_odometry_OK(false),
+          m_odom_x(0.0), m_odom_y(0.0), m_odom_theta(0.0),
+          m_moved_x(0.0), m_moved_y(0.0), m_moved_theta(0.0),
+          m_x_estimate(0.0), m_y_estimate(0.0), m_theta_estimate(0.0),
+          m_next(0), m_done(0), m_outstanding(0) {
+    int num_threads = std::max(params.pf_threads, 0);
+    if (num_threads > 0)
+        m_pool.reset(new Eigen::NonBlockingThreadPool(num_threads));
+    m_num_chunks = CHUNKS_PER_THREAD * size_t(num_threads + 1);
+    m_task = nullptr;
+    m_task_size = 0;
+}
+
+
+ParticleFilter::~ParticleFilter() {
+    while (m_outstanding.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
+
+
+void ParticleFilter::set_map(std::shared_ptr<const LocalizationMap> map) {
+    m_map = std::move(map);
+
+    // The sensor model, by measured range (the rows) and expected range
+    // (the columns), each column normalized
+    m_max_range = std::max(int(m_max_range_m / m_map->resolution), 1);
+    size_t size = size_t(m_max_range) + 1;
+    double sigma = m_sigma_hit / m_map->resolution;
+    std::vector<double> table(size * size);
+    for (int d=0; d <= m_max_range; d++) {
+        double total = 0.0;
+        for (int r=0; r <= m_max_range; r++) {
+            double z = double(r - d);
+            double p = Z_HIT * std::exp(-(z * z) / (2.0 * sigma * sigma)) / (sigma * std::sqrt(2.0 * M_PI));
+            if (r < d)
+                p += 2.0 * Z_SHORT * (d - r) / double(d);
+            if (r == m_max_range)
+                p += Z_MAX;
+            else
+                p += Z_RAND / m_max_range;
+            table[r * size + d] = p;
+            total += p;
+        }
+        for (int r=0; r <= m_max_range; r++)
+            table[r * size + d] /= total;
+    }
+    m_sensor_table.resize(size * size);
+    for (size_t i=0; i < size * size; i++)
+        m_sensor_table[i] = float(std::log(table[i]));
+
+    m_range_table.clear();
+    if (m_use_range_table) {
+        size_t table_size = m_map->width * m_map->height * m_range_bins;
+        if (m_max_range > UINT16_MAX)
+            MPC_WARN("pf_range_table needs pf_max_range under %d cells, ignoring it", UINT16_MAX);
+        else if (table_size * sizeof(uint16_t) > MAX_RANGE_TABLE_SIZE)
+            MPC_WARN("pf_range_table would take %lu MiB, ignoring it", table_size * sizeof(uint16_t) >> 20);
+        else {
+            m_range_table.resize(table_size);
+            run_chunks(&ParticleFilter::cast_rows, m_map->height);
+        }
+    }
+}
+
+
+void ParticleFilter::initialize(double x, double y, double theta, double sigma_xy, double sigma_theta) {
+    std::normal_distribution<float> xy_noise(0.0f, float(sigma_xy));
+    std::normal_distribution<float> theta_noise(0.0f, float(sigma_theta));
+    for (size_t i=0; i < m_num_particles; i++) {
+        m_x[i] = float(x) + xy_noise(m_rng);
+        m_y[i] = float(y) + xy_noise(m_rng);
+        m_theta[i] = float(theta) + theta_noise(m_rng);
+    }
+    m_x_estimate = x;
+    m_y_estimate = y;
+    m_theta_estimate = theta;
+
+    // The motion so far is that of the poses before this one
+    m_moved_x = m_odom_x;
+    m_moved_y = m_odom_y;
+    m_moved_theta = m_odom_theta;
+    m_initialized = true;
+}
+
+
+void ParticleFilter::add_odometry(double x, double y, double theta) {
+    if (!m_odometry_OK) {
+        m_moved_x = x;
+        m_moved_y = y;
+        m_moved_theta = theta;
+        m_odometry_OK = true;
+    }
+    m_odom_x = x;
+    m_odom_y = y;
+    m_odom_theta = theta;
+}
+
+
+bool ParticleFilter::update(const float * ranges, size_t num_ranges, double angle_min, double angle_increment) {
+    if (!ready() or num_ranges == 0)
+        return false;
+
+    // The beams, evenly spread over the scan, the missing ranges at the
+    // max range
+    for (size_t b=0; b < m_num_beams; b++) {
+        size_t i = b * num_ranges / m_num_beams;
+        m_beam_angles[b] = float(angle_min + i * angle_increment);
+        float range = ranges[i];
+        m_beam_ranges[b] = (std::isfinite(range) and range > 0.0f)
+                           ? std::min(int(range / m_map->resolution + 0.5), m_max_range) : m_max_range;
+    }
+
+    move();
+    run_chunks(&ParticleFilter::weigh, m_num_particles);
+
+    // The weights, relative to the likeliest particle so that they don't
+    // all underflow
+    double best = *std::max_element(m_weight.begin(), m_weight.end());
+    double total = 0.0;
+    for (size_t i=0; i < m_num_particles; i++) {
+        m_weight[i] = std::exp(INV_SQUASH_FACTOR * (m_weight[i] - best));
+        total += m_weight[i];
+    }
+    double x = 0.0, y = 0.0, sin_theta = 0.0, cos_theta = 0.0;
+    for (size_t i=0; i < m_num_particles; i++) {
+        m_weight[i] /= total;
+        x += m_weight[i] * m_x[i];
+        y += m_weight[i] * m_y[i];
+        sin_theta += m_weight[i] * std::sin(m_theta[i]);
+        cos_theta += m_weight[i] * std::cos(m_theta[i]);
+    }
+    m_x_estimate = x;
+    m_y_estimate = y;
+    m_theta_estimate = std::atan2(sin_theta, cos_theta);
+
+    resample();
+    return true;
+}
+
+
+float ParticleFilter::cast(float x, float y, float theta) const {
+    const LocalizationMap & map = *m_map;
+    float dx = std::cos(theta);
+    float dy = std::sin(theta);
+    float t = 0.0f;
+    while (t < m_max_range) {
+        float cx = std::floor(x + t * dx);
+        float cy = std::floor(y + t * dy);
+        if (cx < 0.0f or cy < 0.0f or cx >= map.width or cy >= map.height)
+            break;
+        float distance = map.distance[size_t(cy) * map.width + size_t(cx)];
+        if (distance == 0.0f)
+            return t;
+        // Never past the nearest occupied cell, from anywhere in this one
+        t += std::max(distance - 1.0f, 1.0f);
+    }
+    return float(m_max_range);
+}
+
+
+void ParticleFilter::cast_rows(size_t begin, size_t end) {
+    const LocalizationMap & map = *m_map;
+    float bin_angle = float(2 * M_PI / m_range_bins);
+    for (size_t y=begin; y < end; y++) {
+        for (size_t x=0; x < map.width; x++) {
+            uint16_t * ranges = &m_range_table[(y * map.width + x) * m_range_bins];
+            if (map.distance[y * map.width + x] == 0.0f) {
+                std::fill(ranges, ranges + m_range_bins, uint16_t(0));
+                continue;
+            }
+            for (size_t bin=0; bin < m_range_bins; bin++)
+                ranges[bin] = uint16_t(cast(x + 0.5f, y + 0.5f, bin * bin_angle));
+        }
+    }
+}
+
+
+void ParticleFilter::move() {
+    if (!m_odometry_OK)
+        return;
+
+    // The motion of the odometry since the last update, in the frame of the
+    // car then
+    double dx_odom = m_odom_x - m_moved_x;
+    double dy_odom = m_odom_y - m_moved_y;
+    double c = std::cos(m_moved_theta);
+    double s = std::sin(m_moved_theta);
+    float dx = float(c * dx_odom + s * dy_odom);
+    float dy = float(-s * dx_odom + c * dy_odom);
+    float dtheta = float(std::remainder(m_odom_theta - m_moved_theta, 2 * M_PI));
+    m_moved_x = m_odom_x;
+    m_moved_y = m_odom_y;
+    m_moved_theta = m_odom_theta;
+
+    std::normal_distribution<float> noise_x(0.0f, float(m_noise_x));
+    std::normal_distribution<float> noise_y(0.0f, float(m_noise_y));
+    std::normal_distribution<float> noise_theta(0.0f, float(m_noise_theta));
+    for (size_t i=0; i < m_num_particles; i++) {
+        m_noise_x_draws[i] = noise_x(m_rng);
+        m_noise_y_draws[i] = noise_y(m_rng);
+        m_noise_theta_draws[i] = noise_theta(m_rng);
+    }
+
+    float * x = m_x.data();
+    float * y = m_y.data();
+    float * theta = m_theta.data();
+    const float * nx = m_noise_x_draws.data();
+    const float * ny = m_noise_y_draws.data();
+    const float * ntheta = m_noise_theta_draws.data();
+    for (size_t i=0; i < m_num_particles; i++) {
+        float c_i = std::cos(theta[i]);
+        float s_i = std::sin(theta[i]);
+        x[i] += c_i * dx - s_i * dy + nx[i];
+        y[i] += s_i * dx + c_i * dy + ny[i];
+        theta[i] += dtheta + ntheta[i];
+    }
+}
+
+
+void ParticleFilter::weigh(size_t begin, size_t end) {
+    const LocalizationMap & map = *m_map;
+    float c = float(std::cos(map.origin_yaw));
+    float s = float(std::sin(map.origin_yaw));
+    float inv_resolution = float(1.0 / map.resolution);
+    size_t size = size_t(m_max_range) + 1;
+    for (size_t i=begin; i < end; i++) {
+        // The particle in the cells of the map
+        float dx = m_x[i] - float(map.origin_x);
+        float dy = m_y[i] - float(map.origin_y);
+        float x = (c * dx + s * dy) * inv_resolution;
+        float y = (-s * dx + c * dy) * inv_resolution;
+        float theta = m_theta[i] - float(map.origin_yaw);
+
+        double log_likelihood = 0.0;
+        if (m_range_table.empty()) {
+            for (size_t b=0; b < m_num_beams; b++) {
+                int expected = std::min(int(cast(x, y, theta + m_beam_angles[b])), m_max_range);
+                log_likelihood += m_sensor_table[size_t(m_beam_ranges[b]) * size + size_t(expected)];
+            }
+        } else if (x >= 0.0f and y >= 0.0f and x < map.width and y < map.height) {
+            // The ranges of the cell, by the direction of every beam
+            const uint16_t * ranges = &m_range_table[(size_t(y) * map.width + size_t(x)) * m_range_bins];
+            float bins_per_radian = float(m_range_bins / (2 * M_PI));
+            int num_bins = int(m_range_bins);
+            for (size_t b=0; b < m_num_beams; b++) {
+                int bin = int(std::floor((theta + m_beam_angles[b]) * bins_per_radian + 0.5f)) % num_bins;
+                int expected = ranges[bin < 0 ? bin + num_bins : bin];
+                log_likelihood += m_sensor_table[size_t(m_beam_ranges[b]) * size + size_t(expected)];
+            }
+        } else {
+            // Off the map, where every ray is at the max range
+            for (size_t b=0; b < m_num_beams; b++)
+                log_likelihood += m_sensor_table[size_t(m_beam_ranges[b]) * size + size_t(m_max_range)];
+        }
+        m_weight[i] = log_likelihood;
+    }
+}
+
+
+void ParticleFilter::run_chunks(void (ParticleFilter::*task)(size_t, size_t), size_t size) {
+    // The calling thread claims chunks too, and then waits for those being
+    // worked on
+    m_task = task;
+    m_task_size = size;
+    m_done.store(0, std::memory_order_relaxed);
+    m_next.store(0, std::memory_order_release);
+    if (m_pool) {
+        for (int t=0; t < m_pool->NumThreads(); t++) {
+            m_outstanding.fetch_add(1, std::memory_order_relaxed);
+            m_pool->Schedule([this]() {
+                work();
+                m_outstanding.fetch_sub(1, std::memory_order_release);
+            });
+        }
+    }
+    work();
+    while (m_done.load(std::memory_order_acquire) < m_num_chunks)
+        std::this_thread::yield();
+}
+
+
+void ParticleFilter::work() {
+    for (;;) {
+        size_t chunk = m_next.fetch_add(1, std::memory_order_acq_rel);
+        if (chunk >= m_num_chunks)
+            return;
+        (this->*m_task)(chunk * m_task_size / m_num_chunks, (chunk + 1) * m_task_size / m_num_chunks);
+        m_done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+void ParticleFilter::resample() {
+    // One draw, and the particles at the evenly spaced points of the
+    // cumulative weights from it
+    double step = 1.0 / m_num_particles;
+    double u = std::uniform_real_distribution<double>(0.0, step)(m_rng);
+    double cumulative = m_weight[0];
+    size_t i = 0;
+    for (size_t m=0; m < m_num_particles; m++) {
+        while (u > cumulative and i + 1 < m_num_particles)
+            cumulative += m_weight[++i];
+        m_next_x[m] = m_x[i];
+        m_next_y[m] = m_y[i];
+        m_next_theta[m] = m_theta[i];
+        u += step;
+    }
+    m_x.swap(m_next_x);
+    m_y.swap(m_next_y);
+    m_theta.swap(m_next_theta);
+}
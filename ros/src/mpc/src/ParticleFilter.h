@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "MPC.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* The map the particle filter localizes in: an occupancy grid, and for
+///* every cell the distance [cells] to the nearest occupied one, which the
+///* rays march along (see `ParticleFilter::cast`)
+struct LocalizationMap {
+    size_t width = 0;
+    size_t height = 0;
+    ///* [m/cell], and the pose of the corner of the cell (0, 0) [m, rad]
+    double resolution = 0.05;
+    double origin_x = 0.0;
+    double origin_y = 0.0;
+    double origin_yaw = 0.0;
+
+    ///* Row after row, as the cells of an OccupancyGrid
+    std::vector<float> distance;
+
+    ///* From the cells of an occupancy grid (-1 for unknown, else 0 to
+    ///* 100): those above `threshold` are occupied, and so are the unknown
+    void build(const int8_t * cells, size_t width, size_t height, int threshold = 50);
+
+    bool empty() const { return distance.empty(); }
+};
+
+
+///* Monte Carlo localization in the node itself (see
+///* `Params::particle_filter`), so that the pose goes to the solver loop
+///* through the same TripleBuffer as the callbacks', without a topic in
+///* between: the motion of the odometry moves the particles, each scan
+///* weights them by how well its beams agree with the rays cast from them
+///* into the map, and they're resampled.
+///*
+///* The particles are in arrays of their own coordinates (x, y, theta and
+///* weight), allocated up front, so that the motion model is plain loops
+///* over them; the noise is drawn into arrays of its own before. The
+///* weighting is split into chunks of particles, claimed by the threads of
+///* a pool of `Params::pf_threads` and by the calling thread. The
+///* resampling is the low-variance one, into the second set of arrays,
+///* which are swapped with the first.
+///*
+///* The sensor model is that of the MIT racecar's particle filter: a mix of
+///* a hit, a short reading, a max range reading and a random one, in a
+///* table of the log-likelihoods by measured and expected range [cells],
+///* with the sum over the beams squashed so that the particles aren't too
+///* peaked.
+///*
+///* The expected ranges are cast along the distance transform of the map,
+///* or with `Params::pf_range_table` looked up in a table of the ranges
+///* from every free cell along `Params::pf_range_bins` directions, cast
+///* once per map (on the pool too). Its directions are the innermost, so
+///* that the beams of a particle are read from the same few cache lines.
+class ParticleFilter {
+public:
+    ParticleFilter(const Params & params);
+    ~ParticleFilter();
+
+    ParticleFilter(const ParticleFilter &) = delete;
+    ParticleFilter & operator=(const ParticleFilter &) = delete;
+
+    void set_map(std::shared_ptr<const LocalizationMap> map);
+
+    ///* Spreads the particles about (x, y, theta) [m, rad], with the
+    ///* standard deviations `sigma_xy` [m] and `sigma_theta` [rad]
+    void initialize(double x, double y, double theta, double sigma_xy, double sigma_theta);
+
+    ///* The pose of the odometry (in its own frame): the motion since the
+    ///* previous update is applied at the next one
+    void add_odometry(double x, double y, double theta);
+
+    ///* A scan of `num_ranges` ranges [m], at `angle_min` + i
+    ///* `angle_increment` [rad] in the frame of the car: moves, weights and
+    ///* resamples the particles. False (and nothing done) without a map or
+    ///* before `initialize`
+    bool update(const float * ranges, size_t num_ranges, double angle_min, double angle_increment);
+
+    ///* The pose the particles agree on [m, rad]: their weighted mean before
+    ///* the last resampling
+    double x() const { return m_x_estimate; }
+    double y() const { return m_y_estimate; }
+    double theta() const { return m_theta_estimate; }
+
+    bool ready() const { return m_map and m_initialized; }
+
+private:
+    ///* The range [cells] of the ray from (x, y) [cells] along the angle
+    ///* `theta` [rad] of the map, up to `m_max_range` [cells]
+    float cast(float x, float y, float theta) const;
+
+    ///* The ranges of the cells of the rows [begin, end) into the table
+    void cast_rows(size_t begin, size_t end);
+
+    ///* Moves the particles by the motion of the odometry since the last
+    ///* update, with noise
+    void move();
+
+    ///* The log-likelihood of the scan (of the beams of `m_beam_ranges`) from the
+    ///* particles [begin, end)
+    void weigh(size_t begin, size_t end);
+
+    ///* The chunks of `task` over [0, `size`) (`weigh` or `cast_rows`) on
+    ///* the threads of the pool and on the calling one, until all are done
+    void run_chunks(void (ParticleFilter::*task)(size_t, size_t), size_t size);
+    void work();
+
+    void resample();
+
+    size_t m_num_particles;
+    size_t m_num_beams;
+    double m_max_range_m;
+    double m_noise_x;
+    double m_noise_y;
+    double m_noise_theta;
+    double m_sigma_hit;
+
+    std::shared_ptr<const LocalizationMap> m_map;
+    ///* In cells, and the table of the sensor model (by measured range, then
+    ///* expected range, in cells up to it)
+    int m_max_range;
+    std::vector<float> m_sensor_table;
+
+    ///* With `Params::pf_range_table`: the ranges [cells] by row, column and
+    ///* direction (0 from the occupied cells); empty without it or when it
+    ///* would be larger than MAX_RANGE_TABLE_SIZE
+    bool m_use_range_table;
+    size_t m_range_bins;
+    std::vector<uint16_t> m_range_table;
+
+    ///* The particles, in the frame of the map (x, y [m], theta [rad]), and
+    ///* their weights; the next ones the resampling writes
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<float> m_theta;
+    std::vector<double> m_weight;
+    std::vector<float> m_next_x;
+    std::vector<float> m_next_y;
+    std::vector<float> m_next_theta;
+
+    ///* The noise of the motion model, drawn before it's applied
+    std::vector<float> m_noise_x_draws;
+    std::vector<float> m_noise_y_draws;
+    std::vector<float> m_noise_theta_draws;
+    std::mt19937 m_rng;
+
+    ///* The beams of the scan being weighted: their angles [rad] in the frame
+    ///* of the car, and their ranges [cells] (clamped to `m_max_range`)
+    std::vector<float> m_beam_angles;
+    std::vector<int> m_beam_ranges;
+
+    bool m_initialized;
+    bool m_odometry_OK;
+    double m_odom_x;
+    double m_odom_y;
+    double m_odom_theta;
+    ///* The pose of the odometry the particles were last moved to
+    double m_moved_x;
+    double m_moved_y;
+    double m_moved_theta;
+
+    double m_x_estimate;
+    double m_y_estimate;
+    double m_theta_estimate;
+
+    std::unique_ptr<Eigen::ThreadPoolInterface> m_pool;
+    size_t m_num_chunks;
+    void (ParticleFilter::*m_task)(size_t, size_t);
+    size_t m_task_size;
+    std::atomic<size_t> m_next;
+    std::atomic<size_t> m_done;
+    std::atomic<size_t> m_outstanding;
+
+    ///* The exponent of the likelihood of a scan, which flattens it (the
+    ///* beams aren't independent)
+    static constexpr double INV_SQUASH_FACTOR = 1.0 / 2.2;
+    ///* The mix of the sensor model
+    static constexpr double Z_HIT = 0.75;
+    static constexpr double Z_SHORT = 0.01;
+    static constexpr double Z_MAX = 0.07;
+    static constexpr double Z_RAND = 0.12;
+    ///* Chunks of the weighting per thread (the calling one included)
+    static constexpr size_t CHUNKS_PER_THREAD = 4;
+    ///* [B]
+    static constexpr size_t MAX_RANGE_TABLE_SIZE = size_t(1) << 30;
+};
@@ -0,0 +1,63 @@
+#include <cassert>
+
+#include "PathSegments.h"
+
+
+void PathSegments::build(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed) {
+    int num_points = int(pts_x.size());
+    m_start_x.resize(num_points);
+    m_start_y.resize(num_points);
+    m_dir_x.resize(num_points);
+    m_dir_y.resize(num_points);
+    m_inv_length2.resize(num_points);
+    for (int i=0; i < num_points; i++)
+        set(pts_x, pts_y, closed, i);
+}
+
+
+void PathSegments::update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed,
+                          int first, int count) {
+    int num_points = size();
+    assert(int(pts_x.size()) == num_points and first >= 0 and count >= 0 and first + count <= num_points);
+    // The segment into the first point is the previous one's
+    int begin = (first > 0) ? first - 1 : (closed ? num_points - 1 : 0);
+    for (int k=0; k < count + ((first > 0 or closed) ? 1 : 0); k++)
+        set(pts_x, pts_y, closed, (begin + k) % num_points);
+}
+
+
+void PathSegments::set(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed, int i) {
+    int num_points = int(pts_x.size());
+    int j = (i + 1 == num_points) ? (closed ? 0 : i) : i + 1;
+    m_start_x[i] = pts_x[i];
+    m_start_y[i] = pts_y[i];
+    m_dir_x[i] = pts_x[j] - pts_x[i];
+    m_dir_y[i] = pts_y[j] - pts_y[i];
+    double length2 = m_dir_x[i] * m_dir_x[i] + m_dir_y[i] * m_dir_y[i];
+    m_inv_length2[i] = (length2 > 0.0) ? 1.0 / length2 : 0.0;
+}
+
+
+int PathSegments::project(int first, int count, double x, double y, Eigen::ArrayXd & t_work,
+                          Eigen::ArrayXd & dist2_work, double & t, double & dist2) const {
+    assert(first >= 0 and count > 0 and first + count <= size());
+    if (t_work.size() < count)
+        t_work.resize(count);
+    if (dist2_work.size() < count)
+        dist2_work.resize(count);
+
+    // Relative to the starts, as expressions: each is evaluated where it's
+    // used, a packet at a time
+    auto rel_x = x - m_start_x.segment(first, count);
+    auto rel_y = y - m_start_y.segment(first, count);
+    auto dir_x = m_dir_x.segment(first, count);
+    auto dir_y = m_dir_y.segment(first, count);
+    t_work.head(count) = ((rel_x * dir_x + rel_y * dir_y) * m_inv_length2.segment(first, count)).max(0.0).min(1.0);
+    dist2_work.head(count) = (rel_x - t_work.head(count) * dir_x).square()
+            + (rel_y - t_work.head(count) * dir_y).square();
+
+    Eigen::Index best;
+    dist2 = dist2_work.head(count).minCoeff(&best);
+    t = t_work[best];
+    return first + int(best);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+
+
+///* The segments between consecutive waypoints of a path (and from the last
+///* one back to the first, which is a point unless the path is closed), as
+///* a structure of arrays, for projecting a point onto a run of them at
+///* once: every segment of the run is a lane of Eigen's packet math (SSE,
+///* AVX or NEON, whichever it's built for), and only the search for the
+///* nearest projection is scalar.
+class PathSegments {
+public:
+    ///* (Re)builds the segments of the points; keeps no reference to them
+    void build(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed);
+
+    ///* ... only those from or to the points [first, first + count), moved
+    ///* (the same number of them)
+    void update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed,
+                int first, int count);
+
+    bool empty() const { return m_start_x.size() == 0; }
+    int size() const { return int(m_start_x.size()); }
+
+    ///* The segment of [first, first + count) (within the segments) with the
+    ///* projection of (x, y) nearest to it, the fraction `t` (in [0, 1])
+    ///* along it of the projection, and its squared distance. `t_work` and
+    ///* `dist2_work` take the projections on all of them: they're resized
+    ///* only if they're shorter than `count`
+    int project(int first, int count, double x, double y, Eigen::ArrayXd & t_work, Eigen::ArrayXd & dist2_work,
+                double & t, double & dist2) const;
+
+private:
+    void set(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed, int i);
+
+    ///* Start and direction (end - start) of every segment, and the inverse
+    ///* of its squared length (0 for a segment of no length, whose
+    ///* projections are at its start)
+    Eigen::ArrayXd m_start_x;
+    Eigen::ArrayXd m_start_y;
+    Eigen::ArrayXd m_dir_x;
+    Eigen::ArrayXd m_dir_y;
+    Eigen::ArrayXd m_inv_length2;
+};
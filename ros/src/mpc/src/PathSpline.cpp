@@ -0,0 +1,259 @@
+#include <cmath>
+#include <algorithm>
+
+#include "PathSpline.h"
+
+
+constexpr double PathSpline::MIN_SEGMENT_LENGTH;
+constexpr size_t PathSpline::UPDATE_MARGIN;
+
+
+PathSpline::PathSpline() : m_closed(false), m_length(0.0) {}
+
+
+void PathSpline::build(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed) {
+    m_knot_s.clear();
+    m_knot_x.clear();
+    m_knot_y.clear();
+    m_point_s.assign(pts_x.size(), 0.0);
+    m_length = 0.0;
+    m_closed = false;
+    if (pts_x.empty())
+        return;
+
+    double s = 0.0;
+    m_knot_s.push_back(0.0);
+    m_knot_x.push_back(pts_x[0]);
+    m_knot_y.push_back(pts_y[0]);
+    for (size_t i=1; i < pts_x.size(); i++) {
+        double ds = std::hypot(pts_x[i] - m_knot_x.back(), pts_y[i] - m_knot_y.back());
+        if (ds >= MIN_SEGMENT_LENGTH) {
+            s += ds;
+            m_knot_s.push_back(s);
+            m_knot_x.push_back(pts_x[i]);
+            m_knot_y.push_back(pts_y[i]);
+        }
+        m_point_s[i] = s;
+    }
+
+    // A periodic spline needs at least three distinct points
+    m_closed = closed and m_knot_s.size() >= 3;
+    if (m_closed) {
+        double ds = std::hypot(m_knot_x[0] - m_knot_x.back(), m_knot_y[0] - m_knot_y.back());
+        s += std::max(ds, MIN_SEGMENT_LENGTH);
+        m_knot_s.push_back(s);
+        m_knot_x.push_back(m_knot_x[0]);
+        m_knot_y.push_back(m_knot_y[0]);
+        solve_periodic(m_knot_x, m_m_x);
+        solve_periodic(m_knot_y, m_m_y);
+    } else {
+        solve_natural(m_knot_x, m_m_x);
+        solve_natural(m_knot_y, m_m_y);
+    }
+    m_length = s;
+}
+
+
+bool PathSpline::update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t first,
+                        size_t count, double & s_begin, double & s_end) {
+    size_t num_points = pts_x.size();
+    size_t num_knots = m_knot_s.size();
+    if (count == 0 or first + count > num_points or m_point_s.size() != num_points
+            or num_knots != num_points + (m_closed ? 1 : 0))
+        return false;
+
+    // The equations of the knots next to the moved ones change too, and
+    // those of the margin take up the change
+    size_t last = std::min(first + count, num_knots - 1);
+    if (m_closed and (first < UPDATE_MARGIN + 1 or last + UPDATE_MARGIN > num_knots - 1))
+        return false;
+    size_t a = (first > UPDATE_MARGIN + 1) ? first - UPDATE_MARGIN - 1 : 0;
+    size_t b = std::min(last + UPDATE_MARGIN, num_knots - 1);
+    for (size_t i = std::max(first, size_t(1)); i <= last and i < num_points; i++) {
+        if (std::hypot(pts_x[i] - pts_x[i - 1], pts_y[i] - pts_y[i - 1]) < MIN_SEGMENT_LENGTH)
+            return false;
+    }
+
+    for (size_t i=first; i < first + count; i++) {
+        m_knot_x[i] = pts_x[i];
+        m_knot_y[i] = pts_y[i];
+    }
+    double old_s = m_knot_s[last];
+    for (size_t i = std::max(first, size_t(1)); i <= last; i++)
+        m_knot_s[i] = m_knot_s[i - 1] + std::hypot(m_knot_x[i] - m_knot_x[i - 1], m_knot_y[i] - m_knot_y[i - 1]);
+    double shift = m_knot_s[last] - old_s;
+    for (size_t i=last + 1; i < num_knots; i++)
+        m_knot_s[i] += shift;
+    m_length += shift;
+    for (size_t i=first; i < num_points; i++)
+        m_point_s[i] = m_knot_s[i];
+
+    if (b > a + 1) {
+        solve_span(m_knot_x, m_m_x, a, b);
+        solve_span(m_knot_y, m_m_y, a, b);
+    }
+    s_begin = m_knot_s[a];
+    s_end = m_knot_s[b];
+    return true;
+}
+
+
+// M[i-1] h[i-1] + 2 M[i] (h[i-1] + h[i]) + M[i+1] h[i] = 6 (slope[i] - slope[i-1]),
+// with M = 0 at both ends (Thomas algorithm)
+void PathSpline::solve_natural(const std::vector<double> & v, std::vector<double> & m) const {
+    size_t n = v.size();
+    m.assign(n, 0.0);
+    if (n < 3)
+        return;
+
+    std::vector<double> c(n, 0.0), d(n, 0.0);
+    for (size_t i=1; i + 1 < n; i++) {
+        double h0 = m_knot_s[i] - m_knot_s[i - 1];
+        double h1 = m_knot_s[i + 1] - m_knot_s[i];
+        double rhs = 6.0 * ((v[i + 1] - v[i]) / h1 - (v[i] - v[i - 1]) / h0);
+        double denom = 2.0 * (h0 + h1) - h0 * c[i - 1];
+        c[i] = h1 / denom;
+        d[i] = (rhs - h0 * d[i - 1]) / denom;
+    }
+    for (size_t i = n - 2; i >= 1; i--)
+        m[i] = d[i] - c[i] * m[i + 1];
+}
+
+
+// The same equations over (a, b), with M[a] and M[b] as they are
+void PathSpline::solve_span(const std::vector<double> & v, std::vector<double> & m, size_t a, size_t b) const {
+    std::vector<double> c(b - a + 1, 0.0), d(b - a + 1, 0.0);
+    d[0] = m[a];
+    for (size_t i=a + 1; i < b; i++) {
+        double h0 = m_knot_s[i] - m_knot_s[i - 1];
+        double h1 = m_knot_s[i + 1] - m_knot_s[i];
+        double rhs = 6.0 * ((v[i + 1] - v[i]) / h1 - (v[i] - v[i - 1]) / h0);
+        double denom = 2.0 * (h0 + h1) - h0 * c[i - 1 - a];
+        c[i - a] = h1 / denom;
+        d[i - a] = (rhs - h0 * d[i - 1 - a]) / denom;
+    }
+    for (size_t i = b - 1; i > a; i--)
+        m[i] = d[i - a] - c[i - a] * m[i + 1];
+}
+
+
+// The same equations around the loop (the last knot is the first one), a cyclic
+// tridiagonal system solved with the Sherman-Morrison formula
+void PathSpline::solve_periodic(const std::vector<double> & v, std::vector<double> & m) const {
+    size_t n = v.size() - 1;
+    m.assign(n + 1, 0.0);
+
+    std::vector<double> h(n), lower(n), diag(n), upper(n), rhs(n);
+    for (size_t i=0; i < n; i++)
+        h[i] = m_knot_s[i + 1] - m_knot_s[i];
+    for (size_t i=0; i < n; i++) {
+        size_t prev = (i + n - 1) % n;
+        double slope_prev = (v[prev + 1] - v[prev]) / h[prev];
+        double slope = (v[i + 1] - v[i]) / h[i];
+        lower[i] = h[prev];
+        diag[i] = 2.0 * (h[prev] + h[i]);
+        upper[i] = h[i];
+        rhs[i] = 6.0 * (slope - slope_prev);
+    }
+
+    // A = B + u v^T, with the corners of A moved into u v^T
+    double gamma = -diag[0];
+    std::vector<double> b(diag), u(n, 0.0);
+    b[0] -= gamma;
+    b[n - 1] -= lower[0] * upper[n - 1] / gamma;
+    u[0] = gamma;
+    u[n - 1] = upper[n - 1];
+
+    auto solve_tridiagonal = [&](const std::vector<double> & r, std::vector<double> & x) {
+        std::vector<double> c(n), d(n);
+        c[0] = upper[0] / b[0];
+        d[0] = r[0] / b[0];
+        for (size_t i=1; i < n; i++) {
+            double denom = b[i] - lower[i] * c[i - 1];
+            c[i] = upper[i] / denom;
+            d[i] = (r[i] - lower[i] * d[i - 1]) / denom;
+        }
+        x.assign(n, 0.0);
+        x[n - 1] = d[n - 1];
+        for (size_t i = n - 1; i-- > 0; )
+            x[i] = d[i] - c[i] * x[i + 1];
+    };
+
+    std::vector<double> x, z;
+    solve_tridiagonal(rhs, x);
+    solve_tridiagonal(u, z);
+    double v_x = x[0] + lower[0] / gamma * x[n - 1];
+    double v_z = z[0] + lower[0] / gamma * z[n - 1];
+    double factor = v_x / (1.0 + v_z);
+    for (size_t i=0; i < n; i++)
+        m[i] = x[i] - factor * z[i];
+    m[n] = m[0];
+}
+
+
+size_t PathSpline::segment(double & s) const {
+    if (m_closed) {
+        s = std::fmod(s, m_length);
+        if (s < 0.0)
+            s += m_length;
+    } else {
+        s = std::min(std::max(s, 0.0), m_length);
+    }
+
+    size_t num_segments = m_knot_s.size() - 1;
+    auto it = std::upper_bound(m_knot_s.begin(), m_knot_s.end(), s);
+    size_t i = (it == m_knot_s.begin()) ? 0 : size_t(it - m_knot_s.begin()) - 1;
+    return std::min(i, num_segments - 1);
+}
+
+
+void PathSpline::eval(const std::vector<double> & v, const std::vector<double> & m, size_t i, double s,
+                      double & value, double & d1, double & d2) const {
+    double h = m_knot_s[i + 1] - m_knot_s[i];
+    double a = (m_knot_s[i + 1] - s) / h;
+    double b = 1.0 - a;
+    value = a * v[i] + b * v[i + 1] + ((a*a*a - a) * m[i] + (b*b*b - b) * m[i + 1]) * h * h / 6.0;
+    d1 = (v[i + 1] - v[i]) / h - (3.0*a*a - 1.0) / 6.0 * h * m[i] + (3.0*b*b - 1.0) / 6.0 * h * m[i + 1];
+    d2 = a * m[i] + b * m[i + 1];
+}
+
+
+void PathSpline::sample(double s, Sample & result) const {
+    if (m_knot_s.size() < 2) {
+        result.x = m_knot_x.empty() ? 0.0 : m_knot_x[0];
+        result.y = m_knot_y.empty() ? 0.0 : m_knot_y[0];
+        result.heading = 0.0;
+        result.curvature = 0.0;
+        return;
+    }
+
+    size_t i = segment(s);
+    double dx, dy, ddx, ddy;
+    eval(m_knot_x, m_m_x, i, s, result.x, dx, ddx);
+    eval(m_knot_y, m_m_y, i, s, result.y, dy, ddy);
+    result.heading = std::atan2(dy, dx);
+    double speed2 = dx*dx + dy*dy;
+    result.curvature = (dx * ddy - dy * ddx) / std::max(speed2 * std::sqrt(speed2), 1e-12);
+}
+
+
+void PathSpline::position(double s, double & x, double & y) const {
+    Sample result;
+    sample(s, result);
+    x = result.x;
+    y = result.y;
+}
+
+
+double PathSpline::heading(double s) const {
+    Sample result;
+    sample(s, result);
+    return result.heading;
+}
+
+
+double PathSpline::curvature(double s) const {
+    Sample result;
+    sample(s, result);
+    return result.curvature;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+
+///* Cubic spline model of the centerline, parameterised by (chord) arc
+///* length. It's built once per path (an O(N) tridiagonal solve per
+///* coordinate), after which the position, heading and curvature at any arc
+///* length cost a binary search in the arc-length table plus a few flops.
+///*
+///* A closed path (the usual case: a track) gets a periodic spline, and the
+///* arc length then wraps around; otherwise a natural spline, and the arc
+///* length is clamped to the ends.
+class PathSpline {
+public:
+    struct Sample {
+        double x;
+        double y;
+        double heading;
+        double curvature;
+    };
+
+    PathSpline();
+
+    void build(const std::vector<double> & pts_x, const std::vector<double> & pts_y, bool closed);
+
+    ///* Takes in the points [first, first + count) of those it's built from,
+    ///* moved (the same number of them): their knots, the arc length from
+    ///* them on, and the second derivatives over them and `UPDATE_MARGIN`
+    ///* knots either side, with those beyond kept (their change decays by
+    ///* about 4 per knot). [s_begin, s_end] is the arc length over which
+    ///* the spline changed, and past it the arc length shifted by the change
+    ///* of the length. False, with the spline unchanged, when the points
+    ///* don't map one to one on the knots (merged ones) or the span is
+    ///* within the margin of an end of a closed path: it's built again then
+    bool update(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t first, size_t count,
+                double & s_begin, double & s_end);
+
+    bool empty() const { return m_knot_s.empty(); }
+    bool closed() const { return m_closed; }
+    double length() const { return m_length; }
+
+    ///* Arc length at the i-th point passed to `build`
+    double arc_length(size_t i) const { return m_point_s[i]; }
+
+    void position(double s, double & x, double & y) const;
+    double heading(double s) const;
+    double curvature(double s) const;
+    void sample(double s, Sample & result) const;
+
+private:
+    ///* Which stores and restores the spline as is
+    friend class TrackStore;
+
+    ///* Maps `s` into [0, length] and finds its segment
+    size_t segment(double & s) const;
+
+    ///* Value and first two derivatives (w.r.t. s) of one coordinate on
+    ///* segment i
+    void eval(const std::vector<double> & v, const std::vector<double> & m, size_t i, double s,
+              double & value, double & d1, double & d2) const;
+
+    ///* Second derivatives at the knots
+    void solve_natural(const std::vector<double> & v, std::vector<double> & m) const;
+    void solve_periodic(const std::vector<double> & v, std::vector<double> & m) const;
+    ///* ... over the knots (a, b), with those at a and b kept
+    void solve_span(const std::vector<double> & v, std::vector<double> & m, size_t a, size_t b) const;
+
+    bool m_closed;
+    double m_length;
+
+    ///* Knots (the points without duplicates; for a closed path the first
+    ///* one is repeated at the end), their arc length, and the second
+    ///* derivatives of x(s) and y(s) there
+    std::vector<double> m_knot_s;
+    std::vector<double> m_knot_x;
+    std::vector<double> m_knot_y;
+    std::vector<double> m_m_x;
+    std::vector<double> m_m_y;
+
+    std::vector<double> m_point_s;
+
+    ///* Points closer than this to the previous one are merged into it
+    static constexpr double MIN_SEGMENT_LENGTH = 1e-6; // [m]
+
+    ///* The knots either side of an update whose second derivatives are
+    ///* solved for again
+    static constexpr size_t UPDATE_MARGIN = 8;
+};
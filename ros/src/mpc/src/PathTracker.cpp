@@ -0,0 +1,741 @@
+#include <cmath>
+#include <algorithm>
+
+#include "PathTracker.h"
+#include "AllocationCounter.h"
+#include "Log.h"
+#include "Polynomial.h"
+#include "Trace.h"
+
+
+PathTracker::PathTracker(const Params & params) {
+    m_poly_degree = params.poly_degree;
+    m_num_steps_poly = params.num_steps_poly;
+
+    m_windowed_closest = params.windowed_closest;
+    m_tracked_hash = 0;
+    m_tracked_version = 0;
+    m_tracked_idx = -1;
+    m_projected_closest = params.projected_closest;
+    m_projection_OK = false;
+    m_projected_segment = 0;
+    m_projected_t = 0.0;
+    if (m_projected_closest) {
+        m_projection_t.resize(2 * CLOSEST_WINDOW);
+        m_projection_dist2.resize(2 * CLOSEST_WINDOW);
+    }
+    m_lap_progress = params.lap_progress;
+    m_progress_OK = false;
+    m_spline_reference = params.spline_reference;
+    m_incremental_fit = params.incremental_fit;
+    m_fit_centerline = nullptr;
+    m_precomputed_fit = params.precomputed_fit;
+    m_fused_fit = params.fused_fit;
+    m_window_fused = false;
+    m_fused_coeffs.setZero();
+    m_fused_centerline = nullptr;
+    m_fused_pose[0] = m_fused_pose[1] = m_fused_pose[2] = 0.0;
+    m_adaptive_window = params.adaptive_window;
+    m_pyramid = (params.pyramid_levels > 0);
+    m_window_pyramid = false;
+
+    m_closest_idx = 0;
+    m_window_start = 0;
+    m_fraction_steps_OK = 1.0;
+    m_window_stride = STEP_POLY;
+    m_window_size = m_num_steps_poly;
+    m_float_window = (params.precision == "mixed" or params.precision == "float");
+    m_car_pts_OK = true;
+}
+
+
+void PathTracker::prepare_centerline(Centerline & centerline, const Params & params) {
+    size_t poly_degree = params.poly_degree;
+    size_t num_steps_poly = params.num_steps_poly;
+    int num_points = centerline.pts_x.size();
+    // Only the points make the grid and the spline, so a centerline prepared
+    // again (for another fit) or read from a TrackStore keeps them
+    if (centerline.grid.empty())
+        centerline.grid.build(centerline.pts_x, centerline.pts_y);
+    if (!params.compact_waypoints)
+        centerline.compact = CompactTrack();
+    else if (centerline.compact.size() != centerline.pts_x.size())
+        centerline.compact.build(centerline.pts_x, centerline.pts_y);
+    // The widest window reaches NUM_STEPS_BACK points back and all of its
+    // strided points forward
+    size_t ring_margin = (params.ring_margin > 0) ? size_t(params.ring_margin)
+            : NUM_STEPS_BACK + num_steps_poly * MAX_WINDOW_STRIDE;
+    if (params.ring_margin < 0)
+        centerline.ring = PaddedRing();
+    else
+        centerline.ring.build(centerline.pts_x, centerline.pts_y, ring_margin);
+
+    // The tracks are loops: the last waypoint is about as close to the first
+    // one as any two consecutive ones
+    bool closed = false;
+    if (centerline.spline.empty() and num_points > 2) {
+        double length = 0.0;
+        for (int i=1; i < num_points; i++)
+            length += std::hypot(centerline.pts_x[i] - centerline.pts_x[i-1], centerline.pts_y[i] - centerline.pts_y[i-1]);
+        double gap = std::hypot(centerline.pts_x[0] - centerline.pts_x[num_points-1], centerline.pts_y[0] - centerline.pts_y[num_points-1]);
+        closed = (gap < CLOSED_PATH_GAP * length / (num_points - 1));
+    }
+    if (centerline.spline.empty())
+        centerline.spline.build(centerline.pts_x, centerline.pts_y, closed);
+    if (centerline.segments.empty())
+        centerline.segments.build(centerline.pts_x, centerline.pts_y, centerline.spline.closed());
+
+    centerline.speed_profile = SpeedProfile();
+    if (params.speed_profile)
+        centerline.speed_profile.build(centerline.spline, params.max_lateral_accel, params.max_accel,
+                                       params.max_decel);
+
+    // The room on either side, the moments of the windows and their shapes
+    centerline.corridor_left.clear();
+    centerline.corridor_right.clear();
+    if (params.corridor_width > 0.0 and !centerline.spline.empty()) {
+        centerline.corridor_left.resize(num_points);
+        centerline.corridor_right.resize(num_points);
+        prepare_corridor(centerline, params, 0, num_points);
+    }
+
+    centerline.pyramid = CenterlinePyramid();
+    if (params.pyramid_levels > 0 and !centerline.spline.empty() and num_points > 1)
+        prepare_pyramid(centerline, params);
+
+    centerline.window_moments.clear();
+    if (params.precomputed_fit and poly_degree <= WindowMoments::MAX_DEGREE and num_points > 0) {
+        centerline.window_moments.resize(num_points);
+        centerline.moments_degree = poly_degree;
+        centerline.moments_size = num_steps_poly;
+        prepare_window_moments(centerline, 0, num_points);
+    }
+
+    centerline.window_shapes.clear();
+    if (params.adaptive_window and !centerline.spline.empty() and num_points > 0) {
+        centerline.window_shapes.resize(num_points);
+        centerline.shapes_size = num_steps_poly;
+        prepare_window_shapes(centerline, params, 0, num_points);
+    }
+}
+
+
+bool PathTracker::patch_centerline(Centerline & centerline, size_t first, size_t count, const Params & params) {
+    int num_points = centerline.pts_x.size();
+    double s_begin = 0.0, s_end = 0.0;
+    double length = centerline.spline.length();
+    if (centerline.spline.empty() or centerline.segments.size() != num_points or count == 0
+            or !centerline.spline.update(centerline.pts_x, centerline.pts_y, first, count, s_begin, s_end)) {
+        centerline.grid = SpatialGrid();
+        centerline.spline = PathSpline();
+        centerline.compact = CompactTrack();
+        centerline.segments = PathSegments();
+        prepare_centerline(centerline, params);
+        return false;
+    }
+    const PathSpline & spline = centerline.spline;
+
+    centerline.grid.build(centerline.pts_x, centerline.pts_y);
+    centerline.segments.update(centerline.pts_x, centerline.pts_y, spline.closed(), int(first), int(count));
+    if (!centerline.compact.empty())
+        centerline.compact.update(centerline.pts_x, centerline.pts_y, first, count);
+    if (!centerline.ring.empty())
+        centerline.ring.update(centerline.pts_x, centerline.pts_y, first, count);
+    if (!centerline.speed_profile.empty())
+        centerline.speed_profile.update(spline, s_begin, s_end, spline.length() - length);
+
+    // The waypoints whose curvature changed: those over which the spline did
+    int begin = int(first), end = int(first + count);
+    while (begin > 0 and spline.arc_length(begin - 1) >= s_begin)
+        begin--;
+    while (end < num_points and spline.arc_length(end) <= s_end)
+        end++;
+    if (!centerline.corridor_left.empty())
+        prepare_corridor(centerline, params, begin, end - begin);
+    // The levels are samples of the spline along all of it, shifted past
+    // the patch: taken again
+    if (!centerline.pyramid.empty())
+        prepare_pyramid(centerline, params);
+
+    // The windows with a moved waypoint in them, and those with a waypoint
+    // whose turn changed (which counts the arc length to the next one)
+    if (!centerline.window_moments.empty()) {
+        int size = int(centerline.moments_size);
+        prepare_window_moments(centerline, int(first) + NUM_STEPS_BACK - size + 1 + num_points,
+                               std::min(int(count) + size - 1, num_points));
+    }
+    if (!centerline.window_shapes.empty()) {
+        int size = int(centerline.shapes_size);
+        prepare_window_shapes(centerline, params, begin - 1 + NUM_STEPS_BACK - size + 1 + num_points,
+                              std::min(end - begin + size, num_points));
+    }
+    return true;
+}
+
+
+void PathTracker::corridor_at(const PathSpline & spline, const Params & params, double s, double & left,
+                              double & right) {
+    // The track's less the margin, and short of the center of the turn on
+    // its inside (the left of a turn to the left, of positive curvature)
+    double room = std::max(params.corridor_width - params.corridor_margin, 0.0);
+    double curvature = spline.curvature(s);
+    double inside = (1.0 - TURN_CENTER_MARGIN) / std::max(std::abs(curvature), 1e-6);
+    left = (curvature > 0.0) ? std::min(room, inside) : room;
+    right = (curvature > 0.0) ? room : std::min(room, inside);
+}
+
+
+void PathTracker::prepare_corridor(Centerline & centerline, const Params & params, int first, int count) {
+    int num_points = centerline.pts_x.size();
+    for (int k=0; k < std::min(count, num_points); k++) {
+        int i = (first + k) % num_points;
+        corridor_at(centerline.spline, params, centerline.spline.arc_length(i), centerline.corridor_left[i],
+                    centerline.corridor_right[i]);
+    }
+}
+
+
+void PathTracker::prepare_pyramid(Centerline & centerline, const Params & params) {
+    // Level 0 as dense as the waypoints (on average)
+    const PathSpline & spline = centerline.spline;
+    CenterlinePyramid & pyramid = centerline.pyramid;
+    pyramid.build(spline, spline.length() / centerline.pts_x.size(), size_t(params.pyramid_levels));
+    if (pyramid.empty() or params.corridor_width <= 0.0)
+        return;
+    CenterlinePyramid::Level & fine = pyramid.fine_level();
+    fine.left.resize(fine.x.size());
+    fine.right.resize(fine.x.size());
+    for (size_t i=0; i < fine.x.size(); i++)
+        corridor_at(spline, params, i * fine.spacing, fine.left[i], fine.right[i]);
+    pyramid.reduce_corridor();
+}
+
+
+void PathTracker::prepare_window_moments(Centerline & centerline, int first, int count) {
+    // The window of a waypoint starts `NUM_STEPS_BACK` points before it (see
+    // `make_window`); its moments are taken around its first point
+    int num_points = centerline.pts_x.size();
+    for (int k=0; k < std::min(count, num_points); k++) {
+        int i = (first + k) % num_points;
+        int start = ((i - NUM_STEPS_BACK) % num_points + num_points) % num_points;
+        WindowMoments & moments = centerline.window_moments[i];
+        moments.reset(centerline.moments_degree, centerline.pts_x[start], centerline.pts_y[start]);
+        for (size_t j=0; j < centerline.moments_size; j++) {
+            int idx = (start + j) % num_points;
+            moments.accumulate(centerline.pts_x[idx], centerline.pts_y[idx], 1.0);
+        }
+    }
+}
+
+
+void PathTracker::prepare_window_shapes(Centerline & centerline, const Params & params, int first, int count) {
+    // The shape of the window of every waypoint, by how much the path turns
+    // over it (the curvature at every waypoint times the arc length to the
+    // next): where it winds, the window stops before the fit degenerates,
+    // and where it's straight, fewer points span it
+    const PathSpline & spline = centerline.spline;
+    size_t poly_degree = params.poly_degree;
+    size_t num_steps_poly = centerline.shapes_size;
+    int num_points = centerline.pts_x.size();
+    count = std::min(count, num_points);
+
+    // The turns of the points of the windows, from the first one's start
+    int turn_first = ((first - NUM_STEPS_BACK) % num_points + num_points) % num_points;
+    int num_turns = std::min(count + int(num_steps_poly) - 1, num_points);
+    std::vector<double> turn(num_turns);
+    for (int k=0; k < num_turns; k++) {
+        int i = (turn_first + k) % num_points;
+        double s = spline.arc_length(i);
+        double ds = (i + 1 < num_points) ? spline.arc_length(i + 1) - s : spline.length() / num_points;
+        turn[k] = std::abs(spline.curvature(s)) * ds;
+    }
+
+    size_t min_size = std::min(num_steps_poly, 2 * (poly_degree + 1));
+    for (int k=0; k < count; k++) {
+        double window_turn = 0.0;
+        size_t size = 0;
+        while (size < num_steps_poly) {
+            double next_turn = turn[(k + size) % num_turns];
+            if (size >= min_size and window_turn + next_turn > MAX_WINDOW_TURN)
+                break;
+            window_turn += next_turn;
+            size++;
+        }
+
+        WindowShape & shape = centerline.window_shapes[(first + k) % num_points];
+        shape = WindowShape{uint16_t(STEP_POLY), uint16_t(num_steps_poly)};
+        if (size < num_steps_poly) {
+            shape.size = uint16_t(size);
+        } else if (window_turn < STRAIGHT_WINDOW_TURN) {
+            size_t stride = MAX_WINDOW_STRIDE;
+            while (stride > 1 and (num_steps_poly + stride - 1) / stride < min_size)
+                stride--;
+            shape.stride = uint16_t(stride);
+            shape.size = uint16_t((num_steps_poly + stride - 1) / stride);
+        }
+    }
+}
+
+
+void PathTracker::reconfigure(const Params & params) {
+    m_poly_degree = params.poly_degree;
+    m_num_steps_poly = params.num_steps_poly;
+
+    // The buffers of the fit may have grown
+    m_sliding_fit.reset();
+    m_fit_centerline = nullptr;
+}
+
+
+int PathTracker::closest_waypoint(const Centerline & centerline, double pos_x, double pos_y,
+                                  TelemetryRecord & record) {
+    m_progress_OK = m_lap_progress and m_progress.update(centerline, pos_x, pos_y);
+    m_projection_OK = false;
+    if (!m_progress_OK)
+        return m_windowed_closest ? find_closest_tracked(centerline, pos_x, pos_y)
+                                  : find_closest(centerline, pos_x, pos_y);
+
+    if (m_progress.lost()) {
+        // A rare event, which the allocation check lets log
+        AllocationCounter::Pause pause;
+        MPC_WARN("Lost track of the progress along the path, searching the whole path");
+        Trace::instant("track_lost");
+    }
+    record.events |= TelemetryRecord::LAP_PROGRESS;
+    record.progress_s = m_progress.s();
+    record.progress_d = m_progress.d();
+    record.laps = int16_t(m_progress.laps());
+    return m_progress.closest_waypoint();
+}
+
+
+double PathTracker::arc_length(const Centerline & centerline) const {
+    if (m_progress_OK)
+        return m_progress.s();
+    const PathSpline & spline = centerline.spline;
+    if (!m_projection_OK)
+        return spline.arc_length(m_closest_idx);
+
+    // As LapProgress, from the start of the segment
+    int i = m_projected_segment;
+    double s_start = spline.arc_length(i);
+    double s_end = (i + 1 < int(centerline.pts_x.size())) ? spline.arc_length(i + 1) : spline.length();
+    return s_start + m_projected_t * (s_end - s_start);
+}
+
+
+void PathTracker::corridor(const Centerline & centerline, double speed, const Params & params, size_t num_stages,
+                           double * lower, double * upper) const {
+    const PathSpline & spline = centerline.spline;
+    const CenterlinePyramid & pyramid = centerline.pyramid;
+    if (m_pyramid and pyramid.has_corridor()) {
+        // Each stage from the level as fine as it is from the previous one
+        double s = arc_length(centerline);
+        double distance = 0.0, time = 0.0;
+        for (size_t t=0; t < num_stages; t++) {
+            double step = speed * time - distance;
+            distance = speed * time;
+            double left, right;
+            pyramid.corridor(pyramid.level_for(step), s + distance, left, right);
+            lower[t] = -left;
+            upper[t] = right;
+            time += params.step_dt(t);
+        }
+        return;
+    }
+
+    int num_points = centerline.corridor_left.size();
+    bool closed = spline.closed();
+
+    // From the waypoint the car is at (or on the segment from), by the arc
+    // length from the car to the waypoint
+    int i = m_progress_OK ? m_progress.segment() : (m_projection_OK ? m_projected_segment : m_closest_idx);
+    double ahead = spline.arc_length(i) - arc_length(centerline);
+    if (closed)
+        ahead = std::remainder(ahead, spline.length());
+    double time = 0.0;
+    for (size_t t=0; t < num_stages; t++) {
+        double distance = speed * time;
+        while (closed or i + 1 < num_points) {
+            int next = (i + 1 == num_points) ? 0 : i + 1;
+            double segment = spline.arc_length(next) - spline.arc_length(i);
+            if (segment < 0.0)
+                segment += spline.length();
+            // The nearer of the two ends
+            if (ahead + 0.5 * segment > distance)
+                break;
+            ahead += segment;
+            i = next;
+        }
+        // cte is f(x) - y in the car's frame: the left is the negative side
+        lower[t] = -centerline.corridor_left[i];
+        upper[t] = centerline.corridor_right[i];
+        time += params.step_dt(t);
+    }
+}
+
+
+void PathTracker::contouring_reference(const Centerline & centerline, double pos_x, double pos_y, double psi,
+                                       double speed, const Params & params, size_t num_stages,
+                                       Eigen::VectorXd & coeffs) const {
+    const PathSpline & spline = centerline.spline;
+    if (size_t(coeffs.size()) != REF_SAMPLE_SIZE * num_stages)
+        coeffs.resize(REF_SAMPLE_SIZE * num_stages);
+
+    double sin_psi = sin(psi), cos_psi = cos(psi);
+    double s = arc_length(centerline);
+    double heading = 0.0;
+    PathSpline::Sample sample;
+    for (size_t t=0; t < num_stages; t++) {
+        spline.sample(s, sample);
+        double dx = sample.x - pos_x, dy = sample.y - pos_y;
+        double * reference = coeffs.data() + REF_SAMPLE_SIZE * t;
+        reference[REF_X] = dx * cos_psi + dy * sin_psi;
+        reference[REF_Y] = dy * cos_psi - dx * sin_psi;
+        // Unwrapped from step to step, so that it turns on through a hairpin
+        double relative = std::remainder(sample.heading - psi, 2 * M_PI);
+        heading = (t == 0) ? relative : heading + std::remainder(relative - heading, 2 * M_PI);
+        reference[REF_HEADING] = heading;
+        reference[REF_CURVATURE] = sample.curvature;
+        s += speed * params.step_dt(t);
+    }
+}
+
+
+int PathTracker::find_closest(const Centerline & centerline, double pos_x, double pos_y) {
+    return centerline.grid.nearest(pos_x, pos_y);
+}
+
+
+int PathTracker::find_closest_tracked(const Centerline & centerline, double pos_x, double pos_y) {
+    const std::vector<double> & pts_x = centerline.pts_x;
+    const std::vector<double> & pts_y = centerline.pts_y;
+    int num_points = pts_x.size();
+
+    // A new path, or nothing to track yet. The path is told by its hash and
+    // version, not its address: a new one may be allocated where the last
+    // one was
+    bool tracking = (centerline.hash == m_tracked_hash and centerline.version == m_tracked_version
+                     and m_tracked_idx >= 0 and m_tracked_idx < num_points
+                     and num_points > 2 * CLOSEST_WINDOW + 1);
+
+    if (tracking and m_projected_closest and centerline.segments.size() == num_points) {
+        // The segments between the waypoints of the window
+        int first = m_tracked_idx - CLOSEST_WINDOW;
+        double t, dist2;
+        int segment = project_segments(centerline, first, 2 * CLOSEST_WINDOW, pos_x, pos_y, t, dist2);
+        int offset = ((segment - first) % num_points + num_points) % num_points;
+
+        bool at_edge = ((offset == 0 and t == 0.0) or (offset == 2 * CLOSEST_WINDOW - 1 and t == 1.0));
+        bool too_far = (dist2 > TRACK_LOST_DISTANCE * TRACK_LOST_DISTANCE);
+        if (!at_edge and !too_far) {
+            m_projection_OK = true;
+            m_projected_segment = segment;
+            m_projected_t = t;
+            m_tracked_idx = (t < 0.5) ? segment : (segment + 1) % num_points;
+            return m_tracked_idx;
+        }
+        AllocationCounter::Pause pause;
+        MPC_WARN("Lost track of the closest point, searching the whole path");
+        Trace::instant("track_lost");
+    } else if (tracking) {
+        int closest_offset = 0;
+        double closest_dist = 1.0e19;
+        if (centerline.compact.size() == size_t(num_points)) {
+            int first = (m_tracked_idx - CLOSEST_WINDOW + num_points) % num_points;
+            int i = int(centerline.compact.nearest(first, 2 * CLOSEST_WINDOW + 1, pos_x, pos_y, closest_dist));
+            closest_offset = (i - first + num_points) % num_points - CLOSEST_WINDOW;
+        } else {
+            for (int offset=-CLOSEST_WINDOW; offset <= CLOSEST_WINDOW; offset++) {
+                int i = (m_tracked_idx + offset + num_points) % num_points;
+                double diff_x = (pts_x[i] - pos_x);
+                double diff_y = (pts_y[i] - pos_y);
+                double dist = diff_x*diff_x + diff_y*diff_y;
+                if (dist < closest_dist) {
+                    closest_offset = offset;
+                    closest_dist = dist;
+                }
+            }
+        }
+
+        // The closest point may lie beyond the window, or the car jumped
+        bool at_edge = (std::abs(closest_offset) == CLOSEST_WINDOW);
+        bool too_far = (closest_dist > TRACK_LOST_DISTANCE * TRACK_LOST_DISTANCE);
+        if (!at_edge and !too_far) {
+            m_tracked_idx = (m_tracked_idx + closest_offset + num_points) % num_points;
+            return m_tracked_idx;
+        }
+        // A rare event, which the allocation check lets log
+        AllocationCounter::Pause pause;
+        MPC_WARN("Lost track of the closest point, searching the whole path");
+        Trace::instant("track_lost");
+    }
+
+    m_tracked_hash = centerline.hash;
+    m_tracked_version = centerline.version;
+    m_tracked_idx = find_closest(centerline, pos_x, pos_y);
+
+    // The projection is on one of the two segments of the closest waypoint
+    if (m_projected_closest and m_tracked_idx >= 0 and num_points > 1
+            and centerline.segments.size() == num_points) {
+        double t, dist2;
+        m_projected_segment = project_segments(centerline, m_tracked_idx - 1, 2, pos_x, pos_y, t, dist2);
+        m_projected_t = t;
+        m_projection_OK = true;
+    }
+    return m_tracked_idx;
+}
+
+
+int PathTracker::project_segments(const Centerline & centerline, int first, int count, double pos_x, double pos_y,
+                                  double & t, double & dist2) {
+    // At most two runs, where the window wraps around the end
+    const PathSegments & segments = centerline.segments;
+    int num_segments = segments.size();
+    first = (first % num_segments + num_segments) % num_segments;
+    int run = std::min(count, num_segments - first);
+    int best = segments.project(first, run, pos_x, pos_y, m_projection_t, m_projection_dist2, t, dist2);
+    if (run < count) {
+        double t_wrapped, dist2_wrapped;
+        int wrapped = segments.project(0, count - run, pos_x, pos_y, m_projection_t, m_projection_dist2,
+                                       t_wrapped, dist2_wrapped);
+        if (dist2_wrapped < dist2) {
+            best = wrapped;
+            t = t_wrapped;
+            dist2 = dist2_wrapped;
+        }
+    }
+    return best;
+}
+
+
+WaypointBuffer & PathTracker::car_pts() {
+    if (!m_car_pts_OK and m_window_fused) {
+        // No point of a fused window breaks the fit, so there's nothing to
+        // record
+        TelemetryRecord record;
+        make_window(*m_fused_centerline, m_fused_pose[0], m_fused_pose[1], m_fused_pose[2],
+                    m_window_world, m_window_car, record);
+        m_car_pts_OK = true;
+    } else if (!m_car_pts_OK) {
+        m_window_car.x = m_window_car_f.x.cast<double>();
+        m_window_car.y = m_window_car_f.y.cast<double>();
+        m_car_pts_OK = true;
+    }
+    return m_window_car;
+}
+
+
+double PathTracker::make_window(const Centerline & centerline, int closest_idx, double pos_x, double pos_y,
+                                double psi, TelemetryRecord & record) {
+    m_closest_idx = closest_idx;
+    m_window_stride = STEP_POLY;
+    m_window_size = m_num_steps_poly;
+    m_window_pyramid = m_pyramid and !centerline.pyramid.empty();
+    if (m_adaptive_window and !m_window_pyramid and centerline.shapes_size == m_num_steps_poly
+            and size_t(m_closest_idx) < centerline.window_shapes.size()) {
+        const WindowShape & shape = centerline.window_shapes[m_closest_idx];
+        m_window_stride = shape.stride;
+        m_window_size = shape.size;
+    }
+
+    m_window_fused = m_fused_fit and !m_window_pyramid and fused_fit(centerline, pos_x, pos_y, psi);
+    if (m_window_fused) {
+        m_fraction_steps_OK = 1.0;
+        m_car_pts_OK = false;
+        return m_fraction_steps_OK;
+    }
+    m_fraction_steps_OK = m_float_window
+            ? make_window(centerline, pos_x, pos_y, psi, m_window_world_f, m_window_car_f, record)
+            : make_window(centerline, pos_x, pos_y, psi, m_window_world, m_window_car, record);
+    m_car_pts_OK = !m_float_window;
+    return m_fraction_steps_OK;
+}
+
+
+bool PathTracker::fused_fit(const Centerline & centerline, double pos_x, double pos_y, double psi) {
+    const PaddedRing & ring = centerline.ring;
+    m_window_start = m_closest_idx - NUM_STEPS_BACK;
+    size_t span = (m_window_size - 1) * m_window_stride + 1;
+    if (m_spline_reference or m_poly_degree < 1 or m_poly_degree > 3
+            or ring.size() != centerline.pts_x.size() or !ring.covers(m_window_start, span))
+        return false;
+
+    // The raw windows are the precomputed or the incremental fit's when on
+    bool raw_window = (m_window_stride == 1 and m_window_size == m_num_steps_poly);
+    if (raw_window and (m_precomputed_fit or m_incremental_fit))
+        return false;
+
+    const double * x = ring.x(m_window_start);
+    const double * y = ring.y(m_window_start);
+    double sin_psi = sin(psi), cos_psi = cos(psi);
+    bool fit_OK = false;
+    switch (m_poly_degree) {
+        case 1: {
+            PolyCoeffs<1> coeffs;
+            fit_OK = polyfit_transformed<1>(x, y, m_window_size, m_window_stride, pos_x, pos_y,
+                                            sin_psi, cos_psi, X_DELTA_MIN_VALUE, coeffs);
+            m_fused_coeffs.head<2>() = coeffs;
+            break;
+        }
+        case 2: {
+            PolyCoeffs<2> coeffs;
+            fit_OK = polyfit_transformed<2>(x, y, m_window_size, m_window_stride, pos_x, pos_y,
+                                            sin_psi, cos_psi, X_DELTA_MIN_VALUE, coeffs);
+            m_fused_coeffs.head<3>() = coeffs;
+            break;
+        }
+        default: {
+            PolyCoeffs<3> coeffs;
+            fit_OK = polyfit_transformed<3>(x, y, m_window_size, m_window_stride, pos_x, pos_y,
+                                            sin_psi, cos_psi, X_DELTA_MIN_VALUE, coeffs);
+            m_fused_coeffs = coeffs;
+        }
+    }
+    m_fused_centerline = &centerline;
+    m_fused_pose[0] = pos_x;
+    m_fused_pose[1] = pos_y;
+    m_fused_pose[2] = psi;
+    return fit_OK;
+}
+
+
+template <class Scalar>
+double PathTracker::make_window(const Centerline & centerline, double pos_x, double pos_y, double psi,
+                                WaypointBufferT<Scalar> & window, WaypointBufferT<Scalar> & car_pts,
+                                TelemetryRecord & record) {
+    const std::vector<double> & pts_x = centerline.pts_x;
+    const std::vector<double> & pts_y = centerline.pts_y;
+    window.resize(m_num_steps_poly);
+
+    if (m_window_pyramid) {
+        // As many points of each level in turn, from NUM_STEPS_BACK fine
+        // samples back: the near ones fine, the far ones coarse
+        const CenterlinePyramid & pyramid = centerline.pyramid;
+        size_t num_levels = pyramid.num_levels();
+        size_t per_level = (m_window_size + num_levels - 1) / num_levels;
+        double s = arc_length(centerline) - NUM_STEPS_BACK * pyramid.spacing(0);
+        if (!pyramid.closed())
+            s = std::max(s, 0.0);
+        size_t level = 0;
+        long index = pyramid.first_at(0, s);
+        for (size_t i=0; i < m_window_size; i++) {
+            if (i > 0 and i % per_level == 0 and level + 1 < num_levels) {
+                // Past the last point of the finer level
+                level++;
+                index = pyramid.first_at(level, (index + 1) * pyramid.spacing(level - 1));
+            } else if (i > 0) {
+                index++;
+            }
+            const CenterlinePyramid::Level & samples = pyramid.level(level);
+            size_t k = pyramid.wrap(level, index);
+            window.x[i] = Scalar(samples.x[k]);
+            window.y[i] = Scalar(samples.y[k]);
+        }
+        m_window_start = m_closest_idx;
+    } else if (m_spline_reference) {
+        // Evenly spaced samples of the smoothed path, with the same
+        // spacing (on average) and the same offset back as below, from the
+        // progress along the path when it's tracked
+        const PathSpline & spline = centerline.spline;
+        double waypoint_spacing = spline.length() / pts_x.size();
+        double spacing = m_window_stride * waypoint_spacing;
+        double s_closest = arc_length(centerline);
+        double s_start = s_closest - NUM_STEPS_BACK * waypoint_spacing;
+        for (size_t i=0; i < m_window_size; i++) {
+            double x, y;
+            spline.position(s_start + i * spacing, x, y);
+            window.x[i] = Scalar(x);
+            window.y[i] = Scalar(y);
+        }
+        m_window_start = m_closest_idx;
+    } else {
+        // It pays to use `NUM_STEPS_BACK` points for fitting the polynomial
+        // (stabilizes the polynomial)
+        m_window_start = m_closest_idx - NUM_STEPS_BACK;
+
+        // A strided span of the ring, or the points one by one around the
+        // path without it
+        const PaddedRing & ring = centerline.ring;
+        size_t span = (m_window_size - 1) * m_window_stride + 1;
+        if (ring.size() == pts_x.size() and ring.covers(m_window_start, span)) {
+            typedef Eigen::Map<const Eigen::ArrayXd, 0, Eigen::InnerStride<> > Span;
+            Eigen::InnerStride<> stride(m_window_stride);
+            window.x.head(m_window_size) = Span(ring.x(m_window_start), m_window_size, stride).cast<Scalar>();
+            window.y.head(m_window_size) = Span(ring.y(m_window_start), m_window_size, stride).cast<Scalar>();
+        } else {
+            int num_points = pts_x.size();
+            for (size_t i=0; i < m_window_size; i++) {
+                int idx = ((m_window_start + int(i*m_window_stride)) % num_points + num_points) % num_points;
+                window.x[i] = Scalar(pts_x[idx]);
+                window.y[i] = Scalar(pts_y[idx]);
+            }
+        }
+    }
+    for (size_t i=m_window_size; i < m_num_steps_poly; i++) {
+        window.x[i] = window.x[m_window_size - 1];
+        window.y[i] = window.y[m_window_size - 1];
+    }
+
+    // Before we get the actuators, we need to calculate points in car's
+    // coordinate system; these will be passed later on to polyfit
+    double fraction_steps_OK = 1.0;
+    to_car_frame(window, pos_x, pos_y, sin(psi), cos(psi), car_pts);
+
+    for (size_t i=m_poly_degree+1; i<m_window_size; i++) {
+        bool x_delta_too_low = (car_pts.x[i] - car_pts.x[i-1] < X_DELTA_MIN_VALUE);
+        if (x_delta_too_low) {
+            size_t num_steps_remaining = m_window_size-i+1;
+            fraction_steps_OK = 1.0 * (i+1) / m_window_size;
+            record.events |= TelemetryRecord::X_DELTA_TOO_LOW;
+            Trace::instant("x_delta_too_low", i);
+            record.x_delta_break = i;
+
+            // Fill out the rest of the points with fake waypoints
+            Scalar delta_x = car_pts.x[i-1] - car_pts.x[i-2];
+            Scalar delta_y = car_pts.y[i-1] - car_pts.y[i-2];
+            delta_x = delta_x / num_steps_remaining;
+            delta_y = delta_y / num_steps_remaining;
+
+            for (size_t sub_i=1; sub_i<num_steps_remaining; sub_i++) {
+                car_pts.x[i-1+sub_i] = car_pts.x[i-1] + sub_i * delta_x;
+                car_pts.y[i-1+sub_i] = car_pts.y[i-1] + sub_i * delta_y;
+            }
+
+            break;
+        }
+    }
+    return fraction_steps_OK;
+}
+
+
+void PathTracker::fit(const Centerline & centerline, double pos_x, double pos_y, double psi,
+                      Eigen::VectorXd & coeffs) {
+    // From the precomputed moments of the window or incrementally when they
+    // are the raw waypoints (consecutive ones, all `m_num_steps_poly` of
+    // them) and none had to be made up
+    if (m_window_fused) {
+        coeffs = m_fused_coeffs.head(m_poly_degree + 1);
+        return;
+    }
+    bool fit_OK = false;
+    bool raw_window = (!m_spline_reference and !m_window_pyramid and m_window_stride == 1
+                       and m_window_size == m_num_steps_poly and m_fraction_steps_OK == 1.0);
+    bool moments_OK = !centerline.window_moments.empty() and centerline.moments_degree == m_poly_degree
+            and centerline.moments_size == m_num_steps_poly;
+    if (m_precomputed_fit and raw_window and moments_OK) {
+        centerline.window_moments[m_closest_idx].fit(pos_x, pos_y, psi, coeffs);
+        fit_OK = true;
+    } else if (m_incremental_fit and raw_window) {
+        if (&centerline != m_fit_centerline) {
+            m_sliding_fit.reset();
+            m_fit_centerline = &centerline;
+        }
+        fit_OK = m_sliding_fit.fit(centerline.pts_x, centerline.pts_y, m_window_start, m_num_steps_poly,
+                                   m_poly_degree, pos_x, pos_y, psi, coeffs);
+    }
+    if (!fit_OK and m_float_window)
+        polyfit(m_window_car_f.x.data(), m_window_car_f.y.data(), m_window_size, m_poly_degree, coeffs);
+    else if (!fit_OK)
+        polyfit(m_window_car.x.data(), m_window_car.y.data(), m_window_size, m_poly_degree, coeffs);
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "CenterlinePyramid.h"
+#include "SpatialGrid.h"
+#include "CompactTrack.h"
+#include "PaddedRing.h"
+#include "SpeedProfile.h"
+#include "LapProgress.h"
+#include "PathSpline.h"
+#include "PathSegments.h"
+#include "SlidingPolyFit.h"
+#include "WindowMoments.h"
+#include "WaypointBuffer.h"
+#include "Telemetry.h"
+
+
+///* The waypoints of a window of the fit: every `stride`-th from the first,
+///* `size` of them
+struct WindowShape {
+    uint16_t stride;
+    uint16_t size;
+};
+
+
+///* The waypoints of the path to follow, and the structures derived from them
+///* (built once per path, by `PathTracker::prepare_centerline`)
+struct Centerline {
+    ///* Hash of the points, to tell a new path from a re-published one
+    uint64_t hash = 0;
+
+    ///* The hash of the path as published, and the version of the last
+    ///* patch applied to it (see `Params::centerline_patches`): 0 unless
+    ///* it's patched
+    uint64_t patched_from = 0;
+    uint32_t version = 0;
+
+    std::vector<double> pts_x;
+    std::vector<double> pts_y;
+
+    ///* The yaw [rad] and speed [m/s] recorded with the waypoints (only
+    ///* /centerline_numpy and the CSVs have them, empty otherwise)
+    std::vector<double> yaw;
+    std::vector<double> speed;
+
+    SpatialGrid grid;
+    PathSpline spline;
+    ///* The points in fixed point (empty unless `Params::compact_waypoints`)
+    CompactTrack compact;
+    ///* The points with copies past both ends (empty with a negative
+    ///* `Params::ring_margin`)
+    PaddedRing ring;
+    PathSegments segments;
+
+    ///* For every waypoint, the moments of the window of waypoints the
+    ///* polynomial is fit to when it's the first one (empty unless
+    ///* `Params::precomputed_fit`), and the fit they're for: its degree and
+    ///* the size of its window
+    std::vector<WindowMoments> window_moments;
+    size_t moments_degree = 0;
+    size_t moments_size = 0;
+
+    ///* For every waypoint, the shape of the window of the fit when it's the
+    ///* closest one (empty unless `Params::adaptive_window`), for windows of
+    ///* up to `shapes_size` waypoints
+    std::vector<WindowShape> window_shapes;
+    size_t shapes_size = 0;
+
+    ///* The reference speed along the path (empty unless
+    ///* `Params::speed_profile`)
+    SpeedProfile speed_profile;
+
+    ///* The room to the left and to the right of every waypoint [m] (empty
+    ///* unless `Params::corridor_width`)
+    std::vector<double> corridor_left;
+    std::vector<double> corridor_right;
+
+    ///* The path at several resolutions, with the corridor (empty unless
+    ///* `Params::pyramid_levels`)
+    CenterlinePyramid pyramid;
+};
+
+
+///* The path tracking of a tick, shared by the controllers (the MPC and the
+///* PID law, through ControlPipeline) and the offline tools: the closest
+///* waypoint to the car, the window of waypoints about it in the car's
+///* frame (with the points past any that would break the fit made up) and
+///* the polynomial fit to it, from which the cross track and the heading
+///* errors come. In that order, every tick:
+///*
+///*     int closest = tracker.closest_waypoint(centerline, x, y, record);
+///*     double fraction_OK = tracker.make_window(centerline, closest, x, y, psi, record);
+///*     tracker.fit(centerline, x, y, psi, coeffs);
+///*
+///* (or `contouring_reference` instead of `fit`, see
+///* `Params::contouring_reference`).
+///*
+///* Keeps what's carried from tick to tick (the tracked closest point or
+///* the progress along the path, the sliding fit) and the buffers that make
+///* a warmed-up tick allocation-free.
+class PathTracker {
+public:
+    PathTracker(const Params & params);
+
+    ///* Builds the structures derived from the waypoints of `centerline` for
+    ///* the fit of `params` (the grid and the spline unless they're built
+    ///* already); reads nothing of a PathTracker, so it's safe to call from
+    ///* another thread than the ticks'
+    static void prepare_centerline(Centerline & centerline, const Params & params);
+
+    ///* Takes the waypoints [first, first + count) of a prepared `centerline`
+    ///* in, replaced by as many others (see `Params::centerline_patches`):
+    ///* the spline is solved again about them only, and only the entries of
+    ///* the structures derived from it that they change are taken again
+    ///* (the grid, a counting sort, is built again). False when the spline
+    ///* can't be updated in place (see `PathSpline::update`) and the
+    ///* centerline was prepared from scratch instead
+    static bool patch_centerline(Centerline & centerline, size_t first, size_t count, const Params & params);
+
+    ///* Takes over the fit of `params` (`poly_degree` and `num_steps_poly`);
+    ///* the centerlines prepared for another fit are fit from scratch until
+    ///* they're prepared again
+    void reconfigure(const Params & params);
+
+    ///* Index of the waypoint closest to (pos_x, pos_y): from the progress
+    ///* along the path (`Params::lap_progress`), a search around the
+    ///* previous one (`Params::windowed_closest`) or of the whole path. The
+    ///* progress goes into `record`
+    int closest_waypoint(const Centerline & centerline, double pos_x, double pos_y, TelemetryRecord & record);
+
+    ///* Gathers the window of the fit about `closest_idx` (of the shape of
+    ///* `Centerline::window_shapes` with `Params::adaptive_window`) and takes
+    ///* it to the frame of the car at the pose, making up the points past any
+    ///* that would break the fit (see `X_DELTA_MIN_VALUE`); the fraction of
+    ///* the window that's real
+    double make_window(const Centerline & centerline, int closest_idx, double pos_x, double pos_y, double psi,
+                       TelemetryRecord & record);
+
+    ///* The polynomial (lowest order first) through the window of the last
+    ///* `make_window`, in the car's frame: from the precomputed moments of
+    ///* the window, incrementally as it slides along the path, in the pass
+    ///* that read it (`Params::fused_fit`), or fit to it
+    void fit(const Centerline & centerline, double pos_x, double pos_y, double psi, Eigen::VectorXd & coeffs);
+
+    ///* The contouring reference (see `ReferenceSample`) of `num_stages`
+    ///* stages of the time grid of `params` at `speed` [m/s] into `coeffs`:
+    ///* the spline of the path, in the frame of the car at the pose, from
+    ///* the car's arc length at the last `make_window` on. Nothing is fit,
+    ///* and `coeffs` isn't reallocated if it has the right size already
+    void contouring_reference(const Centerline & centerline, double pos_x, double pos_y, double psi, double speed,
+                              const Params & params, size_t num_stages, Eigen::VectorXd & coeffs) const;
+
+    ///* The waypoints of the last window, in the car's frame (converted on
+    ///* demand from a float window, or made from the path when the window
+    ///* was fused). The caller may swap their contents out
+    ///* (see Visualizer::push)
+    WaypointBuffer & car_pts();
+
+    ///* The progress along the path of the last pose tracked
+    const LapProgress & progress() const { return m_progress; }
+
+    ///* The arc length [m] along the path (as in `PathSpline::arc_length`)
+    ///* of the car at the last `make_window`: its progress when it's
+    ///* tracked, that of its projection on the path with
+    ///* `Params::projected_closest`, that of the closest waypoint otherwise
+    double arc_length(const Centerline & centerline) const;
+
+    ///* The bounds of the cross track error (cte, positive to the right of
+    ///* the path) of `num_stages` stages of the time grid of `params` at
+    ///* `speed` [m/s]: those of the corridor at the waypoint about as far
+    ///* along the path from the car (at the last `make_window`) as the
+    ///* stage. Walks from the car's waypoint, so it costs the waypoints of
+    ///* the horizon, whatever the length of the path; with
+    ///* `Params::pyramid_levels`, reads every stage off the level of the
+    ///* pyramid as fine as the stages are apart instead, a lookup each
+    void corridor(const Centerline & centerline, double speed, const Params & params, size_t num_stages,
+                  double * lower, double * upper) const;
+
+    size_t poly_degree() const { return m_poly_degree; }
+    size_t num_steps_poly() const { return m_num_steps_poly; }
+
+private:
+    ///* The entries of the waypoints [first, first + count) (past the last,
+    ///* from the first again) of the corridor, the window moments and the
+    ///* window shapes of `prepare_centerline`, sized already
+    static void prepare_corridor(Centerline & centerline, const Params & params, int first, int count);
+    static void prepare_window_moments(Centerline & centerline, int first, int count);
+    static void prepare_window_shapes(Centerline & centerline, const Params & params, int first, int count);
+    ///* The pyramid of `prepare_centerline`, and its corridor
+    static void prepare_pyramid(Centerline & centerline, const Params & params);
+
+    ///* The room on either side of the path [m] at `s` [m], by its
+    ///* curvature there
+    static void corridor_at(const PathSpline & spline, const Params & params, double s, double & left,
+                            double & right);
+
+    ///* Index of the waypoint closest to (pos_x, pos_y), from the spatial
+    ///* index of the centerline
+    int find_closest(const Centerline & centerline, double pos_x, double pos_y);
+
+    ///* Same result as `find_closest`, but only searches a window around the
+    ///* previous closest point (the path is treated as a closed loop), in
+    ///* `Centerline::compact` when there's one. Falls
+    ///* back to `find_closest` when the track is lost. With
+    ///* `Params::projected_closest`, the car is projected onto the segments
+    ///* of the window instead, and the waypoint is the nearer end of the
+    ///* segment of the nearest projection
+    int find_closest_tracked(const Centerline & centerline, double pos_x, double pos_y);
+
+    ///* The segment of the `count` from `first` on (the path is treated as a
+    ///* closed loop) with the projection of (pos_x, pos_y) nearest to it,
+    ///* see `PathSegments::project`
+    int project_segments(const Centerline & centerline, int first, int count, double pos_x, double pos_y,
+                         double & t, double & dist2);
+
+    template <class Scalar>
+    double make_window(const Centerline & centerline, double pos_x, double pos_y, double psi,
+                       WaypointBufferT<Scalar> & window, WaypointBufferT<Scalar> & car_pts,
+                       TelemetryRecord & record);
+
+    ///* With `Params::fused_fit`, fits the window of the last `make_window`
+    ///* straight from the span of `Centerline::ring` into `m_fused_coeffs`;
+    ///* false where it can't (the window isn't a span of the ring, another
+    ///* fit takes it, or a point would break the fit)
+    bool fused_fit(const Centerline & centerline, double pos_x, double pos_y, double psi);
+
+    size_t m_poly_degree;
+    size_t m_num_steps_poly;
+
+    ///* Tracking of the closest point, on the path of `Centerline::hash`
+    ///* and `Centerline::version`
+    bool m_windowed_closest;
+    uint64_t m_tracked_hash;
+    uint32_t m_tracked_version;
+    int m_tracked_idx;
+
+    ///* ... projected onto the segments: the segment of the last tick and
+    ///* the fraction along it, if it was, and the projections of the window
+    bool m_projected_closest;
+    bool m_projection_OK;
+    int m_projected_segment;
+    double m_projected_t;
+    Eigen::ArrayXd m_projection_t;
+    Eigen::ArrayXd m_projection_dist2;
+
+    ///* Tracking of the progress along the path, which replaces it
+    bool m_lap_progress;
+    LapProgress m_progress;
+    bool m_progress_OK;
+
+    ///* Fit the polynomial to samples of `Centerline::spline` instead of to
+    ///* the raw waypoints
+    bool m_spline_reference;
+
+    ///* Sliding-window fit of the polynomial, and the path it slides along
+    bool m_incremental_fit;
+    SlidingPolyFit m_sliding_fit;
+    const Centerline * m_fit_centerline;
+
+    ///* Fit the polynomial from `Centerline::window_moments`
+    bool m_precomputed_fit;
+
+    ///* Fit the polynomial in the pass that reads the window (see
+    ///* `polyfit_transformed`), whether the last window was, its fit, and
+    ///* its path and pose (to make its points on demand, see `car_pts`)
+    bool m_fused_fit;
+    bool m_window_fused;
+    Eigen::Vector4d m_fused_coeffs;
+    const Centerline * m_fused_centerline;
+    double m_fused_pose[3];
+
+    ///* Shape the window by `Centerline::window_shapes`
+    bool m_adaptive_window;
+
+    ///* Take the window from the levels of `Centerline::pyramid` (see
+    ///* `Params::pyramid_levels`), and whether the last window was
+    bool m_pyramid;
+    bool m_window_pyramid;
+
+    ///* The last window: the closest waypoint and the first one of the
+    ///* window (of the raw waypoints), and the fraction of it that's real
+    int m_closest_idx;
+    int m_window_start;
+    double m_fraction_steps_OK;
+    ///* ... the stride between its waypoints and their number (the buffers
+    ///* keep `m_num_steps_poly`, the rest repeating the last)
+    size_t m_window_stride;
+    size_t m_window_size;
+
+    ///* Scratch buffers, kept to reuse their storage: the window of waypoints
+    ///* the polynomial is fit to (in the world and the car's frame)
+    WaypointBuffer m_window_world;
+    WaypointBuffer m_window_car;
+    ///* ... or in float (see `Params::precision`), and whether `m_window_car`
+    ///* is up to date with them
+    bool m_float_window;
+    WaypointBufferF m_window_world_f;
+    WaypointBufferF m_window_car_f;
+    bool m_car_pts_OK;
+
+    ///* When fitting a degree=3 polynomial to the waypoints we're using
+    ///* (STEPS_POLY * 3) points ahead to fit it (impacts smoothness)
+    static constexpr int STEP_POLY = 1;
+
+    ///* If you see: "coeffs: nan   nan   nan   nan" in the logger,
+    ///* it means that polyfit was unable to fit a polynomial which
+    ///* may be caused by the `X_DELTA_MIN_VALUE` being too low
+    static constexpr double X_DELTA_MIN_VALUE = 0.001;
+
+    static constexpr int NUM_STEPS_BACK = 5;
+
+    ///* With `Params::adaptive_window`: the window of a waypoint is cut
+    ///* short where the path turns by more than `MAX_WINDOW_TURN` [rad] over
+    ///* it (but keeps two points per coefficient), and where it turns by
+    ///* less than `STRAIGHT_WINDOW_TURN` [rad] it takes every
+    ///* `MAX_WINDOW_STRIDE`-th waypoint of the same stretch
+    static constexpr double MAX_WINDOW_TURN = M_PI / 3;
+    static constexpr double STRAIGHT_WINDOW_TURN = 0.1;
+    static constexpr size_t MAX_WINDOW_STRIDE = 4;
+
+    ///* Number of points searched on each side of the previous closest point,
+    ///* and the distance from it beyond which we consider the track lost
+    ///* (e.g. the particle filter relocalized the car)
+    static constexpr int CLOSEST_WINDOW = 50;
+    static constexpr double TRACK_LOST_DISTANCE = 1.0; // [m]
+
+    ///* A path whose ends are closer than this many times the mean spacing of
+    ///* its waypoints is considered closed
+    static constexpr double CLOSED_PATH_GAP = 3.0;
+
+    ///* The corridor keeps this fraction of the radius of a turn from its
+    ///* center (as RacelineNLP)
+    static constexpr double TURN_CENTER_MARGIN = 0.1;
+};
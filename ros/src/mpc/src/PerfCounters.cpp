@@ -0,0 +1,130 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "PerfCounters.h"
+#include "Log.h"
+
+
+constexpr int PerfCounters::NUM_EVENTS;
+
+
+PerfCounts & PerfCounts::operator+=(const PerfCounts & other) {
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cache_misses += other.cache_misses;
+    branch_misses += other.branch_misses;
+    return *this;
+}
+
+
+PerfCounts operator-(const PerfCounts & end, const PerfCounts & start) {
+    PerfCounts counts;
+    counts.cycles = end.cycles - start.cycles;
+    counts.instructions = end.instructions - start.instructions;
+    counts.cache_misses = end.cache_misses - start.cache_misses;
+    counts.branch_misses = end.branch_misses - start.branch_misses;
+    return counts;
+}
+
+
+double thread_cpu_time() {
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+        return 0.0;
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+
+// In the order of PerfCounts
+static const uint64_t EVENTS[] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+
+static int open_event(uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group_fd < 0) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // This thread, on any CPU
+    return int(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+
+PerfCounters::PerfCounters() {
+    for (int & fd : m_fds)
+        fd = -1;
+    for (int e=0; e < NUM_EVENTS; e++) {
+        m_fds[e] = open_event(EVENTS[e], m_fds[0]);
+        if (m_fds[e] < 0) {
+            int error = errno;
+            static std::atomic<bool> warned(false);
+            if (!warned.exchange(true)) {
+                if (error == EACCES or error == EPERM)
+                    MPC_WARN("Not allowed to open the hardware performance counters (%s): they need "
+                             "/proc/sys/kernel/perf_event_paranoid at 2 or less, or CAP_PERFMON",
+                             std::strerror(error));
+                else
+                    MPC_WARN("Could not open the hardware performance counters (%s): the stages won't be counted",
+                             std::strerror(error));
+            }
+            for (int & fd : m_fds) {
+                if (fd >= 0)
+                    close(fd);
+                fd = -1;
+            }
+            return;
+        }
+    }
+    ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+
+PerfCounters::~PerfCounters() {
+    for (int fd : m_fds)
+        if (fd >= 0)
+            close(fd);
+}
+
+
+PerfCounters & PerfCounters::thread() {
+    thread_local PerfCounters counters;
+    return counters;
+}
+
+
+PerfCounts PerfCounters::read() const {
+    PerfCounts counts;
+    if (!available())
+        return counts;
+
+    // PERF_FORMAT_GROUP: the number of events, the times the group was
+    // enabled and ran, and the values
+    uint64_t data[3 + NUM_EVENTS];
+    if (::read(m_fds[0], data, sizeof(data)) != ssize_t(sizeof(data)) or data[0] != NUM_EVENTS)
+        return counts;
+    uint64_t enabled = data[1], running = data[2];
+    if (running == 0)
+        return counts;
+    uint64_t values[NUM_EVENTS];
+    for (int e=0; e < NUM_EVENTS; e++)
+        values[e] = (running < enabled) ? uint64_t(double(data[3 + e]) * enabled / running) : data[3 + e];
+    counts.cycles = values[0];
+    counts.instructions = values[1];
+    counts.cache_misses = values[2];
+    counts.branch_misses = values[3];
+    return counts;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+
+///* Hardware counts of a stretch of code (see `Params::perf_counters`), all
+///* zero when they weren't counted
+struct PerfCounts {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0;
+    uint64_t branch_misses = 0;
+
+    ///* Instructions per cycle (0 without cycles)
+    double ipc() const { return cycles > 0 ? double(instructions) / cycles : 0.0; }
+
+    PerfCounts & operator+=(const PerfCounts & other);
+};
+
+PerfCounts operator-(const PerfCounts & end, const PerfCounts & start);
+
+
+///* The CPU time [s] the calling thread has run for (CLOCK_THREAD_CPUTIME_ID,
+///* read through the vDSO on most kernels): unlike the wall time of a
+///* stage, it leaves out the time the thread was preempted or waited (see
+///* `Params::cpu_time`)
+double thread_cpu_time();
+
+
+///* The hardware performance counters of the calling thread: the cycles, the
+///* instructions, the last level cache misses and the mispredicted branches,
+///* opened with perf_event_open(2) as one group, so that they're scheduled
+///* (and multiplexed, when the PMU runs short) together and read with a
+///* single syscall, their counts scaled up by the time they ran.
+///*
+///* User space only, which perf_event_paranoid allows up to 2 (the default
+///* of most distributions). They count the thread that opened them, so each
+///* thread has its own (see `thread`): the solver loop's stages are counted,
+///* not the pool threads working for it.
+class PerfCounters {
+public:
+    ///* The counters of the calling thread, opened on its first call; when
+    ///* they can't be (no PMU, as in most virtual machines, or not allowed)
+    ///* it's logged once, and they read zeros
+    static PerfCounters & thread();
+
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters & operator=(const PerfCounters &) = delete;
+
+    bool available() const { return m_fds[0] >= 0; }
+
+    ///* The counts since they were opened
+    PerfCounts read() const;
+
+private:
+    PerfCounters();
+
+    static constexpr int NUM_EVENTS = 4;
+
+    ///* The group leader (the cycles) first
+    int m_fds[NUM_EVENTS];
+};
@@ -0,0 +1,99 @@
+#include <cmath>
+#include <algorithm>
+
+#include "PlanFollower.h"
+
+
+constexpr double PlanFollower::MAX_DISTANCE;
+
+
+bool plan_inputs_at(const Plan & plan, double time, double & steer_angle, double & speed) {
+    size_t num_points = plan.time.size();
+    double elapsed = time - plan.stamp;
+    if (!plan.OK or num_points < 2 or elapsed > plan.time.back())
+        return false;
+
+    // The stage the time is in, by bisection (the times are increasing)
+    size_t i = size_t(std::upper_bound(plan.time.begin(), plan.time.end(), elapsed) - plan.time.begin());
+    i = std::min(std::max(i, size_t(1)), num_points - 1) - 1;
+    double step_time = plan.time[i + 1] - plan.time[i];
+    double a = (step_time > 0.0) ? std::min(std::max((elapsed - plan.time[i]) / step_time, 0.0), 1.0) : 0.0;
+    steer_angle = plan.steer_angle[i] + a * (plan.steer_angle[i + 1] - plan.steer_angle[i]);
+    speed = plan.speed[i] + a * (plan.speed[i + 1] - plan.speed[i]);
+    return true;
+}
+
+
+PlanFollower::PlanFollower(const Params & params)
+        : m_pid(params), m_max_steer(0.017453 * delta_constraint()) {}
+
+
+void PlanFollower::set_plan(Plan & plan) {
+    std::swap(m_plan, plan);
+    m_pid.reset();
+}
+
+
+bool PlanFollower::command(double pos_x, double pos_y, double psi, double now, double & steer_angle,
+                           double & speed) {
+    size_t num_points = m_plan.x.size();
+    if (!m_plan.OK or num_points < 2 or now - m_plan.stamp > m_plan.time.back())
+        return false;
+
+    // The segment with the nearest projection
+    size_t best = 0;
+    double best_dist2 = -1.0;
+    for (size_t i=0; i + 1 < num_points; i++) {
+        double seg_x = m_plan.x[i + 1] - m_plan.x[i];
+        double seg_y = m_plan.y[i + 1] - m_plan.y[i];
+        double rel_x = pos_x - m_plan.x[i];
+        double rel_y = pos_y - m_plan.y[i];
+        double length2 = seg_x * seg_x + seg_y * seg_y;
+        double t = (length2 > 0.0) ? std::min(std::max((rel_x * seg_x + rel_y * seg_y) / length2, 0.0), 1.0) : 0.0;
+        double diff_x = rel_x - t * seg_x;
+        double diff_y = rel_y - t * seg_y;
+        double dist2 = diff_x * diff_x + diff_y * diff_y;
+        if (best_dist2 < 0.0 or dist2 < best_dist2) {
+            best = i;
+            best_dist2 = dist2;
+        }
+    }
+    if (best_dist2 > MAX_DISTANCE * MAX_DISTANCE)
+        return false;
+
+    double seg_x = m_plan.x[best + 1] - m_plan.x[best];
+    double seg_y = m_plan.y[best + 1] - m_plan.y[best];
+    double length = std::hypot(seg_x, seg_y);
+    double heading = std::atan2(seg_y, seg_x);
+
+    // The errors as those of the MPC's state: the path's offset from the
+    // car (the car's to the left of it, negated) and the heading of the
+    // car from the path's
+    double offset = (length > 0.0)
+            ? (seg_x * (pos_y - m_plan.y[best]) - seg_y * (pos_x - m_plan.x[best])) / length : 0.0;
+    double cte = -offset;
+    double epsi = std::remainder(psi - heading, 2 * M_PI);
+    m_pid.update(cte, epsi);
+
+    // The curvature from the turn to the next segment (or from the previous
+    // one, on the last), over the mean of their lengths
+    size_t a = (best + 2 < num_points) ? best : best - std::min(best, size_t(1));
+    double curvature = 0.0;
+    if (a + 2 < num_points) {
+        double next_x = m_plan.x[a + 2] - m_plan.x[a + 1];
+        double next_y = m_plan.y[a + 2] - m_plan.y[a + 1];
+        double prev_x = m_plan.x[a + 1] - m_plan.x[a];
+        double prev_y = m_plan.y[a + 1] - m_plan.y[a];
+        double mean_length = 0.5 * (std::hypot(next_x, next_y) + std::hypot(prev_x, prev_y));
+        if (mean_length > 0.0)
+            curvature = std::remainder(std::atan2(next_y, next_x) - std::atan2(prev_y, prev_x), 2 * M_PI)
+                        / mean_length;
+    }
+
+    // psi' = -v delta / Lf in the model: a turn to the left is a negative
+    // angle
+    steer_angle = std::min(std::max(-Lf() * curvature + m_pid.steer(), -m_max_steer), m_max_steer);
+    double step_time = m_plan.time[best + 1] - m_plan.time[best];
+    speed = (step_time > 0.0) ? length / step_time : 0.0;
+    return true;
+}
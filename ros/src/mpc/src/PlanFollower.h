@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "MPC.h"
+#include "PIDController.h"
+
+
+///* A plan of the MPC, in the world frame, as the fast tracking loop follows
+///* it (see `Params::tracking_rate`) and as it's published (see
+///* `Params::publish_plan`)
+struct Plan {
+    ///* There's one to follow: the tick that made it was solved, with go
+    bool OK = false;
+
+    ///* When [s] it starts, on the clock of the stamps of the inputs, and
+    ///* the (latency-projected) pose it starts from
+    double stamp = 0.0;
+    double pos_x = 0.0;
+    double pos_y = 0.0;
+    double psi = 0.0;
+
+    ///* The predicted positions, from the pose's on, and the time [s] from
+    ///* `stamp` of each of them
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> time;
+
+    ///* The rest of the state and the inputs of every stage, by the
+    ///* kinematic model from the positions (exactly those of the solution
+    ///* with it): the heading [rad], and the speed [m/s] and the steering
+    ///* angle [rad] from it to the next stage (the last stage repeats those
+    ///* of the one before)
+    std::vector<double> heading;
+    std::vector<double> speed;
+    std::vector<double> steer_angle;
+};
+
+
+///* The inputs of `plan` at `time` [s] (on the clock of its stamp): the
+///* steering angle [rad] and the speed [m/s], linear between those of its
+///* stages, and those of the first before it starts. False without a plan,
+///* or once it's run out by then
+bool plan_inputs_at(const Plan & plan, double time, double & steer_angle, double & speed);
+
+
+///* The inner loop of the multi-rate controller: between two solves of the
+///* MPC, steers along its latest plan at a higher rate than the solves.
+///*
+///* The car is projected onto the segment of the plan nearest to it; the
+///* steering angle is that of the curvature of the plan there (by the
+///* kinematic model), corrected by the PID law (with the gains of
+///* `Params::pid_kp_cte` ...) on the cross track and the heading errors from
+///* the segment, and the speed is the plan's along the segment. The PID
+///* law's errors are its own, and restart with every plan.
+class PlanFollower {
+public:
+    PlanFollower(const Params & params);
+
+    ///* Follows `plan` from now on (swaps its contents in, `plan` gets the
+    ///* previous ones back)
+    void set_plan(Plan & plan);
+
+    ///* The commands for the car at the pose at `now` [s] (on the clock of
+    ///* the stamps): the steering angle [rad] and the speed [m/s]. False,
+    ///* when there's no plan, it's run out by then, or the car is farther
+    ///* than `MAX_DISTANCE` from it: the solver's commands stand
+    bool command(double pos_x, double pos_y, double psi, double now, double & steer_angle, double & speed);
+
+    ///* Farthest the car may be from the plan [m]
+    static constexpr double MAX_DISTANCE = 0.5;
+
+private:
+    Plan m_plan;
+    PIDController m_pid;
+    double m_max_steer;
+};
@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <cmath>
+
+#include "PlanValidator.h"
+
+
+PlanValidator::PlanValidator(const Params & params, size_t max_steps_ahead, double speed_upperbound)
+        : m_max_steer(0.017453 * delta_constraint()), m_speed_upperbound(speed_upperbound), m_tolerance(params.validate_plan_tolerance),
+          m_corridor(!params.contouring_reference), m_cte(max_steps_ahead)
+{
+}
+
+
+bool PlanValidator::valid(const std::vector<double> & vars, const Eigen::VectorXd & coeffs,
+                          const std::vector<double> & cte_lower, const std::vector<double> & cte_upper) {
+    Eigen::Map<const Eigen::ArrayXd> all(vars.data(), Eigen::Index(vars.size()));
+    if (vars.size() < 2 or !all.allFinite())
+        return false;
+    double steer = vars[0];
+    double speed = vars[1];
+    if (std::abs(steer) > m_max_steer + 1e-9 or speed < -1e-9 or speed > m_speed_upperbound + 1e-9)
+        return false;
+
+    // The positions after the first, strided over the (x, y) pairs
+    size_t num_positions = (vars.size() - 2) / 2;
+    size_t n = std::min(std::min(num_positions, cte_lower.size()), size_t(m_cte.size()));
+    if (!m_corridor or n < 2 or coeffs.size() == 0)
+        return true;
+    typedef Eigen::Map<const Eigen::ArrayXd, 0, Eigen::InnerStride<2> > Strided;
+    Strided x(vars.data() + 4, Eigen::Index(n - 1));
+    Strided y(vars.data() + 5, Eigen::Index(n - 1));
+
+    auto cte = m_cte.head(n - 1);
+    cte.setConstant(coeffs[coeffs.size() - 1]);
+    for (Eigen::Index i = coeffs.size() - 2; i >= 0; i--)
+        cte = cte * x + coeffs[i];
+    cte -= y;
+
+    Eigen::Map<const Eigen::ArrayXd> lower(cte_lower.data() + 1, Eigen::Index(n - 1));
+    Eigen::Map<const Eigen::ArrayXd> upper(cte_upper.data() + 1, Eigen::Index(n - 1));
+    return (cte >= lower - m_tolerance).all() and (cte <= upper + m_tolerance).all();
+}
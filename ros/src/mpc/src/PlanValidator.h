@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+///* The check of a plan before it's published (see `Params::validate_plan`):
+///* a solve cut short, or one that failed, can still return a trajectory
+///* that leaves the track, and this catches it in a few microseconds.
+///*
+///* A plan (the result of `MPC::Solve`) is valid when it's finite, its
+///* actuations are within the actuators' range, and every predicted
+///* position but the first (the car's, which may be out already) is within
+///* the corridor of its step, by `validate_plan_tolerance` [m]. The
+///* corridor is that of the tick's problem (see `PathTracker::corridor`),
+///* and a position's cross track error is f(x) - y of the polynomial
+///* reference, evaluated for all of them at once (strided over the plan, by
+///* Horner), so only with the polynomial reference; the actuations are
+///* checked either way. Nothing is allocated.
+class PlanValidator {
+public:
+    ///* For plans of up to `max_steps_ahead` steps in the corridor, longer
+    ///* ones being checked over those only
+    PlanValidator(const Params & params, size_t max_steps_ahead, double speed_upperbound);
+
+    bool valid(const std::vector<double> & vars, const Eigen::VectorXd & coeffs,
+               const std::vector<double> & cte_lower, const std::vector<double> & cte_upper);
+
+private:
+    double m_max_steer;
+    double m_speed_upperbound;
+    double m_tolerance;
+    bool m_corridor;
+
+    ///* The cross track errors of the positions
+    Eigen::ArrayXd m_cte;
+};
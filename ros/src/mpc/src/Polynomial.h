@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+
+
+///* Coefficients of a polynomial of degree `Degree`, lowest order first
+template <int Degree>
+using PolyCoeffs = Eigen::Matrix<double, Degree + 1, 1>;
+
+
+///* Least-squares fit of a polynomial of degree `Degree` to n points, with all
+///* of the storage on the stack: the normal equations only need the power
+///* sums of x (up to x^(2 Degree)) and the moments of y, so the Vandermonde
+///* matrix is never built, and the (Degree + 1) x (Degree + 1) system is
+///* solved with LDLT.
+///*
+///* The normal equations square the condition number of the fit, which is
+///* fine for the low degrees and the few-metre spans (in the car's frame)
+///* that the controller uses, but not in float: the sums are accumulated in
+///* double whatever the `Scalar` of the points.
+template <int Degree, class Scalar>
+PolyCoeffs<Degree> polyfit_fixed(const Scalar * xvals, const Scalar * yvals, size_t n) {
+    static_assert(Degree >= 1, "polyfit_fixed needs a degree of at least 1");
+
+    Eigen::Matrix<double, 2 * Degree + 1, 1> power_sums = Eigen::Matrix<double, 2 * Degree + 1, 1>::Zero();
+    PolyCoeffs<Degree> moments = PolyCoeffs<Degree>::Zero();
+    for (size_t i=0; i < n; i++) {
+        double x = xvals[i], y = yvals[i];
+        double power = 1.0;
+        for (int k=0; k <= 2 * Degree; k++) {
+            power_sums[k] += power;
+            if (k <= Degree)
+                moments[k] += power * y;
+            power *= x;
+        }
+    }
+
+    Eigen::Matrix<double, Degree + 1, Degree + 1> normal;
+    for (int r=0; r <= Degree; r++)
+        for (int c=0; c <= Degree; c++)
+            normal(r, c) = power_sums[r + c];
+
+    return normal.ldlt().solve(moments);
+}
+
+
+///* `polyfit_fixed` of `count` problems of n points each at once, LANES of
+///* them side by side: the power sums and the moments of a block of them
+///* are arrays of LANES (packed SIMD), and so is every step of their LDLT
+///* (without pivoting: the x of each problem have to span at least Degree +
+///* 1 distinct values). The points are interleaved, point i of problem p at
+///* [i * count + p] of `xvals` and `yvals`, so that those of a block are
+///* loaded together; the coefficients of problem p (lowest order first) go
+///* to [p * (Degree + 1)] of `coeffs` on
+template <int Degree, class Scalar>
+void polyfit_fixed_batch(const Scalar * xvals, const Scalar * yvals, size_t n, size_t count, double * coeffs) {
+    static_assert(Degree >= 1, "polyfit_fixed_batch needs a degree of at least 1");
+    constexpr int LANES = 8;
+    typedef Eigen::Array<double, LANES, 1> Lanes;
+    typedef Eigen::Array<Scalar, LANES, 1> ScalarLanes;
+
+    for (size_t first=0; first < count; first += LANES) {
+        // The last block is padded with a copy of its first problem
+        size_t lanes = std::min(count - first, size_t(LANES));
+        Lanes power_sums[2 * Degree + 1];
+        Lanes moments[Degree + 1];
+        for (int k=0; k <= 2 * Degree; k++)
+            power_sums[k].setZero();
+        for (int k=0; k <= Degree; k++)
+            moments[k].setZero();
+        for (size_t i=0; i < n; i++) {
+            Lanes x, y;
+            if (lanes == LANES) {
+                x = Eigen::Map<const ScalarLanes>(xvals + i * count + first).template cast<double>();
+                y = Eigen::Map<const ScalarLanes>(yvals + i * count + first).template cast<double>();
+            } else {
+                for (size_t l=0; l < LANES; l++) {
+                    size_t p = first + (l < lanes ? l : 0);
+                    x[l] = double(xvals[i * count + p]);
+                    y[l] = double(yvals[i * count + p]);
+                }
+            }
+            Lanes power = Lanes::Ones();
+            for (int k=0; k <= 2 * Degree; k++) {
+                power_sums[k] += power;
+                if (k <= Degree)
+                    moments[k] += power * y;
+                power *= x;
+            }
+        }
+
+        // LDLT of the normal matrix (of power_sums[r + c]), then the
+        // substitutions, all lanes at once
+        Lanes L[Degree + 1][Degree + 1];
+        Lanes D[Degree + 1];
+        for (int j=0; j <= Degree; j++) {
+            D[j] = power_sums[2 * j];
+            for (int k=0; k < j; k++)
+                D[j] -= L[j][k] * L[j][k] * D[k];
+            for (int i = j + 1; i <= Degree; i++) {
+                L[i][j] = power_sums[i + j];
+                for (int k=0; k < j; k++)
+                    L[i][j] -= L[i][k] * L[j][k] * D[k];
+                L[i][j] /= D[j];
+            }
+        }
+        Lanes z[Degree + 1];
+        for (int i=0; i <= Degree; i++) {
+            z[i] = moments[i];
+            for (int k=0; k < i; k++)
+                z[i] -= L[i][k] * z[k];
+        }
+        for (int i=0; i <= Degree; i++)
+            z[i] /= D[i];
+        for (int i = Degree; i >= 0; i--)
+            for (int k = i + 1; k <= Degree; k++)
+                z[i] -= L[k][i] * z[k];
+
+        for (size_t l=0; l < lanes; l++)
+            for (int k=0; k <= Degree; k++)
+                coeffs[(first + l) * (Degree + 1) + k] = z[k][l];
+    }
+}
+
+
+///* The fit of `polyfit_fixed` to n world points, every `stride`-th one of
+///* `xvals` and `yvals`, taken to the frame of a car at (pos_x, pos_y) with
+///* heading psi on the way (as `to_car_frame`): a single pass over them,
+///* with the transform and the sums in registers, and no buffer of the
+///* points in either frame.
+///*
+///* False, with `coeffs` left as they were, when x in the car's frame grows
+///* by less than `min_x_delta` from a point to the next past the first
+///* Degree + 1 (where the caller makes up the rest of the window instead)
+template <int Degree>
+bool polyfit_transformed(const double * xvals, const double * yvals, size_t n, size_t stride,
+                         double pos_x, double pos_y, double sin_psi, double cos_psi, double min_x_delta,
+                         PolyCoeffs<Degree> & coeffs) {
+    static_assert(Degree >= 1, "polyfit_transformed needs a degree of at least 1");
+
+    Eigen::Matrix<double, 2 * Degree + 1, 1> power_sums = Eigen::Matrix<double, 2 * Degree + 1, 1>::Zero();
+    PolyCoeffs<Degree> moments = PolyCoeffs<Degree>::Zero();
+    double previous_x = 0.0;
+    for (size_t i=0; i < n; i++) {
+        double dx = xvals[i * stride] - pos_x, dy = yvals[i * stride] - pos_y;
+        double x = dx * cos_psi + dy * sin_psi;
+        double y = dy * cos_psi - dx * sin_psi;
+        if (i > size_t(Degree) and x - previous_x < min_x_delta)
+            return false;
+        previous_x = x;
+
+        double power = 1.0;
+        for (int k=0; k <= 2 * Degree; k++) {
+            power_sums[k] += power;
+            if (k <= Degree)
+                moments[k] += power * y;
+            power *= x;
+        }
+    }
+
+    Eigen::Matrix<double, Degree + 1, Degree + 1> normal;
+    for (int r=0; r <= Degree; r++)
+        for (int c=0; c <= Degree; c++)
+            normal(r, c) = power_sums[r + c];
+
+    coeffs = normal.ldlt().solve(moments);
+    return true;
+}
+
+
+///* Value and first derivative of the polynomial at x, in one Horner pass
+template <int Degree>
+void polyeval_fixed(const PolyCoeffs<Degree> & coeffs, double x, double & value, double & derivative) {
+    value = coeffs[Degree];
+    derivative = 0.0;
+    for (int i = Degree - 1; i >= 0; i--) {
+        derivative = derivative * x + value;
+        value = value * x + coeffs[i];
+    }
+}
+
+
+///* The polynomial of the `n` coefficients of `coeffs` from `first` (lowest
+///* order first) and its derivative at x, in one pass of Horner's scheme
+///* (as `polyeval_with_diff`). `Scalar` is double, or CppAD's AD in the
+///* FG_evals, whose tapes then get two multiplications and two additions
+///* per coefficient instead of the powers of x, again for the derivative
+template <class Vector, class Scalar>
+void horner_with_diff(const Vector & coeffs, size_t first, size_t n, const Scalar & x,
+                      Scalar & value, Scalar & derivative) {
+    value = Scalar(0);
+    derivative = Scalar(0);
+    if (n == 0)
+        return;
+    value = coeffs[first + n - 1];
+    for (size_t i = n - 1; i-- > 0; ) {
+        derivative = derivative * x + value;
+        value = value * x + coeffs[first + i];
+    }
+}
+
+
+///* x * x: one multiplication on a tape, where CppAD::pow(x, 2) goes
+///* through its integer power
+template <class Scalar>
+inline Scalar square(const Scalar & x) {
+    return x * x;
+}
@@ -0,0 +1,52 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "PowerRail.h"
+#include "Log.h"
+
+
+PowerRail::~PowerRail() {
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+
+bool PowerRail::open(const std::string & path, double scale) {
+    if (m_fd >= 0)
+        close(m_fd);
+    m_scale = scale;
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        MPC_WARN("Could not open the power rail %s (%s): the energy of the ticks won't be measured", path.c_str(),
+                 std::strerror(errno));
+        return false;
+    }
+    if (read() < 0.0) {
+        MPC_WARN("Could not read the power rail %s: the energy of the ticks won't be measured", path.c_str());
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+
+double PowerRail::read() const {
+    if (m_fd < 0)
+        return -1.0;
+    // sysfs files are read again from their start
+    char text[32];
+    ssize_t size = pread(m_fd, text, sizeof(text) - 1, 0);
+    if (size <= 0)
+        return -1.0;
+    text[size] = '\0';
+    char * end;
+    long long value = std::strtoll(text, &end, 10);
+    if (end == text)
+        return -1.0;
+    return m_scale * value;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+
+///* The power drawn by the board, from a sensor of its power rail exposed in
+///* sysfs (see `Params::power_rail`): a hwmon `power1_input` [uW], or the
+///* `in_power0_input` [mW] of the INA3221 of a Jetson, whose unit is
+///* `scale` [W]. The file stays open and is read from its start on each
+///* `read`, a syscall that doesn't allocate, on the solver loop.
+///*
+///* The sensor averages over its own window (a few ms), and it's the whole
+///* rail's: a tick's energy is an estimate of what the board drew while the
+///* tick ran, which the other processes share in.
+class PowerRail {
+public:
+    PowerRail() : m_fd(-1), m_scale(1.0) {}
+    ~PowerRail();
+    PowerRail(const PowerRail &) = delete;
+    PowerRail & operator=(const PowerRail &) = delete;
+
+    ///* Opens the sensor at `path`; false (and logs why) if it can't be read
+    bool open(const std::string & path, double scale);
+
+    bool is_open() const { return m_fd >= 0; }
+
+    ///* The power [W] the sensor reports now, negative when it can't be read
+    double read() const;
+
+private:
+    int m_fd;
+    double m_scale;
+};
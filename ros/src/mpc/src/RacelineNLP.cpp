@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/AutoDiff"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "RacelineNLP.h"
+#include "MPC.h"
+
+
+const size_t RacelineNLP::STAGE_CONSTRAINTS;
+const size_t RacelineNLP::STAGE_JACOBIAN;
+const size_t RacelineNLP::STAGE_HESSIAN;
+constexpr double RacelineNLP::STEER_CHANGE_WEIGHT;
+constexpr double RacelineNLP::ACCEL_CHANGE_WEIGHT;
+constexpr double RacelineNLP::MIN_SPEED;
+constexpr double RacelineNLP::MAX_HEADING;
+constexpr double RacelineNLP::TURN_CENTER_MARGIN;
+constexpr size_t RacelineNLP::CHUNK_STAGES;
+
+
+// The scalars of the stages on AutoDiff, as in KinematicModel: first order
+// over the variables of a stage, and second order
+typedef Eigen::AutoDiffScalar<Eigen::Matrix<double, RacelineNLP::STAGE_VARS, 1> > Stage1;
+typedef Eigen::AutoDiffScalar<Eigen::Matrix<Stage1, RacelineNLP::STAGE_VARS, 1> > Stage2;
+
+
+RacelineNLP::RacelineNLP(const PathSpline & centerline, size_t num_stages, const RacelineLimits & limits,
+                         Eigen::ThreadPoolInterface * pool)
+        : m_num_stages(num_stages), m_step(centerline.length() / num_stages), m_limits(limits), m_pool(pool),
+          m_curvature(num_stages), m_offset_lower(num_stages), m_offset_upper(num_stages),
+          m_x(num_stages * STAGE_VARS, 0.0), m_status(Ipopt::UNASSIGNED), m_iterations(0),
+          m_partial((num_stages + CHUNK_STAGES - 1) / CHUNK_STAGES, 0.0), m_pending(0)
+{
+    assert(num_stages >= 3);
+    for (size_t k=0; k < num_stages; k++) {
+        double curvature = centerline.curvature(station(k));
+        m_curvature[k] = curvature;
+        // 1 - n kappa stays positive: the car doesn't reach the center of
+        // the turn (on its inside, to the left of a left turn)
+        m_offset_lower[k] = -limits.half_width;
+        m_offset_upper[k] = limits.half_width;
+        if (curvature > 0.0)
+            m_offset_upper[k] = std::min(m_offset_upper[k], (1.0 - TURN_CENTER_MARGIN) / curvature);
+        else if (curvature < 0.0)
+            m_offset_lower[k] = std::max(m_offset_lower[k], (1.0 - TURN_CENTER_MARGIN) / curvature);
+    }
+    set_start(std::vector<double>(num_stages, MIN_SPEED));
+}
+
+
+void RacelineNLP::set_start(const std::vector<double> & speeds) {
+    assert(speeds.size() == m_num_stages);
+    // Along the centerline, steering with its curvature
+    for (size_t k=0; k < m_num_stages; k++) {
+        double * z = &m_x[k * STAGE_VARS];
+        double v = std::min(std::max(speeds[k], MIN_SPEED), m_limits.max_speed);
+        double v_next = std::min(std::max(speeds[next(k)], MIN_SPEED), m_limits.max_speed);
+        z[N_OFFSET] = 0.0;
+        z[MU] = 0.0;
+        z[V] = v;
+        z[DELTA] = std::min(std::max(-Lf() * m_curvature[k], -m_limits.max_steer), m_limits.max_steer);
+        z[ACCEL] = std::min(std::max((v_next * v_next - v * v) / (2.0 * m_step), -m_limits.max_decel),
+                            m_limits.max_accel);
+    }
+}
+
+
+template <class T>
+void RacelineNLP::stage(const T * z, size_t k, T * out) const {
+    // d/ds of the car's own arc length and time, for the arc length s of
+    // the centerline: ds_car/ds = (1 - n kappa) / cos(mu), dt/ds = that / v
+    using std::cos;
+    using std::sin;
+    const double kappa = m_curvature[k];
+    const double h = m_step;
+    T scale = z[N_OFFSET] * (-kappa) + 1.0;
+    T cos_mu = cos(z[MU]);
+    T dt_ds = scale / (z[V] * cos_mu);
+
+    // The yaw rate of FG_eval, -v delta / Lf, relative to the heading of the
+    // centerline (which turns by kappa)
+    out[OUT_TIME] = dt_ds * h;
+    out[OUT_OFFSET] = z[N_OFFSET] + scale * sin(z[MU]) / cos_mu * h;
+    out[OUT_HEADING] = z[MU] - (z[DELTA] * scale / (cos_mu * Lf()) + kappa) * h;
+    out[OUT_SPEED] = z[V] + z[ACCEL] * dt_ds * h;
+    out[OUT_LATERAL] = z[V] * z[V] * z[DELTA] / Lf();
+}
+
+
+double RacelineNLP::lap_time(const double * x) const {
+    double time = 0.0;
+    double out[STAGE_OUTPUTS];
+    for (size_t k=0; k < m_num_stages; k++) {
+        stage(x + k * STAGE_VARS, k, out);
+        time += out[OUT_TIME];
+    }
+    return time;
+}
+
+
+void RacelineNLP::parallel_stages(const std::function<void(size_t, size_t)> & work) {
+    size_t num_chunks = m_partial.size();
+    if (m_pool == nullptr or num_chunks == 1) {
+        for (size_t first=0; first < m_num_stages; first += CHUNK_STAGES)
+            work(first, std::min(first + CHUNK_STAGES, m_num_stages));
+        return;
+    }
+
+    m_pending = num_chunks;
+    for (size_t first=0; first < m_num_stages; first += CHUNK_STAGES) {
+        size_t last = std::min(first + CHUNK_STAGES, m_num_stages);
+        m_pool->Schedule([this, &work, first, last]() {
+            work(first, last);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0)
+                m_done.notify_one();
+        });
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_pending == 0; });
+}
+
+
+bool RacelineNLP::get_nlp_info(Ipopt::Index & n, Ipopt::Index & m, Ipopt::Index & nnz_jac_g,
+                               Ipopt::Index & nnz_h_lag, IndexStyleEnum & index_style) {
+    n = Ipopt::Index(m_num_stages * STAGE_VARS);
+    m = Ipopt::Index(m_num_stages * STAGE_CONSTRAINTS);
+    nnz_jac_g = Ipopt::Index(m_num_stages * STAGE_JACOBIAN);
+    nnz_h_lag = Ipopt::Index(m_num_stages * STAGE_HESSIAN);
+    index_style = C_STYLE;
+    return true;
+}
+
+
+bool RacelineNLP::get_bounds_info(Ipopt::Index n, Ipopt::Number * x_l, Ipopt::Number * x_u,
+                                  Ipopt::Index m, Ipopt::Number * g_l, Ipopt::Number * g_u) {
+    for (size_t k=0; k < m_num_stages; k++) {
+        Ipopt::Number * lower = x_l + k * STAGE_VARS;
+        Ipopt::Number * upper = x_u + k * STAGE_VARS;
+        lower[N_OFFSET] = m_offset_lower[k];
+        upper[N_OFFSET] = m_offset_upper[k];
+        lower[MU] = -MAX_HEADING;
+        upper[MU] = MAX_HEADING;
+        lower[V] = MIN_SPEED;
+        upper[V] = m_limits.max_speed;
+        lower[DELTA] = -m_limits.max_steer;
+        upper[DELTA] = m_limits.max_steer;
+        lower[ACCEL] = -m_limits.max_decel;
+        upper[ACCEL] = m_limits.max_accel;
+
+        for (size_t c=0; c < STAGE_CONSTRAINTS - 1; c++)
+            g_l[k * STAGE_CONSTRAINTS + c] = g_u[k * STAGE_CONSTRAINTS + c] = 0.0;
+        g_l[k * STAGE_CONSTRAINTS + 3] = -m_limits.max_lateral_accel;
+        g_u[k * STAGE_CONSTRAINTS + 3] = m_limits.max_lateral_accel;
+    }
+    return true;
+}
+
+
+bool RacelineNLP::get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number * x,
+                                     bool init_z, Ipopt::Number * z_L, Ipopt::Number * z_U,
+                                     Ipopt::Index m, bool init_lambda, Ipopt::Number * lambda) {
+    if (init_z or init_lambda)
+        return false;
+    std::copy(m_x.begin(), m_x.end(), x);
+    return true;
+}
+
+
+bool RacelineNLP::eval_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number & obj_value) {
+    parallel_stages([this, x](size_t first, size_t last) {
+        double sum = 0.0;
+        double out[STAGE_OUTPUTS];
+        for (size_t k=first; k < last; k++) {
+            const double * z = x + k * STAGE_VARS;
+            const double * z_next = x + next(k) * STAGE_VARS;
+            stage(z, k, out);
+            double steer_change = z_next[DELTA] - z[DELTA];
+            double accel_change = z_next[ACCEL] - z[ACCEL];
+            sum += out[OUT_TIME] + STEER_CHANGE_WEIGHT * steer_change * steer_change
+                    + ACCEL_CHANGE_WEIGHT * accel_change * accel_change;
+        }
+        m_partial[first / CHUNK_STAGES] = sum;
+    });
+    obj_value = 0.0;
+    for (double sum : m_partial)
+        obj_value += sum;
+    return true;
+}
+
+
+bool RacelineNLP::eval_grad_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number * grad_f) {
+    parallel_stages([this, x, grad_f](size_t first, size_t last) {
+        Stage1 in[STAGE_VARS];
+        Stage1 out[STAGE_OUTPUTS];
+        for (size_t k=first; k < last; k++) {
+            const double * z = x + k * STAGE_VARS;
+            const double * z_next = x + next(k) * STAGE_VARS;
+            const double * z_previous = x + previous(k) * STAGE_VARS;
+            for (size_t i=0; i < STAGE_VARS; i++)
+                in[i] = Stage1(z[i], STAGE_VARS, i);
+            stage(in, k, out);
+
+            double * grad = grad_f + k * STAGE_VARS;
+            for (size_t i=0; i < STAGE_VARS; i++)
+                grad[i] = out[OUT_TIME].derivatives()[i];
+            // The penalties of the changes from the previous stage and to the
+            // next one
+            grad[DELTA] += 2.0 * STEER_CHANGE_WEIGHT * (2.0 * z[DELTA] - z_previous[DELTA] - z_next[DELTA]);
+            grad[ACCEL] += 2.0 * ACCEL_CHANGE_WEIGHT * (2.0 * z[ACCEL] - z_previous[ACCEL] - z_next[ACCEL]);
+        }
+    });
+    return true;
+}
+
+
+bool RacelineNLP::eval_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m,
+                         Ipopt::Number * g) {
+    parallel_stages([this, x, g](size_t first, size_t last) {
+        double out[STAGE_OUTPUTS];
+        for (size_t k=first; k < last; k++) {
+            const double * z_next = x + next(k) * STAGE_VARS;
+            stage(x + k * STAGE_VARS, k, out);
+            // The next state minus its prediction, for N_OFFSET, MU and V
+            Ipopt::Number * row = g + k * STAGE_CONSTRAINTS;
+            for (size_t c=0; c < STAGE_CONSTRAINTS - 1; c++)
+                row[c] = z_next[N_OFFSET + c] - out[OUT_OFFSET + c];
+            row[3] = out[OUT_LATERAL];
+        }
+    });
+    return true;
+}
+
+
+bool RacelineNLP::eval_jac_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m,
+                             Ipopt::Index nele_jac, Ipopt::Index * iRow, Ipopt::Index * jCol,
+                             Ipopt::Number * values) {
+    if (values == nullptr) {
+        // The entries of every stage, in the order they're evaluated in
+        for (size_t k=0; k < m_num_stages; k++) {
+            Ipopt::Index * rows = iRow + k * STAGE_JACOBIAN;
+            Ipopt::Index * cols = jCol + k * STAGE_JACOBIAN;
+            size_t e = 0;
+            for (size_t c=0; c < STAGE_CONSTRAINTS - 1; c++) {
+                for (size_t i=0; i < STAGE_VARS; i++) {
+                    rows[e] = Ipopt::Index(k * STAGE_CONSTRAINTS + c);
+                    cols[e++] = Ipopt::Index(k * STAGE_VARS + i);
+                }
+                rows[e] = Ipopt::Index(k * STAGE_CONSTRAINTS + c);
+                cols[e++] = Ipopt::Index(next(k) * STAGE_VARS + N_OFFSET + c);
+            }
+            rows[e] = rows[e + 1] = Ipopt::Index(k * STAGE_CONSTRAINTS + 3);
+            cols[e] = Ipopt::Index(k * STAGE_VARS + V);
+            cols[e + 1] = Ipopt::Index(k * STAGE_VARS + DELTA);
+        }
+        return true;
+    }
+
+    parallel_stages([this, x, values](size_t first, size_t last) {
+        Stage1 in[STAGE_VARS];
+        Stage1 out[STAGE_OUTPUTS];
+        for (size_t k=first; k < last; k++) {
+            const double * z = x + k * STAGE_VARS;
+            for (size_t i=0; i < STAGE_VARS; i++)
+                in[i] = Stage1(z[i], STAGE_VARS, i);
+            stage(in, k, out);
+
+            Ipopt::Number * value = values + k * STAGE_JACOBIAN;
+            size_t e = 0;
+            for (size_t c=0; c < STAGE_CONSTRAINTS - 1; c++) {
+                for (size_t i=0; i < STAGE_VARS; i++)
+                    value[e++] = -out[OUT_OFFSET + c].derivatives()[i];
+                value[e++] = 1.0;
+            }
+            value[e] = out[OUT_LATERAL].derivatives()[V];
+            value[e + 1] = out[OUT_LATERAL].derivatives()[DELTA];
+        }
+    });
+    return true;
+}
+
+
+bool RacelineNLP::eval_h(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number obj_factor,
+                         Ipopt::Index m, const Ipopt::Number * lambda, bool new_lambda,
+                         Ipopt::Index nele_hess, Ipopt::Index * iRow, Ipopt::Index * jCol,
+                         Ipopt::Number * values) {
+    if (values == nullptr) {
+        // The lower triangle of the block of every stage, then the
+        // couplings of its inputs with the next stage's (lower triangle too,
+        // so the last stage's are in the first stage's columns)
+        for (size_t k=0; k < m_num_stages; k++) {
+            Ipopt::Index * rows = iRow + k * STAGE_HESSIAN;
+            Ipopt::Index * cols = jCol + k * STAGE_HESSIAN;
+            size_t e = 0;
+            for (size_t i=0; i < STAGE_VARS; i++) {
+                for (size_t j=0; j <= i; j++) {
+                    rows[e] = Ipopt::Index(k * STAGE_VARS + i);
+                    cols[e++] = Ipopt::Index(k * STAGE_VARS + j);
+                }
+            }
+            for (size_t input : {size_t(DELTA), size_t(ACCEL)}) {
+                size_t a = k * STAGE_VARS + input, b = next(k) * STAGE_VARS + input;
+                rows[e] = Ipopt::Index(std::max(a, b));
+                cols[e++] = Ipopt::Index(std::min(a, b));
+            }
+        }
+        return true;
+    }
+
+    parallel_stages([this, x, obj_factor, lambda, values](size_t first, size_t last) {
+        Stage2 in[STAGE_VARS];
+        Stage2 out[STAGE_OUTPUTS];
+        for (size_t k=first; k < last; k++) {
+            const double * z = x + k * STAGE_VARS;
+            for (size_t i=0; i < STAGE_VARS; i++) {
+                in[i].value() = Stage1(z[i], STAGE_VARS, i);
+                for (size_t j=0; j < STAGE_VARS; j++)
+                    in[i].derivatives()[j] = Stage1(i == j ? 1.0 : 0.0);
+            }
+            stage(in, k, out);
+
+            // obj_factor * time + lambda . g, with the steps as the next
+            // state minus the predictions
+            const Ipopt::Number * l = lambda + k * STAGE_CONSTRAINTS;
+            Stage2 lagrangian = out[OUT_TIME] * obj_factor - out[OUT_OFFSET] * l[0] - out[OUT_HEADING] * l[1]
+                    - out[OUT_SPEED] * l[2] + out[OUT_LATERAL] * l[3];
+
+            Ipopt::Number * value = values + k * STAGE_HESSIAN;
+            size_t e = 0;
+            for (size_t i=0; i < STAGE_VARS; i++)
+                for (size_t j=0; j <= i; j++)
+                    value[e++] = lagrangian.derivatives()[i].derivatives()[j];
+            // The penalties: every input is in the changes from the previous
+            // stage and to the next one
+            value[DELTA * (DELTA + 1) / 2 + DELTA] += 4.0 * obj_factor * STEER_CHANGE_WEIGHT;
+            value[ACCEL * (ACCEL + 1) / 2 + ACCEL] += 4.0 * obj_factor * ACCEL_CHANGE_WEIGHT;
+            value[e++] = -2.0 * obj_factor * STEER_CHANGE_WEIGHT;
+            value[e++] = -2.0 * obj_factor * ACCEL_CHANGE_WEIGHT;
+        }
+    });
+    return true;
+}
+
+
+void RacelineNLP::finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number * x,
+                                    const Ipopt::Number * z_L, const Ipopt::Number * z_U,
+                                    Ipopt::Index m, const Ipopt::Number * g, const Ipopt::Number * lambda,
+                                    Ipopt::Number obj_value, const Ipopt::IpoptData * ip_data,
+                                    Ipopt::IpoptCalculatedQuantities * ip_cq) {
+    m_status = status;
+    std::copy(x, x + n, m_x.begin());
+}
+
+
+bool RacelineNLP::intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                                        Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                                        Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                                        Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                                        const Ipopt::IpoptData * ip_data, Ipopt::IpoptCalculatedQuantities * ip_cq) {
+    m_iterations = iter;
+    return true;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include <coin/IpTNLP.hpp>
+
+#include "PathSpline.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* What bounds the raceline: the corridor about the centerline and the car
+struct RacelineLimits {
+    ///* Half the width of the corridor the car's center stays in [m]
+    double half_width = 0.3;
+    double max_speed = 8.0; // [m/s]
+    double max_lateral_accel = 4.0; // [m/s^2]
+    double max_accel = 2.0; // [m/s^2]
+    double max_decel = 4.0; // [m/s^2]
+    double max_steer = 0.436; // [rad]
+};
+
+
+///* The fastest lap of a closed path, as an Ipopt problem over the whole lap
+///* (for mpc_raceline): the car follows the kinematic model of FG_eval (the
+///* same Lf and sign of the steering), written in the Frenet frame of the
+///* centerline and stepped in its arc length (explicit Euler, like the
+///* model's steps in time), at `num_stages` stations spread evenly along it.
+///*
+///* Every stage has the state (n, mu, v), the lateral offset from the
+///* centerline (positive to the left), the heading relative to it and the
+///* speed, and the inputs (delta, a), the steering angle and the
+///* acceleration. The cost is the time of the lap, plus small penalties on
+///* the changes of the inputs from a stage to the next; the constraints are
+///* the steps of the model (the last stage steps into the first one) and
+///* the lateral acceleration v^2 delta / Lf, with the rest as bounds.
+///*
+///* Only neighbouring stages are coupled, so the Jacobian and the Hessian
+///* are banded (but for the wrap-around) and Ipopt's sparse factorization
+///* of the KKT system is linear in the stages. Their blocks come stage by
+///* stage from Eigen's AutoDiff, as in KinematicModel (`autodiff_stages`),
+///* and the stages are evaluated in parallel on `pool`, into disjoint parts
+///* of the outputs.
+class RacelineNLP : public Ipopt::TNLP {
+public:
+    ///* The variables of a stage, in their order in x
+    enum StageVar { N_OFFSET, MU, V, DELTA, ACCEL, STAGE_VARS };
+
+    ///* `pool`: nullptr evaluates on the calling thread
+    RacelineNLP(const PathSpline & centerline, size_t num_stages, const RacelineLimits & limits,
+                Eigen::ThreadPoolInterface * pool = nullptr);
+
+    size_t num_stages() const { return m_num_stages; }
+    ///* The arc length between two stages [m], and at stage k
+    double step() const { return m_step; }
+    double station(size_t k) const { return k * m_step; }
+
+    ///* The starting point (STAGE_VARS per stage), the centerline at the
+    ///* speed of `speeds` (one per stage) by default
+    void set_start(const std::vector<double> & speeds);
+
+    ///* The last solution (the starting point until there's one), its lap
+    ///* time [s] (without the penalties) and how the solve went
+    const std::vector<double> & x() const { return m_x; }
+    double lap_time() const { return lap_time(m_x.data()); }
+    Ipopt::SolverReturn status() const { return m_status; }
+    int iterations() const { return m_iterations; }
+
+    ///* The lap time of `x`
+    double lap_time(const double * x) const;
+
+    ///* Ipopt::TNLP interface
+    bool get_nlp_info(Ipopt::Index & n, Ipopt::Index & m, Ipopt::Index & nnz_jac_g,
+                      Ipopt::Index & nnz_h_lag, IndexStyleEnum & index_style);
+
+    bool get_bounds_info(Ipopt::Index n, Ipopt::Number * x_l, Ipopt::Number * x_u,
+                         Ipopt::Index m, Ipopt::Number * g_l, Ipopt::Number * g_u);
+
+    bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number * x,
+                            bool init_z, Ipopt::Number * z_L, Ipopt::Number * z_U,
+                            Ipopt::Index m, bool init_lambda, Ipopt::Number * lambda);
+
+    bool eval_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number & obj_value);
+
+    bool eval_grad_f(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number * grad_f);
+
+    bool eval_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m, Ipopt::Number * g);
+
+    bool eval_jac_g(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Index m,
+                    Ipopt::Index nele_jac, Ipopt::Index * iRow, Ipopt::Index * jCol, Ipopt::Number * values);
+
+    bool eval_h(Ipopt::Index n, const Ipopt::Number * x, bool new_x, Ipopt::Number obj_factor,
+                Ipopt::Index m, const Ipopt::Number * lambda, bool new_lambda,
+                Ipopt::Index nele_hess, Ipopt::Index * iRow, Ipopt::Index * jCol, Ipopt::Number * values);
+
+    void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number * x,
+                           const Ipopt::Number * z_L, const Ipopt::Number * z_U,
+                           Ipopt::Index m, const Ipopt::Number * g, const Ipopt::Number * lambda,
+                           Ipopt::Number obj_value, const Ipopt::IpoptData * ip_data,
+                           Ipopt::IpoptCalculatedQuantities * ip_cq);
+
+    bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                               Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                               Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                               Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                               const Ipopt::IpoptData * ip_data, Ipopt::IpoptCalculatedQuantities * ip_cq);
+
+private:
+    ///* The outputs of a stage: its time, the state it steps to, and the
+    ///* lateral acceleration
+    enum StageOutput { OUT_TIME, OUT_OFFSET, OUT_HEADING, OUT_SPEED, OUT_LATERAL, STAGE_OUTPUTS };
+
+    ///* The constraints of a stage: the steps of the state, then the lateral
+    ///* acceleration
+    static const size_t STAGE_CONSTRAINTS = 4;
+    ///* The entries of a stage in the Jacobian (6 per step of the state, 2
+    ///* of the lateral acceleration) and in the Hessian (the lower triangle
+    ///* of its block, and the penalties' couplings with the next stage)
+    static const size_t STAGE_JACOBIAN = 20;
+    static const size_t STAGE_HESSIAN = STAGE_VARS * (STAGE_VARS + 1) / 2 + 2;
+
+    ///* A stage of the model, in any scalar (the AutoDiff ones, see the .cpp)
+    template <class T>
+    void stage(const T * z, size_t k, T * out) const;
+
+    ///* Runs `work(first, last)` over chunks of the stages on the pool, and
+    ///* returns once all of them are done
+    void parallel_stages(const std::function<void(size_t, size_t)> & work);
+
+    size_t next(size_t k) const { return (k + 1 == m_num_stages) ? 0 : k + 1; }
+    size_t previous(size_t k) const { return (k == 0) ? m_num_stages - 1 : k - 1; }
+
+    size_t m_num_stages;
+    double m_step;
+    RacelineLimits m_limits;
+    Eigen::ThreadPoolInterface * m_pool;
+
+    ///* The curvature of the centerline at every stage, and the bounds of
+    ///* the offset there (within the corridor, and short of the center of
+    ///* the turn)
+    std::vector<double> m_curvature;
+    std::vector<double> m_offset_lower;
+    std::vector<double> m_offset_upper;
+
+    std::vector<double> m_x;
+    Ipopt::SolverReturn m_status;
+    int m_iterations;
+
+    ///* Partial sums of the chunks of `eval_f`
+    std::vector<double> m_partial;
+
+    ///* The chunks still running
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    size_t m_pending;
+
+    ///* The weights of the penalties on the changes of the inputs
+    static constexpr double STEER_CHANGE_WEIGHT = 0.1; // [s/rad^2]
+    static constexpr double ACCEL_CHANGE_WEIGHT = 1e-3; // [s^5/m^2]
+
+    ///* The car doesn't stop, nor turn across the path
+    static constexpr double MIN_SPEED = 0.5; // [m/s]
+    static constexpr double MAX_HEADING = 1.0; // [rad]
+    ///* The car stays this fraction of the radius of a turn from its center
+    static constexpr double TURN_CENTER_MARGIN = 0.1;
+    ///* The stages of a chunk of the parallel evaluations
+    static constexpr size_t CHUNK_STAGES = 256;
+};
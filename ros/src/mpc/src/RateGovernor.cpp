@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "RateGovernor.h"
+
+
+constexpr size_t RateGovernor::WINDOW;
+constexpr size_t RateGovernor::DECISION_TICKS;
+constexpr double RateGovernor::MARGIN;
+constexpr double RateGovernor::MAX_STEP;
+constexpr double RateGovernor::HYSTERESIS;
+
+
+RateGovernor::RateGovernor(double min_rate, double max_rate, double miss_ratio)
+        : m_min_rate(std::min(min_rate, max_rate)), m_max_rate(max_rate),
+          m_miss_ratio(std::min(std::max(miss_ratio, 0.0), 1.0)), m_rate(max_rate),
+          m_next(0), m_size(0), m_since_decision(0)
+{
+}
+
+
+bool RateGovernor::record(double tick_time, bool missed) {
+    m_times[m_next] = tick_time;
+    m_missed[m_next] = missed;
+    m_next = (m_next + 1) % WINDOW;
+    m_size = std::min(m_size + 1, WINDOW);
+    if (++m_since_decision < DECISION_TICKS)
+        return false;
+    m_since_decision = 0;
+
+    size_t misses = size_t(std::count(m_missed.begin(), m_missed.begin() + m_size, true));
+    double miss_ratio = double(misses) / double(m_size);
+
+    // The tick time all but `m_miss_ratio` of the ticks are within
+    std::copy(m_times.begin(), m_times.begin() + m_size, m_sorted.begin());
+    auto quantile = m_sorted.begin() + size_t((1.0 - m_miss_ratio) * double(m_size - 1));
+    std::nth_element(m_sorted.begin(), quantile, m_sorted.begin() + m_size);
+    double sustainable = (*quantile > 0.0) ? 1.0 / (MARGIN * *quantile) : m_max_rate;
+
+    double rate = m_rate;
+    if (miss_ratio > m_miss_ratio)
+        rate = std::min(sustainable, m_rate / MAX_STEP);
+    else if (sustainable > m_rate * HYSTERESIS)
+        rate = std::min(sustainable, m_rate * MAX_STEP);
+    rate = std::min(std::max(rate, m_min_rate), m_max_rate);
+    if (rate == m_rate)
+        return false;
+
+    m_rate = rate;
+    m_size = 0;
+    m_next = 0;
+    return true;
+}
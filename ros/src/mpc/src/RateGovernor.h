@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+
+///* The highest control rate the solves can sustain (see
+///* `Params::rate_governor`): instead of a fixed `loop_rate`, the loop runs
+///* as fast as its ticks let it, with at most `miss_ratio` of them missing
+///* their deadline.
+///*
+///* It keeps the durations of the latest WINDOW ticks, and every
+///* DECISION_TICKS of them takes the quantile at 1 - `miss_ratio`: the
+///* sustainable period is that, with a MARGIN for the jitter of the wake-ups.
+///* When more ticks than that missed, the rate drops to the sustainable one
+///* (by MAX_STEP at least); when the sustainable rate is higher by
+///* HYSTERESIS, it rises towards it, by MAX_STEP at most. After a change,
+///* the window starts over, since the ticks at the old rate say little of
+///* the new one (with its shorter, or longer, deadline). Nothing is
+///* allocated.
+class RateGovernor {
+public:
+    ///* Between `min_rate` and `max_rate` [Hz], starting at the highest
+    RateGovernor(double min_rate, double max_rate, double miss_ratio);
+
+    ///* Adds a tick, of `tick_time` [s], which `missed` its deadline (it
+    ///* overran the period, or its solve was cut short). True when the rate
+    ///* changes
+    bool record(double tick_time, bool missed);
+
+    ///* [Hz], and the period [s]
+    double rate() const { return m_rate; }
+    double period() const { return 1.0 / m_rate; }
+
+private:
+    static constexpr size_t WINDOW = 128;
+    static constexpr size_t DECISION_TICKS = 32;
+    static constexpr double MARGIN = 1.2;
+    static constexpr double MAX_STEP = 1.25;
+    static constexpr double HYSTERESIS = 1.05;
+
+    double m_min_rate;
+    double m_max_rate;
+    double m_miss_ratio;
+    double m_rate;
+
+    ///* The ring of the latest ticks, and its copy for the quantile
+    std::array<double, WINDOW> m_times;
+    std::array<bool, WINDOW> m_missed;
+    std::array<double, WINDOW> m_sorted;
+    size_t m_next;
+    size_t m_size;
+    size_t m_since_decision;
+};
@@ -0,0 +1,101 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "RealTime.h"
+#include "Log.h"
+
+
+bool pin_thread_to_cpu(int cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (error != 0) {
+        MPC_ERROR("Could not pin the solver loop to CPU %d: %s", cpu, std::strerror(error));
+        return false;
+    }
+    return true;
+}
+
+
+bool set_thread_fifo_priority(int priority) {
+    sched_param param;
+    param.sched_priority = priority;
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error == EPERM) {
+        MPC_ERROR("Not allowed to run the solver loop with SCHED_FIFO priority %d: it needs CAP_SYS_NICE or "
+                  "an rtprio limit (ulimit -r, /etc/security/limits.conf) of at least %d", priority, priority);
+        return false;
+    } else if (error != 0) {
+        MPC_ERROR("Could not run the solver loop with SCHED_FIFO priority %d: %s", priority, std::strerror(error));
+        return false;
+    }
+    return true;
+}
+
+
+bool set_thread_background_priority() {
+    sched_param param;
+    param.sched_priority = 0;
+    int error = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    if (error != 0) {
+        MPC_ERROR("Could not run a background thread with SCHED_IDLE: %s", std::strerror(error));
+        return false;
+    }
+    return true;
+}
+
+
+// Touches every page of a block of the stack, so it's faulted in (and locked)
+static void prefault_stack(size_t stack_size) {
+    static constexpr size_t PAGE_SIZE = 4096;
+    volatile unsigned char * block = static_cast<volatile unsigned char *>(alloca(stack_size));
+    for (size_t i=0; i < stack_size; i += PAGE_SIZE)
+        block[i] = 0;
+}
+
+
+bool lock_memory(size_t stack_size) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        int error = errno;
+        if (error == EPERM or error == ENOMEM)
+            MPC_ERROR("Could not lock the memory of the node (%s): it needs CAP_IPC_LOCK or a memlock limit "
+                      "(ulimit -l, /etc/security/limits.conf) larger than the node", std::strerror(error));
+        else
+            MPC_ERROR("Could not lock the memory of the node: %s", std::strerror(error));
+        return false;
+    }
+
+    // Freed memory stays in the heap (and so locked), and big blocks come
+    // from the heap too instead of fresh mappings
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    prefault_stack(stack_size);
+    return true;
+}
+
+
+bool check_cpu_governor(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/scaling_governor";
+    std::ifstream file(path);
+    std::string governor;
+    if (!(file >> governor)) {
+        MPC_WARN("Could not read the frequency governor of CPU %d (%s): its frequency may vary", cpu, path.c_str());
+        return false;
+    }
+    if (governor != "performance") {
+        MPC_WARN("CPU %d runs with the \"%s\" frequency governor, whose frequency varies with the load: "
+                 "\"performance\" holds it (cpupower frequency-set -g performance)", cpu, governor.c_str());
+        return false;
+    }
+    return true;
+}
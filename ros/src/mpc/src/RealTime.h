@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+
+///* The pieces of the real-time profile of the solver loop (see the `rt_*`
+///* members of Params). Each applies to the calling thread (or, for the
+///* memory, the whole process) and returns false, after logging why, when it
+///* can't be applied: typically for lack of privileges, which the message
+///* then says how to grant.
+
+///* Only lets the calling thread run on the given core
+bool pin_thread_to_cpu(int cpu);
+
+///* Switches the calling thread to SCHED_FIFO with the given priority (1-99)
+bool set_thread_fifo_priority(int priority);
+
+///* Switches the calling thread to SCHED_IDLE, below every other thread of
+///* the system, for work that must never take a core from the others (no
+///* privileges needed)
+bool set_thread_background_priority();
+
+///* Locks all the current and future pages of the process into memory, keeps
+///* the heap from being given back to the system (so that freed memory
+///* stays mapped and locked) and pre-faults `stack_size` bytes of the
+///* calling thread's stack
+bool lock_memory(size_t stack_size);
+
+///* Whether the frequency governor of the given core holds it at its highest
+///* frequency ("performance"), so that timings don't depend on the load
+///* before them (logs a warning when it doesn't, or can't be read)
+bool check_cpu_governor(int cpu);
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "ReferenceCandidates.h"
+#include "ParallelCppAD.h"
+#include "Trace.h"
+
+
+constexpr double ReferenceCandidates::MIN_FIT_LENGTH;
+
+
+ReferenceCandidates::ReferenceCandidates(const Params & params, Eigen::ThreadPoolInterface * pool,
+                                         ParallelBuild * build)
+        : m_pool(pool), m_followed(0), m_switched(false), m_ref_v(0.0), m_pending(0)
+{
+    m_offset_cost = params.reference_offset_cost;
+    m_switch_margin = params.reference_switch_margin;
+    m_poly_degree = params.poly_degree;
+    m_horizon = 0.0;
+    for (size_t t=0; t + 1 < params.steps_ahead; t++)
+        m_horizon += params.step_dt(t);
+
+    m_candidates.resize(params.reference_offsets.size());
+    m_fit_x.resize(FIT_POINTS * m_candidates.size());
+    m_fit_y.resize(FIT_POINTS * m_candidates.size());
+    m_fit_coeffs.resize((params.poly_degree + 1) * m_candidates.size());
+    for (size_t i=0; i < m_candidates.size(); i++) {
+        Candidate & candidate = m_candidates[i];
+        candidate.offset = params.reference_offsets[i];
+        candidate.coeffs.resize(params.poly_degree + 1);
+        candidate.state = Eigen::VectorXd::Zero(5);
+        candidate.result.reserve(2 + 2 * params.steps_ahead);
+        if (build != nullptr)
+            build->add(params, candidate.controller);
+        else
+            candidate.controller.reset(new MPC(params));
+    }
+    auto setup = [this]() {
+        for (Candidate & candidate : m_candidates)
+            candidate.controller->set_saves_solution(false);
+    };
+    if (build != nullptr)
+        build->then(setup);
+    else
+        setup();
+}
+
+
+bool ReferenceCandidates::allocation_free() const {
+    for (const Candidate & candidate : m_candidates)
+        if (!candidate.controller->allocation_free())
+            return false;
+    return true;
+}
+
+
+void ReferenceCandidates::memory_stats(MemoryStats & stats) const {
+    for (const Candidate & candidate : m_candidates)
+        candidate.controller->memory_stats(stats);
+}
+
+
+bool ReferenceCandidates::set_weights(const Params & params) {
+    bool OK = true;
+    for (Candidate & candidate : m_candidates)
+        OK = candidate.controller->set_weights(params) and OK;
+    return OK;
+}
+
+
+void ReferenceCandidates::set_obstacles(const double * positions, const double * clearances, size_t n) {
+    for (Candidate & candidate : m_candidates)
+        candidate.controller->set_obstacles(positions, clearances, n);
+}
+
+
+void ReferenceCandidates::set_cancel_flag(const std::atomic<bool> * cancel) {
+    for (Candidate & candidate : m_candidates)
+        candidate.controller->set_cancel_flag(cancel);
+}
+
+
+void ReferenceCandidates::reset_warm_start() {
+    for (Candidate & candidate : m_candidates)
+        candidate.controller->reset_warm_start();
+}
+
+
+void ReferenceCandidates::fit(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                              const std::vector<double> & cte_lower, const std::vector<double> & cte_upper) {
+    // The centerline's fit, sampled over the distance of the horizon and
+    // moved along its normal (to the left of the path, as y in the car's
+    // frame, for a positive offset), for every line
+    size_t count = m_candidates.size();
+    double length = std::max(std::abs(ref_v) * m_horizon, MIN_FIT_LENGTH);
+    for (size_t i=0; i < FIT_POINTS; i++) {
+        double x = length * double(i) / double(FIT_POINTS - 1);
+        double y, slope;
+        polyeval_with_diff(coeffs, x, y, slope);
+        double norm = std::sqrt(1.0 + slope * slope);
+        for (size_t c=0; c < count; c++) {
+            m_fit_x[i * count + c] = x - m_candidates[c].offset * slope / norm;
+            m_fit_y[i * count + c] = y + m_candidates[c].offset / norm;
+        }
+    }
+    polyfit_batch(m_fit_x.data(), m_fit_y.data(), FIT_POINTS, count, m_poly_degree, m_fit_coeffs.data());
+
+    for (size_t c=0; c < count; c++) {
+        Candidate & candidate = m_candidates[c];
+        candidate.coeffs = Eigen::Map<const Eigen::VectorXd>(&m_fit_coeffs[c * (m_poly_degree + 1)],
+                                                             m_poly_degree + 1);
+        double cte, slope;
+        polyeval_with_diff(candidate.coeffs, 0.0, cte, slope);
+        candidate.state = state;
+        candidate.state[3] = cte;
+        candidate.state[4] = -atan(slope);
+
+        // The corridor, about the line instead of the centerline
+        candidate.cte_lower.resize(cte_lower.size());
+        candidate.cte_upper.resize(cte_upper.size());
+        for (size_t t=0; t < cte_lower.size(); t++) {
+            candidate.cte_lower[t] = cte_lower[t] + candidate.offset;
+            candidate.cte_upper[t] = cte_upper[t] + candidate.offset;
+        }
+        if (!cte_lower.empty())
+            candidate.controller->set_cte_bounds(candidate.cte_lower.data(), candidate.cte_upper.data(),
+                                                 candidate.cte_lower.size());
+    }
+}
+
+
+void ReferenceCandidates::solve_candidate(size_t index) {
+    MPC_TRACE_SCOPE("ReferenceCandidates::candidate");
+    Candidate & candidate = m_candidates[index];
+    candidate.controller->Solve(candidate.state, candidate.coeffs, m_ref_v, candidate.result, m_deadline);
+}
+
+
+void ReferenceCandidates::Solve(MultiStartSolver & centerline, const Eigen::VectorXd & state,
+                                const Eigen::VectorXd & coeffs, double ref_v, const std::vector<double> & cte_lower,
+                                const std::vector<double> & cte_upper, std::vector<double> & result,
+                                const std::chrono::steady_clock::time_point & deadline) {
+    fit(state, coeffs, ref_v, cte_lower, cte_upper);
+    m_ref_v = ref_v;
+    m_deadline = deadline;
+
+    // The candidates on the pool (the capture fits in std::function's own
+    // storage, so scheduling doesn't allocate), the centerline here
+    ParallelCppAD::Section parallel;
+    m_pending = m_candidates.size();
+    for (size_t i=0; i < m_candidates.size(); i++) {
+        m_pool->Schedule([this, i]() {
+            solve_candidate(i);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0)
+                m_done.notify_one();
+        });
+    }
+    centerline.Solve(state, coeffs, ref_v, result, deadline);
+    {
+        MPC_TRACE_SCOPE("ReferenceCandidates::wait");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_pending == 0; });
+    }
+
+    size_t followed = select(centerline.stats());
+    m_switched = (followed != m_followed);
+    m_followed = followed;
+    if (followed > 0)
+        result = m_candidates[followed - 1].result;
+}
+
+
+size_t ReferenceCandidates::select(const SolveStats & centerline) const {
+    size_t best = 0;
+    double best_score = HUGE_VAL;
+    for (size_t line=0; line <= m_candidates.size(); line++) {
+        const SolveStats & stats = (line == 0) ? centerline : m_candidates[line - 1].controller->stats();
+        if (!stats.ok or !std::isfinite(stats.cost))
+            continue;
+        double offset = (line == 0) ? 0.0 : m_candidates[line - 1].offset;
+        double score = stats.cost + m_offset_cost * std::abs(offset);
+        if (line != m_followed)
+            score += m_switch_margin * std::abs(score);
+        if (score < best_score) {
+            best = line;
+            best_score = score;
+        }
+    }
+    return best;
+}
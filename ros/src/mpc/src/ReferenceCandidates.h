@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "MultiStartSolver.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* Alternative reference paths, solved along with the centerline's (see
+///* `Params::reference_offsets`): lines at a lateral offset from the path
+///* (e.g. to either side, to overtake or to take the pit entry), each fit in
+///* the car's frame and solved by an MPC of its own on `pool`, while the
+///* centerline's controller solves on the calling thread, all until the same
+///* deadline.
+///*
+///* The line followed is then the one of the cheapest feasible solution
+///* (solved, even if cut short by the deadline): by the cost of its solve,
+///* plus `reference_offset_cost` per metre of offset, and a line other than
+///* the one followed so far has to be cheaper by `reference_switch_margin`
+///* (relative). None feasible: the centerline's, whose failure falls back as
+///* usual.
+///*
+///* A line's fit is that of the centerline offset along its normal, sampled
+///* over the distance the horizon covers; the bounds of the corridor (of the
+///* cte from the centerline) move with it.
+class ReferenceCandidates {
+public:
+    ///* With `build`, the MPCs are made by it (see ParallelBuild), and the
+    ///* lines can't be solved before its `run`
+    ReferenceCandidates(const Params & params, Eigen::ThreadPoolInterface * pool, ParallelBuild * build = nullptr);
+
+    ///* Like `MultiStartSolver::Solve` of `centerline`, with the bounds of
+    ///* the corridor of the problem (empty without one): the result is the
+    ///* followed line's. Nothing is allocated once the results have the
+    ///* right size
+    void Solve(MultiStartSolver & centerline, const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs,
+               double ref_v, const std::vector<double> & cte_lower, const std::vector<double> & cte_upper,
+               std::vector<double> & result, const std::chrono::steady_clock::time_point & deadline);
+
+    ///* The line the last result is from (0: the centerline, i: the offset
+    ///* i - 1 of `Params::reference_offsets`), and whether it's another one
+    ///* than the line of the result before
+    size_t followed() const { return m_followed; }
+    bool switched() const { return m_switched; }
+
+    ///* The stats of the solve of the line `line` > 0, and its fit
+    const SolveStats & stats(size_t line) const { return m_candidates[line - 1].controller->stats(); }
+    const Eigen::VectorXd & coeffs(size_t line) const { return m_candidates[line - 1].coeffs; }
+
+    size_t size() const { return m_candidates.size(); }
+
+    ///* See MultiStartSolver
+    bool set_weights(const Params & params);
+    void set_obstacles(const double * positions, const double * clearances, size_t n);
+    void set_cancel_flag(const std::atomic<bool> * cancel);
+    bool allocation_free() const;
+    void reset_warm_start();
+    void memory_stats(MemoryStats & stats) const;
+
+private:
+    static const size_t FIT_POINTS = 32;
+
+    struct Candidate {
+        std::unique_ptr<MPC> controller;
+        ///* [m], to the left
+        double offset;
+        Eigen::VectorXd coeffs;
+        Eigen::VectorXd state;
+        std::vector<double> cte_lower;
+        std::vector<double> cte_upper;
+        std::vector<double> result;
+    };
+
+    ///* The fits, the states and the corridors of the candidates' lines,
+    ///* from the centerline's (the fits all at once, see `polyfit_batch`)
+    void fit(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+             const std::vector<double> & cte_lower, const std::vector<double> & cte_upper);
+    void solve_candidate(size_t index);
+
+    ///* The line of the cheapest feasible solution (see the class)
+    size_t select(const SolveStats & centerline) const;
+
+    std::vector<Candidate> m_candidates;
+    Eigen::ThreadPoolInterface * m_pool;
+    size_t m_followed;
+    bool m_switched;
+
+    double m_offset_cost;
+    double m_switch_margin;
+    ///* The time the horizon covers [s], and the degree of the fits
+    double m_horizon;
+    int m_poly_degree;
+    ///* The points the lines are fit to, interleaved (point i of candidate
+    ///* c at [i * size() + c]), and their fits, candidate after candidate
+    std::vector<double> m_fit_x;
+    std::vector<double> m_fit_y;
+    std::vector<double> m_fit_coeffs;
+
+    ///* The problem being solved, for the candidates
+    double m_ref_v;
+    std::chrono::steady_clock::time_point m_deadline;
+
+    ///* The candidates still solving
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    size_t m_pending;
+
+    ///* Shortest length [m] the lines are fit over
+    static constexpr double MIN_FIT_LENGTH = 2.0;
+};
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "RemoteSolve.h"
+#include "Log.h"
+
+
+RemoteSolver::RemoteSolver() : m_socket(-1), m_sequence(0) {
+    std::memset(&m_server, 0, sizeof(m_server));
+    std::memset(&m_request, 0, sizeof(m_request));
+    m_request.magic = RemoteRequest::MAGIC;
+}
+
+
+RemoteSolver::~RemoteSolver() {
+    if (m_socket >= 0)
+        close(m_socket);
+}
+
+
+bool RemoteSolver::open(const std::string & address) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos or colon == 0 or colon + 1 == address.size()) {
+        MPC_ERROR("The remote solver %s isn't host:port", address.c_str());
+        return false;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo * found = nullptr;
+    int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+    if (error != 0 or found == nullptr) {
+        MPC_ERROR("Could not resolve the remote solver %s: %s", address.c_str(), gai_strerror(error));
+        return false;
+    }
+    std::memcpy(&m_server, found->ai_addr, sizeof(m_server));
+    freeaddrinfo(found);
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket < 0 or fcntl(m_socket, F_SETFL, O_NONBLOCK) != 0) {
+        MPC_ERROR("Could not open a socket to the remote solver: %s", std::strerror(errno));
+        if (m_socket >= 0)
+            close(m_socket);
+        m_socket = -1;
+        return false;
+    }
+    return true;
+}
+
+
+bool RemoteSolver::request(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                           bool reset) {
+    if (m_socket < 0 or size_t(state.size()) > RemoteRequest::MAX_STATE
+            or size_t(coeffs.size()) > RemoteRequest::MAX_COEFFS)
+        return false;
+
+    m_request.sequence = ++m_sequence;
+    m_request.reset = reset ? 1 : 0;
+    m_request.num_state = uint8_t(state.size());
+    m_request.num_coeffs = uint16_t(coeffs.size());
+    m_request.ref_v = ref_v;
+    for (Eigen::Index i=0; i < state.size(); i++)
+        m_request.state[i] = state[i];
+    for (Eigen::Index i=0; i < coeffs.size(); i++)
+        m_request.coeffs[i] = coeffs[i];
+
+    size_t size = RemoteRequest::size(m_request.num_coeffs);
+    return sendto(m_socket, &m_request, size, 0, reinterpret_cast<const sockaddr *>(&m_server),
+                  sizeof(m_server)) == ssize_t(size);
+}
+
+
+bool RemoteSolver::receive(const std::chrono::steady_clock::time_point & deadline, RemoteReply & reply) {
+    if (m_socket < 0)
+        return false;
+    for (;;) {
+        ssize_t size = recv(m_socket, &reply, sizeof(reply), 0);
+        if (size >= ssize_t(RemoteReply::size(0))) {
+            // The late replies of the earlier ticks are dropped
+            if (reply.magic == RemoteReply::MAGIC and reply.sequence == m_sequence
+                    and reply.num_vars <= RemoteReply::MAX_VARS and size >= ssize_t(RemoteReply::size(reply.num_vars)))
+                return true;
+            continue;
+        }
+        if (size >= 0 or errno == EINTR)
+            continue;
+        if (errno != EAGAIN and errno != EWOULDBLOCK)
+            return false;
+
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0)
+            return false;
+        pollfd readable = {m_socket, POLLIN, 0};
+        poll(&readable, 1, int(std::min<long long>(left, 1000)));
+    }
+}
+
+
+int open_remote_server(int port) {
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server < 0) {
+        MPC_ERROR("Could not open the socket of the solver server: %s", std::strerror(errno));
+        return -1;
+    }
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(uint16_t(port));
+    if (bind(server, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        MPC_ERROR("Could not bind the solver server to port %d: %s", port, std::strerror(errno));
+        close(server);
+        return -1;
+    }
+    return server;
+}
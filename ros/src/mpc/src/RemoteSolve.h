@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "Eigen-3.3/Eigen/Core"
+
+
+///* Offload of the solves to a faster machine (see `Params::remote_solver`):
+///* the node sends the problem of every tick (the state, the coefficients of
+///* the fit and the reference speed) in a datagram to mpc_solver_server,
+///* which solves it with an MPC of its own and sends the result back.
+///*
+///* The datagrams are the structs below as they are in memory, cut after the
+///* values in use: both ends are built from the same source, for the same
+///* byte order. A server keeps the warm start of its own solves (its chain
+///* is the ticks it's sent), which `reset` restarts.
+struct RemoteRequest {
+    static const uint32_t MAGIC = 0x4d504351; // "MPCQ"
+    static const size_t MAX_STATE = 8;
+    static const size_t MAX_COEFFS = 256;
+
+    uint32_t magic;
+    uint32_t sequence;
+    uint8_t reset;
+    uint8_t num_state;
+    uint16_t num_coeffs;
+    double ref_v;
+    double state[MAX_STATE];
+    double coeffs[MAX_COEFFS];
+
+    ///* The bytes of a request of `num_coeffs` coefficients
+    static size_t size(size_t num_coeffs) {
+        return offsetof(RemoteRequest, coeffs) + num_coeffs * sizeof(double);
+    }
+};
+
+
+struct RemoteReply {
+    static const uint32_t MAGIC = 0x4d504352; // "MPCR"
+    ///* The actuations and the (x, y) of 200 steps
+    static const size_t MAX_VARS = 402;
+
+    uint32_t magic;
+    uint32_t sequence;
+    uint8_t ok;
+    uint8_t deadline_hit;
+    uint16_t num_vars;
+    int32_t iterations;
+    double cost;
+    ///* Of the solve on the server [s]
+    double solve_time;
+    double vars[MAX_VARS];
+
+    static size_t size(size_t num_vars) {
+        return offsetof(RemoteReply, vars) + num_vars * sizeof(double);
+    }
+};
+
+
+///* The node's end: a non-blocking UDP socket to the server. A tick sends
+///* its problem (`request`), goes on with its own solve, and then takes the
+///* server's result if it's there by the time it's needed (`receive`).
+///* Doesn't allocate once open.
+class RemoteSolver {
+public:
+    RemoteSolver();
+    ~RemoteSolver();
+
+    ///* To "host:port" (an IPv4 address or a name); false (and logs why)
+    ///* if it can't be resolved or the socket opened
+    bool open(const std::string & address);
+
+    bool is_open() const { return m_socket >= 0; }
+
+    ///* Sends the problem of the next tick (without waiting); `reset` when
+    ///* the server's warm start doesn't carry over (e.g. the horizon
+    ///* switched). False if it can't be sent
+    bool request(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v, bool reset);
+
+    ///* Waits until `deadline` at most for the reply to the last request,
+    ///* dropping those of the earlier ones; true (with the reply in
+    ///* `reply`) if it came
+    bool receive(const std::chrono::steady_clock::time_point & deadline, RemoteReply & reply);
+
+private:
+    int m_socket;
+    sockaddr_in m_server;
+    uint32_t m_sequence;
+    RemoteRequest m_request;
+};
+
+
+///* The server's end: a UDP socket bound to `port` (on every interface),
+///* blocking. -1 (logged) if it can't be bound
+int open_remote_server(int port);
@@ -0,0 +1,829 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "RiccatiSolver.h"
+#include "SolverBackend.h"
+#include "Log.h"
+
+
+constexpr double RiccatiSolver::TOLERANCE;
+constexpr double RiccatiSolver::MIN_REGULARIZATION;
+constexpr double RiccatiSolver::MAX_REGULARIZATION;
+constexpr double RiccatiSolver::SCHEDULED_RATIO;
+
+
+RiccatiSolver::RiccatiSolver(const Params & params, double steer_bound, double speed_upperbound)
+        : m_params(params), m_N(params.steps_ahead),
+          m_steer_bound(steer_bound), m_speed_upperbound(speed_upperbound),
+          m_ref_v(0.0),
+          m_s(params.steps_ahead), m_u(params.steps_ahead - 1),
+          m_s_new(params.steps_ahead), m_u_new(params.steps_ahead - 1),
+          m_k(params.steps_ahead - 1), m_K(params.steps_ahead - 1),
+          m_A(params.steps_ahead - 1), m_B(params.steps_ahead - 1),
+          m_sens_shift(0), m_sensitivity_OK(false), m_sensitivity_updated(false),
+          m_speed_bins(std::max(params.linearization_speed_bins, 0)),
+          m_epsi_bins(std::max(params.linearization_epsi_bins, 1)),
+          m_max_epsi(std::max(params.linearization_max_epsi, 0.0)),
+          m_curvature_bins(std::max(params.linearization_curvature_bins, 1)),
+          m_max_curvature(std::max(params.linearization_max_curvature, 0.0)), m_predicted_decrease(0.0),
+          m_ok(false), m_cost(0.0), m_u_OK(false), m_deadline_hit(false), m_iterations(0),
+          m_eval_time(0.0)
+{
+    assert(m_N >= 3);
+    if (params.active_set_qp) {
+        size_t n = 2 * (m_N - 1);
+        m_qp.reset(new ActiveSetQP(n));
+        m_S.resize(7, n);
+        m_S_next.resize(7, n);
+        m_US.resize(2, n);
+    }
+    if (params.sensitivity_updates > 0) {
+        m_Q_uu_inv.resize(m_N - 1);
+        m_sens_A.resize(m_N - 1);
+        m_sens_B.resize(m_N - 1);
+        m_sens_K.resize(m_N - 1);
+        m_sens_Q_uu_inv.resize(m_N - 1);
+        m_sens_active.resize(m_N - 1);
+    }
+    if (m_speed_bins > 0) {
+        size_t n = 2 * (m_N - 1);
+        m_bins.resize(m_speed_bins * m_epsi_bins * m_curvature_bins);
+        for (LinearizationBin & bin : m_bins) {
+            bin.A.resize(m_N - 1);
+            bin.B.resize(m_N - 1);
+            bin.K.resize(m_N - 1);
+            bin.Q_uu_inv.resize(m_N - 1);
+            if (m_qp) {
+                bin.H.resize(n, n);
+                bin.L.resize(n, n);
+            }
+        }
+        m_gradient.resize(m_N - 1);
+        build_bins();
+    }
+}
+
+
+double RiccatiSolver::poly(double x) const {
+    double result = 0.0;
+    for (int i = m_coeffs.size() - 1; i >= 0; i--)
+        result = result * x + m_coeffs[i];
+    return result;
+}
+
+
+double RiccatiSolver::poly_diff(double x) const {
+    double result = 0.0;
+    for (int i = m_coeffs.size() - 1; i >= 1; i--)
+        result = result * x + i * m_coeffs[i];
+    return result;
+}
+
+
+double RiccatiSolver::poly_diff2(double x) const {
+    double result = 0.0;
+    for (int i = m_coeffs.size() - 1; i >= 2; i--)
+        result = result * x + i * (i - 1) * m_coeffs[i];
+    return result;
+}
+
+
+RiccatiSolver::InputVector RiccatiSolver::clamp(const InputVector & u) const {
+    InputVector result;
+    result[0] = std::min(std::max(u[0], -m_steer_bound), m_steer_bound);
+    result[1] = std::min(std::max(u[1], 0.0), m_speed_upperbound);
+    return result;
+}
+
+
+uint8_t RiccatiSolver::active_bounds(const InputVector & u) const {
+    // Clamped inputs are on their bounds exactly
+    uint8_t active = 0;
+    if (std::abs(u[0]) >= m_steer_bound)
+        active |= 1;
+    if (u[1] <= 0.0 or u[1] >= m_speed_upperbound)
+        active |= 2;
+    return active;
+}
+
+
+// The same equations as in FG_eval::operator()
+void RiccatiSolver::step(const StateVector & s, const InputVector & u, StateVector & s_next) const {
+    double dt = m_params.dt;
+    double x = s[0], y = s[1], psi = s[2], epsi = s[4];
+    double delta = u[0], v = u[1];
+
+    s_next[0] = x + v * cos(psi) * dt;
+    s_next[1] = y + v * sin(psi) * dt;
+    s_next[2] = psi - v * delta / Lf() * dt;
+    s_next[3] = poly(x) - y + v * sin(epsi) * dt;
+    s_next[4] = psi - atan(poly_diff(x)) - v * delta / Lf() * dt;
+    s_next[5] = delta;
+    s_next[6] = v;
+}
+
+
+void RiccatiSolver::linearize(const StateVector & s, const InputVector & u, StateMatrix & A, InputMatrix & B) const {
+    linearize(s, u, poly_diff(s[0]), poly_diff2(s[0]), A, B);
+}
+
+
+void RiccatiSolver::linearize(const StateVector & s, const InputVector & u, double fdiff, double fdiff2,
+                              StateMatrix & A, InputMatrix & B) const {
+    double dt = m_params.dt;
+    double psi = s[2], epsi = s[4];
+    double delta = u[0], v = u[1];
+
+    A.setZero();
+    B.setZero();
+
+    A(0, 0) = 1.0;
+    A(0, 2) = -v * sin(psi) * dt;
+    B(0, 1) = cos(psi) * dt;
+
+    A(1, 1) = 1.0;
+    A(1, 2) = v * cos(psi) * dt;
+    B(1, 1) = sin(psi) * dt;
+
+    A(2, 2) = 1.0;
+    B(2, 0) = -v / Lf() * dt;
+    B(2, 1) = -delta / Lf() * dt;
+
+    A(3, 0) = fdiff;
+    A(3, 1) = -1.0;
+    A(3, 4) = v * cos(epsi) * dt;
+    B(3, 1) = sin(epsi) * dt;
+
+    A(4, 0) = -fdiff2 / (1.0 + fdiff * fdiff);
+    A(4, 2) = 1.0;
+    B(4, 0) = -v / Lf() * dt;
+    B(4, 1) = -delta / Lf() * dt;
+
+    // The previous input is just carried over
+    B(5, 0) = 1.0;
+    B(6, 1) = 1.0;
+}
+
+
+double RiccatiSolver::rollout(const std::vector<InputVector, Eigen::aligned_allocator<InputVector> > & u,
+                              std::vector<StateVector, Eigen::aligned_allocator<StateVector> > & s) const {
+    const Params & p = m_params;
+    double cost = 0.0;
+    for (size_t t=0; t < m_N - 1; t++) {
+        cost += p.cte_coeff * s[t][3] * s[t][3] + p.epsi_coeff * s[t][4] * s[t][4];
+        cost += p.speed_coeff * (u[t][1] - m_ref_v) * (u[t][1] - m_ref_v);
+        cost += p.steer_coeff * u[t][0] * u[t][0];
+        if (t >= 1) {
+            cost += p.consec_steer_coeff * (u[t][0] - s[t][5]) * (u[t][0] - s[t][5]);
+            cost += p.consec_speed_coeff * (u[t][1] - s[t][6]) * (u[t][1] - s[t][6]);
+        }
+        step(s[t], u[t], s[t + 1]);
+    }
+    const StateVector & s_N = s[m_N - 1];
+    cost += p.cte_coeff * s_N[3] * s_N[3] + p.epsi_coeff * s_N[4] * s_N[4];
+    return cost;
+}
+
+
+void RiccatiSolver::stage_derivatives(size_t t, StateVector & l_x, InputVector & l_u, StateMatrix & l_xx,
+                                      InputHessian & l_uu, GainMatrix & l_ux) const {
+    const Params & p = m_params;
+    const StateVector & s = m_s[t];
+    const InputVector & u = m_u[t];
+    double consec = (t >= 1) ? 1.0 : 0.0;
+
+    l_x.setZero();
+    l_x[3] = 2 * p.cte_coeff * s[3];
+    l_x[4] = 2 * p.epsi_coeff * s[4];
+    l_x[5] = -2 * consec * p.consec_steer_coeff * (u[0] - s[5]);
+    l_x[6] = -2 * consec * p.consec_speed_coeff * (u[1] - s[6]);
+    l_u[0] = 2 * p.steer_coeff * u[0] + 2 * consec * p.consec_steer_coeff * (u[0] - s[5]);
+    l_u[1] = 2 * p.speed_coeff * (u[1] - m_ref_v) + 2 * consec * p.consec_speed_coeff * (u[1] - s[6]);
+
+    stage_hessians(t, l_xx, l_uu, l_ux);
+}
+
+
+void RiccatiSolver::stage_hessians(size_t t, StateMatrix & l_xx, InputHessian & l_uu, GainMatrix & l_ux) const {
+    const Params & p = m_params;
+    double consec = (t >= 1) ? 1.0 : 0.0;
+
+    l_xx.setZero();
+    l_uu.setZero();
+    l_ux.setZero();
+
+    l_xx(3, 3) = 2 * p.cte_coeff;
+    l_xx(4, 4) = 2 * p.epsi_coeff;
+    l_xx(5, 5) = 2 * consec * p.consec_steer_coeff;
+    l_xx(6, 6) = 2 * consec * p.consec_speed_coeff;
+    l_uu(0, 0) = 2 * p.steer_coeff + 2 * consec * p.consec_steer_coeff;
+    l_uu(1, 1) = 2 * p.speed_coeff + 2 * consec * p.consec_speed_coeff;
+    l_ux(0, 5) = -2 * consec * p.consec_steer_coeff;
+    l_ux(1, 6) = -2 * consec * p.consec_speed_coeff;
+}
+
+
+bool RiccatiSolver::backward_pass(double regularization) {
+    const Params & p = m_params;
+
+    // Terminal cost
+    StateVector V_x = StateVector::Zero();
+    StateMatrix V_xx = StateMatrix::Zero();
+    const StateVector & s_N = m_s[m_N - 1];
+    V_x[3] = 2 * p.cte_coeff * s_N[3];
+    V_x[4] = 2 * p.epsi_coeff * s_N[4];
+    V_xx(3, 3) = 2 * p.cte_coeff;
+    V_xx(4, 4) = 2 * p.epsi_coeff;
+
+    StateVector l_x;
+    InputVector l_u;
+    StateMatrix l_xx;
+    InputHessian l_uu;
+    GainMatrix l_ux;
+    for (int t = m_N - 2; t >= 0; t--) {
+        StateMatrix & A = m_A[t];
+        InputMatrix & B = m_B[t];
+        const StateVector & s = m_s[t];
+        const InputVector & u = m_u[t];
+
+        // Derivatives of the (quadratic) stage cost
+        stage_derivatives(t, l_x, l_u, l_xx, l_uu, l_ux);
+
+        auto linearize_start = std::chrono::steady_clock::now();
+        linearize(s, u, A, B);
+        m_eval_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - linearize_start).count();
+
+        StateVector Q_x = l_x + A.transpose() * V_x;
+        InputVector Q_u = l_u + B.transpose() * V_x;
+        StateMatrix Q_xx = l_xx + A.transpose() * V_xx * A;
+        InputHessian Q_uu = l_uu + B.transpose() * V_xx * B;
+        GainMatrix Q_ux = l_ux + B.transpose() * V_xx * A;
+
+        InputHessian Q_uu_reg = Q_uu + regularization * InputHessian::Identity();
+        Eigen::LLT<InputHessian> llt(Q_uu_reg);
+        if (llt.info() != Eigen::Success)
+            return false;
+
+        m_k[t] = -llt.solve(Q_u);
+        m_K[t] = -llt.solve(Q_ux);
+        if (!m_Q_uu_inv.empty())
+            m_Q_uu_inv[t] = llt.solve(InputHessian::Identity());
+
+        const InputVector & k = m_k[t];
+        const GainMatrix & K = m_K[t];
+        V_x = Q_x + K.transpose() * Q_uu * k + K.transpose() * Q_u + Q_ux.transpose() * k;
+        V_xx = Q_xx + K.transpose() * Q_uu * K + K.transpose() * Q_ux + Q_ux.transpose() * K;
+        V_xx = 0.5 * (V_xx + V_xx.transpose());
+    }
+    return true;
+}
+
+
+bool RiccatiSolver::qp_pass(double regularization) {
+    // The feedback of the recursion (without the bounds), and the
+    // linearization
+    if (!backward_pass(regularization))
+        return false;
+
+    const Params & p = m_params;
+    ActiveSetQP & qp = *m_qp;
+    Eigen::MatrixXd & H = qp.hessian();
+    Eigen::VectorXd & g = qp.gradient();
+    H.setZero();
+    g.setZero();
+    // The initial state doesn't change
+    m_S.setZero();
+
+    StateVector l_x;
+    InputVector l_u;
+    StateMatrix l_xx;
+    InputHessian l_uu;
+    GainMatrix l_ux;
+    for (size_t t=0; t < m_N - 1; t++) {
+        size_t i = 2 * t;
+
+        // The cost of the stage, with the change of its state through m_S
+        // (l_xx is diagonal)
+        stage_derivatives(t, l_x, l_u, l_xx, l_uu, l_ux);
+        for (int k=0; k < 7; k++)
+            if (l_xx(k, k) != 0.0)
+                H.noalias() += l_xx(k, k) * m_S.row(k).transpose() * m_S.row(k);
+        m_US.noalias() = l_ux * m_S;
+        H.middleRows(i, 2) += m_US;
+        H.middleCols(i, 2) += m_US.transpose();
+        H.block<2, 2>(i, i) += l_uu;
+        g.noalias() += m_S.transpose() * l_x;
+        g.segment<2>(i) += l_u;
+
+        // The bounds of the actuators, on the changes
+        qp.lower()[i] = -m_steer_bound - m_u[t][0];
+        qp.upper()[i] = m_steer_bound - m_u[t][0];
+        qp.lower()[i + 1] = -m_u[t][1];
+        qp.upper()[i + 1] = m_speed_upperbound - m_u[t][1];
+
+        m_S_next.noalias() = m_A[t] * m_S;
+        m_S_next.middleCols(i, 2) += m_B[t];
+        m_S.swap(m_S_next);
+    }
+
+    // Terminal cost
+    const StateVector & s_N = m_s[m_N - 1];
+    H.noalias() += 2 * p.cte_coeff * m_S.row(3).transpose() * m_S.row(3);
+    H.noalias() += 2 * p.epsi_coeff * m_S.row(4).transpose() * m_S.row(4);
+    g.noalias() += 2 * p.cte_coeff * s_N[3] * m_S.row(3).transpose();
+    g.noalias() += 2 * p.epsi_coeff * s_N[4] * m_S.row(4).transpose();
+    H.diagonal().array() += regularization;
+
+    if (!qp.solve())
+        return false;
+
+    // The forward pass goes along the QP's changes of the inputs, with the
+    // feedback on how far the states stray from those the linearization
+    // predicts for them, which keeps it on the QP's branch
+    StateVector ds = StateVector::Zero();
+    for (size_t t=0; t < m_N - 1; t++) {
+        InputVector du = qp.solution().segment<2>(2 * t);
+        m_k[t] = du - m_K[t] * ds;
+        ds = m_A[t] * ds + m_B[t] * du;
+    }
+    return true;
+}
+
+
+void RiccatiSolver::keep_sensitivities() {
+    // The factors at the solution itself (those of the last iteration are
+    // at the trajectory before its step)
+    m_sens_shift = 0;
+    m_sensitivity_OK = backward_pass(MIN_REGULARIZATION);
+    if (!m_sensitivity_OK)
+        return;
+    for (size_t t=0; t < m_N - 1; t++) {
+        m_sens_A[t] = m_A[t];
+        m_sens_B[t] = m_B[t];
+        m_sens_K[t] = m_K[t];
+        m_sens_Q_uu_inv[t] = m_Q_uu_inv[t];
+        m_sens_active[t] = active_bounds(m_u[t]);
+    }
+}
+
+
+bool RiccatiSolver::sensitivity_update() {
+    const Params & p = m_params;
+
+    // The last inputs, shifted by one step (as the factors are), rolled out
+    // on the new problem
+    for (size_t t=0; t < m_N - 2; t++)
+        m_u[t] = m_u[t + 1];
+    double cost = rollout(m_u, m_s);
+    if (!std::isfinite(cost))
+        return false;
+    m_sens_shift++;
+
+    // The backward pass with the kept factors: only the gradients are the
+    // new problem's
+    StateVector V_x = StateVector::Zero();
+    const StateVector & s_N = m_s[m_N - 1];
+    V_x[3] = 2 * p.cte_coeff * s_N[3];
+    V_x[4] = 2 * p.epsi_coeff * s_N[4];
+    StateVector l_x;
+    InputVector l_u;
+    StateMatrix l_xx;
+    InputHessian l_uu;
+    GainMatrix l_ux;
+    for (int t = m_N - 2; t >= 0; t--) {
+        size_t j = std::min(size_t(t) + m_sens_shift, m_N - 2);
+        stage_derivatives(t, l_x, l_u, l_xx, l_uu, l_ux);
+        InputVector Q_u = l_u + m_sens_B[j].transpose() * V_x;
+        m_k[t] = -m_sens_Q_uu_inv[j] * Q_u;
+        if (m_k[t].cwiseAbs().maxCoeff() > p.sensitivity_tolerance)
+            return false;
+        V_x = l_x + m_sens_A[j].transpose() * V_x + m_sens_K[j].transpose() * Q_u;
+    }
+
+    // The full step, with the kept feedback, on the bounds of the full solve
+    for (size_t t=0; t < m_N - 1; t++) {
+        size_t j = std::min(t + m_sens_shift, m_N - 2);
+        InputVector u = m_u[t] + m_k[t] + m_sens_K[j] * (m_s_new[t] - m_s[t]);
+        m_u_new[t] = clamp(u);
+        if (active_bounds(m_u_new[t]) != m_sens_active[j])
+            return false;
+        step(m_s_new[t], m_u_new[t], m_s_new[t + 1]);
+    }
+    double new_cost = rollout(m_u_new, m_s_new);
+    if (!std::isfinite(new_cost))
+        return false;
+
+    m_s.swap(m_s_new);
+    m_u.swap(m_u_new);
+    m_s_new[0] = m_s[0];
+    m_cost = new_cost;
+    return true;
+}
+
+
+void RiccatiSolver::build_bins() {
+    // The speeds of the bins are the middles of their ranges, their heading
+    // errors and curvatures are spread over theirs
+    size_t failed = 0;
+    for (size_t i=0; i < m_speed_bins; i++) {
+        double speed = (i + 0.5) * m_speed_upperbound / m_speed_bins;
+        for (size_t j=0; j < m_epsi_bins; j++) {
+            double epsi = (m_epsi_bins > 1) ? -m_max_epsi + 2 * m_max_epsi * j / (m_epsi_bins - 1) : 0.0;
+            for (size_t k=0; k < m_curvature_bins; k++) {
+                double curvature = (m_curvature_bins > 1)
+                        ? -m_max_curvature + 2 * m_max_curvature * k / (m_curvature_bins - 1) : 0.0;
+                if (!build_bin(speed, epsi, curvature, m_bins[(i * m_epsi_bins + j) * m_curvature_bins + k]))
+                    failed++;
+            }
+        }
+    }
+    if (failed > 0)
+        MPC_WARN("%lu of the %lu linearizations of the table aren't positive definite, their ticks linearize "
+                 "as usual", failed, m_bins.size());
+}
+
+
+bool RiccatiSolver::build_bin(double speed, double epsi, double curvature, LinearizationBin & bin) {
+    const Params & p = m_params;
+    double dt = p.dt;
+    bin.OK = false;
+
+    // Along the path y = c1 x + c2 x^2 of the bin's heading error and
+    // curvature at the car, at `speed`, steering as the curvature needs
+    double c1 = -std::tan(epsi);
+    double c2 = 0.5 * curvature * std::pow(1.0 + c1 * c1, 1.5);
+    InputVector u(std::min(std::max(-Lf() * curvature, -m_steer_bound), m_steer_bound), speed);
+    StateVector s = StateVector::Zero();
+    s[4] = epsi;
+    for (size_t t=0; t < m_N - 1; t++) {
+        double fdiff = c1 + 2 * c2 * s[0];
+        linearize(s, u, fdiff, 2 * c2, bin.A[t], bin.B[t]);
+        double psi = s[2];
+        s[0] += speed * std::cos(psi) * dt;
+        s[1] += speed * std::sin(psi) * dt;
+        s[2] = psi - speed * u[0] / Lf() * dt;
+        s[4] = psi - std::atan(fdiff) - speed * u[0] / Lf() * dt;
+    }
+
+    // The recursion of `backward_pass`, on the second derivatives alone
+    StateMatrix V_xx = StateMatrix::Zero();
+    V_xx(3, 3) = 2 * p.cte_coeff;
+    V_xx(4, 4) = 2 * p.epsi_coeff;
+    StateMatrix l_xx;
+    InputHessian l_uu;
+    GainMatrix l_ux;
+    for (int t = m_N - 2; t >= 0; t--) {
+        const StateMatrix & A = bin.A[t];
+        const InputMatrix & B = bin.B[t];
+        stage_hessians(t, l_xx, l_uu, l_ux);
+        StateMatrix Q_xx = l_xx + A.transpose() * V_xx * A;
+        InputHessian Q_uu = l_uu + B.transpose() * V_xx * B;
+        GainMatrix Q_ux = l_ux + B.transpose() * V_xx * A;
+
+        InputHessian Q_uu_reg = Q_uu + MIN_REGULARIZATION * InputHessian::Identity();
+        Eigen::LLT<InputHessian> llt(Q_uu_reg);
+        if (llt.info() != Eigen::Success)
+            return false;
+        bin.K[t] = -llt.solve(Q_ux);
+        bin.Q_uu_inv[t] = llt.solve(InputHessian::Identity());
+
+        const GainMatrix & K = bin.K[t];
+        V_xx = Q_xx + K.transpose() * Q_uu * K + K.transpose() * Q_ux + Q_ux.transpose() * K;
+        V_xx = 0.5 * (V_xx + V_xx.transpose());
+    }
+    if (!m_qp) {
+        bin.OK = true;
+        return true;
+    }
+
+    // The Hessian of the condensed QP, as `qp_pass` makes it
+    Eigen::MatrixXd & H = bin.H;
+    H.setZero();
+    m_S.setZero();
+    for (size_t t=0; t < m_N - 1; t++) {
+        size_t i = 2 * t;
+        stage_hessians(t, l_xx, l_uu, l_ux);
+        for (int k=0; k < 7; k++)
+            if (l_xx(k, k) != 0.0)
+                H.noalias() += l_xx(k, k) * m_S.row(k).transpose() * m_S.row(k);
+        m_US.noalias() = l_ux * m_S;
+        H.middleRows(i, 2) += m_US;
+        H.middleCols(i, 2) += m_US.transpose();
+        H.block<2, 2>(i, i) += l_uu;
+
+        m_S_next.noalias() = bin.A[t] * m_S;
+        m_S_next.middleCols(i, 2) += bin.B[t];
+        m_S.swap(m_S_next);
+    }
+    H.noalias() += 2 * p.cte_coeff * m_S.row(3).transpose() * m_S.row(3);
+    H.noalias() += 2 * p.epsi_coeff * m_S.row(4).transpose() * m_S.row(4);
+    H.diagonal().array() += MIN_REGULARIZATION;
+
+    // In place: only the lower triangle is read and written
+    bin.L = H;
+    Eigen::LLT<Eigen::Ref<Eigen::MatrixXd> > llt(bin.L);
+    bin.OK = (llt.info() == Eigen::Success);
+    return bin.OK;
+}
+
+
+// The bin of `value` of `count` spread over [-max, max] (the nearest), or
+// `count` when it's out of their range
+static size_t spread_bin(double value, double max, size_t count) {
+    if (count <= 1)
+        return 0;
+    double position = (value + max) / (2 * max) * (count - 1);
+    if (!(position >= -0.5 and position <= count - 0.5))
+        return count;
+    return std::min(size_t(std::max(std::round(position), 0.0)), count - 1);
+}
+
+
+const RiccatiSolver::LinearizationBin * RiccatiSolver::find_bin() const {
+    // The speed and the heading error the trajectory starts with, and the
+    // curvature of the path there
+    double speed = m_u[0][1];
+    double fdiff = poly_diff(0.0);
+    double curvature = poly_diff2(0.0) / std::pow(1.0 + fdiff * fdiff, 1.5);
+    size_t i = size_t(std::min(std::max(speed / m_speed_upperbound * m_speed_bins, 0.0), m_speed_bins - 1.0));
+    size_t j = spread_bin(m_s[0][4], m_max_epsi, m_epsi_bins);
+    size_t k = spread_bin(curvature, m_max_curvature, m_curvature_bins);
+    if (j == m_epsi_bins or k == m_curvature_bins)
+        return nullptr;
+    const LinearizationBin & bin = m_bins[(i * m_epsi_bins + j) * m_curvature_bins + k];
+    return bin.OK ? &bin : nullptr;
+}
+
+
+bool RiccatiSolver::scheduled_pass(const LinearizationBin & bin) {
+    const Params & p = m_params;
+
+    // The gradient of the cost w.r.t. the inputs, exact (the trajectory's
+    // own linearization, through the adjoint of the states after each
+    // stage): with it, the steps stop where the solve would,
+    // however far the bin's linearization is from the trajectory's
+    auto linearize_start = std::chrono::steady_clock::now();
+    StateVector adjoint = StateVector::Zero();
+    const StateVector & s_N = m_s[m_N - 1];
+    adjoint[3] = 2 * p.cte_coeff * s_N[3];
+    adjoint[4] = 2 * p.epsi_coeff * s_N[4];
+    StateVector l_x;
+    InputVector l_u;
+    StateMatrix l_xx;
+    InputHessian l_uu;
+    GainMatrix l_ux;
+    for (int t = m_N - 2; t >= 0; t--) {
+        stage_derivatives(t, l_x, l_u, l_xx, l_uu, l_ux);
+        linearize(m_s[t], m_u[t], m_A[t], m_B[t]);
+        m_gradient[t] = l_u + m_B[t].transpose() * adjoint;
+        adjoint = l_x + m_A[t].transpose() * adjoint;
+    }
+    m_eval_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - linearize_start).count();
+
+    if (!m_qp) {
+        // The LQ subproblem of the bin with that gradient, by the
+        // back-substitution through its factors (as `sensitivity_update`)
+        StateVector V_x = StateVector::Zero();
+        for (int t = m_N - 2; t >= 0; t--) {
+            InputVector Q_u = m_gradient[t] + bin.B[t].transpose() * V_x;
+            m_k[t] = -bin.Q_uu_inv[t] * Q_u;
+            V_x = bin.A[t].transpose() * V_x + bin.K[t].transpose() * Q_u;
+        }
+
+        // Its steps of the inputs, open loop: the feedback of the bin is
+        // that of another trajectory. The decrease the subproblem predicts
+        // at its minimizer is half the one along the gradient
+        StateVector ds = StateVector::Zero();
+        double gradient_step = 0.0;
+        for (size_t t=0; t < m_N - 1; t++) {
+            InputVector du = m_k[t] + bin.K[t] * ds;
+            gradient_step += m_gradient[t].dot(du);
+            m_k[t] = du;
+            m_K[t].setZero();
+            ds = bin.A[t] * ds + bin.B[t] * du;
+        }
+        m_predicted_decrease = -0.5 * gradient_step;
+        return true;
+    }
+
+    // The QP of the bin's Hessian and factor, with that gradient
+    ActiveSetQP & qp = *m_qp;
+    for (size_t t=0; t < m_N - 1; t++) {
+        size_t i = 2 * t;
+        qp.gradient().segment<2>(i) = m_gradient[t];
+        qp.lower()[i] = -m_steer_bound - m_u[t][0];
+        qp.upper()[i] = m_steer_bound - m_u[t][0];
+        qp.lower()[i + 1] = -m_u[t][1];
+        qp.upper()[i + 1] = m_speed_upperbound - m_u[t][1];
+    }
+    qp.hessian() = bin.H;
+    if (!qp.solve(bin.L))
+        return false;
+
+    // Its steps of the inputs, open loop, and the decrease it predicts
+    const Eigen::VectorXd & du = qp.solution();
+    double curvature = 0.0;
+    for (Eigen::Index j=0; j < du.size(); j++)
+        curvature += du[j] * bin.H.col(j).dot(du);
+    m_predicted_decrease = -du.dot(qp.gradient()) - 0.5 * curvature;
+    for (size_t t=0; t < m_N - 1; t++) {
+        m_k[t] = du.segment<2>(2 * t);
+        m_K[t].setZero();
+    }
+    return true;
+}
+
+
+void RiccatiSolver::write_result(std::vector<double> & result) const {
+    result.resize(2 + 2*m_N);
+    result[0] = m_u[0][0];
+    result[1] = m_u[0][1];
+    for (size_t t=0; t < m_N; t++) {
+        result[2 + 2*t] = m_s[t][0];
+        result[3 + 2*t] = m_s[t][1];
+    }
+}
+
+
+void RiccatiSolver::Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                          std::vector<double> & result, const std::chrono::steady_clock::time_point & deadline) {
+    m_coeffs = coeffs;
+    m_ref_v = ref_v;
+    m_deadline_hit = false;
+    m_eval_time = 0.0;
+
+    // Initial state; the "previous input" part is never used at t = 0
+    m_s[0] << state[0], state[1], state[2], state[3], state[4], 0.0, 0.0;
+    m_s_new[0] = m_s[0];
+
+    // Between the full solves, the tangential predictor of the last one
+    // when it's close enough; otherwise a full solve, from the inputs it
+    // shifted
+    m_sensitivity_updated = false;
+    bool shifted = false;
+    if (m_sensitivity_OK and m_u_OK and m_sens_shift < size_t(m_params.sensitivity_updates)) {
+        if (sensitivity_update()) {
+            if (m_qp)
+                m_qp->shift(2);
+            m_sensitivity_updated = true;
+            m_iterations = 0;
+            m_ok = true;
+            write_result(result);
+            return;
+        }
+        shifted = true;
+    }
+
+    // Initial guess of the inputs (RTI and an iteration budget always
+    // continue from the previous trajectory), and the bounds active in the
+    // last QP with it
+    bool budget = (m_params.iterations_per_tick > 0);
+    if ((m_params.warm_start or m_params.rti or budget or shifted) and m_u_OK) {
+        if (!shifted)
+            for (size_t t=0; t < m_N - 2; t++)
+                m_u[t] = m_u[t + 1];
+        if (m_qp)
+            m_qp->shift(2);
+    } else {
+        InputVector u0;
+        u0 << 0.0, ref_v;
+        for (size_t t=0; t < m_N - 1; t++)
+            m_u[t] = clamp(u0);
+        if (m_qp)
+            m_qp->reset();
+    }
+
+    double cost = rollout(m_u, m_s);
+    double regularization = MIN_REGULARIZATION;
+    bool converged = false;
+
+    // In RTI mode a single Gauss-Newton step (one linearization and one LQ
+    // subproblem) is taken per tick, with a budget that many
+    int max_iterations = m_params.rti ? 1 : (budget ? m_params.iterations_per_tick : MAX_ITERATIONS);
+    int iter = 0;
+    // Whether any step was taken: without one the trajectory is only the
+    // shifted last one (or a cold start)
+    bool stepped = false;
+    // The step of the table's linearization, unless it's of no use
+    bool scheduled = !m_bins.empty();
+    while (iter < max_iterations and !converged) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            m_deadline_hit = true;
+            break;
+        }
+
+        const LinearizationBin * bin = scheduled ? find_bin() : nullptr;
+        scheduled = (bin != nullptr);
+        if (scheduled ? !scheduled_pass(*bin)
+                : !(m_qp ? qp_pass(regularization) : backward_pass(regularization))) {
+            if (scheduled) {
+                scheduled = false;
+                continue;
+            }
+            regularization *= 10;
+            if (regularization > MAX_REGULARIZATION)
+                break;
+            continue;
+        }
+        iter++;
+
+        // Line search on the feedforward term. The step of the table is
+        // taken whole, and only when it lowers the cost by enough of what
+        // its subproblem predicts
+        bool accepted = false;
+        double alpha = 1.0;
+        for (int ls=0; ls < (scheduled ? 1 : MAX_LINE_SEARCH_STEPS); ls++) {
+            for (size_t t=0; t < m_N - 1; t++) {
+                InputVector u = m_u[t] + alpha * m_k[t] + m_K[t] * (m_s_new[t] - m_s[t]);
+                m_u_new[t] = clamp(u);
+                step(m_s_new[t], m_u_new[t], m_s_new[t + 1]);
+            }
+            double new_cost = rollout(m_u_new, m_s_new);
+
+            if (new_cost < cost and (!scheduled or cost - new_cost >= SCHEDULED_RATIO * m_predicted_decrease)) {
+                double decrease = (cost - new_cost) / std::max(std::abs(cost), 1e-12);
+                converged = (decrease < TOLERANCE);
+                m_s.swap(m_s_new);
+                m_u.swap(m_u_new);
+                m_s_new[0] = m_s[0];
+                cost = new_cost;
+                accepted = true;
+                break;
+            }
+            alpha *= 0.5;
+        }
+
+        if (accepted) {
+            stepped = true;
+            regularization = std::max(regularization / 10, MIN_REGULARIZATION);
+        } else if (scheduled) {
+            // The trajectory is too far from the bin's for its step: that of
+            // its own linearization instead
+            scheduled = false;
+            iter--;
+        } else {
+            // No descent along the Newton direction: (clamped) stationary point
+            regularization *= 10;
+            if (regularization > MAX_REGULARIZATION) {
+                converged = true;
+                break;
+            }
+        }
+    }
+
+    m_cost = cost;
+    m_iterations = iter;
+    // A solve cut short (by RTI, the budget or the deadline) is an iterate
+    // only when it moved the trajectory
+    m_ok = (converged or ((m_params.rti or budget or m_deadline_hit) and stepped)) and std::isfinite(cost);
+    m_u_OK = m_ok;
+    if (!m_Q_uu_inv.empty()) {
+        m_sensitivity_OK = false;
+        if (converged and m_ok)
+            keep_sensitivities();
+    }
+
+    write_result(result);
+}
+
+
+// The backends "riccati" and "rti" (`Params::rti` tells them apart)
+class RiccatiBackend : public SolverBackend {
+public:
+    RiccatiBackend(const Params & params, double steer_bound, double speed_upperbound)
+            : m_solver(params, steer_bound, speed_upperbound) {}
+
+    void solve(const SolveProblem & problem, std::vector<double> & result, SolveStats & stats) {
+        m_solver.Solve(problem.state, problem.coeffs, problem.ref_v, result, problem.deadline);
+        stats.deadline_hit = m_solver.deadline_hit();
+        stats.fallback = FALLBACK_NONE;
+        stats.cost = m_solver.cost();
+        stats.ok = m_solver.ok();
+        stats.iterations = m_solver.iterations();
+        stats.restoration = false;
+        stats.diverged = false;
+        // The states are rolled out from the (clamped) inputs, which
+        // satisfies the constraints by construction
+        stats.constraint_violation = 0.0;
+        stats.eval_time = m_solver.eval_time();
+        stats.linear_solver_time = -1.0;
+    }
+
+    void reset_warm_start() { m_solver.reset_warm_start(); }
+    void set_weights(const Params & params) { m_solver.set_weights(params); }
+    bool allocation_free() const { return true; }
+
+private:
+    RiccatiSolver m_solver;
+};
+
+
+static std::unique_ptr<SolverBackend> make_riccati(const Params & params, double steer_bound,
+                                                   double speed_upperbound) {
+    return std::unique_ptr<SolverBackend>(new RiccatiBackend(params, steer_bound, speed_upperbound));
+}
+
+MPC_REGISTER_BACKEND(riccati, make_riccati);
+MPC_REGISTER_BACKEND(rti, make_riccati);
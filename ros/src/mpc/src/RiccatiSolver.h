@@ -0,0 +1,249 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+#include "MPC.h"
+#include "ActiveSetQP.h"
+
+
+///* Solver for the same optimal control problem as `MPC::Solve`, that uses
+///* its stage-wise structure instead of handing it to Ipopt as a general
+///* sparse NLP: the inputs are optimized with Gauss-Newton DDP, i.e. a
+///* Riccati recursion over the horizon with 7x7 (state + previous input) and
+///* 2x2 dense blocks. The work per iteration is linear in `steps_ahead`.
+///*
+///* The states are eliminated by simulating the kinematic model (the same
+///* equations as in FG_eval), and the bounds on the actuators are handled by
+///* clamping in the forward pass.
+///*
+///* With `Params::rti` it does real-time iterations instead: a single
+///* Gauss-Newton step per call, around the previous trajectory shifted by one
+///* step, so the latency is (almost) constant.
+///*
+///* With `Params::active_set_qp` the step is that of the QP condensed on
+///* the inputs, with their bounds (see `qp_pass`), rather than of the
+///* recursion.
+///*
+///* With `Params::sensitivity_updates`, the ticks between full solves only
+///* take the tangential predictor of the last one (see `sensitivity_update`).
+///*
+///* With `Params::linearization_speed_bins`, the RTI step is that of a
+///* linearization of a table made by the constructor (see `scheduled_pass`).
+class RiccatiSolver {
+public:
+    ///* State (x, y, psi, cte, epsi) augmented with the previous input
+    ///* (delta, v), so that the consecutive-actuation penalties become stage
+    ///* costs
+    typedef Eigen::Matrix<double, 7, 1> StateVector;
+    typedef Eigen::Matrix<double, 2, 1> InputVector;
+    typedef Eigen::Matrix<double, 7, 7> StateMatrix;
+    typedef Eigen::Matrix<double, 7, 2> InputMatrix;
+    typedef Eigen::Matrix<double, 2, 7> GainMatrix;
+    typedef Eigen::Matrix<double, 2, 2> InputHessian;
+
+    RiccatiSolver(const Params & params, double steer_bound, double speed_upperbound);
+
+    ///* Same arguments and result layout as `MPC::Solve`: the first
+    ///* actuations followed by the (x, y) of every stage. The iterations stop
+    ///* at `deadline` (every iterate is dynamically feasible). Nothing is
+    ///* allocated once `result` has the right size
+    void Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+               std::vector<double> & result,
+               const std::chrono::steady_clock::time_point & deadline
+                    = std::chrono::steady_clock::time_point::max());
+
+    ///* The next solve starts from scratch, and is a full one
+    void reset_warm_start() {
+        m_u_OK = false;
+        m_sensitivity_OK = false;
+    }
+
+    ///* The weights of the cost of `params`, from the next solve on (which
+    ///* is a full one)
+    void set_weights(const Params & params) {
+        m_params.copy_weights(params);
+        m_sensitivity_OK = false;
+        if (!m_bins.empty())
+            build_bins();
+    }
+
+    ///* Whether the last solve converged (or, stopped by RTI, the budget or
+    ///* the deadline, took a step at least), its cost, and whether the
+    ///* deadline stopped it
+    bool ok() const { return m_ok; }
+    double cost() const { return m_cost; }
+    bool deadline_hit() const { return m_deadline_hit; }
+    int iterations() const { return m_iterations; }
+    ///* Time the last solve spent linearizing the model [s]
+    double eval_time() const { return m_eval_time; }
+    ///* Whether the last solve was a sensitivity update (0 iterations)
+    bool sensitivity_updated() const { return m_sensitivity_updated; }
+
+private:
+    ///* One step of the kinematic model, and its Jacobians w.r.t. s and u
+    void step(const StateVector & s, const InputVector & u, StateVector & s_next) const;
+    void linearize(const StateVector & s, const InputVector & u, StateMatrix & A, InputMatrix & B) const;
+    ///* The same, with the slope of the reference and its derivative at s
+    void linearize(const StateVector & s, const InputVector & u, double fdiff, double fdiff2, StateMatrix & A,
+                   InputMatrix & B) const;
+
+    ///* Simulates the model from `m_s[0]` with the inputs `u`, and returns the cost
+    double rollout(const std::vector<InputVector, Eigen::aligned_allocator<InputVector> > & u,
+                   std::vector<StateVector, Eigen::aligned_allocator<StateVector> > & s) const;
+
+    ///* The derivatives of the (quadratic) cost of stage t of (m_s, m_u)
+    void stage_derivatives(size_t t, StateVector & l_x, InputVector & l_u, StateMatrix & l_xx,
+                           InputHessian & l_uu, GainMatrix & l_ux) const;
+    ///* Its second derivatives alone, which are the same for any trajectory
+    void stage_hessians(size_t t, StateMatrix & l_xx, InputHessian & l_uu, GainMatrix & l_ux) const;
+
+    ///* Backward Riccati recursion around (m_s, m_u); false if Q_uu isn't
+    ///* positive definite at some stage
+    bool backward_pass(double regularization);
+
+    ///* The step of the QP of the linearization around (m_s, m_u) on the
+    ///* changes of the inputs, with the states eliminated and the bounds of
+    ///* the actuators, into `m_k`, with the feedback `m_K` of the backward
+    ///* pass; false if either fails
+    bool qp_pass(double regularization);
+
+    ///* The tangential predictor of the last full solve, for the problem of
+    ///* `m_s[0]`, `m_coeffs` and `m_ref_v`: the last inputs shifted by one
+    ///* step are rolled out, and corrected by the step of the LQ subproblem
+    ///* of the full solve's linearization (kept from its last backward pass,
+    ///* shifted along) with the gradients of the new problem, which is a
+    ///* single back-substitution through the Riccati factors. False, with
+    ///* the shifted inputs in `m_u` (to warm start the full solve from),
+    ///* when the predictor isn't to be trusted: the step is over
+    ///* `Params::sensitivity_tolerance`, or the bounds it hits aren't those
+    ///* of the full solve
+    bool sensitivity_update();
+
+    ///* Keeps the factors of the backward pass at the solution of a full
+    ///* solve, and the bounds active in it
+    void keep_sensitivities();
+
+    ///* A bin of the table of `Params::linearization_speed_bins`: the
+    ///* linearization of the model along the path of its heading error and
+    ///* curvature, at its speed, the factors of the Riccati recursion on it
+    ///* and, with `active_set_qp`, the condensed Hessian of the QP on it
+    ///* and its Cholesky factor (lower triangle)
+    struct LinearizationBin {
+        std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix> > A;
+        std::vector<InputMatrix, Eigen::aligned_allocator<InputMatrix> > B;
+        std::vector<GainMatrix, Eigen::aligned_allocator<GainMatrix> > K;
+        std::vector<InputHessian, Eigen::aligned_allocator<InputHessian> > Q_uu_inv;
+        Eigen::MatrixXd H;
+        Eigen::MatrixXd L;
+        bool OK;
+    };
+
+    ///* Makes the table, in place (with the weights of `m_params`)
+    void build_bins();
+    bool build_bin(double speed, double epsi, double curvature, LinearizationBin & bin);
+
+    ///* The bin of the trajectory (m_s, m_u), by its speed and heading error
+    ///* at the start and the curvature of the path there; null when it's out
+    ///* of the table
+    const LinearizationBin * find_bin() const;
+
+    ///* The step around (m_s, m_u) with the linearization of `bin` instead
+    ///* of its own, into `m_k` (open loop, `m_K` is zero): only the
+    ///* gradient of the cost w.r.t. the inputs is taken along the trajectory
+    ///* (by the adjoint of its states), and back-substituted through the
+    ///* factors of the bin, or, with `active_set_qp`, that of the QP whose
+    ///* Hessian and factor are the bin's. Its predicted decrease of the cost
+    ///* into `m_predicted_decrease`; false if the QP fails
+    bool scheduled_pass(const LinearizationBin & bin);
+
+    InputVector clamp(const InputVector & u) const;
+    ///* The bounds `u` is on, a bit per input
+    uint8_t active_bounds(const InputVector & u) const;
+
+    ///* The first actuations and the (x, y) of every stage, of (m_s, m_u)
+    void write_result(std::vector<double> & result) const;
+
+    double poly(double x) const;
+    double poly_diff(double x) const;
+    double poly_diff2(double x) const;
+
+    Params m_params;
+    size_t m_N;
+    double m_steer_bound;
+    double m_speed_upperbound;
+
+    ///* Data of the current solve
+    Eigen::VectorXd m_coeffs;
+    double m_ref_v;
+
+    ///* Trajectory around which we linearize, and the candidate one
+    std::vector<StateVector, Eigen::aligned_allocator<StateVector> > m_s;
+    std::vector<InputVector, Eigen::aligned_allocator<InputVector> > m_u;
+    std::vector<StateVector, Eigen::aligned_allocator<StateVector> > m_s_new;
+    std::vector<InputVector, Eigen::aligned_allocator<InputVector> > m_u_new;
+
+    ///* Feedforward and feedback terms from the backward pass
+    std::vector<InputVector, Eigen::aligned_allocator<InputVector> > m_k;
+    std::vector<GainMatrix, Eigen::aligned_allocator<GainMatrix> > m_K;
+
+    ///* The linearization of the last backward pass
+    std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix> > m_A;
+    std::vector<InputMatrix, Eigen::aligned_allocator<InputMatrix> > m_B;
+
+    ///* Only used with `sensitivity_updates`: the inverses of the Q_uu of
+    ///* the last backward pass, the factors of that of the last full solve
+    ///* (copied from m_A, m_B, m_K) and the bounds active in it (a bit per
+    ///* input), how many steps they're shifted by since, and whether they
+    ///* stand
+    std::vector<InputHessian, Eigen::aligned_allocator<InputHessian> > m_Q_uu_inv;
+    std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix> > m_sens_A;
+    std::vector<InputMatrix, Eigen::aligned_allocator<InputMatrix> > m_sens_B;
+    std::vector<GainMatrix, Eigen::aligned_allocator<GainMatrix> > m_sens_K;
+    std::vector<InputHessian, Eigen::aligned_allocator<InputHessian> > m_sens_Q_uu_inv;
+    std::vector<uint8_t> m_sens_active;
+    size_t m_sens_shift;
+    bool m_sensitivity_OK;
+    bool m_sensitivity_updated;
+
+    ///* Only used with `active_set_qp`: the QP, and the sensitivities of the
+    ///* state of a stage (and of the next one) to all the inputs
+    std::unique_ptr<ActiveSetQP> m_qp;
+    Eigen::MatrixXd m_S;
+    Eigen::MatrixXd m_S_next;
+    Eigen::Matrix<double, 2, Eigen::Dynamic> m_US;
+
+    ///* Only used with `linearization_speed_bins`: the table, by bin of
+    ///* speed, then of heading error, then of curvature, and the ranges of
+    ///* its bins
+    std::vector<LinearizationBin> m_bins;
+    size_t m_speed_bins;
+    size_t m_epsi_bins;
+    double m_max_epsi;
+    size_t m_curvature_bins;
+    double m_max_curvature;
+    ///* The gradient of the cost w.r.t. the inputs of the trajectory, and
+    ///* the decrease of the cost the step of its bin predicts
+    std::vector<InputVector, Eigen::aligned_allocator<InputVector> > m_gradient;
+    double m_predicted_decrease;
+
+    bool m_ok;
+    double m_cost;
+    bool m_u_OK;
+    bool m_deadline_hit;
+    int m_iterations;
+    double m_eval_time;
+
+    static constexpr int MAX_ITERATIONS = 30;
+    static constexpr int MAX_LINE_SEARCH_STEPS = 8;
+    ///* Relative cost decrease below which we consider the solve converged
+    static constexpr double TOLERANCE = 1e-6;
+    static constexpr double MIN_REGULARIZATION = 1e-8;
+    static constexpr double MAX_REGULARIZATION = 1e6;
+    ///* The share of the decrease of the cost predicted by the subproblem
+    ///* of a bin that its step has to make to be taken
+    static constexpr double SCHEDULED_RATIO = 0.75;
+};
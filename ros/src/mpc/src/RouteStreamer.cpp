@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "RouteStreamer.h"
+#include "Log.h"
+
+
+// Reads `size` bytes at `offset` of the file whole, retrying the short reads
+static bool read_at(int fd, void * data, size_t size, uint64_t offset) {
+    char * p = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, off_t(offset));
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= size_t(n);
+        offset += uint64_t(n);
+    }
+    return true;
+}
+
+
+RouteStreamer::RouteStreamer(size_t tiles_behind, size_t tiles_ahead)
+        : m_tiles_behind(tiles_behind), m_tiles_ahead(std::max(tiles_ahead, size_t(1))), m_fd(-1), m_current(-1),
+          m_num_resident(0), m_wanted(-1), m_built(-1), m_stop(false)
+{
+    std::memset(&m_header, 0, sizeof(m_header));
+}
+
+
+RouteStreamer::~RouteStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+
+bool RouteStreamer::open(const std::string & path) {
+    m_path = path;
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+        MPC_ERROR("Could not open the route %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    bool OK = read_at(m_fd, &m_header, sizeof(m_header), 0)
+            and std::memcmp(m_header.magic, RouteTilesHeader::MAGIC, sizeof(m_header.magic)) == 0
+            and m_header.version == RouteTilesHeader::VERSION and m_header.num_tiles > 0;
+    if (OK) {
+        m_tiles.resize(m_header.num_tiles);
+        OK = read_at(m_fd, m_tiles.data(), m_tiles.size() * sizeof(RouteTile), sizeof(m_header));
+    }
+    if (!OK) {
+        MPC_ERROR("%s is not a tiled route (of this version of the node)", path.c_str());
+        m_tiles.clear();
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_thread = std::thread(&RouteStreamer::loop, this);
+    MPC_INFO("Route %s: %lu points in %lu tiles", path.c_str(), m_header.num_points, m_header.num_tiles);
+    return true;
+}
+
+
+bool RouteStreamer::neighbour(size_t tile, long offset, size_t & result) const {
+    long n = long(m_tiles.size());
+    long t = long(tile) + offset;
+    if (m_header.closed)
+        t = ((t % n) + n) % n;
+    if (t < 0 or t >= n)
+        return false;
+    result = size_t(t);
+    return true;
+}
+
+
+void RouteStreamer::update(double x, double y) {
+    if (m_tiles.empty())
+        return;
+
+    // Of the tile of the last pose and its neighbours, or of all of them
+    long best = -1;
+    double best_dist2 = std::numeric_limits<double>::infinity();
+    auto visit = [&](size_t t) {
+        double dx = m_tiles[t].center_x - x, dy = m_tiles[t].center_y - y;
+        if (dx*dx + dy*dy < best_dist2) {
+            best_dist2 = dx*dx + dy*dy;
+            best = long(t);
+        }
+    };
+    if (m_current < 0) {
+        for (size_t t=0; t < m_tiles.size(); t++)
+            visit(t);
+    } else {
+        for (long offset=-1; offset <= 1; offset++) {
+            size_t t;
+            if (neighbour(size_t(m_current), offset, t))
+                visit(t);
+        }
+    }
+    if (best == m_current)
+        return;
+    m_current = best;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wanted = best;
+    }
+    m_cv.notify_one();
+}
+
+
+std::shared_ptr<Centerline> RouteStreamer::take() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<Centerline> centerline;
+    centerline.swap(m_ready);
+    return centerline;
+}
+
+
+void RouteStreamer::loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this]() { return m_stop or m_wanted != m_built; });
+        if (m_stop)
+            return;
+        size_t tile = size_t(m_wanted);
+        lock.unlock();
+
+        // The tiles to keep: those of the path, ahead first, and the next one
+        // ahead, which is read once the path is made
+        std::vector<size_t> keep;
+        for (long offset=0; offset <= long(m_tiles_ahead); offset++) {
+            size_t t;
+            if (neighbour(tile, offset, t))
+                keep.push_back(t);
+        }
+        for (long offset=1; offset <= long(m_tiles_behind); offset++) {
+            size_t t;
+            if (neighbour(tile, -offset, t))
+                keep.push_back(t);
+        }
+        size_t prefetch;
+        bool prefetching = neighbour(tile, long(m_tiles_ahead) + 1, prefetch);
+        for (auto it = m_resident.begin(); it != m_resident.end(); ) {
+            bool kept = (std::find(keep.begin(), keep.end(), it->first) != keep.end())
+                    or (prefetching and it->first == prefetch);
+            if (kept)
+                ++it;
+            else
+                it = m_resident.erase(it);
+        }
+
+        bool OK = true;
+        for (size_t t : keep)
+            OK = load(t) and OK;
+        std::shared_ptr<Centerline> centerline = OK ? make_centerline(tile) : nullptr;
+        lock.lock();
+        if (centerline)
+            m_ready = centerline;
+        m_built = long(tile);
+        lock.unlock();
+
+        if (prefetching)
+            load(prefetch);
+        m_num_resident.store(m_resident.size(), std::memory_order_relaxed);
+        lock.lock();
+    }
+}
+
+
+bool RouteStreamer::load(size_t tile) {
+    if (m_resident.count(tile) > 0)
+        return true;
+    const RouteTile & entry = m_tiles[tile];
+    TileData data;
+    bool OK = true;
+    uint64_t offset = entry.offset;
+    for (std::vector<double> * column : {&data.x, &data.y, &data.yaw, &data.speed}) {
+        column->resize(entry.count);
+        OK = OK and read_at(m_fd, column->data(), entry.count * sizeof(double), offset);
+        offset += entry.count * sizeof(double);
+    }
+    if (!OK) {
+        MPC_ERROR("Could not read tile %lu of the route %s", tile, m_path.c_str());
+        return false;
+    }
+    m_resident[tile] = std::move(data);
+    return true;
+}
+
+
+std::shared_ptr<Centerline> RouteStreamer::make_centerline(size_t tile) const {
+    // From the first tile behind to the last one ahead, in the order of the
+    // route (the whole of a short loop from its start, so it's closed)
+    size_t first = tile;
+    long num = 1;
+    for (long offset=1; offset <= long(m_tiles_behind) and neighbour(tile, -offset, first); offset++)
+        num++;
+    neighbour(tile, -(num - 1), first);
+    size_t last;
+    for (long offset=1; offset <= long(m_tiles_ahead) and neighbour(tile, offset, last); offset++)
+        num++;
+    if (m_header.closed and num >= long(m_tiles.size())) {
+        first = 0;
+        num = long(m_tiles.size());
+    }
+
+    std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>();
+    for (long k=0; k < num; k++) {
+        size_t t;
+        neighbour(first, k, t);
+        const TileData & data = m_resident.at(t);
+        centerline->pts_x.insert(centerline->pts_x.end(), data.x.begin(), data.x.end());
+        centerline->pts_y.insert(centerline->pts_y.end(), data.y.begin(), data.y.end());
+        centerline->yaw.insert(centerline->yaw.end(), data.yaw.begin(), data.yaw.end());
+        centerline->speed.insert(centerline->speed.end(), data.speed.begin(), data.speed.end());
+    }
+    // Another path for every span of tiles
+    centerline->hash = m_header.hash ^ ((uint64_t(first) + 1) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(num) << 48);
+    return centerline;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PathTracker.h"
+#include "WaypointLoader.h"
+
+
+///* The path of a route too long to hold whole (see `Params::route_tiles`),
+///* from its tiled file (see `write_route_tiles`): only the tiles about the
+///* car are in memory, `tiles_behind` behind the one it's in and
+///* `tiles_ahead` ahead of it, and the path is theirs.
+///*
+///* The tile the car is in is the one of the nearest center of the tile of
+///* the last pose and its two neighbours (of all of them at first). When it
+///* changes, a thread of the streamer's reads the tiles the path lacks,
+///* ahead first, drops those behind, and makes the path of the new tiles;
+///* then it reads the next tile ahead too, so that it's there by the time
+///* the car gets to it. The caller picks the path up with `take` and swaps
+///* it in as a new one (so the ticks themselves never wait for the disk).
+class RouteStreamer {
+public:
+    RouteStreamer(size_t tiles_behind, size_t tiles_ahead);
+    ~RouteStreamer();
+
+    ///* Reads the index of the route at `path` and starts the thread; false
+    ///* (and logs why) if it's not a tiled route
+    bool open(const std::string & path);
+
+    ///* The car is at (x, y)
+    void update(double x, double y);
+
+    ///* The path of the tiles about the car, when there's a new one since
+    ///* the last call (nullptr otherwise): its points, yaw and speed, none of
+    ///* the structures derived from them
+    std::shared_ptr<Centerline> take();
+
+    size_t num_tiles() const { return m_tiles.size(); }
+    size_t resident_tiles() const { return m_num_resident.load(std::memory_order_relaxed); }
+
+private:
+    struct TileData {
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> yaw;
+        std::vector<double> speed;
+    };
+
+    void loop();
+
+    ///* The tile `offset` tiles from `tile`, false past the ends of a route
+    ///* that isn't a loop
+    bool neighbour(size_t tile, long offset, size_t & result) const;
+
+    ///* Reads the tile into the resident ones (unless it's there already);
+    ///* false (and logs why) if it can't
+    bool load(size_t tile);
+
+    ///* The path of the resident tiles about `tile`
+    std::shared_ptr<Centerline> make_centerline(size_t tile) const;
+
+    size_t m_tiles_behind;
+    size_t m_tiles_ahead;
+
+    std::string m_path;
+    int m_fd;
+    RouteTilesHeader m_header;
+    std::vector<RouteTile> m_tiles;
+
+    ///* The tile the car is in (-1: not known yet), by `update`
+    long m_current;
+
+    ///* Of the thread only
+    std::map<size_t, TileData> m_resident;
+    std::atomic<size_t> m_num_resident;
+
+    ///* The tile the path is wanted about, the one the last path is about,
+    ///* and that path until it's taken
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    long m_wanted;
+    long m_built;
+    std::shared_ptr<Centerline> m_ready;
+    bool m_stop;
+    std::thread m_thread;
+};
@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cmath>
+
+#include "SQPSolver.h"
+#include "SolverBackend.h"
+#include "VehicleModel.h"
+#include "Log.h"
+
+
+constexpr int SQPSolver::MAX_ITERATIONS;
+constexpr int SQPSolver::MAX_LINE_SEARCH_STEPS;
+constexpr int SQPSolver::MAX_ACTIVE_SET_PASSES;
+constexpr double SQPSolver::TOLERANCE;
+constexpr double SQPSolver::ARMIJO;
+constexpr double SQPSolver::BOUND_TOLERANCE;
+constexpr double SQPSolver::MIN_REGULARIZATION;
+constexpr double SQPSolver::MAX_REGULARIZATION;
+constexpr double SQPSolver::DUAL_REGULARIZATION;
+
+
+// Same layout of the variables as in MPC::MPC, with the kinematic model
+static Indexes kinematic_indexes(const Params & params) {
+    Indexes indexes;
+    indexes.x_start = 0;
+    indexes.y_start = indexes.x_start + params.steps_ahead;
+    indexes.psi_start = indexes.y_start + params.steps_ahead;
+    indexes.cte_start = indexes.psi_start + params.steps_ahead;
+    indexes.epsi_start = indexes.cte_start + params.steps_ahead;
+    indexes.extra_start = indexes.epsi_start + params.steps_ahead;
+    indexes.steps_ahead = params.steps_ahead;
+    indexes.delta_start = indexes.extra_start;
+    indexes.v_start = indexes.delta_start + params.steps_ahead - 1;
+    return indexes;
+}
+
+
+// The Newton steps need the derivatives in double
+static Params double_precision(const Params & params) {
+    Params copy(params);
+    copy.precision = "double";
+    return copy;
+}
+
+
+SQPSolver::SQPSolver(const Params & params, double steer_bound, double speed_upperbound)
+        : m_params(params), m_indexes(kinematic_indexes(params)), m_model(double_precision(params), m_indexes),
+          m_n(params.steps_ahead * 5 + (params.steps_ahead - 1) * 2), m_m(params.steps_ahead * 5),
+          m_steer_bound(steer_bound), m_speed_upperbound(speed_upperbound),
+          m_cte_lower(nullptr), m_cte_upper(nullptr),
+          m_lower(m_n), m_upper(m_n), m_rhs(Eigen::VectorXd::Zero(m_m)),
+          m_x(Eigen::VectorXd::Zero(m_n)), m_lambda(Eigen::VectorXd::Zero(m_m)), m_x_new(m_n), m_x_OK(false),
+          m_f(0.0), m_grad(m_n), m_g(m_m), m_g_new(m_m),
+          m_jac_values(m_model.jac_row().size()), m_hes_values(m_model.hes_row().size()),
+          m_grad_lagrangian(m_n), m_fixed(m_n, 0),
+          m_kkt(m_n + m_m, m_n + m_m), m_kkt_rhs(m_n + m_m), m_kkt_step(m_n + m_m),
+          m_rho(MIN_REGULARIZATION), m_mu(0.0),
+          m_ok(false), m_cost(0.0), m_deadline_hit(false), m_iterations(0), m_constraint_violation(0.0),
+          m_eval_time(0.0), m_linear_solver_time(0.0)
+{
+    // The pattern of the lower triangle of the KKT matrix: the Hessian, the
+    // diagonal (for the regularizations and the fixed variables), the
+    // Jacobian below it and the diagonal of the constraints
+    const std::vector<size_t> & hes_row = m_model.hes_row();
+    const std::vector<size_t> & hes_col = m_model.hes_col();
+    const std::vector<size_t> & jac_row = m_model.jac_row();
+    const std::vector<size_t> & jac_col = m_model.jac_col();
+    std::vector<Eigen::Triplet<double> > entries;
+    entries.reserve(hes_row.size() + jac_row.size() + m_n + m_m);
+    for (size_t k=0; k < hes_row.size(); k++)
+        entries.emplace_back(int(hes_row[k]), int(hes_col[k]), 0.0);
+    for (size_t k=0; k < jac_row.size(); k++)
+        entries.emplace_back(int(m_n + jac_row[k]), int(jac_col[k]), 0.0);
+    for (size_t i=0; i < m_n + m_m; i++)
+        entries.emplace_back(int(i), int(i), 0.0);
+    m_kkt.setFromTriplets(entries.begin(), entries.end());
+    m_kkt.makeCompressed();
+
+    // Every entry's slot in the values, which the iterations write
+    const double * values = m_kkt.valuePtr();
+    m_hes_slot.resize(hes_row.size());
+    for (size_t k=0; k < hes_row.size(); k++)
+        m_hes_slot[k] = size_t(&m_kkt.coeffRef(int(hes_row[k]), int(hes_col[k])) - values);
+    m_jac_slot.resize(jac_row.size());
+    for (size_t k=0; k < jac_row.size(); k++)
+        m_jac_slot[k] = size_t(&m_kkt.coeffRef(int(m_n + jac_row[k]), int(jac_col[k])) - values);
+    m_diagonal_slot.resize(m_n + m_m);
+    for (size_t i=0; i < m_n + m_m; i++)
+        m_diagonal_slot[i] = size_t(&m_kkt.coeffRef(int(i), int(i)) - values);
+
+    // The ordering and the symbolic factorization only depend on the pattern
+    m_ldlt.analyzePattern(m_kkt);
+
+    // The bounds of the actuators; the others are set on every solve
+    for (size_t i=0; i < m_n; i++) {
+        m_lower[i] = -1.0e19;
+        m_upper[i] = 1.0e19;
+    }
+    for (size_t i=m_indexes.delta_start; i < m_indexes.v_start; i++) {
+        m_lower[i] = -steer_bound;
+        m_upper[i] = steer_bound;
+    }
+    for (size_t i=m_indexes.v_start; i < m_n; i++) {
+        m_lower[i] = 0.0;
+        m_upper[i] = speed_upperbound;
+    }
+}
+
+
+void SQPSolver::initial_guess(double ref_v) {
+    size_t N = m_params.steps_ahead;
+    bool budget = (m_params.iterations_per_tick > 0);
+    if ((m_params.warm_start or budget) and m_x_OK) {
+        // Every block of N states (and of N rows of their constraints) and
+        // of N - 1 actuations moves one step ahead, its last one repeated
+        for (size_t start=0; start < m_indexes.delta_start; start += N) {
+            for (size_t t=0; t + 1 < N; t++) {
+                m_x[start + t] = m_x[start + t + 1];
+                m_lambda[start + t] = m_lambda[start + t + 1];
+            }
+        }
+        for (size_t start=m_indexes.delta_start; start < m_n; start += N - 1) {
+            for (size_t t=0; t + 2 < N; t++)
+                m_x[start + t] = m_x[start + t + 1];
+        }
+    } else {
+        // Straight on from the initial state
+        double v = std::max(0.0, std::min(ref_v, m_speed_upperbound));
+        for (size_t t=0; t < N; t++) {
+            m_x[m_indexes.x_start + t] = m_rhs[m_indexes.x_start] + t * v * m_params.dt
+                                         * std::cos(m_rhs[m_indexes.psi_start]);
+            m_x[m_indexes.y_start + t] = m_rhs[m_indexes.y_start] + t * v * m_params.dt
+                                         * std::sin(m_rhs[m_indexes.psi_start]);
+            m_x[m_indexes.psi_start + t] = m_rhs[m_indexes.psi_start];
+            m_x[m_indexes.cte_start + t] = m_rhs[m_indexes.cte_start];
+            m_x[m_indexes.epsi_start + t] = m_rhs[m_indexes.epsi_start];
+        }
+        for (size_t t=0; t + 1 < N; t++) {
+            m_x[m_indexes.delta_start + t] = 0.0;
+            m_x[m_indexes.v_start + t] = v;
+        }
+        m_lambda.setZero();
+    }
+
+    // The initial state is the problem's, and every variable within its
+    // bounds
+    for (size_t start=0; start < m_indexes.delta_start; start += N)
+        m_x[start] = m_rhs[start];
+    m_x = m_x.cwiseMax(m_lower).cwiseMin(m_upper);
+}
+
+
+void SQPSolver::evaluate() {
+    auto start = std::chrono::steady_clock::now();
+    m_f = m_model.cost(m_x.data());
+    m_model.gradient(m_x.data(), m_grad.data());
+    m_model.constraints(m_x.data(), m_g.data());
+    m_g -= m_rhs;
+    m_model.jacobian(m_x.data(), m_jac_values.data());
+    m_eval_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+double SQPSolver::fix_active_bounds() {
+    const std::vector<size_t> & jac_row = m_model.jac_row();
+    const std::vector<size_t> & jac_col = m_model.jac_col();
+    m_grad_lagrangian = m_grad;
+    for (size_t k=0; k < jac_row.size(); k++)
+        m_grad_lagrangian[jac_col[k]] += m_jac_values[k] * m_lambda[jac_row[k]];
+
+    double residual = 0.0;
+    for (size_t i=0; i < m_n; i++) {
+        double gradient = m_grad_lagrangian[i];
+        bool at_lower = (m_x[i] <= m_lower[i] + BOUND_TOLERANCE);
+        bool at_upper = (m_x[i] >= m_upper[i] - BOUND_TOLERANCE);
+        m_fixed[i] = ((at_lower and gradient > 0.0) or (at_upper and gradient < 0.0)) ? 1 : 0;
+        if (!m_fixed[i])
+            residual = std::max(residual, std::abs(gradient));
+    }
+    return residual;
+}
+
+
+bool SQPSolver::factorize(double rho) {
+    const std::vector<size_t> & hes_row = m_model.hes_row();
+    const std::vector<size_t> & hes_col = m_model.hes_col();
+    const std::vector<size_t> & jac_col = m_model.jac_col();
+
+    // The rows and columns of the fixed variables are those of the identity
+    double * values = m_kkt.valuePtr();
+    std::fill(values, values + m_kkt.nonZeros(), 0.0);
+    for (size_t i=0; i < m_n; i++)
+        values[m_diagonal_slot[i]] = m_fixed[i] ? 1.0 : rho;
+    for (size_t j=0; j < m_m; j++)
+        values[m_diagonal_slot[m_n + j]] = -DUAL_REGULARIZATION;
+    for (size_t k=0; k < hes_row.size(); k++)
+        if (!m_fixed[hes_row[k]] and !m_fixed[hes_col[k]])
+            values[m_hes_slot[k]] += m_hes_values[k];
+    for (size_t k=0; k < jac_col.size(); k++)
+        if (!m_fixed[jac_col[k]])
+            values[m_jac_slot[k]] += m_jac_values[k];
+
+    m_ldlt.factorize(m_kkt);
+    if (m_ldlt.info() != Eigen::Success)
+        return false;
+
+    // A minimum: the Hessian positive definite on the null space of the
+    // Jacobian, i.e. as many positive pivots as variables
+    size_t positive = 0, negative = 0;
+    const Eigen::VectorXd & D = m_ldlt.vectorD();
+    for (int i=0; i < D.size(); i++) {
+        if (D[i] > 0.0)
+            positive++;
+        else if (D[i] < 0.0)
+            negative++;
+    }
+    return positive == m_n and negative == m_m;
+}
+
+
+bool SQPSolver::newton_step() {
+    for (int pass=0; ; pass++) {
+        // The Hessian convexified as much as needed
+        bool factorized = factorize(m_rho);
+        while (!factorized and m_rho < MAX_REGULARIZATION) {
+            m_rho *= 10;
+            factorized = factorize(m_rho);
+        }
+        if (!factorized)
+            return false;
+        for (size_t i=0; i < m_n; i++)
+            m_kkt_rhs[i] = m_fixed[i] ? 0.0 : -m_grad[i];
+        // With the multipliers of the iterate as the center of the dual
+        // regularization, the step meets the linearized constraints exactly
+        // at a solution, however large the multipliers are
+        m_kkt_rhs.tail(m_m) = -m_g - DUAL_REGULARIZATION * m_lambda;
+        m_kkt_step = m_ldlt.solve(m_kkt_rhs);
+
+        // The variables at a bound that the step leaves through are held at
+        // it too (the projection would cut the step short of the
+        // constraints)
+        bool more = false;
+        for (size_t i=0; i < m_n and pass < MAX_ACTIVE_SET_PASSES; i++) {
+            if (!m_fixed[i] and ((m_x[i] <= m_lower[i] + BOUND_TOLERANCE and m_kkt_step[i] < 0.0)
+                                 or (m_x[i] >= m_upper[i] - BOUND_TOLERANCE and m_kkt_step[i] > 0.0))) {
+                m_fixed[i] = 1;
+                more = true;
+            }
+        }
+        if (!more)
+            return true;
+    }
+}
+
+
+double SQPSolver::l1_violation(const Eigen::VectorXd & g) const {
+    return g.lpNorm<1>();
+}
+
+
+void SQPSolver::write_result(std::vector<double> & result) const {
+    size_t N = m_params.steps_ahead;
+    result.resize(2 + 2*N);
+    result[0] = m_x[m_indexes.delta_start];
+    result[1] = m_x[m_indexes.v_start];
+    for (size_t t=0; t < N; t++) {
+        result[2 + 2*t] = m_x[m_indexes.x_start + t];
+        result[3 + 2*t] = m_x[m_indexes.y_start + t];
+    }
+}
+
+
+void SQPSolver::Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                      std::vector<double> & result, const std::chrono::steady_clock::time_point & deadline) {
+    size_t N = m_params.steps_ahead;
+    m_model.set_problem(coeffs, ref_v);
+    m_deadline_hit = false;
+    m_eval_time = 0.0;
+    m_linear_solver_time = 0.0;
+
+    // The rows of the initial state equal it, the others are 0
+    m_rhs[m_indexes.x_start] = state[0];
+    m_rhs[m_indexes.y_start] = state[1];
+    m_rhs[m_indexes.psi_start] = state[2];
+    m_rhs[m_indexes.cte_start] = state[3];
+    m_rhs[m_indexes.epsi_start] = state[4];
+
+    // A car out of the corridor already only has to get no farther out
+    for (size_t t=1; t < N; t++) {
+        size_t i = m_indexes.cte_start + t;
+        m_lower[i] = (m_cte_lower != nullptr) ? std::min(m_cte_lower[t], state[3]) : -1.0e19;
+        m_upper[i] = (m_cte_upper != nullptr) ? std::max(m_cte_upper[t], state[3]) : 1.0e19;
+    }
+
+    initial_guess(ref_v);
+    evaluate();
+
+    bool budget = (m_params.iterations_per_tick > 0);
+    int max_iterations = budget ? m_params.iterations_per_tick : MAX_ITERATIONS;
+    m_mu = 0.0;
+    m_rho = MIN_REGULARIZATION;
+    bool converged = false;
+    int iter = 0;
+    for (;;) {
+        double dual_residual = fix_active_bounds();
+        if (m_g.lpNorm<Eigen::Infinity>() <= TOLERANCE
+                and dual_residual <= TOLERANCE * std::max(1.0, m_grad.lpNorm<Eigen::Infinity>())) {
+            converged = true;
+            break;
+        }
+        if (iter >= max_iterations)
+            break;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            m_deadline_hit = true;
+            break;
+        }
+
+        auto eval_start = std::chrono::steady_clock::now();
+        m_model.hessian(m_x.data(), 1.0, m_lambda.data(), m_hes_values.data());
+        auto solve_start = std::chrono::steady_clock::now();
+        m_eval_time += std::chrono::duration<double>(solve_start - eval_start).count();
+
+        bool stepped = newton_step();
+        m_linear_solver_time += std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                              - solve_start).count();
+        if (!stepped)
+            break;
+        iter++;
+        auto dx = m_kkt_step.head(m_n);
+        auto lambda_step = m_kkt_step.tail(m_m);
+
+        // Backtracking on the l1 merit function, whose penalty outweighs
+        // the multipliers
+        m_mu = std::max(m_mu, 1.1 * lambda_step.lpNorm<Eigen::Infinity>());
+        double violation = l1_violation(m_g);
+        double merit = m_f + m_mu * violation;
+        double slope = std::min(m_grad.dot(dx) - m_mu * violation, 0.0);
+        double alpha = 1.0;
+        bool accepted = false;
+        for (int ls=0; ls < MAX_LINE_SEARCH_STEPS; ls++) {
+            m_x_new = (m_x + alpha * dx).cwiseMax(m_lower).cwiseMin(m_upper);
+            auto start = std::chrono::steady_clock::now();
+            double f_new = m_model.cost(m_x_new.data());
+            m_model.constraints(m_x_new.data(), m_g_new.data());
+            m_g_new -= m_rhs;
+            m_eval_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (std::isfinite(f_new) and f_new + m_mu * l1_violation(m_g_new) <= merit + ARMIJO * alpha * slope) {
+                accepted = true;
+                break;
+            }
+            alpha *= 0.5;
+        }
+
+        if (!accepted) {
+            // No decrease along the step: a (projected) stationary point, or
+            // a Hessian to convexify more
+            m_rho *= 10;
+            if (m_rho > MAX_REGULARIZATION)
+                break;
+            continue;
+        }
+        m_x.swap(m_x_new);
+        m_lambda += alpha * (lambda_step - m_lambda);
+        m_rho = std::max(m_rho / 10, MIN_REGULARIZATION);
+        evaluate();
+    }
+
+    m_cost = m_f;
+    m_iterations = iter;
+    m_constraint_violation = m_g.lpNorm<Eigen::Infinity>();
+    m_ok = (converged or budget or m_deadline_hit) and std::isfinite(m_f);
+    m_x_OK = m_ok;
+    write_result(result);
+}
+
+
+// The backend "sqp"
+class SQPBackend : public SolverBackend {
+public:
+    SQPBackend(const Params & params, double steer_bound, double speed_upperbound)
+            : m_solver(params, steer_bound, speed_upperbound) {}
+
+    void solve(const SolveProblem & problem, std::vector<double> & result, SolveStats & stats) {
+        m_solver.Solve(problem.state, problem.coeffs, problem.ref_v, result, problem.deadline);
+        stats.deadline_hit = m_solver.deadline_hit();
+        stats.fallback = FALLBACK_NONE;
+        stats.cost = m_solver.cost();
+        stats.ok = m_solver.ok();
+        stats.iterations = m_solver.iterations();
+        stats.restoration = false;
+        stats.diverged = false;
+        stats.constraint_violation = m_solver.constraint_violation();
+        stats.eval_time = m_solver.eval_time();
+        stats.linear_solver_time = m_solver.linear_solver_time();
+    }
+
+    void reset_warm_start() { m_solver.reset_warm_start(); }
+    void set_weights(const Params & params) { m_solver.set_weights(params); }
+    void set_cte_bounds(const double * lower, const double * upper) { m_solver.set_cte_bounds(lower, upper); }
+
+private:
+    SQPSolver m_solver;
+};
+
+
+// KinematicModel has the NLP of the kinematic model on the polynomial
+// reference, with the bounds of the actuators alone
+static std::unique_ptr<SolverBackend> make_sqp(const Params & params, double steer_bound,
+                                               double speed_upperbound) {
+    if (params.vehicle_model != KinematicBicycle::name() or params.contouring_reference
+            or !params.input_blocks.empty() or !params.dt_steps.empty() or params.terminal_cte > 0.0
+            or params.terminal_epsi > 0.0 or params.max_steer_rate > 0.0 or params.max_obstacles > 0) {
+        MPC_WARN("The sqp backend needs the kinematic model, the polynomial reference, neither input_blocks "
+                 "nor dt_steps, and neither terminal_cte, terminal_epsi, max_steer_rate nor max_obstacles");
+        return nullptr;
+    }
+    return std::unique_ptr<SolverBackend>(new SQPBackend(params, steer_bound, speed_upperbound));
+}
+
+MPC_REGISTER_BACKEND(sqp, make_sqp);
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCore"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "MPC.h"
+#include "KinematicModel.h"
+
+
+///* Solver for the same NLP as `MPC::Solve` with Ipopt (that of FG_eval,
+///* with the kinematic model and the polynomial reference), on the vendored
+///* Eigen alone (see the backend "sqp"): sequential quadratic programming,
+///* a Newton step on the KKT conditions per iteration.
+///*
+///* The NLP is evaluated by KinematicModel, whose patterns are fixed, so the
+///* KKT matrix
+///*
+///*   [ H + rho I   J^T       ]
+///*   [ J           -delta I  ]
+///*
+///* (lower triangle) is a SparseMatrix whose pattern is built once, with the
+///* slot of every entry of the Hessian and the Jacobian in it: an iteration
+///* writes the values and factorizes it with SimplicialLDLT, whose ordering
+///* and symbolic analysis are done once too. `rho` is raised until the
+///* factorization has the inertia of a minimum (n positive pivots, m
+///* negative), and `delta` keeps the matrix quasi-definite, which LDLT
+///* factorizes without pivoting.
+///*
+///* The only inequalities are bounds on variables (the actuators, and the cte
+///* with `Params::corridor_width`): those that are at a bound that the
+///* gradient of the Lagrangian pushes against, or that the step leaves
+///* through, are fixed for the step (their rows and columns are those of
+///* the identity), and the steps are projected on the bounds. The step
+///* length is that of a backtracking line search on the l1 merit function,
+///* cost + mu |constraints|.
+///*
+///* The solves are warm started from the previous solution and multipliers,
+///* shifted by one step.
+class SQPSolver {
+public:
+    SQPSolver(const Params & params, double steer_bound, double speed_upperbound);
+
+    ///* Same arguments and result layout as `MPC::Solve`: the first
+    ///* actuations followed by the (x, y) of every stage. The iterations stop
+    ///* at `deadline`, with the last iterate
+    void Solve(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+               std::vector<double> & result,
+               const std::chrono::steady_clock::time_point & deadline
+                    = std::chrono::steady_clock::time_point::max());
+
+    ///* The next solve starts from straight driving at the reference speed
+    void reset_warm_start() { m_x_OK = false; }
+
+    void set_weights(const Params & params) {
+        m_params.copy_weights(params);
+        m_model.set_weights(params);
+    }
+
+    ///* The bounds of the cte of every step, read on every solve; null for
+    ///* none (see `SolverBackend::set_cte_bounds`)
+    void set_cte_bounds(const double * lower, const double * upper) {
+        m_cte_lower = lower;
+        m_cte_upper = upper;
+    }
+
+    ///* Whether the last solve converged (or was stopped by the deadline or
+    ///* the iteration budget with a finite cost), its cost, and the rest of
+    ///* its statistics
+    bool ok() const { return m_ok; }
+    double cost() const { return m_cost; }
+    bool deadline_hit() const { return m_deadline_hit; }
+    int iterations() const { return m_iterations; }
+    double constraint_violation() const { return m_constraint_violation; }
+    ///* Time the last solve spent evaluating the NLP, and factorizing and
+    ///* solving the KKT systems [s]
+    double eval_time() const { return m_eval_time; }
+    double linear_solver_time() const { return m_linear_solver_time; }
+
+private:
+    typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+    ///* The initial guess: the last solution and its multipliers shifted by
+    ///* one step, or straight driving at `ref_v` from the initial state
+    void initial_guess(double ref_v);
+
+    ///* The NLP at `m_x`: cost, gradient, constraints (less their bounds)
+    ///* and the Jacobian, into the buffers
+    void evaluate();
+
+    ///* Which variables are held at their bounds for the next step, from the
+    ///* gradient of the Lagrangian at `m_x` with `m_lambda`, and the largest
+    ///* part of it (projected on the bounds) there
+    double fix_active_bounds();
+
+    ///* Writes the KKT matrix of `m_x` and `m_lambda` with `rho` and
+    ///* factorizes it; false if it fails or hasn't the inertia of a minimum
+    bool factorize(double rho);
+
+    ///* The step of the iterate and the next multipliers into `m_kkt_step`;
+    ///* false if no regularization gives a minimum
+    bool newton_step();
+
+    ///* l1 norm of the constraints of `g` (less their bounds)
+    double l1_violation(const Eigen::VectorXd & g) const;
+
+    ///* The first actuations and the (x, y) of every stage of `m_x`
+    void write_result(std::vector<double> & result) const;
+
+    Params m_params;
+    Indexes m_indexes;
+    KinematicModel m_model;
+    size_t m_n;
+    size_t m_m;
+    double m_steer_bound;
+    double m_speed_upperbound;
+    const double * m_cte_lower;
+    const double * m_cte_upper;
+
+    ///* The bounds of the variables of the current solve, and the right hand
+    ///* sides of the constraints (the initial state, 0 for the others)
+    Eigen::VectorXd m_lower;
+    Eigen::VectorXd m_upper;
+    Eigen::VectorXd m_rhs;
+
+    ///* The iterate, its multipliers and the candidate of the line search
+    Eigen::VectorXd m_x;
+    Eigen::VectorXd m_lambda;
+    Eigen::VectorXd m_x_new;
+    bool m_x_OK;
+
+    ///* The evaluations at `m_x`
+    double m_f;
+    Eigen::VectorXd m_grad;
+    Eigen::VectorXd m_g;
+    Eigen::VectorXd m_g_new;
+    std::vector<double> m_jac_values;
+    std::vector<double> m_hes_values;
+    Eigen::VectorXd m_grad_lagrangian;
+    std::vector<char> m_fixed;
+
+    ///* The KKT matrix, and where the entries of the Hessian, of the
+    ///* Jacobian and of the diagonal are in its values
+    SparseMatrix m_kkt;
+    std::vector<size_t> m_hes_slot;
+    std::vector<size_t> m_jac_slot;
+    std::vector<size_t> m_diagonal_slot;
+    Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower> m_ldlt;
+    Eigen::VectorXd m_kkt_rhs;
+    Eigen::VectorXd m_kkt_step;
+
+    double m_rho;
+    double m_mu;
+
+    bool m_ok;
+    double m_cost;
+    bool m_deadline_hit;
+    int m_iterations;
+    double m_constraint_violation;
+    double m_eval_time;
+    double m_linear_solver_time;
+
+    static constexpr int MAX_ITERATIONS = 50;
+    static constexpr int MAX_LINE_SEARCH_STEPS = 12;
+    ///* Factorizations of a step with more bounds held each time
+    static constexpr int MAX_ACTIVE_SET_PASSES = 4;
+    ///* The KKT conditions are met to this (the constraints, and the
+    ///* gradient of the Lagrangian relative to that of the cost)
+    static constexpr double TOLERANCE = 1e-6;
+    ///* Sufficient decrease of the merit function (Armijo)
+    static constexpr double ARMIJO = 1e-4;
+    ///* How close to a bound a variable is at it
+    static constexpr double BOUND_TOLERANCE = 1e-9;
+    static constexpr double MIN_REGULARIZATION = 1e-8;
+    static constexpr double MAX_REGULARIZATION = 1e6;
+    ///* The negative regularization of the constraints
+    static constexpr double DUAL_REGULARIZATION = 1e-9;
+};
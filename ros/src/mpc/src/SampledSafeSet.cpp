@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cmath>
+
+#include "SampledSafeSet.h"
+
+
+const size_t SampledSafeSet::MIN_NEIGHBORS;
+const size_t SampledSafeSet::MAX_NEIGHBORS;
+constexpr double SampledSafeSet::BIN_LENGTH;
+constexpr double SampledSafeSet::SCALE_S;
+constexpr double SampledSafeSet::SCALE_CTE;
+constexpr double SampledSafeSet::SCALE_EPSI;
+constexpr double SampledSafeSet::SCALE_V;
+constexpr double SampledSafeSet::TEMPERATURE;
+constexpr double SampledSafeSet::MIN_SPEED;
+constexpr double SampledSafeSet::MAX_STEP;
+
+
+SampledSafeSet::SampledSafeSet(size_t capacity, size_t neighbors)
+        : m_num_bins(0), m_bin_size(0), m_bin_length(BIN_LENGTH), m_length(0.0), m_size(0), m_num_laps(0),
+          m_lap_size(0), m_lap_OK(false), m_started(false), m_laps(0), m_last_s(0.0) {
+    capacity = std::max(capacity, MIN_NEIGHBORS);
+    m_neighbors = std::min(std::max(neighbors, MIN_NEIGHBORS), std::min(MAX_NEIGHBORS, capacity));
+    m_samples.resize(capacity);
+    // Every bin has room for the neighbors at least
+    m_counts.resize(capacity / m_neighbors);
+    m_lap.resize(capacity);
+    m_lap_times.resize(capacity);
+}
+
+
+void SampledSafeSet::clear() {
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_size = 0;
+    m_num_laps = 0;
+    m_lap_size = 0;
+    m_lap_OK = false;
+    m_started = false;
+}
+
+
+void SampledSafeSet::start(double length) {
+    clear();
+    m_length = length;
+    m_num_bins = std::min(std::max(size_t(std::ceil(length / BIN_LENGTH)), size_t(1)), m_counts.size());
+    m_bin_length = length / m_num_bins;
+    m_bin_size = m_samples.size() / m_num_bins;
+}
+
+
+size_t SampledSafeSet::bin(double s) const {
+    s = std::fmod(s, m_length);
+    if (s < 0.0)
+        s += m_length;
+    return std::min(size_t(s / m_bin_length), m_num_bins - 1);
+}
+
+
+double SampledSafeSet::wrap(double s) const {
+    return std::remainder(s, m_length);
+}
+
+
+void SampledSafeSet::record(double now, double s, int laps, double length, double cte, double epsi, double v,
+                            double delta, bool valid) {
+    if (!(length > 0.0))
+        return;
+    if (length != m_length)
+        start(length);
+
+    if (m_started) {
+        // The progress since the last tick, across the start
+        double step = s - m_last_s + (laps - m_laps) * m_length;
+        bool jumped = (std::abs(step) > MAX_STEP);
+        if (laps == m_laps + 1 and !jumped) {
+            // A lap ends, and the next one starts here
+            if (m_lap_OK)
+                commit(now);
+            m_lap_size = 0;
+            m_lap_OK = true;
+        } else if (laps != m_laps or jumped) {
+            m_lap_size = 0;
+            m_lap_OK = false;
+        }
+    }
+    m_started = true;
+    m_laps = laps;
+    m_last_s = s;
+
+    if (!valid or m_lap_size == m_lap.size())
+        m_lap_OK = false;
+    if (!m_lap_OK)
+        return;
+    Sample & sample = m_lap[m_lap_size];
+    sample.s = s;
+    sample.cte = cte;
+    sample.epsi = epsi;
+    sample.v = v;
+    sample.delta = delta;
+    m_lap_times[m_lap_size] = now;
+    m_lap_size++;
+}
+
+
+void SampledSafeSet::commit(double lap_end) {
+    for (size_t i=0; i < m_lap_size; i++) {
+        m_lap[i].cost_to_go = lap_end - m_lap_times[i];
+        insert(m_lap[i]);
+    }
+    m_num_laps++;
+}
+
+
+void SampledSafeSet::insert(const Sample & sample) {
+    size_t b = bin(sample.s);
+    Sample * samples = &m_samples[b * m_bin_size];
+    if (m_counts[b] < m_bin_size) {
+        samples[m_counts[b]++] = sample;
+        m_size++;
+        return;
+    }
+    // A full bin keeps the fastest
+    Sample * slowest = std::max_element(samples, samples + m_bin_size, [](const Sample & x, const Sample & y) {
+        return x.cost_to_go < y.cost_to_go;
+    });
+    if (sample.cost_to_go < slowest->cost_to_go)
+        *slowest = sample;
+}
+
+
+bool SampledSafeSet::target(double s, double cte, double epsi, double v, double & cte_out, double & epsi_out,
+                            double & delta_out) const {
+    if (m_size == 0)
+        return false;
+
+    // The nearest samples of the bin of s and of its neighbors, by
+    // increasing distance
+    const Sample * nearest[MAX_NEIGHBORS];
+    double distances[MAX_NEIGHBORS];
+    double offsets[MAX_NEIGHBORS];
+    size_t found = 0;
+    size_t b = bin(s);
+    size_t num_searched = std::min(m_num_bins, size_t(3));
+    for (size_t i=0; i < num_searched; i++) {
+        size_t searched = (b + m_num_bins - 1 + i) % m_num_bins;
+        const Sample * samples = &m_samples[searched * m_bin_size];
+        for (uint32_t j=0; j < m_counts[searched]; j++) {
+            const Sample & sample = samples[j];
+            double ds = wrap(sample.s - s);
+            double e_s = ds / SCALE_S, e_cte = (sample.cte - cte) / SCALE_CTE;
+            double e_epsi = (sample.epsi - epsi) / SCALE_EPSI, e_v = (sample.v - v) / SCALE_V;
+            double distance = e_s * e_s + e_cte * e_cte + e_epsi * e_epsi + e_v * e_v;
+            if (found == m_neighbors and distance >= distances[found - 1])
+                continue;
+            size_t k = (found < m_neighbors) ? found++ : found - 1;
+            for (; k > 0 and distances[k - 1] > distance; k--) {
+                nearest[k] = nearest[k - 1];
+                distances[k] = distances[k - 1];
+                offsets[k] = offsets[k - 1];
+            }
+            nearest[k] = &sample;
+            distances[k] = distance;
+            offsets[k] = ds;
+        }
+    }
+    if (found == 0)
+        return false;
+
+    // The cost-to-go of the state by each of them: theirs, and the time to
+    // drive to them. The softmin of those weighs them
+    double costs[MAX_NEIGHBORS];
+    double min_cost = INFINITY;
+    for (size_t k=0; k < found; k++) {
+        costs[k] = nearest[k]->cost_to_go + offsets[k] / std::max(nearest[k]->v, MIN_SPEED);
+        min_cost = std::min(min_cost, costs[k]);
+    }
+    double sum = 0.0, sum_cte = 0.0, sum_epsi = 0.0, sum_delta = 0.0;
+    for (size_t k=0; k < found; k++) {
+        double w = std::exp(-(costs[k] - min_cost) / TEMPERATURE);
+        sum += w;
+        sum_cte += w * nearest[k]->cte;
+        sum_epsi += w * nearest[k]->epsi;
+        sum_delta += w * nearest[k]->delta;
+    }
+    cte_out = sum_cte / sum;
+    epsi_out = sum_epsi / sum;
+    delta_out = sum_delta / sum;
+    return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+///* The sampled safe set of the learning MPC (see `Params::learning_mpc`):
+///* the states the car drove through on its completed laps, each with its
+///* cost-to-go, the time [s] it took from there to the end of its lap. The
+///* target of the terminal cost of a solve is the blend of the samples
+///* nearest to the end of the previous plan, weighted towards those that
+///* got to the end of the lap first, so that the plans end where the
+///* fastest laps went through.
+///*
+///* The samples are kept in bins of the lap progress (the arc length along
+///* the path, see LapProgress), of a fixed room each: a query only searches
+///* the bins about its arc length, and a full bin drops its slowest sample
+///* for a faster one. The samples of the lap being driven are buffered, and
+///* only go into the set once it's completed in one go: from a crossing of
+///* the start to the next one, without an invalid tick (a fallback, no go)
+///* nor a jump of the progress (a relocalization).
+///*
+///* All the storage is allocated up front, so neither the queries nor the
+///* records allocate.
+class SampledSafeSet {
+public:
+    struct Sample {
+        ///* The arc length [m] along the path
+        double s = 0.0;
+        double cte = 0.0;
+        double epsi = 0.0;
+        double v = 0.0;
+        ///* The steering angle [rad] of the tick
+        double delta = 0.0;
+        ///* The time [s] from the sample to the end of its lap
+        double cost_to_go = 0.0;
+    };
+
+    ///* Room for `capacity` samples, blended by `neighbors` (both at least
+    ///* MIN_NEIGHBORS, and the neighbors at most MAX_NEIGHBORS)
+    SampledSafeSet(size_t capacity, size_t neighbors);
+
+    ///* The state of the car at `now` [s]: at arc length `s` [m] after
+    ///* `laps` laps of a path of `length` [m], with the steering angle
+    ///* `delta` [rad] it's commanded. Not `valid` when the tick fell back or
+    ///* didn't drive (the lap is then dropped). A path of another length
+    ///* starts the set over
+    void record(double now, double s, int laps, double length, double cte, double epsi, double v, double delta,
+                bool valid);
+
+    ///* The target (cte [m], epsi [rad], steering angle [rad]) of a terminal
+    ///* state at `s` [m], with `cte`, `epsi` and speed `v` [m/s]; false
+    ///* (and nothing is written) when there's no sample about `s`
+    bool target(double s, double cte, double epsi, double v, double & cte_out, double & epsi_out,
+                double & delta_out) const;
+
+    ///* The samples in the set, and the laps they're from
+    size_t size() const { return m_size; }
+    size_t num_laps() const { return m_num_laps; }
+
+    ///* Forgets the samples and the lap being driven
+    void clear();
+
+    static const size_t MIN_NEIGHBORS = 1;
+    static const size_t MAX_NEIGHBORS = 32;
+
+    ///* The length [m] of a bin (or a bit longer, with few samples per bin)
+    static constexpr double BIN_LENGTH = 0.5;
+    ///* The scales of the distance between a state and a sample, by which
+    ///* the nearest are
+    static constexpr double SCALE_S = 0.5; // [m]
+    static constexpr double SCALE_CTE = 0.2; // [m]
+    static constexpr double SCALE_EPSI = 0.2; // [rad]
+    static constexpr double SCALE_V = 0.5; // [m/s]
+    ///* The temperature [s] of the softmin of the costs-to-go of the
+    ///* neighbors: the faster by a few of it outweigh the others
+    static constexpr double TEMPERATURE = 0.1;
+    ///* The least speed [m/s] the time from a state to its neighbor is
+    ///* taken at
+    static constexpr double MIN_SPEED = 0.1;
+    ///* The progress between two ticks [m] beyond which (or backwards) the
+    ///* car jumped
+    static constexpr double MAX_STEP = 2.0;
+
+private:
+    ///* Sizes the bins for a path of `length` [m], empty
+    void start(double length);
+
+    ///* Moves the samples of the lap that ended at `lap_end` [s] into the
+    ///* bins
+    void commit(double lap_end);
+    void insert(const Sample & sample);
+
+    size_t bin(double s) const;
+    ///* s - from wrapped into [-length / 2, length / 2)
+    double wrap(double s) const;
+
+    size_t m_neighbors;
+
+    ///* The bins: `m_bin_size` samples each, the first `m_counts[b]` of bin
+    ///* b in use
+    std::vector<Sample> m_samples;
+    std::vector<uint32_t> m_counts;
+    size_t m_num_bins;
+    size_t m_bin_size;
+    double m_bin_length;
+    double m_length;
+    size_t m_size;
+    size_t m_num_laps;
+
+    ///* The lap being driven: its samples and when they were recorded [s],
+    ///* from a crossing of the start (`m_lap_OK` until one is invalid)
+    std::vector<Sample> m_lap;
+    std::vector<double> m_lap_times;
+    size_t m_lap_size;
+    bool m_lap_OK;
+    bool m_started;
+    int m_laps;
+    double m_last_s;
+};
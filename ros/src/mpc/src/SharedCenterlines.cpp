@@ -0,0 +1,83 @@
+#include <mutex>
+#include <vector>
+
+#include "SharedCenterlines.h"
+#include "ControlPipeline.h"
+
+
+namespace {
+
+struct Entry {
+    uint64_t hash;
+    size_t num_points;
+    ///* What `PathTracker::prepare_centerline` depends on
+    int poly_degree;
+    int num_steps_poly;
+    bool precomputed_fit;
+    bool adaptive_window;
+    bool compact_waypoints;
+    bool speed_profile;
+    double max_lateral_accel;
+    double max_accel;
+    double max_decel;
+    std::weak_ptr<const Centerline> centerline;
+
+    bool matches(const Centerline & other, const Params & params) const {
+        return hash == other.hash and num_points == other.pts_x.size() and poly_degree == params.poly_degree
+                and num_steps_poly == params.num_steps_poly and precomputed_fit == params.precomputed_fit
+                and adaptive_window == params.adaptive_window and compact_waypoints == params.compact_waypoints
+                and speed_profile == params.speed_profile and max_lateral_accel == params.max_lateral_accel
+                and max_accel == params.max_accel and max_decel == params.max_decel;
+    }
+};
+
+std::mutex s_mutex;
+std::vector<Entry> s_entries;
+
+// The entry of the centerline, nullptr if there's none; the entries of
+// centerlines no longer used go
+Entry * find(const Centerline & centerline, const Params & params) {
+    for (size_t i=0; i < s_entries.size(); ) {
+        if (s_entries[i].centerline.expired()) {
+            s_entries[i] = s_entries.back();
+            s_entries.pop_back();
+        } else if (s_entries[i].matches(centerline, params)) {
+            return &s_entries[i];
+        } else {
+            i++;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+
+std::shared_ptr<const Centerline> SharedCenterlines::share(const std::shared_ptr<Centerline> & centerline,
+                                                          const Params & params) {
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        Entry * entry = find(*centerline, params);
+        if (entry != nullptr) {
+            std::shared_ptr<const Centerline> shared = entry->centerline.lock();
+            if (shared)
+                return shared;
+        }
+    }
+
+    // Prepared without the lock (it takes a while for a large map): when
+    // another controller shared the same one meanwhile, its copy stands
+    ControlPipeline::prepare_centerline(*centerline, params);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Entry * entry = find(*centerline, params);
+    if (entry != nullptr) {
+        std::shared_ptr<const Centerline> shared = entry->centerline.lock();
+        if (shared)
+            return shared;
+    }
+    s_entries.push_back(Entry{centerline->hash, centerline->pts_x.size(), params.poly_degree, params.num_steps_poly,
+                              params.precomputed_fit, params.adaptive_window, params.compact_waypoints, params.speed_profile, params.max_lateral_accel,
+                              params.max_accel, params.max_decel, centerline});
+    return centerline;
+}
+
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "MPC.h"
+#include "PathTracker.h"
+
+
+///* The centerlines of the controllers of one process (e.g. the vehicles of
+///* mpc_host), by their path (its hash and size) and the fit they're
+///* prepared for: the controllers that follow the same path share one copy
+///* of it and of the structures derived from it, which nothing changes once
+///* it's shared. A centerline is kept for as long as a controller uses it.
+///*
+///* Thread-safe: every controller shares its centerlines from its own
+///* callbacks.
+class SharedCenterlines {
+public:
+    ///* The shared centerline of the path of `centerline` for the fit of
+    ///* `params`: the one already shared, or `centerline`, prepared (see
+    ///* `ControlPipeline::prepare_centerline`) and shared from now on
+    static std::shared_ptr<const Centerline> share(const std::shared_ptr<Centerline> & centerline,
+                                                   const Params & params);
+};
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Simulation.h"
+#include "Telemetry.h"
+
+
+// The car along the path
+struct CarState {
+    double t = 0.0;
+    double x = 0.0;
+    double y = 0.0;
+    double psi = 0.0;
+    double v = 0.0;
+};
+
+
+// Distance from (x, y) to the polyline of the path around waypoint `i`
+static double distance_to_path(const Centerline & centerline, int i, double x, double y) {
+    const std::vector<double> & pts_x = centerline.pts_x;
+    const std::vector<double> & pts_y = centerline.pts_y;
+    int n = int(pts_x.size());
+    double distance = std::hypot(pts_x[i] - x, pts_y[i] - y);
+    for (int j : {(i - 1 + n) % n, (i + 1) % n}) {
+        double seg_x = pts_x[j] - pts_x[i];
+        double seg_y = pts_y[j] - pts_y[i];
+        double length2 = seg_x*seg_x + seg_y*seg_y;
+        if (length2 <= 0.0)
+            continue;
+        double u = ((x - pts_x[i]) * seg_x + (y - pts_y[i]) * seg_y) / length2;
+        u = std::min(std::max(u, 0.0), 1.0);
+        distance = std::min(distance, std::hypot(pts_x[i] + u * seg_x - x, pts_y[i] + u * seg_y - y));
+    }
+    return distance;
+}
+
+
+// How far [m] the end of the horizon of the latest solution of `controller`
+// is from where its actuations take the car by the model of the simulation,
+// which steps finely enough (see ControlPipeline::project_pose) to tell the
+// error of the steps of FG_eval; < 0 without a solution
+static double prediction_error(const MPC & controller, const Params & params) {
+    const std::vector<double> & solution = controller.last_solution();
+    const Indexes & indexes = controller.indexes();
+    size_t steps = indexes.steps_ahead;
+    if (steps < 2 or solution.size() <= indexes.v(steps - 2))
+        return -1.0;
+
+    double x = solution[indexes.x_start], y = solution[indexes.y_start], psi = solution[indexes.psi_start];
+    for (size_t t=0; t + 1 < steps; t++)
+        ControlPipeline::project_pose(x, y, psi, solution[indexes.v(t)], solution[indexes.delta(t)], params.step_dt(t),
+                                      x, y, psi);
+    return std::hypot(x - solution[indexes.x_start + steps - 1], y - solution[indexes.y_start + steps - 1]);
+}
+
+
+std::shared_ptr<Centerline> make_centerline(Waypoints & waypoints, const Params & params) {
+    std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>();
+    centerline->pts_x = std::move(waypoints.x);
+    centerline->pts_y = std::move(waypoints.y);
+    centerline->yaw = std::move(waypoints.yaw);
+    centerline->speed = std::move(waypoints.speed);
+    ControlPipeline::prepare_centerline(*centerline, params);
+    return centerline;
+}
+
+
+RunResult simulate(const std::shared_ptr<const Centerline> & centerline, const Params & params,
+                   const SimulationOptions & options, unsigned seed) {
+    ControlPipeline pipeline(params);
+    RunResult result;
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> unit_noise(0.0, 1.0);
+
+    const std::vector<double> & pts_x = centerline->pts_x;
+    const std::vector<double> & pts_y = centerline->pts_y;
+    int n = int(pts_x.size());
+    double period = 1.0 / params.loop_rate;
+
+    // On the first waypoint, heading along the path
+    CarState car;
+    car.x = pts_x[0];
+    car.y = pts_y[0];
+    car.psi = atan2(pts_y[1] - pts_y[0], pts_x[1] - pts_x[0]);
+
+    // The poses the controller gets are those from `latency` ago
+    std::vector<CarState> history;
+    size_t delay = size_t(std::round(options.latency / period));
+    history.reserve(delay + 1);
+
+    InputSnapshot inputs;
+    inputs.centerline = centerline;
+    inputs.go_flag = true;
+
+    int closest = centerline->grid.nearest(car.x, car.y);
+    long progress = 0; // [waypoints]
+    double lap_start = 0.0;
+    size_t num_ticks = 0;
+    size_t num_predictions = 0;
+
+    auto wall_start = std::chrono::steady_clock::now();
+    while (result.lap_times.size() < options.num_laps and car.t < options.max_time) {
+        if (history.size() == delay + 1)
+            history.erase(history.begin());
+        history.push_back(car);
+        const CarState & measured = history.front();
+
+        inputs.pos_x = measured.x + options.pos_noise * unit_noise(rng);
+        inputs.pos_y = measured.y + options.pos_noise * unit_noise(rng);
+        inputs.psi = measured.psi + options.psi_noise * unit_noise(rng);
+        inputs.speed = measured.v + options.speed_noise * unit_noise(rng);
+        inputs.pose_stamp = inputs.odom_stamp = measured.t;
+        inputs.history.add_pose(measured.t, inputs.pos_x, inputs.pos_y, inputs.psi);
+        inputs.history.add_speed(measured.t, inputs.speed);
+        inputs.pos_OK = inputs.psi_OK = inputs.speed_OK = true;
+
+        TelemetryRecord record;
+        auto tick_start = std::chrono::steady_clock::now();
+        pipeline.step(inputs, car.t, tick_start, record);
+        result.solve_times.push_back(
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - tick_start).count());
+        if (record.events & TelemetryRecord::DEADLINE_HIT)
+            result.num_deadline_hits++;
+        if (record.events & TelemetryRecord::SOLVE_FAILED)
+            result.num_solve_failures++;
+        if (record.fallback == FALLBACK_PID)
+            result.num_pid_fallbacks++;
+        num_ticks++;
+
+        const MPC * controller = pipeline.solved_controller();
+        if (controller != nullptr and !(record.events & TelemetryRecord::SOLVE_FAILED)) {
+            double error = prediction_error(*controller, params);
+            if (error >= 0.0) {
+                result.prediction_error_mean += error;
+                result.prediction_error_max = std::max(result.prediction_error_max, error);
+                num_predictions++;
+            }
+        }
+
+        // Drive with the commands (as Dzik would get them) until the next tick
+        double steer_angle = ControlPipeline::steer_from_dzik(pipeline.steer_cmd());
+        car.v = ControlPipeline::speed_from_dzik(pipeline.rpm());
+        ControlPipeline::project_pose(car.x, car.y, car.psi, car.v, steer_angle, period, car.x, car.y, car.psi);
+        car.t += period;
+
+        // Laps, by the waypoints passed (the path is a loop)
+        int next = centerline->grid.nearest(car.x, car.y);
+        int step = next - closest;
+        if (step > n / 2)
+            step -= n;
+        else if (step < -n / 2)
+            step += n;
+        progress += step;
+        closest = next;
+        if (progress >= long(n) * long(result.lap_times.size() + 1)) {
+            result.lap_times.push_back(car.t - lap_start);
+            lap_start = car.t;
+        }
+
+        double cte = distance_to_path(*centerline, closest, car.x, car.y);
+        result.cte_mean += cte;
+        result.cte_mean_squares += cte * cte;
+        result.cte_max = std::max(result.cte_max, cte);
+        if (cte > OFF_TRACK_DISTANCE) {
+            result.off_track = 1;
+            break;
+        }
+    }
+    result.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    result.sim_time = car.t;
+
+    result.cte_mean /= std::max(num_ticks, size_t(1));
+    result.cte_mean_squares /= std::max(num_ticks, size_t(1));
+    result.prediction_error_mean /= std::max(num_predictions, size_t(1));
+    return result;
+}
+
+
+// The result goes through a pipe, as a sized array of the vectors and then the
+// scalars
+static bool write_all(int fd, const void * data, size_t size) {
+    const char * bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+
+static bool read_all(int fd, void * data, size_t size) {
+    char * bytes = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got <= 0)
+            return false;
+        bytes += got;
+        size -= got;
+    }
+    return true;
+}
+
+
+static bool write_result(int fd, const RunResult & result) {
+    double scalars[] = {result.cte_mean, result.cte_mean_squares, result.cte_max, result.sim_time, result.wall_time,
+                        result.num_deadline_hits, result.num_solve_failures, result.num_pid_fallbacks,
+                        result.off_track, result.prediction_error_mean, result.prediction_error_max};
+    for (const std::vector<double> * values : {&result.lap_times, &result.solve_times}) {
+        uint64_t size = values->size();
+        if (!write_all(fd, &size, sizeof(size)) or !write_all(fd, values->data(), size * sizeof(double)))
+            return false;
+    }
+    return write_all(fd, scalars, sizeof(scalars));
+}
+
+
+static bool read_result(int fd, RunResult & result) {
+    double scalars[11];
+    for (std::vector<double> * values : {&result.lap_times, &result.solve_times}) {
+        uint64_t size;
+        if (!read_all(fd, &size, sizeof(size)))
+            return false;
+        values->resize(size);
+        if (!read_all(fd, values->data(), size * sizeof(double)))
+            return false;
+    }
+    if (!read_all(fd, scalars, sizeof(scalars)))
+        return false;
+    result.cte_mean = scalars[0];
+    result.cte_mean_squares = scalars[1];
+    result.cte_max = scalars[2];
+    result.sim_time = scalars[3];
+    result.wall_time = scalars[4];
+    result.num_deadline_hits = scalars[5];
+    result.num_solve_failures = scalars[6];
+    result.num_pid_fallbacks = scalars[7];
+    result.off_track = scalars[8];
+    result.prediction_error_mean = scalars[9];
+    result.prediction_error_max = scalars[10];
+    return true;
+}
+
+
+bool run_in_processes(size_t num_runs, size_t num_jobs, const std::function<RunResult(size_t)> & run,
+                      const std::function<void(size_t, const RunResult &)> & done) {
+    struct Child {
+        size_t run;
+        pid_t pid;
+        int fd;
+    };
+    std::vector<Child> children;
+    size_t next = 0;
+    bool OK = true;
+    while (next < num_runs or !children.empty()) {
+        // A new run as soon as there's room for it, unless one failed
+        if (OK and next < num_runs and children.size() < std::max(num_jobs, size_t(1))) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                std::perror("pipe");
+                OK = false;
+                continue;
+            }
+            pid_t pid = fork();
+            if (pid < 0) {
+                std::perror("fork");
+                close(fds[0]);
+                close(fds[1]);
+                OK = false;
+                continue;
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                RunResult result = run(next);
+                _exit(write_result(fds[1], result) ? 0 : 1);
+            }
+            close(fds[1]);
+            children.push_back({next++, pid, fds[0]});
+            continue;
+        }
+        if (!OK and children.empty())
+            break;
+
+        // The first run that's done (which writes its result all at once)
+        std::vector<pollfd> fds(children.size());
+        for (size_t c=0; c < children.size(); c++)
+            fds[c] = {children[c].fd, POLLIN, 0};
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            std::perror("poll");
+            return false;
+        }
+        size_t c = 0;
+        while (c < fds.size() and fds[c].revents == 0)
+            c++;
+        if (c == fds.size())
+            continue;
+
+        Child child = children[c];
+        children.erase(children.begin() + c);
+        RunResult result;
+        bool read = read_result(child.fd, result);
+        close(child.fd);
+        int status;
+        waitpid(child.pid, &status, 0);
+        if (!read or !WIFEXITED(status) or WEXITSTATUS(status) != 0) {
+            std::fprintf(stderr, "run %lu failed\n", child.run);
+            OK = false;
+            continue;
+        }
+        done(child.run, result);
+    }
+    return OK;
+}
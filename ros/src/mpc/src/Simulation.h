@@ -0,0 +1,68 @@
+#pragma once
+
+///* The closed-loop simulation of the ROS-free tools (mpc_simulator,
+///* mpc_tune): the car follows the kinematic model of FG_eval, driven by the
+///* commands of the same ControlPipeline as the node's
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "ControlPipeline.h"
+#include "MPC.h"
+#include "WaypointLoader.h"
+
+
+struct SimulationOptions {
+    size_t num_laps = 3;
+    double max_time = 600.0; // [s] of simulated time, per run
+    double latency = 0.0; // [s] from the measurement of a pose to the controller
+    double pos_noise = 0.0; // [m]
+    double psi_noise = 0.0; // [rad]
+    double speed_noise = 0.0; // [m/s]
+};
+
+
+///* What a run hands over to the parent process
+struct RunResult {
+    std::vector<double> lap_times; // [s]
+    std::vector<double> solve_times; // [s]
+    double cte_mean = 0.0; // [m]
+    double cte_mean_squares = 0.0; // [m^2]
+    double cte_max = 0.0;
+    double sim_time = 0.0; // [s]
+    double wall_time = 0.0; // [s]
+    double num_deadline_hits = 0;
+    double num_solve_failures = 0;
+    ///* Failed solves whose commands came from the PID law (the others' from
+    ///* the shifted plan, see SolveStats::fallback)
+    double num_pid_fallbacks = 0;
+    double off_track = 0;
+    ///* How far [m] the plans stray, at the end of their horizon, from
+    ///* where their actuations take the simulated car (see
+    ///* `Params::integrator`): the mean and the max over the solved ticks
+    double prediction_error_mean = 0.0;
+    double prediction_error_max = 0.0;
+};
+
+
+///* A run ends early when the car gets this far from the path
+static const double OFF_TRACK_DISTANCE = 2.0; // [m]
+
+
+///* The centerline of the waypoints, prepared for the runs by `params`;
+///* moves the points out of `waypoints`
+std::shared_ptr<Centerline> make_centerline(Waypoints & waypoints, const Params & params);
+
+///* A run on the path, from its first waypoint, until the laps are done, the
+///* time is up or the car left the track; `seed` is the one of the noise.
+///* Every tick is stepped as soon as the previous one is solved
+RunResult simulate(const std::shared_ptr<const Centerline> & centerline, const Params & params,
+                   const SimulationOptions & options, unsigned seed);
+
+///* Runs `run(0 ... num_runs)` in processes, up to `num_jobs` at a time (not
+///* every linear solver of Ipopt is thread-safe), and hands every result to
+///* `done` as the runs finish, in the parent process; false (and says why)
+///* if a run failed
+bool run_in_processes(size_t num_runs, size_t num_jobs, const std::function<RunResult(size_t)> & run,
+                      const std::function<void(size_t, const RunResult &)> & done);
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include "ControlPipeline.h"
+#include "SimulatorFarm.h"
+
+
+// The window of the fit starts this many waypoints back, as PathTracker's
+static const int NUM_STEPS_BACK = 5;
+
+const size_t SimulatorFarm::BLOCK_SIZE;
+
+
+FarmCar FarmCar::from_params(const Params & params, uint64_t seed) {
+    FarmCar car;
+    car.ref_v = params.ref_v;
+    car.ref_v_alpha = params.ref_v_alpha;
+    car.pid_kp_cte = params.pid_kp_cte;
+    car.pid_ki_cte = params.pid_ki_cte;
+    car.pid_kd_cte = params.pid_kd_cte;
+    car.pid_kp_epsi = params.pid_kp_epsi;
+    car.pid_ki_epsi = params.pid_ki_epsi;
+    car.pid_kd_epsi = params.pid_kd_epsi;
+    car.seed = seed;
+    return car;
+}
+
+
+// A standard normal number from a car's own generator (splitmix64, then
+// Box-Muller): a word of state per car, where std::mt19937 would take 5 kB
+static double normal_noise(uint64_t & state) {
+    auto uniform = [&state]() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        return (double(z >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    };
+    double u = uniform(), v = uniform();
+    return std::sqrt(-2.0 * std::log(u)) * std::cos(2 * M_PI * v);
+}
+
+
+// The state of the cars of a block, an array each (entry c for car c), and
+// the interleaved windows of their fits
+struct SimulatorFarm::Block {
+    size_t count;
+    std::vector<double> x, y, psi;
+    std::vector<uint64_t> noise;
+    std::vector<int> closest;
+    std::vector<long> progress; // [waypoints]
+    std::vector<double> lap_start; // [s]
+    std::vector<bool> done;
+
+    // The poses of the last `history` ticks (the latency of the poses and
+    // the tick), slot after slot
+    size_t history;
+    std::vector<double> history_x, history_y, history_psi;
+
+    // The PID law's errors, as PIDController's
+    std::vector<double> cte, prev_cte, sum_cte, epsi, prev_epsi, sum_epsi;
+
+    std::vector<double> window_x, window_y, coeffs;
+};
+
+
+SimulatorFarm::SimulatorFarm(const std::shared_ptr<const Centerline> & centerline, const ExplicitTable & table,
+                             const Params & params, const SimulationOptions & options)
+        : m_centerline(centerline), m_table(table), m_params(params), m_options(options) {}
+
+
+void SimulatorFarm::run(const std::vector<FarmCar> & cars, size_t num_threads,
+                        std::vector<FarmResult> & results) const {
+    results.assign(cars.size(), FarmResult());
+    size_t num_blocks = (cars.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t b = next++; b < num_blocks; b = next++) {
+            size_t first = b * BLOCK_SIZE;
+            run_block(&cars[first], std::min(BLOCK_SIZE, cars.size() - first), &results[first]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t=1; t < std::min(std::max(num_threads, size_t(1)), num_blocks); t++)
+        threads.emplace_back(work);
+    work();
+    for (std::thread & thread : threads)
+        thread.join();
+}
+
+
+void SimulatorFarm::run_block(const FarmCar * cars, size_t count, FarmResult * results) const {
+    const Centerline & centerline = *m_centerline;
+    const std::vector<double> & pts_x = centerline.pts_x;
+    const std::vector<double> & pts_y = centerline.pts_y;
+    int n = int(pts_x.size());
+    double period = 1.0 / m_params.loop_rate;
+    size_t window_size = size_t(m_params.num_steps_poly);
+    size_t num_coeffs = size_t(m_params.poly_degree) + 1;
+    double max_steer = 0.017453 * delta_constraint();
+
+    // On the first waypoint, heading along the path, as in `simulate`
+    Block block;
+    block.count = count;
+    block.x.assign(count, pts_x[0]);
+    block.y.assign(count, pts_y[0]);
+    block.psi.assign(count, std::atan2(pts_y[1] - pts_y[0], pts_x[1] - pts_x[0]));
+    block.noise.resize(count);
+    block.closest.assign(count, centerline.grid.nearest(pts_x[0], pts_y[0]));
+    block.progress.assign(count, 0);
+    block.lap_start.assign(count, 0.0);
+    block.done.assign(count, false);
+    for (size_t c=0; c < count; c++)
+        block.noise[c] = cars[c].seed;
+    size_t delay = size_t(std::round(m_options.latency / period));
+    block.history = delay + 1;
+    block.history_x.resize(block.history * count);
+    block.history_y.resize(block.history * count);
+    block.history_psi.resize(block.history * count);
+    for (std::vector<double> * errors : {&block.cte, &block.prev_cte, &block.sum_cte, &block.epsi, &block.prev_epsi,
+                                         &block.sum_epsi})
+        errors->assign(count, 0.0);
+    block.window_x.resize(window_size * count);
+    block.window_y.resize(window_size * count);
+    block.coeffs.resize(num_coeffs * count);
+    Eigen::VectorXd coeffs(num_coeffs);
+
+    size_t num_done = 0;
+    double t = 0.0;
+    for (size_t tick=0; num_done < count and t < m_options.max_time; tick++) {
+        // The poses the law gets: those of `delay` ticks ago (the first one
+        // until there are that many), with the noise (the law doesn't use
+        // the speed, nor its noise)
+        size_t slot = tick % block.history;
+        size_t measured = (tick - std::min(delay, tick)) % block.history;
+        for (size_t c=0; c < count; c++) {
+            block.history_x[slot * count + c] = block.x[c];
+            block.history_y[slot * count + c] = block.y[c];
+            block.history_psi[slot * count + c] = block.psi[c];
+        }
+        for (size_t c=0; c < count; c++) {
+            double pos_x = block.history_x[measured * count + c];
+            double pos_y = block.history_y[measured * count + c];
+            double psi = block.history_psi[measured * count + c];
+            if (m_options.pos_noise > 0.0) {
+                pos_x += m_options.pos_noise * normal_noise(block.noise[c]);
+                pos_y += m_options.pos_noise * normal_noise(block.noise[c]);
+            }
+            if (m_options.psi_noise > 0.0)
+                psi += m_options.psi_noise * normal_noise(block.noise[c]);
+
+            // The window, in the car's frame (the cars that are done still
+            // fit, on their last pose, to keep the lanes in step)
+            double sin_psi = std::sin(psi), cos_psi = std::cos(psi);
+            int start = block.closest[c] - NUM_STEPS_BACK;
+            for (size_t k=0; k < window_size; k++) {
+                int i = ((start + int(k)) % n + n) % n;
+                double dx = pts_x[i] - pos_x, dy = pts_y[i] - pos_y;
+                block.window_x[k * count + c] = dx * cos_psi + dy * sin_psi;
+                block.window_y[k * count + c] = dy * cos_psi - dx * sin_psi;
+            }
+        }
+        polyfit_batch(block.window_x.data(), block.window_y.data(), window_size, count, m_params.poly_degree,
+                      block.coeffs.data());
+
+        // The law, then the step of the model until the next tick
+        for (size_t c=0; c < count; c++) {
+            if (block.done[c])
+                continue;
+            const FarmCar & car = cars[c];
+            const double * car_coeffs = &block.coeffs[c * num_coeffs];
+            double cte = car_coeffs[0], epsi = -std::atan(car_coeffs[1]);
+            bool first = (tick == 0);
+            block.prev_cte[c] = first ? cte : block.cte[c];
+            block.prev_epsi[c] = first ? epsi : block.epsi[c];
+            block.cte[c] = cte;
+            block.epsi[c] = epsi;
+            block.sum_cte[c] += cte;
+            block.sum_epsi[c] += epsi;
+
+            for (size_t k=0; k < num_coeffs; k++)
+                coeffs[k] = car_coeffs[k];
+            double delta, speed;
+            if (!m_table.lookup(coeffs, car.ref_v, m_params.explicit_table_steer_tolerance,
+                                m_params.explicit_table_speed_tolerance, delta, speed)) {
+                delta = car.pid_kp_cte * cte + car.pid_ki_cte * block.sum_cte[c]
+                        + car.pid_kd_cte * (cte - block.prev_cte[c])
+                        - car.pid_kp_epsi * epsi - car.pid_ki_epsi * block.sum_epsi[c]
+                        - car.pid_kd_epsi * (epsi - block.prev_epsi[c]);
+                delta = std::min(std::max(delta, -max_steer), max_steer);
+                speed = car.ref_v_alpha * car.ref_v;
+                results[c].num_pid_fallbacks++;
+            }
+            // (as far as Dzik's servo goes)
+            double steer = std::min(std::max(ControlPipeline::steer_to_dzik(delta), 0.0), 1.0);
+            ControlPipeline::project_pose(block.x[c], block.y[c], block.psi[c], speed,
+                                          ControlPipeline::steer_from_dzik(steer), period,
+                                          block.x[c], block.y[c], block.psi[c]);
+        }
+        t += period;
+
+        // The laps, by the waypoints passed, and the distance to the path;
+        // the closest waypoint is followed along the path, from the last
+        for (size_t c=0; c < count; c++) {
+            if (block.done[c])
+                continue;
+            FarmResult & result = results[c];
+            double x = block.x[c], y = block.y[c];
+            int closest = block.closest[c];
+            auto dist2 = [&](int i) {
+                double dx = pts_x[i] - x, dy = pts_y[i] - y;
+                return dx * dx + dy * dy;
+            };
+            int step = 0;
+            double closest_dist2 = dist2(closest);
+            for (int direction : {1, -1}) {
+                while (std::abs(step) < n / 2) {
+                    int i = ((closest + step + direction) % n + n) % n;
+                    double d2 = dist2(i);
+                    if (d2 >= closest_dist2)
+                        break;
+                    closest_dist2 = d2;
+                    step += direction;
+                }
+                if (step != 0)
+                    break;
+            }
+            closest = ((closest + step) % n + n) % n;
+            block.closest[c] = closest;
+            block.progress[c] += step;
+            if (block.progress[c] >= long(n) * long(result.num_laps + 1)) {
+                result.num_laps++;
+                result.lap_time_sum += t - block.lap_start[c];
+                block.lap_start[c] = t;
+            }
+
+            double cte = std::sqrt(closest_dist2);
+            for (int j : {(closest - 1 + n) % n, (closest + 1) % n}) {
+                double seg_x = pts_x[j] - pts_x[closest], seg_y = pts_y[j] - pts_y[closest];
+                double length2 = seg_x * seg_x + seg_y * seg_y;
+                if (length2 <= 0.0)
+                    continue;
+                double u = ((x - pts_x[closest]) * seg_x + (y - pts_y[closest]) * seg_y) / length2;
+                u = std::min(std::max(u, 0.0), 1.0);
+                cte = std::min(cte, std::hypot(pts_x[closest] + u * seg_x - x, pts_y[closest] + u * seg_y - y));
+            }
+            result.cte_mean_squares += cte * cte;
+            result.cte_max = std::max(result.cte_max, cte);
+            result.num_ticks++;
+            result.sim_time = t;
+            result.off_track = cte > OFF_TRACK_DISTANCE;
+            if (result.off_track or result.num_laps >= m_options.num_laps) {
+                block.done[c] = true;
+                num_done++;
+            }
+        }
+    }
+
+    for (size_t c=0; c < count; c++)
+        results[c].cte_mean_squares /= std::max(results[c].num_ticks, size_t(1));
+}
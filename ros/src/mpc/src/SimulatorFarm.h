@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ExplicitTable.h"
+#include "MPC.h"
+#include "PathTracker.h"
+#include "Simulation.h"
+
+
+///* What differs between the cars of a farm: the parameters of the law that
+///* aren't baked into its table (the reference speed, the gains of the PID
+///* fallback) and the seed of their noise
+struct FarmCar {
+    double ref_v = 0.0;
+    double ref_v_alpha = 0.0;
+    double pid_kp_cte = 0.0;
+    double pid_ki_cte = 0.0;
+    double pid_kd_cte = 0.0;
+    double pid_kp_epsi = 0.0;
+    double pid_ki_epsi = 0.0;
+    double pid_kd_epsi = 0.0;
+    uint64_t seed = 0;
+
+    ///* Those of `params`
+    static FarmCar from_params(const Params & params, uint64_t seed);
+};
+
+
+///* The run of a car, summed up as it drives (no per-tick data is kept)
+struct FarmResult {
+    size_t num_laps = 0;
+    double lap_time_sum = 0.0; // [s]
+    double cte_mean_squares = 0.0; // [m^2]
+    double cte_max = 0.0; // [m]
+    size_t num_ticks = 0;
+    ///* Ticks outside of the table (or in its cells of too large an error),
+    ///* which the PID law steered
+    size_t num_pid_fallbacks = 0;
+    double sim_time = 0.0; // [s]
+    bool off_track = false;
+};
+
+
+///* Closed-loop runs of thousands of cars at once, for the sweeps of mpc_tune
+///* and the Monte Carlo studies: the model of `simulate` (Simulation.h),
+///* driven by the law of an explicit table (see ExplicitTable, with the PID
+///* law where the table refuses) instead of by the solves of a
+///* ControlPipeline.
+///*
+///* The cars run in lock-step, by blocks of BLOCK_SIZE, each block on a
+///* thread from start to end: their states are arrays of the block (one
+///* entry per car), every stage of a tick is a loop over all of them, and
+///* their fits are one `polyfit_batch`. Nothing is allocated during the
+///* runs, and what a car's run yields is summed up in its FarmResult as it
+///* drives. The runs are deterministic (by the seeds of the cars), whatever
+///* the number of threads.
+///*
+///* The table's law is only as good as the table; the solves of `simulate`
+///* stay the reference the farm's results are checked against.
+class SimulatorFarm {
+public:
+    ///* The farm of the waypoints, the table and the parameters the table
+    ///* was made for (see `ExplicitTable::matches`)
+    SimulatorFarm(const std::shared_ptr<const Centerline> & centerline, const ExplicitTable & table,
+                  const Params & params, const SimulationOptions & options);
+
+    ///* The runs of `cars`, on `num_threads` threads, into `results` (by
+    ///* car)
+    void run(const std::vector<FarmCar> & cars, size_t num_threads, std::vector<FarmResult> & results) const;
+
+    static const size_t BLOCK_SIZE = 256;
+
+private:
+    struct Block;
+
+    ///* The runs of cars [first, first + count)
+    void run_block(const FarmCar * cars, size_t count, FarmResult * results) const;
+
+    std::shared_ptr<const Centerline> m_centerline;
+    const ExplicitTable & m_table;
+    Params m_params;
+    SimulationOptions m_options;
+};
@@ -0,0 +1,84 @@
+#include <cstdlib>
+
+#include "SlidingPolyFit.h"
+
+
+constexpr size_t SlidingPolyFit::REFIT_INTERVAL;
+
+
+SlidingPolyFit::SlidingPolyFit() {
+    reset();
+}
+
+
+void SlidingPolyFit::reset() {
+    m_valid = false;
+    m_start = 0;
+    m_n = 0;
+    m_updates = 0;
+    m_drift = 0;
+}
+
+
+void SlidingPolyFit::accumulate(const std::vector<double> & pts_x, const std::vector<double> & pts_y,
+                                size_t idx, double weight) {
+    m_moments.accumulate(pts_x[idx], pts_y[idx], weight);
+    m_updates++;
+}
+
+
+void SlidingPolyFit::refit(const std::vector<double> & pts_x, const std::vector<double> & pts_y) {
+    m_moments.reset(m_moments.degree(), pts_x[m_start], pts_y[m_start]);
+    for (size_t i=0; i < m_n; i++)
+        accumulate(pts_x, pts_y, (m_start + i) % pts_x.size(), 1.0);
+    m_updates = 0;
+    m_drift = 0;
+    m_valid = true;
+}
+
+
+bool SlidingPolyFit::fit(const std::vector<double> & pts_x, const std::vector<double> & pts_y, int start, size_t n,
+                         int degree, double pos_x, double pos_y, double psi, Eigen::VectorXd & coeffs) {
+    size_t size = pts_x.size();
+    if (degree < 1 or degree > WindowMoments::MAX_DEGREE or n < size_t(degree) + 1 or size == 0)
+        return false;
+    auto wrap = [size](long idx) { return size_t(((idx % long(size)) + long(size)) % long(size)); };
+    size_t new_start = wrap(start);
+
+    // Slide the window if it only moved a little, otherwise start over
+    bool full_refit = !m_valid or degree != m_moments.degree() or n != m_n or m_updates >= REFIT_INTERVAL;
+    long shift = 0;
+    if (!full_refit) {
+        shift = long(new_start) - long(m_start);
+        if (shift > long(size) / 2)
+            shift -= long(size);
+        else if (shift < -long(size) / 2)
+            shift += long(size);
+        // Also once the window has moved far from the origin of the moments,
+        // where their (higher) powers would lose precision
+        full_refit = (2 * size_t(std::labs(m_drift + shift)) >= n);
+    }
+
+    if (full_refit) {
+        m_moments.reset(degree, 0.0, 0.0);
+        m_n = n;
+        m_start = new_start;
+        refit(pts_x, pts_y);
+    } else {
+        long first = long(m_start);
+        long end = first + long(m_n);
+        for (long j=0; j < shift; j++) {
+            accumulate(pts_x, pts_y, wrap(first + j), -1.0);
+            accumulate(pts_x, pts_y, wrap(end + j), 1.0);
+        }
+        for (long j=1; j <= -shift; j++) {
+            accumulate(pts_x, pts_y, wrap(end - j), -1.0);
+            accumulate(pts_x, pts_y, wrap(first - j), 1.0);
+        }
+        m_start = new_start;
+        m_drift += shift;
+    }
+
+    m_moments.fit(pos_x, pos_y, psi, coeffs);
+    return true;
+}
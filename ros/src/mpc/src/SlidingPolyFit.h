@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+#include "WindowMoments.h"
+
+
+///* Least-squares fit of a polynomial y = p(x), in the car's frame, to a
+///* window of consecutive waypoints that slides along the path from one tick
+///* to the next.
+///*
+///* The window keeps the WindowMoments of its points, updated as points
+///* enter and leave it, so each tick only costs the points that moved plus
+///* the mapping of the moments into the car's frame.
+class SlidingPolyFit {
+public:
+    SlidingPolyFit();
+
+    ///* Forgets the window (e.g. when the path changes)
+    void reset();
+
+    ///* Fits the polynomial to the points start, ..., start + n - 1 (wrapping
+    ///* around the path) in the frame of a car at (pos_x, pos_y) heading
+    ///* psi. False if the degree isn't supported or there are too few points
+    bool fit(const std::vector<double> & pts_x, const std::vector<double> & pts_y, int start, size_t n,
+             int degree, double pos_x, double pos_y, double psi, Eigen::VectorXd & coeffs);
+
+private:
+    void refit(const std::vector<double> & pts_x, const std::vector<double> & pts_y);
+
+    ///* Adds (weight 1) or removes (weight -1) a point of the path
+    void accumulate(const std::vector<double> & pts_x, const std::vector<double> & pts_y, size_t idx, double weight);
+
+    bool m_valid;
+    size_t m_start;
+    size_t m_n;
+
+    ///* Points added or removed since the last full refit, which bounds the
+    ///* round-off accumulated in the moments
+    size_t m_updates;
+
+    ///* The moments are taken around the first point of the window at the
+    ///* last full refit, to keep their magnitudes small; how many points the
+    ///* window has moved since
+    long m_drift;
+
+    WindowMoments m_moments;
+
+    ///* Full refits every this many updates
+    static constexpr size_t REFIT_INTERVAL = 1000;
+};
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cmath>
+
+#include "SolutionCache.h"
+
+
+constexpr size_t SolutionCache::MAX_KEY;
+
+
+bool SolutionCache::Key::operator==(const Key & other) const {
+    if (size != other.size)
+        return false;
+    for (size_t i=0; i < size; i++)
+        if (values[i] != other.values[i])
+            return false;
+    return true;
+}
+
+
+SolutionCache::SolutionCache() : m_tolerance(0.0), m_clock(0) {}
+
+
+void SolutionCache::reset(size_t capacity, double tolerance, size_t max_result_size) {
+    m_entries.assign(std::max(capacity, size_t(1)), Entry());
+    for (Entry & entry : m_entries)
+        entry.result.reserve(max_result_size);
+    m_tolerance = tolerance;
+    m_clock = 0;
+}
+
+
+double SolutionCache::quantize(double value) const {
+    return m_tolerance > 0.0 ? std::round(value / m_tolerance) : value;
+}
+
+
+bool SolutionCache::make_key(size_t controller, const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs,
+                             double ref_v, Key & key) const {
+    key.size = 4 + size_t(coeffs.size());
+    if (key.size > MAX_KEY)
+        return false;
+    key.values[0] = double(controller);
+    key.values[1] = quantize(state[3]);
+    key.values[2] = quantize(state[4]);
+    key.values[3] = quantize(ref_v);
+    for (int i=0; i < coeffs.size(); i++)
+        key.values[4 + i] = quantize(coeffs[i]);
+    return true;
+}
+
+
+const SolutionCache::Entry * SolutionCache::find(const Key & key) {
+    // NaN never equals itself, so a failed fit never hits
+    for (Entry & entry : m_entries) {
+        if (entry.used and entry.key == key) {
+            entry.last_used = ++m_clock;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+
+void SolutionCache::insert(const Key & key, const std::vector<double> & result, double cost) {
+    // The entry of the same key if there's one, else an unused one, else
+    // the least recently used
+    Entry * slot = &m_entries[0];
+    for (Entry & entry : m_entries) {
+        if (entry.used and entry.key == key) {
+            slot = &entry;
+            break;
+        }
+        if (!entry.used) {
+            if (slot->used)
+                slot = &entry;
+        } else if (slot->used and entry.last_used < slot->last_used) {
+            slot = &entry;
+        }
+    }
+    slot->key = key;
+    slot->result.assign(result.begin(), result.end());
+    slot->cost = cost;
+    slot->last_used = ++m_clock;
+    slot->used = true;
+}
+
+
+void SolutionCache::clear() {
+    for (Entry & entry : m_entries)
+        entry.used = false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+
+
+///* The results of the last solves, by their problems quantized (see
+///* `Params::solution_cache_size`): the problem is the controller that
+///* solves it, cte, epsi, the coefficients of the fit and the reference
+///* speed, each rounded to a multiple of the tolerance (0: taken as is), so
+///* a hit is a solve of a problem within about the tolerance of the new one.
+///* The least recently used entry makes room for a new one.
+///*
+///* There are few entries, searched in order. All the storage is allocated
+///* up front, so neither the lookups nor the insertions allocate.
+class SolutionCache {
+public:
+    static constexpr size_t MAX_KEY = 10;
+
+    struct Key {
+        size_t size = 0;
+        double values[MAX_KEY];
+
+        bool operator==(const Key & other) const;
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<double> result;
+        double cost = 0.0;
+        uint64_t last_used = 0;
+        bool used = false;
+    };
+
+    SolutionCache();
+
+    ///* `capacity` entries (at least 1), with room for results of up to
+    ///* `max_result_size` values, all empty
+    void reset(size_t capacity, double tolerance, size_t max_result_size);
+
+    ///* The key of a problem; false if it has too many coefficients to
+    ///* have one
+    bool make_key(size_t controller, const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                  Key & key) const;
+
+    ///* The entry of `key` (which is then the most recently used), nullptr
+    ///* if there's none
+    const Entry * find(const Key & key);
+
+    ///* Keeps the result of the solve of `key`, in place of the least
+    ///* recently used entry
+    void insert(const Key & key, const std::vector<double> & result, double cost);
+
+    void clear();
+
+private:
+    double quantize(double value) const;
+
+    std::vector<Entry> m_entries;
+    double m_tolerance;
+    uint64_t m_clock;
+};
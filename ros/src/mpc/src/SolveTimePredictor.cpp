@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "SolveTimePredictor.h"
+#include "Log.h"
+
+
+const size_t SolveTimePredictor::NUM_FEATURES;
+
+
+void SolveTimePredictor::features(double cte, double epsi, const double * coeffs, size_t num_coeffs, double speed,
+                                  double ref_v, double previous_cte, double previous_epsi, int previous_iterations,
+                                  double * out) {
+    bool cold = (previous_iterations < 0);
+    out[0] = 1.0;
+    out[1] = std::abs(cte);
+    out[2] = std::abs(epsi);
+    for (size_t i=1; i <= 3; i++)
+        out[2 + i] = (i < num_coeffs) ? std::abs(coeffs[i]) : 0.0;
+    out[6] = std::abs(speed);
+    out[7] = ref_v;
+    out[8] = cold ? 0.0 : std::abs(cte - previous_cte) + std::abs(epsi - previous_epsi);
+    out[9] = cold ? 1.0 : 0.0;
+    out[10] = cold ? 0.0 : double(previous_iterations);
+}
+
+
+bool SolveTimePredictor::load(const std::string & path, const std::vector<std::string> & backends) {
+    std::ifstream file(path);
+    size_t num_features = 0;
+    file >> num_features;
+    if (!file) {
+        MPC_ERROR("Could not read %s", path.c_str());
+        return false;
+    }
+    if (num_features != NUM_FEATURES) {
+        MPC_ERROR("%s has %lu features, not %lu", path.c_str(), num_features, NUM_FEATURES);
+        return false;
+    }
+
+    m_weights = Eigen::MatrixXd::Zero(backends.size(), NUM_FEATURES);
+    m_margins.assign(backends.size(), 0.0);
+    std::vector<bool> found(backends.size(), false);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name))
+            continue;
+        size_t b = std::find(backends.begin(), backends.end(), name) - backends.begin();
+        if (b == backends.size())
+            continue;
+        fields >> m_margins[b];
+        for (size_t j=0; j < NUM_FEATURES; j++)
+            fields >> m_weights(b, j);
+        if (!fields) {
+            MPC_ERROR("%s is missing some of the weights of %s", path.c_str(), name.c_str());
+            return false;
+        }
+        found[b] = true;
+    }
+    for (size_t b=0; b < backends.size(); b++) {
+        if (!found[b]) {
+            MPC_ERROR("%s has no model of the backend %s", path.c_str(), backends[b].c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+double SolveTimePredictor::predict(size_t backend, const double * features) const {
+    double time = m_margins[backend];
+    for (size_t j=0; j < NUM_FEATURES; j++)
+        time += m_weights(backend, j) * features[j];
+    return std::max(time, 0.0);
+}
+
+
+size_t SolveTimePredictor::select(const double * features, size_t warm, double budget, double & predicted) const {
+    double cold[NUM_FEATURES];
+    std::copy(features, features + NUM_FEATURES, cold);
+    cold[8] = 0.0;
+    cold[9] = 1.0;
+    cold[10] = 0.0;
+
+    size_t fastest = 0;
+    double fastest_time = HUGE_VAL;
+    for (size_t b=0; b < size(); b++) {
+        double time = predict(b, (b == warm) ? features : cold);
+        if (budget <= 0.0 or time <= budget) {
+            predicted = time;
+            return b;
+        }
+        if (time < fastest_time) {
+            fastest = b;
+            fastest_time = time;
+        }
+    }
+    predicted = fastest_time;
+    return fastest;
+}
+
+
+bool SolveTimePredictor::write(const std::string & path, const std::vector<std::string> & names,
+                               const Eigen::MatrixXd & weights, const std::vector<double> & margins) {
+    std::ofstream file(path);
+    file.precision(17);
+    file << weights.cols() << "\n";
+    for (size_t b=0; b < names.size(); b++) {
+        file << names[b] << " " << margins[b];
+        for (int j=0; j < weights.cols(); j++)
+            file << " " << weights(b, j);
+        file << "\n";
+    }
+    if (!file) {
+        MPC_ERROR("Could not write %s", path.c_str());
+        return false;
+    }
+    return true;
+}
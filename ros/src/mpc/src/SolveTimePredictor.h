@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+
+
+///* What a tick's solve is expected to cost, by backend (see
+///* `Params::predicted_backends`): a linear model per backend of the solve
+///* time [s] on the features of the problem (`features`), fit offline to
+///* flight logs (see mpc_solvetime_fit), plus a margin, the quantile of the
+///* errors of the fit that the prediction has to cover.
+///*
+///* Before every solve, the backend is the first of the list (the most
+///* optimal first) whose prediction fits in the time left until the
+///* deadline, or the fastest one when none does: the solver is switched
+///* before a hard problem rather than cut short by the deadline in it.
+///*
+///* The file of the models is text: the number of features, then a line
+///* per backend, its name, its margin [s] and its weights.
+class SolveTimePredictor {
+public:
+    ///* 1, |cte|, |epsi|, the magnitudes of the coefficients of order 1 to
+    ///* 3 of the fit (0 past its degree), the measured and the reference
+    ///* speed [m/s], then how good the warm start is: how far the cte and
+    ///* the epsi moved since the previous solve, whether the backend starts
+    ///* cold (it didn't solve the previous tick), and its iterations then
+    ///* (0 when cold)
+    static const size_t NUM_FEATURES = 11;
+
+    ///* The features of a problem into `out`; `previous_iterations` < 0 for
+    ///* a cold start
+    static void features(double cte, double epsi, const double * coeffs, size_t num_coeffs, double speed,
+                         double ref_v, double previous_cte, double previous_epsi, int previous_iterations,
+                         double * out);
+
+    ///* Reads the models of `backends` (in their order of preference);
+    ///* false (and logs why) if it can't, or if one of them isn't there
+    bool load(const std::string & path, const std::vector<std::string> & backends);
+
+    size_t size() const { return m_margins.size(); }
+
+    ///* The solve time [s] of `backend` (an index of those loaded) for the
+    ///* problem of `features`, its margin included
+    double predict(size_t backend, const double * features) const;
+
+    ///* The first backend whose prediction is within `budget` [s] (0 for
+    ///* no deadline: the first one), else the fastest one, with its
+    ///* prediction in `predicted`. `features` are those of a warm start of
+    ///* the backend `warm` (`size()` for none), the others start cold
+    size_t select(const double * features, size_t warm, double budget, double & predicted) const;
+
+    ///* Writes the models of `names` (a row of `weights` and a margin each);
+    ///* false (and logs why) if it can't
+    static bool write(const std::string & path, const std::vector<std::string> & names,
+                      const Eigen::MatrixXd & weights, const std::vector<double> & margins);
+
+private:
+    ///* A row per backend
+    Eigen::MatrixXd m_weights;
+    std::vector<double> m_margins;
+};
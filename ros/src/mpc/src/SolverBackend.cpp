@@ -0,0 +1,68 @@
+#include <map>
+
+#include "SolverBackend.h"
+#include "Log.h"
+
+
+// Built on first use, whatever the order of the initialization of the
+// registrations
+static std::map<std::string, SolverBackends::Factory> & registry() {
+    static std::map<std::string, SolverBackends::Factory> factories;
+    return factories;
+}
+
+
+bool SolverBackends::add(const std::string & name, Factory factory) {
+    return registry().insert(std::make_pair(name, factory)).second;
+}
+
+
+std::unique_ptr<SolverBackend> SolverBackends::make(const std::string & name, const Params & params,
+                                                    double steer_bound, double speed_upperbound) {
+    auto found = registry().find(name);
+    if (found == registry().end())
+        return nullptr;
+    return found->second(params, steer_bound, speed_upperbound);
+}
+
+
+bool SolverBackends::known(const std::string & name) {
+    return registry().count(name) > 0;
+}
+
+
+std::vector<std::string> SolverBackends::names() {
+    std::vector<std::string> names;
+    for (const auto & entry : registry())
+        names.push_back(entry.first);
+    return names;
+}
+
+
+std::string backend_name(const Params & params) {
+    if (!params.backend.empty())
+        return params.backend;
+    if (params.mppi)
+        return "mppi";
+    if (params.rti)
+        return "rti";
+    if (params.riccati_solver)
+        return "riccati";
+    return "ipopt";
+}
+
+
+void apply_backend(Params & params) {
+    if (params.backend.empty())
+        return;
+    if (params.backend != "ipopt" and !SolverBackends::known(params.backend)) {
+        MPC_WARN("Unknown backend \"%s\", solving with Ipopt", params.backend.c_str());
+        params.backend = "ipopt";
+    }
+    params.riccati_solver = (params.backend == "riccati");
+    params.rti = (params.backend == "rti");
+    params.mppi = (params.backend == "mppi");
+    if (params.backend == "ipopt" or params.backend == "riccati" or params.backend == "rti"
+            or params.backend == "mppi")
+        params.backend.clear();
+}
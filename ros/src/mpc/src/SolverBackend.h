@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* What `MPC::Solve` is asked: the state, the reference (the coefficients
+///* of its polynomial), the reference speed [m/s] and when the solve has to
+///* be done by
+struct SolveProblem {
+    SolveProblem(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                 const std::chrono::steady_clock::time_point & deadline)
+            : state(state), coeffs(coeffs), ref_v(ref_v), deadline(deadline) {}
+
+    const Eigen::VectorXd & state;
+    const Eigen::VectorXd & coeffs;
+    double ref_v;
+    const std::chrono::steady_clock::time_point & deadline;
+};
+
+
+///* A solver of MPC's optimal control problem that takes the solves of an
+///* MPC over (see `Params::backend`), instead of its NLP and Ipopt: MPC
+///* keeps its bounds, corridor and obstacles, the explicit table in front of
+///* it, and the timing of the solves, and hands the rest over.
+class SolverBackend {
+public:
+    virtual ~SolverBackend() {}
+
+    ///* Solves `problem` into `result`, in the layout of `MPC::Solve` (the
+    ///* first actuations, then the (x, y) of every step), and fills in the
+    ///* fields of `stats` it knows (MPC sets `solve_time`)
+    virtual void solve(const SolveProblem & problem, std::vector<double> & result, SolveStats & stats) = 0;
+
+    ///* See `MPC::reset_warm_start`
+    virtual void reset_warm_start() = 0;
+
+    ///* The weights of the cost of `params`, from the next solve on
+    virtual void set_weights(const Params & params) = 0;
+
+    ///* Where MPC keeps the bounds of the cte of every step (with
+    ///* `Params::corridor_width`) and the obstacles (see
+    ///* `MPC::set_obstacles`), read on every solve; ignored by the backends
+    ///* that don't have them
+    virtual void set_cte_bounds(const double * lower, const double * upper) {}
+    virtual void set_obstacles(const double * positions, const double * clearances, size_t num_slots) {}
+
+    ///* Threads to share the solves with, for the backends that can (see
+    ///* `MPC::set_derivative_pool`)
+    virtual void set_pool(Eigen::ThreadPoolInterface * pool) {}
+
+    ///* Whether the solves, once warmed up, make no heap allocations
+    virtual bool allocation_free() const { return false; }
+};
+
+
+///* The backends by name, which `Params::backend` selects: "riccati" and
+///* "rti" (RiccatiSolver) and "mppi" (MPPISolver) register themselves, and
+///* "ipopt" is MPC's own NLP. A new one is a class and a registration in a
+///* file of its own, e.g.
+///*
+///*   static std::unique_ptr<SolverBackend> make_mine(const Params & params, double steer_bound,
+///*                                                   double speed_upperbound) { ... }
+///*   MPC_REGISTER_BACKEND(mine, make_mine);
+class SolverBackends {
+public:
+    ///* A backend for `params`, with the bounds of the actuators ([rad] and
+    ///* [m/s])
+    typedef std::unique_ptr<SolverBackend> (*Factory)(const Params & params, double steer_bound,
+                                                      double speed_upperbound);
+
+    ///* From the initialization of a static (see MPC_REGISTER_BACKEND); the
+    ///* first factory of a name is kept
+    static bool add(const std::string & name, Factory factory);
+
+    ///* Null when there's no backend of that name, or when it can't solve
+    ///* the problem of `params`
+    static std::unique_ptr<SolverBackend> make(const std::string & name, const Params & params,
+                                               double steer_bound, double speed_upperbound);
+
+    static bool known(const std::string & name);
+
+    ///* The registered names, sorted ("ipopt" isn't one)
+    static std::vector<std::string> names();
+};
+
+#define MPC_REGISTER_BACKEND(name, factory) \
+    static const bool mpc_backend_registered_##name = SolverBackends::add(#name, factory)
+
+
+///* The backend that `params` selects: `backend`, or when it's empty the
+///* one of the flags `mppi`, `rti` and `riccati_solver`, or "ipopt"
+std::string backend_name(const Params & params);
+
+///* Sets the flags of `params` to the built-in backend of `backend` (and
+///* empties it then, so that the flags decide), or clears them for another
+///* one; an unknown backend is Ipopt, with a warning
+void apply_backend(Params & params);
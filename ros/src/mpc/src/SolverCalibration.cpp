@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "SolverCalibration.h"
+#include "SolverBackend.h"
+#include "Log.h"
+
+
+// The candidates, Ipopt's own first
+static const char * const LINEAR_SOLVERS[] = {"mumps", "ma27", "ma57", "ma86", "ma97"};
+
+// The problems: the curvatures [1/m] of the path and the offsets [m] of
+// the car from it, and the timed rounds of all of them
+static const std::vector<double> CURVATURES = {-0.5, -0.1, 0.1, 0.5};
+static const double OFFSETS[] = {-0.2, 0.2};
+static const int NUM_ROUNDS = 3;
+
+// The first line of an Ipopt profile
+static const char * const PROFILE_MAGIC = "# mpc Ipopt profile";
+
+
+// All the problems once, false as soon as one isn't solved
+static bool solve_all(MPC & controller, const Params & params, const std::vector<double> & curvatures,
+                      std::vector<double> & result) {
+    Eigen::VectorXd coeffs = Eigen::VectorXd::Zero(params.poly_degree + 1);
+    Eigen::VectorXd state(5);
+    for (double curvature : curvatures) {
+        for (double offset : OFFSETS) {
+            coeffs[0] = offset;
+            if (params.poly_degree >= 2)
+                coeffs[2] = 0.5 * curvature;
+            state << 0, 0, 0, offset, 0;
+            controller.Solve(state, coeffs, params.ref_v, result);
+            if (!controller.ok())
+                return false;
+        }
+    }
+    return true;
+}
+
+
+// The time [s] of a solve of the problems with the options of `params`, after
+// a round to set up; -1 if one isn't solved
+static double solve_time(const Params & params, const std::vector<double> & curvatures) {
+    // Nothing of the calibration goes into the caches or the table
+    Params candidate = params;
+    candidate.calibrate_linear_solver = false;
+    candidate.calibrate_ipopt = false;
+    candidate.structure_cache.clear();
+    candidate.explicit_table.clear();
+    MPC controller(candidate);
+    controller.set_saves_solution(false);
+
+    std::vector<double> result;
+    if (!solve_all(controller, candidate, curvatures, result))
+        return -1.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        if (!solve_all(controller, candidate, curvatures, result))
+            return -1.0;
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return time / (NUM_ROUNDS * curvatures.size() * (sizeof(OFFSETS) / sizeof(OFFSETS[0])));
+}
+
+
+std::string fastest_linear_solver(const Params & params) {
+    if (backend_name(params) != "ipopt") {
+        MPC_WARN("calibrate_linear_solver needs Ipopt, ignoring it");
+        return params.linear_solver;
+    }
+
+    std::string fastest = params.linear_solver;
+    double fastest_time = -1.0;
+    for (const char * linear_solver : LINEAR_SOLVERS) {
+        Params candidate = params;
+        candidate.linear_solver = linear_solver;
+        double time = solve_time(candidate, CURVATURES);
+        if (time < 0.0) {
+            MPC_INFO("Linear solver %s: not there, or it failed", linear_solver);
+            continue;
+        }
+        MPC_INFO("Linear solver %s: %.3f ms per solve", linear_solver, 1e3 * time);
+        if (fastest_time < 0.0 or time < fastest_time) {
+            fastest = linear_solver;
+            fastest_time = time;
+        }
+    }
+
+    if (fastest_time < 0.0)
+        MPC_WARN("No linear solver solved the calibration problems, keeping linear_solver \"%s\"",
+                 params.linear_solver.c_str());
+    else
+        MPC_INFO("Using the linear solver %s for steps_ahead=%lu", fastest.c_str(), params.steps_ahead);
+    return fastest;
+}
+
+
+// The options swept, one at a time, with their values
+struct IpoptOption {
+    const char * name;
+    std::vector<std::string> values;
+    std::string (*get)(const Params & params);
+    void (*set)(Params & params, const std::string & value);
+};
+
+static const IpoptOption IPOPT_OPTIONS[] = {
+    {"linear_solver", {"mumps", "ma27", "ma57", "ma86", "ma97"},
+     [](const Params & params) { return params.linear_solver; },
+     [](Params & params, const std::string & value) { params.linear_solver = value; }},
+    {"mu_strategy", {"monotone", "adaptive"},
+     [](const Params & params) { return params.mu_strategy; },
+     [](Params & params, const std::string & value) { params.mu_strategy = value; }},
+    {"limited_memory_hessian", {"0", "1"},
+     [](const Params & params) { return std::string(params.limited_memory_hessian ? "1" : "0"); },
+     [](Params & params, const std::string & value) { params.limited_memory_hessian = (value == "1"); }},
+    {"cppad_sparsity", {"both", "forward", "reverse", "none"},
+     [](const Params & params) { return params.cppad_sparsity; },
+     [](Params & params, const std::string & value) { params.cppad_sparsity = value; }},
+};
+
+
+// What the options are calibrated for: the problem and its solver
+static std::string profile_problem(const Params & params) {
+    std::ostringstream problem;
+    problem << "steps_ahead=" << params.steps_ahead << " poly_degree=" << params.poly_degree
+            << " backend=" << backend_name(params) << " persistent_tape=" << params.persistent_tape
+            << " condensed=" << params.condensed << " analytic_derivatives=" << params.analytic_derivatives
+            << " precision=" << params.precision;
+    return problem.str();
+}
+
+
+// The options of the profile at `path`, if it's of `problem`
+static bool load_profile(const std::string & path, const std::string & problem, Params & params) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) or line != PROFILE_MAGIC)
+        return false;
+    if (!std::getline(file, line) or line != "problem " + problem)
+        return false;
+    Params loaded = params;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name, value;
+        if (!(fields >> name))
+            continue;
+        fields >> value;
+        for (const IpoptOption & option : IPOPT_OPTIONS) {
+            if (name == option.name)
+                option.set(loaded, value == "-" ? "" : value);
+        }
+    }
+    params = loaded;
+    return true;
+}
+
+
+static bool save_profile(const std::string & path, const std::string & problem, const Params & params) {
+    std::ofstream file(path);
+    file << PROFILE_MAGIC << "\n" << "problem " << problem << "\n";
+    for (const IpoptOption & option : IPOPT_OPTIONS) {
+        std::string value = option.get(params);
+        file << option.name << " " << (value.empty() ? "-" : value) << "\n";
+    }
+    return bool(file);
+}
+
+
+void calibrate_ipopt(Params & params, const std::vector<double> & curvatures) {
+    params.calibrate_ipopt = false;
+    params.calibrate_linear_solver = false;
+    if (backend_name(params) != "ipopt") {
+        MPC_WARN("calibrate_ipopt needs Ipopt, ignoring it");
+        return;
+    }
+    std::string problem = profile_problem(params);
+    if (!params.ipopt_profile.empty() and load_profile(params.ipopt_profile, problem, params)) {
+        MPC_INFO("Ipopt options from %s: linear_solver \"%s\", mu_strategy \"%s\", limited_memory_hessian %d, "
+                 "cppad_sparsity %s", params.ipopt_profile.c_str(), params.linear_solver.c_str(),
+                 params.mu_strategy.c_str(), params.limited_memory_hessian, params.cppad_sparsity.c_str());
+        return;
+    }
+
+    // Only CppAD::ipopt::solve reads the sparsity
+    const std::vector<double> & problems = curvatures.empty() ? CURVATURES : curvatures;
+    bool cppad_solve = !params.persistent_tape or params.condensed;
+    Params fastest = params;
+    double initial_time = solve_time(fastest, problems);
+    double fastest_time = initial_time;
+    for (const IpoptOption & option : IPOPT_OPTIONS) {
+        if (std::string(option.name) == "cppad_sparsity" and !cppad_solve)
+            continue;
+        std::string current = option.get(fastest);
+        for (const std::string & value : option.values) {
+            if (value == current)
+                continue;
+            Params candidate = fastest;
+            option.set(candidate, value);
+            double time = solve_time(candidate, problems);
+            if (time < 0.0) {
+                MPC_INFO("Ipopt %s %s: not there, or it failed", option.name, value.c_str());
+                continue;
+            }
+            MPC_INFO("Ipopt %s %s: %.3f ms per solve", option.name, value.c_str(), 1e3 * time);
+            if (fastest_time < 0.0 or time < fastest_time) {
+                fastest = candidate;
+                fastest_time = time;
+            }
+        }
+    }
+
+    if (fastest_time < 0.0) {
+        MPC_WARN("No options of Ipopt solved the calibration problems, keeping those of the parameters");
+        return;
+    }
+    params = fastest;
+    MPC_INFO("Using the Ipopt options linear_solver \"%s\", mu_strategy \"%s\", limited_memory_hessian %d, "
+             "cppad_sparsity %s for steps_ahead=%lu: %.3f ms per solve", params.linear_solver.c_str(),
+             params.mu_strategy.c_str(), params.limited_memory_hessian, params.cppad_sparsity.c_str(),
+             params.steps_ahead, 1e3 * fastest_time);
+    if (initial_time >= 0.0)
+        MPC_INFO("(%.3f ms per solve with the options of the parameters)", 1e3 * initial_time);
+    if (!params.ipopt_profile.empty() and !save_profile(params.ipopt_profile, problem, params))
+        MPC_WARN("Could not write the Ipopt profile %s", params.ipopt_profile.c_str());
+}
+
+
+// The 99th percentile [s] of the times of `num_solves` solves of the problems
+// (in turn) with `params`, after a round to set up, and how many of them
+// failed
+static double solve_time_p99(const Params & params, const std::vector<double> & curvatures, int num_solves,
+                             int & num_failed) {
+    Params candidate = params;
+    candidate.calibrate_linear_solver = false;
+    candidate.calibrate_ipopt = false;
+    candidate.structure_cache.clear();
+    candidate.explicit_table.clear();
+    MPC controller(candidate);
+    controller.set_saves_solution(false);
+
+    std::vector<double> result;
+    solve_all(controller, candidate, curvatures, result);
+    Eigen::VectorXd coeffs = Eigen::VectorXd::Zero(candidate.poly_degree + 1);
+    Eigen::VectorXd state(5);
+    size_t num_offsets = sizeof(OFFSETS) / sizeof(OFFSETS[0]);
+    std::vector<double> times(std::max(num_solves, 1));
+    num_failed = 0;
+    for (size_t i=0; i < times.size(); i++) {
+        double curvature = curvatures[(i / num_offsets) % curvatures.size()];
+        double offset = OFFSETS[i % num_offsets];
+        coeffs[0] = offset;
+        if (candidate.poly_degree >= 2)
+            coeffs[2] = 0.5 * curvature;
+        state << 0, 0, 0, offset, 0;
+        auto start = std::chrono::steady_clock::now();
+        controller.Solve(state, coeffs, candidate.ref_v, result);
+        times[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!controller.ok())
+            num_failed++;
+    }
+    size_t p99 = size_t(std::ceil(0.99 * times.size())) - 1;
+    std::nth_element(times.begin(), times.begin() + p99, times.end());
+    return times[p99];
+}
+
+
+bool admit(Params & params, const std::vector<double> & curvatures) {
+    if (params.admission.empty() or params.controller == "pid")
+        return true;
+    if (params.admission != "warn" and params.admission != "refuse" and params.admission != "downgrade") {
+        MPC_WARN("Unknown admission \"%s\", not checking the solve times", params.admission.c_str());
+        return true;
+    }
+    const std::vector<double> & problems = curvatures.empty() ? CURVATURES : curvatures;
+    double period = (params.solve_deadline > 0.0) ? params.solve_deadline : 1.0 / params.loop_rate;
+    double budget = params.admission_budget * period;
+
+    int num_failed = 0;
+    double p99 = solve_time_p99(params, problems, params.admission_solves, num_failed);
+    if (p99 <= budget) {
+        MPC_INFO("Admitted %s with steps_ahead=%lu: p99 solve time %.3f ms, budget %.3f ms (%d of %d solves failed)",
+                 backend_name(params).c_str(), params.steps_ahead, 1e3 * p99, 1e3 * budget, num_failed,
+                 params.admission_solves);
+        return true;
+    }
+    MPC_WARN("%s with steps_ahead=%lu, poly_degree=%d can't keep up: p99 solve time %.3f ms over a budget of "
+             "%.3f ms (%.0f%% of the control period of %.3f ms; %d of %d solves failed)",
+             backend_name(params).c_str(), params.steps_ahead, params.poly_degree, 1e3 * p99, 1e3 * budget,
+             1e2 * params.admission_budget, 1e3 * period, num_failed, params.admission_solves);
+    if (params.admission == "warn")
+        return true;
+    if (params.admission == "refuse") {
+        MPC_ERROR("Refusing the configuration (admission \"refuse\")");
+        return false;
+    }
+
+    // The backends, that of `params` first
+    std::vector<std::string> backends(1, backend_name(params));
+    for (size_t start=0; start < params.admission_backends.size();) {
+        size_t end = std::min(params.admission_backends.find(',', start), params.admission_backends.size());
+        std::string backend = params.admission_backends.substr(start, end - start);
+        if (!backend.empty() and std::find(backends.begin(), backends.end(), backend) == backends.end())
+            backends.push_back(backend);
+        start = end + 1;
+    }
+    // The horizons, shorter by a quarter each
+    std::vector<size_t> horizons(1, params.steps_ahead);
+    size_t min_steps = size_t(std::max(params.admission_min_steps, 2));
+    while (horizons.back() > min_steps)
+        horizons.push_back(std::max(horizons.back() - std::max(horizons.back() / 4, size_t(1)), min_steps));
+    for (const std::string & backend : backends) {
+        for (size_t steps_ahead : horizons) {
+            if (backend == backends[0] and steps_ahead == params.steps_ahead)
+                continue;
+            Params candidate = params;
+            candidate.backend = backend;
+            apply_backend(candidate);
+            candidate.steps_ahead = steps_ahead;
+            p99 = solve_time_p99(candidate, problems, params.admission_solves, num_failed);
+            MPC_INFO("Admission: %s with steps_ahead=%lu: p99 solve time %.3f ms (%d of %d solves failed)",
+                     backend.c_str(), steps_ahead, 1e3 * p99, num_failed, params.admission_solves);
+            if (p99 <= budget and num_failed < params.admission_solves) {
+                MPC_WARN("Downgraded to %s with steps_ahead=%lu to keep up (admission \"downgrade\")",
+                         backend.c_str(), steps_ahead);
+                params = candidate;
+                return true;
+            }
+        }
+    }
+    MPC_ERROR("No backend nor horizon keeps up, refusing the configuration (admission \"downgrade\")");
+    return false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MPC.h"
+
+
+///* The linear solver of `params` (see `Params::calibrate_linear_solver`):
+///* each of Ipopt's linear solvers in turn solves a few synthetic problems
+///* of the horizon of `params` (curves of either direction, with the car
+///* off the path), a first round to set up, then timed ones, and the one
+///* with the shortest time of those that solve them all is chosen and
+///* logged. The solvers that aren't there (HSL's, without its library) fail
+///* their first solve. `params.linear_solver` when none solves them, or
+///* when the solver isn't Ipopt
+std::string fastest_linear_solver(const Params & params);
+
+///* The options of Ipopt of `params` (see `Params::calibrate_ipopt`), set in
+///* it: those of `params.ipopt_profile` when it's of the same problem, or
+///* the fastest of a sweep of one option at a time, timed as the linear
+///* solvers above on problems of the `curvatures` [1/m] (those of the path,
+///* e.g.; the synthetic ones when empty), then written to the profile.
+///* Unchanged when the solver isn't Ipopt or nothing solves the problems
+void calibrate_ipopt(Params & params, const std::vector<double> & curvatures);
+
+///* The admission of `params` at start-up (see `Params::admission`): the
+///* 99th percentile of the times of `admission_solves` solves of the
+///* problems of the `curvatures` (as above) against `admission_budget` of
+///* the control period. When it's over, "warn" logs it, "refuse" returns
+///* false, and "downgrade" sets the first configuration that's within it
+///* into `params`: of the horizon of `steps_ahead`, then of shorter ones
+///* (by quarters, down to `admission_min_steps`), with the backend of
+///* `params`, then with those of `admission_backends` in turn; false when
+///* none is. True when there's nothing to check
+bool admit(Params & params, const std::vector<double> & curvatures);
@@ -0,0 +1,141 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "SolverStructure.h"
+#include "Log.h"
+
+
+const char SolverStructure::MAGIC[8] = {'M', 'P', 'C', 'S', 'T', 'R', '1', '\0'};
+
+
+// FNV-1a, of the bytes of `size` at `data`, from `hash`
+static uint64_t fnv1a(const void * data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (size_t i=0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+SolverStructure::SolverStructure(const Params & params, size_t n_vars, size_t n_constraints) {
+    std::memset(&m_header, 0, sizeof(m_header));
+    std::memcpy(m_header.magic, MAGIC, sizeof(MAGIC));
+    m_header.n_vars = n_vars;
+    m_header.n_constraints = n_constraints;
+    m_header.steps_ahead = uint32_t(params.steps_ahead);
+    m_header.poly_degree = params.contouring_reference ? -1 : params.poly_degree;
+    m_header.checkpoint_stage = params.checkpoint_stage ? 1 : 0;
+    m_header.extra_constraints = (params.terminal_cte > 0.0 ? 1 : 0) | (params.terminal_epsi > 0.0 ? 2 : 0)
+            | (params.max_steer_rate > 0.0 ? 4 : 0) | (params.max_obstacles > 0 ? 8 : 0)
+            | (params.terminal_cost ? 16 : 0) | (params.integrator != "euler" ? 32 : 0)
+            | (params.parallel_stages > 1 ? 64 : 0);
+    m_header.blocks_hash = fnv1a(params.input_blocks.data(), params.input_blocks.size() * sizeof(int));
+}
+
+
+std::string SolverStructure::path(const std::string & directory) const {
+    // The key alone: the sizes after it are the contents'
+    uint64_t key = fnv1a(&m_header, offsetof(Header, jac_size));
+    char name[64];
+    std::snprintf(name, sizeof(name), "/structure-%016llx.bin", (unsigned long long)key);
+    return directory + name;
+}
+
+
+bool SolverStructure::load(const std::string & path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    Header header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file or std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        MPC_WARN("%s is not a solver structure, ignoring it", path.c_str());
+        return false;
+    }
+    if (std::memcmp(&header, &m_header, offsetof(Header, jac_size)) != 0) {
+        MPC_WARN("%s is the structure of another problem, ignoring it", path.c_str());
+        return false;
+    }
+    if (header.solution_size != 0 and header.solution_size != header.n_vars) {
+        MPC_WARN("%s is corrupt, ignoring it", path.c_str());
+        return false;
+    }
+
+    std::vector<uint32_t> rows(header.jac_size), cols(header.jac_size);
+    std::vector<uint32_t> hes_rows(header.hes_size), hes_cols(header.hes_size);
+    std::vector<double> x(header.solution_size);
+    file.read(reinterpret_cast<char *>(rows.data()), rows.size() * sizeof(uint32_t));
+    file.read(reinterpret_cast<char *>(cols.data()), cols.size() * sizeof(uint32_t));
+    file.read(reinterpret_cast<char *>(hes_rows.data()), hes_rows.size() * sizeof(uint32_t));
+    file.read(reinterpret_cast<char *>(hes_cols.data()), hes_cols.size() * sizeof(uint32_t));
+    file.read(reinterpret_cast<char *>(x.data()), x.size() * sizeof(double));
+
+    // The patterns index the rows of `fg` and the variables
+    bool OK = bool(file) and file.peek() == std::ifstream::traits_type::eof();
+    for (size_t k=0; OK and k < rows.size(); k++)
+        OK = (rows[k] < 1 + header.n_constraints and cols[k] < header.n_vars);
+    for (size_t k=0; OK and k < hes_rows.size(); k++)
+        OK = (hes_rows[k] < header.n_vars and hes_cols[k] < header.n_vars);
+    if (!OK) {
+        MPC_WARN("%s is corrupt, ignoring it", path.c_str());
+        return false;
+    }
+
+    m_header = header;
+    jac_row.swap(rows);
+    jac_col.swap(cols);
+    hes_row.swap(hes_rows);
+    hes_col.swap(hes_cols);
+    solution.swap(x);
+    return true;
+}
+
+
+bool SolverStructure::save(const std::string & path) const {
+    if (jac_row.size() != jac_col.size() or hes_row.size() != hes_col.size()
+            or (!solution.empty() and solution.size() != m_header.n_vars)) {
+        MPC_ERROR("The solver structure doesn't have the sizes of its problem");
+        return false;
+    }
+    Header header = m_header;
+    header.jac_size = jac_row.size();
+    header.hes_size = hes_row.size();
+    header.solution_size = solution.size();
+
+    std::string directory = path.substr(0, path.rfind('/'));
+    if (!directory.empty() and mkdir(directory.c_str(), 0755) != 0 and errno != EEXIST) {
+        MPC_ERROR("Could not create %s: %s", directory.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    std::string tmp_path = path + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(uintptr_t(this));
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(jac_row.data()), jac_row.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char *>(jac_col.data()), jac_col.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char *>(hes_row.data()), hes_row.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char *>(hes_col.data()), hes_col.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char *>(solution.data()), solution.size() * sizeof(double));
+        if (!file) {
+            MPC_ERROR("Could not write %s", tmp_path.c_str());
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        MPC_ERROR("Could not write %s: %s", path.c_str(), std::strerror(errno));
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MPC.h"
+
+
+///* What the first solves of an MPC with `persistent_tape` would otherwise
+///* have to work out again on every start of the node (see
+///* `Params::structure_cache`): the sparsity patterns of the tape, and a
+///* representative solution to warm start from (the last one of the
+///* previous run).
+///*
+///* The file is the Header, then the (row, col) of every entry of the
+///* Jacobian of `fg` (the cost's row 0 included), those of the Hessian of
+///* the Lagrangian (both triangles), as uint32, and then the solution, in
+///* doubles. Its name is that of the key of the Header, so the controllers
+///* of several horizons share the directory.
+class SolverStructure {
+public:
+    struct Header {
+        char magic[8];
+        ///* The key: the shape of the NLP, which the patterns are for
+        uint64_t n_vars;
+        uint64_t n_constraints;
+        uint32_t steps_ahead;
+        ///* -1 with `Params::contouring_reference`
+        int32_t poly_degree;
+        uint32_t checkpoint_stage;
+        ///* Which of `Params::terminal_cte`, `terminal_epsi`,
+        ///* `max_steer_rate` and `max_obstacles` there are (bits 0 to 3),
+        ///* and `terminal_cost`, which adds to the Hessian (bit 4), and an
+        ///* `integrator` other than Euler's, whose steps depend on more
+        ///* variables (bit 5), and `parallel_stages`, which takes the steps
+        ///* out of the tape (bit 6)
+        uint32_t extra_constraints;
+        ///* Hash of `Params::input_blocks`
+        uint64_t blocks_hash;
+        ///* The sizes of what follows
+        uint64_t jac_size;
+        uint64_t hes_size;
+        uint64_t solution_size;
+    };
+
+    ///* The structure of the MPC of `params` (with the sizes of its NLP), to
+    ///* be filled in or loaded
+    SolverStructure(const Params & params, size_t n_vars, size_t n_constraints);
+
+    ///* The file of this structure in `directory`
+    std::string path(const std::string & directory) const;
+
+    ///* Loads the structure from `path`; false if there's no such file (or
+    ///* it's for another NLP, or it isn't one, which is logged)
+    bool load(const std::string & path);
+
+    ///* Writes it to `path`, creating its directory (not the parents); false
+    ///* (and logs why) if it can't. Written aside and then renamed, so the
+    ///* controllers writing the same one don't get in each other's way
+    bool save(const std::string & path) const;
+
+    size_t n_vars() const { return m_header.n_vars; }
+    size_t n_constraints() const { return m_header.n_constraints; }
+
+    ///* Whether there are patterns (loaded, or filled in from the tape)
+    bool patterns_OK() const { return !jac_row.empty(); }
+
+    ///* The patterns, see above
+    std::vector<uint32_t> jac_row;
+    std::vector<uint32_t> jac_col;
+    std::vector<uint32_t> hes_row;
+    std::vector<uint32_t> hes_col;
+
+    ///* The variables of a solution, in the layout of the MPC's Indexes
+    ///* (empty if there's none)
+    std::vector<double> solution;
+
+private:
+    Header m_header;
+
+    static const char MAGIC[8];
+};
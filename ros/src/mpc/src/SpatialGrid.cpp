@@ -0,0 +1,178 @@
+#include <cmath>
+#include <algorithm>
+
+#include "SpatialGrid.h"
+
+
+constexpr double SpatialGrid::POINTS_PER_CELL;
+constexpr double SpatialGrid::MIN_CELL_SIZE;
+
+
+SpatialGrid::SpatialGrid()
+        : m_min_x(0.0), m_min_y(0.0), m_cell_size(1.0),
+          m_num_cells_x(0), m_num_cells_y(0)
+{}
+
+
+void SpatialGrid::build(const std::vector<double> & pts_x, const std::vector<double> & pts_y) {
+    size_t num_points = pts_x.size();
+    m_cell_start.clear();
+    m_cell_points.clear();
+    m_pts_x.clear();
+    m_pts_y.clear();
+    m_num_cells_x = 0;
+    m_num_cells_y = 0;
+    if (num_points == 0)
+        return;
+
+    double max_x = pts_x[0], max_y = pts_y[0];
+    m_min_x = pts_x[0];
+    m_min_y = pts_y[0];
+    for (size_t i=1; i < num_points; i++) {
+        m_min_x = std::min(m_min_x, pts_x[i]);
+        m_min_y = std::min(m_min_y, pts_y[i]);
+        max_x = std::max(max_x, pts_x[i]);
+        max_y = std::max(max_y, pts_y[i]);
+    }
+
+    // A path is a curve, so its points are spread along the diagonal rather
+    // than over the whole bounding box
+    double extent = std::hypot(max_x - m_min_x, max_y - m_min_y);
+    m_cell_size = std::max(extent * POINTS_PER_CELL / num_points, MIN_CELL_SIZE);
+    m_num_cells_x = int((max_x - m_min_x) / m_cell_size) + 1;
+    m_num_cells_y = int((max_y - m_min_y) / m_cell_size) + 1;
+
+    // Counting sort of the points by cell
+    size_t num_cells = size_t(m_num_cells_x) * m_num_cells_y;
+    std::vector<int> point_cell(num_points);
+    m_cell_start.assign(num_cells + 1, 0);
+    for (size_t i=0; i < num_points; i++) {
+        point_cell[i] = cell_y(pts_y[i]) * m_num_cells_x + cell_x(pts_x[i]);
+        m_cell_start[point_cell[i] + 1]++;
+    }
+    for (size_t c=0; c < num_cells; c++)
+        m_cell_start[c + 1] += m_cell_start[c];
+
+    std::vector<int> fill(m_cell_start.begin(), m_cell_start.end() - 1);
+    m_cell_points.resize(num_points);
+    m_pts_x.resize(num_points);
+    m_pts_y.resize(num_points);
+    for (size_t i=0; i < num_points; i++) {
+        int k = fill[point_cell[i]]++;
+        m_cell_points[k] = i;
+        m_pts_x[k] = pts_x[i];
+        m_pts_y[k] = pts_y[i];
+    }
+}
+
+
+int SpatialGrid::cell_x(double x) const {
+    return int(std::floor((x - m_min_x) / m_cell_size));
+}
+
+
+int SpatialGrid::cell_y(double y) const {
+    return int(std::floor((y - m_min_y) / m_cell_size));
+}
+
+
+void SpatialGrid::visit_cell(int cx, int cy, double x, double y, int & best_idx, double & best_dist) const {
+    if (cx < 0 or cy < 0 or cx >= m_num_cells_x or cy >= m_num_cells_y)
+        return;
+    int c = cy * m_num_cells_x + cx;
+    for (int k = m_cell_start[c]; k < m_cell_start[c + 1]; k++) {
+        double diff_x = m_pts_x[k] - x;
+        double diff_y = m_pts_y[k] - y;
+        double dist = diff_x*diff_x + diff_y*diff_y;
+        // Ties go to the lowest index, as in a linear scan
+        if (dist < best_dist or (dist == best_dist and m_cell_points[k] < best_idx)) {
+            best_idx = m_cell_points[k];
+            best_dist = dist;
+        }
+    }
+}
+
+
+// Squared distance from (x, y) to the rectangle [x0, x1] x [y0, y1], or
+// 1e38 if it's empty
+static double rect_dist2(double x, double y, double x0, double x1, double y0, double y1) {
+    if (x0 > x1 or y0 > y1)
+        return 1.0e38;
+    double dx = std::max(std::max(x0 - x, 0.0), x - x1);
+    double dy = std::max(std::max(y0 - y, 0.0), y - y1);
+    return dx*dx + dy*dy;
+}
+
+
+int SpatialGrid::nearest(double x, double y) const {
+    if (empty())
+        return -1;
+
+    // Search rings of cells of growing (Chebyshev) radius around the cell of
+    // the query (clamped to the grid, for queries outside of it)
+    int cx = std::min(std::max(cell_x(x), 0), m_num_cells_x - 1);
+    int cy = std::min(std::max(cell_y(y), 0), m_num_cells_y - 1);
+    int max_ring = std::max(std::max(cx, m_num_cells_x - 1 - cx), std::max(cy, m_num_cells_y - 1 - cy));
+
+    double grid_x1 = m_min_x + m_num_cells_x * m_cell_size;
+    double grid_y1 = m_min_y + m_num_cells_y * m_cell_size;
+
+    int best_idx = -1;
+    double best_dist = 1.0e19;
+    for (int r=0; r <= max_ring; r++) {
+        if (r == 0) {
+            visit_cell(cx, cy, x, y, best_idx, best_dist);
+        } else {
+            for (int i=-r; i <= r; i++) {
+                visit_cell(cx + i, cy - r, x, y, best_idx, best_dist);
+                visit_cell(cx + i, cy + r, x, y, best_idx, best_dist);
+            }
+            for (int i=-r+1; i <= r-1; i++) {
+                visit_cell(cx - r, cy + i, x, y, best_idx, best_dist);
+                visit_cell(cx + r, cy + i, x, y, best_idx, best_dist);
+            }
+        }
+        if (best_idx < 0)
+            continue;
+
+        // The points not visited yet are in the grid but outside of the
+        // square of cells searched so far, i.e. in one of these four strips
+        double box_x0 = m_min_x + (cx - r) * m_cell_size;
+        double box_x1 = m_min_x + (cx + r + 1) * m_cell_size;
+        double box_y0 = m_min_y + (cy - r) * m_cell_size;
+        double box_y1 = m_min_y + (cy + r + 1) * m_cell_size;
+        double lower_bound = std::min(
+                std::min(rect_dist2(x, y, m_min_x, box_x0, m_min_y, grid_y1),
+                         rect_dist2(x, y, box_x1, grid_x1, m_min_y, grid_y1)),
+                std::min(rect_dist2(x, y, m_min_x, grid_x1, m_min_y, box_y0),
+                         rect_dist2(x, y, m_min_x, grid_x1, box_y1, grid_y1)));
+        if (best_dist < lower_bound)
+            break;
+    }
+    return best_idx;
+}
+
+
+void SpatialGrid::within_radius(double x, double y, double radius, std::vector<int> & result) const {
+    result.clear();
+    if (empty())
+        return;
+
+    int cx_min = std::max(cell_x(x - radius), 0);
+    int cx_max = std::min(cell_x(x + radius), m_num_cells_x - 1);
+    int cy_min = std::max(cell_y(y - radius), 0);
+    int cy_max = std::min(cell_y(y + radius), m_num_cells_y - 1);
+    double radius2 = radius * radius;
+
+    for (int cy = cy_min; cy <= cy_max; cy++) {
+        for (int cx = cx_min; cx <= cx_max; cx++) {
+            int c = cy * m_num_cells_x + cx;
+            for (int k = m_cell_start[c]; k < m_cell_start[c + 1]; k++) {
+                double diff_x = m_pts_x[k] - x;
+                double diff_y = m_pts_y[k] - y;
+                if (diff_x*diff_x + diff_y*diff_y <= radius2)
+                    result.push_back(m_cell_points[k]);
+            }
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+
+///* Uniform grid over a set of 2D points (the waypoints of the centerline),
+///* for nearest-point and radius queries that don't scan all of them. The
+///* points are bucketed by cell and stored cell after cell, so a query only
+///* visits the cells around it.
+class SpatialGrid {
+public:
+    SpatialGrid();
+
+    ///* (Re)builds the grid over the points; it keeps no reference to them
+    void build(const std::vector<double> & pts_x, const std::vector<double> & pts_y);
+
+    bool empty() const { return m_pts_x.empty(); }
+
+    ///* Index of the point closest to (x, y), -1 if there are none
+    int nearest(double x, double y) const;
+
+    ///* Indices of the points within `radius` of (x, y), in no particular order
+    void within_radius(double x, double y, double radius, std::vector<int> & result) const;
+
+private:
+    ///* Which stores and restores the grid as is
+    friend class TrackStore;
+
+    int cell_x(double x) const;
+    int cell_y(double y) const;
+
+    ///* Checks the points of the cell (if it exists) against the best so far
+    void visit_cell(int cx, int cy, double x, double y, int & best_idx, double & best_dist) const;
+
+    double m_min_x;
+    double m_min_y;
+    double m_cell_size;
+    int m_num_cells_x;
+    int m_num_cells_y;
+
+    ///* Points of cell c: m_cell_points[m_cell_start[c] ... m_cell_start[c + 1])
+    std::vector<int> m_cell_start;
+    std::vector<int> m_cell_points;
+
+    ///* Copies of the points, in the order of `m_cell_points`
+    std::vector<double> m_pts_x;
+    std::vector<double> m_pts_y;
+
+    ///* The cells are sized for about this many points per cell (with a
+    ///* lower bound on the size, for tiny or degenerate paths)
+    static constexpr double POINTS_PER_CELL = 4.0;
+    static constexpr double MIN_CELL_SIZE = 0.05; // [m]
+};
@@ -0,0 +1,117 @@
+#include <cmath>
+#include <algorithm>
+
+#include "SpeedProfile.h"
+
+
+constexpr double SpeedProfile::SAMPLE_SPACING;
+constexpr double SpeedProfile::MAX_SPEED;
+
+
+SpeedProfile::SpeedProfile()
+        : m_closed(false), m_length(0.0), m_spacing(SAMPLE_SPACING),
+          m_max_lateral_accel(0.0), m_max_accel(0.0), m_max_decel(0.0)
+{}
+
+
+void SpeedProfile::build(const PathSpline & spline, double max_lateral_accel, double max_accel, double max_decel) {
+    m_max_lateral_accel = max_lateral_accel;
+    m_max_accel = max_accel;
+    m_max_decel = max_decel;
+    m_speed.clear();
+    m_limit.clear();
+    m_closed = spline.closed();
+    m_length = spline.length();
+    if (spline.empty() or m_length <= 0.0)
+        return;
+
+    // The samples divide the path evenly; a closed one's last sample is its
+    // first one again
+    size_t num_intervals = std::max(size_t(1), size_t(std::ceil(m_length / SAMPLE_SPACING)));
+    m_spacing = m_length / num_intervals;
+    size_t num_samples = m_closed ? num_intervals : num_intervals + 1;
+    m_limit.resize(num_samples);
+    for (size_t i=0; i < num_samples; i++)
+        m_limit[i] = lateral_limit(spline, i * m_spacing);
+    limit_accel();
+}
+
+
+void SpeedProfile::update(const PathSpline & spline, double s_begin, double s_end, double shift) {
+    if (m_speed.empty() or spline.empty() or spline.closed() != m_closed or spline.length() <= 0.0) {
+        build(spline, m_max_lateral_accel, m_max_accel, m_max_decel);
+        return;
+    }
+
+    std::vector<double> old_limit;
+    old_limit.swap(m_limit);
+    double old_spacing = m_spacing;
+    double old_length = m_length;
+    size_t old_samples = old_limit.size();
+    m_length = spline.length();
+    size_t num_intervals = std::max(size_t(1), size_t(std::ceil(m_length / SAMPLE_SPACING)));
+    m_spacing = m_length / num_intervals;
+    size_t num_samples = m_closed ? num_intervals : num_intervals + 1;
+    m_limit.resize(num_samples);
+    for (size_t i=0; i < num_samples; i++) {
+        double s = i * m_spacing;
+        if (s >= s_begin and s <= s_end) {
+            m_limit[i] = lateral_limit(spline, s);
+            continue;
+        }
+        double old_s = (s < s_begin) ? s : s - shift;
+        double position = std::min(std::max(old_s, 0.0), old_length) / old_spacing;
+        size_t j = std::min(size_t(position), m_closed ? old_samples - 1 : old_samples - 2);
+        size_t next = m_closed ? (j + 1) % old_samples : j + 1;
+        double t = std::min(std::max(position - j, 0.0), 1.0);
+        m_limit[i] = old_limit[j] + t * (old_limit[next] - old_limit[j]);
+    }
+    limit_accel();
+}
+
+
+double SpeedProfile::lateral_limit(const PathSpline & spline, double s) const {
+    double curvature = std::abs(spline.curvature(s));
+    return (curvature * MAX_SPEED * MAX_SPEED > m_max_lateral_accel)
+            ? std::sqrt(m_max_lateral_accel / curvature) : MAX_SPEED;
+}
+
+
+void SpeedProfile::limit_accel() {
+    // v[i+1]^2 <= v[i]^2 + 2 a ds, forwards with the acceleration, and
+    // backwards with the deceleration
+    m_speed = m_limit;
+    size_t num_samples = m_speed.size();
+    double accel_step = 2.0 * m_max_accel * m_spacing;
+    double decel_step = 2.0 * m_max_decel * m_spacing;
+    size_t num_steps = m_closed ? 2 * num_samples : num_samples - 1;
+    for (size_t k=0; k < num_steps; k++) {
+        size_t i = k % num_samples, next = (k + 1) % num_samples;
+        m_speed[next] = std::min(m_speed[next], std::sqrt(m_speed[i] * m_speed[i] + accel_step));
+    }
+    for (size_t k=num_steps; k > 0; k--) {
+        size_t i = k % num_samples, previous = (k - 1) % num_samples;
+        m_speed[previous] = std::min(m_speed[previous], std::sqrt(m_speed[i] * m_speed[i] + decel_step));
+    }
+}
+
+
+double SpeedProfile::speed(double s) const {
+    if (m_speed.empty())
+        return MAX_SPEED;
+    if (m_closed) {
+        s = std::fmod(s, m_length);
+        if (s < 0.0)
+            s += m_length;
+    } else {
+        s = std::min(std::max(s, 0.0), m_length);
+    }
+
+    size_t num_samples = m_speed.size();
+    double position = s / m_spacing;
+    // An open path has a sample at either end, so at least two
+    size_t i = std::min(size_t(position), m_closed ? num_samples - 1 : num_samples - 2);
+    size_t next = m_closed ? (i + 1) % num_samples : i + 1;
+    double t = std::min(std::max(position - i, 0.0), 1.0);
+    return m_speed[i] + t * (m_speed[next] - m_speed[i]);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+#include "PathSpline.h"
+
+
+///* The fastest speed along the path that keeps within the limits of the
+///* car, as a table over the arc length (of PathSpline) built once per
+///* path, so a tick looks its reference speed up at the car's progress in
+///* O(1).
+///*
+///* The speed of every sample is first that of the lateral acceleration
+///* limit on the curvature there (v^2 |k| <= a_lat), then a forward pass
+///* caps it by what the car reaches accelerating from the previous sample
+///* and a backward pass by what it can still brake from to the next one. A
+///* closed path is passed over twice around, so the laps join up.
+class SpeedProfile {
+public:
+    SpeedProfile();
+
+    ///* (Re)builds the profile of the spline for the lateral acceleration,
+    ///* acceleration and deceleration limits [m/s^2]
+    void build(const PathSpline & spline, double max_lateral_accel, double max_accel, double max_decel);
+
+    ///* Takes in a change of the spline over the arc length [s_begin,
+    ///* s_end] (see `PathSpline::update`), past which the arc length shifted
+    ///* by `shift` [m]: the lateral limits of the samples there are taken
+    ///* again, the others carried over (from their shifted arc length), and
+    ///* the passes made again
+    void update(const PathSpline & spline, double s_begin, double s_end, double shift);
+
+    bool empty() const { return m_speed.empty(); }
+
+    ///* The limits it's built for
+    double max_lateral_accel() const { return m_max_lateral_accel; }
+    double max_accel() const { return m_max_accel; }
+    double max_decel() const { return m_max_decel; }
+
+    ///* The speed [m/s] at the arc length `s` (wrapped around on a closed
+    ///* path, clamped to the ends otherwise), interpolated between the two
+    ///* samples about it
+    double speed(double s) const;
+
+private:
+    bool m_closed;
+    double m_length;
+    double m_spacing;
+    std::vector<double> m_speed;
+    ///* ... and before the passes, by the lateral acceleration only
+    std::vector<double> m_limit;
+
+    ///* The lateral limit at the curvature of the spline at s, and the
+    ///* passes from `m_limit` to `m_speed`
+    double lateral_limit(const PathSpline & spline, double s) const;
+    void limit_accel();
+
+    double m_max_lateral_accel;
+    double m_max_accel;
+    double m_max_decel;
+
+    ///* The samples are this far apart along the path (or closer, so that
+    ///* they divide it evenly)
+    static constexpr double SAMPLE_SPACING = 0.05; // [m]
+
+    ///* The speed on the straights, beyond anything the car does
+    static constexpr double MAX_SPEED = 100.0; // [m/s]
+};
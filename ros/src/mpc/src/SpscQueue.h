@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+///* Lock-free queue of up to N values from one writer thread to one reader
+///* thread, in slots allocated up front: the writer fills the slot `back()`
+///* gives it and `push()`es it, the reader reads `front()` and `pop()`s it.
+///* Neither of them ever waits for the other, a full queue just has no slot
+///* to write into.
+///*
+///* Unlike TripleBuffer, every value pushed is there for the reader until
+///* it pops it, so a value can stay in its slot while it's being worked on
+///* (e.g. be swapped with the reader's own buffers).
+template <class T, size_t N>
+class SpscQueue {
+public:
+    SpscQueue() : m_head(0), m_tail(0) {}
+
+    ///* Writer side: the slot of the next value, nullptr when the queue is
+    ///* full
+    T * back() {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == N)
+            return nullptr;
+        return &m_slots[head % N];
+    }
+
+    void push() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    ///* Reader side: the oldest value, nullptr when the queue is empty
+    T * front() {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return nullptr;
+        return &m_slots[tail % N];
+    }
+
+    void pop() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    ///* Values pushed and not popped yet (from the reader's side)
+    size_t size() const {
+        return size_t(m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed));
+    }
+
+private:
+    T m_slots[N];
+
+    ///* Values pushed (only written by the writer) and popped (only written
+    ///* by the reader) so far, kept a cache line apart
+    std::atomic<uint64_t> m_head;
+    char m_padding[64];
+    std::atomic<uint64_t> m_tail;
+};
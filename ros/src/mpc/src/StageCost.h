@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+#include "MPC.h"
+
+
+///* The stage cost of the NLP, declared as a list of terms at compile time
+///* (see `Terms` and `Cost` at the end): every term is a weight times the
+///* square of a linear residual of the variables of a step, so its value,
+///* its gradient and its (constant) Hessian all follow from the declaration,
+///* with no tape. FG_eval and FG_eval_condensed record the value on their
+///* AD scalars, KinematicModel evaluates the value and the gradient in one
+///* pass and emits the Hessian's entries.
+///*
+///* A new term is a line of `Cost`, and a weight of `Weight` (and of
+///* `weights`); the derivatives come with it.
+namespace StageCost {
+
+///* The weights of the terms, by index into the arrays of weights the
+///* functions below take (their Scalars, or anything convertible)
+enum Weight { W_CTE, W_EPSI, W_SPEED, W_STEER, W_CONSEC_STEER, W_CONSEC_SPEED, NUM_WEIGHTS };
+
+
+///* The weights of `params`, in the order of `Weight`
+inline void weights(const Params & params, double * out) {
+    out[W_CTE] = params.cte_coeff;
+    out[W_EPSI] = params.epsi_coeff;
+    out[W_SPEED] = params.speed_coeff;
+    out[W_STEER] = params.steer_coeff;
+    out[W_CONSEC_STEER] = params.consec_steer_coeff;
+    out[W_CONSEC_SPEED] = params.consec_speed_coeff;
+}
+
+
+enum Variable { CTE, EPSI, DELTA, V };
+
+///* The variable `Var` of step t + Lag (the actuations through the blocks
+///* of move blocking, see `Indexes::delta`)
+template <Variable Var, size_t Lag = 0>
+struct At {
+    static size_t index(const Indexes & I, size_t t) {
+        return Var == CTE ? I.cte_start + t + Lag
+             : Var == EPSI ? I.epsi_start + t + Lag
+             : Var == DELTA ? I.delta(t + Lag)
+             : I.v(t + Lag);
+    }
+};
+
+
+///* The term Weight * (Plus - Minus - ref_v if Reference)^2 of the steps t
+///* from 0 to steps_ahead - Shorter (excluded). A difference is skipped on
+///* the steps whose two variables are the same (within a block of move
+///* blocking)
+template <Weight W, size_t Shorter, class Plus, class Minus = void, bool Reference = false>
+struct Square {
+    static const bool DIFFERENCE = !std::is_void<Minus>::value;
+
+    template <class Scalar, class Vars>
+    static Scalar residual(const Vars & x, size_t plus, size_t minus, const Scalar & ref_v) {
+        Scalar r = Scalar(x[plus]);
+        if (DIFFERENCE)
+            r -= Scalar(x[minus]);
+        if (Reference)
+            r -= ref_v;
+        return r;
+    }
+
+    ///* Adds the term to `f`, and its gradient to `grad` unless null
+    template <class Scalar, class Vars, class Weights, class Grad>
+    static void evaluate(const Vars & x, const Indexes & I, size_t steps_ahead, const Weights & weights,
+                         const Scalar & ref_v, Scalar & f, Grad * grad) {
+        const Scalar w = Scalar(weights[W]);
+        for (size_t t=0; t + Shorter < steps_ahead; t++) {
+            size_t plus = Plus::index(I, t);
+            size_t minus = plus;
+            if (DIFFERENCE) {
+                minus = Step<Minus>::index(I, t);
+                if (minus == plus)
+                    continue;
+            }
+            Scalar r = residual(x, plus, minus, ref_v);
+            f += w * (r * r);
+            if (grad != nullptr) {
+                Scalar g = Scalar(2) * w * r;
+                grad[plus] += g;
+                if (DIFFERENCE)
+                    grad[minus] -= g;
+            }
+        }
+    }
+
+    ///* Calls emit(row, col, value) for the entries of the lower triangle
+    ///* of the term's Hessian, by `scale` (the same whatever x)
+    template <class Scalar, class Weights, class Emit>
+    static void hessian(const Indexes & I, size_t steps_ahead, const Weights & weights, double scale, Emit emit) {
+        const Scalar h = Scalar(2 * scale * weights[W]);
+        for (size_t t=0; t + Shorter < steps_ahead; t++) {
+            size_t plus = Plus::index(I, t);
+            if (!DIFFERENCE) {
+                emit(plus, plus, h);
+                continue;
+            }
+            size_t minus = Step<Minus>::index(I, t);
+            if (minus == plus)
+                continue;
+            emit(plus, plus, h);
+            emit(minus, minus, h);
+            emit(std::max(plus, minus), std::min(plus, minus), Scalar(-h));
+        }
+    }
+
+private:
+    // (Minus is void when there's no difference, and isn't indexed then)
+    template <class Var, class = void>
+    struct Step {
+        static size_t index(const Indexes & I, size_t t) { return Var::index(I, t); }
+    };
+    template <class Dummy>
+    struct Step<void, Dummy> {
+        static size_t index(const Indexes &, size_t) { return 0; }
+    };
+};
+
+
+///* A sum of terms
+template <class... Term>
+struct Terms;
+
+template <>
+struct Terms<> {
+    template <class Scalar, class Vars, class Weights, class Grad>
+    static void evaluate(const Vars &, const Indexes &, size_t, const Weights &, const Scalar &, Scalar &, Grad *) {}
+
+    template <class Scalar, class Weights, class Emit>
+    static void hessian(const Indexes &, size_t, const Weights &, double, Emit) {}
+};
+
+template <class First, class... Rest>
+struct Terms<First, Rest...> {
+    template <class Scalar, class Vars, class Weights, class Grad>
+    static void evaluate(const Vars & x, const Indexes & I, size_t steps_ahead, const Weights & weights,
+                         const Scalar & ref_v, Scalar & f, Grad * grad) {
+        First::evaluate(x, I, steps_ahead, weights, ref_v, f, grad);
+        Terms<Rest...>::evaluate(x, I, steps_ahead, weights, ref_v, f, grad);
+    }
+
+    template <class Scalar, class Weights, class Emit>
+    static void hessian(const Indexes & I, size_t steps_ahead, const Weights & weights, double scale, Emit emit) {
+        First::template hessian<Scalar>(I, steps_ahead, weights, scale, emit);
+        Terms<Rest...>::template hessian<Scalar>(I, steps_ahead, weights, scale, emit);
+    }
+
+    ///* The sum of the terms at `x` (anything indexable, of anything
+    ///* convertible to Scalar, AD scalars included)
+    template <class Scalar, class Vars, class Weights>
+    static Scalar value(const Vars & x, const Indexes & I, size_t steps_ahead, const Weights & weights,
+                        const Scalar & ref_v) {
+        Scalar f = Scalar(0);
+        evaluate(x, I, steps_ahead, weights, ref_v, f, static_cast<Scalar *>(nullptr));
+        return f;
+    }
+};
+
+
+///* The cost of FG_eval: the errors of the states of every step, the
+///* actuations of every step but the last (the speed's from the reference
+///* speed), and the changes of the actuations between consecutive steps
+typedef Terms<
+    Square<W_CTE, 0, At<CTE>>,
+    Square<W_EPSI, 0, At<EPSI>>,
+    Square<W_SPEED, 1, At<V>, void, true>,
+    Square<W_STEER, 1, At<DELTA>>,
+    Square<W_CONSEC_STEER, 2, At<DELTA, 1>, At<DELTA>>,
+    Square<W_CONSEC_SPEED, 2, At<V, 1>, At<V>>
+> Cost;
+
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+
+#include "StageStats.h"
+
+
+constexpr size_t StageStats::MAX_BACKENDS;
+
+
+const char * const StageStats::STAGE_NAMES[TelemetryRecord::NUM_STAGES] = {
+    "snapshot", "closest", "transform", "polyfit", "derivatives", "solver", "publish", "tick"
+};
+
+
+void StageStats::record(const TelemetryRecord & record, double period, bool histograms) {
+    if (record.events & TelemetryRecord::NO_OPTIMIZATION)
+        return;
+
+    if (histograms) {
+        for (int s=0; s < TelemetryRecord::NUM_STAGES; s++)
+            if (record.stage_time[s] >= 0.0f)
+                stages[s].record(record.stage_time[s]);
+        if (record.linear_solver_time >= 0.0f)
+            linear_solver.record(record.linear_solver_time);
+        for (int s=0; s < TelemetryRecord::NUM_STAGES; s++) {
+            if (record.stage_counts[s].cycles > 0) {
+                stage_counts[s] += record.stage_counts[s];
+                num_counted[s]++;
+            }
+            if (record.stage_cpu_time[s] >= 0.0f) {
+                stage_cpu_time[s] += record.stage_cpu_time[s];
+                num_cpu_timed[s]++;
+            }
+        }
+        size_t backend = std::min(size_t(record.backend), MAX_BACKENDS - 1);
+        backend_ticks[backend]++;
+        if (record.stage_cpu_time[TelemetryRecord::STAGE_TICK] >= 0.0f) {
+            backend_cpu_time[backend] += record.stage_cpu_time[TelemetryRecord::STAGE_TICK];
+            backend_cpu_timed[backend]++;
+        }
+        if (record.energy >= 0.0f) {
+            backend_energy[backend] += record.energy;
+            backend_metered[backend]++;
+        }
+    }
+
+    num_ticks++;
+    total_ticks++;
+    if (period > 0.0 and record.stage_time[TelemetryRecord::STAGE_TICK] > period) {
+        num_overruns++;
+        total_overruns++;
+    }
+    if (record.events & TelemetryRecord::DEADLINE_HIT) {
+        num_deadline_hits++;
+        total_deadline_hits++;
+    }
+    if (record.events & TelemetryRecord::RESTORATION) {
+        num_restorations++;
+        total_restorations++;
+    }
+    if (record.events & TelemetryRecord::SOLVE_FAILED) {
+        num_failures++;
+        total_failures++;
+    }
+    double cte = std::abs(double(record.cte));
+    if (cte > max_cte)
+        max_cte = cte;
+    cte_squares += cte * cte;
+    events |= record.events;
+    if (record.iterations >= 0) {
+        iterations += record.iterations;
+        num_iterations_known++;
+    }
+    if (record.constraint_violation > max_constraint_violation)
+        max_constraint_violation = record.constraint_violation;
+    if (record.slack > max_slack)
+        max_slack = record.slack;
+    if (record.tolerance > max_tolerance)
+        max_tolerance = record.tolerance;
+}
+
+
+void StageStats::reset_window() {
+    for (LatencyHistogram & histogram : stages)
+        histogram.reset();
+    linear_solver.reset();
+    num_ticks = 0;
+    num_overruns = 0;
+    num_deadline_hits = 0;
+    num_restorations = 0;
+    num_failures = 0;
+    iterations = 0;
+    num_iterations_known = 0;
+    max_constraint_violation = 0.0;
+    max_slack = 0.0;
+    max_tolerance = 0.0;
+    max_cte = 0.0;
+    cte_squares = 0.0;
+    events = 0;
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++) {
+        stage_counts[s] = PerfCounts();
+        num_counted[s] = 0;
+        stage_cpu_time[s] = 0.0;
+        num_cpu_timed[s] = 0;
+    }
+    for (size_t b=0; b < MAX_BACKENDS; b++) {
+        backend_ticks[b] = 0;
+        backend_cpu_time[b] = 0.0;
+        backend_cpu_timed[b] = 0;
+        backend_energy[b] = 0.0;
+        backend_metered[b] = 0;
+    }
+}
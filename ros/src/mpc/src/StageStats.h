@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+
+#include "LatencyHistogram.h"
+#include "MemoryStats.h"
+#include "Telemetry.h"
+
+
+///* Latency histograms of the stages of the solved ticks (from the
+///* `TelemetryRecord::stage_time` of their records) and of the solver's linear
+///* algebra, and the counts of the ticks that took longer than the control
+///* period, of the solves cut short by their deadline, of those that went
+///* through Ipopt's restoration phase and of those that failed, over a window (until `reset_window`)
+///* and in total.
+///*
+///* A flat object, which the solver loop hands over whole (see
+///* MPCControllerNode::stats_cb).
+struct StageStats {
+    LatencyHistogram stages[TelemetryRecord::NUM_STAGES];
+    LatencyHistogram linear_solver;
+
+    uint64_t num_ticks = 0;
+    uint64_t num_overruns = 0;
+    uint64_t num_deadline_hits = 0;
+    uint64_t num_restorations = 0;
+    uint64_t num_failures = 0;
+
+    uint64_t total_ticks = 0;
+    uint64_t total_overruns = 0;
+    uint64_t total_deadline_hits = 0;
+    uint64_t total_restorations = 0;
+    uint64_t total_failures = 0;
+
+    ///* Over the window: the iterations of the solves that reported them
+    ///* (and their count), the largest violation of the constraints, the
+    ///* largest slack of the soft ones, and the loosest adaptive tolerance
+    uint64_t iterations = 0;
+    uint64_t num_iterations_known = 0;
+    double max_constraint_violation = 0.0;
+    double max_slack = 0.0;
+    double max_tolerance = 0.0;
+
+    ///* Over the window: the largest cross-track error [m] and the sum of
+    ///* the squares (of `num_ticks`), and the events of the ticks, or-ed
+    double max_cte = 0.0;
+    double cte_squares = 0.0;
+    uint32_t events = 0;
+
+    ///* Over the window: the hardware counts of the stages, summed over the
+    ///* ticks that counted them (and their count, see
+    ///* `Params::perf_counters`)
+    PerfCounts stage_counts[TelemetryRecord::NUM_STAGES];
+    uint64_t num_counted[TelemetryRecord::NUM_STAGES] = {};
+
+    ///* Over the window: the CPU time of the stages [s], summed over the
+    ///* ticks that measured it (and their count, see `Params::cpu_time`)
+    double stage_cpu_time[TelemetryRecord::NUM_STAGES] = {};
+    uint64_t num_cpu_timed[TelemetryRecord::NUM_STAGES] = {};
+
+    ///* Over the window, per backend that solved (by
+    ///* `TelemetryRecord::backend`, those past the last counted as it): the
+    ///* ticks, the CPU time of those that measured it [s] and the energy
+    ///* of those that measured it [J] (see `Params::power_rail`), with
+    ///* their counts
+    static constexpr size_t MAX_BACKENDS = 8;
+    uint64_t backend_ticks[MAX_BACKENDS] = {};
+    double backend_cpu_time[MAX_BACKENDS] = {};
+    uint64_t backend_cpu_timed[MAX_BACKENDS] = {};
+    double backend_energy[MAX_BACKENDS] = {};
+    uint64_t backend_metered[MAX_BACKENDS] = {};
+
+    ///* The memory of the controllers at the end of the window (set by the
+    ///* solver loop when it hands the stats over, see
+    ///* `ControlPipeline::memory_stats`)
+    MemoryStats memory;
+
+    ///* Adds the tick, an overrun when it took longer than `period` [s] (0:
+    ///* no period); ticks that didn't solve are left out. Without
+    ///* `histograms`, only its counts (see Instrumentation.h)
+    void record(const TelemetryRecord & record, double period, bool histograms = true);
+
+    ///* Empties the histograms and the counts of the window
+    void reset_window();
+
+    ///* Names of the stages, by TelemetryRecord::Stage
+    static const char * const STAGE_NAMES[TelemetryRecord::NUM_STAGES];
+};
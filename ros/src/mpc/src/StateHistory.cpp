@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cmath>
+
+#include "StateHistory.h"
+
+
+constexpr size_t StateHistory::CAPACITY;
+
+
+void StateHistory::add_pose(double stamp, double x, double y, double psi) {
+    if (m_num_poses > 0 and stamp <= sample(m_poses, m_next_pose, m_num_poses, m_num_poses - 1).stamp)
+        return;
+    m_poses[m_next_pose] = PoseSample{stamp, x, y, psi};
+    m_next_pose = (m_next_pose + 1) % CAPACITY;
+    m_num_poses = std::min(m_num_poses + 1, CAPACITY);
+}
+
+
+void StateHistory::add_speed(double stamp, double speed) {
+    if (m_num_speeds > 0 and stamp <= sample(m_speeds, m_next_speed, m_num_speeds, m_num_speeds - 1).stamp)
+        return;
+    m_speeds[m_next_speed] = SpeedSample{stamp, speed};
+    m_next_speed = (m_next_speed + 1) % CAPACITY;
+    m_num_speeds = std::min(m_num_speeds + 1, CAPACITY);
+}
+
+
+template <class Sample>
+const Sample & StateHistory::sample(const std::array<Sample, CAPACITY> & ring, size_t next, size_t size, size_t i) {
+    return ring[(next + CAPACITY - size + i) % CAPACITY];
+}
+
+
+template <class Sample>
+bool StateHistory::bracket(const std::array<Sample, CAPACITY> & ring, size_t next, size_t size, double time,
+                           double max_extrapolation, size_t & a, double & fraction) {
+    if (size < 2)
+        return false;
+
+    // The last pair that starts at or before the time (the first pair
+    // before the first sample)
+    a = 0;
+    while (a + 2 < size and sample(ring, next, size, a + 1).stamp <= time)
+        a++;
+    const Sample & first = sample(ring, next, size, 0);
+    const Sample & last = sample(ring, next, size, size - 1);
+    time = std::min(std::max(time, first.stamp - max_extrapolation), last.stamp + max_extrapolation);
+
+    double start = sample(ring, next, size, a).stamp;
+    double end = sample(ring, next, size, a + 1).stamp;
+    fraction = (time - start) / (end - start);
+    return true;
+}
+
+
+bool StateHistory::pose_at(double time, double max_extrapolation, double & x, double & y, double & psi) const {
+    size_t a;
+    double fraction;
+    if (!bracket(m_poses, m_next_pose, m_num_poses, time, max_extrapolation, a, fraction))
+        return false;
+    const PoseSample & p0 = sample(m_poses, m_next_pose, m_num_poses, a);
+    const PoseSample & p1 = sample(m_poses, m_next_pose, m_num_poses, a + 1);
+    x = p0.x + fraction * (p1.x - p0.x);
+    y = p0.y + fraction * (p1.y - p0.y);
+    psi = std::remainder(p0.psi + fraction * std::remainder(p1.psi - p0.psi, 2 * M_PI), 2 * M_PI);
+    return true;
+}
+
+
+bool StateHistory::speed_at(double time, double max_extrapolation, double & speed) const {
+    size_t a;
+    double fraction;
+    if (!bracket(m_speeds, m_next_speed, m_num_speeds, time, max_extrapolation, a, fraction))
+        return false;
+    const SpeedSample & s0 = sample(m_speeds, m_next_speed, m_num_speeds, a);
+    const SpeedSample & s1 = sample(m_speeds, m_next_speed, m_num_speeds, a + 1);
+    speed = s0.speed + fraction * (s1.speed - s0.speed);
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+
+///* The latest samples of the pose and of the speed, with their stamps, for
+///* the state of a tick at a common instant (see `Params::align_inputs`):
+///* the two streams come asynchronously, each at its own rate and with its
+///* own delay, so the latest pose and the latest speed are of different
+///* instants.
+///*
+///* Rings of CAPACITY samples each, in place (no allocation), so that the
+///* history travels with the InputSnapshot through its triple buffer: the
+///* callbacks add to theirs, and the solver loop reads the copy of its
+///* tick. Samples out of order (older than the latest) are dropped.
+struct StateHistory {
+    static constexpr size_t CAPACITY = 8;
+
+    void add_pose(double stamp, double x, double y, double psi);
+    void add_speed(double stamp, double speed);
+
+    ///* The pose at `time` [s]: linear between the two samples around it,
+    ///* or from the last two (the first two) past the ends, at most
+    ///* `max_extrapolation` [s] beyond them. False without two samples
+    bool pose_at(double time, double max_extrapolation, double & x, double & y, double & psi) const;
+
+    ///* ... and the speed
+    bool speed_at(double time, double max_extrapolation, double & speed) const;
+
+private:
+    struct PoseSample {
+        double stamp;
+        double x;
+        double y;
+        double psi;
+    };
+    struct SpeedSample {
+        double stamp;
+        double speed;
+    };
+
+    ///* The i-th oldest sample of the ring, and the pair of samples (a,
+    ///* a + 1) to interpolate between at `time`, with the fraction of the
+    ///* way from a, clamped by `max_extrapolation`
+    template <class Sample>
+    static const Sample & sample(const std::array<Sample, CAPACITY> & ring, size_t next, size_t size, size_t i);
+    template <class Sample>
+    static bool bracket(const std::array<Sample, CAPACITY> & ring, size_t next, size_t size, double time,
+                        double max_extrapolation, size_t & a, double & fraction);
+
+    std::array<PoseSample, CAPACITY> m_poses;
+    size_t m_next_pose = 0;
+    size_t m_num_poses = 0;
+    std::array<SpeedSample, CAPACITY> m_speeds;
+    size_t m_next_speed = 0;
+    size_t m_num_speeds = 0;
+};
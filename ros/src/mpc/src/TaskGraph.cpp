@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "TaskGraph.h"
+#include "Trace.h"
+
+
+TaskGraph::TaskGraph() : m_pool(nullptr), m_done(0), m_helpers(0), m_missed(0) {}
+
+
+TaskGraph::~TaskGraph() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [this]() { return m_helpers == 0; });
+}
+
+
+TaskGraph::TaskId TaskGraph::add(const char * name, std::function<void()> task, int priority, double deadline) {
+    Task added;
+    added.name = name;
+    added.run = std::move(task);
+    added.priority = priority;
+    added.deadline = deadline;
+    added.num_inputs = 0;
+    added.pending = 0;
+    m_tasks.push_back(std::move(added));
+    m_ready.reserve(m_tasks.size());
+    return m_tasks.size() - 1;
+}
+
+
+void TaskGraph::depends(TaskId task, TaskId input) {
+    m_tasks[input].dependents.push_back(task);
+    m_tasks[task].num_inputs++;
+}
+
+
+void TaskGraph::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_start = std::chrono::steady_clock::now();
+    m_done = 0;
+    m_missed = 0;
+    m_ready.clear();
+    for (TaskId id=0; id < m_tasks.size(); id++) {
+        m_tasks[id].pending = m_tasks[id].num_inputs;
+        if (m_tasks[id].pending == 0)
+            m_ready.push_back(id);
+    }
+    // This thread takes one of the first ready tasks, the pool the others
+    for (size_t i=1; i < m_ready.size(); i++)
+        schedule_helper();
+
+    while (m_done < m_tasks.size()) {
+        if (!run_next(lock))
+            m_changed.wait(lock, [this]() { return !m_ready.empty() or m_done == m_tasks.size(); });
+    }
+    // The jobs of the pool that found nothing to run still hold the graph
+    m_changed.wait(lock, [this]() { return m_helpers == 0; });
+}
+
+
+bool TaskGraph::run_next(std::unique_lock<std::mutex> & lock) {
+    if (m_ready.empty())
+        return false;
+
+    // The highest priority first, then the earliest deadline
+    auto urgent = std::min_element(m_ready.begin(), m_ready.end(), [this](TaskId a, TaskId b) {
+        const Task & task_a = m_tasks[a];
+        const Task & task_b = m_tasks[b];
+        if (task_a.priority != task_b.priority)
+            return task_a.priority > task_b.priority;
+        double deadline_a = (task_a.deadline > 0.0) ? task_a.deadline : HUGE_VAL;
+        double deadline_b = (task_b.deadline > 0.0) ? task_b.deadline : HUGE_VAL;
+        return deadline_a < deadline_b;
+    });
+    TaskId id = *urgent;
+    m_ready.erase(urgent);
+    Task & task = m_tasks[id];
+
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    {
+        TraceScope scope(task.name);
+        task.run();
+    }
+    auto end = std::chrono::steady_clock::now();
+    lock.lock();
+
+    Timing & timing = task.timing;
+    timing.time = std::chrono::duration<double>(end - start).count();
+    timing.finish = std::chrono::duration<double>(end - m_start).count();
+    timing.max_time = std::max(timing.max_time, timing.time);
+    timing.total_time += timing.time;
+    timing.runs++;
+    if (task.deadline > 0.0 and timing.finish > task.deadline) {
+        timing.missed++;
+        m_missed++;
+    }
+
+    // This thread goes on with one of the tasks it made ready, the pool
+    // takes the others
+    size_t num_ready = 0;
+    for (TaskId dependent : task.dependents) {
+        if (--m_tasks[dependent].pending == 0) {
+            m_ready.push_back(dependent);
+            if (num_ready++ > 0)
+                schedule_helper();
+        }
+    }
+    m_done++;
+    m_changed.notify_all();
+    return true;
+}
+
+
+void TaskGraph::schedule_helper() {
+    if (m_pool == nullptr)
+        return;
+    m_helpers++;
+    m_pool->Schedule([this]() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (run_next(lock)) {}
+        m_helpers--;
+        m_changed.notify_all();
+    });
+}
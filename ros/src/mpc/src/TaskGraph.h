@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+namespace Eigen {
+    class ThreadPoolInterface;
+}
+
+
+///* The stages of a tick as a graph of tasks, each run once its inputs (the
+///* tasks it depends on) are done, instead of one after the other by hand
+///* (see `Params::task_graph`): what doesn't depend on another stage runs
+///* alongside it, on the threads of a pool.
+///*
+///* The graph is built once, then `run` for every tick. The calling thread
+///* takes part: it runs the ready tasks itself, the most urgent first (by
+///* their priority, then their deadline), and hands those that are ready
+///* meanwhile to the pool, whose threads take them the same way. Without a
+///* pool, the calling thread runs them all, in that order.
+///*
+///* Every task is timed (and traced under its name, see Trace.h), and its
+///* deadline, from the start of the run, is checked when it's done; a task
+///* late for it still runs to the end. The tasks see the state of the tick
+///* through what they capture; a task's writes are visible to those that
+///* depend on it.
+class TaskGraph {
+public:
+    typedef size_t TaskId;
+
+    ///* How a task went, over the runs so far (from the calling thread,
+    ///* between the runs)
+    struct Timing {
+        ///* Of the last run: how long it took [s], and when it was done [s]
+        ///* from the start of the run
+        double time = 0.0;
+        double finish = 0.0;
+        double max_time = 0.0;
+        double total_time = 0.0;
+        uint64_t runs = 0;
+        uint64_t missed = 0;
+    };
+
+    TaskGraph();
+    ///* Waits for the run under way, if any
+    ~TaskGraph();
+
+    TaskGraph(const TaskGraph &) = delete;
+    TaskGraph & operator=(const TaskGraph &) = delete;
+
+    ///* A task `name` (a string literal, it's kept), run before the tasks
+    ///* of a lower `priority` that are ready along with it, and due
+    ///* `deadline` [s] after the start of the run (0: no deadline)
+    TaskId add(const char * name, std::function<void()> task, int priority = 0, double deadline = 0.0);
+
+    ///* `task` runs once `input` is done (within a run)
+    void depends(TaskId task, TaskId input);
+
+    ///* Where the tasks run besides the calling thread (nullptr: only
+    ///* there); the pool must outlive the runs
+    void set_pool(Eigen::ThreadPoolInterface * pool) { m_pool = pool; }
+
+    ///* Runs every task once, returns when they're all done. The graph has
+    ///* to be acyclic; not reentrant
+    void run();
+
+    size_t size() const { return m_tasks.size(); }
+    const char * name(TaskId task) const { return m_tasks[task].name; }
+    const Timing & timing(TaskId task) const { return m_tasks[task].timing; }
+
+    ///* The deadlines missed in the last run
+    size_t missed() const { return m_missed; }
+
+private:
+    struct Task {
+        const char * name;
+        std::function<void()> run;
+        int priority;
+        double deadline;
+        std::vector<TaskId> dependents;
+        size_t num_inputs;
+        ///* The inputs still to be done in this run
+        size_t pending;
+        Timing timing;
+    };
+
+    ///* Runs the most urgent ready task, if there's one; false otherwise.
+    ///* With `lock` held, which it releases while the task runs
+    bool run_next(std::unique_lock<std::mutex> & lock);
+
+    ///* Has the pool take one of the ready tasks (with the lock held)
+    void schedule_helper();
+
+    std::vector<Task> m_tasks;
+    Eigen::ThreadPoolInterface * m_pool;
+
+    ///* The state of the run, under `m_mutex`: the ready tasks, the tasks
+    ///* done, and the jobs handed to the pool that haven't returned yet
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<TaskId> m_ready;
+    size_t m_done;
+    size_t m_helpers;
+    size_t m_missed;
+    std::chrono::steady_clock::time_point m_start;
+};
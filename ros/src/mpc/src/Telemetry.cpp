@@ -0,0 +1,165 @@
+#ifdef MPC_TELEMETRY
+
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+
+#include <ros/console.h>
+
+#include "Telemetry.h"
+#include "MPC.h"
+
+
+constexpr size_t Telemetry::CAPACITY;
+
+
+Telemetry::Telemetry() : m_head(0), m_tail(0), m_dropped(0), m_running(false) {
+    for (size_t f=0; f < size_t(TelemetryField::NUM_FIELDS); f++) {
+        m_decimation[f] = 1;
+        m_counts[f] = 0;
+    }
+}
+
+
+Telemetry::~Telemetry() {
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+
+void Telemetry::set_decimation(TelemetryField field, unsigned every) {
+    m_decimation[size_t(field)] = every;
+}
+
+
+void Telemetry::start() {
+    m_running = true;
+    m_thread = std::thread(&Telemetry::drain, this);
+}
+
+
+void Telemetry::push(const TelemetryRecord & record) {
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    uint64_t tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail >= CAPACITY) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_ring[head % CAPACITY] = record;
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+
+void Telemetry::drain() {
+    // Polls: the writer doesn't signal anything, so that it never makes a
+    // system call
+    while (true) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        if (tail == head) {
+            if (!m_running)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        TelemetryRecord record = m_ring[tail % CAPACITY];
+        m_tail.store(tail + 1, std::memory_order_release);
+        print(record);
+    }
+}
+
+
+void Telemetry::print(const TelemetryRecord & r) {
+    auto due = [this](TelemetryField field) {
+        size_t f = size_t(field);
+        bool print = (m_decimation[f] > 0 and m_counts[f] % m_decimation[f] == 0);
+        m_counts[f]++;
+        return print;
+    };
+
+    uint32_t events = r.events & ~uint32_t(TelemetryRecord::GO | TelemetryRecord::EXPLICIT_LAW
+                                         | TelemetryRecord::CACHE_HIT | TelemetryRecord::SOLVE_SKIPPED
+                                         | TelemetryRecord::SPECULATION_HIT | TelemetryRecord::REMOTE_USED
+                                         | TelemetryRecord::FIT_REUSED | TelemetryRecord::LAP_SEEDED);
+    if (events != 0 and due(TelemetryField::EVENTS)) {
+        if (events & TelemetryRecord::NO_OPTIMIZATION)
+            ROS_WARN(
+                    "No optimization, m_pts_OK: %d, m_speed_OK: %d, m_pos_OK: %d, m_psi_OK: %d",
+                    bool(r.inputs & TelemetryRecord::INPUT_PTS), bool(r.inputs & TelemetryRecord::INPUT_SPEED),
+                    bool(r.inputs & TelemetryRecord::INPUT_POS), bool(r.inputs & TelemetryRecord::INPUT_PSI)
+            );
+        if (events & TelemetryRecord::X_DELTA_TOO_LOW)
+            ROS_WARN("X delta too low, breaking at %u", unsigned(r.x_delta_break));
+        if (events & TelemetryRecord::DEADLINE_HIT)
+            ROS_WARN("Solve cut short by the deadline (%.3f [s])", r.time_budget);
+        if (events & TelemetryRecord::SOLVE_FAILED)
+            ROS_WARN("Solve failed");
+        if (events & TelemetryRecord::PLAN_INVALID)
+            ROS_WARN("Plan out of the corridor or of the actuators' range");
+        if (events & TelemetryRecord::FALLBACK)
+            ROS_WARN("Commands from the fallback: %s",
+                     r.fallback == FALLBACK_SHIFTED_PLAN ? "the shifted previous plan" : "the PID law");
+        if (events & TelemetryRecord::DIVERGED)
+            ROS_WARN("Solve given up on as diverging at iteration %d", int(r.iterations));
+        if (events & TelemetryRecord::RESTORATION)
+            ROS_WARN("Ipopt went through its restoration phase (%d iterations)", int(r.iterations));
+        if (events & TelemetryRecord::HORIZON_SWITCHED)
+            ROS_WARN("Horizon switched to %u steps (at %.2f [m/s])", unsigned(r.steps_ahead), r.odom_speed);
+        if (events & TelemetryRecord::VARIANT_USED)
+            ROS_WARN("Main solve failed, used the parallel variant %u", unsigned(r.variant));
+        if (events & TelemetryRecord::REFERENCE_SWITCHED)
+            ROS_WARN("Reference switched to line %u", unsigned(r.reference));
+        if (events & TelemetryRecord::BACKEND_SWITCHED)
+            ROS_WARN("Backend switched to %u of predicted_backends (%.4f [s] predicted)", unsigned(r.backend),
+                     r.predicted_time);
+        if (events & TelemetryRecord::CONTINGENCY)
+            ROS_WARN("Stopping along the contingency trajectory");
+        if (events & TelemetryRecord::STEER_CLIPPED_LOW)
+            ROS_WARN("steer angle was below 0 -- clipped it to 0");
+        if (events & TelemetryRecord::STEER_CLIPPED_HIGH)
+            ROS_WARN("steer angle was greater than 1 -- clipped it to 1");
+    }
+    if (r.events & TelemetryRecord::NO_OPTIMIZATION)
+        return;
+
+    if (due(TelemetryField::FIT)) {
+        std::stringstream ss;
+        ss << "coeffs: ";
+        for (size_t c=0; c < r.num_coeffs; c++)
+            ss << std::setprecision(3) << r.coeffs[c] << " ";
+        ROS_WARN("%s", ss.str().c_str());
+        ROS_WARN("CTE: %.2f, ePsi: %.2f, psi: %.2f", r.cte, r.epsi, r.psi);
+        if (r.events & TelemetryRecord::LAP_PROGRESS)
+            ROS_WARN("s: %.2f, d: %.2f, laps: %d", r.progress_s, r.progress_d, int(r.laps));
+    }
+    if (due(TelemetryField::COST))
+        ROS_WARN("COST: %.2f, OK: %d, deadline hit: %d, iterations: %d, restoration: %d, "
+                 "constraint violation: %.2g, slack: %.2g, tol: %.0e, linear solver: %.3f[s], explicit: %d, "
+                 "cached: %d, speculative: %d, remote: %d",
+                 r.cost, !(r.events & TelemetryRecord::SOLVE_FAILED), bool(r.events & TelemetryRecord::DEADLINE_HIT),
+                 r.iterations, bool(r.events & TelemetryRecord::RESTORATION), r.constraint_violation,
+                 r.slack, r.tolerance, r.linear_solver_time, bool(r.events & TelemetryRecord::EXPLICIT_LAW),
+                 bool(r.events & (TelemetryRecord::CACHE_HIT | TelemetryRecord::SOLVE_SKIPPED)),
+                 bool(r.events & TelemetryRecord::SPECULATION_HIT), bool(r.events & TelemetryRecord::REMOTE_USED));
+    if (due(TelemetryField::ACTUATORS))
+        ROS_WARN("steer: %.2f [rad], speed: %.2f [m/s], in Dzik: %.2f, %.2f [RPM], GO: %d",
+                 r.steer, r.speed, r.steer_cmd, r.rpm, bool(r.events & TelemetryRecord::GO));
+    if (due(TelemetryField::TIMING))
+        ROS_WARN("dt_bet_cb: %.3f[s] dt_in_cb: %.3f[s] m_speed: %.3f [m/s] latency: %.3f[s] (pose age: %.3f[s], odom age: %.3f[s]) (%lu records dropped)",
+                 r.dt_between, r.dt_within, r.odom_speed, r.latency, r.pose_age, r.odom_age, dropped());
+    if ((r.ipopt.num_iterations > 0 or r.ipopt.num_messages > 0) and due(TelemetryField::IPOPT)) {
+        // As Ipopt would have printed them
+        if (r.ipopt.num_kept() < r.ipopt.num_iterations)
+            ROS_WARN("Ipopt: %u iterations, the last %lu:", unsigned(r.ipopt.num_iterations), r.ipopt.num_kept());
+        for (size_t i=0; i < r.ipopt.num_kept(); i++) {
+            const IpoptLog::Iteration & it = r.ipopt.kept(i);
+            ROS_WARN("Ipopt: %4d%c %14.7e %7.2e %7.2e %5.1f %7.2e %2u", int(it.iter), it.restoration ? 'r' : ' ',
+                     it.obj_value, it.inf_pr, it.inf_du, it.log10_mu, it.alpha_pr, unsigned(it.ls_trials));
+        }
+        if (r.ipopt.num_messages > 0)
+            ROS_WARN("Ipopt: %u messages, the last: %s", unsigned(r.ipopt.num_messages), r.ipopt.message);
+    }
+}
+
+#endif
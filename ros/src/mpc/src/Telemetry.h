@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef MPC_TELEMETRY
+#include <atomic>
+#include <thread>
+#endif
+
+#include "PerfCounters.h"
+#include "IpoptLog.h"
+
+
+///* What the solver loop reports about one tick, in a fixed-size record
+struct TelemetryRecord {
+    ///* ros::Time of the tick [s]
+    double stamp = 0.0;
+
+    ///* TelemetryRecord::Event bits
+    uint32_t events = 0;
+
+    ///* Which of the inputs were available (INPUT_* bits)
+    uint8_t inputs = 0;
+
+    ///* The fit (the first `num_coeffs`, lowest order first)
+    uint8_t num_coeffs = 0;
+    float coeffs[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    ///* Where the X delta got too low, with X_DELTA_TOO_LOW
+    uint16_t x_delta_break = 0;
+
+    float cte = 0.0f;
+    float epsi = 0.0f;
+    float psi = 0.0f;
+
+    ///* The progress along the path, with LAP_PROGRESS (see LapProgress):
+    ///* the arc length [m], the lateral offset [m] and the laps
+    float progress_s = 0.0f;
+    float progress_d = 0.0f;
+    int16_t laps = 0;
+
+    ///* The solve: its cost, the first actuations [rad], [m/s] and what was
+    ///* sent to Dzik
+    float cost = 0.0f;
+    float steer = 0.0f;
+    float speed = 0.0f;
+    float steer_cmd = 0.0f;
+    float rpm = 0.0f;
+
+    ///* What the solver reported (see SolveStats): its iterations (-1 if not
+    ///* known), the violation of the constraints by the solution and the
+    ///* time [s] of its linear solver (both negative when not known), the
+    ///* largest slack of the soft constraints, and the tolerance it ran
+    ///* with (negative when it's not adaptive)
+    int16_t iterations = -1;
+    ///* The horizon of the controller that solved (see
+    ///* `Params::adaptive_horizons`)
+    uint16_t steps_ahead = 0;
+    ///* The parallel variant the commands are from (0: the main solve, see
+    ///* MultiStartSolver)
+    uint8_t variant = 0;
+    ///* The reference line the commands follow (0: the centerline, i: the
+    ///* (i - 1)-th of `Params::reference_offsets`, see ReferenceCandidates)
+    uint8_t reference = 0;
+    ///* The backend that solved, of `Params::predicted_backends` (see
+    ///* SolveTimePredictor)
+    uint8_t backend = 0;
+    ///* Where the commands of a failed solve are from (a Fallback, see
+    ///* SolveStats)
+    uint8_t fallback = 0;
+    float constraint_violation = -1.0f;
+    float linear_solver_time = -1.0f;
+    float slack = 0.0f;
+    float tolerance = -1.0f;
+
+    ///* [s]
+    float time_budget = 0.0f;
+    ///* The solve time predicted for the backend (negative without
+    ///* `Params::predicted_backends`) [s]
+    float predicted_time = -1.0f;
+    float dt_between = 0.0f;
+    float dt_within = 0.0f;
+
+    ///* From /odom [m/s]
+    float odom_speed = 0.0f;
+
+    ///* The latency the pose was projected by, and the ages of the pose
+    ///* and of the speed (with the measured latency) [s]
+    float latency = 0.0f;
+    float pose_age = 0.0f;
+    float odom_age = 0.0f;
+
+    ///* The stages of a tick, in order (TICK is all of it)
+    enum Stage : uint8_t {
+        STAGE_SNAPSHOT,     // taking the inputs over from the callbacks
+        STAGE_CLOSEST,      // latency projection and closest waypoint
+        STAGE_TRANSFORM,    // window of waypoints, in the car's frame
+        STAGE_POLYFIT,      // the fit, and the errors from it
+        STAGE_DERIVATIVES,  // evaluations of the model and its derivatives
+        STAGE_SOLVER,       // the rest of the solve (the solver's own iterations)
+        STAGE_PUBLISH,      // the commands going out
+        STAGE_TICK,
+        NUM_STAGES
+    };
+
+    ///* How long each stage took [s]; negative when it wasn't measured
+    float stage_time[NUM_STAGES] = {-1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f};
+
+    ///* The hardware counts of the pipeline's stages (see
+    ///* `Params::perf_counters`): the whole solve is counted as SOLVER, as
+    ///* the evaluations of the model happen inside it
+    PerfCounts stage_counts[NUM_STAGES];
+
+    ///* The CPU time of the stages on the threads that ran them (see
+    ///* `Params::cpu_time`), the solve's all in SOLVER as its counts, and
+    ///* TICK the sum of the others [s]; negative when it wasn't measured
+    float stage_cpu_time[NUM_STAGES] = {-1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f};
+
+    ///* The power of the board's rail at the end of the tick [W] and the
+    ///* energy of the tick, that power over its time [J] (see
+    ///* `Params::power_rail`); negative when it wasn't measured
+    float power = -1.0f;
+    float energy = -1.0f;
+
+    ///* What Ipopt reported during the solve, with `Params::ipopt_journal`
+    ///* (empty otherwise)
+    IpoptLog ipopt;
+
+    enum Event : uint32_t {
+        NO_OPTIMIZATION = 1 << 0,
+        X_DELTA_TOO_LOW = 1 << 1,
+        DEADLINE_HIT = 1 << 2,
+        STEER_CLIPPED_LOW = 1 << 3,
+        STEER_CLIPPED_HIGH = 1 << 4,
+        SOLVE_FAILED = 1 << 5,
+        GO = 1 << 6,
+        RESTORATION = 1 << 7,
+        HORIZON_SWITCHED = 1 << 8,
+        VARIANT_USED = 1 << 9,
+        EXPLICIT_LAW = 1 << 10,
+        CACHE_HIT = 1 << 11,
+        SOLVE_SKIPPED = 1 << 12,
+        FALLBACK = 1 << 13,
+        LAP_PROGRESS = 1 << 14,
+        SPECULATION_HIT = 1 << 15,
+        REMOTE_USED = 1 << 16,
+        PLAN_INVALID = 1 << 17,
+        FIT_REUSED = 1 << 18,
+        REFERENCE_SWITCHED = 1 << 19,
+        BACKEND_SWITCHED = 1 << 20,
+        CONTINGENCY = 1 << 21,
+        DIVERGED = 1 << 22,
+        LAP_SEEDED = 1 << 23
+    };
+
+    enum Input : uint8_t {
+        INPUT_PTS = 1 << 0,
+        INPUT_SPEED = 1 << 1,
+        INPUT_POS = 1 << 2,
+        INPUT_PSI = 1 << 3
+    };
+};
+
+
+///* Groups of fields of the record that are printed together, each with its
+///* own decimation
+enum class TelemetryField {
+    EVENTS,
+    FIT,
+    ACTUATORS,
+    COST,
+    TIMING,
+    IPOPT,
+    NUM_FIELDS
+};
+
+
+#ifdef MPC_TELEMETRY
+
+///* Telemetry of the solver loop that costs it (the writer) a copy of the
+///* record into a lock-free ring buffer. A background thread drains the
+///* buffer, decimates each field group and formats it into the log. When the
+///* buffer is full the record is dropped (and counted), the writer never
+///* waits.
+///*
+///* Built without MPC_TELEMETRY (the CMake option), the class is empty and
+///* so are the calls, which the compiler removes.
+class Telemetry {
+public:
+    Telemetry();
+    ~Telemetry();
+
+    ///* Print one in every `every` records of the field group (0 disables it)
+    void set_decimation(TelemetryField field, unsigned every);
+
+    ///* Starts the background thread
+    void start();
+
+    ///* Writer side (one thread only)
+    void push(const TelemetryRecord & record);
+
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    void drain();
+    void print(const TelemetryRecord & record);
+
+    static constexpr size_t CAPACITY = 1024;
+
+    TelemetryRecord m_ring[CAPACITY];
+    ///* Written by the writer / the background thread respectively; they
+    ///* only ever grow, the slot is their value modulo CAPACITY
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+    std::atomic<uint64_t> m_dropped;
+
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+
+    ///* Only touched by the background thread once it's started
+    unsigned m_decimation[size_t(TelemetryField::NUM_FIELDS)];
+    uint64_t m_counts[size_t(TelemetryField::NUM_FIELDS)];
+};
+
+#else
+
+class Telemetry {
+public:
+    void set_decimation(TelemetryField, unsigned) {}
+    void start() {}
+    void push(const TelemetryRecord &) {}
+    uint64_t dropped() const { return 0; }
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/ip.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TelemetryUplink.h"
+#include "Log.h"
+
+
+constexpr double UplinkSummary::LATENCY_UNIT;
+constexpr double TelemetryUplink::MIN_PERIOD;
+
+
+// The CPU time of the process [s]
+static double process_cpu_time() {
+    timespec now;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0)
+        return 0.0;
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+
+static uint16_t saturate16(double value) {
+    if (!(value > 0.0))
+        return 0;
+    return uint16_t(std::min(std::round(value), 65535.0));
+}
+
+
+TelemetryUplink::TelemetryUplink() : m_socket(-1), m_period(1.0) {
+    std::memset(&m_collector, 0, sizeof(m_collector));
+    std::memset(&m_summary, 0, sizeof(m_summary));
+    m_summary.magic = UplinkSummary::MAGIC;
+    m_summary.version = UplinkSummary::VERSION;
+    reset();
+}
+
+
+TelemetryUplink::~TelemetryUplink() {
+    if (m_socket >= 0)
+        close(m_socket);
+}
+
+
+bool TelemetryUplink::open(const std::string & address, int vehicle, double period) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos or colon == 0 or colon + 1 == address.size()) {
+        MPC_ERROR("The telemetry collector %s isn't host:port", address.c_str());
+        return false;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo * found = nullptr;
+    int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+    if (error != 0 or found == nullptr) {
+        MPC_ERROR("Could not resolve the telemetry collector %s: %s", address.c_str(), gai_strerror(error));
+        return false;
+    }
+    std::memcpy(&m_collector, found->ai_addr, sizeof(m_collector));
+    freeaddrinfo(found);
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket < 0 or fcntl(m_socket, F_SETFL, O_NONBLOCK) != 0) {
+        MPC_ERROR("Could not open a socket to the telemetry collector: %s", std::strerror(errno));
+        if (m_socket >= 0)
+            close(m_socket);
+        m_socket = -1;
+        return false;
+    }
+    // Behind everything else on the links that honour it (DSCP CS1)
+    int tos = 0x20;
+    setsockopt(m_socket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    m_summary.vehicle = uint16_t(vehicle);
+    m_period = std::max(period, MIN_PERIOD);
+    reset();
+    return true;
+}
+
+
+bool TelemetryUplink::add(const StageStats & window) {
+    if (m_socket < 0)
+        return false;
+
+    m_ticks += window.num_ticks;
+    m_overruns += window.num_overruns;
+    m_deadline_hits += window.num_deadline_hits;
+    m_restorations += window.num_restorations;
+    m_failures += window.num_failures;
+    m_iterations += window.iterations;
+    m_num_iterations_known += window.num_iterations_known;
+    m_max_cte = std::max(m_max_cte, window.max_cte);
+    m_cte_squares += window.cte_squares;
+    m_events |= window.events;
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++) {
+        const LatencyHistogram & histogram = window.stages[s];
+        if (histogram.count() == 0)
+            continue;
+        m_latency[s][0] = std::max(m_latency[s][0], histogram.percentile(50));
+        m_latency[s][1] = std::max(m_latency[s][1], histogram.percentile(99));
+        m_latency[s][2] = std::max(m_latency[s][2], histogram.max());
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - m_start).count();
+    if (elapsed < m_period)
+        return false;
+
+    UplinkSummary & summary = m_summary;
+    summary.sequence++;
+    summary.period = saturate16(1e3 * elapsed);
+    summary.total_ticks = uint32_t(window.total_ticks);
+    summary.events = m_events;
+    summary.ticks = saturate16(double(m_ticks));
+    summary.overruns = saturate16(double(m_overruns));
+    summary.deadline_hits = saturate16(double(m_deadline_hits));
+    summary.restorations = saturate16(double(m_restorations));
+    summary.failures = saturate16(double(m_failures));
+    summary.mean_iterations = (m_num_iterations_known > 0)
+            ? uint8_t(std::min(m_iterations / m_num_iterations_known, uint64_t(255))) : 0;
+    summary.cpu = saturate16(1e3 * (process_cpu_time() - m_cpu_start) / elapsed);
+    summary.max_cte = saturate16(1e3 * m_max_cte);
+    summary.rms_cte = (m_ticks > 0) ? saturate16(1e3 * std::sqrt(m_cte_squares / m_ticks)) : 0;
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++)
+        for (int p=0; p < 3; p++)
+            summary.latency[s][p] = saturate16(m_latency[s][p] / UplinkSummary::LATENCY_UNIT);
+
+    // A full buffer drops it: the next one has its counts anyway
+    bool sent = sendto(m_socket, &summary, sizeof(summary), 0, reinterpret_cast<const sockaddr *>(&m_collector),
+                       sizeof(m_collector)) == ssize_t(sizeof(summary));
+    reset();
+    return sent;
+}
+
+
+void TelemetryUplink::reset() {
+    m_start = std::chrono::steady_clock::now();
+    m_cpu_start = process_cpu_time();
+    m_ticks = 0;
+    m_overruns = 0;
+    m_deadline_hits = 0;
+    m_restorations = 0;
+    m_failures = 0;
+    m_iterations = 0;
+    m_num_iterations_known = 0;
+    m_max_cte = 0.0;
+    m_cte_squares = 0.0;
+    m_events = 0;
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++)
+        for (int p=0; p < 3; p++)
+            m_latency[s][p] = 0.0;
+}
+
+
+int open_uplink_collector(int port) {
+    int collector = socket(AF_INET, SOCK_DGRAM, 0);
+    if (collector < 0) {
+        MPC_ERROR("Could not open the socket of the telemetry collector: %s", std::strerror(errno));
+        return -1;
+    }
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(uint16_t(port));
+    if (bind(collector, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        MPC_ERROR("Could not bind the telemetry collector to port %d: %s", port, std::strerror(errno));
+        close(collector);
+        return -1;
+    }
+    return collector;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <netinet/in.h>
+
+#include "StageStats.h"
+#include "Telemetry.h"
+
+
+///* What a vehicle tells the base station about itself (see
+///* `Params::uplink`): a summary of its stats windows since the last one, in
+///* a datagram of a fixed, small size, to mpc_telemetry_collector.
+///*
+///* The summary is the struct below as it is in memory (both ends are built
+///* from the same source, for the same byte order), quantized to what a
+///* fleet view needs: the counts are those since the previous summary (the
+///* deltas of the totals, which the collector sums back up; a lost datagram
+///* shows as a gap in `sequence`), the latencies of the stages are the worst
+///* of the windows' percentiles in units of LATENCY_UNIT, saturated, and the
+///* cross-track errors are in millimetres.
+struct UplinkSummary {
+    static const uint32_t MAGIC = 0x4d504354; // "MPCT"
+    static const uint8_t VERSION = 1;
+    ///* [s]
+    static constexpr double LATENCY_UNIT = 1e-5;
+
+    uint32_t magic;
+    uint8_t version;
+    ///* Of the solves that reported them, over the summary (saturated)
+    uint8_t mean_iterations;
+    uint16_t vehicle;
+    uint16_t sequence;
+    ///* The time the summary covers [ms]
+    uint16_t period;
+    ///* The low bits of the vehicle's total, to tell a restart
+    uint32_t total_ticks;
+    ///* The TelemetryRecord::Event bits of the ticks, or-ed
+    uint32_t events;
+
+    ///* Since the previous summary (saturated)
+    uint16_t ticks;
+    uint16_t overruns;
+    uint16_t deadline_hits;
+    uint16_t restorations;
+    uint16_t failures;
+
+    ///* Of the process, over the summary [1/1000 of a core]
+    uint16_t cpu;
+    ///* [mm]
+    uint16_t max_cte;
+    uint16_t rms_cte;
+
+    ///* p50, p99 and max of every stage [LATENCY_UNIT]
+    uint16_t latency[TelemetryRecord::NUM_STAGES][3];
+};
+
+static_assert(sizeof(UplinkSummary) == 84, "UplinkSummary has padding");
+
+
+///* The vehicle's end: a non-blocking UDP socket to the collector, fed the
+///* stats windows (`add`), which sends their summary once every period at
+///* most (and never more often than MIN_PERIOD), marked as background
+///* traffic. Doesn't allocate once open.
+class TelemetryUplink {
+public:
+    ///* [s]
+    static constexpr double MIN_PERIOD = 0.1;
+
+    TelemetryUplink();
+    ~TelemetryUplink();
+
+    ///* To "host:port" (an IPv4 address or a name), as `vehicle`, every
+    ///* `period` [s]; false (and logs why) if it can't be resolved or the
+    ///* socket opened
+    bool open(const std::string & address, int vehicle, double period);
+
+    bool is_open() const { return m_socket >= 0; }
+
+    ///* Adds a stats window, and sends the summary when it's due; true if
+    ///* it sent one
+    bool add(const StageStats & window);
+
+private:
+    ///* Starts the next summary
+    void reset();
+
+    int m_socket;
+    sockaddr_in m_collector;
+    double m_period;
+    UplinkSummary m_summary;
+
+    ///* Of the summary under way
+    std::chrono::steady_clock::time_point m_start;
+    double m_cpu_start;
+    uint64_t m_ticks;
+    uint64_t m_overruns;
+    uint64_t m_deadline_hits;
+    uint64_t m_restorations;
+    uint64_t m_failures;
+    uint64_t m_iterations;
+    uint64_t m_num_iterations_known;
+    double m_max_cte;
+    double m_cte_squares;
+    uint32_t m_events;
+    double m_latency[TelemetryRecord::NUM_STAGES][3];
+};
+
+
+///* The collector's end: a UDP socket bound to `port` (on every interface),
+///* blocking. -1 (logged) if it can't be bound
+int open_uplink_collector(int port);
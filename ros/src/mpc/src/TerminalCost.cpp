@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/LU"
+#include "TerminalCost.h"
+
+
+const int TerminalCost::MAX_ITERATIONS;
+constexpr double TerminalCost::TOLERANCE;
+
+
+void TerminalCost::weights(const Params & params, double ref_v, double * out) {
+    std::fill(out, out + SIZE, 0.0);
+    double dt = params.step_dt(params.steps_ahead - 2);
+    double v_dt = ref_v * dt;
+    if (!(std::abs(v_dt) > 1e-6))
+        return;
+
+    typedef Eigen::Matrix3d Matrix;
+    typedef Eigen::Vector3d Vector;
+    Matrix a;
+    a << 1.0, v_dt, 0.0,
+         0.0, 1.0, -v_dt / Lf(),
+         0.0, 0.0, 1.0;
+    Vector b(0.0, -v_dt / Lf(), 1.0);
+
+    // The stage cost, x' Q x + 2 x' N u + R u^2: the steering is delta + u
+    Matrix q = Matrix::Zero();
+    q(0, 0) = params.cte_coeff;
+    q(1, 1) = params.epsi_coeff;
+    q(2, 2) = params.steer_coeff;
+    Vector n(0.0, 0.0, params.steer_coeff);
+    double r = params.steer_coeff + params.consec_steer_coeff;
+    if (r <= 0.0)
+        return;
+
+    // P = Q + A' P A - (A' P B + N) (R + B' P B)^-1 (B' P A + N')
+    Matrix p = q;
+    for (int i=0; i < MAX_ITERATIONS; i++) {
+        Vector pb = p * b;
+        Vector gain = a.transpose() * pb + n;
+        Matrix next = q + a.transpose() * p * a - gain * gain.transpose() / (r + b.dot(pb));
+        next = 0.5 * (next + next.transpose());
+        double change = (next - p).cwiseAbs().maxCoeff();
+        p = next;
+        if (change <= TOLERANCE * p.cwiseAbs().maxCoeff())
+            break;
+    }
+
+    // The last step's cte and epsi are in the stage costs already
+    out[CTE_CTE] = p(0, 0) - params.cte_coeff;
+    out[CTE_EPSI] = p(0, 1);
+    out[CTE_DELTA] = p(0, 2);
+    out[EPSI_EPSI] = p(1, 1) - params.epsi_coeff;
+    out[EPSI_DELTA] = p(1, 2);
+    out[DELTA_DELTA] = p(2, 2);
+}
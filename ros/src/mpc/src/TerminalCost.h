@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+#include "MPC.h"
+
+
+///* The LQR terminal cost of FG_eval (see `Params::terminal_cost`): the
+///* cost to go from the end of the horizon, of the errors there and of the
+///* last steering, as if the rest of the drive were optimal.
+///*
+///* The kinematic model's errors, linearised around the reference at the
+///* end of the horizon (the reference speed, on a path of any constant
+///* curvature), with the steering held from step to step as a state:
+///*
+///*   cte'   = cte + v dt epsi
+///*   epsi'  = epsi - v dt / Lf (delta + u)
+///*   delta' = delta + u
+///*
+///* over a change of the steering u, with the stage costs of FG_eval (of
+///* cte, epsi, the steering and its change). The discrete Riccati equation
+///* of that is solved by iterating it (a 3x3 one, a few microseconds), and
+///* the terminal cost is its solution P, less the costs of cte and epsi the
+///* last step has already.
+///*
+///* The errors are those from a target, (0, 0, 0) but with
+///* `Params::learning_mpc`, whose sampled safe set sets it (see
+///* SampledSafeSet).
+struct TerminalCost {
+    ///* The entries of the symmetric P of the cost (x - x0)' P (x - x0),
+    ///* x = (cte, epsi, delta), and those of the target x0
+    enum Entry { CTE_CTE, CTE_EPSI, CTE_DELTA, EPSI_EPSI, EPSI_DELTA, DELTA_DELTA, CTE_TARGET, EPSI_TARGET,
+                 DELTA_TARGET, SIZE };
+
+    ///* The weights of the terminal cost at the reference speed `ref_v`
+    ///* [m/s], for the last step of `params`' grid, with the target at 0.
+    ///* All 0 (no terminal cost) when the car doesn't move on that step,
+    ///* whose errors are then out of the steering's reach
+    static void weights(const Params & params, double ref_v, double * out);
+
+    ///* The iterations of the Riccati equation at most, and the change of P
+    ///* (relative) it stops at
+    static const int MAX_ITERATIONS = 1000;
+    static constexpr double TOLERANCE = 1e-9;
+};
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "AllocationCounter.h"
+#include "Log.h"
+#include "TickArena.h"
+
+
+const size_t TickArena::WARMUP_TICKS;
+const size_t TickArena::MAX_PINNED_TICKS;
+const size_t TickArena::MAX_BLOCK;
+const size_t TickArena::ALIGNMENT;
+
+// The huge pages of x86-64 and of aarch64 (with 4 kB pages)
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+// The arena of the Scope of each thread
+static thread_local TickArena * t_arena = nullptr;
+
+// The registered arena, its range, and the count of its blocks in use
+// (static, so that blocks freed after the arena is gone are still its)
+static std::atomic<TickArena *> s_registered(nullptr);
+static std::atomic<char *> s_begin(nullptr);
+static std::atomic<char *> s_end(nullptr);
+static std::atomic<uint64_t> s_live(0);
+// Whether operator new goes through the arenas (see ArenaNew.cpp)
+static std::atomic<bool> s_hooked(false);
+
+
+TickArena::TickArena(size_t bytes)
+        : m_base(nullptr), m_size(0), m_huge_pages(false), m_offset(0), m_pinned_run(0), m_pinned_warned(false),
+          m_high_water(0), m_fallbacks(0), m_pinned_ticks(0), m_ticks(0) {
+    if (!s_hooked.load()) {
+        MPC_WARN("tick_arena_mb needs the operator new of mpc_node_cpp, ignoring it");
+        return;
+    }
+    size_t size = std::max((bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE, size_t(1)) * HUGE_PAGE_SIZE;
+    TickArena * expected = nullptr;
+    if (!s_registered.compare_exchange_strong(expected, this)) {
+        MPC_WARN("tick_arena_mb needs the only arena of the process, ignoring it");
+        return;
+    }
+
+    // Explicit huge pages if the system has some reserved, otherwise pages
+    // the kernel may merge into huge ones; all faulted in now
+    void * data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                       -1, 0);
+    m_huge_pages = (data != MAP_FAILED);
+    if (!m_huge_pages) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            MPC_ERROR("Could not map the tick arena of %.1f MiB: %s", size / double(1 << 20), std::strerror(errno));
+            s_registered.store(nullptr);
+            return;
+        }
+        madvise(data, size, MADV_HUGEPAGE);
+        long page_size = sysconf(_SC_PAGESIZE);
+        for (size_t offset=0; offset < size; offset += size_t(page_size > 0 ? page_size : 4096))
+            static_cast<volatile char *>(data)[offset] = 0;
+    }
+
+    m_base = static_cast<char *>(data);
+    m_size = size;
+    s_begin.store(m_base, std::memory_order_release);
+    s_end.store(m_base + m_size, std::memory_order_release);
+    MPC_INFO("Tick arena of %.1f MiB, on %s", m_size / double(1 << 20),
+             m_huge_pages ? "huge pages" : "pages advised to be huge");
+}
+
+
+TickArena::~TickArena() {
+    if (m_base == nullptr)
+        return;
+    // Blocks still in use keep the mapping (and the range) until the exit
+    if (s_live.load() != 0) {
+        MPC_WARN("The tick arena has %lu blocks in use, keeping it", s_live.load());
+        return;
+    }
+    s_begin.store(nullptr);
+    s_end.store(nullptr);
+    munmap(m_base, m_size);
+    s_registered.store(nullptr);
+}
+
+
+TickArena::Scope::Scope(TickArena * arena)
+        : m_arena(arena) {
+    if (m_arena != nullptr and m_arena->ok() and m_arena->m_ticks.load(std::memory_order_relaxed) >= WARMUP_TICKS
+            and m_arena->m_pinned_run < MAX_PINNED_TICKS)
+        t_arena = m_arena;
+}
+
+
+TickArena::Scope::~Scope() {
+    if (m_arena == nullptr or !m_arena->ok())
+        return;
+    t_arena = nullptr;
+    m_arena->end_tick();
+}
+
+
+void * TickArena::allocate(size_t size) {
+    size = (std::max(size, size_t(1)) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (size > MAX_BLOCK or size > m_size - m_offset) {
+        m_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    void * p = m_base + m_offset;
+    m_offset += size;
+    s_live.fetch_add(1, std::memory_order_relaxed);
+    if (m_offset > m_high_water.load(std::memory_order_relaxed))
+        m_high_water.store(m_offset, std::memory_order_relaxed);
+    return p;
+}
+
+
+void TickArena::end_tick() {
+    m_ticks.fetch_add(1, std::memory_order_relaxed);
+    // Freed by any thread: acquire, so that their last uses of the blocks
+    // come before the blocks are cut again
+    if (s_live.load(std::memory_order_acquire) == 0) {
+        m_offset = 0;
+        m_pinned_run = 0;
+    } else if (m_offset > 0) {
+        m_pinned_ticks.fetch_add(1, std::memory_order_relaxed);
+        // Blocks kept for good: the next ticks are better off on the heap
+        // than bumping the rest of the arena, until they're freed
+        if (++m_pinned_run == MAX_PINNED_TICKS and !m_pinned_warned) {
+            m_pinned_warned = true;
+            AllocationCounter::Pause pause;
+            MPC_WARN("The tick arena is pinned by %lu blocks for %lu ticks, allocating from the heap until they "
+                     "are freed", s_live.load(), m_pinned_run);
+        }
+    }
+}
+
+
+TickArena::Stats TickArena::stats() const {
+    Stats stats;
+    stats.high_water = m_high_water.load(std::memory_order_relaxed);
+    stats.fallbacks = m_fallbacks.load(std::memory_order_relaxed);
+    stats.pinned_ticks = m_pinned_ticks.load(std::memory_order_relaxed);
+    stats.ticks = m_ticks.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+void * TickArena::thread_allocate(size_t size) {
+    TickArena * arena = t_arena;
+    return (arena != nullptr) ? arena->allocate(size) : nullptr;
+}
+
+
+bool TickArena::set_hooked() {
+    s_hooked.store(true);
+    return true;
+}
+
+
+bool TickArena::release(void * p) {
+    char * block = static_cast<char *>(p);
+    char * begin = s_begin.load(std::memory_order_relaxed);
+    if (begin == nullptr or block < begin or block >= s_end.load(std::memory_order_relaxed))
+        return false;
+    s_live.fetch_sub(1, std::memory_order_release);
+    return true;
+}
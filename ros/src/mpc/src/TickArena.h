@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+///* A monotonic arena for the allocations of the solver loop's ticks (see
+///* `Params::tick_arena_mb`): what the thread of a Scope allocates through
+///* operator new (CppAD, Ipopt, the messages) is cut from a mapping of huge
+///* pages faulted in up front, and the whole arena is reset at the end of
+///* the tick, so that a tick doesn't take the heap's locks nor fault pages.
+///*
+///* The allocations that outlive their tick (a pool that keeps a block, a
+///* vector that grows past its warmed-up size) pin the arena: it isn't
+///* reset until they are all freed, and it goes on from where it is
+///* meanwhile. After MAX_PINNED_TICKS ticks without a reset (which is
+///* warned about once) the ticks allocate from the heap, until it's reset.
+///* The first WARMUP_TICKS ticks run on the heap, so that the pools and the
+///* buffers grow to their sizes there. What doesn't fit (the arena is full,
+///* or the block is larger than MAX_BLOCK) comes from the heap, and is
+///* counted.
+///*
+///* Only one arena is registered at a time: its blocks are recognized by
+///* their address when they are freed, from any thread. Allocations made
+///* with malloc directly aren't served (nor counted). Only the operator new
+///* of ArenaNew.cpp (mpc_node_cpp's) goes through the arenas: in another
+///* process an arena isn't `ok`.
+class TickArena {
+public:
+    ///* An arena of `bytes` [bytes] (rounded up to the huge pages); not
+    ///* `ok` when it can't be mapped, or when another arena is registered
+    explicit TickArena(size_t bytes);
+    ~TickArena();
+
+    TickArena(const TickArena &) = delete;
+    TickArena & operator=(const TickArena &) = delete;
+
+    bool ok() const { return m_base != nullptr; }
+    size_t size() const { return m_size; }
+    ///* Whether the mapping is of explicit huge pages (MAP_HUGETLB), rather
+    ///* than of pages the kernel was advised to merge into huge ones
+    bool huge_pages() const { return m_huge_pages; }
+
+    ///* The allocations of the calling thread in the scope (a tick) come
+    ///* from `arena` (none: from the heap), which is reset at its end when
+    ///* nothing of it is in use any more. What outlives the tick (the
+    ///* messages it publishes) is better allocated out of the scope
+    class Scope {
+    public:
+        explicit Scope(TickArena * arena);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+
+    private:
+        TickArena * m_arena;
+    };
+
+    ///* What the arena did since the start
+    struct Stats {
+        ///* The most of it ever in use at once [bytes]
+        uint64_t high_water = 0;
+        ///* Allocations of its ticks that came from the heap
+        uint64_t fallbacks = 0;
+        ///* Ticks at the end of which it couldn't be reset
+        uint64_t pinned_ticks = 0;
+        uint64_t ticks = 0;
+    };
+    Stats stats() const;
+
+    ///* The hooks of operator new and delete of mpc_node_cpp (ArenaNew.cpp,
+    ///* the other targets have the heap's, counted in debug builds by
+    ///* CountedNew.cpp): a block of the arena of the calling thread's Scope
+    ///* (null when there's none, or when it doesn't fit), and whether `p`
+    ///* was one of the registered arena's (which is then released)
+    static void * thread_allocate(size_t size);
+    static bool release(void * p);
+    ///* Called by that operator new, when the process starts: the arenas
+    ///* are of no use otherwise
+    static bool set_hooked();
+
+    static const size_t WARMUP_TICKS = 20;
+    static const size_t MAX_PINNED_TICKS = 100;
+    static const size_t MAX_BLOCK = 1 << 20;
+    static const size_t ALIGNMENT = 16;
+
+private:
+    void * allocate(size_t size);
+    void end_tick();
+
+    char * m_base;
+    size_t m_size;
+    bool m_huge_pages;
+
+    // Only the thread of the Scope allocates, any thread frees
+    size_t m_offset;
+    // The ticks since the last reset, when it's pinned
+    size_t m_pinned_run;
+    bool m_pinned_warned;
+    std::atomic<uint64_t> m_live;
+    std::atomic<uint64_t> m_high_water;
+    std::atomic<uint64_t> m_fallbacks;
+    std::atomic<uint64_t> m_pinned_ticks;
+    std::atomic<uint64_t> m_ticks;
+};
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Trace.h"
+#include "AllocationCounter.h"
+#include "Log.h"
+
+
+constexpr int64_t Trace::NO_ARG;
+constexpr size_t Trace::RING_CAPACITY;
+
+std::atomic<bool> Trace::s_enabled(false);
+
+
+struct TraceEvent {
+    const char * name;
+    uint64_t start; // [ns]
+    uint64_t duration; // [ns]
+    int64_t arg;
+    char phase; // 'X' (complete) or 'i' (instant), as in the trace format
+};
+
+
+///* Written only by its thread: `head` counts the events written so far, the
+///* last RING_CAPACITY of which are in `events`
+struct TraceRing {
+    TraceEvent events[Trace::RING_CAPACITY];
+    std::atomic<uint64_t> head;
+    long tid;
+    char name[32];
+};
+
+
+// All the rings, which live until the process exits (there's one per thread
+// that ever traced, and the node only has a few)
+static std::mutex & rings_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+
+static std::vector<TraceRing *> & rings() {
+    static std::vector<TraceRing *> rings;
+    return rings;
+}
+
+
+static thread_local TraceRing * t_ring = nullptr;
+
+
+static TraceRing & ring() {
+    if (t_ring == nullptr) {
+        // Once per thread, which the allocation check lets through
+        AllocationCounter::Pause pause;
+        TraceRing * new_ring = new TraceRing();
+        new_ring->head = 0;
+        new_ring->tid = syscall(SYS_gettid);
+        if (pthread_getname_np(pthread_self(), new_ring->name, sizeof(new_ring->name)) != 0)
+            new_ring->name[0] = '\0';
+
+        std::lock_guard<std::mutex> lock(rings_mutex());
+        rings().push_back(new_ring);
+        t_ring = new_ring;
+    }
+    return *t_ring;
+}
+
+
+static void push(char phase, const char * name, uint64_t start, uint64_t duration, int64_t arg) {
+    TraceRing & r = ring();
+    uint64_t head = r.head.load(std::memory_order_relaxed);
+    TraceEvent & event = r.events[head % Trace::RING_CAPACITY];
+    event.name = name;
+    event.start = start;
+    event.duration = duration;
+    event.arg = arg;
+    event.phase = phase;
+    r.head.store(head + 1, std::memory_order_release);
+}
+
+
+uint64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Trace::complete(const char * name, uint64_t start, uint64_t end, int64_t arg) {
+    if (enabled())
+        push('X', name, start, end > start ? end - start : 0, arg);
+}
+
+
+void Trace::instant(const char * name, int64_t arg) {
+    if (enabled())
+        push('i', name, now(), 0, arg);
+}
+
+
+void Trace::name_thread(const char * name) {
+    TraceRing & r = ring();
+    std::snprintf(r.name, sizeof(r.name), "%s", name);
+}
+
+
+bool Trace::dump(const std::string & path) {
+    // The events of every ring, oldest first. A ring keeps being written
+    // meanwhile: whatever was overwritten while it was copied is dropped
+    struct Copy {
+        long tid;
+        std::string name;
+        std::vector<TraceEvent> events;
+    };
+    std::vector<Copy> copies;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex());
+        for (TraceRing * r : rings()) {
+            Copy copy;
+            copy.tid = r->tid;
+            copy.name = r->name;
+            uint64_t head = r->head.load(std::memory_order_acquire);
+            uint64_t first = (head > RING_CAPACITY) ? head - RING_CAPACITY : 0;
+            for (uint64_t i=first; i < head; i++)
+                copy.events.push_back(r->events[i % RING_CAPACITY]);
+            uint64_t head_after = r->head.load(std::memory_order_acquire);
+            uint64_t first_valid = (head_after > RING_CAPACITY) ? head_after - RING_CAPACITY : 0;
+            if (first_valid > first)
+                copy.events.erase(copy.events.begin(),
+                                  copy.events.begin() + std::min(first_valid - first, uint64_t(copy.events.size())));
+            copies.push_back(std::move(copy));
+        }
+    }
+
+    FILE * file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        MPC_ERROR("Could not write the trace to %s", path.c_str());
+        return false;
+    }
+    int pid = getpid();
+    bool first_event = true;
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (const Copy & copy : copies) {
+        if (!copy.name.empty()) {
+            std::fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %ld, "
+                               "\"args\": {\"name\": \"%s\"}}", first_event ? "" : ",", pid, copy.tid, copy.name.c_str());
+            first_event = false;
+        }
+        for (const TraceEvent & event : copy.events) {
+            std::fprintf(file, "%s\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, ", first_event ? "" : ",",
+                         event.name, event.phase, 1e-3 * event.start);
+            if (event.phase == 'X')
+                std::fprintf(file, "\"dur\": %.3f, ", 1e-3 * event.duration);
+            else
+                std::fprintf(file, "\"s\": \"t\", ");
+            std::fprintf(file, "\"pid\": %d, \"tid\": %ld", pid, copy.tid);
+            if (event.arg != NO_ARG)
+                std::fprintf(file, ", \"args\": {\"value\": %lld}", (long long) event.arg);
+            std::fprintf(file, "}");
+            first_event = false;
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    bool OK = (std::fclose(file) == 0);
+    if (!OK)
+        MPC_ERROR("Could not write the trace to %s", path.c_str());
+    return OK;
+}
+
+
+// The thread that writes the requested dumps. It polls for them (every
+// DUMPER_POLL), so that requesting one is a single store
+struct TraceDumper {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+    bool running = false;
+
+    std::string directory;
+    double min_interval = 0.0;
+    std::atomic<const char *> requested{nullptr};
+};
+
+
+static TraceDumper & dumper() {
+    static TraceDumper dumper;
+    return dumper;
+}
+
+
+static const std::chrono::milliseconds DUMPER_POLL(100);
+
+
+static void run_dumper() {
+    TraceDumper & d = dumper();
+    int num_dumps = 0;
+    auto last_dump = std::chrono::steady_clock::now();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(d.mutex);
+            d.cv.wait_for(lock, DUMPER_POLL, [&d] { return !d.running; });
+            if (!d.running)
+                break;
+        }
+
+        // A request stays pending until the previous dump is old enough
+        auto now = std::chrono::steady_clock::now();
+        bool too_soon = (num_dumps > 0 and now - last_dump < std::chrono::duration<double>(d.min_interval));
+        if (d.requested.load() == nullptr or too_soon)
+            continue;
+        const char * reason = d.requested.exchange(nullptr);
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "/mpc_trace_%d_%d_%s.json", int(getpid()), num_dumps++, reason);
+        std::string path = d.directory + name;
+        if (Trace::dump(path))
+            MPC_WARN("Trace (%s) written to %s", reason, path.c_str());
+        last_dump = now;
+    }
+}
+
+
+void Trace::start_dumper(const std::string & directory, double min_interval) {
+    TraceDumper & d = dumper();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.running)
+        return;
+    d.directory = directory;
+    d.min_interval = min_interval;
+    d.running = true;
+    d.thread = std::thread(run_dumper);
+}
+
+
+void Trace::stop_dumper() {
+    TraceDumper & d = dumper();
+    {
+        std::lock_guard<std::mutex> lock(d.mutex);
+        if (!d.running)
+            return;
+        d.running = false;
+    }
+    d.cv.notify_all();
+    d.thread.join();
+}
+
+
+void Trace::request_dump(const char * reason) {
+    const char * expected = nullptr;
+    dumper().requested.compare_exchange_strong(expected, reason);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+///* Low-overhead tracing of what the controller does, tick by tick: scopes
+///* (`MPC_TRACE_SCOPE`) and instant events, written into a ring buffer per
+///* thread (of the last RING_CAPACITY events) and dumped as Chrome trace JSON
+///* (chrome://tracing, Perfetto). Off, an event costs a relaxed load.
+///*
+///* A thread's ring is allocated by its first event. The names of the events
+///* are kept by pointer, so they have to be string literals.
+///*
+///* Dumps are written by a thread of their own (see `start_dumper`), when
+///* requested with `request_dump` (e.g. by the solver loop when a deadline is
+///* missed), at most every `min_interval`.
+class Trace {
+public:
+    static void enable(bool on) { s_enabled.store(on, std::memory_order_relaxed); }
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    ///* The clock of the events [ns] (the steady clock)
+    static uint64_t now();
+
+    ///* A scope that ran from `start` to `end`, with an optional argument
+    static void complete(const char * name, uint64_t start, uint64_t end, int64_t arg = NO_ARG);
+
+    ///* Something that happened now
+    static void instant(const char * name, int64_t arg = NO_ARG);
+
+    ///* Names the calling thread in the dumps
+    static void name_thread(const char * name);
+
+    ///* Writes the events of all the threads to `path`; false (and logs why)
+    ///* if it can't
+    static bool dump(const std::string & path);
+
+    ///* Starts the thread that writes the requested dumps into `directory`
+    ///* (as mpc_trace_<n>_<reason>.json), and stops it
+    static void start_dumper(const std::string & directory, double min_interval);
+    static void stop_dumper();
+
+    ///* Asks the dumper for a dump (unless one is pending already); `reason`
+    ///* has to be a string literal. Doesn't block, nor allocate
+    static void request_dump(const char * reason);
+
+    static constexpr int64_t NO_ARG = INT64_MIN;
+    static constexpr size_t RING_CAPACITY = 8192;
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+
+///* Traces its scope as the event `name`
+class TraceScope {
+public:
+    TraceScope(const char * name) : m_name(name), m_start(Trace::enabled() ? Trace::now() : 0) {}
+    ~TraceScope() {
+        if (m_start != 0 and Trace::enabled())
+            Trace::complete(m_name, m_start, Trace::now());
+    }
+
+private:
+    const char * m_name;
+    uint64_t m_start;
+};
+
+
+#define MPC_TRACE_CONCAT_(a, b) a##b
+#define MPC_TRACE_CONCAT(a, b) MPC_TRACE_CONCAT_(a, b)
+#define MPC_TRACE_SCOPE(name) TraceScope MPC_TRACE_CONCAT(trace_scope_, __LINE__)(name)
@@ -0,0 +1,192 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TrackStore.h"
+#include "Log.h"
+
+
+constexpr uint32_t TrackStoreHeader::VERSION;
+const char TrackStoreHeader::MAGIC[8] = {'M', 'P', 'C', 'T', 'R', 'K', '1', '\0'};
+
+static_assert(std::is_trivially_copyable<TrackStoreHeader>::value, "TrackStoreHeader has to be plain data");
+static_assert(sizeof(TrackStoreHeader) % 8 == 0, "The sections have to stay aligned");
+static_assert(sizeof(int) == sizeof(int32_t), "The grid's cells are stored as int32");
+
+
+namespace {
+
+// The arrays of the sections, in their order, as they're written
+struct Arrays {
+    const void * data[TrackStoreHeader::NUM_SECTIONS];
+    size_t count[TrackStoreHeader::NUM_SECTIONS];
+    size_t element_size[TrackStoreHeader::NUM_SECTIONS];
+
+    void set(TrackStoreHeader::Section section, const std::vector<double> & v) {
+        data[section] = v.data();
+        count[section] = v.size();
+        element_size[section] = sizeof(double);
+    }
+
+    void set(TrackStoreHeader::Section section, const std::vector<int> & v) {
+        data[section] = v.data();
+        count[section] = v.size();
+        element_size[section] = sizeof(int32_t);
+    }
+};
+
+size_t aligned(size_t offset) {
+    return (offset + 7) & ~size_t(7);
+}
+
+template <class T>
+void read_section(const char * data, const TrackStoreHeader & header, TrackStoreHeader::Section section,
+                  std::vector<T> & v) {
+    const T * begin = reinterpret_cast<const T *>(data + header.sections[section].offset);
+    v.assign(begin, begin + header.sections[section].count);
+}
+
+}
+
+
+bool TrackStore::write(const std::string & path, const Centerline & centerline) {
+    TrackStoreHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TrackStoreHeader::MAGIC, sizeof(header.magic));
+    header.version = TrackStoreHeader::VERSION;
+    header.closed = centerline.spline.m_closed ? 1 : 0;
+    header.hash = centerline.hash;
+    header.num_points = centerline.pts_x.size();
+    header.length = centerline.spline.m_length;
+    const SpatialGrid & grid = centerline.grid;
+    header.grid_min_x = grid.m_min_x;
+    header.grid_min_y = grid.m_min_y;
+    header.grid_cell_size = grid.m_cell_size;
+    header.grid_num_cells_x = grid.m_num_cells_x;
+    header.grid_num_cells_y = grid.m_num_cells_y;
+
+    Arrays arrays;
+    arrays.set(TrackStoreHeader::PTS_X, centerline.pts_x);
+    arrays.set(TrackStoreHeader::PTS_Y, centerline.pts_y);
+    arrays.set(TrackStoreHeader::YAW, centerline.yaw);
+    arrays.set(TrackStoreHeader::SPEED, centerline.speed);
+    arrays.set(TrackStoreHeader::POINT_S, centerline.spline.m_point_s);
+    arrays.set(TrackStoreHeader::KNOT_S, centerline.spline.m_knot_s);
+    arrays.set(TrackStoreHeader::KNOT_X, centerline.spline.m_knot_x);
+    arrays.set(TrackStoreHeader::KNOT_Y, centerline.spline.m_knot_y);
+    arrays.set(TrackStoreHeader::KNOT_M_X, centerline.spline.m_m_x);
+    arrays.set(TrackStoreHeader::KNOT_M_Y, centerline.spline.m_m_y);
+    arrays.set(TrackStoreHeader::GRID_CELL_START, grid.m_cell_start);
+    arrays.set(TrackStoreHeader::GRID_CELL_POINTS, grid.m_cell_points);
+    arrays.set(TrackStoreHeader::GRID_PTS_X, grid.m_pts_x);
+    arrays.set(TrackStoreHeader::GRID_PTS_Y, grid.m_pts_y);
+
+    size_t size = sizeof(header);
+    for (uint32_t s=0; s < TrackStoreHeader::NUM_SECTIONS; s++) {
+        header.sections[s].offset = size;
+        header.sections[s].count = arrays.count[s];
+        size = aligned(size + arrays.count[s] * arrays.element_size[s]);
+    }
+
+    // Written aside, then renamed over the previous one, which the readers
+    // that mapped it keep until they're done with it
+    std::string tmp_path = path + ".tmp";
+    FILE * file = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+        MPC_ERROR("Could not create the track store %s: %s", tmp_path.c_str(), std::strerror(errno));
+        return false;
+    }
+    bool OK = (std::fwrite(&header, sizeof(header), 1, file) == 1);
+    const char zeros[8] = {0};
+    for (uint32_t s=0; OK and s < TrackStoreHeader::NUM_SECTIONS; s++) {
+        size_t bytes = arrays.count[s] * arrays.element_size[s];
+        OK = (bytes == 0 or std::fwrite(arrays.data[s], bytes, 1, file) == 1);
+        size_t padding = aligned(header.sections[s].offset + bytes) - (header.sections[s].offset + bytes);
+        OK = OK and (padding == 0 or std::fwrite(zeros, padding, 1, file) == 1);
+    }
+    OK = (std::fclose(file) == 0) and OK;
+    if (OK and std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        OK = false;
+    if (!OK) {
+        MPC_ERROR("Could not write the track store %s: %s", path.c_str(), std::strerror(errno));
+        std::remove(tmp_path.c_str());
+    }
+    return OK;
+}
+
+
+bool TrackStore::read(const std::string & path, Centerline & centerline) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        MPC_ERROR("Could not open the track store %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 or size_t(st.st_size) < sizeof(TrackStoreHeader)) {
+        MPC_ERROR("%s is not a track store", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    size_t size = size_t(st.st_size);
+    void * mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        MPC_ERROR("Could not map the track store %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    const char * data = static_cast<const char *>(mapping);
+    const TrackStoreHeader & header = *reinterpret_cast<const TrackStoreHeader *>(data);
+    bool OK = (std::memcmp(header.magic, TrackStoreHeader::MAGIC, sizeof(header.magic)) == 0
+               and header.version == TrackStoreHeader::VERSION);
+    for (uint32_t s=0; OK and s < TrackStoreHeader::NUM_SECTIONS; s++) {
+        size_t element_size = (s == TrackStoreHeader::GRID_CELL_START or s == TrackStoreHeader::GRID_CELL_POINTS)
+                ? sizeof(int32_t) : sizeof(double);
+        uint64_t offset = header.sections[s].offset, count = header.sections[s].count;
+        OK = (offset % 8 == 0 and offset <= size and count <= (size - offset) / element_size);
+    }
+    OK = OK and header.sections[TrackStoreHeader::PTS_X].count == header.num_points
+            and header.sections[TrackStoreHeader::PTS_Y].count == header.num_points;
+    if (!OK) {
+        MPC_ERROR("%s is not a track store (of this version of the node)", path.c_str());
+        munmap(mapping, size);
+        return false;
+    }
+
+    centerline.hash = header.hash;
+    read_section(data, header, TrackStoreHeader::PTS_X, centerline.pts_x);
+    read_section(data, header, TrackStoreHeader::PTS_Y, centerline.pts_y);
+    read_section(data, header, TrackStoreHeader::YAW, centerline.yaw);
+    read_section(data, header, TrackStoreHeader::SPEED, centerline.speed);
+
+    PathSpline & spline = centerline.spline;
+    spline.m_closed = (header.closed != 0);
+    spline.m_length = header.length;
+    read_section(data, header, TrackStoreHeader::POINT_S, spline.m_point_s);
+    read_section(data, header, TrackStoreHeader::KNOT_S, spline.m_knot_s);
+    read_section(data, header, TrackStoreHeader::KNOT_X, spline.m_knot_x);
+    read_section(data, header, TrackStoreHeader::KNOT_Y, spline.m_knot_y);
+    read_section(data, header, TrackStoreHeader::KNOT_M_X, spline.m_m_x);
+    read_section(data, header, TrackStoreHeader::KNOT_M_Y, spline.m_m_y);
+
+    SpatialGrid & grid = centerline.grid;
+    grid.m_min_x = header.grid_min_x;
+    grid.m_min_y = header.grid_min_y;
+    grid.m_cell_size = header.grid_cell_size;
+    grid.m_num_cells_x = header.grid_num_cells_x;
+    grid.m_num_cells_y = header.grid_num_cells_y;
+    read_section(data, header, TrackStoreHeader::GRID_CELL_START, grid.m_cell_start);
+    read_section(data, header, TrackStoreHeader::GRID_CELL_POINTS, grid.m_cell_points);
+    read_section(data, header, TrackStoreHeader::GRID_PTS_X, grid.m_pts_x);
+    read_section(data, header, TrackStoreHeader::GRID_PTS_Y, grid.m_pts_y);
+
+    munmap(mapping, size);
+    return true;
+}
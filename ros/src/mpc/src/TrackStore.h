@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "PathTracker.h"
+
+
+///* The start of a track store (see TrackStore): the path, its spline and
+///* its grid, then (from the offsets of `sections`, 8-byte aligned) their
+///* arrays, one after the other: doubles but for the GRID_CELL_* ints. Plain
+///* data in the native endianness, with no pointers, so that any process
+///* (the Python nodes too) reads it straight from the mapping
+struct TrackStoreHeader {
+    char magic[8];
+    uint32_t version;
+    ///* Whether the spline is periodic (see PathSpline)
+    uint32_t closed;
+    ///* `Centerline::hash` of the path, as announced on /centerline_store
+    uint64_t hash;
+    uint64_t num_points;
+
+    ///* Of the spline and the grid, as in PathSpline and SpatialGrid
+    double length;
+    double grid_min_x;
+    double grid_min_y;
+    double grid_cell_size;
+    int32_t grid_num_cells_x;
+    int32_t grid_num_cells_y;
+
+    enum Section : uint32_t {
+        PTS_X, PTS_Y, YAW, SPEED,
+        ///* PathSpline: the arc length of every point, then the knots
+        POINT_S, KNOT_S, KNOT_X, KNOT_Y, KNOT_M_X, KNOT_M_Y,
+        ///* SpatialGrid: the cells and the points in their order
+        GRID_CELL_START, GRID_CELL_POINTS, GRID_PTS_X, GRID_PTS_Y,
+        NUM_SECTIONS
+    };
+
+    ///* Where every section starts in the file [bytes] and its size [elements]
+    struct {
+        uint64_t offset;
+        uint64_t count;
+    } sections[NUM_SECTIONS];
+
+    static constexpr uint32_t VERSION = 1;
+    static const char MAGIC[8];
+};
+
+
+///* The track (the centerline and the structures derived from it but for
+///* the fit's) in a file, usually in /dev/shm, written once per path by
+///* track_store_node and announced on /centerline_store: the nodes that
+///* follow the path map it instead of each receiving, parsing and preparing
+///* their own copy of it (see `Params::centerline_format`).
+///*
+///* A new path replaces the file at once (it's renamed over it), so a
+///* reader maps either the old one or the new one, whole.
+class TrackStore {
+public:
+    ///* Writes the centerline, whose grid and spline are built (see
+    ///* `PathTracker::prepare_centerline`), to `path`; false (and logs why)
+    ///* if it can't
+    static bool write(const std::string & path, const Centerline & centerline);
+
+    ///* Reads the centerline of the file at `path` (its points, grid and
+    ///* spline, so that preparing it only adds the fit's structures); false
+    ///* (and logs why) if it's not a track store
+    static bool read(const std::string & path, Centerline & centerline);
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+
+///* Lock-free hand-off of the latest value from one writer thread to one
+///* reader thread. Neither of them ever waits for the other: the writer always
+///* has a slot of its own to write into, the reader always has one to read
+///* from, and the third slot holds the latest value that was published.
+///*
+///* Values that are published while the reader isn't looking simply replace
+///* each other, the reader only ever sees the freshest one.
+template <class T>
+class TripleBuffer {
+public:
+    TripleBuffer() : m_write(0), m_middle(1), m_read(2) {}
+
+    ///* Writer side: fill `back()` and then `publish()` it
+    T & back() { return m_slots[m_write]; }
+
+    void publish() {
+        uint8_t previous = m_middle.exchange(m_write | NEW_BIT, std::memory_order_acq_rel);
+        m_write = previous & INDEX_MASK;
+    }
+
+    ///* Reader side: `update()` makes the latest published value (if there's
+    ///* a new one, then it returns true) available in `front()`
+    bool update() {
+        if (!(m_middle.load(std::memory_order_relaxed) & NEW_BIT))
+            return false;
+        uint8_t previous = m_middle.exchange(m_read, std::memory_order_acq_rel);
+        m_read = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T & front() const { return m_slots[m_read]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t NEW_BIT = 0x4;
+
+    T m_slots[3];
+
+    ///* Only touched by the writer
+    uint8_t m_write;
+
+    ///* Index of the shared slot, and whether it's newer than the reader's
+    std::atomic<uint8_t> m_middle;
+
+    ///* Only touched by the reader
+    uint8_t m_read;
+};
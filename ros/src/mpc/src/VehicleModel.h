@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+
+#include "MPC.h"
+#include "FastTrig.h"
+
+
+///* The vehicle models of FG_eval (see `Params::vehicle_model`), as policies
+///* it's a template of: the dimensions of the state and of the inputs, a
+///* step of the dynamics, and the bounds. FG_eval is instantiated for each
+///* of them, so the steps are inlined into the tape (or the checkpoint
+///* function) it records, and the kinematic model costs what it always did.
+///*
+///* The state of a model starts with the pose (x, y, psi), which the
+///* tracking errors (cte, epsi) of FG_eval follow, then has EXTRA_STATES
+///* of its own. The inputs are the steering angle delta (positive to the
+///* right: the yaw rate of the kinematic model is -v delta / Lf) and the
+///* speed v.
+///*
+///* `step` is written for any scalar with cos and sin (AD<double>, the
+///* CppADCodeGen one), those of the `Trig` policy (see FastTrig.h).
+///*
+///* With ERRORS_FROM_POSE, the cte and epsi of FG_eval at the end of a step
+///* are those of the pose there (f(x) - y and psi - atan(f'(x))), instead of
+///* their own explicit Euler step.
+enum ModelState { MODEL_X, MODEL_Y, MODEL_PSI, MODEL_EXTRA };
+
+
+///* The model the controller has always had: no slip, the yaw rate follows
+///* the steering at once
+struct KinematicBicycle {
+    enum { STATE_DIM = 3, INPUT_DIM = 2, EXTRA_STATES = STATE_DIM - MODEL_EXTRA, ERRORS_FROM_POSE = 0 };
+
+    static const char * name() { return "kinematic"; }
+
+    template <class T, class Trig = ExactTrig>
+    static void step(const T * state, const T & delta, const T & v, const T & dt, T * next) {
+        next[MODEL_X] = state[MODEL_X] + v * Trig::cos(state[MODEL_PSI]) * dt;
+        next[MODEL_Y] = state[MODEL_Y] + v * Trig::sin(state[MODEL_PSI]) * dt;
+        next[MODEL_PSI] = state[MODEL_PSI] - v * delta / Lf() * dt;
+    }
+
+    ///* The speed of the car across the path, whose heading is `epsi` off
+    ///* the car's
+    template <class T, class Trig = ExactTrig>
+    static T lateral_speed(const T * state, const T & v, const T & epsi) {
+        return v * Trig::sin(epsi);
+    }
+
+    static double max_steer() { return 0.017453 * delta_constraint(); }
+    ///* As MPC's SPEED_UPPERBOUND
+    static double max_speed() { return 10.0; }
+    static double extra_lower(size_t) { return -1.0e19; }
+    static double extra_upper(size_t) { return 1.0e19; }
+};
+
+
+///* The integrators of the kinematic model (see `Params::integrator`)
+enum Integrator { INTEGRATOR_EULER, INTEGRATOR_RK2, INTEGRATOR_RK4, INTEGRATOR_EXACT };
+
+///* Its name in `Params::integrator`: "euler", "rk2", "rk4" or "exact"
+inline const char * integrator_name(Integrator integrator) {
+    static const char * const NAMES[] = {"euler", "rk2", "rk4", "exact"};
+    return NAMES[integrator];
+}
+
+///* ... and the one of `name`; false if none is
+inline bool integrator_from_name(const std::string & name, Integrator & integrator) {
+    for (int i=INTEGRATOR_EULER; i <= INTEGRATOR_EXACT; i++) {
+        if (name == integrator_name(Integrator(i))) {
+            integrator = Integrator(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+///* The kinematic model, integrated over a step more accurately than by
+///* its explicit Euler step, so that a coarser time grid (fewer, longer
+///* steps) predicts as far as well. The inputs are held over the step, so
+///* the yaw rate w = -v delta / Lf is constant and psi is exact either way;
+///* x and y move by v dt along:
+///*  - RK2 (the midpoint rule): the heading halfway, psi + w dt / 2
+///*  - RK4: its stages k2 and k3 are both halfway, so Simpson's rule of
+///*    the headings at the start, halfway and at the end
+///*  - exact: the chord of the arc, v dt sinc(w dt / 2) along the heading
+///*    halfway, with sinc as its Taylor series to z^6 (the tape has no
+///*    branch for z = 0), relatively within 1e-8 while |w dt| < 1 rad
+///* The tracking errors follow from the pose (see ERRORS_FROM_POSE), or
+///* they'd be first order again. (Euler is KinematicBicycle itself.)
+template <Integrator METHOD>
+struct IntegratedKinematic : KinematicBicycle {
+    static_assert(METHOD != INTEGRATOR_EULER, "The Euler step is KinematicBicycle's");
+    enum { ERRORS_FROM_POSE = 1 };
+
+    template <class T, class Trig = ExactTrig>
+    static void step(const T * state, const T & delta, const T & v, const T & dt, T * next) {
+        T turn = -v * delta / Lf() * dt;
+        T psi = state[MODEL_PSI];
+        T psi_half = psi + 0.5 * turn;
+        T forward_x, forward_y, length = v * dt;
+        if (METHOD == INTEGRATOR_RK4) {
+            T psi_end = psi + turn;
+            forward_x = (Trig::cos(psi) + 4.0 * Trig::cos(psi_half) + Trig::cos(psi_end)) * (1.0 / 6.0);
+            forward_y = (Trig::sin(psi) + 4.0 * Trig::sin(psi_half) + Trig::sin(psi_end)) * (1.0 / 6.0);
+        } else {
+            forward_x = Trig::cos(psi_half);
+            forward_y = Trig::sin(psi_half);
+        }
+        if (METHOD == INTEGRATOR_EXACT) {
+            T z = 0.5 * turn;
+            T z2 = z * z;
+            length = length * (1.0 - z2 * (1.0 / 6.0 - z2 * (1.0 / 120.0 - z2 * (1.0 / 5040.0))));
+        }
+        next[MODEL_X] = state[MODEL_X] + length * forward_x;
+        next[MODEL_Y] = state[MODEL_Y] + length * forward_y;
+        next[MODEL_PSI] = psi + turn;
+    }
+};
+
+
+///* A dynamic bicycle with linear tyres: the lateral velocity vy (in the
+///* car's frame, positive to the left) and the yaw rate r are states, driven
+///* by the lateral forces of the tyres, proportional to their slip angles.
+///* The speed input is the longitudinal velocity, as in the kinematic model.
+///*
+///* The lateral dynamics are stiff at low speed, so a step of `dt` is
+///* SUBSTEPS explicit Euler steps, and the slip angles are divided by a
+///* speed of at least about MIN_SLIP_SPEED (smoothly) instead of v, so they
+///* stay finite when stopped (where the car doesn't turn). Slowly, it turns
+///* like the kinematic model.
+struct DynamicBicycle {
+    enum ExtraState { VY = MODEL_EXTRA, YAW_RATE };
+    enum { STATE_DIM = 5, INPUT_DIM = 2, EXTRA_STATES = STATE_DIM - MODEL_EXTRA, ERRORS_FROM_POSE = 0 };
+
+    static const char * name() { return "dynamic"; }
+
+    template <class T, class Trig = ExactTrig>
+    static void step(const T * state, const T & delta, const T & v, const T & dt, T * next) {
+        using std::sqrt;
+        // (by value: CppAD's operators take references)
+        const double lf = FRONT_AXLE, lr = Lf() - FRONT_AXLE;
+        const double cf = FRONT_STIFFNESS, cr = REAR_STIFFNESS, mass = MASS, inertia = YAW_INERTIA;
+        T h = dt * (1.0 / SUBSTEPS);
+        // Positive to the left, as the yaw rate
+        T steer = -delta;
+        T slip_speed = sqrt(v * v + MIN_SLIP_SPEED * MIN_SLIP_SPEED);
+
+        for (size_t i=0; i < STATE_DIM; i++)
+            next[i] = state[i];
+        for (size_t s=0; s < SUBSTEPS; s++) {
+            T psi = next[MODEL_PSI];
+            T vy = next[VY];
+            T r = next[YAW_RATE];
+            T force_front = cf * (steer * v - (vy + lf * r)) / slip_speed;
+            T force_rear = cr * (lr * r - vy) / slip_speed;
+
+            T cos_psi = Trig::cos(psi);
+            T sin_psi = Trig::sin(psi);
+            next[MODEL_X] = next[MODEL_X] + (v * cos_psi - vy * sin_psi) * h;
+            next[MODEL_Y] = next[MODEL_Y] + (v * sin_psi + vy * cos_psi) * h;
+            next[MODEL_PSI] = psi + r * h;
+            T cos_steer = Trig::cos(steer);
+            next[VY] = vy + ((force_front * cos_steer + force_rear) / mass - v * r) * h;
+            next[YAW_RATE] = r + (lf * force_front * cos_steer - lr * force_rear) / inertia * h;
+        }
+    }
+
+    template <class T, class Trig = ExactTrig>
+    static T lateral_speed(const T * state, const T & v, const T & epsi) {
+        return v * Trig::sin(epsi) + state[VY] * Trig::cos(epsi);
+    }
+
+    static double max_steer() { return KinematicBicycle::max_steer(); }
+    static double max_speed() { return KinematicBicycle::max_speed(); }
+    static double extra_lower(size_t e) { return -extra_bound(e); }
+    static double extra_upper(size_t e) { return extra_bound(e); }
+
+    ///* Of the 1/10 car, roughly: its mass [kg] and moment of inertia about
+    ///* the vertical axis [kg m^2], the distance from its center of mass to
+    ///* the front axle [m] (the rear axle is Lf() - FRONT_AXLE behind it),
+    ///* and the cornering stiffness of either axle [N/rad]
+    static constexpr double MASS = 3.5;
+    static constexpr double YAW_INERTIA = 0.04;
+    static constexpr double FRONT_AXLE = 0.16;
+    static constexpr double FRONT_STIFFNESS = 30.0;
+    static constexpr double REAR_STIFFNESS = 30.0;
+
+    static const size_t SUBSTEPS = 4;
+    static constexpr double MIN_SLIP_SPEED = 1.0; // [m/s]
+
+private:
+    ///* Far beyond anything the car does, they only keep a diverging
+    ///* iterate finite: |vy| [m/s], |r| [rad/s]
+    static double extra_bound(size_t e) { return (e == 0) ? 5.0 : 20.0; }
+};
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "VescSerial.h"
+#include "Log.h"
+
+
+constexpr uint8_t VescSerial::COMM_SET_RPM;
+constexpr uint8_t VescSerial::COMM_SET_SERVO_POS;
+
+
+// CRC-16/XMODEM (polynomial 0x1021, initial 0), as the VESC checks it
+static uint16_t crc16(const uint8_t * data, size_t size) {
+    uint16_t crc = 0;
+    for (size_t i=0; i < size; i++) {
+        crc ^= uint16_t(data[i]) << 8;
+        for (int bit=0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? uint16_t((crc << 1) ^ 0x1021) : uint16_t(crc << 1);
+    }
+    return crc;
+}
+
+
+VescSerial::VescSerial() : m_fd(-1), m_dropped(0), m_pending_size(0) {
+}
+
+
+VescSerial::~VescSerial() {
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+
+bool VescSerial::open(const std::string & port) {
+    m_fd = ::open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) {
+        MPC_ERROR("Could not open the VESC's port %s: %s", port.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    // Raw bytes, no echo nor line discipline (the VESC's USB port ignores
+    // the baud rate)
+    termios tty;
+    if (tcgetattr(m_fd, &tty) != 0) {
+        MPC_ERROR("%s isn't a serial port: %s", port.c_str(), std::strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, B115200);
+    cfsetospeed(&tty, B115200);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if (tcsetattr(m_fd, TCSANOW, &tty) != 0) {
+        MPC_ERROR("Could not set the VESC's port %s up: %s", port.c_str(), std::strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    tcflush(m_fd, TCIOFLUSH);
+    return true;
+}
+
+
+size_t VescSerial::frame(const uint8_t * payload, size_t size) {
+    m_packet[0] = 0x02;
+    m_packet[1] = uint8_t(size);
+    std::memcpy(m_packet + 2, payload, size);
+    uint16_t crc = crc16(payload, size);
+    m_packet[2 + size] = uint8_t(crc >> 8);
+    m_packet[3 + size] = uint8_t(crc & 0xff);
+    m_packet[4 + size] = 0x03;
+    return 5 + size;
+}
+
+
+bool VescSerial::write_pending() {
+    if (m_pending_size == 0)
+        return true;
+    ssize_t written = write(m_fd, m_pending, m_pending_size);
+    if (written > 0) {
+        m_pending_size -= size_t(written);
+        std::memmove(m_pending, m_pending + written, m_pending_size);
+    }
+    return m_pending_size == 0;
+}
+
+
+bool VescSerial::write_packet(size_t length) {
+    // Nothing may go out until the cut frame is whole
+    if (!write_pending()) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    ssize_t written = write(m_fd, m_packet, length);
+    if (written == ssize_t(length))
+        return true;
+    if (written <= 0) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // The rest goes out before the next frame
+    m_pending_size = length - size_t(written);
+    std::memcpy(m_pending, m_packet + written, m_pending_size);
+    return false;
+}
+
+
+bool VescSerial::send(double servo_position, double rpm) {
+    if (m_fd < 0)
+        return false;
+
+    // The servo first, the steering matters most. Its position in
+    // thousandths, the speed in whole ERPM
+    int16_t servo = int16_t(std::lround(std::min(std::max(servo_position, 0.0), 1.0) * 1000.0));
+    uint8_t payload[5] = {COMM_SET_SERVO_POS, uint8_t(uint16_t(servo) >> 8), uint8_t(uint16_t(servo) & 0xff)};
+    bool OK = write_packet(frame(payload, 3));
+
+    int32_t erpm = int32_t(std::lround(rpm));
+    uint32_t bits = uint32_t(erpm);
+    payload[0] = COMM_SET_RPM;
+    payload[1] = uint8_t(bits >> 24);
+    payload[2] = uint8_t(bits >> 16);
+    payload[3] = uint8_t(bits >> 8);
+    payload[4] = uint8_t(bits);
+    OK &= write_packet(frame(payload, 5));
+    return OK;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+///* The commands straight to the VESC over its serial port (see
+///* `Params::vesc_port`), instead of through the topics and the driver's
+///* node: the servo position and the motor speed, in the same units as on
+///* /commands/servo/position and /commands/motor/speed (Dzik's, see
+///* ControlPipeline::CENTER_IN_DZIK and WHEEL_RADIUS_IN_DZIK), each in a
+///* packet of the VESC's protocol: 0x02, the length, the payload (the id of
+///* the command and its big-endian value), its CRC-16 (XMODEM) and 0x03.
+///*
+///* The writes don't block: a command the port can't take any of right away
+///* is dropped (the next tick sends a newer one), and counted. One it takes
+///* only part of is finished before the next one goes out, which is dropped
+///* if it still can't be, so that the VESC never reads a cut frame.
+class VescSerial {
+public:
+    VescSerial();
+    ~VescSerial();
+    VescSerial(const VescSerial &) = delete;
+    VescSerial & operator=(const VescSerial &) = delete;
+
+    ///* Opens the port (e.g. /dev/ttyACM0) raw; false, after logging why,
+    ///* when it can't
+    bool open(const std::string & port);
+
+    ///* The servo position in [0, 1] and the motor speed [ERPM]; false when
+    ///* either packet didn't go out whole
+    bool send(double servo_position, double rpm);
+
+    ///* The packets dropped so far (from any thread)
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint8_t COMM_SET_RPM = 8;
+    static constexpr uint8_t COMM_SET_SERVO_POS = 12;
+
+    ///* Frames a payload of `size` bytes into `m_packet`; its length
+    size_t frame(const uint8_t * payload, size_t size);
+
+    ///* Writes the rest of the last frame, then the `length` bytes of
+    ///* `m_packet`; true when the whole of both went out
+    bool write_packet(size_t length);
+
+    ///* Writes what's left of the last frame; true when nothing is
+    bool write_pending();
+
+    int m_fd;
+    std::atomic<uint64_t> m_dropped;
+    ///* The start and end bytes, the length, a payload of up to 5 bytes and
+    ///* the CRC
+    uint8_t m_packet[10];
+    ///* The bytes of the last frame the port didn't take yet
+    uint8_t m_pending[10];
+    size_t m_pending_size;
+};
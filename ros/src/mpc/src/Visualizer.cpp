@@ -0,0 +1,198 @@
+#include <cmath>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <ros/console.h>
+
+#include "Visualizer.h"
+#include "MPC.h"
+
+
+constexpr int Visualizer::NUM_POLY_SAMPLES;
+constexpr double Visualizer::POLY_SAMPLE_STEP;
+
+
+Visualizer::Visualizer() : m_rate(0.0), m_contouring_reference(false), m_compact(false), m_running(false) {}
+
+
+Visualizer::~Visualizer() {
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+
+void Visualizer::start(ros::NodeHandle & nodehandle, double rate, bool contouring_reference, bool compact) {
+    m_contouring_reference = contouring_reference;
+    m_compact = compact;
+    if (m_compact) {
+        m_pub_debug = nodehandle.advertise<mpc::Debug>(
+                "mpc/debug_cpp",
+                1
+        );
+    } else {
+        m_pub_closest = nodehandle.advertise<visualization_msgs::Marker>(
+                "mpc/closest_cpp",
+                1
+        );
+
+        m_pub_next_pos = nodehandle.advertise<visualization_msgs::Marker>(
+                "mpc/next_pos_cpp",
+                1
+        );
+
+        m_pub_poly = nodehandle.advertise<visualization_msgs::Marker>(
+                "mpc/poly_cpp",
+                1
+        );
+    }
+
+    m_rate = rate;
+    m_running = true;
+    m_thread = std::thread(&Visualizer::run, this);
+
+    // Only runs when nothing else wants the core (Linux)
+    sched_param param;
+    param.sched_priority = 0;
+    if (pthread_setschedparam(m_thread.native_handle(), SCHED_IDLE, &param) != 0)
+        ROS_WARN("Could not lower the priority of the visualization thread");
+}
+
+
+void Visualizer::push(const ros::Time & stamp, double pos_x, double pos_y, double sin_psi, double cos_psi,
+                      std::vector<double> & vars, Eigen::VectorXd & coeffs, WaypointBuffer & window) {
+    VisualizationFrame & frame = m_frames.back();
+    frame.stamp = stamp;
+    frame.pos_x = pos_x;
+    frame.pos_y = pos_y;
+    frame.sin_psi = sin_psi;
+    frame.cos_psi = cos_psi;
+    frame.vars.swap(vars);
+    frame.coeffs.swap(coeffs);
+    frame.window.x.swap(window.x);
+    frame.window.y.swap(window.y);
+    m_frames.publish();
+}
+
+
+void Visualizer::run() {
+    ros::Rate rate(m_rate);
+    while (m_running and ros::ok()) {
+        rate.sleep();
+        if (!m_frames.update())
+            continue;
+        const VisualizationFrame & frame = m_frames.front();
+        if (m_compact) {
+            fill_debug(frame);
+            m_pub_debug.publish(m_debug);
+            continue;
+        }
+
+        // First, publish the next points as predicted from MPC (the first two
+        // values are the actuators)
+        size_t num_predicted = frame.vars.size() < 2 ? 0 : (frame.vars.size() - 2) / 2;
+        m_marker_car.resize(num_predicted);
+        for (size_t i=0; i < num_predicted; i++) {
+            m_marker_car.x[i] = frame.vars[2 + 2*i];
+            m_marker_car.y[i] = frame.vars[3 + 2*i];
+        }
+        m_pub_next_pos.publish(get_marker(frame, m_marker_car, 0.0, 0.0, 1.0));
+
+        // Now, publish the closest waypoints (those used for polyfit)
+        m_pub_closest.publish(get_marker(frame, frame.window, 1.0, 1.0, 1.0));
+
+        // Now, publish markers that show the polynomial that was fit to the
+        // waypoints, or the points of the contouring reference
+        if (m_contouring_reference) {
+            size_t num_steps = frame.coeffs.size() / REF_SAMPLE_SIZE;
+            m_marker_car.resize(num_steps);
+            for (size_t t=0; t < num_steps; t++) {
+                m_marker_car.x[t] = frame.coeffs[REF_SAMPLE_SIZE * t + REF_X];
+                m_marker_car.y[t] = frame.coeffs[REF_SAMPLE_SIZE * t + REF_Y];
+            }
+        } else {
+            m_marker_car.resize(NUM_POLY_SAMPLES);
+            for (int i=0; i < NUM_POLY_SAMPLES; i++) {
+                m_marker_car.x[i] = POLY_SAMPLE_STEP * i;
+                m_marker_car.y[i] = polyeval(frame.coeffs, m_marker_car.x[i]);
+            }
+        }
+        m_pub_poly.publish(get_marker(frame, m_marker_car, 0.7, 0.2, 0.1));
+    }
+}
+
+
+visualization_msgs::Marker Visualizer::get_marker(
+        const VisualizationFrame & frame,
+        const WaypointBuffer & car_pts,
+        float red, float green, float blue
+
+    ) {
+    visualization_msgs::Marker marker;
+    marker.header.frame_id = "/map";
+    marker.header.stamp = frame.stamp;
+    marker.type = visualization_msgs::Marker::LINE_STRIP;
+    marker.action = visualization_msgs::Marker::ADD;
+
+    marker.scale.x = 0.1;
+    marker.scale.y = 0.1;
+    marker.scale.z = 0.1;
+
+    marker.pose.position.x = 0;
+    marker.pose.position.y = 0;
+    marker.pose.position.z = 0;
+
+    marker.pose.orientation.x = 0.0;
+    marker.pose.orientation.y = 0.0;
+    marker.pose.orientation.z = 0.0;
+    marker.pose.orientation.w = 1.0;
+
+    marker.color.a = 0.5;
+    marker.color.r = red;
+    marker.color.g = green;
+    marker.color.b = blue;
+
+    marker.lifetime = ros::Duration();
+
+    // The points are in the car's frame
+    to_world_frame(car_pts, frame.pos_x, frame.pos_y, frame.sin_psi, frame.cos_psi, m_marker_world);
+    marker.points.resize(m_marker_world.size());
+    for (size_t i=0; i < m_marker_world.size(); i++) {
+        marker.points[i].x = m_marker_world.x[i];
+        marker.points[i].y = m_marker_world.y[i];
+        marker.points[i].z = 0.0;
+    }
+
+    return marker;
+}
+
+
+void Visualizer::fill_debug(const VisualizationFrame & frame) {
+    m_debug.header.frame_id = "/map";
+    m_debug.header.stamp = frame.stamp;
+    m_debug.pos_x = frame.pos_x;
+    m_debug.pos_y = frame.pos_y;
+    m_debug.psi = std::atan2(frame.sin_psi, frame.cos_psi);
+
+    m_debug.coeffs.resize(frame.coeffs.size());
+    for (Eigen::Index i=0; i < frame.coeffs.size(); i++)
+        m_debug.coeffs[i] = frame.coeffs[i];
+    m_debug.contouring_reference = m_contouring_reference;
+
+    // The first two values are the actuators
+    size_t num_predicted = frame.vars.size() < 2 ? 0 : (frame.vars.size() - 2) / 2;
+    m_debug.plan_x.resize(num_predicted);
+    m_debug.plan_y.resize(num_predicted);
+    for (size_t i=0; i < num_predicted; i++) {
+        m_debug.plan_x[i] = float(frame.vars[2 + 2*i]);
+        m_debug.plan_y[i] = float(frame.vars[3 + 2*i]);
+    }
+
+    m_debug.window_x.resize(frame.window.size());
+    m_debug.window_y.resize(frame.window.size());
+    for (size_t i=0; i < frame.window.size(); i++) {
+        m_debug.window_x[i] = float(frame.window.x[i]);
+        m_debug.window_y[i] = float(frame.window.y[i]);
+    }
+}
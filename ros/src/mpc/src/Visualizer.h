@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <ros/ros.h>
+#include <visualization_msgs/Marker.h>
+#include <mpc/Debug.h>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "TripleBuffer.h"
+#include "WaypointBuffer.h"
+
+
+///* What the debug markers of one tick are built from
+struct VisualizationFrame {
+    ros::Time stamp;
+
+    ///* The (latency-corrected) pose of the car the points are relative to
+    double pos_x = 0.0;
+    double pos_y = 0.0;
+    double sin_psi = 0.0;
+    double cos_psi = 1.0;
+
+    ///* As returned by `MPC::Solve`: the actuators, then the predicted
+    ///* (x, y) pairs in the car's frame
+    std::vector<double> vars;
+    ///* The fit polynomial, or the contouring reference (see
+    ///* `ReferenceSample`), in the car's frame
+    Eigen::VectorXd coeffs;
+    ///* The waypoints it was fit to, in the car's frame
+    WaypointBuffer window;
+};
+
+
+///* Builds and publishes the debug markers (/mpc/next_pos_cpp, /mpc/closest_cpp
+///* and /mpc/poly_cpp) on a thread of its own, at the lowest priority and at
+///* most at `rate` [Hz], so that they don't take time from the solver loop.
+///* Compact, it publishes what they're built from instead (/mpc/debug_cpp,
+///* see Debug.msg), for mpc_debug_markers to build them off-board.
+///*
+///* The solver loop hands a tick over with `push`, which swaps the vectors
+///* into a TripleBuffer slot instead of copying them; the thread only ever
+///* builds the markers of the latest tick.
+class Visualizer {
+public:
+    Visualizer();
+    ~Visualizer();
+
+    ///* Advertises the topics and starts the thread; the markers of the
+    ///* polynomial are those of the points of a contouring reference with
+    ///* `contouring_reference` (see `Params::contouring_reference`); with
+    ///* `compact`, the compact view is published instead of the markers
+    void start(ros::NodeHandle & nodehandle, double rate, bool contouring_reference = false,
+               bool compact = false);
+
+    ///* Solver loop side: takes over the contents of `vars`, `coeffs` and
+    ///* `window` (which are left with those of an older frame)
+    void push(const ros::Time & stamp, double pos_x, double pos_y, double sin_psi, double cos_psi,
+              std::vector<double> & vars, Eigen::VectorXd & coeffs, WaypointBuffer & window);
+
+private:
+    void run();
+
+    ///* Line strip through the points of `car_pts` (in the frame of the car of
+    ///* `frame`)
+    visualization_msgs::Marker get_marker(const VisualizationFrame & frame, const WaypointBuffer & car_pts,
+                                          float red, float green, float blue);
+
+    ///* The compact message of `frame`, in `m_debug`
+    void fill_debug(const VisualizationFrame & frame);
+
+    TripleBuffer<VisualizationFrame> m_frames;
+
+    ros::Publisher m_pub_next_pos;
+    ros::Publisher m_pub_poly;
+    ros::Publisher m_pub_closest;
+    ros::Publisher m_pub_debug;
+
+    double m_rate;
+    bool m_contouring_reference;
+    bool m_compact;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+
+    ///* Scratch buffers of the thread
+    WaypointBuffer m_marker_car;
+    WaypointBuffer m_marker_world;
+    mpc::Debug m_debug;
+
+    ///* Samples of the polynomial marker: every POLY_SAMPLE_STEP [m] ahead
+    static constexpr int NUM_POLY_SAMPLES = 11;
+    static constexpr double POLY_SAMPLE_STEP = 0.2;
+};
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <fstream>
+
+#include "WarmStart.h"
+#include "Log.h"
+
+
+ShiftWarmStart::ShiftWarmStart(const Params & params, const Indexes & indexes)
+        : m_steps_ahead(params.steps_ahead), m_indexes(indexes) {}
+
+
+bool ShiftWarmStart::initialize(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                                const double * prev_x, double * vars) {
+    if (prev_x == nullptr)
+        return false;
+    shift_solution(prev_x, m_indexes, m_steps_ahead, vars);
+    return true;
+}
+
+
+LearnedWarmStart::LearnedWarmStart(const Params & params, const Indexes & indexes, double max_delta, double max_v)
+        : m_params(params), m_indexes(indexes), m_num_inputs(indexes.v_start - indexes.delta_start),
+          m_max_delta(max_delta), m_max_v(max_v),
+          m_features(num_features(params.poly_degree)), m_inputs(2 * m_num_inputs) {}
+
+
+void LearnedWarmStart::features(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                                double * out) {
+    out[0] = 1.0;
+    out[1] = state[3];
+    out[2] = state[4];
+    for (int i=0; i < coeffs.size(); i++)
+        out[3 + i] = coeffs[i];
+    out[3 + coeffs.size()] = ref_v;
+}
+
+
+bool LearnedWarmStart::load(const std::string & path) {
+    std::ifstream file(path);
+    size_t steps_ahead, num_inputs, n_features;
+    int poly_degree;
+    file >> steps_ahead >> poly_degree >> num_inputs >> n_features;
+    if (!file) {
+        MPC_ERROR("Could not read %s", path.c_str());
+        return false;
+    }
+    if (steps_ahead != m_params.steps_ahead or poly_degree != m_params.poly_degree
+        or num_inputs != m_num_inputs or n_features != num_features(m_params.poly_degree)) {
+        MPC_ERROR("%s is for steps_ahead=%lu, poly_degree=%d and %lu actuations, not steps_ahead=%lu, "
+                  "poly_degree=%d and %lu", path.c_str(), steps_ahead, poly_degree, num_inputs,
+                  m_params.steps_ahead, m_params.poly_degree, m_num_inputs);
+        return false;
+    }
+
+    m_weights.resize(2 * num_inputs, n_features);
+    for (size_t i=0; i < 2 * num_inputs; i++)
+        for (size_t j=0; j < n_features; j++)
+            file >> m_weights(i, j);
+    if (!file) {
+        MPC_ERROR("%s is missing some of its weights", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+bool LearnedWarmStart::initialize(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                                  const double * prev_x, double * vars) {
+    features(state, coeffs, ref_v, m_features.data());
+    m_inputs.noalias() = m_weights * m_features;
+    for (size_t i=0; i < m_num_inputs; i++) {
+        vars[m_indexes.delta_start + i] = std::min(std::max(m_inputs[i], -m_max_delta), m_max_delta);
+        vars[m_indexes.v_start + i] = std::min(std::max(m_inputs[m_num_inputs + i], 0.0), m_max_v);
+    }
+
+    // The states of those actuations, by the model of FG_eval
+    size_t N = m_params.steps_ahead;
+    double x = state[0], y = state[1], psi = state[2], cte = state[3], epsi = state[4];
+    for (size_t t=0; t < N; t++) {
+        vars[m_indexes.x_start + t] = x;
+        vars[m_indexes.y_start + t] = y;
+        vars[m_indexes.psi_start + t] = psi;
+        vars[m_indexes.cte_start + t] = cte;
+        vars[m_indexes.epsi_start + t] = epsi;
+        if (t + 1 == N)
+            break;
+
+        double v = vars[m_indexes.v(t)];
+        double delta = vars[m_indexes.delta(t)];
+        double dt = m_params.step_dt(t);
+        double f, slope;
+        polyeval_with_diff(coeffs, x, f, slope);
+        double psides = atan(slope);
+
+        cte = f - y + v * sin(epsi) * dt;
+        epsi = psi - psides - v * delta / Lf() * dt;
+        x += v * cos(psi) * dt;
+        y += v * sin(psi) * dt;
+        psi -= v * delta / Lf() * dt;
+    }
+    return true;
+}
+
+
+bool LearnedWarmStart::write(const std::string & path, const Params & params, size_t num_inputs,
+                             const Eigen::MatrixXd & weights) {
+    std::ofstream file(path);
+    file.precision(17);
+    file << params.steps_ahead << " " << params.poly_degree << " " << num_inputs << " "
+         << weights.cols() << "\n";
+    for (int i=0; i < weights.rows(); i++) {
+        for (int j=0; j < weights.cols(); j++)
+            file << (j == 0 ? "" : " ") << weights(i, j);
+        file << "\n";
+    }
+    if (!file) {
+        MPC_ERROR("Could not write %s", path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+
+///* Where a solve of MPC starts from (see `Params::warm_start_initializer`):
+///* the initial values of the variables of the NLP, in the layout of the
+///* Indexes the initializer was made for.
+class WarmStartInitializer {
+public:
+    virtual ~WarmStartInitializer() {}
+
+    ///* The initial guess for the problem into `vars`; `prev_x` is the last
+    ///* successful solution, nullptr if there's none. False when there's no
+    ///* guess (the solve starts from zeros then). The initial state is set
+    ///* by the caller. Doesn't allocate
+    virtual bool initialize(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                            const double * prev_x, double * vars) = 0;
+};
+
+
+///* The previous solution shifted by one step (see `shift_solution`), the
+///* default
+class ShiftWarmStart : public WarmStartInitializer {
+public:
+    ShiftWarmStart(const Params & params, const Indexes & indexes);
+
+    bool initialize(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                    const double * prev_x, double * vars) override;
+
+private:
+    const size_t m_steps_ahead;
+    const Indexes m_indexes;
+};
+
+
+///* A linear regression from the problem to its solution, fit offline to
+///* logged solves (see mpc_warmstart_fit): the actuations of every step (or
+///* block) from the features of `features`, clamped to their bounds, and
+///* the states rolled out from them by the model of FG_eval. It doesn't
+///* need a previous solution, so it's a start after a relocalization jump,
+///* or where the previous plan doesn't fit the corner ahead.
+///*
+///* The file of the weights is text: the horizon, the degree, the number of
+///* actuations (per actuator) and of features, then the rows of the matrix,
+///* the deltas then the v's.
+class LearnedWarmStart : public WarmStartInitializer {
+public:
+    LearnedWarmStart(const Params & params, const Indexes & indexes, double max_delta, double max_v);
+
+    ///* Reads the weights; false (and logs why) if it can't, or if they're
+    ///* for another horizon, degree or move blocking
+    bool load(const std::string & path);
+
+    bool initialize(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                    const double * prev_x, double * vars) override;
+
+    ///* What the actuations are regressed on: 1, cte, epsi, the coefficients
+    ///* (lowest order first), then the reference speed
+    static size_t num_features(int poly_degree) { return size_t(poly_degree) + 5; }
+    static void features(const Eigen::VectorXd & state, const Eigen::VectorXd & coeffs, double ref_v,
+                         double * out);
+
+    ///* Writes weights (2 * `num_inputs` rows of `num_features` each); false
+    ///* (and logs why) if it can't
+    static bool write(const std::string & path, const Params & params, size_t num_inputs,
+                      const Eigen::MatrixXd & weights);
+
+private:
+    Params m_params;
+    const Indexes m_indexes;
+    const size_t m_num_inputs;
+    const double m_max_delta;
+    const double m_max_v;
+
+    Eigen::MatrixXd m_weights;
+    Eigen::VectorXd m_features;
+    Eigen::VectorXd m_inputs;
+};
+
+
+// Shift the values of the states of a previous solve one step ahead (each
+// of the blocks separately, padded with its last value), as they are
+template <class Vector>
+void shift_states(const double * prev_x, const Indexes & indexes, size_t steps_ahead, Vector & vars) {
+    const size_t state_starts[] = {indexes.x_start, indexes.y_start, indexes.psi_start, indexes.cte_start, indexes.epsi_start};
+    for (size_t start : state_starts) {
+        for (size_t t=0; t < steps_ahead - 1; t++)
+            vars[start + t] = prev_x[start + t + 1];
+        vars[start + steps_ahead - 1] = prev_x[start + steps_ahead - 1];
+    }
+    for (size_t e=0; e < indexes.num_extra; e++) {
+        for (size_t t=0; t < steps_ahead; t++)
+            vars[indexes.extra(e, t)] = prev_x[indexes.extra(e, std::min(t + 1, steps_ahead - 1))];
+    }
+}
+
+
+// ... and those of the actuations: by step, from the last to the first, so
+// that every block (with move blocking) ends up with the next actuation of
+// its first step
+template <class Vector>
+void shift_inputs(const double * prev_x, const Indexes & indexes, size_t steps_ahead, Vector & vars) {
+    for (size_t t=steps_ahead - 1; t-- > 0;) {
+        size_t next = std::min(t + 1, steps_ahead - 2);
+        vars[indexes.delta(t)] = prev_x[indexes.delta(next)];
+        vars[indexes.v(t)] = prev_x[indexes.v(next)];
+    }
+}
+
+
+// Shift the previous solution one step ahead (see above) and rewrite the
+// positions and headings relative to the first shifted stage, which is
+// where the car is expected to be now, i.e. the origin of the new car's
+// coordinate system. Those of the model's extra states are in the car's
+// frame, they only shift
+template <class Vector>
+void shift_solution(const double * prev_x, const Indexes & indexes, size_t steps_ahead, Vector & vars) {
+    shift_states(prev_x, indexes, steps_ahead, vars);
+    shift_inputs(prev_x, indexes, steps_ahead, vars);
+
+    double x0 = vars[indexes.x_start];
+    double y0 = vars[indexes.y_start];
+    double psi0 = vars[indexes.psi_start];
+    double cos_psi0 = cos(psi0);
+    double sin_psi0 = sin(psi0);
+    for (size_t t=0; t < steps_ahead; t++) {
+        double dx = vars[indexes.x_start + t] - x0;
+        double dy = vars[indexes.y_start + t] - y0;
+        vars[indexes.x_start + t] = dx * cos_psi0 + dy * sin_psi0;
+        vars[indexes.y_start + t] = -dx * sin_psi0 + dy * cos_psi0;
+        vars[indexes.psi_start + t] -= psi0;
+    }
+}
+
+
+// Shift the multipliers of a previous solve as its solution (see
+// `shift_solution`, multipliers don't depend on the frame): those of the
+// bounds of the variables, and those of the constraints, where the rows of
+// the model are in the layout of the states they define. The slacks and
+// their soft rows keep theirs; those of the obstacles start from 0, their
+// slots are filled anew on every tick
+template <class Vector>
+void shift_multipliers(const double * prev_z_L, const double * prev_z_U, const double * prev_lambda,
+                       const Indexes & indexes, size_t steps_ahead, Vector & z_L, Vector & z_U, Vector & lambda) {
+    shift_states(prev_z_L, indexes, steps_ahead, z_L);
+    shift_inputs(prev_z_L, indexes, steps_ahead, z_L);
+    shift_states(prev_z_U, indexes, steps_ahead, z_U);
+    shift_inputs(prev_z_U, indexes, steps_ahead, z_U);
+    for (size_t k=0; k < indexes.num_slacks; k++) {
+        z_L[indexes.slack_start + k] = prev_z_L[indexes.slack_start + k];
+        z_U[indexes.slack_start + k] = prev_z_U[indexes.slack_start + k];
+    }
+
+    shift_states(prev_lambda, indexes, steps_ahead, lambda);
+    for (size_t k=indexes.soft_start; k < indexes.obstacle_start; k++)
+        lambda[k] = prev_lambda[k];
+    for (size_t k=indexes.obstacle_start; k < size_t(lambda.size()); k++)
+        lambda[k] = 0.0;
+}
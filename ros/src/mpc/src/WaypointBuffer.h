@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+
+
+///* Structure-of-arrays buffer of 2D points. The coordinates live in two
+///* (16-byte aligned) Eigen arrays, so the transforms below compile to
+///* packed SIMD over whole arrays, and a buffer that is kept around (e.g. as
+///* a member) is only reallocated when its size changes.
+template <class Scalar>
+struct WaypointBufferT {
+    typedef Eigen::Array<Scalar, Eigen::Dynamic, 1> Array;
+
+    Array x;
+    Array y;
+
+    void resize(size_t n) {
+        x.resize(n);
+        y.resize(n);
+    }
+
+    size_t size() const { return size_t(x.size()); }
+};
+
+typedef WaypointBufferT<double> WaypointBuffer;
+
+///* Half the memory traffic and twice the SIMD width (see `Params::precision`);
+///* in the car's frame the points are a few metres away, well within what
+///* float resolves
+typedef WaypointBufferT<float> WaypointBufferF;
+
+
+///* World frame -> frame of a car at (pos_x, pos_y) with heading psi (into
+///* another buffer)
+template <class Scalar>
+inline void to_car_frame(const WaypointBufferT<Scalar> & world, double pos_x, double pos_y,
+                         double sin_psi, double cos_psi, WaypointBufferT<Scalar> & car) {
+    const Scalar x0 = Scalar(pos_x), y0 = Scalar(pos_y), s = Scalar(sin_psi), c = Scalar(cos_psi);
+    car.resize(world.size());
+    car.x = (world.x - x0) * c + (world.y - y0) * s;
+    car.y = (world.y - y0) * c - (world.x - x0) * s;
+}
+
+
+///* The inverse of `to_car_frame`
+template <class Scalar>
+inline void to_world_frame(const WaypointBufferT<Scalar> & car, double pos_x, double pos_y,
+                           double sin_psi, double cos_psi, WaypointBufferT<Scalar> & world) {
+    const Scalar x0 = Scalar(pos_x), y0 = Scalar(pos_y), s = Scalar(sin_psi), c = Scalar(cos_psi);
+    world.resize(car.size());
+    world.x = car.x * c - car.y * s + x0;
+    world.y = car.x * s + car.y * c + y0;
+}
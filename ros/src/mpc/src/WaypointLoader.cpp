@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "WaypointLoader.h"
+
+
+// Layout of the cache file: this header, then the x, y, yaw and speed
+// arrays (num_points doubles each)
+struct CacheHeader {
+    char magic[8];
+    uint64_t csv_size;
+    int64_t csv_mtime_sec;
+    int64_t csv_mtime_nsec;
+    double distance;
+    uint64_t num_points;
+};
+
+
+static const char CACHE_MAGIC[8] = {'M', 'P', 'C', 'W', 'P', 'T', 'S', '1'};
+
+
+static void fill_header(const struct stat & csv_stat, double distance, uint64_t num_points, CacheHeader & header) {
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.csv_size = uint64_t(csv_stat.st_size);
+    header.csv_mtime_sec = int64_t(csv_stat.st_mtim.tv_sec);
+    header.csv_mtime_nsec = int64_t(csv_stat.st_mtim.tv_nsec);
+    header.distance = distance;
+    header.num_points = num_points;
+}
+
+
+static bool read_cache(const std::string & cache_path, const struct stat & csv_stat, double distance, Waypoints & waypoints) {
+    std::ifstream cache(cache_path, std::ios::binary | std::ios::ate);
+    if (!cache)
+        return false;
+    uint64_t cache_size = uint64_t(cache.tellg());
+    cache.seekg(0);
+
+    CacheHeader header, expected;
+    cache.read(reinterpret_cast<char *>(&header), sizeof(header));
+    fill_header(csv_stat, distance, header.num_points, expected);
+    if (!cache or std::memcmp(&header, &expected, sizeof(header)) != 0
+            or cache_size != sizeof(header) + 4 * header.num_points * sizeof(double))
+        return false;
+
+    size_t n = header.num_points;
+    for (std::vector<double> * column : {&waypoints.x, &waypoints.y, &waypoints.yaw, &waypoints.speed}) {
+        column->resize(n);
+        cache.read(reinterpret_cast<char *>(column->data()), n * sizeof(double));
+    }
+    return bool(cache);
+}
+
+
+static void write_cache(const std::string & cache_path, const struct stat & csv_stat, double distance, const Waypoints & waypoints) {
+    // Written aside and then renamed, so a reader never sees half of it
+    std::string tmp_path = cache_path + ".tmp";
+    {
+        std::ofstream cache(tmp_path, std::ios::binary | std::ios::trunc);
+        CacheHeader header;
+        fill_header(csv_stat, distance, waypoints.x.size(), header);
+        cache.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const std::vector<double> * column : {&waypoints.x, &waypoints.y, &waypoints.yaw, &waypoints.speed})
+            cache.write(reinterpret_cast<const char *>(column->data()), column->size() * sizeof(double));
+        if (!cache) {
+            MPC_WARN("Could not write the waypoints cache %s", tmp_path.c_str());
+            std::remove(tmp_path.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+        MPC_WARN("Could not write the waypoints cache %s", cache_path.c_str());
+        std::remove(tmp_path.c_str());
+    }
+}
+
+
+static bool is_digit(char c) {
+    return c >= '0' and c <= '9';
+}
+
+
+// Parses a decimal number at p (after spaces/tabs), moving p past it. Exact
+// when the digits fit in 2^53 and the power of 10 in a double (the usual
+// case for the CSVs), otherwise it falls back to strtod.
+static bool parse_double(const char * & p, const char * end, double & value) {
+    static const double POWERS_OF_10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    while (p < end and (*p == ' ' or *p == '\t'))
+        p++;
+    const char * start = p;
+
+    bool negative = false;
+    if (p < end and (*p == '-' or *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int num_digits = 0;
+    int exponent = 0;
+    bool any_digits = false;
+    for (; p < end and is_digit(*p); p++) {
+        any_digits = true;
+        if (num_digits < 19) {
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+            if (mantissa != 0)
+                num_digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end and *p == '.') {
+        for (p++; p < end and is_digit(*p); p++) {
+            any_digits = true;
+            if (num_digits < 19) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                if (mantissa != 0)
+                    num_digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any_digits)
+        return false;
+
+    if (p < end and (*p == 'e' or *p == 'E')) {
+        const char * q = p + 1;
+        bool exponent_negative = false;
+        if (q < end and (*q == '-' or *q == '+')) {
+            exponent_negative = (*q == '-');
+            q++;
+        }
+        if (q < end and is_digit(*q)) {
+            int explicit_exponent = 0;
+            for (; q < end and is_digit(*q); q++)
+                explicit_exponent = std::min(explicit_exponent * 10 + (*q - '0'), 100000);
+            exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+            p = q;
+        }
+    }
+
+    if (mantissa <= (uint64_t(1) << 53) and exponent >= -22 and exponent <= 22) {
+        value = double(mantissa);
+        value = (exponent < 0) ? value / POWERS_OF_10[-exponent] : value * POWERS_OF_10[exponent];
+        if (negative)
+            value = -value;
+        return true;
+    }
+
+    char buffer[128];
+    size_t length = std::min(size_t(p - start), sizeof(buffer) - 1);
+    std::memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    value = std::strtod(buffer, nullptr);
+    return true;
+}
+
+
+static bool parse_csv(const char * data, size_t size, const std::string & csv_path, double distance, Waypoints & waypoints) {
+    const char * p = data;
+    const char * end = data + size;
+    double distance2 = distance * distance;
+    size_t num_columns = 0;
+    size_t line = 0;
+
+    while (p < end) {
+        line++;
+
+        // Skip empty lines
+        const char * line_start = p;
+        while (p < end and (*p == ' ' or *p == '\t' or *p == '\r'))
+            p++;
+        if (p == end)
+            break;
+        if (*p == '\n') {
+            p++;
+            continue;
+        }
+        p = line_start;
+
+        double row[6];
+        size_t n = 0;
+        while (true) {
+            // The 6-column CSVs have empty trailing fields in places, that's
+            // fine past the 4 that are used
+            double value = std::numeric_limits<double>::quiet_NaN();
+            while (p < end and (*p == ' ' or *p == '\t'))
+                p++;
+            bool empty = (p == end or *p == ',' or *p == '\n' or *p == '\r');
+            if ((empty and n < 4) or (!empty and !parse_double(p, end, value))) {
+                MPC_ERROR("%s:%lu: expected a number", csv_path.c_str(), line);
+                return false;
+            }
+            if (n < 6)
+                row[n] = value;
+            n++;
+
+            while (p < end and (*p == ' ' or *p == '\t' or *p == '\r'))
+                p++;
+            if (p < end and *p == ',') {
+                p++;
+                continue;
+            }
+            if (p == end or *p == '\n')
+                break;
+            MPC_ERROR("%s:%lu: unexpected '%c'", csv_path.c_str(), line, *p);
+            return false;
+        }
+        if (p < end)
+            p++;
+
+        if (num_columns == 0) {
+            num_columns = n;
+            if (num_columns != 4 and num_columns != 6) {
+                MPC_ERROR("%s: rows of %lu values, expected 4 (x, y, yaw, speed) or 6", csv_path.c_str(), n);
+                return false;
+            }
+        } else if (n != num_columns) {
+            MPC_ERROR("%s:%lu: %lu values instead of %lu", csv_path.c_str(), line, n, num_columns);
+            return false;
+        }
+
+        // The same sparsification as markers_node.py: the first waypoint,
+        // and then every one far enough from the previous one kept
+        bool keep = waypoints.x.empty();
+        if (!keep) {
+            double dx = row[0] - waypoints.x.back();
+            double dy = row[1] - waypoints.y.back();
+            keep = (dx*dx + dy*dy >= distance2);
+        }
+        if (keep) {
+            waypoints.x.push_back(row[0]);
+            waypoints.y.push_back(row[1]);
+            waypoints.yaw.push_back(row[2]);
+            waypoints.speed.push_back(row[3]);
+        }
+    }
+    return true;
+}
+
+
+bool load_waypoints(const std::string & csv_path, double distance, Waypoints & waypoints) {
+    waypoints = Waypoints();
+
+    int fd = open(csv_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        MPC_ERROR("Could not open %s: %s", csv_path.c_str(), std::strerror(errno));
+        return false;
+    }
+    struct stat csv_stat;
+    if (fstat(fd, &csv_stat) != 0) {
+        MPC_ERROR("Could not stat %s: %s", csv_path.c_str(), std::strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    std::string cache_path = csv_path + ".cache";
+    if (read_cache(cache_path, csv_stat, distance, waypoints)) {
+        close(fd);
+        return true;
+    }
+    waypoints = Waypoints();
+
+    size_t size = size_t(csv_stat.st_size);
+    bool OK = true;
+    if (size > 0) {
+        void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            MPC_ERROR("Could not map %s: %s", csv_path.c_str(), std::strerror(errno));
+            close(fd);
+            return false;
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+        OK = parse_csv(static_cast<const char *>(data), size, csv_path, distance, waypoints);
+        munmap(data, size);
+    }
+    close(fd);
+
+    if (!OK)
+        return false;
+    if (waypoints.x.empty()) {
+        MPC_ERROR("%s has no waypoints", csv_path.c_str());
+        return false;
+    }
+    write_cache(cache_path, csv_stat, distance, waypoints);
+    return true;
+}
+
+
+bool write_waypoints_csv(const std::string & path, const Waypoints & waypoints, int columns) {
+    if (columns != 4 and columns != 6) {
+        MPC_ERROR("No %d-column format of the waypoints for %s", columns, path.c_str());
+        return false;
+    }
+    std::FILE * file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        MPC_ERROR("Could not open %s: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    for (size_t i=0; i < waypoints.x.size(); i++) {
+        double yaw = (i < waypoints.yaw.size()) ? waypoints.yaw[i] : 0.0;
+        double speed = (i < waypoints.speed.size()) ? waypoints.speed[i] : 0.0;
+        std::fprintf(file, (columns == 4) ? "%f, %f, %f, %f\n" : "%f,%f,%f,%f,0,0\n",
+                     waypoints.x[i], waypoints.y[i], yaw, speed);
+    }
+    bool OK = !std::ferror(file);
+    if (std::fclose(file) != 0 or !OK) {
+        MPC_ERROR("Could not write %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+constexpr uint32_t RouteTilesHeader::VERSION;
+const char RouteTilesHeader::MAGIC[8] = {'M', 'P', 'C', 'R', 'T', 'E', '1', '\0'};
+
+// A route whose ends are closer than this many times the mean spacing of its
+// waypoints is a loop (as PathTracker's paths)
+static constexpr double CLOSED_ROUTE_GAP = 3.0;
+
+
+bool write_route_tiles(const std::string & path, const Waypoints & waypoints, size_t tile_points) {
+    size_t num_points = waypoints.x.size();
+    if (num_points == 0 or tile_points == 0) {
+        MPC_ERROR("No waypoints or no tile size for the route %s", path.c_str());
+        return false;
+    }
+
+    RouteTilesHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, RouteTilesHeader::MAGIC, sizeof(header.magic));
+    header.version = RouteTilesHeader::VERSION;
+    header.num_points = num_points;
+    header.num_tiles = (num_points + tile_points - 1) / tile_points;
+
+    // FNV-1a over the bytes of the points
+    header.hash = 14695981039346656037ull;
+    for (const std::vector<double> * column : {&waypoints.x, &waypoints.y}) {
+        const unsigned char * bytes = reinterpret_cast<const unsigned char *>(column->data());
+        for (size_t i=0; i < column->size() * sizeof(double); i++)
+            header.hash = (header.hash ^ bytes[i]) * 1099511628211ull;
+    }
+    double length = 0.0;
+    for (size_t i=1; i < num_points; i++)
+        length += std::hypot(waypoints.x[i] - waypoints.x[i-1], waypoints.y[i] - waypoints.y[i-1]);
+    double gap = std::hypot(waypoints.x[0] - waypoints.x[num_points-1], waypoints.y[0] - waypoints.y[num_points-1]);
+    header.closed = (num_points > 2 and gap < CLOSED_ROUTE_GAP * length / (num_points - 1)) ? 1 : 0;
+
+    std::vector<RouteTile> tiles(header.num_tiles);
+    uint64_t offset = sizeof(header) + tiles.size() * sizeof(RouteTile);
+    for (size_t t=0; t < tiles.size(); t++) {
+        size_t begin = t * tile_points;
+        size_t count = std::min(tile_points, num_points - begin);
+        tiles[t].offset = offset;
+        tiles[t].count = count;
+        tiles[t].center_x = tiles[t].center_y = 0.0;
+        for (size_t i=begin; i < begin + count; i++) {
+            tiles[t].center_x += waypoints.x[i] / count;
+            tiles[t].center_y += waypoints.y[i] / count;
+        }
+        offset += 4 * count * sizeof(double);
+    }
+
+    // Written aside and then renamed, so a reader never sees half of it
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(tiles.data()), tiles.size() * sizeof(RouteTile));
+        for (size_t t=0; t < tiles.size(); t++) {
+            for (const std::vector<double> * column : {&waypoints.x, &waypoints.y, &waypoints.yaw, &waypoints.speed})
+                file.write(reinterpret_cast<const char *>(column->data() + t * tile_points),
+                           tiles[t].count * sizeof(double));
+        }
+        if (!file) {
+            MPC_ERROR("Could not write the route %s", tmp_path.c_str());
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        MPC_ERROR("Could not write the route %s: %s", path.c_str(), std::strerror(errno));
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+///* The recorded waypoints of a path
+struct Waypoints {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> yaw;
+    std::vector<double> speed;
+};
+
+
+///* Loads the waypoints CSV (the 4-column "x, y, yaw, speed" or the 6-column
+///* format of waypoints/, of which only the first 4 are used) and keeps only
+///* the waypoints at least `distance` [m] away from the previous one kept,
+///* like `sparse_trajectory` in markers_node.py.
+///*
+///* The result is cached in `<csv>.cache`, which later loads of the same
+///* (unmodified) CSV with the same distance read instead of parsing it.
+///* Returns false (and logs why) if the CSV can't be read.
+bool load_waypoints(const std::string & csv_path, double distance, Waypoints & waypoints);
+
+
+///* Writes the waypoints to `path` as a CSV that `load_waypoints` reads: the
+///* 4-column format ("x, y, yaw, speed"), or the 6-column one with the last
+///* two columns 0; false (and logs why) if it can't
+bool write_waypoints_csv(const std::string & path, const Waypoints & waypoints, int columns = 4);
+
+
+///* The start of a tiled route (see RouteStreamer): this header, the index
+///* of its tiles (`num_tiles` RouteTile), then the waypoints of every tile,
+///* at the offset of its entry: its x, y, yaw and speed columns (`count`
+///* doubles each). Plain data in the native endianness, as the cache
+struct RouteTilesHeader {
+    char magic[8];
+    uint32_t version;
+    ///* Whether the route is a loop (its ends about as close as two
+    ///* consecutive waypoints)
+    uint32_t closed;
+    ///* Of all its points, for the hashes of the paths of its tiles
+    uint64_t hash;
+    uint64_t num_points;
+    uint64_t num_tiles;
+
+    static constexpr uint32_t VERSION = 1;
+    static const char MAGIC[8];
+};
+
+struct RouteTile {
+    ///* [bytes] from the start of the file, and [waypoints]
+    uint64_t offset;
+    uint64_t count;
+    ///* The mean of its waypoints, which tells the tile the car is in
+    double center_x;
+    double center_y;
+};
+
+
+///* Writes the waypoints to `path` as a tiled route, in tiles of
+///* `tile_points` consecutive waypoints; false (and logs why) if it can't
+bool write_route_tiles(const std::string & path, const Waypoints & waypoints, size_t tile_points);
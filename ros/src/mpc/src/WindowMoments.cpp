@@ -0,0 +1,105 @@
+#include <cmath>
+#include <cstring>
+
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "WindowMoments.h"
+
+
+constexpr int WindowMoments::MAX_DEGREE;
+constexpr int WindowMoments::MAX_MOMENT;
+
+
+WindowMoments::WindowMoments() {
+    reset(1, 0.0, 0.0);
+}
+
+
+void WindowMoments::reset(int degree, double origin_x, double origin_y) {
+    m_degree = degree;
+    m_origin_x = origin_x;
+    m_origin_y = origin_y;
+    std::memset(m_moments, 0, sizeof(m_moments));
+}
+
+
+void WindowMoments::accumulate(double x, double y, double weight) {
+    double u = x - m_origin_x;
+    double v = y - m_origin_y;
+    int max_order = 2 * m_degree;
+
+    double u_power = weight;
+    for (int a=0; a <= max_order; a++) {
+        double term = u_power;
+        for (int b=0; a + b <= max_order; b++) {
+            m_moments[a][b] += term;
+            term *= v;
+        }
+        u_power *= u;
+    }
+}
+
+
+double WindowMoments::apply(const Bivariate & p, int max_order) const {
+    double result = 0.0;
+    for (int a=0; a <= max_order; a++)
+        for (int b=0; a + b <= max_order; b++)
+            result += p[a][b] * m_moments[a][b];
+    return result;
+}
+
+
+// out = p * (e + cu u + cv v), for p of total order `order`
+void WindowMoments::multiply_linear(const Bivariate & p, int order, double e, double cu, double cv, Bivariate & out) {
+    for (int a=0; a <= order + 1; a++) {
+        for (int b=0; a + b <= order + 1; b++) {
+            double value = (a + b <= order) ? e * p[a][b] : 0.0;
+            if (a > 0)
+                value += cu * p[a - 1][b];
+            if (b > 0)
+                value += cv * p[a][b - 1];
+            out[a][b] = value;
+        }
+    }
+}
+
+
+void WindowMoments::fit(double pos_x, double pos_y, double psi, Eigen::VectorXd & coeffs) const {
+    // In the car's frame a point at (origin + (u, v)) is at
+    //     x = cos_psi u + sin_psi v + e_x
+    //     y = -sin_psi u + cos_psi v + e_y
+    double cos_psi = std::cos(psi);
+    double sin_psi = std::sin(psi);
+    double dx = m_origin_x - pos_x;
+    double dy = m_origin_y - pos_y;
+    double e_x = dx * cos_psi + dy * sin_psi;
+    double e_y = -dx * sin_psi + dy * cos_psi;
+
+    // Power sums of x (up to x^(2 degree)) and moments of y (x^k y, k <= degree)
+    double power_sums[MAX_MOMENT + 1];
+    double moments[MAX_DEGREE + 1];
+    Bivariate x_power, next, xy;
+    std::memset(x_power, 0, sizeof(x_power));
+    x_power[0][0] = 1.0;
+    for (int k=0; k <= 2 * m_degree; k++) {
+        power_sums[k] = apply(x_power, k);
+        if (k <= m_degree) {
+            multiply_linear(x_power, k, e_y, -sin_psi, cos_psi, xy);
+            moments[k] = apply(xy, k + 1);
+        }
+        if (k < 2 * m_degree) {
+            multiply_linear(x_power, k, e_x, cos_psi, sin_psi, next);
+            std::memcpy(x_power, next, sizeof(next));
+        }
+    }
+
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MAX_DEGREE + 1, MAX_DEGREE + 1> Normal;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_DEGREE + 1, 1> Rhs;
+    Normal normal(m_degree + 1, m_degree + 1);
+    Rhs rhs(m_degree + 1);
+    for (int r=0; r <= m_degree; r++) {
+        rhs[r] = moments[r];
+        for (int c=0; c <= m_degree; c++)
+            normal(r, c) = power_sums[r + c];
+    }
+    coeffs = normal.ldlt().solve(rhs);
+}
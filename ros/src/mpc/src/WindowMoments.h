@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+
+
+///* World-frame summary of a set of waypoints from which the least-squares
+///* fit of a polynomial y = p(x) to them, in the frame of a car anywhere,
+///* follows at a cost that doesn't depend on the number of points.
+///*
+///* The normal equations of the fit in the car's frame only need the sums of
+///* x^k and x^k y over the points, and both are polynomials in the world
+///* coordinates of the points. So it keeps the moments sum(u^a v^b), for
+///* a + b <= 2 degree, of the points (u, v) relative to a local origin, and
+///* maps them into the car's frame when fitting.
+class WindowMoments {
+public:
+    WindowMoments();
+
+    ///* Clears the moments, for a polynomial of the given degree with the
+    ///* moments taken around (origin_x, origin_y)
+    void reset(int degree, double origin_x, double origin_y);
+
+    ///* Adds (weight 1) or removes (weight -1) a point
+    void accumulate(double x, double y, double weight);
+
+    ///* Fit in the frame of a car at (pos_x, pos_y) heading psi
+    void fit(double pos_x, double pos_y, double psi, Eigen::VectorXd & coeffs) const;
+
+    int degree() const { return m_degree; }
+
+    static constexpr int MAX_DEGREE = 3;
+
+private:
+    static constexpr int MAX_MOMENT = 2 * MAX_DEGREE;
+
+    ///* Bivariate polynomials in (u, v): p[a][b] is the coefficient of u^a v^b
+    typedef double Bivariate[MAX_MOMENT + 1][MAX_MOMENT + 1];
+
+    static void multiply_linear(const Bivariate & p, int order, double e, double cu, double cv, Bivariate & out);
+
+    ///* sum_{a,b} p[a][b] m_moments[a][b], over a + b <= max_order
+    double apply(const Bivariate & p, int max_order) const;
+
+    int m_degree;
+    double m_origin_x;
+    double m_origin_y;
+    Bivariate m_moments;
+};
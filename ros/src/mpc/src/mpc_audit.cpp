@@ -0,0 +1,250 @@
+// How much optimality the fast modes of the solver give up (early
+// termination, RTI, the Riccati solver, float precision, fast trig, the
+// explicit table, the cache, ...), from the flight logs of their runs (see
+// FlightRecorder), without ROS:
+//
+//   mpc_audit [--threads N] flight.log...
+//
+// Every tick with a problem is solved again from scratch by the reference
+// solver: Ipopt through CppAD (the "ipopt" configuration of mpc_benchmark)
+// in double, to its full tolerance, without a time or an iteration limit,
+// an adaptive tolerance or fast trig, on the model of the run (the vehicle
+// model and the integrator of the log's header) and the horizon, the
+// weights and the fit of the tick. The reference solves are independent,
+// so they're batches on all the cores (see BatchSolver), one per set of
+// Params among the ticks of a log.
+//
+// The ticks are grouped by the mode that made their commands: the
+// configuration of the log (labelled as by mpc_log_stats) and how the tick
+// got them (solved, cut short by the deadline, from the explicit table, the
+// cache, a speculative solve, the remote solver, a parallel variant or a
+// fallback). Every group gets the percentiles of the differences of its
+// first actuations from the reference's and, where the run's cost is that
+// of the tick's own problem (solved, deadline, remote), of its
+// suboptimality: the cost over the reference's, relative to the reference
+// (to at least MIN_COST). A negative one is a solution of the run that's
+// better than the reference's (another local minimum, or the run's solve
+// didn't quite satisfy the constraints).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "BatchSolver.h"
+#include "FlightRecorder.h"
+#include "MPC.h"
+#include "OfflineTools.h"
+
+
+// The cost the suboptimality is relative to, at least
+static const double MIN_COST = 1.0;
+
+// How a tick got its commands, first match in this order
+enum Kind {
+    KIND_FALLBACK,
+    KIND_EXPLICIT,
+    KIND_CACHE,
+    KIND_SPECULATION,
+    KIND_REMOTE,
+    KIND_DEADLINE,
+    KIND_VARIANT,
+    KIND_SOLVED,
+    NUM_KINDS
+};
+
+static const char * const KIND_NAMES[NUM_KINDS] = {
+    "fallback", "explicit", "cache", "speculation", "remote", "deadline", "variant", "solved"
+};
+
+
+static Kind kind_of(const FlightRecord & record) {
+    if ((record.events & TelemetryRecord::FALLBACK) or record.fallback != 0)
+        return KIND_FALLBACK;
+    if (record.events & TelemetryRecord::EXPLICIT_LAW)
+        return KIND_EXPLICIT;
+    if (record.events & (TelemetryRecord::CACHE_HIT | TelemetryRecord::SOLVE_SKIPPED))
+        return KIND_CACHE;
+    if (record.events & TelemetryRecord::SPECULATION_HIT)
+        return KIND_SPECULATION;
+    if (record.events & TelemetryRecord::REMOTE_USED)
+        return KIND_REMOTE;
+    if (record.events & TelemetryRecord::DEADLINE_HIT)
+        return KIND_DEADLINE;
+    if (record.variant != 0)
+        return KIND_VARIANT;
+    return KIND_SOLVED;
+}
+
+
+// Whether the run's cost is that of the tick's problem, as the reference's
+static bool same_problem_cost(Kind kind) {
+    return kind == KIND_SOLVED or kind == KIND_DEADLINE or kind == KIND_REMOTE;
+}
+
+
+// The ticks of a configuration and a kind
+struct Group {
+    std::vector<double> suboptimality;
+    std::vector<double> steer_errors;
+    std::vector<double> speed_errors;
+    size_t ticks = 0;
+    ///* Of the reference solve
+    size_t failures = 0;
+};
+
+
+// The solver of the reference, for the problem of `record` in `log`
+static Params reference_params(const FlightLog & log, const FlightRecord & record) {
+    Params params = log.params(default_params(), record);
+    find_configuration("ipopt")->apply(params);
+    params.precision = "double";
+    params.fast_trig = false;
+    params.adaptive_tolerance = false;
+    params.iterations_per_tick = 0;
+    params.sensitivity_updates = 0;
+    params.solve_time_limit = 0.0;
+    params.explicit_table = "";
+    params.backend = "";
+    return params;
+}
+
+
+// What tells the Params of the ticks apart (see `FlightLog::params`)
+static std::vector<double> params_key(const FlightRecord & record) {
+    std::vector<double> key(record.weights, record.weights + 6);
+    key.push_back(double(record.steps_ahead));
+    key.push_back(double(record.num_coeffs));
+    return key;
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--threads N] flight.log...\n", program);
+    std::fprintf(stderr, "  --threads N   threads of the reference solves (default: one per core)\n");
+}
+
+
+static void print_percentiles(const char * name, std::vector<double> & values) {
+    if (values.empty()) {
+        std::printf("  %-14s %8s\n", name, "-");
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    std::printf("  %-14s %8lu %11.3e %11.3e %11.3e %11.3e\n", name, values.size(),
+                percentile(values, 50), percentile(values, 90), percentile(values, 99), percentile(values, 100));
+}
+
+
+int main(int argc, char ** argv) {
+    int num_threads = 0;
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if (arg == "--threads" and a + 1 < argc) {
+            num_threads = std::atoi(argv[++a]);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // By configuration, then by kind
+    std::map<std::string, std::vector<Group> > groups;
+    std::vector<BatchProblem> problems;
+    std::vector<BatchSolution> solutions;
+    auto start = std::chrono::steady_clock::now();
+    size_t num_solved = 0;
+
+    for (const std::string & path : paths) {
+        FlightLog log;
+        if (!log.load(path))
+            return 1;
+        const std::vector<FlightRecord> & records = log.records();
+        std::string label = configuration_label(log.header());
+        std::vector<Group> & kinds = groups[label];
+        if (kinds.empty())
+            kinds.resize(NUM_KINDS);
+        std::printf("%s: %lu ticks, %s\n", path.c_str(), records.size(), label.c_str());
+        std::fflush(stdout);
+
+        // The ticks with a problem, by their Params
+        std::map<std::vector<double>, std::vector<size_t> > batches;
+        for (size_t i=0; i < records.size(); i++) {
+            const FlightRecord & record = records[i];
+            if ((record.events & TelemetryRecord::NO_OPTIMIZATION) or record.steps_ahead == 0
+                    or record.num_coeffs == 0 or record.num_vars < 2)
+                continue;
+            batches[params_key(record)].push_back(i);
+        }
+
+        for (const auto & batch : batches) {
+            const std::vector<size_t> & ticks = batch.second;
+            BatchSolver solver(reference_params(log, records[ticks.front()]), num_threads);
+            problems.resize(ticks.size());
+            for (size_t k=0; k < ticks.size(); k++) {
+                const FlightRecord & record = records[ticks[k]];
+                BatchProblem & problem = problems[k];
+                problem.state.resize(5);
+                problem.state << 0, 0, 0, record.cte, record.epsi;
+                problem.coeffs.resize(record.num_coeffs);
+                for (size_t c=0; c < record.num_coeffs; c++)
+                    problem.coeffs[c] = record.coeffs[c];
+                problem.ref_v = record.ref_v;
+            }
+            solver.Solve(problems, solutions);
+            num_solved += ticks.size();
+
+            for (size_t k=0; k < ticks.size(); k++) {
+                const FlightRecord & record = records[ticks[k]];
+                const BatchSolution & solution = solutions[k];
+                Kind kind = kind_of(record);
+                Group & group = kinds[kind];
+                group.ticks++;
+                if (!solution.stats.ok or solution.result.size() < 2) {
+                    group.failures++;
+                    continue;
+                }
+                group.steer_errors.push_back(std::abs(record.vars[0] - solution.result[0]));
+                group.speed_errors.push_back(std::abs(record.vars[1] - solution.result[1]));
+                if (same_problem_cost(kind) and std::isfinite(record.cost)) {
+                    double reference = solution.stats.cost;
+                    group.suboptimality.push_back((record.cost - reference)
+                                                  / std::max(std::abs(reference), MIN_COST));
+                }
+            }
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%lu reference solves in %.1f s\n", num_solved, elapsed);
+
+    for (auto & configuration : groups) {
+        for (size_t kind=0; kind < NUM_KINDS; kind++) {
+            Group & group = configuration.second[kind];
+            if (group.ticks == 0)
+                continue;
+            std::printf("\n%s, %s: %lu ticks", configuration.first.c_str(), KIND_NAMES[kind], group.ticks);
+            if (group.failures > 0)
+                std::printf(" (%lu reference solves failed)", group.failures);
+            std::printf("\n  %-14s %8s %11s %11s %11s %11s\n", "", "count", "p50", "p90", "p99", "max");
+            print_percentiles("suboptimality", group.suboptimality);
+            print_percentiles("steer [rad]", group.steer_errors);
+            print_percentiles("speed [m/s]", group.speed_errors);
+        }
+    }
+    return 0;
+}
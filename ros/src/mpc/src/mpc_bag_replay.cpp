@@ -0,0 +1,499 @@
+// Streams rosbags of a real run through the controller, as fast as the
+// solves allow, and reports how long the ticks took and how far their
+// commands are from those recorded:
+//
+//   mpc_bag_replay [--step pose|rate] [--rate HZ] [--config NAME] [--horizon N]
+//                  [--go] [--match-window S] [--python WORKER] run.bag...
+//
+// The messages of /centerline (or /centerline_numpy), /pf/pose/odom, /odom
+// and /signal/go are read in the order of the bag and turned into the inputs
+// of the controller as the node's callbacks do (see InputMessages.h). The
+// ticks are those of the node's ControlPipeline, on the clock of the bag:
+// one per pose (--step pose, as the node's "pose" scheduler), or at a fixed
+// rate (--step rate, by default at 100 Hz as the node's "rate" scheduler).
+// With --go, the car is taken to be allowed to drive from the start (e.g.
+// for bags without /signal/go).
+//
+// The commands of every tick are matched with the first ones recorded on
+// /commands/servo/position and /commands/motor/speed after it, within the
+// match window (those of ticks that aren't followed by any are left out).
+//
+// With --python, the controller of mpc_in_python.py (MPCController) is run
+// on the very same inputs, in a worker process (WORKER is
+// scripts/mpc_python_worker.py) that every tick of the C++ one sends the
+// path (when it's new), the speed and the pose: the two are compared by
+// the time of their ticks (the C++ one's whole tick, the Python one's
+// `control`), their failed solves, and the differences of their steering
+// angles (the Python one's other command is an acceleration, which has no
+// counterpart).
+//
+// The other Params are the defaults of run_mpc_cpp.sh, in the solver
+// configuration of --config (see OfflineTools.h, persistent_warm by
+// default); no master is needed.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ros/time.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <std_msgs/Float64.h>
+#include <std_msgs/UInt16.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ControlPipeline.h"
+#include "InputMessages.h"
+#include "OfflineTools.h"
+#include "StageStats.h"
+
+
+// A recorded command comes this long [s] after its tick at most, by default
+static const double DEFAULT_MATCH_WINDOW = 0.1;
+
+static const char * const DEFAULT_CONFIGURATION = "persistent_warm";
+
+
+struct Options {
+    bool step_per_pose = false;
+    double rate = 100.0; // [Hz]
+    const Configuration * configuration = nullptr;
+    size_t horizon = 0; // 0: that of the defaults
+    bool go = false;
+    double match_window = DEFAULT_MATCH_WINDOW; // [s]
+    std::string python_worker; // "": no Python controller
+};
+
+
+// The commands of a tick, until the recorded ones are matched with them
+struct PendingCommand {
+    double stamp; // [s]
+    double value;
+};
+
+
+// The differences of the commands of the ticks from those recorded
+struct CommandErrors {
+    std::deque<PendingCommand> pending;
+    std::vector<double> errors;
+    size_t num_unmatched = 0;
+
+    // A command recorded at `stamp`: matched with the oldest tick before it,
+    // the ticks too long before it left out
+    void recorded(double stamp, double value, double match_window) {
+        while (!pending.empty() and pending.front().stamp + match_window < stamp) {
+            pending.pop_front();
+            num_unmatched++;
+        }
+        if (!pending.empty() and pending.front().stamp <= stamp) {
+            errors.push_back(std::abs(pending.front().value - value));
+            pending.pop_front();
+        }
+    }
+
+    void print(const char * name, const char * unit) {
+        num_unmatched += pending.size();
+        pending.clear();
+        std::sort(errors.begin(), errors.end());
+        std::printf("%-6s %8lu %9lu %11.4g %11.4g %11.4g %11.4g  %s\n", name, errors.size(), num_unmatched,
+                    percentile(errors, 50), percentile(errors, 90), percentile(errors, 99),
+                    errors.empty() ? 0.0 : errors.back(), unit);
+    }
+};
+
+
+// The controller of mpc_in_python.py, in a worker process fed over pipes
+// (see scripts/mpc_python_worker.py)
+class PythonController {
+public:
+    ~PythonController() {
+        if (m_requests != nullptr)
+            std::fclose(m_requests);
+        if (m_replies != nullptr)
+            std::fclose(m_replies);
+        if (m_pid > 0)
+            waitpid(m_pid, nullptr, 0);
+    }
+
+    // Runs the worker script; false if it can't be
+    bool start(const std::string & worker) {
+        // A worker that's gone fails the reads rather than the replay
+        std::signal(SIGPIPE, SIG_IGN);
+        int requests[2], replies[2];
+        if (pipe(requests) != 0 or pipe(replies) != 0) {
+            std::perror("pipe");
+            return false;
+        }
+        m_pid = fork();
+        if (m_pid < 0) {
+            std::perror("fork");
+            return false;
+        }
+        if (m_pid == 0) {
+            dup2(requests[0], STDIN_FILENO);
+            dup2(replies[1], STDOUT_FILENO);
+            close(requests[0]);
+            close(requests[1]);
+            close(replies[0]);
+            close(replies[1]);
+            execlp("python", "python", worker.c_str(), static_cast<char *>(nullptr));
+            std::perror("python");
+            _exit(127);
+        }
+        close(requests[0]);
+        close(replies[1]);
+        m_requests = fdopen(requests[1], "w");
+        m_replies = fdopen(replies[0], "r");
+        return m_requests != nullptr and m_replies != nullptr;
+    }
+
+    void set_path(const Centerline & centerline) {
+        std::fputs("path", m_requests);
+        for (size_t i=0; i < centerline.pts_x.size(); i++)
+            std::fprintf(m_requests, " %.17g %.17g", centerline.pts_x[i], centerline.pts_y[i]);
+        std::fputc('\n', m_requests);
+    }
+
+    // The commands of a tick, and how long [s] it took; false once the
+    // worker is gone
+    bool control(double v, double x, double y, double psi, bool & success, double & steer, double & seconds) {
+        std::fprintf(m_requests, "control %.17g %.17g %.17g %.17g\n", v, x, y, psi);
+        std::fflush(m_requests);
+        int ok;
+        double throttle;
+        if (std::fscanf(m_replies, "%d %lf %lf %lf", &ok, &steer, &throttle, &seconds) != 4)
+            return false;
+        success = (ok != 0);
+        return true;
+    }
+
+private:
+    pid_t m_pid = -1;
+    FILE * m_requests = nullptr;
+    FILE * m_replies = nullptr;
+};
+
+
+// The two controllers' ticks on the same inputs
+struct ControllerComparison {
+    std::vector<double> cpp_times; // [s]
+    std::vector<double> python_times; // [s]
+    size_t cpp_failures = 0;
+    size_t python_failures = 0;
+    // Of the ticks both solved
+    std::vector<double> steer_deltas; // [rad]
+
+    void print() {
+        std::sort(cpp_times.begin(), cpp_times.end());
+        std::sort(python_times.begin(), python_times.end());
+        std::sort(steer_deltas.begin(), steer_deltas.end());
+        std::printf("%-10s %8s %8s %9s %9s %9s %9s\n", "controller", "ticks", "failed", "p50 [ms]", "p90 [ms]",
+                    "p99 [ms]", "max [ms]");
+        print_times("C++", cpp_times, cpp_failures);
+        print_times("Python", python_times, python_failures);
+        std::printf("steer delta [rad] over %lu ticks: p50 %.4g, p90 %.4g, p99 %.4g, max %.4g\n",
+                    steer_deltas.size(), percentile(steer_deltas, 50), percentile(steer_deltas, 90),
+                    percentile(steer_deltas, 99), steer_deltas.empty() ? 0.0 : steer_deltas.back());
+    }
+
+    static void print_times(const char * name, const std::vector<double> & times, size_t failures) {
+        std::printf("%-10s %8lu %8lu %9.3f %9.3f %9.3f %9.3f\n", name, times.size(), failures,
+                    1e3 * percentile(times, 50), 1e3 * percentile(times, 90), 1e3 * percentile(times, 99),
+                    times.empty() ? 0.0 : 1e3 * times.back());
+    }
+};
+
+
+class BagReplay {
+public:
+    BagReplay(const Params & params, const Options & options)
+            : m_params(params), m_options(options), m_pipeline(params), m_centerline_skipped(0) {
+        m_inputs.go_flag = options.go;
+        m_period = (params.solve_deadline > 0.0) ? params.solve_deadline : 1.0 / options.rate;
+        if (!options.python_worker.empty()) {
+            m_python.reset(new PythonController());
+            if (!m_python->start(options.python_worker))
+                m_python.reset();
+        }
+    }
+
+    // Streams the bag at `path` through the pipeline; false if it can't be
+    // read
+    bool run(const std::string & path);
+
+    void print();
+
+private:
+    void set_centerline(const std::shared_ptr<Centerline> & centerline);
+    void tick(double now);
+    // The Python controller's tick, on the inputs of the C++ one's
+    void tick_python(const TelemetryRecord & record, double tick_time);
+
+    Params m_params;
+    Options m_options;
+    ControlPipeline m_pipeline;
+    InputSnapshot m_inputs;
+    uint64_t m_centerline_skipped;
+    double m_period; // [s]
+
+    StageStats m_stats;
+    std::vector<double> m_tick_times; // [s]
+    CommandErrors m_steer_errors;
+    CommandErrors m_rpm_errors;
+
+    // With --python
+    std::unique_ptr<PythonController> m_python;
+    const Centerline * m_python_centerline = nullptr;
+    ControllerComparison m_comparison;
+};
+
+
+void BagReplay::set_centerline(const std::shared_ptr<Centerline> & centerline) {
+    // The centerline is re-published all the time, as in the node
+    const Centerline * current = m_inputs.centerline.get();
+    if (current != nullptr and current->hash == centerline->hash
+            and current->pts_x.size() == centerline->pts_x.size()) {
+        m_centerline_skipped++;
+        return;
+    }
+    ControlPipeline::prepare_centerline(*centerline, m_params);
+    m_inputs.centerline = centerline;
+}
+
+
+void BagReplay::tick(double now) {
+    TelemetryRecord record;
+    record.stamp = now;
+    auto tick_start = std::chrono::steady_clock::now();
+    record.stage_time[TelemetryRecord::STAGE_SNAPSHOT] = 0.0f;
+    if (!m_pipeline.step(m_inputs, now, tick_start, record))
+        return;
+    double tick_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - tick_start).count();
+    record.stage_time[TelemetryRecord::STAGE_TICK] = float(tick_time);
+    m_stats.record(record, m_period);
+    m_tick_times.push_back(tick_time);
+    m_steer_errors.pending.push_back({now, m_pipeline.steer_cmd()});
+    m_rpm_errors.pending.push_back({now, m_pipeline.rpm()});
+    if (m_python)
+        tick_python(record, tick_time);
+}
+
+
+void BagReplay::tick_python(const TelemetryRecord & record, double tick_time) {
+    if (!m_inputs.centerline or !m_inputs.speed_OK or !m_inputs.pos_OK or !m_inputs.psi_OK)
+        return;
+    if (m_inputs.centerline.get() != m_python_centerline) {
+        m_python->set_path(*m_inputs.centerline);
+        m_python_centerline = m_inputs.centerline.get();
+    }
+    bool success;
+    double steer, seconds;
+    if (!m_python->control(m_inputs.speed, m_inputs.pos_x, m_inputs.pos_y, m_inputs.psi, success, steer, seconds)) {
+        std::fprintf(stderr, "The Python controller is gone, comparing no more\n");
+        m_python.reset();
+        return;
+    }
+
+    bool cpp_success = !(record.events & (TelemetryRecord::SOLVE_FAILED | TelemetryRecord::NO_OPTIMIZATION));
+    m_comparison.cpp_times.push_back(tick_time);
+    m_comparison.python_times.push_back(seconds);
+    m_comparison.cpp_failures += !cpp_success;
+    m_comparison.python_failures += !success;
+    if (cpp_success and success)
+        m_comparison.steer_deltas.push_back(
+                std::abs(ControlPipeline::steer_from_dzik(m_pipeline.steer_cmd()) - steer));
+}
+
+
+bool BagReplay::run(const std::string & path) {
+    rosbag::Bag bag;
+    try {
+        bag.open(path, rosbag::bagmode::Read);
+    } catch (const rosbag::BagException & e) {
+        std::fprintf(stderr, "Could not read %s: %s\n", path.c_str(), e.what());
+        return false;
+    }
+    std::vector<std::string> topics = {"/centerline", "/centerline_numpy", "/pf/pose/odom", "/odom", "/signal/go",
+                                       "/commands/servo/position", "/commands/motor/speed"};
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+    double next_tick = -1.0;
+    for (const rosbag::MessageInstance & message : view) {
+        double stamp = message.getTime().toSec();
+        const std::string & topic = message.getTopic();
+
+        // The ticks at the fixed rate that are due before the message
+        if (!m_options.step_per_pose) {
+            if (next_tick < 0.0)
+                next_tick = stamp;
+            while (next_tick <= stamp) {
+                tick(next_tick);
+                next_tick += 1.0 / m_options.rate;
+            }
+        }
+
+        if (topic == "/centerline") {
+            visualization_msgs::Marker::ConstPtr marker = message.instantiate<visualization_msgs::Marker>();
+            if (marker)
+                set_centerline(make_centerline(*marker, centerline_hash(*marker)));
+        } else if (topic == "/centerline_numpy") {
+            rospy_tutorials::Floats::ConstPtr rows = message.instantiate<rospy_tutorials::Floats>();
+            std::shared_ptr<Centerline> centerline = rows ? make_centerline(*rows, centerline_hash(*rows)) : nullptr;
+            if (centerline)
+                set_centerline(centerline);
+        } else if (topic == "/pf/pose/odom") {
+            nav_msgs::Odometry::ConstPtr pose = message.instantiate<nav_msgs::Odometry>();
+            if (pose) {
+                read_pose(*pose, m_inputs);
+                if (m_options.step_per_pose)
+                    tick(stamp);
+            }
+        } else if (topic == "/odom") {
+            nav_msgs::Odometry::ConstPtr odom = message.instantiate<nav_msgs::Odometry>();
+            if (odom)
+                read_odom(*odom, m_inputs);
+        } else if (topic == "/signal/go") {
+            std_msgs::UInt16::ConstPtr signal = message.instantiate<std_msgs::UInt16>();
+            if (signal and !m_options.go)
+                read_signal_go(signal->data, m_inputs);
+        } else {
+            std_msgs::Float64::ConstPtr command = message.instantiate<std_msgs::Float64>();
+            if (command and topic == "/commands/servo/position")
+                m_steer_errors.recorded(stamp, command->data, m_options.match_window);
+            else if (command)
+                m_rpm_errors.recorded(stamp, command->data, m_options.match_window);
+        }
+    }
+    bag.close();
+    return true;
+}
+
+
+void BagReplay::print() {
+    std::sort(m_tick_times.begin(), m_tick_times.end());
+    std::printf("%lu ticks solved (%lu overruns of %.1f [ms], %lu deadline hits), %lu re-published centerlines skipped\n",
+                m_tick_times.size(), m_stats.total_overruns, 1e3 * m_period, m_stats.total_deadline_hits,
+                m_centerline_skipped);
+
+    std::printf("%-12s %9s %9s %9s %9s\n", "stage", "p50 [ms]", "p90 [ms]", "p99 [ms]", "max [ms]");
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++) {
+        const LatencyHistogram & histogram = m_stats.stages[s];
+        if (histogram.count() == 0)
+            continue;
+        std::printf("%-12s %9.3f %9.3f %9.3f %9.3f\n", StageStats::STAGE_NAMES[s],
+                    1e3 * histogram.percentile(50), 1e3 * histogram.percentile(90),
+                    1e3 * histogram.percentile(99), 1e3 * histogram.max());
+    }
+
+    std::printf("%-6s %8s %9s %11s %11s %11s %11s\n", "command", "matched", "unmatched", "p50 error", "p90 error",
+                "p99 error", "max error");
+    m_steer_errors.print("steer", "[servo position]");
+    m_rpm_errors.print("rpm", "[RPM]");
+    if (!m_options.python_worker.empty())
+        m_comparison.print();
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--step pose|rate] [--rate HZ] [--config NAME] [--horizon N] [--go] "
+                 "[--match-window S] [--python WORKER] run.bag...\n", program);
+    std::fprintf(stderr, "  --step          a tick per pose, or at a fixed rate (default: rate)\n");
+    std::fprintf(stderr, "  --rate          the rate of the ticks [Hz] (default: 100)\n");
+    std::fprintf(stderr, "  --config        the solver configuration (default: %s, or any of", DEFAULT_CONFIGURATION);
+    for (const Configuration & configuration : CONFIGURATIONS)
+        std::fprintf(stderr, " %s", configuration.name);
+    std::fprintf(stderr, ")\n");
+    std::fprintf(stderr, "  --horizon       the steps_ahead (default: 20)\n");
+    std::fprintf(stderr, "  --go            drive from the start, whatever /signal/go says\n");
+    std::fprintf(stderr, "  --match-window  how long [s] after a tick its recorded commands come at most (default: %g)\n",
+                 DEFAULT_MATCH_WINDOW);
+    std::fprintf(stderr, "  --python        compare with the Python controller, run by this worker "
+                 "(scripts/mpc_python_worker.py)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    Options options;
+    options.configuration = find_configuration(DEFAULT_CONFIGURATION);
+    std::vector<std::string> bag_paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if (arg == "--go") {
+            options.go = true;
+        } else if ((arg == "--step" or arg == "--rate" or arg == "--config" or arg == "--horizon"
+                    or arg == "--match-window" or arg == "--python") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--step") {
+                if (value != "pose" and value != "rate") {
+                    std::fprintf(stderr, "The step should be pose or rate\n");
+                    return 1;
+                }
+                options.step_per_pose = (value == "pose");
+            } else if (arg == "--rate") {
+                options.rate = std::atof(value.c_str());
+                if (options.rate <= 0.0) {
+                    std::fprintf(stderr, "The rate should be positive\n");
+                    return 1;
+                }
+            } else if (arg == "--config") {
+                options.configuration = find_configuration(value);
+                if (options.configuration == nullptr) {
+                    std::fprintf(stderr, "Unknown configuration \"%s\"\n", value.c_str());
+                    usage(argv[0]);
+                    return 1;
+                }
+            } else if (arg == "--horizon") {
+                options.horizon = std::strtoul(value.c_str(), nullptr, 10);
+                if (options.horizon < 3) {
+                    std::fprintf(stderr, "The horizon should be at least 3 steps\n");
+                    return 1;
+                }
+            } else if (arg == "--python") {
+                options.python_worker = value;
+            } else {
+                options.match_window = std::atof(value.c_str());
+            }
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            bag_paths.push_back(arg);
+        }
+    }
+    if (bag_paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // ros::Time without a master
+    ros::Time::init();
+
+    Params params = default_params();
+    options.configuration->apply(params);
+    if (options.horizon > 0)
+        params.steps_ahead = options.horizon;
+    params.scheduler = options.step_per_pose ? "pose" : "rate";
+    params.loop_rate = options.rate;
+
+    for (const std::string & bag_path : bag_paths) {
+        if (options.step_per_pose)
+            std::printf("%s, %s, every pose:\n", bag_path.c_str(), options.configuration->name);
+        else
+            std::printf("%s, %s, at %g [Hz]:\n", bag_path.c_str(), options.configuration->name, options.rate);
+        BagReplay replay(params, options);
+        if (!replay.run(bag_path))
+            return 1;
+        replay.print();
+        std::fflush(stdout);
+    }
+    return 0;
+}
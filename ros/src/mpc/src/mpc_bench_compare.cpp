@@ -0,0 +1,188 @@
+// Compares the results of two benchmark replays of the same flight log (see
+// mpc_replay --results), e.g. of the solver before and after a change:
+//
+//   mpc_bench_compare [--alpha A] [--threshold T] [--tolerance T] baseline.csv candidate.csv
+//
+// The ticks of both are paired, and the ratios of their solve times tested
+// by Wilcoxon's signed-rank test (in its normal approximation, which the
+// hundreds of ticks of a log are plenty for): the candidate is a regression
+// when it's slower with a significance of `alpha` and by more than
+// `threshold` (the median of the ratios), an improvement the other way
+// round. The solutions and the iterations are compared too: a change that
+// moves the solutions or the iterations isn't just a faster or a slower
+// solver.
+//
+// Exits with 1 on a regression, 0 otherwise.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BenchmarkResults.h"
+#include "OfflineTools.h"
+
+
+static const double DEFAULT_ALPHA = 0.01;
+// Of the median of the ratios of the solve times
+static const double DEFAULT_THRESHOLD = 0.02;
+// Of the differences of the first actuations
+static const double DEFAULT_TOLERANCE = 1e-6;
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--alpha A] [--threshold T] [--tolerance T] baseline.csv candidate.csv\n",
+                 program);
+    std::fprintf(stderr, "  --alpha       significance of the test of the solve times (default: %g)\n",
+                 DEFAULT_ALPHA);
+    std::fprintf(stderr, "  --threshold   smallest relative change of the median solve time reported "
+                 "(default: %g)\n", DEFAULT_THRESHOLD);
+    std::fprintf(stderr, "  --tolerance   largest difference of the first actuations (default: %g)\n",
+                 DEFAULT_TOLERANCE);
+}
+
+
+// The two-sided p-value of Wilcoxon's signed-rank test of the differences
+// being centered on 0 (the zeros dropped, the ties given their mean rank),
+// from the normal approximation of its statistic
+static double signed_rank_p_value(const std::vector<double> & differences) {
+    std::vector<double> nonzero;
+    for (double d : differences)
+        if (d != 0.0)
+            nonzero.push_back(d);
+    size_t n = nonzero.size();
+    if (n == 0)
+        return 1.0;
+    std::sort(nonzero.begin(), nonzero.end(), [](double a, double b) { return std::abs(a) < std::abs(b); });
+
+    double positive = 0.0;
+    double tie_correction = 0.0;
+    for (size_t i=0; i < n; ) {
+        size_t j = i;
+        while (j < n and std::abs(nonzero[j]) == std::abs(nonzero[i]))
+            j++;
+        double rank = 0.5 * (i + 1 + j);
+        for (size_t k=i; k < j; k++)
+            if (nonzero[k] > 0.0)
+                positive += rank;
+        double ties = double(j - i);
+        tie_correction += ties * ties * ties - ties;
+        i = j;
+    }
+
+    double mean = n * (n + 1) / 4.0;
+    double variance = n * (n + 1) * (2 * n + 1) / 24.0 - tie_correction / 48.0;
+    if (variance <= 0.0)
+        return 1.0;
+    double z = (positive - mean) / std::sqrt(variance);
+    return std::erfc(std::abs(z) / std::sqrt(2.0));
+}
+
+
+static void print_times(const char * name, std::vector<double> times) {
+    std::sort(times.begin(), times.end());
+    std::printf("%-10s %6lu %9.3f %9.3f %9.3f %9.3f\n", name, times.size(), 1e3 * percentile(times, 50),
+                1e3 * percentile(times, 90), 1e3 * percentile(times, 99), 1e3 * percentile(times, 100));
+}
+
+
+int main(int argc, char ** argv) {
+    double alpha = DEFAULT_ALPHA;
+    double threshold = DEFAULT_THRESHOLD;
+    double tolerance = DEFAULT_TOLERANCE;
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--alpha" or arg == "--threshold" or arg == "--tolerance") and a + 1 < argc) {
+            double value = std::atof(argv[++a]);
+            if (arg == "--alpha")
+                alpha = value;
+            else if (arg == "--threshold")
+                threshold = value;
+            else
+                tolerance = value;
+        } else if (arg.compare(0, 2, "--") == 0 or paths.size() == 2) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    BenchmarkResults baseline, candidate;
+    if (!baseline.load(paths[0]) or !candidate.load(paths[1]))
+        return 1;
+    if (baseline.log != candidate.log)
+        std::printf("warning: the results are of different logs (%s, %s)\n", baseline.log.c_str(),
+                    candidate.log.c_str());
+
+    // The ticks of both, in the order of the candidate's
+    std::map<uint64_t, const BenchmarkTick *> baseline_ticks;
+    for (const BenchmarkTick & tick : baseline.ticks)
+        baseline_ticks[tick.tick] = &tick;
+
+    std::vector<double> baseline_times, candidate_times, log_ratios;
+    size_t num_moved = 0;
+    double max_steer_error = 0.0, max_speed_error = 0.0;
+    long baseline_iterations = 0, candidate_iterations = 0;
+    size_t num_iterations_changed = 0;
+    for (const BenchmarkTick & tick : candidate.ticks) {
+        auto found = baseline_ticks.find(tick.tick);
+        if (found == baseline_ticks.end() or found->second->solve_time <= 0.0 or tick.solve_time <= 0.0)
+            continue;
+        const BenchmarkTick & base = *found->second;
+        baseline_times.push_back(base.solve_time);
+        candidate_times.push_back(tick.solve_time);
+        log_ratios.push_back(std::log(tick.solve_time / base.solve_time));
+
+        double steer_error = std::abs(tick.steer - base.steer);
+        double speed_error = std::abs(tick.speed - base.speed);
+        max_steer_error = std::max(max_steer_error, steer_error);
+        max_speed_error = std::max(max_speed_error, speed_error);
+        if (steer_error > tolerance or speed_error > tolerance)
+            num_moved++;
+        if (base.iterations >= 0 and tick.iterations >= 0) {
+            baseline_iterations += base.iterations;
+            candidate_iterations += tick.iterations;
+            num_iterations_changed += (base.iterations != tick.iterations) ? 1 : 0;
+        }
+    }
+    if (log_ratios.empty()) {
+        std::printf("No tick of %s in %s\n", paths[1].c_str(), paths[0].c_str());
+        return 1;
+    }
+
+    std::printf("%lu ticks in both (%lu and %lu repeats)\n", log_ratios.size(), baseline.repeats,
+                candidate.repeats);
+    std::printf("%-10s %6s %9s %9s %9s %9s\n", "solves", "count", "p50 [ms]", "p90 [ms]", "p99 [ms]", "max [ms]");
+    print_times("baseline", baseline_times);
+    print_times("candidate", candidate_times);
+
+    std::vector<double> sorted(log_ratios);
+    std::sort(sorted.begin(), sorted.end());
+    double ratio = std::exp(percentile(sorted, 50));
+    double p_value = signed_rank_p_value(log_ratios);
+    std::printf("candidate / baseline: %.3f (median of the ticks), p = %.2g\n", ratio, p_value);
+    std::printf("iterations: %ld and %ld, %lu ticks changed; solutions: largest differences %.2e (steer), "
+                "%.2e (speed), %lu ticks over the tolerance\n", baseline_iterations, candidate_iterations,
+                num_iterations_changed, max_steer_error, max_speed_error, num_moved);
+
+    bool significant = (p_value < alpha);
+    if (significant and ratio > 1.0 + threshold) {
+        std::printf("REGRESSION: %.1f%% slower\n", 100.0 * (ratio - 1.0));
+        return 1;
+    }
+    if (significant and ratio < 1.0 - threshold)
+        std::printf("improvement: %.1f%% faster\n", 100.0 * (1.0 - ratio));
+    else
+        std::printf("no significant change\n");
+    return 0;
+}
@@ -0,0 +1,588 @@
+// Replays synthetic drives along the recorded paths through polyfit and
+// MPC::Solve, without ROS, and reports how long the solves take:
+//
+//   mpc_benchmark [--ticks N] [--warmup N] [--configs NAME,...] [--horizons N,...] [--blocks N,...]
+//                 [--degrees N,...] [--windows N,...] [--dt-steps DT,...] [--precision P [--tolerance T]]
+//                 [--backends NAME,...] [--perf] [--results FILE] waypoints.csv...
+//
+// For every path, horizon and solver configuration (e.g. the exact against
+// the limited-memory Hessian: persistent_warm and persistent_lbfgs, or the
+// derivatives of the steps by CppAD against Eigen's AutoDiff: persistent and
+// autodiff, or the warm start of the variables alone against that of the
+// multipliers too, by their iterations: persistent_warm and persistent_dual),
+// the car drives one waypoint per tick along the path, weaving around it
+// (so that the cross track and the heading errors aren't 0), and every tick
+// does what the node does: fit the polynomial to the window of waypoints in
+// the car's frame and solve. The drive is the same on every run.
+//
+// With a `--precision` other than double (see Params::precision), every tick
+// is solved in double too (not timed), and the largest differences of the
+// first actuations are reported; the benchmark fails if they're over the
+// tolerance.
+//
+// With `--backends`, every configuration is run with each of the solver
+// backends (see Params::backend), side by side.
+//
+// With `--perf`, the hardware counters of the benchmark's thread (see
+// PerfCounters) count the measured ticks, and their means per tick are
+// reported too: the cycles, the instructions per cycle, the cache misses
+// and the branch misses (not those of the threads of a pool).
+//
+// With `--degrees` and `--windows`, the poly_degree and the num_steps_poly
+// are swept too, over the grid of them and of the horizons: every point
+// reports the size of the tape and the memory as well (see MemoryStats),
+// and `--results` saves the rows as CSV. When a dimension has more than
+// one value, the exponents of how the median solve time, the iterations
+// and the bytes of the tape scale with it (the horizon, the coefficients
+// of the polynomial and the window) are fit by least squares on their
+// logarithms, for every configuration and backend.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Dense"
+#include "MPC.h"
+#include "MemoryStats.h"
+#include "OfflineTools.h"
+#include "PerfCounters.h"
+#include "SolverBackend.h"
+#include "WaypointBuffer.h"
+#include "WaypointLoader.h"
+
+
+// Of the differences of the first actuations from double (with `--precision`)
+static const double DEFAULT_TOLERANCE = 1e-3;
+
+
+struct Result {
+    std::vector<double> latencies; // [s]
+    size_t num_ok = 0;
+    size_t num_iterations = 0;
+    size_t num_iterations_known = 0;
+    // Largest differences from the solves in double (with a precision
+    // other than double): of the steering [rad] and of the speed [m/s]
+    double max_steer_error = 0.0;
+    double max_speed_error = 0.0;
+    // The hardware counts of the measured ticks (with `--perf`)
+    PerfCounts counts;
+    // The tape and the problem of the controller after the ticks, CppAD's
+    // memory and the resident set then, and its growth over the run [bytes]
+    MemoryStats memory;
+    int64_t rss_growth = 0;
+};
+
+
+// A point of the sweep, as saved by `--results`
+struct SweepRow {
+    std::string path;
+    std::string label;
+    size_t horizon;
+    int degree;
+    int window;
+    size_t ticks;
+    double ok;
+    double p50, p90, p99, max; // [s]
+    double iterations; // < 0 if not known
+    MemoryStats memory;
+    int64_t rss_growth;
+};
+
+
+// What a tick does before the solve: the window to the car's frame, the
+// fit, and the state from it
+template <class Scalar>
+static void fit_window(const WaypointBufferT<Scalar> & window, double pos_x, double pos_y, double psi,
+                       int poly_degree, WaypointBufferT<Scalar> & car_pts, Eigen::VectorXd & coeffs,
+                       Eigen::VectorXd & state) {
+    to_car_frame(window, pos_x, pos_y, sin(psi), cos(psi), car_pts);
+    polyfit(car_pts.x.data(), car_pts.y.data(), window.size(), poly_degree, coeffs);
+    double cte, slope;
+    polyeval_with_diff(coeffs, 0.0, cte, slope);
+    state << 0, 0, 0, cte, -atan(slope);
+}
+
+
+template <class Scalar>
+static Result run(const Waypoints & waypoints, const Params & params, size_t num_ticks, size_t num_warmup,
+                  bool perf) {
+    Result result;
+    MemoryStats before;
+    read_process_memory(before);
+    MPC controller(params);
+
+    size_t window_size = params.num_steps_poly;
+
+    WaypointBufferT<Scalar> window, car_pts;
+    window.resize(window_size);
+    Eigen::VectorXd coeffs;
+    Eigen::VectorXd state(5);
+    std::vector<double> vars;
+
+    // The same ticks in double, as the reference
+    bool compare = (params.precision != "double");
+    Params reference_params = params;
+    reference_params.precision = "double";
+    std::unique_ptr<MPC> reference(compare ? new MPC(reference_params) : nullptr);
+    WaypointBuffer reference_window, reference_car_pts;
+    reference_window.resize(window_size);
+    Eigen::VectorXd reference_coeffs;
+    Eigen::VectorXd reference_state(5);
+    std::vector<double> reference_vars;
+
+    for (size_t tick=0; tick < num_warmup + num_ticks; tick++) {
+        double pos_x, pos_y, psi;
+        replay_pose(waypoints, tick, window, pos_x, pos_y, psi);
+
+        PerfCounts counts_start = perf ? PerfCounters::thread().read() : PerfCounts();
+        auto start = std::chrono::steady_clock::now();
+
+        fit_window(window, pos_x, pos_y, psi, params.poly_degree, car_pts, coeffs, state);
+        controller.Solve(state, coeffs, params.ref_v, vars);
+
+        double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        PerfCounts counts = perf ? PerfCounters::thread().read() - counts_start : PerfCounts();
+
+        if (compare) {
+            replay_pose(waypoints, tick, reference_window, pos_x, pos_y, psi);
+            fit_window(reference_window, pos_x, pos_y, psi, params.poly_degree,
+                       reference_car_pts, reference_coeffs, reference_state);
+            reference->Solve(reference_state, reference_coeffs, params.ref_v, reference_vars);
+        }
+
+        if (tick < num_warmup)
+            continue;
+        result.latencies.push_back(latency);
+        result.counts += counts;
+        if (controller.ok())
+            result.num_ok++;
+        if (controller.iterations() >= 0) {
+            result.num_iterations += controller.iterations();
+            result.num_iterations_known++;
+        }
+        if (compare) {
+            result.max_steer_error = std::max(result.max_steer_error, std::abs(vars[0] - reference_vars[0]));
+            result.max_speed_error = std::max(result.max_speed_error, std::abs(vars[1] - reference_vars[1]));
+        }
+    }
+
+    controller.memory_stats(result.memory);
+    read_cppad_memory(result.memory);
+    if (read_process_memory(result.memory))
+        result.rss_growth = int64_t(result.memory.rss) - int64_t(before.rss);
+    return result;
+}
+
+
+// Saves the rows of the sweep as CSV, after a `#` line with the ticks and
+// the warmup of every point
+static bool save_sweep(const std::string & path, const std::vector<SweepRow> & rows, size_t num_warmup) {
+    FILE * file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        std::fprintf(stderr, "Can't write %s\n", path.c_str());
+        return false;
+    }
+    std::fprintf(file, "# mpc_benchmark sweep, %lu ticks of warmup\n", num_warmup);
+    std::fprintf(file, "path,configuration,steps_ahead,poly_degree,num_steps_poly,ticks,ok,p50,p90,p99,max,"
+                 "iterations,tape_ops,tape_vars,tape_bytes,nlp_vars,nlp_constraints,jacobian_nonzeros,"
+                 "hessian_nonzeros,cppad_inuse,cppad_available,rss,peak_rss,rss_growth\n");
+    for (const SweepRow & row : rows) {
+        const MemoryStats & m = row.memory;
+        std::fprintf(file, "%s,%s,%lu,%d,%d,%lu,%.4f,%.9f,%.9f,%.9f,%.9f,%.2f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,"
+                     "%lu,%lu,%ld\n",
+                     row.path.c_str(), row.label.c_str(), row.horizon, row.degree, row.window, row.ticks, row.ok,
+                     row.p50, row.p90, row.p99, row.max, row.iterations, m.tape_ops, m.tape_vars, m.tape_bytes,
+                     m.nlp_vars, m.nlp_constraints, m.jacobian_nonzeros, m.hessian_nonzeros, m.cppad_inuse,
+                     m.cppad_available, m.rss, m.peak_rss, row.rss_growth);
+    }
+    bool ok = !std::ferror(file);
+    ok = (std::fclose(file) == 0) and ok;
+    if (!ok)
+        std::fprintf(stderr, "Can't write %s\n", path.c_str());
+    return ok;
+}
+
+
+// The exponents of `value` ~ N^a (deg + 1)^b window^c, by least squares on
+// the logarithms of the rows where it's positive, of the dimensions that
+// vary (the others are NAN). False if too few rows
+static bool fit_exponents(const std::vector<const SweepRow *> & rows, double (*value)(const SweepRow &),
+                          double exponents[3]) {
+    double (*dimensions[3])(const SweepRow &) = {
+        [](const SweepRow & row) { return double(row.horizon); },
+        [](const SweepRow & row) { return double(row.degree + 1); },
+        [](const SweepRow & row) { return double(row.window); },
+    };
+    std::vector<const SweepRow *> used;
+    for (const SweepRow * row : rows)
+        if (value(*row) > 0.0)
+            used.push_back(row);
+    std::vector<int> varying;
+    for (int d=0; d < 3; d++) {
+        exponents[d] = NAN;
+        for (const SweepRow * row : used)
+            if (dimensions[d](*row) != dimensions[d](*used[0])) {
+                varying.push_back(d);
+                break;
+            }
+    }
+    if (varying.empty() or used.size() <= varying.size())
+        return false;
+
+    // log value = log c + sum of the exponents times the log dimensions
+    Eigen::MatrixXd a(used.size(), varying.size() + 1);
+    Eigen::VectorXd b(used.size());
+    for (size_t r=0; r < used.size(); r++) {
+        a(r, 0) = 1.0;
+        for (size_t v=0; v < varying.size(); v++)
+            a(r, v + 1) = std::log(dimensions[varying[v]](*used[r]));
+        b(r) = std::log(value(*used[r]));
+    }
+    Eigen::VectorXd x = a.colPivHouseholderQr().solve(b);
+    for (size_t v=0; v < varying.size(); v++)
+        exponents[varying[v]] = x(v + 1);
+    return true;
+}
+
+
+// Prints the exponents of the median solve time, the iterations and the
+// bytes of the tape, for every configuration (over all the paths)
+static void print_exponents(const std::vector<SweepRow> & rows) {
+    struct Quantity {
+        const char * name;
+        double (*value)(const SweepRow &);
+    };
+    const Quantity quantities[] = {
+        {"p50", [](const SweepRow & row) { return row.p50; }},
+        {"iterations", [](const SweepRow & row) { return row.iterations; }},
+        {"tape bytes", [](const SweepRow & row) { return double(row.memory.tape_bytes); }},
+    };
+
+    std::vector<std::string> labels;
+    for (const SweepRow & row : rows)
+        if (std::find(labels.begin(), labels.end(), row.label) == labels.end())
+            labels.push_back(row.label);
+
+    bool header = false;
+    for (const std::string & label : labels) {
+        std::vector<const SweepRow *> of_label;
+        for (const SweepRow & row : rows)
+            if (row.label == label)
+                of_label.push_back(&row);
+        for (const Quantity & quantity : quantities) {
+            double exponents[3];
+            if (!fit_exponents(of_label, quantity.value, exponents))
+                continue;
+            if (!header) {
+                std::printf("\nScaling exponents (quantity ~ N^a (degree + 1)^b window^c):\n");
+                std::printf("%-24s %-12s %7s %7s %7s\n", "configuration", "quantity", "a", "b", "c");
+                header = true;
+            }
+            std::printf("%-24s %-12s", label.c_str(), quantity.name);
+            for (double exponent : exponents) {
+                if (std::isnan(exponent))
+                    std::printf(" %7s", "-");
+                else
+                    std::printf(" %7.2f", exponent);
+            }
+            std::printf("\n");
+        }
+    }
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--ticks N] [--warmup N] [--configs NAME,...] [--horizons N,...] [--blocks N,...] "
+                 "[--degrees N,...] [--windows N,...] [--dt-steps DT,...] [--precision P [--tolerance T]] "
+                 "[--backends NAME,...] [--perf] [--results FILE] waypoints.csv...\n", program);
+    std::fprintf(stderr, "  --ticks N     ticks measured per path and configuration (default: a lap)\n");
+    std::fprintf(stderr, "  --warmup N    ticks before those, not measured (default: 5)\n");
+    std::fprintf(stderr, "  --configs     the solver configurations to run (default: all of");
+    for (const Configuration & configuration : CONFIGURATIONS)
+        std::fprintf(stderr, " %s", configuration.name);
+    std::fprintf(stderr, ")\n");
+    std::fprintf(stderr, "  --horizons    the steps_ahead to run (default: 20)\n");
+    std::fprintf(stderr, "  --blocks      the input_blocks of move blocking (default: none)\n");
+    std::fprintf(stderr, "  --degrees     the poly_degree to sweep (default: 2)\n");
+    std::fprintf(stderr, "  --windows     the num_steps_poly to sweep (default: 50)\n");
+    std::fprintf(stderr, "  --dt-steps    the dt_steps of the time grid [s] (default: a uniform one)\n");
+    std::fprintf(stderr, "  --precision   double, mixed or float (default: double); other than double, the\n"
+                 "                solutions are checked against those in double\n");
+    std::fprintf(stderr, "  --tolerance   largest difference of the first actuations from double (default: %g)\n",
+                 DEFAULT_TOLERANCE);
+    std::fprintf(stderr, "  --backends    the solver backends to run every configuration with (default: its own;\n"
+                 "                of ipopt");
+    for (const std::string & name : SolverBackends::names())
+        std::fprintf(stderr, " %s", name.c_str());
+    std::fprintf(stderr, ")\n");
+    std::fprintf(stderr, "  --perf        the hardware counters of the ticks too (cycles, IPC, cache and branch\n"
+                 "                misses per tick)\n");
+    std::fprintf(stderr, "  --results     save the rows, with the tapes and the memory, as CSV to FILE\n");
+}
+
+
+int main(int argc, char ** argv) {
+    size_t num_ticks = 0;
+    size_t num_warmup = 5;
+    std::vector<const Configuration *> configurations;
+    std::vector<size_t> horizons;
+    std::vector<int> blocks;
+    std::vector<int> degrees;
+    std::vector<int> windows;
+    std::vector<double> dt_steps;
+    std::string precision = "double";
+    double tolerance = DEFAULT_TOLERANCE;
+    bool perf = false;
+    std::vector<std::string> backends;
+    std::string results_path;
+    std::vector<std::string> csv_paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--ticks" or arg == "--warmup" or arg == "--configs" or arg == "--horizons"
+             or arg == "--blocks" or arg == "--dt-steps" or arg == "--precision" or arg == "--tolerance"
+             or arg == "--backends" or arg == "--degrees" or arg == "--windows" or arg == "--results")
+            and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--ticks") {
+                num_ticks = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--warmup") {
+                num_warmup = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--precision") {
+                if (value != "double" and value != "mixed" and value != "float") {
+                    std::fprintf(stderr, "The precision should be double, mixed or float\n");
+                    return 1;
+                }
+                precision = value;
+            } else if (arg == "--tolerance") {
+                tolerance = std::atof(value.c_str());
+            } else if (arg == "--results") {
+                results_path = value;
+            } else if (arg == "--backends") {
+                size_t begin = 0;
+                while (begin <= value.size()) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    std::string name = value.substr(begin, end - begin);
+                    if (name != "ipopt" and !SolverBackends::known(name)) {
+                        std::fprintf(stderr, "Unknown backend \"%s\"\n", name.c_str());
+                        usage(argv[0]);
+                        return 1;
+                    }
+                    backends.push_back(name);
+                    begin = end + 1;
+                }
+            } else if (arg == "--horizons") {
+                size_t begin = 0;
+                while (begin <= value.size()) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    size_t horizon = std::strtoul(value.substr(begin, end - begin).c_str(), nullptr, 10);
+                    if (horizon < 3) {
+                        std::fprintf(stderr, "The horizons should be at least 3 steps\n");
+                        return 1;
+                    }
+                    horizons.push_back(horizon);
+                    begin = end + 1;
+                }
+            } else if (arg == "--blocks") {
+                size_t begin = 0;
+                while (begin <= value.size()) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    int length = std::atoi(value.substr(begin, end - begin).c_str());
+                    if (length < 1) {
+                        std::fprintf(stderr, "The blocks should be at least 1 step long\n");
+                        return 1;
+                    }
+                    blocks.push_back(length);
+                    begin = end + 1;
+                }
+            } else if (arg == "--degrees" or arg == "--windows") {
+                bool degree = (arg == "--degrees");
+                size_t begin = 0;
+                while (begin <= value.size()) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    int n = std::atoi(value.substr(begin, end - begin).c_str());
+                    if (degree ? n < 1 : n < 3) {
+                        std::fprintf(stderr, degree ? "The degrees should be at least 1\n"
+                                                    : "The windows should be at least 3 waypoints\n");
+                        return 1;
+                    }
+                    (degree ? degrees : windows).push_back(n);
+                    begin = end + 1;
+                }
+            } else if (arg == "--dt-steps") {
+                size_t begin = 0;
+                while (begin <= value.size()) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    double step = std::atof(value.substr(begin, end - begin).c_str());
+                    if (step <= 0.0) {
+                        std::fprintf(stderr, "The dt steps should be positive\n");
+                        return 1;
+                    }
+                    dt_steps.push_back(step);
+                    begin = end + 1;
+                }
+            } else {
+                size_t begin = 0;
+                while (begin <= value.size()) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    std::string name = value.substr(begin, end - begin);
+                    const Configuration * found = find_configuration(name);
+                    if (found == nullptr) {
+                        std::fprintf(stderr, "Unknown configuration \"%s\"\n", name.c_str());
+                        usage(argv[0]);
+                        return 1;
+                    }
+                    configurations.push_back(found);
+                    begin = end + 1;
+                }
+            }
+        } else if (arg == "--perf") {
+            perf = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            csv_paths.push_back(arg);
+        }
+    }
+    if (csv_paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (configurations.empty())
+        for (const Configuration & configuration : CONFIGURATIONS)
+            configurations.push_back(&configuration);
+
+    Params base = default_params();
+    base.input_blocks = blocks;
+    base.dt_steps = dt_steps;
+    base.precision = precision;
+    bool compare = (precision != "double");
+    bool within_tolerance = true;
+    bool sweep = !degrees.empty() or !windows.empty();
+    if (horizons.empty())
+        horizons.push_back(base.steps_ahead);
+    if (degrees.empty())
+        degrees.push_back(base.poly_degree);
+    if (windows.empty())
+        windows.push_back(base.num_steps_poly);
+    int largest_window = *std::max_element(windows.begin(), windows.end());
+
+    // The points of the sweep, of a horizon, a degree and a window each
+    struct GridPoint {
+        size_t horizon;
+        int degree;
+        int window;
+    };
+    std::vector<GridPoint> grid;
+    for (size_t horizon : horizons)
+        for (int degree : degrees)
+            for (int window : windows) {
+                if (window <= degree)
+                    std::fprintf(stderr, "Skipping the window of %d waypoints, too few for a degree of %d\n",
+                                 window, degree);
+                else
+                    grid.push_back(GridPoint{horizon, degree, window});
+            }
+    std::vector<SweepRow> rows;
+
+    // Each configuration's own
+    if (backends.empty())
+        backends.push_back("");
+
+    std::printf("%-28s %3s", "path", "N");
+    if (sweep)
+        std::printf(" %3s %4s", "deg", "win");
+    std::printf(" %-16s %6s %7s %9s %9s %9s %9s %7s",
+                "configuration", "ticks", "ok [%]", "p50 [ms]", "p90 [ms]", "p99 [ms]", "max [ms]", "iters");
+    if (compare)
+        std::printf(" %11s %11s", "steer error", "speed error");
+    if (perf)
+        std::printf(" %9s %5s %9s %9s", "Mcycles", "IPC", "c-misses", "b-misses");
+    if (sweep)
+        std::printf(" %10s %10s %9s", "tape [kB]", "CppAD [kB]", "RSS [MB]");
+    std::printf("\n");
+    for (const std::string & csv_path : csv_paths) {
+        Waypoints waypoints;
+        if (!load_waypoints(csv_path, 0.05, waypoints))
+            return 1;
+        if (waypoints.x.size() <= size_t(largest_window)) {
+            std::fprintf(stderr, "%s: too few waypoints (%lu)\n", csv_path.c_str(), waypoints.x.size());
+            return 1;
+        }
+        size_t ticks = (num_ticks > 0) ? num_ticks : waypoints.x.size();
+
+        std::string name = csv_path.substr(csv_path.find_last_of('/') + 1);
+        for (const GridPoint & point : grid) {
+            for (const Configuration * configuration : configurations) {
+                for (const std::string & backend : backends) {
+                    Params params = base;
+                    params.steps_ahead = point.horizon;
+                    params.poly_degree = point.degree;
+                    params.num_steps_poly = point.window;
+                    configuration->apply(params);
+                    params.backend = backend;
+                    std::string label = configuration->name;
+                    if (!backend.empty())
+                        label += "@" + backend;
+
+                    // The window in float too with "mixed" and "float", as in
+                    // ControlPipeline
+                    Result result = compare ? run<float>(waypoints, params, ticks, num_warmup, perf)
+                                            : run<double>(waypoints, params, ticks, num_warmup, perf);
+                    std::vector<double> & latencies = result.latencies;
+                    std::sort(latencies.begin(), latencies.end());
+
+                    SweepRow row{name, label, point.horizon, point.degree, point.window, latencies.size(),
+                                 double(result.num_ok) / std::max(latencies.size(), size_t(1)),
+                                 percentile(latencies, 50), percentile(latencies, 90), percentile(latencies, 99),
+                                 latencies.empty() ? 0.0 : latencies.back(), -1.0, result.memory,
+                                 result.rss_growth};
+                    char iterations[16] = "-";
+                    if (result.num_iterations_known > 0) {
+                        row.iterations = double(result.num_iterations) / result.num_iterations_known;
+                        std::snprintf(iterations, sizeof(iterations), "%.1f", row.iterations);
+                    }
+                    rows.push_back(row);
+
+                    std::printf("%-28s %3lu", name.c_str(), point.horizon);
+                    if (sweep)
+                        std::printf(" %3d %4d", point.degree, point.window);
+                    std::printf(" %-16s %6lu %7.1f %9.3f %9.3f %9.3f %9.3f %7s",
+                                label.c_str(), row.ticks, 100.0 * row.ok, 1e3 * row.p50, 1e3 * row.p90,
+                                1e3 * row.p99, 1e3 * row.max, iterations);
+                    if (compare) {
+                        std::printf(" %11.2e %11.2e", result.max_steer_error, result.max_speed_error);
+                        if (result.max_steer_error > tolerance or result.max_speed_error > tolerance) {
+                            std::printf("  over the tolerance");
+                            within_tolerance = false;
+                        }
+                    }
+                    if (perf) {
+                        double measured = double(std::max(latencies.size(), size_t(1)));
+                        std::printf(" %9.3f %5.2f %9.0f %9.0f", 1e-6 * result.counts.cycles / measured,
+                                    result.counts.ipc(), result.counts.cache_misses / measured,
+                                    result.counts.branch_misses / measured);
+                    }
+                    if (sweep)
+                        std::printf(" %10.1f %10.1f %9.1f", 1e-3 * result.memory.tape_bytes,
+                                    1e-3 * (result.memory.cppad_inuse + result.memory.cppad_available),
+                                    1e-6 * result.memory.rss);
+                    std::printf("\n");
+                    std::fflush(stdout);
+                }
+            }
+        }
+    }
+
+    print_exponents(rows);
+    if (!results_path.empty() and !save_sweep(results_path, rows, num_warmup))
+        return 1;
+    return within_tolerance ? 0 : 1;
+}
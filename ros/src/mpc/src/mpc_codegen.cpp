@@ -0,0 +1,122 @@
+// Generates, and compiles into a shared library, the C code of FG_eval's cost
+// and constraints and of their sparse derivatives (see MPC_NLP::load_codegen).
+//
+// The horizon, the polynomial degree, `dt` and the weights of the cost are
+// baked into the generated code, so the library has to be regenerated when
+// any of them changes. The polynomial coefficients and the reference speed
+// are parameters of the generated functions, as in the persistent tape.
+
+#include <iostream>
+#include <fstream>
+#include <set>
+#include <vector>
+
+#include <cppad/cg.hpp>
+
+#include "FG_eval.h"
+#include "MPC_NLP.h"
+
+
+typedef CppAD::cg::CG<double> CGD;
+
+
+int main(int argc, char **argv) {
+    const int num_expected_args = 11;
+    if (argc != num_expected_args) {
+        std::cerr << "Usage: " << argv[0] << " <library (without extension)>"
+                  << " <steps_ahead> <dt> <cte_coeff> <epsi_coeff> <speed_coeff> <steer_coeff>"
+                  << " <consec_steer_coeff> <consec_speed_coeff> <poly_degree>" << std::endl;
+        return 1;
+    }
+
+    std::string library(argv[1]);
+
+    Params params;
+    params.steps_ahead = atoi(argv[2]);
+    params.dt = atof(argv[3]);
+    params.cte_coeff = atof(argv[4]);
+    params.epsi_coeff = atof(argv[5]);
+    params.speed_coeff = atof(argv[6]);
+    params.steer_coeff = atof(argv[7]);
+    params.consec_steer_coeff = atof(argv[8]);
+    params.consec_speed_coeff = atof(argv[9]);
+    params.poly_degree = atoi(argv[10]);
+
+    // Same layout of the variables as in MPC::MPC
+    Indexes indexes;
+    indexes.x_start = 0;
+    indexes.y_start = indexes.x_start + params.steps_ahead;
+    indexes.psi_start = indexes.y_start + params.steps_ahead;
+    indexes.cte_start = indexes.psi_start + params.steps_ahead;
+    indexes.epsi_start = indexes.cte_start + params.steps_ahead;
+    indexes.delta_start = indexes.epsi_start + params.steps_ahead;
+    indexes.v_start = indexes.delta_start + params.steps_ahead - 1;
+
+    size_t n_vars = params.steps_ahead * 5 + (params.steps_ahead - 1) * 2;
+    size_t n_constraints = params.steps_ahead * 5;
+    size_t n_coeffs = params.poly_degree + 1;
+
+    // Record FG_eval on CG<double>, with the same dynamic parameters as the
+    // persistent tape: coeffs followed by ref_v
+    FG_eval_base<CGD>::ADvector a_vars(n_vars);
+    for (size_t i=0; i < n_vars; i++)
+        a_vars[i] = 0.0;
+
+    FG_eval_base<CGD>::ADvector a_dynamic(n_coeffs + 1);
+    for (size_t i=0; i < n_coeffs + 1; i++)
+        a_dynamic[i] = 0.0;
+
+    size_t abort_op_index = 0;
+    bool record_compare = false;
+    CppAD::Independent(a_vars, abort_op_index, record_compare, a_dynamic);
+
+    FG_eval_base<CGD>::ADvector a_coeffs(n_coeffs);
+    for (size_t i=0; i < n_coeffs; i++)
+        a_coeffs[i] = a_dynamic[i];
+
+    FG_eval_base<CGD> fg_eval(a_coeffs, a_dynamic[n_coeffs], params, indexes);
+    FG_eval_base<CGD>::ADvector a_fg(1 + n_constraints);
+    fg_eval(a_fg, a_vars);
+
+    CppAD::ADFun<CGD> fun(a_vars, a_fg);
+    fun.optimize();
+
+    // Ipopt only needs the lower triangle of the Hessian of the Lagrangian
+    std::vector<std::set<size_t> > hes_pattern =
+            CppAD::cg::hessianSparsitySet<std::vector<std::set<size_t> >, CGD>(fun);
+    std::vector<size_t> hes_row, hes_col;
+    for (size_t i=0; i < n_vars; i++) {
+        for (auto j : hes_pattern[i]) {
+            if (j <= i) {
+                hes_row.push_back(i);
+                hes_col.push_back(j);
+            }
+        }
+    }
+
+    CppAD::cg::ModelCSourceGen<double> cgen(fun, MPC_NLP::CODEGEN_MODEL);
+    cgen.setCreateForwardZero(true);
+    cgen.setCreateSparseJacobian(true);
+    cgen.setCreateSparseHessian(true);
+    cgen.setCustomSparseHessianElements(hes_row, hes_col);
+
+    CppAD::cg::ModelLibraryCSourceGen<double> libcgen(cgen);
+    CppAD::cg::DynamicModelLibraryProcessor<double> processor(libcgen, library);
+
+    CppAD::cg::GccCompiler<double> compiler;
+    compiler.addCompileFlag("-O2");
+    processor.createDynamicLibrary(compiler);
+
+    // What was baked into the code, checked by MPC_NLP::load_codegen
+    std::ofstream config(library + ".params");
+    config.precision(17);
+    config << params.steps_ahead << " " << params.dt << " "
+           << params.cte_coeff << " " << params.epsi_coeff << " "
+           << params.speed_coeff << " " << params.steer_coeff << " "
+           << params.consec_steer_coeff << " " << params.consec_speed_coeff << " "
+           << params.poly_degree << std::endl;
+
+    std::cout << "Generated " << library << " (steps_ahead: " << params.steps_ahead
+              << ", poly_degree: " << params.poly_degree << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,558 @@
+// The C API of mpc_core.h, over the C++ classes of the controller. No
+// exception gets past it: the failures are returned, and kept for
+// `mpc_last_error`.
+
+#include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mpc_core.h"
+#include "MPC.h"
+#include "PathTracker.h"
+#include "LapProgress.h"
+#include "OfflineTools.h"
+#include "SolverCalibration.h"
+
+
+struct MpcParams {
+    Params params;
+};
+
+struct MpcSolver {
+    std::unique_ptr<MPC> mpc;
+    size_t result_size;
+    ///* Kept to reuse their storage from solve to solve
+    Eigen::VectorXd state;
+    Eigen::VectorXd coeffs;
+    std::vector<double> result;
+};
+
+struct MpcPath {
+    Centerline centerline;
+    LapProgress progress;
+};
+
+
+static thread_local std::string last_error;
+
+
+static int fail(const std::string & error) {
+    last_error = error;
+    return -1;
+}
+
+
+// The text of a field, as on the command line of the node, and back
+static bool parse(const std::string & text, double & value) {
+    char * end = nullptr;
+    errno = 0;
+    double parsed = std::strtod(text.c_str(), &end);
+    if (text.empty() or *end != '\0' or errno != 0)
+        return false;
+    value = parsed;
+    return true;
+}
+
+static bool parse(const std::string & text, int & value) {
+    char * end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() or *end != '\0' or errno != 0 or parsed != long(int(parsed)))
+        return false;
+    value = int(parsed);
+    return true;
+}
+
+static bool parse(const std::string & text, size_t & value) {
+    int parsed;
+    if (!parse(text, parsed) or parsed < 0)
+        return false;
+    value = size_t(parsed);
+    return true;
+}
+
+static bool parse(const std::string & text, bool & value) {
+    if (text == "true" or text == "1")
+        value = true;
+    else if (text == "false" or text == "0")
+        value = false;
+    else
+        return false;
+    return true;
+}
+
+static bool parse(const std::string & text, std::string & value) {
+    value = text;
+    return true;
+}
+
+template <class T>
+static bool parse(const std::string & text, std::vector<T> & values) {
+    std::vector<T> parsed;
+    size_t begin = 0;
+    while (!text.empty() and begin <= text.size()) {
+        size_t end = std::min(text.find(',', begin), text.size());
+        T value;
+        if (!parse(text.substr(begin, end - begin), value))
+            return false;
+        parsed.push_back(value);
+        begin = end + 1;
+    }
+    values.swap(parsed);
+    return true;
+}
+
+template <class T>
+static void format(std::ostream & out, const T & value) {
+    out << std::setprecision(17) << value;
+}
+
+static void format(std::ostream & out, bool value) {
+    out << (value ? "true" : "false");
+}
+
+template <class T>
+static void format(std::ostream & out, const std::vector<T> & values) {
+    for (size_t i=0; i < values.size(); i++) {
+        if (i > 0)
+            out << ",";
+        format(out, values[i]);
+    }
+}
+
+
+static const char * type_name(const double *) { return "double"; }
+static const char * type_name(const int *) { return "int"; }
+static const char * type_name(const size_t *) { return "int"; }
+static const char * type_name(const bool *) { return "bool"; }
+static const char * type_name(const std::string *) { return "string"; }
+static const char * type_name(const std::vector<double> *) { return "double list"; }
+static const char * type_name(const std::vector<int> *) { return "int list"; }
+
+
+// The fields of Params, by name
+struct Field {
+    const char * name;
+    const char * type;
+    bool (*set)(Params & params, const std::string & text);
+    void (*get)(const Params & params, std::ostream & out);
+};
+
+template <class T, T Params::*member>
+static bool set_field(Params & params, const std::string & text) {
+    return parse(text, params.*member);
+}
+
+template <class T, T Params::*member>
+static void get_field(const Params & params, std::ostream & out) {
+    format(out, params.*member);
+}
+
+#define MPC_FIELD(type, name) \
+    {#name, type_name(static_cast<const type *>(nullptr)), &set_field<type, &Params::name>, &get_field<type, &Params::name>}
+
+static const Field FIELDS[] = {
+    MPC_FIELD(size_t, steps_ahead),
+    MPC_FIELD(double, dt),
+    MPC_FIELD(double, ref_v),
+    MPC_FIELD(double, ref_v_alpha),
+    MPC_FIELD(std::vector<double>, dt_steps),
+    MPC_FIELD(double, latency),
+    MPC_FIELD(std::string, latency_mode),
+    MPC_FIELD(double, cte_coeff),
+    MPC_FIELD(double, epsi_coeff),
+    MPC_FIELD(double, speed_coeff),
+    MPC_FIELD(double, steer_coeff),
+    MPC_FIELD(double, consec_speed_coeff),
+    MPC_FIELD(double, consec_steer_coeff),
+    MPC_FIELD(int, poly_degree),
+    MPC_FIELD(int, num_steps_poly),
+    MPC_FIELD(bool, debug),
+    MPC_FIELD(bool, persistent_tape),
+    MPC_FIELD(bool, warm_start),
+    MPC_FIELD(std::string, warm_start_initializer),
+    MPC_FIELD(std::string, warm_start_weights),
+    MPC_FIELD(bool, dual_warm_start),
+    MPC_FIELD(double, warm_start_mu),
+    MPC_FIELD(bool, lap_warm_start),
+    MPC_FIELD(int, lap_warm_start_bins),
+    MPC_FIELD(std::string, backend),
+    MPC_FIELD(bool, riccati_solver),
+    MPC_FIELD(bool, fixed_horizon),
+    MPC_FIELD(bool, codegen),
+    MPC_FIELD(bool, checkpoint_stage),
+    MPC_FIELD(bool, fast_trig),
+    MPC_FIELD(std::string, structure_cache),
+    MPC_FIELD(bool, analytic_derivatives),
+    MPC_FIELD(std::string, precision),
+    MPC_FIELD(bool, autodiff_stages),
+    MPC_FIELD(bool, limited_memory_hessian),
+    MPC_FIELD(bool, constant_cost_hessian),
+    MPC_FIELD(int, parallel_derivatives),
+    MPC_FIELD(int, parallel_stages),
+    MPC_FIELD(std::string, linear_solver),
+    MPC_FIELD(bool, calibrate_linear_solver),
+    MPC_FIELD(std::string, mu_strategy),
+    MPC_FIELD(bool, nlp_scaling),
+    MPC_FIELD(std::string, cppad_sparsity),
+    MPC_FIELD(bool, calibrate_ipopt),
+    MPC_FIELD(std::string, ipopt_profile),
+    MPC_FIELD(bool, ipopt_journal),
+    MPC_FIELD(bool, fix_initial_state),
+    MPC_FIELD(bool, condensed),
+    MPC_FIELD(std::vector<int>, input_blocks),
+    MPC_FIELD(std::string, vehicle_model),
+    MPC_FIELD(std::string, integrator),
+    MPC_FIELD(double, terminal_cte),
+    MPC_FIELD(double, terminal_epsi),
+    MPC_FIELD(double, max_steer_rate),
+    MPC_FIELD(bool, terminal_cost),
+    MPC_FIELD(bool, learning_mpc),
+    MPC_FIELD(int, safe_set_neighbors),
+    MPC_FIELD(int, safe_set_size),
+    MPC_FIELD(bool, soft_constraints),
+    MPC_FIELD(double, soft_constraint_weight),
+    MPC_FIELD(std::vector<int>, adaptive_horizons),
+    MPC_FIELD(std::vector<double>, adaptive_horizon_speeds),
+    MPC_FIELD(std::vector<double>, parallel_ref_v_scales),
+    MPC_FIELD(bool, parallel_cold_start),
+    MPC_FIELD(std::vector<double>, reference_offsets),
+    MPC_FIELD(double, reference_offset_cost),
+    MPC_FIELD(double, reference_switch_margin),
+    MPC_FIELD(std::string, predicted_backends),
+    MPC_FIELD(std::string, solve_time_model),
+    MPC_FIELD(bool, parallel_build),
+    MPC_FIELD(std::string, explicit_table),
+    MPC_FIELD(double, explicit_table_steer_tolerance),
+    MPC_FIELD(double, explicit_table_speed_tolerance),
+    MPC_FIELD(int, solution_cache_size),
+    MPC_FIELD(double, solution_cache_tolerance),
+    MPC_FIELD(double, pid_kp_cte),
+    MPC_FIELD(double, pid_ki_cte),
+    MPC_FIELD(double, pid_kd_cte),
+    MPC_FIELD(double, pid_kp_epsi),
+    MPC_FIELD(double, pid_ki_epsi),
+    MPC_FIELD(double, pid_kd_epsi),
+    MPC_FIELD(bool, rti),
+    MPC_FIELD(int, iterations_per_tick),
+    MPC_FIELD(int, sensitivity_updates),
+    MPC_FIELD(double, sensitivity_tolerance),
+    MPC_FIELD(bool, active_set_qp),
+    MPC_FIELD(int, linearization_speed_bins),
+    MPC_FIELD(int, linearization_epsi_bins),
+    MPC_FIELD(double, linearization_max_epsi),
+    MPC_FIELD(int, linearization_curvature_bins),
+    MPC_FIELD(double, linearization_max_curvature),
+    MPC_FIELD(bool, mppi),
+    MPC_FIELD(int, mppi_samples),
+    MPC_FIELD(double, mppi_temperature),
+    MPC_FIELD(double, mppi_steer_noise),
+    MPC_FIELD(double, mppi_speed_noise),
+    MPC_FIELD(int, mppi_threads),
+    MPC_FIELD(double, solve_deadline),
+    MPC_FIELD(double, solve_time_limit),
+    MPC_FIELD(bool, abort_divergence),
+    MPC_FIELD(int, divergence_min_iterations),
+    MPC_FIELD(double, divergence_inf_pr_growth),
+    MPC_FIELD(double, divergence_min_alpha),
+    MPC_FIELD(int, divergence_small_steps),
+    MPC_FIELD(int, divergence_restoration_iterations),
+    MPC_FIELD(bool, adaptive_tolerance),
+    MPC_FIELD(double, relaxed_tol),
+    MPC_FIELD(double, relaxed_acceptable_tol),
+    MPC_FIELD(bool, windowed_closest),
+    MPC_FIELD(bool, projected_closest),
+    MPC_FIELD(bool, lap_progress),
+    MPC_FIELD(bool, spline_reference),
+    MPC_FIELD(bool, contouring_reference),
+    MPC_FIELD(bool, incremental_fit),
+    MPC_FIELD(bool, precomputed_fit),
+    MPC_FIELD(bool, fused_fit),
+    MPC_FIELD(bool, adaptive_window),
+    MPC_FIELD(int, pyramid_levels),
+    MPC_FIELD(bool, compact_waypoints),
+    MPC_FIELD(int, ring_margin),
+    MPC_FIELD(double, fit_reuse_distance),
+    MPC_FIELD(double, fit_reuse_angle),
+    MPC_FIELD(bool, speed_profile),
+    MPC_FIELD(double, max_lateral_accel),
+    MPC_FIELD(double, max_accel),
+    MPC_FIELD(double, max_decel),
+    MPC_FIELD(double, corridor_width),
+    MPC_FIELD(double, corridor_margin),
+    MPC_FIELD(int, max_obstacles),
+    MPC_FIELD(double, obstacle_margin),
+};
+
+#undef MPC_FIELD
+
+
+static const Field * find_field(const char * name) {
+    for (const Field & field : FIELDS)
+        if (name != nullptr and std::strcmp(name, field.name) == 0)
+            return &field;
+    return nullptr;
+}
+
+
+const char * mpc_last_error(void) {
+    return last_error.c_str();
+}
+
+
+MpcParams * mpc_params_new(void) {
+    MpcParams * params = new MpcParams;
+    params->params = default_params();
+    return params;
+}
+
+
+MpcParams * mpc_params_copy(const MpcParams * params) {
+    return new MpcParams(*params);
+}
+
+
+void mpc_params_free(MpcParams * params) {
+    delete params;
+}
+
+
+int mpc_params_set(MpcParams * params, const char * name, const char * value) {
+    const Field * field = find_field(name);
+    if (field == nullptr)
+        return fail(std::string("No parameter ") + (name ? name : "(null)"));
+    if (value == nullptr or !field->set(params->params, value))
+        return fail(std::string("Bad value of ") + name + ": " + (value ? value : "(null)"));
+    return 0;
+}
+
+
+int mpc_params_get(const MpcParams * params, const char * name, char * value, size_t size) {
+    const Field * field = find_field(name);
+    if (field == nullptr)
+        return fail(std::string("No parameter ") + (name ? name : "(null)"));
+    std::ostringstream out;
+    field->get(params->params, out);
+    std::string text = out.str();
+    if (size > 0) {
+        size_t length = std::min(text.size(), size - 1);
+        std::memcpy(value, text.data(), length);
+        value[length] = '\0';
+    }
+    return int(text.size());
+}
+
+
+const char * mpc_params_name(size_t index) {
+    return (index < sizeof(FIELDS) / sizeof(FIELDS[0])) ? FIELDS[index].name : nullptr;
+}
+
+
+const char * mpc_params_type(const char * name) {
+    const Field * field = find_field(name);
+    return (field != nullptr) ? field->type : nullptr;
+}
+
+
+const Params & mpc_params_cpp(const MpcParams * params) {
+    return params->params;
+}
+
+
+MpcSolver * mpc_solver_new(const MpcParams * params) {
+    try {
+        std::unique_ptr<MpcSolver> solver(new MpcSolver);
+        Params mpc_params = params->params;
+        if (mpc_params.calibrate_ipopt)
+            calibrate_ipopt(mpc_params, std::vector<double>());
+        else if (mpc_params.calibrate_linear_solver)
+            mpc_params.linear_solver = fastest_linear_solver(mpc_params);
+        solver->mpc.reset(new MPC(mpc_params));
+        solver->result_size = 2 + 2 * params->params.steps_ahead;
+        solver->state = Eigen::VectorXd::Zero(5);
+        solver->result.reserve(solver->result_size);
+        return solver.release();
+    } catch (const std::exception & e) {
+        fail(std::string("Can't build the controller: ") + e.what());
+        return nullptr;
+    }
+}
+
+
+void mpc_solver_free(MpcSolver * solver) {
+    delete solver;
+}
+
+
+size_t mpc_solver_result_size(const MpcSolver * solver) {
+    return solver->result_size;
+}
+
+
+int mpc_solver_solve(MpcSolver * solver, const double * state, const double * coeffs, size_t num_coeffs,
+                     double ref_v, double time_limit, double * result, size_t result_size) {
+    for (int i=0; i < 5; i++)
+        solver->state[i] = state[i];
+    if (size_t(solver->coeffs.size()) != num_coeffs)
+        solver->coeffs.resize(num_coeffs);
+    for (size_t i=0; i < num_coeffs; i++)
+        solver->coeffs[i] = coeffs[i];
+
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (time_limit > 0.0)
+        deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(time_limit));
+    try {
+        solver->mpc->Solve(solver->state, solver->coeffs, ref_v, solver->result, deadline);
+    } catch (const std::exception & e) {
+        return fail(std::string("The solve failed: ") + e.what());
+    }
+    if (solver->result.size() > result_size)
+        return fail("The result doesn't fit, see mpc_solver_result_size");
+    std::copy(solver->result.begin(), solver->result.end(), result);
+    return 0;
+}
+
+
+void mpc_solver_stats(const MpcSolver * solver, MpcStats * stats) {
+    const SolveStats & solve_stats = solver->mpc->stats();
+    stats->ok = solve_stats.ok;
+    stats->deadline_hit = solve_stats.deadline_hit;
+    stats->cost = solve_stats.cost;
+    stats->iterations = solve_stats.iterations;
+    stats->solve_time = solve_stats.solve_time;
+    stats->eval_time = solve_stats.eval_time;
+    stats->constraint_violation = solve_stats.constraint_violation;
+    stats->fallback = int(solve_stats.fallback);
+    stats->slack = solve_stats.slack;
+    stats->tolerance = solve_stats.tolerance;
+}
+
+
+int mpc_solver_set_weights(MpcSolver * solver, const MpcParams * params) {
+    if (!solver->mpc->set_weights(params->params))
+        return fail("The derivative code has the weights built in, build a new solver");
+    return 0;
+}
+
+
+void mpc_solver_reset_warm_start(MpcSolver * solver) {
+    solver->mpc->reset_warm_start();
+}
+
+
+int mpc_polyfit(const double * x, const double * y, size_t n, int order, double * coeffs) {
+    if (order < 1 or n < size_t(order) + 1)
+        return fail("Too few points for the degree of the fit");
+    Eigen::VectorXd result;
+    polyfit(x, y, n, order, result);
+    Eigen::Map<Eigen::VectorXd>(coeffs, order + 1) = result;
+    return 0;
+}
+
+
+void mpc_polyeval(const double * coeffs, size_t num_coeffs, const double * x, size_t n,
+                  double * value, double * derivative) {
+    Eigen::Map<const Eigen::VectorXd> map(coeffs, num_coeffs);
+    Eigen::VectorXd poly = map;
+    for (size_t i=0; i < n; i++) {
+        double v, dv;
+        polyeval_with_diff(poly, x[i], v, dv);
+        if (value != nullptr)
+            value[i] = v;
+        if (derivative != nullptr)
+            derivative[i] = dv;
+    }
+}
+
+
+void mpc_to_car_frame(const double * x, const double * y, size_t n, double pos_x, double pos_y, double psi,
+                      double * car_x, double * car_y) {
+    // As `to_car_frame`, on the caller's arrays
+    Eigen::Map<const Eigen::ArrayXd> world_x(x, n), world_y(y, n);
+    Eigen::Map<Eigen::ArrayXd> out_x(car_x, n), out_y(car_y, n);
+    double s = std::sin(psi), c = std::cos(psi);
+    Eigen::ArrayXd rotated_x = (world_x - pos_x) * c + (world_y - pos_y) * s;
+    out_y = (world_y - pos_y) * c - (world_x - pos_x) * s;
+    out_x = rotated_x;
+}
+
+
+MpcPath * mpc_path_new(const double * x, const double * y, size_t n, const MpcParams * params) {
+    MpcPath * path = new MpcPath;
+    path->centerline.pts_x.assign(x, x + n);
+    path->centerline.pts_y.assign(y, y + n);
+    PathTracker::prepare_centerline(path->centerline, params ? params->params : default_params());
+    return path;
+}
+
+
+void mpc_path_free(MpcPath * path) {
+    delete path;
+}
+
+
+size_t mpc_path_size(const MpcPath * path) {
+    return path->centerline.pts_x.size();
+}
+
+
+double mpc_path_length(const MpcPath * path) {
+    return path->centerline.spline.length();
+}
+
+
+int mpc_path_closed(const MpcPath * path) {
+    return path->centerline.spline.closed();
+}
+
+
+int mpc_path_closest(const MpcPath * path, double x, double y) {
+    return path->centerline.grid.nearest(x, y);
+}
+
+
+void mpc_path_sample(const MpcPath * path, const double * s, size_t n,
+                     double * x, double * y, double * heading, double * curvature) {
+    const PathSpline & spline = path->centerline.spline;
+    for (size_t i=0; i < n; i++) {
+        PathSpline::Sample sample;
+        spline.sample(s[i], sample);
+        if (x != nullptr)
+            x[i] = sample.x;
+        if (y != nullptr)
+            y[i] = sample.y;
+        if (heading != nullptr)
+            heading[i] = sample.heading;
+        if (curvature != nullptr)
+            curvature[i] = sample.curvature;
+    }
+}
+
+
+int mpc_path_progress(MpcPath * path, const double * x, const double * y, size_t n,
+                      double * s, double * d, int * closest) {
+    for (size_t i=0; i < n; i++) {
+        if (!path->progress.update(path->centerline, x[i], y[i]))
+            return fail("The path has fewer than two waypoints");
+        if (s != nullptr)
+            s[i] = path->progress.s();
+        if (d != nullptr)
+            d[i] = path->progress.d();
+        if (closest != nullptr)
+            closest[i] = path->progress.closest_waypoint();
+    }
+    return 0;
+}
+
+
+void mpc_path_reset_progress(MpcPath * path) {
+    path->progress.reset();
+}
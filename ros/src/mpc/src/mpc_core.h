@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stddef.h>
+
+
+///* A C API of the controller's core, without ROS: the Params, MPC::Solve,
+///* polyfit and the kernels of the path (the closest waypoint, the frame of
+///* the car, the spline and the progress along the path). It's what the
+///* Python bindings (scripts/mpc_core.py) load, through ctypes, from the
+///* shared library libmpc_core.so.
+///*
+///* The arrays are the caller's (e.g. the buffers of NumPy arrays of
+///* doubles), they're read and written in place and never kept. The
+///* handles are opaque and owned by the caller, who frees them. The
+///* functions that can fail return 0 on success and -1 otherwise, with the
+///* reason in `mpc_last_error`.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MpcParams MpcParams;
+typedef struct MpcSolver MpcSolver;
+typedef struct MpcPath MpcPath;
+
+///* What the last solve reported (see SolveStats)
+typedef struct MpcStats {
+    int ok;
+    int deadline_hit;
+    double cost;
+    int iterations;
+    double solve_time;
+    double eval_time;
+    double constraint_violation;
+    int fallback;
+    double slack;
+    double tolerance;
+} MpcStats;
+
+///* The reason the last call on this thread failed ("" if none did)
+const char * mpc_last_error(void);
+
+///* The defaults of run_mpc_cpp.sh
+MpcParams * mpc_params_new(void);
+MpcParams * mpc_params_copy(const MpcParams * params);
+void mpc_params_free(MpcParams * params);
+
+///* Sets the field of Params called `name` from its text, as on the
+///* command line of the node: a number, "true" or "false", a string, or a
+///* comma-separated list
+int mpc_params_set(MpcParams * params, const char * name, const char * value);
+
+///* The text of the field called `name` into `value` (of `size` bytes);
+///* the length it needs, -1 if there's no such field
+int mpc_params_get(const MpcParams * params, const char * name, char * value, size_t size);
+
+///* The names of the fields, NULL past the last one
+const char * mpc_params_name(size_t index);
+
+///* The type of the field called `name`: "double", "int", "bool",
+///* "string", "double list" or "int list"; NULL if there's no such field
+const char * mpc_params_type(const char * name);
+
+///* A controller for `params` (which tapes, or loads the derivative code);
+///* NULL if it can't be built
+MpcSolver * mpc_solver_new(const MpcParams * params);
+void mpc_solver_free(MpcSolver * solver);
+
+///* The size of the results of the solves: the actuations [rad], [m/s],
+///* then the predicted (x, y) of every step
+size_t mpc_solver_result_size(const MpcSolver * solver);
+
+///* MPC::Solve from the state (x, y, psi, cte, epsi) and the `num_coeffs`
+///* coefficients of the fit (lowest order first), into `result` (of
+///* `mpc_solver_result_size`), within `time_limit` [s] (0: none)
+int mpc_solver_solve(MpcSolver * solver, const double * state, const double * coeffs, size_t num_coeffs,
+                     double ref_v, double time_limit, double * result, size_t result_size);
+
+void mpc_solver_stats(const MpcSolver * solver, MpcStats * stats);
+int mpc_solver_set_weights(MpcSolver * solver, const MpcParams * params);
+void mpc_solver_reset_warm_start(MpcSolver * solver);
+
+///* The least-squares polynomial of degree `order` through the n points,
+///* into `coeffs` (order + 1 of them, lowest order first)
+int mpc_polyfit(const double * x, const double * y, size_t n, int order, double * coeffs);
+
+///* The polynomial and its derivative at each of the n `x`
+void mpc_polyeval(const double * coeffs, size_t num_coeffs, const double * x, size_t n,
+                  double * value, double * derivative);
+
+///* The n points from the world frame to that of a car at (pos_x, pos_y)
+///* with heading psi; `car_x` and `car_y` may be `x` and `y`
+void mpc_to_car_frame(const double * x, const double * y, size_t n, double pos_x, double pos_y, double psi,
+                      double * car_x, double * car_y);
+
+///* A path through the n waypoints, prepared as the controller prepares a
+///* centerline for `params` (NULL: the defaults)
+MpcPath * mpc_path_new(const double * x, const double * y, size_t n, const MpcParams * params);
+void mpc_path_free(MpcPath * path);
+
+size_t mpc_path_size(const MpcPath * path);
+double mpc_path_length(const MpcPath * path);
+int mpc_path_closed(const MpcPath * path);
+
+///* Index of the waypoint closest to (x, y)
+int mpc_path_closest(const MpcPath * path, double x, double y);
+
+///* The spline of the path at the n arc lengths `s`: the positions, the
+///* headings and the curvatures (any of them may be NULL)
+void mpc_path_sample(const MpcPath * path, const double * s, size_t n,
+                     double * x, double * y, double * heading, double * curvature);
+
+///* The progress along the path (see LapProgress), tracked from the
+///* previous call over the n poses; into `s`, `d` (either may be NULL) and
+///* `closest` (the closest waypoints, may be NULL). `mpc_path_reset_progress`
+///* forgets it
+int mpc_path_progress(MpcPath * path, const double * x, const double * y, size_t n,
+                      double * s, double * d, int * closest);
+void mpc_path_reset_progress(MpcPath * path);
+
+#ifdef __cplusplus
+}
+
+struct Params;
+
+///* The Params of the handle, for C++ code that sets them by name through
+///* this API (e.g. the ROS 2 component, from its parameters)
+const Params & mpc_params_cpp(const MpcParams * params);
+#endif
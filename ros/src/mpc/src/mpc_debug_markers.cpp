@@ -0,0 +1,89 @@
+// Builds the debug markers of a node publishing the compact debug view
+// (`debug_compact`, see Debug.msg) off-board, e.g. on the base station, so
+// that only that crosses the car's Wi-Fi:
+//
+//   rosrun mpc mpc_debug_markers [_rate:=10]
+//
+// Every /mpc/debug_cpp is turned into the /mpc/next_pos_cpp,
+// /mpc/closest_cpp and /mpc/poly_cpp markers of the node without it (by the
+// same Visualizer), at most at `rate` [Hz].
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <ros/ros.h>
+#include <mpc/Debug.h>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "Visualizer.h"
+#include "WaypointBuffer.h"
+
+
+namespace {
+
+class DebugMarkersNode {
+public:
+    DebugMarkersNode(ros::NodeHandle & nodehandle, double rate)
+            : m_nodehandle(nodehandle), m_rate(rate), m_started(false) {
+        m_sub_debug = nodehandle.subscribe("mpc/debug_cpp", 1, &DebugMarkersNode::debug_cb, this);
+    }
+
+private:
+    void debug_cb(const mpc::Debug::ConstPtr & msg) {
+        // Whether the markers of the polynomial are those of a contouring
+        // reference is the node's, so known from its first message
+        if (!m_started) {
+            m_visualizer.start(m_nodehandle, m_rate, msg->contouring_reference);
+            m_started = true;
+        }
+
+        size_t num_predicted = std::min(msg->plan_x.size(), msg->plan_y.size());
+        m_vars.assign(2 + 2 * num_predicted, 0.0);
+        for (size_t i=0; i < num_predicted; i++) {
+            m_vars[2 + 2*i] = msg->plan_x[i];
+            m_vars[3 + 2*i] = msg->plan_y[i];
+        }
+        m_coeffs.resize(msg->coeffs.size());
+        for (size_t i=0; i < msg->coeffs.size(); i++)
+            m_coeffs[i] = msg->coeffs[i];
+        m_window.resize(std::min(msg->window_x.size(), msg->window_y.size()));
+        for (size_t i=0; i < m_window.size(); i++) {
+            m_window.x[i] = msg->window_x[i];
+            m_window.y[i] = msg->window_y[i];
+        }
+
+        m_visualizer.push(msg->header.stamp, msg->pos_x, msg->pos_y, std::sin(msg->psi), std::cos(msg->psi),
+                          m_vars, m_coeffs, m_window);
+    }
+
+    ros::NodeHandle & m_nodehandle;
+    double m_rate;
+    bool m_started;
+    Visualizer m_visualizer;
+    ros::Subscriber m_sub_debug;
+
+    ///* Handed over to the visualizer, which gives those of an older message
+    ///* back
+    std::vector<double> m_vars;
+    Eigen::VectorXd m_coeffs;
+    WaypointBuffer m_window;
+};
+
+}
+
+
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "mpc_debug_markers");
+
+    ros::NodeHandle nodehandle;
+    ros::NodeHandle private_nodehandle("~");
+    double rate = Params().debug_rate;
+    private_nodehandle.param("rate", rate, rate);
+
+    DebugMarkersNode node(nodehandle, rate);
+    ros::spin();
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Runs the controllers of several vehicles in one process, e.g. for the
+// simulation of a race, instead of an mpc_node_cpp per vehicle:
+//
+//   rosrun mpc mpc_host _vehicles:="[car1, car2]" [the parameters of mpc_node_cpp]
+//
+// Every vehicle gets an MPCControllerNode with its topics in its namespace
+// (car1/odom, car1/pf/pose/odom, car1/commands/servo/position, ...), its
+// reconfiguration in the host's private one (~car1) and its own flight log
+// (<flight_recorder>.car1), all with the parameters of the host. They share
+// what doesn't depend on the vehicle:
+// - the centerline (the same /centerline for all) and the structures derived
+//   from it, once per path (see SharedCenterlines);
+// - one work-stealing pool of threads, which runs their solver loops and
+//   all their parallel and speculative solves. CppAD is set up for the pool,
+//   so every one of them has its own memory and tapes.
+// The callbacks of every vehicle are served by a thread of its own.
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "mpc_node.h"
+#include "ParallelCppAD.h"
+
+
+namespace {
+
+struct Vehicle {
+    std::string name;
+    ros::CallbackQueue queue;
+    std::unique_ptr<ros::AsyncSpinner> spinner;
+    std::unique_ptr<MPCControllerNode> node;
+};
+
+}
+
+
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "mpc_host");
+
+    Params params;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    ros::NodeHandle private_nodehandle("~");
+    if (!parse_params(args, private_nodehandle, params))
+        return 1;
+
+    std::vector<std::string> names;
+    private_nodehandle.param("vehicles", names, names);
+    if (names.empty()) {
+        ROS_ERROR("No ~vehicles to control");
+        return 1;
+    }
+
+    // A thread per solver loop, and per solve each of them may run at the
+    // same time besides its main one; set up before anything tapes
+    size_t threads_per_vehicle = 1 + params.parallel_ref_v_scales.size() + (params.parallel_cold_start ? 1 : 0)
+            + params.reference_offsets.size() + (params.speculative_solve ? 1 : 0);
+    Eigen::NonBlockingThreadPool pool(int(names.size() * threads_per_vehicle));
+    if (!ParallelCppAD::setup(&pool))
+        return 1;
+
+    std::vector<std::unique_ptr<Vehicle> > vehicles;
+    for (const std::string & name : names) {
+        std::unique_ptr<Vehicle> vehicle(new Vehicle());
+        vehicle->name = name;
+        ros::NodeHandle nodehandle(name);
+        ros::NodeHandle vehicle_private_nodehandle(private_nodehandle, name);
+        nodehandle.setCallbackQueue(&vehicle->queue);
+        vehicle_private_nodehandle.setCallbackQueue(&vehicle->queue);
+
+        Params vehicle_params = params;
+        if (!params.flight_recorder.empty())
+            vehicle_params.flight_recorder = params.flight_recorder + "." + name;
+        vehicle->node.reset(new MPCControllerNode(nodehandle, vehicle_private_nodehandle, vehicle_params, &pool));
+        vehicle->spinner.reset(new ros::AsyncSpinner(1, &vehicle->queue));
+        vehicle->spinner->start();
+        vehicles.push_back(std::move(vehicle));
+    }
+    ROS_INFO("Controlling %lu vehicles on %d threads", vehicles.size(), pool.NumThreads());
+
+    // The solver loops, on the threads of the pool for as long as the host
+    // runs
+    std::mutex mutex;
+    std::condition_variable loops_done;
+    size_t num_loops = vehicles.size();
+    {
+        ParallelCppAD::Section parallel;
+        for (std::unique_ptr<Vehicle> & vehicle : vehicles) {
+            MPCControllerNode * node = vehicle->node.get();
+            pool.Schedule([node, &mutex, &loops_done, &num_loops]() {
+                node->loop();
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--num_loops == 0)
+                    loops_done.notify_one();
+            });
+        }
+
+        ros::waitForShutdown();
+        for (std::unique_ptr<Vehicle> & vehicle : vehicles)
+            vehicle->node->stop();
+        std::unique_lock<std::mutex> lock(mutex);
+        loops_done.wait(lock, [&num_loops]() { return num_loops == 0; });
+    }
+
+    // The nodes go before the pool their controllers solve on
+    for (std::unique_ptr<Vehicle> & vehicle : vehicles)
+        vehicle->spinner->stop();
+    vehicles.clear();
+    return 0;
+}
@@ -0,0 +1,357 @@
+// Statistics of the ticks of many flight logs (see FlightRecorder), e.g. of
+// a whole race weekend, without ROS:
+//
+//   mpc_log_stats [--threads N] [--chunk N] [--track waypoints.csv [--segments N]] flight.log...
+//
+// The ticks are grouped by the configuration of the solver (the flags, the
+// precision and the step of the log's header, and the horizon of the tick)
+// and, with --track, by the segment of the track they were at (the
+// waypoints cut in `--segments` runs of the same number of them). Every
+// group gets the percentiles of its tick and solve times, its deadline
+// misses, its failed solves and the statistics of its cte; every
+// configuration the counts of the events of its ticks, which tell what the
+// failures came from.
+//
+// The logs are mapped (see MappedFlightLog), not read, and cut in chunks of
+// `--chunk` ticks that the threads claim one after the other. A thread
+// copies the few fields of a chunk it needs into columns first, then sums
+// the columns up into its own groups, which are merged once all the chunks
+// are done: the percentiles are those of LatencyHistogram, whose merge is
+// exact.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FlightRecorder.h"
+#include "LatencyHistogram.h"
+#include "OfflineTools.h"
+#include "SpatialGrid.h"
+#include "VehicleModel.h"
+#include "WaypointLoader.h"
+
+
+static const size_t DEFAULT_CHUNK = 16384;
+
+static const int DEFAULT_SEGMENTS = 10;
+
+// The names of the TelemetryRecord::Event bits, in their order
+static const char * const EVENT_NAMES[] = {
+    "no_optimization", "x_delta_too_low", "deadline_hit", "steer_clipped_low", "steer_clipped_high",
+    "solve_failed", "go", "restoration", "horizon_switched", "variant_used", "explicit_law", "cache_hit",
+    "solve_skipped", "fallback", "lap_progress", "speculation_hit", "remote_used", "plan_invalid", "fit_reused",
+    "reference_switched", "backend_switched", "contingency", "diverged", "lap_seeded"
+};
+static const size_t NUM_EVENTS = sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]);
+
+static const char * const FALLBACK_NAMES[] = {"none", "shifted_plan", "pid"};
+static const size_t NUM_FALLBACKS = sizeof(FALLBACK_NAMES) / sizeof(FALLBACK_NAMES[0]);
+
+// The ticks that didn't solve, so have no solve time
+static const uint32_t NOT_SOLVED = TelemetryRecord::NO_OPTIMIZATION | TelemetryRecord::CACHE_HIT
+        | TelemetryRecord::SOLVE_SKIPPED | TelemetryRecord::SPECULATION_HIT;
+
+
+// The ticks of a configuration, a horizon and a segment
+struct Group {
+    LatencyHistogram tick_times;
+    LatencyHistogram solve_times;
+    uint64_t ticks = 0;
+    uint64_t deadline_misses = 0;
+    uint64_t failures = 0;
+    ///* Of the ticks with a fit
+    uint64_t fits = 0;
+    double cte_sum = 0.0;
+    double cte_sum2 = 0.0;
+    double cte_max = 0.0;
+
+    void merge(const Group & other) {
+        tick_times.merge(other.tick_times);
+        solve_times.merge(other.solve_times);
+        ticks += other.ticks;
+        deadline_misses += other.deadline_misses;
+        failures += other.failures;
+        fits += other.fits;
+        cte_sum += other.cte_sum;
+        cte_sum2 += other.cte_sum2;
+        cte_max = std::max(cte_max, other.cte_max);
+    }
+};
+
+
+// The events of the ticks of a configuration
+struct Causes {
+    uint64_t events[NUM_EVENTS] = {};
+    uint64_t fallbacks[NUM_FALLBACKS] = {};
+
+    void merge(const Causes & other) {
+        for (size_t e=0; e < NUM_EVENTS; e++)
+            events[e] += other.events[e];
+        for (size_t f=0; f < NUM_FALLBACKS; f++)
+            fallbacks[f] += other.fallbacks[f];
+    }
+};
+
+
+// A group by its configuration, its horizon and its segment (+1, 0 for
+// none), in that order
+static uint64_t group_key(uint32_t configuration, uint16_t steps_ahead, int segment) {
+    return (uint64_t(configuration) << 48) | (uint64_t(steps_ahead) << 32) | uint64_t(uint32_t(segment + 1));
+}
+
+
+// What a thread adds up, and the columns of its chunk
+struct Partial {
+    std::map<uint64_t, std::unique_ptr<Group> > groups;
+    std::vector<Causes> causes;
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> events;
+    std::vector<uint8_t> fallbacks;
+    std::vector<uint8_t> fits;
+    std::vector<float> tick_times;
+    std::vector<float> solve_times;
+    std::vector<float> ctes;
+
+    Group & group(uint64_t key) {
+        std::unique_ptr<Group> & group = groups[key];
+        if (!group)
+            group.reset(new Group);
+        return *group;
+    }
+};
+
+
+// Consecutive ticks of a log
+struct Chunk {
+    size_t log;
+    size_t begin;
+    size_t end;
+};
+
+
+// The segment of the track at (x, y), -1 without a track
+struct Segments {
+    SpatialGrid grid;
+    size_t num_waypoints = 0;
+    int count = 0;
+
+    int at(double x, double y) const {
+        if (grid.empty())
+            return -1;
+        int nearest = grid.nearest(x, y);
+        return (nearest < 0) ? -1 : int(size_t(nearest) * size_t(count) / num_waypoints);
+    }
+};
+
+
+// Copies the fields of the ticks of the chunk into the columns, then adds
+// them up
+static void scan(const MappedFlightLog & log, uint32_t configuration, const Chunk & chunk,
+                 const Segments & segments, Partial & partial) {
+    size_t count = chunk.end - chunk.begin;
+    partial.keys.resize(count);
+    partial.events.resize(count);
+    partial.fallbacks.resize(count);
+    partial.fits.resize(count);
+    partial.tick_times.resize(count);
+    partial.solve_times.resize(count);
+    partial.ctes.resize(count);
+
+    for (size_t k=0; k < count; k++) {
+        const FlightRecord & record = log[chunk.begin + k];
+        int segment = (record.inputs & TelemetryRecord::INPUT_POS) ? segments.at(record.pos_x, record.pos_y) : -1;
+        partial.keys[k] = group_key(configuration, record.steps_ahead, segment);
+        partial.events[k] = record.events;
+        partial.fallbacks[k] = record.fallback;
+        partial.fits[k] = (record.num_coeffs > 0);
+        partial.tick_times[k] = record.stage_time[TelemetryRecord::STAGE_TICK];
+        partial.solve_times[k] = float(record.solve_time());
+        partial.ctes[k] = float(record.cte);
+    }
+
+    // The ticks of a group come in runs (a horizon and a segment last)
+    Causes & causes = partial.causes[configuration];
+    Group * group = nullptr;
+    uint64_t current_key = 0;
+    for (size_t k=0; k < count; k++) {
+        if (group == nullptr or partial.keys[k] != current_key) {
+            current_key = partial.keys[k];
+            group = &partial.group(current_key);
+        }
+        uint32_t events = partial.events[k];
+        group->ticks++;
+        if (partial.tick_times[k] >= 0.0f)
+            group->tick_times.record(partial.tick_times[k]);
+        if ((events & NOT_SOLVED) == 0)
+            group->solve_times.record(partial.solve_times[k]);
+        if (events & TelemetryRecord::DEADLINE_HIT)
+            group->deadline_misses++;
+        if (events & (TelemetryRecord::SOLVE_FAILED | TelemetryRecord::FALLBACK))
+            group->failures++;
+        if (partial.fits[k]) {
+            double cte = partial.ctes[k];
+            group->fits++;
+            group->cte_sum += cte;
+            group->cte_sum2 += cte * cte;
+            group->cte_max = std::max(group->cte_max, std::abs(cte));
+        }
+
+        for (size_t e=0; e < NUM_EVENTS; e++)
+            causes.events[e] += (events >> e) & 1;
+        if (partial.fallbacks[k] < NUM_FALLBACKS)
+            causes.fallbacks[partial.fallbacks[k]]++;
+    }
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--threads N] [--chunk N] [--track waypoints.csv [--segments N]] "
+                 "flight.log...\n", program);
+    std::fprintf(stderr, "  --threads N   of the scan (default: the cores)\n");
+    std::fprintf(stderr, "  --chunk N     the ticks a thread claims at once (default: %lu)\n", DEFAULT_CHUNK);
+    std::fprintf(stderr, "  --track CSV   the waypoints of the track, to group the ticks by its segments\n");
+    std::fprintf(stderr, "  --segments N  of the track (default: %d)\n", DEFAULT_SEGMENTS);
+}
+
+
+int main(int argc, char ** argv) {
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk_size = DEFAULT_CHUNK;
+    int num_segments = DEFAULT_SEGMENTS;
+    std::string track_path;
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--threads" or arg == "--chunk" or arg == "--track" or arg == "--segments")
+                and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--threads")
+                num_threads = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+            else if (arg == "--chunk")
+                chunk_size = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+            else if (arg == "--track")
+                track_path = value;
+            else
+                num_segments = std::max(1, std::atoi(value.c_str()));
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Segments segments;
+    if (!track_path.empty()) {
+        Waypoints waypoints;
+        if (!load_waypoints(track_path, 0.05, waypoints))
+            return 1;
+        segments.grid.build(waypoints.x, waypoints.y);
+        segments.num_waypoints = waypoints.x.size();
+        segments.count = num_segments;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // The logs, their configurations and their chunks
+    std::vector<std::unique_ptr<MappedFlightLog> > logs;
+    std::vector<uint32_t> log_configurations;
+    std::vector<std::string> configurations;
+    std::vector<Chunk> chunks;
+    size_t num_ticks = 0;
+    for (const std::string & path : paths) {
+        std::unique_ptr<MappedFlightLog> log(new MappedFlightLog);
+        if (!log->open(path))
+            continue;
+        std::string label = configuration_label(log->header());
+        size_t c = std::find(configurations.begin(), configurations.end(), label) - configurations.begin();
+        if (c == configurations.size())
+            configurations.push_back(label);
+        for (size_t begin=0; begin < log->size(); begin += chunk_size)
+            chunks.push_back({logs.size(), begin, std::min(begin + chunk_size, log->size())});
+        num_ticks += log->size();
+        log_configurations.push_back(uint32_t(c));
+        logs.push_back(std::move(log));
+    }
+    if (logs.empty())
+        return 1;
+
+    // The chunks, claimed by the threads in order
+    num_threads = std::min(num_threads, std::max<size_t>(1, chunks.size()));
+    std::vector<Partial> partials(num_threads);
+    std::atomic<size_t> next(0);
+    auto work = [&](Partial & partial) {
+        partial.causes.resize(configurations.size());
+        for (size_t c=next.fetch_add(1); c < chunks.size(); c=next.fetch_add(1)) {
+            const Chunk & chunk = chunks[c];
+            scan(*logs[chunk.log], log_configurations[chunk.log], chunk, segments, partial);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t=1; t < num_threads; t++)
+        threads.emplace_back(work, std::ref(partials[t]));
+    work(partials[0]);
+    for (std::thread & thread : threads)
+        thread.join();
+
+    Partial & total = partials[0];
+    for (size_t t=1; t < num_threads; t++) {
+        for (auto & entry : partials[t].groups)
+            total.group(entry.first).merge(*entry.second);
+        for (size_t c=0; c < configurations.size(); c++)
+            total.causes[c].merge(partials[t].causes[c]);
+    }
+    double scan_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%lu logs, %lu ticks scanned in %.3f s (%lu threads)\n", logs.size(), num_ticks, scan_time,
+                num_threads);
+
+    std::printf("%-32s %5s %7s %9s %9s %9s %9s %9s %9s %9s %7s %7s %8s %8s %8s\n", "configuration", "steps",
+                "segment", "ticks", "tick p50", "tick p99", "tick max", "solve p50", "solve p99", "solve max",
+                "misses", "failed", "cte mean", "cte rms", "cte max");
+    std::printf("%-32s %5s %7s %9s %9s %9s %9s %9s %9s %9s %7s %7s %8s %8s %8s\n", "", "", "", "", "[ms]", "[ms]",
+                "[ms]", "[ms]", "[ms]", "[ms]", "", "", "[m]", "[m]", "[m]");
+    for (auto & entry : total.groups) {
+        uint64_t key = entry.first;
+        const Group & group = *entry.second;
+        int segment = int(uint32_t(key)) - 1;
+        char segment_name[16] = "-";
+        if (segment >= 0)
+            std::snprintf(segment_name, sizeof(segment_name), "%d", segment);
+        double fits = std::max<double>(1.0, double(group.fits));
+        std::printf("%-32s %5u %7s %9lu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %7lu %7lu %8.4f %8.4f %8.4f\n",
+                    configurations[key >> 48].c_str(), unsigned((key >> 32) & 0xffff), segment_name,
+                    group.ticks, 1e3 * group.tick_times.percentile(50), 1e3 * group.tick_times.percentile(99),
+                    1e3 * group.tick_times.max(), 1e3 * group.solve_times.percentile(50),
+                    1e3 * group.solve_times.percentile(99), 1e3 * group.solve_times.max(), group.deadline_misses,
+                    group.failures, group.cte_sum / fits, std::sqrt(group.cte_sum2 / fits), group.cte_max);
+    }
+
+    // What the ticks of every configuration ran into
+    for (size_t c=0; c < configurations.size(); c++) {
+        const Causes & causes = total.causes[c];
+        std::printf("%s:", configurations[c].c_str());
+        for (size_t e=0; e < NUM_EVENTS; e++)
+            if (causes.events[e] > 0)
+                std::printf(" %s=%lu", EVENT_NAMES[e], causes.events[e]);
+        for (size_t f=1; f < NUM_FALLBACKS; f++)
+            if (causes.fallbacks[f] > 0)
+                std::printf(" fallback_%s=%lu", FALLBACK_NAMES[f], causes.fallbacks[f]);
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,441 @@
+// Times the kernels of a tick one by one, without ROS, for baselines of the
+// fitting and the solver code:
+//
+//   mpc_microbench [--tries N] [--filter TEXT] [--config NAME] waypoints.csv...
+//
+// The kernels: polyfit for sizes of the window and degrees of the
+// polynomial, and for batches of windows (polyfit_batch), polyeval and polyeval_diff, the search of the closest waypoint
+// (SpatialGrid::nearest, as in ControlPipeline, and the linear scan it
+// replaced) and the path tracking of a tick (PathTracker, for the --config:
+// the closest waypoint, the window and the fit, and the first two on their
+// own) on the paths of the CSVs, taping and evaluating FG_eval, the batched rollouts of the model
+// (BatchRollout, on the calling thread and on a pool), and MPC::Solve for
+// horizons of 5 to 40 steps.
+//
+// Every kernel is repeated for at least MIN_TRY_TIME per try, and the best
+// and the mean time of a call over the tries are reported (build it in
+// Release for meaningful numbers).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <cppad/cppad.hpp>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/bench/BenchTimer.h"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "MPC.h"
+#include "BatchRollout.h"
+#include "FG_eval.h"
+#include "OfflineTools.h"
+#include "PathTracker.h"
+#include "SpatialGrid.h"
+#include "WaypointLoader.h"
+
+
+// A try lasts at least this long [s], with as many calls as it takes
+static const double MIN_TRY_TIME = 0.01;
+static const int MAX_REPETITIONS = 1 << 24;
+
+// The waypoints the fit benchmarks are made of: along y = CURVATURE x^2
+static const double CURVATURE = 0.1;
+static const double SPACING = 0.05; // [m]
+
+// The kernels' parameters
+static const size_t WINDOW_SIZES[] = {10, 25, 50, 100};
+static const int DEGREES[] = {1, 2, 3};
+static const size_t HORIZONS[] = {5, 10, 20, 30, 40};
+static const size_t BATCH_SIZES[] = {16, 256, 4096};
+// The chunks of the batched rollouts on the pool
+static const size_t ROLLOUT_THREADS = 4;
+
+// The queries of the closest waypoint are this far off the path
+static const double QUERY_OFFSET = 0.1; // [m]
+
+
+struct Options {
+    int tries = 10;
+    std::string filter;
+};
+
+
+// Times `kernel` (called with no arguments) as `name`, unless filtered out
+template <class Kernel>
+static void bench(const Options & options, const std::string & name, Kernel kernel) {
+    if (!options.filter.empty() and name.find(options.filter) == std::string::npos)
+        return;
+
+    // As many calls per try as last MIN_TRY_TIME
+    Eigen::BenchTimer timer;
+    int repetitions = 1;
+    while (true) {
+        timer.reset();
+        timer.start();
+        for (int r=0; r < repetitions; r++)
+            kernel();
+        timer.stop();
+        if (timer.value(Eigen::REAL_TIMER) >= MIN_TRY_TIME or repetitions >= MAX_REPETITIONS)
+            break;
+        repetitions *= 2;
+    }
+
+    BENCH(timer, options.tries, repetitions, kernel());
+
+    std::printf("%-40s %10d %12.3f %12.3f\n", name.c_str(), options.tries * repetitions,
+                1e6 * timer.best(Eigen::REAL_TIMER) / repetitions,
+                1e6 * timer.total(Eigen::REAL_TIMER) / (options.tries * repetitions));
+    std::fflush(stdout);
+}
+
+
+static void bench_polynomials(const Options & options) {
+    for (size_t n : WINDOW_SIZES) {
+        std::vector<double> xs(n), ys(n);
+        for (size_t i=0; i < n; i++) {
+            xs[i] = SPACING * i;
+            ys[i] = CURVATURE * xs[i] * xs[i];
+        }
+        for (int degree : DEGREES) {
+            Eigen::VectorXd coeffs;
+            bench(options, "polyfit/" + std::to_string(n) + "/" + std::to_string(degree), [&]() {
+                polyfit(xs.data(), ys.data(), n, degree, coeffs);
+                escape(coeffs.data());
+            });
+        }
+    }
+
+    // The same windows fit BATCH_SIZES at a time, by polyfit_batch and one by
+    // one (the times are of the whole batch)
+    for (size_t count : BATCH_SIZES) {
+        size_t n = WINDOW_SIZES[1];
+        std::vector<double> xs(n * count), ys(n * count), window_x(n), window_y(n);
+        for (size_t p=0; p < count; p++) {
+            double curvature = CURVATURE * (1.0 + double(p) / count);
+            for (size_t i=0; i < n; i++) {
+                xs[i * count + p] = SPACING * i;
+                ys[i * count + p] = curvature * SPACING * i * SPACING * i;
+            }
+        }
+        for (int degree : DEGREES) {
+            std::string suffix = std::to_string(n) + "/" + std::to_string(degree) + "/" + std::to_string(count);
+            std::vector<double> batch_coeffs((degree + 1) * count);
+            bench(options, "polyfit_batch/" + suffix, [&]() {
+                polyfit_batch(xs.data(), ys.data(), n, count, degree, batch_coeffs.data());
+                escape(batch_coeffs.data());
+            });
+            Eigen::VectorXd coeffs;
+            bench(options, "polyfit_each/" + suffix, [&]() {
+                for (size_t p=0; p < count; p++) {
+                    for (size_t i=0; i < n; i++) {
+                        window_x[i] = xs[i * count + p];
+                        window_y[i] = ys[i * count + p];
+                    }
+                    polyfit(window_x.data(), window_y.data(), n, degree, coeffs);
+                    escape(coeffs.data());
+                }
+            });
+        }
+    }
+
+    for (int degree : DEGREES) {
+        Eigen::VectorXd coeffs = Eigen::VectorXd::LinSpaced(degree + 1, 0.5, 0.1);
+        double x = 0.3;
+        double value = 0.0, derivative = 0.0;
+        bench(options, "polyeval/" + std::to_string(degree), [&]() {
+            value = polyeval(coeffs, x);
+            escape(&value);
+        });
+        bench(options, "polyeval_diff/" + std::to_string(degree), [&]() {
+            derivative = polyeval_diff(coeffs, x);
+            escape(&derivative);
+        });
+        bench(options, "polyeval_with_diff/" + std::to_string(degree), [&]() {
+            polyeval_with_diff(coeffs, x, value, derivative);
+            escape(&value);
+            escape(&derivative);
+        });
+    }
+}
+
+
+// The poses next to every waypoint in turn, heading along the path
+static void make_queries(const Waypoints & waypoints, std::vector<double> & query_x, std::vector<double> & query_y,
+                         std::vector<double> & query_psi) {
+    const std::vector<double> & pts_x = waypoints.x;
+    const std::vector<double> & pts_y = waypoints.y;
+    size_t n = pts_x.size();
+    query_x.resize(n);
+    query_y.resize(n);
+    query_psi.resize(n);
+    for (size_t i=0; i < n; i++) {
+        size_t prev = (i + n - 1) % n;
+        size_t next = (i + 1) % n;
+        double heading = atan2(pts_y[next] - pts_y[prev], pts_x[next] - pts_x[prev]);
+        query_x[i] = pts_x[i] - QUERY_OFFSET * sin(heading);
+        query_y[i] = pts_y[i] + QUERY_OFFSET * cos(heading);
+        query_psi[i] = heading;
+    }
+}
+
+
+static void bench_closest(const Options & options, const std::string & name, const Waypoints & waypoints) {
+    const std::vector<double> & pts_x = waypoints.x;
+    const std::vector<double> & pts_y = waypoints.y;
+    size_t n = pts_x.size();
+
+    SpatialGrid grid;
+    grid.build(pts_x, pts_y);
+
+    // Next to every waypoint in turn
+    std::vector<double> query_x, query_y, query_psi;
+    make_queries(waypoints, query_x, query_y, query_psi);
+
+    size_t q = 0;
+    int closest = -1;
+    bench(options, "find_closest/grid/" + name, [&]() {
+        closest = grid.nearest(query_x[q], query_y[q]);
+        escape(&closest);
+        q = (q + 1 == n) ? 0 : q + 1;
+    });
+    bench(options, "find_closest/linear/" + name, [&]() {
+        double best = std::numeric_limits<double>::max();
+        for (size_t i=0; i < n; i++) {
+            double dx = pts_x[i] - query_x[q];
+            double dy = pts_y[i] - query_y[q];
+            double dist = dx * dx + dy * dy;
+            if (dist < best) {
+                best = dist;
+                closest = int(i);
+            }
+        }
+        escape(&closest);
+        q = (q + 1 == n) ? 0 : q + 1;
+    });
+}
+
+
+static void bench_tracker(const Options & options, const std::string & name, const Waypoints & waypoints,
+                          const Params & params) {
+    Centerline centerline;
+    centerline.pts_x = waypoints.x;
+    centerline.pts_y = waypoints.y;
+    PathTracker::prepare_centerline(centerline, params);
+
+    std::vector<double> query_x, query_y, query_psi;
+    make_queries(waypoints, query_x, query_y, query_psi);
+    size_t n = query_x.size();
+
+    // Along the path, as the car would drive it: the whole tick, then its
+    // stages (the fit is what the tick takes on top of the window)
+    PathTracker tracker(params);
+    TelemetryRecord record;
+    Eigen::VectorXd coeffs;
+    size_t q = 0;
+    bench(options, "path_tracker/" + name, [&]() {
+        int closest = tracker.closest_waypoint(centerline, query_x[q], query_y[q], record);
+        tracker.make_window(centerline, closest, query_x[q], query_y[q], query_psi[q], record);
+        tracker.fit(centerline, query_x[q], query_y[q], query_psi[q], coeffs);
+        escape(coeffs.data());
+        q = (q + 1 == n) ? 0 : q + 1;
+    });
+
+    std::vector<int> closest(n);
+    PathTracker closest_tracker(params);
+    q = 0;
+    bench(options, "path_tracker/closest/" + name, [&]() {
+        closest[q] = closest_tracker.closest_waypoint(centerline, query_x[q], query_y[q], record);
+        escape(&closest[q]);
+        q = (q + 1 == n) ? 0 : q + 1;
+    });
+    for (size_t i=0; i < n; i++)
+        closest[i] = closest_tracker.closest_waypoint(centerline, query_x[i], query_y[i], record);
+
+    PathTracker window_tracker(params);
+    double fraction_OK = 0.0;
+    q = 0;
+    bench(options, "path_tracker/window/" + name, [&]() {
+        fraction_OK = window_tracker.make_window(centerline, closest[q], query_x[q], query_y[q], query_psi[q],
+                                                 record);
+        escape(&fraction_OK);
+        q = (q + 1 == n) ? 0 : q + 1;
+    });
+}
+
+
+static void bench_fg_eval(const Options & options, const Params & base) {
+    Eigen::VectorXd coeffs(base.poly_degree + 1);
+    coeffs.setZero();
+    coeffs[1] = 0.1;
+    if (base.poly_degree >= 2)
+        coeffs[2] = CURVATURE;
+
+    for (size_t horizon : HORIZONS) {
+        Params params = base;
+        params.steps_ahead = horizon;
+
+        // Same layout of the variables as in MPC::MPC
+        Indexes indexes;
+        indexes.x_start = 0;
+        indexes.y_start = indexes.x_start + params.steps_ahead;
+        indexes.psi_start = indexes.y_start + params.steps_ahead;
+        indexes.cte_start = indexes.psi_start + params.steps_ahead;
+        indexes.epsi_start = indexes.cte_start + params.steps_ahead;
+        indexes.delta_start = indexes.epsi_start + params.steps_ahead;
+        indexes.v_start = indexes.delta_start + params.steps_ahead - 1;
+
+        size_t n_vars = params.steps_ahead * 5 + (params.steps_ahead - 1) * 2;
+        size_t n_constraints = params.steps_ahead * 5;
+
+        FG_eval::ADvector a_vars(n_vars);
+        FG_eval::ADvector a_fg(1 + n_constraints);
+        CppAD::ADFun<double> fun;
+        std::string suffix = "/" + std::to_string(horizon);
+
+        bench(options, "fg_eval/tape" + suffix, [&]() {
+            for (size_t i=0; i < n_vars; i++)
+                a_vars[i] = 0.0;
+            CppAD::Independent(a_vars);
+            FG_eval fg_eval(coeffs, params, indexes, params.ref_v);
+            fg_eval(a_fg, a_vars);
+            fun.Dependent(a_vars, a_fg);
+        });
+
+        std::vector<double> x(n_vars, 0.0);
+        for (size_t i=indexes.v_start; i < n_vars; i++)
+            x[i] = params.ref_v;
+        std::vector<double> fg, w(1 + n_constraints, 1.0), gradient;
+        bench(options, "fg_eval/forward" + suffix, [&]() {
+            fg = fun.Forward(0, x);
+            escape(fg.data());
+        });
+        bench(options, "fg_eval/reverse" + suffix, [&]() {
+            fun.Forward(0, x);
+            gradient = fun.Reverse(1, w);
+            escape(gradient.data());
+        });
+    }
+}
+
+
+static void bench_rollout(const Options & options, const Params & base) {
+    Eigen::VectorXd coeffs(base.poly_degree + 1);
+    coeffs.setZero();
+    coeffs[1] = 0.1;
+    if (base.poly_degree >= 2)
+        coeffs[2] = CURVATURE;
+    Eigen::NonBlockingThreadPool pool(int(ROLLOUT_THREADS - 1));
+    BatchRollout rollout(base);
+
+    for (size_t batch_size : BATCH_SIZES) {
+        // Around the reference, with the inputs spread over the actuators'
+        // range
+        Eigen::ArrayXXd initial = Eigen::ArrayXXd::Zero(batch_size, BatchRollout::STATE_SIZE);
+        initial.col(BatchRollout::R_CTE) = coeffs[0] + QUERY_OFFSET * Eigen::ArrayXd::Random(batch_size);
+        Eigen::ArrayXXd delta = 0.4 * Eigen::ArrayXXd::Random(batch_size, base.steps_ahead - 1);
+        Eigen::ArrayXXd v = base.ref_v * (1.0 + 0.5 * Eigen::ArrayXXd::Random(batch_size, base.steps_ahead - 1));
+        std::string suffix = "/" + std::to_string(batch_size) + "x" + std::to_string(base.steps_ahead);
+
+        rollout.set_pool(nullptr, 1);
+        bench(options, "rollout/serial" + suffix, [&]() {
+            rollout.rollout(initial, delta, v, coeffs);
+            escape(const_cast<double *>(rollout.state(BatchRollout::R_CTE).data()));
+        });
+        rollout.set_pool(&pool, ROLLOUT_THREADS);
+        bench(options, "rollout/pool" + std::to_string(ROLLOUT_THREADS) + suffix, [&]() {
+            rollout.rollout(initial, delta, v, coeffs);
+            escape(const_cast<double *>(rollout.state(BatchRollout::R_CTE).data()));
+        });
+    }
+}
+
+
+static void bench_solve(const Options & options, const Params & base) {
+    for (size_t horizon : HORIZONS) {
+        Params params = base;
+        params.steps_ahead = horizon;
+        MPC controller(params);
+
+        // On a bend, a little off the path
+        Eigen::VectorXd coeffs(params.poly_degree + 1);
+        coeffs.setZero();
+        if (params.poly_degree >= 2)
+            coeffs[2] = CURVATURE;
+        Eigen::VectorXd state(5);
+        state << 0, 0, 0, coeffs[0] - QUERY_OFFSET, 0;
+        std::vector<double> vars;
+
+        bench(options, "solve/" + std::to_string(horizon), [&]() {
+            controller.Solve(state, coeffs, params.ref_v, vars);
+            escape(vars.data());
+        });
+    }
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--tries N] [--filter TEXT] [--config NAME] waypoints.csv...\n", program);
+    std::fprintf(stderr, "  --tries N     tries of every kernel (default: 10)\n");
+    std::fprintf(stderr, "  --filter      only the kernels whose name contains TEXT\n");
+    std::fprintf(stderr, "  --config      the solver configuration of MPC::Solve (default: ipopt), one of");
+    for (const Configuration & configuration : CONFIGURATIONS)
+        std::fprintf(stderr, " %s", configuration.name);
+    std::fprintf(stderr, "\n");
+}
+
+
+int main(int argc, char ** argv) {
+    Options options;
+    const Configuration * configuration = &CONFIGURATIONS[0];
+    std::vector<std::string> csv_paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--tries" or arg == "--filter" or arg == "--config") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--tries") {
+                options.tries = std::max(std::atoi(value.c_str()), 1);
+            } else if (arg == "--filter") {
+                options.filter = value;
+            } else {
+                configuration = find_configuration(value);
+                if (configuration == nullptr) {
+                    std::fprintf(stderr, "Unknown configuration \"%s\"\n", value.c_str());
+                    usage(argv[0]);
+                    return 1;
+                }
+            }
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            csv_paths.push_back(arg);
+        }
+    }
+
+    Params params = default_params();
+    configuration->apply(params);
+
+    std::printf("%-40s %10s %12s %12s\n", "kernel", "calls", "best [us]", "mean [us]");
+    bench_polynomials(options);
+    for (const std::string & csv_path : csv_paths) {
+        Waypoints waypoints;
+        if (!load_waypoints(csv_path, 0.05, waypoints))
+            return 1;
+        if (waypoints.x.size() < 3) {
+            std::fprintf(stderr, "%s: too few waypoints (%lu)\n", csv_path.c_str(), waypoints.x.size());
+            return 1;
+        }
+        std::string name = csv_path.substr(csv_path.find_last_of('/') + 1);
+        bench_closest(options, name, waypoints);
+        bench_tracker(options, name, waypoints, params);
+    }
+    bench_fg_eval(options, params);
+    bench_rollout(options, params);
+    bench_solve(options, params);
+    return 0;
+}
@@ -1,443 +1,1542 @@
 #include <math.h> /* floor, abs */
 #include <cmath> /* atan2, M_PI */
 #include <string>
-#include <sstream>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <chrono>
 
 #include <ros/ros.h>
 #include <ros/console.h>
 #include <std_msgs/Float64.h>
+#include <std_msgs/Float64MultiArray.h>
 #include <visualization_msgs/Marker.h>
 #include <nav_msgs/Odometry.h>
 
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
 #include "mpc_node.h"
 #include "MPC.h"
+#include "InputMessages.h"
+#include "SharedCenterlines.h"
+#include "SolverBackend.h"
+#include "SolverCalibration.h"
+#include "TrackStore.h"
+#include "Trace.h"
+
+
+constexpr double MPCControllerNode::POSE_WAIT_TIMEOUT;
+constexpr size_t MPCControllerNode::PREFAULT_STACK_SIZE;
+constexpr size_t MPCControllerNode::STATS_COLUMNS;
+constexpr size_t MPCControllerNode::PERF_COLUMNS;
+constexpr size_t MPCControllerNode::CPU_COLUMNS;
+constexpr size_t MPCControllerNode::MEMORY_COLUMNS;
+constexpr double MPCControllerNode::TRACE_DUMP_INTERVAL;
+constexpr size_t MPCControllerNode::PIPELINE_DEPTH;
+
+
+// The transport of the small high-rate topics (see `Params::pose_transport`)
+static ros::TransportHints pose_transport_hints(const std::string & transport) {
+    // Over TCP (without Nagle's delay) from the publishers that have no UDP
+    if (transport == "udp")
+        return ros::TransportHints().unreliable().reliable().tcpNoDelay();
+    if (transport == "tcp_nodelay")
+        return ros::TransportHints().tcpNoDelay();
+    if (transport != "tcp")
+        MPC_WARN("Unknown pose_transport \"%s\", using tcp", transport.c_str());
+    return ros::TransportHints();
+}
 
 
-MPCControllerNode::MPCControllerNode(const ros::NodeHandle & nodehandle, const Params & params)
-        : m_controller(params)
+MPCControllerNode::MPCControllerNode(const ros::NodeHandle & nodehandle, const ros::NodeHandle & private_nodehandle,
+                                     const Params & params, Eigen::ThreadPoolInterface * pool)
+        : m_pipeline(params, pool), m_params(params), m_params_snapshot(std::make_shared<const Params>(params)),
+          m_params_version(0), m_params_applied(0), m_diagnostics(nodehandle), m_follower(params)
 {
 
     m_nodehandle = nodehandle;
     m_old_time = ros::Time::now();
     m_last_stop_msg_ts = ros::Time::now().toSec();
 
-    m_pts_OK = false;
-    m_pos_OK = false;
-    m_speed_OK = false;
-    m_psi_OK = false;
-
-    m_ref_v = params.ref_v;
-    m_ref_v_alpha = params.ref_v_alpha;
-    m_poly_degree = params.poly_degree;
-    m_num_steps_poly = params.num_steps_poly;
+    m_scheduler = (params.scheduler == "pose") ? Scheduler::POSE : Scheduler::RATE;
+    m_loop_rate = params.loop_rate;
+    m_tracking_rate = params.tracking_rate;
+    m_tracking_latency = params.latency;
+    m_actuation_rate = params.actuation_rate;
+    if (m_actuation_rate > 0.0 and m_tracking_rate > 0.0) {
+        ROS_WARN("actuation_rate and tracking_rate both publish the commands, ignoring actuation_rate");
+        m_actuation_rate = 0.0;
+    }
+    if (params.rate_governor) {
+        if (params.scheduler == "pose" or params.pipelined)
+            ROS_WARN("rate_governor needs the rate scheduler, not pipelined, ignoring it");
+        else
+            m_governor.reset(new RateGovernor(params.governor_min_rate, params.loop_rate, params.governor_miss_ratio));
+    }
+    m_tick_commands_OK = false;
+    m_tick_steer_cmd = 0.0;
+    m_tick_rpm = 0.0;
+    m_tick_events = 0;
+    if (params.contingency_decel > 0.0)
+        m_contingency.reset(new ContingencyPlanner(params));
+    m_contingency_pose_timeout = params.contingency_pose_timeout;
+    m_contingency_engaged = false;
+    m_pose_seq = 0;
+    m_pipelined = params.pipelined;
+    m_prepared_seq = 0;
+    m_centerline_skipped = 0;
+    m_running = true;
+    m_priority_stop = params.priority_stop;
+    m_stopped = false;
+    if (m_priority_stop)
+        m_pipeline.set_cancel_flag(&m_stopped);
+    m_graph_inputs = nullptr;
+    m_graph_record = nullptr;
+    if (params.task_graph)
+        build_tick_graph();
 
     m_debug = params.debug;
-    m_go_flag = false;
 
-    ///* Actuators
-    m_steer = CENTER_IN_DZIK;
-    m_rpm = 0;
+    m_rt_cpu = params.rt_cpu;
+    m_rt_priority = params.rt_priority;
+    m_rt_lock_memory = params.rt_lock_memory;
+    m_warmup_solves = params.warmup_solves;
+    m_parallel_build = params.parallel_build;
+    m_solvers_ready = false;
+    m_pending_go = 0;
+
+    m_stats_period = params.stats_period;
+    m_perf_counters = params.perf_counters;
+    m_cpu_time = params.cpu_time;
+    if (!params.power_rail.empty())
+        m_power_rail.open(params.power_rail, params.power_rail_scale);
+    for (size_t start=0; start < params.predicted_backends.size();) {
+        size_t end = std::min(params.predicted_backends.find(',', start), params.predicted_backends.size());
+        if (end > start)
+            m_backend_names.push_back(params.predicted_backends.substr(start, end - start));
+        start = end + 1;
+    }
+    if (m_backend_names.empty())
+        m_backend_names.push_back(backend_name(params));
+    m_control_period = (params.solve_deadline > 0.0) ? params.solve_deadline : 1.0 / params.loop_rate;
+    m_stats_handed_over = ros::Time::now();
+
+    m_trace_directory = params.trace_directory;
+    InstrumentationLevel instrumentation = INSTRUMENTATION_HISTOGRAMS;
+    if (!Instrumentation::from_name(params.instrumentation, instrumentation))
+        MPC_WARN("Unknown instrumentation level \"%s\", using histograms", params.instrumentation.c_str());
+    if (params.trace)
+        instrumentation = INSTRUMENTATION_TRACE;
+    set_instrumentation(instrumentation);
+
+    m_ticks = 0;
+    if (!params.flight_recorder.empty() and params.flight_recorder_ticks > 0
+            and m_flight_recorder.open(params.flight_recorder, size_t(params.flight_recorder_ticks), params))
+        ROS_INFO("Recording the ticks into %s", params.flight_recorder.c_str());
+    if (!params.live_view.empty() and m_live_view.open(params.live_view))
+        ROS_INFO("Live view of the ticks in %s", params.live_view.c_str());
+    if (params.tick_arena_mb > 0.0) {
+        m_tick_arena.reset(new TickArena(size_t(params.tick_arena_mb * (1 << 20))));
+        if (!m_tick_arena->ok())
+            m_tick_arena.reset();
+    }
+
+    m_telemetry.set_decimation(TelemetryField::EVENTS, params.log_events_every);
+    m_telemetry.set_decimation(TelemetryField::FIT, params.log_fit_every);
+    m_telemetry.set_decimation(TelemetryField::ACTUATORS, params.log_actuators_every);
+    m_telemetry.set_decimation(TelemetryField::COST, params.log_cost_every);
+    m_telemetry.set_decimation(TelemetryField::TIMING, params.log_timing_every);
+    m_telemetry.set_decimation(TelemetryField::IPOPT, params.log_ipopt_every);
+    m_telemetry.start();
 
     ///* Publishers
-    m_pub_commands_servo_position = m_nodehandle.advertise<std_msgs::Float64>(
-            "/commands/servo/position",
-            1,
-            true
-    );
-    m_pub_commands_motor_speed = m_nodehandle.advertise<std_msgs::Float64>(
-            "/commands/motor/speed",
-            1,
-            true
-    );
-    if (m_debug) {
-        m_pub_closest = m_nodehandle.advertise<visualization_msgs::Marker>(
-                "/mpc/closest_cpp",
+    m_separate_commands = (params.commands != "combined");
+    m_combined_commands = (params.commands != "separate");
+    if (m_separate_commands) {
+        m_pub_commands_servo_position = m_nodehandle.advertise<std_msgs::Float64>(
+                "commands/servo/position",
+                1,
+                true
+        );
+        m_pub_commands_motor_speed = m_nodehandle.advertise<std_msgs::Float64>(
+                "commands/motor/speed",
+                1,
+                true
+        );
+    }
+    if (m_combined_commands) {
+        m_pub_commands_combined = m_nodehandle.advertise<mpc::Commands>(
+                "commands/combined",
+                1,
+                true
+        );
+    }
+    if (!params.vesc_port.empty()) {
+        m_vesc.reset(new VescSerial());
+        if (!m_vesc->open(params.vesc_port)) {
+            MPC_WARN("Sending the commands through the topics only");
+            m_vesc.reset();
+        }
+    }
+    m_publish_plan = params.publish_plan;
+    if (m_publish_plan) {
+        m_pub_plan = m_nodehandle.advertise<mpc::Plan>(
+                "mpc/plan",
                 1
         );
-
-        m_pub_next_pos = m_nodehandle.advertise<visualization_msgs::Marker>(
-                "/mpc/next_pos_cpp",
+    }
+    if (m_debug)
+        m_visualizer.start(m_nodehandle, params.debug_rate, params.contouring_reference, params.debug_compact);
+    if (m_stats_period > 0.0) {
+        m_pub_stats = m_nodehandle.advertise<std_msgs::Float64MultiArray>(
+                "mpc/stats",
                 1
         );
-
-        m_pub_poly = m_nodehandle.advertise<visualization_msgs::Marker>(
-                "/mpc/poly_cpp",
+        m_pub_memory = m_nodehandle.advertise<std_msgs::Float64MultiArray>(
+                "mpc/memory",
                 1
         );
-
+        m_diagnostics.setHardwareID("none");
+        m_diagnostics.add("Solver loop", this, &MPCControllerNode::diagnose);
+        m_stats_timer = m_nodehandle.createTimer(ros::Duration(m_stats_period), &MPCControllerNode::stats_cb, this);
+        if (!params.uplink.empty())
+            m_uplink.open(params.uplink, params.uplink_vehicle, params.uplink_period);
+    } else if (!params.uplink.empty()) {
+        ROS_WARN("uplink needs stats_period, ignoring it");
     }
+    m_srv_dump_trace = m_nodehandle.advertiseService("mpc/dump_trace", &MPCControllerNode::dump_trace_cb, this);
+    m_srv_set_instrumentation = m_nodehandle.advertiseService("mpc/set_instrumentation",
+                                                              &MPCControllerNode::set_instrumentation_cb, this);
 
     ///* Subscribers
-    m_sub_centerline = m_nodehandle.subscribe(
-            "/centerline",
-            1,
-            &MPCControllerNode::centerline_cb,
-            this
-    );
-    m_sub_odom = m_nodehandle.subscribe(
-            "/odom",
+    // The path either comes straight from a CSV or from markers_node.py
+    bool loaded = false;
+    if (!params.route_tiles.empty()) {
+        m_route.reset(new RouteStreamer(size_t(std::max(params.route_tiles_behind, 0)),
+                                        size_t(std::max(params.route_tiles_ahead, 1))));
+        loaded = m_route->open(params.route_tiles);
+        if (!loaded) {
+            ROS_ERROR("Falling back to the waypoints CSV or the centerline topic");
+            m_route.reset();
+        }
+    }
+    if (!loaded and !params.waypoints_csv.empty()) {
+        Waypoints waypoints;
+        loaded = load_waypoints(params.waypoints_csv, params.waypoints_spacing, waypoints);
+        if (loaded) {
+            std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>();
+            centerline->pts_x = std::move(waypoints.x);
+            centerline->pts_y = std::move(waypoints.y);
+            centerline->hash = centerline_hash(centerline->pts_x, centerline->pts_y);
+            centerline->yaw = std::move(waypoints.yaw);
+            centerline->speed = std::move(waypoints.speed);
+            set_centerline(centerline);
+        } else {
+            ROS_ERROR("Falling back to the centerline topic");
+        }
+    }
+
+    // The paths from now on, off the spinner's thread
+    if (params.background_centerline)
+        m_preparer.reset(new CenterlinePreparer());
+
+    // With `Params::callback_queues`, the poses (and what they're made
+    // from), the paths and /signal/go each go through a queue of their own
+    // (see `m_pose_queue`); the small high-rate topics take the transport
+    // of `Params::pose_transport`
+    ros::NodeHandle pose_nodehandle(m_nodehandle);
+    ros::NodeHandle path_nodehandle(m_nodehandle);
+    ros::NodeHandle signal_nodehandle(m_nodehandle);
+    if (params.callback_queues) {
+        pose_nodehandle.setCallbackQueue(&m_pose_queue);
+        path_nodehandle.setCallbackQueue(&m_path_queue);
+        signal_nodehandle.setCallbackQueue(&m_signal_queue);
+    }
+    ros::TransportHints pose_hints = pose_transport_hints(params.pose_transport);
+
+    if (loaded) {
+        // Nothing to subscribe to
+    } else if (params.centerline_format == "shared") {
+        m_sub_centerline = path_nodehandle.subscribe(
+                "/centerline_store",
+                1,
+                &MPCControllerNode::centerline_store_cb,
+                this
+        );
+    } else if (params.centerline_format == "numpy") {
+        m_sub_centerline = path_nodehandle.subscribe(
+                "/centerline_numpy",
+                1,
+                &MPCControllerNode::centerline_numpy_cb,
+                this
+        );
+    } else {
+        m_sub_centerline = path_nodehandle.subscribe(
+                "/centerline",
+                1,
+                &MPCControllerNode::centerline_cb,
+                this
+        );
+    }
+    m_sub_odom = pose_nodehandle.subscribe(
+            "odom",
             1,
             &MPCControllerNode::odom_cb,
-            this
+            this,
+            pose_hints
     );
-    m_sub_pf_pose_odom = m_nodehandle.subscribe(
-            "/pf/pose/odom",
-            1,
-            &MPCControllerNode::pf_pose_odom_cb,
-            this
-    );
-    m_sub_signal_go = m_nodehandle.subscribe(
-            "/signal/go",
+    if (params.dead_reckoning and params.dead_reckoning_imu) {
+        m_sub_imu = pose_nodehandle.subscribe(
+                "imu",
+                10,
+                &MPCControllerNode::imu_cb,
+                this,
+                pose_hints
+        );
+    }
+    if (params.particle_filter) {
+        m_particle_filter.reset(new ParticleFilter(params));
+        m_sub_scan = pose_nodehandle.subscribe(
+                "scan",
+                1,
+                &MPCControllerNode::scan_cb,
+                this
+        );
+        m_sub_map = pose_nodehandle.subscribe(
+                "map",
+                1,
+                &MPCControllerNode::map_cb,
+                this
+        );
+        m_sub_initial_pose = pose_nodehandle.subscribe(
+                "initialpose",
+                1,
+                &MPCControllerNode::initial_pose_cb,
+                this
+        );
+    } else {
+        m_sub_pf_pose_odom = pose_nodehandle.subscribe(
+                "pf/pose/odom",
+                1,
+                &MPCControllerNode::pf_pose_odom_cb,
+                this,
+                pose_hints
+        );
+    }
+    m_sub_signal_go = signal_nodehandle.subscribe(
+            "signal/go",
             10,
             &MPCControllerNode::signal_go_cb,
-            this
+            this,
+            pose_hints
     );
+    if (params.max_obstacles > 0) {
+        m_sub_obstacles = path_nodehandle.subscribe(
+                "obstacles",
+                1,
+                &MPCControllerNode::obstacles_cb,
+                this
+        );
+    }
+    if (params.centerline_patches) {
+        m_sub_centerline_patch = path_nodehandle.subscribe(
+                "/centerline_patch",
+                10,
+                &MPCControllerNode::centerline_patch_cb,
+                this
+        );
+    }
+
+    ///* Reconfiguration, starting from the parameters the node was launched
+    ///* with rather than from the defaults of cfg/MPC.cfg
+    m_reconfigure_server.reset(new dynamic_reconfigure::Server<mpc::MPCConfig>(private_nodehandle));
+    mpc::MPCConfig config;
+    config.ref_v = params.ref_v;
+    config.ref_v_alpha = params.ref_v_alpha;
+    config.latency = params.latency;
+    config.cte_coeff = params.cte_coeff;
+    config.epsi_coeff = params.epsi_coeff;
+    config.speed_coeff = params.speed_coeff;
+    config.steer_coeff = params.steer_coeff;
+    config.consec_steer_coeff = params.consec_steer_coeff;
+    config.consec_speed_coeff = params.consec_speed_coeff;
+    config.poly_degree = params.poly_degree;
+    config.num_steps_poly = params.num_steps_poly;
+    m_reconfigure_server->updateConfig(config);
+    m_reconfigure_server->setCallback(boost::bind(&MPCControllerNode::reconfigure_cb, this, _1, _2));
+
+    if (params.callback_queues) {
+        m_pose_spinner.reset(new ros::AsyncSpinner(1, &m_pose_queue));
+        m_path_spinner.reset(new ros::AsyncSpinner(1, &m_path_queue));
+        m_signal_spinner.reset(new ros::AsyncSpinner(1, &m_signal_queue));
+        m_pose_spinner->start();
+        m_path_spinner->start();
+        m_signal_spinner->start();
+    }
 }
 
 
-void MPCControllerNode::centerline_cb(const visualization_msgs::Marker & data) {
-    int num_points = data.points.size();
+bool MPCControllerNode::is_current_centerline(uint64_t hash, size_t num_points) {
+    // The centerline is re-published all the time; only a new path is worth
+    // re-building the derived structures (and the tracking state) for
+    std::lock_guard<std::mutex> lock(m_inputs_mutex);
+    const Centerline * current = m_inputs.centerline.get();
+    if (current != nullptr and ((current->hash == hash and current->pts_x.size() == num_points)
+                                or (current->patched_from != 0 and current->patched_from == hash))) {
+        m_centerline_skipped++;
+        return true;
+    }
+    // ... or the one being prepared
+    if (m_preparer and m_preparer->submitted(hash, num_points)) {
+        m_centerline_skipped++;
+        return true;
+    }
+    return false;
+}
+
 
-    m_pts_x = std::vector<double>();
-    m_pts_x.reserve(num_points);
+void MPCControllerNode::centerline_cb(const visualization_msgs::Marker::ConstPtr & data) {
+    uint64_t hash = centerline_hash(*data);
+    if (is_current_centerline(hash, data->points.size()))
+        return;
+    set_centerline(make_centerline(*data, hash));
+}
+
+
+void MPCControllerNode::centerline_numpy_cb(const rospy_tutorials::Floats::ConstPtr & data) {
+    uint64_t hash = centerline_hash(*data);
+    if (is_current_centerline(hash, data->data.size() / CENTERLINE_NUMPY_COLUMNS))
+        return;
+    std::shared_ptr<Centerline> centerline = make_centerline(*data, hash);
+    if (centerline)
+        set_centerline(centerline);
+}
 
-    m_pts_y = std::vector<double>();
-    m_pts_y.reserve(num_points);
 
-    for (auto & p : data.points) {
-        m_pts_x.push_back(p.x);
-        m_pts_y.push_back(p.y);
+void MPCControllerNode::centerline_store_cb(const std_msgs::UInt64::ConstPtr & data) {
+    std::string track_store;
+    {
+        std::lock_guard<std::mutex> lock(m_inputs_mutex);
+        const Centerline * current = m_inputs.centerline.get();
+        if (current != nullptr and (current->hash == data->data or current->patched_from == data->data)) {
+            m_centerline_skipped++;
+            return;
+        }
+        track_store = m_params.track_store;
     }
-    m_pts_OK = true;
+    std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>();
+    if (!TrackStore::read(track_store, *centerline))
+        return;
+    // Replaced by a newer path since it was announced: that one's on its way
+    if (centerline->hash != data->data)
+        return;
+    set_centerline(centerline);
 }
 
 
-void MPCControllerNode::signal_go_cb(const std_msgs::UInt16 & data) {
-    if (data.data == 0) {
-        ROS_WARN("Emergency stop!");
-        m_go_flag = false;
-    } else if (data.data == 2309){
-        ROS_WARN("GO!");
-        m_go_flag = true;
+void MPCControllerNode::centerline_patch_cb(const mpc::CenterlinePatch::ConstPtr & data) {
+    // Patched in a copy, already prepared: it's not shared with the other
+    // controllers of the process, whose paths may be patched otherwise
+    std::shared_ptr<const Centerline> current;
+    Params params;
+    {
+        std::lock_guard<std::mutex> lock(m_inputs_mutex);
+        current = m_inputs.centerline;
+        params = m_params;
     }
+    std::shared_ptr<Centerline> centerline = patch_centerline(current, *data, params);
+    if (!centerline)
+        return;
+    std::lock_guard<std::mutex> lock(m_inputs_mutex);
+    // ... unless a new path came in meanwhile
+    if (m_inputs.centerline != current)
+        return;
+    m_inputs.centerline = centerline;
+    ROS_INFO("Centerline patched (version %u): %lu waypoints from %.2f m to %.2f m",
+             centerline->version, data->x.size(), data->s_start, data->s_end);
+    publish_inputs();
 }
 
 
-visualization_msgs::Marker MPCControllerNode::get_marker(
-        const std::vector<double> & vars,
-        double pos_x_lat, double pos_y_lat,
-        double sin_psi_lat, double cos_psi_lat,
-        float red, float green, float blue
+void MPCControllerNode::set_centerline(const std::shared_ptr<Centerline> & centerline) {
+    // With the latest parameters, and nothing the solver loop changes; the
+    // controllers of the process that follow the same path share it. The
+    // poses go on meanwhile
+    std::unique_lock<std::mutex> lock(m_inputs_mutex);
+    if (m_preparer) {
+        m_preparer->submit(centerline, m_params);
+        return;
+    }
+    Params params = m_params;
+    lock.unlock();
+    std::shared_ptr<const Centerline> shared = SharedCenterlines::share(centerline, params);
+    lock.lock();
+    swap_centerline(shared);
+    publish_inputs();
+}
 
-    ) {
-    visualization_msgs::Marker marker;
-    marker.header.frame_id = "/map";
-    marker.header.stamp = ros::Time::now();
-    marker.type = visualization_msgs::Marker::LINE_STRIP;
-    marker.action = visualization_msgs::Marker::ADD;
 
-    marker.scale.x = 0.1;
-    marker.scale.y = 0.1;
-    marker.scale.z = 0.1;
+void MPCControllerNode::swap_centerline(const std::shared_ptr<const Centerline> & centerline) {
+    // The solves under way keep the one they started with
+    m_inputs.centerline = centerline;
 
-    marker.pose.position.x = 0;
-    marker.pose.position.y = 0;
-    marker.pose.position.z = 0;
+    int num_points = m_inputs.centerline->pts_x.size();
+    ROS_WARN("New centerline: %d points (%lu re-published ones skipped)", num_points, m_centerline_skipped);
+}
 
-    marker.pose.orientation.x = 0.0;
-    marker.pose.orientation.y = 0.0;
-    marker.pose.orientation.z = 0.0;
-    marker.pose.orientation.w = 1.0;
 
-    marker.color.a = 0.5;
-    marker.color.r = red;
-    marker.color.g = green;
-    marker.color.b = blue;
+void MPCControllerNode::reconfigure_cb(mpc::MPCConfig & config, uint32_t level) {
+    Params params = m_params;
+    params.ref_v = config.ref_v;
+    params.ref_v_alpha = config.ref_v_alpha;
+    params.latency = config.latency;
+    params.cte_coeff = config.cte_coeff;
+    params.epsi_coeff = config.epsi_coeff;
+    params.speed_coeff = config.speed_coeff;
+    params.steer_coeff = config.steer_coeff;
+    params.consec_steer_coeff = config.consec_steer_coeff;
+    params.consec_speed_coeff = config.consec_speed_coeff;
+    params.poly_degree = config.poly_degree;
+    params.num_steps_poly = config.num_steps_poly;
+
+    // The fit needs more points than coefficients; the configuration that's
+    // reported back is the one still applied
+    if (params.num_steps_poly < params.poly_degree + 2) {
+        ROS_WARN("num_steps_poly (%d) should be more than poly_degree + 1 (%d), ignoring the fit",
+                 params.num_steps_poly, params.poly_degree + 1);
+        params.poly_degree = m_params.poly_degree;
+        params.num_steps_poly = m_params.num_steps_poly;
+        config.poly_degree = params.poly_degree;
+        config.num_steps_poly = params.num_steps_poly;
+    }
+    bool fit_changed = (params.poly_degree != m_params.poly_degree
+                        or params.num_steps_poly != m_params.num_steps_poly);
+    std::shared_ptr<const Centerline> current;
+    {
+        std::lock_guard<std::mutex> lock(m_inputs_mutex);
+        m_params = params;
+        current = m_inputs.centerline;
+    }
 
-    marker.lifetime = ros::Duration();
+    std::atomic_store(&m_params_snapshot, std::shared_ptr<const Params>(std::make_shared<Params>(params)));
+    m_params_version.fetch_add(1, std::memory_order_release);
+    ROS_INFO("Reconfigured: ref_v %.2f (alpha %.2f), latency %.3f, weights %.1f %.1f %.1f %.1f %.1f %.1f, "
+             "fit of degree %d over %d points",
+             params.ref_v, params.ref_v_alpha, params.latency,
+             params.cte_coeff, params.epsi_coeff, params.speed_coeff,
+             params.steer_coeff, params.consec_steer_coeff, params.consec_speed_coeff,
+             params.poly_degree, params.num_steps_poly);
+
+    // The moments precomputed for the old fit are of no use to the new one
+    if (fit_changed and current)
+        set_centerline(std::make_shared<Centerline>(*current));
+}
 
-    // The first two values are the actuators
-    marker.points.reserve((vars.size() - 2) / 2);
 
-    for (size_t i=2; i < vars.size(); i+=2) {
-        geometry_msgs::Point p;
-        double x = vars[i];
-        double y = vars[i+1];
-        double x_rot = x * cos_psi_lat - y * sin_psi_lat;
-        double y_rot = x * sin_psi_lat + y * cos_psi_lat;
-        p.x = x_rot + pos_x_lat;
-        p.y = y_rot + pos_y_lat;
-        p.z = 0.0f;
-        marker.points.push_back(p);
+void MPCControllerNode::signal_go_cb(const std_msgs::UInt16::ConstPtr & data) {
+    std::lock_guard<std::mutex> lock(m_inputs_mutex);
+    // A go before the solvers are ready waits for them (see
+    // `apply_realtime_profile`), a stop doesn't
+    if (!m_solvers_ready and data->data != 0) {
+        ROS_WARN("The solvers aren't ready yet, going once they are");
+        m_pending_go = data->data;
+        return;
     }
+    if (data->data == 0)
+        m_pending_go = 0;
+    read_signal_go(data->data, m_inputs);
+    publish_inputs();
+    if (!m_priority_stop)
+        return;
+
+    // The stop doesn't wait for the solver loop: the car gets the neutral
+    // commands from here, the solve in flight is cancelled, and whatever
+    // the loops publish from now on is neutral too (see `publish_commands`)
+    bool stopped = !m_inputs.go_flag;
+    if (m_stopped.exchange(stopped) != stopped and stopped) {
+        TelemetryRecord record;
+        publish_commands(m_inputs, record, ControlPipeline::CENTER_IN_DZIK, 0.0);
+    }
+}
+
 
-    return marker;
+void MPCControllerNode::obstacles_cb(const mpc::Obstacles::ConstPtr & data) {
+    std::shared_ptr<ObstacleSet> obstacles = make_obstacles(*data);
+    if (!obstacles)
+        return;
+    std::lock_guard<std::mutex> lock(m_inputs_mutex);
+    m_inputs.obstacles = obstacles;
+    publish_inputs();
 }
 
 
-void MPCControllerNode::odom_cb(const nav_msgs::Odometry & data) {
-    m_speed = data.twist.twist.linear.x;
-    m_speed_OK = true;
+void MPCControllerNode::publish_inputs() {
+    m_input_buffer.back() = m_inputs;
+    m_input_buffer.publish();
+    if (m_tracking_rate > 0.0 or m_actuation_rate > 0.0) {
+        m_tracking_input_buffer.back() = m_inputs;
+        m_tracking_input_buffer.publish();
+    }
 }
 
 
-void MPCControllerNode::pf_pose_odom_cb(const nav_msgs::Odometry & data) {
-    m_pos_x = data.pose.pose.position.x;
-    m_pos_y = data.pose.pose.position.y;
-    m_pos_OK = true;
+bool MPCControllerNode::wait_for_pose(uint64_t & seen) {
+    std::unique_lock<std::mutex> lock(m_pose_mutex);
+    bool woken = m_pose_cv.wait_for(
+            lock,
+            std::chrono::duration<double>(POSE_WAIT_TIMEOUT),
+            [&]() { return m_pose_seq != seen; }
+    );
+    seen = m_pose_seq;
+    return woken;
+}
+
 
-    // Calculate the psi Euler angle
-    // (source: https://en.wikipedia.org/wiki/Conversion_between_quaternions_and_Euler_angles)
-    auto o = data.pose.pose.orientation;
-    double siny_cosp = 2.0 * (o.w * o.z + o.x * o.y);
-    double cosy_cosp = 1.0 - 2.0 * (o.y * o.y + o.z * o.z);
-    m_psi = atan2(siny_cosp, cosy_cosp);
-    m_psi_OK = true;
+void MPCControllerNode::odom_cb(const nav_msgs::Odometry::ConstPtr & data) {
+    std::lock_guard<std::mutex> lock(m_inputs_mutex);
+    read_odom(*data, m_inputs);
+    if (m_particle_filter) {
+        const auto & pose = data->pose.pose;
+        m_particle_filter->add_odometry(pose.position.x, pose.position.y, quaternion_yaw(pose.orientation));
+    }
+    publish_inputs();
 }
 
 
-void MPCControllerNode::loop() {
-    while (m_nodehandle.ok()) {
-        m_time = ros::Time::now();
-
-        if (m_pts_OK and m_speed_OK and m_pos_OK and m_psi_OK) {
-            double v_lat = m_speed;// + m_latency * m_throttle; TODO: you can collect m_throttle from /odom
-            double psi_lat = m_psi - m_latency * (v_lat * m_steer / Lf());
-            double pos_x_lat = m_pos_x + m_latency * (v_lat * cos(psi_lat));
-            double pos_y_lat = m_pos_y + m_latency * (v_lat * sin(psi_lat));
-
-            int closest_idx = find_closest(m_pts_x, m_pts_y, pos_x_lat, pos_y_lat);
-
-            // It pays to use `NUM_STEPS_BACK` points for fitting the polynomial
-            // (stabilizes the polynomial)
-            closest_idx -= NUM_STEPS_BACK;
-
-            std::vector<double> closest_pts_x;
-            closest_pts_x.reserve(m_num_steps_poly);
-            std::vector<double> closest_pts_y;
-            closest_pts_y.reserve(m_num_steps_poly);
-            for (size_t i=0; i < m_num_steps_poly; i++) {
-                int idx = (closest_idx + i*STEP_POLY) % m_pts_x.size();
-                closest_pts_x.push_back(m_pts_x[idx]);
-                closest_pts_y.push_back(m_pts_y[idx]);
-            }
+void MPCControllerNode::imu_cb(const sensor_msgs::Imu::ConstPtr & data) {
+    std::lock_guard<std::mutex> lock(m_inputs_mutex);
+    read_imu(*data, m_inputs);
+}
 
-            // Before we get the actuators, we need to calculate points in car's
-            // coordinate system; these will be passed later on to polyfit
-            std::vector<double> xvals_vec;
-            std::vector<double> yvals_vec;
-            xvals_vec.reserve(m_num_steps_poly);
-            yvals_vec.reserve(m_num_steps_poly);
-
-            double sin_psi_lat = sin(psi_lat);
-            double cos_psi_lat = cos(psi_lat);
-            double fraction_steps_OK = 1.0;
-
-            for (size_t i=0; i<m_num_steps_poly; i++) {
-                double dx = closest_pts_x[i] - pos_x_lat;
-                double dy = closest_pts_y[i] - pos_y_lat;
-
-                // Rotation around the origin
-                double x_rot = dx * cos_psi_lat + dy * sin_psi_lat;
-                double y_rot = -dx * sin_psi_lat + dy * cos_psi_lat;
-
-                if (i > m_poly_degree) {
-                    bool x_delta_too_low = (x_rot - xvals_vec[i-1] < X_DELTA_MIN_VALUE);
-                    if (x_delta_too_low) {
-                        size_t num_steps_remaining = m_num_steps_poly-i+1;
-                        fraction_steps_OK = 1.0 * (i+1) / m_num_steps_poly;
-                        ROS_WARN("X delta too low, breaking at %lu, num_steps_remaining: %lu", i, num_steps_remaining);
-
-                        // Fill out the rest of the points with fake waypoints
-                        double delta_x = xvals_vec[i-1] - xvals_vec[i-2];
-                        double delta_y = yvals_vec[i-1] - yvals_vec[i-2];
-                        delta_x = delta_x / num_steps_remaining;
-                        delta_y = delta_y / num_steps_remaining;
-
-                        for (size_t sub_i=1; sub_i<num_steps_remaining; sub_i++) {
-                            xvals_vec.push_back(xvals_vec[i-1] + sub_i * delta_x);
-                            yvals_vec.push_back(yvals_vec[i-1] + sub_i * delta_y);
-                        }
-
-                        break;
-                    }
-                }
-
-                xvals_vec.push_back(x_rot);
-                yvals_vec.push_back(y_rot);
-            }
 
-            double new_ref_v = m_ref_v_alpha * m_ref_v + (1-m_ref_v_alpha) * (fraction_steps_OK * m_ref_v);
+void MPCControllerNode::pf_pose_odom_cb(const nav_msgs::Odometry::ConstPtr & data) {
+    {
+        std::lock_guard<std::mutex> lock(m_inputs_mutex);
+        read_pose(*data, m_inputs);
+    }
+    publish_pose();
+}
+
 
-            Eigen::VectorXd xvals(m_num_steps_poly);
-            Eigen::VectorXd yvals(m_num_steps_poly);
-            for (size_t i=0; i < m_num_steps_poly; i++) {
-                xvals[i] = xvals_vec[i];
-                yvals[i] = yvals_vec[i];
-            }
+void MPCControllerNode::scan_cb(const sensor_msgs::LaserScan::ConstPtr & data) {
+    if (!m_particle_filter->update(data->ranges.data(), data->ranges.size(), data->angle_min,
+                                   data->angle_increment))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_inputs_mutex);
+        read_pose(*m_particle_filter, data->header.stamp.toSec(), m_inputs);
+    }
+    publish_pose();
+}
 
-            // Here we calculate the fit to the points in *car's coordinate system*
-            Eigen::VectorXd coeffs = polyfit(xvals, yvals, m_poly_degree);
-            std::stringstream ss;
-            ss << "coeffs: ";
-            for (size_t c=0; c<m_poly_degree+1; c++)
-                ss << std::setprecision(3) << coeffs[c] << " ";
-            ROS_WARN("%s", ss.str().c_str());
 
-            // Now, we can calculate the cross track error
-            double cte = polyeval(coeffs, 0);
+void MPCControllerNode::map_cb(const nav_msgs::OccupancyGrid::ConstPtr & data) {
+    std::shared_ptr<LocalizationMap> map = make_localization_map(*data);
+    if (map)
+        m_particle_filter->set_map(map);
+}
 
-            // ... and psi's error
-            double epsi = -atan(coeffs[1]);
 
-            ROS_WARN("CTE: %.2f, ePsi: %.2f, psi: %.2f", cte, epsi, m_psi);
+void MPCControllerNode::initial_pose_cb(const geometry_msgs::PoseWithCovarianceStamped::ConstPtr & data) {
+    // Spread as the covariance of x, y and yaw (that of RViz's "2D Pose
+    // Estimate" tool by default)
+    const auto & pose = data->pose.pose;
+    const auto & covariance = data->pose.covariance;
+    m_particle_filter->initialize(pose.position.x, pose.position.y, quaternion_yaw(pose.orientation),
+                                  std::sqrt(std::max(std::max(covariance[0], covariance[7]), 0.0)),
+                                  std::sqrt(std::max(covariance[35], 0.0)));
+}
 
-            // And now we're ready to calculate the actuators using the MPC
-            Eigen::VectorXd state(5);
-            state << 0, 0, 0, cte, epsi;
-            auto vars = m_controller.Solve(state, coeffs, new_ref_v);
 
-            // Extract the actuator values
-            double steering_angle_in_radians = vars[0];
-            double speed_in_meters_by_second = vars[1];
+void MPCControllerNode::publish_pose() {
+    if (m_route) {
+        // The path of the tiles about the car, once they're read
+        double pos_x, pos_y;
+        {
+            std::lock_guard<std::mutex> lock(m_inputs_mutex);
+            pos_x = m_inputs.pos_x;
+            pos_y = m_inputs.pos_y;
+        }
+        m_route->update(pos_x, pos_y);
+        std::shared_ptr<Centerline> centerline = m_route->take();
+        if (centerline)
+            set_centerline(centerline);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_inputs_mutex);
+        if (m_preparer) {
+            std::shared_ptr<const Centerline> centerline = m_preparer->take();
+            if (centerline)
+                swap_centerline(centerline);
+        }
+        publish_inputs();
+    }
 
-            ROS_WARN("steer: %.2f [rad], speed: %.2f [m/s]", steering_angle_in_radians, speed_in_meters_by_second);
+    {
+        std::lock_guard<std::mutex> lock(m_pose_mutex);
+        m_pose_seq++;
+    }
+    m_pose_cv.notify_one();
+}
 
-            // Map the angle to the values used in Dzik
-            m_steer = CENTER_IN_DZIK - steering_angle_in_radians;
 
-            if (m_steer < 0.0) {
-                ROS_WARN("steer angle %.2f is below 0 -- clipping it to 0", m_steer);
-                m_steer = 0.0;   
-            } else if (m_steer > 1.0) {
-                ROS_WARN("steer angle %.2f is greater than 1 -- clipping it to 1", m_steer);
-                m_steer = 1.0;
-            }
+void MPCControllerNode::apply_realtime_profile() {
+    // In this order, so that the pages the warm-up faults in are locked
+    if (m_rt_lock_memory) {
+        bool OK = lock_memory(PREFAULT_STACK_SIZE);
+        ROS_WARN("Real-time profile: memory locked: %s", OK ? "yes" : "NO");
+    }
+    if (m_rt_cpu >= 0) {
+        bool OK = pin_thread_to_cpu(m_rt_cpu);
+        ROS_WARN("Real-time profile: solver loop pinned to CPU %d: %s", m_rt_cpu, OK ? "yes" : "NO");
+    }
+    if (m_rt_priority > 0) {
+        bool OK = set_thread_fifo_priority(m_rt_priority);
+        ROS_WARN("Real-time profile: solver loop at SCHED_FIFO priority %d: %s", m_rt_priority, OK ? "yes" : "NO");
+    }
 
-            // Map the speed to the values used in Dzik
-            m_rpm = speed_in_meters_by_second / 2 / M_PI / WHEEL_RADIUS_IN_DZIK; // [1/s]
-            m_rpm *= 60; // [1/min = RPM]
-            m_rpm *= 10; // TODO: I had to multiply by 10 to get values as they really are in Dzik
-            ROS_WARN("speed_in_Dzik: %.2f [RPM]", m_rpm);
-
-            if (!m_go_flag) {
-                m_steer = CENTER_IN_DZIK;
-                m_rpm = 0;
-            } else {
-                ROS_WARN("GO flag is 'true'");
-            }
+    // With `Params::parallel_build`, the pipeline warmed its solvers up as
+    // it built them
+    if (m_warmup_solves > 0 and !m_parallel_build) {
+        double elapsed = m_pipeline.warm_up(m_warmup_solves);
+        ROS_WARN("Real-time profile: %d warm-up solves took %.3f [s]", m_warmup_solves, elapsed);
+    }
 
-            // Publish the transformed angle
-            std_msgs::Float64 msg_placeholder;
-            msg_placeholder.data = m_steer;
-            m_pub_commands_servo_position.publish(msg_placeholder);
-            msg_placeholder.data = m_rpm;
-            m_pub_commands_motor_speed.publish(msg_placeholder);
-
-            if (m_debug) {
-                // First, publish the next points as predicted from MPC
-                auto next_pos_marker = get_marker(vars, pos_x_lat, pos_y_lat, sin_psi_lat, cos_psi_lat, 0.0, 0.0, 1.0);
-                m_pub_next_pos.publish(next_pos_marker);
-
-                // Now, publish the closest waypoints (those used for polyfit)
-                std::vector<double> closest_waypoints;
-                closest_waypoints.reserve(m_num_steps_poly);
-                for (size_t i=0; i<m_num_steps_poly; i++) {
-                    closest_waypoints.push_back(xvals_vec[i]);
-                    closest_waypoints.push_back(yvals_vec[i]);
-                }
-                auto closest_marker = get_marker(closest_waypoints, pos_x_lat, pos_y_lat, sin_psi_lat, cos_psi_lat, 1.0, 1.0, 1.0);
-                m_pub_closest.publish(closest_marker);
-
-                // Now, publish markers that show the polynomial that was fit to the waypoints
-                std::vector<double> for_poly_marker;
-                for_poly_marker.push_back(0);
-                for_poly_marker.push_back(0);
-                for (double x=0; x < 2.1; x+=0.2) {
-                    for_poly_marker.push_back(x);
-                    for_poly_marker.push_back(polyeval(coeffs, x));
-                }
-                auto poly_marker = get_marker(for_poly_marker, pos_x_lat, pos_y_lat, sin_psi_lat, cos_psi_lat, 0.7, 0.2, 0.1);
-                m_pub_poly.publish(poly_marker);
+    std::lock_guard<std::mutex> lock(m_inputs_mutex);
+    m_solvers_ready = true;
+    ROS_WARN("Solvers ready");
+    if (m_pending_go != 0) {
+        read_signal_go(m_pending_go, m_inputs);
+        publish_inputs();
+        m_pending_go = 0;
+    }
+}
+
+
+void MPCControllerNode::stats_cb(const ros::TimerEvent & event) {
+    if (!m_stats_buffer.update())
+        return;
+    const StageStats & stats = m_stats_buffer.front();
+
+    size_t columns = STATS_COLUMNS + (m_perf_counters ? PERF_COLUMNS : 0) + (m_cpu_time ? CPU_COLUMNS : 0);
+    std_msgs::Float64MultiArray msg;
+    msg.layout.dim.resize(2);
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++)
+        msg.layout.dim[0].label += std::string(s > 0 ? "," : "") + StageStats::STAGE_NAMES[s];
+    msg.layout.dim[0].size = TelemetryRecord::NUM_STAGES;
+    msg.layout.dim[0].stride = TelemetryRecord::NUM_STAGES * columns;
+    msg.layout.dim[1].label = "count,p50,p90,p99,max";
+    if (m_perf_counters)
+        msg.layout.dim[1].label += ",cycles,instructions,cache_misses,branch_misses";
+    if (m_cpu_time)
+        msg.layout.dim[1].label += ",cpu";
+    msg.layout.dim[1].size = columns;
+    msg.layout.dim[1].stride = columns;
+    msg.data.reserve(TelemetryRecord::NUM_STAGES * columns);
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++) {
+        const LatencyHistogram & histogram = stats.stages[s];
+        msg.data.push_back(histogram.count());
+        msg.data.push_back(histogram.percentile(50));
+        msg.data.push_back(histogram.percentile(90));
+        msg.data.push_back(histogram.percentile(99));
+        msg.data.push_back(histogram.max());
+        if (m_perf_counters) {
+            const PerfCounts & counts = stats.stage_counts[s];
+            double ticks = double(std::max(stats.num_counted[s], uint64_t(1)));
+            msg.data.push_back(counts.cycles / ticks);
+            msg.data.push_back(counts.instructions / ticks);
+            msg.data.push_back(counts.cache_misses / ticks);
+            msg.data.push_back(counts.branch_misses / ticks);
+        }
+        if (m_cpu_time)
+            msg.data.push_back(stats.stage_cpu_time[s] / double(std::max(stats.num_cpu_timed[s], uint64_t(1))));
+    }
+    m_pub_stats.publish(msg);
+
+    // The memory of the process, with that of the controllers (read here,
+    // off the solver loop)
+    m_memory = stats.memory;
+    read_process_memory(m_memory);
+    std_msgs::Float64MultiArray memory;
+    memory.layout.dim.resize(1);
+    memory.layout.dim[0].label = "cppad_inuse,cppad_available,tape_ops,tape_vars,tape_bytes,nlp_vars,"
+            "nlp_constraints,jacobian_nonzeros,hessian_nonzeros,rss,peak_rss,arena_high_water,arena_fallbacks,"
+            "arena_pinned_ticks";
+    memory.layout.dim[0].size = MEMORY_COLUMNS;
+    memory.layout.dim[0].stride = MEMORY_COLUMNS;
+    memory.data = {double(m_memory.cppad_inuse), double(m_memory.cppad_available), double(m_memory.tape_ops),
+                   double(m_memory.tape_vars), double(m_memory.tape_bytes), double(m_memory.nlp_vars),
+                   double(m_memory.nlp_constraints), double(m_memory.jacobian_nonzeros),
+                   double(m_memory.hessian_nonzeros), double(m_memory.rss), double(m_memory.peak_rss),
+                   double(m_memory.arena_high_water), double(m_memory.arena_fallbacks),
+                   double(m_memory.arena_pinned_ticks)};
+    m_pub_memory.publish(memory);
+
+    // A datagram of the summary to the base station, when it's due
+    if (m_uplink.is_open())
+        m_uplink.add(stats);
+
+    m_diagnostics.force_update();
+}
+
+
+void MPCControllerNode::diagnose(diagnostic_updater::DiagnosticStatusWrapper & status) {
+    const StageStats & stats = m_stats_buffer.front();
+    if (stats.num_ticks == 0)
+        status.summary(diagnostic_msgs::DiagnosticStatus::WARN, "No solves");
+    else if (stats.num_overruns > 0)
+        status.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "%lu of %lu ticks over the control period",
+                        stats.num_overruns, stats.num_ticks);
+    else
+        status.summary(diagnostic_msgs::DiagnosticStatus::OK, "OK");
+
+    status.add("control period [s]", m_control_period.load(std::memory_order_relaxed));
+    status.add("ticks", stats.num_ticks);
+    status.add("overruns", stats.num_overruns);
+    status.add("deadline hits", stats.num_deadline_hits);
+    status.add("total ticks", stats.total_ticks);
+    status.add("total overruns", stats.total_overruns);
+    status.add("total deadline hits", stats.total_deadline_hits);
+    status.add("restorations", stats.num_restorations);
+    status.add("total restorations", stats.total_restorations);
+    status.add("failures", stats.num_failures);
+    status.add("total failures", stats.total_failures);
+    if (stats.num_iterations_known > 0)
+        status.addf("mean iterations", "%.1f", double(stats.iterations) / stats.num_iterations_known);
+    status.addf("max constraint violation", "%.3g", stats.max_constraint_violation);
+    status.addf("max slack", "%.3g", stats.max_slack);
+    status.addf("max tolerance", "%.3g", stats.max_tolerance);
+    for (int s=0; s < TelemetryRecord::NUM_STAGES; s++) {
+        const LatencyHistogram & histogram = stats.stages[s];
+        status.addf(std::string(StageStats::STAGE_NAMES[s]) + " [ms]", "p50 %.3f p90 %.3f p99 %.3f max %.3f",
+                    1e3 * histogram.percentile(50), 1e3 * histogram.percentile(90),
+                    1e3 * histogram.percentile(99), 1e3 * histogram.max());
+        if (stats.num_counted[s] > 0) {
+            const PerfCounts & counts = stats.stage_counts[s];
+            double ticks = double(stats.num_counted[s]);
+            status.addf(std::string(StageStats::STAGE_NAMES[s]) + " counters", "IPC %.2f cache misses %.0f "
+                        "branch misses %.0f per tick", counts.ipc(), counts.cache_misses / ticks,
+                        counts.branch_misses / ticks);
+        }
+        if (stats.num_cpu_timed[s] > 0)
+            status.addf(std::string(StageStats::STAGE_NAMES[s]) + " CPU [ms]", "%.3f per tick",
+                        1e3 * stats.stage_cpu_time[s] / stats.num_cpu_timed[s]);
+    }
+    // The cost of each backend that solved, per tick
+    for (size_t b=0; b < StageStats::MAX_BACKENDS; b++) {
+        if (stats.backend_cpu_timed[b] == 0 and stats.backend_metered[b] == 0)
+            continue;
+        std::string name = (b < m_backend_names.size()) ? m_backend_names[b] : std::to_string(b);
+        status.addf("backend " + name, "%lu ticks, CPU %.3f [ms] energy %.3f [mJ] per tick", stats.backend_ticks[b],
+                    (stats.backend_cpu_timed[b] > 0) ? 1e3 * stats.backend_cpu_time[b] / stats.backend_cpu_timed[b]
+                                                     : -1.0,
+                    (stats.backend_metered[b] > 0) ? 1e3 * stats.backend_energy[b] / stats.backend_metered[b] : -1.0);
+    }
+    if (stats.linear_solver.count() > 0)
+        status.addf("linear solver [ms]", "p50 %.3f p90 %.3f p99 %.3f max %.3f",
+                    1e3 * stats.linear_solver.percentile(50), 1e3 * stats.linear_solver.percentile(90),
+                    1e3 * stats.linear_solver.percentile(99), 1e3 * stats.linear_solver.max());
+    if (m_vesc)
+        status.add("VESC packets dropped", m_vesc->dropped());
+    if (m_route)
+        status.addf("route tiles", "%lu of %lu in memory", m_route->resident_tiles(), m_route->num_tiles());
+    status.addf("CppAD memory [MiB]", "in use %.1f held %.1f", m_memory.cppad_inuse / double(1 << 20),
+                m_memory.cppad_available / double(1 << 20));
+    status.addf("tapes", "%lu operations %lu variables %.1f MiB", m_memory.tape_ops, m_memory.tape_vars,
+                m_memory.tape_bytes / double(1 << 20));
+    status.addf("NLPs", "%lu variables %lu constraints %lu + %lu nonzeros", m_memory.nlp_vars,
+                m_memory.nlp_constraints, m_memory.jacobian_nonzeros, m_memory.hessian_nonzeros);
+    status.addf("resident set [MiB]", "%.1f peak %.1f", m_memory.rss / double(1 << 20),
+                m_memory.peak_rss / double(1 << 20));
+    if (m_tick_arena)
+        status.addf("tick arena", "%.1f of %.1f MiB at most, %lu allocations from the heap, %lu ticks pinned",
+                    m_memory.arena_high_water / double(1 << 20), m_tick_arena->size() / double(1 << 20),
+                    m_memory.arena_fallbacks, m_memory.arena_pinned_ticks);
+}
+
+
+void MPCControllerNode::stop() {
+    m_running = false;
+}
+
+
+MPCControllerNode::~MPCControllerNode() {
+    // No callback of the queues runs past here
+    if (m_pose_spinner) {
+        m_pose_spinner->stop();
+        m_path_spinner->stop();
+        m_signal_spinner->stop();
+    }
+    Trace::stop_dumper();
+
+    for (TaskGraph::TaskId task=0; task < m_tick_graph.size(); task++) {
+        const TaskGraph::Timing & timing = m_tick_graph.timing(task);
+        if (timing.runs > 0)
+            ROS_INFO("Stage %s: %.3f ms on average, %.3f ms at most, over %lu ticks", m_tick_graph.name(task),
+                     1e3 * timing.total_time / timing.runs, 1e3 * timing.max_time, timing.runs);
+    }
+}
+
+
+bool MPCControllerNode::dump_trace_cb(std_srvs::Empty::Request & request, std_srvs::Empty::Response & response) {
+    Trace::request_dump("request");
+    return true;
+}
+
+
+bool MPCControllerNode::set_instrumentation_cb(mpc::SetInstrumentation::Request & request,
+                                               mpc::SetInstrumentation::Response & response) {
+    response.previous = Instrumentation::name(Instrumentation::level());
+    InstrumentationLevel level;
+    response.success = Instrumentation::from_name(request.level, level);
+    if (!response.success) {
+        MPC_WARN("Unknown instrumentation level \"%s\", keeping %s", request.level.c_str(),
+                 response.previous.c_str());
+        return true;
+    }
+    set_instrumentation(level);
+    ROS_INFO("Instrumentation: %s (was %s)", request.level.c_str(), response.previous.c_str());
+    return true;
+}
+
+
+void MPCControllerNode::set_instrumentation(InstrumentationLevel level) {
+    if (level >= INSTRUMENTATION_TRACE)
+        Trace::start_dumper(m_trace_directory, TRACE_DUMP_INTERVAL);
+    Instrumentation::set_level(level);
+}
+
+
+void MPCControllerNode::publish_commands(const InputSnapshot & inputs, const TelemetryRecord & record,
+                                         double steer_cmd, double rpm) {
+    MPC_TRACE_SCOPE("publish");
+    std::lock_guard<std::mutex> lock(m_commands_mutex);
+    // Stopped since the inputs were read (see `m_stopped`)
+    bool stopped = !inputs.go_flag or m_stopped.load(std::memory_order_relaxed);
+    if (stopped and m_priority_stop) {
+        steer_cmd = ControlPipeline::CENTER_IN_DZIK;
+        rpm = 0.0;
+    }
+    if (m_vesc)
+        m_vesc->send(steer_cmd, rpm);
+    if (m_separate_commands) {
+        std_msgs::Float64 msg_placeholder;
+        msg_placeholder.data = steer_cmd;
+        m_pub_commands_servo_position.publish(msg_placeholder);
+        msg_placeholder.data = rpm;
+        m_pub_commands_motor_speed.publish(msg_placeholder);
+    }
+    if (m_combined_commands) {
+        mpc::Commands commands;
+        commands.header.stamp = ros::Time::now();
+        commands.steer = steer_cmd;
+        commands.rpm = rpm;
+        commands.pose_stamp.fromSec(inputs.pose_stamp);
+        commands.events = record.events;
+        if (stopped)
+            commands.status = mpc::Commands::STATUS_STOPPED;
+        else if (record.events & TelemetryRecord::FALLBACK)
+            commands.status = mpc::Commands::STATUS_FALLBACK;
+        else if (record.events & TelemetryRecord::DEADLINE_HIT)
+            commands.status = mpc::Commands::STATUS_DEADLINE_HIT;
+        else
+            commands.status = mpc::Commands::STATUS_OK;
+        m_pub_commands_combined.publish(commands);
+    }
+}
+
+
+void MPCControllerNode::publish_plan(const InputSnapshot & inputs) {
+    MPC_TRACE_SCOPE("publish_plan");
+    m_pipeline.plan(m_published_plan);
+    if (!m_published_plan.OK)
+        return;
+
+    const Plan & plan = m_published_plan;
+    size_t num_points = plan.x.size();
+    m_plan_msg.header.stamp.fromSec(plan.stamp);
+    m_plan_msg.header.frame_id = "/map";
+    m_plan_msg.pose_stamp.fromSec(inputs.pose_stamp);
+    m_plan_msg.time.resize(num_points);
+    m_plan_msg.x.resize(num_points);
+    m_plan_msg.y.resize(num_points);
+    m_plan_msg.psi.resize(num_points);
+    m_plan_msg.speed.resize(num_points);
+    m_plan_msg.steer.resize(num_points);
+    for (size_t i=0; i < num_points; i++) {
+        m_plan_msg.time[i] = float(plan.time[i]);
+        m_plan_msg.x[i] = float(plan.x[i]);
+        m_plan_msg.y[i] = float(plan.y[i]);
+        m_plan_msg.psi[i] = float(plan.heading[i]);
+        m_plan_msg.speed[i] = float(plan.speed[i]);
+        m_plan_msg.steer[i] = float(plan.steer_angle[i]);
+    }
+    m_pub_plan.publish(m_plan_msg);
+}
+
+
+void MPCControllerNode::record_flight(const InputSnapshot & inputs, const TelemetryRecord & record) {
+    if (m_flight_recorder.is_open()) {
+        FlightRecord & flight = m_flight_recorder.next();
+        flight.tick = m_ticks;
+        m_pipeline.record_flight(inputs, record, flight);
+        m_flight_recorder.commit();
+    }
+    if (m_live_view.is_open()) {
+        m_pipeline.plan(m_live_plan);
+        m_live_frame.tick = m_ticks;
+        m_pipeline.live_frame(inputs, record, m_live_plan, m_live_frame);
+        m_live_view.write(m_live_frame);
+    }
+}
+
+
+bool MPCControllerNode::wait_for_tick(ros::Rate & loop_rate, uint64_t & pose_seq) {
+    if (m_scheduler == Scheduler::POSE)
+        return wait_for_pose(pose_seq);
+    loop_rate.sleep();
+    return true;
+}
+
+
+bool MPCControllerNode::wait_for_prepared(uint64_t & seen) {
+    std::unique_lock<std::mutex> lock(m_prepared_mutex);
+    bool woken = m_prepared_cv.wait_for(
+            lock,
+            std::chrono::duration<double>(POSE_WAIT_TIMEOUT),
+            [&]() { return m_prepared_seq != seen; }
+    );
+    seen = m_prepared_seq;
+    return woken;
+}
+
+
+void MPCControllerNode::loop() {
+    // The callbacks run on another thread (the spinner's, or the nodelet
+    // manager's), so they're never held up by the solver (this thread), and
+    // they hand the inputs over through `m_input_buffer`
+    apply_realtime_profile();
+    Trace::name_thread("solver loop");
+
+    std::thread tracking;
+    if (m_tracking_rate > 0.0)
+        tracking = std::thread(&MPCControllerNode::tracking_loop, this);
+    else if (m_actuation_rate > 0.0)
+        tracking = std::thread(&MPCControllerNode::actuation_loop, this);
+
+    if (m_pipelined) {
+        std::thread path_stage(&MPCControllerNode::path_loop, this);
+        solve_loop();
+        path_stage.join();
+        if (tracking.joinable())
+            tracking.join();
+        return;
+    }
+
+    ros::Rate loop_rate(m_loop_rate);
+    uint64_t pose_seq = 0;
+
+    while (m_running and m_nodehandle.ok()) {
+        // Wait for the next tick; none for long is a fault too
+        if (!wait_for_tick(loop_rate, pose_seq)) {
+            TelemetryRecord record;
+            if (m_contingency)
+                contingency_step(nullptr, ros::Time::now().toSec(), false, record);
+            continue;
+        }
+
+        // Always start from the freshest inputs, and don't solve the same
+        // problem twice
+        MPC_TRACE_SCOPE("tick");
+        auto tick_start = std::chrono::steady_clock::now();
+        bool cpu_time = m_cpu_time and Instrumentation::level() >= INSTRUMENTATION_HISTOGRAMS;
+        double tick_cpu_start = cpu_time ? thread_cpu_time() : 0.0;
+        if (!m_input_buffer.update())
+            continue;
+        const InputSnapshot & inputs = m_input_buffer.front();
+
+        // The latest reconfiguration, if it's not applied yet
+        uint64_t params_version = m_params_version.load(std::memory_order_acquire);
+        if (params_version != m_params_applied) {
+            MPC_TRACE_SCOPE("reconfigure");
+            m_pipeline.reconfigure(*std::atomic_load(&m_params_snapshot));
+            m_params_applied = params_version;
+        }
+
+        ros::Time time = ros::Time::now();
+
+        TelemetryRecord record;
+        record.stamp = time.toSec();
+        record.stage_time[TelemetryRecord::STAGE_SNAPSHOT] = std::chrono::duration<float>(
+                std::chrono::steady_clock::now() - tick_start).count();
+        if (cpu_time)
+            record.stage_cpu_time[TelemetryRecord::STAGE_SNAPSHOT] = float(thread_cpu_time() - tick_cpu_start);
+
+        // The allocations of the solve come from the tick's arena; not those
+        // of the messages, which outlive it in the publishers' queues
+        bool solved;
+        {
+            TickArena::Scope arena(m_tick_arena.get());
+            solved = m_pipeline.step(inputs, time.toSec(), tick_start, record);
+            if (m_contingency and contingency_step(&inputs, time.toSec(),
+                                                   !solved or record.fallback == FALLBACK_PID, record))
+                solved = false;
+        }
+        finish_tick(inputs, time, tick_start, solved, record);
+
+        // The rate the ticks sustain, for the next ones
+        if (m_governor and solved) {
+            bool missed = (record.stage_time[TelemetryRecord::STAGE_TICK] > m_control_period)
+                          or (record.events & TelemetryRecord::DEADLINE_HIT);
+            if (m_governor->record(record.stage_time[TelemetryRecord::STAGE_TICK], missed)) {
+                loop_rate = ros::Rate(m_governor->rate());
+                m_control_period = m_governor->period();
+                m_pipeline.set_control_period(m_governor->period());
             }
+        }
+    }
+    if (tracking.joinable())
+        tracking.join();
+}
 
-            // Print out calculation times
-            double delta_between_callbacks = (m_time.toSec() - m_old_time.toSec());
-            double delta_within_callback = (ros::Time::now().toSec() - m_time.toSec());
-            ROS_WARN(
-                    "dt_bet_cb: %.3f[s] dt_in_cb: %.3f[s]",
-                    delta_between_callbacks, delta_within_callback
-            );
 
-            // Print out relevant attributes
-            ROS_WARN("m_speed: %.3f [m/s]", m_speed);
+void MPCControllerNode::tracking_loop() {
+    Trace::name_thread("tracking loop");
 
+    ros::Rate loop_rate(m_tracking_rate);
+    double steer_angle = 0.0;
+    while (m_running and m_nodehandle.ok()) {
+        loop_rate.sleep();
+        MPC_TRACE_SCOPE("tracking");
+        if (m_plan_buffer.update()) {
+            // Copied into storage of its own, which the follower swaps in
+            m_tracking_plan = m_plan_buffer.front();
+            m_follower.set_plan(m_tracking_plan);
+        }
+        m_tracking_input_buffer.update();
+        const InputSnapshot & inputs = m_tracking_input_buffer.front();
+        if (!inputs.pos_OK or !inputs.psi_OK or !inputs.speed_OK or !inputs.go_flag)
+            continue;
+
+        // The pose projected by the latency, as the solver loop does, by the
+        // last commands of this loop
+        double pos_x, pos_y, psi;
+        ControlPipeline::project_pose(inputs.pos_x, inputs.pos_y, inputs.psi, inputs.speed, steer_angle,
+                                      m_tracking_latency, pos_x, pos_y, psi);
+        double speed;
+        if (!m_follower.command(pos_x, pos_y, psi, inputs.pose_stamp + m_tracking_latency, steer_angle, speed)) {
+            steer_angle = ControlPipeline::steer_from_dzik(m_pipeline.steer_cmd());
+            continue;
+        }
+        double steer_cmd = std::min(std::max(ControlPipeline::steer_to_dzik(steer_angle), 0.0), 1.0);
+        publish_commands(inputs, TelemetryRecord(), steer_cmd, ControlPipeline::speed_to_dzik(speed));
+    }
+}
+
+
+void MPCControllerNode::actuation_loop() {
+    Trace::name_thread("actuation loop");
+
+    // On absolute times, so that the period doesn't drift by the time the
+    // publishing takes; the periods missed (the thread preempted) are
+    // skipped rather than caught up on
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / m_actuation_rate));
+    auto next = std::chrono::steady_clock::now();
+    while (m_running and m_nodehandle.ok()) {
+        next += period;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now)
+            next = now + period;
+        std::this_thread::sleep_until(next);
+        MPC_TRACE_SCOPE("actuation");
+
+        // The latest plan stays the front until there's a newer one
+        m_plan_buffer.update();
+        m_tracking_input_buffer.update();
+        const InputSnapshot & inputs = m_tracking_input_buffer.front();
+        if (!m_tick_commands_OK.load(std::memory_order_acquire))
+            continue;
+
+        // The plan starts at the pose projected by the latency, where the
+        // commands of now take effect
+        TelemetryRecord record;
+        record.events = m_tick_events.load(std::memory_order_relaxed);
+        double steer_angle, speed;
+        if (inputs.go_flag and plan_inputs_at(m_plan_buffer.front(), ros::Time::now().toSec() + m_tracking_latency,
+                                              steer_angle, speed)) {
+            double steer_cmd = std::min(std::max(ControlPipeline::steer_to_dzik(steer_angle), 0.0), 1.0);
+            publish_commands(inputs, record, steer_cmd, ControlPipeline::speed_to_dzik(speed));
         } else {
-            ROS_WARN(
-                    "No optimization, m_pts_OK: %d, m_speed_OK: %d, m_pos_OK: %d, m_psi_OK: %d",
-                    m_pts_OK, m_speed_OK, m_pos_OK, m_psi_OK
-            );
+            publish_commands(inputs, record, m_tick_steer_cmd.load(std::memory_order_relaxed),
+                             m_tick_rpm.load(std::memory_order_relaxed));
         }
+    }
+}
 
-        m_old_time = m_time;
-        ros::spinOnce();
+
+void MPCControllerNode::path_loop() {
+    Trace::name_thread("path stage");
+
+    ros::Rate loop_rate(m_loop_rate);
+    uint64_t pose_seq = 0;
+    std::shared_ptr<const Params> params = std::atomic_load(&m_params_snapshot);
+    uint64_t params_applied = 0;
+
+    while (m_running and m_nodehandle.ok()) {
+        if (!wait_for_tick(loop_rate, pose_seq))
+            continue;
+
+        MPC_TRACE_SCOPE("path stage");
+        auto tick_start = std::chrono::steady_clock::now();
+        bool cpu_time = m_cpu_time and Instrumentation::level() >= INSTRUMENTATION_HISTOGRAMS;
+        double tick_cpu_start = cpu_time ? thread_cpu_time() : 0.0;
+        if (!m_input_buffer.update())
+            continue;
+        // The solver loop is behind: the problems it has yet to take are
+        // all it can solve before this one would be stale anyway
+        PreparedTick * tick = m_prepared.back();
+        if (tick == nullptr)
+            continue;
+
+        // The path stage's part of the latest reconfiguration; the solver
+        // loop takes the rest with the first problem prepared with it
+        uint64_t params_version = m_params_version.load(std::memory_order_acquire);
+        if (params_version != params_applied) {
+            MPC_TRACE_SCOPE("reconfigure");
+            params = std::atomic_load(&m_params_snapshot);
+            m_pipeline.reconfigure_path(*params);
+            params_applied = params_version;
+        }
+
+        tick->inputs = m_input_buffer.front();
+        tick->time = ros::Time::now();
+        tick->tick_start = tick_start;
+        tick->params = params;
+        tick->params_version = params_applied;
+        tick->record = TelemetryRecord();
+        tick->record.stamp = tick->time.toSec();
+        tick->record.stage_time[TelemetryRecord::STAGE_SNAPSHOT] = std::chrono::duration<float>(
+                std::chrono::steady_clock::now() - tick_start).count();
+        if (cpu_time)
+            tick->record.stage_cpu_time[TelemetryRecord::STAGE_SNAPSHOT] = float(thread_cpu_time()
+                                                                                 - tick_cpu_start);
+        m_pipeline.prepare(tick->inputs, tick->time.toSec(), tick_start, tick->problem, tick->record);
+
+        m_prepared.push();
+        {
+            std::lock_guard<std::mutex> lock(m_prepared_mutex);
+            m_prepared_seq++;
+        }
+        m_prepared_cv.notify_one();
     }
 }
 
 
-int MPCControllerNode::find_closest(const std::vector<double> & pts_x, const std::vector<double> & pts_y, double pos_x, double pos_y) {
-    int closest_idx = -1;
-    double closest_dist = 1.0e19;
-    for (size_t i=0; i < pts_x.size(); i++) {
-        double diff_x = (pts_x[i] - pos_x);
-        double diff_y = (pts_y[i] - pos_y);
-        double dist = diff_x*diff_x + diff_y*diff_y;
-        if (dist < closest_dist) {
-            closest_idx = i;
-            closest_dist = dist;
+void MPCControllerNode::solve_loop() {
+    uint64_t prepared_seq = 0;
+
+    while (m_running and m_nodehandle.ok()) {
+        if (!wait_for_prepared(prepared_seq)) {
+            TelemetryRecord record;
+            if (m_contingency)
+                contingency_step(nullptr, ros::Time::now().toSec(), false, record);
+            continue;
+        }
+
+        // The newest problem, those before it are stale by now
+        while (m_prepared.size() > 1)
+            m_prepared.pop();
+        PreparedTick * tick = m_prepared.front();
+        if (tick == nullptr)
+            continue;
+
+        MPC_TRACE_SCOPE("tick");
+        if (tick->params_version != m_params_applied) {
+            MPC_TRACE_SCOPE("reconfigure");
+            m_pipeline.reconfigure_solver(*tick->params);
+            m_params_applied = tick->params_version;
+        }
+
+        bool solved;
+        {
+            TickArena::Scope arena(m_tick_arena.get());
+            solved = m_pipeline.solve(tick->inputs, tick->problem, tick->tick_start, tick->record);
+            if (m_contingency and contingency_step(&tick->inputs, tick->time.toSec(),
+                                                   !solved or tick->record.fallback == FALLBACK_PID, tick->record))
+                solved = false;
         }
+        finish_tick(tick->inputs, tick->time, tick->tick_start, solved, tick->record);
+        m_prepared.pop();
     }
-    return closest_idx;
 }
 
 
+void MPCControllerNode::publish_tick(const InputSnapshot & inputs, std::chrono::steady_clock::time_point tick_start,
+                                     TelemetryRecord & record) {
+    // Publish the transformed angle
+    auto publish_start = std::chrono::steady_clock::now();
+    bool cpu_time = m_cpu_time and Instrumentation::level() >= INSTRUMENTATION_HISTOGRAMS;
+    double publish_cpu_start = cpu_time ? thread_cpu_time() : 0.0;
+    if (m_actuation_rate > 0.0) {
+        m_tick_steer_cmd.store(m_pipeline.steer_cmd(), std::memory_order_relaxed);
+        m_tick_rpm.store(m_pipeline.rpm(), std::memory_order_relaxed);
+        m_tick_events.store(record.events, std::memory_order_relaxed);
+        m_tick_commands_OK.store(true, std::memory_order_release);
+    } else {
+        publish_commands(inputs, record, m_pipeline.steer_cmd(), m_pipeline.rpm());
+    }
+    auto publish_end = std::chrono::steady_clock::now();
+    record.stage_time[TelemetryRecord::STAGE_PUBLISH] = std::chrono::duration<float>(
+            publish_end - publish_start).count();
+    record.stage_time[TelemetryRecord::STAGE_TICK] = std::chrono::duration<float>(
+            publish_end - tick_start).count();
+
+    // The CPU time of the tick, that of its stages on whichever thread ran
+    // them
+    if (cpu_time) {
+        record.stage_cpu_time[TelemetryRecord::STAGE_PUBLISH] = float(thread_cpu_time() - publish_cpu_start);
+        float tick_cpu_time = 0.0f;
+        for (int s=0; s < TelemetryRecord::STAGE_TICK; s++)
+            if (record.stage_cpu_time[s] > 0.0f)
+                tick_cpu_time += record.stage_cpu_time[s];
+        record.stage_cpu_time[TelemetryRecord::STAGE_TICK] = tick_cpu_time;
+    }
+    if (m_power_rail.is_open()) {
+        double power = m_power_rail.read();
+        if (power >= 0.0) {
+            record.power = float(power);
+            record.energy = float(power * record.stage_time[TelemetryRecord::STAGE_TICK]);
+        }
+    }
+}
+
+
+void MPCControllerNode::hand_over_plan(const InputSnapshot & inputs) {
+    if (m_tracking_rate > 0.0 or m_actuation_rate > 0.0) {
+        m_pipeline.plan(m_plan_buffer.back());
+        m_plan_buffer.publish();
+    }
+    if (m_publish_plan)
+        publish_plan(inputs);
+    if (m_contingency) {
+        m_pipeline.plan(m_contingency->source());
+        if (m_contingency->source().OK)
+            m_contingency->submit(inputs.centerline, m_control_period);
+    }
+}
 
-int main(int argc, char **argv) {
 
-    ros::init(argc, argv, "mpc_node_cpp");
+bool MPCControllerNode::contingency_step(const InputSnapshot * inputs, double now, bool failed,
+                                         TelemetryRecord & record) {
+    if (inputs != nullptr) {
+        m_contingency_inputs.go_flag = inputs->go_flag;
+        m_contingency_inputs.pose_stamp = inputs->pos_OK ? inputs->pose_stamp : 0.0;
+    }
+    // The latest contingency, unless the car's stopping along one already
+    if (!m_contingency_engaged)
+        m_contingency->update();
+    bool pose_lost = m_contingency_inputs.pose_stamp <= 0.0
+            or now - m_contingency_inputs.pose_stamp > m_contingency_pose_timeout;
+    if (!m_contingency_inputs.go_flag or !(pose_lost or failed)) {
+        if (m_contingency_engaged and m_contingency_inputs.go_flag)
+            ROS_WARN("Contingency over, back to the solver");
+        m_contingency_engaged = false;
+        return false;
+    }
 
-    Params params;
+    // Without one ready (no plan yet), as without contingencies
+    const Plan & contingency = m_contingency->front();
+    if (!m_contingency_engaged) {
+        if (!contingency.OK)
+            return false;
+        m_contingency_engaged = true;
+        ROS_WARN("Contingency: %s, stopping within %.2f [s]",
+                 pose_lost ? "localization lost" : "no commands of the solver",
+                 contingency.stamp + contingency.time.back() - now);
+        // The loops between the ticks follow it too
+        if (m_tracking_rate > 0.0 or m_actuation_rate > 0.0) {
+            m_plan_buffer.back() = contingency;
+            m_plan_buffer.publish();
+        }
+    }
 
-    int num_expected_args = 15;
-
-    if (argc == num_expected_args) {
-        params.steps_ahead = atoi(argv[1]);
-        params.dt = atof(argv[2]);
-        params.ref_v = atof(argv[3]);
-        params.ref_v_alpha = atof(argv[4]);
-        if (params.ref_v_alpha > 1.0 or params.ref_v_alpha < 0.0) {
-            std::cout << "The ref_v_alpha argument should be a float"
-                      << " between 0.0 and 1.0 (inclusive) and you"
-                      << " passed "
-                      << params.ref_v_alpha
-                      << "\n";
-            return 1;
+    record.events |= TelemetryRecord::CONTINGENCY | TelemetryRecord::FALLBACK;
+    // Neutral once it's stopped
+    double steer_cmd = ControlPipeline::CENTER_IN_DZIK, rpm = 0.0;
+    double steer_angle, speed;
+    if (plan_inputs_at(contingency, now + m_tracking_latency, steer_angle, speed)) {
+        steer_cmd = std::min(std::max(ControlPipeline::steer_to_dzik(steer_angle), 0.0), 1.0);
+        rpm = ControlPipeline::speed_to_dzik(speed);
+    }
+    if (m_actuation_rate > 0.0) {
+        m_tick_steer_cmd.store(steer_cmd, std::memory_order_relaxed);
+        m_tick_rpm.store(rpm, std::memory_order_relaxed);
+        m_tick_events.store(record.events, std::memory_order_relaxed);
+        m_tick_commands_OK.store(true, std::memory_order_release);
+    } else {
+        publish_commands(m_contingency_inputs, record, steer_cmd, rpm);
+    }
+    return true;
+}
+
+
+void MPCControllerNode::visualize() {
+    // The markers are built on the visualizer's thread, from the vectors of
+    // this tick (which it takes over)
+    if (m_debug)
+        m_visualizer.push(m_time, m_pipeline.pos_x(), m_pipeline.pos_y(),
+                          sin(m_pipeline.psi()), cos(m_pipeline.psi()),
+                          m_pipeline.vars(), m_pipeline.coeffs(), m_pipeline.car_pts());
+}
+
+
+void MPCControllerNode::build_tick_graph() {
+    // The commands first. The plan and the speculative solve only read the
+    // solution, so they go alongside each other; the flight record reads
+    // the waypoints the speculative solve may convert; the visualizer takes
+    // the buffers of the tick over, so it's last
+    TaskGraph & graph = m_tick_graph;
+    TaskGraph::TaskId commands = graph.add("commands", [this]() {
+        publish_tick(*m_graph_inputs, m_graph_tick_start, *m_graph_record);
+    }, 2);
+    TaskGraph::TaskId speculate = graph.add("speculate", [this]() {
+        m_pipeline.speculate(m_control_period);
+    }, 1);
+    TaskGraph::TaskId plan = graph.add("plan", [this]() {
+        hand_over_plan(*m_graph_inputs);
+    }, 1);
+    TaskGraph::TaskId flight = graph.add("flight_record", [this]() {
+        record_flight(*m_graph_inputs, *m_graph_record);
+    });
+    TaskGraph::TaskId markers = graph.add("visualize", [this]() {
+        visualize();
+    });
+    graph.depends(speculate, commands);
+    graph.depends(plan, commands);
+    graph.depends(flight, speculate);
+    graph.depends(markers, plan);
+    graph.depends(markers, flight);
+
+    m_graph_pool.reset(new Eigen::NonBlockingThreadPool(1));
+    graph.set_pool(m_graph_pool.get());
+}
+
+
+void MPCControllerNode::finish_tick(const InputSnapshot & inputs, const ros::Time & time,
+                                    std::chrono::steady_clock::time_point tick_start, bool solved,
+                                    TelemetryRecord & record) {
+    // The level of the tick (see Instrumentation.h)
+    InstrumentationLevel instrumentation = Instrumentation::level();
+    m_time = time;
+    if (solved) {
+        if (m_tick_graph.size() > 0) {
+            // The stages of the tick, each as soon as its inputs are done
+            m_graph_inputs = &inputs;
+            m_graph_record = &record;
+            m_graph_tick_start = tick_start;
+            m_tick_graph.run();
+        } else {
+            publish_tick(inputs, tick_start, record);
+
+            // The next tick's solve starts now, from where the plan says
+            // the car will be then
+            m_pipeline.speculate(m_control_period);
+
+            // The plan goes to the tracking (or actuation) loop before the
+            // visualizer takes the solution over
+            hand_over_plan(inputs);
+
+            // Before the visualizer takes the waypoints over
+            record_flight(inputs, record);
+            visualize();
+        }
+
+        // Calculation times
+        record.dt_between = m_time.toSec() - m_old_time.toSec();
+        record.dt_within = ros::Time::now().toSec() - m_time.toSec();
+
+        // Keep the trace of the ticks that led to a missed deadline
+        bool overrun = (record.stage_time[TelemetryRecord::STAGE_TICK] > m_control_period);
+        if (instrumentation >= INSTRUMENTATION_TRACE
+                and (overrun or (record.events & TelemetryRecord::DEADLINE_HIT)))
+            Trace::request_dump("deadline");
+    } else {
+        record_flight(inputs, record);
+    }
+    m_ticks++;
+    m_telemetry.push(record);
+
+    // The stats go out every period, whole (the copy doesn't allocate)
+    if (m_stats_period > 0.0) {
+        if (instrumentation >= INSTRUMENTATION_COUNTERS)
+            m_stats.record(record, m_control_period, instrumentation >= INSTRUMENTATION_HISTOGRAMS);
+        if ((m_time - m_stats_handed_over).toSec() >= m_stats_period) {
+            m_pipeline.memory_stats(m_stats.memory);
+            if (m_tick_arena) {
+                TickArena::Stats arena = m_tick_arena->stats();
+                m_stats.memory.arena_high_water = arena.high_water;
+                m_stats.memory.arena_fallbacks = arena.fallbacks;
+                m_stats.memory.arena_pinned_ticks = arena.pinned_ticks;
+            }
+            m_stats_buffer.back() = m_stats;
+            m_stats_buffer.publish();
+            m_stats.reset_window();
+            m_stats_handed_over = m_time;
         }
+    }
 
-        params.latency = atof(argv[5]);
+    m_old_time = m_time;
+}
 
-        params.cte_coeff = atof(argv[6]);
-        params.epsi_coeff = atof(argv[7]);
-        params.speed_coeff = atof(argv[8]);
-        params.steer_coeff = atof(argv[9]);
 
-        params.consec_steer_coeff = atof(argv[10]);
-        params.consec_speed_coeff = atof(argv[11]);
+// The curvatures [1/m] of the problems of `calibrate_ipopt` (see
+// SolverCalibration.h): the median and the tails of those of the path of the
+// CSV, turning either way; none without it
+static std::vector<double> path_curvatures(const Params & params) {
+    std::vector<double> curvatures;
+    Waypoints waypoints;
+    if (params.waypoints_csv.empty() or !load_waypoints(params.waypoints_csv, params.waypoints_spacing, waypoints))
+        return curvatures;
+    PathSpline spline;
+    spline.build(waypoints.x, waypoints.y, false);
+    std::vector<double> samples;
+    for (double s=0.0; s < spline.length(); s += params.waypoints_spacing)
+        samples.push_back(std::abs(spline.curvature(s)));
+    if (samples.empty())
+        return curvatures;
+    std::sort(samples.begin(), samples.end());
+    for (double p : {0.5, 0.9, 0.99}) {
+        double curvature = samples[size_t(p * (samples.size() - 1))];
+        curvatures.push_back(-curvature);
+        curvatures.push_back(curvature);
+    }
+    return curvatures;
+}
 
-        params.poly_degree = atoi(argv[12]);
-        params.num_steps_poly = atoi(argv[13]);
 
-        std::string debug_msg(argv[14]);
+bool parse_params(const std::vector<std::string> & args, const ros::NodeHandle & private_nodehandle, Params & params) {
+    size_t num_expected_args = 14;
+
+    if (args.size() == num_expected_args) {
+        params.steps_ahead = atoi(args[0].c_str());
+        params.dt = atof(args[1].c_str());
+        params.ref_v = atof(args[2].c_str());
+        params.ref_v_alpha = atof(args[3].c_str());
+
+        params.latency = atof(args[4].c_str());
+
+        params.cte_coeff = atof(args[5].c_str());
+        params.epsi_coeff = atof(args[6].c_str());
+        params.speed_coeff = atof(args[7].c_str());
+        params.steer_coeff = atof(args[8].c_str());
+
+        params.consec_steer_coeff = atof(args[9].c_str());
+        params.consec_speed_coeff = atof(args[10].c_str());
+
+        params.poly_degree = atoi(args[11].c_str());
+        params.num_steps_poly = atoi(args[12].c_str());
+
+        const std::string & debug_msg = args[13];
 
         if (debug_msg == "true") {
             params.debug = true;
@@ -446,24 +1545,422 @@ int main(int argc, char **argv) {
         } else {
             std::cout << "The debug argument should either be \"true\" or \"false\""
                       << " and you passed "
-                      << argv[14]
+                      << args[13]
                       << "\n";
-            return 1;
+            return false;
         }
 
-    } else if (argc > num_expected_args ) {
+    } else if (args.empty()) {
+        // The same settings from the parameter server (with the defaults of
+        // run_mpc_cpp.sh), e.g. from a launch file
+        int steps_ahead;
+        private_nodehandle.param("steps_ahead", steps_ahead, 20);
+        params.steps_ahead = steps_ahead;
+        private_nodehandle.param("dt", params.dt, 0.05);
+        private_nodehandle.param("ref_v", params.ref_v, 4.5);
+        private_nodehandle.param("ref_v_alpha", params.ref_v_alpha, 0.9);
+        private_nodehandle.param("latency", params.latency, 0.05);
+        private_nodehandle.param("cte_coeff", params.cte_coeff, 200.0);
+        private_nodehandle.param("epsi_coeff", params.epsi_coeff, 100.0);
+        private_nodehandle.param("speed_coeff", params.speed_coeff, 100.0);
+        private_nodehandle.param("steer_coeff", params.steer_coeff, 2.0);
+        private_nodehandle.param("consec_steer_coeff", params.consec_steer_coeff, 1000.0);
+        private_nodehandle.param("consec_speed_coeff", params.consec_speed_coeff, 5.0);
+        private_nodehandle.param("poly_degree", params.poly_degree, 2);
+        private_nodehandle.param("num_steps_poly", params.num_steps_poly, 50);
+        private_nodehandle.param("debug", params.debug, false);
+
+    } else if (args.size() > num_expected_args) {
         std::cout << "Too many arguments passed to main\n";
-        return 1;
+        return false;
     } else {
         std::cout << "Too few arguments passed to main\n";
-        return 1;
+        return false;
+    }
+
+    if (params.ref_v_alpha > 1.0 or params.ref_v_alpha < 0.0) {
+        std::cout << "The ref_v_alpha argument should be a float"
+                  << " between 0.0 and 1.0 (inclusive) and you"
+                  << " passed "
+                  << params.ref_v_alpha
+                  << "\n";
+        return false;
+    }
+
+    // Optional settings, read from the parameter server
+    private_nodehandle.param("persistent_tape", params.persistent_tape, params.persistent_tape);
+    private_nodehandle.param("warm_start", params.warm_start, params.warm_start);
+    private_nodehandle.param("warm_start_initializer", params.warm_start_initializer,
+                             params.warm_start_initializer);
+    private_nodehandle.param("warm_start_weights", params.warm_start_weights, params.warm_start_weights);
+    private_nodehandle.param("dual_warm_start", params.dual_warm_start, params.dual_warm_start);
+    private_nodehandle.param("warm_start_mu", params.warm_start_mu, params.warm_start_mu);
+    private_nodehandle.param("lap_warm_start", params.lap_warm_start, params.lap_warm_start);
+    private_nodehandle.param("lap_warm_start_bins", params.lap_warm_start_bins, params.lap_warm_start_bins);
+    private_nodehandle.param("backend", params.backend, params.backend);
+    private_nodehandle.param("riccati_solver", params.riccati_solver, params.riccati_solver);
+    private_nodehandle.param("fixed_horizon", params.fixed_horizon, params.fixed_horizon);
+    private_nodehandle.param("codegen", params.codegen, params.codegen);
+    private_nodehandle.param("checkpoint_stage", params.checkpoint_stage, params.checkpoint_stage);
+    private_nodehandle.param("fast_trig", params.fast_trig, params.fast_trig);
+    private_nodehandle.param("structure_cache", params.structure_cache, params.structure_cache);
+    private_nodehandle.param("analytic_derivatives", params.analytic_derivatives, params.analytic_derivatives);
+    private_nodehandle.param("precision", params.precision, params.precision);
+    private_nodehandle.param("autodiff_stages", params.autodiff_stages, params.autodiff_stages);
+    private_nodehandle.param("limited_memory_hessian", params.limited_memory_hessian, params.limited_memory_hessian);
+    private_nodehandle.param("constant_cost_hessian", params.constant_cost_hessian, params.constant_cost_hessian);
+    private_nodehandle.param("parallel_derivatives", params.parallel_derivatives, params.parallel_derivatives);
+    private_nodehandle.param("parallel_stages", params.parallel_stages, params.parallel_stages);
+    private_nodehandle.param("linear_solver", params.linear_solver, params.linear_solver);
+    private_nodehandle.param("calibrate_linear_solver", params.calibrate_linear_solver,
+                             params.calibrate_linear_solver);
+    private_nodehandle.param("mu_strategy", params.mu_strategy, params.mu_strategy);
+    private_nodehandle.param("nlp_scaling", params.nlp_scaling, params.nlp_scaling);
+    private_nodehandle.param("cppad_sparsity", params.cppad_sparsity, params.cppad_sparsity);
+    private_nodehandle.param("calibrate_ipopt", params.calibrate_ipopt, params.calibrate_ipopt);
+    private_nodehandle.param("ipopt_profile", params.ipopt_profile, params.ipopt_profile);
+    private_nodehandle.param("ipopt_journal", params.ipopt_journal, params.ipopt_journal);
+    private_nodehandle.param("fix_initial_state", params.fix_initial_state, params.fix_initial_state);
+    private_nodehandle.param("condensed", params.condensed, params.condensed);
+    private_nodehandle.param("input_blocks", params.input_blocks, params.input_blocks);
+    private_nodehandle.param("vehicle_model", params.vehicle_model, params.vehicle_model);
+    private_nodehandle.param("integrator", params.integrator, params.integrator);
+    private_nodehandle.param("terminal_cte", params.terminal_cte, params.terminal_cte);
+    private_nodehandle.param("terminal_epsi", params.terminal_epsi, params.terminal_epsi);
+    private_nodehandle.param("max_steer_rate", params.max_steer_rate, params.max_steer_rate);
+    private_nodehandle.param("terminal_cost", params.terminal_cost, params.terminal_cost);
+    private_nodehandle.param("learning_mpc", params.learning_mpc, params.learning_mpc);
+    private_nodehandle.param("safe_set_neighbors", params.safe_set_neighbors, params.safe_set_neighbors);
+    private_nodehandle.param("safe_set_size", params.safe_set_size, params.safe_set_size);
+    private_nodehandle.param("soft_constraints", params.soft_constraints, params.soft_constraints);
+    private_nodehandle.param("soft_constraint_weight", params.soft_constraint_weight, params.soft_constraint_weight);
+    private_nodehandle.param("dt_steps", params.dt_steps, params.dt_steps);
+    private_nodehandle.param("adaptive_horizons", params.adaptive_horizons, params.adaptive_horizons);
+    private_nodehandle.param("adaptive_horizon_speeds", params.adaptive_horizon_speeds,
+                             params.adaptive_horizon_speeds);
+    private_nodehandle.param("parallel_ref_v_scales", params.parallel_ref_v_scales, params.parallel_ref_v_scales);
+    private_nodehandle.param("parallel_cold_start", params.parallel_cold_start, params.parallel_cold_start);
+    private_nodehandle.param("reference_offsets", params.reference_offsets, params.reference_offsets);
+    private_nodehandle.param("reference_offset_cost", params.reference_offset_cost, params.reference_offset_cost);
+    private_nodehandle.param("reference_switch_margin", params.reference_switch_margin,
+                             params.reference_switch_margin);
+    private_nodehandle.param("predicted_backends", params.predicted_backends, params.predicted_backends);
+    private_nodehandle.param("solve_time_model", params.solve_time_model, params.solve_time_model);
+    private_nodehandle.param("explicit_table", params.explicit_table, params.explicit_table);
+    private_nodehandle.param("explicit_table_steer_tolerance", params.explicit_table_steer_tolerance,
+                             params.explicit_table_steer_tolerance);
+    private_nodehandle.param("explicit_table_speed_tolerance", params.explicit_table_speed_tolerance,
+                             params.explicit_table_speed_tolerance);
+    private_nodehandle.param("solution_cache_size", params.solution_cache_size, params.solution_cache_size);
+    private_nodehandle.param("solution_cache_tolerance", params.solution_cache_tolerance,
+                             params.solution_cache_tolerance);
+    private_nodehandle.param("speculative_solve", params.speculative_solve, params.speculative_solve);
+    private_nodehandle.param("speculative_tolerance", params.speculative_tolerance, params.speculative_tolerance);
+    private_nodehandle.param("speculative_heading_tolerance", params.speculative_heading_tolerance,
+                             params.speculative_heading_tolerance);
+    private_nodehandle.param("remote_solver", params.remote_solver, params.remote_solver);
+    private_nodehandle.param("remote_timeout", params.remote_timeout, params.remote_timeout);
+    private_nodehandle.param("validate_plan", params.validate_plan, params.validate_plan);
+    private_nodehandle.param("validate_plan_tolerance", params.validate_plan_tolerance, params.validate_plan_tolerance);
+    private_nodehandle.param("pid_kp_cte", params.pid_kp_cte, params.pid_kp_cte);
+    private_nodehandle.param("pid_ki_cte", params.pid_ki_cte, params.pid_ki_cte);
+    private_nodehandle.param("pid_kd_cte", params.pid_kd_cte, params.pid_kd_cte);
+    private_nodehandle.param("pid_kp_epsi", params.pid_kp_epsi, params.pid_kp_epsi);
+    private_nodehandle.param("pid_ki_epsi", params.pid_ki_epsi, params.pid_ki_epsi);
+    private_nodehandle.param("pid_kd_epsi", params.pid_kd_epsi, params.pid_kd_epsi);
+    private_nodehandle.param("controller", params.controller, params.controller);
+    private_nodehandle.param("rti", params.rti, params.rti);
+    private_nodehandle.param("iterations_per_tick", params.iterations_per_tick, params.iterations_per_tick);
+    private_nodehandle.param("sensitivity_updates", params.sensitivity_updates, params.sensitivity_updates);
+    private_nodehandle.param("sensitivity_tolerance", params.sensitivity_tolerance, params.sensitivity_tolerance);
+    private_nodehandle.param("active_set_qp", params.active_set_qp, params.active_set_qp);
+    private_nodehandle.param("linearization_speed_bins", params.linearization_speed_bins,
+                             params.linearization_speed_bins);
+    private_nodehandle.param("linearization_epsi_bins", params.linearization_epsi_bins,
+                             params.linearization_epsi_bins);
+    private_nodehandle.param("linearization_max_epsi", params.linearization_max_epsi,
+                             params.linearization_max_epsi);
+    private_nodehandle.param("linearization_curvature_bins", params.linearization_curvature_bins,
+                             params.linearization_curvature_bins);
+    private_nodehandle.param("linearization_max_curvature", params.linearization_max_curvature,
+                             params.linearization_max_curvature);
+    private_nodehandle.param("mppi", params.mppi, params.mppi);
+    private_nodehandle.param("mppi_samples", params.mppi_samples, params.mppi_samples);
+    private_nodehandle.param("mppi_temperature", params.mppi_temperature, params.mppi_temperature);
+    private_nodehandle.param("mppi_steer_noise", params.mppi_steer_noise, params.mppi_steer_noise);
+    private_nodehandle.param("mppi_speed_noise", params.mppi_speed_noise, params.mppi_speed_noise);
+    private_nodehandle.param("mppi_threads", params.mppi_threads, params.mppi_threads);
+    private_nodehandle.param("solve_deadline", params.solve_deadline, params.solve_deadline);
+    private_nodehandle.param("solve_time_limit", params.solve_time_limit, params.solve_time_limit);
+    private_nodehandle.param("abort_divergence", params.abort_divergence, params.abort_divergence);
+    private_nodehandle.param("divergence_min_iterations", params.divergence_min_iterations,
+                             params.divergence_min_iterations);
+    private_nodehandle.param("divergence_inf_pr_growth", params.divergence_inf_pr_growth,
+                             params.divergence_inf_pr_growth);
+    private_nodehandle.param("divergence_min_alpha", params.divergence_min_alpha, params.divergence_min_alpha);
+    private_nodehandle.param("divergence_small_steps", params.divergence_small_steps, params.divergence_small_steps);
+    private_nodehandle.param("divergence_restoration_iterations", params.divergence_restoration_iterations,
+                             params.divergence_restoration_iterations);
+    private_nodehandle.param("adaptive_tolerance", params.adaptive_tolerance, params.adaptive_tolerance);
+    private_nodehandle.param("relaxed_tol", params.relaxed_tol, params.relaxed_tol);
+    private_nodehandle.param("relaxed_acceptable_tol", params.relaxed_acceptable_tol, params.relaxed_acceptable_tol);
+    private_nodehandle.param("scheduler", params.scheduler, params.scheduler);
+    private_nodehandle.param("pipelined", params.pipelined, params.pipelined);
+    private_nodehandle.param("loop_rate", params.loop_rate, params.loop_rate);
+    private_nodehandle.param("rate_governor", params.rate_governor, params.rate_governor);
+    private_nodehandle.param("governor_min_rate", params.governor_min_rate, params.governor_min_rate);
+    private_nodehandle.param("governor_miss_ratio", params.governor_miss_ratio, params.governor_miss_ratio);
+    private_nodehandle.param("tracking_rate", params.tracking_rate, params.tracking_rate);
+    private_nodehandle.param("actuation_rate", params.actuation_rate, params.actuation_rate);
+    private_nodehandle.param("windowed_closest", params.windowed_closest, params.windowed_closest);
+    private_nodehandle.param("projected_closest", params.projected_closest, params.projected_closest);
+    private_nodehandle.param("lap_progress", params.lap_progress, params.lap_progress);
+    private_nodehandle.param("spline_reference", params.spline_reference, params.spline_reference);
+    private_nodehandle.param("contouring_reference", params.contouring_reference, params.contouring_reference);
+    private_nodehandle.param("incremental_fit", params.incremental_fit, params.incremental_fit);
+    private_nodehandle.param("precomputed_fit", params.precomputed_fit, params.precomputed_fit);
+    private_nodehandle.param("fused_fit", params.fused_fit, params.fused_fit);
+    private_nodehandle.param("adaptive_window", params.adaptive_window, params.adaptive_window);
+    private_nodehandle.param("pyramid_levels", params.pyramid_levels, params.pyramid_levels);
+    private_nodehandle.param("compact_waypoints", params.compact_waypoints, params.compact_waypoints);
+    private_nodehandle.param("ring_margin", params.ring_margin, params.ring_margin);
+    private_nodehandle.param("fit_reuse_distance", params.fit_reuse_distance, params.fit_reuse_distance);
+    private_nodehandle.param("fit_reuse_angle", params.fit_reuse_angle, params.fit_reuse_angle);
+    private_nodehandle.param("speed_profile", params.speed_profile, params.speed_profile);
+    private_nodehandle.param("max_lateral_accel", params.max_lateral_accel, params.max_lateral_accel);
+    private_nodehandle.param("max_accel", params.max_accel, params.max_accel);
+    private_nodehandle.param("max_decel", params.max_decel, params.max_decel);
+    private_nodehandle.param("corridor_width", params.corridor_width, params.corridor_width);
+    private_nodehandle.param("corridor_margin", params.corridor_margin, params.corridor_margin);
+    private_nodehandle.param("max_obstacles", params.max_obstacles, params.max_obstacles);
+    private_nodehandle.param("obstacle_margin", params.obstacle_margin, params.obstacle_margin);
+    private_nodehandle.param("centerline_format", params.centerline_format, params.centerline_format);
+    private_nodehandle.param("track_store", params.track_store, params.track_store);
+    private_nodehandle.param("commands", params.commands, params.commands);
+    private_nodehandle.param("vesc_port", params.vesc_port, params.vesc_port);
+    private_nodehandle.param("publish_plan", params.publish_plan, params.publish_plan);
+    private_nodehandle.param("waypoints_csv", params.waypoints_csv, params.waypoints_csv);
+    private_nodehandle.param("waypoints_spacing", params.waypoints_spacing, params.waypoints_spacing);
+    private_nodehandle.param("route_tiles", params.route_tiles, params.route_tiles);
+    private_nodehandle.param("route_tiles_behind", params.route_tiles_behind, params.route_tiles_behind);
+    private_nodehandle.param("route_tiles_ahead", params.route_tiles_ahead, params.route_tiles_ahead);
+    private_nodehandle.param("centerline_patches", params.centerline_patches, params.centerline_patches);
+    private_nodehandle.param("background_centerline", params.background_centerline, params.background_centerline);
+    private_nodehandle.param("callback_queues", params.callback_queues, params.callback_queues);
+    private_nodehandle.param("pose_transport", params.pose_transport, params.pose_transport);
+    private_nodehandle.param("priority_stop", params.priority_stop, params.priority_stop);
+    private_nodehandle.param("contingency_decel", params.contingency_decel, params.contingency_decel);
+    private_nodehandle.param("contingency_pose_timeout", params.contingency_pose_timeout,
+                             params.contingency_pose_timeout);
+    private_nodehandle.param("task_graph", params.task_graph, params.task_graph);
+    private_nodehandle.param("particle_filter", params.particle_filter, params.particle_filter);
+    private_nodehandle.param("pf_particles", params.pf_particles, params.pf_particles);
+    private_nodehandle.param("pf_beams", params.pf_beams, params.pf_beams);
+    private_nodehandle.param("pf_max_range", params.pf_max_range, params.pf_max_range);
+    private_nodehandle.param("pf_threads", params.pf_threads, params.pf_threads);
+    private_nodehandle.param("pf_noise_x", params.pf_noise_x, params.pf_noise_x);
+    private_nodehandle.param("pf_noise_y", params.pf_noise_y, params.pf_noise_y);
+    private_nodehandle.param("pf_noise_theta", params.pf_noise_theta, params.pf_noise_theta);
+    private_nodehandle.param("pf_sigma_hit", params.pf_sigma_hit, params.pf_sigma_hit);
+    private_nodehandle.param("pf_range_table", params.pf_range_table, params.pf_range_table);
+    private_nodehandle.param("pf_range_bins", params.pf_range_bins, params.pf_range_bins);
+    private_nodehandle.param("log_events_every", params.log_events_every, params.log_events_every);
+    private_nodehandle.param("log_fit_every", params.log_fit_every, params.log_fit_every);
+    private_nodehandle.param("log_actuators_every", params.log_actuators_every, params.log_actuators_every);
+    private_nodehandle.param("log_cost_every", params.log_cost_every, params.log_cost_every);
+    private_nodehandle.param("log_timing_every", params.log_timing_every, params.log_timing_every);
+    private_nodehandle.param("log_ipopt_every", params.log_ipopt_every, params.log_ipopt_every);
+    private_nodehandle.param("debug_rate", params.debug_rate, params.debug_rate);
+    private_nodehandle.param("debug_compact", params.debug_compact, params.debug_compact);
+    private_nodehandle.param("latency_mode", params.latency_mode, params.latency_mode);
+    private_nodehandle.param("align_inputs", params.align_inputs, params.align_inputs);
+    private_nodehandle.param("align_max_extrapolation", params.align_max_extrapolation, params.align_max_extrapolation);
+    private_nodehandle.param("dead_reckoning", params.dead_reckoning, params.dead_reckoning);
+    private_nodehandle.param("dead_reckoning_max_age", params.dead_reckoning_max_age, params.dead_reckoning_max_age);
+    private_nodehandle.param("dead_reckoning_imu", params.dead_reckoning_imu, params.dead_reckoning_imu);
+    private_nodehandle.param("rt_cpu", params.rt_cpu, params.rt_cpu);
+    private_nodehandle.param("rt_priority", params.rt_priority, params.rt_priority);
+    private_nodehandle.param("rt_lock_memory", params.rt_lock_memory, params.rt_lock_memory);
+    private_nodehandle.param("warmup_solves", params.warmup_solves, params.warmup_solves);
+    private_nodehandle.param("parallel_build", params.parallel_build, params.parallel_build);
+    private_nodehandle.param("admission", params.admission, params.admission);
+    private_nodehandle.param("admission_solves", params.admission_solves, params.admission_solves);
+    private_nodehandle.param("admission_budget", params.admission_budget, params.admission_budget);
+    private_nodehandle.param("admission_min_steps", params.admission_min_steps, params.admission_min_steps);
+    private_nodehandle.param("admission_backends", params.admission_backends, params.admission_backends);
+    private_nodehandle.param("stats_period", params.stats_period, params.stats_period);
+    private_nodehandle.param("perf_counters", params.perf_counters, params.perf_counters);
+    private_nodehandle.param("cpu_time", params.cpu_time, params.cpu_time);
+    private_nodehandle.param("power_rail", params.power_rail, params.power_rail);
+    private_nodehandle.param("power_rail_scale", params.power_rail_scale, params.power_rail_scale);
+    private_nodehandle.param("uplink", params.uplink, params.uplink);
+    private_nodehandle.param("uplink_period", params.uplink_period, params.uplink_period);
+    private_nodehandle.param("uplink_vehicle", params.uplink_vehicle, params.uplink_vehicle);
+    private_nodehandle.param("cppad_reserve_mb", params.cppad_reserve_mb, params.cppad_reserve_mb);
+    private_nodehandle.param("cppad_cap_mb", params.cppad_cap_mb, params.cppad_cap_mb);
+    private_nodehandle.param("trace", params.trace, params.trace);
+    private_nodehandle.param("trace_directory", params.trace_directory, params.trace_directory);
+    private_nodehandle.param("instrumentation", params.instrumentation, params.instrumentation);
+    private_nodehandle.param("flight_recorder", params.flight_recorder, params.flight_recorder);
+    private_nodehandle.param("flight_recorder_ticks", params.flight_recorder_ticks, params.flight_recorder_ticks);
+    private_nodehandle.param("live_view", params.live_view, params.live_view);
+    private_nodehandle.param("tick_arena_mb", params.tick_arena_mb, params.tick_arena_mb);
+    if (params.scheduler != "rate" and params.scheduler != "pose") {
+        std::cout << "The scheduler parameter should either be \"rate\" or \"pose\""
+                  << " and you passed "
+                  << params.scheduler
+                  << "\n";
+        return false;
+    }
+    if (params.controller != "mpc" and params.controller != "pid") {
+        std::cout << "The controller parameter should either be \"mpc\" or \"pid\""
+                  << " and you passed "
+                  << params.controller
+                  << "\n";
+        return false;
+    }
+    if (params.latency_mode != "fixed" and params.latency_mode != "measured") {
+        std::cout << "The latency_mode parameter should either be \"fixed\" or \"measured\""
+                  << " and you passed "
+                  << params.latency_mode
+                  << "\n";
+        return false;
+    }
+    if (params.precision != "double" and params.precision != "mixed" and params.precision != "float") {
+        std::cout << "The precision parameter should be \"double\", \"mixed\" or \"float\""
+                  << " and you passed "
+                  << params.precision
+                  << "\n";
+        return false;
+    }
+    if (params.vehicle_model != "kinematic" and params.vehicle_model != "dynamic") {
+        std::cout << "The vehicle_model parameter should either be \"kinematic\" or \"dynamic\""
+                  << " and you passed "
+                  << params.vehicle_model
+                  << "\n";
+        return false;
+    }
+    if (params.integrator != "euler" and params.integrator != "rk2" and params.integrator != "rk4"
+            and params.integrator != "exact") {
+        std::cout << "The integrator parameter should be \"euler\", \"rk2\", \"rk4\" or \"exact\""
+                  << " and you passed "
+                  << params.integrator
+                  << "\n";
+        return false;
+    }
+    if (params.centerline_format != "marker" and params.centerline_format != "numpy"
+            and params.centerline_format != "shared") {
+        std::cout << "The centerline_format parameter should either be \"marker\", \"numpy\" or \"shared\""
+                  << " and you passed "
+                  << params.centerline_format
+                  << "\n";
+        return false;
+    }
+
+    if (params.commands != "separate" and params.commands != "combined" and params.commands != "both") {
+        std::cout << "The commands parameter should be \"separate\", \"combined\" or \"both\""
+                  << " and you passed "
+                  << params.commands
+                  << "\n";
+        return false;
+    }
+
+    std::string input_blocks;
+    for (int length : params.input_blocks) {
+        if (length < 1) {
+            std::cout << "The input_blocks should be at least 1 step long and you passed " << length << "\n";
+            return false;
+        }
+        input_blocks += (input_blocks.empty() ? "" : ",") + std::to_string(length);
+    }
+    std::string dt_steps;
+    for (double step : params.dt_steps) {
+        if (step <= 0.0) {
+            std::cout << "The dt_steps should be positive and you passed " << step << "\n";
+            return false;
+        }
+        dt_steps += (dt_steps.empty() ? "" : ",") + std::to_string(step);
+    }
+    std::string adaptive_horizons;
+    for (int steps_ahead : params.adaptive_horizons) {
+        if (steps_ahead < 3) {
+            std::cout << "The adaptive_horizons should be at least 3 steps and you passed " << steps_ahead << "\n";
+            return false;
+        }
+        adaptive_horizons += (adaptive_horizons.empty() ? "" : ",") + std::to_string(steps_ahead);
+    }
+    if (!params.adaptive_horizons.empty()
+            and params.adaptive_horizon_speeds.size() + 1 != params.adaptive_horizons.size()) {
+        std::cout << "There should be one adaptive_horizon_speeds fewer than adaptive_horizons"
+                  << " and you passed " << params.adaptive_horizon_speeds.size()
+                  << " for " << params.adaptive_horizons.size() << "\n";
+        return false;
+    }
+    std::string adaptive_horizon_speeds;
+    for (size_t i=0; i < params.adaptive_horizon_speeds.size(); i++) {
+        if (i > 0 and params.adaptive_horizon_speeds[i] <= params.adaptive_horizon_speeds[i - 1]) {
+            std::cout << "The adaptive_horizon_speeds should be increasing\n";
+            return false;
+        }
+        adaptive_horizon_speeds += (i > 0 ? "," : "") + std::to_string(params.adaptive_horizon_speeds[i]);
+    }
+    std::string parallel_ref_v_scales;
+    for (double scale : params.parallel_ref_v_scales) {
+        if (scale <= 0.0) {
+            std::cout << "The parallel_ref_v_scales should be positive and you passed " << scale << "\n";
+            return false;
+        }
+        parallel_ref_v_scales += (parallel_ref_v_scales.empty() ? "" : ",") + std::to_string(scale);
+    }
+    std::string reference_offsets;
+    for (double offset : params.reference_offsets)
+        reference_offsets += (reference_offsets.empty() ? "" : ",") + std::to_string(offset);
+    if (params.speed_profile and !(params.max_lateral_accel > 0.0 and params.max_accel > 0.0
+                                   and params.max_decel > 0.0)) {
+        std::cout << "The max_lateral_accel, max_accel and max_decel should be positive and you passed "
+                  << params.max_lateral_accel << ", " << params.max_accel << ", " << params.max_decel << "\n";
+        return false;
+    }
+    if (params.corridor_width < 0.0 or params.corridor_margin < 0.0) {
+        std::cout << "The corridor_width and corridor_margin should not be negative and you passed "
+                  << params.corridor_width << ", " << params.corridor_margin << "\n";
+        return false;
+    }
+    if (params.warm_start_mu <= 0.0) {
+        std::cout << "The warm_start_mu should be positive and you passed " << params.warm_start_mu << "\n";
+        return false;
+    }
+    if (params.relaxed_tol <= 0.0 or params.relaxed_acceptable_tol <= 0.0) {
+        std::cout << "The relaxed_tol and relaxed_acceptable_tol should be positive and you passed "
+                  << params.relaxed_tol << ", " << params.relaxed_acceptable_tol << "\n";
+        return false;
+    }
+    if (params.max_obstacles < 0 or params.obstacle_margin < 0.0) {
+        std::cout << "The max_obstacles and obstacle_margin should not be negative and you passed "
+                  << params.max_obstacles << ", " << params.obstacle_margin << "\n";
+        return false;
+    }
+    if (params.terminal_cte < 0.0 or params.terminal_epsi < 0.0 or params.max_steer_rate < 0.0
+            or params.soft_constraint_weight <= 0.0) {
+        std::cout << "The terminal_cte, terminal_epsi and max_steer_rate should not be negative, and the "
+                  << "soft_constraint_weight should be positive, and you passed " << params.terminal_cte << ", "
+                  << params.terminal_epsi << ", " << params.max_steer_rate << ", "
+                  << params.soft_constraint_weight << "\n";
+        return false;
     }
 
     std::cout << "steps_ahead: " << params.steps_ahead
               << " dt: " << params.dt
+              << " dt_steps: [" << dt_steps << "]"
               << " ref_v: " << params.ref_v
               << " ref_v_alpha: " << params.ref_v_alpha
               << " latency: " << params.latency << "[s]"
+              << " latency_mode: " << params.latency_mode
+              << " align_inputs: " << params.align_inputs
+              << " align_max_extrapolation: " << params.align_max_extrapolation
+              << " dead_reckoning: " << params.dead_reckoning
+              << " dead_reckoning_max_age: " << params.dead_reckoning_max_age
+              << " dead_reckoning_imu: " << params.dead_reckoning_imu
               << " cte_coeff: " << params.cte_coeff
               << " epsi_coeff: " << params.epsi_coeff
               << " speed_coeff: " << params.speed_coeff
@@ -473,20 +1970,210 @@ int main(int argc, char **argv) {
               << " poly degree: " << params.poly_degree
               << " num_steps_poly: " << params.num_steps_poly
               << " debug: " << params.debug
+              << " debug_rate: " << params.debug_rate
+              << " debug_compact: " << params.debug_compact
+              << " persistent_tape: " << params.persistent_tape
+              << " warm_start: " << params.warm_start
+              << " warm_start_initializer: " << params.warm_start_initializer
+              << " warm_start_weights: " << params.warm_start_weights
+              << " dual_warm_start: " << params.dual_warm_start
+              << " warm_start_mu: " << params.warm_start_mu
+              << " lap_warm_start: " << params.lap_warm_start
+              << " lap_warm_start_bins: " << params.lap_warm_start_bins
+              << " backend: \"" << params.backend << "\""
+              << " riccati_solver: " << params.riccati_solver
+              << " fixed_horizon: " << params.fixed_horizon
+              << " codegen: " << params.codegen
+              << " checkpoint_stage: " << params.checkpoint_stage
+              << " fast_trig: " << params.fast_trig
+              << " structure_cache: \"" << params.structure_cache << "\""
+              << " analytic_derivatives: " << params.analytic_derivatives
+              << " precision: " << params.precision
+              << " autodiff_stages: " << params.autodiff_stages
+              << " limited_memory_hessian: " << params.limited_memory_hessian
+              << " constant_cost_hessian: " << params.constant_cost_hessian
+              << " parallel_derivatives: " << params.parallel_derivatives
+              << " parallel_stages: " << params.parallel_stages
+              << " linear_solver: " << params.linear_solver
+              << " calibrate_linear_solver: " << params.calibrate_linear_solver
+              << " mu_strategy: \"" << params.mu_strategy << "\""
+              << " nlp_scaling: " << params.nlp_scaling
+              << " cppad_sparsity: " << params.cppad_sparsity
+              << " calibrate_ipopt: " << params.calibrate_ipopt
+              << " ipopt_profile: \"" << params.ipopt_profile << "\""
+              << " ipopt_journal: " << params.ipopt_journal
+              << " fix_initial_state: " << params.fix_initial_state
+              << " condensed: " << params.condensed
+              << " input_blocks: [" << input_blocks << "]"
+              << " vehicle_model: " << params.vehicle_model
+              << " integrator: " << params.integrator
+              << " terminal_cte: " << params.terminal_cte
+              << " terminal_epsi: " << params.terminal_epsi
+              << " max_steer_rate: " << params.max_steer_rate
+              << " terminal_cost: " << params.terminal_cost
+              << " learning_mpc: " << params.learning_mpc
+              << " safe_set_neighbors: " << params.safe_set_neighbors
+              << " safe_set_size: " << params.safe_set_size
+              << " soft_constraints: " << params.soft_constraints
+              << " soft_constraint_weight: " << params.soft_constraint_weight
+              << " adaptive_horizons: [" << adaptive_horizons << "]"
+              << " adaptive_horizon_speeds: [" << adaptive_horizon_speeds << "]"
+              << " parallel_ref_v_scales: [" << parallel_ref_v_scales << "]"
+              << " parallel_cold_start: " << params.parallel_cold_start
+              << " reference_offsets: [" << reference_offsets << "]"
+              << " reference_offset_cost: " << params.reference_offset_cost
+              << " reference_switch_margin: " << params.reference_switch_margin
+              << " predicted_backends: " << params.predicted_backends
+              << " solve_time_model: " << params.solve_time_model
+              << " explicit_table: " << params.explicit_table
+              << " explicit_table_steer_tolerance: " << params.explicit_table_steer_tolerance
+              << " explicit_table_speed_tolerance: " << params.explicit_table_speed_tolerance
+              << " solution_cache_size: " << params.solution_cache_size
+              << " solution_cache_tolerance: " << params.solution_cache_tolerance
+              << " speculative_solve: " << params.speculative_solve
+              << " speculative_tolerance: " << params.speculative_tolerance
+              << " speculative_heading_tolerance: " << params.speculative_heading_tolerance
+              << " remote_solver: " << params.remote_solver
+              << " remote_timeout: " << params.remote_timeout
+              << " validate_plan: " << params.validate_plan
+              << " validate_plan_tolerance: " << params.validate_plan_tolerance
+              << " pid_kp_cte: " << params.pid_kp_cte
+              << " pid_ki_cte: " << params.pid_ki_cte
+              << " pid_kd_cte: " << params.pid_kd_cte
+              << " pid_kp_epsi: " << params.pid_kp_epsi
+              << " pid_ki_epsi: " << params.pid_ki_epsi
+              << " pid_kd_epsi: " << params.pid_kd_epsi
+              << " controller: " << params.controller
+              << " rti: " << params.rti
+              << " iterations_per_tick: " << params.iterations_per_tick
+              << " sensitivity_updates: " << params.sensitivity_updates
+              << " sensitivity_tolerance: " << params.sensitivity_tolerance
+              << " active_set_qp: " << params.active_set_qp
+              << " linearization_speed_bins: " << params.linearization_speed_bins
+              << " linearization_epsi_bins: " << params.linearization_epsi_bins
+              << " linearization_max_epsi: " << params.linearization_max_epsi
+              << " linearization_curvature_bins: " << params.linearization_curvature_bins
+              << " linearization_max_curvature: " << params.linearization_max_curvature
+              << " mppi: " << params.mppi
+              << " mppi_samples: " << params.mppi_samples
+              << " mppi_temperature: " << params.mppi_temperature
+              << " mppi_steer_noise: " << params.mppi_steer_noise
+              << " mppi_speed_noise: " << params.mppi_speed_noise
+              << " mppi_threads: " << params.mppi_threads
+              << " solve_deadline: " << params.solve_deadline
+              << " solve_time_limit: " << params.solve_time_limit
+              << " abort_divergence: " << params.abort_divergence
+              << " divergence_min_iterations: " << params.divergence_min_iterations
+              << " divergence_inf_pr_growth: " << params.divergence_inf_pr_growth
+              << " divergence_min_alpha: " << params.divergence_min_alpha
+              << " divergence_small_steps: " << params.divergence_small_steps
+              << " divergence_restoration_iterations: " << params.divergence_restoration_iterations
+              << " adaptive_tolerance: " << params.adaptive_tolerance
+              << " relaxed_tol: " << params.relaxed_tol
+              << " relaxed_acceptable_tol: " << params.relaxed_acceptable_tol
+              << " scheduler: " << params.scheduler
+              << " pipelined: " << params.pipelined
+              << " loop_rate: " << params.loop_rate
+              << " rate_governor: " << params.rate_governor
+              << " governor_min_rate: " << params.governor_min_rate
+              << " governor_miss_ratio: " << params.governor_miss_ratio
+              << " tracking_rate: " << params.tracking_rate
+              << " actuation_rate: " << params.actuation_rate
+              << " windowed_closest: " << params.windowed_closest
+              << " projected_closest: " << params.projected_closest
+              << " lap_progress: " << params.lap_progress
+              << " spline_reference: " << params.spline_reference
+              << " contouring_reference: " << params.contouring_reference
+              << " incremental_fit: " << params.incremental_fit
+              << " precomputed_fit: " << params.precomputed_fit
+              << " fused_fit: " << params.fused_fit
+              << " adaptive_window: " << params.adaptive_window
+              << " pyramid_levels: " << params.pyramid_levels
+              << " compact_waypoints: " << params.compact_waypoints
+              << " ring_margin: " << params.ring_margin
+              << " fit_reuse_distance: " << params.fit_reuse_distance
+              << " fit_reuse_angle: " << params.fit_reuse_angle
+              << " speed_profile: " << params.speed_profile
+              << " max_lateral_accel: " << params.max_lateral_accel
+              << " max_accel: " << params.max_accel
+              << " max_decel: " << params.max_decel
+              << " corridor_width: " << params.corridor_width
+              << " corridor_margin: " << params.corridor_margin
+              << " max_obstacles: " << params.max_obstacles
+              << " obstacle_margin: " << params.obstacle_margin
+              << " centerline_format: " << params.centerline_format
+              << " track_store: \"" << params.track_store << "\""
+              << " commands: " << params.commands
+              << " vesc_port: \"" << params.vesc_port << "\""
+              << " publish_plan: " << params.publish_plan
+              << " waypoints_csv: \"" << params.waypoints_csv << "\""
+              << " waypoints_spacing: " << params.waypoints_spacing
+              << " route_tiles: \"" << params.route_tiles << "\""
+              << " route_tiles_behind: " << params.route_tiles_behind
+              << " route_tiles_ahead: " << params.route_tiles_ahead
+              << " centerline_patches: " << params.centerline_patches
+              << " background_centerline: " << params.background_centerline
+              << " callback_queues: " << params.callback_queues
+              << " pose_transport: " << params.pose_transport
+              << " priority_stop: " << params.priority_stop
+              << " contingency_decel: " << params.contingency_decel
+              << " contingency_pose_timeout: " << params.contingency_pose_timeout
+              << " task_graph: " << params.task_graph
+              << " particle_filter: " << params.particle_filter
+              << " pf_particles: " << params.pf_particles
+              << " pf_beams: " << params.pf_beams
+              << " pf_max_range: " << params.pf_max_range
+              << " pf_threads: " << params.pf_threads
+              << " pf_noise (x, y, theta): " << params.pf_noise_x << " " << params.pf_noise_y
+              << " " << params.pf_noise_theta
+              << " pf_sigma_hit: " << params.pf_sigma_hit
+              << " pf_range_table: " << params.pf_range_table
+              << " pf_range_bins: " << params.pf_range_bins
+              << " log_every (events, fit, actuators, cost, timing, ipopt): " << params.log_events_every
+              << " " << params.log_fit_every << " " << params.log_actuators_every
+              << " " << params.log_cost_every << " " << params.log_timing_every << " " << params.log_ipopt_every
+              << " rt_cpu: " << params.rt_cpu
+              << " rt_priority: " << params.rt_priority
+              << " rt_lock_memory: " << params.rt_lock_memory
+              << " warmup_solves: " << params.warmup_solves
+              << " parallel_build: " << params.parallel_build
+              << " admission: \"" << params.admission << "\""
+              << " admission_solves: " << params.admission_solves
+              << " admission_budget: " << params.admission_budget
+              << " admission_min_steps: " << params.admission_min_steps
+              << " admission_backends: \"" << params.admission_backends << "\""
+              << " stats_period: " << params.stats_period
+              << " perf_counters: " << params.perf_counters
+              << " cpu_time: " << params.cpu_time
+              << " power_rail: " << params.power_rail
+              << " power_rail_scale: " << params.power_rail_scale
+              << " uplink: " << params.uplink
+              << " uplink_period: " << params.uplink_period
+              << " uplink_vehicle: " << params.uplink_vehicle
+              << " cppad_reserve_mb: " << params.cppad_reserve_mb
+              << " cppad_cap_mb: " << params.cppad_cap_mb
+              << " trace: " << params.trace
+              << " trace_directory: \"" << params.trace_directory << "\""
+              << " instrumentation: " << params.instrumentation
+              << " flight_recorder: \"" << params.flight_recorder << "\""
+              << " flight_recorder_ticks: " << params.flight_recorder_ticks
+              << " live_view: \"" << params.live_view << "\""
+              << " tick_arena_mb: " << params.tick_arena_mb
               << "\n";
 
+    if (params.calibrate_ipopt or !params.admission.empty()) {
+        std::vector<double> curvatures = path_curvatures(params);
+        if (params.calibrate_ipopt)
+            calibrate_ipopt(params, curvatures);
+        if (!admit(params, curvatures))
+            return false;
+    }
+
     if (params.latency > 1)
         std::cout << "Latency passed to main is > 1."
                   << " However, it should be in seconds, isn't "
                   << params.latency
                   << " too high?\n";
 
-    ros::NodeHandle nodehandle;
-    MPCControllerNode mpc_node(nodehandle, params);
-
-    ros::Rate loop_rate(100);
-
-    mpc_node.loop();
-
-    return 0;
+    return true;
 }
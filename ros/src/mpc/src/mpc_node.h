@@ -1,18 +1,65 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
 #include <math.h> /* floor */
 #include <cmath>
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <std_msgs/UInt16.h>
+#include <std_msgs/UInt64.h>
 #include <std_msgs/Float64.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <std_srvs/Empty.h>
 #include <visualization_msgs/Marker.h>
 #include <geometry_msgs/Point.h>
 #include <nav_msgs/Odometry.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/Imu.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <rospy_tutorials/Floats.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <boost/bind.hpp>
+#include <dynamic_reconfigure/server.h>
+
+#include <mpc/MPCConfig.h>
+#include <mpc/CenterlinePatch.h>
+#include <mpc/Commands.h>
+#include <mpc/Obstacles.h>
+#include <mpc/Plan.h>
+#include <mpc/SetInstrumentation.h>
 
-#include "Eigen-3.3/Eigen/Core"
 #include "MPC.h"
+#include "ControlPipeline.h"
+#include "ContingencyPlanner.h"
+#include "TripleBuffer.h"
+#include "TelemetryUplink.h"
+#include "SpscQueue.h"
+#include "WaypointLoader.h"
+#include "Telemetry.h"
+#include "StageStats.h"
+#include "Instrumentation.h"
+#include "Visualizer.h"
+#include "RealTime.h"
+#include "VescSerial.h"
+#include "RateGovernor.h"
+#include "RouteStreamer.h"
+#include "CenterlinePreparer.h"
+#include "TaskGraph.h"
+#include "FlightRecorder.h"
+#include "LiveView.h"
+#include "TickArena.h"
+#include "ParticleFilter.h"
+#include "PowerRail.h"
 
 
 class MPCControllerNode {
@@ -30,82 +77,426 @@ private:
     ///* Publisher for the ESC, and the second one: for the servo
     ros::Publisher m_pub_commands_servo_position;
     ros::Publisher m_pub_commands_motor_speed;
-    // Publishers for debugging
-    ros::Publisher m_pub_next_pos;
-    ros::Publisher m_pub_poly;
-    ros::Publisher m_pub_closest;
+
+    ///* ... or both in one stamped message, see `Params::commands`
+    ros::Publisher m_pub_commands_combined;
+    bool m_separate_commands;
+    bool m_combined_commands;
+
+    ///* ... and straight to the VESC, see `Params::vesc_port`
+    std::unique_ptr<VescSerial> m_vesc;
+
+    ///* The commands go out from the loops and from /signal/go's callback
+    ///* (see `m_stopped`), one at a time
+    std::mutex m_commands_mutex;
+
+    ///* With `Params::priority_stop`: raised by an emergency stop, from
+    ///* /signal/go's callback (which sends the neutral commands right
+    ///* away), until the next go. It cancels the solve of a tick with go in
+    ///* flight (see `ControlPipeline::set_cancel_flag`), and while it's up
+    ///* the commands published are the neutral ones, whatever the loops
+    ///* worked them out from
+    bool m_priority_stop;
+    std::atomic<bool> m_stopped;
+
+    ///* ... and the plan of every tick, see `Params::publish_plan`, with the
+    ///* storage of the message kept from tick to tick
+    ros::Publisher m_pub_plan;
+    bool m_publish_plan;
+    Plan m_published_plan;
+    mpc::Plan m_plan_msg;
 
     ///* Subscribers for the readings of the lidar, and the second one: for an emergency stop signal
     ros::Subscriber m_sub_centerline;
     ros::Subscriber m_sub_odom;
     ros::Subscriber m_sub_pf_pose_odom;
     ros::Subscriber m_sub_signal_go;
+    ///* ... and of the obstacles, with `Params::max_obstacles`
+    ros::Subscriber m_sub_obstacles;
+
+    ///* ... and of the patches of the path, with `Params::centerline_patches`
+    ros::Subscriber m_sub_centerline_patch;
+
+    ///* ... and of the scans, the map and the initial pose of the particle
+    ///* filter, with `Params::particle_filter` (in place of pf/pose/odom)
+    ros::Subscriber m_sub_scan;
+    ros::Subscriber m_sub_map;
+    ros::Subscriber m_sub_initial_pose;
 
-    ///* The Model Predictive controller
-    MPC m_controller;
+    ///* ... and of the IMU, with `Params::dead_reckoning_imu`
+    ros::Subscriber m_sub_imu;
+
+    ///* Everything from the inputs to the commands (only touched by the
+    ///* solver loop, but for `prepare_centerline`)
+    ControlPipeline m_pipeline;
 
     ///* Callbacks
-    void centerline_cb(const visualization_msgs::Marker & data);
+    void centerline_cb(const visualization_msgs::Marker::ConstPtr & data);
+
+    ///* The same path, as the packed rows of (x, y, yaw, speed) floats
+    ///* that markers_node.py publishes along with the Marker
+    void centerline_numpy_cb(const rospy_tutorials::Floats::ConstPtr & data);
+
+    ///* The hash of the path of the track store (see TrackStore), which is
+    ///* read from it when it's a new one
+    void centerline_store_cb(const std_msgs::UInt64::ConstPtr & data);
+
+    ///* A span of the current path replaced (see `Params::centerline_patches`)
+    void centerline_patch_cb(const mpc::CenterlinePatch::ConstPtr & data);
+
+    void odom_cb(const nav_msgs::Odometry::ConstPtr & data);
+
+    void imu_cb(const sensor_msgs::Imu::ConstPtr & data);
+
+    void pf_pose_odom_cb(const nav_msgs::Odometry::ConstPtr & data);
 
-    void odom_cb(const nav_msgs::Odometry & data);
+    ///* With `Params::particle_filter`: localizes from the scan, and hands
+    ///* the pose over as `pf_pose_odom_cb` does
+    void scan_cb(const sensor_msgs::LaserScan::ConstPtr & data);
+    void map_cb(const nav_msgs::OccupancyGrid::ConstPtr & data);
+    void initial_pose_cb(const geometry_msgs::PoseWithCovarianceStamped::ConstPtr & data);
 
-    void pf_pose_odom_cb(const nav_msgs::Odometry & data);
+    void signal_go_cb(const std_msgs::UInt16::ConstPtr & data);
 
-    void signal_go_cb(const std_msgs::UInt16 & data);
+    void obstacles_cb(const mpc::Obstacles::ConstPtr & data);
+
+    ///* Publishes the latest stats the solver loop handed over (on a timer,
+    ///* every `Params::stats_period`)
+    void stats_cb(const ros::TimerEvent & event);
+
+    ///* The "Solver loop" status of /diagnostics, from the same stats
+    void diagnose(diagnostic_updater::DiagnosticStatusWrapper & status);
+
+    ///* /mpc/dump_trace: asks for a dump of the trace (see `Params::trace`)
+    bool dump_trace_cb(std_srvs::Empty::Request & request, std_srvs::Empty::Response & response);
+
+    ///* /mpc/set_instrumentation: switches the instrumentation level (see
+    ///* Instrumentation.h), without touching the solvers
+    bool set_instrumentation_cb(mpc::SetInstrumentation::Request & request,
+                                mpc::SetInstrumentation::Response & response);
+
+    ///* Switches to `level`, with the dumper of the trace started for the
+    ///* trace (it then stays up until the node stops)
+    void set_instrumentation(InstrumentationLevel level);
+
+    ///* dynamic_reconfigure (see cfg/MPC.cfg): the new parameters are handed
+    ///* over to the solver loop, which takes them between two ticks (see
+    ///* `ControlPipeline::reconfigure`)
+    void reconfigure_cb(mpc::MPCConfig & config, uint32_t level);
 
     ///* Other methods
-    visualization_msgs::Marker get_marker(const std::vector<double> & vars, double px_lat, double py_lat, double sin_psi_lat, double cos_psi_lat, float red, float green, float blue);
+    ///* Whether the path (by its hash and size, see InputMessages.h) is the
+    ///* current one already, or the one it's patched from; counts the
+    ///* skipped messages
+    bool is_current_centerline(uint64_t hash, size_t num_points);
+
+    ///* Builds the structures derived from the waypoints and makes the
+    ///* centerline the current one (on `m_preparer`'s thread, when there's
+    ///* one, and from the next pose on)
+    void set_centerline(const std::shared_ptr<Centerline> & centerline);
+
+    ///* Makes the prepared centerline the current one (without handing the
+    ///* inputs over), with `m_inputs_mutex` held
+    void swap_centerline(const std::shared_ptr<const Centerline> & centerline);
+
+    ///* Hands `m_inputs` over to the solver loop, with `m_inputs_mutex` held
+    void publish_inputs();
+
+    ///* ... after a new pose: with the path of the tiles about it, and waking
+    ///* the solver loop up in the "pose" mode
+    void publish_pose();
+
+    ///* The real-time profile (see `Params::rt_cpu`) of the calling thread,
+    ///* and the warm-up solves, after which /signal/go is taken
+    void apply_realtime_profile();
+
+    ///* The commands (in Dzik's units, see ControlPipeline), from the pose of
+    ///* `inputs`, on the topics of `Params::commands`
+    void publish_commands(const InputSnapshot & inputs, const TelemetryRecord & record, double steer_cmd,
+                          double rpm);
+
+    ///* The plan of the latest tick, on /mpc/plan
+    void publish_plan(const InputSnapshot & inputs);
+
+    ///* Writes the tick into the flight recorder and the live view, those
+    ///* that are on
+    void record_flight(const InputSnapshot & inputs, const TelemetryRecord & record);
 
-    int find_closest(const std::vector<double> & pts_x, const std::vector<double> & pts_y, double pos_x, double pos_y);
+    ///* Waits (up to a timeout) for a pose newer than `seen`; false on timeout
+    bool wait_for_pose(uint64_t & seen);
+
+    ///* Waits for the next tick of `Params::scheduler`; false on timeout
+    bool wait_for_tick(ros::Rate & loop_rate, uint64_t & pose_seq);
+
+    ///* With `Params::pipelined`: the path stage of the ticks (on a thread
+    ///* of its own, which `loop` starts) and the solves, which hand the
+    ///* problems over through `m_prepared`
+    void path_loop();
+    void solve_loop();
+
+    ///* With `Params::tracking_rate`: follows the plan of the latest tick
+    ///* between the solves, on a thread of its own, which `loop` starts
+    void tracking_loop();
+
+    ///* With `Params::actuation_rate`: publishes the commands at a fixed
+    ///* rate, on a thread of its own, which `loop` starts
+    void actuation_loop();
+
+    ///* Waits (up to a timeout) for a problem prepared after the `seen`th;
+    ///* false on timeout
+    bool wait_for_prepared(uint64_t & seen);
+
+    ///* The rest of a tick, once it's solved (`solved`) or not: the
+    ///* commands, the speculative solve, the records and the stats
+    void finish_tick(const InputSnapshot & inputs, const ros::Time & time,
+                     std::chrono::steady_clock::time_point tick_start, bool solved, TelemetryRecord & record);
+
+    ///* The stages of a solved tick (see `finish_tick`): the commands (and
+    ///* the times of the tick), the plan to the tracking loop and the plan
+    ///* topic, and the debug markers
+    void publish_tick(const InputSnapshot & inputs, std::chrono::steady_clock::time_point tick_start,
+                      TelemetryRecord & record);
+    void hand_over_plan(const InputSnapshot & inputs);
+    void visualize();
+
+    ///* With `Params::contingency_decel`, after a tick at `now` [s] (the
+    ///* stamp of its inputs' clock), `failed` when nothing of the solver's
+    ///* drives the car: on a fault, the commands of the contingency go out
+    ///* instead of the tick's (then it returns true). Without a tick (no
+    ///* pose by the timeout of the loop), `inputs` is nullptr and only the
+    ///* age of the last pose counts
+    bool contingency_step(const InputSnapshot * inputs, double now, bool failed, TelemetryRecord & record);
+
+    ///* With `Params::task_graph`: those stages, the speculative solve and
+    ///* the flight record as `m_tick_graph`, on a thread of `m_graph_pool`
+    ///* besides the solver loop's, and the tick they're run for
+    void build_tick_graph();
+    TaskGraph m_tick_graph;
+    std::unique_ptr<Eigen::ThreadPoolInterface> m_graph_pool;
+    const InputSnapshot * m_graph_inputs;
+    TelemetryRecord * m_graph_record;
+    std::chrono::steady_clock::time_point m_graph_tick_start;
 
     ///* Non-ROS members
-    std::vector<double> m_pts_x;
-    std::vector<double> m_pts_y;
-    bool m_pts_OK;
 
-    double m_pos_x;
-    double m_pos_y;
-    bool m_pos_OK;
+    ///* Inputs as gathered by the callbacks, and their hand-off to the
+    ///* solver loop, under `m_inputs_mutex` (the callbacks of the queues
+    ///* below run on threads of their own)
+    InputSnapshot m_inputs;
+    TripleBuffer<InputSnapshot> m_input_buffer;
+    std::mutex m_inputs_mutex;
+
+    ///* With `Params::callback_queues`: the queues of the callbacks of the
+    ///* poses (and of the odometry, the IMU and the particle filter), of the
+    ///* paths (and of the obstacles), and of /signal/go, each served by a
+    ///* spinner thread of its own, so that a long path never holds a pose
+    ///* up; the rest (reconfiguration, services, timers) stay on the
+    ///* node's queue
+    ros::CallbackQueue m_pose_queue;
+    ros::CallbackQueue m_path_queue;
+    ros::CallbackQueue m_signal_queue;
+    std::unique_ptr<ros::AsyncSpinner> m_pose_spinner;
+    std::unique_ptr<ros::AsyncSpinner> m_path_spinner;
+    std::unique_ptr<ros::AsyncSpinner> m_signal_spinner;
+
+    ///* The parameters as last reconfigured (written under `m_inputs_mutex`
+    ///* by the reconfiguration only), and their hand-off to the solver loop: a snapshot swapped
+    ///* atomically, along with its version (the last one applied is only
+    ///* touched by the solver loop)
+    Params m_params;
+    std::shared_ptr<const Params> m_params_snapshot;
+    std::atomic<uint64_t> m_params_version;
+    uint64_t m_params_applied;
+    std::unique_ptr<dynamic_reconfigure::Server<mpc::MPCConfig> > m_reconfigure_server;
+
+    ///* Number of /centerline messages skipped because their path was
+    ///* already known
+    uint64_t m_centerline_skipped;
+
+    ///* The tiles of the route about the car (see `Params::route_tiles`),
+    ///* null when the path is whole
+    std::unique_ptr<RouteStreamer> m_route;
+
+    ///* Prepares the new paths, with `Params::background_centerline` (null
+    ///* without it)
+    std::unique_ptr<CenterlinePreparer> m_preparer;
+
+    ///* See `Params::particle_filter` (null without it); only touched on the
+    ///* spinner's thread
+    std::unique_ptr<ParticleFilter> m_particle_filter;
 
-    double m_speed;
-    bool m_speed_OK;
+    ///* Everything the solver loop reports goes through it (it's logged on
+    ///* a thread of its own)
+    Telemetry m_telemetry;
 
-    double m_psi;
-    bool m_psi_OK;
+    ///* Latency histograms of the stages of the ticks, gathered by the
+    ///* solver loop and handed over to `stats_cb` every `m_stats_period` [s]
+    ///* (0: not at all); overruns are counted against `m_control_period` [s]
+    StageStats m_stats;
+    TripleBuffer<StageStats> m_stats_buffer;
+    double m_stats_period;
+    std::atomic<double> m_control_period;
+    ///* See `Params::rate_governor` (null without it)
+    std::unique_ptr<RateGovernor> m_governor;
+    ///* See `Params::perf_counters`
+    bool m_perf_counters;
+    ///* See `Params::cpu_time`
+    bool m_cpu_time;
+    ///* See `Params::power_rail` (not open without it)
+    PowerRail m_power_rail;
+    ///* The names of the backends, by `TelemetryRecord::backend`
+    std::vector<std::string> m_backend_names;
+    ros::Time m_stats_handed_over;
+    ///* See `Params::uplink` (fed from `stats_cb`)
+    TelemetryUplink m_uplink;
+    ros::Publisher m_pub_stats;
+    ///* The memory of the last stats, with the process' (see MemoryStats)
+    ros::Publisher m_pub_memory;
+    MemoryStats m_memory;
+    ros::Timer m_stats_timer;
+    diagnostic_updater::Updater m_diagnostics;
 
-    double m_steer;
-    double m_rpm;
+    ///* See `Params::trace` and `Params::instrumentation`
+    std::string m_trace_directory;
+    ros::ServiceServer m_srv_dump_trace;
+    ros::ServiceServer m_srv_set_instrumentation;
 
-    double m_ref_v;
-    double m_ref_v_alpha;
+    ///* See `Params::flight_recorder`, and the ticks so far
+    FlightRecorder m_flight_recorder;
+    uint64_t m_ticks;
 
-    size_t m_poly_degree;
-    size_t m_num_steps_poly;
+    ///* See `Params::live_view`, the frame of the tick and its plan
+    LiveView m_live_view;
+    LiveFrame m_live_frame;
+    Plan m_live_plan;
+
+    ///* See `Params::tick_arena_mb` (none without it)
+    std::unique_ptr<TickArena> m_tick_arena;
+
+    ///* Builds and publishes the debug markers (with `m_debug`) on a thread
+    ///* of its own
+    Visualizer m_visualizer;
+
+    ///* Scheduling of the solves, see `Params::scheduler`
+    enum class Scheduler { RATE, POSE };
+    Scheduler m_scheduler;
+    double m_loop_rate;
+
+    ///* The multi-rate control, see `Params::tracking_rate`: the inputs and
+    ///* the plans handed over to the tracking loop (the latter by the solver
+    ///* loop), and what only the tracking loop touches
+    double m_tracking_rate;
+    double m_tracking_latency;
+    TripleBuffer<InputSnapshot> m_tracking_input_buffer;
+    TripleBuffer<Plan> m_plan_buffer;
+    Plan m_tracking_plan;
+    PlanFollower m_follower;
+
+    ///* The fixed-rate actuation, see `Params::actuation_rate`: it takes the
+    ///* inputs and the plans of the tracking loop, and the commands (and the
+    ///* events) of the latest tick, once there's one, from the solver loop
+    double m_actuation_rate;
+    std::atomic<bool> m_tick_commands_OK;
+    std::atomic<double> m_tick_steer_cmd;
+    std::atomic<double> m_tick_rpm;
+    std::atomic<uint32_t> m_tick_events;
+
+    ///* The contingency stop, see `Params::contingency_decel`: whether the
+    ///* car is stopping along the `front()` of the planner (which isn't
+    ///* updated meanwhile), and the go and the pose stamp of the last tick,
+    ///* for when there's none (the solver loop's)
+    std::unique_ptr<ContingencyPlanner> m_contingency;
+    double m_contingency_pose_timeout;
+    bool m_contingency_engaged;
+    InputSnapshot m_contingency_inputs;
+
+    ///* Count of the poses received, to wake the solver loop up in the
+    ///* "pose" mode
+    std::mutex m_pose_mutex;
+    std::condition_variable m_pose_cv;
+    uint64_t m_pose_seq;
+
+    ///* A tick on its way from the path stage to the solver loop (see
+    ///* `Params::pipelined`): its inputs, its problem, what's reported of it
+    ///* so far, and the parameters it was prepared with
+    struct PreparedTick {
+        InputSnapshot inputs;
+        TickProblem problem;
+        TelemetryRecord record;
+        ros::Time time;
+        std::chrono::steady_clock::time_point tick_start;
+        std::shared_ptr<const Params> params;
+        uint64_t params_version = 0;
+    };
+    ///* Room for a problem being solved, and the ones prepared meanwhile
+    static constexpr size_t PIPELINE_DEPTH = 4;
+    bool m_pipelined;
+    SpscQueue<PreparedTick, PIPELINE_DEPTH> m_prepared;
+    std::mutex m_prepared_mutex;
+    std::condition_variable m_prepared_cv;
+    uint64_t m_prepared_seq;
+
+    ///* Cleared by `stop`
+    std::atomic<bool> m_running;
 
     ///* Other member attributes
     bool m_debug;
-    bool m_go_flag;
-    double m_latency;
 
-    ///* When fitting a degree=3 polynomial to the waypoints we're using
-    ///* (STEPS_POLY * 3) points ahead to fit it (impacts smoothness)
-    static constexpr int STEP_POLY = 1;
+    ///* See `Params::rt_cpu`
+    int m_rt_cpu;
+    int m_rt_priority;
+    bool m_rt_lock_memory;
+    int m_warmup_solves;
+    bool m_parallel_build;
+
+    ///* Whether the solvers are built and warmed up (see
+    ///* `apply_realtime_profile`), and the last go of /signal/go until then
+    ///* (0 for none), both under `m_inputs_mutex`: the car only goes once
+    ///* the first solves are as fast as the others
+    bool m_solvers_ready;
+    uint16_t m_pending_go;
+
+    ///* Columns of /mpc/stats, a row per stage: count, p50, p90, p99, max [s]
+    static constexpr size_t STATS_COLUMNS = 5;
+    ///* ... then, with `Params::perf_counters`, the means per tick of the
+    ///* cycles, instructions, cache misses and branch misses
+    static constexpr size_t PERF_COLUMNS = 4;
+    ///* ... then, with `Params::cpu_time`, the mean CPU time per tick [s]
+    static constexpr size_t CPU_COLUMNS = 1;
+    ///* Columns of /mpc/memory (see MemoryStats)
+    static constexpr size_t MEMORY_COLUMNS = 14;
 
-    ///* If you see: "coeffs: nan   nan   nan   nan" in the logger,
-    ///* it means that polyfit was unable to fit a polynomial which
-    ///* may be caused by the `X_DELTA_MIN_VALUE` being too low
-    static constexpr double X_DELTA_MIN_VALUE = 0.001;
+    ///* The trace is dumped at most this often [s]
+    static constexpr double TRACE_DUMP_INTERVAL = 5.0;
 
-    static constexpr int NUM_STEPS_BACK = 5;
+    ///* How much of the solver loop's stack the real-time profile faults in
+    static constexpr size_t PREFAULT_STACK_SIZE = 512 * 1024; // [B]
 
-    ///* The value of the steering angle that means "go straight" in Dzik
-    static constexpr double CENTER_IN_DZIK = 0.56;
-    ///* Dzik's wheel radius
-    static constexpr double WHEEL_RADIUS_IN_DZIK = 0.055; // [m]
+    ///* How long the "pose" mode waits before checking if the node is still OK
+    static constexpr double POSE_WAIT_TIMEOUT = 0.1; // [s]
 
 
 public:
-    MPCControllerNode(const ros::NodeHandle & nodehandle, const Params & params);
+    ///* The topics are those of `nodehandle`'s namespace (but for the
+    ///* centerline, which is the same for all), the dynamic_reconfigure
+    ///* server lives in `private_nodehandle`. The parallel solves run on
+    ///* `pool` when there's one (see ControlPipeline)
+    MPCControllerNode(const ros::NodeHandle & nodehandle, const ros::NodeHandle & private_nodehandle,
+                      const Params & params, Eigen::ThreadPoolInterface * pool = nullptr);
+    ~MPCControllerNode();
 
+    ///* The solver loop: returns when the node shuts down or after `stop`.
+    ///* The callbacks have to be served by another thread meanwhile (e.g. an
+    ///* AsyncSpinner, or the nodelet manager)
     void loop();
+
+    ///* Makes `loop` return (from any thread)
+    void stop();
 };
+
+
+///* Reads the parameters from the positional arguments (`args`, without the
+///* program name), or from the parameter server without any, and the optional
+///* ones from the parameter server; false (after printing why) if they're not
+///* valid
+bool parse_params(const std::vector<std::string> & args, const ros::NodeHandle & private_nodehandle, Params & params);
@@ -0,0 +1,31 @@
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include "mpc_node.h"
+
+
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "mpc_node_cpp");
+
+    Params params;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    ros::NodeHandle private_nodehandle("~");
+    if (!parse_params(args, private_nodehandle, params))
+        return 1;
+
+    ros::NodeHandle nodehandle;
+    MPCControllerNode mpc_node(nodehandle, private_nodehandle, params);
+
+    // The callbacks are served by the spinner's thread (but those of the
+    // node's own queues, see `Params::callback_queues`), the solver loop runs
+    // on this one
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+
+    mpc_node.loop();
+
+    return 0;
+}
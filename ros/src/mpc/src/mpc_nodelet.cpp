@@ -0,0 +1,50 @@
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "mpc_node.h"
+
+
+namespace mpc {
+
+///* MPCControllerNode as a nodelet (mpc/MPCNodelet), to be loaded into the
+///* manager of the particle filter and the VESC driver so that the poses,
+///* odometry and commands are passed as shared pointers instead of being
+///* serialized. It takes the same arguments as mpc_node_cpp (as the nodelet's
+///* `args`) and the same private parameters.
+///*
+///* The callbacks are served (one at a time) by the manager's threads, the
+///* solver loop runs on a thread of its own.
+class MPCNodelet : public nodelet::Nodelet {
+public:
+    ~MPCNodelet() {
+        if (m_node)
+            m_node->stop();
+        if (m_loop_thread.joinable())
+            m_loop_thread.join();
+    }
+
+private:
+    void onInit() override {
+        Params params;
+        if (!parse_params(getMyArgv(), getPrivateNodeHandle(), params)) {
+            NODELET_ERROR("Invalid arguments, the MPC controller is not running");
+            return;
+        }
+
+        m_node.reset(new MPCControllerNode(getNodeHandle(), getPrivateNodeHandle(), params));
+        m_loop_thread = std::thread(&MPCControllerNode::loop, m_node.get());
+    }
+
+    std::unique_ptr<MPCControllerNode> m_node;
+    std::thread m_loop_thread;
+};
+
+}
+
+
+PLUGINLIB_EXPORT_CLASS(mpc::MPCNodelet, nodelet::Nodelet)
@@ -0,0 +1,168 @@
+// The fastest line around a track (see RacelineNLP), solved offline by
+// Ipopt, without ROS:
+//
+//   mpc_raceline [--spacing S] [--width W] [--max-speed V] [--max-lateral-accel A]
+//                [--max-accel A] [--max-decel A] [--threads N] waypoints.csv raceline.csv
+//
+// The centerline is the spline through the waypoints, which have to make a
+// loop (as PathTracker tells one); the car keeps within `--width` of it.
+// The solve starts from the centerline at the speed of its SpeedProfile,
+// and the lap times of both are reported. The raceline is written in the
+// 4-column format of the waypoints (x, y, yaw, speed), a point per stage,
+// so the nodes follow it like any other path.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <coin/IpIpoptApplication.hpp>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "PathSpline.h"
+#include "RacelineNLP.h"
+#include "SpeedProfile.h"
+#include "WaypointLoader.h"
+
+
+// The arc length between two stages [m]
+static const double DEFAULT_SPACING = 0.1;
+
+// As PathTracker::CLOSED_PATH_GAP: the last waypoint is about as close to
+// the first one as any two consecutive ones
+static const double CLOSED_PATH_GAP = 3.0;
+
+
+static void usage(const char * program) {
+    RacelineLimits limits;
+    std::fprintf(stderr, "Usage: %s [--spacing S] [--width W] [--max-speed V] [--max-lateral-accel A]\n"
+                         "       [--max-accel A] [--max-decel A] [--threads N] waypoints.csv raceline.csv\n", program);
+    std::fprintf(stderr, "  --spacing S             the arc length between two stages [m] (default: %g)\n",
+                 DEFAULT_SPACING);
+    std::fprintf(stderr, "  --width W               the half width of the corridor [m] (default: %g)\n",
+                 limits.half_width);
+    std::fprintf(stderr, "  --max-speed V           [m/s] (default: %g)\n", limits.max_speed);
+    std::fprintf(stderr, "  --max-lateral-accel A   [m/s^2] (default: %g)\n", limits.max_lateral_accel);
+    std::fprintf(stderr, "  --max-accel A           [m/s^2] (default: %g)\n", limits.max_accel);
+    std::fprintf(stderr, "  --max-decel A           [m/s^2] (default: %g)\n", limits.max_decel);
+    std::fprintf(stderr, "  --threads N             of the evaluations (default: the cores)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    RacelineLimits limits;
+    double spacing = DEFAULT_SPACING;
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--spacing" or arg == "--width" or arg == "--max-speed" or arg == "--max-lateral-accel"
+             or arg == "--max-accel" or arg == "--max-decel" or arg == "--threads") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--threads") {
+                num_threads = std::strtoul(value.c_str(), nullptr, 10);
+                continue;
+            }
+            double number = std::atof(value.c_str());
+            if (number <= 0.0) {
+                std::fprintf(stderr, "%s should be positive\n", arg.c_str());
+                return 1;
+            }
+            if (arg == "--spacing")
+                spacing = number;
+            else if (arg == "--width")
+                limits.half_width = number;
+            else if (arg == "--max-speed")
+                limits.max_speed = number;
+            else if (arg == "--max-lateral-accel")
+                limits.max_lateral_accel = number;
+            else if (arg == "--max-accel")
+                limits.max_accel = number;
+            else
+                limits.max_decel = number;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Waypoints waypoints;
+    if (!load_waypoints(paths[0], 0.05, waypoints))
+        return 1;
+    size_t num_points = waypoints.x.size();
+    double length = 0.0;
+    for (size_t i=1; i < num_points; i++)
+        length += std::hypot(waypoints.x[i] - waypoints.x[i-1], waypoints.y[i] - waypoints.y[i-1]);
+    if (num_points < 3 or std::hypot(waypoints.x[0] - waypoints.x[num_points-1], waypoints.y[0] - waypoints.y[num_points-1])
+                          >= CLOSED_PATH_GAP * length / (num_points - 1)) {
+        std::fprintf(stderr, "%s: the waypoints don't make a loop\n", paths[0].c_str());
+        return 1;
+    }
+    PathSpline centerline;
+    centerline.build(waypoints.x, waypoints.y, true);
+    size_t num_stages = std::max(size_t(3), size_t(std::ceil(centerline.length() / spacing)));
+
+    Eigen::NonBlockingThreadPool pool(int(std::max(size_t(1), num_threads)));
+    Ipopt::SmartPtr<RacelineNLP> nlp = new RacelineNLP(centerline, num_stages, limits, &pool);
+
+    // The centerline at the fastest speed it allows
+    SpeedProfile profile;
+    profile.build(centerline, limits.max_lateral_accel, limits.max_accel, limits.max_decel);
+    std::vector<double> speeds(num_stages);
+    for (size_t k=0; k < num_stages; k++)
+        speeds[k] = profile.speed(nlp->station(k));
+    nlp->set_start(speeds);
+    double start_time = nlp->lap_time();
+    std::printf("%s: %.2f m, %lu stages of %.3f m, %lu threads\n", paths[0].c_str(), centerline.length(),
+                num_stages, nlp->step(), num_threads);
+
+    Ipopt::SmartPtr<Ipopt::IpoptApplication> app = IpoptApplicationFactory();
+    app->Options()->SetIntegerValue("print_level", 5);
+    app->Options()->SetNumericValue("tol", 1e-6);
+    app->Options()->SetIntegerValue("max_iter", 3000);
+    app->Options()->SetStringValue("mu_strategy", "adaptive");
+    Ipopt::ApplicationReturnStatus status = app->Initialize();
+    if (status != Ipopt::Solve_Succeeded) {
+        std::fprintf(stderr, "Could not initialize Ipopt (status: %d)\n", status);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    status = app->OptimizeTNLP(nlp);
+    double solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    bool solved = (status == Ipopt::Solve_Succeeded or status == Ipopt::Solved_To_Acceptable_Level);
+    std::printf("status %d after %d iterations, %.2f s\n", status, nlp->iterations(), solve_time);
+    std::printf("lap time: %.3f s on the centerline, %.3f s on the raceline\n", start_time, nlp->lap_time());
+    if (!solved)
+        return 1;
+
+    FILE * file = std::fopen(paths[1].c_str(), "w");
+    if (file == nullptr) {
+        std::fprintf(stderr, "Could not write %s\n", paths[1].c_str());
+        return 1;
+    }
+    const std::vector<double> & x = nlp->x();
+    PathSpline::Sample sample;
+    for (size_t k=0; k < num_stages; k++) {
+        const double * z = &x[k * RacelineNLP::STAGE_VARS];
+        centerline.sample(nlp->station(k), sample);
+        double n = z[RacelineNLP::N_OFFSET];
+        std::fprintf(file, "%.6f, %.6f, %.6f, %.6f\n", sample.x - n * std::sin(sample.heading),
+                     sample.y + n * std::cos(sample.heading), sample.heading + z[RacelineNLP::MU], z[RacelineNLP::V]);
+    }
+    std::fclose(file);
+    std::printf("wrote %s\n", paths[1].c_str());
+    return 0;
+}
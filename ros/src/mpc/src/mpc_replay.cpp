@@ -0,0 +1,269 @@
+// Solves the ticks of a flight log (see FlightRecorder) again, without ROS,
+// and compares the solutions and the solve times with those of the run:
+//
+//   mpc_replay [--tolerance T] [--slowest N] [--repeat N] [--deterministic [--cpu C]]
+//              [--results FILE] flight.log
+//
+// Every tick that was solved is solved again, in order, by an MPC of the
+// configuration of the run (the solver flags, the horizon, the weights and
+// the degree of the fit as they were at the tick), from the very same
+// problem: so the warm starts follow the same chain, and the solutions are
+// the same as the run's, but for the ticks whose solve was cut short by the
+// deadline (the replay has none). The ticks answered from the cache or by a
+// speculative solve aren't solved, as in the run (whose speculative solves
+// aren't in the log, so the warm starts differ with them); those whose
+// commands aren't the main solve's (the explicit table's, a parallel
+// variant's or a fallback's) are solved to keep the chain, but not
+// compared. The other fields of Params (e.g. the
+// time grid, the move blocking) are the defaults of run_mpc_cpp.sh.
+//
+// The slowest ticks of the run are listed with their replayed solve times:
+// a spike that replays slow is the problem's, one that doesn't the node's.
+//
+// To compare solvers (builds or configurations), the replay is a benchmark:
+// with --repeat, the log is replayed that many times (from fresh
+// controllers) and the solve time of a tick is the median of its repeats;
+// with --deterministic, the replay runs on one core (--cpu, 0 by default),
+// whose frequency governor is checked, with a single thread for the linear
+// solver and no CPU time limit on the solves (see
+// `Params::solve_time_limit`), so that they end on Ipopt's iterations
+// rather than on the load of the machine. --results writes the times of
+// the ticks (see BenchmarkResults), which mpc_bench_compare compares.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "FlightRecorder.h"
+#include "OfflineTools.h"
+#include "BenchmarkResults.h"
+#include "RealTime.h"
+
+
+// Of the differences of the first actuations from the run's
+static const double DEFAULT_TOLERANCE = 1e-6;
+
+static const size_t DEFAULT_SLOWEST = 10;
+
+
+// Whether the solution of the tick is the main solve's, in full
+static bool comparable(const FlightRecord & record) {
+    const uint32_t OTHER = TelemetryRecord::CACHE_HIT | TelemetryRecord::SOLVE_SKIPPED
+            | TelemetryRecord::SPECULATION_HIT | TelemetryRecord::EXPLICIT_LAW | TelemetryRecord::DEADLINE_HIT | TelemetryRecord::FALLBACK
+            | TelemetryRecord::REMOTE_USED;
+    return (record.events & OTHER) == 0 and record.variant == 0;
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--tolerance T] [--slowest N] [--repeat N] [--deterministic [--cpu C]] "
+                 "[--results FILE] flight.log\n", program);
+    std::fprintf(stderr, "  --tolerance   largest difference of the first actuations from the run's (default: %g)\n",
+                 DEFAULT_TOLERANCE);
+    std::fprintf(stderr, "  --slowest N   the slowest ticks of the run listed (default: %lu)\n", DEFAULT_SLOWEST);
+    std::fprintf(stderr, "  --repeat N    replays of the log, the median solve time of a tick is reported "
+                 "(default: 1)\n");
+    std::fprintf(stderr, "  --deterministic  on one core, one thread, without time limits on the solves\n");
+    std::fprintf(stderr, "  --cpu C       the core of --deterministic (default: 0)\n");
+    std::fprintf(stderr, "  --results FILE  the times of the ticks, for mpc_bench_compare\n");
+}
+
+
+int main(int argc, char ** argv) {
+    double tolerance = DEFAULT_TOLERANCE;
+    size_t num_slowest = DEFAULT_SLOWEST;
+    size_t repeats = 1;
+    bool deterministic = false;
+    int cpu = 0;
+    std::string results_path;
+    std::string path;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--tolerance" or arg == "--slowest" or arg == "--repeat" or arg == "--cpu"
+                or arg == "--results") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--tolerance")
+                tolerance = std::atof(value.c_str());
+            else if (arg == "--slowest")
+                num_slowest = std::strtoul(value.c_str(), nullptr, 10);
+            else if (arg == "--repeat")
+                repeats = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+            else if (arg == "--cpu")
+                cpu = std::atoi(value.c_str());
+            else
+                results_path = value;
+        } else if (arg == "--deterministic") {
+            deterministic = true;
+        } else if (arg.compare(0, 2, "--") == 0 or !path.empty()) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+    if (path.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FlightLog log;
+    if (!log.load(path))
+        return 1;
+    const std::vector<FlightRecord> & records = log.records();
+    std::printf("%s: %lu ticks", path.c_str(), records.size());
+    if (!records.empty())
+        std::printf(" (%lu to %lu)", records.front().tick, records.back().tick);
+    std::printf("\n");
+
+    // Nothing the timings depend on but the solves (the threads of the
+    // linear solver are set up by its first solve)
+    Params base = default_params();
+    if (deterministic) {
+        setenv("OMP_NUM_THREADS", "1", 1);
+        pin_thread_to_cpu(cpu);
+        check_cpu_governor(cpu);
+        base.solve_time_limit = 0.0;
+    }
+
+    // A controller per horizon, as in ControlPipeline, all of them rebuilt
+    // when the problem changes otherwise
+    std::map<size_t, std::unique_ptr<MPC> > controllers;
+    Params current;
+    bool current_OK = false;
+
+    Eigen::VectorXd state(5);
+    Eigen::VectorXd coeffs;
+    std::vector<double> vars;
+
+    struct Replayed {
+        size_t index;
+        double recorded; // [s]
+        double replayed; // [s]
+    };
+    std::vector<Replayed> replayed;
+    std::vector<double> recorded_times, replayed_times;
+    size_t num_compared = 0;
+    size_t num_over = 0;
+    double max_steer_error = 0.0;
+    double max_speed_error = 0.0;
+
+    // The solve times of every tick solved, over the repeats
+    BenchmarkResults results;
+    results.log = path;
+    results.repeats = repeats;
+    std::vector<std::vector<double> > tick_times;
+
+    for (size_t repeat=0; repeat < repeats; repeat++) {
+        controllers.clear();
+        current_OK = false;
+        size_t solved = 0;
+
+        for (size_t i=0; i < records.size(); i++) {
+            const FlightRecord & record = records[i];
+            if ((record.events & TelemetryRecord::NO_OPTIMIZATION) or record.steps_ahead == 0
+                    or record.num_coeffs == 0)
+                continue;
+            // Those didn't solve, so didn't move the warm start on
+            if (record.events & (TelemetryRecord::CACHE_HIT | TelemetryRecord::SOLVE_SKIPPED
+                                 | TelemetryRecord::SPECULATION_HIT))
+                continue;
+
+            Params params = log.params(base, record);
+            if (!current_OK or !params.same_weights(current) or params.poly_degree != current.poly_degree) {
+                controllers.clear();
+                current = params;
+                current_OK = true;
+            }
+            std::unique_ptr<MPC> & controller = controllers[params.steps_ahead];
+            if (!controller)
+                controller.reset(new MPC(params));
+            if (record.events & TelemetryRecord::HORIZON_SWITCHED)
+                controller->reset_warm_start();
+
+            state << 0, 0, 0, record.cte, record.epsi;
+            coeffs.resize(record.num_coeffs);
+            for (size_t c=0; c < record.num_coeffs; c++)
+                coeffs[c] = record.coeffs[c];
+
+            auto start = std::chrono::steady_clock::now();
+            controller->Solve(state, coeffs, record.ref_v, vars);
+            double solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // The solutions are the same on every repeat
+            if (repeat == 0) {
+                tick_times.emplace_back();
+                replayed.push_back({i, record.solve_time(), 0.0});
+                recorded_times.push_back(record.solve_time());
+                results.ticks.push_back({record.tick, 0.0, 0.0, 0.0, controller->iterations(),
+                                         vars.empty() ? 0.0 : vars[0], vars.size() < 2 ? 0.0 : vars[1]});
+            }
+            tick_times[solved++].push_back(solve_time);
+            if (repeat > 0 or !comparable(record) or record.num_vars < 2)
+                continue;
+
+            double steer_error = std::abs(vars[0] - record.vars[0]);
+            double speed_error = std::abs(vars[1] - record.vars[1]);
+            max_steer_error = std::max(max_steer_error, steer_error);
+            max_speed_error = std::max(max_speed_error, speed_error);
+            if (steer_error > tolerance or speed_error > tolerance) {
+                if (num_over == 0)
+                    std::printf("tick %lu: steer %.9g instead of %.9g, speed %.9g instead of %.9g\n",
+                                record.tick, vars[0], record.vars[0], vars[1], record.vars[1]);
+                num_over++;
+            }
+            num_compared++;
+        }
+    }
+
+    // The median of the repeats of every tick
+    for (size_t k=0; k < tick_times.size(); k++) {
+        std::vector<double> & times = tick_times[k];
+        std::sort(times.begin(), times.end());
+        double median = percentile(times, 50);
+        replayed[k].replayed = median;
+        replayed_times.push_back(median);
+        results.ticks[k].solve_time = median;
+        results.ticks[k].min_time = times.front();
+        results.ticks[k].max_time = times.back();
+    }
+    if (!results_path.empty() and !results.save(results_path))
+        return 1;
+
+    std::sort(recorded_times.begin(), recorded_times.end());
+    std::sort(replayed_times.begin(), replayed_times.end());
+    std::printf("%-10s %6s %9s %9s %9s %9s\n", "solves", "count", "p50 [ms]", "p90 [ms]", "p99 [ms]", "max [ms]");
+    std::printf("%-10s %6lu %9.3f %9.3f %9.3f %9.3f\n", "recorded", recorded_times.size(),
+                1e3 * percentile(recorded_times, 50), 1e3 * percentile(recorded_times, 90),
+                1e3 * percentile(recorded_times, 99), 1e3 * percentile(recorded_times, 100));
+    std::printf("%-10s %6lu %9.3f %9.3f %9.3f %9.3f\n", "replayed", replayed_times.size(),
+                1e3 * percentile(replayed_times, 50), 1e3 * percentile(replayed_times, 90),
+                1e3 * percentile(replayed_times, 99), 1e3 * percentile(replayed_times, 100));
+
+    // The slowest ticks of the run, slowest first
+    std::sort(replayed.begin(), replayed.end(),
+              [](const Replayed & a, const Replayed & b) { return a.recorded > b.recorded; });
+    if (num_slowest > 0 and !replayed.empty())
+        std::printf("%8s %13s %13s %13s %6s %8s\n", "tick", "tick [ms]", "solve [ms]", "replay [ms]", "iters", "events");
+    for (size_t s=0; s < std::min(num_slowest, replayed.size()); s++) {
+        const FlightRecord & record = records[replayed[s].index];
+        std::printf("%8lu %13.3f %13.3f %13.3f %6d %8x\n", record.tick,
+                    1e3 * record.stage_time[TelemetryRecord::STAGE_TICK], 1e3 * replayed[s].recorded,
+                    1e3 * replayed[s].replayed, int(record.iterations), record.events);
+    }
+
+    std::printf("%lu solutions compared: largest differences %.2e (steer), %.2e (speed)", num_compared,
+                max_steer_error, max_speed_error);
+    if (num_over > 0)
+        std::printf(", %lu over the tolerance", num_over);
+    std::printf("\n");
+    return (num_over == 0) ? 0 : 1;
+}
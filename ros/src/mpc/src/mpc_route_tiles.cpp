@@ -0,0 +1,58 @@
+// Writes a waypoints CSV as a tiled route (see write_route_tiles), for the
+// node to stream the tiles about the car from instead of loading the whole
+// path (`Params::route_tiles`), without ROS:
+//
+//   mpc_route_tiles [--tile-points N] [--spacing D] route.tiles waypoints.csv
+//
+// The waypoints are those the node would load from the CSV (see
+// load_waypoints) with the same spacing.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "WaypointLoader.h"
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--tile-points N] [--spacing D] route.tiles waypoints.csv\n", program);
+    std::fprintf(stderr, "  --tile-points N  the waypoints of a tile (default: 1024)\n");
+    std::fprintf(stderr, "  --spacing D      the least distance between the waypoints kept [m] (default: 0.05)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    int tile_points = 1024;
+    double spacing = 0.05;
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--tile-points" or arg == "--spacing") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--tile-points")
+                tile_points = std::atoi(value.c_str());
+            else
+                spacing = std::atof(value.c_str());
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2 or tile_points < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Waypoints waypoints;
+    if (!load_waypoints(paths[1], spacing, waypoints))
+        return 1;
+    if (!write_route_tiles(paths[0], waypoints, size_t(tile_points)))
+        return 1;
+    std::printf("%s: %lu waypoints in %lu tiles\n", paths[0].c_str(), waypoints.x.size(),
+                (waypoints.x.size() + tile_points - 1) / tile_points);
+    return 0;
+}
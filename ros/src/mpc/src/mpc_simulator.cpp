@@ -0,0 +1,236 @@
+// Closed-loop simulation of the controller on a waypoints CSV, without ROS:
+//
+//   mpc_simulator [options] waypoints.csv
+//
+// The car follows the kinematic model of FG_eval, driven by the commands of
+// the same ControlPipeline as the node's (in Dzik's units, mapped back to the
+// steering angle and the speed); every tick is stepped as soon as the previous
+// one is solved, so it runs as fast as the solves allow. The poses the
+// controller gets can be delayed and noisy, and the runs (each with its own
+// seed of the noise) are spread over processes, one per core by default (see
+// Simulation.h).
+//
+// It reports, for every run and over all of them, the lap times, the cross
+// track error (the distance of the car to the path), the prediction error
+// (how far the end of a plan is from where its actuations take the car by
+// the simulation's finer steps, the error of the integrator of FG_eval, see
+// `Params::integrator`) and the distribution of the solve times.
+//
+// The solve times are how long the ticks took, but the simulated car doesn't
+// wait for them: the latency it sees is the one injected with --latency.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "MPC.h"
+#include "OfflineTools.h"
+#include "Simulation.h"
+#include "WaypointLoader.h"
+
+
+struct Options : SimulationOptions {
+    size_t num_runs = 1;
+    size_t num_jobs = 0; // 0: one per core
+    unsigned seed = 1;
+};
+
+
+// Bounds of the lowest bucket of the solve time histogram; each of the next
+// ones is twice as wide
+static const double HISTOGRAM_START = 1.0e-4; // [s]
+static const int HISTOGRAM_BUCKETS = 12;
+static const int HISTOGRAM_WIDTH = 50; // [characters]
+
+
+static void print_run(size_t index, unsigned seed, const RunResult & result) {
+    std::printf("run %lu (seed %u): %lu laps [s]:", index, seed, result.lap_times.size());
+    for (double lap_time : result.lap_times)
+        std::printf(" %.3f", lap_time);
+    std::printf("%s\n", result.off_track ? " (left the track)" : "");
+    std::printf("    |cte| [m]: mean %.4f rms %.4f max %.4f; %lu ticks, %.1f [s] simulated in %.2f [s] (%.1fx real time)\n",
+                result.cte_mean, std::sqrt(result.cte_mean_squares), result.cte_max, result.solve_times.size(),
+                result.sim_time, result.wall_time, result.sim_time / std::max(result.wall_time, 1e-9));
+    std::printf("    prediction error [m]: mean %.4f max %.4f\n", result.prediction_error_mean,
+                result.prediction_error_max);
+    std::fflush(stdout);
+}
+
+
+static void print_summary(const std::vector<RunResult> & results) {
+    std::vector<double> lap_times, solve_times;
+    double cte_mean = 0.0, cte_mean_squares = 0.0, cte_max = 0.0;
+    double prediction_error_mean = 0.0, prediction_error_max = 0.0;
+    double num_deadline_hits = 0, num_solve_failures = 0, num_pid_fallbacks = 0, num_off_track = 0;
+    for (const RunResult & result : results) {
+        lap_times.insert(lap_times.end(), result.lap_times.begin(), result.lap_times.end());
+        solve_times.insert(solve_times.end(), result.solve_times.begin(), result.solve_times.end());
+        // Weighted by the ticks of the run
+        cte_mean += result.cte_mean * result.solve_times.size();
+        cte_mean_squares += result.cte_mean_squares * result.solve_times.size();
+        cte_max = std::max(cte_max, result.cte_max);
+        prediction_error_mean += result.prediction_error_mean * result.solve_times.size();
+        prediction_error_max = std::max(prediction_error_max, result.prediction_error_max);
+        num_deadline_hits += result.num_deadline_hits;
+        num_solve_failures += result.num_solve_failures;
+        num_pid_fallbacks += result.num_pid_fallbacks;
+        num_off_track += result.off_track;
+    }
+    size_t num_ticks = std::max(solve_times.size(), size_t(1));
+    std::sort(lap_times.begin(), lap_times.end());
+    std::sort(solve_times.begin(), solve_times.end());
+
+    std::printf("\n%lu runs, %lu laps, %.0f left the track\n", results.size(), lap_times.size(), num_off_track);
+    if (!lap_times.empty()) {
+        double total = 0.0;
+        for (double lap_time : lap_times)
+            total += lap_time;
+        std::printf("lap time [s]: best %.3f mean %.3f p50 %.3f worst %.3f\n", lap_times.front(),
+                    total / lap_times.size(), percentile(lap_times, 50), lap_times.back());
+    }
+    std::printf("|cte| [m]: mean %.4f rms %.4f max %.4f\n", cte_mean / num_ticks,
+                std::sqrt(cte_mean_squares / num_ticks), cte_max);
+    std::printf("prediction error [m]: mean %.4f max %.4f\n", prediction_error_mean / num_ticks,
+                prediction_error_max);
+    if (solve_times.empty())
+        return;
+    std::printf("solve [ms]: p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f; %.0f deadline hits, %.0f failures "
+                "(%.0f on the PID law)\n",
+                1e3 * percentile(solve_times, 50), 1e3 * percentile(solve_times, 90),
+                1e3 * percentile(solve_times, 99), 1e3 * percentile(solve_times, 99.9), 1e3 * solve_times.back(),
+                num_deadline_hits, num_solve_failures, num_pid_fallbacks);
+
+    // Log-scale histogram of the solve times, the last bucket unbounded
+    size_t counts[HISTOGRAM_BUCKETS] = {0};
+    for (double solve_time : solve_times) {
+        int bucket = 0;
+        for (double bound = HISTOGRAM_START; bucket < HISTOGRAM_BUCKETS - 1 and solve_time >= bound; bound *= 2)
+            bucket++;
+        counts[bucket]++;
+    }
+    size_t most = *std::max_element(counts, counts + HISTOGRAM_BUCKETS);
+    double low = 0.0, high = HISTOGRAM_START;
+    for (int bucket=0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        char range[32];
+        if (bucket < HISTOGRAM_BUCKETS - 1)
+            std::snprintf(range, sizeof(range), "[%.3f, %.3f)", 1e3 * low, 1e3 * high);
+        else
+            std::snprintf(range, sizeof(range), "[%.3f, inf)", 1e3 * low);
+        int width = int(std::round(double(HISTOGRAM_WIDTH) * counts[bucket] / std::max(most, size_t(1))));
+        std::printf("  %-20s %8lu %s\n", range, counts[bucket], std::string(width, '#').c_str());
+        low = high;
+        high *= 2;
+    }
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [options] waypoints.csv\n", program);
+    std::fprintf(stderr, "  --laps N          laps per run (default: 3)\n");
+    std::fprintf(stderr, "  --max-time S      simulated time after which a run stops [s] (default: 600)\n");
+    std::fprintf(stderr, "  --latency S       age of the poses the controller gets [s] (default: 0)\n");
+    std::fprintf(stderr, "  --latency-mode M  Params::latency_mode, \"fixed\" or \"measured\" (default: fixed)\n");
+    std::fprintf(stderr, "  --pos-noise M     standard deviations of the noise of the position [m],\n");
+    std::fprintf(stderr, "  --psi-noise R     of the heading [rad]\n");
+    std::fprintf(stderr, "  --speed-noise V   and of the speed [m/s] (default: 0)\n");
+    std::fprintf(stderr, "  --rate HZ         rate of the ticks in simulated time (default: 100)\n");
+    std::fprintf(stderr, "  --config NAME     solver configuration, of");
+    for (const Configuration & configuration : CONFIGURATIONS)
+        std::fprintf(stderr, " %s", configuration.name);
+    std::fprintf(stderr, " (default: ipopt)\n");
+    std::fprintf(stderr, "  --steps N         steps_ahead of the horizon (default: 20)\n");
+    std::fprintf(stderr, "  --dt S            the step of the horizon [s] (default: 0.05)\n");
+    std::fprintf(stderr, "  --integrator I    of the steps, \"euler\", \"rk2\", \"rk4\" or \"exact\" (default: euler)\n");
+    std::fprintf(stderr, "  --runs N          independent runs (default: 1)\n");
+    std::fprintf(stderr, "  --jobs N          runs at a time (default: one per core)\n");
+    std::fprintf(stderr, "  --seed N          seed of the noise of the first run, the next ones count up (default: 1)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    Options options;
+    Params params = default_params();
+    std::string csv_path;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if (arg.compare(0, 2, "--") == 0 and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--laps") {
+                options.num_laps = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--max-time") {
+                options.max_time = std::atof(value.c_str());
+            } else if (arg == "--latency") {
+                options.latency = std::atof(value.c_str());
+            } else if (arg == "--latency-mode" and (value == "fixed" or value == "measured")) {
+                params.latency_mode = value;
+            } else if (arg == "--pos-noise") {
+                options.pos_noise = std::atof(value.c_str());
+            } else if (arg == "--psi-noise") {
+                options.psi_noise = std::atof(value.c_str());
+            } else if (arg == "--speed-noise") {
+                options.speed_noise = std::atof(value.c_str());
+            } else if (arg == "--rate" and std::atof(value.c_str()) > 0.0) {
+                params.loop_rate = std::atof(value.c_str());
+            } else if (arg == "--config" and find_configuration(value) != nullptr) {
+                find_configuration(value)->apply(params);
+            } else if (arg == "--steps" and std::atoi(value.c_str()) > 2) {
+                params.steps_ahead = size_t(std::atoi(value.c_str()));
+            } else if (arg == "--dt" and std::atof(value.c_str()) > 0.0) {
+                params.dt = std::atof(value.c_str());
+            } else if (arg == "--integrator" and (value == "euler" or value == "rk2" or value == "rk4"
+                                                  or value == "exact")) {
+                params.integrator = value;
+            } else if (arg == "--runs") {
+                options.num_runs = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--jobs") {
+                options.num_jobs = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--seed") {
+                options.seed = std::strtoul(value.c_str(), nullptr, 10);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg.compare(0, 2, "--") == 0 or !csv_path.empty()) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            csv_path = arg;
+        }
+    }
+    if (csv_path.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (options.num_jobs == 0)
+        options.num_jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    Waypoints waypoints;
+    if (!load_waypoints(csv_path, 0.05, waypoints))
+        return 1;
+    if (waypoints.x.size() <= size_t(params.num_steps_poly)) {
+        std::fprintf(stderr, "%s: too few waypoints (%lu)\n", csv_path.c_str(), waypoints.x.size());
+        return 1;
+    }
+
+    // Built before the runs fork, which share it
+    std::shared_ptr<const Centerline> centerline = make_centerline(waypoints, params);
+
+    std::vector<RunResult> results(options.num_runs);
+    bool OK = run_in_processes(options.num_runs, options.num_jobs, [&](size_t r) {
+        return simulate(centerline, params, options, options.seed + unsigned(r));
+    }, [&](size_t r, const RunResult & result) {
+        results[r] = result;
+        print_run(r, options.seed + unsigned(r), result);
+    });
+    if (!OK)
+        return 1;
+    print_summary(results);
+    return 0;
+}
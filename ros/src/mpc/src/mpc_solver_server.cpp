@@ -0,0 +1,126 @@
+// Solves the problems of a node offloading its solves (see
+// `Params::remote_solver`), without ROS, typically on a faster machine next
+// to the track:
+//
+//   mpc_solver_server [--port P] [--horizon N] [--dt DT] [--config NAME] [--model NAME]
+//
+// Every request (see RemoteRequest) is solved by an MPC of the defaults of
+// run_mpc_cpp.sh, with the given horizon, time step, solver configuration
+// (see OfflineTools.h, persistent_warm by default) and vehicle model, and
+// the result sent back to where it came from. The horizon can be longer
+// than the node's (up to 200 steps), but the time step has to be the
+// node's, which interpolates the plan on its own grid. The warm start is
+// the server's own, from the solve of the last request (the node asks for
+// a reset when its own doesn't carry over).
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "OfflineTools.h"
+#include "RemoteSolve.h"
+
+
+static const int DEFAULT_PORT = 7450;
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--port P] [--horizon N] [--dt DT] [--config NAME] [--model NAME]\n",
+                 program);
+    std::fprintf(stderr, "  --port      UDP port to listen on (default: %d)\n", DEFAULT_PORT);
+    std::fprintf(stderr, "  --horizon   steps ahead (default: run_mpc_cpp.sh's)\n");
+    std::fprintf(stderr, "  --dt        time step [s], the node's (default: run_mpc_cpp.sh's)\n");
+    std::fprintf(stderr, "  --config    solver configuration (default: persistent_warm):");
+    for (const Configuration & configuration : CONFIGURATIONS)
+        std::fprintf(stderr, " %s", configuration.name);
+    std::fprintf(stderr, "\n  --model     vehicle model (default: kinematic)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    Params params = default_params();
+    int port = DEFAULT_PORT;
+    std::string config = "persistent_warm";
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--port" or arg == "--horizon" or arg == "--dt" or arg == "--config" or arg == "--model")
+                and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--port")
+                port = std::atoi(value.c_str());
+            else if (arg == "--horizon")
+                params.steps_ahead = std::atoi(value.c_str());
+            else if (arg == "--dt")
+                params.dt = std::atof(value.c_str());
+            else if (arg == "--config")
+                config = value;
+            else
+                params.vehicle_model = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    const Configuration * configuration = find_configuration(config);
+    if (configuration == nullptr or params.steps_ahead < 1
+            or 2 + 2 * size_t(params.steps_ahead) > RemoteReply::MAX_VARS or params.dt <= 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    configuration->apply(params);
+
+    int server = open_remote_server(port);
+    if (server < 0)
+        return 1;
+    std::printf("Solving on port %d: %d steps of %.3f [s], %s, %s model\n", port, int(params.steps_ahead), params.dt,
+                configuration->name, params.vehicle_model.c_str());
+    std::fflush(stdout);
+
+    MPC controller(params);
+    RemoteRequest request;
+    RemoteReply reply;
+    reply.magic = RemoteReply::MAGIC;
+    Eigen::VectorXd state, coeffs;
+    std::vector<double> vars;
+    vars.reserve(2 + 2 * params.steps_ahead);
+    for (;;) {
+        sockaddr_storage client;
+        socklen_t client_size = sizeof(client);
+        ssize_t size = recvfrom(server, &request, sizeof(request), 0, reinterpret_cast<sockaddr *>(&client),
+                                &client_size);
+        if (size < ssize_t(RemoteRequest::size(0)) or request.magic != RemoteRequest::MAGIC
+                or request.num_state > RemoteRequest::MAX_STATE or request.num_coeffs > RemoteRequest::MAX_COEFFS
+                or size < ssize_t(RemoteRequest::size(request.num_coeffs)))
+            continue;
+
+        state.resize(request.num_state);
+        for (size_t i=0; i < request.num_state; i++)
+            state[i] = request.state[i];
+        coeffs.resize(request.num_coeffs);
+        for (size_t i=0; i < request.num_coeffs; i++)
+            coeffs[i] = request.coeffs[i];
+        if (request.reset)
+            controller.reset_warm_start();
+
+        controller.Solve(state, coeffs, request.ref_v, vars);
+        const SolveStats & stats = controller.stats();
+        reply.sequence = request.sequence;
+        reply.ok = stats.ok ? 1 : 0;
+        reply.deadline_hit = stats.deadline_hit ? 1 : 0;
+        reply.num_vars = uint16_t(std::min(vars.size(), size_t(RemoteReply::MAX_VARS)));
+        reply.iterations = stats.iterations;
+        reply.cost = stats.cost;
+        reply.solve_time = stats.solve_time;
+        for (size_t i=0; i < reply.num_vars; i++)
+            reply.vars[i] = vars[i];
+        sendto(server, &reply, RemoteReply::size(reply.num_vars), 0, reinterpret_cast<const sockaddr *>(&client),
+               client_size);
+    }
+}
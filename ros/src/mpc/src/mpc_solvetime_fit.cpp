@@ -0,0 +1,181 @@
+// Fits the models of the solve times of the backends (see
+// SolveTimePredictor) to flight logs (see FlightRecorder), without ROS:
+//
+//   mpc_solvetime_fit [--ridge F] [--quantile Q] model.txt [--backend NAME] flight.log...
+//
+// The samples are the ticks the controller solved (not answered from the
+// explicit table, the cache, a speculative solve or the remote solver): the
+// features of the problem against the solve time of the tick, by ridge
+// regression per backend. A log's backend is the one of its header (Ipopt,
+// the Riccati solver or RTI), or that of the --backend before it (for the
+// others, e.g. "mppi"). The logs of runs that switched backends (with
+// `Params::predicted_backends`) are skipped.
+//
+// A backend's margin is the quantile Q of the errors of its fit (how much
+// slower than predicted its solves were), so that a prediction covers that
+// share of the solves. It then reports, per backend, the RMS error of the
+// fit and its margin.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "FlightRecorder.h"
+#include "SolveTimePredictor.h"
+
+
+// The samples of a backend: the features, one tick after the other, and the
+// solve times [s]
+struct Samples {
+    std::string backend;
+    std::vector<double> features;
+    std::vector<double> times;
+};
+
+
+// The ticks the controller solved itself
+static bool solved(const FlightRecord & record) {
+    const uint32_t not_solved = TelemetryRecord::NO_OPTIMIZATION | TelemetryRecord::EXPLICIT_LAW
+            | TelemetryRecord::CACHE_HIT | TelemetryRecord::SOLVE_SKIPPED | TelemetryRecord::SPECULATION_HIT
+            | TelemetryRecord::REMOTE_USED;
+    return !(record.events & not_solved) and record.stage_time[TelemetryRecord::STAGE_SOLVER] >= 0.0f;
+}
+
+
+// The backend of the header's configuration
+static std::string header_backend(const FlightLogHeader & header) {
+    if (header.solver_flags & FlightLogHeader::SOLVER_RTI)
+        return "rti";
+    if (header.solver_flags & FlightLogHeader::SOLVER_RICCATI)
+        return "riccati";
+    return "ipopt";
+}
+
+
+// The samples of a log; false if it switched backends
+static bool add_samples(const FlightLog & log, Samples & samples) {
+    const std::vector<FlightRecord> & records = log.records();
+    for (const FlightRecord & record : records)
+        if (record.events & TelemetryRecord::BACKEND_SWITCHED)
+            return false;
+
+    const FlightRecord * previous = nullptr;
+    for (const FlightRecord & record : records) {
+        if (solved(record)) {
+            // Warm, as the pipeline tells it: from the solve of the tick
+            // before, which succeeded, on the same horizon
+            bool warm = previous != nullptr and previous->tick + 1 == record.tick and solved(*previous)
+                    and !(previous->events & TelemetryRecord::SOLVE_FAILED)
+                    and !(record.events & TelemetryRecord::HORIZON_SWITCHED);
+            int previous_iterations = warm ? std::max(int(previous->iterations), 0) : -1;
+            size_t n = samples.features.size();
+            samples.features.resize(n + SolveTimePredictor::NUM_FEATURES);
+            SolveTimePredictor::features(record.cte, record.epsi, record.coeffs,
+                                         std::min(size_t(record.num_coeffs), FlightRecord::MAX_COEFFS),
+                                         record.speed, record.ref_v, warm ? previous->cte : 0.0,
+                                         warm ? previous->epsi : 0.0, previous_iterations, &samples.features[n]);
+            samples.times.push_back(record.solve_time());
+        }
+        previous = &record;
+    }
+    return true;
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--ridge F] [--quantile Q] model.txt [--backend NAME] flight.log...\n",
+                 program);
+    std::fprintf(stderr, "  --ridge F       the regularization of the fit (default: 1e-6)\n");
+    std::fprintf(stderr, "  --quantile Q    the share of the solves a prediction covers (default: 0.95)\n");
+    std::fprintf(stderr, "  --backend NAME  the backend of the logs that follow (default: their header's)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    double ridge = 1e-6;
+    double quantile = 0.95;
+    std::string model_path;
+    std::string backend;
+    std::vector<Samples> backends;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--ridge" or arg == "--quantile" or arg == "--backend") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--ridge")
+                ridge = std::atof(value.c_str());
+            else if (arg == "--quantile")
+                quantile = std::atof(value.c_str());
+            else
+                backend = value;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else if (model_path.empty()) {
+            model_path = arg;
+        } else {
+            FlightLog log;
+            if (!log.load(arg))
+                return 1;
+            std::string name = backend.empty() ? header_backend(log.header()) : backend;
+            auto found = std::find_if(backends.begin(), backends.end(),
+                                      [&name](const Samples & samples) { return samples.backend == name; });
+            if (found == backends.end()) {
+                backends.emplace_back();
+                backends.back().backend = name;
+                found = backends.end() - 1;
+            }
+            if (!add_samples(log, *found))
+                std::fprintf(stderr, "%s switched backends, skipping it\n", arg.c_str());
+        }
+    }
+    if (backends.empty() or !(quantile > 0.0 and quantile < 1.0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const size_t num_features = SolveTimePredictor::NUM_FEATURES;
+    std::vector<std::string> names;
+    Eigen::MatrixXd weights(backends.size(), num_features);
+    std::vector<double> margins;
+    for (size_t b=0; b < backends.size(); b++) {
+        const Samples & samples = backends[b];
+        size_t num_samples = samples.times.size();
+        if (num_samples < num_features) {
+            std::fprintf(stderr, "Only %lu solves of %s for %lu features\n", num_samples,
+                         samples.backend.c_str(), num_features);
+            return 1;
+        }
+
+        // Ridge regression, one sample per column
+        Eigen::Map<const Eigen::MatrixXd> X(samples.features.data(), num_features, num_samples);
+        Eigen::Map<const Eigen::VectorXd> y(samples.times.data(), num_samples);
+        Eigen::MatrixXd gram = X * X.transpose();
+        gram.diagonal().array() += ridge * num_samples;
+        Eigen::VectorXd w = gram.ldlt().solve(X * y);
+        weights.row(b) = w.transpose();
+
+        // The margin: how much slower than the fit the solves were, at
+        // the quantile
+        Eigen::VectorXd error = y - X.transpose() * w;
+        std::vector<double> errors(error.data(), error.data() + num_samples);
+        size_t k = std::min(size_t(quantile * num_samples), num_samples - 1);
+        std::nth_element(errors.begin(), errors.begin() + k, errors.end());
+        double margin = std::max(errors[k], 0.0);
+        names.push_back(samples.backend);
+        margins.push_back(margin);
+
+        std::printf("%-10s %7lu solves, mean %.2f ms, RMS error %.2f ms, margin %.2f ms (p%.0f)\n",
+                    samples.backend.c_str(), num_samples, 1e3 * y.mean(),
+                    1e3 * std::sqrt(error.squaredNorm() / num_samples), 1e3 * margin, 1e2 * quantile);
+    }
+    if (!SolveTimePredictor::write(model_path, names, weights, margins))
+        return 1;
+    std::printf("wrote %s\n", model_path.c_str());
+    return 0;
+}
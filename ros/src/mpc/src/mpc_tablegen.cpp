@@ -0,0 +1,265 @@
+// Builds the table of the explicit MPC (see ExplicitTable), without ROS:
+//
+//   mpc_tablegen [--config NAME] [--counts N,...] [--margin F] [--threads N] table.bin waypoints.csv...
+//
+// The grid spans the inputs the recorded paths give MPC::Solve: the
+// coefficients of the fits of a lap of the synthetic drive along each of
+// them (the one of mpc_benchmark), from their 1st to their 99th percentile
+// widened by the margin, and the reference speeds from
+// ref_v_alpha * ref_v to ref_v. Every node is solved from scratch, and so is
+// the center of every cell, against which the cell's interpolation is
+// checked; the table keeps that error, for the tolerances of the lookups.
+// The solves are batches on all the cores (see BatchSolver).
+//
+// The Params are those of run_mpc_cpp.sh, which the node has to match for
+// the table to be used.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "BatchSolver.h"
+#include "ExplicitTable.h"
+#include "MPC.h"
+#include "OfflineTools.h"
+#include "WaypointBuffer.h"
+#include "WaypointLoader.h"
+
+
+// The problem at `point` (the coefficients, then the reference speed)
+static void make_problem(const double * point, size_t num_coeffs, BatchProblem & problem) {
+    problem.coeffs.resize(num_coeffs);
+    for (size_t i=0; i < num_coeffs; i++)
+        problem.coeffs[i] = point[i];
+    // The state follows from the fit, as in the node
+    problem.state.resize(5);
+    problem.state << 0, 0, 0, problem.coeffs[0], -atan(problem.coeffs[1]);
+    problem.ref_v = point[num_coeffs];
+}
+
+
+// Its first actuations, NaN if the solve failed
+static void first_actuations(const BatchSolution & solution, float & delta, float & v) {
+    if (solution.stats.ok) {
+        delta = float(solution.result[0]);
+        v = float(solution.result[1]);
+    } else {
+        delta = v = std::numeric_limits<float>::quiet_NaN();
+    }
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--config NAME] [--counts N,...] [--margin F] [--threads N] table.bin "
+                 "waypoints.csv...\n", program);
+    std::fprintf(stderr, "  --config      the solver configuration of the solves (default: persistent)\n");
+    std::fprintf(stderr, "  --counts      the nodes of every axis, the coefficients then the reference speed\n");
+    std::fprintf(stderr, "                (default: 7 per coefficient, 3 for the speed)\n");
+    std::fprintf(stderr, "  --margin F    how much wider than the range of the coefficients the grid is\n");
+    std::fprintf(stderr, "                (default: 0.1)\n");
+    std::fprintf(stderr, "  --threads N   the threads of the solves (default: one per core)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    const Configuration * configuration = find_configuration("persistent");
+    std::vector<uint32_t> counts;
+    double margin = 0.1;
+    int num_threads = 0;
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--config" or arg == "--counts" or arg == "--margin" or arg == "--threads") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--config") {
+                configuration = find_configuration(value);
+                if (configuration == nullptr) {
+                    std::fprintf(stderr, "Unknown configuration \"%s\"\n", value.c_str());
+                    return 1;
+                }
+            } else if (arg == "--counts") {
+                size_t begin = 0;
+                while (begin <= value.size()) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    int count = std::atoi(value.substr(begin, end - begin).c_str());
+                    if (count < 2) {
+                        std::fprintf(stderr, "The axes should have at least 2 nodes\n");
+                        return 1;
+                    }
+                    counts.push_back(uint32_t(count));
+                    begin = end + 1;
+                }
+            } else if (arg == "--margin") {
+                margin = std::atof(value.c_str());
+            } else {
+                num_threads = std::atoi(value.c_str());
+            }
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string table_path = paths[0];
+
+    Params params = default_params();
+    configuration->apply(params);
+    // Every node from scratch, the same however the grid is walked
+    params.warm_start = false;
+
+    size_t num_coeffs = size_t(params.poly_degree) + 1;
+    size_t num_dims = num_coeffs + 1;
+    if (num_dims > ExplicitTable::MAX_DIMS) {
+        std::fprintf(stderr, "poly_degree %d has too many coefficients for a table\n", params.poly_degree);
+        return 1;
+    }
+    if (counts.empty()) {
+        counts.assign(num_coeffs, 7);
+        counts.push_back(3);
+    }
+    if (counts.size() != num_dims) {
+        std::fprintf(stderr, "%lu counts for %lu axes\n", counts.size(), num_dims);
+        return 1;
+    }
+
+    // The coefficients of the fits along the paths, those of a path all at
+    // once (its windows interleaved, see polyfit_batch)
+    size_t window_size = params.num_steps_poly;
+    WaypointBuffer window, car_pts;
+    window.resize(window_size);
+    std::vector<double> windows_x, windows_y, coeffs;
+    std::vector<std::vector<double>> samples(num_coeffs);
+    for (size_t p=1; p < paths.size(); p++) {
+        Waypoints waypoints;
+        if (!load_waypoints(paths[p], 0.05, waypoints))
+            return 1;
+        if (waypoints.x.size() <= window_size) {
+            std::fprintf(stderr, "%s: too few waypoints (%lu)\n", paths[p].c_str(), waypoints.x.size());
+            return 1;
+        }
+        size_t num_ticks = waypoints.x.size();
+        windows_x.resize(window_size * num_ticks);
+        windows_y.resize(window_size * num_ticks);
+        coeffs.resize(num_coeffs * num_ticks);
+        for (size_t tick=0; tick < num_ticks; tick++) {
+            double pos_x, pos_y, psi;
+            replay_pose(waypoints, tick, window, pos_x, pos_y, psi);
+            to_car_frame(window, pos_x, pos_y, sin(psi), cos(psi), car_pts);
+            for (size_t i=0; i < window_size; i++) {
+                windows_x[i * num_ticks + tick] = car_pts.x[i];
+                windows_y[i * num_ticks + tick] = car_pts.y[i];
+            }
+        }
+        polyfit_batch(windows_x.data(), windows_y.data(), window_size, num_ticks, params.poly_degree, coeffs.data());
+        for (size_t tick=0; tick < num_ticks; tick++)
+            for (size_t i=0; i < num_coeffs; i++)
+                samples[i].push_back(coeffs[tick * num_coeffs + i]);
+    }
+
+    std::vector<float> axis_min(num_dims), axis_max(num_dims);
+    for (size_t i=0; i < num_coeffs; i++) {
+        std::sort(samples[i].begin(), samples[i].end());
+        double low = percentile(samples[i], 1), high = percentile(samples[i], 99);
+        double width = std::max(high - low, 1e-6);
+        axis_min[i] = float(low - margin * width);
+        axis_max[i] = float(high + margin * width);
+    }
+    axis_min[num_coeffs] = float(params.ref_v_alpha * params.ref_v);
+    axis_max[num_coeffs] = float(params.ref_v);
+    if (!(axis_max[num_coeffs] > axis_min[num_coeffs]))
+        axis_min[num_coeffs] = axis_max[num_coeffs] - 0.1f;
+
+    ExplicitTable::Header header = ExplicitTable::make_header(params, axis_min, axis_max, counts);
+    size_t num_nodes = ExplicitTable::num_nodes(header);
+    size_t num_cells = ExplicitTable::num_cells(header);
+    std::printf("%lu nodes, %lu cells, by the %s configuration\n", num_nodes, num_cells, configuration->name);
+    for (size_t d=0; d < num_dims; d++)
+        std::printf("  %-6s [%.4g, %.4g] x %u\n", d < num_coeffs ? ("c" + std::to_string(d)).c_str() : "ref_v",
+                    axis_min[d], axis_max[d], counts[d]);
+    std::fflush(stdout);
+
+    BatchSolver solver(params, num_threads);
+    std::vector<BatchProblem> problems;
+    std::vector<BatchSolution> solutions;
+    double index[ExplicitTable::MAX_DIMS];
+    double point[ExplicitTable::MAX_DIMS];
+
+    // The nodes, the last axis fastest
+    problems.resize(num_nodes);
+    for (size_t node=0; node < num_nodes; node++) {
+        size_t rest = node;
+        for (size_t d=num_dims; d-- > 0;) {
+            index[d] = double(rest % counts[d]);
+            rest /= counts[d];
+        }
+        ExplicitTable::grid_point(header, index, point);
+        make_problem(point, num_coeffs, problems[node]);
+    }
+    solver.Solve(problems, solutions);
+
+    std::vector<float> nodes(2 * num_nodes);
+    size_t num_failed = 0;
+    for (size_t node=0; node < num_nodes; node++) {
+        first_actuations(solutions[node], nodes[2 * node], nodes[2 * node + 1]);
+        if (std::isnan(nodes[2 * node]))
+            num_failed++;
+    }
+
+    // The centers of the cells, solved and interpolated
+    problems.resize(num_cells);
+    for (size_t cell=0; cell < num_cells; cell++) {
+        size_t rest = cell;
+        for (size_t d=num_dims; d-- > 0;) {
+            index[d] = double(rest % (counts[d] - 1)) + 0.5;
+            rest /= counts[d] - 1;
+        }
+        ExplicitTable::grid_point(header, index, point);
+        make_problem(point, num_coeffs, problems[cell]);
+    }
+    solver.Solve(problems, solutions);
+
+    std::vector<float> cell_errors(2 * num_cells);
+    std::vector<double> steer_errors, speed_errors;
+    for (size_t cell=0; cell < num_cells; cell++) {
+        float delta, v;
+        first_actuations(solutions[cell], delta, v);
+        for (size_t d=0; d < num_dims; d++)
+            point[d] = d < num_coeffs ? problems[cell].coeffs[d] : problems[cell].ref_v;
+
+        double interpolated_delta, interpolated_v;
+        size_t at;
+        if (!std::isnan(delta)
+            and ExplicitTable::interpolate(header, nodes.data(), point, interpolated_delta, interpolated_v, at)) {
+            cell_errors[2 * cell] = float(std::abs(interpolated_delta - delta));
+            cell_errors[2 * cell + 1] = float(std::abs(interpolated_v - v));
+            steer_errors.push_back(cell_errors[2 * cell]);
+            speed_errors.push_back(cell_errors[2 * cell + 1]);
+        } else {
+            cell_errors[2 * cell] = cell_errors[2 * cell + 1] = std::numeric_limits<float>::quiet_NaN();
+        }
+    }
+
+    if (!ExplicitTable::write(table_path, header, nodes, cell_errors))
+        return 1;
+
+    std::sort(steer_errors.begin(), steer_errors.end());
+    std::sort(speed_errors.begin(), speed_errors.end());
+    std::printf("%lu failed nodes, %lu cells without an error\n", num_failed, num_cells - steer_errors.size());
+    std::printf("steer error [rad]: p50 %.4f, p90 %.4f, max %.4f\n", percentile(steer_errors, 50),
+                percentile(steer_errors, 90), steer_errors.empty() ? 0.0 : steer_errors.back());
+    std::printf("speed error [m/s]: p50 %.4f, p90 %.4f, max %.4f\n", percentile(speed_errors, 50),
+                percentile(speed_errors, 90), speed_errors.empty() ? 0.0 : speed_errors.back());
+    std::printf("wrote %s\n", table_path.c_str());
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Gathers the telemetry of a fleet of nodes (see `Params::uplink`) at the
+// base station, without ROS:
+//
+//   mpc_telemetry_collector [--port P] [--interval S]
+//
+// Every vehicle sends a summary (see UplinkSummary) every uplink period;
+// the collector keeps them by vehicle and prints a table of the fleet every
+// interval: the counts since it started (summed back up from the summaries'
+// deltas), the summaries lost on the way (the gaps of their sequence), the
+// restarts of the vehicle (its sequence starting over, with its total of
+// ticks), and, over the interval, the worst latencies of the solver and of
+// the whole tick, the worst cross-track error, and the last CPU load and RMS
+// cross-track error.
+// A vehicle that hasn't been heard from for three intervals is marked stale.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "TelemetryUplink.h"
+
+
+static const int DEFAULT_PORT = 7451;
+
+
+// What the collector knows of a vehicle
+struct Vehicle {
+    std::string address;
+    std::chrono::steady_clock::time_point last_seen;
+    uint16_t sequence = 0;
+    uint32_t total_ticks = 0;
+    uint64_t summaries = 0;
+    uint64_t lost = 0;
+    uint64_t restarts = 0;
+
+    uint64_t ticks = 0;
+    uint64_t overruns = 0;
+    uint64_t deadline_hits = 0;
+    uint64_t restorations = 0;
+    uint64_t failures = 0;
+
+    ///* Over the interval [s], [m]
+    double solver_p99 = 0.0;
+    double tick_p99 = 0.0;
+    double tick_max = 0.0;
+    double max_cte = 0.0;
+    ///* Of the last summary
+    double cpu = 0.0;
+    double rms_cte = 0.0;
+    int mean_iterations = 0;
+};
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--port P] [--interval S]\n", program);
+    std::fprintf(stderr, "  --port      UDP port to listen on (default: %d)\n", DEFAULT_PORT);
+    std::fprintf(stderr, "  --interval  seconds between the tables (default: 5)\n");
+}
+
+
+// False for a summary that came late (or twice), which is dropped
+static bool add(Vehicle & vehicle, const UplinkSummary & summary) {
+    if (vehicle.summaries > 0) {
+        uint16_t gap = uint16_t(summary.sequence - vehicle.sequence);
+        if (summary.sequence == 1 and summary.total_ticks < vehicle.total_ticks)
+            vehicle.restarts++;
+        else if (gap == 0 or gap >= 0x8000)
+            return false;
+        else
+            vehicle.lost += gap - 1;
+    }
+    vehicle.sequence = summary.sequence;
+    vehicle.total_ticks = summary.total_ticks;
+    vehicle.summaries++;
+
+    vehicle.ticks += summary.ticks;
+    vehicle.overruns += summary.overruns;
+    vehicle.deadline_hits += summary.deadline_hits;
+    vehicle.restorations += summary.restorations;
+    vehicle.failures += summary.failures;
+
+    const double unit = UplinkSummary::LATENCY_UNIT;
+    vehicle.solver_p99 = std::max(vehicle.solver_p99, unit * summary.latency[TelemetryRecord::STAGE_SOLVER][1]);
+    vehicle.tick_p99 = std::max(vehicle.tick_p99, unit * summary.latency[TelemetryRecord::STAGE_TICK][1]);
+    vehicle.tick_max = std::max(vehicle.tick_max, unit * summary.latency[TelemetryRecord::STAGE_TICK][2]);
+    vehicle.max_cte = std::max(vehicle.max_cte, 1e-3 * summary.max_cte);
+    vehicle.cpu = 1e-3 * summary.cpu;
+    vehicle.rms_cte = 1e-3 * summary.rms_cte;
+    vehicle.mean_iterations = summary.mean_iterations;
+    return true;
+}
+
+
+static void print_fleet(std::map<uint16_t, Vehicle> & fleet, double interval) {
+    auto now = std::chrono::steady_clock::now();
+    std::printf("\n%-7s %-21s %9s %8s %8s %8s %6s %7s %9s %9s %9s %7s %7s %6s %5s\n", "vehicle", "address",
+                "ticks", "overruns", "deadline", "failures", "lost", "restart", "solve p99", "tick p99",
+                "tick max", "cte max", "cte rms", "cpu", "iter");
+    for (auto & entry : fleet) {
+        Vehicle & vehicle = entry.second;
+        double silent = std::chrono::duration<double>(now - vehicle.last_seen).count();
+        std::printf("%-7u %-21s %9lu %8lu %8lu %8lu %6lu %7lu %7.2fms %7.2fms %7.2fms %6.3fm %6.3fm %5.0f%% %5d%s\n",
+                    unsigned(entry.first), vehicle.address.c_str(), vehicle.ticks, vehicle.overruns,
+                    vehicle.deadline_hits, vehicle.failures, vehicle.lost, vehicle.restarts,
+                    1e3 * vehicle.solver_p99, 1e3 * vehicle.tick_p99, 1e3 * vehicle.tick_max, vehicle.max_cte,
+                    vehicle.rms_cte, 1e2 * vehicle.cpu, vehicle.mean_iterations,
+                    (silent > 3.0 * interval) ? " stale" : "");
+        vehicle.solver_p99 = 0.0;
+        vehicle.tick_p99 = 0.0;
+        vehicle.tick_max = 0.0;
+        vehicle.max_cte = 0.0;
+    }
+    std::fflush(stdout);
+}
+
+
+int main(int argc, char ** argv) {
+    int port = DEFAULT_PORT;
+    double interval = 5.0;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if (arg == "--port" and a + 1 < argc) {
+            port = std::atoi(argv[++a]);
+        } else if (arg == "--interval" and a + 1 < argc) {
+            interval = std::atof(argv[++a]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (interval <= 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int collector = open_uplink_collector(port);
+    if (collector < 0)
+        return 1;
+    std::printf("Collecting on port %d\n", port);
+    std::fflush(stdout);
+
+    std::map<uint16_t, Vehicle> fleet;
+    auto next_print = std::chrono::steady_clock::now() + std::chrono::duration<double>(interval);
+    UplinkSummary summary;
+    for (;;) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_print) {
+            print_fleet(fleet, interval);
+            next_print = now + std::chrono::duration<double>(interval);
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(next_print - now).count();
+        pollfd readable = {collector, POLLIN, 0};
+        if (poll(&readable, 1, int(std::max<long long>(left, 1))) <= 0)
+            continue;
+
+        sockaddr_in sender;
+        socklen_t sender_size = sizeof(sender);
+        ssize_t size = recvfrom(collector, &summary, sizeof(summary), 0, reinterpret_cast<sockaddr *>(&sender),
+                                &sender_size);
+        if (size != ssize_t(sizeof(summary)) or summary.magic != UplinkSummary::MAGIC
+                or summary.version != UplinkSummary::VERSION)
+            continue;
+
+        Vehicle & vehicle = fleet[summary.vehicle];
+        if (!add(vehicle, summary))
+            continue;
+        char address[INET_ADDRSTRLEN] = "";
+        inet_ntop(AF_INET, &sender.sin_addr, address, sizeof(address));
+        vehicle.address = std::string(address) + ":" + std::to_string(ntohs(sender.sin_port));
+        vehicle.last_seen = std::chrono::steady_clock::now();
+    }
+}
@@ -0,0 +1,250 @@
+// Generates synthetic tracks, for the benchmarks of how the kernels of the
+// path (the closest waypoint, the spatial grid, the spline) and the memory
+// scale with its size, without ROS:
+//
+//   mpc_trackgen [options] track.csv
+//
+// A closed track is a star-shaped loop, its radius 1 plus a sum of
+// harmonics of its angle, scaled to the length; an open one is driven
+// along a curvature that's a sum of harmonics of the distance. Either way
+// the amplitudes of the harmonics fall off as 1 / k^slope (the spectrum of
+// the curvature), with random phases. The points are `--spacing` apart
+// along the track, moved sideways by `--noise`, with the yaw of the track
+// and a constant speed.
+//
+// The CSV is in the format of waypoints/, read back with load_waypoints
+// so that its cache (`<csv>.cache`) is there for the spacing it will be
+// loaded with (which should be below `--spacing`, as the chords of the
+// curves are a little shorter), and optionally written as a tiled route
+// (see mpc_route_tiles).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "WaypointLoader.h"
+
+
+struct TrackOptions {
+    double length = 100.0;
+    double spacing = 0.05;
+    bool open = false;
+    int harmonics = 8;
+    double slope = 2.0;
+    double amplitude = 0.3;
+    double noise = 0.0;
+    double speed = 0.0;
+    unsigned seed = 1;
+    int columns = 4;
+    double cache_spacing = 0.0;
+    std::string route_tiles;
+    int tile_points = 1024;
+};
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [options] track.csv\n", program);
+    std::fprintf(stderr, "  --length L         the length of the track [m] (default: 100)\n");
+    std::fprintf(stderr, "  --spacing D        between the waypoints [m] (default: 0.05)\n");
+    std::fprintf(stderr, "  --open             an open route instead of a loop\n");
+    std::fprintf(stderr, "  --harmonics K      of the shape (default: 8)\n");
+    std::fprintf(stderr, "  --slope S          their amplitudes fall off as 1 / k^S (default: 2)\n");
+    std::fprintf(stderr, "  --amplitude A      of the loop's radius relative to its mean (below 1), or the\n");
+    std::fprintf(stderr, "                     largest curvature of the open route [1/m] (default: 0.3)\n");
+    std::fprintf(stderr, "  --noise N          standard deviation of the sideways noise [m] (default: 0)\n");
+    std::fprintf(stderr, "  --speed V          the speed column [m/s] (default: 0)\n");
+    std::fprintf(stderr, "  --seed N           of the phases and the noise (default: 1)\n");
+    std::fprintf(stderr, "  --columns 4|6      the CSV format (default: 4)\n");
+    std::fprintf(stderr, "  --cache-spacing D  the spacing the cache is written for, as the CSV will be loaded with\n");
+    std::fprintf(stderr, "                     (default: 0, every waypoint; < 0: no cache)\n");
+    std::fprintf(stderr, "  --route-tiles F    write it as a tiled route to F too\n");
+    std::fprintf(stderr, "  --tile-points N    the waypoints of a tile (default: 1024)\n");
+}
+
+
+// The amplitudes of the harmonics 1 ... K, as 1 / k^slope, summing to
+// `amplitude`
+static std::vector<double> spectrum(const TrackOptions & options, int first) {
+    std::vector<double> amplitudes(size_t(options.harmonics) + 1, 0.0);
+    double total = 0.0;
+    for (int k=first; k <= options.harmonics; k++) {
+        amplitudes[k] = std::pow(double(k), -options.slope);
+        total += amplitudes[k];
+    }
+    for (double & a : amplitudes)
+        a *= (total > 0.0) ? options.amplitude / total : 0.0;
+    return amplitudes;
+}
+
+
+// The loop: r(theta) = 1 + sum of a_k cos(k theta + phi_k) (from k = 2, as
+// k = 1 only shifts it), sampled finely, scaled to the length and resampled
+// every `spacing` along it
+static void closed_track(const TrackOptions & options, std::mt19937 & rng, Waypoints & track) {
+    std::vector<double> amplitudes = spectrum(options, 2);
+    std::uniform_real_distribution<double> phase(0.0, 2 * M_PI);
+    std::vector<double> phases(amplitudes.size());
+    for (double & p : phases)
+        p = phase(rng);
+
+    size_t num_points = std::max(size_t(options.length / options.spacing), size_t(3));
+    size_t fine = 8 * num_points;
+    std::vector<double> fine_x(fine + 1), fine_y(fine + 1), fine_s(fine + 1, 0.0);
+    for (size_t i=0; i <= fine; i++) {
+        double theta = 2 * M_PI * double(i) / fine;
+        double r = 1.0;
+        for (size_t k=2; k < amplitudes.size(); k++)
+            r += amplitudes[k] * std::cos(k * theta + phases[k]);
+        fine_x[i] = r * std::cos(theta);
+        fine_y[i] = r * std::sin(theta);
+        if (i > 0)
+            fine_s[i] = fine_s[i-1] + std::hypot(fine_x[i] - fine_x[i-1], fine_y[i] - fine_y[i-1]);
+    }
+    double scale = options.length / fine_s[fine];
+
+    double step = fine_s[fine] / num_points;
+    size_t j = 0;
+    for (size_t i=0; i < num_points; i++) {
+        double s = i * step;
+        while (j + 1 < fine and fine_s[j + 1] < s)
+            j++;
+        double u = (s - fine_s[j]) / std::max(fine_s[j + 1] - fine_s[j], 1e-12);
+        track.x[i] = scale * (fine_x[j] + u * (fine_x[j + 1] - fine_x[j]));
+        track.y[i] = scale * (fine_y[j] + u * (fine_y[j + 1] - fine_y[j]));
+    }
+}
+
+
+// The open route: the curvature is a sum of a_k sin(2 pi k s / length +
+// phi_k), driven from the origin along the x axis
+static void open_track(const TrackOptions & options, std::mt19937 & rng, Waypoints & track) {
+    std::vector<double> amplitudes = spectrum(options, 1);
+    std::uniform_real_distribution<double> phase(0.0, 2 * M_PI);
+    std::vector<double> phases(amplitudes.size());
+    for (double & p : phases)
+        p = phase(rng);
+
+    double x = 0.0, y = 0.0, heading = 0.0;
+    for (size_t i=0; i < track.x.size(); i++) {
+        track.x[i] = x;
+        track.y[i] = y;
+        // The curvature halfway to the next point
+        double s = (i + 0.5) * options.spacing;
+        double curvature = 0.0;
+        for (size_t k=1; k < amplitudes.size(); k++)
+            curvature += amplitudes[k] * std::sin(2 * M_PI * k * s / options.length + phases[k]);
+        double turn = curvature * options.spacing;
+        x += options.spacing * std::cos(heading + 0.5 * turn);
+        y += options.spacing * std::sin(heading + 0.5 * turn);
+        heading += turn;
+    }
+}
+
+
+static void generate(const TrackOptions & options, Waypoints & track) {
+    size_t num_points = std::max(size_t(options.length / options.spacing), size_t(3));
+    track.x.resize(num_points);
+    track.y.resize(num_points);
+    track.yaw.resize(num_points);
+    track.speed.assign(num_points, options.speed);
+
+    std::mt19937 rng(options.seed);
+    if (options.open)
+        open_track(options, rng, track);
+    else
+        closed_track(options, rng, track);
+
+    // The yaw of the track, and the noise across it
+    std::normal_distribution<double> noise(0.0, std::max(options.noise, 0.0));
+    for (size_t i=0; i < num_points; i++) {
+        size_t next = (i + 1 < num_points) ? i + 1 : (options.open ? i : 0);
+        size_t previous = (i > 0) ? i - 1 : (options.open ? i : num_points - 1);
+        track.yaw[i] = std::atan2(track.y[next] - track.y[previous], track.x[next] - track.x[previous]);
+    }
+    if (options.noise > 0.0) {
+        for (size_t i=0; i < num_points; i++) {
+            double offset = noise(rng);
+            track.x[i] -= offset * std::sin(track.yaw[i]);
+            track.y[i] += offset * std::cos(track.yaw[i]);
+        }
+    }
+}
+
+
+int main(int argc, char ** argv) {
+    TrackOptions options;
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if (arg == "--open") {
+            options.open = true;
+        } else if (arg.compare(0, 2, "--") == 0 and a + 1 < argc) {
+            const char * value = argv[++a];
+            if (arg == "--length")
+                options.length = std::atof(value);
+            else if (arg == "--spacing")
+                options.spacing = std::atof(value);
+            else if (arg == "--harmonics")
+                options.harmonics = std::atoi(value);
+            else if (arg == "--slope")
+                options.slope = std::atof(value);
+            else if (arg == "--amplitude")
+                options.amplitude = std::atof(value);
+            else if (arg == "--noise")
+                options.noise = std::atof(value);
+            else if (arg == "--speed")
+                options.speed = std::atof(value);
+            else if (arg == "--seed")
+                options.seed = unsigned(std::atoi(value));
+            else if (arg == "--columns")
+                options.columns = std::atoi(value);
+            else if (arg == "--cache-spacing")
+                options.cache_spacing = std::atof(value);
+            else if (arg == "--route-tiles")
+                options.route_tiles = value;
+            else if (arg == "--tile-points")
+                options.tile_points = std::atoi(value);
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 1 or options.length <= 0.0 or options.spacing <= 0.0 or options.harmonics < 1
+            or options.tile_points < 1 or (!options.open and !(options.amplitude >= 0.0 and options.amplitude < 1.0))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Waypoints track;
+    generate(options, track);
+    if (!write_waypoints_csv(paths[0], track, options.columns))
+        return 1;
+    std::printf("%s: %lu waypoints, %s, %.1f m\n", paths[0].c_str(), track.x.size(),
+                options.open ? "open" : "closed", options.length);
+
+    if (options.cache_spacing >= 0.0) {
+        Waypoints loaded;
+        if (!load_waypoints(paths[0], options.cache_spacing, loaded))
+            return 1;
+        std::printf("%s.cache: %lu waypoints at %.3f m\n", paths[0].c_str(), loaded.x.size(),
+                    options.cache_spacing);
+    }
+    if (!options.route_tiles.empty()) {
+        if (!write_route_tiles(options.route_tiles, track, size_t(options.tile_points)))
+            return 1;
+        std::printf("%s: %lu tiles\n", options.route_tiles.c_str(),
+                    (track.x.size() + options.tile_points - 1) / options.tile_points);
+    }
+    return 0;
+}
@@ -0,0 +1,442 @@
+// Times the topics of the controller, for the choices of the centerline
+// format, of the transport of the poses and of nodelets against processes:
+//
+//   rosrun mpc mpc_transport_bench [--rounds N] [--tries N] [--filter TEXT] waypoints.csv...
+//   rosrun mpc mpc_transport_bench --echo waypoints.csv...
+//
+// The messages are those of the node's topics at the sizes they have on the
+// car: the centerlines of each CSV as markers_node.py publishes them (the
+// Marker of /centerline and the Floats of /centerline_numpy, sparsified to
+// 5 cm), the Odometry of /odom, and the commands (the mpc::Commands of
+// /commands/combined and the Float64 of /commands/servo/position).
+//
+// First, without the master, the cost of each message: its serialization,
+// its deserialization, and what the node's callback makes of it (see
+// InputMessages.h). Then, when there's a master, the latency from the
+// publish to the callback, as half of the round trip to an echo (p50, p90,
+// p99 and max): in the same process (the intraprocess link of nodelets,
+// which passes the pointer, unserialized), and to an `--echo` process of
+// the same CSVs running meanwhile, over tcp, tcp_nodelay and udp (UDPROS,
+// which drops what it can't deliver: those are the lost rounds).
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ros/ros.h>
+#include <ros/serialization.h>
+#include <nav_msgs/Odometry.h>
+#include <rospy_tutorials/Floats.h>
+#include <std_msgs/Float64.h>
+#include <visualization_msgs/Marker.h>
+#include <mpc/Commands.h>
+
+#include "InputMessages.h"
+#include "LatencyHistogram.h"
+#include "WaypointLoader.h"
+
+
+// The spacing of the centerlines, markers_node.py's default [m]
+static const double SPACING = 0.05;
+
+// A try of the serialization lasts at least this long [s]
+static const double MIN_TRY_TIME = 0.01;
+static const int MAX_REPETITIONS = 1 << 20;
+
+// The rounds of the echo: the first ones aren't timed, a round is lost
+// after ROUND_TIMEOUT, and the next one starts ROUND_GAP after it (or
+// ROUND_TIMEOUT after a lost one, so that its late echo isn't taken for
+// the next one's)
+static const int WARMUP_ROUNDS = 10;
+static const std::chrono::milliseconds ROUND_TIMEOUT(500);
+static const std::chrono::milliseconds ROUND_GAP(1);
+// How long the links to the echo have to come up [s]
+static const double CONNECT_TIMEOUT = 5.0;
+
+// The transports to the echo process, as the node's `pose_transport`
+static const char * const TRANSPORTS[] = {"tcp", "tcp_nodelay", "udp"};
+
+
+struct Options {
+    int rounds = 1000;
+    int tries = 10;
+    std::string filter;
+};
+
+
+static ros::TransportHints transport_hints(const std::string & transport) {
+    if (transport == "udp")
+        return ros::TransportHints().udp();
+    if (transport == "tcp_nodelay")
+        return ros::TransportHints().tcpNoDelay();
+    return ros::TransportHints();
+}
+
+
+static std::string topic_prefix(const std::string & name, const std::string & transport) {
+    return "mpc_transport_bench/" + name + "/" + transport;
+}
+
+
+// The best and the mean time of a call of `kernel` [us] over the tries, with
+// as many calls per try as last MIN_TRY_TIME
+template <class Kernel>
+static void time_calls(int tries, Kernel kernel, double & best, double & mean) {
+    typedef std::chrono::steady_clock Clock;
+    int repetitions = 1;
+    while (repetitions < MAX_REPETITIONS) {
+        auto start = Clock::now();
+        for (int r=0; r < repetitions; r++)
+            kernel();
+        if (std::chrono::duration<double>(Clock::now() - start).count() >= MIN_TRY_TIME)
+            break;
+        repetitions *= 2;
+    }
+    best = 1e300;
+    double total = 0.0;
+    for (int t=0; t < tries; t++) {
+        auto start = Clock::now();
+        for (int r=0; r < repetitions; r++)
+            kernel();
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count() / repetitions;
+        best = std::min(best, elapsed);
+        total += elapsed;
+    }
+    best *= 1e6;
+    mean = 1e6 * total / tries;
+}
+
+
+// The cost of `message` as `name`: its size, its serialization, its
+// deserialization, and `convert` (which returns false when there's nothing
+// to make of it)
+template <class Message, class Convert>
+static void bench_serialization(const Options & options, const std::string & name, const Message & message,
+                                Convert convert) {
+    if (!options.filter.empty() and name.find(options.filter) == std::string::npos)
+        return;
+
+    uint32_t size = ros::serialization::serializationLength(message);
+    std::vector<uint8_t> buffer(size);
+    double serialize_best, serialize_mean;
+    time_calls(options.tries, [&]() {
+        ros::serialization::OStream stream(buffer.data(), size);
+        ros::serialization::serialize(stream, message);
+    }, serialize_best, serialize_mean);
+
+    Message copy;
+    double deserialize_best, deserialize_mean;
+    time_calls(options.tries, [&]() {
+        ros::serialization::IStream stream(buffer.data(), size);
+        ros::serialization::deserialize(stream, copy);
+    }, deserialize_best, deserialize_mean);
+
+    double convert_best = 0.0, convert_mean = 0.0;
+    bool converted = convert(copy);
+    if (converted)
+        time_calls(options.tries, [&]() { convert(copy); }, convert_best, convert_mean);
+
+    std::printf("%-36s %10u %10.3f %10.3f %10.3f %10.3f", name.c_str(), size, serialize_best, serialize_mean,
+                deserialize_best, deserialize_mean);
+    if (converted)
+        std::printf(" %10.3f %10.3f\n", convert_best, convert_mean);
+    else
+        std::printf(" %10s %10s\n", "-", "-");
+    std::fflush(stdout);
+}
+
+
+// Publishes every ping back, as it came
+template <class Message>
+class Echo {
+public:
+    Echo(ros::NodeHandle & nodehandle, const std::string & prefix, const ros::TransportHints & hints) {
+        m_pub = nodehandle.advertise<Message>(prefix + "/pong", 1);
+        m_sub = nodehandle.subscribe(prefix + "/ping", 1, &Echo::ping_cb, this, hints);
+    }
+
+private:
+    void ping_cb(const boost::shared_ptr<const Message> & message) {
+        m_pub.publish(message);
+    }
+
+    ros::Publisher m_pub;
+    ros::Subscriber m_sub;
+};
+
+
+// The rounds of `message` to the echo of `prefix`
+template <class Message>
+class PingPong {
+public:
+    PingPong(ros::NodeHandle & nodehandle, const std::string & prefix, const ros::TransportHints & hints)
+            : m_received(0) {
+        m_pub = nodehandle.advertise<Message>(prefix + "/ping", 1);
+        m_sub = nodehandle.subscribe(prefix + "/pong", 1, &PingPong::pong_cb, this, hints);
+    }
+
+    ///* False when the echo didn't come up
+    bool run(const boost::shared_ptr<const Message> & message, int rounds, LatencyHistogram & latency,
+             int & lost) {
+        ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(CONNECT_TIMEOUT);
+        while (m_pub.getNumSubscribers() == 0 or m_sub.getNumPublishers() == 0) {
+            if (ros::WallTime::now() > deadline or !ros::ok())
+                return false;
+            ros::WallDuration(0.01).sleep();
+        }
+
+        lost = 0;
+        for (int r = -WARMUP_ROUNDS; r < rounds and ros::ok(); r++) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            uint64_t expected = m_received + 1;
+            auto start = std::chrono::steady_clock::now();
+            m_pub.publish(message);
+            bool OK = m_cv.wait_for(lock, ROUND_TIMEOUT, [&]() { return m_received >= expected; });
+            double round_trip = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            lock.unlock();
+            if (r >= 0) {
+                if (OK)
+                    latency.record(0.5 * round_trip);
+                else
+                    lost++;
+            }
+            std::this_thread::sleep_for(OK ? ROUND_GAP : ROUND_TIMEOUT);
+        }
+        return true;
+    }
+
+private:
+    void pong_cb(const boost::shared_ptr<const Message> &) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_received++;
+        }
+        m_cv.notify_one();
+    }
+
+    ros::Publisher m_pub;
+    ros::Subscriber m_sub;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    uint64_t m_received;
+};
+
+
+// The latency of `message` as `name` over each transport
+template <class Message>
+static void bench_transports(const Options & options, ros::NodeHandle & nodehandle, const std::string & name,
+                             const Message & message) {
+    if (!options.filter.empty() and name.find(options.filter) == std::string::npos)
+        return;
+
+    boost::shared_ptr<const Message> shared = boost::make_shared<const Message>(message);
+    std::vector<std::string> transports(1, "intraprocess");
+    transports.insert(transports.end(), std::begin(TRANSPORTS), std::end(TRANSPORTS));
+    for (const std::string & transport : transports) {
+        std::string prefix = topic_prefix(name, transport);
+        ros::TransportHints hints = transport_hints(transport);
+        std::unique_ptr<Echo<Message>> echo;
+        if (transport == "intraprocess")
+            echo.reset(new Echo<Message>(nodehandle, prefix, hints));
+
+        LatencyHistogram latency;
+        int lost = 0;
+        std::string label = name + "/" + transport;
+        PingPong<Message> ping_pong(nodehandle, prefix, hints);
+        if (!ping_pong.run(shared, options.rounds, latency, lost)) {
+            std::printf("%-36s no echo (is mpc_transport_bench --echo running?)\n", label.c_str());
+            continue;
+        }
+        std::printf("%-36s %8lu %10.1f %10.1f %10.1f %10.1f %6d\n", label.c_str(), latency.count(),
+                    1e6 * latency.percentile(50), 1e6 * latency.percentile(90), 1e6 * latency.percentile(99),
+                    1e6 * latency.max(), lost);
+        std::fflush(stdout);
+    }
+}
+
+
+// The messages of the node at their sizes on the car, by name (see
+// `bench_messages`), with the centerlines of `waypoints`
+struct Messages {
+    visualization_msgs::Marker centerline;
+    rospy_tutorials::Floats centerline_numpy;
+    nav_msgs::Odometry odom;
+    mpc::Commands commands;
+    std_msgs::Float64 servo_position;
+
+    explicit Messages(const Waypoints & waypoints) {
+        // As markers_node.py's
+        centerline.header.frame_id = "/map";
+        centerline.type = visualization_msgs::Marker::LINE_STRIP;
+        centerline.action = visualization_msgs::Marker::ADD;
+        centerline.scale.x = centerline.scale.y = centerline.scale.z = 0.1;
+        centerline.color.a = 0.3;
+        centerline.color.g = 1.0;
+        centerline.pose.orientation.w = 1.0;
+        centerline.points.resize(waypoints.x.size());
+        centerline_numpy.data.reserve(CENTERLINE_NUMPY_COLUMNS * waypoints.x.size());
+        for (size_t i=0; i < waypoints.x.size(); i++) {
+            centerline.points[i].x = waypoints.x[i];
+            centerline.points[i].y = waypoints.y[i];
+            for (double value : {waypoints.x[i], waypoints.y[i], waypoints.yaw[i], waypoints.speed[i]})
+                centerline_numpy.data.push_back(float(value));
+        }
+
+        odom.header.frame_id = "odom";
+        odom.child_frame_id = "base_link";
+        odom.header.stamp = ros::Time(1.0);
+        odom.pose.pose.orientation.w = 1.0;
+        odom.twist.twist.linear.x = 1.5;
+        odom.twist.twist.angular.z = 0.2;
+
+        commands.header.stamp = ros::Time(1.0);
+        commands.pose_stamp = ros::Time(1.0);
+        commands.steer = 0.5;
+        commands.rpm = 4000.0;
+        servo_position.data = 0.5;
+    }
+};
+
+
+// Calls `bench(name, message, convert)` for each message, `convert` making
+// of it what the node's callback does (false when it's not one of its
+// inputs); the centerlines are named after their `track`
+template <class Bench>
+static void bench_messages(const std::vector<std::string> & tracks, const std::vector<Messages> & messages,
+                           Bench bench) {
+    for (size_t i=0; i < tracks.size(); i++) {
+        bench("centerline/" + tracks[i], messages[i].centerline, [](const visualization_msgs::Marker & marker) {
+            make_centerline(marker, centerline_hash(marker));
+            return true;
+        });
+        bench("centerline_numpy/" + tracks[i], messages[i].centerline_numpy,
+              [](const rospy_tutorials::Floats & rows) {
+            make_centerline(rows, centerline_hash(rows));
+            return true;
+        });
+    }
+    InputSnapshot inputs;
+    bench("odom", messages[0].odom, [&inputs](const nav_msgs::Odometry & odom) {
+        read_odom(odom, inputs);
+        return true;
+    });
+    bench("commands/combined", messages[0].commands, [](const mpc::Commands &) { return false; });
+    bench("commands/servo/position", messages[0].servo_position, [](const std_msgs::Float64 &) { return false; });
+}
+
+
+struct SerializationBench {
+    const Options & options;
+
+    template <class Message, class Convert>
+    void operator()(const std::string & name, const Message & message, Convert convert) const {
+        bench_serialization(options, name, message, convert);
+    }
+};
+
+
+struct TransportBench {
+    const Options & options;
+    ros::NodeHandle & nodehandle;
+
+    template <class Message, class Convert>
+    void operator()(const std::string & name, const Message & message, Convert) const {
+        bench_transports(options, nodehandle, name, message);
+    }
+};
+
+
+// The echoes of the messages over each transport to the echo process
+struct EchoSetup {
+    ros::NodeHandle & nodehandle;
+    std::vector<std::shared_ptr<void>> & echoes;
+
+    template <class Message, class Convert>
+    void operator()(const std::string & name, const Message &, Convert) const {
+        for (const char * transport : TRANSPORTS)
+            echoes.push_back(std::make_shared<Echo<Message>>(nodehandle, topic_prefix(name, transport),
+                                                             transport_hints(transport)));
+    }
+};
+
+
+static void usage(const char * argv0) {
+    std::fprintf(stderr, "Usage: %s [--rounds N] [--tries N] [--filter TEXT] waypoints.csv...\n"
+                         "       %s --echo waypoints.csv...\n", argv0, argv0);
+}
+
+
+int main(int argc, char ** argv) {
+    ros::init(argc, argv, "mpc_transport_bench", ros::init_options::AnonymousName);
+
+    Options options;
+    bool echo = false;
+    std::vector<std::string> csv_paths;
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--rounds" or arg == "--tries" or arg == "--filter") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--rounds")
+                options.rounds = std::max(std::atoi(value.c_str()), 1);
+            else if (arg == "--tries")
+                options.tries = std::max(std::atoi(value.c_str()), 1);
+            else
+                options.filter = value;
+        } else if (arg == "--echo") {
+            echo = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            csv_paths.push_back(arg);
+        }
+    }
+
+    if (csv_paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<std::string> tracks;
+    std::vector<Messages> messages;
+    for (const std::string & csv_path : csv_paths) {
+        Waypoints waypoints;
+        if (!load_waypoints(csv_path, SPACING, waypoints))
+            return 1;
+        tracks.push_back(csv_path.substr(csv_path.find_last_of('/') + 1));
+        messages.emplace_back(waypoints);
+    }
+
+    if (echo) {
+        ros::NodeHandle nodehandle;
+        std::vector<std::shared_ptr<void>> echoes;
+        bench_messages(tracks, messages, EchoSetup{nodehandle, echoes});
+        ROS_INFO("Echoing the topics of mpc_transport_bench");
+        ros::spin();
+        return 0;
+    }
+
+    std::printf("%-36s %10s %10s %10s %10s %10s %10s %10s\n", "message", "bytes", "ser. [us]", "mean",
+                "deser. [us]", "mean", "callback", "mean");
+    bench_messages(tracks, messages, SerializationBench{options});
+
+    if (!ros::master::check()) {
+        std::printf("\nNo master, no latencies\n");
+        return 0;
+    }
+    ros::NodeHandle nodehandle;
+    ros::AsyncSpinner spinner(2);
+    spinner.start();
+    std::printf("\n%-36s %8s %10s %10s %10s %10s %6s\n", "message/transport", "rounds", "p50 [us]", "p90",
+                "p99", "max", "lost");
+    bench_messages(tracks, messages, TransportBench{options, nodehandle});
+    spinner.stop();
+    return 0;
+}
@@ -0,0 +1,456 @@
+// Tunes Params (the cost weights, the reference speed, ...) by closed-loop
+// simulations (see Simulation.h), without ROS:
+//
+//   mpc_tune [options] --param NAME=VALUES... waypoints.csv
+//
+// The candidates are either the grid of all the combinations of the values
+// of the parameters (NAME=V1,V2,...), or --samples random ones, each of the
+// parameters drawn from its values or from its range (NAME=LOW:HIGH,
+// log-uniform if both bounds are positive). Every candidate drives --runs
+// runs (of consecutive seeds of the noise), spread over processes, one per
+// core by default.
+//
+// A candidate is scored (the lower, the better) by the mean lap time, plus
+// the RMS cross track error by --cte-weight, plus the p99 of the solve times
+// over the budget of a tick by --solve-weight: the solve times are part of
+// the cost, and a candidate whose p99 is over the budget is rejected, as is
+// one that left the track or didn't finish its laps. The solve times are
+// those of this machine, which should be (or be as fast as) the one in the
+// car, with no more jobs than it has free cores.
+//
+// Every candidate is a line of CSV on stdout, as its runs are done: its
+// index, its score (empty when rejected), why it was rejected, the lap time,
+// the cross track error, the p99 of the solve times and its parameters; the
+// best ones are summed up at the end. With --shard I/N, only every Nth candidate from
+// the Ith is driven, so machines given the same options and each its shard
+// split the candidates between them (the runs are deterministic but for the
+// solve times), and their lines merge with `sort -t, -k2 -g`.
+//
+// With --table, the runs are those of a SimulatorFarm instead: thousands of
+// cars in lock-step on the threads of this process, driven by the law of the
+// explicit table (made by mpc_tablegen for the --config and the weights),
+// so that sweeps of the parameters the table doesn't fix (the reference
+// speed and the PID fallback's) and Monte Carlo runs over the noise take
+// minutes instead of hours. There are no solve times then; the candidates
+// it ranks best are the ones to check with the solves.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "MPC.h"
+#include "OfflineTools.h"
+#include "ExplicitTable.h"
+#include "Simulation.h"
+#include "SimulatorFarm.h"
+#include "WaypointLoader.h"
+
+
+// The parameters that can be tuned, by their names in Params
+struct Tunable {
+    const char * name;
+    void (*set)(Params & params, double value);
+};
+
+
+static const Tunable TUNABLES[] = {
+    {"steps_ahead",        [](Params & p, double value) { p.steps_ahead = size_t(std::lround(value)); }},
+    {"dt",                 [](Params & p, double value) { p.dt = value; }},
+    {"ref_v",              [](Params & p, double value) { p.ref_v = value; }},
+    {"ref_v_alpha",        [](Params & p, double value) { p.ref_v_alpha = value; }},
+    {"latency",            [](Params & p, double value) { p.latency = value; }},
+    {"cte_coeff",          [](Params & p, double value) { p.cte_coeff = value; }},
+    {"epsi_coeff",         [](Params & p, double value) { p.epsi_coeff = value; }},
+    {"speed_coeff",        [](Params & p, double value) { p.speed_coeff = value; }},
+    {"steer_coeff",        [](Params & p, double value) { p.steer_coeff = value; }},
+    {"consec_speed_coeff", [](Params & p, double value) { p.consec_speed_coeff = value; }},
+    {"consec_steer_coeff", [](Params & p, double value) { p.consec_steer_coeff = value; }},
+    {"poly_degree",        [](Params & p, double value) { p.poly_degree = int(std::lround(value)); }},
+    {"num_steps_poly",     [](Params & p, double value) { p.num_steps_poly = int(std::lround(value)); }},
+    {"pid_kp_cte",         [](Params & p, double value) { p.pid_kp_cte = value; }},
+    {"pid_ki_cte",         [](Params & p, double value) { p.pid_ki_cte = value; }},
+    {"pid_kd_cte",         [](Params & p, double value) { p.pid_kd_cte = value; }},
+    {"pid_kp_epsi",        [](Params & p, double value) { p.pid_kp_epsi = value; }},
+    {"pid_ki_epsi",        [](Params & p, double value) { p.pid_ki_epsi = value; }},
+    {"pid_kd_epsi",        [](Params & p, double value) { p.pid_kd_epsi = value; }},
+};
+
+
+// Those a SimulatorFarm can sweep (see FarmCar)
+static const char * const FARM_TUNABLES[] = {
+    "ref_v", "ref_v_alpha", "pid_kp_cte", "pid_ki_cte", "pid_kd_cte", "pid_kp_epsi", "pid_ki_epsi", "pid_kd_epsi",
+};
+
+
+// A parameter of the search: its values, or its range
+struct Axis {
+    const Tunable * tunable;
+    std::vector<double> values;
+    double low = 0.0;
+    double high = 0.0;
+};
+
+
+struct Candidate {
+    std::vector<double> values; // by axis
+    size_t num_runs = 0; // done
+    double lap_time_sum = 0.0; // [s]
+    size_t num_laps = 0;
+    std::vector<double> solve_times;
+    double cte_mean_squares = 0.0; // weighted by the ticks
+    size_t num_ticks = 0;
+    bool off_track = false;
+    bool short_laps = false;
+
+    double score = 0.0;
+    double lap_time = 0.0;
+    double cte_rms = 0.0;
+    double solve_p99 = 0.0;
+    const char * rejected = nullptr;
+};
+
+
+// --param NAME=V1,V2,... or NAME=LOW:HIGH
+static bool parse_axis(const std::string & value, Axis & axis) {
+    size_t equals = value.find('=');
+    if (equals == std::string::npos)
+        return false;
+    std::string name = value.substr(0, equals);
+    axis.tunable = nullptr;
+    for (const Tunable & tunable : TUNABLES)
+        if (name == tunable.name)
+            axis.tunable = &tunable;
+    if (axis.tunable == nullptr)
+        return false;
+
+    std::string values = value.substr(equals + 1);
+    size_t colon = values.find(':');
+    if (colon != std::string::npos) {
+        axis.low = std::atof(values.substr(0, colon).c_str());
+        axis.high = std::atof(values.substr(colon + 1).c_str());
+        return axis.high >= axis.low;
+    }
+    size_t begin = 0;
+    while (begin <= values.size()) {
+        size_t end = std::min(values.find(',', begin), values.size());
+        axis.values.push_back(std::atof(values.substr(begin, end - begin).c_str()));
+        begin = end + 1;
+    }
+    return true;
+}
+
+
+// All the combinations of the values, the last axis fastest
+static void grid_candidates(const std::vector<Axis> & axes, std::vector<Candidate> & candidates) {
+    size_t count = 1;
+    for (const Axis & axis : axes)
+        count *= axis.values.size();
+    candidates.resize(count);
+    for (size_t c=0; c < count; c++) {
+        size_t rest = c;
+        candidates[c].values.resize(axes.size());
+        for (size_t a=axes.size(); a-- > 0;) {
+            candidates[c].values[a] = axes[a].values[rest % axes[a].values.size()];
+            rest /= axes[a].values.size();
+        }
+    }
+}
+
+
+static void random_candidates(const std::vector<Axis> & axes, size_t count, unsigned seed,
+                              std::vector<Candidate> & candidates) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    candidates.resize(count);
+    for (Candidate & candidate : candidates) {
+        candidate.values.resize(axes.size());
+        for (size_t a=0; a < axes.size(); a++) {
+            const Axis & axis = axes[a];
+            double u = unit(rng);
+            if (!axis.values.empty())
+                candidate.values[a] = axis.values[std::min(size_t(u * axis.values.size()), axis.values.size() - 1)];
+            else if (axis.low > 0.0)
+                candidate.values[a] = axis.low * std::pow(axis.high / axis.low, u);
+            else
+                candidate.values[a] = axis.low + u * (axis.high - axis.low);
+        }
+    }
+}
+
+
+static Params candidate_params(const Params & base, const std::vector<Axis> & axes, const Candidate & candidate) {
+    Params params = base;
+    for (size_t a=0; a < axes.size(); a++)
+        axes[a].tunable->set(params, candidate.values[a]);
+    return params;
+}
+
+
+// Scores a candidate whose runs are all done, and prints its line
+static void score(Candidate & candidate, size_t index, double budget, double cte_weight, double solve_weight) {
+    candidate.lap_time = candidate.num_laps == 0 ? 0.0 : candidate.lap_time_sum / candidate.num_laps;
+    candidate.cte_rms = std::sqrt(candidate.cte_mean_squares / std::max(candidate.num_ticks, size_t(1)));
+    std::sort(candidate.solve_times.begin(), candidate.solve_times.end());
+    candidate.solve_p99 = percentile(candidate.solve_times, 99);
+    if (candidate.off_track)
+        candidate.rejected = "left the track";
+    else if (candidate.short_laps)
+        candidate.rejected = "laps not done";
+    else if (candidate.solve_p99 > budget)
+        candidate.rejected = "over the budget";
+    candidate.score = candidate.lap_time + cte_weight * candidate.cte_rms + solve_weight * candidate.solve_p99 / budget;
+
+    if (candidate.rejected == nullptr)
+        std::printf("%lu,%.4f,", index, candidate.score);
+    else
+        std::printf("%lu,,%s", index, candidate.rejected);
+    std::printf(",%.4f,%.4f,%.6f", candidate.lap_time, candidate.cte_rms, candidate.solve_p99);
+    for (double value : candidate.values)
+        std::printf(",%g", value);
+    std::printf("\n");
+    std::fflush(stdout);
+    candidate.solve_times.clear();
+    candidate.solve_times.shrink_to_fit();
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [options] --param NAME=VALUES... waypoints.csv\n", program);
+    std::fprintf(stderr, "  --param NAME=V1,V2,...  values of a parameter of Params, of");
+    for (const Tunable & tunable : TUNABLES)
+        std::fprintf(stderr, " %s", tunable.name);
+    std::fprintf(stderr, "\n");
+    std::fprintf(stderr, "  --param NAME=LOW:HIGH   or its range (for --samples)\n");
+    std::fprintf(stderr, "  --samples N       random candidates in place of the grid (default: 0, the grid)\n");
+    std::fprintf(stderr, "  --laps N          laps per run (default: 2)\n");
+    std::fprintf(stderr, "  --max-time S      simulated time after which a run stops [s] (default: 600)\n");
+    std::fprintf(stderr, "  --latency S       age of the poses the controller gets [s] (default: 0)\n");
+    std::fprintf(stderr, "  --rate HZ         rate of the ticks in simulated time (default: 100)\n");
+    std::fprintf(stderr, "  --config NAME     solver configuration (default: ipopt)\n");
+    std::fprintf(stderr, "  --runs N          runs per candidate (default: 1)\n");
+    std::fprintf(stderr, "  --jobs N          runs at a time (default: one per core)\n");
+    std::fprintf(stderr, "  --seed N          seed of the samples and of the noise of the first run (default: 1)\n");
+    std::fprintf(stderr, "  --cte-weight W    [s/m] of the RMS cross track error in the score (default: 20)\n");
+    std::fprintf(stderr, "  --solve-weight W  [s] of the p99 of the solve times over the budget (default: 1)\n");
+    std::fprintf(stderr, "  --budget S        of the solves [s] (default: the period of the ticks)\n");
+    std::fprintf(stderr, "  --shard I/N       drive every Nth candidate from the Ith only (default: 0/1)\n");
+    std::fprintf(stderr, "  --table PATH      run on a SimulatorFarm, by the law of this explicit table, with\n"
+                         "                    --jobs threads (default: the solves, in processes)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    SimulationOptions options;
+    options.num_laps = 2;
+    Params params = default_params();
+    std::vector<Axis> axes;
+    size_t num_samples = 0, num_runs = 1, num_jobs = 0;
+    size_t shard = 0, num_shards = 1;
+    unsigned seed = 1;
+    double cte_weight = 20.0, solve_weight = 1.0, budget = 0.0;
+    std::string csv_path, table_path;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if (arg.compare(0, 2, "--") == 0 and a + 1 < argc) {
+            std::string value(argv[++a]);
+            Axis axis;
+            if (arg == "--param" and parse_axis(value, axis)) {
+                axes.push_back(axis);
+            } else if (arg == "--samples") {
+                num_samples = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--laps") {
+                options.num_laps = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--max-time") {
+                options.max_time = std::atof(value.c_str());
+            } else if (arg == "--latency") {
+                options.latency = std::atof(value.c_str());
+            } else if (arg == "--rate" and std::atof(value.c_str()) > 0.0) {
+                params.loop_rate = std::atof(value.c_str());
+            } else if (arg == "--config" and find_configuration(value) != nullptr) {
+                find_configuration(value)->apply(params);
+            } else if (arg == "--runs" and std::atoi(value.c_str()) > 0) {
+                num_runs = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--jobs") {
+                num_jobs = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--seed") {
+                seed = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--cte-weight") {
+                cte_weight = std::atof(value.c_str());
+            } else if (arg == "--solve-weight") {
+                solve_weight = std::atof(value.c_str());
+            } else if (arg == "--budget") {
+                budget = std::atof(value.c_str());
+            } else if (arg == "--shard" and std::sscanf(value.c_str(), "%lu/%lu", &shard, &num_shards) == 2
+                       and shard < num_shards) {
+            } else if (arg == "--table") {
+                table_path = value;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg.compare(0, 2, "--") == 0 or !csv_path.empty()) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            csv_path = arg;
+        }
+    }
+    if (csv_path.empty() or axes.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (const Axis & axis : axes) {
+        if (axis.values.empty() and num_samples == 0) {
+            std::fprintf(stderr, "The range of %s needs --samples\n", axis.tunable->name);
+            return 1;
+        }
+    }
+    if (!table_path.empty()) {
+        for (const Axis & axis : axes) {
+            bool swept = false;
+            for (const char * name : FARM_TUNABLES)
+                swept = swept or std::string(name) == axis.tunable->name;
+            if (!swept) {
+                std::fprintf(stderr, "The table fixes %s, a farm can't sweep it\n", axis.tunable->name);
+                return 1;
+            }
+        }
+    }
+    if (num_jobs == 0)
+        num_jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    if (budget <= 0.0)
+        budget = 1.0 / params.loop_rate;
+
+    std::vector<Candidate> candidates;
+    if (num_samples > 0)
+        random_candidates(axes, num_samples, seed, candidates);
+    else
+        grid_candidates(axes, candidates);
+
+    // The candidates of the shard
+    std::vector<size_t> driven;
+    for (size_t c=shard; c < candidates.size(); c += num_shards)
+        driven.push_back(c);
+    std::fprintf(stderr, "%lu candidates, %lu of them in shard %lu/%lu, %lu runs each\n", candidates.size(),
+                 driven.size(), shard, num_shards, num_runs);
+
+    Waypoints waypoints;
+    if (!load_waypoints(csv_path, 0.05, waypoints))
+        return 1;
+    if (waypoints.x.size() <= size_t(params.num_steps_poly)) {
+        std::fprintf(stderr, "%s: too few waypoints (%lu)\n", csv_path.c_str(), waypoints.x.size());
+        return 1;
+    }
+    // Built before the runs fork, which share it; the candidates with
+    // another num_steps_poly prepare their own in their process
+    std::shared_ptr<const Centerline> centerline = make_centerline(waypoints, params);
+
+    std::printf("index,score,rejected,lap_time,cte_rms,solve_p99");
+    for (const Axis & axis : axes)
+        std::printf(",%s", axis.tunable->name);
+    std::printf("\n");
+    std::fflush(stdout);
+
+    bool OK = true;
+    if (!table_path.empty()) {
+        // Every run of every candidate is a car of the farm
+        ExplicitTable table;
+        if (!table.load(table_path))
+            return 1;
+        if (!table.matches(params)) {
+            std::fprintf(stderr, "%s wasn't made for the horizon, the weights and the degree of the --config\n",
+                         table_path.c_str());
+            return 1;
+        }
+        std::vector<FarmCar> cars;
+        for (size_t r=0; r < driven.size() * num_runs; r++)
+            cars.push_back(FarmCar::from_params(candidate_params(params, axes, candidates[driven[r / num_runs]]),
+                                                seed + unsigned(r % num_runs)));
+        std::vector<FarmResult> results;
+        SimulatorFarm farm(centerline, table, params, options);
+        auto start = std::chrono::steady_clock::now();
+        farm.run(cars, num_jobs, results);
+        double sim_time = 0.0;
+        for (size_t r=0; r < results.size(); r++) {
+            const FarmResult & result = results[r];
+            Candidate & candidate = candidates[driven[r / num_runs]];
+            candidate.lap_time_sum += result.lap_time_sum;
+            candidate.num_laps += result.num_laps;
+            candidate.cte_mean_squares += result.cte_mean_squares * result.num_ticks;
+            candidate.num_ticks += result.num_ticks;
+            candidate.off_track = candidate.off_track or result.off_track;
+            candidate.short_laps = candidate.short_laps or result.num_laps < options.num_laps;
+            if (++candidate.num_runs == num_runs)
+                score(candidate, driven[r / num_runs], budget, cte_weight, solve_weight);
+            sim_time += result.sim_time;
+        }
+        std::fprintf(stderr, "%lu runs, %.0f [s] of driving in %.3f [s]\n", results.size(), sim_time,
+                     std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    } else {
+        OK = run_in_processes(driven.size() * num_runs, num_jobs, [&](size_t r) {
+            const Candidate & candidate = candidates[driven[r / num_runs]];
+            Params run_params = candidate_params(params, axes, candidate);
+            std::shared_ptr<const Centerline> run_centerline = centerline;
+            if (run_params.num_steps_poly != params.num_steps_poly) {
+                Waypoints copy;
+                copy.x = centerline->pts_x;
+                copy.y = centerline->pts_y;
+                copy.yaw = centerline->yaw;
+                copy.speed = centerline->speed;
+                run_centerline = make_centerline(copy, run_params);
+            }
+            return simulate(run_centerline, run_params, options, seed + unsigned(r % num_runs));
+        }, [&](size_t r, const RunResult & result) {
+            size_t index = driven[r / num_runs];
+            Candidate & candidate = candidates[index];
+            for (double lap_time : result.lap_times)
+                candidate.lap_time_sum += lap_time;
+            candidate.num_laps += result.lap_times.size();
+            candidate.solve_times.insert(candidate.solve_times.end(), result.solve_times.begin(),
+                                         result.solve_times.end());
+            candidate.cte_mean_squares += result.cte_mean_squares * result.solve_times.size();
+            candidate.num_ticks += result.solve_times.size();
+            candidate.off_track = candidate.off_track or result.off_track;
+            candidate.short_laps = candidate.short_laps or result.lap_times.size() < options.num_laps;
+            if (++candidate.num_runs == num_runs)
+                score(candidate, index, budget, cte_weight, solve_weight);
+        });
+    }
+    if (!OK)
+        return 1;
+
+    // The best of the shard
+    std::vector<const Candidate *> ranked;
+    size_t num_rejected[3] = {0, 0, 0};
+    for (size_t c : driven) {
+        const Candidate & candidate = candidates[c];
+        if (candidate.rejected == nullptr)
+            ranked.push_back(&candidate);
+        else
+            num_rejected[candidate.off_track ? 0 : candidate.short_laps ? 1 : 2]++;
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const Candidate * a, const Candidate * b) {
+        return a->score < b->score;
+    });
+    std::fprintf(stderr, "\n%lu left the track, %lu didn't finish their laps, %lu were over the budget "
+                 "(%.3f [ms])\n", num_rejected[0], num_rejected[1], num_rejected[2], 1e3 * budget);
+    for (size_t i=0; i < std::min(ranked.size(), size_t(5)); i++) {
+        const Candidate & candidate = *ranked[i];
+        std::fprintf(stderr, "%lu. score %.4f: lap %.3f [s], |cte| rms %.4f [m], solve p99 %.3f [ms];",
+                     i + 1, candidate.score, candidate.lap_time, candidate.cte_rms, 1e3 * candidate.solve_p99);
+        for (size_t a=0; a < axes.size(); a++)
+            std::fprintf(stderr, " %s=%g", axes[a].tunable->name, candidate.values[a]);
+        std::fprintf(stderr, "\n");
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+// Fits the weights of the learned warm start (see LearnedWarmStart), without
+// ROS:
+//
+//   mpc_warmstart_fit [--config NAME] [--horizon N] [--ridge F] weights.txt waypoints.csv...
+//
+// The solves it's fit to are those of the synthetic drive of mpc_benchmark
+// along each of the paths, a lap each: the features of every successful
+// solve against all of its actuations, by ridge regression. It then reports
+// how far the predictions are from the solutions, and how many iterations
+// the solves take from the shifted previous solution and from the
+// predictions.
+//
+// The Params are those of run_mpc_cpp.sh, which the node has to match for
+// the weights to be used.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "MPC.h"
+#include "OfflineTools.h"
+#include "WarmStart.h"
+#include "WaypointBuffer.h"
+#include "WaypointLoader.h"
+
+
+struct Problem {
+    Eigen::VectorXd state;
+    Eigen::VectorXd coeffs;
+};
+
+
+// The problems of the drive along the path, as mpc_benchmark makes them
+// (their fits all at once, see polyfit_batch)
+static void replay(const Waypoints & waypoints, const Params & params, std::vector<Problem> & problems) {
+    size_t window_size = params.num_steps_poly;
+    size_t num_ticks = waypoints.x.size();
+    size_t num_coeffs = size_t(params.poly_degree) + 1;
+    WaypointBuffer window, car_pts;
+    window.resize(window_size);
+    std::vector<double> windows_x(window_size * num_ticks), windows_y(window_size * num_ticks);
+    std::vector<double> coeffs(num_coeffs * num_ticks);
+
+    for (size_t tick=0; tick < num_ticks; tick++) {
+        double pos_x, pos_y, psi;
+        replay_pose(waypoints, tick, window, pos_x, pos_y, psi);
+        to_car_frame(window, pos_x, pos_y, sin(psi), cos(psi), car_pts);
+        for (size_t i=0; i < window_size; i++) {
+            windows_x[i * num_ticks + tick] = car_pts.x[i];
+            windows_y[i * num_ticks + tick] = car_pts.y[i];
+        }
+    }
+    polyfit_batch(windows_x.data(), windows_y.data(), window_size, num_ticks, params.poly_degree, coeffs.data());
+
+    for (size_t tick=0; tick < num_ticks; tick++) {
+        Problem problem;
+        problem.coeffs = Eigen::Map<const Eigen::VectorXd>(&coeffs[tick * num_coeffs], num_coeffs);
+        double cte, slope;
+        polyeval_with_diff(problem.coeffs, 0.0, cte, slope);
+        problem.state.resize(5);
+        problem.state << 0, 0, 0, cte, -atan(slope);
+        problems.push_back(problem);
+    }
+}
+
+
+// The mean iterations of the solves of `problems`, in order, by `controller`
+static double mean_iterations(MPC & controller, const std::vector<Problem> & problems, double ref_v) {
+    std::vector<double> vars;
+    size_t total = 0, known = 0;
+    for (const Problem & problem : problems) {
+        controller.Solve(problem.state, problem.coeffs, ref_v, vars);
+        if (controller.iterations() >= 0) {
+            total += controller.iterations();
+            known++;
+        }
+    }
+    return known > 0 ? double(total) / known : -1.0;
+}
+
+
+static void usage(const char * program) {
+    std::fprintf(stderr, "Usage: %s [--config NAME] [--horizon N] [--ridge F] weights.txt waypoints.csv...\n",
+                 program);
+    std::fprintf(stderr, "  --config      the solver configuration of the solves (default: persistent)\n");
+    std::fprintf(stderr, "  --horizon N   the steps_ahead of the weights (default: 20)\n");
+    std::fprintf(stderr, "  --ridge F     the regularization of the fit (default: 1e-6)\n");
+}
+
+
+int main(int argc, char ** argv) {
+    const Configuration * configuration = find_configuration("persistent");
+    Params params = default_params();
+    double ridge = 1e-6;
+    std::vector<std::string> paths;
+
+    for (int a=1; a < argc; a++) {
+        std::string arg(argv[a]);
+        if ((arg == "--config" or arg == "--horizon" or arg == "--ridge") and a + 1 < argc) {
+            std::string value(argv[++a]);
+            if (arg == "--config") {
+                configuration = find_configuration(value);
+                if (configuration == nullptr) {
+                    std::fprintf(stderr, "Unknown configuration \"%s\"\n", value.c_str());
+                    return 1;
+                }
+            } else if (arg == "--horizon") {
+                params.steps_ahead = std::strtoul(value.c_str(), nullptr, 10);
+                if (params.steps_ahead < 3) {
+                    std::fprintf(stderr, "The horizon should be at least 3 steps\n");
+                    return 1;
+                }
+            } else {
+                ridge = std::atof(value.c_str());
+            }
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string weights_path = paths[0];
+    configuration->apply(params);
+    params.warm_start = true;
+
+    std::vector<Problem> problems;
+    for (size_t p=1; p < paths.size(); p++) {
+        Waypoints waypoints;
+        if (!load_waypoints(paths[p], 0.05, waypoints))
+            return 1;
+        if (waypoints.x.size() <= size_t(params.num_steps_poly)) {
+            std::fprintf(stderr, "%s: too few waypoints (%lu)\n", paths[p].c_str(), waypoints.x.size());
+            return 1;
+        }
+        replay(waypoints, params, problems);
+    }
+
+    // The solutions, from the shifted previous ones
+    MPC controller(params);
+    const Indexes & indexes = controller.indexes();
+    size_t num_inputs = indexes.v_start - indexes.delta_start;
+    size_t num_features = LearnedWarmStart::num_features(params.poly_degree);
+
+    std::vector<double> vars;
+    std::vector<double> features, inputs;
+    size_t num_samples = 0;
+    for (const Problem & problem : problems) {
+        controller.Solve(problem.state, problem.coeffs, params.ref_v, vars);
+        if (!controller.ok())
+            continue;
+        const std::vector<double> & x = controller.last_solution();
+        features.resize(features.size() + num_features);
+        LearnedWarmStart::features(problem.state, problem.coeffs, params.ref_v, &features[features.size() - num_features]);
+        for (size_t i=0; i < num_inputs; i++)
+            inputs.push_back(x[indexes.delta_start + i]);
+        for (size_t i=0; i < num_inputs; i++)
+            inputs.push_back(x[indexes.v_start + i]);
+        num_samples++;
+    }
+    if (num_samples < num_features) {
+        std::fprintf(stderr, "Only %lu successful solves for %lu features\n", num_samples, num_features);
+        return 1;
+    }
+
+    // Ridge regression, one sample per column
+    Eigen::Map<const Eigen::MatrixXd> X(features.data(), num_features, num_samples);
+    Eigen::Map<const Eigen::MatrixXd> Y(inputs.data(), 2 * num_inputs, num_samples);
+    Eigen::MatrixXd gram = X * X.transpose();
+    gram.diagonal().array() += ridge * num_samples;
+    Eigen::MatrixXd weights = gram.ldlt().solve(X * Y.transpose()).transpose();
+    if (!LearnedWarmStart::write(weights_path, params, num_inputs, weights))
+        return 1;
+
+    Eigen::MatrixXd error = weights * X - Y;
+    std::printf("%lu solves, %lu features, %lu actuations\n", num_samples, num_features, 2 * num_inputs);
+    std::printf("RMS error of the first delta: %.4f [rad], of the first v: %.4f [m/s]\n",
+                std::sqrt(error.row(0).squaredNorm() / num_samples),
+                std::sqrt(error.row(num_inputs).squaredNorm() / num_samples));
+
+    // The same drive from either of the warm starts
+    MPC shifted(params);
+    params.warm_start_initializer = "learned";
+    params.warm_start_weights = weights_path;
+    MPC learned(params);
+    std::printf("mean iterations, shifted: %.1f, learned: %.1f\n",
+                mean_iterations(shifted, problems, params.ref_v), mean_iterations(learned, problems, params.ref_v));
+    std::printf("wrote %s\n", weights_path.c_str());
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include "mpc_node.h"
+
+
+// The controller node with the PID law steering on its own (see
+// `Params::controller`): the same inputs, pipeline of the path and
+// commands as mpc_node_cpp, without a solver
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "pid_node_cpp");
+
+    Params params;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    ros::NodeHandle private_nodehandle("~");
+    if (!parse_params(args, private_nodehandle, params))
+        return 1;
+    params.controller = "pid";
+
+    ros::NodeHandle nodehandle;
+    MPCControllerNode pid_node(nodehandle, private_nodehandle, params);
+
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+
+    pid_node.loop();
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Keeps the track store (see TrackStore) of the path of markers_node.py,
+// for the nodes that map it instead of receiving the path themselves
+// (`centerline_format: shared`):
+//
+//   rosrun mpc track_store_node [_track_store:=/dev/shm/mpc_track]
+//
+// Every new path of /centerline_numpy is prepared once (its grid and its
+// spline) and written to the store, then its hash is announced on the
+// latched /centerline_store, so that the nodes that start later read it
+// too.
+
+#include <memory>
+#include <string>
+
+#include <ros/ros.h>
+#include <std_msgs/UInt64.h>
+
+#include "InputMessages.h"
+#include "TrackStore.h"
+
+
+namespace {
+
+class TrackStoreNode {
+public:
+    TrackStoreNode(ros::NodeHandle & nodehandle, const std::string & path) : m_path(path), m_hash(0), m_num_points(0) {
+        m_pub_store = nodehandle.advertise<std_msgs::UInt64>("/centerline_store", 1, true);
+        m_sub_centerline = nodehandle.subscribe("/centerline_numpy", 1, &TrackStoreNode::centerline_numpy_cb, this);
+    }
+
+private:
+    void centerline_numpy_cb(const rospy_tutorials::Floats::ConstPtr & data) {
+        // Re-published as is most of the time
+        uint64_t hash = centerline_hash(*data);
+        size_t num_points = data->data.size() / CENTERLINE_NUMPY_COLUMNS;
+        if (hash == m_hash and num_points == m_num_points)
+            return;
+        std::shared_ptr<Centerline> centerline = make_centerline(*data, hash);
+        if (!centerline)
+            return;
+        // The grid and the spline only: the structures of the fit depend on
+        // the parameters of every controller
+        Params params;
+        params.precomputed_fit = false;
+        PathTracker::prepare_centerline(*centerline, params);
+        if (!TrackStore::write(m_path, *centerline))
+            return;
+
+        m_hash = hash;
+        m_num_points = num_points;
+        std_msgs::UInt64 announcement;
+        announcement.data = hash;
+        m_pub_store.publish(announcement);
+        ROS_INFO("New path in %s: %lu points", m_path.c_str(), num_points);
+    }
+
+    std::string m_path;
+    uint64_t m_hash;
+    size_t m_num_points;
+    ros::Publisher m_pub_store;
+    ros::Subscriber m_sub_centerline;
+};
+
+}
+
+
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "track_store_node");
+
+    ros::NodeHandle nodehandle;
+    ros::NodeHandle private_nodehandle("~");
+    std::string path = Params().track_store;
+    private_nodehandle.param("track_store", path, path);
+
+    TrackStoreNode node(nodehandle, path);
+    ros::spin();
+    return 0;
+}
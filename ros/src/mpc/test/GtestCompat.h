@@ -0,0 +1,11 @@
+#pragma once
+
+///* The macros of gtest 1.10 (Noetic's), which renamed the test cases to
+///* test suites and deprecates the old macros, for the older releases
+///* (Kinetic's, Melodic's), which only have those
+
+#include <gtest/gtest.h>
+
+#ifndef INSTANTIATE_TEST_SUITE_P
+#define INSTANTIATE_TEST_SUITE_P INSTANTIATE_TEST_CASE_P
+#endif
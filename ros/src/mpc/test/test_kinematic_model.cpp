@@ -0,0 +1,179 @@
+// The closed-form values and derivatives of KinematicModel against those of
+// the tape of FG_eval (CppAD), on random states and actuations
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "FG_eval.h"
+#include "GtestCompat.h"
+#include "KinematicModel.h"
+#include "OfflineTools.h"
+
+
+// The draws of a test
+static const int NUM_DRAWS = 20;
+
+// The relative tolerance of the comparisons
+static const double TOLERANCE = 1e-9;
+
+
+// Same layout of the variables as in MPC::MPC, with the kinematic model
+static Indexes kinematic_indexes(const Params & params) {
+    Indexes indexes;
+    indexes.x_start = 0;
+    indexes.y_start = indexes.x_start + params.steps_ahead;
+    indexes.psi_start = indexes.y_start + params.steps_ahead;
+    indexes.cte_start = indexes.psi_start + params.steps_ahead;
+    indexes.epsi_start = indexes.cte_start + params.steps_ahead;
+    indexes.extra_start = indexes.epsi_start + params.steps_ahead;
+    indexes.steps_ahead = params.steps_ahead;
+    indexes.delta_start = indexes.extra_start;
+    indexes.v_start = indexes.delta_start + params.steps_ahead - 1;
+    return indexes;
+}
+
+
+static void expect_near(double expected, double actual, const char * what, size_t i) {
+    EXPECT_NEAR(expected, actual, TOLERANCE * std::max(1.0, std::abs(expected))) << what << " " << i;
+}
+
+
+// The model and the tape of FG_eval for the same problem: a random
+// polynomial, reference speed and variables
+class KinematicModelTest : public ::testing::TestWithParam<bool> {
+protected:
+    void SetUp() override {
+        m_params = default_params();
+        m_params.steps_ahead = 10;
+        m_params.poly_degree = 3;
+        m_params.autodiff_stages = GetParam();
+        m_indexes = kinematic_indexes(m_params);
+        m_n = m_params.steps_ahead * 5 + (m_params.steps_ahead - 1) * 2;
+        m_m = m_params.steps_ahead * 5;
+        m_random.seed(42);
+    }
+
+    // A new draw of the problem, taped
+    void draw() {
+        std::uniform_real_distribution<double> unit(-1.0, 1.0);
+        m_coeffs.resize(m_params.poly_degree + 1);
+        for (int k=0; k < m_coeffs.size(); k++)
+            m_coeffs[k] = unit(m_random) * std::pow(0.3, k);
+        m_ref_v = 3.0 + unit(m_random);
+
+        size_t N = m_params.steps_ahead;
+        m_x.resize(m_n);
+        for (size_t t=0; t < N; t++) {
+            m_x[m_indexes.x_start + t] = 0.2 * t + 0.1 * unit(m_random);
+            m_x[m_indexes.y_start + t] = 0.5 * unit(m_random);
+            m_x[m_indexes.psi_start + t] = 0.3 * unit(m_random);
+            m_x[m_indexes.cte_start + t] = 0.5 * unit(m_random);
+            m_x[m_indexes.epsi_start + t] = 0.3 * unit(m_random);
+        }
+        for (size_t t=0; t < N - 1; t++) {
+            m_x[m_indexes.delta(t)] = 0.4 * unit(m_random);
+            m_x[m_indexes.v(t)] = 3.0 + 2.0 * unit(m_random);
+        }
+
+        m_model.reset(new KinematicModel(m_params, m_indexes));
+        m_model->set_problem(m_coeffs, m_ref_v);
+
+        FG_eval fg_eval(m_coeffs, m_params, m_indexes, m_ref_v);
+        FG_eval::ADvector a_vars(m_n), a_fg(1 + m_m);
+        for (size_t i=0; i < m_n; i++)
+            a_vars[i] = m_x[i];
+        CppAD::Independent(a_vars);
+        fg_eval(a_fg, a_vars);
+        m_tape.Dependent(a_vars, a_fg);
+    }
+
+    Params m_params;
+    Indexes m_indexes;
+    size_t m_n;
+    size_t m_m;
+    std::mt19937 m_random;
+
+    Eigen::VectorXd m_coeffs;
+    double m_ref_v;
+    std::vector<double> m_x;
+    std::unique_ptr<KinematicModel> m_model;
+    CppAD::ADFun<double> m_tape;
+};
+
+
+TEST_P(KinematicModelTest, ValuesMatchTheTape) {
+    for (int d=0; d < NUM_DRAWS; d++) {
+        draw();
+        std::vector<double> fg = m_tape.Forward(0, m_x);
+        expect_near(fg[0], m_model->cost(m_x.data()), "cost", 0);
+
+        std::vector<double> g(m_m);
+        m_model->constraints(m_x.data(), g.data());
+        for (size_t i=0; i < m_m; i++)
+            expect_near(fg[1 + i], g[i], "constraint", i);
+    }
+}
+
+
+TEST_P(KinematicModelTest, JacobianMatchesTheTape) {
+    for (int d=0; d < NUM_DRAWS; d++) {
+        draw();
+        // Dense, row by row: the cost's gradient, then the constraints'
+        std::vector<double> jac = m_tape.Jacobian(m_x);
+
+        std::vector<double> grad(m_n);
+        m_model->gradient(m_x.data(), grad.data());
+        for (size_t j=0; j < m_n; j++)
+            expect_near(jac[j], grad[j], "gradient", j);
+
+        // Every entry of the pattern, and nothing outside of it
+        const std::vector<size_t> & rows = m_model->jac_row();
+        const std::vector<size_t> & cols = m_model->jac_col();
+        std::vector<double> values(rows.size());
+        m_model->jacobian(m_x.data(), values.data());
+        std::vector<double> dense(m_m * m_n, 0.0);
+        for (size_t k=0; k < rows.size(); k++)
+            dense[rows[k] * m_n + cols[k]] += values[k];
+        for (size_t k=0; k < m_m * m_n; k++)
+            expect_near(jac[m_n + k], dense[k], "jacobian", k);
+    }
+}
+
+
+TEST_P(KinematicModelTest, HessianMatchesTheTape) {
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    for (int d=0; d < NUM_DRAWS; d++) {
+        draw();
+        // The Lagrangian obj_factor * cost + lambda . g
+        std::vector<double> w(1 + m_m);
+        w[0] = 0.5 + 0.5 * unit(m_random);
+        for (size_t i=0; i < m_m; i++)
+            w[1 + i] = 10.0 * unit(m_random);
+        std::vector<double> hes = m_tape.Hessian(m_x, w);
+
+        const std::vector<size_t> & rows = m_model->hes_row();
+        const std::vector<size_t> & cols = m_model->hes_col();
+        std::vector<double> values(rows.size());
+        m_model->hessian(m_x.data(), w[0], &w[1], values.data());
+        std::vector<double> lower(m_n * m_n, 0.0);
+        for (size_t k=0; k < rows.size(); k++) {
+            ASSERT_GE(rows[k], cols[k]);
+            lower[rows[k] * m_n + cols[k]] += values[k];
+        }
+        for (size_t r=0; r < m_n; r++)
+            for (size_t c=0; c <= r; c++)
+                expect_near(hes[r * m_n + c], lower[r * m_n + c], "hessian", r * m_n + c);
+    }
+}
+
+
+// The closed forms, and the steps on Eigen's AutoDiff (`Params::autodiff_stages`)
+INSTANTIATE_TEST_SUITE_P(Derivatives, KinematicModelTest, ::testing::Values(false, true));
+
+
+int main(int argc, char ** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
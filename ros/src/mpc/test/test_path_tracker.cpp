@@ -0,0 +1,247 @@
+// The path tracking of PathTracker: the closest waypoint as the car drives
+// across the wrap-around of a closed path, jumps and gets a new path, the
+// window about a closest waypoint near the start of the path, and the fit
+// of a known polynomial
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "GtestCompat.h"
+#include "OfflineTools.h"
+#include "PathTracker.h"
+
+
+// The circle of the closed paths
+static const int NUM_POINTS = 400;
+static const double RADIUS = 5.0; // [m]
+
+// The car drives this far outside of the circle
+static const double OFFSET = 0.05; // [m]
+
+// The tolerance of the points of the window [m] and of the coefficients
+// of the fit
+static const double TOLERANCE = 1e-9;
+static const double FIT_TOLERANCE = 1e-6;
+
+
+// The circle of RADIUS about the origin, counterclockwise from the angle
+// of `first` waypoints, prepared for `params`
+static Centerline make_circle(const Params & params, int num_points, int first, uint64_t hash) {
+    Centerline centerline;
+    centerline.hash = hash;
+    for (int i=0; i < num_points; i++) {
+        double angle = 2.0 * M_PI * (first + i) / num_points;
+        centerline.pts_x.push_back(RADIUS * cos(angle));
+        centerline.pts_y.push_back(RADIUS * sin(angle));
+    }
+    PathTracker::prepare_centerline(centerline, params);
+    return centerline;
+}
+
+
+// The waypoint closest to (x, y), of all of them
+static int brute_force_closest(const Centerline & centerline, double x, double y) {
+    int closest = -1;
+    double closest_dist = std::numeric_limits<double>::max();
+    for (size_t i=0; i < centerline.pts_x.size(); i++) {
+        double dist = std::hypot(centerline.pts_x[i] - x, centerline.pts_y[i] - y);
+        if (dist < closest_dist) {
+            closest = int(i);
+            closest_dist = dist;
+        }
+    }
+    return closest;
+}
+
+
+// The pose just outside of the circle at the angle of `position` waypoints
+// (of NUM_POINTS), heading along it
+static void circle_pose(double position, double & x, double & y, double & psi) {
+    double angle = 2.0 * M_PI * position / NUM_POINTS;
+    x = (RADIUS + OFFSET) * cos(angle);
+    y = (RADIUS + OFFSET) * sin(angle);
+    psi = angle + M_PI / 2;
+}
+
+
+// The tracking of the closest waypoint by a search about the previous one:
+// in the doubles, in the fixed point waypoints, and projected onto the
+// segments
+class TrackedClosestTest : public ::testing::TestWithParam<const char *> {
+protected:
+    void SetUp() override {
+        m_params = default_params();
+        m_params.windowed_closest = true;
+        std::string variant = GetParam();
+        m_params.compact_waypoints = (variant == "compact");
+        m_params.projected_closest = (variant == "projected");
+    }
+
+    Params m_params;
+    TelemetryRecord m_record;
+};
+
+
+TEST_P(TrackedClosestTest, AcrossTheWrapAround) {
+    Centerline centerline = make_circle(m_params, NUM_POINTS, 0, 1);
+    PathTracker tracker(m_params);
+
+    // Two laps, a third of a waypoint past each one
+    for (int tick=0; tick < 2 * NUM_POINTS; tick++) {
+        double x, y, psi;
+        circle_pose(NUM_POINTS - 20 + tick + 0.3, x, y, psi);
+        int closest = tracker.closest_waypoint(centerline, x, y, m_record);
+        ASSERT_EQ(brute_force_closest(centerline, x, y), closest) << "tick " << tick;
+    }
+
+    // ... and back over the start
+    for (int tick=0; tick < 40; tick++) {
+        double x, y, psi;
+        circle_pose(20 - tick + 0.3, x, y, psi);
+        int closest = tracker.closest_waypoint(centerline, x, y, m_record);
+        ASSERT_EQ(brute_force_closest(centerline, x, y), closest) << "tick " << tick;
+    }
+}
+
+
+TEST_P(TrackedClosestTest, OnARelocalisationJump) {
+    Centerline centerline = make_circle(m_params, NUM_POINTS, 0, 1);
+    PathTracker tracker(m_params);
+    double x, y, psi;
+    circle_pose(10.3, x, y, psi);
+    EXPECT_EQ(10, tracker.closest_waypoint(centerline, x, y, m_record));
+
+    // Across the circle, and back next to the window but further than the
+    // track is kept
+    const double jumps[] = {210.3, 70.3, 69.3, 399.3};
+    for (double position : jumps) {
+        circle_pose(position, x, y, psi);
+        int closest = tracker.closest_waypoint(centerline, x, y, m_record);
+        EXPECT_EQ(brute_force_closest(centerline, x, y), closest) << "at " << position;
+    }
+
+    // Off the path, and onto it again
+    EXPECT_EQ(brute_force_closest(centerline, 2.0, 0.3), tracker.closest_waypoint(centerline, 2.0, 0.3, m_record));
+    circle_pose(123.3, x, y, psi);
+    EXPECT_EQ(123, tracker.closest_waypoint(centerline, x, y, m_record));
+}
+
+
+TEST_P(TrackedClosestTest, OnANewPath) {
+    Centerline centerline = make_circle(m_params, NUM_POINTS, 0, 1);
+    PathTracker tracker(m_params);
+    double x, y, psi;
+    circle_pose(100.3, x, y, psi);
+    EXPECT_EQ(100, tracker.closest_waypoint(centerline, x, y, m_record));
+
+    // Where the last one was: the same circle from another angle, then with
+    // fewer waypoints (fewer than the tracked index)
+    centerline = make_circle(m_params, NUM_POINTS, 30, 2);
+    EXPECT_EQ(brute_force_closest(centerline, x, y), tracker.closest_waypoint(centerline, x, y, m_record));
+    EXPECT_EQ(70, tracker.closest_waypoint(centerline, x, y, m_record));
+
+    circle_pose(300.3, x, y, psi);
+    EXPECT_EQ(270, tracker.closest_waypoint(centerline, x, y, m_record));
+    centerline = make_circle(m_params, NUM_POINTS / 2, 0, 3);
+    EXPECT_EQ(brute_force_closest(centerline, x, y), tracker.closest_waypoint(centerline, x, y, m_record));
+
+    // A patched path is new as well
+    centerline.version = 1;
+    EXPECT_EQ(brute_force_closest(centerline, x, y), tracker.closest_waypoint(centerline, x, y, m_record));
+}
+
+
+INSTANTIATE_TEST_SUITE_P(Tracking, TrackedClosestTest, ::testing::Values("doubles", "compact", "projected"));
+
+
+// The window about a closest waypoint fewer than NUM_STEPS_BACK from the
+// start of a closed path: the waypoints from the end of the path on, from
+// the padding of the ring or around the path without it
+class WindowTest : public ::testing::TestWithParam<int> {};
+
+
+TEST_P(WindowTest, WrapsAroundTheStart) {
+    Params params = default_params();
+    params.ring_margin = GetParam();
+    Centerline centerline = make_circle(params, NUM_POINTS, 0, 1);
+    PathTracker tracker(params);
+    TelemetryRecord record;
+
+    for (int closest=0; closest < 5; closest++) {
+        double x, y, psi;
+        circle_pose(closest, x, y, psi);
+        EXPECT_EQ(1.0, tracker.make_window(centerline, closest, x, y, psi, record));
+
+        const WaypointBuffer & car_pts = tracker.car_pts();
+        ASSERT_EQ(size_t(params.num_steps_poly), size_t(car_pts.x.size()));
+        for (int i=0; i < params.num_steps_poly; i++) {
+            int idx = ((closest - 5 + i) % NUM_POINTS + NUM_POINTS) % NUM_POINTS;
+            double dx = centerline.pts_x[idx] - x;
+            double dy = centerline.pts_y[idx] - y;
+            EXPECT_NEAR(dx * cos(psi) + dy * sin(psi), car_pts.x[i], TOLERANCE) << closest << " " << i;
+            EXPECT_NEAR(-dx * sin(psi) + dy * cos(psi), car_pts.y[i], TOLERANCE) << closest << " " << i;
+        }
+    }
+}
+
+
+// The ring of the widest window, of 10 waypoints, and none
+INSTANTIATE_TEST_SUITE_P(Ring, WindowTest, ::testing::Values(0, 10, -1));
+
+
+// The fit of the waypoints of a known polynomial: from scratch, from the
+// precomputed moments, incrementally, and fused with the window
+class FitTest : public ::testing::TestWithParam<const char *> {};
+
+
+TEST_P(FitTest, RecoversAKnownPolynomial) {
+    Params params = default_params();
+    params.poly_degree = 3;
+    std::string variant = GetParam();
+    params.precomputed_fit = (variant == "precomputed");
+    params.incremental_fit = (variant == "incremental");
+    params.fused_fit = (variant == "fused");
+    const double known[] = {0.2, 0.1, 0.05, -0.002};
+
+    // An open path along it, every 0.1 m of x from -5 m
+    Centerline centerline;
+    centerline.hash = 1;
+    for (int i=0; i < 300; i++) {
+        double x = -5.0 + 0.1 * i;
+        centerline.pts_x.push_back(x);
+        centerline.pts_y.push_back(known[0] + known[1] * x + known[2] * x * x + known[3] * x * x * x);
+    }
+    PathTracker::prepare_centerline(centerline, params);
+    PathTracker tracker(params);
+    TelemetryRecord record;
+
+    // The car on the path heading along x, from x = 0 on: the same
+    // polynomial, about the car
+    Eigen::VectorXd coeffs;
+    for (int tick=0; tick < 10; tick++) {
+        double x = 0.1 * tick, psi = 0.0;
+        double y = known[0] + known[1] * x + known[2] * x * x + known[3] * x * x * x;
+        int closest = tracker.closest_waypoint(centerline, x, y, record);
+        EXPECT_EQ(50 + tick, closest);
+        EXPECT_EQ(1.0, tracker.make_window(centerline, closest, x, y, psi, record));
+        tracker.fit(centerline, x, y, psi, coeffs);
+
+        // y(x + u) - y(x), in u
+        ASSERT_EQ(4, coeffs.size());
+        EXPECT_NEAR(0.0, coeffs[0], FIT_TOLERANCE);
+        EXPECT_NEAR(known[1] + 2 * known[2] * x + 3 * known[3] * x * x, coeffs[1], FIT_TOLERANCE);
+        EXPECT_NEAR(known[2] + 3 * known[3] * x, coeffs[2], FIT_TOLERANCE);
+        EXPECT_NEAR(known[3], coeffs[3], FIT_TOLERANCE);
+    }
+}
+
+
+INSTANTIATE_TEST_SUITE_P(Fits, FitTest, ::testing::Values("polyfit", "precomputed", "incremental", "fused"));
+
+
+int main(int argc, char ** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
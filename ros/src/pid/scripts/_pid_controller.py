@@ -24,6 +24,11 @@ class Storage:
 
 
 class PIDController:
+    # The closest waypoint is searched for this many waypoints either side
+    # of the previous one, and the fit starts this many before it
+    CLOSEST_WINDOW = 20
+    FIT_BACK = 5
+
     def __init__(
         self,
         debug,
@@ -56,24 +61,96 @@ class PIDController:
 
         self.next_pos = None
 
+        # The tracking of the closest waypoint: the path it's on (and its
+        # points as float64, which /centerline_numpy's aren't), and the
+        # previous one (None to search the whole path)
+        self._tracked_pts = None
+        self._path = None
+        self._prev_closest = None
+
+        # Preallocated, so that a tick only allocates the fit's small solve:
+        # the offsets and the indexes of the search window and of the
+        # waypoints of the fit, their points (in the car's frame for the
+        # fit), and the Vandermonde matrix and normal equations of the fit
+        num_window = 2 * self.CLOSEST_WINDOW + 1
+        num_fit = self.poly_steps + 1
+        self._window_offsets = np.arange(-self.CLOSEST_WINDOW, self.CLOSEST_WINDOW + 1)
+        self._window_indexes = np.zeros(num_window, dtype=np.intp)
+        self._window_pts = np.zeros((num_window, 2))
+        self._window_dists = np.zeros(num_window)
+        self._fit_offsets = np.arange(num_fit) - self.FIT_BACK
+        self._fit_indexes = np.zeros(num_fit, dtype=np.intp)
+        self._fit_pts = np.zeros((num_fit, 2))
+        self._fit_tmp = np.zeros((2, num_fit))
+        self._vander = np.zeros((num_fit, self.poly_degree + 1))
+        self._gram = np.zeros((self.poly_degree + 1, self.poly_degree + 1))
+        self._rhs = np.zeros(self.poly_degree + 1)
+        self._col_scale = np.zeros(self.poly_degree + 1)
+
     def _find_closest(self, pts_2D, position):
         dists = np.linalg.norm(pts_2D - position, axis=1)
         return np.argmin(dists), dists
 
+    def _find_closest_tracked(self, pts_2D, position):
+        '''The closest waypoint, searched for around the previous one on the
+        same path; the whole path is searched when it's new, or when the
+        closest of the window is at its edge (the car moved past it, or
+        jumped)'''
+        num_pts = pts_2D.shape[0]
+        if pts_2D is self._tracked_pts and self._prev_closest is not None \
+                and num_pts > self._window_indexes.shape[0]:
+            indexes = self._window_indexes
+            np.add(self._window_offsets, self._prev_closest, out=indexes)
+            np.remainder(indexes, num_pts, out=indexes)
+            window = self._window_pts
+            np.take(self._path, indexes, axis=0, out=window)
+            np.subtract(window, position, out=window)
+            np.multiply(window, window, out=window)
+            np.sum(window, axis=1, out=self._window_dists)
+            best = int(np.argmin(self._window_dists))
+            if 0 < best < indexes.shape[0] - 1:
+                self._prev_closest = int(indexes[best])
+                return self._prev_closest
+
+        if pts_2D is not self._tracked_pts:
+            self._tracked_pts = pts_2D
+            self._path = np.asarray(pts_2D, dtype=np.float64)
+        closest, _ = self._find_closest(self._path, position)
+        self._prev_closest = int(closest)
+        return self._prev_closest
+
+    def _fit(self, x, y):
+        '''The coefficients (highest degree first, as np.polyfit's) of the
+        least squares polynomial of `poly_degree` through (x, y), by its
+        normal equations, with the columns scaled as np.polyfit does'''
+        vander = self._vander
+        vander[:, -1] = 1.0
+        for k in range(self.poly_degree - 1, -1, -1):
+            np.multiply(vander[:, k + 1], x, out=vander[:, k])
+        np.einsum('ij,ij->j', vander, vander, out=self._col_scale)
+        np.sqrt(self._col_scale, out=self._col_scale)
+        np.maximum(self._col_scale, np.finfo(float).tiny, out=self._col_scale)
+        np.divide(vander, self._col_scale, out=vander)
+        np.dot(vander.T, vander, out=self._gram)
+        np.dot(vander.T, y, out=self._rhs)
+        return np.linalg.solve(self._gram, self._rhs) / self._col_scale
+
     def control(self, pts_2D, v, position, psi):
-        which_closest, _ = self._find_closest(pts_2D, position)
+        which_closest = self._find_closest_tracked(pts_2D, position)
 
-        which_closest_shifted = which_closest - 5
-        # NOTE: `which_closest_shifted` might become < 0, but the modulo operation below fixes that
-        indeces = which_closest_shifted + np.arange(self.poly_steps+1)
-        indeces = indeces % pts_2D.shape[0]
-        pts = pts_2D[indeces]
+        # NOTE: the indexes might go < 0, but the modulo operation fixes that
+        indeces = self._fit_indexes
+        np.add(self._fit_offsets, which_closest, out=indeces)
+        np.remainder(indeces, pts_2D.shape[0], out=indeces)
+        pts_car = self._fit_pts
+        np.take(self._path, indeces, axis=0, out=pts_car)
 
         cos_psi = np.cos(psi)
         sin_psi = np.sin(psi)
-        pts_car = PIDController.transform_into_cars_coordinate_system(pts, position, cos_psi, sin_psi)
+        PIDController.transform_into_cars_coordinate_system_in_place(pts_car, position, cos_psi, sin_psi,
+                                                                     self._fit_tmp)
 
-        poly = np.polyfit(pts_car[:, 0], pts_car[:, 1], self.poly_degree)
+        poly = self._fit(pts_car[:, 0], pts_car[:, 1])
 
         cte = poly[-1]
         ePsi = -np.arctan(poly[-2])
@@ -109,3 +186,17 @@ class PIDController:
         pts_car[:, 0] =  cos_psi * diff[:, 0] + sin_psi * diff[:, 1]
         pts_car[:, 1] = -sin_psi * diff[:, 0] + cos_psi * diff[:, 1]
         return pts_car
+
+    @staticmethod
+    def transform_into_cars_coordinate_system_in_place(pts, position, cos_psi, sin_psi, tmp):
+        '''As `transform_into_cars_coordinate_system`, into `pts` itself,
+        with `tmp` (two columns' worth) to work in'''
+        pts -= position
+        x = pts[:, 0]
+        y = pts[:, 1]
+        np.multiply(x, -sin_psi, out=tmp[0])
+        np.multiply(y, sin_psi, out=tmp[1])
+        x *= cos_psi
+        x += tmp[1]
+        y *= cos_psi
+        y += tmp[0]
@@ -1,5 +1,7 @@
 #!/usr/bin/env python
+import mmap
 import numpy as np
+import struct
 import sys
 from scipy.linalg import expm
 
@@ -13,7 +15,7 @@ from tf.transformations import (
 )
 
 # Message types
-from std_msgs.msg import Float32, Time, UInt16
+from std_msgs.msg import Float32, Time, UInt16, UInt64
 from nav_msgs.msg import Odometry
 from visualization_msgs.msg import Marker
 from geometry_msgs.msg import Point
@@ -24,6 +26,36 @@ from _pid_controller import PIDController
 CENTER_IN_DZIK = 0.56
 
 
+# The layout of TrackStoreHeader (see src/TrackStore.h in the mpc package):
+# the fields up to the sections, then (offset, count) of every array
+TRACK_STORE_MAGIC = b'MPCTRK1\0'
+TRACK_STORE_VERSION = 1
+TRACK_STORE_FIELDS = struct.Struct('=8sIIQQ')
+TRACK_STORE_SECTIONS_OFFSET = 72
+TRACK_STORE_SECTION = struct.Struct('=QQ')
+TRACK_STORE_PTS_X, TRACK_STORE_PTS_Y = 0, 1
+
+
+def read_track_store(path, expected_hash):
+    '''The (x, y) waypoints of the track store of track_store_node, mapped
+    rather than received; None if it's not the path of `expected_hash`
+    (replaced by a newer one since it was announced)'''
+    with open(path, 'rb') as f:
+        mapping = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, version, _, path_hash, _ = TRACK_STORE_FIELDS.unpack_from(mapping, 0)
+    if magic != TRACK_STORE_MAGIC or version != TRACK_STORE_VERSION:
+        rospy.logerr('{} is not a track store'.format(path))
+        return None
+    if path_hash != expected_hash:
+        return None
+    columns = []
+    for section in (TRACK_STORE_PTS_X, TRACK_STORE_PTS_Y):
+        offset, count = TRACK_STORE_SECTION.unpack_from(
+            mapping, TRACK_STORE_SECTIONS_OFFSET + section * TRACK_STORE_SECTION.size)
+        columns.append(np.frombuffer(mapping, dtype=np.float64, count=count, offset=offset))
+    return np.column_stack(columns)
+
+
 class PIDControllerNode:
     def __init__(self, debug, pid_controller, common_queue_size=None, which_speed='VESC'):
         self.debug = debug
@@ -99,6 +131,19 @@ class PIDControllerNode:
 
         rospy.init_node('~pid_node_python')
 
+        # ~track_store: the path is mapped from the track store of
+        # track_store_node whenever /centerline_store announces a new one,
+        # instead of received on /centerline_numpy
+        self.track_store = rospy.get_param('~track_store', '')
+        if self.track_store:
+            self.subscribers.pop('/centerline_numpy').unregister()
+            self.subscribers['/centerline_store'] = rospy.Subscriber(
+                '/centerline_store',
+                UInt64,
+                self.centerline_store_cb,
+                queue_size=queue_size,
+            )
+
         self.loop()
 
     def loop(self):
@@ -213,6 +258,15 @@ class PIDControllerNode:
         #  the first two
         self.points = data.data.reshape(-1, 4)[:, :2]  # TODO: magic number 4
 
+    def centerline_store_cb(self, data):
+        try:
+            points = read_track_store(self.track_store, data.data)
+        except (IOError, ValueError, struct.error) as e:
+            rospy.logwarn('Could not read the track store {}: {}'.format(self.track_store, e))
+            return
+        if points is not None:
+            self.points = points
+
     def pf_pose_odom_cb(self, data):
         position = data.pose.pose.position
         self.position = np.array([position.x, position.y])
@@ -0,0 +1,217 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp_components/register_node_macro.hpp>
+#include <std_msgs/msg/u_int16.hpp>
+
+#include "mpc_ros2/msg/car_pose.hpp"
+#include "mpc_ros2/msg/car_speed.hpp"
+#include "mpc_ros2/msg/drive_commands.hpp"
+
+#include "ControlPipeline.h"
+#include "TripleBuffer.h"
+#include "WaypointLoader.h"
+#include "mpc_core.h"
+
+
+namespace mpc_ros2 {
+
+///* MPCControllerNode as a ROS 2 component (mpc_ros2::MPCComponent), to be
+///* composed into the process of the localization and of the driver. The
+///* pose, the speed and the commands are fixed-size messages, which go
+///* through the intra-process transport as unique pointers, and are loaned
+///* from the middleware when it can (e.g. shared memory), so that none of
+///* them is serialized on the way.
+///*
+///* The parameters are those of mpc_node_cpp (the fields of Params, see
+///* mpc_core.h), the lists as comma-separated strings. The path comes from
+///* `waypoints_csv`. The callbacks are served one at a time, the solver loop
+///* (ControlPipeline) runs on a thread of its own, at `loop_rate`.
+class MPCComponent : public rclcpp::Node {
+public:
+    explicit MPCComponent(const rclcpp::NodeOptions & options)
+            : rclcpp::Node("mpc", rclcpp::NodeOptions(options).use_intra_process_comms(true)),
+              m_params(declare_params()), m_pipeline(m_params) {
+        Waypoints waypoints;
+        if (m_params.waypoints_csv.empty()
+                or !load_waypoints(m_params.waypoints_csv, m_params.waypoints_spacing, waypoints)) {
+            RCLCPP_ERROR(get_logger(), "No waypoints (see waypoints_csv), the MPC controller is not running");
+            return;
+        }
+        std::shared_ptr<Centerline> centerline = std::make_shared<Centerline>();
+        centerline->pts_x = std::move(waypoints.x);
+        centerline->pts_y = std::move(waypoints.y);
+        centerline->yaw = std::move(waypoints.yaw);
+        centerline->speed = std::move(waypoints.speed);
+        ControlPipeline::prepare_centerline(*centerline, m_params);
+        m_inputs.centerline = centerline;
+
+        m_pub_commands = create_publisher<msg::DriveCommands>("commands", 1);
+
+        rclcpp::SubscriptionOptions subscription_options;
+        subscription_options.callback_group = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+        m_sub_pose = create_subscription<msg::CarPose>(
+                "pose", 1, [this](msg::CarPose::ConstSharedPtr msg) { pose_cb(*msg); }, subscription_options);
+        m_sub_speed = create_subscription<msg::CarSpeed>(
+                "speed", 1, [this](msg::CarSpeed::ConstSharedPtr msg) { speed_cb(*msg); }, subscription_options);
+        m_sub_go = create_subscription<std_msgs::msg::UInt16>(
+                "signal/go", 1, [this](std_msgs::msg::UInt16::ConstSharedPtr msg) { go_cb(*msg); },
+                subscription_options);
+
+        m_running = true;
+        m_loop_thread = std::thread(&MPCComponent::loop, this);
+    }
+
+    ~MPCComponent() override {
+        m_running = false;
+        if (m_loop_thread.joinable())
+            m_loop_thread.join();
+    }
+
+private:
+    ///* Declares a parameter for every field of Params, with its default,
+    ///* and returns the Params they're set to
+    Params declare_params() {
+        std::unique_ptr<MpcParams, void (*)(MpcParams *)> params(mpc_params_new(), mpc_params_free);
+        for (size_t i = 0; mpc_params_name(i) != nullptr; i++) {
+            const char * name = mpc_params_name(i);
+            std::string type = mpc_params_type(name);
+            std::string text(size_t(mpc_params_get(params.get(), name, nullptr, 0)) + 1, '\0');
+            mpc_params_get(params.get(), name, &text[0], text.size());
+            text.resize(text.size() - 1);
+
+            std::ostringstream value;
+            value << std::setprecision(17);
+            if (type == "double")
+                value << declare_parameter<double>(name, std::stod(text));
+            else if (type == "int")
+                value << declare_parameter<int64_t>(name, std::stoll(text));
+            else if (type == "bool")
+                value << (declare_parameter<bool>(name, text == "true") ? "true" : "false");
+            else
+                value << declare_parameter<std::string>(name, text);
+            if (mpc_params_set(params.get(), name, value.str().c_str()) != 0)
+                RCLCPP_WARN(get_logger(), "%s, ignoring it", mpc_last_error());
+        }
+        return mpc_params_cpp(params.get());
+    }
+
+    void pose_cb(const msg::CarPose & msg) {
+        double stamp = rclcpp::Time(msg.stamp).seconds();
+        m_inputs.pos_x = msg.x;
+        m_inputs.pos_y = msg.y;
+        m_inputs.pos_OK = true;
+        m_inputs.psi = msg.psi;
+        m_inputs.psi_OK = true;
+        m_inputs.pose_stamp = stamp;
+        m_inputs.history.add_pose(stamp, msg.x, msg.y, msg.psi);
+        publish_inputs();
+    }
+
+    void speed_cb(const msg::CarSpeed & msg) {
+        double stamp = rclcpp::Time(msg.stamp).seconds();
+        m_inputs.speed = msg.speed;
+        m_inputs.speed_OK = true;
+        m_inputs.odom_stamp = stamp;
+        m_inputs.history.add_speed(stamp, msg.speed);
+        publish_inputs();
+    }
+
+    ///* As /signal/go of the ROS 1 node: 0 stops the car, 2309 lets it go
+    void go_cb(const std_msgs::msg::UInt16 & msg) {
+        if (msg.data == 0) {
+            RCLCPP_WARN(get_logger(), "Emergency stop!");
+            m_inputs.go_flag = false;
+        } else if (msg.data == 2309) {
+            RCLCPP_WARN(get_logger(), "GO!");
+            m_inputs.go_flag = true;
+        }
+        publish_inputs();
+    }
+
+    void publish_inputs() {
+        m_input_buffer.back() = m_inputs;
+        m_input_buffer.publish();
+    }
+
+    void loop() {
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / m_params.loop_rate));
+        auto next = std::chrono::steady_clock::now();
+        while (m_running and rclcpp::ok()) {
+            next += period;
+            std::this_thread::sleep_until(next);
+
+            // Always start from the freshest inputs, and don't solve the same
+            // problem twice
+            auto tick_start = std::chrono::steady_clock::now();
+            if (!m_input_buffer.update())
+                continue;
+            const InputSnapshot & inputs = m_input_buffer.front();
+
+            double time = now().seconds();
+            TelemetryRecord record;
+            record.stamp = time;
+            if (m_pipeline.step(inputs, time, tick_start, record))
+                publish_commands(inputs, record);
+        }
+    }
+
+    void publish_commands(const InputSnapshot & inputs, const TelemetryRecord & record) {
+        if (m_pub_commands->can_loan_messages()) {
+            rclcpp::LoanedMessage<msg::DriveCommands> commands = m_pub_commands->borrow_loaned_message();
+            fill_commands(inputs, record, commands.get());
+            m_pub_commands->publish(std::move(commands));
+        } else {
+            // Handed over to the subscribers of the process as it is
+            std::unique_ptr<msg::DriveCommands> commands(new msg::DriveCommands);
+            fill_commands(inputs, record, *commands);
+            m_pub_commands->publish(std::move(commands));
+        }
+    }
+
+    void fill_commands(const InputSnapshot & inputs, const TelemetryRecord & record, msg::DriveCommands & commands) {
+        commands.stamp = now();
+        commands.steer = m_pipeline.steer_cmd();
+        commands.rpm = m_pipeline.rpm();
+        commands.pose_stamp = rclcpp::Time(int64_t(inputs.pose_stamp * 1e9));
+        commands.events = record.events;
+        if (!inputs.go_flag)
+            commands.status = msg::DriveCommands::STATUS_STOPPED;
+        else if (record.events & TelemetryRecord::FALLBACK)
+            commands.status = msg::DriveCommands::STATUS_FALLBACK;
+        else if (record.events & TelemetryRecord::DEADLINE_HIT)
+            commands.status = msg::DriveCommands::STATUS_DEADLINE_HIT;
+        else
+            commands.status = msg::DriveCommands::STATUS_OK;
+    }
+
+    Params m_params;
+    ControlPipeline m_pipeline;
+
+    ///* The inputs as the callbacks update them, and as they hand them over
+    ///* to the solver loop
+    InputSnapshot m_inputs;
+    TripleBuffer<InputSnapshot> m_input_buffer;
+
+    rclcpp::Publisher<msg::DriveCommands>::SharedPtr m_pub_commands;
+    rclcpp::Subscription<msg::CarPose>::SharedPtr m_sub_pose;
+    rclcpp::Subscription<msg::CarSpeed>::SharedPtr m_sub_speed;
+    rclcpp::Subscription<std_msgs::msg::UInt16>::SharedPtr m_sub_go;
+
+    std::atomic<bool> m_running{false};
+    std::thread m_loop_thread;
+};
+
+}
+
+
+RCLCPP_COMPONENTS_REGISTER_NODE(mpc_ros2::MPCComponent)